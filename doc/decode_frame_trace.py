@@ -0,0 +1,171 @@
+#!/usr/bin/env python
+#
+# Decodes the frame trace file written by ODR-DabMod when
+# log.frame_trace_file is set, and the capture file of log.frame_capture_file,
+# see src/FrameTracer.h for the format.
+#
+# Prints one line per record, oldest first:
+#   time, thread, event, name, fct, value
+# The trace file can be decoded while the modulator runs, the capture file
+# once frametrace capture_state is done.
+#
+# LICENSE: see bottom of file
+
+import argparse
+import datetime
+import os
+import struct
+import sys
+
+HEADER_SIZE = 4096
+HEADER_FORMAT = "=8sIIQQqII"
+RECORD_FORMAT = "=QQQiBBH"
+MAX_NAMES = 64
+NAME_SIZE = 56
+
+EVENTS = {
+    1: "frame_input",
+    2: "node_enter",
+    3: "node_exit",
+    4: "queue_push",
+    5: "queue_pop",
+    6: "send_start",
+    7: "send_end",
+    8: "timestamp_late",
+    9: "underflow",
+    10: "late_packet",
+    11: "snapshot",
+}
+
+
+def format_value(event, value):
+    if event in ("node_exit", "send_end"):
+        return "{:.1f}us".format(value / 1000.0)
+    elif event == "timestamp_late":
+        return "{:.3f}ms".format(value / 1e6)
+    elif event == "queue_push":
+        size = value & 0xFFFFFFFF
+        return "size={}{}".format(size, " overflow" if value >> 32 else "")
+    elif event == "queue_pop":
+        return "size={}".format(value)
+    elif event == "send_start":
+        return "tx={}+{:.6f}".format(value >> 32, (value & 0xFFFFFFFF) / 16384000.0)
+    elif event in ("underflow", "late_packet"):
+        return "count={}".format(value)
+    elif event == "snapshot":
+        return "bytes={}".format(value)
+    return str(value)
+
+
+parser = argparse.ArgumentParser(description="Decode an ODR-DabMod frame trace")
+parser.add_argument("file", help="Frame trace file")
+parser.add_argument("--last", type=int, default=0,
+        help="Only print the last N records")
+parser.add_argument("--fct", type=int, default=None,
+        help="Only print the records of this FCT")
+parser.add_argument("--monotonic", action="store_true",
+        help="Print the CLOCK_MONOTONIC time instead of UTC")
+parser.add_argument("--snapshots", default=None, metavar="DIR",
+        help="Write the block outputs of a capture into this directory")
+args = parser.parse_args()
+
+with open(args.file, "rb") as fd:
+    data = fd.read()
+
+(magic, version, record_size, num_records, write_index, realtime_offset,
+        num_names, _) = struct.unpack_from(HEADER_FORMAT, data, 0)
+
+if magic not in (b"ODRTRACE", b"ODRCAPTR"):
+    print("Not a frame trace file", file=sys.stderr)
+    sys.exit(1)
+capture = magic == b"ODRCAPTR"
+if version != 1 or record_size != struct.calcsize(RECORD_FORMAT):
+    print("Unsupported trace version {} with records of {} bytes".format(
+        version, record_size), file=sys.stderr)
+    sys.exit(1)
+
+names_offset = struct.calcsize(HEADER_FORMAT)
+names = []
+for i in range(min(num_names, MAX_NAMES)):
+    raw = data[names_offset + i * NAME_SIZE:names_offset + (i + 1) * NAME_SIZE]
+    names.append(raw.split(b"\0", 1)[0].decode(errors="replace"))
+
+records = []
+snapshots = {}
+if capture:
+    # The records follow each other, the snapshots take several slots
+    i = 0
+    while i < num_records:
+        offset = HEADER_SIZE + i * record_size
+        if offset + record_size > len(data):
+            break
+        record = struct.unpack_from(RECORD_FORMAT, data, offset)
+        records.append(record)
+        i += 1
+        if EVENTS.get(record[4]) == "snapshot":
+            value = record[2]
+            start = HEADER_SIZE + i * record_size
+            snapshots[record[0]] = data[start:start + value]
+            i += (value + record_size - 1) // record_size
+else:
+    for i in range(num_records):
+        offset = HEADER_SIZE + i * record_size
+        if offset + record_size > len(data):
+            break
+        seq, time_ns, value, fct, event, name, thread = struct.unpack_from(
+                RECORD_FORMAT, data, offset)
+        # Records not written yet, or being written, are skipped
+        if seq == 0 or (seq - 1) % num_records != i:
+            continue
+        records.append((seq, time_ns, value, fct, event, name, thread))
+
+records.sort()
+if args.fct is not None:
+    records = [r for r in records if r[3] == args.fct]
+if args.last > 0:
+    records = records[-args.last:]
+
+for seq, time_ns, value, fct, event, name, thread in records:
+    if args.monotonic:
+        time_str = "{:.6f}".format(time_ns / 1e9)
+    else:
+        t = datetime.datetime.fromtimestamp(
+                (time_ns + realtime_offset) / 1e9, tz=datetime.timezone.utc)
+        time_str = t.strftime("%Y-%m-%dT%H:%M:%S.%fZ")
+    event_str = EVENTS.get(event, str(event))
+    name_str = names[name] if name < len(names) else str(name)
+    print("{} {:3} {:14} {:24} {:3} {}".format(time_str, thread, event_str,
+        name_str, fct, format_value(event_str, value)))
+
+    if args.snapshots and seq in snapshots:
+        os.makedirs(args.snapshots, exist_ok=True)
+        filename = os.path.join(args.snapshots, "{:08}_fct{}_{}.bin".format(
+            seq, fct, name_str))
+        with open(filename, "wb") as out:
+            out.write(snapshots[seq])
+
+
+# This is free and unencumbered software released into the public domain.
+#
+# Anyone is free to copy, modify, publish, use, compile, sell, or
+# distribute this software, either in source code form or as a compiled
+# binary, for any purpose, commercial or non-commercial, and by any
+# means.
+#
+# In jurisdictions that recognize copyright laws, the author or authors
+# of this software dedicate any and all copyright interest in the
+# software to the public domain. We make this dedication for the benefit
+# of the public at large and to the detriment of our heirs and
+# successors. We intend this dedication to be an overt act of
+# relinquishment in perpetuity of all present and future rights to this
+# software under copyright law.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+# EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+# MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+# IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+# OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+# ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+# OTHER DEALINGS IN THE SOFTWARE.
+#
+# For more information, please refer to <http://unlicense.org>
@@ -362,6 +362,9 @@ public:
     // and valid false values are "false", "no", "off", "0" (not case sensitive).
     bool GetBoolean(std::string section_name, bool default_value);
 
+    // Return true if the value is present in the INI file.
+    bool HasValue(std::string section_name) const;
+
 private:
     int _error;
     std::map<std::string, std::string> _values;
@@ -404,6 +407,11 @@ inline string INIReader::Get(string section_name, string default_value)
     return _values.count(key) ? _values[key] : default_value;
 }
 
+inline bool INIReader::HasValue(string section_name) const
+{
+    return _values.count(section_name) > 0;
+}
+
 inline long INIReader::GetInteger(string section_name, long default_value)
 {
     string valstr = Get(section_name, "");
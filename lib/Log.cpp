@@ -30,11 +30,15 @@
 #include <cstdarg>
 #include <cinttypes>
 #include <chrono>
+#include <algorithm>
 
 #include "Log.h"
 
 using namespace std;
 
+// How often the deferred thread empties the rings
+static constexpr auto DEFERRED_POLL_PERIOD = chrono::milliseconds(10);
+
 
 Logger::Logger()
 {
@@ -42,6 +46,11 @@ Logger::Logger()
 }
 
 Logger::~Logger() {
+    m_deferred_running.store(false);
+    if (m_deferred_thread.joinable()) {
+        m_deferred_thread.join();
+    }
+
     m_message_queue.trigger_wakeup();
     m_io_thread.join();
 
@@ -53,12 +62,16 @@ void Logger::register_backend(std::shared_ptr<LogBackend> backend)
 {
     std::lock_guard<std::mutex> guard(m_backend_mutex);
     backends.push_back(backend);
+
+    if (backend->get_name() == "TRACE") {
+        m_trace_enabled.store(true);
+    }
 }
 
 
 void Logger::log(log_level_t level, const char* fmt, ...)
 {
-    if (level == discard) {
+    if (level == discard or (level == trace and not trace_enabled())) {
         return;
     }
 
@@ -85,7 +98,7 @@ void Logger::log(log_level_t level, const char* fmt, ...)
 
 void Logger::logstr(log_level_t level, std::string&& message)
 {
-    if (level == discard) {
+    if (level == discard or (level == trace and not trace_enabled())) {
         return;
     }
 
@@ -95,28 +108,28 @@ void Logger::logstr(log_level_t level, std::string&& message)
 
 void Logger::io_process()
 {
+    std::deque<log_message_t> messages;
     while (1) {
-        log_message_t m;
         try {
-            m_message_queue.wait_and_pop(m);
+            m_message_queue.wait_and_pop_all(messages);
         }
         catch (const ThreadsafeQueueWakeup&) {
             break;
         }
 
-        auto message = m.message;
+        std::lock_guard<std::mutex> guard(m_backend_mutex);
+        for (auto& m : messages) {
+            auto& message = m.message;
 
-        /* Remove a potential trailing newline.
-         * It doesn't look good in syslog
-         */
-        if (message[message.length()-1] == '\n') {
-            message.resize(message.length()-1);
-        }
+            /* Remove a potential trailing newline.
+             * It doesn't look good in syslog
+             */
+            if (message[message.length()-1] == '\n') {
+                message.resize(message.length()-1);
+            }
 
-        {
-            std::lock_guard<std::mutex> guard(m_backend_mutex);
             for (auto &backend : backends) {
-                backend->log(m.level, message);
+                backend->log_at(m.level, message, m.timestamp);
             }
 
             if (m.level != log_level_t::trace) {
@@ -129,8 +142,73 @@ void Logger::io_process()
 }
 
 
+Logger::deferred_ring_t& Logger::deferred_ring()
+{
+    // There is only one Logger, etiLog
+    thread_local shared_ptr<deferred_ring_t> ring;
+
+    if (not ring) {
+        ring = make_shared<deferred_ring_t>();
+
+        std::lock_guard<std::mutex> guard(m_rings_mutex);
+        m_rings.push_back(ring);
+
+        if (not m_deferred_running.load()) {
+            m_deferred_running.store(true);
+            m_deferred_thread = std::thread(&Logger::deferred_process, this);
+        }
+    }
+    return *ring;
+}
+
+void Logger::deferred_process()
+{
+    std::deque<log_message_t> messages;
+    bool last_pass = false;
+    while (not last_pass) {
+        // Empty the rings once more after the destructor stopped us
+        last_pass = not m_deferred_running.load();
+
+        vector<shared_ptr<deferred_ring_t> > rings;
+        {
+            std::lock_guard<std::mutex> guard(m_rings_mutex);
+            // Forget the rings of the threads that have terminated
+            m_rings.erase(remove_if(m_rings.begin(), m_rings.end(),
+                        [](const shared_ptr<deferred_ring_t>& r) {
+                            return r.use_count() == 1 and r->records.empty();
+                        }), m_rings.end());
+            rings = m_rings;
+        }
+
+        for (auto& ring : rings) {
+            deferred_log_record_t record;
+            while (ring->records.try_pop(record)) {
+                string message;
+                record.format(record, message);
+                messages.emplace_back(record.level, move(message), record.timestamp);
+            }
+            if (not messages.empty()) {
+                m_message_queue.push_many(messages);
+            }
+
+            const auto num_dropped = ring->num_dropped.exchange(0);
+            if (num_dropped > 0) {
+                logstr(warn, "Logger: " + to_string(num_dropped) +
+                        " deferred messages dropped");
+            }
+        }
+
+        if (not last_pass) {
+            this_thread::sleep_for(DEFERRED_POLL_PERIOD);
+        }
+    }
+}
+
 LogLine Logger::level(log_level_t level)
 {
+    if (level == trace and not trace_enabled()) {
+        return LogLine(this, discard);
+    }
     return LogLine(this, level);
 }
 
@@ -197,11 +275,16 @@ LogTracer::LogTracer(const string& trace_filename) : name("TRACE")
 }
 
 void LogTracer::log(log_level_t level, const std::string& message)
+{
+    log_at(level, message, std::chrono::steady_clock::now());
+}
+
+void LogTracer::log_at(log_level_t level, const std::string& message,
+        std::chrono::steady_clock::time_point when)
 {
     if (level == log_level_t::trace) {
         using namespace std::chrono;
-        const auto now = steady_clock::now().time_since_epoch();
-        const auto micros = duration_cast<microseconds>(now).count();
+        const auto micros = duration_cast<microseconds>(when.time_since_epoch()).count();
 
         fprintf(m_trace_file.get(), "%" PRIu64 ",%s\n",
                 micros - m_trace_micros_startup,
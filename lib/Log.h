@@ -32,7 +32,10 @@
 #endif
 
 #include <syslog.h>
+#include <atomic>
+#include <chrono>
 #include <cstdarg>
+#include <cstdint>
 #include <cstdio>
 #include <fstream>
 #include <sstream>
@@ -44,7 +47,11 @@
 #include <mutex>
 #include <memory>
 #include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
 #include "ThreadsafeQueue.h"
+#include "SPSCQueue.h"
 
 #define SYSLOG_IDENT PACKAGE_NAME
 #define SYSLOG_FACILITY LOG_LOCAL0
@@ -60,6 +67,13 @@ class LogBackend {
         virtual ~LogBackend() {};
         virtual void log(log_level_t level, const std::string& message) = 0;
         virtual std::string get_name() const = 0;
+
+        /* Called by the logger with the time the message was logged at,
+         * which can be long before the backend gets it. */
+        virtual void log_at(log_level_t level, const std::string& message,
+                std::chrono::steady_clock::time_point /*when*/) {
+            log(level, message);
+        }
 };
 
 /** A Logging backend for Syslog */
@@ -104,6 +118,8 @@ class LogTracer : public LogBackend {
     public:
         LogTracer(const std::string& filename);
         void log(log_level_t level, const std::string& message);
+        void log_at(log_level_t level, const std::string& message,
+                std::chrono::steady_clock::time_point when);
         std::string get_name() const { return name; }
     private:
         std::string name;
@@ -119,9 +135,12 @@ class LogTracer : public LogBackend {
 class LogLine;
 
 struct log_message_t {
-    log_message_t(log_level_t _level, std::string&& _message) :
+    log_message_t(log_level_t _level, std::string&& _message,
+            std::chrono::steady_clock::time_point _timestamp =
+                std::chrono::steady_clock::now()) :
         level(_level),
-        message(move(_message)) {}
+        message(move(_message)),
+        timestamp(_timestamp) {}
 
     log_message_t() :
         level(debug),
@@ -129,6 +148,25 @@ struct log_message_t {
 
     log_level_t level;
     std::string message;
+    std::chrono::steady_clock::time_point timestamp;
+};
+
+/* A message of log_deferred(), formatted by the logger later on. The
+ * arguments are kept by value, the format must be a string literal. */
+struct deferred_log_record_t {
+    static constexpr size_t MAX_ARGS = 6;
+
+    union arg_t {
+        int64_t i;
+        uint64_t u;
+        double d;
+    };
+
+    log_level_t level = debug;
+    std::chrono::steady_clock::time_point timestamp;
+    const char *fmt = nullptr;
+    void (*format)(const deferred_log_record_t& record, std::string& out) = nullptr;
+    arg_t args[MAX_ARGS];
 };
 
 class Logger {
@@ -145,6 +183,24 @@ class Logger {
 
         void logstr(log_level_t level, std::string&& message);
 
+        /* Log a message with a printf format and only numeric arguments,
+         * for the threads that cannot wait. It is copied into a ring
+         * buffer of the calling thread, and formatted and given to the
+         * backends by another thread. If the ring is full, the message is
+         * dropped and counted. Call it through LOG_DEFERRED, which checks
+         * the format against the arguments. */
+        template<typename... Args>
+        void log_deferred(log_level_t level, const char* fmt, Args... args);
+
+        /* Never called, only lets the compiler check a printf format */
+        __attribute__((format(printf, 1, 2)))
+        static void check_format(const char*, ...) {}
+
+        /* Trace messages are only kept when a TRACE backend is registered */
+        bool trace_enabled() const {
+            return m_trace_enabled.load(std::memory_order_relaxed);
+        }
+
         /* All logging IO is done in another thread */
         void io_process(void);
 
@@ -153,17 +209,146 @@ class Logger {
         LogLine level(log_level_t level);
 
     private:
+        struct deferred_ring_t {
+            deferred_ring_t() : records(DEFERRED_RING_SIZE) {}
+            SPSCQueue<deferred_log_record_t> records;
+            std::atomic<uint64_t> num_dropped = ATOMIC_VAR_INIT(0);
+        };
+
+        static constexpr size_t DEFERRED_RING_SIZE = 1024;
+
+        template<typename T>
+        using vararg_t = std::conditional_t<std::is_floating_point_v<T>, double, T>;
+
+        template<typename T>
+        static deferred_log_record_t::arg_t to_arg(T value);
+        template<typename T>
+        static T from_arg(const deferred_log_record_t::arg_t& arg);
+        template<typename... Args, size_t... Is>
+        static void format_deferred(const deferred_log_record_t& record,
+                std::string& out, std::index_sequence<Is...>);
+
+        // Returns the ring of the calling thread, created at the first call
+        deferred_ring_t& deferred_ring();
+        void deferred_process(void);
+
         std::list<std::shared_ptr<LogBackend> > backends;
+        std::atomic<bool> m_trace_enabled = ATOMIC_VAR_INIT(false);
 
         ThreadsafeQueue<log_message_t> m_message_queue;
         std::thread m_io_thread;
         std::mutex m_backend_mutex;
+
+        // The rings of all threads that used log_deferred(), emptied by
+        // the deferred thread, started at the first use.
+        std::mutex m_rings_mutex;
+        std::vector<std::shared_ptr<deferred_ring_t> > m_rings;
+        std::atomic<bool> m_deferred_running = ATOMIC_VAR_INIT(false);
+        std::thread m_deferred_thread;
 };
 
 /* etiLog is a singleton used in all parts of the program to output log messages.
  * It is constructed in Globals.cpp */
 extern Logger etiLog;
 
+/* etiLog.log_deferred(), with the format checked at compile time */
+#define LOG_DEFERRED(level, ...) \
+    do { \
+        if (false) { \
+            Logger::check_format(__VA_ARGS__); \
+        } \
+        etiLog.log_deferred(level, __VA_ARGS__); \
+    } while (0)
+
+template<typename T>
+deferred_log_record_t::arg_t Logger::to_arg(T value)
+{
+    deferred_log_record_t::arg_t arg;
+    if constexpr (std::is_floating_point_v<T>) {
+        arg.d = value;
+    }
+    else if constexpr (std::is_signed_v<T>) {
+        arg.i = value;
+    }
+    else {
+        arg.u = value;
+    }
+    return arg;
+}
+
+template<typename T>
+T Logger::from_arg(const deferred_log_record_t::arg_t& arg)
+{
+    if constexpr (std::is_floating_point_v<T>) {
+        return arg.d;
+    }
+    else if constexpr (std::is_signed_v<T>) {
+        return arg.i;
+    }
+    else {
+        return arg.u;
+    }
+}
+
+template<typename... Args, size_t... Is>
+void Logger::format_deferred(const deferred_log_record_t& record,
+        std::string& out, std::index_sequence<Is...>)
+{
+    if constexpr (sizeof...(Is) == 0) {
+        out = record.fmt;
+    }
+    else {
+        // The floating-point values are stored, and passed to snprintf,
+        // as double. LOG_DEFERRED checked the format at the call site.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+        char buf[256];
+        int n = snprintf(buf, sizeof(buf), record.fmt,
+                from_arg<vararg_t<Args> >(record.args[Is])...);
+        if (n < 0) {
+            out = record.fmt;
+        }
+        else if ((size_t)n < sizeof(buf)) {
+            out.assign(buf, n);
+        }
+        else {
+            out.resize(n + 1);
+            snprintf(&out[0], n + 1, record.fmt,
+                    from_arg<vararg_t<Args> >(record.args[Is])...);
+            out.resize(n);
+        }
+#pragma GCC diagnostic pop
+    }
+}
+
+template<typename... Args>
+void Logger::log_deferred(log_level_t level, const char* fmt, Args... args)
+{
+    static_assert((std::is_arithmetic_v<Args> and ...),
+            "log_deferred() only takes numeric arguments");
+    static_assert(sizeof...(Args) <= deferred_log_record_t::MAX_ARGS,
+            "Too many arguments for log_deferred()");
+
+    if (level == discard or (level == trace and not trace_enabled())) {
+        return;
+    }
+
+    deferred_log_record_t record;
+    record.level = level;
+    record.timestamp = std::chrono::steady_clock::now();
+    record.fmt = fmt;
+    record.format = [](const deferred_log_record_t& r, std::string& out) {
+        format_deferred<Args...>(r, out, std::index_sequence_for<Args...>());
+    };
+    size_t i = 0;
+    ((record.args[i++] = to_arg(args)), ...);
+
+    auto& ring = deferred_ring();
+    if (not ring.records.push_if_space(std::move(record))) {
+        ring.num_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
 // Accumulate a line of logs, using same syntax as stringstream
 // The line is logged when the LogLine gets destroyed
 class LogLine {
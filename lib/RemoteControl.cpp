@@ -61,6 +61,16 @@ void RemoteControllerTelnet::restart()
             this, 0);
 }
 
+static thread_local std::string rc_name_prefix;
+
+void set_rc_name_prefix(const std::string& prefix) {
+    rc_name_prefix = prefix;
+}
+
+const std::string& get_rc_name_prefix() {
+    return rc_name_prefix;
+}
+
 RemoteControllable::~RemoteControllable() {
     rcs.remove_controllable(this);
 }
@@ -78,10 +88,12 @@ void RemoteControllers::add_controller(std::shared_ptr<BaseRemoteController> rc)
 }
 
 void RemoteControllers::enrol(RemoteControllable *rc) {
+    std::lock_guard<std::mutex> lock(m_controllables_mutex);
     controllables.push_back(rc);
 }
 
 void RemoteControllers::remove_controllable(RemoteControllable *rc) {
+    std::lock_guard<std::mutex> lock(m_controllables_mutex);
     controllables.remove(rc);
 }
 
@@ -116,6 +128,20 @@ std::string RemoteControllers::get_showjson() {
     return json::map_to_json(root);
 }
 
+std::map<std::string, std::map<std::string, std::string> >
+RemoteControllers::get_all_values_json()
+{
+    std::lock_guard<std::mutex> lock(m_controllables_mutex);
+    std::map<std::string, std::map<std::string, std::string> > values;
+    for (auto &controllable : controllables) {
+        auto& module = values[controllable->get_rc_name()];
+        for (const auto& param : controllable->get_all_values()) {
+            module[param.first] = json::value_to_json(param.second);
+        }
+    }
+    return values;
+}
+
 std::string RemoteControllers::get_param(const std::string& name, const std::string& param) {
     RemoteControllable* controllable = get_controllable_(name);
     return controllable->get_parameter(param);
@@ -133,6 +159,7 @@ void RemoteControllers::check_faults() {
 
 RemoteControllable* RemoteControllers::get_controllable_(const std::string& name)
 {
+    std::lock_guard<std::mutex> lock(m_controllables_mutex);
     auto rc = std::find_if(controllables.begin(), controllables.end(),
             [&](RemoteControllable* r) { return r->get_rc_name() == name; });
 
@@ -153,13 +180,150 @@ void RemoteControllers::set_param(
         << " to " << value;
     RemoteControllable* controllable = get_controllable_(name);
     try {
-        return controllable->set_parameter(param, value);
+        controllable->set_parameter(param, value);
     }
     catch (const ios_base::failure& e) {
         etiLog.level(info) << "RC: Failed to set " << name << " " << param
         << " to " << value << ": " << e.what();
         throw ParameterError("Cannot understand value");
     }
+
+    for (auto &controller : m_controllers) {
+        controller->notify_change();
+    }
+}
+
+rc_batch_target_t rc_batch_target_t::parse(const std::string& target)
+{
+    rc_batch_target_t t;
+    if (target == "now") {
+        return t;
+    }
+
+    try {
+        size_t pos = 0;
+        if (target.compare(0, 4, "fct=") == 0) {
+            const unsigned long fct = std::stoul(target.substr(4), &pos);
+            if (pos == target.size() - 4 and fct < 250) {
+                t.type = type_t::fct;
+                t.fct = fct;
+                return t;
+            }
+        }
+        else if (target.compare(0, 5, "time=") == 0) {
+            t.time = std::stod(target.substr(5), &pos);
+            if (pos == target.size() - 5) {
+                t.type = type_t::time;
+                return t;
+            }
+        }
+    }
+    catch (const std::logic_error&) {
+        // invalid_argument and out_of_range
+    }
+
+    throw ParameterError("Invalid target '" + target +
+            "', expected now, fct=0..249 or time=SECONDS");
+}
+
+void RemoteControllers::set_params_at(
+        const rc_batch_target_t& target,
+        std::vector<rc_setting_t>&& settings)
+{
+    if (settings.empty()) {
+        throw ParameterError("No parameter to set");
+    }
+
+    for (const auto& s : settings) {
+        const auto params = get_controllable_(s.module)->get_supported_parameters();
+        if (std::find(params.begin(), params.end(), s.parameter) == params.end()) {
+            throw ParameterError("Parameter '" + s.parameter +
+                    "' is not exported by controllable " + s.module);
+        }
+    }
+
+    etiLog.level(info) << "RC: Scheduling " << settings.size() << " settings";
+
+    std::lock_guard<std::mutex> lock(m_scheduled_mutex);
+    batch_t batch;
+    batch.target = target;
+    batch.settings = std::move(settings);
+    m_scheduled.push_back(std::move(batch));
+    m_num_scheduled.store(m_scheduled.size());
+}
+
+void RemoteControllers::apply_scheduled_(unsigned fct, double frame_time)
+{
+    // With several ensembles, the first modulator that reaches the target
+    // applies the batch.
+    std::list<batch_t> due;
+    {
+        std::lock_guard<std::mutex> lock(m_scheduled_mutex);
+        for (auto it = m_scheduled.begin(); it != m_scheduled.end();) {
+            bool is_due = false;
+            switch (it->target.type) {
+                case rc_batch_target_t::type_t::next_frame:
+                    is_due = true;
+                    break;
+                case rc_batch_target_t::type_t::fct:
+                    is_due = (it->target.fct == fct);
+                    break;
+                case rc_batch_target_t::type_t::time:
+                    is_due = (frame_time >= it->target.time);
+                    break;
+            }
+
+            if (is_due) {
+                auto next = std::next(it);
+                due.splice(due.end(), m_scheduled, it);
+                it = next;
+            }
+            else {
+                ++it;
+            }
+        }
+        m_num_scheduled.store(m_scheduled.size());
+    }
+
+    for (const auto& batch : due) {
+        // Previous values of the settings applied so far including the one
+        // that failed, empty for the parameters that cannot be read back.
+        std::vector<std::string> previous;
+
+        try {
+            for (const auto& s : batch.settings) {
+                std::string value;
+                try {
+                    value = get_param(s.module, s.parameter);
+                }
+                catch (const ParameterError&) {
+                }
+                previous.push_back(std::move(value));
+                set_param(s.module, s.parameter, s.value);
+            }
+            etiLog.level(info) << "RC: Applied " << batch.settings.size() <<
+                " settings at FCT " << fct;
+        }
+        catch (const std::exception& e) {
+            etiLog.level(error) << "RC: Batch failed at FCT " << fct <<
+                ": " << e.what() << ", restoring previous values";
+
+            for (size_t i = previous.size(); i-- > 0;) {
+                const auto& s = batch.settings[i];
+                if (previous[i].empty()) {
+                    continue;
+                }
+
+                try {
+                    set_param(s.module, s.parameter, previous[i]);
+                }
+                catch (const std::exception& e_restore) {
+                    etiLog.level(error) << "RC: Cannot restore " << s.module <<
+                        " " << s.parameter << ": " << e_restore.what();
+                }
+            }
+        }
+    }
 }
 
 // This runs in a separate thread, because
@@ -284,6 +448,30 @@ static std::vector<std::string> tokenise(const std::string& message) {
     return all_tokens;
 }
 
+// Parses "MODULE PARAMETER VALUE ; MODULE PARAMETER VALUE ...", the values
+// may contain spaces.
+static std::vector<rc_setting_t> parse_settings(const std::string& settings)
+{
+    std::vector<rc_setting_t> parsed;
+    stringstream ss(settings);
+    std::string item;
+    while (std::getline(ss, item, ';')) {
+        stringstream item_ss(item);
+        rc_setting_t setting;
+        item_ss >> setting.module >> setting.parameter;
+        std::getline(item_ss >> std::ws, setting.value);
+        while (not setting.value.empty() and setting.value.back() == ' ') {
+            setting.value.pop_back();
+        }
+
+        if (setting.value.empty()) {
+            throw ParameterError("Expected MODULE PARAMETER VALUE, got '" + item + "'");
+        }
+        parsed.push_back(std::move(setting));
+    }
+    return parsed;
+}
+
 
 void RemoteControllerTelnet::dispatch_command(Socket::TCPSocket& socket, string command)
 {
@@ -300,6 +488,11 @@ void RemoteControllerTelnet::dispatch_command(Socket::TCPSocket& socket, string
                 "    * Gets the value for the specified PARAMETER from module MODULE\n"
                 "  set MODULE PARAMETER VALUE\n"
                 "    * Sets the value for the PARAMETER ofr module MODULE\n"
+                "  getmulti MODULE PARAMETER [MODULE PARAMETER]...\n"
+                "    * Gets the values of several parameters, one per line\n"
+                "  setmulti TARGET MODULE PARAMETER VALUE [; MODULE PARAMETER VALUE]...\n"
+                "    * Sets several parameters together before the frame given by\n"
+                "      TARGET: now, fct=0..249 or time=SECONDS since the epoch\n"
                 "  quit\n"
                 "    * Terminate this session\n"
                 "\n");
@@ -382,6 +575,39 @@ void RemoteControllerTelnet::dispatch_command(Socket::TCPSocket& socket, string
             reply(socket, "Incorrect parameters for command 'set'");
         }
     }
+    else if (cmd[0] == "getmulti") {
+        if (cmd.size() >= 3 and cmd.size() % 2 == 1) {
+            try {
+                stringstream ss;
+                for (size_t i = 1; i < cmd.size(); i += 2) {
+                    ss << rcs.get_param(cmd[i], cmd[i+1]) << endl;
+                }
+                reply(socket, ss.str());
+            }
+            catch (const ParameterError &e) {
+                reply(socket, e.what());
+            }
+        }
+        else {
+            reply(socket, "Incorrect parameters for command 'getmulti'");
+        }
+    }
+    else if (cmd[0] == "setmulti") {
+        if (cmd.size() >= 5) {
+            try {
+                const auto target = rc_batch_target_t::parse(cmd[1]);
+                const size_t settings_start = cmd[0].size() + cmd[1].size() + 2;
+                rcs.set_params_at(target, parse_settings(command.substr(settings_start)));
+                reply(socket, "ok");
+            }
+            catch (const ParameterError &e) {
+                reply(socket, e.what());
+            }
+        }
+        else {
+            reply(socket, "Incorrect parameters for command 'setmulti'");
+        }
+    }
     else if (cmd[0] == "quit") {
         reply(socket, "Goodbye");
     }
@@ -592,9 +818,41 @@ void RemoteControllerZmq::process()
                         send_fail_reply(repSocket, err.what());
                     }
                 }
+                else if (msg.size() >= 3 and msg.size() % 2 == 1 and command == "getmulti") {
+                    try {
+                        std::vector<std::string> values;
+                        for (size_t i = 1; i < msg.size(); i += 2) {
+                            values.push_back(rcs.get_param(msg[i], msg[i+1]));
+                        }
+
+                        size_t num_values = values.size();
+                        for (const auto& value : values) {
+                            zmq::message_t zmsg(value.size());
+                            memcpy ((void*) zmsg.data(), value.data(), value.size());
+                            repSocket.send(zmsg, (--num_values > 0) ? zmq::send_flags::sndmore : zmq::send_flags::none);
+                        }
+                    }
+                    catch (const ParameterError &err) {
+                        send_fail_reply(repSocket, err.what());
+                    }
+                }
+                else if (msg.size() >= 5 and msg.size() % 3 == 2 and command == "setmulti") {
+                    try {
+                        const auto target = rc_batch_target_t::parse(msg[1]);
+                        std::vector<rc_setting_t> settings;
+                        for (size_t i = 2; i < msg.size(); i += 3) {
+                            settings.push_back({msg[i], msg[i+1], msg[i+2]});
+                        }
+                        rcs.set_params_at(target, std::move(settings));
+                        send_ok_reply(repSocket);
+                    }
+                    catch (const ParameterError &err) {
+                        send_fail_reply(repSocket, err.what());
+                    }
+                }
                 else {
                     send_fail_reply(repSocket,
-                            "Unsupported command. commands: list, show, get, set, showjson");
+                            "Unsupported command. commands: list, show, get, set, getmulti, setmulti, showjson");
                 }
             }
         }
@@ -609,4 +867,145 @@ void RemoteControllerZmq::process()
     }
 }
 
+RemoteControllerZmqPub::~RemoteControllerZmqPub() {
+    m_active = false;
+    m_fault = false;
+    notify_change();
+
+    if (m_restarter_thread.joinable()) {
+        m_restarter_thread.join();
+    }
+
+    if (m_child_thread.joinable()) {
+        m_child_thread.join();
+    }
+}
+
+void RemoteControllerZmqPub::restart()
+{
+    if (m_restarter_thread.joinable()) {
+        m_restarter_thread.join();
+    }
+
+    m_restarter_thread = std::thread(&RemoteControllerZmqPub::restart_thread, this);
+}
+
+void RemoteControllerZmqPub::restart_thread()
+{
+    m_active = false;
+    notify_change();
+
+    if (m_child_thread.joinable()) {
+        m_child_thread.join();
+    }
+
+    m_active = true;
+    m_child_thread = std::thread(&RemoteControllerZmqPub::process, this);
+}
+
+void RemoteControllerZmqPub::notify_change()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_wakeup_mutex);
+        m_changed = true;
+    }
+    m_wakeup.notify_one();
+}
+
+std::chrono::milliseconds RemoteControllerZmqPub::publish_changes(
+        zmq::socket_t& pubSocket)
+{
+    using namespace std::chrono;
+    const auto now = steady_clock::now();
+    auto wait = m_interval;
+
+    for (const auto& module : rcs.get_all_values_json()) {
+        auto& published = m_published[module.first];
+
+        std::map<std::string, std::string> changes;
+        for (const auto& param : module.second) {
+            auto p = published.find(param.first);
+            if (p != published.end()) {
+                if (p->second.value == param.second) {
+                    continue;
+                }
+
+                const auto since = duration_cast<milliseconds>(now - p->second.time);
+                if (since < m_min_interval) {
+                    // Comes again at the next poll, with the value it will
+                    // have by then
+                    wait = std::min(wait, m_min_interval - since);
+                    continue;
+                }
+            }
+
+            published[param.first] = {param.second, now};
+            changes[param.first] = param.second;
+        }
+
+        if (changes.empty()) {
+            continue;
+        }
+
+        // The values already are JSON, they are put together by hand
+        // instead of getting quoted as strings again.
+        std::stringstream ss;
+        ss << "{ ";
+        size_t i = 0;
+        for (const auto& change : changes) {
+            if (i++ > 0) {
+                ss << ", ";
+            }
+            ss << "\"" << change.first << "\": " << change.second;
+        }
+        ss << " }";
+        const std::string msg_s = ss.str();
+
+        zmq::message_t zmsg_module(module.first.size());
+        memcpy(zmsg_module.data(), module.first.data(), module.first.size());
+        pubSocket.send(zmsg_module, zmq::send_flags::sndmore);
+
+        zmq::message_t zmsg(msg_s.size());
+        memcpy(zmsg.data(), msg_s.data(), msg_s.size());
+        pubSocket.send(zmsg, zmq::send_flags::none);
+    }
+
+    return wait;
+}
+
+void RemoteControllerZmqPub::process()
+{
+    m_fault = false;
+
+    try {
+        zmq::socket_t pubSocket(m_zmqContext, ZMQ_PUB);
+
+        int hwm = 1000;
+        int linger = 0;
+        pubSocket.setsockopt(ZMQ_SNDHWM, &hwm, sizeof(hwm));
+        pubSocket.setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
+        pubSocket.bind(m_endpoint.c_str());
+
+        // The first poll publishes all values, also after a restart
+        m_published.clear();
+
+        while (m_active) {
+            const auto wait = publish_changes(pubSocket);
+
+            std::unique_lock<std::mutex> lock(m_wakeup_mutex);
+            m_wakeup.wait_for(lock, wait, [&]{ return m_changed or not m_active; });
+            m_changed = false;
+        }
+        pubSocket.close();
+    }
+    catch (const zmq::error_t &e) {
+        etiLog.level(error) << "ZMQ RC publisher error: " << std::string(e.what());
+        m_fault = true;
+    }
+    catch (const std::exception& e) {
+        etiLog.level(error) << "ZMQ RC publisher caught exception: " << e.what();
+        m_fault = true;
+    }
+}
+
 #endif
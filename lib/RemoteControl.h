@@ -38,12 +38,18 @@
 #endif
 
 #include <list>
+#include <vector>
 #include <unordered_map>
 #include <variant>
 #include <map>
 #include <memory>
+#include <future>
 #include <string>
+#include <type_traits>
 #include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
 #include <iostream>
 #include <thread>
 #include <stdexcept>
@@ -87,14 +93,37 @@ class BaseRemoteController {
          */
         virtual void restart() = 0;
 
+        /* Called after a parameter was set through any of the remote
+         * controllers, so that the ones publishing changes do not have to
+         * wait for their next poll. */
+        virtual void notify_change() {}
+
         virtual ~BaseRemoteController() {}
 };
 
+/* Set a prefix that gets prepended to the name of all RemoteControllables
+ * created afterwards by the calling thread. This keeps the names unique
+ * when several instances of the same objects exist in one process. */
+void set_rc_name_prefix(const std::string& prefix);
+const std::string& get_rc_name_prefix();
+
+/* Runs f in a new thread that has the RC name prefix of the calling
+ * thread, for objects that are constructed in the background. */
+template<typename F>
+std::future<std::invoke_result_t<F> > async_with_rc_name_prefix(F&& f)
+{
+    return std::async(std::launch::async,
+            [f = std::forward<F>(f), prefix = get_rc_name_prefix()]() mutable {
+                set_rc_name_prefix(prefix);
+                return f();
+            });
+}
+
 /* Objects that support remote control must implement the following class */
 class RemoteControllable {
     public:
         RemoteControllable(const std::string& name) :
-            m_rc_name(name) {}
+            m_rc_name(get_rc_name_prefix() + name) {}
 
         RemoteControllable(const RemoteControllable& other) = delete;
         RemoteControllable& operator=(const RemoteControllable& other) = delete;
@@ -130,6 +159,25 @@ class RemoteControllable {
         std::list< std::vector<std::string> > m_parameters;
 };
 
+/* One parameter change of a batch */
+struct rc_setting_t {
+    std::string module;
+    std::string parameter;
+    std::string value;
+};
+
+/* The frame before which a batch of settings is applied */
+struct rc_batch_target_t {
+    enum class type_t { next_frame, fct, time };
+
+    type_t type = type_t::next_frame;
+    unsigned fct = 0;
+    double time = 0;
+
+    /* Parses "now", "fct=N" or "time=SECONDS", throws a ParameterError */
+    static rc_batch_target_t parse(const std::string& target);
+};
+
 /* Holds all our remote controllers and controlled object.
  */
 class RemoteControllers {
@@ -142,17 +190,52 @@ class RemoteControllers {
         std::string get_param(const std::string& name, const std::string& param);
         std::string get_showjson();
 
+        /* The values of all parameters, given as JSON, for every
+         * controllable. */
+        std::map<std::string, std::map<std::string, std::string> >
+            get_all_values_json();
+
         void set_param(
                 const std::string& name,
                 const std::string& param,
                 const std::string& value);
 
+        /* Checks that all modules and parameters exist, and queues the
+         * settings so that the modulator applies them together, before the
+         * frame given by the target. Throws a ParameterError. */
+        void set_params_at(
+                const rc_batch_target_t& target,
+                std::vector<rc_setting_t>&& settings);
+
+        /* Called by the modulator before a frame goes into the flowgraph,
+         * with the frame time in seconds since the epoch. Applies the
+         * batches that are due. If a setting fails, the ones of the batch
+         * that were already applied get their previous value back. */
+        void apply_scheduled(unsigned fct, double frame_time) {
+            if (m_num_scheduled.load(std::memory_order_relaxed) > 0) {
+                apply_scheduled_(fct, frame_time);
+            }
+        }
+
         std::list<RemoteControllable*> controllables;
 
     private:
         RemoteControllable* get_controllable_(const std::string& name);
+        void apply_scheduled_(unsigned fct, double frame_time);
+
+        struct batch_t {
+            rc_batch_target_t target;
+            std::vector<rc_setting_t> settings;
+        };
+
+        std::mutex m_scheduled_mutex;
+        std::list<batch_t> m_scheduled;
+        std::atomic<size_t> m_num_scheduled = ATOMIC_VAR_INIT(0);
 
         std::list<std::shared_ptr<BaseRemoteController> > m_controllers;
+
+        // Controllables can be enrolled and removed from several threads
+        std::mutex m_controllables_mutex;
 };
 
 /* rcs is a singleton used in all parts of the program to interact with the RC.
@@ -253,5 +336,73 @@ class RemoteControllerZmq : public BaseRemoteController {
         std::string m_endpoint;
         std::thread m_child_thread;
 };
+
+/* Publishes the parameters that changed on a ZMQ PUB socket, so that
+ * clients do not have to poll all values with showjson. Every interval_ms,
+ * the values of all controllables are compared with the ones that were
+ * published last, which is as cheap as one showjson, whatever the number of
+ * subscribers. A message has two parts: [module] [JSON object with the
+ * changed parameters]. Subscribers can filter on the module name.
+ *
+ * A parameter is not published more often than every min_interval_ms.
+ * When it changes faster, the latest value gets published when the interval
+ * has passed. A subscriber that connects does not get the values that
+ * did not change since, it should read them once with showjson. */
+class RemoteControllerZmqPub : public BaseRemoteController {
+    public:
+        RemoteControllerZmqPub(const std::string& endpoint,
+                unsigned interval_ms, unsigned min_interval_ms)
+            : m_active(not endpoint.empty()), m_fault(false),
+            m_zmqContext(1),
+            m_endpoint(endpoint),
+            m_interval(interval_ms),
+            m_min_interval(min_interval_ms),
+            m_child_thread(&RemoteControllerZmqPub::process, this) { }
+
+        RemoteControllerZmqPub& operator=(const RemoteControllerZmqPub& other) = delete;
+        RemoteControllerZmqPub(const RemoteControllerZmqPub& other) = delete;
+
+        ~RemoteControllerZmqPub();
+
+        virtual bool fault_detected() { return m_fault; }
+
+        virtual void restart();
+
+        virtual void notify_change();
+
+    private:
+        void restart_thread();
+        void process();
+
+        // Publishes the changes, and returns how long to wait before the
+        // deferred ones can be published
+        std::chrono::milliseconds publish_changes(zmq::socket_t& pubSocket);
+
+        struct published_t {
+            std::string value;
+            std::chrono::steady_clock::time_point time;
+        };
+
+        std::atomic<bool> m_active;
+
+        /* This is set to true if a fault occurred */
+        std::atomic<bool> m_fault;
+        std::thread m_restarter_thread;
+
+        zmq::context_t m_zmqContext;
+
+        std::string m_endpoint;
+        const std::chrono::milliseconds m_interval;
+        const std::chrono::milliseconds m_min_interval;
+
+        // Module name, then parameter name
+        std::map<std::string, std::map<std::string, published_t> > m_published;
+
+        std::mutex m_wakeup_mutex;
+        std::condition_variable m_wakeup;
+        bool m_changed = false;
+
+        std::thread m_child_thread;
+};
 #endif
 
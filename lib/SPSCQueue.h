@@ -0,0 +1,286 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+   A bounded lock-free queue for one producer and one consumer thread,
+   with an interface similar to ThreadsafeQueue.
+ */
+/*
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <utility>
+#include <cassert>
+#include <cstddef>
+
+#include "ThreadsafeQueue.h"
+
+/* This queue is meant to be used by two threads. One producer that
+ * pushes elements, and one consumer that retrieves them. All slots are
+ * allocated when the queue is created, and neither push nor pop take a
+ * lock as long as the consumer does not have to wait.
+ *
+ * Every slot carries a sequence number, as in the bounded queue by
+ * D. Vyukov. This allows the producer to also remove the oldest element
+ * in push_overflow(), without interfering with the consumer.
+ *
+ * A blocking consumer first spins for a short while, and then sleeps on
+ * a condition variable. The producer only takes the mutex to wake it up
+ * when the consumer is actually sleeping.
+ */
+template<typename T>
+class SPSCQueue
+{
+public:
+    /* The capacity is rounded up to the next power of two */
+    SPSCQueue(size_t capacity = 16)
+    {
+        size_t cap = 2;
+        while (cap < capacity) {
+            cap <<= 1;
+        }
+
+        m_mask = cap - 1;
+        m_slots = std::vector<slot_t>(cap);
+        for (size_t i = 0; i < cap; i++) {
+            m_slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    SPSCQueue(const SPSCQueue& other) = delete;
+    SPSCQueue& operator=(const SPSCQueue& other) = delete;
+
+    size_t capacity() const { return m_mask + 1; }
+
+    /* Push one element into the queue, and notify the consumer if it is
+     * waiting. Waits for free space if the queue is full.
+     *
+     * If max_size > 0 and the queue already contains at least max_size
+     * elements, the element gets discarded instead.
+     *
+     * returns the new queue size.
+     */
+    size_t push(T&& val, size_t max_size = 0)
+    {
+        if (max_size > 0 and size() >= max_size) {
+            return size();
+        }
+
+        while (not try_push(val)) {
+            std::this_thread::yield();
+        }
+        notify_consumer();
+        return size();
+    }
+
+    /* Push one element into the queue if it is not full, without
+     * notifying the consumer, which must poll with try_pop(). Never
+     * blocks.
+     *
+     * returns false if the queue was full.
+     */
+    bool push_if_space(T&& val)
+    {
+        return try_push(val);
+    }
+
+    using push_overflow_result = typename ThreadsafeQueue<T>::push_overflow_result;
+
+    /* Push one element into the queue, and if the queue contains max_size
+     * elements, remove the oldest ones first.
+     *
+     * max_size == 0 is not allowed.
+     *
+     * returns the new queue size and a flag if overflow occurred.
+     */
+    push_overflow_result push_overflow(T&& val, size_t max_size)
+    {
+        assert(max_size > 0);
+
+        bool overflow = false;
+        while (size() >= max_size or size() >= capacity()) {
+            T discarded;
+            if (try_pop(discarded)) {
+                overflow = true;
+            }
+        }
+
+        while (not try_push(val)) {
+            // The consumer can only make more space
+            std::this_thread::yield();
+        }
+        notify_consumer();
+        return {overflow, size()};
+    }
+
+    /* Trigger a wakeup event on a blocking consumer, which
+     * will receive a ThreadsafeQueueWakeup exception.
+     */
+    void trigger_wakeup(void)
+    {
+        m_wakeup_requested.store(true);
+        std::unique_lock<std::mutex> lock(m_wait_mutex);
+        m_rx_notification.notify_one();
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    size_t size() const
+    {
+        const size_t tail = m_tail.load(std::memory_order_acquire);
+        const size_t head = m_head.load(std::memory_order_acquire);
+        return head >= tail ? head - tail : 0;
+    }
+
+    bool try_pop(T& popped_value)
+    {
+        size_t pos = m_tail.load(std::memory_order_relaxed);
+        slot_t *slot = nullptr;
+
+        while (true) {
+            slot = &m_slots[pos & m_mask];
+            const size_t seq = slot->seq.load(std::memory_order_acquire);
+            const ptrdiff_t dif = (ptrdiff_t)seq - (ptrdiff_t)(pos + 1);
+
+            if (dif == 0) {
+                // The producer uses this to drop the oldest element, we
+                // therefore have to claim the slot.
+                if (m_tail.compare_exchange_weak(pos, pos + 1,
+                            std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+            else if (dif < 0) {
+                return false;
+            }
+            else {
+                pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+
+        popped_value = std::move(slot->value);
+        slot->seq.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    void wait_and_pop(T& popped_value)
+    {
+        constexpr int num_spins = 64;
+        for (int i = 0; i < num_spins; i++) {
+            if (check_wakeup()) {
+                throw ThreadsafeQueueWakeup();
+            }
+
+            if (try_pop(popped_value)) {
+                return;
+            }
+            std::this_thread::yield();
+        }
+
+        std::unique_lock<std::mutex> lock(m_wait_mutex);
+        m_consumer_waiting.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while (true) {
+            if (check_wakeup()) {
+                m_consumer_waiting.store(false);
+                throw ThreadsafeQueueWakeup();
+            }
+
+            if (try_pop(popped_value)) {
+                m_consumer_waiting.store(false);
+                return;
+            }
+
+            m_rx_notification.wait(lock);
+        }
+    }
+
+private:
+    struct slot_t {
+        std::atomic<size_t> seq;
+        T value;
+
+        slot_t() : seq(0), value() {}
+        // Only used when the vector is created
+        slot_t(slot_t&& other) : seq(other.seq.load()), value() {}
+    };
+
+    bool try_push(T& val)
+    {
+        size_t pos = m_head.load(std::memory_order_relaxed);
+        slot_t *slot = nullptr;
+
+        while (true) {
+            slot = &m_slots[pos & m_mask];
+            const size_t seq = slot->seq.load(std::memory_order_acquire);
+            const ptrdiff_t dif = (ptrdiff_t)seq - (ptrdiff_t)pos;
+
+            if (dif == 0) {
+                if (m_head.compare_exchange_weak(pos, pos + 1,
+                            std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+            else if (dif < 0) {
+                return false;
+            }
+            else {
+                pos = m_head.load(std::memory_order_relaxed);
+            }
+        }
+
+        slot->value = std::move(val);
+        slot->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool check_wakeup()
+    {
+        bool expected = true;
+        return m_wakeup_requested.compare_exchange_strong(expected, false);
+    }
+
+    void notify_consumer()
+    {
+        // Pairs with the fence in wait_and_pop: either the consumer sees
+        // the new element before sleeping, or we see that it sleeps.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_consumer_waiting.load()) {
+            std::unique_lock<std::mutex> lock(m_wait_mutex);
+            m_rx_notification.notify_one();
+        }
+    }
+
+    size_t m_mask = 0;
+    std::vector<slot_t> m_slots;
+
+    // Keep producer and consumer indices on separate cache lines
+    alignas(64) std::atomic<size_t> m_head = ATOMIC_VAR_INIT(0);
+    alignas(64) std::atomic<size_t> m_tail = ATOMIC_VAR_INIT(0);
+
+    std::atomic<bool> m_wakeup_requested = ATOMIC_VAR_INIT(false);
+    std::atomic<bool> m_consumer_waiting = ATOMIC_VAR_INIT(false);
+    std::mutex m_wait_mutex;
+    std::condition_variable m_rx_notification;
+};
@@ -23,7 +23,9 @@
 */
 
 #include "Socket.h"
+#include "Log.h"
 
+#include <algorithm>
 #include <stdexcept>
 #include <cstdio>
 #include <cstring>
@@ -31,6 +33,19 @@
 #include <fcntl.h>
 #include <poll.h>
 #include <netinet/tcp.h>
+#if defined(HAVE_LIBURING)
+#   include <liburing.h>
+#endif
+#if defined(__linux__)
+#   include <linux/filter.h>
+#   include <linux/if_packet.h>
+#   include <linux/net_tstamp.h>
+#   include <net/ethernet.h>
+#   include <net/if.h>
+#   include <netinet/ip.h>
+#   include <netinet/udp.h>
+#   include <sys/mman.h>
+#endif
 
 namespace Socket {
 
@@ -253,6 +268,70 @@ UDPSocket::~UDPSocket()
 }
 
 
+// Returns the packet info of a received message, or nullptr if the
+// message doesn't contain it.
+static struct in_pktinfo *get_pktinfo(struct msghdr *msg)
+{
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL;
+            cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO) {
+            return (struct in_pktinfo *)CMSG_DATA(cmsg);
+        }
+    }
+    return nullptr;
+}
+
+/* The arrival time in an SO_TIMESTAMPING control message, which contains
+ * the software timestamp, a legacy one and the hardware timestamp, zero if
+ * the NIC did not give one. */
+static chrono::system_clock::time_point timestamping_arrival(const struct cmsghdr *cmsg)
+{
+    struct timespec ts[3];
+    memcpy(ts, CMSG_DATA(cmsg), sizeof(ts));
+    const struct timespec& t = (ts[2].tv_sec != 0 or ts[2].tv_nsec != 0) ?
+        ts[2] : ts[0];
+    return chrono::system_clock::time_point(
+            chrono::duration_cast<chrono::system_clock::duration>(
+                chrono::seconds(t.tv_sec) + chrono::nanoseconds(t.tv_nsec)));
+}
+
+static bool is_timestamping(const struct cmsghdr *cmsg)
+{
+#if defined(__linux__)
+    return cmsg->cmsg_level == SOL_SOCKET and
+        cmsg->cmsg_type == SCM_TIMESTAMPING and
+        cmsg->cmsg_len >= CMSG_LEN(3 * sizeof(struct timespec));
+#else
+    (void)cmsg;
+    return false;
+#endif
+}
+
+// The arrival of a received message, or the epoch if it has no timestamp
+static chrono::system_clock::time_point get_arrival(struct msghdr *msg)
+{
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL;
+            cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        if (is_timestamping(cmsg)) {
+            return timestamping_arrival(cmsg);
+        }
+    }
+    return {};
+}
+
+// True if the packet is for the multicast group of the socket, if it has one
+static bool is_for_multicast_source(const struct in_pktinfo *pktinfo,
+        const string& multicast_source)
+{
+    if (pktinfo == nullptr or multicast_source.empty()) {
+        return true;
+    }
+
+    char dst_addr[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &(pktinfo->ipi_addr), dst_addr, INET_ADDRSTRLEN);
+    return strcmp(dst_addr, multicast_source.c_str()) == 0;
+}
+
 UDPPacket UDPSocket::receive(size_t max_size)
 {
     struct sockaddr_in addr;
@@ -260,7 +339,6 @@ UDPPacket UDPSocket::receive(size_t max_size)
     struct iovec iov;
     constexpr size_t BUFFER_SIZE = 1024;
     char control_buffer[BUFFER_SIZE];
-    struct cmsghdr *cmsg;
 
     UDPPacket packet(max_size);
 
@@ -290,14 +368,9 @@ UDPPacket UDPSocket::receive(size_t max_size)
         throw runtime_error(string("Can't receive data: ") + strerror(errno));
     }
 
-    struct in_pktinfo *pktinfo = nullptr;
-    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
-        if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO) {
-            pktinfo = (struct in_pktinfo *)CMSG_DATA(cmsg);
-            break;
-        }
-    }
+    packet.arrival = get_arrival(&msg);
 
+    struct in_pktinfo *pktinfo = get_pktinfo(&msg);
     if (pktinfo) {
         char src_addr[INET_ADDRSTRLEN];
         char dst_addr[INET_ADDRSTRLEN];
@@ -324,6 +397,72 @@ UDPPacket UDPSocket::receive(size_t max_size)
     return packet;
 }
 
+size_t UDPSocket::receive_many(UDPPacket *packets, size_t num_packets, size_t max_size)
+{
+    constexpr size_t MAX_PACKETS = 64;
+    num_packets = std::min(num_packets, MAX_PACKETS);
+
+    struct mmsghdr msgs[MAX_PACKETS];
+    struct iovec iovs[MAX_PACKETS];
+    struct sockaddr_in addrs[MAX_PACKETS];
+    // The packet info requested in post_init(), and the timestamps
+    union {
+        char buf[CMSG_SPACE(sizeof(struct in_pktinfo)) +
+            CMSG_SPACE(3 * sizeof(struct timespec))];
+        struct cmsghdr align;
+    } control_buffers[MAX_PACKETS];
+
+    memset(msgs, 0, num_packets * sizeof(msgs[0]));
+    for (size_t i = 0; i < num_packets; i++) {
+        packets[i].buffer.resize(max_size);
+        iovs[i].iov_base = packets[i].buffer.data();
+        iovs[i].iov_len = max_size;
+
+        struct msghdr& msg = msgs[i].msg_hdr;
+        msg.msg_name = &addrs[i];
+        msg.msg_namelen = sizeof(addrs[i]);
+        msg.msg_iov = &iovs[i];
+        msg.msg_iovlen = 1;
+        msg.msg_control = control_buffers[i].buf;
+        msg.msg_controllen = sizeof(control_buffers[i].buf);
+    }
+
+    const int ret = recvmmsg(m_sock, msgs, num_packets, MSG_DONTWAIT, nullptr);
+    if (ret == SOCKET_ERROR) {
+        // This suppresses the -Wlogical-op warning
+#if EAGAIN == EWOULDBLOCK
+        if (errno == EAGAIN)
+#else
+        if (errno == EAGAIN or errno == EWOULDBLOCK)
+#endif
+        {
+            return 0;
+        }
+        throw runtime_error(string("Can't receive data: ") + strerror(errno));
+    }
+
+    size_t num_received = 0;
+    for (size_t i = 0; i < (size_t)ret; i++) {
+        if (not is_for_multicast_source(get_pktinfo(&msgs[i].msg_hdr),
+                    m_multicast_source)) {
+            // Ignore packet for different multicast group
+            continue;
+        }
+
+        // The packets that were ignored get overwritten by the following ones
+        UDPPacket& packet = packets[num_received];
+        if (num_received != i) {
+            std::swap(packet.buffer, packets[i].buffer);
+        }
+        packet.buffer.resize(msgs[i].msg_len);
+        memcpy(&packet.address.addr, &addrs[i], sizeof(addrs[i]));
+        packet.arrival = get_arrival(&msgs[i].msg_hdr);
+        num_received++;
+    }
+
+    return num_received;
+}
+
 void UDPSocket::send(UDPPacket& packet)
 {
     const int ret = sendto(m_sock, packet.buffer.data(), packet.buffer.size(), 0,
@@ -352,6 +491,38 @@ void UDPSocket::send(const std::string& data, InetAddress destination)
     }
 }
 
+void UDPSocket::send_many(struct iovec *iovs, size_t iovs_per_packet,
+        size_t num_packets, InetAddress destination)
+{
+    constexpr size_t MAX_PACKETS = 64;
+    struct mmsghdr msgs[MAX_PACKETS];
+
+    size_t num_sent = 0;
+    while (num_sent < num_packets) {
+        const size_t n = std::min(num_packets - num_sent, MAX_PACKETS);
+
+        memset(msgs, 0, n * sizeof(msgs[0]));
+        for (size_t i = 0; i < n; i++) {
+            struct msghdr& msg = msgs[i].msg_hdr;
+            msg.msg_name = destination.as_sockaddr();
+            msg.msg_namelen = sizeof(*destination.as_sockaddr());
+            msg.msg_iov = &iovs[(num_sent + i) * iovs_per_packet];
+            msg.msg_iovlen = iovs_per_packet;
+        }
+
+        const int ret = sendmmsg(m_sock, msgs, n, 0);
+        if (ret == SOCKET_ERROR) {
+            if (errno == ECONNREFUSED) {
+                // Give up this batch like send() gives up the packet
+                num_sent += n;
+                continue;
+            }
+            throw runtime_error(string("Can't send UDP packets: ") + strerror(errno));
+        }
+        num_sent += ret;
+    }
+}
+
 void UDPSocket::join_group(const char* groupname, const char* if_addr)
 {
     ip_mreqn group;
@@ -396,6 +567,25 @@ void UDPSocket::setMulticastTTL(int ttl)
     }
 }
 
+void UDPSocket::enable_rx_timestamps(rx_timestamps_e timestamps)
+{
+    if (timestamps == rx_timestamps_e::none) {
+        return;
+    }
+#if defined(__linux__)
+    int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    if (timestamps == rx_timestamps_e::hardware) {
+        flags |= SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+    }
+    if (setsockopt(m_sock, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags))
+            == SOCKET_ERROR) {
+        throw runtime_error(string("Can't enable receive timestamps: ") + strerror(errno));
+    }
+#else
+    throw runtime_error("Receive timestamps need Linux");
+#endif
+}
+
 SOCKET UDPSocket::getNativeSocket() const
 {
     return m_sock;
@@ -406,6 +596,289 @@ int UDPSocket::getPort() const
     return m_port;
 }
 
+#if defined(HAVE_LIBURING)
+/* The kernel receives the packets into buffers it takes from a ring of
+ * provided buffers, every buffer holds the header of the message, the
+ * source address, the packet info and the packet. The buffers are given
+ * back to the ring once the packet is copied into the batch. */
+struct UDPReceiver::uring_t {
+    static constexpr unsigned NUM_ENTRIES = 64;
+    // Must be a power of two
+    static constexpr unsigned NUM_BUFFERS = 256;
+    static constexpr int BUFFER_GROUP = 0;
+    static constexpr size_t CONTROL_SIZE = CMSG_SPACE(sizeof(struct in_pktinfo)) +
+        CMSG_SPACE(3 * sizeof(struct timespec));
+    static constexpr size_t BUFFER_SIZE = sizeof(struct io_uring_recvmsg_out) +
+        sizeof(struct sockaddr_in) + CONTROL_SIZE + MAX_PACKET_SIZE;
+
+    struct io_uring ring;
+    struct io_uring_buf_ring *buf_ring = nullptr;
+    std::vector<uint8_t> buffers;
+
+    // Only the sizes of the address and of the control data are used by
+    // the multishot recvmsg
+    struct msghdr msg = {};
+
+    uring_t()
+    {
+        int ret = io_uring_queue_init(NUM_ENTRIES, &ring, 0);
+        if (ret < 0) {
+            throw runtime_error(string("io_uring_queue_init: ") + strerror(-ret));
+        }
+
+        buf_ring = io_uring_setup_buf_ring(&ring, NUM_BUFFERS, BUFFER_GROUP, 0, &ret);
+        if (buf_ring == nullptr) {
+            io_uring_queue_exit(&ring);
+            throw runtime_error(string("io_uring_setup_buf_ring: ") + strerror(-ret));
+        }
+
+        buffers.resize(NUM_BUFFERS * BUFFER_SIZE);
+        for (unsigned bid = 0; bid < NUM_BUFFERS; bid++) {
+            io_uring_buf_ring_add(buf_ring, buffers.data() + bid * BUFFER_SIZE,
+                    BUFFER_SIZE, bid, io_uring_buf_ring_mask(NUM_BUFFERS), bid);
+        }
+        io_uring_buf_ring_advance(buf_ring, NUM_BUFFERS);
+
+        msg.msg_namelen = sizeof(struct sockaddr_in);
+        msg.msg_controllen = CONTROL_SIZE;
+    }
+
+    ~uring_t()
+    {
+        io_uring_free_buf_ring(&ring, buf_ring, NUM_BUFFERS, BUFFER_GROUP);
+        io_uring_queue_exit(&ring);
+    }
+
+    // Start the multishot recvmsg of the socket, which stays armed until
+    // it completes without IORING_CQE_F_MORE
+    void arm(SOCKET sock, size_t socket_index)
+    {
+        struct io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+        if (sqe == nullptr) {
+            io_uring_submit(&ring);
+            sqe = io_uring_get_sqe(&ring);
+        }
+        io_uring_prep_recvmsg_multishot(sqe, sock, &msg, 0);
+        sqe->flags |= IOSQE_BUFFER_SELECT;
+        sqe->buf_group = BUFFER_GROUP;
+        io_uring_sqe_set_data64(sqe, socket_index);
+
+        const int ret = io_uring_submit(&ring);
+        if (ret < 0) {
+            throw runtime_error(string("io_uring_submit: ") + strerror(-ret));
+        }
+    }
+
+    uint8_t *buffer(unsigned bid) { return buffers.data() + bid * BUFFER_SIZE; }
+
+    void give_back(unsigned bid)
+    {
+        io_uring_buf_ring_add(buf_ring, buffer(bid), BUFFER_SIZE, bid,
+                io_uring_buf_ring_mask(NUM_BUFFERS), 0);
+        io_uring_buf_ring_advance(buf_ring, 1);
+    }
+};
+#else
+struct UDPReceiver::uring_t {};
+#endif
+
+#if defined(__linux__)
+static void attach_filter(SOCKET sock, vector<struct sock_filter>& code)
+{
+    struct sock_fprog prog = {};
+    prog.len = code.size();
+    prog.filter = code.data();
+    if (setsockopt(sock, SOL_SOCKET, SO_ATTACH_FILTER,
+                &prog, sizeof(prog)) == -1) {
+        throw runtime_error(string("SO_ATTACH_FILTER: ") + strerror(errno));
+    }
+}
+
+/* A TPACKET_V3 ring: the kernel fills blocks with the packets that pass
+ * the filter, and hands a block over once it is full or after
+ * RETIRE_TIMEOUT_MS. The socket is SOCK_DGRAM, the packets start at the IP
+ * header. */
+struct UDPReceiver::packet_ring_t {
+    static constexpr unsigned BLOCK_SIZE = 1 << 18;
+    static constexpr unsigned NUM_BLOCKS = 32;
+    // Holds the headers of the ring and a packet of MAX_PACKET_SIZE
+    static constexpr unsigned FRAME_SIZE = 4096;
+    static constexpr unsigned RETIRE_TIMEOUT_MS = 2;
+
+    SOCKET sock = INVALID_SOCKET;
+    uint8_t *map = nullptr;
+    size_t map_size = 0;
+
+    // The block the receive is in, and its packets not received yet
+    unsigned block = 0;
+    bool block_owned = false;
+    const uint8_t *next_packet = nullptr;
+    uint32_t packets_left = 0;
+
+    // The packets get the timestamps of the ring
+    bool timestamps = false;
+
+    packet_ring_t(const string& interface, rx_timestamps_e rx_timestamps)
+    {
+        const unsigned ifindex = if_nametoindex(interface.c_str());
+        if (ifindex == 0) {
+            throw runtime_error("unknown interface " + interface);
+        }
+
+        sock = ::socket(AF_PACKET, SOCK_DGRAM, htons(ETH_P_IP));
+        if (sock == INVALID_SOCKET) {
+            throw runtime_error(string("AF_PACKET socket: ") + strerror(errno));
+        }
+
+        try {
+            // Nothing passes until the ports are known
+            update_filter();
+
+            int version = TPACKET_V3;
+            if (setsockopt(sock, SOL_PACKET, PACKET_VERSION,
+                        &version, sizeof(version)) == -1) {
+                throw runtime_error(string("PACKET_VERSION: ") + strerror(errno));
+            }
+
+            timestamps = rx_timestamps != rx_timestamps_e::none;
+            if (rx_timestamps == rx_timestamps_e::hardware) {
+                int ts = SOF_TIMESTAMPING_RAW_HARDWARE;
+                if (setsockopt(sock, SOL_PACKET, PACKET_TIMESTAMP,
+                            &ts, sizeof(ts)) == -1) {
+                    throw runtime_error(string("PACKET_TIMESTAMP: ") + strerror(errno));
+                }
+            }
+
+            struct tpacket_req3 req = {};
+            req.tp_block_size = BLOCK_SIZE;
+            req.tp_block_nr = NUM_BLOCKS;
+            req.tp_frame_size = FRAME_SIZE;
+            req.tp_frame_nr = BLOCK_SIZE / FRAME_SIZE * NUM_BLOCKS;
+            req.tp_retire_blk_tov = RETIRE_TIMEOUT_MS;
+            if (setsockopt(sock, SOL_PACKET, PACKET_RX_RING,
+                        &req, sizeof(req)) == -1) {
+                throw runtime_error(string("PACKET_RX_RING: ") + strerror(errno));
+            }
+
+            map_size = (size_t)BLOCK_SIZE * NUM_BLOCKS;
+            void *m = mmap(nullptr, map_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_LOCKED, sock, 0);
+            if (m == MAP_FAILED) {
+                // Without the permission to lock the memory
+                m = mmap(nullptr, map_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, sock, 0);
+            }
+            if (m == MAP_FAILED) {
+                throw runtime_error(string("mmap of the ring: ") + strerror(errno));
+            }
+            map = reinterpret_cast<uint8_t*>(m);
+
+            struct sockaddr_ll addr = {};
+            addr.sll_family = AF_PACKET;
+            addr.sll_protocol = htons(ETH_P_IP);
+            addr.sll_ifindex = ifindex;
+            if (::bind(sock, reinterpret_cast<struct sockaddr*>(&addr),
+                        sizeof(addr)) == -1) {
+                throw runtime_error(string("bind to ") + interface + ": " +
+                        strerror(errno));
+            }
+        }
+        catch (const runtime_error&) {
+            close_ring();
+            throw;
+        }
+    }
+
+    ~packet_ring_t() { close_ring(); }
+
+    void close_ring()
+    {
+        if (map) {
+            munmap(map, map_size);
+            map = nullptr;
+        }
+        if (sock != INVALID_SOCKET) {
+            ::close(sock);
+            sock = INVALID_SOCKET;
+        }
+    }
+
+    struct port_t {
+        int port;
+        // The multicast group in network byte order, 0 for unicast
+        in_addr_t group;
+    };
+    // Like the sockets of the receiver
+    vector<port_t> ports;
+
+    /* Only let the IPv4 UDP packets to one of the ports through, that are
+     * not fragments. With the offsets from the IP header:
+     *   ldb [9]; jne #17, drop; ldh [6]; jset #0x3fff, drop;
+     *   ldxb 4*([0]&0xf); ldh [x+2]; jeq #port, accept; ...; drop
+     */
+    void update_filter()
+    {
+        const size_t n = ports.size();
+        if (n > 250) {
+            throw logic_error("Too many ports for the packet ring filter");
+        }
+
+        vector<struct sock_filter> code;
+        code.push_back(BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 9));
+        code.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP,
+                    0, (uint8_t)(n + 4)));
+        code.push_back(BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 6));
+        code.push_back(BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x3fff,
+                    (uint8_t)(n + 2), 0));
+        code.push_back(BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 0));
+        code.push_back(BPF_STMT(BPF_LD | BPF_H | BPF_IND, 2));
+        for (size_t i = 0; i < n; i++) {
+            code.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,
+                        (uint32_t)ports[i].port, (uint8_t)(n - i), 0));
+        }
+        code.push_back(BPF_STMT(BPF_RET | BPF_K, 0));
+        code.push_back(BPF_STMT(BPF_RET | BPF_K, 0xFFFF));
+
+        attach_filter(sock, code);
+    }
+
+    struct tpacket_block_desc *block_desc(unsigned b)
+    {
+        return reinterpret_cast<struct tpacket_block_desc*>(
+                map + (size_t)b * BLOCK_SIZE);
+    }
+
+    // Takes the next block if the kernel handed it over
+    bool take_block()
+    {
+        auto *bd = block_desc(block);
+        if ((__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) &
+                    TP_STATUS_USER) == 0) {
+            return false;
+        }
+        block_owned = true;
+        packets_left = bd->hdr.bh1.num_pkts;
+        next_packet = reinterpret_cast<const uint8_t*>(bd) +
+            bd->hdr.bh1.offset_to_first_pkt;
+        return true;
+    }
+
+    void give_back_block()
+    {
+        __atomic_store_n(&block_desc(block)->hdr.bh1.block_status,
+                TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+        block = (block + 1) % NUM_BLOCKS;
+        block_owned = false;
+    }
+};
+#else
+struct UDPReceiver::packet_ring_t {};
+#endif
+
+UDPReceiver::UDPReceiver() {}
+
+UDPReceiver::~UDPReceiver() {}
+
 void UDPReceiver::add_receive_port(int port, const string& bindto, const string& mcastaddr) {
     UDPSocket sock;
 
@@ -417,12 +890,85 @@ void UDPReceiver::add_receive_port(int port, const string& bindto, const string&
     }
 
     m_sockets.push_back(std::move(sock));
+
+#if defined(__linux__)
+    if (m_sockets.size() == 1 and not m_packet_ring_interface.empty()) {
+        try {
+            m_packet_ring = make_unique<packet_ring_t>(m_packet_ring_interface,
+                    m_rx_timestamps);
+        }
+        catch (const runtime_error& e) {
+            etiLog.level(warn) << "UDPReceiver: PACKET_MMAP ring on " <<
+                m_packet_ring_interface << " unavailable, using the sockets: " <<
+                e.what();
+        }
+    }
+
+    if (m_packet_ring) {
+        const auto& s = m_sockets.back();
+        in_addr_t group = 0;
+        if (IN_MULTICAST(ntohl(inet_addr(mcastaddr.c_str())))) {
+            group = inet_addr(mcastaddr.c_str());
+        }
+        m_packet_ring->ports.push_back({port, group});
+        m_packet_ring->update_filter();
+
+        // The socket keeps the membership, and drops the packets the ring
+        // receives
+        vector<struct sock_filter> drop_all = {BPF_STMT(BPF_RET | BPF_K, 0)};
+        attach_filter(s.getNativeSocket(), drop_all);
+        return;
+    }
+#endif
+
+    m_sockets.back().enable_rx_timestamps(m_rx_timestamps);
+
+#if defined(HAVE_LIBURING)
+    // Set up with the first port. If the kernel does not support io_uring,
+    // the sockets are polled.
+    if (m_sockets.size() == 1) {
+        try {
+            m_uring = make_unique<uring_t>();
+        }
+        catch (const runtime_error& e) {
+            etiLog.level(warn) << "UDPReceiver: io_uring unavailable, "
+                "using poll(): " << e.what();
+        }
+    }
+
+    if (m_uring) {
+        m_uring->arm(m_sockets.back().getNativeSocket(), m_sockets.size() - 1);
+    }
+#endif
 }
 
-vector<UDPReceiver::ReceivedPacket> UDPReceiver::receive(int timeout_ms)
+void UDPReceiver::set_packet_ring_interface(const string& interface)
+{
+    if (not m_sockets.empty()) {
+        throw logic_error("UDPReceiver: the packet ring must be set up "
+                "before the ports");
+    }
+#if defined(__linux__)
+    m_packet_ring_interface = interface;
+#else
+    if (not interface.empty()) {
+        etiLog.level(warn) << "UDPReceiver: PACKET_MMAP rings need Linux, "
+            "using the sockets";
+    }
+#endif
+}
+
+void UDPReceiver::set_rx_timestamps(rx_timestamps_e timestamps)
+{
+    if (not m_sockets.empty()) {
+        throw logic_error("UDPReceiver: the timestamps must be set up "
+                "before the ports");
+    }
+    m_rx_timestamps = timestamps;
+}
+
+void UDPReceiver::wait_for_packets(struct pollfd *fds, int timeout_ms)
 {
-    constexpr size_t MAX_FDS = 64;
-    struct pollfd fds[MAX_FDS];
     if (m_sockets.size() > MAX_FDS) {
         throw std::runtime_error("UDPReceiver only supports up to 64 ports");
     }
@@ -441,29 +987,338 @@ vector<UDPReceiver::ReceivedPacket> UDPReceiver::receive(int timeout_ms)
         std::string errstr(strerror(errno));
         throw std::runtime_error("UDP receive with poll() error: " + errstr);
     }
-    else if (retval > 0) {
+    else if (retval == 0) {
+        throw Timeout();
+    }
+}
+
+vector<UDPReceiver::ReceivedPacket> UDPReceiver::receive(int timeout_ms)
+{
+    if (m_uring or m_packet_ring) {
+        // The multishot receive or the ring takes the packets from the
+        // sockets
         vector<ReceivedPacket> received;
+        const size_t n = receive_batch(timeout_ms);
+        for (size_t i = 0; i < n; i++) {
+            ReceivedPacket rp;
+            rp.packetdata = m_batch[i].buffer;
+            rp.received_from = m_batch[i].address;
+            rp.port_received_on = m_batch_ports[i];
+            received.push_back(std::move(rp));
+        }
+        return received;
+    }
 
-        for (size_t i = 0; i < m_sockets.size(); i++) {
-            if (fds[i].revents & POLLIN) {
-                auto p = m_sockets[i].receive(2048); // This is larger than the usual MTU
-                if (not p.buffer.empty()) {
-                    ReceivedPacket rp;
-                    rp.packetdata = std::move(p.buffer);
-                    rp.received_from = std::move(p.address);
-                    rp.port_received_on = m_sockets[i].getPort();
-                    received.push_back(std::move(rp));
-                }
+    struct pollfd fds[MAX_FDS];
+    wait_for_packets(fds, timeout_ms);
+
+    vector<ReceivedPacket> received;
+
+    for (size_t i = 0; i < m_sockets.size(); i++) {
+        if (fds[i].revents & POLLIN) {
+            auto p = m_sockets[i].receive(MAX_PACKET_SIZE);
+            if (not p.buffer.empty()) {
+                ReceivedPacket rp;
+                rp.packetdata = std::move(p.buffer);
+                rp.received_from = std::move(p.address);
+                rp.port_received_on = m_sockets[i].getPort();
+                received.push_back(std::move(rp));
             }
         }
+    }
 
-        return received;
+    return received;
+}
+
+void UDPReceiver::allocate_batch()
+{
+    if (m_batch.empty()) {
+        m_batch.reserve(MAX_BATCH_PACKETS);
+        for (size_t i = 0; i < MAX_BATCH_PACKETS; i++) {
+            m_batch.emplace_back(MAX_PACKET_SIZE);
+        }
+        m_batch_ports.resize(MAX_BATCH_PACKETS);
+    }
+}
+
+size_t UDPReceiver::receive_batch(int timeout_ms)
+{
+    if (m_packet_ring) {
+        return receive_batch_ring(timeout_ms);
+    }
+
+    if (m_uring) {
+        return receive_batch_uring(timeout_ms);
+    }
+
+    struct pollfd fds[MAX_FDS];
+    wait_for_packets(fds, timeout_ms);
+
+    allocate_batch();
+
+    size_t num_received = 0;
+    for (size_t i = 0; i < m_sockets.size() and
+            num_received < MAX_BATCH_PACKETS; i++) {
+        if (fds[i].revents & POLLIN) {
+            const size_t n = m_sockets[i].receive_many(&m_batch[num_received],
+                    MAX_BATCH_PACKETS - num_received, MAX_PACKET_SIZE);
+            for (size_t j = num_received; j < num_received + n; j++) {
+                m_batch_ports[j] = m_sockets[i].getPort();
+            }
+            num_received += n;
+        }
+    }
+
+    return num_received;
+}
+
+#if defined(HAVE_LIBURING)
+size_t UDPReceiver::receive_batch_uring(int timeout_ms)
+{
+    allocate_batch();
+    auto& ring = m_uring->ring;
+
+    // Like poll(), 0 does not wait and a negative timeout waits forever
+    struct io_uring_cqe *cqe = nullptr;
+    int ret = 0;
+    if (timeout_ms == 0) {
+        ret = io_uring_peek_cqe(&ring, &cqe);
+    }
+    else if (timeout_ms < 0) {
+        ret = io_uring_wait_cqe(&ring, &cqe);
     }
     else {
+        struct __kernel_timespec ts;
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+        ret = io_uring_wait_cqe_timeout(&ring, &cqe, &ts);
+    }
+
+    if (ret == -ETIME or ret == -EAGAIN) {
         throw Timeout();
     }
+    else if (ret == -EINTR) {
+        throw Interrupted();
+    }
+    else if (ret < 0) {
+        throw runtime_error(string("UDP receive with io_uring error: ") + strerror(-ret));
+    }
+
+    size_t num_received = 0;
+    unsigned num_seen = 0;
+    int error = 0;
+    vector<size_t> to_rearm;
+
+    unsigned head;
+    io_uring_for_each_cqe(&ring, head, cqe) {
+        if (num_received == MAX_BATCH_PACKETS) {
+            break;
+        }
+        num_seen++;
+
+        const size_t index = io_uring_cqe_get_data64(cqe);
+        if (not (cqe->flags & IORING_CQE_F_MORE)) {
+            to_rearm.push_back(index);
+        }
+
+        if (cqe->res < 0) {
+            // Without buffer, the receive stops and gets rearmed, the
+            // packets wait in the socket meanwhile
+            if (cqe->res != -ENOBUFS) {
+                error = cqe->res;
+            }
+            continue;
+        }
+
+        if (not (cqe->flags & IORING_CQE_F_BUFFER)) {
+            continue;
+        }
+
+        const unsigned bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        auto *out = io_uring_recvmsg_validate(m_uring->buffer(bid), cqe->res,
+                &m_uring->msg);
+
+        struct in_pktinfo *pktinfo = nullptr;
+        chrono::system_clock::time_point arrival;
+        if (out) {
+            for (struct cmsghdr *cmsg = io_uring_recvmsg_cmsg_firsthdr(out, &m_uring->msg);
+                    cmsg != nullptr;
+                    cmsg = io_uring_recvmsg_cmsg_nexthdr(out, &m_uring->msg, cmsg)) {
+                if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO) {
+                    pktinfo = (struct in_pktinfo *)CMSG_DATA(cmsg);
+                }
+                else if (is_timestamping(cmsg)) {
+                    arrival = timestamping_arrival(cmsg);
+                }
+            }
+        }
+
+        if (out and is_for_multicast_source(pktinfo,
+                    m_sockets[index].getMulticastSource())) {
+            const uint8_t *payload = reinterpret_cast<const uint8_t*>(
+                    io_uring_recvmsg_payload(out, &m_uring->msg));
+            const size_t len = io_uring_recvmsg_payload_length(out, cqe->res,
+                    &m_uring->msg);
+
+            UDPPacket& packet = m_batch[num_received];
+            packet.buffer.assign(payload, payload + len);
+            memcpy(&packet.address.addr, io_uring_recvmsg_name(out),
+                    sizeof(struct sockaddr_in));
+            packet.arrival = arrival;
+            m_batch_ports[num_received] = m_sockets[index].getPort();
+            num_received++;
+        }
+
+        m_uring->give_back(bid);
+    }
+    io_uring_cq_advance(&ring, num_seen);
+
+    for (const size_t index : to_rearm) {
+        m_uring->arm(m_sockets[index].getNativeSocket(), index);
+    }
+
+    if (error != 0) {
+        throw runtime_error(string("UDP receive with io_uring error: ") + strerror(-error));
+    }
+
+    return num_received;
+}
+#else
+size_t UDPReceiver::receive_batch_uring(int)
+{
+    throw logic_error("UDPReceiver built without io_uring");
+}
+#endif
+
+#if defined(__linux__)
+size_t UDPReceiver::receive_batch_ring(int timeout_ms)
+{
+    allocate_batch();
+    auto& ring = *m_packet_ring;
+
+    size_t num_received = 0;
+    while (num_received < MAX_BATCH_PACKETS) {
+        if (not ring.block_owned and not ring.take_block()) {
+            if (num_received > 0) {
+                break;
+            }
+
+            struct pollfd pfd = {};
+            pfd.fd = ring.sock;
+            pfd.events = POLLIN | POLLERR;
+            const int retval = poll(&pfd, 1, timeout_ms);
+            if (retval == -1 and errno == EINTR) {
+                throw Interrupted();
+            }
+            else if (retval == -1) {
+                std::string errstr(strerror(errno));
+                throw std::runtime_error("UDP receive with poll() error: " + errstr);
+            }
+            else if (retval == 0) {
+                throw Timeout();
+            }
+
+            if (not ring.take_block()) {
+                break;
+            }
+        }
+
+        while (ring.packets_left > 0 and num_received < MAX_BATCH_PACKETS) {
+            const auto *hdr = reinterpret_cast<const struct tpacket3_hdr*>(
+                    ring.next_packet);
+            const auto *ll = reinterpret_cast<const struct sockaddr_ll*>(
+                    ring.next_packet + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+            const uint8_t *ip = ring.next_packet + hdr->tp_net;
+            const size_t len = hdr->tp_snaplen;
+
+            ring.next_packet += hdr->tp_next_offset;
+            ring.packets_left--;
+
+            // The filter only lets unfragmented UDP packets through
+            const size_t ihl = (ip[0] & 0x0F) * 4;
+            if (ll->sll_pkttype == PACKET_OUTGOING or
+                    len < ihl + sizeof(struct udphdr)) {
+                continue;
+            }
+
+            struct iphdr iph;
+            struct udphdr udph;
+            memcpy(&iph, ip, sizeof(iph));
+            memcpy(&udph, ip + ihl, sizeof(udph));
+
+            const int port = ntohs(udph.dest);
+            size_t index = 0;
+            while (index < ring.ports.size() and ring.ports[index].port != port) {
+                index++;
+            }
+            if (index == ring.ports.size() or (ring.ports[index].group != 0 and
+                        ring.ports[index].group != iph.daddr)) {
+                continue;
+            }
+
+            const size_t udp_len = ntohs(udph.len);
+            if (udp_len < sizeof(udph) or ihl + udp_len > len) {
+                continue;
+            }
+
+            const uint8_t *payload = ip + ihl + sizeof(udph);
+            UDPPacket& packet = m_batch[num_received];
+            packet.buffer.assign(payload, payload + udp_len - sizeof(udph));
+
+            struct sockaddr_in from = {};
+            from.sin_family = AF_INET;
+            from.sin_port = udph.source;
+            from.sin_addr.s_addr = iph.saddr;
+            memcpy(&packet.address.addr, &from, sizeof(from));
+
+            // With PACKET_TIMESTAMP, the packets without hardware timestamp
+            // get the software one
+            packet.arrival = {};
+            if (ring.timestamps) {
+                packet.arrival = chrono::system_clock::time_point(
+                        chrono::duration_cast<chrono::system_clock::duration>(
+                            chrono::seconds(hdr->tp_sec) +
+                            chrono::nanoseconds(hdr->tp_nsec)));
+            }
+
+            m_batch_ports[num_received] = port;
+            num_received++;
+        }
+
+        if (ring.packets_left == 0) {
+            ring.give_back_block();
+        }
+    }
+
+    return num_received;
 }
+#else
+size_t UDPReceiver::receive_batch_ring(int)
+{
+    throw logic_error("UDPReceiver built without PACKET_MMAP rings");
+}
+#endif
 
+std::vector<SOCKET> UDPReceiver::getNativeSockets() const
+{
+#if defined(__linux__)
+    if (m_packet_ring) {
+        return {m_packet_ring->sock};
+    }
+#endif
+
+#if defined(HAVE_LIBURING)
+    if (m_uring) {
+        return {m_uring->ring.ring_fd};
+    }
+#endif
+
+    std::vector<SOCKET> sockets;
+    for (const auto& sock : m_sockets) {
+        sockets.push_back(sock.getNativeSocket());
+    }
+    return sockets;
+}
 
 TCPSocket::TCPSocket()
 {
@@ -894,6 +1749,42 @@ ssize_t TCPSocket::send(const void* data, size_t size, int timeout_ms)
     return ret;
 }
 
+ssize_t TCPSocket::send(const struct iovec *iov, size_t iovcnt, int timeout_ms)
+{
+    if (timeout_ms) {
+        struct pollfd fds[1];
+        fds[0].fd = m_sock;
+        fds[0].events = POLLOUT;
+
+        const int retval = poll(fds, 1, timeout_ms);
+
+        if (retval == -1) {
+            throw std::runtime_error(string("TCP Socket send error on poll(): ") + strerror(errno));
+        }
+        else if (retval == 0) {
+            // Timed out
+            return 0;
+        }
+    }
+
+    // sendmsg() instead of writev(), which does not take MSG_NOSIGNAL
+    struct msghdr msg = {};
+    msg.msg_iov = const_cast<struct iovec*>(iov);
+    msg.msg_iovlen = iovcnt;
+
+#if defined(HAVE_MSG_NOSIGNAL)
+    const int flags = MSG_NOSIGNAL;
+#else
+    const int flags = 0;
+#endif
+    const ssize_t ret = ::sendmsg(m_sock, &msg, flags);
+
+    if (ret == SOCKET_ERROR) {
+            throw std::runtime_error(string("TCP Socket send error: ") + strerror(errno));
+    }
+    return ret;
+}
+
 ssize_t TCPSocket::recv(void *buffer, size_t length, int flags)
 {
     ssize_t ret = ::recv(m_sock, buffer, length, flags);
@@ -975,20 +1866,23 @@ ssize_t TCPClient::recv(void *buffer, size_t length, int flags, int timeout_ms)
         return -1;
     }
     catch (const TCPSocket::Timeout&) {
-        const auto timeout = chrono::milliseconds(timeout_ms * 5);
-        if (m_last_received_packet_ts.has_value() and
-            chrono::steady_clock::now() - *m_last_received_packet_ts > timeout)
-        {
-            // This is to catch half-closed TCP connections
-            reconnect();
-        }
-
+        // This is to catch half-closed TCP connections
+        reconnect_if_idle(chrono::milliseconds(timeout_ms * 5));
         return 0;
     }
 
     throw std::logic_error("unreachable");
 }
 
+void TCPClient::reconnect_if_idle(chrono::steady_clock::duration timeout)
+{
+    if (m_last_received_packet_ts.has_value() and
+        chrono::steady_clock::now() - *m_last_received_packet_ts > timeout)
+    {
+        reconnect();
+    }
+}
+
 void TCPClient::reconnect()
 {
     TCPSocket newsock;
@@ -1016,37 +1910,77 @@ TCPConnection::TCPConnection(TCPSocket&& sock) :
 TCPConnection::~TCPConnection()
 {
     m_running = false;
-    vector<uint8_t> termination_marker;
-    queue.push(termination_marker);
+    queue.push(nullptr);
     if (m_sender_thread.joinable()) {
         m_sender_thread.join();
     }
 }
 
+void TCPConnection::push(const shared_buffer_t& data)
+{
+    m_queued_bytes += data->size();
+    queue.push(data);
+}
+
+// Number of queued buffers a connection sends with one system call
+static constexpr size_t MAX_BUFFERS_PER_SEND = 16;
+
 void TCPConnection::process()
 {
+    vector<shared_buffer_t> batch;
+    vector<struct iovec> iov;
+    batch.reserve(MAX_BUFFERS_PER_SEND);
+    iov.reserve(MAX_BUFFERS_PER_SEND);
+
     while (m_running) {
-        vector<uint8_t> data;
+        // Take the buffers that are waiting, up to the termination marker
+        batch.clear();
+        shared_buffer_t data;
         queue.wait_and_pop(data);
+        batch.push_back(std::move(data));
+        queue.pop_up_to(batch, MAX_BUFFERS_PER_SEND - 1);
 
-        if (data.empty()) {
-            // empty vector is the termination marker
+        const auto marker = find(batch.begin(), batch.end(), nullptr);
+        if (marker != batch.end()) {
             m_running = false;
-            break;
+            batch.erase(marker, batch.end());
+        }
+        batch.erase(remove_if(batch.begin(), batch.end(),
+                    [](const shared_buffer_t& b) { return b->empty(); }),
+                batch.end());
+
+        iov.clear();
+        for (const auto& buf : batch) {
+            struct iovec v;
+            v.iov_base = const_cast<uint8_t*>(buf->data());
+            v.iov_len = buf->size();
+            iov.push_back(v);
         }
 
         try {
-            ssize_t remaining = data.size();
-            const uint8_t *buf = reinterpret_cast<const uint8_t*>(data.data());
             const int timeout_ms = 10; // Less than one ETI frame
 
-            while (m_running and remaining > 0) {
-                const ssize_t sent = m_sock.send(buf, remaining, timeout_ms);
-                if (sent < 0 or sent > remaining) {
+            size_t first = 0;
+            while (m_running and first < iov.size()) {
+                const ssize_t sent = m_sock.send(&iov[first], iov.size() - first, timeout_ms);
+                if (sent < 0) {
                     throw std::logic_error("Invalid TCPSocket::send() return value");
                 }
-                remaining -= sent;
-                buf += sent;
+
+                // Skip the buffers that are completely sent
+                size_t remaining = sent;
+                while (first < iov.size() and remaining >= iov[first].iov_len) {
+                    remaining -= iov[first].iov_len;
+                    m_queued_bytes -= batch[first]->size();
+                    first++;
+                }
+                if (remaining > 0) {
+                    if (first == iov.size()) {
+                        throw std::logic_error("Invalid TCPSocket::send() return value");
+                    }
+                    iov[first].iov_base = reinterpret_cast<uint8_t*>(iov[first].iov_base) + remaining;
+                    iov[first].iov_len -= remaining;
+                }
             }
         }
         catch (const std::runtime_error& e) {
@@ -1064,9 +1998,11 @@ void TCPConnection::process()
 }
 
 
-TCPDataDispatcher::TCPDataDispatcher(size_t max_queue_size, size_t buffers_to_preroll) :
+TCPDataDispatcher::TCPDataDispatcher(size_t max_queue_size, size_t buffers_to_preroll,
+        size_t max_queue_bytes) :
     m_max_queue_size(max_queue_size),
-    m_buffers_to_preroll(buffers_to_preroll)
+    m_buffers_to_preroll(buffers_to_preroll),
+    m_max_queue_bytes(max_queue_bytes)
 {
 }
 
@@ -1089,6 +2025,11 @@ void TCPDataDispatcher::start(int port, const string& address)
 }
 
 void TCPDataDispatcher::write(const vector<uint8_t>& data)
+{
+    write(make_shared<const vector<uint8_t> >(data));
+}
+
+void TCPDataDispatcher::write(const shared_buffer_t& data)
 {
     if (not m_running) {
         throw runtime_error(m_exception_data);
@@ -1104,10 +2045,12 @@ void TCPDataDispatcher::write(const vector<uint8_t>& data)
     }
 
     for (auto& connection : m_connections) {
-        connection.queue.push(data);
+        connection.push(data);
     }
 
-    m_connections.remove_if( [&](const TCPConnection& conn){ return conn.queue.size() > m_max_queue_size; });
+    m_connections.remove_if( [&](const TCPConnection& conn){
+            return conn.queue_size() > m_max_queue_size or
+                (m_max_queue_bytes > 0 and conn.queued_bytes() > m_max_queue_bytes); });
 }
 
 void TCPDataDispatcher::process()
@@ -1124,7 +2067,7 @@ void TCPDataDispatcher::process()
 
                 if (m_buffers_to_preroll > 0) {
                     for (const auto& buf : m_preroll_queue) {
-                        m_connections.front().queue.push(buf);
+                        m_connections.front().push(buf);
                     }
                 }
             }
@@ -1234,6 +2177,11 @@ TCPSendClient::~TCPSendClient()
 }
 
 TCPSendClient::ErrorStats TCPSendClient::sendall(const std::vector<uint8_t>& buffer)
+{
+    return sendall(make_shared<const vector<uint8_t> >(buffer));
+}
+
+TCPSendClient::ErrorStats TCPSendClient::sendall(const shared_buffer_t& buffer)
 {
     if (not m_running) {
         throw runtime_error(m_exception_data);
@@ -1242,7 +2190,7 @@ TCPSendClient::ErrorStats TCPSendClient::sendall(const std::vector<uint8_t>& buf
     m_queue.push(buffer);
 
     if (m_queue.size() > MAX_QUEUE_SIZE) {
-        vector<uint8_t> discard;
+        shared_buffer_t discard;
         m_queue.try_pop(discard);
     }
 
@@ -1264,9 +2212,9 @@ void TCPSendClient::process()
         while (m_running) {
             if (m_is_connected) {
                 try {
-                    vector<uint8_t> incoming;
+                    shared_buffer_t incoming;
                     m_queue.wait_and_pop(incoming);
-                    if (m_sock.sendall(incoming.data(), incoming.size()) == -1) {
+                    if (m_sock.sendall(incoming->data(), incoming->size()) == -1) {
                         m_is_connected = false;
                         m_sock = TCPSocket();
                     }
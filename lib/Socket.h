@@ -40,7 +40,9 @@
 #include <vector>
 
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <unistd.h>
 #include <netdb.h>
 #include <arpa/inet.h>
@@ -52,6 +54,11 @@
 
 namespace Socket {
 
+/* The data given to the TCP senders, shared by all the connections it is
+ * sent on instead of being copied into each of their queues. It must not
+ * be modified once given. */
+using shared_buffer_t = std::shared_ptr<const std::vector<uint8_t> >;
+
 struct InetAddress {
     struct sockaddr_storage addr = {};
 
@@ -76,8 +83,19 @@ class UDPPacket
 
         std::vector<uint8_t> buffer;
         InetAddress address;
+
+        // When the kernel or the NIC received an incoming packet, the
+        // epoch if the socket does not have receive timestamps
+        std::chrono::system_clock::time_point arrival;
 };
 
+/* The receive timestamps of the kernel: none, the time at which the kernel
+ * received the packet, or the time the NIC put into it, with the software
+ * one for the packets without. The hardware timestamps must be enabled on
+ * the interface, e.g. with hwstamp_ctl, and its clock must follow the
+ * system clock, e.g. with phc2sys. */
+enum class rx_timestamps_e { none, software, hardware };
+
 /**
  *  This class represents a socket for sending and receiving UDP packets.
  *
@@ -119,10 +137,29 @@ class UDPSocket
         void send(UDPPacket& packet);
         void send(const std::vector<uint8_t>& data, InetAddress destination);
         void send(const std::string& data, InetAddress destination);
+        /** Send num_packets packets to the destination with as few
+         * sendmmsg() calls as possible. Packet i consists of the
+         * iovs_per_packet buffers starting at iovs[i * iovs_per_packet].
+         * Throws a runtime_error on error.
+         */
+        void send_many(struct iovec *iovs, size_t iovs_per_packet,
+                size_t num_packets, InetAddress destination);
         UDPPacket receive(size_t max_size);
+        /** Receive the packets already available, up to num_packets, with a
+         * single recvmmsg() call and without blocking. The buffers of the
+         * packets are reused, and only allocated if they are smaller than
+         * max_size. Returns the number of packets received, which are
+         * placed in the first packets. Throws a runtime_error on error.
+         */
+        size_t receive_many(UDPPacket *packets, size_t num_packets, size_t max_size);
         void setMulticastSource(const char* source_addr);
         void setMulticastTTL(int ttl);
 
+        /** Request receive timestamps with SO_TIMESTAMPING, which receive()
+         * and receive_many() put into the arrival of the packets. Throws a
+         * runtime_error on error. */
+        void enable_rx_timestamps(rx_timestamps_e timestamps);
+
         /** Set blocking mode. By default, the socket is blocking.
          * throws a runtime_error on error.
          */
@@ -130,6 +167,7 @@ class UDPSocket
 
         SOCKET getNativeSocket() const;
         int getPort() const;
+        const std::string& getMulticastSource() const { return m_multicast_source; }
 
     private:
         void join_group(const char* groupname, const char* if_addr = nullptr);
@@ -144,8 +182,27 @@ class UDPSocket
 /* UDP packet receiver supporting receiving from several ports at once */
 class UDPReceiver {
     public:
+        UDPReceiver();
+        ~UDPReceiver();
+
         void add_receive_port(int port, const std::string& bindto, const std::string& mcastaddr);
 
+        /* Receive the packets of all ports from a PACKET_MMAP ring of an
+         * AF_PACKET socket on the given network interface, instead of
+         * from the sockets. The kernel copies the packets into the ring,
+         * which is shared with this process, and the receive does no
+         * system call per packet. The sockets only stay open for the
+         * multicast memberships, with a filter that drops everything.
+         * Needs CAP_NET_RAW, and UDP packets that are not IP fragments.
+         * Must be called before add_receive_port(). If the ring cannot be
+         * set up, the sockets are used. */
+        void set_packet_ring_interface(const std::string& interface);
+
+        /* Set the receive timestamps of the sockets or of the ring, which
+         * go into the arrival of the packets. Must be called before
+         * add_receive_port(). */
+        void set_rx_timestamps(rx_timestamps_e timestamps);
+
         struct ReceivedPacket {
             std::vector<uint8_t> packetdata;
             InetAddress received_from;
@@ -159,10 +216,67 @@ class UDPReceiver {
          * on error. */
         std::vector<ReceivedPacket> receive(int timeout_ms);
 
+        /* Like receive(), but receives all packets that are already
+         * available, up to MAX_BATCH_PACKETS, with one recvmmsg() call per
+         * socket. The packets are received into slots that are reused by
+         * every call, and stay valid until the next call. Returns the
+         * number of packets, accessed with batch_packet() and batch_port().
+         */
+        size_t receive_batch(int timeout_ms);
+        const UDPPacket& batch_packet(size_t i) const { return m_batch[i]; }
+        int batch_port(size_t i) const { return m_batch_ports[i]; }
+
+        static constexpr size_t MAX_BATCH_PACKETS = 64;
+
+        /* The sockets of all ports, for callers that poll() them together
+         * with other sockets before calling receive_batch(). With the
+         * io_uring backend, the file descriptor of the ring instead, which
+         * is readable when packets were received, and with the PACKET_MMAP
+         * ring the AF_PACKET socket, readable when a block of the ring is
+         * ready. */
+        std::vector<SOCKET> getNativeSockets() const;
+
+        /* True if the packets are received through io_uring */
+        bool uses_io_uring() const { return m_uring != nullptr; }
+
+        /* True if the packets are received from a PACKET_MMAP ring */
+        bool uses_packet_ring() const { return m_packet_ring != nullptr; }
+
     private:
+        static constexpr size_t MAX_FDS = 64;
+        // This is larger than the usual MTU
+        static constexpr size_t MAX_PACKET_SIZE = 2048;
+
         void m_run(void);
 
+        // Waits until at least one socket has packets to receive, and sets
+        // the revents of fds. Throws like receive().
+        void wait_for_packets(struct pollfd *fds, int timeout_ms);
+
+        void allocate_batch();
+        size_t receive_batch_uring(int timeout_ms);
+        size_t receive_batch_ring(int timeout_ms);
+
         std::vector<UDPSocket> m_sockets;
+
+        std::vector<UDPPacket> m_batch;
+        std::vector<int> m_batch_ports;
+
+        /* When built with liburing, every socket has a multishot recvmsg
+         * in this ring, with the buffers provided by the ring. nullptr
+         * without liburing, or if the kernel does not support it. Declared
+         * after the sockets, so that it is destroyed before they get
+         * closed. */
+        struct uring_t;
+        std::unique_ptr<uring_t> m_uring;
+
+        /* The AF_PACKET socket and its ring, nullptr unless
+         * set_packet_ring_interface() was called and the ring could be set
+         * up. Also declared after the sockets. */
+        std::string m_packet_ring_interface;
+        rx_timestamps_e m_rx_timestamps = rx_timestamps_e::none;
+        struct packet_ring_t;
+        std::unique_ptr<packet_ring_t> m_packet_ring;
 };
 
 class TCPSocket {
@@ -199,6 +313,9 @@ class TCPSocket {
          */
         ssize_t send(const void* data, size_t size, int timeout_ms=0);
 
+        /** Send several buffers with one system call, like send() */
+        ssize_t send(const struct iovec *iov, size_t iovcnt, int timeout_ms=0);
+
         class Interrupted {};
         /* Returns number of bytes read, 0 on disconnect.
          * Throws Interrupted on EINTR, runtime_error on error */
@@ -233,8 +350,15 @@ class TCPClient {
          * Throws a runtime_error on error */
         ssize_t recv(void *buffer, size_t length, int flags, int timeout_ms);
 
-    private:
+        /* For callers that poll() the socket together with other sockets,
+         * and call recv() when it is readable, with a timeout of 0. They
+         * have to call reconnect_if_idle() to catch half-closed
+         * connections, and reconnect() when poll() reports an error. */
+        SOCKET get_sockfd() const { return m_sock.get_sockfd(); }
+        void reconnect_if_idle(std::chrono::steady_clock::duration timeout);
         void reconnect(void);
+
+    private:
         TCPSocket m_sock;
         std::string m_hostname;
         int m_port;
@@ -252,9 +376,17 @@ class TCPConnection
         TCPConnection& operator=(const TCPConnection&) = delete;
         ~TCPConnection();
 
-        ThreadsafeQueue<std::vector<uint8_t> > queue;
+        /* Queue the data, and count its bytes until they are sent */
+        void push(const shared_buffer_t& data);
+
+        size_t queue_size() const { return queue.size(); }
+        size_t queued_bytes() const { return m_queued_bytes.load(); }
 
     private:
+        // A nullptr is the termination marker
+        ThreadsafeQueue<shared_buffer_t> queue;
+        std::atomic<size_t> m_queued_bytes = ATOMIC_VAR_INIT(0);
+
         std::atomic<bool> m_running;
         std::thread m_sender_thread;
         TCPSocket m_sock;
@@ -263,24 +395,30 @@ class TCPConnection
 };
 
 /* Send a TCP stream to several destinations, and automatically disconnect destinations
- * whose buffer overflows.
+ * whose buffer overflows: when more than max_queue_size buffers, or more
+ * than max_queue_bytes bytes if not 0, wait to be sent to it.
+ *
+ * The data is not copied for every destination, they all share it.
  */
 class TCPDataDispatcher
 {
     public:
-        TCPDataDispatcher(size_t max_queue_size, size_t buffers_to_preroll);
+        TCPDataDispatcher(size_t max_queue_size, size_t buffers_to_preroll,
+                size_t max_queue_bytes = 0);
         ~TCPDataDispatcher();
         TCPDataDispatcher(const TCPDataDispatcher&) = delete;
         TCPDataDispatcher& operator=(const TCPDataDispatcher&) = delete;
 
         void start(int port, const std::string& address);
         void write(const std::vector<uint8_t>& data);
+        void write(const shared_buffer_t& data);
 
     private:
         void process();
 
         size_t m_max_queue_size;
         size_t m_buffers_to_preroll;
+        size_t m_max_queue_bytes;
 
 
         std::atomic<bool> m_running = ATOMIC_VAR_INIT(false);
@@ -289,7 +427,7 @@ class TCPDataDispatcher
         TCPSocket m_listener_socket;
 
         std::mutex m_mutex;
-        std::deque<std::vector<uint8_t> > m_preroll_queue;
+        std::deque<shared_buffer_t> m_preroll_queue;
         std::list<TCPConnection> m_connections;
 };
 
@@ -345,6 +483,7 @@ class TCPSendClient {
 
         /* Throws a runtime_error when the process thread isn't running */
         ErrorStats sendall(const std::vector<uint8_t>& buffer);
+        ErrorStats sendall(const shared_buffer_t& buffer);
 
     private:
         void process();
@@ -356,7 +495,7 @@ class TCPSendClient {
 
         TCPSocket m_sock;
         static constexpr size_t MAX_QUEUE_SIZE = 512;
-        ThreadsafeQueue<std::vector<uint8_t> > m_queue;
+        ThreadsafeQueue<shared_buffer_t> m_queue;
         std::atomic<bool> m_running;
         std::string m_exception_data;
         std::thread m_sender_thread;
@@ -30,8 +30,10 @@
 
 #include <mutex>
 #include <condition_variable>
-#include <queue>
+#include <deque>
+#include <vector>
 #include <utility>
+#include <algorithm>
 #include <cassert>
 
 /* This queue is meant to be used by two threads. One producer
@@ -63,10 +65,10 @@ public:
         std::unique_lock<std::mutex> lock(the_mutex);
         size_t queue_size_before = the_queue.size();
         if (max_size == 0) {
-            the_queue.push(val);
+            the_queue.push_back(val);
         }
         else if (queue_size_before < max_size) {
-            the_queue.push(val);
+            the_queue.push_back(val);
         }
         size_t queue_size = the_queue.size();
         lock.unlock();
@@ -80,10 +82,10 @@ public:
         std::unique_lock<std::mutex> lock(the_mutex);
         size_t queue_size_before = the_queue.size();
         if (max_size == 0) {
-            the_queue.emplace(std::move(val));
+            the_queue.emplace_back(std::move(val));
         }
         else if (queue_size_before < max_size) {
-            the_queue.emplace(std::move(val));
+            the_queue.emplace_back(std::move(val));
         }
         size_t queue_size = the_queue.size();
         lock.unlock();
@@ -110,9 +112,9 @@ public:
         bool overflow = false;
         while (the_queue.size() >= max_size) {
             overflow = true;
-            the_queue.pop();
+            the_queue.pop_front();
         }
-        the_queue.push(val);
+        the_queue.push_back(val);
         const size_t queue_size = the_queue.size();
         lock.unlock();
 
@@ -129,9 +131,9 @@ public:
         bool overflow = false;
         while (the_queue.size() >= max_size) {
             overflow = true;
-            the_queue.pop();
+            the_queue.pop_front();
         }
-        the_queue.emplace(std::move(val));
+        the_queue.emplace_back(std::move(val));
         const size_t queue_size = the_queue.size();
         lock.unlock();
 
@@ -152,7 +154,7 @@ public:
         while (the_queue.size() >= threshold) {
             the_tx_notification.wait(lock);
         }
-        the_queue.push(val);
+        the_queue.push_back(val);
         size_t queue_size = the_queue.size();
         lock.unlock();
 
@@ -197,8 +199,8 @@ public:
             return false;
         }
 
-        popped_value = the_queue.front();
-        the_queue.pop();
+        popped_value = std::move(the_queue.front());
+        the_queue.pop_front();
 
         lock.unlock();
         the_tx_notification.notify_one();
@@ -220,7 +222,91 @@ public:
         }
         else {
             std::swap(popped_value, the_queue.front());
-            the_queue.pop();
+            the_queue.pop_front();
+
+            lock.unlock();
+            the_tx_notification.notify_one();
+        }
+    }
+
+    /* Push all elements of vals into the queue under one lock, and
+     * notify another thread that might be waiting. vals is empty
+     * afterwards. When the queue is empty, it takes over the storage of
+     * vals, which gets the one of the queue.
+     *
+     * if max_size > 0, the elements that do not fit into max_size get
+     * discarded.
+     *
+     * returns the new queue size.
+     */
+    size_t push_many(std::deque<T>& vals, size_t max_size = 0)
+    {
+        std::unique_lock<std::mutex> lock(the_mutex);
+        if (max_size > 0 and the_queue.size() + vals.size() > max_size) {
+            const size_t room = the_queue.size() < max_size ?
+                max_size - the_queue.size() : 0;
+            vals.erase(vals.begin() + room, vals.end());
+        }
+
+        if (the_queue.empty()) {
+            std::swap(the_queue, vals);
+        }
+        else {
+            for (auto& val : vals) {
+                the_queue.emplace_back(std::move(val));
+            }
+        }
+        vals.clear();
+        size_t queue_size = the_queue.size();
+        lock.unlock();
+
+        the_rx_notification.notify_one();
+
+        return queue_size;
+    }
+
+    /* Move up to max_count elements to the end of popped, without
+     * blocking.
+     *
+     * returns the number of elements moved.
+     */
+    size_t pop_up_to(std::vector<T>& popped, size_t max_count)
+    {
+        std::unique_lock<std::mutex> lock(the_mutex);
+        const size_t n = std::min(max_count, the_queue.size());
+        for (size_t i = 0; i < n; i++) {
+            popped.emplace_back(std::move(the_queue.front()));
+            the_queue.pop_front();
+        }
+
+        lock.unlock();
+        if (n > 0) {
+            the_tx_notification.notify_one();
+        }
+
+        return n;
+    }
+
+    /* Wait like wait_and_pop(), and then take all elements of the queue at
+     * once. The previous contents of popped are discarded, and its storage
+     * is given to the queue.
+     */
+    void wait_and_pop_all(std::deque<T>& popped, size_t prebuffering = 1)
+    {
+        popped.clear();
+
+        std::unique_lock<std::mutex> lock(the_mutex);
+        while (the_queue.size() < prebuffering and
+                not wakeup_requested) {
+            the_rx_notification.wait(lock);
+        }
+
+        if (wakeup_requested) {
+            wakeup_requested = false;
+            throw ThreadsafeQueueWakeup();
+        }
+        else {
+            std::swap(popped, the_queue);
 
             lock.unlock();
             the_tx_notification.notify_one();
@@ -228,7 +314,7 @@ public:
     }
 
 private:
-    std::queue<T> the_queue;
+    std::deque<T> the_queue;
     mutable std::mutex the_mutex;
     std::condition_variable the_rx_notification;
     std::condition_variable the_tx_notification;
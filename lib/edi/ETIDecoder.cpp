@@ -52,9 +52,19 @@ void ETIDecoder::set_verbose(bool verbose)
     m_dispatcher.set_verbose(verbose);
 }
 
-void ETIDecoder::push_bytes(const vector<uint8_t> &buf)
+void ETIDecoder::push_bytes(const vector<uint8_t> &buf, size_t source)
 {
-    m_dispatcher.push_bytes(buf);
+    m_dispatcher.push_bytes(buf, source);
+}
+
+uint8_t* ETIDecoder::stream_reserve(size_t max_len, size_t source)
+{
+    return m_dispatcher.stream_reserve(max_len, source);
+}
+
+void ETIDecoder::stream_commit(size_t len, size_t source)
+{
+    m_dispatcher.stream_commit(len, source);
 }
 
 void ETIDecoder::push_packet(Packet& pack)
@@ -69,7 +79,7 @@ void ETIDecoder::setMaxDelay(int num_af_packets)
 
 #define AFPACKET_HEADER_LEN 10 // includes SYNC
 
-bool ETIDecoder::decode_starptr(const std::vector<uint8_t>& value, const tag_name_t& /*n*/)
+bool ETIDecoder::decode_starptr(const tag_value_t& value, const tag_name_t& /*n*/)
 {
     if (value.size() != 0x40 / 8) {
         etiLog.log(warn, "Incorrect length %02lx for *PTR", value.size());
@@ -89,7 +99,7 @@ bool ETIDecoder::decode_starptr(const std::vector<uint8_t>& value, const tag_nam
     return true;
 }
 
-bool ETIDecoder::decode_deti(const std::vector<uint8_t>& value, const tag_name_t& /*n*/)
+bool ETIDecoder::decode_deti(const tag_value_t& value, const tag_name_t& /*n*/)
 {
     /*
     uint16_t detiHeader = fct | (fcth << 8) | (rfudf << 13) | (ficf << 14) | (atstf << 15);
@@ -195,7 +205,7 @@ bool ETIDecoder::decode_deti(const std::vector<uint8_t>& value, const tag_name_t
     return true;
 }
 
-bool ETIDecoder::decode_estn(const std::vector<uint8_t>& value, const tag_name_t& name)
+bool ETIDecoder::decode_estn(const tag_value_t& value, const tag_name_t& name)
 {
     uint32_t sstc = read_24b(value.begin());
 
@@ -211,16 +221,16 @@ bool ETIDecoder::decode_estn(const std::vector<uint8_t>& value, const tag_name_t
         etiLog.level(warn) << "EDI: rfa field in ESTn tag non-null";
     }
 
-    copy(   value.begin() + 3,
-            value.end(),
-            back_inserter(stc.mst));
+    // The only copy of the subchannel data, it is moved to the
+    // SubchannelSource
+    stc.mst.assign(value.begin() + 3, value.end());
 
     m_data_collector.add_subchannel(std::move(stc));
 
     return true;
 }
 
-bool ETIDecoder::decode_stardmy(const std::vector<uint8_t>&, const tag_name_t&)
+bool ETIDecoder::decode_stardmy(const tag_value_t&, const tag_name_t&)
 {
     return true;
 }
@@ -234,6 +244,7 @@ bool ETIDecoder::decode_afpacket(std::vector<uint8_t>&& value)
 void ETIDecoder::packet_completed()
 {
     m_received_tagpacket.seq = m_dispatcher.get_seq_info();
+    m_received_tagpacket.arrival = m_dispatcher.get_arrival();
 
     ReceivedTagPacket tp;
     swap(tp, m_received_tagpacket);
@@ -61,6 +61,8 @@ struct ReceivedTagPacket {
     std::vector<uint8_t> afpacket;
     frame_timestamp_t timestamp;
     seq_info_t seq;
+    // When the AF packet was received, the epoch if not known
+    std::chrono::system_clock::time_point arrival;
 };
 
 
@@ -113,9 +115,14 @@ class ETIDecoder {
 
         /* Push bytes into the decoder. The buf can contain more
          * than a single packet. This is useful when reading from streams
-         * (files, TCP)
+         * (files, TCP). Every source has its own stream buffer.
          */
-        void push_bytes(const std::vector<uint8_t> &buf);
+        void push_bytes(const std::vector<uint8_t> &buf, size_t source = 0);
+
+        /* The same without the copy of the bytes, see
+         * TagDispatcher::stream_reserve() */
+        uint8_t* stream_reserve(size_t max_len, size_t source = 0);
+        void stream_commit(size_t len, size_t source = 0);
 
         /* Push a complete packet into the decoder. Useful for UDP and other
          * datagram-oriented protocols.
@@ -127,11 +134,15 @@ class ETIDecoder {
          */
         void setMaxDelay(int num_af_packets);
 
+        const PathStatistics& get_path_statistics() const {
+            return m_dispatcher.get_path_statistics();
+        }
+
     private:
-        bool decode_starptr(const std::vector<uint8_t>& value, const tag_name_t& n);
-        bool decode_deti(const std::vector<uint8_t>& value, const tag_name_t& n);
-        bool decode_estn(const std::vector<uint8_t>& value, const tag_name_t& n);
-        bool decode_stardmy(const std::vector<uint8_t>& value, const tag_name_t& n);
+        bool decode_starptr(const tag_value_t& value, const tag_name_t& n);
+        bool decode_deti(const tag_value_t& value, const tag_name_t& n);
+        bool decode_estn(const tag_value_t& value, const tag_name_t& n);
+        bool decode_stardmy(const tag_value_t& value, const tag_name_t& n);
 
         bool decode_afpacket(std::vector<uint8_t>&& value);
 
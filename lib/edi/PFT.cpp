@@ -29,6 +29,7 @@
 #include <algorithm>
 #include "crc.h"
 #include "PFT.hpp"
+#include "RSErasureDecoder.hpp"
 #include "Log.h"
 #include "buffer_unpack.hpp"
 extern "C" {
@@ -66,29 +67,18 @@ class FECDecoder {
 
         // return -1 in case of failure, non-negative value if errors
         // were corrected.
-        // Known positions of erasures should be given in eras_pos to
-        // improve decoding probability. After calling this function
-        // eras_pos will contain the positions of the corrected errors.
-        int decode(vector<uint8_t> &data, vector<int> &eras_pos) {
-            assert(data.size() == N);
-            const size_t no_eras = eras_pos.size();
-
-            eras_pos.resize(nroots);
-            int num_err = decode_rs_char(m_rs_handler, data.data(),
-                    eras_pos.data(), no_eras);
-            if (num_err > 0) {
-                eras_pos.resize(num_err);
-            }
-            return num_err;
+        // data contains N bytes. Known positions of erasures should be
+        // given in eras_pos to improve decoding probability, eras_pos must
+        // have room for nroots positions. The tables of the decoder are
+        // only read, several threads can decode at the same time.
+        int decode(uint8_t *data, int *eras_pos, int no_eras) const {
+            return decode_rs_char(m_rs_handler, data,
+                    no_eras > 0 ? eras_pos : nullptr, no_eras);
         }
 
-        // return -1 in case of failure, non-negative value if errors
-        // were corrected. No known erasures.
-        int decode(vector<uint8_t> &data) {
-            assert(data.size() == N);
-            int num_err = decode_rs_char(m_rs_handler, data.data(), nullptr, 0);
-            return num_err;
-        }
+        static constexpr size_t N = 255;
+        static constexpr size_t K = 207;
+        static constexpr size_t nroots = N - K; // For EDI PFT, this must be 48
 
     private:
         void* m_rs_handler;
@@ -99,11 +89,8 @@ class FECDecoder {
         // The encoding has to be 255, 207 always, because the chunk has to
         // be padded at the end, and not at the beginning as libfec would
         // do
-        const size_t N = 255;
-        const size_t K = 207;
         const int primElem = 1;
         const int symsize = 8;
-        const size_t nroots = N - K; // For EDI PFT, this must be 48
         const size_t pad = ((1 << symsize) - 1) - N; // is 255-N
 
 };
@@ -114,9 +101,14 @@ size_t Fragment::loadData(const std::vector<uint8_t> &buf)
 }
 
 size_t Fragment::loadData(const std::vector<uint8_t> &buf, int received_on_port)
+{
+    return loadData(buf.data(), buf.size(), received_on_port);
+}
+
+size_t Fragment::loadData(const uint8_t *buf, size_t len, int received_on_port)
 {
     const size_t header_len = 14;
-    if (buf.size() < header_len) {
+    if (len < header_len) {
         return 0;
     }
 
@@ -130,18 +122,18 @@ size_t Fragment::loadData(const std::vector<uint8_t> &buf, int received_on_port)
     }
     index += 2; // Psync
 
-    _Pseq = read_16b(buf.begin()+index); index += 2;
-    _Findex = read_24b(buf.begin()+index); index += 3;
-    _Fcount = read_24b(buf.begin()+index); index += 3;
+    _Pseq = read_16b(buf+index); index += 2;
+    _Findex = read_24b(buf+index); index += 3;
+    _Fcount = read_24b(buf+index); index += 3;
     _FEC = unpack1bit(buf[index], 0);
     _Addr = unpack1bit(buf[index], 1);
-    _Plen = read_16b(buf.begin()+index) & 0x3FFF; index += 2;
+    _Plen = read_16b(buf+index) & 0x3FFF; index += 2;
 
     const size_t required_len = header_len +
         (_FEC ? 1 : 0) +
         (_Addr ? 2 : 0) +
         2; // CRC
-    if (buf.size() < required_len) {
+    if (len < required_len) {
         return 0;
     }
 
@@ -157,13 +149,13 @@ size_t Fragment::loadData(const std::vector<uint8_t> &buf, int received_on_port)
     _Source = 0;
     _Dest = 0;
     if (_Addr) {
-        _Source = read_16b(buf.begin()+index); index += 2;
-        _Dest = read_16b(buf.begin()+index); index += 2;
+        _Source = read_16b(buf+index); index += 2;
+        _Dest = read_16b(buf+index); index += 2;
     }
 
     index += 2;
-    const bool crc_valid = checkCRC(buf.data(), index);
-    const bool buf_has_enough_data = (buf.size() >= index + _Plen);
+    const bool crc_valid = checkCRC(buf, index);
+    const bool buf_has_enough_data = (len >= index + _Plen);
 
     if (not buf_has_enough_data) {
         return 0;
@@ -186,11 +178,9 @@ size_t Fragment::loadData(const std::vector<uint8_t> &buf, int received_on_port)
     }
 #endif
 
-    _payload.clear();
+    _payload = nullptr;
     if (_valid) {
-        copy( buf.begin()+index,
-                buf.begin()+index+_Plen,
-                back_inserter(_payload));
+        _payload = buf + index;
         index += _Plen;
     }
 
@@ -199,14 +189,34 @@ size_t Fragment::loadData(const std::vector<uint8_t> &buf, int received_on_port)
 
 
 AFBuilder::AFBuilder(pseq_t Pseq, findex_t Fcount, size_t lifetime)
+{
+    reset(Pseq, Fcount, lifetime);
+}
+
+void AFBuilder::reset(pseq_t Pseq, findex_t Fcount, size_t lifetime)
 {
     _Pseq = Pseq;
     _Fcount = Fcount;
     assert(lifetime > 0);
     lifeTime = lifetime;
+
+    if (_fragments.size() < Fcount) {
+        _fragments.resize(Fcount);
+    }
+    clearFragments();
 }
 
-void AFBuilder::pushPFTFrag(const Fragment &frag)
+void AFBuilder::clearFragments()
+{
+    for (findex_t i = 0; i < _Fcount; i++) {
+        _fragments[i].received = false;
+    }
+    _num_fragments = 0;
+    _arrival = {};
+}
+
+void AFBuilder::pushPFTFrag(const Fragment &frag,
+        PathStatistics::clock::time_point arrival, PathStatistics *stats)
 {
     if (_Pseq != frag.Pseq()) {
         throw logic_error("Invalid PFT fragment Pseq");
@@ -215,23 +225,40 @@ void AFBuilder::pushPFTFrag(const Fragment &frag)
     if (_Fcount != frag.Fcount()) {
         etiLog.level(warn) << "Discarding fragment with invalid fcount";
     }
+    else if (frag.Findex() >= _Fcount) {
+        etiLog.level(warn) << "Discarding fragment with invalid findex";
+    }
     else {
-        const auto Findex = frag.Findex();
-        const bool fragment_already_received = _fragments.count(Findex);
+        auto& slot = _fragments[frag.Findex()];
 
-        if (not fragment_already_received) {
+        if (not slot.received) {
             bool consistent = true;
-            if (_fragments.size() > 0) {
-                consistent = frag.checkConsistency(_fragments.cbegin()->second);
+            if (_num_fragments > 0) {
+                consistent = frag.checkConsistency(_reference);
+            }
+            else {
+                _reference = frag;
             }
 
             if (consistent) {
-                _fragments[Findex] = frag;
+                slot.received = true;
+                slot.received_on_port = frag.received_on_port;
+                slot.arrival = arrival;
+                slot.payload.assign(frag.payload(), frag.payload() + frag.Plen());
+                _num_fragments++;
+                _arrival = std::max(_arrival, frag.arrival);
+
+                if (stats) {
+                    stats->add_first(frag.source);
+                }
             }
             else {
                 etiLog.level(warn) << "Discard fragment";
             }
         }
+        else if (stats) {
+            stats->add_late(frag.source, arrival - slot.arrival);
+        }
     }
 }
 
@@ -263,53 +290,30 @@ bool Fragment::checkConsistency(const Fragment& other) const
 
 AFBuilder::decode_attempt_result_t AFBuilder::canAttemptToDecode()
 {
-    if (_fragments.empty()) {
+    if (_num_fragments == 0) {
         return AFBuilder::decode_attempt_result_t::no;
     }
 
-    if (_fragments.size() == _Fcount) {
+    if (_num_fragments == _Fcount) {
         return AFBuilder::decode_attempt_result_t::yes;
     }
 
-    /* Check that all fragments are consistent */
-    const Fragment& first = _fragments.begin()->second;
-    if (not std::all_of(_fragments.begin(), _fragments.end(),
-            [&](const pair<int, Fragment>& pair) {
-                const Fragment& frag = pair.second;
-                return first.checkConsistency(frag) and _Pseq == frag.Pseq();
-            }) ) {
-        _fragments.clear();
-        throw runtime_error("Inconsistent PFT fragments");
-    }
+    // All fragments were checked to be consistent with the reference when
+    // they were pushed. With FEC, all fragments have the same length.
+    if (_reference.FEC()) {
+        const uint16_t _Plen = _reference.Plen();
 
-    // Calculate the minimum number of fragments necessary to apply FEC.
-    // This can't be done with the last fragment that may have a
-    // smaller size
-    // ETSI TS 102 821 V1.4.1 ch 7.4.4
-    auto frag_it = _fragments.begin();
-    if (frag_it->second.Fcount() == _Fcount - 1) {
-        frag_it++;
-
-        if (frag_it == _fragments.end()) {
+        /* max number of RS chunks that may have been sent */
+        const uint32_t _cmax = (_Fcount*_Plen) / (_reference.RSk()+48);
+        if (_cmax == 0) {
             return AFBuilder::decode_attempt_result_t::no;
         }
-    }
-
-    const Fragment& frag = frag_it->second;
-
-    if ( frag.FEC() )
-    {
-        const uint16_t _Plen = frag.Plen();
-
-        /* max number of RS chunks that may have been sent */
-        const uint32_t _cmax = (_Fcount*_Plen) / (frag.RSk()+48);
-        assert(_cmax > 0);
 
         /* Receiving _rxmin fragments does not guarantee that decoding
          * will succeed! */
         const uint32_t _rxmin = _Fcount - (_cmax*48)/_Plen;
 
-        if (_fragments.size() >= _rxmin) {
+        if (_num_fragments >= _rxmin) {
             return AFBuilder::decode_attempt_result_t::maybe;
         }
     }
@@ -317,134 +321,148 @@ AFBuilder::decode_attempt_result_t AFBuilder::canAttemptToDecode()
     return AFBuilder::decode_attempt_result_t::no;
 }
 
-std::vector<uint8_t> AFBuilder::extractAF()
+void AFBuilder::extractAF(std::vector<uint8_t>& af_packet)
 {
-    if (not _af_packet.empty()) {
-        return _af_packet;
-    }
+    af_packet.clear();
 
     bool ok = false;
 
     if (canAttemptToDecode() != AFBuilder::decode_attempt_result_t::no) {
-        auto frag_it = _fragments.begin();
-        if (frag_it->second.Fcount() == _Fcount - 1) {
-            frag_it++;
+        const auto RSk = _reference.RSk();
+        const auto RSz = _reference.RSz();
+        const auto Plen = _reference.Plen();
 
-            if (frag_it == _fragments.end()) {
-                throw runtime_error("Invalid attempt at extracting AF");
-            }
-        }
-
-        const Fragment& ref_frag = frag_it->second;
-        const auto RSk = ref_frag.RSk();
-        const auto RSz = ref_frag.RSz();
-        const auto Plen = ref_frag.Plen();
-
-        if ( ref_frag.FEC() )
+        if (_reference.FEC())
         {
-            const uint32_t cmax = (_Fcount*Plen) / (RSk+48);
-
-            // Keep track of erasures (missing fragments) for
-            // every chunk
-            map<int, vector<int> > erasures;
-
+            const size_t chunk_len = RSk + FECDecoder::nroots;
+            const uint32_t cmax = (_Fcount*Plen) / chunk_len;
 
             // Assemble fragments into a RS block, immediately
-            // deinterleaving it.
-            vector<uint8_t> rs_block(Plen * _Fcount);
+            // deinterleaving it. Missing fragments are filled with zeros.
+            _rs_block.resize(Plen * _Fcount);
             for (size_t j = 0; j < _Fcount; j++) {
-                const bool fragment_present = _fragments.count(j);
-                if (fragment_present) {
-                    const auto& fragment = _fragments.at(j).payload();
+                const auto& slot = _fragments[j];
+                size_t k = 0;
+                if (slot.received) {
+                    const auto& fragment = slot.payload;
 
                     if (j != _Fcount - 1 and fragment.size() != Plen) {
-                        _fragments.clear();
+                        clearFragments();
                         throw runtime_error("Incorrect fragment length " +
                                 to_string(fragment.size()) + " " +
                                 to_string(Plen));
                     }
 
                     if (j == _Fcount - 1 and fragment.size() > Plen) {
-                        _fragments.clear();
+                        clearFragments();
                         throw runtime_error("Incorrect last fragment length " +
                                 to_string(fragment.size()) + " " +
                                 to_string(Plen));
                     }
 
-                    size_t k = 0;
                     for (; k < fragment.size(); k++) {
-                        rs_block[k * _Fcount + j] = fragment[k];
-                    }
-
-                    for (; k < Plen; k++) {
-                        rs_block[k * _Fcount + j] = 0x00;
+                        _rs_block[k * _Fcount + j] = fragment[k];
                     }
                 }
-                else {
-                    // fill with zeros if fragment is missing
-                    for (size_t k = 0; k < Plen; k++) {
-                        rs_block[k * _Fcount + j] = 0x00;
 
-                        const size_t chunk_ix = (k * _Fcount + j) / (RSk + 48);
-                        const size_t chunk_offset = (k * _Fcount + j) % (RSk + 48);
-                        erasures[chunk_ix].push_back(chunk_offset);
-                    }
+                for (; k < Plen; k++) {
+                    _rs_block[k * _Fcount + j] = 0x00;
                 }
             }
 
             // The RS block is a concatenation of chunks of RSk bytes + 48 parity
             // followed by RSz padding
 
-            FECDecoder fec;
-            for (size_t i = 0; i < cmax; i++) {
-                // We need to pad the chunk ourself
-                vector<uint8_t> chunk(255);
-                const auto& block_begin = rs_block.begin() + (RSk + 48) * i;
-                copy(block_begin, block_begin + RSk, chunk.begin());
-                // bytes between RSk and 207 are 0x00 already
-                copy(block_begin + RSk, block_begin + RSk + 48,
-                        chunk.begin() + 207);
-
-                int errors_corrected = -1;
-                if (erasures.count(i)) {
-                    errors_corrected = fec.decode(chunk, erasures[i]);
-                }
-                else {
-                    errors_corrected = fec.decode(chunk);
+            // The chunks are first decoded together by the erasure
+            // decoder. The ones that also have errors go through the
+            // libfec decoder.
+            static const RSErasureDecoder rs_erasures;
+            static const FECDecoder fec;
+            constexpr size_t max_codewords = RSErasureDecoder::max_codewords;
+
+            af_packet.reserve(cmax * RSk);
+            for (size_t i0 = 0; i0 < cmax; i0 += max_codewords) {
+                const size_t num_chunks = std::min(max_codewords, cmax - i0);
+
+                // We need to pad the chunks ourself, the bytes
+                // between RSk and 207 are 0x00
+                alignas(32) uint8_t symbols[FECDecoder::N * max_codewords] = {};
+                RSErasureDecoder::codeword_t codewords[max_codewords];
+
+                for (size_t c = 0; c < num_chunks; c++) {
+                    const size_t i = i0 + c;
+                    const uint8_t *block_begin = _rs_block.data() + chunk_len * i;
+                    auto& codeword = codewords[c];
+
+                    // The bytes of the missing fragments are erasures, at
+                    // their position in the padded chunk.
+                    size_t j = (chunk_len * i) % _Fcount;
+                    for (size_t offset = 0; offset < chunk_len; offset++) {
+                        const size_t pos = offset < RSk ? offset :
+                            offset - RSk + FECDecoder::K;
+                        symbols[pos * max_codewords + c] = block_begin[offset];
+
+                        if (not _fragments[j].received) {
+                            if (codeword.no_eras == FECDecoder::nroots) {
+                                af_packet.clear();
+                                return;
+                            }
+                            codeword.eras_pos[codeword.no_eras++] = pos;
+                        }
+
+                        if (++j == _Fcount) {
+                            j = 0;
+                        }
+                    }
                 }
 
-                if (errors_corrected == -1) {
-                    _af_packet.clear();
-                    return {};
-                }
+                rs_erasures.decode(symbols, num_chunks, codewords);
+
+                for (size_t c = 0; c < num_chunks; c++) {
+                    auto& codeword = codewords[c];
+                    const uint8_t *block_begin = _rs_block.data() + chunk_len * (i0 + c);
+
+                    if (codeword.decoded) {
+                        const size_t chunk_begin = af_packet.size();
+                        af_packet.insert(af_packet.end(), block_begin, block_begin + RSk);
+                        for (size_t e = 0; e < codeword.no_eras; e++) {
+                            if (codeword.eras_pos[e] < RSk) {
+                                af_packet[chunk_begin + codeword.eras_pos[e]] ^=
+                                    codeword.corrections[e];
+                            }
+                        }
+                        continue;
+                    }
 
-#if 0
-                if (errors_corrected > 0) {
-                    etiLog.log(debug, "Corrected %d errors at ", errors_corrected);
-                    for (const auto &index : erasures[i]) {
-                        etiLog.log(debug, " %d", index);
+                    uint8_t chunk[FECDecoder::N] = {};
+                    copy(block_begin, block_begin + RSk, chunk);
+                    copy(block_begin + RSk, block_begin + chunk_len,
+                            chunk + FECDecoder::K);
+
+                    const int errors_corrected = fec.decode(chunk,
+                            codeword.eras_pos, (int)codeword.no_eras);
+
+                    if (errors_corrected == -1) {
+                        af_packet.clear();
+                        return;
                     }
-                    etiLog.log(debug, "\n");
-                }
-#endif
 
-                _af_packet.insert(_af_packet.end(), chunk.begin(), chunk.begin() + RSk);
+                    af_packet.insert(af_packet.end(), chunk, chunk + RSk);
+                }
             }
 
-            _af_packet.resize(_af_packet.size() - RSz);
+            af_packet.resize(af_packet.size() - std::min<size_t>(RSz, af_packet.size()));
         }
         else {
             // No FEC: just assemble fragments
 
             for (size_t j = 0; j < _Fcount; ++j) {
-                const bool fragment_present = _fragments.count(j);
-                if (fragment_present)
+                const auto& slot = _fragments[j];
+                if (slot.received)
                 {
-                    const auto& fragment = _fragments.at(j);
-
-                    _af_packet.insert(_af_packet.end(),
-                       fragment.payload().begin(),
-                       fragment.payload().end());
+                    af_packet.insert(af_packet.end(),
+                       slot.payload.begin(),
+                       slot.payload.end());
                 }
                 else {
                     throw logic_error("Missing fragment");
@@ -453,21 +471,19 @@ std::vector<uint8_t> AFBuilder::extractAF()
         }
 
         // EDI specific, must have a CRC.
-        if (_af_packet.size() >= 12) {
-            ok = checkCRC(_af_packet.data(), _af_packet.size());
+        if (af_packet.size() >= 12) {
+            ok = checkCRC(af_packet.data(), af_packet.size());
 
             if (not ok) {
-                etiLog.log(debug, "CRC error after AF reconstruction from %zu/%u"
-                        " PFT fragments\n", _fragments.size(), _Fcount);
+                etiLog.log(debug, "CRC error after AF reconstruction from %u/%u"
+                        " PFT fragments\n", _num_fragments, _Fcount);
             }
         }
     }
 
     if (not ok) {
-        _af_packet.clear();
+        af_packet.clear();
     }
-
-    return _af_packet;
 }
 
 std::string AFBuilder::visualise()
@@ -475,7 +491,7 @@ std::string AFBuilder::visualise()
     stringstream ss;
     ss << "|";
     for (size_t i = 0; i < _Fcount; i++) {
-        if (_fragments.count(i)) {
+        if (_fragments[i].received) {
             ss << ".";
         }
         else {
@@ -489,22 +505,24 @@ std::string AFBuilder::visualise()
 std::string AFBuilder::visualise_fragment_origins() const
 {
     stringstream ss;
-    if (_fragments.size() == 0) {
+    if (_num_fragments == 0) {
         return "No fragments";
     }
     else {
-        ss << _fragments.size() << " fragments: ";
+        ss << _num_fragments << " fragments: ";
     }
 
     std::map<int, size_t> port_count;
 
-    for (const auto& f : _fragments) {
-        port_count[f.second.received_on_port]++;
+    for (size_t i = 0; i < _Fcount; i++) {
+        if (_fragments[i].received) {
+            port_count[_fragments[i].received_on_port]++;
+        }
     }
 
     for (const auto& p : port_count) {
         ss << "p" << p.first << " " <<
-            std::round(100.0 * ((double)p.second) / (double)_fragments.size()) << "% ";
+            std::round(100.0 * ((double)p.second) / (double)_num_fragments) << "% ";
     }
 
     ss << "\n";
@@ -512,70 +530,166 @@ std::string AFBuilder::visualise_fragment_origins() const
     return ss.str();
 }
 
+// Limits the memory used by the fragments of one AF packet
+const findex_t MAX_FCOUNT = 1 << 14;
+
+// The initial number of AFBuilder slots, a power of two so that the slots
+// of consecutive Pseq stay consecutive when the Pseq wraps around.
+static size_t num_builder_slots(size_t max_delay)
+{
+    size_t n = 1;
+    while (n < NUM_AFBUILDERS_TO_KEEP + max_delay + 2) {
+        n *= 2;
+    }
+    return n;
+}
+
+// Every AF packet that waits for its lifetime to run out delays the ones
+// after it, the slots are doubled up to this number when they do not cover
+// all Pseq ahead of the next one.
+const size_t MAX_BUILDER_SLOTS = 1 << 12;
+
+PFT::PFT() :
+    m_builders(num_builder_slots(m_max_delay))
+{
+}
+
+AFBuilder *PFT::findBuilder(pseq_t pseq)
+{
+    auto& slot = m_builders[pseq % m_builders.size()];
+    if (slot.used and slot.builder.Pseq() == pseq) {
+        return &slot.builder;
+    }
+    return nullptr;
+}
+
+bool PFT::isAhead(pseq_t pseq) const
+{
+    return (pseq_t)(pseq - m_next_pseq) < m_builders.size();
+}
+
+void PFT::growBuilders()
+{
+    std::vector<builder_slot_t> builders(m_builders.size() * 2);
+    for (auto& slot : m_builders) {
+        if (slot.used) {
+            builders[slot.builder.Pseq() % builders.size()] = std::move(slot);
+        }
+    }
+    m_builders = std::move(builders);
+}
+
+void PFT::clearBuilders()
+{
+    for (auto& slot : m_builders) {
+        slot.used = false;
+    }
+    m_num_builders = 0;
+}
+
 void PFT::pushPFTFrag(const Fragment &fragment)
 {
+    if (fragment.Fcount() == 0 or fragment.Fcount() > MAX_FCOUNT) {
+        etiLog.level(warn) << "Discarding fragment with unsupported fcount " <<
+            fragment.Fcount();
+        return;
+    }
+
     // Start decoding the first pseq we receive. In normal
-    // operation without interruptions, the map should
-    // never become empty
-    if (m_afbuilders.empty()) {
+    // operation without interruptions, there should
+    // always be builders
+    if (m_num_builders == 0) {
         m_next_pseq = fragment.Pseq();
         etiLog.log(debug,"Initialise next_pseq to %u\n", m_next_pseq);
     }
 
-    if (m_afbuilders.count(fragment.Pseq()) == 0) {
+    const pseq_t distance = fragment.Pseq() - m_next_pseq;
+    while (m_builders.size() < MAX_BUILDER_SLOTS and
+            distance >= m_builders.size() and distance < MAX_BUILDER_SLOTS) {
+        const auto& slot = m_builders[fragment.Pseq() % m_builders.size()];
+        if (not slot.used or not isAhead(slot.builder.Pseq())) {
+            break;
+        }
+        growBuilders();
+    }
+
+    auto& slot = m_builders[fragment.Pseq() % m_builders.size()];
+    if (not slot.used or slot.builder.Pseq() != fragment.Pseq()) {
+        // The next Pseq and the ones following it have a slot each, late
+        // fragments of older AF packets or the fragments of a Pseq far
+        // ahead must not replace them. They can replace the AFBuilders
+        // kept behind the next Pseq, so that the PFT reinitialises when
+        // the Pseq jump.
+        if (slot.used and isAhead(slot.builder.Pseq())) {
+            return;
+        }
+
         // The AFBuilder wants to know the lifetime in number of fragments,
         // we know the delay in number of AF packets. Every AF packet
         // is cut into Fcount fragments.
         const size_t lifetime = fragment.Fcount() * m_max_delay;
 
-        // Build the afbuilder in the map in-place
-        m_afbuilders.emplace(std::piecewise_construct,
-                /* key */
-                std::forward_as_tuple(fragment.Pseq()),
-                /* builder */
-                std::forward_as_tuple(fragment.Pseq(), fragment.Fcount(), lifetime));
+        if (not slot.used) {
+            slot.used = true;
+            m_num_builders++;
+        }
+        slot.builder.reset(fragment.Pseq(), fragment.Fcount(), lifetime);
+
+        // If the AFBuilder of a Pseq before the next one was already
+        // removed, it is not known when the first copies arrived.
+        slot.count_arrivals = isAhead(fragment.Pseq());
     }
 
-    auto& p = m_afbuilders.at(fragment.Pseq());
-    p.pushPFTFrag(fragment);
+    PathStatistics *stats = slot.count_arrivals ? m_path_stats : nullptr;
+
+    slot.builder.pushPFTFrag(fragment,
+            stats ? PathStatistics::clock::now() :
+            PathStatistics::clock::time_point(),
+            stats);
 
     if (m_verbose) {
         etiLog.log(debug, "Got frag %u:%u, afbuilders: ",
                 fragment.Pseq(), fragment.Findex());
-        for (auto &k : m_afbuilders) {
-            const bool isNextPseq = (m_next_pseq == k.first);
-            etiLog.level(debug) << (isNextPseq ? "->" : "  ") <<
-                k.first << " " << k.second.visualise();
+        for (auto &k : m_builders) {
+            if (k.used) {
+                const bool isNextPseq = (m_next_pseq == k.builder.Pseq());
+                etiLog.level(debug) << (isNextPseq ? "->" : "  ") <<
+                    k.builder.Pseq() << " " << k.builder.visualise();
+            }
         }
     }
 }
 
 
-afpacket_pft_t PFT::getNextAFPacket()
+const afpacket_pft_t& PFT::getNextAFPacket()
 {
-    afpacket_pft_t af;
-
-    if (m_afbuilders.count(m_next_pseq) == 0) {
-        if (m_afbuilders.size() > m_max_delay) {
-            m_afbuilders.clear();
+    afpacket_pft_t& af = m_af;
+    af.af_packet.clear();
+    af.pseq = 0;
+    af.arrival = {};
+
+    AFBuilder *next_builder = findBuilder(m_next_pseq);
+    if (next_builder == nullptr) {
+        if (m_num_builders > m_max_delay) {
+            clearBuilders();
             etiLog.level(debug) << " Reinit";
         }
 
         return af;
     }
 
-    auto &builder = m_afbuilders.at(m_next_pseq);
+    auto &builder = *next_builder;
 
     using dar_t = AFBuilder::decode_attempt_result_t;
 
     if (builder.canAttemptToDecode() == dar_t::yes) {
-        auto afpacket = builder.extractAF();
+        builder.extractAF(af.af_packet);
         // Empty AF Packet can happen if CRC is wrong
         if (m_verbose) {
             etiLog.level(debug) << "Fragment origin stats: " << builder.visualise_fragment_origins();
         }
         af.pseq = m_next_pseq;
-        af.af_packet = afpacket;
+        af.arrival = builder.arrival();
         incrementNextPseq();
     }
     else if (builder.canAttemptToDecode() == dar_t::maybe) {
@@ -585,16 +699,16 @@ afpacket_pft_t PFT::getNextAFPacket()
 
         if (builder.lifeTime == 0) {
             // Attempt Reed-Solomon decoding
-            auto afpacket = builder.extractAF();
+            builder.extractAF(af.af_packet);
 
-            if (afpacket.empty()) {
+            if (af.af_packet.empty()) {
                 etiLog.log(debug, "pseq %d timed out after RS", m_next_pseq);
             }
             if (m_verbose) {
                 etiLog.level(debug) << "Fragment origin stats: " << builder.visualise_fragment_origins();
             }
             af.pseq = m_next_pseq;
-            af.af_packet = afpacket;
+            af.arrival = builder.arrival();
             incrementNextPseq();
         }
     }
@@ -615,6 +729,9 @@ afpacket_pft_t PFT::getNextAFPacket()
 void PFT::setMaxDelay(size_t num_af_packets)
 {
     m_max_delay = num_af_packets;
+    m_builders.clear();
+    m_builders.resize(num_builder_slots(m_max_delay));
+    m_num_builders = 0;
 }
 
 void PFT::setVerbose(bool enable)
@@ -622,10 +739,17 @@ void PFT::setVerbose(bool enable)
     m_verbose = enable;
 }
 
+void PFT::setPathStatistics(PathStatistics *stats)
+{
+    m_path_stats = stats;
+}
+
 void PFT::incrementNextPseq()
 {
-    if (m_afbuilders.count(m_next_pseq - NUM_AFBUILDERS_TO_KEEP) > 0) {
-        m_afbuilders.erase(m_next_pseq - NUM_AFBUILDERS_TO_KEEP);
+    const pseq_t old_pseq = m_next_pseq - NUM_AFBUILDERS_TO_KEEP;
+    if (findBuilder(old_pseq) != nullptr) {
+        m_builders[old_pseq % m_builders.size()].used = false;
+        m_num_builders--;
     }
 
     m_next_pseq++;
@@ -21,11 +21,13 @@
  */
 
 #pragma once
+#include <chrono>
 #include <cstdio>
 #include <cstdint>
 #include <vector>
 #include <map>
 #include <string>
+#include "PathStatistics.hpp"
 
 namespace EdiDecoder {
 namespace PFT {
@@ -38,13 +40,22 @@ class Fragment
     public:
         int received_on_port = 0;
 
+        // Index of the source the fragment was received from, when the
+        // same stream is received from several sources.
+        size_t source = 0;
+
+        // When the fragment was received, the epoch if not known
+        std::chrono::system_clock::time_point arrival;
+
         // Load the data for one fragment from buf into
         // the Fragment.
         // \returns the number of bytes of useful data found in buf
         // A non-zero return value doesn't imply a valid fragment
         // the isValid() method must be used to verify this.
+        // The payload is not copied, it stays in buf.
         size_t loadData(const std::vector<uint8_t> &buf, int received_on_port);
         size_t loadData(const std::vector<uint8_t> &buf);
+        size_t loadData(const uint8_t *buf, size_t len, int received_on_port);
 
         bool isValid() const { return _valid; }
         pseq_t Pseq() const { return _Pseq; }
@@ -54,13 +65,14 @@ class Fragment
         uint16_t Plen() const { return _Plen; }
         uint8_t RSk() const { return _RSk; }
         uint8_t RSz() const { return _RSz; }
-        const std::vector<uint8_t>& payload() const
-            { return _payload; }
+        // The Plen bytes of payload in the buffer given to loadData(),
+        // only valid as long as that buffer is.
+        const uint8_t *payload() const { return _payload; }
 
         bool checkConsistency(const Fragment& other) const;
 
     private:
-        std::vector<uint8_t> _payload;
+        const uint8_t *_payload = nullptr;
 
         pseq_t _Pseq = 0;
         findex_t _Findex = 0;
@@ -96,24 +108,42 @@ class AFBuilder
             return "?";
         }
 
+        AFBuilder() = default;
         AFBuilder(pseq_t Pseq, findex_t Fcount, size_t lifetime);
 
-        void pushPFTFrag(const Fragment &frag);
+        /* Start building another AF packet, keeping the buffers
+         * already allocated.
+         */
+        void reset(pseq_t Pseq, findex_t Fcount, size_t lifetime);
+
+        /* Copies the payload of the fragment, unless a fragment with the
+         * same Findex was already pushed. If stats is given, the arrival
+         * is counted for the source of the fragment.
+         */
+        void pushPFTFrag(const Fragment &frag,
+                PathStatistics::clock::time_point arrival,
+                PathStatistics *stats);
 
         /* Assess if it may be possible to decode this AF packet */
         decode_attempt_result_t canAttemptToDecode();
 
-        /* Try to build the AF with received fragments.
+        /* Try to build the AF with received fragments into af_packet.
          * Apply error correction if necessary (missing packets/CRC errors)
-         * \return an empty vector if building the AF is not possible
+         * af_packet is empty if building the AF is not possible
          */
-        std::vector<uint8_t> extractAF();
+        void extractAF(std::vector<uint8_t>& af_packet);
 
         std::pair<findex_t, findex_t>
             numberOfFragments(void) const {
-                return {_fragments.size(), _Fcount};
+                return {_num_fragments, _Fcount};
             }
 
+        pseq_t Pseq() const { return _Pseq; }
+
+        /* The latest arrival of the fragments pushed, which is when the
+         * AF packet could be decoded. */
+        std::chrono::system_clock::time_point arrival() const { return _arrival; }
+
         std::string visualise();
 
         std::string visualise_fragment_origins() const;
@@ -121,18 +151,34 @@ class AFBuilder
         /* The user of this instance can keep track of the lifetime of this
          * builder
          */
-        size_t lifeTime;
+        size_t lifeTime = 0;
 
     private:
+        void clearFragments();
+
+        struct fragment_slot_t {
+            bool received = false;
+            int received_on_port = 0;
+            PathStatistics::clock::time_point arrival;
+            std::vector<uint8_t> payload;
+        };
+
+        // The slots of the Fcount fragments, indexed by fragment index.
+        // There can be more slots than fragments, which are kept for
+        // the next AF packets.
+        std::vector<fragment_slot_t> _fragments;
+        findex_t _num_fragments = 0;
 
-        // A map from fragment index to fragment
-        std::map<findex_t, Fragment> _fragments;
+        // The first fragment received, all the others must be consistent
+        // with it. Its payload isn't valid anymore.
+        Fragment _reference;
 
-        // cached version of decoded AF packet
-        mutable std::vector<uint8_t> _af_packet;
+        // Reused for every RS decoding
+        std::vector<uint8_t> _rs_block;
 
-        pseq_t _Pseq;
-        findex_t _Fcount;
+        pseq_t _Pseq = 0;
+        findex_t _Fcount = 0;
+        std::chrono::system_clock::time_point _arrival;
 };
 
 struct afpacket_pft_t
@@ -140,19 +186,24 @@ struct afpacket_pft_t
     // validity of the struct is given by af_packet begin empty or not.
     std::vector<uint8_t> af_packet;
     pseq_t pseq = 0;
+    // See AFBuilder::arrival()
+    std::chrono::system_clock::time_point arrival;
 };
 
 class PFT
 {
     public:
+        PFT();
+
         void pushPFTFrag(const Fragment &fragment);
 
         /* Try to build the AF packet for the next pseq. This might
          * skip one or more pseq according to the maximum delay setting.
+         * The AF packet is valid until the next call.
          *
          * \return an empty vector if building the AF is not possible
          */
-        afpacket_pft_t getNextAFPacket();
+        const afpacket_pft_t& getNextAFPacket();
 
         /* Set the maximum delay in number of AF Packets before we
          * abandon decoding a given pseq.
@@ -162,14 +213,37 @@ class PFT
         /* Enable verbose fprintf */
         void setVerbose(bool enable);
 
+        /* Count the fragments received from every source in stats, which
+         * must outlive the PFT. */
+        void setPathStatistics(PathStatistics *stats);
+
     private:
         void incrementNextPseq();
 
+        // Returns the AFBuilder for the Pseq, or nullptr
+        AFBuilder *findBuilder(pseq_t pseq);
+        bool isAhead(pseq_t pseq) const;
+        void growBuilders();
+        void clearBuilders();
+
         pseq_t m_next_pseq;
         size_t m_max_delay = 10; // in AF packets
 
-        // Keep one AFBuilder for each Pseq
-        std::map<pseq_t, AFBuilder> m_afbuilders;
+        // Keep one AFBuilder for each Pseq, in the slot given by the Pseq
+        // modulo the number of slots, a power of two that covers the
+        // maximum delay and grows when the next Pseq lags behind. The slots
+        // and their fragments are reused.
+        struct builder_slot_t {
+            bool used = false;
+            bool count_arrivals = false;
+            AFBuilder builder;
+        };
+        std::vector<builder_slot_t> m_builders;
+        size_t m_num_builders = 0;
+
+        afpacket_pft_t m_af;
+
+        PathStatistics *m_path_stats = nullptr;
 
         bool m_verbose = 0;
 };
@@ -0,0 +1,115 @@
+/* ------------------------------------------------------------------
+ * Copyright (C) 2026 Matthias P. Braendli
+ *                    matthias.braendli@mpb.li
+ *
+ * http://opendigitalradio.org
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ * -------------------------------------------------------------------
+ */
+
+#include "PathStatistics.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace EdiDecoder {
+
+size_t PathStatistics::bin_index(uint64_t delay_us)
+{
+    if (delay_us < 2) {
+        return 0;
+    }
+
+    // Position of the most significant bit gives the octave, the two
+    // following bits give the bin inside the octave.
+    const size_t octave = 63 - __builtin_clzll(delay_us);
+    size_t sub = 0;
+    if (octave >= 2) {
+        sub = (delay_us >> (octave - 2)) & 0x3;
+    }
+    else {
+        sub = (delay_us << (2 - octave)) & 0x3;
+    }
+
+    return std::min(octave * bins_per_octave + sub, num_bins - 1);
+}
+
+uint64_t PathStatistics::bin_upper_bound(size_t index)
+{
+    const size_t octave = index / bins_per_octave;
+    const size_t sub = index % bins_per_octave;
+    // Lower bound of the bin is (4 + sub) * 2^octave / 4
+    return (((uint64_t)(bins_per_octave + sub + 1)) << octave) / bins_per_octave;
+}
+
+uint64_t PathStatistics::source_t::late_percentile_us(double p) const
+{
+    if (num_late == 0) {
+        return 0;
+    }
+
+    const uint64_t rank = std::max<uint64_t>(1, std::ceil(p * num_late));
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < num_bins; i++) {
+        cumulative += late_bins[i];
+        if (cumulative >= rank) {
+            return std::min(bin_upper_bound(i), late_max_us);
+        }
+    }
+    return late_max_us;
+}
+
+PathStatistics::source_t& PathStatistics::get_source(size_t source)
+{
+    if (source >= m_sources.size()) {
+        m_sources.resize(source + 1);
+    }
+    return m_sources[source];
+}
+
+void PathStatistics::add_first(size_t source)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    get_source(source).num_first++;
+}
+
+void PathStatistics::add_late(size_t source, clock::duration delay)
+{
+    using namespace std::chrono;
+    const uint64_t delay_us = std::max<int64_t>(0,
+            duration_cast<microseconds>(delay).count());
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& s = get_source(source);
+    s.num_late++;
+    s.late_bins[bin_index(delay_us)]++;
+    s.late_max_us = std::max(s.late_max_us, delay_us);
+}
+
+std::vector<PathStatistics::source_stats_t> PathStatistics::get() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<source_stats_t> stats(m_sources.size());
+    for (size_t i = 0; i < m_sources.size(); i++) {
+        const auto& s = m_sources[i];
+        stats[i].num_first = s.num_first;
+        stats[i].num_late = s.num_late;
+        stats[i].late_p50_us = s.late_percentile_us(0.5);
+        stats[i].late_p99_us = s.late_percentile_us(0.99);
+        stats[i].late_max_us = s.late_max_us;
+    }
+    return stats;
+}
+
+}
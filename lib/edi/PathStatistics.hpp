@@ -0,0 +1,92 @@
+/* ------------------------------------------------------------------
+ * Copyright (C) 2026 Matthias P. Braendli
+ *                    matthias.braendli@mpb.li
+ *
+ * http://opendigitalradio.org
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ * -------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace EdiDecoder {
+
+/* When the same EDI stream is received from several sources, only the
+ * first copy of every PFT fragment or AF packet is used. For every source,
+ * this counts the copies it delivered first, and keeps a histogram of how
+ * much later than the first one it delivered the other copies.
+ *
+ * The delays tell how far the maximum delay of the PFT can be lowered
+ * while keeping the protection of the slower paths. The bins are
+ * logarithmic with four bins per octave, like the ones of the flowgraph
+ * latency. Can be read from another thread than the one decoding.
+ */
+class PathStatistics
+{
+    public:
+        using clock = std::chrono::steady_clock;
+
+        void add_first(size_t source);
+        void add_late(size_t source, clock::duration delay);
+
+        struct source_stats_t {
+            uint64_t num_first = 0;
+            uint64_t num_late = 0;
+
+            // Upper bounds of the bins containing the percentiles of the
+            // delays of the late copies.
+            uint64_t late_p50_us = 0;
+            uint64_t late_p99_us = 0;
+            uint64_t late_max_us = 0;
+        };
+
+        /* Returns the statistics indexed by source, up to the last source
+         * that delivered a copy. */
+        std::vector<source_stats_t> get() const;
+
+        /* The bins, also used for other histograms of durations in
+         * microseconds */
+        static constexpr size_t bins_per_octave = 4;
+        static constexpr size_t num_octaves = 24;
+        static constexpr size_t num_bins = bins_per_octave * num_octaves;
+
+        static size_t bin_index(uint64_t delay_us);
+        static uint64_t bin_upper_bound(size_t index);
+
+    private:
+
+        struct source_t {
+            uint64_t num_first = 0;
+            uint64_t num_late = 0;
+            uint64_t late_max_us = 0;
+            std::array<uint64_t, num_bins> late_bins = {};
+
+            uint64_t late_percentile_us(double p) const;
+        };
+
+        source_t& get_source(size_t source);
+
+        mutable std::mutex m_mutex;
+        std::vector<source_t> m_sources;
+};
+
+}
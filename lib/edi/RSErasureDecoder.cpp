@@ -0,0 +1,302 @@
+/* ------------------------------------------------------------------
+ * Copyright (C) 2026 Matthias P. Braendli
+ *                    matthias.braendli@mpb.li
+ *
+ * http://opendigitalradio.org
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ * -------------------------------------------------------------------
+ */
+
+#include "RSErasureDecoder.hpp"
+#include <algorithm>
+#if defined(__x86_64__) || defined(__i386__)
+#  include <immintrin.h>
+#elif defined(__ARM_NEON)
+#  include <arm_neon.h>
+#endif
+
+namespace EdiDecoder {
+namespace PFT {
+
+using RS = RSErasureDecoder;
+
+// Computes the nroots syndromes of max_codewords codewords, syndrome i of
+// codeword k goes to syndromes[i * max_codewords + k]. Syndrome i is the
+// codeword evaluated at alpha^(i+1), with Horner's method.
+using syndromes_kernel_t = void (*)(const uint8_t *symbols,
+        const uint8_t (*tables)[32], uint8_t *syndromes);
+
+static void syndromes_scalar(const uint8_t *symbols,
+        const uint8_t (*tables)[32], uint8_t *syndromes)
+{
+    for (size_t i = 0; i < RS::nroots; i++) {
+        const uint8_t *t = tables[i];
+        for (size_t k = 0; k < RS::max_codewords; k++) {
+            uint8_t s = 0;
+            for (size_t j = 0; j < RS::N; j++) {
+                s = t[s & 0x0f] ^ t[16 + (s >> 4)] ^
+                    symbols[j * RS::max_codewords + k];
+            }
+            syndromes[i * RS::max_codewords + k] = s;
+        }
+    }
+}
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+// Compiled for SSSE3 and AVX2 even if the rest of the program isn't, and
+// only used if the CPU supports them.
+#  define HAVE_RS_ERASURES_DISPATCH 1
+
+// The codewords are in the 16 bytes of the registers, four syndromes are
+// computed at the same time to hide the latency of the multiplications.
+__attribute__((target("ssse3")))
+static void syndromes_ssse3(const uint8_t *symbols,
+        const uint8_t (*tables)[32], uint8_t *syndromes)
+{
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    for (size_t i = 0; i < RS::nroots; i += 4) {
+        __m128i lo[4], hi[4], s[4];
+        for (size_t u = 0; u < 4; u++) {
+            lo[u] = _mm_load_si128((const __m128i*)tables[i + u]);
+            hi[u] = _mm_load_si128((const __m128i*)(tables[i + u] + 16));
+            s[u] = _mm_setzero_si128();
+        }
+
+        for (size_t j = 0; j < RS::N; j++) {
+            const __m128i x = _mm_loadu_si128(
+                    (const __m128i*)(symbols + j * RS::max_codewords));
+            for (size_t u = 0; u < 4; u++) {
+                const __m128i l = _mm_shuffle_epi8(lo[u],
+                        _mm_and_si128(s[u], mask));
+                const __m128i h = _mm_shuffle_epi8(hi[u],
+                        _mm_and_si128(_mm_srli_epi64(s[u], 4), mask));
+                s[u] = _mm_xor_si128(_mm_xor_si128(l, h), x);
+            }
+        }
+
+        for (size_t u = 0; u < 4; u++) {
+            _mm_storeu_si128(
+                    (__m128i*)(syndromes + (i + u) * RS::max_codewords), s[u]);
+        }
+    }
+}
+
+// Two syndromes per register, one in each 128-bit lane, in which the
+// byte shuffle works separately.
+__attribute__((target("avx2")))
+static void syndromes_avx2(const uint8_t *symbols,
+        const uint8_t (*tables)[32], uint8_t *syndromes)
+{
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    for (size_t i = 0; i < RS::nroots; i += 8) {
+        __m256i lo[4], hi[4], s[4];
+        for (size_t u = 0; u < 4; u++) {
+            const uint8_t *t0 = tables[i + 2 * u];
+            const uint8_t *t1 = tables[i + 2 * u + 1];
+            lo[u] = _mm256_setr_m128i(
+                    _mm_load_si128((const __m128i*)t0),
+                    _mm_load_si128((const __m128i*)t1));
+            hi[u] = _mm256_setr_m128i(
+                    _mm_load_si128((const __m128i*)(t0 + 16)),
+                    _mm_load_si128((const __m128i*)(t1 + 16)));
+            s[u] = _mm256_setzero_si256();
+        }
+
+        for (size_t j = 0; j < RS::N; j++) {
+            const __m256i x = _mm256_broadcastsi128_si256(_mm_loadu_si128(
+                    (const __m128i*)(symbols + j * RS::max_codewords)));
+            for (size_t u = 0; u < 4; u++) {
+                const __m256i l = _mm256_shuffle_epi8(lo[u],
+                        _mm256_and_si256(s[u], mask));
+                const __m256i h = _mm256_shuffle_epi8(hi[u],
+                        _mm256_and_si256(_mm256_srli_epi64(s[u], 4), mask));
+                s[u] = _mm256_xor_si256(_mm256_xor_si256(l, h), x);
+            }
+        }
+
+        for (size_t u = 0; u < 4; u++) {
+            _mm256_storeu_si256(
+                    (__m256i*)(syndromes + (i + 2 * u) * RS::max_codewords),
+                    s[u]);
+        }
+    }
+}
+#endif
+
+#if defined(__ARM_NEON)
+static void syndromes_neon(const uint8_t *symbols,
+        const uint8_t (*tables)[32], uint8_t *syndromes)
+{
+    const uint8x16_t mask = vdupq_n_u8(0x0f);
+    for (size_t i = 0; i < RS::nroots; i += 4) {
+        uint8x16_t lo[4], hi[4], s[4];
+        for (size_t u = 0; u < 4; u++) {
+            lo[u] = vld1q_u8(tables[i + u]);
+            hi[u] = vld1q_u8(tables[i + u] + 16);
+            s[u] = vdupq_n_u8(0);
+        }
+
+        for (size_t j = 0; j < RS::N; j++) {
+            const uint8x16_t x = vld1q_u8(symbols + j * RS::max_codewords);
+            for (size_t u = 0; u < 4; u++) {
+                const uint8x16_t l = vqtbl1q_u8(lo[u], vandq_u8(s[u], mask));
+                const uint8x16_t h = vqtbl1q_u8(hi[u], vshrq_n_u8(s[u], 4));
+                s[u] = veorq_u8(veorq_u8(l, h), x);
+            }
+        }
+
+        for (size_t u = 0; u < 4; u++) {
+            vst1q_u8(syndromes + (i + u) * RS::max_codewords, s[u]);
+        }
+    }
+}
+#endif
+
+static syndromes_kernel_t select_syndromes_kernel()
+{
+#if defined(HAVE_RS_ERASURES_DISPATCH)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return syndromes_avx2;
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        return syndromes_ssse3;
+    }
+#elif defined(__ARM_NEON)
+    return syndromes_neon;
+#endif
+    return syndromes_scalar;
+}
+
+RSErasureDecoder::RSErasureDecoder()
+{
+    const unsigned gf_poly = 0x11d;
+    unsigned x = 1;
+    for (size_t i = 0; i < N; i++) {
+        m_exp[i] = m_exp[i + N] = x;
+        m_log[x] = i;
+        x <<= 1;
+        if (x & 0x100) {
+            x ^= gf_poly;
+        }
+    }
+    m_log[0] = 0; // never used
+
+    for (size_t i = 0; i < nroots; i++) {
+        const uint8_t root = m_exp[i + 1];
+        for (unsigned v = 0; v < 16; v++) {
+            m_syndrome_tables[i][v] = mul(root, v);
+            m_syndrome_tables[i][16 + v] = mul(root, v << 4);
+        }
+    }
+}
+
+uint8_t RSErasureDecoder::mul(uint8_t a, uint8_t b) const
+{
+    if (a == 0 or b == 0) {
+        return 0;
+    }
+    return m_exp[m_log[a] + m_log[b]];
+}
+
+void RSErasureDecoder::decode(const uint8_t *symbols, size_t num_codewords,
+        codeword_t *codewords) const
+{
+    static const syndromes_kernel_t syndromes_kernel =
+        select_syndromes_kernel();
+
+    alignas(32) uint8_t syndromes[nroots * max_codewords];
+    syndromes_kernel(symbols, m_syndrome_tables, syndromes);
+
+    for (size_t k = 0; k < std::min(num_codewords, max_codewords); k++) {
+        uint8_t s[nroots];
+        for (size_t i = 0; i < nroots; i++) {
+            s[i] = syndromes[i * max_codewords + k];
+        }
+        solve(s, codewords[k]);
+    }
+}
+
+void RSErasureDecoder::solve(const uint8_t *s, codeword_t& codeword) const
+{
+    codeword.decoded = false;
+
+    const size_t no_eras = codeword.no_eras;
+    if (no_eras > nroots) {
+        return;
+    }
+
+    // The erasure locator polynomial, whose roots are the inverses of
+    // alpha^(N-1-pos) for the erasure positions.
+    uint8_t lambda[nroots + 1] = {1};
+    for (size_t e = 0; e < no_eras; e++) {
+        const int pos = codeword.eras_pos[e];
+        if (pos < 0 or pos >= (int)N) {
+            return;
+        }
+        const uint8_t x = m_exp[N - 1 - pos];
+        for (size_t l = e + 1; l > 0; l--) {
+            lambda[l] ^= mul(x, lambda[l - 1]);
+        }
+    }
+
+    // The error evaluator omega is the product of the syndrome polynomial
+    // and lambda, modulo x^nroots. If all errors are erasures, its degree
+    // is below no_eras, otherwise the codeword has other errors.
+    uint8_t omega[nroots];
+    for (size_t d = 0; d < nroots; d++) {
+        uint8_t c = 0;
+        for (size_t l = 0; l <= std::min(d, no_eras); l++) {
+            c ^= mul(lambda[l], s[d - l]);
+        }
+
+        if (d < no_eras) {
+            omega[d] = c;
+        }
+        else if (c != 0) {
+            return;
+        }
+    }
+
+    // Forney's formula, with a first root of 1. The derivative of lambda
+    // only has the odd terms.
+    for (size_t e = 0; e < no_eras; e++) {
+        const uint8_t x_inv = m_exp[(codeword.eras_pos[e] + 1) % N];
+
+        uint8_t num = 0;
+        for (size_t d = no_eras; d > 0; d--) {
+            num = mul(num, x_inv) ^ omega[d - 1];
+        }
+
+        uint8_t den = 0;
+        const uint8_t x_inv2 = mul(x_inv, x_inv);
+        for (int l = (no_eras - 1) | 1; l > 0; l -= 2) {
+            den = mul(den, x_inv2) ^ lambda[l];
+        }
+
+        if (den == 0) {
+            // Two erasures at the same position
+            return;
+        }
+
+        codeword.corrections[e] = num == 0 ? 0 :
+            m_exp[m_log[num] + N - m_log[den]];
+    }
+
+    codeword.decoded = true;
+}
+
+}
+}
@@ -0,0 +1,88 @@
+/* ------------------------------------------------------------------
+ * Copyright (C) 2026 Matthias P. Braendli
+ *                    matthias.braendli@mpb.li
+ *
+ * http://opendigitalradio.org
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ * -------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace EdiDecoder {
+namespace PFT {
+
+/* Decoder for the RS(255, 207) code of the EDI PFT, the same code as the
+ * one of the libfec decoder: GF(256) with the field polynomial 0x11d, first
+ * root 1 and primitive element 1.
+ *
+ * It only corrects erasures, which the PFT knows from the missing
+ * fragments, and decodes up to max_codewords codewords together, with the
+ * syndromes of all codewords computed at once in SIMD registers.
+ *
+ * A codeword that also has errors outside of the erasures isn't decoded,
+ * it has to go through the libfec decoder, which also corrects errors. The
+ * tables are only read, several threads can decode at the same time.
+ */
+class RSErasureDecoder
+{
+    public:
+        static constexpr size_t N = 255;
+        static constexpr size_t nroots = 48;
+        static constexpr size_t max_codewords = 16;
+
+        struct codeword_t {
+            // The positions of the erasures in the codeword, given by
+            // the caller.
+            size_t no_eras = 0;
+            int eras_pos[nroots];
+
+            // Set by decode(). If the codeword was decoded, the values to
+            // add (xor) to the symbols at the positions of the erasures.
+            bool decoded = false;
+            uint8_t corrections[nroots];
+        };
+
+        RSErasureDecoder();
+        RSErasureDecoder(const RSErasureDecoder& other) = delete;
+        RSErasureDecoder& operator=(const RSErasureDecoder& other) = delete;
+
+        /* symbols contains the N symbols of max_codewords codewords,
+         * symbol i of codeword k is at symbols[i * max_codewords + k].
+         * Only the first num_codewords are decoded.
+         */
+        void decode(const uint8_t *symbols, size_t num_codewords,
+                codeword_t *codewords) const;
+
+    private:
+        void solve(const uint8_t *syndromes, codeword_t& codeword) const;
+        uint8_t mul(uint8_t a, uint8_t b) const;
+
+        // m_exp is twice as long so that the sum of two logarithms
+        // doesn't need a reduction modulo N.
+        uint8_t m_exp[2 * N];
+        uint8_t m_log[N + 1];
+
+        // For every syndrome i, the products of alpha^(i+1) with the 16
+        // values of the low nibble, followed by those with the values of
+        // the high nibble.
+        alignas(32) uint8_t m_syndrome_tables[nroots][32];
+};
+
+}
+}
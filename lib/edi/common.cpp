@@ -28,6 +28,8 @@
 #include <cmath>
 #include <cstdio>
 #include <cctype>
+#include <cstring>
+#include <stdexcept>
 
 namespace EdiDecoder {
 
@@ -133,6 +135,7 @@ TagDispatcher::TagDispatcher(std::function<void()>&& af_packet_completed) :
     m_af_packet_completed(std::move(af_packet_completed)),
     m_afpacket_handler([](std::vector<uint8_t>&& /*ignore*/){})
 {
+    m_pft.setPathStatistics(&m_path_statistics);
 }
 
 void TagDispatcher::set_verbose(bool verbose)
@@ -140,25 +143,69 @@ void TagDispatcher::set_verbose(bool verbose)
     m_pft.setVerbose(verbose);
 }
 
-void TagDispatcher::push_bytes(const vector<uint8_t> &buf)
+void TagDispatcher::push_bytes(const vector<uint8_t> &buf, size_t source)
 {
     if (buf.empty()) {
-        m_input_data.clear();
+        if (source < m_streams.size()) {
+            m_streams[source].begin = 0;
+            m_streams[source].end = 0;
+        }
         m_last_sequences.seq_valid = false;
         return;
     }
 
-    copy(buf.begin(), buf.end(), back_inserter(m_input_data));
+    uint8_t *dest = stream_reserve(buf.size(), source);
+    copy(buf.begin(), buf.end(), dest);
+    stream_commit(buf.size(), source);
+}
+
+uint8_t* TagDispatcher::stream_reserve(size_t max_len, size_t source)
+{
+    if (source >= m_streams.size()) {
+        m_streams.resize(source + 1);
+    }
+    auto& stream = m_streams[source];
+
+    if (stream.data.size() - stream.end < max_len) {
+        // Move the incomplete packet to the front before growing
+        if (stream.begin > 0) {
+            memmove(stream.data.data(), stream.data.data() + stream.begin,
+                    stream.end - stream.begin);
+            stream.end -= stream.begin;
+            stream.begin = 0;
+        }
+        if (stream.data.size() - stream.end < max_len) {
+            stream.data.resize(stream.end + max_len);
+        }
+    }
+    return stream.data.data() + stream.end;
+}
+
+void TagDispatcher::stream_commit(size_t len, size_t source)
+{
+    auto& stream = m_streams.at(source);
+    if (stream.end + len > stream.data.size()) {
+        throw std::logic_error("EDI stream: more bytes than reserved");
+    }
+    stream.end += len;
+    m_last_arrival = chrono::system_clock::now();
+
+    // The packets are decoded where they were received, and the buffer
+    // does not move until the next stream_reserve()
+    while (stream.end - stream.begin > 2) {
+        const uint8_t *data = stream.data.data() + stream.begin;
+        const size_t available = stream.end - stream.begin;
 
-    while (m_input_data.size() > 2) {
-        if (m_input_data[0] == 'A' and m_input_data[1] == 'F') {
-            const auto r = decode_afpacket(m_input_data);
+        if (data[0] == 'A' and data[1] == 'F') {
+            const auto r = decode_afpacket(data, available, source);
             bool leave_loop = false;
             switch (r.st) {
                 case decode_state_e::Ok:
                     m_last_sequences.pseq_valid = false;
                     m_af_packet_completed();
                     break;
+                case decode_state_e::Duplicate:
+                    break;
                 case decode_state_e::MissingData:
                     /* Continue filling buffer */
                     leave_loop = true;
@@ -169,38 +216,30 @@ void TagDispatcher::push_bytes(const vector<uint8_t> &buf)
                     break;
             }
 
-            if (r.num_bytes_consumed) {
-                vector<uint8_t> remaining_data;
-                copy(m_input_data.begin() + r.num_bytes_consumed,
-                        m_input_data.end(),
-                        back_inserter(remaining_data));
-                m_input_data = remaining_data;
-            }
+            stream.begin += r.num_bytes_consumed;
 
             if (leave_loop) {
                 break;
             }
         }
-        else if (m_input_data[0] == 'P' and m_input_data[1] == 'F') {
+        else if (data[0] == 'P' and data[1] == 'F') {
             PFT::Fragment fragment;
-            const size_t fragment_bytes = fragment.loadData(m_input_data);
+            const size_t fragment_bytes = fragment.loadData(data, available, 0);
+            fragment.source = source;
 
             if (fragment_bytes == 0) {
                 // We need to refill our buffer
                 break;
             }
 
-            vector<uint8_t> remaining_data;
-            copy(m_input_data.begin() + fragment_bytes,
-                    m_input_data.end(),
-                    back_inserter(remaining_data));
-            m_input_data = remaining_data;
-
+            // The fragment payload is in the stream buffer
             if (fragment.isValid()) {
                 m_pft.pushPFTFrag(fragment);
             }
 
-            auto af = m_pft.getNextAFPacket();
+            stream.begin += fragment_bytes;
+
+            const auto& af = m_pft.getNextAFPacket();
             if (not af.af_packet.empty()) {
                 const auto r = decode_afpacket(af.af_packet);
 
@@ -217,14 +256,21 @@ void TagDispatcher::push_bytes(const vector<uint8_t> &buf)
                     case decode_state_e::Error:
                         m_last_sequences.pseq_valid = false;
                         break;
+                    case decode_state_e::Duplicate:
+                        break;
                 }
             }
         }
         else {
-            etiLog.log(warn, "Unknown 0x%02x!", *m_input_data.data());
-            m_input_data.erase(m_input_data.begin());
+            etiLog.log(warn, "Unknown 0x%02x!", *data);
+            stream.begin++;
         }
     }
+
+    if (stream.begin == stream.end) {
+        stream.begin = 0;
+        stream.end = 0;
+    }
 }
 
 void TagDispatcher::push_packet(const Packet &packet)
@@ -236,7 +282,12 @@ void TagDispatcher::push_packet(const Packet &packet)
     }
 
     if (buf[0] == 'A' and buf[1] == 'F') {
-        const auto r = decode_afpacket(buf);
+        m_last_arrival = packet.arrival;
+        const auto r = decode_afpacket(buf, packet.source);
+        if (r.st == decode_state_e::Duplicate) {
+            return;
+        }
+
         m_last_sequences.pseq_valid = false;
 
         if (r.st == decode_state_e::Ok) {
@@ -247,13 +298,16 @@ void TagDispatcher::push_packet(const Packet &packet)
     else if (buf[0] == 'P' and buf[1] == 'F') {
         PFT::Fragment fragment;
         fragment.loadData(buf, packet.received_on_port);
+        fragment.source = packet.source;
+        fragment.arrival = packet.arrival;
 
         if (fragment.isValid()) {
             m_pft.pushPFTFrag(fragment);
         }
 
-        auto af = m_pft.getNextAFPacket();
+        const auto& af = m_pft.getNextAFPacket();
         if (not af.af_packet.empty()) {
+            m_last_arrival = af.arrival;
             const auto r = decode_afpacket(af.af_packet);
 
             if (r.st == decode_state_e::Ok) {
@@ -278,21 +332,42 @@ void TagDispatcher::setMaxDelay(int num_af_packets)
 
 
 TagDispatcher::decode_result_t TagDispatcher::decode_afpacket(
-        const std::vector<uint8_t> &input_data)
+        const std::vector<uint8_t> &input_data, size_t source)
+{
+    return decode_afpacket(input_data.data(), input_data.size(), source);
+}
+
+TagDispatcher::decode_result_t TagDispatcher::decode_afpacket(
+        const uint8_t *input_data, size_t len, size_t source)
 {
-    if (input_data.size() < AFPACKET_HEADER_LEN) {
+    if (len < AFPACKET_HEADER_LEN) {
         return {decode_state_e::MissingData, 0};
     }
 
     // read length from packet
-    uint32_t taglength = read_32b(input_data.begin() + 2);
-    uint16_t seq = read_16b(input_data.begin() + 6);
+    uint32_t taglength = read_32b(input_data + 2);
+    uint16_t seq = read_16b(input_data + 6);
 
     const size_t crclength = 2;
-    if (input_data.size() < AFPACKET_HEADER_LEN + taglength + crclength) {
+    if (len < AFPACKET_HEADER_LEN + taglength + crclength) {
         return {decode_state_e::MissingData, 0};
     }
 
+    // The same SEQ and CRC as an AF packet received less than a second
+    // ago: another source delivered it first.
+    const uint16_t packet_crc =
+        read_16b(input_data + AFPACKET_HEADER_LEN + taglength);
+    const auto now = source != NO_SOURCE ?
+        PathStatistics::clock::now() : PathStatistics::clock::time_point();
+    auto& recent = m_recent_afpackets[seq % m_recent_afpackets.size()];
+    if (source != NO_SOURCE and recent.valid and
+            recent.seq == seq and recent.crc == packet_crc and
+            now - recent.arrival < chrono::seconds(1)) {
+        m_path_statistics.add_late(source, now - recent.arrival);
+        return {decode_state_e::Duplicate,
+            AFPACKET_HEADER_LEN + taglength + crclength};
+    }
+
     // SEQ wraps at 0xFFFF, unsigned integer overflow is intentional
     if (m_last_sequences.seq_valid) {
         const uint16_t expected_seq = m_last_sequences.seq + 1;
@@ -332,32 +407,53 @@ TagDispatcher::decode_result_t TagDispatcher::decode_afpacket(
     }
     crc ^= 0xffff;
 
-    uint16_t packet_crc = read_16b(input_data.begin() + AFPACKET_HEADER_LEN + taglength);
-
     if (packet_crc != crc) {
         etiLog.level(warn) << "AF Packet crc wrong";
         return {decode_state_e::Error, AFPACKET_HEADER_LEN + taglength + crclen};
     }
     else {
+        if (source != NO_SOURCE) {
+            recent.valid = true;
+            recent.seq = seq;
+            recent.crc = packet_crc;
+            recent.arrival = now;
+            m_path_statistics.add_first(source);
+        }
+
         vector<uint8_t> afpacket(AFPACKET_HEADER_LEN + taglength + crclen);
-        copy(input_data.begin(),
-                input_data.begin() + AFPACKET_HEADER_LEN + taglength + crclen,
+        copy(input_data,
+                input_data + AFPACKET_HEADER_LEN + taglength + crclen,
                 afpacket.begin());
         m_afpacket_handler(std::move(afpacket));
 
-        vector<uint8_t> payload(taglength);
-        copy(input_data.begin() + AFPACKET_HEADER_LEN,
-                input_data.begin() + AFPACKET_HEADER_LEN + taglength,
-                payload.begin());
-
-        auto result = decode_tagpacket(payload) ? decode_state_e::Ok : decode_state_e::Error;
+        auto result = decode_tagpacket(input_data + AFPACKET_HEADER_LEN,
+                taglength) ? decode_state_e::Ok : decode_state_e::Error;
         return {result, AFPACKET_HEADER_LEN + taglength + crclen};
     }
 }
 
 void TagDispatcher::register_tag(const std::string& tag, tag_handler&& h)
 {
-    m_handlers[tag] = std::move(h);
+    if (tag.size() > 4) {
+        throw std::invalid_argument("EDI TAG name longer than 4: " + tag);
+    }
+
+    handler_entry_t entry;
+    entry.name.fill(0);
+    copy(tag.begin(), tag.end(), entry.name.begin());
+    entry.name_length = tag.size();
+    entry.handler = std::move(h);
+
+    auto it = find_if(m_handlers.begin(), m_handlers.end(),
+            [&](const handler_entry_t& e) {
+                return e.name_length == entry.name_length and e.name == entry.name;
+            });
+    if (it != m_handlers.end()) {
+        *it = std::move(entry);
+    }
+    else {
+        m_handlers.push_back(std::move(entry));
+    }
 }
 
 void TagDispatcher::register_afpacket_handler(afpacket_handler&& h)
@@ -366,20 +462,25 @@ void TagDispatcher::register_afpacket_handler(afpacket_handler&& h)
 }
 
 
-bool TagDispatcher::decode_tagpacket(const vector<uint8_t> &payload)
+bool TagDispatcher::decode_tagpacket(const uint8_t *payload, size_t payload_size)
 {
     size_t length = 0;
 
     bool success = true;
 
-    for (size_t i = 0; i + 8 < payload.size(); i += 8 + length) {
-        char tag_sz[5];
-        tag_sz[4] = '\0';
-        copy(payload.begin() + i, payload.begin() + i + 4, tag_sz);
-
-        string tag(tag_sz);
+    for (size_t i = 0; i + 8 < payload_size; i += 8 + length) {
+        const tag_name_t tag_name({
+               payload[i], payload[i + 1], payload[i + 2], payload[i + 3]
+               });
+        // Only for the messages
+        const auto tag = [&]() {
+            char tag_sz[5];
+            tag_sz[4] = '\0';
+            copy(payload + i, payload + i + 4, tag_sz);
+            return string(tag_sz);
+        };
 
-        uint32_t taglength = read_32b(payload.begin() + i + 4);
+        uint32_t taglength = read_32b(payload + i + 4);
 
         if (taglength % 8 != 0) {
             etiLog.log(warn, "Invalid EDI tag length, not multiple of 8!");
@@ -390,42 +491,36 @@ bool TagDispatcher::decode_tagpacket(const vector<uint8_t> &payload)
         length = taglength;
 
         const size_t calculated_length = i + 8 + taglength;
-        if (calculated_length > payload.size()) {
+        if (calculated_length > payload_size) {
             etiLog.log(warn, "Invalid EDI tag length: tag larger %zu than tagpacket %zu!",
-                    calculated_length, payload.size());
+                    calculated_length, payload_size);
             break;
         }
 
-        const array<uint8_t, 4> tag_name({
-               (uint8_t)tag_sz[0], (uint8_t)tag_sz[1], (uint8_t)tag_sz[2], (uint8_t)tag_sz[3]
-               });
-        vector<uint8_t> tag_value(taglength);
-        copy(   payload.begin() + i+8,
-                payload.begin() + i+8+taglength,
-                tag_value.begin());
+        // The value stays in the AF packet
+        const tag_value_t tag_value(payload + i + 8, taglength);
 
         bool tagsuccess = true;
         bool found = false;
-        for (auto tag_handler : m_handlers) {
-            if (    (tag_handler.first.size() == 4 and tag == tag_handler.first) or
-                    (tag_handler.first.size() == 3 and tag.substr(0, 3) == tag_handler.first) or
-                    (tag_handler.first.size() == 2 and tag.substr(0, 2) == tag_handler.first) or
-                    (tag_handler.first.size() == 1 and tag.substr(0, 1) == tag_handler.first)) {
+        for (const auto& entry : m_handlers) {
+            if (entry.name_length > 0 and equal(entry.name.begin(),
+                        entry.name.begin() + entry.name_length, tag_name.begin())) {
                 found = true;
-                tagsuccess &= tag_handler.second(tag_value, tag_name);
+                tagsuccess &= entry.handler(tag_value, tag_name);
             }
         }
 
         if (not found) {
-            if (std::find(m_ignored_tags.begin(), m_ignored_tags.end(), tag) == m_ignored_tags.end()) {
-                etiLog.log(warn, "Ignoring unknown TAG %s", tag.c_str());
-                m_ignored_tags.push_back(tag);
+            const string name = tag();
+            if (std::find(m_ignored_tags.begin(), m_ignored_tags.end(), name) == m_ignored_tags.end()) {
+                etiLog.log(warn, "Ignoring unknown TAG %s", name.c_str());
+                m_ignored_tags.push_back(name);
             }
             break;
         }
 
         if (not tagsuccess) {
-            etiLog.log(warn, "Error decoding TAG %s", tag.c_str());
+            etiLog.log(warn, "Error decoding TAG %s", tag().c_str());
             success = tagsuccess;
             break;
         }
@@ -434,7 +529,7 @@ bool TagDispatcher::decode_tagpacket(const vector<uint8_t> &payload)
     return success;
 }
 
-odr_version_data parse_odr_version_data(const std::vector<uint8_t>& data)
+odr_version_data parse_odr_version_data(const tag_value_t& data)
 {
     if (data.size() < sizeof(uint32_t)) {
         return {};
@@ -21,6 +21,7 @@
 #pragma once
 
 #include "PFT.hpp"
+#include "PathStatistics.hpp"
 #include <functional>
 #include <map>
 #include <chrono>
@@ -80,13 +81,40 @@ struct frame_timestamp_t {
 
 using tag_name_t = std::array<uint8_t, 4>;
 
+/* The value of a TAG, inside the AF packet it was received in. It is only
+ * valid during the call to the tag handler, which has to copy the data it
+ * keeps. */
+class tag_value_t {
+    public:
+        tag_value_t(const uint8_t *data, size_t size) :
+            m_data(data), m_size(size) {}
+
+        const uint8_t* begin() const { return m_data; }
+        const uint8_t* end() const { return m_data + m_size; }
+        const uint8_t* data() const { return m_data; }
+        size_t size() const { return m_size; }
+        bool empty() const { return m_size == 0; }
+        uint8_t operator[](size_t i) const { return m_data[i]; }
+
+    private:
+        const uint8_t *m_data;
+        size_t m_size;
+};
+
 std::string tag_name_to_human_readable(const tag_name_t& name);
 
 struct Packet {
     std::vector<uint8_t> buf;
-    int received_on_port;
+    int received_on_port = 0;
+
+    // Index of the source, when the same EDI stream is received from
+    // several sources.
+    size_t source = 0;
+
+    // When the packet was received, the epoch if not known
+    std::chrono::system_clock::time_point arrival;
 
-    Packet(std::vector<uint8_t>&& b) : buf(b), received_on_port(0) { }
+    Packet(std::vector<uint8_t>&& b) : buf(b) { }
     Packet() {}
 };
 
@@ -113,8 +141,21 @@ class TagDispatcher {
          * than a single packet. This is useful when reading from streams
          * (files, TCP). Pushing an empty buf will clear the internal decoder
          * state to ensure realignment (e.g. on stream reconnection)
+         *
+         * Every source has its own stream buffer, several streams carrying
+         * the same EDI can be pushed together.
          */
-        void push_bytes(const std::vector<uint8_t> &buf);
+        void push_bytes(const std::vector<uint8_t> &buf, size_t source = 0);
+
+        /* The same without a copy: stream_reserve() gives room for up to
+         * max_len bytes at the end of the stream buffer of the source, and
+         * once they are written there, stream_commit() decodes the len
+         * bytes that were. The packets get decoded inside the stream
+         * buffer, which only moves its remaining bytes to the front when
+         * the room at its end is too small.
+         */
+        uint8_t* stream_reserve(size_t max_len, size_t source = 0);
+        void stream_commit(size_t len, size_t source = 0);
 
         /* Push a complete packet into the decoder. Useful for UDP and other
          * datagram-oriented protocols.
@@ -128,7 +169,7 @@ class TagDispatcher {
 
         /* Handler function for a tag. The first argument contains the tag value,
          * the second argument contains the tag name */
-        using tag_handler = std::function<bool(const std::vector<uint8_t>&, const tag_name_t&)>;
+        using tag_handler = std::function<bool(const tag_value_t&, const tag_name_t&)>;
 
         /* Register a handler for a tag. If the tag string can be length 0, 1, 2, 3 or 4.
          * If is shorter than 4, it will perform a longest match on the tag name.
@@ -143,9 +184,23 @@ class TagDispatcher {
             return m_last_sequences;
         }
 
+        /* When the last fragment or the bytes that completed the last AF
+         * packet were received, the epoch if not known. */
+        std::chrono::system_clock::time_point get_arrival() const {
+            return m_last_arrival;
+        }
+
+        /* Which source delivered the PFT fragments and AF packets first,
+         * and how late the other copies arrived. */
+        const PathStatistics& get_path_statistics() const {
+            return m_path_statistics;
+        }
+
     private:
         enum class decode_state_e {
-            Ok, MissingData, Error
+            // Duplicate: the AF packet was already received from another
+            // source, and is ignored.
+            Ok, MissingData, Error, Duplicate
         };
         struct decode_result_t {
             decode_result_t(decode_state_e _st, size_t _num_bytes_consumed) :
@@ -154,13 +209,48 @@ class TagDispatcher {
             size_t num_bytes_consumed;
         };
 
-        decode_result_t decode_afpacket(const std::vector<uint8_t> &input_data);
-        bool decode_tagpacket(const std::vector<uint8_t> &payload);
+        /* AF packets received directly from a source are checked against
+         * the recently received ones, those coming out of the PFT were
+         * already deduplicated fragment by fragment. */
+        static constexpr size_t NO_SOURCE = (size_t)-1;
+        decode_result_t decode_afpacket(const std::vector<uint8_t> &input_data,
+                size_t source = NO_SOURCE);
+        decode_result_t decode_afpacket(const uint8_t *input_data, size_t len,
+                size_t source = NO_SOURCE);
+        bool decode_tagpacket(const uint8_t *payload, size_t length);
 
         PFT::PFT m_pft;
+        PathStatistics m_path_statistics;
         seq_info_t m_last_sequences;
-        std::vector<uint8_t> m_input_data;
-        std::map<std::string, tag_handler> m_handlers;
+        std::chrono::system_clock::time_point m_last_arrival;
+
+        // The bytes of the streams, indexed by source. The bytes from begin
+        // to end are not decoded yet.
+        struct stream_t {
+            std::vector<uint8_t> data;
+            size_t begin = 0;
+            size_t end = 0;
+        };
+        std::vector<stream_t> m_streams;
+
+        // The last AF packets, indexed by SEQ modulo their number, which
+        // covers more than a second of AF packets.
+        struct recent_afpacket_t {
+            bool valid = false;
+            uint16_t seq = 0;
+            uint16_t crc = 0;
+            PathStatistics::clock::time_point arrival;
+        };
+        std::array<recent_afpacket_t, 64> m_recent_afpackets;
+
+        // The handlers in the order they were registered, the name is
+        // matched on its first name_length characters
+        struct handler_entry_t {
+            tag_name_t name;
+            size_t name_length;
+            tag_handler handler;
+        };
+        std::vector<handler_entry_t> m_handlers;
         std::function<void()> m_af_packet_completed;
         afpacket_handler m_afpacket_handler;
 
@@ -173,6 +263,6 @@ struct odr_version_data {
     uint32_t uptime_s;
 };
 
-odr_version_data parse_odr_version_data(const std::vector<uint8_t>& data);
+odr_version_data parse_odr_version_data(const tag_value_t& data);
 
 }
@@ -90,6 +90,78 @@ class Measure:
 
         return txframe, tx_ts, rxframe, rx_ts
 
+    def receive_stream(self, num_samples_to_request : int, decimation : int):
+        """Connect to ODR-DabMod and yield a tuple
+        (txframe, tx_ts, rxframe, rx_ts, dropped) for every decimation-th
+        transmission frame, until the generator is closed. dropped is the
+        number of records ODR-DabMod could not send since the previous one.
+        """
+        s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        s.settimeout(4)
+        s.connect(('localhost', self.port))
+
+        try:
+            s.sendall(b"\x02")
+            s.sendall(struct.pack("=II", num_samples_to_request, decimation))
+
+            while True:
+                header = self._recv_exact(s, 24)
+                if len(header) < 24:
+                    break
+                num_samps, tx_second, tx_pps, rx_second, rx_pps, dropped = \
+                        struct.unpack("=IIIIII", header)
+
+                frame_bytes = num_samps * self.sizeof_sample
+                samples = self._recv_exact(s, 2 * frame_bytes)
+                if len(samples) < 2 * frame_bytes:
+                    break
+
+                txframe = np.frombuffer(samples[:frame_bytes], dtype=np.complex64)
+                rxframe = np.frombuffer(samples[frame_bytes:], dtype=np.complex64)
+
+                yield (txframe, tx_second + tx_pps / 16384000.0,
+                       rxframe, rx_second + rx_pps / 16384000.0, dropped)
+        finally:
+            s.close()
+
+    def receive_bursts(self, num_samples_to_request : int, count : int,
+                       sample_format : int = 1, compression : int = 0,
+                       decimation : int = 1, host : str = 'localhost'):
+        """Request count bursts on one connection with request version 3,
+        and yield a tuple (txframe, tx_ts, rxframe, rx_ts) for each. The
+        sample format is 0 for cf32, 1 for sc16 and 2 for sc8, compression
+        1 uses zstd and needs the zstandard module."""
+        dtypes = {0: np.float32, 1: np.int16, 2: np.int8}
+
+        s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        s.settimeout(70)
+        s.connect((host, self.port))
+
+        try:
+            for _ in range(count):
+                s.sendall(b"\x03")
+                s.sendall(struct.pack("=IBBH", num_samples_to_request,
+                                      sample_format, compression, decimation))
+
+                (num_samps, tx_second, tx_pps, rx_second, rx_pps, fmt, comp,
+                 _decim, tx_scale, rx_scale, tx_bytes, rx_bytes) = \
+                        struct.unpack("=IIIIIBBHffII", self._recv_exact(s, 40))
+
+                frames = []
+                for nbytes, scale in ((tx_bytes, tx_scale), (rx_bytes, rx_scale)):
+                    payload = self._recv_exact(s, nbytes)
+                    if comp == 1:
+                        import zstandard
+                        payload = zstandard.ZstdDecompressor().decompress(
+                                payload, max_output_size=num_samps * 8)
+                    iq = np.frombuffer(payload, dtype=dtypes[fmt]).astype(np.float32)
+                    frames.append((iq[0::2] + 1j * iq[1::2]).astype(np.complex64) / scale)
+
+                yield (frames[0], tx_second + tx_pps / 16384000.0,
+                       frames[1], rx_second + rx_pps / 16384000.0)
+        finally:
+            s.close()
+
     def get_samples_unaligned(self, short=False):
         """Connect to ODR-DabMod, retrieve TX and RX samples, load
         into numpy arrays, and return a tuple
@@ -0,0 +1,281 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "AllocationTracker.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <new>
+
+namespace alloc_tracking {
+
+counts_t& counts_t::operator+=(const counts_t& other)
+{
+    allocations += other.allocations;
+    bytes += other.bytes;
+    steady_allocations += other.steady_allocations;
+    return *this;
+}
+
+counts_t counts_t::operator-(const counts_t& other) const
+{
+    counts_t diff;
+    diff.allocations = allocations - other.allocations;
+    diff.bytes = bytes - other.bytes;
+    diff.steady_allocations = steady_allocations - other.steady_allocations;
+    return diff;
+}
+
+static std::atomic<mode_e> s_mode = ATOMIC_VAR_INIT(mode_e::off);
+static std::atomic<bool> s_steady = ATOMIC_VAR_INIT(false);
+
+// The allocations of all threads that have the same name
+struct shared_counts_t {
+    std::atomic<uint64_t> allocations = ATOMIC_VAR_INIT(0);
+    std::atomic<uint64_t> bytes = ATOMIC_VAR_INIT(0);
+    std::atomic<uint64_t> steady_allocations = ATOMIC_VAR_INIT(0);
+};
+
+/* Trivial, so that operator new can use it at any time of the life of the
+ * thread, also before the constructors and after the destructors of the
+ * other thread-local variables. */
+struct local_counts_t {
+    uint64_t allocations;
+    uint64_t bytes;
+    uint64_t steady_allocations;
+    shared_counts_t *shared;
+};
+
+static thread_local local_counts_t t_counts;
+
+using threads_t = std::map<std::string, std::unique_ptr<shared_counts_t> >;
+
+/* Never destroyed, because threads can allocate until the end of the
+ * program */
+static std::mutex& threads_mutex()
+{
+    static std::mutex *mutex = new std::mutex;
+    return *mutex;
+}
+
+static threads_t& threads()
+{
+    static threads_t *t = new threads_t;
+    return *t;
+}
+
+static inline void count(size_t size)
+{
+    if (s_mode.load(std::memory_order_relaxed) == mode_e::off) {
+        return;
+    }
+
+    const bool steady = s_steady.load(std::memory_order_relaxed);
+    t_counts.allocations++;
+    t_counts.bytes += size;
+    if (steady) {
+        t_counts.steady_allocations++;
+    }
+
+    if (shared_counts_t *shared = t_counts.shared) {
+        shared->allocations.fetch_add(1, std::memory_order_relaxed);
+        shared->bytes.fetch_add(size, std::memory_order_relaxed);
+        if (steady) {
+            shared->steady_allocations.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+void set_mode(mode_e mode)
+{
+    s_mode = mode;
+}
+
+mode_e mode()
+{
+    return s_mode.load(std::memory_order_relaxed);
+}
+
+void set_steady_state(bool steady)
+{
+    s_steady = steady;
+}
+
+counts_t thread_counts()
+{
+    counts_t counts;
+    counts.allocations = t_counts.allocations;
+    counts.bytes = t_counts.bytes;
+    counts.steady_allocations = t_counts.steady_allocations;
+    return counts;
+}
+
+void register_thread(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(threads_mutex());
+    auto& shared = threads()[name];
+    if (not shared) {
+        shared = std::make_unique<shared_counts_t>();
+    }
+    t_counts.shared = shared.get();
+}
+
+std::map<std::string, counts_t> get_thread_counts()
+{
+    std::map<std::string, counts_t> counts;
+    std::lock_guard<std::mutex> lock(threads_mutex());
+    for (const auto& t : threads()) {
+        auto& c = counts[t.first];
+        c.allocations = t.second->allocations.load(std::memory_order_relaxed);
+        c.bytes = t.second->bytes.load(std::memory_order_relaxed);
+        c.steady_allocations =
+            t.second->steady_allocations.load(std::memory_order_relaxed);
+    }
+    return counts;
+}
+
+} // namespace alloc_tracking
+
+/* The replaced operators call the new handler like the ones of the
+ * standard library, and release the memory with free(). */
+
+static void *allocate(std::size_t size)
+{
+    alloc_tracking::count(size);
+    if (size == 0) {
+        size = 1;
+    }
+
+    while (true) {
+        void *p = std::malloc(size);
+        if (p) {
+            return p;
+        }
+
+        std::new_handler handler = std::get_new_handler();
+        if (not handler) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+static void *allocate_aligned(std::size_t size, std::align_val_t alignment)
+{
+    alloc_tracking::count(size);
+    if (size == 0) {
+        size = 1;
+    }
+
+    const size_t align = std::max(static_cast<size_t>(alignment), sizeof(void*));
+    while (true) {
+        void *p = nullptr;
+        if (posix_memalign(&p, align, size) == 0) {
+            return p;
+        }
+
+        std::new_handler handler = std::get_new_handler();
+        if (not handler) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+void *operator new(std::size_t size)
+{
+    return allocate(size);
+}
+
+void *operator new[](std::size_t size)
+{
+    return allocate(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    try {
+        return allocate(size);
+    }
+    catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    try {
+        return allocate(size);
+    }
+    catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+    return allocate_aligned(size, alignment);
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return allocate_aligned(size, alignment);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment,
+        const std::nothrow_t&) noexcept
+{
+    try {
+        return allocate_aligned(size, alignment);
+    }
+    catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment,
+        const std::nothrow_t&) noexcept
+{
+    try {
+        return allocate_aligned(size, alignment);
+    }
+    catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+void operator delete(void *p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void *p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
@@ -0,0 +1,81 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+/* Counts the heap allocations made with operator new, which this module
+ * replaces, per thread and per flowgraph node. Once the modulator is
+ * warmed up, it should not allocate any more: the allocations made after
+ * the warm-up are counted separately, and can be logged or abort the
+ * program, to find the blocks that still allocate every frame.
+ *
+ * The memory allocated with malloc, e.g. by FFTW or by the C libraries
+ * of the SDR devices, is not counted. When tracking is off, operator new
+ * costs a relaxed load.
+ */
+namespace alloc_tracking {
+
+enum class mode_e {
+    off,    // Nothing is counted
+    count,  // Only count
+    warn,   // Count, and log the first allocation of every node after the warm-up
+    abort,  // Count, and abort at the first allocation of a node after the warm-up
+};
+
+struct counts_t {
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+
+    // Allocations after the warm-up
+    uint64_t steady_allocations = 0;
+
+    counts_t& operator+=(const counts_t& other);
+    counts_t operator-(const counts_t& other) const;
+};
+
+void set_mode(mode_e mode);
+mode_e mode();
+
+/* Set by the main loop once the modulator is warmed up, and cleared when
+ * it restarts. */
+void set_steady_state(bool steady);
+
+/* The allocations of the calling thread since it started */
+counts_t thread_counts();
+
+/* Add the allocations of the calling thread to the ones of all threads
+ * that have this name. Called by set_thread_name(). */
+void register_thread(const std::string& name);
+
+/* The allocations of the registered threads, by name */
+std::map<std::string, counts_t> get_thread_counts();
+
+} // namespace alloc_tracking
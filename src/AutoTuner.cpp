@@ -0,0 +1,195 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "AutoTuner.h"
+#include "Log.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+// The first frames fill the pipelines and allocate the buffers
+static constexpr size_t warmup_frames = 10;
+
+AutoTuner::AutoTuner(chrono::milliseconds frame_duration,
+        float duration, float headroom) :
+    RemoteControllable("autotune"),
+    m_frame_duration_us(chrono::duration<double, std::micro>(
+                frame_duration).count()),
+    m_measure_frames(std::max<size_t>(1,
+                lround((double)duration * 1e6 / m_frame_duration_us))),
+    m_headroom(headroom)
+{
+    if (duration <= 0 or headroom < 0 or headroom >= 1) {
+        throw invalid_argument("AutoTuner: invalid settings");
+    }
+
+    RC_ADD_PARAMETER(state, "(Read-only) measuring, or tuned once the settings are known");
+    RC_ADD_PARAMETER(settings, "(Read-only) Tuned settings, as configuration keys and values");
+}
+
+void AutoTuner::add_block(PipelinedModCodec *block,
+        const string& threads_key)
+{
+    block_t b;
+    b.block = block;
+    b.threads_key = threads_key;
+    m_blocks.push_back(b);
+}
+
+void AutoTuner::frame_processed()
+{
+    m_num_frames++;
+    if (m_num_frames == warmup_frames) {
+        for (auto& b : m_blocks) {
+            b.block->take_process_time();
+        }
+    }
+    else if (m_num_frames == warmup_frames + m_measure_frames) {
+        tune();
+    }
+}
+
+void AutoTuner::tune()
+{
+    const double budget_us = (1.0 - (double)m_headroom) * m_frame_duration_us;
+    const size_t max_parts = WorkerPool::shared().num_threads() + 1;
+
+    map<string, size_t> settings;
+    auto set_max = [&](const string& key, size_t value) {
+        auto& v = settings[key];
+        v = std::max(v, value);
+    };
+
+    double total_us = 0;
+    size_t worker_threads = 0;
+    for (auto& b : m_blocks) {
+        const auto t = b.block->take_process_time();
+        if (t.count == 0) {
+            // Bypassed during the whole measurement
+            continue;
+        }
+
+        string name = b.block->name();
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+
+        stringstream ss;
+        ss << std::fixed << std::setprecision(2);
+        ss << "AutoTuner: " << name << " takes " << t.mean_us / 1000 <<
+            " ms on average and " << t.max_us / 1000 << " ms at most";
+
+        double mean_us = t.mean_us;
+        double max_us = t.max_us;
+        const size_t parts = b.block->get_num_parts();
+        if (parts > 0 and not b.threads_key.empty()) {
+            /* Assuming that the work splits evenly among the parts. The
+             * number of threads in the configuration is the number of
+             * parts minus one, 0 would mean one per CPU. */
+            const double work_us = mean_us * parts;
+            const size_t tuned = std::min(max_parts, std::max<size_t>(2,
+                        ceil(work_us / budget_us)));
+            mean_us = work_us / tuned;
+            max_us = max_us * parts / tuned;
+
+            b.block->set_num_parts(tuned);
+            set_max(b.threads_key, tuned - 1);
+            worker_threads = std::max(worker_threads, tuned - 1);
+            ss << " with " << parts << " parts, now " << tuned;
+        }
+        etiLog.level(info) << ss.str();
+        if (mean_us > m_frame_duration_us) {
+            etiLog.level(warn) << "AutoTuner: " << name << " takes longer "
+                "than the frame duration on average, no pipeline depth can "
+                "make up for it";
+        }
+
+        // With a depth of n, one frame can take up to n frame durations
+        const size_t depth = std::min(PipelinedModCodec::max_pipeline_depth,
+                std::max<size_t>(1, ceil(max_us / budget_us)));
+        set_max("modulator." + name + "_pipeline_depth", depth);
+        total_us += mean_us;
+    }
+
+    if (total_us > 0) {
+        set_max("general.pipeline_threads",
+                std::max<size_t>(1, ceil(total_us / budget_us)));
+    }
+    if (worker_threads > 0) {
+        set_max("general.worker_threads", worker_threads);
+    }
+
+    lock_guard<mutex> lock(m_mutex);
+    m_settings = settings;
+    m_tuned = true;
+    etiLog.level(info) << "AutoTuner: for " << (int)(m_headroom * 100) <<
+        "% headroom, set " << settings_to_string();
+}
+
+string AutoTuner::settings_to_string() const
+{
+    stringstream ss;
+    for (const auto& s : m_settings) {
+        ss << (ss.tellp() > 0 ? " " : "") << s.first << "=" << s.second;
+    }
+    return ss.str();
+}
+
+void AutoTuner::set_parameter(const string& parameter, const string& value)
+{
+    stringstream ss_err;
+    ss_err << "Parameter '" << parameter
+        << "' is read-only or not exported by controllable " << get_rc_name();
+    throw ParameterError(ss_err.str());
+}
+
+const string AutoTuner::get_parameter(const string& parameter) const
+{
+    lock_guard<mutex> lock(m_mutex);
+    stringstream ss;
+    if (parameter == "state") {
+        ss << (m_tuned ? "tuned" : "measuring");
+    }
+    else if (parameter == "settings") {
+        ss << settings_to_string();
+    }
+    else {
+        ss << "Parameter '" << parameter <<
+            "' is not exported by controllable " << get_rc_name();
+        throw ParameterError(ss.str());
+    }
+    return ss.str();
+}
+
+const json::map_t AutoTuner::get_all_values() const
+{
+    lock_guard<mutex> lock(m_mutex);
+    json::map_t map;
+    map["state"].v = string(m_tuned ? "tuned" : "measuring");
+    map["settings"].v = settings_to_string();
+    return map;
+}
@@ -0,0 +1,96 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include "ModPlugin.h"
+#include "RemoteControl.h"
+
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/* Measures the processing time of the pipelined blocks during the first
+ * frames, and sizes their number of threads and pipeline depth so that
+ * every block takes at most (1 - headroom) of the frame duration.
+ *
+ * The blocks that split their frames for the WorkerPool get the number
+ * of parts that keeps them within budget, which applies immediately. The
+ * pipeline depth can only be set before the first frame, and the depths
+ * that absorb the slowest measured frame are only given as settings,
+ * together with the number of threads of the WorkerPool and of the
+ * PipelineExecutor. All settings are logged with their configuration key,
+ * so that they can be set in the configuration file. */
+class AutoTuner : public RemoteControllable
+{
+    public:
+        AutoTuner(std::chrono::milliseconds frame_duration,
+                float duration, float headroom);
+        AutoTuner(const AutoTuner& other) = delete;
+        AutoTuner& operator=(const AutoTuner& other) = delete;
+
+        /* threads_key is the configuration key of the number of threads
+         * of a block that splits its frames, empty for the others. */
+        void add_block(PipelinedModCodec *block,
+                const std::string& threads_key);
+
+        // Called after every frame
+        void frame_processed();
+
+        /******* REMOTE CONTROL ********/
+        virtual void set_parameter(const std::string& parameter,
+                const std::string& value) override;
+
+        virtual const std::string get_parameter(
+                const std::string& parameter) const override;
+
+        virtual const json::map_t get_all_values() const override;
+
+    private:
+        void tune();
+        std::string settings_to_string() const;
+
+        struct block_t {
+            PipelinedModCodec *block;
+            std::string threads_key;
+        };
+
+        const double m_frame_duration_us;
+        const size_t m_measure_frames;
+        const float m_headroom;
+
+        std::vector<block_t> m_blocks;
+        size_t m_num_frames = 0;
+
+        mutable std::mutex m_mutex;
+        bool m_tuned = false;
+        // The tuned settings, by configuration key
+        std::map<std::string, size_t> m_settings;
+};
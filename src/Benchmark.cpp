@@ -0,0 +1,778 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   Micro-benchmark of the modulator blocks. Every block is fed with
+   synthetic data of the size it sees in the real flowgraph, and the
+   processing time is reported per item and per frame. The queues that
+   link the threads are measured with one producer and one consumer.
+*/
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include "Buffer.h"
+#include "ConvEncoder.h"
+#include "FIRFilter.h"
+#include "FormatConverter.h"
+#include "FrequencyInterleaver.h"
+#include "GainControl.h"
+#include "GuardIntervalInserter.h"
+#include "InterleavedQpskMapper.h"
+#include "Log.h"
+#include "MemlessPoly.h"
+#include "MemoryPoly.h"
+#include "OfdmGenerator.h"
+#include "PrbsGenerator.h"
+#include "PuncturingEncoder.h"
+#include "QpskSymbolMapper.h"
+#include "FrequencyShifter.h"
+#include "HalfbandInterpolator.h"
+#include "PolyphaseResampler.h"
+#include "Resampler.h"
+#include "RunReport.h"
+#include "SubchannelEncoder.h"
+#include "SubchannelSource.h"
+#include "TimeInterleaver.h"
+#include "SPSCQueue.h"
+#include "ThreadsafeQueue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+using namespace std;
+
+/* Parameters of a transmission mode, as in DabModulator::setMode() */
+struct mode_params_t {
+    unsigned mode;
+    size_t nbSymbols;
+    size_t nbCarriers;
+    size_t spacing;
+    size_t nullSize;
+    size_t symSize;
+    double frameDuration_s;
+};
+
+static const vector<mode_params_t> all_modes({
+        {1, 76, 1536, 2048, 2656, 2552, 0.096},
+        {2, 76,  384,  512,  664,  638, 0.024},
+        {3, 153, 192,  256,  345,  319, 0.024},
+        {4, 76,  768, 1024, 1328, 1276, 0.048},
+        });
+
+/* Duration of one ETI frame, which the encoder blocks process in one call */
+static constexpr double eti_frame_duration_s = 0.024;
+
+/* The benchmarked subchannel: 128kbps EEP-3A */
+static constexpr uint16_t bench_subch_stl = 48;
+static constexpr uint8_t bench_subch_tpl = 0x22;
+
+/* The OfdmGeneratorCF32 keeps references to its CFR settings */
+static bool cfr_disabled = false;
+static bool cfr_enabled = true;
+static float cfr_clip = 50.0f;
+static float cfr_error_clip = 0.1f;
+static size_t cfr_iterations = 1;
+static float cfr_target_papr = 0.0f;
+
+/* Same for the GainControl */
+static GainMode gain_mode = GainMode::GAIN_VAR;
+static float digital_gain = 0.8f;
+static float normalise_variance = 4.0f;
+
+/* And for the GuardIntervalInserter */
+static size_t window_overlap_off = 0;
+static size_t window_overlap_on = 10;
+
+struct bench_case_t {
+    string name;
+    unsigned mode = 0; // 0 means independent of the transmission mode
+    shared_ptr<ModPlugin> plugin;
+    vector<Buffer> inputs;
+
+    // Number of items in the input, in the given unit
+    size_t num_items = 0;
+    const char *item_unit = "";
+
+    // Duration of the signal one call to process() represents
+    double frameDuration_s = 0;
+};
+
+static void usage(const char *progName)
+{
+    fprintf(stderr,
+            "Usage: %s [-m mode] [-b block] [-t seconds] [-j report]\n"
+            "  -m mode      Only run the given transmission mode (1-4)\n"
+            "  -b block     Only run the blocks whose name contains block\n"
+            "  -t seconds   Minimum run time per block (default 0.5)\n"
+            "  -j report    Append the results as one line of JSON to report\n",
+            progName);
+}
+
+static Buffer random_bytes(size_t len, mt19937& rng)
+{
+    Buffer buf(len);
+    uint8_t *data = reinterpret_cast<uint8_t*>(buf.getData());
+    uniform_int_distribution<int> dist(0, 255);
+    for (size_t i = 0; i < len; i++) {
+        data[i] = dist(rng);
+    }
+    return buf;
+}
+
+/* Complex samples with a DAB-like amplitude distribution */
+static Buffer random_complexf(size_t num_samples, float amplitude, mt19937& rng)
+{
+    Buffer buf(num_samples * sizeof(complexf));
+    complexf *data = reinterpret_cast<complexf*>(buf.getData());
+    normal_distribution<float> dist(0.0f, amplitude);
+    for (size_t i = 0; i < num_samples; i++) {
+        data[i] = complexf(dist(rng), dist(rng));
+    }
+    return buf;
+}
+
+static Buffer random_complexfix(size_t num_samples, float amplitude, mt19937& rng)
+{
+    Buffer buf(num_samples * sizeof(complexfix));
+    complexfix *data = reinterpret_cast<complexfix*>(buf.getData());
+    normal_distribution<float> dist(0.0f, amplitude);
+    for (size_t i = 0; i < num_samples; i++) {
+        // fpm converts from double without promoting the operands
+        data[i] = complexfix(fixed_16{(double)dist(rng)}, fixed_16{(double)dist(rng)});
+    }
+    return buf;
+}
+
+static Buffer qpsk_symbols(size_t num_samples, mt19937& rng)
+{
+    Buffer buf(num_samples * sizeof(complexf));
+    complexf *data = reinterpret_cast<complexf*>(buf.getData());
+    const float v = 1.0f / sqrtf(2.0f);
+    uniform_int_distribution<int> dist(0, 3);
+    for (size_t i = 0; i < num_samples; i++) {
+        const int s = dist(rng);
+        data[i] = complexf((s & 1) ? v : -v, (s & 2) ? v : -v);
+    }
+    return buf;
+}
+
+static Buffer qpsk_symbols_fix(size_t num_samples, mt19937& rng)
+{
+    Buffer buf(num_samples * sizeof(complexfix));
+    complexfix *data = reinterpret_cast<complexfix*>(buf.getData());
+    const fixed_16 v{M_SQRT1_2};
+    uniform_int_distribution<int> dist(0, 3);
+    for (size_t i = 0; i < num_samples; i++) {
+        const int s = dist(rng);
+        data[i] = complexfix((s & 1) ? v : -v, (s & 2) ? v : -v);
+    }
+    return buf;
+}
+
+/* MemlessPoly only loads its coefficients from a file */
+static string write_coefs_file(const string& contents)
+{
+    char path[] = "/tmp/odr-dabmod-bench-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1) {
+        throw runtime_error("Could not create coefficients file");
+    }
+    close(fd);
+
+    ofstream coefs(path);
+    coefs << contents;
+    return path;
+}
+
+// Odd-only polynomial format: identity AM/AM and no AM/PM
+static const string poly_coefs =
+    "1\n5\n1.0\n0.0\n0.0\n0.0\n0.0\n0.0\n0.0\n0.0\n0.0\n0.0\n";
+
+// Interpolated lookup table with 1024 identity entries
+static string interpolated_lut_coefs()
+{
+    stringstream ss;
+    ss << "3\n1024\n4000.0\n";
+    for (size_t i = 0; i < 1024; i++) {
+        ss << "1.0\n0.0\n";
+    }
+    return ss.str();
+}
+
+// Memory polynomial with 5 orders and 4 memory taps, identity on the
+// first tap and small coefficients elsewhere
+static string memory_poly_coefs()
+{
+    stringstream ss;
+    ss << "1\n5\n4\n";
+    for (size_t m = 0; m < 4; m++) {
+        for (size_t k = 0; k < 5; k++) {
+            ss << (m == 0 and k == 0 ? 1.0 : 0.01) << "\n0.001\n";
+        }
+    }
+    return ss.str();
+}
+
+struct coefs_files_t {
+    string poly;
+    string lut;
+    string memory_poly;
+};
+
+static vector<bench_case_t> encoder_cases(mt19937& rng)
+{
+    vector<bench_case_t> cases;
+
+    SubchannelSource subch(0, bench_subch_stl, bench_subch_tpl);
+    const size_t framesize = subch.framesize();
+
+    auto add = [&](const string& name, shared_ptr<ModPlugin> plugin,
+            vector<Buffer>&& inputs) {
+        bench_case_t c;
+        c.name = name;
+        c.plugin = plugin;
+        c.num_items = inputs.empty() ? framesize : inputs[0].getLength();
+        c.item_unit = "byte";
+        c.inputs = std::move(inputs);
+        c.frameDuration_s = eti_frame_duration_s;
+        cases.push_back(std::move(c));
+    };
+
+    {
+        vector<Buffer> in;
+        in.push_back(random_bytes(framesize, rng));
+        add("PrbsGenerator", make_shared<PrbsGenerator>(framesize, 0x110),
+                std::move(in));
+    }
+
+    {
+        vector<Buffer> in;
+        in.push_back(random_bytes(framesize, rng));
+        add("ConvEncoder", make_shared<ConvEncoder>(framesize), std::move(in));
+    }
+
+    {
+        auto punc = make_shared<PuncturingEncoder>(subch.framesizeCu(),
+                subch.get_rules(), PuncturingRule(3, 0xcccccc));
+
+        vector<Buffer> in;
+        in.push_back(random_bytes(punc->getInputSize(), rng));
+        add("PuncturingEncoder", punc, std::move(in));
+    }
+
+    {
+        vector<Buffer> in;
+        in.push_back(random_bytes(framesize, rng));
+        add("SubchannelEncoder", make_shared<SubchannelEncoder>(framesize,
+                    subch.framesizeCu(), subch.get_rules(),
+                    PuncturingRule(3, 0xcccccc)),
+                std::move(in));
+    }
+
+    {
+        // The same frame every time, as for a padding subchannel
+        vector<Buffer> in;
+        in.push_back(random_bytes(framesize, rng));
+        add("SubchannelEncoder+cache", make_shared<SubchannelEncoder>(framesize,
+                    subch.framesizeCu(), subch.get_rules(),
+                    PuncturingRule(3, 0xcccccc), 4),
+                std::move(in));
+    }
+
+    {
+        const size_t subchSizeOut = subch.framesizeCu() * 8;
+        vector<Buffer> in;
+        in.push_back(random_bytes(subchSizeOut, rng));
+        add("TimeInterleaver", make_shared<TimeInterleaver>(subchSizeOut),
+                std::move(in));
+    }
+
+    return cases;
+}
+
+static vector<bench_case_t> modulator_cases(const mode_params_t& m,
+        const coefs_files_t& coefs_files, mt19937& rng)
+{
+    vector<bench_case_t> cases;
+
+    // Sizes of one transmission frame at the different stages
+    const size_t cif_bytes = (m.nbSymbols - 1) * m.nbCarriers / 4;
+    const size_t mapped_len = (m.nbSymbols - 1) * m.nbCarriers;
+    const size_t ofdm_in_len = (m.nbSymbols + 1) * m.nbCarriers;
+    const size_t ofdm_out_len = (m.nbSymbols + 1) * m.spacing;
+    const size_t frame_len = m.nullSize + m.nbSymbols * m.symSize;
+
+    auto add = [&](const string& name, shared_ptr<ModPlugin> plugin,
+            Buffer&& input, size_t num_items, const char *unit) {
+        bench_case_t c;
+        c.name = name;
+        c.mode = m.mode;
+        c.plugin = plugin;
+        c.inputs.push_back(std::move(input));
+        c.num_items = num_items;
+        c.item_unit = unit;
+        c.frameDuration_s = m.frameDuration_s;
+        cases.push_back(std::move(c));
+    };
+
+    add("QpskSymbolMapper",
+            make_shared<QpskSymbolMapper>(m.nbCarriers, false),
+            random_bytes(cif_bytes, rng), cif_bytes, "byte");
+
+    add("FrequencyInterleaver",
+            make_shared<FrequencyInterleaver>(m.mode, false),
+            qpsk_symbols(mapped_len, rng), mapped_len, "sample");
+
+    add("InterleavedQpskMapper",
+            make_shared<InterleavedQpskMapper>(m.mode, false),
+            random_bytes(cif_bytes, rng), cif_bytes, "byte");
+
+    add("OfdmGeneratorCF32",
+            make_shared<OfdmGeneratorCF32>(m.nbSymbols + 1, m.nbCarriers,
+                m.spacing, cfr_disabled, cfr_clip, cfr_error_clip,
+                cfr_iterations, cfr_target_papr),
+            qpsk_symbols(ofdm_in_len, rng), ofdm_out_len, "sample");
+
+    add("OfdmGeneratorCF32 batched",
+            make_shared<OfdmGeneratorCF32>(m.nbSymbols + 1, m.nbCarriers,
+                m.spacing, cfr_disabled, cfr_clip, cfr_error_clip,
+                cfr_iterations, cfr_target_papr,
+                true, true),
+            qpsk_symbols(ofdm_in_len, rng), ofdm_out_len, "sample");
+
+    add("OfdmGeneratorCF32+CFR",
+            make_shared<OfdmGeneratorCF32>(m.nbSymbols + 1, m.nbCarriers,
+                m.spacing, cfr_enabled, cfr_clip, cfr_error_clip,
+                cfr_iterations, cfr_target_papr),
+            qpsk_symbols(ofdm_in_len, rng), ofdm_out_len, "sample");
+
+    add("OfdmGeneratorCF32+CFR batched",
+            make_shared<OfdmGeneratorCF32>(m.nbSymbols + 1, m.nbCarriers,
+                m.spacing, cfr_enabled, cfr_clip, cfr_error_clip,
+                cfr_iterations, cfr_target_papr,
+                true, true),
+            qpsk_symbols(ofdm_in_len, rng), ofdm_out_len, "sample");
+
+    add("OfdmGeneratorCF32+CFR 4 parts",
+            make_shared<OfdmGeneratorCF32>(m.nbSymbols + 1, m.nbCarriers,
+                m.spacing, cfr_enabled, cfr_clip, cfr_error_clip,
+                cfr_iterations, cfr_target_papr,
+                true, false, 3),
+            qpsk_symbols(ofdm_in_len, rng), ofdm_out_len, "sample");
+
+    add("OfdmGeneratorFixed",
+            make_shared<OfdmGeneratorFixed>(m.nbSymbols + 1, m.nbCarriers,
+                m.spacing),
+            qpsk_symbols_fix(ofdm_in_len, rng), ofdm_out_len, "sample");
+
+    add("OfdmGeneratorFixed SIMD",
+            make_shared<OfdmGeneratorFixed>(m.nbSymbols + 1, m.nbCarriers,
+                m.spacing, true, true),
+            qpsk_symbols_fix(ofdm_in_len, rng), ofdm_out_len, "sample");
+
+    add("GainControl",
+            make_shared<GainControl>(m.spacing, gain_mode, digital_gain,
+                1.0f, normalise_variance),
+            random_complexf(ofdm_out_len, 30.0f, rng), ofdm_out_len, "sample");
+
+    add("GainControl+clip",
+            make_shared<GainControl>(m.spacing, gain_mode, digital_gain,
+                1.0f, normalise_variance, true, -32768.0f, 32767.0f),
+            random_complexf(ofdm_out_len, 30.0f, rng), ofdm_out_len, "sample");
+
+    add("GuardIntervalInserter",
+            make_shared<GuardIntervalInserter>(m.nbSymbols, m.spacing,
+                m.nullSize, m.symSize, window_overlap_off, FFTEngine::FFTW),
+            random_complexf(ofdm_out_len, 0.1f, rng), frame_len, "sample");
+
+    add("GuardIntervalInserter+win",
+            make_shared<GuardIntervalInserter>(m.nbSymbols, m.spacing,
+                m.nullSize, m.symSize, window_overlap_on, FFTEngine::FFTW),
+            random_complexf(ofdm_out_len, 0.1f, rng), frame_len, "sample");
+
+    string taps_file = "default";
+    add("FIRFilter", make_shared<FIRFilter>(taps_file),
+            random_complexf(frame_len, 0.1f, rng), frame_len, "sample");
+
+    add("FIRFilter FFT", make_shared<FIRFilter>(taps_file, 1),
+            random_complexf(frame_len, 0.1f, rng), frame_len, "sample");
+
+    add("FIRFilter fixed", make_shared<FIRFilter>(taps_file, 0, FFTEngine::KISS),
+            random_complexfix(frame_len, 0.1f, rng), frame_len, "sample");
+
+    string coefs = coefs_files.poly;
+    add("MemlessPoly", make_shared<MemlessPoly>(coefs, 0),
+            random_complexf(frame_len, 0.1f, rng), frame_len, "sample");
+
+    string lut_coefs = coefs_files.lut;
+    add("MemlessPoly LUT", make_shared<MemlessPoly>(lut_coefs, 0),
+            random_complexf(frame_len, 0.1f, rng), frame_len, "sample");
+
+    add("MemlessPoly fixed", make_shared<MemlessPoly>(coefs, 0, FFTEngine::KISS),
+            random_complexfix(frame_len, 0.1f, rng), frame_len, "sample");
+
+    add("MemoryPoly", make_shared<MemoryPoly>(coefs_files.memory_poly, 0),
+            random_complexf(frame_len, 0.1f, rng), frame_len, "sample");
+
+    add("Resampler",
+            make_shared<Resampler>(2048000, 4096000, m.spacing),
+            random_complexf(frame_len, 0.1f, rng), frame_len, "sample");
+
+    add("HalfbandInterpolator",
+            make_shared<HalfbandInterpolator>(2048000, 4096000),
+            random_complexf(frame_len, 0.1f, rng), frame_len, "sample");
+
+    add("HalfbandInterpolator x4",
+            make_shared<HalfbandInterpolator>(2048000, 8192000),
+            random_complexf(frame_len, 0.1f, rng), frame_len, "sample");
+
+    add("FrequencyShifter",
+            make_shared<FrequencyShifter>(4096000, 1000000, false),
+            random_complexf(2 * frame_len, 0.1f, rng), 2 * frame_len, "sample");
+
+    add("PolyphaseResampler",
+            make_shared<PolyphaseResampler>(2048000, 4096000),
+            random_complexf(frame_len, 0.1f, rng), frame_len, "sample");
+
+    add("PolyphaseResampler+FIR",
+            make_shared<PolyphaseResampler>(2048000, 4096000, taps_file),
+            random_complexf(frame_len, 0.1f, rng), frame_len, "sample");
+
+    add("PolyphaseResampler fixed",
+            make_shared<PolyphaseResampler>(2048000, 4096000, "",
+                FFTEngine::KISS),
+            random_complexfix(frame_len, 0.1f, rng), frame_len, "sample");
+
+    for (const string fmt : {"s16", "sc16q11", "s8", "u8", "sc12"}) {
+        add("FormatConverter " + fmt,
+                make_shared<FormatConverter>(false, fmt),
+                random_complexf(frame_len, 0.1f, rng), frame_len, "sample");
+
+        add("FormatConverter " + fmt + " in range",
+                make_shared<FormatConverter>(false, fmt, true),
+                random_complexf(frame_len, 0.1f, rng), frame_len, "sample");
+    }
+
+    return cases;
+}
+
+/* Runs the case, prints its line and returns its entry of the report */
+static json::value_t run_case(bench_case_t& c, double min_duration_s)
+{
+    using clock = chrono::steady_clock;
+
+    // Pipelined and in-place blocks take over their input buffer, which
+    // therefore gets restored before every call. Only the call itself is
+    // measured.
+    vector<Buffer> work(c.inputs.size());
+    vector<Buffer*> inputs;
+    for (auto& b : work) {
+        inputs.push_back(&b);
+    }
+    Buffer out;
+    vector<Buffer*> outputs({&out});
+
+    auto restore_inputs = [&]() {
+        for (size_t i = 0; i < work.size(); i++) {
+            work[i].setData(c.inputs[i].getData(), c.inputs[i].getLength());
+        }
+    };
+
+    // Warm up to fill pipelines and allocate all buffers
+    constexpr size_t num_warmup = 4;
+    for (size_t i = 0; i < num_warmup; i++) {
+        restore_inputs();
+        c.plugin->process(inputs, outputs);
+    }
+
+    size_t iterations = 0;
+    clock::duration elapsed = clock::duration::zero();
+    vector<double> call_durations_us;
+    do {
+        restore_inputs();
+        const auto start = clock::now();
+        c.plugin->process(inputs, outputs);
+        const auto duration = clock::now() - start;
+        elapsed += duration;
+        call_durations_us.push_back(
+                chrono::duration<double, micro>(duration).count());
+        iterations++;
+    } while (chrono::duration<double>(elapsed).count() < min_duration_s);
+
+    const double elapsed_s = chrono::duration<double>(elapsed).count();
+    const double per_call_s = elapsed_s / iterations;
+    const double ns_per_item = 1e9 * per_call_s / c.num_items;
+    const double frames_per_s = 1.0 / per_call_s;
+    const double realtime_factor = c.frameDuration_s / per_call_s;
+
+    printf("%-32s %4s %10.3f ns/%-6s %10.1f frames/s %9.1fx realtime\n",
+            c.name.c_str(),
+            c.mode ? to_string(c.mode).c_str() : "-",
+            ns_per_item, c.item_unit, frames_per_s, realtime_factor);
+    fflush(stdout);
+
+    const size_t p99_index = (call_durations_us.size() * 99) / 100;
+    nth_element(call_durations_us.begin(),
+            call_durations_us.begin() + p99_index, call_durations_us.end());
+
+    auto entry = make_shared<json::map_t>();
+    (*entry)["name"].v = c.name;
+    (*entry)["mode"].v = (uint32_t)c.mode;
+    (*entry)["count"].v = (uint64_t)iterations;
+    (*entry)["mean_us"].v = 1e6 * per_call_s;
+    (*entry)["p99_us"].v = call_durations_us[p99_index];
+    (*entry)["ns_per_item"].v = ns_per_item;
+    (*entry)["item_unit"].v = string(c.item_unit);
+    (*entry)["frames_per_s"].v = frames_per_s;
+    (*entry)["realtime_factor"].v = realtime_factor;
+    json::value_t v;
+    v.v = entry;
+    return v;
+}
+
+/* Runs the producer in a thread, and consume() until it got all
+ * elements. Prints the line of the queue and returns its entry of the
+ * report. */
+static json::value_t run_queue_case(const string& name, size_t num_elements,
+        const function<void()>& produce, const function<size_t()>& consume)
+{
+    using clock = chrono::steady_clock;
+
+    const auto start = clock::now();
+    thread producer(produce);
+    size_t received = 0;
+    while (received < num_elements) {
+        received += consume();
+    }
+    producer.join();
+    const double elapsed_s = chrono::duration<double>(clock::now() - start).count();
+
+    const double ns_per_element = 1e9 * elapsed_s / num_elements;
+    const double elements_per_s = num_elements / elapsed_s;
+    printf("%-32s %10.1f ns/element %10.2f M elements/s\n",
+            name.c_str(), ns_per_element, elements_per_s / 1e6);
+    fflush(stdout);
+
+    auto entry = make_shared<json::map_t>();
+    (*entry)["name"].v = name;
+    (*entry)["count"].v = (uint64_t)num_elements;
+    (*entry)["ns_per_element"].v = ns_per_element;
+    (*entry)["elements_per_s"].v = elements_per_s;
+    json::value_t v;
+    v.v = entry;
+    return v;
+}
+
+/* The time per element to go from one thread to the other, with the pop
+ * of one element at a time and the bulk transfers of ThreadsafeQueue,
+ * and with the SPSCQueue */
+static vector<json::value_t> queue_cases(const string& block_filter,
+        double min_duration_s)
+{
+    vector<json::value_t> results;
+    const size_t num_elements = std::max<size_t>(
+            1000, 2000000 * min_duration_s);
+    constexpr size_t batch_size = 16;
+
+    auto selected = [&](const string& name) {
+        return block_filter.empty() or name.find(block_filter) != string::npos;
+    };
+
+    if (selected("ThreadsafeQueue wait_and_pop")) {
+        ThreadsafeQueue<size_t> q;
+        results.push_back(run_queue_case("ThreadsafeQueue wait_and_pop",
+                    num_elements,
+                    [&]() {
+                        for (size_t i = 0; i < num_elements; i++) {
+                            q.push(i);
+                        }
+                    },
+                    [&]() -> size_t {
+                        size_t v = 0;
+                        q.wait_and_pop(v);
+                        return 1;
+                    }));
+    }
+
+    if (selected("ThreadsafeQueue wait_and_pop_all")) {
+        ThreadsafeQueue<size_t> q;
+        deque<size_t> popped;
+        results.push_back(run_queue_case("ThreadsafeQueue wait_and_pop_all",
+                    num_elements,
+                    [&]() {
+                        for (size_t i = 0; i < num_elements; i++) {
+                            q.push(i);
+                        }
+                    },
+                    [&]() -> size_t {
+                        q.wait_and_pop_all(popped);
+                        return popped.size();
+                    }));
+    }
+
+    if (selected("ThreadsafeQueue push_many")) {
+        ThreadsafeQueue<size_t> q;
+        deque<size_t> popped;
+        results.push_back(run_queue_case("ThreadsafeQueue push_many",
+                    num_elements,
+                    [&]() {
+                        deque<size_t> batch;
+                        for (size_t i = 0; i < num_elements; i++) {
+                            batch.push_back(i);
+                            if (batch.size() == batch_size or
+                                    i == num_elements - 1) {
+                                q.push_many(batch);
+                            }
+                        }
+                    },
+                    [&]() -> size_t {
+                        q.wait_and_pop_all(popped);
+                        return popped.size();
+                    }));
+    }
+
+    if (selected("SPSCQueue wait_and_pop")) {
+        SPSCQueue<size_t> q(1024);
+        results.push_back(run_queue_case("SPSCQueue wait_and_pop",
+                    num_elements,
+                    [&]() {
+                        for (size_t i = 0; i < num_elements; i++) {
+                            size_t v = i;
+                            q.push(std::move(v));
+                        }
+                    },
+                    [&]() -> size_t {
+                        size_t v = 0;
+                        q.wait_and_pop(v);
+                        return 1;
+                    }));
+    }
+
+    return results;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned only_mode = 0;
+    string block_filter;
+    double min_duration_s = 0.5;
+    string report_file;
+
+    int c;
+    while ((c = getopt(argc, argv, "b:hj:m:t:")) != -1) {
+        switch (c) {
+            case 'b':
+                block_filter = optarg;
+                break;
+            case 'j':
+                report_file = optarg;
+                break;
+            case 'm':
+                only_mode = strtoul(optarg, nullptr, 10);
+                if (only_mode < 1 or only_mode > 4) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 't':
+                min_duration_s = strtod(optarg, nullptr);
+                break;
+            case 'h':
+            default:
+                usage(argv[0]);
+                return c == 'h' ? 0 : 1;
+        }
+    }
+
+    coefs_files_t coefs_files;
+    coefs_files.poly = write_coefs_file(poly_coefs);
+    coefs_files.lut = write_coefs_file(interpolated_lut_coefs());
+    coefs_files.memory_poly = write_coefs_file(memory_poly_coefs());
+
+    auto remove_coefs_files = [&]() {
+        unlink(coefs_files.poly.c_str());
+        unlink(coefs_files.lut.c_str());
+        unlink(coefs_files.memory_poly.c_str());
+    };
+
+    mt19937 rng(42);
+
+    printf("%-32s %4s %17s %19s %18s\n",
+            "block", "mode", "time per item", "rate", "speed");
+
+    vector<json::value_t> results;
+    auto run_all = [&](vector<bench_case_t>&& cases) {
+        for (auto& bc : cases) {
+            if (block_filter.empty() or
+                    bc.name.find(block_filter) != string::npos) {
+                results.push_back(run_case(bc, min_duration_s));
+            }
+        }
+    };
+
+    try {
+        run_all(encoder_cases(rng));
+
+        for (const auto& m : all_modes) {
+            if (only_mode == 0 or only_mode == m.mode) {
+                run_all(modulator_cases(m, coefs_files, rng));
+            }
+        }
+
+        printf("\n%-32s %20s %23s\n", "queue", "time per element", "rate");
+        const auto queue_results = queue_cases(block_filter, min_duration_s);
+
+        if (not report_file.empty()) {
+            json::map_t report;
+            report["type"].v = string("bench");
+            report["time"].v = RunReport::timestamp();
+            report["build"].v = make_shared<json::map_t>(RunReport::build_info());
+            report["blocks"].v = results;
+            report["queues"].v = queue_results;
+            RunReport::append(report_file, report);
+        }
+    }
+    catch (const std::exception& e) {
+        fprintf(stderr, "Benchmark failed: %s\n", e.what());
+        remove_coefs_files();
+        return 1;
+    }
+
+    remove_coefs_files();
+    return 0;
+}
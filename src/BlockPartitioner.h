@@ -41,10 +41,16 @@ public:
 
     int process(std::vector<Buffer*> dataIn, Buffer* dataOut);
     const char* name() { return "BlockPartitioner"; }
+    virtual bool may_stop_run() const { return true; }
 
     // The implementation assumes process_metadata is always called after process
     virtual meta_vec_t process_metadata(const meta_vec_t& metadataIn);
 
+    /* Whether the last call to process() completed a transmission frame,
+     * and the metadata of its ETI frames */
+    bool frame_complete() const { return d_cifNb == 0; }
+    const meta_vec_t& frame_metadata() const { return d_meta; }
+
 protected:
     int d_mode;
     size_t d_ficSize;
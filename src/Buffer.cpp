@@ -26,13 +26,268 @@
  */
 
 #include "Buffer.h"
+#include "Log.h"
 #include "PcDebug.h"
 
 #include <unistd.h>
+#include <sys/mman.h>
+#include <fstream>
 #include <string>
 #include <stdexcept>
 #include <cstdlib>
 #include <cstring>
+#include <atomic>
+#include <map>
+#include <mutex>
+
+/* Pool of aligned memory blocks. Requested sizes are rounded up to a
+ * size class, with four classes per power of two, which limits the
+ * wasted space to 25%. A limited number of blocks are kept per class,
+ * and the total memory held by the pool is bounded too. With huge pages,
+ * the classes above a huge page are rounded up to whole huge pages. */
+class BufferPool {
+    public:
+        static BufferPool& instance() {
+            // Never destroyed, because Buffers with static storage duration
+            // could otherwise be released into a destroyed pool.
+            static BufferPool *pool = new BufferPool();
+            return *pool;
+        }
+
+        // Must be called with m_mutex held
+        size_t size_class(size_t len) const {
+            constexpr size_t min_size = 64;
+            if (len <= min_size) {
+                return min_size;
+            }
+
+            size_t power = min_size;
+            while (power * 2 < len) {
+                power *= 2;
+            }
+            const size_t step = power / 4;
+            return huge_size(((len + step - 1) / step) * step);
+        }
+
+        /* Rounds the sizes that can use huge pages up to whole huge
+         * pages. Must be called with m_mutex held. */
+        size_t huge_size(size_t len) const {
+            if (m_huge_pages == huge_pages_e::off or len < huge_page_size) {
+                return len;
+            }
+            return ((len + huge_page_size - 1) / huge_page_size) * huge_page_size;
+        }
+
+        /* Return a block of at least len bytes, and set capacity to its
+         * actual size. */
+        void *allocate(size_t len, size_t& capacity) {
+            huge_pages_e mode;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                capacity = size_class(len);
+                auto it = m_blocks.find(capacity);
+                if (it != m_blocks.end() and not it->second.empty()) {
+                    void *block = it->second.back();
+                    it->second.pop_back();
+                    m_pooled_bytes -= capacity;
+                    return block;
+                }
+                mode = m_huge_pages;
+            }
+            m_num_allocations.fetch_add(1, std::memory_order_relaxed);
+            return allocate_block(capacity, mode);
+        }
+
+        uint64_t num_allocations() const {
+            return m_num_allocations.load(std::memory_order_relaxed);
+        }
+
+        /* A block outside of the pool, for free_block() */
+        void *allocate_unpooled(size_t len) {
+            size_t capacity;
+            huge_pages_e mode;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                capacity = huge_size(len);
+                mode = m_huge_pages;
+            }
+            return allocate_block(capacity, mode);
+        }
+
+        void release(void *block, size_t capacity) {
+            if (block == nullptr) {
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                auto& blocks = m_blocks[capacity];
+                if (blocks.size() < max_blocks_per_class and
+                        m_pooled_bytes + capacity <= m_max_pooled_bytes) {
+                    blocks.push_back(block);
+                    m_pooled_bytes += capacity;
+                    return;
+                }
+            }
+            free_block(block);
+        }
+
+        void free_block(void *block) {
+            if (block == nullptr) {
+                return;
+            }
+
+            std::unique_lock<std::mutex> lock(m_mutex);
+            auto it = m_mapped.find(block);
+            if (it != m_mapped.end()) {
+                const size_t len = it->second;
+                m_mapped.erase(it);
+                lock.unlock();
+                munmap(block, len);
+            }
+            else {
+                lock.unlock();
+                free(block);
+            }
+        }
+
+        void set_huge_pages(huge_pages_e mode) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_huge_pages = mode;
+            m_warned_hugetlb.store(false);
+        }
+
+        huge_pages_e get_huge_pages() {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_huge_pages;
+        }
+
+        size_t pooled_bytes() {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_pooled_bytes;
+        }
+
+        /* The blocks above the new limit are freed */
+        void set_max_pooled_bytes(size_t max_bytes) {
+            std::vector<void*> freed;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_max_pooled_bytes = max_bytes;
+                for (auto it = m_blocks.rbegin(); it != m_blocks.rend() and
+                        m_pooled_bytes > m_max_pooled_bytes; ++it) {
+                    while (not it->second.empty() and
+                            m_pooled_bytes > m_max_pooled_bytes) {
+                        freed.push_back(it->second.back());
+                        it->second.pop_back();
+                        m_pooled_bytes -= it->first;
+                    }
+                }
+            }
+            for (void *block : freed) {
+                free_block(block);
+            }
+        }
+
+    private:
+        BufferPool() = default;
+
+        void *allocate_block(size_t capacity, huge_pages_e mode) {
+            const bool huge = mode != huge_pages_e::off and
+                capacity >= huge_page_size;
+
+            if (huge and mode == huge_pages_e::hugetlb) {
+                // MAP_POPULATE faults the pages in already
+                void *block = mmap(nullptr, capacity, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE,
+                        -1, 0);
+                if (block != MAP_FAILED) {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_mapped[block] = capacity;
+                    return block;
+                }
+
+                if (not m_warned_hugetlb.exchange(true)) {
+                    etiLog.level(warn) << "Buffer: no reserved huge pages "
+                        "left for " << capacity << " bytes, using "
+                        "transparent huge pages";
+                }
+            }
+
+            void *block = nullptr;
+            /* Align to 32-byte boundary for AVX, or to the huge page. */
+            const int ret = posix_memalign(&block,
+                    huge ? huge_page_size : 32, capacity);
+            if (ret != 0) {
+                throw std::runtime_error("memory allocation failed: " +
+                        std::to_string(ret));
+            }
+
+            if (huge) {
+                // Not fatal, the block is then in normal pages
+                madvise(block, capacity, MADV_HUGEPAGE);
+                memset(block, 0, capacity);
+            }
+            return block;
+        }
+
+        static constexpr size_t max_blocks_per_class = 16;
+
+        std::mutex m_mutex;
+        std::map<size_t, std::vector<void*> > m_blocks;
+        size_t m_pooled_bytes = 0;
+        size_t m_max_pooled_bytes = 64 * 1024 * 1024;
+
+        huge_pages_e m_huge_pages = huge_pages_e::off;
+        std::atomic<bool> m_warned_hugetlb = ATOMIC_VAR_INIT(false);
+        std::atomic<uint64_t> m_num_allocations = ATOMIC_VAR_INIT(0);
+
+        // The blocks from mmap, with their size
+        std::map<void*, size_t> m_mapped;
+};
+
+void set_huge_pages(huge_pages_e mode)
+{
+    if (mode != huge_pages_e::off) {
+        std::ifstream thp("/sys/kernel/mm/transparent_hugepage/enabled");
+        std::string setting;
+        std::getline(thp, setting);
+        if (setting.find("[never]") != std::string::npos) {
+            etiLog.level(warn) << "Buffer: transparent huge pages are "
+                "disabled in the kernel";
+        }
+    }
+    BufferPool::instance().set_huge_pages(mode);
+}
+
+huge_pages_e get_huge_pages()
+{
+    return BufferPool::instance().get_huge_pages();
+}
+
+void *alloc_workspace(size_t len)
+{
+    return BufferPool::instance().allocate_unpooled(len);
+}
+
+void free_workspace(void *block)
+{
+    BufferPool::instance().free_block(block);
+}
+
+uint64_t get_buffer_allocations()
+{
+    return BufferPool::instance().num_allocations();
+}
+
+size_t get_pooled_bytes()
+{
+    return BufferPool::instance().pooled_bytes();
+}
+
+void set_max_pooled_bytes(size_t max_bytes)
+{
+    BufferPool::instance().set_max_pooled_bytes(max_bytes);
+}
 
 Buffer::Buffer(size_t len, const void *data)
 {
@@ -46,6 +301,9 @@ Buffer::Buffer(size_t len, const void *data)
 
 Buffer::Buffer(const Buffer& other)
 {
+    m_len = 0;
+    m_capacity = 0;
+    m_data = nullptr;
     setData(other.m_data, other.m_len);
 }
 
@@ -74,9 +332,7 @@ Buffer::Buffer(const std::vector<uint8_t>& vec)
 Buffer::~Buffer()
 {
     PDEBUG("Buffer::~Buffer() len=%zu, data=%p\n", m_len, m_data);
-    if (m_data) {
-        free(m_data);
-    }
+    BufferPool::instance().release(m_data, m_capacity);
 }
 
 void Buffer::swap(Buffer& other)
@@ -97,11 +353,9 @@ Buffer& Buffer::operator=(const Buffer& other)
 Buffer& Buffer::operator=(Buffer&& other)
 {
     if (&other != this) {
+        BufferPool::instance().release(m_data, m_capacity);
         m_len = other.m_len;
         m_capacity = other.m_capacity;
-        if (m_data != nullptr) {
-            free(m_data);
-        }
         m_data = other.m_data;
 
         other.m_len = 0;
@@ -128,20 +382,15 @@ Buffer& Buffer::operator+=(const Buffer& other)
 void Buffer::setLength(size_t len)
 {
     if (len > m_capacity) {
-        void *tmp = m_data;
+        size_t capacity = 0;
+        void *tmp = BufferPool::instance().allocate(len, capacity);
 
-        /* Align to 32-byte boundary for AVX. */
-        const int ret = posix_memalign(&m_data, 32, len);
-        if (ret != 0) {
-            throw std::runtime_error("memory allocation failed: " +
-                    std::to_string(ret));
-        }
-
-        if (tmp != nullptr) {
-            memcpy(m_data, tmp, m_len);
-            free(tmp);
+        if (m_data != nullptr) {
+            memcpy(tmp, m_data, m_len);
         }
-        m_capacity = len;
+        BufferPool::instance().release(m_data, m_capacity);
+        m_data = tmp;
+        m_capacity = capacity;
     }
     m_len = len;
 }
@@ -45,7 +45,10 @@ typedef std::complex<fpm::fixed_16_16> complexfix_wide;
 /* Buffer is a container for a byte array, which is memory-aligned
  * to 32 bytes for SIMD performance.
  *
- * The allocation/freeing of the data is handled internally.
+ * The allocation/freeing of the data is handled internally. Released
+ * memory blocks are kept in a pool and handed out again when a Buffer
+ * of similar size is needed, so that the steady-state operation of
+ * the modulator does not call malloc and free for every frame.
  */
 class Buffer {
     public:
@@ -79,6 +82,9 @@ class Buffer {
         size_t getLength() const { return m_len; }
         void* getData() const { return m_data; }
 
+        /* Size of the allocated memory, at least getLength() */
+        size_t getCapacity() const { return m_capacity; }
+
     private:
         /* Current length of the data in the Buffer */
         size_t m_len;
@@ -93,3 +99,34 @@ class Buffer {
 
 void swap(Buffer& buf1, Buffer& buf2);
 
+/* Blocks of at least huge_page_size bytes, for the Buffers and the large
+ * workspaces, can be backed by huge pages, which saves TLB misses in the
+ * sample processing. They are rounded up to whole huge pages, and written
+ * once when they are allocated so that the page faults do not happen in
+ * the first frames.
+ *  transparent: madvise the blocks for transparent huge pages
+ *  hugetlb:     map the huge pages reserved with vm.nr_hugepages, and
+ *               use transparent huge pages when there are none left
+ * The setting applies to the blocks allocated afterwards. */
+enum class huge_pages_e { off, transparent, hugetlb };
+
+constexpr size_t huge_page_size = 2 * 1024 * 1024;
+
+void set_huge_pages(huge_pages_e mode);
+huge_pages_e get_huge_pages();
+
+/* Allocate memory for a workspace that is kept for a long time, like the
+ * ones of the FFTs, aligned to 32 bytes and following the huge page
+ * setting. Must be freed with free_workspace(). */
+void *alloc_workspace(size_t len);
+void free_workspace(void *block);
+
+/* Number of blocks allocated because the pool had none of the size. Once
+ * the modulator is warmed up, it stays constant. */
+uint64_t get_buffer_allocations();
+
+/* Bytes of the released blocks the pool keeps for the next Buffers, and
+ * the limit above which released blocks get freed, 64 MB by default. */
+size_t get_pooled_bytes();
+void set_max_pooled_bytes(size_t max_bytes);
+
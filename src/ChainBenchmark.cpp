@@ -0,0 +1,1024 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   Benchmark and regression test of the whole modulator. The same ETI
+   frames go through the DabModulator in several configurations, and the
+   speed and a hash of the output samples are reported for each of them.
+   The hashes can be saved into a golden file and compared against it
+   after a change.
+*/
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include "Buffer.h"
+#include "ConfigParser.h"
+#include "DabModulator.h"
+#include "Eti.h"
+#include "EtiReader.h"
+#include "InputReader.h"
+#include "Log.h"
+#include "PerfCounters.h"
+#include "RunReport.h"
+#include "Utils.h"
+#include "output/Simulated.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+using namespace std;
+
+static constexpr size_t ETI_FRAME_SIZE = 6144;
+
+/* Same normalisation as the main program for the s16 output */
+static constexpr float normalise_s16 = 32767.0f / 50000.0f;
+
+/* The synthetic ensemble fills all 864 CUs of mode I. Every subchannel is
+ * given by its STL (in 64-bit words per ETI frame), its TPL and its size
+ * in CUs: six 128kbps EEP-3A and three 64kbps EEP-1A subchannels. */
+struct synth_subchannel_t {
+    uint16_t stl;
+    uint8_t tpl;
+    uint16_t size_cu;
+};
+
+static const vector<synth_subchannel_t> synth_subchannels({
+        {48, 0x22, 96}, {48, 0x22, 96}, {48, 0x22, 96},
+        {48, 0x22, 96}, {48, 0x22, 96}, {48, 0x22, 96},
+        {24, 0x20, 96}, {24, 0x20, 96}, {24, 0x20, 96},
+        });
+
+/* With -s, count EEP-3A subchannels of the same bitrate instead. One of
+ * n*8kbps has an STL of 3n and 6n CUs. */
+static constexpr size_t max_subchannels = 64;
+
+static vector<synth_subchannel_t> eep3a_subchannels(size_t count)
+{
+    const uint16_t n = 864 / 6 / count;
+    return vector<synth_subchannel_t>(count,
+            synth_subchannel_t{(uint16_t)(3 * n), 0x22, (uint16_t)(6 * n)});
+}
+
+/* The capacity test loops over the frames, which keeps the FCT and the FP
+ * continuous with a multiple of this number of frames */
+static constexpr size_t capacity_frames_multiple = 1000;
+
+// Before the capacity test counts the missed deadlines
+static constexpr auto capacity_warmup = chrono::seconds(2);
+
+struct chain_result_t {
+    size_t num_outputs = 0;
+    uint64_t hash = 0;
+    double frames_per_s = 0;
+
+    // In Transmission Mode I, the energy of the null symbol of every
+    // transmission frame of the output
+    vector<double> null_energy;
+
+    // All s16 output samples, for the comparison against the reference
+    // configuration
+    vector<int16_t> samples;
+
+    // Entry of the report, with the statistics of every block
+    json::value_t report;
+};
+
+struct chain_config_t {
+    string name;
+    function<void(mod_settings_t&)> configure;
+
+    // Returns what is wrong with the output, which fails the benchmark,
+    // or an empty string. Not set for the configurations whose output is
+    // only compared against the golden file.
+    function<string(const chain_result_t&)> check;
+
+    // The configuration whose output this one has to give, except for
+    // the frames that are still in the pipeline or in a batch at the end,
+    // or empty. The samples must differ by at most max_difference.
+    string reference;
+    int max_difference = 0;
+};
+
+/* Files of coefficients and taps the blocks load, removed at exit */
+struct chain_files_t {
+    string poly;
+};
+
+static void usage(const char *progName)
+{
+    fprintf(stderr,
+            "Usage: %s [-i eti] [-n frames] [-s count] [-c config] [-g golden] [-v golden]\n"
+            "          [-j report] [-p] [-m max] [-d seconds] [-b ms]\n"
+            "  -i eti       Modulate this ETI file instead of synthetic frames\n"
+            "  -n frames    Number of ETI frames per configuration (default 500)\n"
+            "  -s count     Synthetic ensemble of count EEP-3A subchannels (1 to 64),\n"
+            "               instead of six at 128kbps and three at 64kbps\n"
+            "  -c config    Only run the configurations whose name contains config\n"
+            "  -g golden    Write the output hashes into the golden file\n"
+            "  -v golden    Compare the output hashes against the golden file,\n"
+            "               and exit with 1 if one differs\n"
+            "  -j report    Append the results as one line of JSON to report\n"
+            "  -p           Add the IPC and cache and branch misses of every block\n"
+            "               to the report, from the hardware performance counters\n"
+            "  -m max       Capacity test: run 1, 2, ... up to max ensembles in parallel\n"
+            "               in real time against simulated devices, until one misses\n"
+            "               a deadline. The frames are used in a loop, the synthetic\n"
+            "               ones rounded up to a multiple of 1000.\n"
+            "  -d seconds   Duration of every step of the capacity test (default 10)\n"
+            "  -b ms        Buffer of the simulated devices, like the queue in front\n"
+            "               of a real one (default 200)\n",
+            progName);
+}
+
+/* Mode I ETI(NI) frames with FP 0 at the first frame, random subchannel
+ * and FIC data, and no timestamp. The CRCs are not computed, the EtiReader
+ * does not check them. */
+static vector<uint8_t> synthetic_eti(size_t num_frames,
+        const vector<synth_subchannel_t>& synth_subchannels)
+{
+    mt19937 rng(42);
+    uniform_int_distribution<int> dist(0, 255);
+
+    const size_t nst = synth_subchannels.size();
+    constexpr size_t fic_length = 96;
+    size_t mst_length = fic_length;
+    for (const auto& s : synth_subchannels) {
+        mst_length += s.stl * 8;
+    }
+
+    vector<uint8_t> frames(num_frames * ETI_FRAME_SIZE, 0x55);
+    for (size_t f = 0; f < num_frames; f++) {
+        uint8_t *frame = frames.data() + f * ETI_FRAME_SIZE;
+        uint8_t *out = frame;
+
+        eti_SYNC sync;
+        sync.ERR = 0xFF;
+        sync.FSYNC = (f % 2) ? 0xF8C549 : 0x073AB6;
+        memcpy(out, &sync, 4);
+        out += 4;
+
+        eti_FC fc;
+        fc.FCT = f % 250;
+        fc.NST = nst;
+        fc.FICF = 1;
+        fc.MID = 1;
+        fc.FP = f % 8;
+        // In 32-bit words, from the STC to the end of the MST
+        fc.setFrameLength(nst + 1 + mst_length / 4);
+        memcpy(out, &fc, 4);
+        out += 4;
+
+        uint16_t start_address = 0;
+        for (size_t i = 0; i < nst; i++) {
+            eti_STC stc;
+            stc.SCID = i + 1;
+            stc.setStartAddress(start_address);
+            stc.TPL = synth_subchannels[i].tpl;
+            stc.setSTL(synth_subchannels[i].stl);
+            memcpy(out, &stc, 4);
+            out += 4;
+            start_address += synth_subchannels[i].size_cu;
+        }
+
+        eti_EOH eoh;
+        eoh.MNSC = 0;
+        eoh.CRC = 0;
+        memcpy(out, &eoh, 4);
+        out += 4;
+
+        for (size_t i = 0; i < mst_length; i++) {
+            *out++ = dist(rng);
+        }
+
+        eti_EOF eof;
+        eof.CRC = 0;
+        eof.RFU = 0xFFFF;
+        memcpy(out, &eof, 4);
+        out += 4;
+
+        eti_TIST tist;
+        tist.TIST = 0xFFFFFFFF;
+        memcpy(out, &tist, 4);
+    }
+
+    return frames;
+}
+
+static vector<uint8_t> load_eti(const string& filename, size_t num_frames)
+{
+    InputMmapReader reader;
+    if (reader.Open(filename, false) == -1) {
+        throw runtime_error("Could not open ETI file " + filename);
+    }
+
+    // Like the modulator, start at the first frame with FP 0
+    size_t first = 0;
+    unsigned fct = 0;
+    unsigned fp = 0;
+    for (; first < reader.GetNumFrames(); first++) {
+        reader.GetFrameCounters(first, fct, fp);
+        if (fp == 0) {
+            break;
+        }
+    }
+
+    num_frames = std::min(num_frames, reader.GetNumFrames() - first);
+    if (num_frames == 0) {
+        throw runtime_error("No frame with FP 0 in " + filename);
+    }
+
+    vector<uint8_t> frames(num_frames * ETI_FRAME_SIZE);
+    vector<uint8_t> padded_frame(ETI_FRAME_SIZE);
+    for (size_t f = 0; f < num_frames; f++) {
+        memcpy(frames.data() + f * ETI_FRAME_SIZE,
+                reader.GetFrame(first + f, padded_frame.data()), ETI_FRAME_SIZE);
+    }
+    return frames;
+}
+
+/* MemlessPoly only loads its coefficients from a file */
+static string write_coefs_file(const string& contents)
+{
+    char path[] = "/tmp/odr-dabmod-chainbench-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1) {
+        throw runtime_error("Could not create coefficients file");
+    }
+    close(fd);
+
+    ofstream coefs(path);
+    coefs << contents;
+    return path;
+}
+
+// Odd-only polynomial format: small AM/AM and AM/PM distortion
+static const string poly_coefs =
+    "1\n5\n1.0\n0.0\n-0.05\n0.0\n0.0\n0.0\n0.01\n0.0\n0.0\n0.0\n";
+
+/* In Transmission Mode I, the TII is in the null symbol of every second
+ * transmission frame */
+static string check_tii(const chain_result_t& result)
+{
+    const auto& energy = result.null_energy;
+    if (energy.size() < 4) {
+        return "not enough transmission frames";
+    }
+
+    for (size_t i = 0; i + 1 < energy.size(); i++) {
+        if ((energy[i] > 0) == (energy[i + 1] > 0)) {
+            return "transmission frames " + to_string(i) + " and " +
+                to_string(i + 1) + " both have " +
+                (energy[i] > 0 ? "" : "no ") + "TII";
+        }
+    }
+    return "";
+}
+
+static void enable_tii(mod_settings_t& s)
+{
+    s.tiiConfig.enable = true;
+    s.tiiConfig.comb = 1;
+    s.tiiConfig.pattern = 1;
+}
+
+/* Every pipeline stage delays the output by one frame, and a batch is only
+ * given once it is full. The other samples are those of the reference. */
+static string check_reference(const chain_config_t& config,
+        const chain_result_t& result, const chain_result_t& reference)
+{
+    mod_settings_t settings;
+    config.configure(settings);
+
+    const auto& samples = result.samples;
+    const auto& expected = reference.samples;
+    if (samples.empty() or reference.num_outputs == 0) {
+        return "no output";
+    }
+
+    const size_t frame_size = expected.size() / reference.num_outputs;
+    const size_t missing = (settings.pipelineStages.size() +
+            settings.batchFrames) * frame_size;
+    if (samples.size() > expected.size() or
+            samples.size() + missing < expected.size()) {
+        return to_string(samples.size()) + " samples instead of " +
+            to_string(expected.size()) + " of " + config.reference;
+    }
+
+    for (size_t i = 0; i < samples.size(); i++) {
+        if (abs(samples[i] - expected[i]) > config.max_difference) {
+            return "sample " + to_string(i) + " differs from " +
+                config.reference + " by " +
+                to_string(abs(samples[i] - expected[i]));
+        }
+    }
+    return "";
+}
+
+static vector<chain_config_t> chain_configs(const chain_files_t& files)
+{
+    vector<chain_config_t> configs;
+    auto add = [&](const string& name, function<void(mod_settings_t&)> configure,
+            function<string(const chain_result_t&)> check = nullptr,
+            const string& reference = "", int max_difference = 0) {
+        configs.push_back({name, configure, check, reference, max_difference});
+    };
+
+    add("fftw", [](mod_settings_t&) { });
+
+    add("fftw cfr", [](mod_settings_t& s) {
+            s.enableCfr = true;
+            s.cfrClip = 50.0f;
+            s.cfrErrorClip = 0.1f;
+            s.cfrIterations = 2;
+        });
+
+    add("fftw peakcancel", [](mod_settings_t& s) {
+            s.filterTapsFilename = "default";
+            s.enablePeakCancel = true;
+        });
+
+    add("fftw fir", [](mod_settings_t& s) {
+            s.filterTapsFilename = "default";
+        });
+
+    add("fftw poly", [&files](mod_settings_t& s) {
+            s.polyCoefFilename = files.poly;
+        });
+
+    add("fftw resampler", [](mod_settings_t& s) {
+            s.outputRate = 4096000;
+            s.filterTapsFilename = "default";
+            s.resampler = ResamplerType::FFT;
+        });
+
+    add("fftw halfband", [](mod_settings_t& s) {
+            s.outputRate = 4096000;
+            s.filterTapsFilename = "default";
+            s.resampler = ResamplerType::Halfband;
+        });
+
+    add("fftw polyphase", [](mod_settings_t& s) {
+            s.outputRate = 4096000;
+            s.filterTapsFilename = "default";
+            s.resampler = ResamplerType::Polyphase;
+        });
+
+    // The plans over several symbols can round differently from the ones
+    // of a single symbol
+    add("fftw batched", [](mod_settings_t& s) {
+            s.batchFrames = 2;
+            s.batchedFft = true;
+        }, nullptr, "fftw", 1);
+
+    add("fftw planar", [](mod_settings_t& s) {
+            s.planarSamples = true;
+        });
+
+    add("fftw planar poly", [&files](mod_settings_t& s) {
+            s.polyCoefFilename = files.poly;
+            s.planarSamples = true;
+        });
+
+    add("fftw tii", enable_tii, check_tii);
+
+    add("fftw tii threads", [](mod_settings_t& s) {
+            enable_tii(s);
+            s.flowgraphNumThreads = 2;
+        }, check_tii);
+
+    add("fftw stages mapping", [](mod_settings_t& s) {
+            s.pipelineStages = {"mapping"};
+        }, nullptr, "fftw");
+
+    add("fftw stages ofdm", [](mod_settings_t& s) {
+            s.pipelineStages = {"ofdm"};
+        }, nullptr, "fftw");
+
+    add("fftw stages output", [](mod_settings_t& s) {
+            s.pipelineStages = {"output"};
+        }, nullptr, "fftw");
+
+    add("fftw stages all", [](mod_settings_t& s) {
+            s.pipelineStages = {"mapping", "ofdm", "output"};
+        }, nullptr, "fftw");
+
+    add("kiss", [](mod_settings_t& s) {
+            s.fftEngine = FFTEngine::KISS;
+        });
+
+    add("kiss simd", [](mod_settings_t& s) {
+            s.fftEngine = FFTEngine::KISS_SIMD;
+        });
+
+    add("kiss gaincontrol", [](mod_settings_t& s) {
+            s.fftEngine = FFTEngine::KISS;
+            s.fixedPointGainControl = true;
+        });
+
+    add("kiss polyphase", [](mod_settings_t& s) {
+            s.fftEngine = FFTEngine::KISS;
+            s.outputRate = 4096000;
+            s.filterTapsFilename = "default";
+        });
+
+    return configs;
+}
+
+/* The s16 output of a flowgraph contains whole transmission frames */
+static void add_null_energy(const mod_settings_t& settings,
+        const Buffer& samples, vector<double>& null_energy)
+{
+    if (settings.dabMode != 1 or settings.planarSamples) {
+        return;
+    }
+
+    // 196608 and 2656 samples at 2048000 samples per second
+    const size_t frame_size = settings.outputRate * 96 / 1000;
+    const size_t null_size = settings.outputRate * 2656 / 2048000;
+
+    const auto *iq = reinterpret_cast<const int16_t*>(samples.getData());
+    const size_t num_samples = samples.getLength() / (2 * sizeof(int16_t));
+    for (size_t start = 0; start + frame_size <= num_samples; start += frame_size) {
+        double energy = 0;
+        for (size_t i = 2 * start; i < 2 * (start + null_size); i++) {
+            energy += (double)iq[i] * iq[i];
+        }
+        null_energy.push_back(energy);
+    }
+}
+
+/* FNV-1a over all output samples */
+static uint64_t fnv1a(uint64_t hash, const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static chain_result_t run_config(const chain_config_t& config,
+        const vector<uint8_t>& eti, bool keep_samples)
+{
+    using clock = chrono::steady_clock;
+
+    // The DabModulator keeps a reference to its settings
+    mod_settings_t settings;
+    settings.normalise = normalise_s16;
+    settings.showProcessTime = false;
+    config.configure(settings);
+
+    EtiReader etiReader(settings.tist_offset_s);
+    DabModulator modulator(etiReader, settings, "s16");
+
+    chain_result_t result;
+    result.hash = 0xcbf29ce484222325ull;
+
+    // The setup of the modulator finishes at the first frame, which is
+    // therefore not part of the measurement
+    const size_t num_frames = eti.size() / ETI_FRAME_SIZE;
+    size_t measured_frames = 0;
+    clock::time_point start;
+
+    Buffer samples;
+    for (size_t f = 0; f < num_frames; f++) {
+        if (etiReader.loadEtiData(eti.data() + f * ETI_FRAME_SIZE,
+                    ETI_FRAME_SIZE) != ETI_FRAME_SIZE) {
+            throw runtime_error("ETI frame " + to_string(f) + " incompletely read");
+        }
+
+        if (f == 1) {
+            start = clock::now();
+        }
+
+        // Returns 0 until a transmission frame, or a batch, is complete
+        if (modulator.process(&samples) != 0) {
+            result.hash = fnv1a(result.hash,
+                    reinterpret_cast<const uint8_t*>(samples.getData()),
+                    samples.getLength());
+            result.num_outputs++;
+            if (config.check) {
+                add_null_energy(settings, samples, result.null_energy);
+            }
+            if (keep_samples) {
+                const auto *iq = reinterpret_cast<const int16_t*>(samples.getData());
+                result.samples.insert(result.samples.end(), iq,
+                        iq + samples.getLength() / sizeof(int16_t));
+            }
+        }
+
+        if (f >= 1) {
+            measured_frames++;
+        }
+    }
+
+    const double elapsed_s = chrono::duration<double>(clock::now() - start).count();
+    result.frames_per_s = elapsed_s > 0 ? measured_frames / elapsed_s : 0;
+
+    char hash[17];
+    snprintf(hash, sizeof(hash), "%016" PRIx64, result.hash);
+
+    auto entry = make_shared<json::map_t>();
+    (*entry)["name"].v = config.name;
+    (*entry)["settings"].v = make_shared<json::map_t>(RunReport::settings_info(settings));
+    (*entry)["frames_per_s"].v = result.frames_per_s;
+    (*entry)["realtime_factor"].v = result.frames_per_s * 0.024;
+    (*entry)["outputs"].v = (uint64_t)result.num_outputs;
+    (*entry)["hash"].v = string(hash);
+    (*entry)["blocks"].v = modulator.get_latency_statistics();
+    result.report.v = entry;
+    return result;
+}
+
+struct capacity_ensemble_t {
+    size_t underruns = 0;
+    size_t late_packets = 0;
+    json::value_t blocks;
+};
+
+/* One ensemble of a capacity step: modulate the frames in a loop, and give
+ * the output to a simulated device, which paces the ensemble in real time.
+ * A frame that the modulator does not deliver before the device runs out of
+ * samples counts as an underrun. */
+static capacity_ensemble_t run_capacity_ensemble(const chain_config_t& config,
+        const vector<uint8_t>& eti, chrono::steady_clock::time_point end,
+        unsigned buffer_ms)
+{
+    using clock = chrono::steady_clock;
+
+    mod_settings_t settings;
+    settings.normalise = normalise_s16;
+    settings.showProcessTime = false;
+    config.configure(settings);
+
+    EtiReader etiReader(settings.tist_offset_s);
+    DabModulator modulator(etiReader, settings, "s16");
+
+    Output::SDRDeviceConfig device_config;
+    device_config.sampleRate = settings.outputRate;
+    device_config.sampleFormat = "s16";
+    device_config.simulatedBufferMs = buffer_ms;
+    Output::Simulated device(device_config);
+    const auto *events = device.get_tx_event_counters();
+
+    const size_t num_frames = eti.size() / ETI_FRAME_SIZE;
+    const auto warmup_end = clock::now() + capacity_warmup;
+    bool warm = false;
+    size_t underruns_before = 0;
+    size_t late_packets_before = 0;
+
+    Buffer samples;
+    for (size_t f = 0; clock::now() < end; f = (f + 1) % num_frames) {
+        if (etiReader.loadEtiData(eti.data() + f * ETI_FRAME_SIZE,
+                    ETI_FRAME_SIZE) != ETI_FRAME_SIZE) {
+            throw runtime_error("ETI frame " + to_string(f) + " incompletely read");
+        }
+
+        if (modulator.process(&samples) != 0) {
+            Output::FrameData frame;
+            frame.buf = std::move(samples);
+            frame.sampleSize = sizeof(complex<int16_t>);
+            device.transmit_frame(std::move(frame));
+            samples = Buffer();
+        }
+
+        if (not warm and clock::now() >= warmup_end) {
+            warm = true;
+            underruns_before = events->underflows;
+            late_packets_before = events->late_packets;
+        }
+    }
+
+    capacity_ensemble_t result;
+    result.underruns = events->underflows - underruns_before;
+    result.late_packets = events->late_packets - late_packets_before;
+    result.blocks.v = modulator.get_latency_statistics();
+    return result;
+}
+
+struct capacity_step_t {
+    size_t num_ensembles = 0;
+    size_t underruns = 0;
+    size_t late_packets = 0;
+    json::value_t report;
+
+    bool missed() const { return underruns > 0 or late_packets > 0; }
+};
+
+/* Run num_ensembles ensembles in parallel, each in its own thread like the
+ * ensembles of the main program */
+static capacity_step_t run_capacity_step(const chain_config_t& config,
+        const vector<uint8_t>& eti, size_t num_ensembles, double duration_s,
+        unsigned buffer_ms)
+{
+    const auto end = chrono::steady_clock::now() + capacity_warmup +
+        chrono::duration_cast<chrono::steady_clock::duration>(
+                chrono::duration<double>(duration_s));
+
+    vector<capacity_ensemble_t> results(num_ensembles);
+    vector<exception_ptr> errors(num_ensembles);
+    vector<thread> threads;
+    for (size_t i = 0; i < num_ensembles; i++) {
+        threads.emplace_back([&, i]() {
+                try {
+                    set_thread_name("capacity");
+                    results[i] = run_capacity_ensemble(config, eti, end, buffer_ms);
+                }
+                catch (...) {
+                    errors[i] = current_exception();
+                }
+            });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    for (const auto& e : errors) {
+        if (e) {
+            rethrow_exception(e);
+        }
+    }
+
+    capacity_step_t step;
+    step.num_ensembles = num_ensembles;
+    vector<json::value_t> ensembles;
+    for (const auto& r : results) {
+        step.underruns += r.underruns;
+        step.late_packets += r.late_packets;
+
+        auto entry = make_shared<json::map_t>();
+        (*entry)["underruns"].v = (uint64_t)r.underruns;
+        (*entry)["late_packets"].v = (uint64_t)r.late_packets;
+        (*entry)["blocks"] = r.blocks;
+        json::value_t v;
+        v.v = entry;
+        ensembles.push_back(v);
+    }
+
+    auto entry = make_shared<json::map_t>();
+    (*entry)["ensembles"].v = (uint64_t)num_ensembles;
+    (*entry)["underruns"].v = (uint64_t)step.underruns;
+    (*entry)["late_packets"].v = (uint64_t)step.late_packets;
+    (*entry)["per_ensemble"].v = ensembles;
+    step.report.v = entry;
+    return step;
+}
+
+/* Increase the number of ensembles until one of them misses a deadline.
+ * The capacity is the last number without a missed deadline. */
+static json::value_t run_capacity(const chain_config_t& config,
+        const vector<uint8_t>& eti, size_t max_ensembles, double duration_s,
+        unsigned buffer_ms)
+{
+    mod_settings_t settings;
+    config.configure(settings);
+
+    size_t capacity = 0;
+    vector<json::value_t> steps;
+    for (size_t n = 1; n <= max_ensembles; n++) {
+        const auto step = run_capacity_step(config, eti, n, duration_s, buffer_ms);
+        steps.push_back(step.report);
+
+        printf("%-20s %3zu ensembles %6zu underruns %6zu late %s\n",
+                config.name.c_str(), n, step.underruns, step.late_packets,
+                step.missed() ? "MISSED" : "ok");
+        fflush(stdout);
+
+        if (step.missed()) {
+            break;
+        }
+        capacity = n;
+    }
+
+    printf("%-20s capacity %zu ensemble%s%s\n", config.name.c_str(),
+            capacity, capacity == 1 ? "" : "s",
+            capacity == max_ensembles ? " or more" : "");
+    fflush(stdout);
+
+    auto entry = make_shared<json::map_t>();
+    (*entry)["name"].v = config.name;
+    (*entry)["settings"].v = make_shared<json::map_t>(RunReport::settings_info(settings));
+    (*entry)["capacity"].v = (uint64_t)capacity;
+    (*entry)["limit_reached"].v = capacity == max_ensembles;
+    (*entry)["steps"].v = steps;
+    json::value_t result;
+    result.v = entry;
+    return result;
+}
+
+/* One line per configuration: hash in hex, number of outputs, name */
+static map<string, pair<uint64_t, size_t> > read_golden(const string& filename)
+{
+    ifstream in(filename);
+    if (not in) {
+        throw runtime_error("Could not open golden file " + filename);
+    }
+
+    map<string, pair<uint64_t, size_t> > golden;
+    string line;
+    while (getline(in, line)) {
+        if (line.empty() or line[0] == '#') {
+            continue;
+        }
+
+        char name[128];
+        uint64_t hash = 0;
+        size_t num_outputs = 0;
+        if (sscanf(line.c_str(), "%" SCNx64 " %zu %127[^\n]",
+                    &hash, &num_outputs, name) != 3) {
+            throw runtime_error("Invalid line in golden file: " + line);
+        }
+        golden[name] = make_pair(hash, num_outputs);
+    }
+    return golden;
+}
+
+int main(int argc, char **argv)
+{
+    string eti_filename;
+    string config_filter;
+    string golden_out;
+    string golden_in;
+    string report_file;
+    size_t num_frames = 500;
+    size_t num_subchannels = 0;
+    size_t max_ensembles = 0;
+    double step_duration_s = 10;
+    unsigned buffer_ms = 200;
+
+    int c;
+    while ((c = getopt(argc, argv, "b:c:d:g:hi:j:m:n:ps:v:")) != -1) {
+        switch (c) {
+            case 'b':
+                buffer_ms = strtoul(optarg, nullptr, 10);
+                if (buffer_ms == 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'c':
+                config_filter = optarg;
+                break;
+            case 'd':
+                step_duration_s = strtod(optarg, nullptr);
+                if (step_duration_s <= 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'g':
+                golden_out = optarg;
+                break;
+            case 'i':
+                eti_filename = optarg;
+                break;
+            case 'j':
+                report_file = optarg;
+                break;
+            case 'm':
+                max_ensembles = strtoul(optarg, nullptr, 10);
+                if (max_ensembles == 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'n':
+                num_frames = strtoul(optarg, nullptr, 10);
+                if (num_frames < 2) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'p':
+                if (not perf_counters::set_enabled(true)) {
+                    return 1;
+                }
+                break;
+            case 's':
+                num_subchannels = strtoul(optarg, nullptr, 10);
+                if (num_subchannels == 0 or num_subchannels > max_subchannels) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'v':
+                golden_in = optarg;
+                break;
+            case 'h':
+            default:
+                usage(argv[0]);
+                return c == 'h' ? 0 : 1;
+        }
+    }
+
+    // FFTW_ESTIMATE always chooses the same plans, the measured ones can
+    // differ from one run to the next and so can their rounding.
+    configure_fftw_planner("", "estimate");
+
+    chain_files_t files;
+    files.poly = write_coefs_file(poly_coefs);
+
+    if (max_ensembles > 0 and (not golden_in.empty() or not golden_out.empty())) {
+        fprintf(stderr, "The capacity test does not compute output hashes\n");
+        return 1;
+    }
+
+    if (max_ensembles > 0 and eti_filename.empty()) {
+        num_frames = (num_frames + capacity_frames_multiple - 1) /
+            capacity_frames_multiple * capacity_frames_multiple;
+    }
+
+    int ret = 0;
+    try {
+        const vector<uint8_t> eti = eti_filename.empty() ?
+            synthetic_eti(num_frames, num_subchannels ?
+                    eep3a_subchannels(num_subchannels) : synth_subchannels) :
+            load_eti(eti_filename, num_frames);
+
+        const string input = eti_filename.empty() ?
+            (num_subchannels ? "synthetic " + to_string(num_subchannels) +
+             " subchannels" : string("synthetic")) : eti_filename;
+
+        if (max_ensembles > 0) {
+            vector<json::value_t> results;
+            for (const auto& config : chain_configs(files)) {
+                if (not config_filter.empty() and
+                        config.name.find(config_filter) == string::npos) {
+                    continue;
+                }
+                results.push_back(run_capacity(config, eti, max_ensembles,
+                            step_duration_s, buffer_ms));
+            }
+
+            if (not report_file.empty()) {
+                json::map_t report;
+                report["type"].v = string("capacity");
+                report["time"].v = RunReport::timestamp();
+                report["build"].v = make_shared<json::map_t>(RunReport::build_info());
+                report["input"].v = input;
+                report["step_duration_s"].v = step_duration_s;
+                report["device_buffer_ms"].v = (uint64_t)buffer_ms;
+                report["configurations"].v = results;
+                RunReport::append(report_file, report);
+            }
+
+            unlink(files.poly.c_str());
+            return 0;
+        }
+
+        map<string, pair<uint64_t, size_t> > golden;
+        if (not golden_in.empty()) {
+            golden = read_golden(golden_in);
+        }
+
+        ofstream golden_file;
+        if (not golden_out.empty()) {
+            golden_file.open(golden_out);
+            if (not golden_file) {
+                throw runtime_error("Could not create golden file " + golden_out);
+            }
+            golden_file << "# odr-dabmod-chainbench, " <<
+                eti.size() / ETI_FRAME_SIZE << " frames of " <<
+                (eti_filename.empty() ? input + " ETI" : eti_filename) << "\n";
+        }
+
+        vector<json::value_t> results;
+
+        printf("%-20s %12s %9s %16s %-8s %s\n",
+                "configuration", "rate", "speed", "hash", "golden", "check");
+
+        const auto configs = chain_configs(files);
+        auto is_reference = [&](const string& name) {
+            return std::any_of(configs.begin(), configs.end(),
+                    [&](const chain_config_t& c) { return c.reference == name; });
+        };
+
+        // The references that ran, or that the filter left out and that
+        // run without being reported when a configuration needs them
+        map<string, chain_result_t> references;
+
+        for (const auto& config : configs) {
+            if (not config_filter.empty() and
+                    config.name.find(config_filter) == string::npos) {
+                continue;
+            }
+
+            const auto result = run_config(config, eti, is_reference(config.name) or
+                    not config.reference.empty());
+            results.push_back(result.report);
+            if (is_reference(config.name)) {
+                references[config.name] = result;
+            }
+
+            string status = "-";
+            if (not golden_in.empty()) {
+                const auto g = golden.find(config.name);
+                if (g == golden.end()) {
+                    status = "missing";
+                }
+                else if (g->second.first == result.hash and
+                        g->second.second == result.num_outputs) {
+                    status = "ok";
+                }
+                else {
+                    status = "MISMATCH";
+                    ret = 1;
+                }
+            }
+
+            string check = "-";
+            if (config.check or not config.reference.empty()) {
+                string problem;
+                if (config.check) {
+                    problem = config.check(result);
+                }
+                if (problem.empty() and not config.reference.empty()) {
+                    if (references.count(config.reference) == 0) {
+                        const auto ref = std::find_if(configs.begin(), configs.end(),
+                                [&](const chain_config_t& c) {
+                                    return c.name == config.reference; });
+                        if (ref == configs.end()) {
+                            throw logic_error("Unknown reference " + config.reference);
+                        }
+                        references[config.reference] = run_config(*ref, eti, true);
+                    }
+                    problem = check_reference(config, result,
+                            references[config.reference]);
+                }
+                check = problem.empty() ? "ok" : "FAILED";
+                if (not problem.empty()) {
+                    fprintf(stderr, "%s: %s\n", config.name.c_str(),
+                            problem.c_str());
+                    ret = 1;
+                }
+            }
+
+            printf("%-20s %5.0f frames/s %7.1fx %016" PRIx64 " %-8s %s\n",
+                    config.name.c_str(), result.frames_per_s,
+                    result.frames_per_s * 0.024, result.hash, status.c_str(),
+                    check.c_str());
+            fflush(stdout);
+
+            if (golden_file.is_open()) {
+                char line[64];
+                snprintf(line, sizeof(line), "%016" PRIx64 " %zu ",
+                        result.hash, result.num_outputs);
+                golden_file << line << config.name << "\n";
+            }
+        }
+
+        if (not report_file.empty()) {
+            json::map_t report;
+            report["type"].v = string("chainbench");
+            report["time"].v = RunReport::timestamp();
+            report["build"].v = make_shared<json::map_t>(RunReport::build_info());
+            report["input"].v = input;
+            report["frames"].v = (uint64_t)(eti.size() / ETI_FRAME_SIZE);
+            report["configurations"].v = results;
+            RunReport::append(report_file, report);
+        }
+    }
+    catch (const std::exception& e) {
+        fprintf(stderr, "Benchmark failed: %s\n", e.what());
+        ret = 1;
+    }
+
+    unlink(files.poly.c_str());
+    return ret;
+}
@@ -23,6 +23,8 @@
 #include "PcDebug.h"
 
 #include <stdio.h>
+#include <fstream>
+#include <sstream>
 #include <stdexcept>
 
 
@@ -30,10 +32,16 @@ CicEqualizer::CicEqualizer(size_t nbCarriers, size_t spacing, int R) :
     ModCodec(),
     myNbCarriers(nbCarriers),
     mySpacing(spacing),
-    myFilter(nbCarriers)
+    myFilter(compute_filter(nbCarriers, spacing, R))
 {
     PDEBUG("CicEqualizer::CicEqualizer(%zu, %zu, %i) @ %p\n",
             nbCarriers, spacing, R, this);
+}
+
+std::vector<float> CicEqualizer::compute_filter(size_t nbCarriers,
+        size_t spacing, int R)
+{
+    std::vector<float> myFilter(nbCarriers);
 
     const int M = 1;
     const int N = 4;
@@ -54,6 +62,49 @@ CicEqualizer::CicEqualizer(size_t nbCarriers, size_t spacing, int R) :
         PDEBUG("HCic[%zu -> %i] = %f (%f dB) -> angle: %f\n",
                 i, k,myFilter[i], 20.0 * log10(myFilter[i]), angle);
     }
+
+    return myFilter;
+}
+
+std::vector<float> CicEqualizer::load_preemphasis(const std::string& filename,
+        size_t nbCarriers)
+{
+    std::ifstream file(filename);
+    if (not file) {
+        throw std::runtime_error("CicEqualizer: cannot open pre-emphasis file " +
+                filename);
+    }
+
+    std::vector<float> gains_db;
+    std::string line;
+    while (std::getline(file, line)) {
+        std::stringstream ss(line);
+        float gain_db;
+        if (line.empty() or line[0] == '#') {
+            continue;
+        }
+        else if (not (ss >> gain_db)) {
+            throw std::runtime_error("CicEqualizer: invalid line in " +
+                    filename + ": " + line);
+        }
+        gains_db.push_back(gain_db);
+    }
+
+    if (gains_db.size() != nbCarriers) {
+        throw std::runtime_error("CicEqualizer: " + filename + " contains " +
+                std::to_string(gains_db.size()) + " gains instead of " +
+                std::to_string(nbCarriers));
+    }
+
+    // The symbols start with the (nbCarriers + 1) / 2 positive frequencies
+    std::vector<float> gains(nbCarriers);
+    const size_t numNegative = nbCarriers / 2;
+    for (size_t i = 0; i < nbCarriers; i++) {
+        const size_t j = i < nbCarriers - numNegative ?
+            numNegative + i : i - (nbCarriers - numNegative);
+        gains[i] = powf(10.0f, gains_db[j] / 20.0f);
+    }
+    return gains;
 }
 
 
@@ -27,6 +27,7 @@
 
 #include "ModPlugin.h"
 
+#include <string>
 #include <vector>
 #include <sys/types.h>
 
@@ -41,6 +42,20 @@ public:
 
     int process(Buffer* const dataIn, Buffer* dataOut);
     const char* name() { return "CicEqualizer"; }
+    bool supports_in_place() const { return true; }
+
+    /* The gain of every carrier, in the order of the carriers in the
+     * symbols: the positive frequencies first. The OfdmGeneratorCF32 can
+     * apply them itself, which makes this block unnecessary. */
+    static std::vector<float> compute_filter(size_t nbCarriers,
+            size_t spacing, int R);
+
+    /* Read a pre-emphasis table from a text file with one gain in dB for
+     * every carrier, from the lowest to the highest frequency. Lines
+     * starting with # are ignored. Returns the linear gains in the order
+     * of compute_filter(). Throws a runtime_error on invalid files. */
+    static std::vector<float> load_preemphasis(const std::string& filename,
+            size_t nbCarriers);
 
 protected:
     size_t myNbCarriers;
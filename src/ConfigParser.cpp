@@ -29,8 +29,11 @@
 #   include "config.h"
 #endif
 
+#include <cmath>
 #include <cstdint>
 #include <algorithm>
+#include <sstream>
+#include <vector>
 
 #include "INIReader.h"
 
@@ -38,10 +41,24 @@
 #include "Utils.h"
 #include "Log.h"
 #include "Events.h"
+#include "Metrics.h"
+#include "FrameTracer.h"
+#include "CpuFeatures.h"
+#include "PerfCounters.h"
+#include "AllocationTracker.h"
+#include "Buffer.h"
+#include "HalfbandInterpolator.h"
+#include "OutputRecorder.h"
+#include "SharedTables.h"
 
 
 using namespace std;
 
+// Limits of general.low_memory: about three seconds of frames in front of
+// the SDR in transmission mode I, and the pooled buffers
+static constexpr long low_memory_queue_depth = 32;
+static constexpr size_t low_memory_pooled_bytes = 16 * 1024 * 1024;
+
 static GainMode parse_gainmode(const std::string &gainMode_setting)
 {
     string gainMode_minuscule(gainMode_setting);
@@ -63,18 +80,25 @@ static GainMode parse_gainmode(const std::string &gainMode_setting)
     throw std::runtime_error("Configuration error");
 }
 
-static FFTEngine parse_fft_engine(const std::string &fft_engine_setting)
+static FFTEngine parse_fft_engine(const std::string &fft_engine_setting,
+        bool& auto_select)
 {
     string fft_engine_minuscule(fft_engine_setting);
     std::transform(fft_engine_minuscule.begin(), fft_engine_minuscule.end(),
             fft_engine_minuscule.begin(), ::tolower);
 
-    if (fft_engine_minuscule == "fftw") {
+    // The settings that need FFTW are checked as for fftw, the
+    // FFTEngineSelector only considers the other engines when none is set
+    auto_select = (fft_engine_minuscule == "auto");
+    if (auto_select or fft_engine_minuscule == "fftw") {
         return FFTEngine::FFTW;
     }
     else if (fft_engine_minuscule == "kiss") {
         return FFTEngine::KISS;
     }
+    else if (fft_engine_minuscule == "kiss_simd") {
+        return FFTEngine::KISS_SIMD;
+    }
     else if (fft_engine_minuscule == "dexter") {
         return FFTEngine::DEXTER;
     }
@@ -84,51 +108,62 @@ static FFTEngine parse_fft_engine(const std::string &fft_engine_setting)
     throw std::runtime_error("Configuration error");
 }
 
-static void parse_configfile(
-        const std::string& configuration_file,
-        mod_settings_t& mod_settings)
-{
-    // First read parameters from the file
-    INIReader pt(configuration_file);
-
-    int line_err = pt.ParseError();
+/* Gives access to the settings of one ensemble. When several ensembles
+ * are defined, a setting in the section [<name>.<section>] takes precedence
+ * over the same setting in [<section>], which is shared by all ensembles. */
+class EnsembleConfig {
+    public:
+        EnsembleConfig(INIReader& pt, const std::string& name) :
+            m_pt(pt), m_prefix()
+        {
+            if (not name.empty()) {
+                m_prefix = name + ".";
+                std::transform(m_prefix.begin(), m_prefix.end(),
+                        m_prefix.begin(), ::tolower);
+            }
+        }
 
-    if (line_err) {
-        std::cerr << "Error, cannot read configuration file '" << configuration_file.c_str() << "'" << std::endl;
-        std::cerr << "At line:       " << line_err << std::endl;
-        throw std::runtime_error("Cannot read configuration file");
-    }
+        std::string Get(const std::string& key, const std::string& default_value) {
+            return m_pt.Get(resolve(key), default_value);
+        }
 
-    mod_settings.startupCheck = pt.Get("general.startupcheck", "");
+        long GetInteger(const std::string& key, long default_value) {
+            return m_pt.GetInteger(resolve(key), default_value);
+        }
 
-    // remote controller interfaces:
-    if (pt.GetInteger("remotecontrol.telnet", 0) == 1) {
-        try {
-            int telnetport = pt.GetInteger("remotecontrol.telnetport", 0);
-            auto telnetrc = make_shared<RemoteControllerTelnet>(telnetport);
-            rcs.add_controller(telnetrc);
+        double GetReal(const std::string& key, double default_value) {
+            return m_pt.GetReal(resolve(key), default_value);
         }
-        catch (const std::exception &e) {
-            std::cerr << "Error: " << e.what() << "\n";
-            std::cerr << "       telnet remote control enabled, but no telnetport defined.\n";
-            throw std::runtime_error("Configuration error");
+
+    private:
+        std::string resolve(const std::string& key) const {
+            if (not m_prefix.empty() and m_pt.HasValue(m_prefix + key)) {
+                return m_prefix + key;
+            }
+            return key;
         }
+
+        INIReader& m_pt;
+        std::string m_prefix;
+};
+
+// The number of FFTW threads of the setting key, 1 if it is not set
+static unsigned parse_fft_threads(EnsembleConfig& pt, const std::string& key)
+{
+    const long threads = pt.GetInteger(key, 1);
+    if (threads < 1 or threads > 64) {
+        cerr << key << " must be between 1 and 64" << endl;
+        throw std::runtime_error("Configuration error");
     }
-#if defined(HAVE_ZEROMQ)
-    if (pt.GetInteger("remotecontrol.zmqctrl", 0) == 1) {
-        try {
-            std::string zmqCtrlEndpoint = pt.Get("remotecontrol.zmqctrlendpoint", "");
-            auto zmqrc = make_shared<RemoteControllerZmq>(zmqCtrlEndpoint);
-            rcs.add_controller(zmqrc);
-        }
-        catch (const std::exception &e) {
-            std::cerr << "Error: " << e.what() << "\n";
-            std::cerr << "       zmq remote control enabled, but no endpoint defined.\n";
-            throw std::runtime_error("Configuration error");
-        }
+    if (threads > 1 and not fftw_threads_supported()) {
+        cerr << key << " needs FFTW with threads support" << endl;
+        throw std::runtime_error("Configuration error");
     }
-#endif
+    return threads;
+}
 
+static void parse_ensemble(EnsembleConfig& pt, mod_settings_t& mod_settings)
+{
     // input params:
     if (pt.GetInteger("input.loop", 0) == 1) {
         mod_settings.loop = true;
@@ -136,49 +171,42 @@ static void parse_configfile(
 
     mod_settings.inputTransport = pt.Get("input.transport", "file");
 
-    mod_settings.edi_max_delay_ms = pt.GetReal("input.edi_max_delay", 0.0);
-
-    mod_settings.inputName = pt.Get("input.source", "/dev/stdin");
+    mod_settings.inputMmap = (pt.GetInteger("input.mmap", 0) == 1);
+    mod_settings.inputIndex = (pt.GetInteger("input.index", 0) == 1);
 
-    // log parameters:
-    const string events_endpoint = pt.Get("log.events_endpoint", "");
-    if (not events_endpoint.empty()) {
-#if defined(HAVE_ZEROMQ)
-        events.bind(events_endpoint);
-#else
-        throw std::runtime_error("Cannot configure events sender when compiled without zeromq");
-#endif
+    const long start_frame = pt.GetInteger("input.start_frame", 0);
+    if (start_frame < 0) {
+        cerr << "input.start_frame must not be negative" << endl;
+        throw std::runtime_error("Configuration error");
     }
+    mod_settings.inputStartFrame = start_frame;
 
-    if (pt.GetInteger("log.syslog", 0) == 1) {
-        etiLog.register_backend(make_shared<LogToSyslog>());
+    mod_settings.edi_max_delay_ms = pt.GetReal("input.edi_max_delay", 0.0);
+    mod_settings.edi_packet_ring_interface = pt.Get("input.edi_packet_ring", "");
+    mod_settings.edi_timestamps = pt.Get("input.edi_timestamps", "software");
+    if (mod_settings.edi_timestamps != "none" and
+            mod_settings.edi_timestamps != "software" and
+            mod_settings.edi_timestamps != "hardware") {
+        cerr << "input.edi_timestamps must be none, software or hardware" << endl;
+        throw std::runtime_error("Configuration error");
     }
 
-    if (pt.GetInteger("log.filelog", 0) == 1) {
-        std::string logfilename;
-        try {
-            logfilename = pt.Get("log.filename", "");
-        }
-        catch (const std::exception &e) {
-            std::cerr << "Error: " << e.what() << "\n";
-            std::cerr << "       Configuration enables file log, but does not specify log filename\n";
-            throw std::runtime_error("Configuration error");
-        }
-
-        etiLog.register_backend(make_shared<LogToFile>(logfilename));
-    }
+    mod_settings.inputName = pt.Get("input.source", "/dev/stdin");
 
-    std::string trace_filename = pt.Get("log.trace", "");
-    if (not trace_filename.empty()) {
-        etiLog.register_backend(make_shared<LogTracer>(trace_filename));
+    const int prefetch_frames = pt.GetInteger("input.prefetch_frames", 0);
+    if (prefetch_frames < 0 or prefetch_frames > 250) {
+        cerr << "input.prefetch_frames must be between 0 and 250" << endl;
+        throw std::runtime_error("Configuration error");
     }
-
-    mod_settings.showProcessTime = pt.GetInteger("log.show_process_time",
-            mod_settings.showProcessTime);
+    mod_settings.inputPrefetchFrames = prefetch_frames;
 
     // modulator parameters:
     const string fft_engine_setting = pt.Get("modulator.fft_engine", "fftw");
-    mod_settings.fftEngine = parse_fft_engine(fft_engine_setting);
+    mod_settings.fftEngine = parse_fft_engine(fft_engine_setting,
+            mod_settings.fftEngineAuto);
+    mod_settings.fftEngineAutoMinSnr = pt.GetReal(
+            "modulator.fft_engine_auto_min_snr",
+            mod_settings.fftEngineAutoMinSnr);
 
     const string gainMode_setting = pt.Get("modulator.gainmode", "var");
     mod_settings.gainMode = parse_gainmode(gainMode_setting);
@@ -189,15 +217,154 @@ static void parse_configfile(
     mod_settings.clockRate = pt.GetInteger("modulator.dac_clk_rate", (size_t)0);
     mod_settings.digitalgain = pt.GetReal("modulator.digital_gain",
             mod_settings.digitalgain);
+    mod_settings.gainClip = pt.GetInteger("modulator.gain_clip", 0) == 1;
+    mod_settings.fixedPointGainControl = pt.GetInteger(
+            "modulator.fixed_point_gaincontrol", 0) == 1;
+    mod_settings.standby = pt.GetInteger("modulator.standby", 0) == 1;
 
     mod_settings.outputRate = pt.GetInteger("modulator.rate", mod_settings.outputRate);
+
+    const string resampler_setting = pt.Get("modulator.resampler", "auto");
+    if (resampler_setting == "auto") {
+        mod_settings.resampler = ResamplerType::Auto;
+    }
+    else if (resampler_setting == "fft") {
+        mod_settings.resampler = ResamplerType::FFT;
+    }
+    else if (resampler_setting == "polyphase") {
+        mod_settings.resampler = ResamplerType::Polyphase;
+    }
+    else if (resampler_setting == "halfband") {
+        if (not HalfbandInterpolator::supports_ratio(2048000,
+                    mod_settings.outputRate)) {
+            cerr << "Modulator resampler halfband needs a rate of 2048000 "
+                "times a power of two" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+        mod_settings.resampler = ResamplerType::Halfband;
+    }
+    else {
+        cerr << "Modulator resampler setting '" << resampler_setting <<
+            "' not recognised." << endl;
+        throw std::runtime_error("Configuration error");
+    }
+    mod_settings.resamplerFftThreads = parse_fft_threads(pt,
+            "modulator.resampler_fft_threads");
+
+    mod_settings.frequencyShiftOffset = pt.GetReal("modulator.freq_shift",
+            mod_settings.frequencyShiftOffset);
+    mod_settings.frequencyShiftRealOutput =
+        pt.GetInteger("modulator.freq_shift_real_output", 0) == 1;
+    mod_settings.frequencyShift = mod_settings.frequencyShiftRealOutput or
+        not pt.Get("modulator.freq_shift", "").empty();
+    if (mod_settings.frequencyShift) {
+        const double half_bandwidth = 768000;
+        const double offset = std::fabs(mod_settings.frequencyShiftOffset);
+        if (offset + half_bandwidth > mod_settings.outputRate / 2.0) {
+            cerr << "modulator.freq_shift moves the signal out of the "
+                "bandwidth of the output rate" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+        if (mod_settings.frequencyShiftRealOutput and
+                offset <= half_bandwidth) {
+            cerr << "modulator.freq_shift_real_output needs a freq_shift "
+                "larger than " << half_bandwidth << " Hz" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+        if (mod_settings.fftEngine != FFTEngine::FFTW) {
+            cerr << "modulator.freq_shift needs the fftw fft_engine" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+    }
     mod_settings.ofdmWindowOverlap = pt.GetInteger("modulator.ofdmwindowing",
             mod_settings.ofdmWindowOverlap);
+    mod_settings.preemphasisFilename = pt.Get("modulator.preemphasis_file", "");
+    mod_settings.flowgraphNumThreads = pt.GetInteger("modulator.flowgraph_threads",
+            mod_settings.flowgraphNumThreads);
+
+    std::stringstream pipeline_stages(pt.Get("modulator.pipeline_stages", ""));
+    mod_settings.pipelineStages.clear();
+    for (std::string cut; std::getline(pipeline_stages, cut, ',');) {
+        if (cut != "mapping" and cut != "ofdm" and cut != "output") {
+            cerr << "modulator.pipeline_stages: unknown cut '" << cut << "'" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+        mod_settings.pipelineStages.push_back(cut);
+    }
+
+    const long default_pipeline_depth = pt.GetInteger("modulator.pipeline_depth", 1);
+    for (const std::string block : {"gaincontrol", "firfilter", "memlesspoly", "memorypoly"}) {
+        const std::string key = "modulator." + block + "_pipeline_depth";
+        const long depth = pt.GetInteger(key, default_pipeline_depth);
+        if (depth < 1 or depth > (long)PipelinedModCodec::max_pipeline_depth) {
+            cerr << key << " must be between 1 and " <<
+                PipelinedModCodec::max_pipeline_depth << endl;
+            throw std::runtime_error("Configuration error");
+        }
+        mod_settings.pipelineDepth[block] = depth;
+    }
+    mod_settings.batchFrames = pt.GetInteger("modulator.batch_frames",
+            mod_settings.batchFrames);
+    if (mod_settings.batchFrames == 0) {
+        cerr << "modulator.batch_frames must be at least 1" << endl;
+        throw std::runtime_error("Configuration error");
+    }
+    mod_settings.batchedFft =
+        pt.GetInteger("modulator.batched_fft", 0) == 1;
+    mod_settings.ofdmNumThreads = pt.GetInteger("modulator.ofdm_num_threads",
+            mod_settings.ofdmNumThreads);
+    mod_settings.ofdmCacheStaticSymbols =
+        pt.GetInteger("modulator.ofdm_cache_static_symbols", 0) == 1;
+    if (mod_settings.lowMemory and mod_settings.batchedFft) {
+        std::cerr << "Warning: modulator.batched_fft is disabled by "
+            "general.low_memory\n";
+        mod_settings.batchedFft = false;
+    }
+    if (mod_settings.lowMemory and mod_settings.ofdmCacheStaticSymbols) {
+        std::cerr << "Warning: modulator.ofdm_cache_static_symbols is "
+            "disabled by general.low_memory\n";
+        mod_settings.ofdmCacheStaticSymbols = false;
+    }
+    mod_settings.planarSamples =
+        pt.GetInteger("modulator.planar_samples", 0) == 1;
+    try {
+        mod_settings.halfSamples = half_float::parse_format(
+                pt.Get("modulator.half_samples", "none"));
+    }
+    catch (const std::invalid_argument& e) {
+        cerr << "modulator.half_samples must be none, fp16 or bf16" << endl;
+        throw std::runtime_error("Configuration error");
+    }
+    mod_settings.streamSymbols = pt.GetInteger("modulator.stream_symbols",
+            mod_settings.streamSymbols);
+    mod_settings.fusedSubchannelEncoder =
+        pt.GetInteger("modulator.fused_subchannel_encoder", 0) == 1;
+    mod_settings.encoderCacheSize = pt.GetInteger("modulator.encoder_cache_size",
+            mod_settings.encoderCacheSize);
+    if (mod_settings.encoderCacheSize > 0 and
+            not mod_settings.fusedSubchannelEncoder) {
+        cerr << "modulator.encoder_cache_size requires "
+            "modulator.fused_subchannel_encoder" << endl;
+        throw std::runtime_error("Configuration error");
+    }
 
     // FIR Filter parameters:
     if (pt.GetInteger("firfilter.enabled", 0) == 1) {
         mod_settings.filterTapsFilename =
             pt.Get("firfilter.filtertapsfile", "default");
+
+        const int fft_min_taps = pt.GetInteger("firfilter.fft_min_taps",
+                mod_settings.filterFftMinTaps);
+        if (fft_min_taps < 0) {
+            cerr << "firfilter.fft_min_taps must not be negative" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+        mod_settings.filterFftMinTaps = fft_min_taps;
+        mod_settings.filterFftThreads = parse_fft_threads(pt,
+                "firfilter.fft_threads");
+        mod_settings.filterNumThreads =
+            pt.GetInteger("firfilter.num_threads", 0);
+        mod_settings.filterBypass = pt.GetInteger("firfilter.bypass", 0) == 1;
     }
 
     // Poly coefficients:
@@ -207,6 +374,67 @@ static void parse_configfile(
 
         mod_settings.polyNumThreads =
             pt.GetInteger("poly.num_threads", 0);
+        mod_settings.polyBypass = pt.GetInteger("poly.bypass", 0) == 1;
+
+        const long poly_rate = pt.GetInteger("poly.rate", 0);
+        if (poly_rate != 0 and (poly_rate < 2048000 or
+                    poly_rate > (long)mod_settings.outputRate)) {
+            cerr << "poly.rate must be between 2048000 and the modulator "
+                "rate" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+        if (poly_rate > 2048000 and
+                mod_settings.resampler == ResamplerType::Halfband and
+                not HalfbandInterpolator::supports_ratio(2048000, poly_rate)) {
+            cerr << "poly.rate with the halfband resampler must be 2048000 "
+                "times a power of two" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+        mod_settings.polyRate = poly_rate;
+    }
+
+    // In-process estimation of the poly coefficients, the SDR output
+    // gets the settings once it is configured.
+    Output::DPDEngineConfig dpd_engine_config;
+    dpd_engine_config.enabled = pt.GetInteger("poly.engine", 0) == 1;
+    if (dpd_engine_config.enabled) {
+        if (mod_settings.polyCoefFilename.empty()) {
+            cerr << "poly.engine needs poly.enabled" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+
+        dpd_engine_config.model = pt.Get("poly.engine_model", dpd_engine_config.model);
+        if (dpd_engine_config.model != "poly" and dpd_engine_config.model != "lut") {
+            cerr << "poly.engine_model must be poly or lut" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+
+        const long lut_entries = pt.GetInteger("poly.engine_lut_entries",
+                dpd_engine_config.lutEntries);
+        const long num_samples = pt.GetInteger("poly.engine_num_samples",
+                dpd_engine_config.numSamples);
+        const double learning_rate = pt.GetReal("poly.engine_learning_rate",
+                dpd_engine_config.learningRate);
+        const long interval = pt.GetInteger("poly.engine_interval", 0);
+        if (lut_entries < 2 or lut_entries > 65536 or num_samples < 1024 or
+                not (learning_rate > 0 and learning_rate <= 1) or interval < 0) {
+            cerr << "poly.engine settings invalid, see example.ini" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+        dpd_engine_config.lutEntries = lut_entries;
+        dpd_engine_config.numSamples = num_samples;
+        dpd_engine_config.learningRate = learning_rate;
+        dpd_engine_config.interval = interval;
+    }
+
+    // Memory polynomial coefficients:
+    if (pt.GetInteger("memorypoly.enabled", 0) == 1) {
+        mod_settings.memoryPolyCoefFilename =
+            pt.Get("memorypoly.coeffile", "dpd/memorypoly.coef");
+
+        mod_settings.memoryPolyNumThreads =
+            pt.GetInteger("memorypoly.num_threads", 0);
+        mod_settings.memoryPolyBypass = pt.GetInteger("memorypoly.bypass", 0) == 1;
     }
 
     // Crest factor reduction
@@ -214,6 +442,111 @@ static void parse_configfile(
         mod_settings.enableCfr = true;
         mod_settings.cfrClip = pt.GetReal("cfr.clip", 0.0);
         mod_settings.cfrErrorClip = pt.GetReal("cfr.error_clip", 0.0);
+        mod_settings.cfrTargetPapr = pt.GetReal("cfr.target_papr", 0.0);
+
+        const long iterations = pt.GetInteger("cfr.iterations", 1);
+        if (iterations < 1) {
+            cerr << "cfr.iterations must be at least 1" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+        mod_settings.cfrIterations = iterations;
+
+        mod_settings.cfrMethod = pt.Get("cfr.method", "errorclip");
+        if (mod_settings.cfrMethod != "errorclip" and
+                mod_settings.cfrMethod != "ace") {
+            cerr << "cfr.method must be errorclip or ace" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+
+        mod_settings.cfrAceGain = pt.GetReal("cfr.ace_gain", 4.0);
+        if (mod_settings.cfrAceGain < 1) {
+            cerr << "cfr.ace_gain must be at least 1" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+
+        if (mod_settings.cfrTargetPapr < 0) {
+            cerr << "cfr.target_papr must not be negative" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+
+        const long stats_interval = pt.GetInteger("cfr.stats_interval", 1);
+        if (stats_interval < 1) {
+            cerr << "cfr.stats_interval must be at least 1" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+        mod_settings.cfrStatsInterval = stats_interval;
+
+        mod_settings.cfrFixedPointPapr = pt.GetReal("cfr.fixed_point_papr",
+                mod_settings.cfrFixedPointPapr);
+        if (mod_settings.cfrFixedPointPapr <= 0) {
+            cerr << "cfr.fixed_point_papr must be positive" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+    }
+
+    // Peak cancellation
+    if (pt.GetInteger("peakcancel.enabled", 0) == 1) {
+        mod_settings.enablePeakCancel = true;
+        mod_settings.peakCancelThreshold =
+            pt.GetReal("peakcancel.threshold", 7.0);
+        if (mod_settings.peakCancelThreshold <= 0) {
+            cerr << "peakcancel.threshold must be positive" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+
+        const long iterations = pt.GetInteger("peakcancel.iterations", 3);
+        if (iterations < 1) {
+            cerr << "peakcancel.iterations must be at least 1" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+        mod_settings.peakCancelIterations = iterations;
+    }
+
+    if (pt.GetInteger("rtbudget.enabled", 0) == 1) {
+        mod_settings.enableRtBudget = true;
+        mod_settings.rtBudgetHigh = pt.GetReal("rtbudget.high", 0.9);
+        mod_settings.rtBudgetLow = pt.GetReal("rtbudget.low", 0.6);
+        if (not (mod_settings.rtBudgetLow > 0 and
+                    mod_settings.rtBudgetLow < mod_settings.rtBudgetHigh)) {
+            cerr << "rtbudget.low must be positive and below rtbudget.high" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+
+        const long window = pt.GetInteger("rtbudget.window", 10);
+        const long recovery = pt.GetInteger("rtbudget.recovery", 250);
+        if (window < 1 or recovery < 1) {
+            cerr << "rtbudget.window and rtbudget.recovery must be at least 1" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+        mod_settings.rtBudgetWindow = window;
+        mod_settings.rtBudgetRecovery = recovery;
+
+        std::stringstream steps(pt.Get("rtbudget.steps", "mer,dpd,cfr"));
+        mod_settings.rtBudgetSteps.clear();
+        for (std::string step; std::getline(steps, step, ',');) {
+            if (step != "mer" and step != "dpd" and step != "cfr") {
+                cerr << "rtbudget.steps: unknown step '" << step << "'" << endl;
+                throw std::runtime_error("Configuration error");
+            }
+            mod_settings.rtBudgetSteps.push_back(step);
+        }
+    }
+
+    if (pt.GetInteger("autotune.enabled", 0) == 1) {
+        mod_settings.enableAutoTune = true;
+        mod_settings.autoTuneDuration = pt.GetReal("autotune.duration",
+                mod_settings.autoTuneDuration);
+        mod_settings.autoTuneHeadroom = pt.GetReal("autotune.headroom",
+                mod_settings.autoTuneHeadroom);
+        if (mod_settings.autoTuneDuration <= 0) {
+            cerr << "autotune.duration must be positive" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+        if (mod_settings.autoTuneHeadroom < 0 or
+                mod_settings.autoTuneHeadroom >= 1) {
+            cerr << "autotune.headroom must be between 0 and 1" << endl;
+            throw std::runtime_error("Configuration error");
+        }
     }
 
     // Output options
@@ -237,6 +570,38 @@ static void parse_configfile(
 
         mod_settings.fileOutputFormat = pt.Get("fileoutput.format",
                 mod_settings.fileOutputFormat);
+
+        const int async_buffer_mb = pt.GetInteger("fileoutput.async_buffer_mb", 0);
+        if (async_buffer_mb < 0) {
+            std::cerr << "fileoutput.async_buffer_mb must not be negative" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+        mod_settings.fileOutputAsyncBufferSize = (size_t)async_buffer_mb * 1024 * 1024;
+        mod_settings.fileOutputDirectIO =
+                (pt.GetInteger("fileoutput.direct_io", 0) == 1);
+
+        mod_settings.fileOutputOffline =
+                (pt.GetInteger("fileoutput.offline", 0) == 1);
+        const int chunk_frames = pt.GetInteger("fileoutput.offline_chunk_frames",
+                mod_settings.offlineChunkFrames);
+        if (chunk_frames <= 0) {
+            std::cerr << "fileoutput.offline_chunk_frames must be positive" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+        mod_settings.offlineChunkFrames = chunk_frames;
+
+        if (mod_settings.fileOutputOffline) {
+            if (mod_settings.inputTransport != "file" or mod_settings.loop) {
+                std::cerr << "Error:\n";
+                std::cerr << "       Offline rendering needs an input file without loop\n";
+                throw std::runtime_error("Configuration error");
+            }
+            if (mod_settings.fileOutputShowMetadata) {
+                std::cerr << "Error:\n";
+                std::cerr << "       Offline rendering cannot show the metadata\n";
+                throw std::runtime_error("Configuration error");
+            }
+        }
     }
 #if defined(HAVE_OUTPUT_UHD)
     else if (output_selected == "uhd") {
@@ -308,6 +673,39 @@ static void parse_configfile(
         sdr_device_config.maxGPSHoldoverTime = pt.GetInteger("uhdoutput.max_gps_holdover_time", 0);
 
         sdr_device_config.dpdFeedbackServerPort = pt.GetInteger("uhdoutput.dpd_port", 0);
+        sdr_device_config.bulkTransmit = pt.GetInteger("uhdoutput.bulk_transmit", 0) == 1;
+        sdr_device_config.rxContinuous = pt.GetInteger("uhdoutput.rx_continuous", 0) == 1;
+        sdr_device_config.rxRingDuration = pt.GetReal("uhdoutput.rx_ring_duration", 1.0);
+        if (sdr_device_config.rxRingDuration <= 0) {
+            std::cerr << "       UHD output: rx_ring_duration must be positive.\n";
+            throw std::runtime_error("Configuration error");
+        }
+
+        const std::string format = pt.Get("uhdoutput.format", "fc32");
+        if (format == "sc16") {
+            sdr_device_config.sampleFormat = "s16";
+        }
+        else if (format != "fc32") {
+            std::cerr << "       UHD output: format '" << format <<
+                "' not supported, use fc32 or sc16.\n";
+            throw std::runtime_error("Configuration error");
+        }
+
+        sdr_device_config.otwFormat = pt.Get("uhdoutput.otw_format", "sc16");
+        if (sdr_device_config.otwFormat != "sc16" and
+                sdr_device_config.otwFormat != "sc12" and
+                sdr_device_config.otwFormat != "sc8") {
+            std::cerr << "       UHD output: otw_format '" <<
+                sdr_device_config.otwFormat <<
+                "' not supported, use sc16, sc12 or sc8.\n";
+            throw std::runtime_error("Configuration error");
+        }
+
+        if (not sdr_device_config.sampleFormat.empty() and
+                sdr_device_config.dpdFeedbackServerPort != 0) {
+            std::cerr << "       UHD output: the dpd_port needs format fc32.\n";
+            throw std::runtime_error("Configuration error");
+        }
 
         mod_settings.sdr_device_config = sdr_device_config;
         mod_settings.useUHDOutput = true;
@@ -341,6 +739,32 @@ static void parse_configfile(
         }
 
         outputsoapy_conf.dpdFeedbackServerPort = pt.GetInteger("soapyoutput.dpd_port", 0);
+        outputsoapy_conf.bulkTransmit = pt.GetInteger("soapyoutput.bulk_transmit", 0) == 1;
+        outputsoapy_conf.rxContinuous = pt.GetInteger("soapyoutput.rx_continuous", 0) == 1;
+        outputsoapy_conf.rxRingDuration = pt.GetReal("soapyoutput.rx_ring_duration", 1.0);
+        if (outputsoapy_conf.rxRingDuration <= 0) {
+            std::cerr << "       soapy output: rx_ring_duration must be positive.\n";
+            throw std::runtime_error("Configuration error");
+        }
+
+        const std::string format = pt.Get("soapyoutput.format", "cf32");
+        if (format == "cs16") {
+            outputsoapy_conf.sampleFormat = "s16";
+        }
+        else if (format == "cs12") {
+            outputsoapy_conf.sampleFormat = "sc12";
+        }
+        else if (format != "cf32") {
+            std::cerr << "       soapy output: format '" << format <<
+                "' not supported, use cf32, cs16 or cs12.\n";
+            throw std::runtime_error("Configuration error");
+        }
+
+        if (not outputsoapy_conf.sampleFormat.empty() and
+                outputsoapy_conf.dpdFeedbackServerPort != 0) {
+            std::cerr << "       soapy output: the dpd_port needs format cf32.\n";
+            throw std::runtime_error("Configuration error");
+        }
 
         mod_settings.useSoapyOutput = true;
     }
@@ -399,6 +823,29 @@ static void parse_configfile(
 
         outputlime_conf.dpdFeedbackServerPort = pt.GetInteger("limeoutput.dpd_port", 0);
 
+        outputlime_conf.limeFifoFrames = pt.GetInteger("limeoutput.fifo_frames", 10);
+        outputlime_conf.limeThroughputVsLatency =
+            pt.GetReal("limeoutput.throughput_vs_latency", 2.0);
+        if (outputlime_conf.limeFifoFrames == 0 or
+                outputlime_conf.limeThroughputVsLatency < 0) {
+            std::cerr << "       Lime output: fifo_frames must be at least 1, "
+                "throughput_vs_latency cannot be negative.\n";
+            throw std::runtime_error("Configuration error");
+        }
+
+        const std::string lime_format = pt.Get("limeoutput.format", "i16");
+        if (lime_format == "i16") {
+            outputlime_conf.otwFormat = "sc16";
+        }
+        else if (lime_format == "i12") {
+            outputlime_conf.otwFormat = "sc12";
+        }
+        else {
+            std::cerr << "       Lime output: format '" << lime_format <<
+                "' not supported, use i16 or i12.\n";
+            throw std::runtime_error("Configuration error");
+        }
+
         mod_settings.useLimeOutput = true;
     }
 #endif // defined(HAVE_LIMESDR)
@@ -428,6 +875,31 @@ static void parse_configfile(
 
         outputbladerf_conf.dpdFeedbackServerPort = pt.GetInteger("bladerfoutput.dpd_port", 0);
 
+        outputbladerf_conf.bladerfNumBuffers =
+            pt.GetInteger("bladerfoutput.num_buffers", 16);
+        outputbladerf_conf.bladerfBufferSize =
+            pt.GetInteger("bladerfoutput.buffer_size", 8192);
+        outputbladerf_conf.bladerfNumTransfers =
+            pt.GetInteger("bladerfoutput.num_transfers", 8);
+        outputbladerf_conf.bladerfTimeoutMs =
+            pt.GetInteger("bladerfoutput.timeout_ms", 3500);
+        outputbladerf_conf.bladerfMetadata =
+            pt.GetInteger("bladerfoutput.metadata", 0) != 0;
+
+        if (outputbladerf_conf.bladerfBufferSize == 0 or
+                outputbladerf_conf.bladerfBufferSize % 1024 != 0) {
+            std::cerr << "       BladeRF output: buffer_size must be a "
+                "multiple of 1024 samples.\n";
+            throw std::runtime_error("Configuration error");
+        }
+        if (outputbladerf_conf.bladerfNumTransfers == 0 or
+                outputbladerf_conf.bladerfNumTransfers >=
+                outputbladerf_conf.bladerfNumBuffers) {
+            std::cerr << "       BladeRF output: num_transfers must be at "
+                "least 1 and smaller than num_buffers.\n";
+            throw std::runtime_error("Configuration error");
+        }
+
         mod_settings.useBladeRFOutput = true;
     }
 #endif // defined(HAVE_BLADERF)
@@ -436,49 +908,849 @@ static void parse_configfile(
     else if (output_selected == "zmq") {
         mod_settings.outputName = pt.Get("zmqoutput.listen", "");
         mod_settings.zmqOutputSocketType = pt.Get("zmqoutput.socket_type", "");
+        mod_settings.zmqOutputSndHwm = pt.GetInteger("zmqoutput.sndhwm", 0);
+        mod_settings.zmqOutputHeader = pt.GetInteger("zmqoutput.header", 0) == 1;
         mod_settings.useZeroMQOutput = true;
     }
 #endif
-    else {
-        std::cerr << "Error: Invalid output defined.\n";
-        throw std::runtime_error("Configuration error");
-    }
+    else if (output_selected == "vita49") {
+        // outputName is the destination host
+        mod_settings.outputName = pt.Get("vita49output.destination", "");
+        mod_settings.vita49OutputPort = pt.GetInteger("vita49output.port", 0);
+        if (mod_settings.outputName.empty() or
+                mod_settings.vita49OutputPort <= 0 or
+                mod_settings.vita49OutputPort > 65535) {
+            std::cerr << "       vita49 output: destination and port required.\n";
+            throw std::runtime_error("Configuration error");
+        }
 
+        mod_settings.vita49OutputFormat = pt.Get("vita49output.format",
+                mod_settings.vita49OutputFormat);
+        if (mod_settings.vita49OutputFormat != "s16" and
+                mod_settings.vita49OutputFormat != "complexf") {
+            std::cerr << "       vita49 output: format '" <<
+                mod_settings.vita49OutputFormat <<
+                "' not supported, use s16 or complexf.\n";
+            throw std::runtime_error("Configuration error");
+        }
+        if (mod_settings.vita49OutputFormat != "s16" and
+                mod_settings.fftEngine != FFTEngine::FFTW) {
+            std::cerr << "       vita49 output: the fixed point fft engines "
+                "need format s16.\n";
+            throw std::runtime_error("Configuration error");
+        }
 
-#if defined(HAVE_OUTPUT_UHD) || defined(HAVE_DEXTER)
-    mod_settings.sdr_device_config.enableSync = (pt.GetInteger("delaymanagement.synchronous", 0) == 1);
-    mod_settings.sdr_device_config.muteNoTimestamps = (pt.GetInteger("delaymanagement.mutenotimestamps", 0) == 1);
-    if (mod_settings.sdr_device_config.enableSync) {
-        std::string delay_mgmt = pt.Get("delaymanagement.management", "");
-        std::string fixedoffset = pt.Get("delaymanagement.fixedoffset", "");
-        std::string offset_filename = pt.Get("delaymanagement.dynamicoffsetfile", "");
+        mod_settings.vita49OutputStreamId = pt.GetInteger("vita49output.stream_id", 0);
 
-        if (not(delay_mgmt.empty() and fixedoffset.empty() and offset_filename.empty())) {
-            std::cerr << "Warning: you are using the old config syntax for the offset management.\n";
-            std::cerr << "         Please see the example.ini configuration for the new settings.\n";
+        const long packet_size = pt.GetInteger("vita49output.max_packet_size",
+                mod_settings.vita49OutputMaxPacketSize);
+        if (packet_size < 64 or packet_size > 65507) {
+            std::cerr << "       vita49 output: max_packet_size must be between "
+                "64 and 65507.\n";
+            throw std::runtime_error("Configuration error");
         }
+        mod_settings.vita49OutputMaxPacketSize = packet_size;
 
-        try {
-            mod_settings.tist_offset_s = pt.GetReal("delaymanagement.offset", 0.0);
+        mod_settings.useVita49Output = true;
+    }
+    else if (output_selected == "simulated") {
+        auto& outputsim_conf = mod_settings.sdr_device_config;
+        outputsim_conf.txgain = pt.GetReal("simulatedoutput.txgain", 0.0);
+        outputsim_conf.rxgain = pt.GetReal("simulatedoutput.rxgain", 0.0);
+        outputsim_conf.frequency = pt.GetReal("simulatedoutput.frequency", 0);
+        std::string chan = pt.Get("simulatedoutput.channel", "");
+        outputsim_conf.dabMode = mod_settings.dabMode;
+
+        if (outputsim_conf.frequency == 0 && chan != "") {
+            outputsim_conf.frequency = parse_channel(chan);
         }
-        catch (const std::exception &e) {
-            std::cerr << "Error: delaymanagement: synchronous is enabled, but no offset defined!\n";
+        else if (outputsim_conf.frequency != 0 && chan != "") {
+            std::cerr << "       simulated output: cannot define both frequency and channel.\n";
             throw std::runtime_error("Configuration error");
         }
-    }
-#endif
-
+
+        const long buffer_ms = pt.GetInteger("simulatedoutput.buffer_ms",
+                outputsim_conf.simulatedBufferMs);
+        if (buffer_ms < 0 or buffer_ms > 10000) {
+            std::cerr << "       simulated output: buffer_ms must be between "
+                "0 and 10000.\n";
+            throw std::runtime_error("Configuration error");
+        }
+        outputsim_conf.simulatedBufferMs = buffer_ms;
+
+        outputsim_conf.dpdFeedbackServerPort = pt.GetInteger("simulatedoutput.dpd_port", 0);
+        outputsim_conf.simulatedLoopback = pt.GetInteger("simulatedoutput.loopback",
+                outputsim_conf.dpdFeedbackServerPort != 0 ? 1 : 0) == 1;
+        outputsim_conf.rxRingDuration = pt.GetReal("simulatedoutput.rx_ring_duration", 1.0);
+        if (outputsim_conf.rxRingDuration <= 0) {
+            std::cerr << "       simulated output: rx_ring_duration must be positive.\n";
+            throw std::runtime_error("Configuration error");
+        }
+
+        outputsim_conf.simulatedPaSaturation = pt.GetReal("simulatedoutput.pa_saturation",
+                outputsim_conf.simulatedPaSaturation);
+        outputsim_conf.simulatedPaSmoothness = pt.GetReal("simulatedoutput.pa_smoothness",
+                outputsim_conf.simulatedPaSmoothness);
+        outputsim_conf.simulatedPaAmPm = pt.GetReal("simulatedoutput.pa_am_pm",
+                outputsim_conf.simulatedPaAmPm);
+        if (outputsim_conf.simulatedPaSaturation <= 0 or
+                outputsim_conf.simulatedPaSmoothness <= 0) {
+            std::cerr << "       simulated output: pa_saturation and "
+                "pa_smoothness must be positive.\n";
+            throw std::runtime_error("Configuration error");
+        }
+
+        const std::string format = pt.Get("simulatedoutput.format", "fc32");
+        if (format == "sc16") {
+            outputsim_conf.sampleFormat = "s16";
+        }
+        else if (format != "fc32") {
+            std::cerr << "       simulated output: format '" << format <<
+                "' not supported, use fc32 or sc16.\n";
+            throw std::runtime_error("Configuration error");
+        }
+
+        if (not outputsim_conf.sampleFormat.empty() and
+                outputsim_conf.dpdFeedbackServerPort != 0) {
+            std::cerr << "       simulated output: the dpd_port needs format fc32.\n";
+            throw std::runtime_error("Configuration error");
+        }
+
+        mod_settings.useSimulatedOutput = true;
+    }
+    else {
+        std::cerr << "Error: Invalid output defined.\n";
+        throw std::runtime_error("Configuration error");
+    }
+
+
+#if defined(HAVE_OUTPUT_UHD) || defined(HAVE_DEXTER)
+    mod_settings.sdr_device_config.enableSync = (pt.GetInteger("delaymanagement.synchronous", 0) == 1);
+    mod_settings.sdr_device_config.muteNoTimestamps = (pt.GetInteger("delaymanagement.mutenotimestamps", 0) == 1);
+    if (mod_settings.sdr_device_config.enableSync) {
+        std::string delay_mgmt = pt.Get("delaymanagement.management", "");
+        std::string fixedoffset = pt.Get("delaymanagement.fixedoffset", "");
+        std::string offset_filename = pt.Get("delaymanagement.dynamicoffsetfile", "");
+
+        if (not(delay_mgmt.empty() and fixedoffset.empty() and offset_filename.empty())) {
+            std::cerr << "Warning: you are using the old config syntax for the offset management.\n";
+            std::cerr << "         Please see the example.ini configuration for the new settings.\n";
+        }
+
+        try {
+            mod_settings.tist_offset_s = pt.GetReal("delaymanagement.offset", 0.0);
+        }
+        catch (const std::exception &e) {
+            std::cerr << "Error: delaymanagement: synchronous is enabled, but no offset defined!\n";
+            throw std::runtime_error("Configuration error");
+        }
+
+        mod_settings.sdr_device_config.tistGuard =
+            pt.GetReal("delaymanagement.offset_guard", 0.05);
+        mod_settings.jitLead = pt.GetReal("delaymanagement.just_in_time", 0.0);
+        if (mod_settings.sdr_device_config.tistGuard < 0 or
+                mod_settings.jitLead < 0) {
+            std::cerr << "Error: delaymanagement: offset_guard and just_in_time must not be negative\n";
+            throw std::runtime_error("Configuration error");
+        }
+    }
+#endif
+
+    // Frame queue in front of the SDR devices
+    const long queue_depth = pt.GetInteger("output.queue_depth",
+            mod_settings.lowMemory ? low_memory_queue_depth : 0);
+    const long queue_prefill = pt.GetInteger("output.queue_prefill", 0);
+    if (queue_depth < 0 or queue_depth > 250) {
+        cerr << "output.queue_depth must be between 0 and 250" << endl;
+        throw std::runtime_error("Configuration error");
+    }
+    if (queue_prefill < 0 or (queue_depth > 0 and queue_prefill > queue_depth)) {
+        cerr << "output.queue_prefill must be between 0 and queue_depth" << endl;
+        throw std::runtime_error("Configuration error");
+    }
+    mod_settings.sdr_device_config.queueDepth = queue_depth;
+    mod_settings.sdr_device_config.queuePrefill = queue_prefill;
+    mod_settings.sdr_device_config.queueAdaptive =
+        (pt.GetInteger("output.queue_adaptive", 0) == 1);
+
+    const string underrun_policy = pt.Get("output.underrun_policy", "restart");
+    if (underrun_policy == "filler") {
+        mod_settings.sdr_device_config.underrunFiller = true;
+    }
+    else if (underrun_policy != "restart") {
+        cerr << "output.underrun_policy must be restart or filler" << endl;
+        throw std::runtime_error("Configuration error");
+    }
+
+    // Additional outputs
+    mod_settings.teeOutputs.clear();
+    for (const std::string type : {"file", "zmq", "record"}) {
+        const std::string key = "output.tee_" + type;
+        tee_output_config_t tee;
+        tee.type = type;
+        tee.target = pt.Get(key, "");
+        if (tee.target.empty()) {
+            continue;
+        }
+#if !defined(HAVE_ZEROMQ)
+        if (type == "zmq") {
+            cerr << key << " needs ZeroMQ support" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+#endif
+        if (mod_settings.fileOutputOffline) {
+            cerr << key << " is not supported with offline rendering" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+
+        const long queue_size = pt.GetInteger(key + "_queue", tee.queueSize);
+        if (queue_size < 1 or queue_size > 250) {
+            cerr << key << "_queue must be between 1 and 250" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+        tee.queueSize = queue_size;
+
+        tee.dropPolicy = pt.Get(key + "_drop", tee.dropPolicy);
+        if (tee.dropPolicy != "oldest" and tee.dropPolicy != "newest" and
+                tee.dropPolicy != "block") {
+            cerr << key << "_drop must be oldest, newest or block" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+
+        if (type == "record") {
+            if (tee.dropPolicy == "block") {
+                cerr << key << "_drop=block would let the recording delay "
+                    "the modulator" << endl;
+                throw std::runtime_error("Configuration error");
+            }
+
+#if defined(HAVE_ZSTD)
+            tee.recordCodec = "zstd";
+#elif defined(HAVE_LZ4)
+            tee.recordCodec = "lz4";
+#else
+            tee.recordCodec = "none";
+#endif
+            tee.recordCodec = pt.Get(key + "_codec", tee.recordCodec);
+            try {
+                OutputRecorder::parse_codec(tee.recordCodec);
+            }
+            catch (const std::runtime_error& e) {
+                cerr << key << "_codec: " << e.what() << endl;
+                throw std::runtime_error("Configuration error");
+            }
+
+            tee.recordLevel = pt.GetInteger(key + "_level", tee.recordLevel);
+            const long chunk_frames = pt.GetInteger(key + "_chunk_frames",
+                    tee.recordChunkFrames);
+            if (chunk_frames < 1 or chunk_frames > 1000) {
+                cerr << key << "_chunk_frames must be between 1 and 1000" << endl;
+                throw std::runtime_error("Configuration error");
+            }
+            tee.recordChunkFrames = chunk_frames;
+        }
+        mod_settings.teeOutputs.push_back(tee);
+    }
+
+    mod_settings.carousel = (pt.GetInteger("output.carousel", 0) == 1);
+    mod_settings.carouselFile = pt.Get("output.carousel_file", "");
+    if (mod_settings.carousel) {
+        if (mod_settings.inputTransport != "file" or not mod_settings.loop) {
+            cerr << "output.carousel needs an input file with loop=1" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+        if (mod_settings.sdr_device_config.enableSync) {
+            cerr << "output.carousel does not support synchronous "
+                "transmission, the timestamps of the file repeat" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+    }
+
+    if (dpd_engine_config.enabled and
+            mod_settings.sdr_device_config.dpdFeedbackServerPort == 0) {
+        cerr << "poly.engine needs the dpd_port of an SDR output" << endl;
+        throw std::runtime_error("Configuration error");
+    }
+    mod_settings.sdr_device_config.dpdEngine = dpd_engine_config;
+
+    const long monitor_interval = pt.GetInteger("output.feedback_monitor_interval", 0);
+    const long monitor_num_samples = pt.GetInteger("output.feedback_monitor_num_samples",
+            mod_settings.sdr_device_config.feedbackMonitorNumSamples);
+    if (monitor_interval < 0) {
+        cerr << "output.feedback_monitor_interval cannot be negative" << endl;
+        throw std::runtime_error("Configuration error");
+    }
+    else if (monitor_interval > 0) {
+        if (mod_settings.sdr_device_config.dpdFeedbackServerPort == 0) {
+            cerr << "output.feedback_monitor_interval needs the dpd_port of an SDR output" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+        if (monitor_num_samples < 4096 or monitor_num_samples > 2048000) {
+            cerr << "output.feedback_monitor_num_samples must be between 4096 and 2048000" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+    }
+    mod_settings.sdr_device_config.feedbackMonitorInterval = monitor_interval;
+    mod_settings.sdr_device_config.feedbackMonitorNumSamples = monitor_num_samples;
+
+    const long probe_interval = pt.GetInteger("output.latency_probe_interval", 0);
+    if (probe_interval < 0) {
+        cerr << "output.latency_probe_interval cannot be negative" << endl;
+        throw std::runtime_error("Configuration error");
+    }
+    else if (probe_interval > 0 and
+            mod_settings.sdr_device_config.dpdFeedbackServerPort == 0) {
+        cerr << "output.latency_probe_interval needs the dpd_port of an SDR output" << endl;
+        throw std::runtime_error("Configuration error");
+    }
+    mod_settings.sdr_device_config.latencyProbeInterval = probe_interval;
+    mod_settings.sdr_device_config.dpdFeedbackServerAddress =
+        pt.Get("output.dpd_listen_address",
+                mod_settings.sdr_device_config.dpdFeedbackServerAddress);
+
+    // Several TX channels of the same SDR device
+    const long num_tx_channels = pt.GetInteger("txchannels.count", 1);
+    if (num_tx_channels < 1) {
+        cerr << "txchannels.count must be at least 1" << endl;
+        throw std::runtime_error("Configuration error");
+    }
+    else if (num_tx_channels > 1) {
+        if (not (mod_settings.useUHDOutput or mod_settings.useSoapyOutput)) {
+            cerr << "txchannels.count needs the uhd or soapysdr output" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+
+        if (mod_settings.fftEngine != FFTEngine::FFTW) {
+            cerr << "txchannels.count needs fft_engine fftw" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+
+        if (not mod_settings.polyCoefFilename.empty() or
+                not mod_settings.memoryPolyCoefFilename.empty()) {
+            cerr << "With several TX channels, the predistortion is "
+                "configured in [txchannels] instead of [poly] and "
+                "[memorypoly]" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+
+        mod_settings.txChannelsSharedFrontEnd =
+            pt.GetInteger("txchannels.shared_front_end", 0) == 1;
+
+        size_t num_with_poly = 0;
+        for (long i = 0; i < num_tx_channels; i++) {
+            const string n = to_string(i);
+            tx_channel_config_t channel;
+            channel.polyCoefFilename = pt.Get("txchannels.polycoeffile_" + n, "");
+            // With a shared front end, it replaces the modulator digital_gain
+            channel.digitalGain = pt.GetReal("txchannels.digital_gain_" + n,
+                    mod_settings.txChannelsSharedFrontEnd ?
+                    (double)mod_settings.digitalgain : 1.0);
+            channel.frequencyOffset = pt.GetReal("txchannels.freq_offset_" + n, 0.0);
+            channel.tiiComb = pt.GetInteger("txchannels.tii_comb_" + n, -1);
+            channel.tiiPattern = pt.GetInteger("txchannels.tii_pattern_" + n, -1);
+            if (not channel.polyCoefFilename.empty()) {
+                num_with_poly++;
+            }
+
+            mod_settings.txChannels.push_back(channel);
+            mod_settings.sdr_device_config.txChannelOffsets.push_back(
+                    channel.frequencyOffset);
+        }
+
+        // The predistortion delays its output by one frame
+        if (num_with_poly != 0 and num_with_poly != mod_settings.txChannels.size()) {
+            cerr << "txchannels: either all channels or none must have "
+                "a polycoeffile" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+        mod_settings.polyNumThreads = pt.GetInteger("txchannels.num_threads", 0);
+
+        for (const auto& channel : mod_settings.txChannels) {
+            if ((channel.tiiComb >= 0 or channel.tiiPattern >= 0) and
+                    not mod_settings.txChannelsSharedFrontEnd) {
+                cerr << "txchannels: the TII of a channel needs "
+                    "shared_front_end" << endl;
+                throw std::runtime_error("Configuration error");
+            }
+        }
+    }
+
+    if (mod_settings.inputTransport == "iq") {
+        if (not (mod_settings.useUHDOutput or
+                 mod_settings.useSoapyOutput or
+                 mod_settings.useDexterOutput or
+                 mod_settings.useLimeOutput or
+                 mod_settings.useBladeRFOutput or
+                 mod_settings.useSimulatedOutput)) {
+            cerr << "input transport iq needs an SDR output" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+        if (mod_settings.txChannels.size() > 1) {
+            cerr << "input transport iq does not support several TX channels" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+    }
+
+    // The predistortion needs the complex envelope of the signal
+    if (mod_settings.frequencyShiftRealOutput) {
+        bool predistortion = not mod_settings.polyCoefFilename.empty() or
+            not mod_settings.memoryPolyCoefFilename.empty();
+        for (const auto& channel : mod_settings.txChannels) {
+            predistortion |= not channel.polyCoefFilename.empty();
+        }
+        if (predistortion) {
+            cerr << "modulator.freq_shift_real_output does not support "
+                "predistortion" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+    }
 
     /* Read TII parameters from config file */
     mod_settings.tiiConfig.enable = pt.GetInteger("tii.enable", 0);
     mod_settings.tiiConfig.comb = pt.GetInteger("tii.comb", 0);
     mod_settings.tiiConfig.pattern = pt.GetInteger("tii.pattern", 0);
     mod_settings.tiiConfig.old_variant = pt.GetInteger("tii.old_variant", 0);
+
+    for (auto& channel : mod_settings.txChannels) {
+        channel.tiiConfig = mod_settings.tiiConfig;
+        if (channel.tiiComb >= 0) {
+            channel.tiiConfig.comb = channel.tiiComb;
+        }
+        if (channel.tiiPattern >= 0) {
+            channel.tiiConfig.pattern = channel.tiiPattern;
+        }
+    }
+}
+
+/* The ensembles are modulated at the output rate of the first one, shifted
+ * by their frequency offset and summed before its predistortion and its
+ * output. */
+static void parse_fdm(INIReader& pt,
+        const std::vector<std::string>& ensemble_names,
+        std::vector<mod_settings_t>& ensembles)
+{
+    if (ensembles.size() < 2) {
+        cerr << "fdm needs at least two ensembles in general.ensembles" << endl;
+        throw std::runtime_error("Configuration error");
+    }
+
+    const auto& first = ensembles.front();
+    if (first.fileOutputOffline) {
+        cerr << "fdm does not support the offline rendering" << endl;
+        throw std::runtime_error("Configuration error");
+    }
+
+    if (first.carousel) {
+        cerr << "fdm does not support output.carousel" << endl;
+        throw std::runtime_error("Configuration error");
+    }
+
+    if (first.txChannels.size() > 1) {
+        cerr << "fdm does not support several TX channels" << endl;
+        throw std::runtime_error("Configuration error");
+    }
+
+    // Half the bandwidth of the DAB signal
+    constexpr double half_bandwidth = 768000;
+
+    std::vector<fdm_ensemble_config_t> fdm_ensembles;
+    for (size_t i = 0; i < ensembles.size(); i++) {
+        EnsembleConfig ensemble_pt(pt, ensemble_names[i]);
+        const auto& s = ensembles[i];
+
+        fdm_ensemble_config_t fdm_ensemble;
+        fdm_ensemble.ensembleName = s.ensembleName;
+        fdm_ensemble.frequencyOffset = ensemble_pt.GetReal("fdm.freq_offset", 0.0);
+        fdm_ensemble.digitalGain = ensemble_pt.GetReal("fdm.digital_gain", 1.0);
+
+        if (s.inputTransport == "iq") {
+            cerr << "fdm: ensemble " << s.ensembleName <<
+                " cannot use the input transport iq" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+
+        if (s.fftEngine != FFTEngine::FFTW) {
+            cerr << "fdm: ensemble " << s.ensembleName <<
+                " needs fft_engine fftw" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+
+        if (s.outputRate != first.outputRate or
+                s.dabMode != first.dabMode or
+                s.batchFrames != first.batchFrames) {
+            cerr << "fdm: ensemble " << s.ensembleName << " must have the "
+                "same modulator rate, mode and batch_frames as " <<
+                first.ensembleName << endl;
+            throw std::runtime_error("Configuration error");
+        }
+
+        if (std::fabs(fdm_ensemble.frequencyOffset) + half_bandwidth >
+                first.outputRate / 2.0) {
+            cerr << "fdm: the freq_offset of ensemble " << s.ensembleName <<
+                " puts it outside of the " << first.outputRate <<
+                " samples/s of the output" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+
+        if (i > 0 and (not s.polyCoefFilename.empty() or
+                    not s.memoryPolyCoefFilename.empty())) {
+            cerr << "fdm: the predistortion of " << first.ensembleName <<
+                " applies to all ensembles, ensemble " << s.ensembleName <<
+                " cannot have its own" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+
+        if (i > 0 and s.frequencyShift) {
+            cerr << "fdm: the freq_shift of " << first.ensembleName <<
+                " applies to all ensembles, ensemble " << s.ensembleName <<
+                " uses fdm.freq_offset instead" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+
+        fdm_ensembles.push_back(fdm_ensemble);
+    }
+
+    for (size_t i = 0; i < ensembles.size(); i++) {
+        auto& s = ensembles[i];
+        s.fdmIndex = i;
+        s.fdmEnsembles = fdm_ensembles;
+
+        // Only the output of the first ensemble is used
+        if (i > 0) {
+            s.useZeroMQOutput = false;
+            s.useVita49Output = false;
+            s.useFileOutput = false;
+            s.useUHDOutput = false;
+            s.useSoapyOutput = false;
+            s.useDexterOutput = false;
+            s.useLimeOutput = false;
+            s.useBladeRFOutput = false;
+            s.useSimulatedOutput = false;
+        }
+    }
 }
 
+static void parse_configfile(
+        const std::string& configuration_file,
+        mod_settings_t& mod_settings,
+        std::vector<mod_settings_t>& ensembles)
+{
+    // First read parameters from the file
+    INIReader pt(configuration_file);
+
+    int line_err = pt.ParseError();
+
+    if (line_err) {
+        std::cerr << "Error, cannot read configuration file '" << configuration_file.c_str() << "'" << std::endl;
+        std::cerr << "At line:       " << line_err << std::endl;
+        throw std::runtime_error("Cannot read configuration file");
+    }
+
+    mod_settings.startupCheck = pt.Get("general.startupcheck", "");
+
+    // remote controller interfaces:
+    if (pt.GetInteger("remotecontrol.telnet", 0) == 1) {
+        try {
+            int telnetport = pt.GetInteger("remotecontrol.telnetport", 0);
+            auto telnetrc = make_shared<RemoteControllerTelnet>(telnetport);
+            rcs.add_controller(telnetrc);
+        }
+        catch (const std::exception &e) {
+            std::cerr << "Error: " << e.what() << "\n";
+            std::cerr << "       telnet remote control enabled, but no telnetport defined.\n";
+            throw std::runtime_error("Configuration error");
+        }
+    }
+#if defined(HAVE_ZEROMQ)
+    if (pt.GetInteger("remotecontrol.zmqctrl", 0) == 1) {
+        try {
+            std::string zmqCtrlEndpoint = pt.Get("remotecontrol.zmqctrlendpoint", "");
+            auto zmqrc = make_shared<RemoteControllerZmq>(zmqCtrlEndpoint);
+            rcs.add_controller(zmqrc);
+        }
+        catch (const std::exception &e) {
+            std::cerr << "Error: " << e.what() << "\n";
+            std::cerr << "       zmq remote control enabled, but no endpoint defined.\n";
+            throw std::runtime_error("Configuration error");
+        }
+    }
+    if (pt.GetInteger("remotecontrol.zmqpub", 0) == 1) {
+        const std::string zmqPubEndpoint = pt.Get("remotecontrol.zmqpubendpoint", "");
+        const int interval_ms = pt.GetInteger("remotecontrol.zmqpubinterval", 500);
+        const int min_interval_ms = pt.GetInteger("remotecontrol.zmqpubmininterval", 1000);
+        if (zmqPubEndpoint.empty()) {
+            std::cerr << "Error: zmq remote control publisher enabled, but no endpoint defined.\n";
+            throw std::runtime_error("Configuration error");
+        }
+        if (interval_ms <= 0 or min_interval_ms < 0) {
+            std::cerr << "Error: remotecontrol.zmqpubinterval must be positive, "
+                "and zmqpubmininterval not negative.\n";
+            throw std::runtime_error("Configuration error");
+        }
+        auto zmqpub = make_shared<RemoteControllerZmqPub>(zmqPubEndpoint,
+                interval_ms, min_interval_ms);
+        rcs.add_controller(zmqpub);
+    }
+#endif
+    if (pt.GetInteger("remotecontrol.metrics", 0) == 1) {
+        const int metrics_port = pt.GetInteger("remotecontrol.metricsport", 0);
+        if (metrics_port <= 0 or metrics_port > 65535) {
+            std::cerr << "Error: metrics enabled, but no valid metricsport defined.\n";
+            throw std::runtime_error("Configuration error");
+        }
+        auto exporter = make_shared<Metrics::HttpExporter>(metrics_port,
+                pt.Get("remotecontrol.metricsaddress", "127.0.0.1"));
+        rcs.add_controller(exporter);
+    }
+
+    // log parameters:
+    const string events_endpoint = pt.Get("log.events_endpoint", "");
+    if (not events_endpoint.empty()) {
+#if defined(HAVE_ZEROMQ)
+        events.bind(events_endpoint);
+#else
+        throw std::runtime_error("Cannot configure events sender when compiled without zeromq");
+#endif
+    }
+
+    if (pt.GetInteger("log.syslog", 0) == 1) {
+        etiLog.register_backend(make_shared<LogToSyslog>());
+    }
 
-void parse_args(int argc, char **argv, mod_settings_t& mod_settings)
+    if (pt.GetInteger("log.filelog", 0) == 1) {
+        std::string logfilename;
+        try {
+            logfilename = pt.Get("log.filename", "");
+        }
+        catch (const std::exception &e) {
+            std::cerr << "Error: " << e.what() << "\n";
+            std::cerr << "       Configuration enables file log, but does not specify log filename\n";
+            throw std::runtime_error("Configuration error");
+        }
+
+        etiLog.register_backend(make_shared<LogToFile>(logfilename));
+    }
+
+    std::string trace_filename = pt.Get("log.trace", "");
+    if (not trace_filename.empty()) {
+        etiLog.register_backend(make_shared<LogTracer>(trace_filename));
+    }
+
+    const std::string frame_trace_file = pt.Get("log.frame_trace_file", "");
+    if (not frame_trace_file.empty()) {
+        const long frame_trace_records = pt.GetInteger("log.frame_trace_records", 262144);
+        if (frame_trace_records < 1024) {
+            cerr << "log.frame_trace_records must be at least 1024" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+
+        auto& tracer = frame_tracer();
+        try {
+            tracer.open(frame_trace_file, frame_trace_records);
+        }
+        catch (const std::runtime_error& e) {
+            cerr << "Error: " << e.what() << endl;
+            throw std::runtime_error("Configuration error");
+        }
+        tracer.set_enabled(pt.GetInteger("log.frame_trace", 1) == 1);
+    }
+
+    const std::string frame_capture_file = pt.Get("log.frame_capture_file", "");
+    if (not frame_capture_file.empty()) {
+        frame_tracer().set_capture_file(frame_capture_file);
+    }
+
+    if (not frame_trace_file.empty() or not frame_capture_file.empty()) {
+        rcs.enrol(&frame_tracer());
+    }
+
+    mod_settings.showProcessTime = pt.GetInteger("log.show_process_time",
+            mod_settings.showProcessTime);
+    mod_settings.runReportFile = pt.Get("log.run_report", "");
+
+    if (pt.GetInteger("log.perf_counters", 0) == 1) {
+        // A warning is logged if the counters are not available
+        perf_counters::set_enabled(true);
+    }
+
+    const std::string alloc_tracking_mode = pt.Get("log.allocation_tracking", "off");
+    if (alloc_tracking_mode == "off") {
+        alloc_tracking::set_mode(alloc_tracking::mode_e::off);
+    }
+    else if (alloc_tracking_mode == "count") {
+        alloc_tracking::set_mode(alloc_tracking::mode_e::count);
+    }
+    else if (alloc_tracking_mode == "warn") {
+        alloc_tracking::set_mode(alloc_tracking::mode_e::warn);
+    }
+    else if (alloc_tracking_mode == "abort") {
+        alloc_tracking::set_mode(alloc_tracking::mode_e::abort);
+    }
+    else {
+        cerr << "log.allocation_tracking must be off, count, warn or abort" << endl;
+        throw std::runtime_error("Configuration error");
+    }
+
+    // Worker pool shared by all ensembles
+    mod_settings.workerPoolNumThreads = pt.GetInteger("general.worker_threads",
+            mod_settings.workerPoolNumThreads);
+    mod_settings.workerPoolPinThreads = pt.GetInteger("general.pin_worker_threads",
+            mod_settings.workerPoolPinThreads) == 1;
+    mod_settings.pipelineExecutorNumThreads = pt.GetInteger(
+            "general.pipeline_threads",
+            mod_settings.pipelineExecutorNumThreads);
+    mod_settings.lockMemory = pt.GetInteger("general.lock_memory", 0) == 1;
+    mod_settings.lowMemory = pt.GetInteger("general.low_memory", 0) == 1;
+    mod_settings.sharedBatchedFft =
+        pt.GetInteger("general.shared_batched_fft", 0) == 1;
+    shared_tables::set_enabled(pt.GetInteger("general.shared_tables", 0) == 1);
+    if (mod_settings.lowMemory) {
+        set_max_pooled_bytes(low_memory_pooled_bytes);
+    }
+
+    mod_settings.fftwWisdomFile = pt.Get("general.fftw_wisdom",
+            mod_settings.fftwWisdomFile);
+    mod_settings.fftwPlanMode = pt.Get("general.fftw_plan_mode",
+            mod_settings.fftwPlanMode);
+    if (mod_settings.fftwPlanMode != "estimate" and
+            mod_settings.fftwPlanMode != "measure" and
+            mod_settings.fftwPlanMode != "patient" and
+            mod_settings.fftwPlanMode != "exhaustive") {
+        cerr << "general.fftw_plan_mode must be estimate, measure, "
+            "patient or exhaustive" << endl;
+        throw std::runtime_error("Configuration error");
+    }
+
+    // Before the first block selects its kernels
+    const std::string max_simd = pt.Get("general.max_simd", "");
+    if (not max_simd.empty()) {
+        try {
+            cpu_features().set_limit(max_simd);
+        }
+        catch (const std::invalid_argument& e) {
+            cerr << "general.max_simd must be avx512f, avx2, avx, ssse3, "
+                "sse2, neon or none" << endl;
+            throw std::runtime_error("Configuration error");
+        }
+    }
+    rcs.enrol(&cpu_features());
+
+    // Before the blocks allocate their workspaces
+    const std::string huge_pages = pt.Get("general.huge_pages", "off");
+    if (huge_pages == "off") {
+        set_huge_pages(huge_pages_e::off);
+    }
+    else if (huge_pages == "transparent") {
+        set_huge_pages(huge_pages_e::transparent);
+    }
+    else if (huge_pages == "hugetlb") {
+        set_huge_pages(huge_pages_e::hugetlb);
+    }
+    else {
+        cerr << "general.huge_pages must be off, transparent or hugetlb" << endl;
+        throw std::runtime_error("Configuration error");
+    }
+
+    // Thread placement
+    const std::vector<std::string> thread_roles = {
+        "modulator", "input", "sdrdevice", "pipeline", "firfilter", "gaincontrol",
+        "memlesspoly", "memorypoly", "workerpool", "flowgraph", "flowgraphstage",
+        "dpdfeedback", "dexter",
+        "fileoutput", "outputtee" };
+
+    for (const auto& role : thread_roles) {
+        thread_placement_t placement;
+        try {
+            placement.cpus = parse_cpu_list(pt.Get("threads." + role, ""));
+        }
+        catch (const std::invalid_argument& e) {
+            std::cerr << "Error: threads." << role << ": " << e.what() << "\n";
+            throw std::runtime_error("Configuration error");
+        }
+        placement.numa_node = pt.GetInteger("threads." + role + "_numa_node", -1);
+
+        const std::string policy = pt.Get("threads." + role + "_policy", "");
+        if (policy.empty()) {
+            placement.policy = thread_policy_e::Unchanged;
+        }
+        else if (policy == "other") {
+            placement.policy = thread_policy_e::Other;
+        }
+        else if (policy == "fifo") {
+            placement.policy = thread_policy_e::FIFO;
+        }
+        else if (policy == "rr") {
+            placement.policy = thread_policy_e::RR;
+        }
+        else if (policy == "deadline") {
+            placement.policy = thread_policy_e::Deadline;
+        }
+        else {
+            std::cerr << "Error: threads." << role <<
+                "_policy must be other, fifo, rr or deadline\n";
+            throw std::runtime_error("Configuration error");
+        }
+
+        placement.priority = pt.GetInteger("threads." + role + "_priority", 1);
+        if (placement.priority < 1 or placement.priority > 99) {
+            std::cerr << "Error: threads." << role <<
+                "_priority must be between 1 and 99\n";
+            throw std::runtime_error("Configuration error");
+        }
+
+        if (placement.policy == thread_policy_e::Deadline) {
+            // Every thread works once per transmission frame
+            const uint64_t frame_ns = (mod_settings.dabMode >= 1 and mod_settings.dabMode <= 4) ?
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        transmission_frame_duration(mod_settings.dabMode)).count() :
+                96000000;
+            const double runtime_percent = pt.GetReal(
+                    "threads." + role + "_runtime_percent", 50);
+            if (runtime_percent <= 0 or runtime_percent > 100) {
+                std::cerr << "Error: threads." << role <<
+                    "_runtime_percent must be above 0 and at most 100\n";
+                throw std::runtime_error("Configuration error");
+            }
+            placement.deadline_period_ns = frame_ns;
+            placement.deadline_runtime_ns = frame_ns * runtime_percent / 100;
+        }
+
+        if (not placement.cpus.empty() or placement.numa_node >= 0 or
+                placement.policy != thread_policy_e::Unchanged) {
+            mod_settings.threadPlacement[role] = placement;
+        }
+    }
+
+    std::stringstream ensembles_ss(pt.Get("general.ensembles", ""));
+    std::vector<std::string> ensemble_names;
+    for (std::string name; ensembles_ss >> name; ) {
+        ensemble_names.push_back(name);
+    }
+
+    if (ensemble_names.empty()) {
+        EnsembleConfig ensemble_pt(pt, "");
+        parse_ensemble(ensemble_pt, mod_settings);
+        ensembles.push_back(mod_settings);
+    }
+    else {
+        for (const auto& name : ensemble_names) {
+            mod_settings_t ensemble_settings = mod_settings;
+            ensemble_settings.ensembleName = name;
+            EnsembleConfig ensemble_pt(pt, name);
+            parse_ensemble(ensemble_pt, ensemble_settings);
+            ensembles.push_back(ensemble_settings);
+        }
+    }
+
+    if (pt.GetInteger("fdm.enable", 0) == 1) {
+        parse_fdm(pt, ensemble_names, ensembles);
+    }
+}
+
+void parse_args(int argc, char **argv, std::vector<mod_settings_t>& ensembles)
 {
+    mod_settings_t mod_settings;
+
     bool use_configuration_cmdline = false;
     bool use_configuration_file = false;
     std::string configuration_file;
@@ -610,7 +1882,7 @@ void parse_args(int argc, char **argv, mod_settings_t& mod_settings)
 
             if (mod_settings.inputName.substr(0, 4) == "zmq+" &&
                 mod_settings.inputName.find("://") != std::string::npos) {
-                throw std::runtime_error("Support for ZeroMQ input transport has been removed.");
+                mod_settings.inputTransport = "zeromq";
             }
             else if (mod_settings.inputName.substr(0, 6) == "tcp://") {
                 mod_settings.inputTransport = "tcp";
@@ -636,7 +1908,10 @@ void parse_args(int argc, char **argv, mod_settings_t& mod_settings)
     }
 
     if (use_configuration_file) {
-        parse_configfile(configuration_file, mod_settings);
+        parse_configfile(configuration_file, mod_settings, ensembles);
+    }
+    else {
+        ensembles.push_back(mod_settings);
     }
 }
 
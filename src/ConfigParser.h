@@ -31,69 +31,399 @@
 #   include "config.h"
 #endif
 
+#include <cstdint>
 #include <string>
+#include <vector>
+#include <map>
+#include <memory>
 #include "GainControl.h"
+#include "HalfFloat.h"
 #include "TII.h"
 #include "output/SDRDevice.h"
 
+class OfdmBatchService;
+
 enum class FFTEngine {
     FFTW, // floating point in software
     KISS, // fixed-point in software
+    KISS_SIMD, // fixed-point in software, vectorised, same output as KISS
     DEXTER // fixed-point in FPGA
 };
 
+// Outcome of the startup benchmark of one engine, see FFTEngineSelector
+struct fft_engine_candidate_t {
+    FFTEngine engine = FFTEngine::FFTW;
+    // Why the engine could not be chosen, empty if it could
+    std::string rejected;
+    // Median over the benchmarked frames, including the CFR
+    double frame_time_us = 0;
+    // Against the output of FFTW, which is the reference
+    double snr_db = 0;
+};
+
+enum class ResamplerType {
+    Auto, // Halfband if the ratio is a power of two, FFT otherwise
+    FFT, // in the frequency domain, see Resampler
+    Polyphase, // see PolyphaseResampler
+    Halfband, // see HalfbandInterpolator
+};
+
+enum class thread_policy_e {
+    Unchanged, // SCHED_RR with the lowest priority for the DSP threads
+    Other, // SCHED_OTHER
+    FIFO, // SCHED_FIFO
+    RR, // SCHED_RR
+    Deadline, // SCHED_DEADLINE
+};
+
+// CPU affinity, NUMA memory policy and scheduling for the threads of one role
+struct thread_placement_t {
+    // CPUs the threads may run on, empty to leave the affinity unchanged
+    std::vector<int> cpus;
+
+    // NUMA node to bind memory allocations to, -1 to leave unchanged
+    int numa_node = -1;
+
+    thread_policy_e policy = thread_policy_e::Unchanged;
+
+    // Priority for FIFO and RR, 1 to 99
+    int priority = 1;
+
+    // For Deadline, the thread gets deadline_runtime_ns of CPU time in
+    // every period, which ends at its deadline.
+    uint64_t deadline_runtime_ns = 0;
+    uint64_t deadline_period_ns = 0;
+};
+
+// Processing of one TX channel when several are used
+struct tx_channel_config_t {
+    // Coefficients of the memoryless predistortion, empty to disable
+    std::string polyCoefFilename;
+    float digitalGain = 1.0f;
+    // Added to the output frequency, in Hz
+    double frequencyOffset = 0.0;
+
+    // With a shared front end, every channel has its own TII, which is the
+    // one of [tii] unless the comb or pattern is overridden.
+    int tiiComb = -1;
+    int tiiPattern = -1;
+    tii_config_t tiiConfig;
+};
+
+// Place of one ensemble in the wideband signal, when several ensembles are
+// frequency multiplexed into the output of the first one
+struct fdm_ensemble_config_t {
+    std::string ensembleName;
+    // Relative to the centre of the output, in Hz
+    double frequencyOffset = 0.0;
+    float digitalGain = 1.0f;
+};
+
+// Additional output that gets the same samples as the main output
+struct tee_output_config_t {
+    // file, zmq or record
+    std::string type;
+    // File name or ZeroMQ endpoint
+    std::string target;
+    size_t queueSize = 4;
+    // oldest, newest or block, see OutputTee
+    std::string dropPolicy = "oldest";
+
+    // Settings of the compressed recording, see OutputRecorder
+    std::string recordCodec;
+    int recordLevel = 1;
+    size_t recordChunkFrames = 10;
+};
+
 struct mod_settings_t {
     std::string startupCheck;
 
+    // Name of the ensemble when several are modulated in the same process,
+    // empty otherwise.
+    std::string ensembleName;
+
+    // Settings of the WorkerPool shared by all ensembles
+    size_t workerPoolNumThreads = 0;
+    bool workerPoolPinThreads = false;
+
+    // Number of threads of the PipelineExecutor shared by the pipelined
+    // blocks of all ensembles, 0 gives every block its own thread
+    size_t pipelineExecutorNumThreads = 0;
+
+    // Lock the memory of the process into RAM, and warn about the buffer
+    // allocations once the modulator is warmed up
+    bool lockMemory = false;
+
+    // Low memory profile for small boards: the flowgraph edges share
+    // their buffers, the frame queue in front of the SDR is shorter, the
+    // OFDM generator uses no batch or cache workspaces, and the buffer
+    // pool keeps less memory. See general.low_memory in doc/example.ini.
+    bool lowMemory = false;
+
+    // File to load FFTW wisdom from and save it to, and how thoroughly
+    // FFTW measures its plans. Shared by all ensembles.
+    std::string fftwWisdomFile;
+    std::string fftwPlanMode = "measure";
+
+    // Placement of the threads, indexed by role. See [threads] in
+    // doc/example.ini for the list of roles.
+    std::map<std::string, thread_placement_t> threadPlacement;
+
     std::string outputName;
     bool useZeroMQOutput = false;
     std::string zmqOutputSocketType = "";
+    int zmqOutputSndHwm = 0;
+    bool zmqOutputHeader = false;
+    bool useVita49Output = false;
+    int vita49OutputPort = 0;
+    std::string vita49OutputFormat = "s16";
+    uint32_t vita49OutputStreamId = 0;
+    size_t vita49OutputMaxPacketSize = 1472;
     bool useFileOutput = false;
     std::string fileOutputFormat = "complexf";
     bool fileOutputShowMetadata = false;
+    // Write the file in a separate thread, with this much buffer memory.
+    // 0 writes in the flowgraph thread.
+    size_t fileOutputAsyncBufferSize = 0;
+    bool fileOutputDirectIO = false;
+    // Modulate the whole input file on all CPUs as fast as possible,
+    // in chunks of offlineChunkFrames ETI frames
+    bool fileOutputOffline = false;
+    size_t offlineChunkFrames = 1000;
     bool useUHDOutput = false;
     bool useSoapyOutput = false;
     bool useDexterOutput = false;
     bool useLimeOutput = false;
     bool useBladeRFOutput = false;
+    bool useSimulatedOutput = false;
+
+    std::vector<tee_output_config_t> teeOutputs;
+
+    // Record the output of one loop of the input file, and transmit the
+    // recording instead of modulating the file, see OutputCarousel
+    bool carousel = false;
+    // Empty to keep the recording in memory
+    std::string carouselFile;
 
     FFTEngine fftEngine = FFTEngine::FFTW;
+    // With fft_engine=auto, fftEngine is FFTW until the FFTEngineSelector
+    // replaces it at startup
+    bool fftEngineAuto = false;
+    double fftEngineAutoMinSnr = 40.0;
+    std::vector<fft_engine_candidate_t> fftEngineCandidates;
 
     size_t outputRate = 2048000;
+    // The PolyphaseResampler also replaces the FIRFilter, whose taps get
+    // folded into it. The fixed-point engines always use it.
+    ResamplerType resampler = ResamplerType::Auto;
+    // Threads for each FFT of the fft resampler and the FFT convolution of
+    // the FIR filter. More than 1 needs FFTW threads support.
+    unsigned resamplerFftThreads = 1;
     size_t clockRate = 0;
     unsigned dabMode = 1;
     float digitalgain = 1.0f;
+
+    // Frequency shift in Hz after the resampler, see FrequencyShifter.
+    // The block is only inserted if enabled, the offset can then be
+    // changed through the remote control.
+    bool frequencyShift = false;
+    double frequencyShiftOffset = 0.0;
+    bool frequencyShiftRealOutput = false;
+
+    // Only run the encoding up to the time interleavers, and do not drive
+    // the output, until the remote control takes over, see DabModulator
+    bool standby = false;
     float normalise = 1.0f;
     GainMode gainMode = GainMode::GAIN_VAR;
     float gainmodeVariance = 4.0f;
+    // Clip to the range of the output format in the GainControl, so that
+    // the FormatConverter does not need to
+    bool gainClip = false;
+    // Apply the gain mode to the output of the fixed-point FFT engines.
+    // Without it, their output keeps the scaling of the inverse FFT.
+    bool fixedPointGainControl = false;
 
     // To handle the timestamp offset of the modulator
     double tist_offset_s = 0.0;
 
+    // With synchronous transmission, the modulation of a frame only starts
+    // this many seconds before its transmission time. 0 starts it as soon
+    // as the frame is received.
+    double jitLead = 0.0;
+
     bool loop = false;
     std::string inputName = "";
     std::string inputTransport = "file";
+
+    // Read the ETI file through a memory mapping
+    bool inputMmap = false;
+
+    // Use the index of a compressed ETI file, and where to start the file
+    bool inputIndex = false;
+    size_t inputStartFrame = 0;
     float edi_max_delay_ms = 0.0f;
 
+    // Network interface whose PACKET_MMAP ring receives the EDI UDP
+    // sources, empty to receive from the sockets
+    std::string edi_packet_ring_interface;
+
+    // Receive timestamps of the EDI UDP sources: none, software or
+    // hardware
+    std::string edi_timestamps = "software";
+
+    // Depth of the frame queue filled by the input thread. 0 means the
+    // input is read by the modulator thread.
+    size_t inputPrefetchFrames = 0;
+
     tii_config_t tiiConfig;
 
+    // The bypass settings build the block, but let it forward the
+    // samples until its bypass RC parameter is set to 0.
     std::string filterTapsFilename = "";
+    size_t filterFftMinTaps = 128;
+    unsigned filterFftThreads = 1;
+    unsigned filterNumThreads = 0;
+    bool filterBypass = false;
 
     std::string polyCoefFilename = "";
     unsigned polyNumThreads = 0;
+    bool polyBypass = false;
+    // Sample rate of the MemlessPoly, from 2048000 to the output rate.
+    // 0 is the output rate.
+    size_t polyRate = 0;
+
+    std::string memoryPolyCoefFilename = "";
+    unsigned memoryPolyNumThreads = 0;
+    bool memoryPolyBypass = false;
+
+    // When transmitting on several channels of the SDR device, the
+    // processing that differs for every channel. Empty for one channel.
+    std::vector<tx_channel_config_t> txChannels;
+
+    // The TX channels only share the blocks up to the differential
+    // modulation, and have their own TII, OFDM generator, gain, guard
+    // interval, FIR filter and resampler.
+    bool txChannelsSharedFrontEnd = false;
+
+    // When the ensembles are frequency multiplexed, the index of this
+    // ensemble and the settings of all of them. Only the first one has
+    // an output, the others give their samples to its EnsembleMixer.
+    // Empty when disabled.
+    size_t fdmIndex = 0;
+    std::vector<fdm_ensemble_config_t> fdmEnsembles;
 
     // Settings for crest factor reduction
     bool enableCfr = false;
     float cfrClip = 1.0f;
     float cfrErrorClip = 1.0f;
+    size_t cfrIterations = 1;
+    float cfrTargetPapr = 0.0f;
+    std::string cfrMethod = "errorclip";
+    float cfrAceGain = 4.0f;
+    // The PAPR and MER are measured on one in this many frames
+    size_t cfrStatsInterval = 1;
+    // With the fixed-point FFT engines, the samples are clipped to this
+    // PAPR in dB, see FixedPointCfr
+    float cfrFixedPointPapr = 9.0f;
+
+    // Settings for the peak cancellation after the FIR filter and the
+    // resampler
+    bool enablePeakCancel = false;
+    float peakCancelThreshold = 7.0f;
+    size_t peakCancelIterations = 3;
+
+    // Settings for the degradation of the processing when it cannot keep
+    // up with real time, see RealtimeBudget. The steps are mer, dpd and
+    // cfr.
+    bool enableRtBudget = false;
+    float rtBudgetHigh = 0.9f;
+    float rtBudgetLow = 0.6f;
+    size_t rtBudgetWindow = 10;
+    size_t rtBudgetRecovery = 250;
+    std::vector<std::string> rtBudgetSteps = {"mer", "dpd", "cfr"};
+
+    // Settings for the tuning of the threads and pipeline depths from
+    // the processing time of the first frames, see AutoTuner
+    bool enableAutoTune = false;
+    float autoTuneDuration = 10.0f;
+    float autoTuneHeadroom = 0.3f;
 
     // Settings for the OFDM windowing
     size_t ofdmWindowOverlap = 0;
 
+    // Gain in dB of every carrier, applied before the OFDM. Empty if not
+    // used.
+    std::string preemphasisFilename;
+
+    // Number of worker threads used to process independent flowgraph
+    // nodes in parallel. 0 means sequential processing.
+    size_t flowgraphNumThreads = 0;
+
+    // The flowgraph edges after which a new pipeline stage with its own
+    // thread starts: mapping (after the channel coding), ofdm (before the
+    // OFDM generator) and output (before the output). Every stage adds
+    // one transmission frame of latency.
+    std::vector<std::string> pipelineStages;
+
+    // Number of frames of latency of each PipelinedModCodec, by
+    // lowercased block name, see PipelinedModCodec::set_pipeline_depth
+    std::map<std::string, size_t> pipelineDepth;
+
+    // Number of transmission frames the OFDM and sample processing blocks
+    // handle in each call. 1 means no batching.
+    size_t batchFrames = 1;
+
+    // Transform all OFDM symbols of a transmission frame with one FFTW
+    // plan, also for the FFTs of the CFR.
+    bool batchedFft = false;
+
+    // With several ensembles, transform the symbols of the ensembles that
+    // use the same mode with one plan, see OfdmBatchService. The service
+    // and the slot of the ensemble are set at startup, nullptr if it keeps
+    // its own plan.
+    bool sharedBatchedFft = false;
+    std::shared_ptr<OfdmBatchService> ofdmBatchService;
+    size_t ofdmBatchSlot = 0;
+
+    // Number of threads of the shared WorkerPool that help the flowgraph
+    // thread with the OFDM symbols. 0 means no help.
+    size_t ofdmNumThreads = 0;
+
+    // Keep the output of the null symbol and of the phase reference, and
+    // reuse it as long as their carriers do not change.
+    bool ofdmCacheStaticSymbols = false;
+
+    // Pass the samples from the OFDM generator to the FormatConverter
+    // with all I values before all Q values, when all blocks in between
+    // support it.
+    bool planarSamples = false;
+
+    // Store the samples between the blocks that support it, from the
+    // GuardIntervalInserter on, as 16-bit floats
+    half_format_e halfSamples = half_format_e::none;
+
+    // Number of OFDM symbols the SymbolStreamer gives at a time to the
+    // blocks that can process parts of frames, 0 to disable it
+    size_t streamSymbols = 0;
+
+    // Do the energy dispersal, convolutional encoding and puncturing of
+    // the FIC and of each subchannel in one block.
+    bool fusedSubchannelEncoder = false;
+
+    // Number of different frames for which the fused encoder remembers
+    // the output, per subchannel. 0 disables the cache.
+    size_t encoderCacheSize = 0;
+
     Output::SDRDeviceConfig sdr_device_config;
 
     bool showProcessTime = true;
+
+    // Append a JSON report with the block statistics of every modulator
+    // run to this file. Empty disables the reports.
+    std::string runReportFile;
 };
 
-void parse_args(int argc, char **argv, mod_settings_t& mod_settings);
+/* Parse the command line and the configuration file. Returns the settings
+ * of every ensemble to modulate, usually only one. */
+void parse_args(int argc, char **argv, std::vector<mod_settings_t>& ensembles);
 
@@ -1,6 +1,11 @@
 /*
    Copyright (C) 2005, 2006, 2007, 2008, 2009, 2010, 2011 Her Majesty
    the Queen in Right of Canada (Communications Research Center Canada)
+
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
  */
 /*
    This file is part of ODR-DabMod.
@@ -26,6 +31,7 @@
 #include <stdio.h>
 #include <stdexcept>
 #include <string>
+#include <cstring>
 
 
 const static uint8_t PARITY[] = {
@@ -48,11 +54,63 @@ const static uint8_t PARITY[] = {
 };
 
 
+/* Encode the lowest num_bits bits of data, MSB first, starting from the
+ * given encoder memory. Returns the output bits, the first ones in the
+ * most significant bits, and updates memory. This is the reference
+ * implementation of the mother code, used to build the tables. */
+static uint32_t encode_bits(uint16_t& memory, uint8_t data, unsigned num_bits)
+{
+    uint32_t out = 0;
+    for (unsigned j = 0; j < num_bits; ++j) {
+        memory >>= 1;
+        memory |= ((data >> (num_bits - 1 - j)) & 1) << 6;
+        const uint8_t poly[4] = {
+            (uint8_t)(memory & 0x5b),
+            (uint8_t)(memory & 0x79),
+            (uint8_t)(memory & 0x65),
+            (uint8_t)(memory & 0x5b)
+        };
+        // For each poly
+        for (unsigned k = 0; k < 4; ++k) {
+            out <<= 1;
+            out |= PARITY[poly[k]];
+        }
+    }
+    return out;
+}
+
+ConvEncoderTable::ConvEncoderTable()
+{
+    for (size_t prev = 0; prev < 64; prev++) {
+        for (size_t cur = 0; cur < 256; cur++) {
+            uint16_t memory = 0;
+            encode_bits(memory, prev, 8);
+            const uint32_t bits = encode_bits(memory, cur, 8);
+
+            uint8_t *entry = out[(prev << 8) | cur];
+            entry[0] = bits >> 24;
+            entry[1] = bits >> 16;
+            entry[2] = bits >> 8;
+            entry[3] = bits;
+        }
+    }
+}
+
+const ConvEncoderTable& ConvEncoderTable::get()
+{
+    static const ConvEncoderTable table;
+    return table;
+}
+
+
 ConvEncoder::ConvEncoder(size_t framesize) :
     ModCodec(),
     d_framesize(framesize)
 {
     PDEBUG("ConvEncoder::ConvEncoder(%zu)\n", framesize);
+
+    // Build the table now rather than during the first frame
+    ConvEncoderTable::get();
 }
 
 
@@ -62,12 +120,8 @@ int ConvEncoder::process(Buffer* const dataIn, Buffer* dataOut)
             "(dataIn: %p, dataOut: %p)\n",
             dataIn, dataOut);
 
-    size_t in_block_size = d_framesize;
-    size_t out_block_size = (d_framesize * 4) + 3;
-    size_t in_offset = 0;
-    size_t out_offset = 0;
-    uint16_t memory = 0;
-    uint8_t data;
+    const size_t in_block_size = d_framesize;
+    const size_t out_block_size = (d_framesize * 4) + 3;
 
     if (dataIn->getLength() != in_block_size) {
         PDEBUG("%zu != %zu != 0\n", dataIn->getLength(), in_block_size);
@@ -78,67 +132,23 @@ int ConvEncoder::process(Buffer* const dataIn, Buffer* dataOut)
     const uint8_t* in = reinterpret_cast<const uint8_t*>(dataIn->getData());
     uint8_t* out = reinterpret_cast<uint8_t*>(dataOut->getData());
 
-    // While there is enought input and ouput items
-    while (dataIn->getLength() - in_offset >= in_block_size &&
-            dataOut->getLength() - out_offset >= out_block_size) {
-        for (size_t in_count = 0; in_count < in_block_size; ++in_count) {
-            data = in[in_offset];
-            //PDEBUG("Input: 0x%x\n", data);
-            // For next 4 output bytes
-            for (unsigned out_count = 0; out_count < 4; ++out_count) {
-                out[out_offset] = 0;
-                // For each 4-bit output word
-                for (unsigned j = 0; j < 2; ++j) {
-                    memory >>= 1;
-                    memory |= (data >> 7) << 6;
-                    data <<= 1;
-                    //PDEBUG("Memory: 0x%x\n", memory);
-                    uint8_t poly[4] = {
-                        (uint8_t)(memory & 0x5b),
-                        (uint8_t)(memory & 0x79),
-                        (uint8_t)(memory & 0x65),
-                        (uint8_t)(memory & 0x5b)
-                    };
-                    //PDEBUG("Polys: 0x%x, 0x%x, 0x%x, 0x%x\n", poly[0], poly[1], poly[2], poly[3]);
-                    // For each poly
-                    for (unsigned k = 0; k < 4; ++k) {
-                        out[out_offset] <<= 1;
-                        out[out_offset] |= PARITY[poly[k]];
-                        //PDEBUG("Out bit: %i\n", out[no] >> 7);
-                    }
-                }
-                //PDEBUG("Out: 0x%x\n", out[no]);
-                ++out_offset;
-            }
-            ++in_offset;
-        }
+    const auto& table = ConvEncoderTable::get();
 
-        for (unsigned pad_count = 0; pad_count < 3; ++pad_count) {
-            out[out_offset] = 0;
-            // For each 4-bit output word
-            for (unsigned j = 0; j < 2; ++j) {
-                memory >>= 1;
-                //PDEBUG("Memory: 0x%x\n", memory);
-                uint8_t poly[4] = {
-                    (uint8_t)(memory & 0x5b),
-                    (uint8_t)(memory & 0x79),
-                    (uint8_t)(memory & 0x65),
-                    (uint8_t)(memory & 0x5b)
-                };
-                //PDEBUG("Polys: 0x%x, 0x%x, 0x%x, 0x%x\n", poly[0], poly[1], poly[2], poly[3]);
-                // For each poly
-                for (unsigned k = 0; k < 4; ++k) {
-                    out[out_offset] <<= 1;
-                    out[out_offset] |= PARITY[poly[k]];
-                    //PDEBUG("Out bit: %i\n", out[no] >> 7);
-                }
-            }
-            //PDEBUG("Out: 0x%x\n", out[no]);
-            ++out_offset;
-        }
+    // The encoder memory is zero at the start of every block
+    uint8_t prev = 0;
+    for (size_t i = 0; i < in_block_size; ++i) {
+        memcpy(out, table.lookup(prev, in[i]), 4);
+        out += 4;
+        prev = in[i];
     }
 
-    PDEBUG(" Consume: %zu\n", in_offset);
+    // The tail flushes the memory with six zero bits, which are the first
+    // 24 output bits of a zero byte.
+    memcpy(out, table.lookup(prev, 0), 3);
+    out += 3;
+
+    const size_t out_offset = out - reinterpret_cast<uint8_t*>(dataOut->getData());
+    PDEBUG(" Consume: %zu\n", in_block_size);
     PDEBUG(" Return: %zu\n", out_offset);
 
     if (out_offset != dataOut->getLength()) {
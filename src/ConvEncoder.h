@@ -27,6 +27,28 @@
 
 #include "ModPlugin.h"
 #include <sys/types.h>
+#include <cstdint>
+
+/* The encoder state before an input byte consists of the last six bits
+ * of the previous input byte. The 32 output bits of one input byte are
+ * therefore a function of the six low bits of the previous byte and of
+ * the current one, and this table contains all of them, first bit in the
+ * MSB of the first byte. As there is no dependency from one lookup to the
+ * next, there is no need for a SIMD implementation.
+ */
+class ConvEncoderTable
+{
+public:
+    static const ConvEncoderTable& get();
+
+    const uint8_t* lookup(uint8_t prev, uint8_t cur) const {
+        return out[((prev & 0x3f) << 8) | cur];
+    }
+
+private:
+    ConvEncoderTable();
+    uint8_t out[1 << 14][4];
+};
 
 class ConvEncoder : public ModCodec
 {
@@ -0,0 +1,271 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CpuFeatures.h"
+#include "Log.h"
+
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+struct feature_info_t {
+    cpu_feature_e feature;
+    const char *name;
+    // Features of lower rank are also allowed by the limit
+    int rank;
+    // Is the program compiled to use it everywhere?
+    bool build;
+};
+
+static const feature_info_t feature_infos[] = {
+    {cpu_feature_e::avx512f, "avx512f", 5,
+#if defined(__AVX512F__)
+        true},
+#else
+        false},
+#endif
+    {cpu_feature_e::avx2, "avx2", 4,
+#if defined(__AVX2__)
+        true},
+#else
+        false},
+#endif
+    {cpu_feature_e::f16c, "f16c", 3,
+#if defined(__F16C__)
+        true},
+#else
+        false},
+#endif
+    {cpu_feature_e::avx, "avx", 3,
+#if defined(__AVX__)
+        true},
+#else
+        false},
+#endif
+    {cpu_feature_e::ssse3, "ssse3", 2,
+#if defined(__SSSE3__)
+        true},
+#else
+        false},
+#endif
+    {cpu_feature_e::sse2, "sse2", 1,
+#if defined(__SSE2__)
+        true},
+#else
+        false},
+#endif
+    {cpu_feature_e::neon, "neon", 1,
+#if defined(__ARM_NEON)
+        true},
+#else
+        false},
+#endif
+};
+
+static const feature_info_t& feature_info(cpu_feature_e feature)
+{
+    for (const auto& info : feature_infos) {
+        if (info.feature == feature) {
+            return info;
+        }
+    }
+    throw logic_error("CpuFeatures: unknown feature");
+}
+
+CpuFeatures& cpu_features()
+{
+    static CpuFeatures features;
+    return features;
+}
+
+CpuFeatures::CpuFeatures() :
+    RemoteControllable("cpu"),
+    m_limit_rank(numeric_limits<int>::max())
+{
+    RC_ADD_PARAMETER(supported, "(Read-only) SIMD instruction sets of the CPU");
+    RC_ADD_PARAMETER(build, "(Read-only) SIMD instruction sets the program is compiled for");
+    RC_ADD_PARAMETER(limit, "(Read-only) Highest instruction set the kernels may use");
+    RC_ADD_PARAMETER(kernels, "(Read-only) Kernel selected by every module");
+
+#if defined(HAVE_CPU_FEATURES_DISPATCH)
+    __builtin_cpu_init();
+#endif
+
+    for (const auto& info : feature_infos) {
+        bool has = info.build;
+#if defined(HAVE_CPU_FEATURES_DISPATCH)
+        switch (info.feature) {
+            case cpu_feature_e::avx512f: has |= __builtin_cpu_supports("avx512f"); break;
+            case cpu_feature_e::avx2: has |= __builtin_cpu_supports("avx2"); break;
+            case cpu_feature_e::avx: has |= __builtin_cpu_supports("avx"); break;
+            case cpu_feature_e::f16c: has |= __builtin_cpu_supports("f16c"); break;
+            case cpu_feature_e::ssse3: has |= __builtin_cpu_supports("ssse3"); break;
+            case cpu_feature_e::sse2: has |= __builtin_cpu_supports("sse2"); break;
+            case cpu_feature_e::neon: break;
+        }
+#endif
+        if (has) {
+            m_cpu.push_back(info.feature);
+        }
+    }
+}
+
+bool CpuFeatures::cpu_has(cpu_feature_e feature) const
+{
+    for (const auto f : m_cpu) {
+        if (f == feature) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CpuFeatures::supports(cpu_feature_e feature) const
+{
+    lock_guard<mutex> lock(m_mutex);
+    return cpu_has(feature) and feature_info(feature).rank <= m_limit_rank;
+}
+
+void CpuFeatures::set_limit(const string& limit)
+{
+    int rank = -1;
+    if (limit == "none") {
+        rank = 0;
+    }
+    for (const auto& info : feature_infos) {
+        if (limit == info.name) {
+            rank = info.rank;
+        }
+    }
+
+    if (rank == -1) {
+        throw invalid_argument("Unknown SIMD instruction set " + limit);
+    }
+
+    lock_guard<mutex> lock(m_mutex);
+    if (not m_kernels.empty()) {
+        etiLog.level(warn) << "CpuFeatures: the limit " << limit <<
+            " does not apply to the kernels selected already";
+    }
+    m_limit = limit;
+    m_limit_rank = rank;
+}
+
+void CpuFeatures::register_kernel(const string& module, const string& kernel)
+{
+    lock_guard<mutex> lock(m_mutex);
+    m_kernels[module] = kernel;
+}
+
+vector<string> CpuFeatures::cpu_names() const
+{
+    vector<string> names;
+    for (const auto f : m_cpu) {
+        names.push_back(feature_info(f).name);
+    }
+    return names;
+}
+
+vector<string> CpuFeatures::build_names() const
+{
+    vector<string> names;
+    for (const auto& info : feature_infos) {
+        if (info.build) {
+            names.push_back(info.name);
+        }
+    }
+    return names;
+}
+
+string CpuFeatures::limit() const
+{
+    lock_guard<mutex> lock(m_mutex);
+    return m_limit;
+}
+
+static string join(const vector<string>& strings)
+{
+    stringstream ss;
+    for (const auto& s : strings) {
+        ss << (ss.tellp() ? " " : "") << s;
+    }
+    return ss.str();
+}
+
+map<string, string> CpuFeatures::kernels() const
+{
+    lock_guard<mutex> lock(m_mutex);
+    return m_kernels;
+}
+
+string CpuFeatures::kernels_string() const
+{
+    stringstream ss;
+    for (const auto& k : kernels()) {
+        ss << (ss.tellp() ? " " : "") << k.first << "=" << k.second;
+    }
+    return ss.str();
+}
+
+void CpuFeatures::set_parameter(const string& parameter, const string&)
+{
+    stringstream ss_err;
+    ss_err << "Parameter '" << parameter
+        << "' is read-only or not exported by controllable " << get_rc_name();
+    throw ParameterError(ss_err.str());
+}
+
+const string CpuFeatures::get_parameter(const string& parameter) const
+{
+    stringstream ss;
+    if (parameter == "supported") {
+        ss << join(cpu_names());
+    }
+    else if (parameter == "build") {
+        ss << join(build_names());
+    }
+    else if (parameter == "limit") {
+        ss << limit();
+    }
+    else if (parameter == "kernels") {
+        ss << kernels_string();
+    }
+    else {
+        ss << "Parameter '" << parameter <<
+            "' is not exported by controllable " << get_rc_name();
+        throw ParameterError(ss.str());
+    }
+    return ss.str();
+}
+
+const json::map_t CpuFeatures::get_all_values() const
+{
+    json::map_t map;
+    map["supported"].v = join(cpu_names());
+    map["build"].v = join(build_names());
+    map["limit"].v = limit();
+    map["kernels"].v = kernels_string();
+    return map;
+}
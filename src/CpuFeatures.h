@@ -0,0 +1,114 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   Detection of the SIMD instruction sets of the CPU, from which the
+   modules select their kernels at runtime
+*/
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "RemoteControl.h"
+
+/* On x86, the kernels using more than the instruction sets the program is
+ * compiled for are built with the target attribute of GCC and clang. */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#  define HAVE_CPU_FEATURES_DISPATCH 1
+#endif
+
+/* In increasing order on x86, F16C is allowed together with AVX. NEON
+ * is the only one on ARM. */
+enum class cpu_feature_e {
+    sse2,
+    ssse3,
+    avx,
+    f16c,
+    avx2,
+    avx512f,
+    neon,
+};
+
+/* Every module selecting a kernel at runtime asks here whether it can use
+ * an instruction set, and records which kernel it selected. The kernels
+ * are selected once, when the first block that uses them is created. */
+class CpuFeatures : public RemoteControllable {
+    public:
+        CpuFeatures();
+        CpuFeatures(const CpuFeatures& other) = delete;
+        CpuFeatures& operator=(const CpuFeatures& other) = delete;
+
+        /* True if the CPU supports the instruction set and the limit
+         * allows it */
+        bool supports(cpu_feature_e feature) const;
+
+        /* Only select kernels up to the given instruction set: avx512f,
+         * avx2, avx, ssse3, sse2, neon, or none for the scalar kernels
+         * where they exist. Throws an invalid_argument for other names. */
+        void set_limit(const std::string& limit);
+
+        void register_kernel(const std::string& module,
+                const std::string& kernel);
+
+        /* Instruction sets the CPU supports, and those the program is
+         * compiled for */
+        std::vector<std::string> cpu_names() const;
+        std::vector<std::string> build_names() const;
+
+        // Highest allowed instruction set, empty when there is no limit
+        std::string limit() const;
+
+        /* Module name to the name of its kernel */
+        std::map<std::string, std::string> kernels() const;
+
+        /******* REMOTE CONTROL ********/
+        virtual void set_parameter(const std::string& parameter,
+                const std::string& value) override;
+
+        virtual const std::string get_parameter(
+                const std::string& parameter) const override;
+
+        virtual const json::map_t get_all_values() const override;
+
+    private:
+        bool cpu_has(cpu_feature_e feature) const;
+        std::string kernels_string() const;
+
+        std::vector<cpu_feature_e> m_cpu;
+
+        mutable std::mutex m_mutex;
+        // Empty when there is no limit
+        std::string m_limit;
+        int m_limit_rank;
+        std::map<std::string, std::string> m_kernels;
+};
+
+/* Shared by all modules, constructed at the first call */
+CpuFeatures& cpu_features();
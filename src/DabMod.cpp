@@ -30,8 +30,16 @@
 #   include "config.h"
 #endif
 
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <iomanip>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 #include <iostream>
 #include <cstdlib>
 #include <stdexcept>
@@ -47,23 +55,39 @@
 
 #include "Events.h"
 #include "Utils.h"
+#include "AllocationTracker.h"
 #include "Log.h"
 #include "DabModulator.h"
+#include "EnsembleMixer.h"
 #include "OutputFile.h"
 #include "FormatConverter.h"
 #include "FrameMultiplexer.h"
+#include "FrameTracer.h"
 #include "output/SDR.h"
 #include "output/UHD.h"
 #include "output/Soapy.h"
 #include "output/Dexter.h"
 #include "output/Lime.h"
 #include "output/BladeRF.h"
+#include "output/Simulated.h"
 #include "OutputZeroMQ.h"
+#include "OutputVita49.h"
+#include "OutputTee.h"
+#include "OutputRecorder.h"
+#include "OutputCarousel.h"
+#include "IQFilePlayer.h"
 #include "InputReader.h"
+#include "InputPrefetcher.h"
 #include "PcDebug.h"
 #include "FIRFilter.h"
 #include "RemoteControl.h"
 #include "ConfigParser.h"
+#include "FFTEngineSelector.h"
+#include "OfdmBatchService.h"
+#include "OfflineRenderer.h"
+#include "RunReport.h"
+#include "WorkerPool.h"
+#include "PipelineExecutor.h"
 
 /* UHD requires the input I and Q samples to be in the interval
  * [-1.0,1.0], otherwise they get truncated, which creates very
@@ -102,9 +126,24 @@ class ModulatorData : public RemoteControllable {
         // For EDI
         std::shared_ptr<EdiInput> ediInput;
 
+        // Receives the ETI or EDI input in its own thread, if enabled
+        std::shared_ptr<InputPrefetcher> inputPrefetcher;
+
         // Common to both EDI and EDI
         uint64_t framecount = 0;
         Flowgraph *flowgraph = nullptr;
+        std::shared_ptr<DabModulator> modulator;
+        // Not driven while the modulator is in standby
+        std::shared_ptr<ModPlugin> output;
+        bool output_enabled = true;
+        // Kept from one run of the modulator to the next
+        DabModulator::state_t modulator_state;
+        // Records one loop of the input file, if enabled
+        std::shared_ptr<OutputCarousel> carousel;
+        size_t carousel_loop_frames = 0;
+        // With fft_engine=auto, the engines the benchmark considered
+        FFTEngine fft_engine = FFTEngine::FFTW;
+        std::vector<fft_engine_candidate_t> fft_engine_candidates;
 
 
         // RC-related
@@ -112,11 +151,49 @@ class ModulatorData : public RemoteControllable {
             RC_ADD_PARAMETER(num_modulator_restarts, "(Read-only) Number of mod restarts");
             RC_ADD_PARAMETER(most_recent_edi_decoded, "(Read-only) UNIX Timestamp of most recently decoded EDI frame");
             RC_ADD_PARAMETER(edi_source, "(Read-only) URL of the EDI/TCP source");
+            RC_ADD_PARAMETER(edi_paths, "(Read-only, only JSON) First and late arrivals of every EDI source");
+            RC_ADD_PARAMETER(edi_tist_margin, "(Read-only, only JSON) How long before their transmission time the EDI frames arrived");
             RC_ADD_PARAMETER(running_since, "(Read-only) UNIX Timestamp of most recent modulator restart");
             RC_ADD_PARAMETER(ensemble_label, "(Read-only) Label of the ensemble");
             RC_ADD_PARAMETER(ensemble_eid, "(Read-only) Ensemble ID");
             RC_ADD_PARAMETER(ensemble_services, "(Read-only, only JSON) Ensemble service information");
             RC_ADD_PARAMETER(num_services, "(Read-only) Number of services in the ensemble");
+            RC_ADD_PARAMETER(flowgraph_latency, "(Read-only, only JSON) Processing time statistics of all modulator blocks");
+            RC_ADD_PARAMETER(input_queue_level, "(Read-only) Number of frames in the input prefetch queue");
+            RC_ADD_PARAMETER(input_queue_overflows, "(Read-only) Number of frames dropped because the input prefetch queue was full");
+            RC_ADD_PARAMETER(input_queue_underflows, "(Read-only) Number of times the modulator found the input prefetch queue empty");
+            RC_ADD_PARAMETER(startup_timeline, "(Read-only) Milliseconds from the most recent modulator start to each startup step");
+            RC_ADD_PARAMETER(late_buffer_allocations, "(Read-only) Number of buffers allocated after the warm-up of the modulator");
+            RC_ADD_PARAMETER(thread_stats, "(Read-only, only JSON) CPU usage, context switches and page faults of every thread");
+            RC_ADD_PARAMETER(thread_allocations, "(Read-only, only JSON) Heap allocations of every thread, if allocation tracking is enabled");
+            RC_ADD_PARAMETER(memory, "(Read-only, only JSON) Bytes of memory of the modulator blocks, the flowgraph buffers, the output and the buffer pool");
+            RC_ADD_PARAMETER(fft_engine, "(Read-only) FFT engine of the modulator");
+            RC_ADD_PARAMETER(fft_engine_candidates, "(Read-only, only JSON) Speed and SNR of the engines benchmarked for fft_engine=auto");
+        }
+
+        /* The startup timeline begins at the start of the ensemble and at
+         * every restart of the modulator. Steps can be marked from any
+         * thread. */
+        void timeline_start() {
+            std::lock_guard<std::mutex> lock(m_timeline_mutex);
+            m_timeline_start = chrono::steady_clock::now();
+            m_timeline.clear();
+        }
+
+        void timeline_mark(const std::string& step) {
+            std::lock_guard<std::mutex> lock(m_timeline_mutex);
+            m_timeline.emplace_back(step, chrono::duration<double, std::milli>(
+                        chrono::steady_clock::now() - m_timeline_start).count());
+        }
+
+        std::string timeline_to_string() const {
+            std::lock_guard<std::mutex> lock(m_timeline_mutex);
+            stringstream ss;
+            ss << std::fixed << std::setprecision(0);
+            for (const auto& step : m_timeline) {
+                ss << (ss.tellp() > 0 ? " " : "") << step.first << "=" << step.second;
+            }
+            return ss.str();
         }
 
         virtual ~ModulatorData() {}
@@ -183,6 +260,54 @@ class ModulatorData : public RemoteControllable {
             else if (parameter == "ensemble_services") {
                 throw ParameterError("ensemble_services is only available through 'showjson'");
             }
+            else if (parameter == "startup_timeline") {
+                ss << timeline_to_string();
+            }
+            else if (parameter == "late_buffer_allocations") {
+                ss << late_buffer_allocations;
+            }
+            else if (parameter == "flowgraph_latency") {
+                throw ParameterError("flowgraph_latency is only available through 'showjson'");
+            }
+            else if (parameter == "edi_paths") {
+                throw ParameterError("edi_paths is only available through 'showjson'");
+            }
+            else if (parameter == "edi_tist_margin") {
+                throw ParameterError("edi_tist_margin is only available through 'showjson'");
+            }
+            else if (parameter == "thread_stats") {
+                throw ParameterError("thread_stats is only available through 'showjson'");
+            }
+            else if (parameter == "thread_allocations") {
+                throw ParameterError("thread_allocations is only available through 'showjson'");
+            }
+            else if (parameter == "memory") {
+                throw ParameterError("memory is only available through 'showjson'");
+            }
+            else if (parameter == "fft_engine") {
+                ss << RunReport::fft_engine_name(fft_engine);
+            }
+            else if (parameter == "fft_engine_candidates") {
+                throw ParameterError("fft_engine_candidates is only available through 'showjson'");
+            }
+            else if (parameter == "input_queue_level" or
+                    parameter == "input_queue_overflows" or
+                    parameter == "input_queue_underflows") {
+                auto prefetcher = inputPrefetcher;
+                if (not prefetcher) {
+                    throw ParameterError("Input prefetching is not enabled");
+                }
+
+                if (parameter == "input_queue_level") {
+                    ss << prefetcher->level();
+                }
+                else if (parameter == "input_queue_overflows") {
+                    ss << prefetcher->num_overflows();
+                }
+                else {
+                    ss << prefetcher->num_underflows();
+                }
+            }
             else {
                 ss << "Parameter '" << parameter <<
                     "' is not exported by controllable " << get_rc_name();
@@ -197,6 +322,7 @@ class ModulatorData : public RemoteControllable {
             map["num_modulator_restarts"].v = num_modulator_restarts;
             map["running_since"].v = running_since;
             map["most_recent_edi_decoded"].v = most_recent_edi_decoded;
+            map["late_buffer_allocations"].v = late_buffer_allocations;
 
             if (ediInput) {
                 map["edi_source"].v = ediInput->ediTransport.getTcpUri();
@@ -228,13 +354,213 @@ class ModulatorData : public RemoteControllable {
 
                 map["ensemble_services"].v = services;
 
+                const auto& uris = ediInput->ediTransport.getSourceUris();
+                const auto path_stats =
+                    ediInput->decoder.get_path_statistics().get();
+                std::vector<json::value_t> paths;
+                for (size_t i = 0; i < uris.size(); i++) {
+                    EdiDecoder::PathStatistics::source_stats_t st;
+                    if (i < path_stats.size()) {
+                        st = path_stats[i];
+                    }
+
+                    auto path_map = make_shared<json::map_t>();
+                    (*path_map)["uri"].v = uris[i];
+                    (*path_map)["num_first"].v = st.num_first;
+                    (*path_map)["num_late"].v = st.num_late;
+                    (*path_map)["late_p50_us"].v = st.late_p50_us;
+                    (*path_map)["late_p99_us"].v = st.late_p99_us;
+                    (*path_map)["late_max_us"].v = st.late_max_us;
+                    json::value_t v;
+                    v.v = path_map;
+                    paths.push_back(v);
+                }
+                map["edi_paths"].v = paths;
+
+                const auto margins = ediInput->ediReader.getTistMargins().get();
+                auto margin_map = make_shared<json::map_t>();
+                (*margin_map)["num_frames"].v = margins.num_frames;
+                (*margin_map)["num_late"].v = margins.num_late;
+                (*margin_map)["min_us"].v = margins.min_us;
+                (*margin_map)["p1_us"].v = margins.p1_us;
+                (*margin_map)["p50_us"].v = margins.p50_us;
+                (*margin_map)["max_us"].v = margins.max_us;
+                std::vector<json::value_t> bins;
+                for (const auto& b : margins.bins) {
+                    auto bin_map = make_shared<json::map_t>();
+                    (*bin_map)["upper_us"].v = b.first;
+                    (*bin_map)["count"].v = b.second;
+                    json::value_t v;
+                    v.v = bin_map;
+                    bins.push_back(v);
+                }
+                (*margin_map)["bins"].v = bins;
+                map["edi_tist_margin"].v = margin_map;
+            }
+            else {
+                map["edi_paths"].v = nullopt;
+                map["edi_tist_margin"].v = nullopt;
+            }
+
+            auto mod = modulator;
+            if (mod) {
+                map["flowgraph_latency"].v = mod->get_latency_statistics();
+            }
+            else {
+                map["flowgraph_latency"].v = nullopt;
+            }
+
+            auto prefetcher = inputPrefetcher;
+            if (prefetcher) {
+                map["input_queue_level"].v = prefetcher->level();
+                map["input_queue_overflows"].v = prefetcher->num_overflows();
+                map["input_queue_underflows"].v = prefetcher->num_underflows();
+            }
+            else {
+                map["input_queue_level"].v = nullopt;
+                map["input_queue_overflows"].v = nullopt;
+                map["input_queue_underflows"].v = nullopt;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_timeline_mutex);
+                auto timeline_map = make_shared<json::map_t>();
+                for (const auto& step : m_timeline) {
+                    (*timeline_map)[step.first].v = step.second;
+                }
+                map["startup_timeline"].v = timeline_map;
+            }
+
+            map["thread_stats"].v = thread_stats_to_json();
+
+            if (alloc_tracking::mode() != alloc_tracking::mode_e::off) {
+                auto allocs_map = make_shared<json::map_t>();
+                for (const auto& t : alloc_tracking::get_thread_counts()) {
+                    auto thread_map = make_shared<json::map_t>();
+                    (*thread_map)["allocations"].v = t.second.allocations;
+                    (*thread_map)["allocated_bytes"].v = t.second.bytes;
+                    (*thread_map)["steady_allocations"].v = t.second.steady_allocations;
+                    (*allocs_map)[t.first].v = thread_map;
+                }
+                map["thread_allocations"].v = allocs_map;
+            }
+            else {
+                map["thread_allocations"].v = nullopt;
+            }
+
+            {
+                // The blocks also appear in flowgraph_latency
+                auto memory_map = make_shared<json::map_t>();
+                const auto usage = mod ? mod->get_memory_usage() :
+                    Flowgraph::memory_usage_t();
+                auto out = output;
+                const size_t output_bytes = out ? out->memory_usage() : 0;
+                const size_t pooled_bytes = get_pooled_bytes();
+                (*memory_map)["blocks"].v = usage.nodes;
+                (*memory_map)["edge_buffers"].v = usage.edge_buffers;
+                (*memory_map)["output"].v = output_bytes;
+                (*memory_map)["buffer_pool"].v = pooled_bytes;
+                (*memory_map)["total"].v = usage.nodes + usage.edge_buffers +
+                    output_bytes + pooled_bytes;
+                map["memory"].v = memory_map;
+            }
+
+            map["fft_engine"].v = RunReport::fft_engine_name(fft_engine);
+            if (fft_engine_candidates.empty()) {
+                map["fft_engine_candidates"].v = nullopt;
+            }
+            else {
+                std::vector<json::value_t> candidates;
+                for (const auto& c : fft_engine_candidates) {
+                    auto candidate_map = make_shared<json::map_t>();
+                    (*candidate_map)["engine"].v = RunReport::fft_engine_name(c.engine);
+                    (*candidate_map)["chosen"].v = (c.engine == fft_engine);
+                    if (c.rejected.empty()) {
+                        (*candidate_map)["rejected"].v = nullopt;
+                    }
+                    else {
+                        (*candidate_map)["rejected"].v = c.rejected;
+                    }
+                    if (c.frame_time_us > 0) {
+                        (*candidate_map)["frame_time_us"].v = c.frame_time_us;
+                    }
+                    else {
+                        (*candidate_map)["frame_time_us"].v = nullopt;
+                    }
+                    // The reference and the engines that did not run
+                    // have no SNR
+                    if (c.engine != FFTEngine::FFTW and c.frame_time_us > 0) {
+                        (*candidate_map)["snr_db"].v = c.snr_db;
+                    }
+                    else {
+                        (*candidate_map)["snr_db"].v = nullopt;
+                    }
+                    json::value_t v;
+                    v.v = candidate_map;
+                    candidates.push_back(v);
+                }
+                map["fft_engine_candidates"].v = candidates;
             }
             return map;
         }
 
+        /* The CPU usage of a thread, in percent of one CPU, is computed
+         * over the time since the previous query of the statistics. */
+        std::shared_ptr<json::map_t> thread_stats_to_json() const
+        {
+            const auto now = chrono::steady_clock::now();
+            auto stats = get_thread_stats();
+
+            std::lock_guard<std::mutex> lock(m_thread_stats_mutex);
+            const double elapsed = chrono::duration<double>(
+                    now - m_thread_stats_time).count();
+
+            auto stats_map = make_shared<json::map_t>();
+            for (const auto& s : stats) {
+                auto thread_map = make_shared<json::map_t>();
+                (*thread_map)["num_threads"].v = s.second.num_threads;
+                (*thread_map)["user_time"].v = s.second.user_time;
+                (*thread_map)["system_time"].v = s.second.system_time;
+                (*thread_map)["voluntary_switches"].v = s.second.voluntary_switches;
+                (*thread_map)["involuntary_switches"].v = s.second.involuntary_switches;
+                (*thread_map)["minor_faults"].v = s.second.minor_faults;
+                (*thread_map)["major_faults"].v = s.second.major_faults;
+
+                const auto prev = m_thread_stats.find(s.first);
+                if (prev != m_thread_stats.end() and elapsed > 0 and
+                        prev->second.num_threads == s.second.num_threads) {
+                    const double cpu_time =
+                        s.second.user_time + s.second.system_time -
+                        prev->second.user_time - prev->second.system_time;
+                    (*thread_map)["cpu_percent"].v =
+                        std::max(0.0, 100.0 * cpu_time / elapsed);
+                }
+                else {
+                    (*thread_map)["cpu_percent"].v = nullopt;
+                }
+
+                (*stats_map)[s.first].v = thread_map;
+            }
+
+            m_thread_stats = std::move(stats);
+            m_thread_stats_time = now;
+            return stats_map;
+        }
+
         size_t num_modulator_restarts = 0;
+        uint64_t late_buffer_allocations = 0;
         time_t most_recent_edi_decoded = 0;
         time_t running_since = 0;
+
+    private:
+        mutable std::mutex m_timeline_mutex;
+        chrono::steady_clock::time_point m_timeline_start = chrono::steady_clock::now();
+        std::vector<std::pair<std::string, double> > m_timeline;
+
+        // The thread statistics at the previous query
+        mutable std::mutex m_thread_stats_mutex;
+        mutable std::map<std::string, thread_stats_t> m_thread_stats;
+        mutable chrono::steady_clock::time_point m_thread_stats_time;
 };
 
 enum class run_modulator_state_t {
@@ -245,7 +571,62 @@ enum class run_modulator_state_t {
 };
 
 static run_modulator_state_t run_modulator(const mod_settings_t& mod_settings, ModulatorData& m);
+static int run_ensemble(mod_settings_t mod_settings,
+        shared_ptr<EnsembleMixer> mixer);
+
 
+static const char* run_modulator_state_name(run_modulator_state_t st)
+{
+    switch (st) {
+        case run_modulator_state_t::failure: return "failure";
+        case run_modulator_state_t::normal_end: return "normal_end";
+        case run_modulator_state_t::again: return "again";
+        case run_modulator_state_t::reconfigure: return "reconfigure";
+    }
+    return "unknown";
+}
+
+/* One line of JSON per modulator run, with the statistics of the blocks
+ * of the modulator and of the flowgraph around it, which contains the
+ * output. */
+static void write_run_report(const mod_settings_t& s, const ModulatorData& m,
+        const Flowgraph& flowgraph, run_modulator_state_t st)
+{
+    auto as_value = [](json::map_t&& map) {
+        json::value_t v;
+        v.v = make_shared<json::map_t>(std::move(map));
+        return v;
+    };
+
+    json::map_t report;
+    report["type"].v = string("modulator");
+    report["time"].v = RunReport::timestamp();
+    report["build"] = as_value(RunReport::build_info());
+    report["settings"] = as_value(RunReport::settings_info(s));
+    report["running_since"].v = (int64_t)m.running_since;
+    report["duration_s"].v = (double)(get_clock_realtime_seconds() - m.running_since);
+    report["frames"].v = m.framecount;
+    report["end"].v = string(run_modulator_state_name(st));
+    report["output"].v = flowgraph.get_latency_statistics();
+    if (m.modulator) {
+        report["modulator"].v = m.modulator->get_latency_statistics();
+    }
+
+    try {
+        RunReport::append(s.runReportFile, report);
+    }
+    catch (const runtime_error& e) {
+        etiLog.level(warn) << e.what();
+    }
+}
+
+static shared_ptr<ModOutput> make_file_output(const mod_settings_t& s)
+{
+    auto output = make_shared<OutputFile>(s.outputName, s.fileOutputShowMetadata,
+            s.fileOutputAsyncBufferSize, s.fileOutputDirectIO);
+    rcs.enrol(output.get());
+    return output;
+}
 
 static shared_ptr<ModOutput> prepare_output(mod_settings_t& s)
 {
@@ -254,10 +635,10 @@ static shared_ptr<ModOutput> prepare_output(mod_settings_t& s)
     if (s.useFileOutput) {
         if (s.fftEngine != FFTEngine::FFTW) {
             // Intentionally ignore fileOutputFormat, it is always sc16
-            output = make_shared<OutputFile>(s.outputName, s.fileOutputShowMetadata);
+            output = make_file_output(s);
         }
         else if (s.fileOutputFormat == "complexf") {
-            output = make_shared<OutputFile>(s.outputName, s.fileOutputShowMetadata);
+            output = make_file_output(s);
         }
         else if (s.fileOutputFormat == "complexf_normalised") {
             if (s.gainMode == GainMode::GAIN_FIX)
@@ -266,13 +647,19 @@ static shared_ptr<ModOutput> prepare_output(mod_settings_t& s)
                 s.normalise = 1.0f / normalise_factor_file_max;
             else if (s.gainMode == GainMode::GAIN_VAR)
                 s.normalise = 1.0f / normalise_factor_file_var;
-            output = make_shared<OutputFile>(s.outputName, s.fileOutputShowMetadata);
+            output = make_file_output(s);
         }
         else if (s.fileOutputFormat == "s16") {
             // We must normalise the samples to the interval [-32767.0; 32767.0]
             s.normalise = 32767.0f / normalise_factor;
 
-            output = make_shared<OutputFile>(s.outputName, s.fileOutputShowMetadata);
+            output = make_file_output(s);
+        }
+        else if (s.fileOutputFormat == "sc12") {
+            // We must normalise the samples to the interval [-2047.0; 2047.0]
+            s.normalise = 2047.0f / normalise_factor;
+
+            output = make_file_output(s);
         }
         else if (s.fileOutputFormat == "s8" or
                 s.fileOutputFormat == "u8") {
@@ -281,7 +668,7 @@ static shared_ptr<ModOutput> prepare_output(mod_settings_t& s)
             // [0; 255]
             s.normalise = 127.0f / normalise_factor;
 
-            output = make_shared<OutputFile>(s.outputName, s.fileOutputShowMetadata);
+            output = make_file_output(s);
         }
         else {
             throw runtime_error("File output format " + s.fileOutputFormat +
@@ -290,7 +677,12 @@ static shared_ptr<ModOutput> prepare_output(mod_settings_t& s)
     }
 #if defined(HAVE_OUTPUT_UHD)
     else if (s.useUHDOutput) {
-        s.normalise = 1.0f / normalise_factor;
+        if (s.sdr_device_config.sampleFormat == "s16") {
+            s.normalise = 32767.0f / normalise_factor;
+        }
+        else {
+            s.normalise = 1.0f / normalise_factor;
+        }
         s.sdr_device_config.sampleRate = s.outputRate;
         s.sdr_device_config.fixedPoint = (s.fftEngine != FFTEngine::FFTW);
         auto uhddevice = make_shared<Output::UHD>(s.sdr_device_config);
@@ -300,8 +692,17 @@ static shared_ptr<ModOutput> prepare_output(mod_settings_t& s)
 #endif
 #if defined(HAVE_SOAPYSDR)
     else if (s.useSoapyOutput) {
-        /* We normalise the same way as for the UHD output */
-        s.normalise = 1.0f / normalise_factor;
+        /* We normalise the same way as for the UHD output, or to the range
+         * of the integer format */
+        if (s.sdr_device_config.sampleFormat == "s16") {
+            s.normalise = 32767.0f / normalise_factor;
+        }
+        else if (s.sdr_device_config.sampleFormat == "sc12") {
+            s.normalise = 2047.0f / normalise_factor;
+        }
+        else {
+            s.normalise = 1.0f / normalise_factor;
+        }
         s.sdr_device_config.sampleRate = s.outputRate;
         if (s.fftEngine != FFTEngine::FFTW) throw runtime_error("soapy fixed_point unsupported");
         auto soapydevice = make_shared<Output::Soapy>(s.sdr_device_config);
@@ -321,8 +722,15 @@ static shared_ptr<ModOutput> prepare_output(mod_settings_t& s)
 #endif
 #if defined(HAVE_LIMESDR)
     else if (s.useLimeOutput) {
-        /* We normalise the same way as for the UHD output */
-        s.normalise = 1.0f / normalise_factor;
+        /* The FormatConverter gives s16 samples to the Lime, except when
+         * the DPD feedback server needs complexf samples. Otherwise we
+         * normalise the same way as for the UHD output */
+        if (s.sdr_device_config.dpdFeedbackServerPort == 0) {
+            s.normalise = 32767.0f / normalise_factor;
+        }
+        else {
+            s.normalise = 1.0f / normalise_factor;
+        }
         if (s.fftEngine != FFTEngine::FFTW) throw runtime_error("limesdr fixed_point unsupported");
         s.sdr_device_config.sampleRate = s.outputRate;
         auto limedevice = make_shared<Output::Lime>(s.sdr_device_config);
@@ -341,15 +749,34 @@ static shared_ptr<ModOutput> prepare_output(mod_settings_t& s)
         rcs.enrol((Output::SDR*)output.get());
     }
 #endif
+    else if (s.useSimulatedOutput) {
+        /* We normalise the same way as for the UHD output */
+        if (s.sdr_device_config.sampleFormat == "s16") {
+            s.normalise = 32767.0f / normalise_factor;
+        }
+        else {
+            s.normalise = 1.0f / normalise_factor;
+        }
+        s.sdr_device_config.sampleRate = s.outputRate;
+        auto simulateddevice = make_shared<Output::Simulated>(s.sdr_device_config);
+        output = make_shared<Output::SDR>(s.sdr_device_config, simulateddevice);
+        rcs.enrol((Output::SDR*)output.get());
+    }
 #if defined(HAVE_ZEROMQ)
     else if (s.useZeroMQOutput) {
         /* We normalise the same way as for the UHD output */
         s.normalise = 1.0f / normalise_factor;
         if (s.zmqOutputSocketType == "pub") {
-            output = make_shared<OutputZeroMQ>(s.outputName, ZMQ_PUB);
+            output = make_shared<OutputZeroMQ>(s.outputName, ZMQ_PUB,
+                    s.zmqOutputSndHwm, s.zmqOutputHeader);
         }
         else if (s.zmqOutputSocketType == "rep") {
-            output = make_shared<OutputZeroMQ>(s.outputName, ZMQ_REP);
+            output = make_shared<OutputZeroMQ>(s.outputName, ZMQ_REP,
+                    s.zmqOutputSndHwm, s.zmqOutputHeader);
+        }
+        else if (s.zmqOutputSocketType == "push") {
+            output = make_shared<OutputZeroMQ>(s.outputName, ZMQ_PUSH,
+                    s.zmqOutputSndHwm, s.zmqOutputHeader);
         }
         else {
             std::stringstream ss;
@@ -358,99 +785,82 @@ static shared_ptr<ModOutput> prepare_output(mod_settings_t& s)
         }
     }
 #endif
+    else if (s.useVita49Output) {
+        /* We normalise to the range of the integer format, or the same way
+         * as for the UHD output */
+        if (s.vita49OutputFormat == "s16") {
+            s.normalise = 32767.0f / normalise_factor;
+        }
+        else {
+            s.normalise = 1.0f / normalise_factor;
+        }
+        output = make_shared<OutputVita49>(s.outputName, s.vita49OutputPort,
+                s.vita49OutputFormat, s.vita49OutputStreamId,
+                s.vita49OutputMaxPacketSize, s.outputRate);
+    }
 
     return output;
 }
 
-int launch_modulator(int argc, char* argv[])
+/* The samples of the file replace those of the modulator, the output and
+ * its remote control, DPD feedback server and predistortion engine work
+ * as usual. */
+static int run_iq_playback(const mod_settings_t& mod_settings,
+        const std::string& output_format, shared_ptr<ModOutput> output)
 {
-    int ret = 0;
-
-    struct sigaction sa;
-    memset(&sa, 0, sizeof(struct sigaction));
-    sa.sa_handler = &signalHandler;
-
-    if (sigaction(SIGINT, &sa, NULL) == -1) {
-        const string errstr = strerror(errno);
-        throw runtime_error("Could not set signal handler: " + errstr);
+    // Same sample size as given to the SDR output
+    size_t sample_size = sizeof(complexf);
+    if (not output_format.empty()) {
+        sample_size = FormatConverter::get_format_size(output_format);
     }
-
-    printStartupInfo();
-
-    mod_settings_t mod_settings;
-    parse_args(argc, argv, mod_settings);
-
-#if defined(HAVE_ZEROMQ)
-    etiLog.register_backend(make_shared<LogToEventSender>());
-#endif // defined(HAVE_ZEROMQ)
-
-    etiLog.level(info) << "Configuration parsed. Starting up version " <<
-#if defined(GITVERSION)
-            GITVERSION;
-#else
-            VERSION;
-#endif
-
-    if (not (mod_settings.useFileOutput or
-             mod_settings.useUHDOutput or
-             mod_settings.useZeroMQOutput or
-             mod_settings.useSoapyOutput or
-             mod_settings.useDexterOutput or
-             mod_settings.useLimeOutput or
-             mod_settings.useBladeRFOutput)) {
-        throw std::runtime_error("Configuration error: Output not specified");
+    else if (mod_settings.fftEngine == FFTEngine::DEXTER) {
+        sample_size = 2 * sizeof(int32_t);
+    }
+    else if (mod_settings.fftEngine != FFTEngine::FFTW) {
+        sample_size = sizeof(complexfix);
     }
 
-    if (not mod_settings.startupCheck.empty()) {
-        etiLog.level(info) << "Running startup check '" << mod_settings.startupCheck << "'";
-        int wstatus = system(mod_settings.startupCheck.c_str());
+    try {
+        IQFilePlayer player(mod_settings, sample_size);
+        etiLog.level(info) << player.get_info();
 
-        if (WIFEXITED(wstatus)) {
-            if (WEXITSTATUS(wstatus) == 0) {
-                etiLog.level(info) << "Startup check ok";
-            }
-            else {
-                etiLog.level(error) << "Startup check failed, returned " << WEXITSTATUS(wstatus);
-                return 1;
-            }
-        }
-        else {
-            etiLog.level(error) << "Startup check failed, child didn't terminate normally";
-            return 1;
+        while (running and player.play_next(*output)) {
         }
     }
+    catch (const std::exception& e) {
+        etiLog.level(error) << "I/Q playback failed: " << e.what();
+        return 1;
+    }
+
+    etiLog.level(info) << "I/Q playback stopped.";
+    return 0;
+}
+
+/* With frequency multiplexing, the mixer is shared by all ensembles. */
+static int run_ensemble(mod_settings_t mod_settings,
+        shared_ptr<EnsembleMixer> mixer)
+{
+    int ret = 0;
 
     printModSettings(mod_settings);
 
     ModulatorData m;
+    m.fft_engine = mod_settings.fftEngine;
+    m.fft_engine_candidates = mod_settings.fftEngineCandidates;
     rcs.enrol(&m);
-
-    // Neither KISS FFT used for fixedpoint nor the FFT Accelerator used for DEXTER need planning.
-    if (mod_settings.fftEngine == FFTEngine::FFTW) {
-        // This is mostly useful on ARM systems where FFTW planning takes some time. If we do it here
-        // it will be done before the modulator starts up
-        etiLog.level(debug) << "Running FFTW planning...";
-        constexpr size_t fft_size = 2048; // Transmission Mode I. If different, it'll recalculate on OfdmGenerator
-                                          // initialisation
-        auto *fft_in = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * fft_size);
-        auto *fft_out = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * fft_size);
-        if (fft_in == nullptr or fft_out == nullptr) {
-            throw std::runtime_error("FFTW malloc failed");
-        }
-        fftwf_set_timelimit(2);
-        fftwf_plan plan = fftwf_plan_dft_1d(fft_size, fft_in, fft_out, FFTW_FORWARD, FFTW_MEASURE);
-        fftwf_destroy_plan(plan);
-        plan = fftwf_plan_dft_1d(fft_size, fft_in, fft_out, FFTW_BACKWARD, FFTW_MEASURE);
-        fftwf_destroy_plan(plan);
-        fftwf_free(fft_in);
-        fftwf_free(fft_out);
-        etiLog.level(debug) << "FFTW planning done.";
-    }
+    m.timeline_start();
 
     std::string output_format;
-    if (mod_settings.fftEngine == FFTEngine::KISS) {
+    if (mod_settings.fftEngine == FFTEngine::KISS or
+            mod_settings.fftEngine == FFTEngine::KISS_SIMD) {
         output_format = ""; //fixed point is native sc16, no converter needed
     }
+    else if (mod_settings.fftEngine == FFTEngine::DEXTER and
+            mod_settings.useDexterOutput) {
+        // FPGA FFT Engine outputs s32, that the Dexter output converts
+        // directly into its IIO buffers
+        output_format = "";
+    }
     else if (mod_settings.fftEngine == FFTEngine::DEXTER) {
         output_format = "s16"; // FPGA FFT Engine outputs s32
     }
@@ -458,37 +868,133 @@ int launch_modulator(int argc, char* argv[])
     else if (mod_settings.useFileOutput and
             (mod_settings.fileOutputFormat == "s8" or
              mod_settings.fileOutputFormat == "u8" or
-             mod_settings.fileOutputFormat == "s16")) {
+             mod_settings.fileOutputFormat == "s16" or
+             mod_settings.fileOutputFormat == "sc12")) {
         output_format = mod_settings.fileOutputFormat;
     }
-    else if (mod_settings.useBladeRFOutput or mod_settings.useDexterOutput) {
+    else if (mod_settings.useVita49Output and
+            mod_settings.vita49OutputFormat == "s16") {
+        output_format = "s16";
+    }
+    else if (mod_settings.useUHDOutput or
+            mod_settings.useSoapyOutput or
+            mod_settings.useSimulatedOutput) {
+        output_format = mod_settings.sdr_device_config.sampleFormat;
+    }
+    else if (mod_settings.useLimeOutput and
+            mod_settings.sdr_device_config.dpdFeedbackServerPort == 0) {
+        output_format = "s16";
+    }
+    else if (mod_settings.useBladeRFOutput) {
+        // The FormatConverter clips to the 12-bit range of the DAC, and
+        // its output is given to libbladeRF as is
+        output_format = "sc16q11";
+    }
+    else if (mod_settings.useDexterOutput) {
         output_format = "s16";
     }
 
-    auto output = prepare_output(mod_settings);
+    if (mod_settings.fileOutputOffline) {
+        // The renderer writes the output file itself, prepare_output
+        // only sets the normalisation
+        prepare_output(mod_settings).reset();
+        OfflineRenderer renderer(mod_settings, output_format);
+        renderer.run();
+        return 0;
+    }
 
-    if (not output_format.empty()) {
-        if (auto o = dynamic_pointer_cast<Output::SDR>(output)) {
-            o->set_sample_size(FormatConverter::get_format_size(output_format));
-        }
+    /* The initialisation of the device, several seconds for some SDRs,
+     * runs while the input gets opened. prepare_output only changes the
+     * output and normalisation settings, which the input does not use. */
+    future<shared_ptr<ModOutput> > output_future;
+    if (mixer and mod_settings.fdmIndex > 0) {
+        // Normalised like for the UHD output, the EnsembleMixer brings it
+        // to the scale of the first ensemble
+        mod_settings.normalise = 1.0f / normalise_factor;
+        promise<shared_ptr<ModOutput> > sink;
+        sink.set_value(make_shared<EnsembleMixerSink>(mixer,
+                mod_settings.fdmIndex, mod_settings.normalise));
+        output_future = sink.get_future();
+    }
+    else {
+        output_future = async_with_rc_name_prefix([&]() {
+                    auto o = prepare_output(mod_settings);
+                    m.timeline_mark("output");
+                    return o;
+                });
     }
 
     // Set thread priority to realtime
     if (int r = set_realtime_prio(1)) {
         etiLog.level(error) << "Could not set priority for modulator:" << r;
     }
+    set_thread_placement("modulator");
+
+    if (mod_settings.lockMemory) {
+        // Deeper than the flowgraph gets
+        prefault_stack(512 * 1024);
+    }
 
     shared_ptr<InputReader> inputReader;
     shared_ptr<EdiInput> ediInput;
 
     if (mod_settings.inputTransport == "edi") {
-        ediInput = make_shared<EdiInput>(mod_settings.tist_offset_s, mod_settings.edi_max_delay_ms);
+        ediInput = make_shared<EdiInput>(mod_settings.tist_offset_s,
+                mod_settings.edi_max_delay_ms,
+                mod_settings.inputPrefetchFrames > 0);
+
+        if (mod_settings.edi_timestamps == "software") {
+            ediInput->ediTransport.setRxTimestamps(
+                    Socket::rx_timestamps_e::software);
+        }
+        else if (mod_settings.edi_timestamps == "hardware") {
+            ediInput->ediTransport.setRxTimestamps(
+                    Socket::rx_timestamps_e::hardware);
+        }
+
+        if (not mod_settings.edi_packet_ring_interface.empty()) {
+            ediInput->ediTransport.setPacketRingInterface(
+                    mod_settings.edi_packet_ring_interface);
+        }
 
-        ediInput->ediTransport.Open(mod_settings.inputName);
+        // Several sources separated by spaces carry the same EDI stream
+        stringstream sources(mod_settings.inputName);
+        string source;
+        while (sources >> source) {
+            ediInput->ediTransport.Open(source);
+        }
         if (not ediInput->ediTransport.isEnabled()) {
             throw runtime_error("inputTransport is edi, but ediTransport is not enabled");
         }
     }
+    else if (mod_settings.inputTransport == "iq") {
+        // The IQFilePlayer opens the file once the output is ready
+    }
+    else if (mod_settings.inputTransport == "file" and
+            InputCompressedReader::IsCompressed(mod_settings.inputName)) {
+        if (mod_settings.inputMmap) {
+            etiLog.level(warn) << "The compressed input file is read "
+                "instead of being memory-mapped";
+        }
+
+        auto inputCompressedReader = make_shared<InputCompressedReader>();
+
+        if (inputCompressedReader->Open(mod_settings.inputName,
+                    mod_settings.loop, mod_settings.inputIndex) == -1) {
+            throw std::runtime_error("Unable to open input");
+        }
+
+        inputReader = inputCompressedReader;
+    }
+    else if (mod_settings.inputTransport == "file" and mod_settings.inputMmap) {
+        auto inputMmapReader = make_shared<InputMmapReader>();
+
+        if (inputMmapReader->Open(mod_settings.inputName, mod_settings.loop) == -1) {
+            throw std::runtime_error("Unable to open input");
+        }
+
+        inputReader = inputMmapReader;
+    }
     else if (mod_settings.inputTransport == "file") {
         auto inputFileReader = make_shared<InputFileReader>();
 
@@ -504,13 +1010,133 @@ int launch_modulator(int argc, char* argv[])
         inputTcpReader->Open(mod_settings.inputName);
         inputReader = inputTcpReader;
     }
+    else if (mod_settings.inputTransport == "zeromq") {
+#if defined(HAVE_ZEROMQ)
+        auto inputZeroMQReader = make_shared<InputZeroMQReader>();
+        inputZeroMQReader->Open(mod_settings.inputName);
+        inputReader = inputZeroMQReader;
+#else
+        throw std::runtime_error("Unable to open input: "
+                "ZeroMQ input transport selected, but not compiled in!");
+#endif
+    }
     else {
         throw std::runtime_error("Unable to open input: "
                 "invalid input transport " + mod_settings.inputTransport + " selected!");
     }
 
+    if (mod_settings.inputStartFrame > 0) {
+        bool found = false;
+        if (auto in = dynamic_pointer_cast<InputMmapReader>(inputReader)) {
+            found = in->Seek(mod_settings.inputStartFrame);
+        }
+        else if (auto in = dynamic_pointer_cast<InputCompressedReader>(inputReader)) {
+            found = in->Seek(mod_settings.inputStartFrame);
+        }
+        else {
+            throw std::runtime_error("input.start_frame needs input.mmap=1 "
+                    "or a compressed input file");
+        }
+
+        if (not found) {
+            throw std::runtime_error("The input file does not have " +
+                    to_string(mod_settings.inputStartFrame) + " frames");
+        }
+    }
+
     m.ediInput = ediInput;
     m.inputReader = inputReader;
+    m.timeline_mark("input");
+
+    auto output = output_future.get();
+
+    if (not output_format.empty()) {
+        if (auto o = dynamic_pointer_cast<Output::SDR>(output)) {
+            o->set_sample_size(FormatConverter::get_format_size(output_format));
+        }
+    }
+    else if (mod_settings.fftEngine == FFTEngine::DEXTER) {
+        if (auto o = dynamic_pointer_cast<Output::SDR>(output)) {
+            o->set_sample_size(2 * sizeof(int32_t));
+        }
+    }
+
+    if (auto o = dynamic_pointer_cast<Output::SDR>(output)) {
+        o->set_frames_per_buffer(mod_settings.batchFrames);
+    }
+
+    if (not mod_settings.teeOutputs.empty()) {
+        auto tee = make_shared<OutputTee>(output);
+        for (const auto& t : mod_settings.teeOutputs) {
+            shared_ptr<ModOutput> o;
+            if (t.type == "file") {
+                o = make_shared<OutputFile>(t.target, false);
+            }
+#if defined(HAVE_ZEROMQ)
+            else if (t.type == "zmq") {
+                o = make_shared<OutputZeroMQ>(t.target, ZMQ_PUB);
+            }
+#endif
+            else if (t.type == "record") {
+                // The samples of the flowgraph, before any conversion
+                // the output itself does
+                string format = output_format;
+                if (format.empty()) {
+                    format =
+                        mod_settings.fftEngine == FFTEngine::FFTW ? "complexf" :
+                        mod_settings.fftEngine == FFTEngine::DEXTER ? "s32" :
+                        "s16";
+                }
+
+                // The modulator normalised the floating-point samples
+                // for the main output, the recording is normalised like
+                // an s16 file output
+                const float scale = mod_settings.normalise > 0 ?
+                    32767.0f / normalise_factor / mod_settings.normalise :
+                    1.0f;
+
+                o = make_shared<OutputRecorder>(t.target,
+                        OutputRecorder::parse_codec(t.recordCodec),
+                        t.recordLevel, format, scale,
+                        mod_settings.outputRate, t.recordChunkFrames);
+            }
+            else {
+                throw std::invalid_argument("Additional output " + t.type + " invalid");
+            }
+
+            const auto policy =
+                t.dropPolicy == "newest" ? OutputTee::drop_policy_e::newest :
+                t.dropPolicy == "block" ? OutputTee::drop_policy_e::block :
+                OutputTee::drop_policy_e::oldest;
+            tee->add_output(t.type, o, t.queueSize, policy);
+        }
+        output = tee;
+    }
+
+    if (mod_settings.inputTransport == "iq") {
+        return run_iq_playback(mod_settings, output_format, output);
+    }
+
+    if (mod_settings.carousel) {
+        if (dynamic_pointer_cast<InputCompressedReader>(inputReader)) {
+            throw std::runtime_error("output.carousel does not support "
+                    "compressed input files");
+        }
+
+        // Whatever the format of the file, the InputMmapReader counts
+        // its frames
+        InputMmapReader loop_counter;
+        if (loop_counter.Open(mod_settings.inputName, false) == -1) {
+            throw std::runtime_error("Unable to count the frames of the input");
+        }
+
+        m.carousel = make_shared<OutputCarousel>(output, mod_settings.carouselFile);
+        m.carousel_loop_frames = loop_counter.GetNumFrames();
+        output = m.carousel;
+    }
+
+    // The first ensemble adds the others to its samples
+    const auto primary_mixer = mod_settings.fdmIndex == 0 ? mixer : nullptr;
 
     bool run_again = true;
 
@@ -525,23 +1151,49 @@ int launch_modulator(int argc, char* argv[])
         shared_ptr<DabModulator> modulator;
         if (inputReader) {
             m.etiReader = make_shared<EtiReader>(mod_settings.tist_offset_s);
-            modulator = make_shared<DabModulator>(*m.etiReader, mod_settings, output_format);
+            modulator = make_shared<DabModulator>(*m.etiReader, mod_settings,
+                    output_format, primary_mixer);
         }
         else if (ediInput) {
-            modulator = make_shared<DabModulator>(ediInput->ediReader, mod_settings, output_format);
+            modulator = make_shared<DabModulator>(ediInput->ediReader,
+                    mod_settings, output_format, primary_mixer);
         }
 
         rcs.enrol(modulator.get());
+        modulator->restore_state(m.modulator_state);
+        m.modulator = modulator;
+        m.timeline_mark("modulator");
 
         flowgraph.connect(modulator, output);
+        m.output = output;
+        m.output_enabled = true;
 
         if (inputReader) {
             etiLog.level(info) << inputReader->GetPrintableInfo();
         }
 
+        // The prefetcher only runs for one run_modulator, because the
+        // input file can be opened again afterwards.
+        if (mod_settings.inputPrefetchFrames > 0) {
+            if (inputReader) {
+                m.inputPrefetcher = make_shared<InputPrefetcher>(
+                        inputReader, mod_settings.inputPrefetchFrames);
+            }
+            else if (ediInput) {
+                m.inputPrefetcher = make_shared<InputPrefetcher>(
+                        ediInput, mod_settings.inputPrefetchFrames);
+            }
+        }
+
         run_modulator_state_t st = run_modulator(mod_settings, m);
         etiLog.log(trace, "DABMOD,run_modulator() = %d", st);
 
+        m.inputPrefetcher.reset();
+
+        if (not mod_settings.runReportFile.empty()) {
+            write_run_report(mod_settings, m, flowgraph, st);
+        }
+
         switch (st) {
             case run_modulator_state_t::failure:
                 etiLog.level(error) << "Modulator failure.";
@@ -560,10 +1212,34 @@ int launch_modulator(int argc, char* argv[])
                         run_again = true;
                     }
                 }
+                else if (auto in = dynamic_pointer_cast<InputMmapReader>(inputReader)) {
+                    if (in->Open(mod_settings.inputName, mod_settings.loop) == -1) {
+                        etiLog.level(error) << "Unable to open input file!";
+                        ret = 1;
+                    }
+                    else {
+                        run_again = true;
+                    }
+                }
+                else if (auto in = dynamic_pointer_cast<InputCompressedReader>(inputReader)) {
+                    if (in->Open(mod_settings.inputName, mod_settings.loop,
+                                mod_settings.inputIndex) == -1) {
+                        etiLog.level(error) << "Unable to open input file!";
+                        ret = 1;
+                    }
+                    else {
+                        run_again = true;
+                    }
+                }
                 else if (dynamic_pointer_cast<InputTcpReader>(inputReader)) {
                     // Keep the same inputReader, as there is no input buffer overflow
                     run_again = true;
                 }
+#if defined(HAVE_ZEROMQ)
+                else if (dynamic_pointer_cast<InputZeroMQReader>(inputReader)) {
+                    run_again = true;
+                }
+#endif
                 else if (ediInput) {
                     // In EDI, keep the same input
                     run_again = true;
@@ -582,38 +1258,362 @@ int launch_modulator(int argc, char* argv[])
                 break;
         }
 
+        m.modulator_state = m.modulator->save_state();
+        m.modulator.reset();
+        m.timeline_start();
+
         etiLog.level(info) << m.framecount << " DAB frames, " << ((float)m.framecount * 0.024f) << " seconds encoded";
         m.num_modulator_restarts++;
     }
 
+    return ret;
+}
+
+int launch_modulator(int argc, char* argv[])
+{
+    int ret = 0;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(struct sigaction));
+    sa.sa_handler = &signalHandler;
+
+    if (sigaction(SIGINT, &sa, NULL) == -1) {
+        const string errstr = strerror(errno);
+        throw runtime_error("Could not set signal handler: " + errstr);
+    }
+
+    printStartupInfo();
+
+    std::vector<mod_settings_t> ensembles;
+    parse_args(argc, argv, ensembles);
+
+#if defined(HAVE_ZEROMQ)
+    etiLog.register_backend(make_shared<LogToEventSender>());
+#endif // defined(HAVE_ZEROMQ)
+
+    etiLog.level(info) << "Configuration parsed. Starting up version " <<
+#if defined(GITVERSION)
+            GITVERSION;
+#else
+            VERSION;
+#endif
+
+    for (const auto& mod_settings : ensembles) {
+        // With frequency multiplexing, only the first ensemble has an output
+        if (mod_settings.fdmIndex > 0) {
+            continue;
+        }
+
+        if (not (mod_settings.useFileOutput or
+                 mod_settings.useUHDOutput or
+                 mod_settings.useZeroMQOutput or
+                 mod_settings.useVita49Output or
+                 mod_settings.useSoapyOutput or
+                 mod_settings.useDexterOutput or
+                 mod_settings.useLimeOutput or
+                 mod_settings.useBladeRFOutput or
+                 mod_settings.useSimulatedOutput)) {
+            throw std::runtime_error("Configuration error: Output not specified" +
+                    (mod_settings.ensembleName.empty() ? "" :
+                     " for ensemble " + mod_settings.ensembleName));
+        }
+    }
+
+    const auto& mod_settings = ensembles.front();
+    if (not mod_settings.startupCheck.empty()) {
+        etiLog.level(info) << "Running startup check '" << mod_settings.startupCheck << "'";
+        int wstatus = system(mod_settings.startupCheck.c_str());
+
+        if (WIFEXITED(wstatus)) {
+            if (WEXITSTATUS(wstatus) == 0) {
+                etiLog.level(info) << "Startup check ok";
+            }
+            else {
+                etiLog.level(error) << "Startup check failed, returned " << WEXITSTATUS(wstatus);
+                return 1;
+            }
+        }
+        else {
+            etiLog.level(error) << "Startup check failed, child didn't terminate normally";
+            return 1;
+        }
+    }
+
+    configure_thread_placement(mod_settings.threadPlacement);
+    WorkerPool::configure(mod_settings.workerPoolNumThreads,
+            mod_settings.workerPoolPinThreads);
+    PipelineExecutor::configure(mod_settings.pipelineExecutorNumThreads);
+
+    if (mod_settings.lowMemory) {
+        etiLog.level(info) << "Low memory profile: the flowgraph edges share "
+            "their buffers, the SDR frame queue holds at most " <<
+            (mod_settings.sdr_device_config.queueDepth ?
+             std::to_string(mod_settings.sdr_device_config.queueDepth) :
+             std::string("the default number of")) << " frames, "
+            "the OFDM generator uses no batched FFT and no symbol cache, "
+            "and the buffer pool keeps at most 16 MB";
+    }
+
+    if (mod_settings.lockMemory) {
+        if (int r = lock_memory()) {
+            etiLog.level(error) << "Could not lock the memory: " << strerror(r);
+        }
+        else {
+            etiLog.level(info) << "Memory locked";
+        }
+    }
+
+    // Neither the fixed-point software FFTs nor the FFT Accelerator used for DEXTER need planning.
+    const bool use_fftw = std::any_of(ensembles.begin(), ensembles.end(),
+            [](const mod_settings_t& s) { return s.fftEngine == FFTEngine::FFTW; });
+    if (use_fftw) {
+        // This is mostly useful on ARM systems where FFTW planning takes some time. If we do it here
+        // it will be done before the modulator starts up
+        configure_fftw_planner(ensembles.front().fftwWisdomFile,
+                ensembles.front().fftwPlanMode);
+
+        etiLog.level(debug) << "Running FFTW planning...";
+        constexpr size_t fft_size = 2048; // Transmission Mode I. If different, it'll recalculate on OfdmGenerator
+                                          // initialisation
+        auto *fft_in = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * fft_size);
+        auto *fft_out = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * fft_size);
+        if (fft_in == nullptr or fft_out == nullptr) {
+            throw std::runtime_error("FFTW malloc failed");
+        }
+        std::lock_guard<std::mutex> lock(fftw_planner_mutex);
+        const unsigned plan_flags = prepare_fftw_planner();
+        fftwf_plan plan = fftwf_plan_dft_1d(fft_size, fft_in, fft_out, FFTW_FORWARD, plan_flags);
+        fftwf_destroy_plan(plan);
+        plan = fftwf_plan_dft_1d(fft_size, fft_in, fft_out, FFTW_BACKWARD, plan_flags);
+        fftwf_destroy_plan(plan);
+        save_fftw_wisdom();
+        fftwf_free(fft_in);
+        fftwf_free(fft_out);
+        etiLog.level(debug) << "FFTW planning done.";
+    }
+
+    // The ensembles with fft_engine=auto have FFTW until now, the
+    // benchmark uses the planning mode and wisdom configured above
+    for (auto& s : ensembles) {
+        if (s.fftEngineAuto) {
+            FFTEngineSelector::select(s);
+        }
+    }
+
+    // Once the FFT engines are known
+    if (ensembles.front().sharedBatchedFft) {
+        OfdmBatchService::assign(ensembles);
+    }
+
+    if (ensembles.size() == 1) {
+        ret = run_ensemble(ensembles.front(), nullptr);
+    }
+    else {
+        /* Every ensemble runs in its own thread, with its own input,
+         * modulator and output. The names of their remote control modules
+         * are prefixed with the ensemble name. If one of them fails, all
+         * are stopped. */
+        std::vector<int> results(ensembles.size(), 0);
+        std::vector<std::thread> threads;
+
+        shared_ptr<EnsembleMixer> mixer;
+        if (not ensembles.front().fdmEnsembles.empty()) {
+            mixer = make_shared<EnsembleMixer>(
+                    ensembles.front().fdmEnsembles,
+                    ensembles.front().outputRate);
+            rcs.enrol(mixer.get());
+        }
+
+        for (size_t i = 0; i < ensembles.size(); i++) {
+            threads.emplace_back([&, i]() {
+                    const auto& name = ensembles[i].ensembleName;
+                    set_thread_name(("mod " + name).substr(0, 15).c_str());
+                    set_rc_name_prefix(name + ".");
+
+                    try {
+                        results[i] = run_ensemble(ensembles[i], mixer);
+                    }
+                    catch (const std::exception& e) {
+                        etiLog.level(error) << "Ensemble " << name <<
+                            ": " << e.what();
+                        results[i] = 1;
+                    }
+
+                    if (results[i] != 0 and running) {
+                        etiLog.level(error) << "Ensemble " << name <<
+                            " failed, stopping all ensembles";
+                        running = 0;
+                    }
+                });
+        }
+
+        for (auto& t : threads) {
+            t.join();
+        }
+
+        for (const auto r : results) {
+            if (r != 0) {
+                ret = r;
+            }
+        }
+    }
+
     etiLog.level(info) << "Terminating";
     return ret;
 }
 
+/* The time interleaver needs 16 frames, the pipelined blocks a few more.
+ * Before that, the output does not repeat with the input file yet. */
+static constexpr uint64_t carousel_min_warmup_frames = 64;
+
+static run_modulator_state_t replay_carousel(ModulatorData& m)
+{
+    etiLog.level(info) << "Carousel: transmitting the " <<
+        m.carousel->num_frames() << " recorded output frames in a loop, "
+        "the modulator is stopped";
+
+    while (running) {
+        if (m.modulator->output_enabled() != m.output_enabled) {
+            m.output_enabled = m.modulator->output_enabled();
+            etiLog.level(info) << "Output " <<
+                (m.output_enabled ? "enabled" : "disabled");
+        }
+
+        if (m.output_enabled) {
+            m.carousel->replay_next();
+        }
+        else {
+            this_thread::sleep_for(chrono::milliseconds(24));
+        }
+    }
+
+    return run_modulator_state_t::normal_end;
+}
+
 static run_modulator_state_t run_modulator(const mod_settings_t& mod_settings, ModulatorData& m)
 {
     auto ret = run_modulator_state_t::failure;
     try {
+        // The modulator starts from scratch, and so does the output
+        if (m.carousel and m.carousel->is_recording()) {
+            etiLog.level(warn) << "Carousel: the modulator restarted, "
+                "recording the loop again";
+            m.carousel->cancel_recording();
+        }
+        const uint64_t carousel_warmup = std::max<uint64_t>(
+                m.carousel_loop_frames, carousel_min_warmup_frames);
+        uint64_t carousel_start = 0;
+
         int last_eti_fct = -1;
+        unsigned last_eti_fp = 0;
+        bool resuming = false;
         auto last_frame_received = chrono::steady_clock::now();
+
+        // The first 250 frames are the warm-up, during which the buffer
+        // pool fills up. The heap allocations after it are the steady-state
+        // ones of the allocation tracking.
+        uint64_t last_allocation_check = 0;
+        uint64_t last_allocations = 0;
+        alloc_tracking::set_steady_state(false);
         frame_timestamp ts;
         Buffer data;
         if (m.inputReader) {
             data.setLength(6144);
         }
 
-        while (running) {
+        // Gives the frames without copying them
+        auto inputMmapReader = dynamic_pointer_cast<InputMmapReader>(m.inputReader);
+
+        // Only stops this modulator, the global running flag is
+        // shared with the other ensembles
+        bool modulator_running = true;
+
+        while (running and modulator_running) {
             unsigned fct = 0;
             unsigned fp = 0;
 
             /* Load ETI data from the source */
-            if (m.inputReader) {
-                int framesize = m.inputReader->GetNextFrame(data.getData());
+            if (m.inputPrefetcher) {
+                InputPrefetcher::frame_t frame;
+                try {
+                    m.inputPrefetcher->get_frame(frame);
+                }
+                catch (const ThreadsafeQueueWakeup&) {
+                    // Timeout of the input
+                    continue;
+                }
+
+                if (frame.status == InputPrefetcher::frame_t::status_e::EndOfInput) {
+                    etiLog.level(info) << "End of file reached.";
+                    modulator_running = false;
+                    ret = run_modulator_state_t::normal_end;
+                    break;
+                }
+                else if (frame.status == InputPrefetcher::frame_t::status_e::Error) {
+                    if (m.ediInput) {
+                        etiLog.level(warn) << "EDI input: " << frame.error;
+                    }
+                    else {
+                        etiLog.level(error) << frame.error;
+                        ret = run_modulator_state_t::normal_end;
+                    }
+                    modulator_running = false;
+                    break;
+                }
+
+                last_frame_received = frame.received;
+
+                if (m.inputReader) {
+                    // The EtiReader refers to the frame data until the
+                    // flowgraph has run, the prefetcher gets the buffer of
+                    // the previous frame back instead.
+                    data.swap(frame.eti);
+                    const int eti_bytes_read = m.etiReader->loadEtiData(data);
+                    m.inputPrefetcher->release_frame(std::move(frame));
+                    if ((size_t)eti_bytes_read != 6144) {
+                        etiLog.level(error) << "ETI frame incompletely read";
+                        throw std::runtime_error("ETI read error");
+                    }
+
+                    fct = m.etiReader->getFct();
+                    fp = m.etiReader->getFp();
+                    ts = m.etiReader->getTimestamp();
+                }
+                else {
+                    try {
+                        frame.edi.replay(m.ediInput->ediReader);
+                    }
+                    catch (const invalid_argument& e) {
+                        etiLog.level(warn) << "Invalid EDI frame: " << e.what();
+                        m.ediInput->ediReader.clearFrame();
+                        m.inputPrefetcher->release_frame(std::move(frame));
+                        continue;
+                    }
+                    m.inputPrefetcher->release_frame(std::move(frame));
+
+                    m.most_recent_edi_decoded = get_clock_realtime_seconds();
+                    fct = m.ediInput->ediReader.getFct();
+                    fp = m.ediInput->ediReader.getFp();
+                    ts = m.ediInput->ediReader.getTimestamp();
+                }
+            }
+            else if (m.inputReader) {
+                const uint8_t *frame = nullptr;
+                int framesize = 0;
+                if (inputMmapReader) {
+                    framesize = inputMmapReader->GetNextFramePointer(&frame);
+                }
+                else {
+                    framesize = m.inputReader->GetNextFrame(data.getData());
+                    frame = reinterpret_cast<const uint8_t*>(data.getData());
+                }
 
                 if (framesize == 0) {
-                    if (dynamic_pointer_cast<InputFileReader>(m.inputReader)) {
+                    if (inputMmapReader or
+                            dynamic_pointer_cast<InputFileReader>(m.inputReader) or
+                            dynamic_pointer_cast<InputCompressedReader>(m.inputReader)) {
                         etiLog.level(info) << "End of file reached.";
-                        running = 0;
+                        modulator_running = false;
                         ret = run_modulator_state_t::normal_end;
                         break;
                     }
@@ -621,6 +1621,11 @@ static run_modulator_state_t run_modulator(const mod_settings_t& mod_settings, M
                         /* An empty frame marks a timeout. We ignore it, but we are
                          * now able to handle SIGINT properly. */
                     }
+#if defined(HAVE_ZEROMQ)
+                    else if (dynamic_pointer_cast<InputZeroMQReader>(m.inputReader)) {
+                        // Same as for TCP
+                    }
+#endif
                     else {
                         throw logic_error("Unhandled framesize==0!");
                     }
@@ -628,13 +1633,13 @@ static run_modulator_state_t run_modulator(const mod_settings_t& mod_settings, M
                 }
                 else if (framesize < 0) {
                     etiLog.level(error) << "Input read error.";
-                    running = 0;
+                    modulator_running = false;
                     ret = run_modulator_state_t::normal_end;
                     break;
                 }
 
-                const int eti_bytes_read = m.etiReader->loadEtiData(data);
-                if ((size_t)eti_bytes_read != data.getLength()) {
+                const int eti_bytes_read = m.etiReader->loadEtiData(frame, framesize);
+                if (eti_bytes_read != framesize) {
                     etiLog.level(error) << "ETI frame incompletely read";
                     throw std::runtime_error("ETI read error");
                 }
@@ -646,7 +1651,8 @@ static run_modulator_state_t run_modulator(const mod_settings_t& mod_settings, M
                 ts = m.etiReader->getTimestamp();
             }
             else if (m.ediInput) {
-                while (running and not m.ediInput->ediReader.isFrameReady()) {
+                while (running and modulator_running and
+                        not m.ediInput->ediReader.isFrameReady()) {
                     try {
                         bool packet_received = m.ediInput->ediTransport.rxPacket();
                         if (packet_received) {
@@ -655,12 +1661,12 @@ static run_modulator_state_t run_modulator(const mod_settings_t& mod_settings, M
                     }
                     catch (const std::runtime_error& e) {
                         etiLog.level(warn) << "EDI input: " << e.what();
-                        running = 0;
+                        modulator_running = false;
                         break;
                     }
                 }
 
-                if (!running) {
+                if (not (running and modulator_running)) {
                     break;
                 }
 
@@ -689,12 +1695,36 @@ static run_modulator_state_t run_modulator(const mod_settings_t& mod_settings, M
                     }
                     else {
                         last_eti_fct = fct;
+                        last_eti_fp = fp;
                     }
                 }
                 else {
                     const unsigned expected_fct = (last_eti_fct + 1) % 250;
                     if (fct == expected_fct) {
                         last_eti_fct = fct;
+                        last_eti_fp = fp;
+                        resuming = false;
+                    }
+                    else if (mod_settings.sdr_device_config.underrunFiller) {
+                        if (not resuming) {
+                            etiLog.level(warn) << "ETI FCT discontinuity, expected " <<
+                                expected_fct << " received " << fct <<
+                                ", continuing";
+                            resuming = true;
+                        }
+
+                        /* The BlockPartitioner continues where it stopped,
+                         * which is the same position in the transmission
+                         * frame for FPs that are four frames apart in every
+                         * mode */
+                        if (fp % 4 == (last_eti_fp + 1) % 4) {
+                            last_eti_fct = fct;
+                            last_eti_fp = fp;
+                            resuming = false;
+                        }
+                        else {
+                            modulate = false;
+                        }
                     }
                     else {
                         etiLog.level(warn) << "ETI FCT discontinuity, expected " <<
@@ -707,8 +1737,85 @@ static run_modulator_state_t run_modulator(const mod_settings_t& mod_settings, M
                 }
 
                 if (modulate) {
+                    // Without timestamps, the batches scheduled for a time
+                    // use the system clock
+                    const double frame_time = ts.timestamp_valid ?
+                        ts.get_real_secs() :
+                        chrono::duration<double>(
+                                chrono::system_clock::now().time_since_epoch()).count();
+                    rcs.apply_scheduled(fct, frame_time);
+
+                    if (mod_settings.jitLead > 0 and ts.timestamp_valid and
+                            mod_settings.sdr_device_config.enableSync) {
+                        // Start the processing just in time for the frame
+                        // to reach the output jitLead before it gets
+                        // transmitted, instead of as soon as it arrives
+                        const double wait = ts.offset_to_system_time() -
+                            mod_settings.jitLead;
+                        if (wait > 0) {
+                            const auto end = chrono::steady_clock::now() +
+                                chrono::duration_cast<chrono::steady_clock::duration>(
+                                        chrono::duration<double>(wait));
+                            while (running) {
+                                const auto remaining = end - chrono::steady_clock::now();
+                                if (remaining <= chrono::steady_clock::duration::zero()) {
+                                    break;
+                                }
+                                this_thread::sleep_for(std::min<chrono::steady_clock::duration>(
+                                            remaining, chrono::milliseconds(50)));
+                            }
+
+                            auto& fic = m.etiReader ? m.etiReader->getFic() :
+                                m.ediInput->ediReader.getFic();
+                            if (fic) {
+                                fic->setScheduleWait(wait);
+                            }
+                        }
+                    }
+
+                    if (m.framecount == 0) {
+                        m.timeline_mark("first_frame");
+                    }
+
                     m.framecount++;
+                    frame_tracer().record(FrameTracer::event_e::frame_input, fct, 0);
+
+                    if (m.modulator->output_enabled() != m.output_enabled) {
+                        m.output_enabled = m.modulator->output_enabled();
+                        m.flowgraph->set_enabled(m.output, m.output_enabled);
+                        etiLog.level(info) << "Output " <<
+                            (m.output_enabled ? "enabled" : "disabled");
+
+                        // The output did not get all frames of the loop
+                        if (m.carousel and m.carousel->is_recording()) {
+                            m.carousel->cancel_recording();
+                        }
+                    }
+
+                    if (m.carousel and m.output_enabled and
+                            not m.carousel->is_ready() and
+                            not m.carousel->is_recording() and
+                            m.framecount > carousel_warmup) {
+                        etiLog.level(info) << "Carousel: recording the " <<
+                            m.carousel_loop_frames << " frames of the loop";
+                        m.carousel->start_recording();
+                        carousel_start = m.framecount;
+                    }
+
                     m.flowgraph->run();
+
+                    if (m.carousel and m.carousel->is_recording() and
+                            m.framecount + 1 == carousel_start + m.carousel_loop_frames) {
+                        m.carousel->stop_recording();
+                        ret = replay_carousel(m);
+                        break;
+                    }
+
+                    if (m.framecount == 1) {
+                        m.timeline_mark("modulated");
+                        etiLog.level(info) << "Startup timeline in ms: " <<
+                            m.timeline_to_string();
+                    }
                 }
             }
 
@@ -717,9 +1824,25 @@ static run_modulator_state_t run_modulator(const mod_settings_t& mod_settings, M
             }
 
             /* Check every once in a while if the remote control
-             * is still working */
+             * is still working, and if buffers got allocated since the
+             * warm-up */
             if ((m.framecount % 250) == 0) {
                 rcs.check_faults();
+
+                if (m.framecount > 0 and m.framecount != last_allocation_check) {
+                    alloc_tracking::set_steady_state(true);
+                    const uint64_t allocations = get_buffer_allocations();
+                    if (last_allocation_check > 0 and
+                            allocations > last_allocations) {
+                        m.late_buffer_allocations += allocations - last_allocations;
+                        if (mod_settings.lockMemory) {
+                            etiLog.level(warn) << allocations - last_allocations <<
+                                " buffers allocated in the last 250 frames";
+                        }
+                    }
+                    last_allocations = allocations;
+                    last_allocation_check = m.framecount;
+                }
             }
         }
     }
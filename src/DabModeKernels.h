@@ -0,0 +1,58 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   Selection of the instantiations of the symbol-level kernels for the
+   number of carriers of the transmission modes
+*/
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+/* A kernel is a class template Kernel<C> with a static process() function
+ * that takes the number of carriers as its last argument. For C > 0, the
+ * instantiation only works on C carriers and ignores that argument, which
+ * lets the compiler unroll and vectorise the loops over the carriers.
+ * Kernel<0> works on any number.
+ *
+ * The blocks select the instantiation for their mode once, when they are
+ * created. Mode I has 1536 carriers, mode II 384, mode III 192 and
+ * mode IV 768. */
+template<template<size_t> class Kernel>
+auto select_carriers_kernel(size_t carriers) -> decltype(&Kernel<0>::process)
+{
+    switch (carriers) {
+        case 1536: return &Kernel<1536>::process;
+        case 768: return &Kernel<768>::process;
+        case 384: return &Kernel<384>::process;
+        case 192: return &Kernel<192>::process;
+        default: return &Kernel<0>::process;
+    }
+}
+
+// The number of carriers of the kernel C, or the given one for Kernel<0>
+template<size_t C>
+constexpr size_t kernel_carriers(size_t carriers)
+{
+    return C > 0 ? C : carriers;
+}
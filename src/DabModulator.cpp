@@ -27,50 +27,71 @@
 
 #include <string>
 #include <memory>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iterator>
 #include <vector>
 
 #include "DabModulator.h"
 #include "PcDebug.h"
 
-#include "BlockPartitioner.h"
 #include "CicEqualizer.h"
 #include "ConvEncoder.h"
 #include "DifferentialModulator.h"
 #include "FIRFilter.h"
+#include "FrameBatcher.h"
 #include "FrameMultiplexer.h"
-#include "FrequencyInterleaver.h"
+#include "FrequencyShifter.h"
+#include "FixedPointCfr.h"
 #include "GainControl.h"
 #include "GuardIntervalInserter.h"
+#include "Events.h"
 #include "Log.h"
+#include "MappingBlockPartitioner.h"
 #include "MemlessPoly.h"
+#include "MemoryPoly.h"
 #include "NullSymbol.h"
 #include "OfdmGenerator.h"
+#include "PeakCanceller.h"
 #include "PhaseReference.h"
 #include "PrbsGenerator.h"
 #include "PuncturingEncoder.h"
-#include "QpskSymbolMapper.h"
 #include "RemoteControl.h"
+#include "HalfbandInterpolator.h"
+#include "PolyphaseResampler.h"
 #include "Resampler.h"
 #include "SignalMultiplexer.h"
+#include "SubchannelEncoder.h"
+#include "SymbolStreamer.h"
 #include "TII.h"
 #include "TimeInterleaver.h"
+#include "TxChannels.h"
+#include "Utils.h"
 
 using namespace std;
 
 DabModulator::DabModulator(EtiSource& etiSource,
                            mod_settings_t& settings,
-                           const std::string& format) :
+                           const std::string& format,
+                           std::shared_ptr<EnsembleMixer> mixer) :
     ModInput(),
     RemoteControllable("modulator"),
     m_settings(settings),
     m_format(format),
     m_etiSource(etiSource),
-    m_flowgraph()
+    m_mixer(mixer),
+    m_flowgraph(),
+    m_standby(settings.standby),
+    m_outputEnabled(not settings.standby)
 {
     PDEBUG("DabModulator::DabModulator() @ %p\n", this);
 
     RC_ADD_PARAMETER(rate, "(Read-only) IQ output samplerate");
     RC_ADD_PARAMETER(num_clipped_samples, "(Read-only) Number of samples clipped in last frame during format conversion");
+    RC_ADD_PARAMETER(standby, "1 to only follow the input without driving the output, 0 to take over");
+    RC_ADD_PARAMETER(output_enabled, "(Read-only) 1 if the modulator drives the output");
+    RC_ADD_PARAMETER(muted, "(Read-only) 1 if the modulation is suspended because the SDR output is muted");
 
     if (m_settings.dabMode == 0) {
         setMode(1);
@@ -78,6 +99,17 @@ DabModulator::DabModulator(EtiSource& etiSource,
     else {
         setMode(m_settings.dabMode);
     }
+
+    // The OFDM part does not depend on the content of the ETI, it gets set
+    // up while we wait for the first frame.
+    m_ofdmSetup = async_with_rc_name_prefix([this]() { setupOfdmChain(); });
+}
+
+DabModulator::~DabModulator()
+{
+    if (m_ofdmSetup.valid()) {
+        m_ofdmSetup.wait();
+    }
 }
 
 
@@ -128,304 +160,1342 @@ int DabModulator::process(Buffer* dataOut)
 
     PDEBUG("DabModulator::process(dataOut: %p)\n", dataOut);
 
-    if (not m_flowgraph) {
-        etiLog.level(debug) << "Setting up DabModulator...";
-        const unsigned mode = m_settings.dabMode;
-        setMode(mode);
+    if (not m_setUp) {
+        const auto start = chrono::steady_clock::now();
+        // Rethrows the errors of the setup
+        m_ofdmSetup.get();
+        const auto ofdm_ready = chrono::steady_clock::now();
+
+        m_output = make_shared<OutputMemory>(dataOut);
+        m_flowgraph->connect(m_chainEnd, m_output, stage_boundary("output"));
+        m_standbyPlugins.push_back(m_output);
+
+        const auto cifPart = m_cifPart;
+        const auto cifMux = m_cifMux;
+
+        ////////////////////////////////////////////////////////////////
+        // Processing FIC
+        ////////////////////////////////////////////////////////////////
+        shared_ptr<FicSource> fic(m_etiSource.getFic());
+        ////////////////////////////////////////////////////////////////
+        // Data initialisation
+        ////////////////////////////////////////////////////////////////
+        size_t ficSizeIn = fic->getFramesize();
+
+        ////////////////////////////////////////////////////////////////
+        // Modules configuration
+        ////////////////////////////////////////////////////////////////
+
+        // Configuring FIC channel
+
+        PDEBUG("FIC:\n");
+        PDEBUG(" Framesize: %zu\n", fic->getFramesize());
+
+        if (m_settings.fusedSubchannelEncoder) {
+            auto ficEnc = make_shared<SubchannelEncoder>(
+                    ficSizeIn, 0,
+                    fic->get_rules(),
+                    PuncturingRule(3, 0xcccccc),
+                    m_settings.encoderCacheSize);
+
+            m_flowgraph->connect(fic, ficEnc);
+            m_flowgraph->connect(ficEnc, cifPart, stage_boundary("mapping"));
+        }
+        else {
+            // Configuring prbs generator
+            auto ficPrbs = make_shared<PrbsGenerator>(ficSizeIn, 0x110);
+
+            // Configuring convolutionnal encoder
+            auto ficConv = make_shared<ConvEncoder>(ficSizeIn);
+
+            // Configuring puncturing encoder
+            auto ficPunc = make_shared<PuncturingEncoder>(0,
+                    fic->get_rules(), PuncturingRule(3, 0xcccccc));
+
+            m_flowgraph->connect(fic, ficPrbs);
+            m_flowgraph->connect(ficPrbs, ficConv);
+            m_flowgraph->connect(ficConv, ficPunc);
+            m_flowgraph->connect(ficPunc, cifPart, stage_boundary("mapping"));
+        }
 
-        m_flowgraph = make_shared<Flowgraph>(m_settings.showProcessTime);
         ////////////////////////////////////////////////////////////////
-        // CIF data initialisation
+        // Configuring subchannels
         ////////////////////////////////////////////////////////////////
-        auto cifPrbs = make_shared<PrbsGenerator>(864 * 8, 0x110);
-        auto cifMux = make_shared<FrameMultiplexer>(m_etiSource);
-        auto cifPart = make_shared<BlockPartitioner>(mode);
-
-        const bool fixedPoint = m_settings.fftEngine != FFTEngine::FFTW;
-        auto cifMap = make_shared<QpskSymbolMapper>(m_nbCarriers, fixedPoint);
-        auto cifRef = make_shared<PhaseReference>(mode, fixedPoint);
-        auto cifFreq = make_shared<FrequencyInterleaver>(mode, fixedPoint);
-        auto cifDiff = make_shared<DifferentialModulator>(m_nbCarriers, fixedPoint);
-
-        auto cifNull = make_shared<NullSymbol>(m_nbCarriers,
-                fixedPoint ? sizeof(complexfix) : sizeof(complexf));
-        auto cifSig = make_shared<SignalMultiplexer>();
-
-        // TODO this needs a review
-        bool useCicEq = false;
-        unsigned cic_ratio = 1;
-        if (m_settings.clockRate) {
-            cic_ratio = m_settings.clockRate / m_settings.outputRate;
-            cic_ratio /= 4; // FPGA DUC
-            if (m_settings.clockRate == 400000000) { // USRP2
-                if (cic_ratio & 1) { // odd
-                    useCicEq = true;
-                } // even, no filter
+        for (const auto& subchannel : m_etiSource.getSubchannels()) {
+            m_subchannels.push_back(setupSubchannel(subchannel));
+            m_flowgraph->connect(m_subchannels.back().interleaver, cifMux);
+        }
+
+        m_flowgraph->connect(cifMux, cifPart, stage_boundary("mapping"));
+
+        m_setUp = true;
+        etiLog.level(debug) << "DabModulator set up, waited " <<
+            chrono::duration_cast<chrono::milliseconds>(ofdm_ready - start).count() <<
+            " ms for the OFDM part and " <<
+            chrono::duration_cast<chrono::milliseconds>(
+                    chrono::steady_clock::now() - ofdm_ready).count() <<
+            " ms for the FIC and subchannels";
+    }
+    else {
+        updateSubchannels();
+    }
+
+    applyStandby();
+
+    ////////////////////////////////////////////////////////////////////
+    // Processing data
+    ////////////////////////////////////////////////////////////////////
+    const auto run_start = chrono::steady_clock::now();
+    const int ret = m_flowgraph->run();
+    if (m_mutedApplied or m_fillerFramesLeft > 0) {
+        // The measurements would only see the blocks that still run
+        return outputFiller(ret, dataOut);
+    }
+
+    if (m_rtBudget) {
+        m_rtBudget->frame_processed(chrono::steady_clock::now() - run_start);
+    }
+    if (m_autoTuner) {
+        m_autoTuner->frame_processed();
+    }
+    m_filler = false;
+    if (ret) {
+        m_frameLength = dataOut->getLength();
+    }
+    return ret;
+}
+
+int DabModulator::outputFiller(int ret, Buffer* dataOut)
+{
+    m_filler = false;
+    if (m_mutedApplied) {
+        // The output blocks do not run, the filler frames follow the
+        // BlockPartitioner and the FrameBatcher
+        if (not m_cifPart->frame_complete()) {
+            return 0;
+        }
+        if (m_fillerBatchFrames == 0) {
+            m_fillerMetadata.clear();
+        }
+        const auto& md = m_cifPart->frame_metadata();
+        std::copy(md.begin(), md.end(), std::back_inserter(m_fillerMetadata));
+        if (++m_fillerBatchFrames < m_settings.batchFrames) {
+            return 0;
+        }
+    }
+    else {
+        // The output is complete, but was modulated before the muting
+        if (not ret) {
+            return 0;
+        }
+        m_fillerMetadata = m_output->get_latest_metadata();
+        m_fillerFramesLeft--;
+        if (m_fillerFramesLeft == 0) {
+            etiLog.level(info) << "Modulator output valid after the muting";
+        }
+    }
+    m_fillerBatchFrames = 0;
+
+    for (auto& md : m_fillerMetadata) {
+        md.filler = true;
+    }
+    m_filler = true;
+
+    dataOut->setLength(m_frameLength);
+    memset(dataOut->getData(), 0, m_frameLength);
+    return m_frameLength;
+}
+
+void DabModulator::setupOfdmChain()
+{
+    const auto start = chrono::steady_clock::now();
+    const unsigned mode = m_settings.dabMode;
+    setMode(mode);
+
+    {
+        std::lock_guard<std::mutex> lock(m_flowgraph_mutex);
+        m_flowgraph = make_shared<Flowgraph>(m_settings.showProcessTime,
+                m_settings.flowgraphNumThreads);
+    }
+    if (m_settings.lowMemory) {
+        if (m_settings.flowgraphNumThreads > 0) {
+            etiLog.level(warn) << "low_memory: the buffers of the first "
+                "pipeline stage are not shared with modulator.flowgraph_threads";
+        }
+        m_flowgraph->set_share_buffers(true);
+    }
+    ////////////////////////////////////////////////////////////////
+    // CIF data initialisation
+    ////////////////////////////////////////////////////////////////
+    auto cifPrbs = make_shared<PrbsGenerator>(864 * 8, 0x110);
+    auto cifMux = make_shared<FrameMultiplexer>(m_etiSource);
+
+    const bool fixedPoint = m_settings.fftEngine != FFTEngine::FFTW;
+    // Block partitioning, QPSK symbol mapping and frequency interleaving
+    auto cifPart = make_shared<MappingBlockPartitioner>(mode, fixedPoint);
+    auto cifRef = make_shared<PhaseReference>(mode, fixedPoint);
+    const size_t carrier_size = fixedPoint ? sizeof(complexfix) : sizeof(complexf);
+
+    // The DifferentialModulator leaves room for the null or TII symbol,
+    // which the SignalMultiplexer writes in front of the other symbols.
+    auto cifDiff = make_shared<DifferentialModulator>(m_nbCarriers, fixedPoint, 1);
+
+    auto cifNull = make_shared<NullSymbol>(m_nbCarriers, carrier_size);
+    auto cifSig = make_shared<SignalMultiplexer>(m_nbCarriers * carrier_size);
+
+    shared_ptr<FrameBatcher> cifBatch;
+    if (m_settings.batchFrames > 1) {
+        if (fixedPoint) throw std::runtime_error("fixed point doesn't support frame batching");
+
+        cifBatch = make_shared<FrameBatcher>(m_settings.batchFrames);
+    }
+
+    // TODO this needs a review
+    bool useCicEq = false;
+    unsigned cic_ratio = 1;
+    if (m_settings.clockRate) {
+        cic_ratio = m_settings.clockRate / m_settings.outputRate;
+        cic_ratio /= 4; // FPGA DUC
+        if (m_settings.clockRate == 400000000) { // USRP2
+            if (cic_ratio & 1) { // odd
+                useCicEq = true;
+            } // even, no filter
+        }
+        else {
+            useCicEq = true;
+        }
+    }
+
+    // With fftw, the OFDM generator applies the gains of the CIC
+    // equaliser and of the pre-emphasis while it copies the carriers.
+    shared_ptr<CicEqualizer> cifCicEq;
+    vector<float> carrierGains;
+    if (m_settings.fftEngine == FFTEngine::FFTW) {
+        if (useCicEq) {
+            carrierGains = CicEqualizer::compute_filter(
+                    m_nbCarriers,
+                    (float)m_spacing * (float)m_settings.outputRate / 2048000.0f,
+                    cic_ratio);
+        }
+
+        if (not m_settings.preemphasisFilename.empty()) {
+            const auto preemphasis = CicEqualizer::load_preemphasis(
+                    m_settings.preemphasisFilename, m_nbCarriers);
+            if (carrierGains.empty()) {
+                carrierGains = preemphasis;
             }
             else {
-                useCicEq = true;
+                for (size_t i = 0; i < m_nbCarriers; i++) {
+                    carrierGains[i] *= preemphasis[i];
+                }
             }
         }
+    }
+    else {
+        if (not m_settings.preemphasisFilename.empty()) {
+            throw std::runtime_error("fixed point doesn't support pre-emphasis");
+        }
 
-        shared_ptr<CicEqualizer> cifCicEq;
         if (useCicEq) {
             cifCicEq = make_shared<CicEqualizer>(
                 m_nbCarriers,
                 (float)m_spacing * (float)m_settings.outputRate / 2048000.0f,
                 cic_ratio);
         }
+    }
 
-        shared_ptr<TII> tii;
-        shared_ptr<PhaseReference> tiiRef;
-        try {
-            tii = make_shared<TII>(
-                    m_settings.dabMode,
-                    m_settings.tiiConfig,
-                    fixedPoint);
-            rcs.enrol(tii.get());
-            tiiRef = make_shared<PhaseReference>(mode, fixedPoint);
-        }
-        catch (const TIIError& e) {
-            etiLog.level(error) << "Could not initialise TII: " << e.what();
-        }
-
-        shared_ptr<ModPlugin> cifOfdm;
-
-        switch (m_settings.fftEngine) {
-            case FFTEngine::FFTW:
-                {
-                    auto ofdm = make_shared<OfdmGeneratorCF32>(
-                            (1 + m_nbSymbols),
-                            m_nbCarriers,
-                            m_spacing,
-                            m_settings.enableCfr,
-                            m_settings.cfrClip,
-                            m_settings.cfrErrorClip);
-                    rcs.enrol(ofdm.get());
-                    cifOfdm = ofdm;
-                }
-                break;
-            case FFTEngine::KISS:
-                cifOfdm = make_shared<OfdmGeneratorFixed>(
-                        (1 + m_nbSymbols),
-                        m_nbCarriers,
-                        m_spacing);
-                break;
-            case FFTEngine::DEXTER:
-#if defined(HAVE_DEXTER)
-                cifOfdm = make_shared<OfdmGeneratorDEXTER>(
-                        (1 + m_nbSymbols),
-                        m_nbCarriers,
-                        m_spacing);
-#else
-                throw std::runtime_error("Cannot use DEXTER fft engine without --enable-dexter");
-#endif
-                break;
+    // With a shared front end, the blocks from the TII to the
+    // predistortion exist once for every TX channel, and the RC names of
+    // the blocks of channel N start with txN.
+    const bool sharedFrontEnd = m_settings.txChannelsSharedFrontEnd and
+        m_settings.txChannels.size() > 1;
+    const string rc_name_prefix = get_rc_name_prefix();
+    if (sharedFrontEnd) {
+        if (fixedPoint) throw std::runtime_error("fixed point doesn't support a shared front end");
+        if (cifBatch or m_mixer or m_settings.enablePeakCancel or
+                m_settings.frequencyShift) {
+            throw std::runtime_error("A shared front end doesn't support "
+                    "batch_frames, frequency multiplexing, peak cancellation "
+                    "or the frequency shift");
         }
+        set_rc_name_prefix(rc_name_prefix + "tx0.");
+    }
 
-        shared_ptr<GainControl> cifGain;
+    shared_ptr<TII> tii;
+    shared_ptr<PhaseReference> tiiRef;
+    try {
+        tii = make_shared<TII>(
+                m_settings.dabMode,
+                sharedFrontEnd ?
+                    m_settings.txChannels[0].tiiConfig : m_settings.tiiConfig,
+                fixedPoint);
+        rcs.enrol(tii.get());
+        tiiRef = make_shared<PhaseReference>(mode, fixedPoint);
+    }
+    catch (const TIIError& e) {
+        etiLog.level(error) << "Could not initialise TII: " << e.what();
+    }
 
-        if (not fixedPoint) {
-            cifGain = make_shared<GainControl>(
+    shared_ptr<ModPlugin> cifOfdm;
+    shared_ptr<OfdmGeneratorCF32> cifOfdmCF32;
+
+    auto make_ofdm_cf32 = [&]() {
+        auto ofdm = make_shared<OfdmGeneratorCF32>(
+                (1 + m_nbSymbols),
+                m_nbCarriers,
+                m_spacing,
+                m_settings.enableCfr,
+                m_settings.cfrClip,
+                m_settings.cfrErrorClip,
+                m_settings.cfrIterations,
+                m_settings.cfrTargetPapr,
+                true,
+                m_settings.batchedFft,
+                m_settings.ofdmNumThreads,
+                m_settings.ofdmCacheStaticSymbols ? 2 : 0);
+        if (not carrierGains.empty()) {
+            ofdm->set_carrier_gains(carrierGains);
+        }
+        ofdm->set_cfr_method(m_settings.cfrMethod,
+                m_settings.cfrAceGain);
+        ofdm->set_stats_interval(m_settings.cfrStatsInterval);
+        if (m_settings.ofdmBatchService) {
+            ofdm->set_batch_service(m_settings.ofdmBatchService,
+                    m_settings.ofdmBatchSlot);
+        }
+        rcs.enrol(ofdm.get());
+        return ofdm;
+    };
+
+    switch (m_settings.fftEngine) {
+        case FFTEngine::FFTW:
+            cifOfdmCF32 = make_ofdm_cf32();
+            cifOfdm = cifOfdmCF32;
+            break;
+        case FFTEngine::KISS:
+            cifOfdm = make_shared<OfdmGeneratorFixed>(
+                    (1 + m_nbSymbols),
+                    m_nbCarriers,
+                    m_spacing);
+            break;
+        case FFTEngine::KISS_SIMD:
+            cifOfdm = make_shared<OfdmGeneratorFixed>(
+                    (1 + m_nbSymbols),
+                    m_nbCarriers,
                     m_spacing,
-                    m_settings.gainMode,
-                    m_settings.digitalgain,
-                    m_settings.normalise,
-                    m_settings.gainmodeVariance);
+                    true,
+                    true);
+            break;
+        case FFTEngine::DEXTER:
+#if defined(HAVE_DEXTER)
+            cifOfdm = make_shared<OfdmGeneratorDEXTER>(
+                    (1 + m_nbSymbols),
+                    m_nbCarriers,
+                    m_spacing);
+#else
+            throw std::runtime_error("Cannot use DEXTER fft engine without --enable-dexter");
+#endif
+            break;
+    }
 
-            rcs.enrol(cifGain.get());
+    // The GainControl can only do the clipping of the FormatConverter
+    // if the blocks in between do not change the amplitude. The
+    // windowing of the GuardIntervalInserter does not increase it.
+    bool gainClip = false;
+    if (m_settings.gainClip) {
+        if (m_settings.fftEngine != FFTEngine::FFTW or m_format.empty()) {
+            etiLog.level(warn) << "gain_clip ignored, the output does "
+                "not need a conversion from floating-point samples";
+        }
+        else if (m_settings.txChannels.size() > 1) {
+            etiLog.level(warn) << "gain_clip ignored, every TX channel "
+                "has its own gain and predistortion";
         }
+        else if (m_mixer) {
+            etiLog.level(warn) << "gain_clip ignored, the other "
+                "ensembles are added after the GainControl";
+        }
+        else if (not m_settings.filterTapsFilename.empty() or
+                not m_settings.polyCoefFilename.empty() or
+                not m_settings.memoryPolyCoefFilename.empty() or
+                m_settings.enablePeakCancel or
+                m_settings.outputRate != 2048000) {
+            etiLog.level(warn) << "gain_clip ignored, the FIR filter, "
+                "predistortion, peak cancellation or resampler changes "
+                "the amplitude after the GainControl";
+        }
+        else {
+            gainClip = true;
+        }
+    }
+
+    // The floating-point OfdmGenerator does the CFR itself
+    shared_ptr<FixedPointCfr> cifFixedCfr;
+    if (fixedPoint and m_settings.enableCfr) {
+        cifFixedCfr = make_shared<FixedPointCfr>(m_spacing,
+                m_settings.fftEngine, m_settings.cfrFixedPointPapr);
+        rcs.enrol(cifFixedCfr.get());
+    }
+
+    const auto clip_range = gainClip ?
+        FormatConverter::get_format_range(m_format) :
+        std::pair<float, float>(0.0f, 0.0f);
+
+    // With a shared front end, the digital gain of a TX channel is the one
+    // of its GainControl.
+    auto make_gain = [&](float& digital_gain) {
+        auto gain = make_shared<GainControl>(
+                m_spacing,
+                m_settings.gainMode,
+                digital_gain,
+                m_settings.normalise,
+                m_settings.gainmodeVariance,
+                gainClip, clip_range.first, clip_range.second,
+                m_settings.fftEngine);
+        rcs.enrol(gain.get());
+        return gain;
+    };
+    // The fixed-point chains only get a GainControl on demand, because the
+    // gain modes change the level of their output
+    shared_ptr<GainControl> cifGain;
+    if (not fixedPoint or m_settings.fixedPointGainControl) {
+        cifGain = make_gain(sharedFrontEnd ?
+                m_settings.txChannels[0].digitalGain : m_settings.digitalgain);
+    }
 
-        auto cifGuard = make_shared<GuardIntervalInserter>(
+    auto make_guard = [&]() {
+        auto guard = make_shared<GuardIntervalInserter>(
                 m_nbSymbols, m_spacing, m_nullSize, m_symSize,
                 m_settings.ofdmWindowOverlap, m_settings.fftEngine);
-        rcs.enrol(cifGuard.get());
+        rcs.enrol(guard.get());
+        return guard;
+    };
+    auto cifGuard = make_guard();
+
+    const bool resample = m_settings.outputRate != 2048000;
+
+    // The MemlessPoly can run between two resampling stages, at a rate
+    // where the predistortion is cheaper
+    size_t polyRate = m_settings.outputRate;
+    if (not m_settings.polyCoefFilename.empty() and
+            m_settings.polyRate != 0 and
+            m_settings.polyRate < m_settings.outputRate) {
+        if (m_settings.enablePeakCancel or m_mixer or
+                m_settings.txChannels.size() > 1) {
+            etiLog.level(warn) << "poly.rate ignored, the peak "
+                "cancellation, the frequency multiplexing and several TX "
+                "channels need the predistortion at the output rate";
+        }
+        else {
+            polyRate = m_settings.polyRate;
+            etiLog.level(info) << "Predistortion at " << polyRate <<
+                " samples/s, before the interpolation to " <<
+                m_settings.outputRate << " samples/s";
+        }
+    }
+    const bool polyBeforeResampler = polyRate < m_settings.outputRate;
+
+    // The fft resampler and the half-band interpolator only exist in
+    // floating point
+    if (resample and fixedPoint and
+            m_settings.resampler != ResamplerType::Polyphase) {
+        etiLog.level(info) << "Using the polyphase resampler, the other "
+            "resamplers do not support fixed point";
+    }
+    const bool polyphaseResampler = resample and (fixedPoint or
+            m_settings.resampler == ResamplerType::Polyphase);
+    const bool halfbandInterpolator = resample and not polyphaseResampler and (
+            m_settings.resampler == ResamplerType::Halfband or
+            (m_settings.resampler == ResamplerType::Auto and
+             HalfbandInterpolator::supports_ratio(2048000, m_settings.outputRate) and
+             (polyRate == 2048000 or
+              HalfbandInterpolator::supports_ratio(2048000, polyRate))));
+
+    // The taps of the FIR filter a PolyphaseResampler includes depend on
+    // its ratio
+    if (polyphaseResampler and polyBeforeResampler and polyRate != 2048000 and
+            not m_settings.filterTapsFilename.empty()) {
+        throw std::runtime_error("The polyphase resampler with a FIR filter "
+                "needs poly.rate 2048000 or the output rate");
+    }
+
+    // The PolyphaseResampler includes the FIR filter
+    auto make_filter = [&]() {
+        shared_ptr<FIRFilter> filter;
+        if (not m_settings.filterTapsFilename.empty() and
+                not polyphaseResampler) {
+            filter = make_shared<FIRFilter>(m_settings.filterTapsFilename,
+                    m_settings.filterFftMinTaps, m_settings.fftEngine,
+                    m_settings.filterFftThreads, m_settings.filterNumThreads);
+            filter->set_bypass(m_settings.filterBypass);
+            rcs.enrol(filter.get());
+        }
+        return filter;
+    };
+    auto cifFilter = make_filter();
+
+    shared_ptr<MemlessPoly> cifPoly;
+    if (not m_settings.polyCoefFilename.empty()) {
+        cifPoly = make_shared<MemlessPoly>(m_settings.polyCoefFilename,
+                                           m_settings.polyNumThreads,
+                                           m_settings.fftEngine);
+        cifPoly->set_bypass(m_settings.polyBypass);
+        rcs.enrol(cifPoly.get());
+    }
 
-        shared_ptr<FIRFilter> cifFilter;
-        if (not m_settings.filterTapsFilename.empty()) {
-            if (fixedPoint) throw std::runtime_error("fixed point doesn't support fir filter");
+    shared_ptr<MemoryPoly> cifMemPoly;
+    if (not m_settings.memoryPolyCoefFilename.empty()) {
+        if (fixedPoint) throw std::runtime_error("fixed point doesn't support predistortion");
 
-            cifFilter = make_shared<FIRFilter>(m_settings.filterTapsFilename);
-            rcs.enrol(cifFilter.get());
+        cifMemPoly = make_shared<MemoryPoly>(
+                m_settings.memoryPolyCoefFilename,
+                m_settings.memoryPolyNumThreads);
+        cifMemPoly->set_bypass(m_settings.memoryPolyBypass);
+        rcs.enrol(cifMemPoly.get());
+    }
+
+    // With several TX channels, the processing that differs for
+    // every PA comes after a fan-out, and the channels are put
+    // together again before the FormatConverter.
+    shared_ptr<ChannelSplitter> cifSplit;
+    vector<shared_ptr<MemlessPoly> > cifChannelPolys;
+    shared_ptr<ChannelCombiner> cifCombine;
+    if (m_settings.txChannels.size() > 1) {
+        if (fixedPoint) throw std::runtime_error("fixed point doesn't support several TX channels");
+
+        vector<float> gains;
+        for (auto& channel : m_settings.txChannels) {
+            if (sharedFrontEnd) {
+                // The split carriers are not scaled, and the polys are
+                // created with the other blocks of their channel
+                gains.push_back(1.0f);
+                continue;
+            }
+            gains.push_back(channel.digitalGain);
+            if (not channel.polyCoefFilename.empty()) {
+                auto poly = make_shared<MemlessPoly>(
+                        channel.polyCoefFilename,
+                        m_settings.polyNumThreads,
+                        m_settings.fftEngine,
+                        "memlesspoly" + to_string(cifChannelPolys.size()));
+                rcs.enrol(poly.get());
+                cifChannelPolys.push_back(poly);
+            }
         }
 
-        shared_ptr<MemlessPoly> cifPoly;
-        if (not m_settings.polyCoefFilename.empty()) {
-            if (fixedPoint) throw std::runtime_error("fixed point doesn't support predistortion");
+        cifSplit = make_shared<ChannelSplitter>(gains);
+        if (not sharedFrontEnd) {
+            rcs.enrol(cifSplit.get());
+        }
+        cifCombine = make_shared<ChannelCombiner>(gains.size());
+    }
 
-            cifPoly = make_shared<MemlessPoly>(m_settings.polyCoefFilename,
-                                               m_settings.polyNumThreads);
-            rcs.enrol(cifPoly.get());
+    auto make_resampler = [&](size_t inputRate, size_t outputRate) {
+        shared_ptr<ModPlugin> resampler;
+        if (inputRate != outputRate) {
+            if (polyphaseResampler) {
+                auto res = make_shared<PolyphaseResampler>(
+                        inputRate,
+                        outputRate,
+                        m_settings.filterTapsFilename,
+                        m_settings.fftEngine);
+                if (not m_settings.filterTapsFilename.empty()) {
+                    rcs.enrol(res.get());
+                }
+                resampler = res;
+            }
+            else if (halfbandInterpolator) {
+                auto res = make_shared<HalfbandInterpolator>(
+                        inputRate, outputRate);
+                etiLog.level(info) << "Using " << res->num_stages() <<
+                    " half-band stages for the interpolation to " <<
+                    outputRate << " samples/s, " <<
+                    res->num_multiplications() << " multiplications per sample";
+
+                // The fft resampler was the default before, and delays the
+                // signal by much more, which calibrated SFN offsets include
+                const size_t fftDelay = Resampler::delay(inputRate,
+                        outputRate, m_spacing * inputRate / 2048000);
+                etiLog.level(m_settings.resampler == ResamplerType::Auto ?
+                        warn : info) <<
+                    "The half-band interpolator delays the signal by " <<
+                    res->delay() << " samples, the fft resampler by " <<
+                    fftDelay << " samples at " << outputRate <<
+                    " samples/s. Set resampler=fft to keep the timing "
+                    "of the fft resampler";
+                resampler = res;
+            }
+            else {
+                // The resolution is the symbol spacing, at the input rate
+                resampler = make_shared<Resampler>(
+                        inputRate,
+                        outputRate,
+                        m_spacing * inputRate / 2048000,
+                        m_settings.resamplerFftThreads);
+            }
         }
+        return resampler;
+    };
+    auto cifRes = make_resampler(2048000, polyRate);
+    // The rest of the interpolation, after the predistortion
+    auto cifPolyRes = make_resampler(polyRate, m_settings.outputRate);
+    const auto cifPolyLowRate = polyBeforeResampler ? cifPoly : nullptr;
+    const auto cifPolyOutputRate = polyBeforeResampler ? nullptr : cifPoly;
+
+    // The peak cancellation sees the samples as they are after the
+    // cyclic prefix, the windowing, the FIR filter and the resampler
+    shared_ptr<PeakCanceller> cifPeakCancel;
+    if (m_settings.enablePeakCancel) {
+        if (fixedPoint) throw std::runtime_error("fixed point doesn't support peak cancellation");
+
+        cifPeakCancel = make_shared<PeakCanceller>(
+                m_settings.peakCancelThreshold,
+                m_settings.peakCancelIterations,
+                m_settings.outputRate);
+        rcs.enrol(cifPeakCancel.get());
+        etiLog.level(info) << "Peak cancellation delays the output by " <<
+            cifPeakCancel->delay() << " samples";
+    }
 
-        shared_ptr<Resampler> cifRes;
-        if (m_settings.outputRate != 2048000) {
-            if (fixedPoint) throw std::runtime_error("fixed point doesn't support resampler");
+    shared_ptr<EnsembleMixerStage> cifMixer;
+    if (m_mixer) {
+        if (fixedPoint) throw std::runtime_error("fixed point doesn't support frequency multiplexing");
 
-            cifRes = make_shared<Resampler>(
-                    2048000,
-                    m_settings.outputRate,
-                    m_spacing);
+        cifMixer = make_shared<EnsembleMixerStage>(m_mixer, m_settings.normalise);
+    }
+
+    shared_ptr<FrequencyShifter> cifShift;
+    if (m_settings.frequencyShift) {
+        if (fixedPoint) throw std::runtime_error("fixed point doesn't support the frequency shift");
+
+        cifShift = make_shared<FrequencyShifter>(m_settings.outputRate,
+                m_settings.frequencyShiftOffset,
+                m_settings.frequencyShiftRealOutput);
+        rcs.enrol(cifShift.get());
+    }
+
+    // The TX channels of a shared front end, channel 0 uses the blocks
+    // above for everything but its predistortion
+    struct back_end_t {
+        shared_ptr<NullSymbol> null;
+        shared_ptr<SignalMultiplexer> sig;
+        shared_ptr<TII> tii;
+        shared_ptr<PhaseReference> tiiRef;
+        // From the OFDM generator to the resampler
+        vector<shared_ptr<ModPlugin> > plugins;
+        shared_ptr<MemlessPoly> poly;
+    };
+    vector<back_end_t> backEnds;
+    if (sharedFrontEnd) {
+        for (size_t c = 0; c < m_settings.txChannels.size(); c++) {
+            auto& channel = m_settings.txChannels[c];
+            set_rc_name_prefix(rc_name_prefix + "tx" + to_string(c) + ".");
+
+            back_end_t backEnd;
+            if (c == 0) {
+                backEnd.null = cifNull;
+                backEnd.sig = cifSig;
+                backEnd.tii = tii;
+                backEnd.tiiRef = tiiRef;
+            }
+            else {
+                backEnd.null = make_shared<NullSymbol>(m_nbCarriers, carrier_size);
+                backEnd.sig = make_shared<SignalMultiplexer>(m_nbCarriers * carrier_size);
+                try {
+                    backEnd.tii = make_shared<TII>(mode, channel.tiiConfig,
+                            fixedPoint);
+                    rcs.enrol(backEnd.tii.get());
+                    backEnd.tiiRef = make_shared<PhaseReference>(mode, fixedPoint);
+                }
+                catch (const TIIError& e) {
+                    etiLog.level(error) << "Could not initialise TII of TX "
+                        "channel " << c << ": " << e.what();
+                }
+
+                for (const auto& p : {
+                        static_pointer_cast<ModPlugin>(make_ofdm_cf32()),
+                        static_pointer_cast<ModPlugin>(make_gain(channel.digitalGain)),
+                        static_pointer_cast<ModPlugin>(make_guard()),
+                        static_pointer_cast<ModPlugin>(make_filter()),
+                        make_resampler(2048000, m_settings.outputRate)}) {
+                    if (p) {
+                        backEnd.plugins.push_back(p);
+                    }
+                }
+            }
+
+            if (not channel.polyCoefFilename.empty()) {
+                backEnd.poly = make_shared<MemlessPoly>(
+                        channel.polyCoefFilename,
+                        m_settings.polyNumThreads,
+                        m_settings.fftEngine);
+                rcs.enrol(backEnd.poly.get());
+                cifChannelPolys.push_back(backEnd.poly);
+            }
+            backEnds.push_back(std::move(backEnd));
         }
+        set_rc_name_prefix(rc_name_prefix);
+
+        etiLog.level(info) << "The " << backEnds.size() << " TX channels "
+            "share the modulation up to the differential modulator";
+    }
 
-        if (m_settings.fftEngine == FFTEngine::FFTW and not m_format.empty()) {
-            m_formatConverter = make_shared<FormatConverter>(false, m_format);
+    if (m_settings.fftEngine == FFTEngine::FFTW and not m_format.empty()) {
+        m_formatConverter = make_shared<FormatConverter>(false, m_format,
+                gainClip);
+    }
+    else if (m_settings.fftEngine == FFTEngine::DEXTER and
+            not m_format.empty()) {
+        m_formatConverter = make_shared<FormatConverter>(true, m_format);
+    }
+    // KISS and KISS_SIMD are already in s16, and the Dexter output
+    // converts the samples of the FPGA FFT itself
+
+    // The FIC and the subchannels are connected to the FrameMultiplexer
+    // and the BlockPartitioner once the ETI is known.
+    m_flowgraph->connect(cifPrbs, cifMux);
+    m_cifMux = cifMux;
+    m_cifPart = cifPart;
+
+    m_flowgraph->connect(cifRef, cifDiff);
+    m_flowgraph->connect(cifPart, cifDiff);
+    if (sharedFrontEnd) {
+        m_flowgraph->connect(cifDiff, cifSplit);
+        for (auto& backEnd : backEnds) {
+            m_flowgraph->connect(backEnd.null, backEnd.sig);
+            m_flowgraph->connect(cifSplit, backEnd.sig);
+            if (backEnd.tii) {
+                m_flowgraph->connect(backEnd.tiiRef, backEnd.tii);
+                m_flowgraph->connect(backEnd.tii, backEnd.sig);
+            }
         }
-        else if (m_settings.fftEngine == FFTEngine::DEXTER) {
-            m_formatConverter = make_shared<FormatConverter>(true, m_format);
+    }
+    else {
+        m_flowgraph->connect(cifNull, cifSig);
+        m_flowgraph->connect(cifDiff, cifSig);
+        if (tii) {
+            m_flowgraph->connect(tiiRef, tii);
+            m_flowgraph->connect(tii, cifSig);
         }
-        // KISS is already in s16
-
-        m_output = make_shared<OutputMemory>(dataOut);
+    }
 
-        m_flowgraph->connect(cifPrbs, cifMux);
+    shared_ptr<ModPlugin> prev_plugin = static_pointer_cast<ModPlugin>(cifSig);
+    const std::vector<shared_ptr<ModPlugin> > plugins({
+            static_pointer_cast<ModPlugin>(cifBatch),
+            static_pointer_cast<ModPlugin>(cifCicEq),
+            static_pointer_cast<ModPlugin>(cifOfdm),
+            static_pointer_cast<ModPlugin>(cifFixedCfr),
+            static_pointer_cast<ModPlugin>(cifGain),
+            static_pointer_cast<ModPlugin>(cifGuard),
+            // optional blocks
+            static_pointer_cast<ModPlugin>(cifFilter),
+            static_pointer_cast<ModPlugin>(cifRes),
+            static_pointer_cast<ModPlugin>(cifPolyLowRate),
+            cifPolyRes,
+            static_pointer_cast<ModPlugin>(cifPeakCancel),
+            static_pointer_cast<ModPlugin>(cifMixer),
+            static_pointer_cast<ModPlugin>(cifShift),
+            static_pointer_cast<ModPlugin>(cifPolyOutputRate),
+            static_pointer_cast<ModPlugin>(cifMemPoly),
+            });
+
+    // The format converter directly follows the other blocks when there
+    // is no channel split in between
+    vector<shared_ptr<ModPlugin> > chain;
+    for (auto& p : plugins) {
+        if (p) {
+            chain.push_back(p);
+        }
+    }
+    if (m_formatConverter and not cifSplit) {
+        chain.push_back(m_formatConverter);
+    }
 
-        ////////////////////////////////////////////////////////////////
-        // Processing FIC
-        ////////////////////////////////////////////////////////////////
-        shared_ptr<FicSource> fic(m_etiSource.getFic());
-        ////////////////////////////////////////////////////////////////
-        // Data initialisation
-        ////////////////////////////////////////////////////////////////
-        size_t ficSizeIn = fic->getFramesize();
+    if (m_settings.halfSamples != half_format_e::none and
+            m_settings.planarSamples) {
+        etiLog.level(warn) << "half_samples ignored, it does not support "
+            "planar_samples";
+    }
+    else if (m_settings.halfSamples != half_format_e::none) {
+        // Every buffer between two consecutive blocks that support it
+        const auto format = m_settings.halfSamples;
+        size_t num_buffers = 0;
+        for (size_t i = 0; i + 1 < chain.size(); i++) {
+            auto from = dynamic_pointer_cast<ModCodec>(chain[i]);
+            auto to = dynamic_pointer_cast<ModCodec>(chain[i + 1]);
+            if (from and to and from->supports_half_output() and
+                    to->supports_half_input()) {
+                from->set_half_output(format);
+                to->set_half_input(format);
+                etiLog.level(info) << "Passing " <<
+                    half_float::format_name(format) << " samples from " <<
+                    from->name() << " to " << to->name();
+                num_buffers++;
+            }
+        }
 
-        ////////////////////////////////////////////////////////////////
-        // Modules configuration
-        ////////////////////////////////////////////////////////////////
+        if (num_buffers == 0) {
+            etiLog.level(warn) << "half_samples ignored, it needs the fftw "
+                "engine and an output format, with the format converter "
+                "right after the guard interval";
+        }
+    }
 
-        // Configuring FIC channel
+    shared_ptr<SymbolStreamer> cifStreamer;
+    if (m_settings.streamSymbols > 0 and sharedFrontEnd) {
+        etiLog.level(warn) << "stream_symbols ignored, it does not "
+            "support a shared front end";
+    }
+    else if (m_settings.streamSymbols > 0) {
+        // The longest run of blocks that can process parts of frames
+        size_t stream_start = 0;
+        size_t stream_len = 0;
+        for (size_t i = 0; i < chain.size(); i++) {
+            size_t len = 0;
+            while (i + len < chain.size()) {
+                auto codec = dynamic_pointer_cast<ModCodec>(chain[i + len]);
+                if (not codec or not codec->supports_streaming()) {
+                    break;
+                }
+                len++;
+            }
+            if (len > stream_len) {
+                stream_start = i;
+                stream_len = len;
+            }
+        }
 
-        PDEBUG("FIC:\n");
-        PDEBUG(" Framesize: %zu\n", fic->getFramesize());
+        if (m_settings.planarSamples) {
+            etiLog.level(warn) << "stream_symbols ignored, it does not "
+                "support planar_samples";
+        }
+        else if (stream_len < 2) {
+            etiLog.level(warn) << "stream_symbols ignored, it needs two "
+                "consecutive blocks among the predistorters and the "
+                "format converter";
+        }
+        else {
+            vector<shared_ptr<ModCodec> > codecs;
+            string names;
+            for (size_t i = stream_start; i < stream_start + stream_len; i++) {
+                codecs.push_back(dynamic_pointer_cast<ModCodec>(chain[i]));
+                names += string(names.empty() ? "" : ", ") + chain[i]->name();
+            }
 
-        // Configuring prbs generator
-        auto ficPrbs = make_shared<PrbsGenerator>(ficSizeIn, 0x110);
+            // Including the null symbol
+            const size_t symbols_per_call =
+                m_settings.batchFrames * (1 + m_nbSymbols);
+            const size_t num_parts =
+                (symbols_per_call + m_settings.streamSymbols - 1) /
+                m_settings.streamSymbols;
+            cifStreamer = make_shared<SymbolStreamer>(codecs, num_parts);
 
-        // Configuring convolutionnal encoder
-        auto ficConv = make_shared<ConvEncoder>(ficSizeIn);
+            chain.erase(chain.begin() + stream_start,
+                    chain.begin() + stream_start + stream_len);
+            chain.insert(chain.begin() + stream_start, cifStreamer);
 
-        // Configuring puncturing encoder
-        auto ficPunc = make_shared<PuncturingEncoder>();
-        for (const auto &rule : fic->get_rules()) {
-            PDEBUG(" Adding rule:\n");
-            PDEBUG("  Length: %zu\n", rule.length());
-            PDEBUG("  Pattern: 0x%x\n", rule.pattern());
-            ficPunc->append_rule(rule);
+            etiLog.level(info) << "Processing " << names << " in " <<
+                num_parts << " parts per frame";
         }
-        PDEBUG(" Adding tail\n");
-        ficPunc->append_tail_rule(PuncturingRule(3, 0xcccccc));
+    }
 
-        m_flowgraph->connect(fic, ficPrbs);
-        m_flowgraph->connect(ficPrbs, ficConv);
-        m_flowgraph->connect(ficConv, ficPunc);
-        m_flowgraph->connect(ficPunc, cifPart);
+    for (auto& p : chain) {
+        m_flowgraph->connect(prev_plugin, p,
+                p == cifOfdm and stage_boundary("ofdm"));
+        prev_plugin = p;
+    }
 
-        ////////////////////////////////////////////////////////////////
-        // Configuring subchannels
-        ////////////////////////////////////////////////////////////////
-        for (const auto& subchannel : m_etiSource.getSubchannels()) {
+    if (sharedFrontEnd) {
+        for (size_t c = 0; c < backEnds.size(); c++) {
+            const auto& backEnd = backEnds[c];
+            shared_ptr<ModPlugin> prev = (c == 0) ?
+                prev_plugin : static_pointer_cast<ModPlugin>(backEnd.sig);
+            for (const auto& p : backEnd.plugins) {
+                m_flowgraph->connect(prev, p,
+                        p == backEnd.plugins.front() and stage_boundary("ofdm"));
+                prev = p;
+            }
+            if (backEnd.poly) {
+                m_flowgraph->connect(prev, backEnd.poly);
+                prev = backEnd.poly;
+            }
+            m_flowgraph->connect(prev, cifCombine);
+        }
+        prev_plugin = cifCombine;
+    }
+    else if (cifSplit) {
+        m_flowgraph->connect(prev_plugin, cifSplit);
+        for (size_t c = 0; c < m_settings.txChannels.size(); c++) {
+            if (cifChannelPolys.empty()) {
+                m_flowgraph->connect(cifSplit, cifCombine);
+            }
+            else {
+                m_flowgraph->connect(cifSplit, cifChannelPolys[c]);
+                m_flowgraph->connect(cifChannelPolys[c], cifCombine);
+            }
+        }
+        prev_plugin = cifCombine;
+    }
 
-            ////////////////////////////////////////////////////////////
-            // Data initialisation
-            ////////////////////////////////////////////////////////////
-            size_t subchSizeIn = subchannel->framesize();
-            size_t subchSizeOut = subchannel->framesizeCu() * 8;
-
-            ////////////////////////////////////////////////////////////
-            // Modules configuration
-            ////////////////////////////////////////////////////////////
-
-            // Configuring subchannel
-            PDEBUG("Subchannel:\n");
-            PDEBUG(" Start address: %zu\n",
-                    subchannel->startAddress());
-            PDEBUG(" Framesize: %zu\n",
-                    subchannel->framesize());
-            PDEBUG(" Bitrate: %zu\n", subchannel->bitrate());
-            PDEBUG(" Framesize CU: %zu\n",
-                    subchannel->framesizeCu());
-            PDEBUG(" Protection: %zu\n",
-                    subchannel->protection());
-            PDEBUG("  Form: %zu\n",
-                    subchannel->protectionForm());
-            PDEBUG("  Level: %zu\n",
-                    subchannel->protectionLevel());
-            PDEBUG("  Option: %zu\n",
-                    subchannel->protectionOption());
-
-            // Configuring prbs genrerator
-            auto subchPrbs = make_shared<PrbsGenerator>(subchSizeIn, 0x110);
+    if (m_formatConverter and cifSplit) {
+        m_flowgraph->connect(prev_plugin, m_formatConverter);
+        prev_plugin = m_formatConverter;
+    }
 
-            // Configuring convolutionnal encoder
-            auto subchConv = make_shared<ConvEncoder>(subchSizeIn);
+    // The OutputMemory needs the buffer given to process()
+    m_chainEnd = prev_plugin;
+
+    for (const auto& p : {
+            static_pointer_cast<ModPlugin>(cifRef),
+            static_pointer_cast<ModPlugin>(cifDiff),
+            static_pointer_cast<ModPlugin>(cifNull),
+            static_pointer_cast<ModPlugin>(cifSig),
+            static_pointer_cast<ModPlugin>(cifSplit),
+            static_pointer_cast<ModPlugin>(cifCombine),
+            static_pointer_cast<ModPlugin>(cifStreamer),
+            static_pointer_cast<ModPlugin>(m_formatConverter)}) {
+        if (p) {
+            m_standbyPlugins.push_back(p);
+        }
+    }
+    for (const auto& p : plugins) {
+        if (p) {
+            m_standbyPlugins.push_back(p);
+        }
+    }
+    for (const auto& p : cifChannelPolys) {
+        m_standbyPlugins.push_back(p);
+    }
+    for (const auto& backEnd : backEnds) {
+        if (backEnd.null != cifNull) {
+            m_standbyPlugins.push_back(backEnd.null);
+            m_standbyPlugins.push_back(backEnd.sig);
+        }
+        for (const auto& p : backEnd.plugins) {
+            m_standbyPlugins.push_back(p);
+        }
+    }
 
-            // Configuring puncturing encoder
-            auto subchPunc =
-                make_shared<PuncturingEncoder>(subchannel->framesizeCu());
-
-            for (const auto& rule : subchannel->get_rules()) {
-                PDEBUG(" Adding rule:\n");
-                PDEBUG("  Length: %zu\n", rule.length());
-                PDEBUG("  Pattern: 0x%x\n", rule.pattern());
-                subchPunc->append_rule(rule);
+    // With a shared PipelineExecutor, the frames of the blocks closer to
+    // the output go first, as the output waits for them.
+    int pipeline_priority = 0;
+    auto setup_pipeline = [&](PipelinedModCodec& pipelined, int priority) {
+        string block = pipelined.name();
+        std::transform(block.begin(), block.end(), block.begin(), ::tolower);
+        const auto depth = m_settings.pipelineDepth.find(block);
+        if (depth != m_settings.pipelineDepth.end()) {
+            pipelined.set_pipeline_depth(depth->second);
+        }
+        pipelined.set_pipeline_priority(priority);
+    };
+    for (const auto& p : plugins) {
+        if (auto pipelined = dynamic_pointer_cast<PipelinedModCodec>(p)) {
+            setup_pipeline(*pipelined, pipeline_priority++);
+            m_pipelineDelay += pipelined->get_pipeline_depth();
+        }
+    }
+    // The back ends and the channel polynomials run side by side
+    size_t parallel_delay = 0;
+    for (const auto& backEnd : backEnds) {
+        int priority = 0;
+        size_t delay = 0;
+        for (const auto& p : backEnd.plugins) {
+            if (auto pipelined = dynamic_pointer_cast<PipelinedModCodec>(p)) {
+                setup_pipeline(*pipelined, priority++);
+                delay += pipelined->get_pipeline_depth();
             }
-            PDEBUG(" Adding tail\n");
-            subchPunc->append_tail_rule(PuncturingRule(3, 0xcccccc));
+        }
+        parallel_delay = std::max(parallel_delay, delay);
+    }
+    m_pipelineDelay += parallel_delay;
+    parallel_delay = 0;
+    for (const auto& p : cifChannelPolys) {
+        setup_pipeline(*p, pipeline_priority);
+        parallel_delay = std::max(parallel_delay, p->get_pipeline_depth());
+    }
+    m_pipelineDelay += parallel_delay;
 
-            // Configuring time interleaver
-            auto subchInterleaver = make_shared<TimeInterleaver>(subchSizeOut);
+    if (m_settings.enableAutoTune) {
+        m_autoTuner = make_shared<AutoTuner>(transmission_frame_duration(mode),
+                m_settings.autoTuneDuration, m_settings.autoTuneHeadroom);
 
-            m_flowgraph->connect(subchannel, subchPrbs);
-            m_flowgraph->connect(subchPrbs, subchConv);
-            m_flowgraph->connect(subchConv, subchPunc);
-            m_flowgraph->connect(subchPunc, subchInterleaver);
-            m_flowgraph->connect(subchInterleaver, cifMux);
+        auto add_block = [&](const shared_ptr<ModPlugin>& p) {
+            if (auto pipelined = dynamic_pointer_cast<PipelinedModCodec>(p)) {
+                string threads_key;
+                if (p == cifPoly) {
+                    threads_key = "poly.num_threads";
+                }
+                else if (p == cifMemPoly) {
+                    threads_key = "memorypoly.num_threads";
+                }
+                else if (p == cifFilter) {
+                    threads_key = "firfilter.num_threads";
+                }
+                m_autoTuner->add_block(pipelined.get(), threads_key);
+            }
+        };
+        for (const auto& p : plugins) {
+            add_block(p);
         }
+        for (const auto& backEnd : backEnds) {
+            for (const auto& p : backEnd.plugins) {
+                add_block(p);
+            }
+        }
+        for (const auto& p : cifChannelPolys) {
+            m_autoTuner->add_block(p.get(), "txchannels.num_threads");
+        }
+        rcs.enrol(m_autoTuner.get());
+    }
 
-        m_flowgraph->connect(cifMux, cifPart);
-        m_flowgraph->connect(cifPart, cifMap);
-        m_flowgraph->connect(cifMap, cifFreq);
-        m_flowgraph->connect(cifRef, cifDiff);
-        m_flowgraph->connect(cifFreq, cifDiff);
-        m_flowgraph->connect(cifNull, cifSig);
-        m_flowgraph->connect(cifDiff, cifSig);
-        if (tii) {
-            m_flowgraph->connect(tiiRef, tii);
-            m_flowgraph->connect(tii, cifSig);
+    if (m_settings.enableRtBudget) {
+        if (fixedPoint) throw std::runtime_error("fixed point doesn't support the real-time budget");
+
+        m_rtBudget = make_shared<RealtimeBudget>(
+                transmission_frame_duration(mode),
+                m_settings.rtBudgetHigh, m_settings.rtBudgetLow,
+                m_settings.rtBudgetWindow, m_settings.rtBudgetRecovery);
+
+        // The steps whose blocks are not in the flowgraph are left out
+        for (const auto& step : m_settings.rtBudgetSteps) {
+            if (step == "mer" and cifOfdmCF32 and m_settings.enableCfr) {
+                m_rtBudget->add_step(step, cifOfdmCF32.get(), "mer_calc", "0");
+            }
+            else if (step == "cfr" and cifOfdmCF32 and m_settings.enableCfr) {
+                m_rtBudget->add_step(step, cifOfdmCF32.get(), "cfr", "0");
+            }
+            else if (step == "dpd") {
+                if (cifPoly) {
+                    m_rtBudget->add_step(step, cifPoly.get(), "lut_fallback", "1");
+                }
+                for (auto& poly : cifChannelPolys) {
+                    m_rtBudget->add_step(step, poly.get(), "lut_fallback", "1");
+                }
+            }
         }
+        rcs.enrol(m_rtBudget.get());
+        etiLog.level(info) << "Real-time budget steps: " <<
+            m_rtBudget->get_parameter("steps");
+    }
 
-        shared_ptr<ModPlugin> prev_plugin = static_pointer_cast<ModPlugin>(cifSig);
-        const std::vector<shared_ptr<ModPlugin> > plugins({
-                static_pointer_cast<ModPlugin>(cifCicEq),
+    if (m_settings.planarSamples) {
+        // Every block from the OFDM generator to the FormatConverter must
+        // support the planar layout
+        vector<shared_ptr<ModPlugin> > planar_plugins;
+        for (const auto& p : {
                 static_pointer_cast<ModPlugin>(cifOfdm),
+                static_pointer_cast<ModPlugin>(cifFixedCfr),
                 static_pointer_cast<ModPlugin>(cifGain),
                 static_pointer_cast<ModPlugin>(cifGuard),
-                // optional blocks
                 static_pointer_cast<ModPlugin>(cifFilter),
-                static_pointer_cast<ModPlugin>(cifRes),
-                static_pointer_cast<ModPlugin>(cifPoly),
-                static_pointer_cast<ModPlugin>(m_formatConverter),
-                // mandatory block
-                static_pointer_cast<ModPlugin>(m_output),
-                });
-
-        for (auto& p : plugins) {
+                cifRes,
+                static_pointer_cast<ModPlugin>(cifPolyLowRate),
+                cifPolyRes,
+                static_pointer_cast<ModPlugin>(cifPeakCancel),
+                static_pointer_cast<ModPlugin>(cifMixer),
+                static_pointer_cast<ModPlugin>(cifShift),
+                static_pointer_cast<ModPlugin>(cifPolyOutputRate),
+                static_pointer_cast<ModPlugin>(cifMemPoly),
+                static_pointer_cast<ModPlugin>(cifSplit),
+                static_pointer_cast<ModPlugin>(m_formatConverter)}) {
             if (p) {
-                m_flowgraph->connect(prev_plugin, p);
-                prev_plugin = p;
+                planar_plugins.push_back(p);
             }
         }
-        etiLog.level(debug) << "DabModulator set up.";
+
+        vector<shared_ptr<ModCodec> > planar_codecs;
+        string blocking;
+        for (size_t i = 0; i < planar_plugins.size(); i++) {
+            auto codec = dynamic_pointer_cast<ModCodec>(planar_plugins[i]);
+            const bool first = (i == 0);
+            const bool last = (i + 1 == planar_plugins.size());
+            if (not codec or
+                    (not first and not codec->supports_planar_input()) or
+                    (not last and not codec->supports_planar_output())) {
+                blocking = planar_plugins[i]->name();
+                break;
+            }
+            planar_codecs.push_back(codec);
+        }
+
+        if (not m_formatConverter) {
+            etiLog.level(warn) << "planar_samples ignored, it needs the fftw "
+                "engine and an output format";
+        }
+        else if (not blocking.empty()) {
+            etiLog.level(warn) << "planar_samples ignored, " << blocking <<
+                " does not support the planar layout";
+        }
+        else {
+            for (auto& codec : planar_codecs) {
+                codec->set_planar(true);
+            }
+            etiLog.level(info) << "Using the planar sample layout for " <<
+                planar_codecs.size() << " blocks";
+        }
     }
 
-    ////////////////////////////////////////////////////////////////////
-    // Processing data
-    ////////////////////////////////////////////////////////////////////
-    return m_flowgraph->run();
+    etiLog.level(debug) << "DabModulator OFDM part set up in " <<
+        chrono::duration_cast<chrono::milliseconds>(
+                chrono::steady_clock::now() - start).count() << " ms";
+}
+
+bool DabModulator::stage_boundary(const std::string& cut) const
+{
+    const auto& cuts = m_settings.pipelineStages;
+    return std::find(cuts.begin(), cuts.end(), cut) != cuts.end();
+}
+
+DabModulator::subchannel_chain_t DabModulator::setupSubchannel(
+        const std::shared_ptr<SubchannelSource>& subchannel)
+{
+    subchannel_chain_t chain;
+    chain.source = subchannel;
+
+    ////////////////////////////////////////////////////////////
+    // Data initialisation
+    ////////////////////////////////////////////////////////////
+    size_t subchSizeIn = subchannel->framesize();
+    size_t subchSizeOut = subchannel->framesizeCu() * 8;
+
+    ////////////////////////////////////////////////////////////
+    // Modules configuration
+    ////////////////////////////////////////////////////////////
+
+    // Configuring subchannel
+    PDEBUG("Subchannel:\n");
+    PDEBUG(" Start address: %zu\n",
+            subchannel->startAddress());
+    PDEBUG(" Framesize: %zu\n",
+            subchannel->framesize());
+    PDEBUG(" Bitrate: %zu\n", subchannel->bitrate());
+    PDEBUG(" Framesize CU: %zu\n",
+            subchannel->framesizeCu());
+    PDEBUG(" Protection: %zu\n",
+            subchannel->protection());
+    PDEBUG("  Form: %zu\n",
+            subchannel->protectionForm());
+    PDEBUG("  Level: %zu\n",
+            subchannel->protectionLevel());
+    PDEBUG("  Option: %zu\n",
+            subchannel->protectionOption());
+
+    // Configuring time interleaver
+    auto subchInterleaver = make_shared<TimeInterleaver>(subchSizeOut);
+
+    if (m_settings.fusedSubchannelEncoder) {
+        auto subchEnc = make_shared<SubchannelEncoder>(
+                subchSizeIn,
+                subchannel->framesizeCu(),
+                subchannel->get_rules(),
+                PuncturingRule(3, 0xcccccc),
+                m_settings.encoderCacheSize);
+
+        m_flowgraph->connect(subchannel, subchEnc);
+        m_flowgraph->connect(subchEnc, subchInterleaver);
+        chain.plugins = {subchannel, subchEnc, subchInterleaver};
+    }
+    else {
+        // Configuring prbs genrerator
+        auto subchPrbs = make_shared<PrbsGenerator>(subchSizeIn, 0x110);
+
+        // Configuring convolutionnal encoder
+        auto subchConv = make_shared<ConvEncoder>(subchSizeIn);
+
+        // Configuring puncturing encoder
+        auto subchPunc = make_shared<PuncturingEncoder>(
+                subchannel->framesizeCu(), subchannel->get_rules(),
+                PuncturingRule(3, 0xcccccc));
+
+        m_flowgraph->connect(subchannel, subchPrbs);
+        m_flowgraph->connect(subchPrbs, subchConv);
+        m_flowgraph->connect(subchConv, subchPunc);
+        m_flowgraph->connect(subchPunc, subchInterleaver);
+        chain.plugins = {subchannel, subchPrbs, subchConv, subchPunc,
+            subchInterleaver};
+    }
+
+    const auto state = m_restoreState.find(state_key(*subchannel));
+    if (state != m_restoreState.end()) {
+        try {
+            subchInterleaver->restore_state(state->second);
+        }
+        catch (const std::invalid_argument& e) {
+            etiLog.level(warn) << "Cannot restore the subchannel at " <<
+                subchannel->startAddress() << ": " << e.what();
+        }
+        m_restoreState.erase(state);
+    }
+
+    chain.interleaver = subchInterleaver;
+    return chain;
+}
+
+std::string DabModulator::state_key(const SubchannelSource& subchannel)
+{
+    stringstream ss;
+    ss << "subchannel_" << subchannel.startAddress() << "_" <<
+        subchannel.framesizeCu() << "_" << subchannel.protection();
+    return ss.str();
+}
+
+DabModulator::state_t DabModulator::save_state() const
+{
+    if (not m_setUp) {
+        // Did not get to the subchannels, keep the state for the next one
+        return m_restoreState;
+    }
+
+    state_t state;
+    for (const auto& chain : m_subchannels) {
+        state[state_key(*chain.source)] = chain.interleaver->save_state();
+    }
+    return state;
+}
+
+void DabModulator::updateSubchannels()
+{
+    const auto subchannels = m_etiSource.getSubchannels();
+
+    bool unchanged = subchannels.size() == m_subchannels.size();
+    for (size_t i = 0; unchanged and i < subchannels.size(); i++) {
+        unchanged = subchannels[i] == m_subchannels[i].source;
+    }
+    if (unchanged) {
+        return;
+    }
+
+    // The FrameMultiplexer expects its inputs in the order of the
+    // subchannels, all of them get connected again.
+    for (const auto& chain : m_subchannels) {
+        m_flowgraph->disconnect(chain.interleaver, m_cifMux);
+    }
+
+    size_t num_added = 0;
+    vector<subchannel_chain_t> chains;
+    for (const auto& subchannel : subchannels) {
+        auto it = find_if(m_subchannels.begin(), m_subchannels.end(),
+                [&](const subchannel_chain_t& c) { return c.source == subchannel; });
+        if (it != m_subchannels.end()) {
+            chains.push_back(std::move(*it));
+            m_subchannels.erase(it);
+        }
+        else {
+            chains.push_back(setupSubchannel(subchannel));
+            num_added++;
+        }
+    }
+
+    // The remaining ones are not part of the ensemble anymore
+    const size_t num_removed = m_subchannels.size();
+    for (const auto& chain : m_subchannels) {
+        for (const auto& plugin : chain.plugins) {
+            m_flowgraph->remove(plugin);
+        }
+    }
+
+    m_subchannels = std::move(chains);
+    for (const auto& chain : m_subchannels) {
+        m_flowgraph->connect(chain.interleaver, m_cifMux);
+    }
+
+    etiLog.level(info) << "Ensemble reconfiguration: " << num_removed <<
+        " subchannels removed, " << num_added << " added, " <<
+        m_subchannels.size() - num_added << " kept";
+}
+
+void DabModulator::applyStandby()
+{
+    // The frames that leave the OFDM part after the standby are only
+    // complete once they went through the pipelined blocks and the
+    // windowing and filters that use the previous frame
+    constexpr size_t TAKEOVER_FRAMES = 2;
+
+    const bool standby = m_standby.load();
+    // The muting only applies once the length of the filler frames is known
+    const bool muted = not standby and m_frameLength > 0 and
+        m_settings.sdr_device_config.muting;
+    if (standby != m_standbyApplied or muted != m_mutedApplied) {
+        for (const auto& p : m_standbyPlugins) {
+            m_flowgraph->set_enabled(p, not standby and not muted);
+        }
+    }
+
+    if (muted != m_mutedApplied) {
+        m_mutedApplied = muted;
+        m_fillerBatchFrames = 0;
+        if (muted) {
+            etiLog.level(info) << "Output muted, modulator sends filler frames";
+            m_fillerFramesLeft = 0;
+        }
+        else {
+            etiLog.level(info) << "Output unmuted, modulator resumes";
+            // The pipelined blocks first give the frames from before the
+            // muting, and the windowing and filters use the previous frame
+            m_fillerFramesLeft = m_pipelineDelay + TAKEOVER_FRAMES;
+        }
+    }
+
+    if (standby != m_standbyApplied) {
+        m_standbyApplied = standby;
+        m_framesSinceStandby = 0;
+
+        if (standby) {
+            m_outputEnabled = false;
+            etiLog.level(warn) << "Modulator in standby, following the input";
+        }
+        else {
+            etiLog.level(warn) << "Modulator taking over";
+        }
+
+#if defined(HAVE_ZEROMQ)
+        json::map_t detail;
+        detail["standby"].v = standby;
+        events.send("standby", detail);
+#endif
+    }
+
+    if (not standby and not m_outputEnabled and
+            ++m_framesSinceStandby > TAKEOVER_FRAMES) {
+        m_outputEnabled = true;
+        etiLog.level(info) << "Modulator drives the output";
+    }
+}
+
+std::vector<json::value_t> DabModulator::get_latency_statistics() const
+{
+    std::shared_ptr<Flowgraph> flowgraph;
+    {
+        std::lock_guard<std::mutex> lock(m_flowgraph_mutex);
+        flowgraph = m_flowgraph;
+    }
+
+    if (flowgraph) {
+        return flowgraph->get_latency_statistics();
+    }
+    return {};
+}
+
+Flowgraph::memory_usage_t DabModulator::get_memory_usage() const
+{
+    std::shared_ptr<Flowgraph> flowgraph;
+    {
+        std::lock_guard<std::mutex> lock(m_flowgraph_mutex);
+        flowgraph = m_flowgraph;
+    }
+
+    if (flowgraph) {
+        return flowgraph->get_memory_usage();
+    }
+    return {};
 }
 
 meta_vec_t DabModulator::process_metadata(const meta_vec_t& metadataIn)
 {
+    if (m_filler) {
+        return m_fillerMetadata;
+    }
+
     if (m_output) {
         return m_output->get_latest_metadata();
     }
@@ -442,6 +1512,18 @@ void DabModulator::set_parameter(const string& parameter, const string& value)
     else if (parameter == "num_clipped_samples") {
         throw ParameterError("Parameter 'num_clipped_samples' is read-only");
     }
+    else if (parameter == "standby") {
+        stringstream ss(value);
+        ss.exceptions ( stringstream::failbit | stringstream::badbit );
+        int standby = 0;
+        ss >> standby;
+        m_standby.store(standby != 0);
+        // A restart of the modulator keeps the standby
+        m_settings.standby = standby != 0;
+    }
+    else if (parameter == "output_enabled" or parameter == "muted") {
+        throw ParameterError("Parameter '" + parameter + "' is read-only");
+    }
     else {
         stringstream ss;
         ss << "Parameter '" << parameter <<
@@ -466,6 +1548,15 @@ const string DabModulator::get_parameter(const string& parameter) const
             throw ParameterError(ss.str());
         }
     }
+    else if (parameter == "standby") {
+        ss << (m_standby.load() ? 1 : 0);
+    }
+    else if (parameter == "output_enabled") {
+        ss << (m_outputEnabled.load() ? 1 : 0);
+    }
+    else if (parameter == "muted") {
+        ss << (m_mutedApplied.load() ? 1 : 0);
+    }
     else {
         ss << "Parameter '" << parameter <<
             "' is not exported by controllable " << get_rc_name();
@@ -479,5 +1570,8 @@ const json::map_t DabModulator::get_all_values() const
     json::map_t map;
     map["rate"].v = m_settings.outputRate;
     map["num_clipped_samples"].v = m_formatConverter ? m_formatConverter->get_num_clipped_samples() : 0;
+    map["standby"].v = m_standby.load();
+    map["output_enabled"].v = m_outputEnabled.load();
+    map["muted"].v = m_mutedApplied.load();
     return map;
 }
@@ -32,24 +32,36 @@
 #endif
 
 #include <sys/types.h>
+#include <atomic>
 #include <string>
+#include <future>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 #include "ModPlugin.h"
 #include "ConfigParser.h"
+#include "EnsembleMixer.h"
 #include "EtiReader.h"
 #include "Flowgraph.h"
 #include "FormatConverter.h"
 #include "OutputMemory.h"
+#include "RealtimeBudget.h"
+#include "AutoTuner.h"
+#include "BlockPartitioner.h"
 #include "RemoteControl.h"
+#include "TimeInterleaver.h"
 
 class DabModulator : public ModInput, public ModMetadata, public RemoteControllable
 {
 public:
-    DabModulator(EtiSource& etiSource, mod_settings_t& settings, const std::string& format);
+    DabModulator(EtiSource& etiSource, mod_settings_t& settings, const std::string& format,
+            std::shared_ptr<EnsembleMixer> mixer = nullptr);
     // Allowed formats: s8, u8 and s16. Empty string means no conversion
+    // With a mixer, the other ensembles are added after the resampler
 
-    virtual ~DabModulator() {}
+    virtual ~DabModulator();
 
     int process(Buffer* dataOut) override;
     const char* name() override { return "DabModulator"; }
@@ -59,6 +71,36 @@ public:
     /* Required to get the timestamp */
     EtiSource* getEtiSource() { return &m_etiSource; }
 
+    /* In standby, the modulator only runs the encoding of the FIC and the
+     * subchannels, including the time interleavers, to follow the input
+     * and be ready to take over from another modulator. The output must
+     * only be driven when output_enabled(), which is the case a few
+     * frames after the end of the standby, once the OFDM part has
+     * replaced the contents of its buffers. */
+    bool output_enabled() const {
+        return not m_standby.load() and m_outputEnabled.load();
+    }
+
+    /* The state of the time interleavers, by subchannel, that a new
+     * DabModulator can continue with after a restart of the modulator.
+     * Otherwise, the first 15 frames of every subchannel cannot be
+     * decoded. */
+    using state_t = std::map<std::string, std::vector<uint8_t> >;
+
+    // Must not be called while process() runs
+    state_t save_state() const;
+
+    // Must be called before the first process()
+    void restore_state(const state_t& state) { m_restoreState = state; }
+
+    /* Per-block processing time statistics, see
+     * Flowgraph::get_latency_statistics() */
+    std::vector<json::value_t> get_latency_statistics() const;
+
+    /* Memory of the blocks and the buffers of the flowgraph, see
+     * Flowgraph::get_memory_usage() */
+    Flowgraph::memory_usage_t get_memory_usage() const;
+
     /******* REMOTE CONTROL ********/
     virtual void set_parameter(const std::string& parameter, const std::string& value) override;
     virtual const std::string get_parameter(const std::string& parameter) const override;
@@ -67,11 +109,48 @@ public:
 protected:
     void setMode(unsigned mode);
 
+    /* Set up the blocks from the FrameMultiplexer to the FormatConverter,
+     * which only depend on the settings. Runs in its own thread, started
+     * by the constructor. */
+    void setupOfdmChain();
+
+    /* Whether the edge at cut, one of mapping, ofdm or output, starts a
+     * new pipeline stage, see pipelineStages in mod_settings_t */
+    bool stage_boundary(const std::string& cut) const;
+
+    /* The blocks that encode one subchannel, from its source to its
+     * time interleaver */
+    struct subchannel_chain_t {
+        std::shared_ptr<SubchannelSource> source;
+        std::shared_ptr<TimeInterleaver> interleaver;
+        std::vector<std::shared_ptr<ModPlugin> > plugins;
+    };
+
+    // The interleaver state only fits a subchannel with the same address,
+    // size and protection
+    static std::string state_key(const SubchannelSource& subchannel);
+    state_t m_restoreState;
+
+    subchannel_chain_t setupSubchannel(
+            const std::shared_ptr<SubchannelSource>& subchannel);
+
+    /* Replace the chains of the subchannels that changed in the ensemble.
+     * The other subchannels and the OFDM part keep running. */
+    void updateSubchannels();
+
     mod_settings_t& m_settings;
     std::string m_format;
 
     EtiSource& m_etiSource;
+    std::shared_ptr<EnsembleMixer> m_mixer;
+    mutable std::mutex m_flowgraph_mutex;
     std::shared_ptr<Flowgraph> m_flowgraph;
+    std::future<void> m_ofdmSetup;
+    bool m_setUp = false;
+    std::shared_ptr<ModPlugin> m_cifMux;
+    std::shared_ptr<BlockPartitioner> m_cifPart;
+    std::shared_ptr<ModPlugin> m_chainEnd;
+    std::vector<subchannel_chain_t> m_subchannels;
 
     size_t m_nbSymbols;
     size_t m_nbCarriers;
@@ -82,5 +161,42 @@ protected:
 
     std::shared_ptr<FormatConverter> m_formatConverter;
     std::shared_ptr<OutputMemory> m_output;
+
+    // Measures the time of every run of the flowgraph, nullptr if not
+    // enabled
+    std::shared_ptr<RealtimeBudget> m_rtBudget;
+
+    // Tunes the pipelined blocks after the first frames, nullptr if not
+    // enabled
+    std::shared_ptr<AutoTuner> m_autoTuner;
+
+    // Set by the remote control, and applied to the flowgraph before the
+    // next frame
+    void applyStandby();
+    std::atomic<bool> m_standby;
+    bool m_standbyApplied = false;
+    // The blocks from the BlockPartitioner to the OutputMemory, without
+    // the TII that alternates from one frame to the next
+    std::vector<std::shared_ptr<ModPlugin> > m_standbyPlugins;
+    size_t m_framesSinceStandby = 0;
+    std::atomic<bool> m_outputEnabled;
+
+    /* While the SDR output is muted, the same blocks as in standby are
+     * disabled, and the output gets frames of zeros with the timestamps
+     * from the BlockPartitioner, that keep the device streaming. After
+     * the muting, the output still gets filler frames until the pipelined
+     * blocks give frames that were modulated after the muting. */
+    int outputFiller(int ret, Buffer* dataOut);
+    std::atomic<bool> m_mutedApplied = ATOMIC_VAR_INIT(false);
+    // Number of calls to process() in the pipelined blocks on the way
+    // from the BlockPartitioner to the output
+    size_t m_pipelineDelay = 0;
+    size_t m_fillerFramesLeft = 0;
+    // Length of the output frames, known once the first one is complete
+    size_t m_frameLength = 0;
+    // Whether the last output was a filler frame, and its metadata
+    bool m_filler = false;
+    meta_vec_t m_fillerMetadata;
+    size_t m_fillerBatchFrames = 0;
 };
 
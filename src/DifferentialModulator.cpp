@@ -21,37 +21,72 @@
 
 #include "DifferentialModulator.h"
 #include "PcDebug.h"
+#include "DabModeKernels.h"
+#include "Simd.h"
 
 #include <cstdio>
 #include <stdexcept>
 #include <cstring>
 
-DifferentialModulator::DifferentialModulator(size_t carriers, bool fixedPoint) :
-    ModMux(),
-    m_carriers(carriers),
-    m_fixedPoint(fixedPoint)
+/* out[i] = a[i] * b[i] for n carriers, n being a multiple of 4 */
+template<typename T>
+static inline void multiply_carriers(const T* a, const T* b, T* out, size_t n)
 {
-    PDEBUG("DifferentialModulator::DifferentialModulator(%zu)\n", carriers);
-
+    for (size_t j = 0; j < n; j += 4) {
+        out[j] = a[j] * b[j];
+        out[j + 1] = a[j + 1] * b[j + 1];
+        out[j + 2] = a[j + 2] * b[j + 2];
+        out[j + 3] = a[j + 3] * b[j + 3];
+    }
 }
 
+template<>
+inline void multiply_carriers(const complexf* a, const complexf* b, complexf* out,
+        size_t n)
+{
+    // The vectors end at the last multiple of cf_width, the rest is scalar
+    const size_t vector_end = n - n % simd::cf_width;
+    for (size_t j = 0; j < vector_end; j += simd::cf_width) {
+        simd::store(out + j, simd::cmul(simd::load(a + j), simd::load(b + j)));
+    }
 
-DifferentialModulator::~DifferentialModulator()
+    for (size_t j = vector_end; j < n; j++) {
+        out[j] = a[j] * b[j];
+    }
+}
+
+template<>
+inline void multiply_carriers(const complexfix* a, const complexfix* b,
+        complexfix* out, size_t n)
 {
-    PDEBUG("DifferentialModulator::~DifferentialModulator()\n");
+    simd::cmul_q14(reinterpret_cast<const int16_t*>(a),
+            reinterpret_cast<const int16_t*>(b),
+            reinterpret_cast<int16_t*>(out), n);
 }
 
+template<typename T>
+struct diff_kernel {
+    template<size_t C>
+    struct type {
+        static void process(const std::vector<Buffer*>& dataIn,
+                Buffer* dataOut, size_t leadingSymbols, size_t carriers);
+    };
+};
 
 template<typename T>
-void do_process(size_t carriers, const std::vector<Buffer*>& dataIn, Buffer* dataOut)
+template<size_t C>
+void diff_kernel<T>::type<C>::process(const std::vector<Buffer*>& dataIn,
+        Buffer* dataOut, size_t leadingSymbols, size_t num_carriers)
 {
+    const size_t carriers = kernel_carriers<C>(num_carriers);
     size_t phaseSize = dataIn[0]->getLength() / sizeof(T);
     size_t dataSize = dataIn[1]->getLength() / sizeof(T);
-    dataOut->setLength((phaseSize + dataSize) * sizeof(T));
+    const size_t leadingSize = leadingSymbols * carriers;
+    dataOut->setLength((leadingSize + phaseSize + dataSize) * sizeof(T));
 
     const T* phase = reinterpret_cast<const T*>(dataIn[0]->getData());
     const T* in = reinterpret_cast<const T*>(dataIn[1]->getData());
-    T* out = reinterpret_cast<T*>(dataOut->getData());
+    T* out = reinterpret_cast<T*>(dataOut->getData()) + leadingSize;
 
     if (phaseSize != carriers) {
         throw std::runtime_error(
@@ -62,19 +97,35 @@ void do_process(size_t carriers, const std::vector<Buffer*>& dataIn, Buffer* dat
                 "DifferentialModulator::process input data size not valid!");
     }
 
-    memcpy(dataOut->getData(), phase, phaseSize * sizeof(T));
+    memcpy(out, phase, phaseSize * sizeof(T));
     for (size_t i = 0; i < dataSize; i += carriers) {
-        for (size_t j = 0; j < carriers; j += 4) {
-            out[carriers + j] = out[j] * in[j];
-            out[carriers + j + 1] = out[j + 1] * in[j + 1];
-            out[carriers + j + 2] = out[j + 2] * in[j + 2];
-            out[carriers + j + 3] = out[j + 3] * in[j + 3];
-        }
+        multiply_carriers(out, in, out + carriers, carriers);
         in += carriers;
         out += carriers;
     }
 }
 
+DifferentialModulator::DifferentialModulator(size_t carriers, bool fixedPoint,
+        size_t leadingSymbols) :
+    ModMux(),
+    m_carriers(carriers),
+    m_fixedPoint(fixedPoint),
+    m_leadingSymbols(leadingSymbols)
+{
+    PDEBUG("DifferentialModulator::DifferentialModulator(%zu)\n", carriers);
+
+    m_kernel = m_fixedPoint ?
+        select_carriers_kernel<diff_kernel<complexfix>::type>(m_carriers) :
+        select_carriers_kernel<diff_kernel<complexf>::type>(m_carriers);
+}
+
+
+DifferentialModulator::~DifferentialModulator()
+{
+    PDEBUG("DifferentialModulator::~DifferentialModulator()\n");
+}
+
+
 // dataIn[0] -> phase reference
 // dataIn[1] -> data symbols
 int DifferentialModulator::process(std::vector<Buffer*> dataIn, Buffer* dataOut)
@@ -96,12 +147,7 @@ int DifferentialModulator::process(std::vector<Buffer*> dataIn, Buffer* dataOut)
                 "DifferentialModulator::process nb of input streams not 2!");
     }
 
-    if (m_fixedPoint) {
-        do_process<complexfix>(m_carriers, dataIn, dataOut);
-    }
-    else {
-        do_process<complexf>(m_carriers, dataIn, dataOut);
-    }
+    m_kernel(dataIn, dataOut, m_leadingSymbols, m_carriers);
 
     return dataOut->getLength();
 }
@@ -35,7 +35,10 @@
 class DifferentialModulator : public ModMux
 {
 public:
-    DifferentialModulator(size_t carriers, bool fixedPoint);
+    // leadingSymbols symbols are left free at the start of the output,
+    // for the SignalMultiplexer to fill in.
+    DifferentialModulator(size_t carriers, bool fixedPoint,
+            size_t leadingSymbols = 0);
     virtual ~DifferentialModulator();
     DifferentialModulator(const DifferentialModulator&);
     DifferentialModulator& operator=(const DifferentialModulator&);
@@ -47,5 +50,11 @@ public:
 protected:
     size_t m_carriers;
     size_t m_fixedPoint;
+    size_t m_leadingSymbols;
+
+    // The kernel for the number of carriers of the mode
+    using kernel_t = void (*)(const std::vector<Buffer*>& dataIn,
+            Buffer* dataOut, size_t leadingSymbols, size_t carriers);
+    kernel_t m_kernel;
 };
 
@@ -0,0 +1,630 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   Throughput benchmark of the EDI input. Synthetic or recorded AF packets
+   get protected and fragmented with PFT, optionally lose and reorder some
+   fragments, and are given to the ETIDecoder and the EdiReader as fast as
+   they can take them, the way the EdiTransport does. The rate of AF
+   packets and fragments and the decode latency are reported.
+*/
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include "EtiReader.h"
+#include "Log.h"
+#include "RunReport.h"
+#include "crc.h"
+#include "edi/ETIDecoder.hpp"
+extern "C" {
+#include "fec/fec.h"
+}
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+using namespace std;
+using clock_type = chrono::steady_clock;
+
+// The AF packets are prepared in batches, outside of the measurement
+static constexpr size_t BATCH_PACKETS = 250;
+
+// Reed-Solomon code of PFT, ETSI TS 102 821 Clause 7.2
+static constexpr size_t RS_K = 207;
+static constexpr size_t RS_PARITY = 48;
+
+struct bench_settings_t {
+    size_t num_packets = 10000;
+
+    // Without PFT, the AF packets are given to the decoder as they are
+    bool pft = true;
+
+    // Number of fragments per AF packet the RS code recovers, 0 for
+    // fragmentation without RS
+    size_t fec = 2;
+    size_t max_fragment_size = 1400;
+
+    // Fraction of the fragments that get lost, and the number of fragments
+    // among which their order is shuffled
+    double loss = 0.0;
+    size_t reorder = 0;
+
+    // Give the packets to the decoder as a byte stream like over TCP,
+    // instead of one datagram at a time like over UDP
+    bool stream = false;
+
+    int max_delay = 10;
+};
+
+static void usage(const char *progName)
+{
+    fprintf(stderr,
+            "Usage: %s [-i edi] [-n packets] [-a] [-f fec] [-s size] [-l loss] [-r depth]\n"
+            "          [-d delay] [-t] [-j report]\n"
+            "  -i edi       Replay the AF packets of this file, which contains AF or PF\n"
+            "               packets one after the other like EDI over TCP, instead of\n"
+            "               synthetic ones\n"
+            "  -n packets   Number of AF packets to decode (default 10000)\n"
+            "  -a           Give the AF packets to the decoder without PFT\n"
+            "  -f fec       Number of lost fragments per AF packet the RS code recovers,\n"
+            "               0 to fragment without RS (default 2)\n"
+            "  -s size      Maximum fragment payload size in bytes (default 1400)\n"
+            "  -l loss      Fraction of the fragments that get lost, e.g. 0.01\n"
+            "  -r depth     Shuffle the order of the fragments within depth fragments\n"
+            "  -d delay     Maximum delay of the PFT decoder in AF packets (default 10).\n"
+            "               An AF packet with missing fragments waits for the delay once\n"
+            "               it is the next one, in number of fragments received, so\n"
+            "               that with loss the decoder can fall behind a replay at\n"
+            "               maximum rate unless the delay is short\n"
+            "  -t           Push the packets as a byte stream, like EDI over TCP\n"
+            "  -j report    Append the results as one line of JSON to report\n",
+            progName);
+}
+
+static void append_16b(vector<uint8_t>& buf, uint16_t value)
+{
+    buf.push_back(value >> 8);
+    buf.push_back(value & 0xFF);
+}
+
+static void append_24b(vector<uint8_t>& buf, uint32_t value)
+{
+    buf.push_back((value >> 16) & 0xFF);
+    buf.push_back((value >> 8) & 0xFF);
+    buf.push_back(value & 0xFF);
+}
+
+static void append_32b(vector<uint8_t>& buf, uint32_t value)
+{
+    append_16b(buf, value >> 16);
+    append_16b(buf, value & 0xFFFF);
+}
+
+static uint16_t edi_crc(const uint8_t *data, size_t len)
+{
+    return crc16(0xffff, data, len) ^ 0xffff;
+}
+
+static void append_tag(vector<uint8_t>& tags, const char *name,
+        const vector<uint8_t>& value)
+{
+    tags.insert(tags.end(), name, name + 4);
+    append_32b(tags, value.size() * 8);
+    tags.insert(tags.end(), value.begin(), value.end());
+}
+
+/* Set the SEQ of an AF packet and update its CRC */
+static void set_afpacket_seq(vector<uint8_t>& af, uint16_t seq)
+{
+    af[6] = seq >> 8;
+    af[7] = seq & 0xFF;
+
+    const size_t len = af.size() - 2;
+    const uint16_t crc = edi_crc(af.data(), len);
+    af[len] = crc >> 8;
+    af[len + 1] = crc & 0xFF;
+}
+
+/* The subchannels of the synthetic ensemble, like in the chainbench: six
+ * 128kbps EEP-3A and three 64kbps EEP-1A subchannels, given by their STL
+ * (in 64-bit words per ETI frame), their TPL and their size in CUs. */
+struct synth_subchannel_t {
+    uint16_t stl;
+    uint8_t tpl;
+    uint16_t size_cu;
+};
+
+static const vector<synth_subchannel_t> synth_subchannels({
+        {48, 0x22, 96}, {48, 0x22, 96}, {48, 0x22, 96},
+        {48, 0x22, 96}, {48, 0x22, 96}, {48, 0x22, 96},
+        {24, 0x20, 96}, {24, 0x20, 96}, {24, 0x20, 96},
+        });
+
+/* The AF packet of the ETI frame n of a mode I ensemble with a timestamp,
+ * an empty FIC and random subchannel data, ETSI TS 102 693. */
+static vector<uint8_t> synthetic_afpacket(uint32_t n, time_t start, mt19937& rng)
+{
+    vector<uint8_t> tags;
+
+    append_tag(tags, "*ptr", {'D', 'E', 'T', 'I', 0, 0, 0, 0});
+
+    vector<uint8_t> deti;
+    const uint16_t dlfc = n % 5000;
+    const bool atstf = true;
+    const bool ficf = true;
+    append_16b(deti, (dlfc % 250) | ((dlfc / 250) << 8) |
+            (ficf << 14) | (atstf << 15));
+
+    const uint8_t stat = 0xFF;
+    const uint8_t mid = 1;
+    const uint8_t fp = n % 8;
+    append_32b(deti, (stat << 24) | (mid << 22) | (fp << 19));
+
+    // EDI seconds since 2000, in units of 1/16384000 s within the second
+    const uint8_t utco = 5;
+    const uint64_t ms = (uint64_t)n * 24;
+    deti.push_back(utco);
+    append_32b(deti, start - 946684800 + utco + ms / 1000);
+    append_24b(deti, (ms % 1000) * 16384);
+
+    // Three FIBs that only contain the end marker
+    for (size_t fib = 0; fib < 3; fib++) {
+        const size_t offset = deti.size();
+        deti.push_back(0xFF);
+        deti.resize(offset + 30, 0x00);
+        append_16b(deti, edi_crc(deti.data() + offset, 30));
+    }
+    append_tag(tags, "deti", deti);
+
+    uniform_int_distribution<int> dist(0, 255);
+    uint16_t start_address = 0;
+    for (size_t i = 0; i < synth_subchannels.size(); i++) {
+        const auto& sub = synth_subchannels[i];
+        vector<uint8_t> est;
+        const uint32_t scid = i + 1;
+        append_24b(est, (scid << 18) | (start_address << 8) | (sub.tpl << 2));
+        for (size_t j = 0; j < sub.stl * 8u; j++) {
+            est.push_back(dist(rng));
+        }
+        start_address += sub.size_cu;
+
+        const char name[5] = {'e', 's', 't', (char)(i + 1), 0};
+        append_tag(tags, name, est);
+    }
+
+    vector<uint8_t> af;
+    af.reserve(EdiDecoder::AFPACKET_HEADER_LEN + tags.size() + 2);
+    af.push_back('A');
+    af.push_back('F');
+    append_32b(af, tags.size());
+    append_16b(af, n & 0xFFFF);
+    af.push_back(0x90); // CF, MAJ 1, MIN 0
+    af.push_back('T');
+    af.insert(af.end(), tags.begin(), tags.end());
+    append_16b(af, 0);
+    set_afpacket_seq(af, n & 0xFFFF);
+    return af;
+}
+
+/* The AF packets of a recorded EDI stream, as the decoder reassembles them */
+static vector<vector<uint8_t> > load_afpackets(const string& filename)
+{
+    ifstream in(filename, ios::binary);
+    if (not in) {
+        throw runtime_error("Could not open EDI file " + filename);
+    }
+    const vector<uint8_t> data((istreambuf_iterator<char>(in)),
+            istreambuf_iterator<char>());
+
+    vector<vector<uint8_t> > packets;
+    EdiDecoder::TagDispatcher dispatcher([]() { });
+    dispatcher.register_afpacket_handler([&](vector<uint8_t>&& af) {
+            packets.push_back(std::move(af));
+        });
+    dispatcher.push_bytes(data);
+
+    if (packets.empty()) {
+        throw runtime_error("No AF packet in " + filename);
+    }
+    return packets;
+}
+
+/* Protection and fragmentation of AF packets, ETSI TS 102 821 Clause 7,
+ * the same way as ODR-DabMux does it. */
+class PftEncoder {
+    public:
+        PftEncoder(const bench_settings_t& settings) :
+            m_fec(settings.fec),
+            m_max_fragment_size(settings.max_fragment_size)
+        {
+            m_rs = init_rs_char(8, 0x11d, 1, 1, RS_PARITY, 0);
+            if (m_rs == nullptr) {
+                throw runtime_error("Could not initialise the RS encoder");
+            }
+        }
+        PftEncoder(const PftEncoder& other) = delete;
+        PftEncoder& operator=(const PftEncoder& other) = delete;
+        ~PftEncoder() { free_rs_char(m_rs); }
+
+        vector<vector<uint8_t> > fragment(const vector<uint8_t>& af, uint16_t pseq)
+        {
+            vector<uint8_t> payload;
+            size_t num_fragments = 0;
+            size_t zero_pad = 0;
+
+            if (m_fec > 0) {
+                // Chunks of RS_K bytes, the last one zero padded, each
+                // followed by its parity bytes
+                const size_t num_chunks = (af.size() + RS_K - 1) / RS_K;
+                zero_pad = num_chunks * RS_K - af.size();
+                payload = af;
+                payload.resize(num_chunks * RS_K, 0x00);
+
+                vector<uint8_t> rs_block(num_chunks * (RS_K + RS_PARITY));
+                for (size_t c = 0; c < num_chunks; c++) {
+                    uint8_t *chunk = rs_block.data() + c * (RS_K + RS_PARITY);
+                    memcpy(chunk, payload.data() + c * RS_K, RS_K);
+                    encode_rs_char(m_rs, chunk, chunk + RS_K);
+                }
+
+                const size_t max_size = std::min(
+                        num_chunks * RS_PARITY / (m_fec + 1), m_max_fragment_size);
+                num_fragments = (rs_block.size() + max_size - 1) / max_size;
+                const size_t fragment_size =
+                    (rs_block.size() + num_fragments - 1) / num_fragments;
+
+                // Interleave the RS block over the fragments
+                payload.assign(num_fragments * fragment_size, 0x00);
+                for (size_t i = 0; i < num_fragments; i++) {
+                    for (size_t j = 0; j < fragment_size; j++) {
+                        const size_t ix = j * num_fragments + i;
+                        if (ix < rs_block.size()) {
+                            payload[i * fragment_size + j] = rs_block[ix];
+                        }
+                    }
+                }
+            }
+            else {
+                payload = af;
+                num_fragments = (af.size() + m_max_fragment_size - 1) /
+                    m_max_fragment_size;
+            }
+
+            const size_t fragment_size =
+                (payload.size() + num_fragments - 1) / num_fragments;
+
+            vector<vector<uint8_t> > fragments(num_fragments);
+            for (size_t i = 0; i < num_fragments; i++) {
+                const size_t begin = i * fragment_size;
+                const size_t plen = std::min(fragment_size, payload.size() - begin);
+
+                auto& f = fragments[i];
+                f.push_back('P');
+                f.push_back('F');
+                append_16b(f, pseq);
+                append_24b(f, i);
+                append_24b(f, num_fragments);
+                append_16b(f, (m_fec > 0 ? 0x8000 : 0) | plen);
+                if (m_fec > 0) {
+                    f.push_back(RS_K);
+                    f.push_back(zero_pad);
+                }
+                append_16b(f, edi_crc(f.data(), f.size()));
+                f.insert(f.end(), payload.begin() + begin,
+                        payload.begin() + begin + plen);
+            }
+            return fragments;
+        }
+
+    private:
+        void *m_rs = nullptr;
+        size_t m_fec;
+        size_t m_max_fragment_size;
+};
+
+/* Takes the decoded frames like the modulator does, and records when
+ * every AF packet was complete. */
+class BenchReader : public EdiReader {
+    public:
+        BenchReader(double& tist_offset_s) : EdiReader(tist_offset_s) {}
+
+        virtual void assemble(EdiDecoder::ReceivedTagPacket&& tagpacket) override
+        {
+            const uint16_t seq = tagpacket.seq.seq;
+            EdiReader::assemble(std::move(tagpacket));
+            clearFrame();
+
+            const auto latency = clock_type::now() - first_push[seq];
+            latencies_us.push_back(
+                    chrono::duration<double, micro>(latency).count());
+            num_decoded++;
+        }
+
+        /* When the first fragment of the AF packet with this SEQ was
+         * pushed, and the index of that packet among all packets, the SEQ
+         * wraps around. */
+        vector<clock_type::time_point> first_push =
+            vector<clock_type::time_point>(65536);
+        vector<uint32_t> first_push_index = vector<uint32_t>(65536, UINT32_MAX);
+
+        vector<double> latencies_us;
+        size_t num_decoded = 0;
+};
+
+struct bench_packet_t {
+    vector<uint8_t> buf;
+    uint32_t index;
+};
+
+struct bench_result_t {
+    size_t num_packets = 0;
+    size_t num_decoded = 0;
+    size_t num_fragments = 0;
+    size_t num_dropped = 0;
+    size_t num_bytes = 0;
+    double elapsed_s = 0;
+    double latency_avg_us = 0;
+    double latency_p99_us = 0;
+    double latency_max_us = 0;
+};
+
+static bench_result_t run_benchmark(const bench_settings_t& settings,
+        const vector<vector<uint8_t> >& recorded)
+{
+    double tist_offset_s = 0;
+    BenchReader reader(tist_offset_s);
+    EdiDecoder::ETIDecoder decoder(reader);
+    decoder.setMaxDelay(settings.max_delay);
+
+    PftEncoder encoder(settings);
+    mt19937 rng(42);
+    bernoulli_distribution lose(settings.loss);
+    const time_t start = time(nullptr);
+
+    bench_result_t result;
+    reader.latencies_us.reserve(settings.num_packets);
+
+    vector<bench_packet_t> batch;
+    vector<bench_packet_t> window;
+    EdiDecoder::Packet packet;
+
+    for (size_t done = 0; done < settings.num_packets;) {
+        const size_t n = std::min(BATCH_PACKETS, settings.num_packets - done);
+
+        batch.clear();
+        for (size_t i = 0; i < n; i++) {
+            const uint32_t index = done + i;
+            const uint16_t seq = index & 0xFFFF;
+
+            vector<uint8_t> af;
+            if (recorded.empty()) {
+                af = synthetic_afpacket(index, start, rng);
+            }
+            else {
+                af = recorded[index % recorded.size()];
+                set_afpacket_seq(af, seq);
+            }
+
+            vector<vector<uint8_t> > fragments;
+            if (settings.pft) {
+                fragments = encoder.fragment(af, seq);
+            }
+            else {
+                fragments.push_back(std::move(af));
+            }
+
+            for (auto& f : fragments) {
+                result.num_fragments++;
+                if (lose(rng)) {
+                    result.num_dropped++;
+                    continue;
+                }
+
+                // Every fragment waits in the window until a random one
+                // gets out
+                window.push_back({std::move(f), index});
+                if (window.size() > settings.reorder) {
+                    uniform_int_distribution<size_t> pick(0, window.size() - 1);
+                    const size_t p = pick(rng);
+                    swap(window[p], window.back());
+                    batch.push_back(std::move(window.back()));
+                    window.pop_back();
+                }
+            }
+        }
+        if (done + n == settings.num_packets) {
+            for (auto& f : window) {
+                batch.push_back(std::move(f));
+            }
+            window.clear();
+        }
+
+        const auto batch_start = clock_type::now();
+        for (auto& p : batch) {
+            const uint16_t seq = p.index & 0xFFFF;
+            if (reader.first_push_index[seq] != p.index) {
+                reader.first_push[seq] = clock_type::now();
+                reader.first_push_index[seq] = p.index;
+            }
+            result.num_bytes += p.buf.size();
+
+            if (settings.stream) {
+                decoder.push_bytes(p.buf);
+            }
+            else {
+                packet.buf.swap(p.buf);
+                decoder.push_packet(packet);
+            }
+        }
+        result.elapsed_s += chrono::duration<double>(
+                clock_type::now() - batch_start).count();
+
+        done += n;
+    }
+
+    result.num_packets = settings.num_packets;
+    result.num_decoded = reader.num_decoded;
+
+    auto& latencies = reader.latencies_us;
+    if (not latencies.empty()) {
+        double sum = 0;
+        for (double l : latencies) {
+            sum += l;
+        }
+        result.latency_avg_us = sum / latencies.size();
+
+        sort(latencies.begin(), latencies.end());
+        result.latency_p99_us = latencies[(latencies.size() - 1) * 99 / 100];
+        result.latency_max_us = latencies.back();
+    }
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    bench_settings_t settings;
+    string edi_filename;
+    string report_file;
+
+    int c;
+    while ((c = getopt(argc, argv, "ad:f:hi:j:l:n:r:s:t")) != -1) {
+        switch (c) {
+            case 'a':
+                settings.pft = false;
+                break;
+            case 'd':
+                settings.max_delay = atoi(optarg);
+                if (settings.max_delay < 1) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'f':
+                settings.fec = strtoul(optarg, nullptr, 10);
+                break;
+            case 'i':
+                edi_filename = optarg;
+                break;
+            case 'j':
+                report_file = optarg;
+                break;
+            case 'l':
+                settings.loss = strtod(optarg, nullptr);
+                if (settings.loss < 0 or settings.loss >= 1) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'n':
+                settings.num_packets = strtoul(optarg, nullptr, 10);
+                if (settings.num_packets == 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'r':
+                settings.reorder = strtoul(optarg, nullptr, 10);
+                break;
+            case 's':
+                settings.max_fragment_size = strtoul(optarg, nullptr, 10);
+                if (settings.max_fragment_size < 16 or
+                        settings.max_fragment_size > 0x3FFF) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 't':
+                settings.stream = true;
+                break;
+            case 'h':
+            default:
+                usage(argv[0]);
+                return c == 'h' ? 0 : 1;
+        }
+    }
+
+    try {
+        vector<vector<uint8_t> > recorded;
+        if (not edi_filename.empty()) {
+            recorded = load_afpackets(edi_filename);
+        }
+
+        const auto r = run_benchmark(settings, recorded);
+        const double af_per_s = r.elapsed_s > 0 ? r.num_packets / r.elapsed_s : 0;
+        const double fragments_per_s = r.elapsed_s > 0 ?
+            (r.num_fragments - r.num_dropped) / r.elapsed_s : 0;
+        const double mbps = r.elapsed_s > 0 ? r.num_bytes * 8 / r.elapsed_s / 1e6 : 0;
+
+        printf("AF packets  %zu decoded of %zu\n", r.num_decoded, r.num_packets);
+        printf("Fragments   %zu, %zu lost\n", r.num_fragments, r.num_dropped);
+        printf("Rate        %.0f AF packets/s, %.0f fragments/s, %.1f Mbit/s\n",
+                af_per_s, fragments_per_s, mbps);
+        // An AF packet carries a 24ms ETI frame
+        printf("Streams     %.1f per core\n", af_per_s * 0.024);
+        printf("Latency     %.1f us average, %.1f us p99, %.1f us max\n",
+                r.latency_avg_us, r.latency_p99_us, r.latency_max_us);
+
+        if (not report_file.empty()) {
+            json::map_t report;
+            report["type"].v = string("edibench");
+            report["time"].v = RunReport::timestamp();
+            report["build"].v = make_shared<json::map_t>(RunReport::build_info());
+            report["input"].v = edi_filename.empty() ? string("synthetic") : edi_filename;
+            report["pft"].v = settings.pft;
+            report["fec"].v = (uint64_t)settings.fec;
+            report["max_fragment_size"].v = (uint64_t)settings.max_fragment_size;
+            report["loss"].v = settings.loss;
+            report["reorder"].v = (uint64_t)settings.reorder;
+            report["stream"].v = settings.stream;
+            report["af_packets"].v = (uint64_t)r.num_packets;
+            report["af_decoded"].v = (uint64_t)r.num_decoded;
+            report["fragments"].v = (uint64_t)r.num_fragments;
+            report["fragments_lost"].v = (uint64_t)r.num_dropped;
+            report["af_packets_per_s"].v = af_per_s;
+            report["fragments_per_s"].v = fragments_per_s;
+            report["mbit_per_s"].v = mbps;
+            report["latency_avg_us"].v = r.latency_avg_us;
+            report["latency_p99_us"].v = r.latency_p99_us;
+            report["latency_max_us"].v = r.latency_max_us;
+            RunReport::append(report_file, report);
+        }
+    }
+    catch (const std::exception& e) {
+        fprintf(stderr, "Benchmark failed: %s\n", e.what());
+        return 1;
+    }
+
+    return 0;
+}
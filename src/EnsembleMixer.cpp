@@ -0,0 +1,376 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "EnsembleMixer.h"
+#include "Log.h"
+#include "PcDebug.h"
+#include "Simd.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+// Number of samples for which the rotation of the oscillators is
+// precomputed. The phase is carried in double precision from one block to
+// the next.
+static constexpr size_t BLOCK_SIZE = 4096;
+
+// Output buffers of an ensemble that can wait for the first ensemble.
+// When the queue is full, the oldest buffer is dropped.
+static constexpr size_t MAX_QUEUED = 4;
+
+// How long the first ensemble waits for the others, and the others wait
+// for space in their queue. Less than a transmission frame.
+static constexpr auto MAX_WAIT = chrono::milliseconds(50);
+
+// Half the bandwidth of the DAB signal
+static constexpr double HALF_BANDWIDTH = 768000;
+
+/* out[j] = in[j] * lo[j], or out[j] += in[j] * lo[j] if accumulate.
+ * in and out may be the same. */
+template<bool accumulate>
+static void multiply_lo(const complexf* in, const complexf* lo, complexf* out,
+        size_t n)
+{
+    size_t j = 0;
+    for (; j + simd::cf_width <= n; j += simd::cf_width) {
+        simd::vcf prod = simd::cmul(simd::load(in + j), simd::load(lo + j));
+        if (accumulate) {
+            prod = simd::cadd(prod, simd::load(out + j));
+        }
+        simd::store(out + j, prod);
+    }
+
+    for (; j < n; j++) {
+        if (accumulate) {
+            out[j] += in[j] * lo[j];
+        }
+        else {
+            out[j] = in[j] * lo[j];
+        }
+    }
+}
+
+EnsembleMixer::EnsembleMixer(
+        const vector<fdm_ensemble_config_t>& ensembles, size_t sample_rate) :
+    RemoteControllable("fdm"),
+    m_sample_rate(sample_rate),
+    m_ensembles(ensembles.size()),
+    m_lo(BLOCK_SIZE)
+{
+    PDEBUG("EnsembleMixer::EnsembleMixer(%zu) @ %p\n", ensembles.size(), this);
+
+    RC_ADD_PARAMETER(digital_gains,
+            "Digital gain of every ensemble, separated by spaces");
+    RC_ADD_PARAMETER(freq_offsets,
+            "Frequency offset of every ensemble in Hz, separated by spaces");
+    RC_ADD_PARAMETER(underflows,
+            "(Read-only) Number of frames every ensemble was missing from the sum");
+    RC_ADD_PARAMETER(overflows,
+            "(Read-only) Number of frames of every ensemble dropped because "
+            "the first ensemble did not take them");
+
+    for (size_t i = 0; i < ensembles.size(); i++) {
+        auto& e = m_ensembles[i];
+        e.name = ensembles[i].ensembleName;
+        e.gain = ensembles[i].digitalGain;
+        e.rotation.resize(BLOCK_SIZE);
+        set_frequency_offset(e, ensembles[i].frequencyOffset);
+        e.requested_frequency_offset = e.frequency_offset;
+    }
+}
+
+void EnsembleMixer::set_frequency_offset(ensemble_t& ensemble, double offset)
+{
+    ensemble.frequency_offset = offset;
+    const double phase_step = 2.0 * M_PI * offset / m_sample_rate;
+    for (size_t k = 0; k < ensemble.rotation.size(); k++) {
+        ensemble.rotation[k] = complexf(polar(1.0, phase_step * k));
+    }
+}
+
+void EnsembleMixer::advance_phase(ensemble_t& ensemble, size_t num_samples)
+{
+    const double phase_step = 2.0 * M_PI * ensemble.frequency_offset / m_sample_rate;
+    ensemble.phase = fmod(ensemble.phase + phase_step * num_samples, 2.0 * M_PI);
+}
+
+void EnsembleMixer::mix_ensemble(ensemble_t& ensemble, const complexf *in,
+        complexf *out, size_t num_samples, float gain, bool accumulate)
+{
+    for (size_t start = 0; start < num_samples; start += BLOCK_SIZE) {
+        const size_t len = std::min(BLOCK_SIZE, num_samples - start);
+
+        // Oscillator at the phase of the block, including the gain
+        const float p_re = (float)((double)gain * cos(ensemble.phase));
+        const float p_im = (float)((double)gain * sin(ensemble.phase));
+        for (size_t k = 0; k < len; k++) {
+            const complexf r = ensemble.rotation[k];
+            m_lo[k] = complexf(r.real() * p_re - r.imag() * p_im,
+                    r.real() * p_im + r.imag() * p_re);
+        }
+
+        if (accumulate) {
+            multiply_lo<true>(in + start, m_lo.data(), out + start, len);
+        }
+        else {
+            multiply_lo<false>(in + start, m_lo.data(), out + start, len);
+        }
+
+        advance_phase(ensemble, len);
+    }
+}
+
+void EnsembleMixer::push(size_t ensemble, Buffer& samples, float normalise)
+{
+    unique_lock<mutex> lock(m_mutex);
+    auto& e = m_ensembles.at(ensemble);
+
+    m_space_cv.wait_for(lock, MAX_WAIT,
+            [&]() { return e.queue.size() < MAX_QUEUED; });
+
+    if (e.queue.size() >= MAX_QUEUED) {
+        m_free_buffers.push_back(std::move(e.queue.front().samples));
+        e.queue.pop_front();
+        e.overflows++;
+    }
+
+    buffer_t b;
+    if (not m_free_buffers.empty()) {
+        b.samples = std::move(m_free_buffers.back());
+        m_free_buffers.pop_back();
+    }
+    b.samples.swap(samples);
+    b.normalise = normalise;
+    e.queue.push_back(std::move(b));
+
+    lock.unlock();
+    m_queue_cv.notify_all();
+}
+
+void EnsembleMixer::mix(Buffer& samples, float normalise)
+{
+    const size_t num_samples = samples.getLength() / sizeof(complexf);
+    complexf *out = reinterpret_cast<complexf*>(samples.getData());
+
+    // Take the buffers of the other ensembles and the settings under the
+    // lock, the mixing itself does not need it
+    m_taken.resize(m_ensembles.size());
+    m_gains.resize(m_ensembles.size());
+    {
+        unique_lock<mutex> lock(m_mutex);
+        for (size_t i = 0; i < m_ensembles.size(); i++) {
+            auto& e = m_ensembles[i];
+            m_gains[i] = e.gain;
+
+            if (e.requested_frequency_offset != e.frequency_offset) {
+                set_frequency_offset(e, e.requested_frequency_offset);
+            }
+
+            if (i == 0) {
+                continue;
+            }
+
+            m_queue_cv.wait_for(lock, MAX_WAIT,
+                    [&]() { return not e.queue.empty(); });
+
+            if (e.queue.empty()) {
+                m_taken[i].samples.setLength(0);
+                e.underflows++;
+                if (e.delivering) {
+                    etiLog.level(warn) << "EnsembleMixer: ensemble " <<
+                        e.name << " late, missing from the output";
+                    e.delivering = false;
+                }
+            }
+            else {
+                m_taken[i].samples.swap(e.queue.front().samples);
+                m_taken[i].normalise = e.queue.front().normalise;
+                m_free_buffers.push_back(std::move(e.queue.front().samples));
+                e.queue.pop_front();
+                if (not e.delivering) {
+                    etiLog.level(info) << "EnsembleMixer: ensemble " <<
+                        e.name << " back in the output";
+                    e.delivering = true;
+                }
+            }
+        }
+    }
+    m_space_cv.notify_all();
+
+    mix_ensemble(m_ensembles[0], out, out, num_samples, m_gains[0], false);
+
+    for (size_t i = 1; i < m_ensembles.size(); i++) {
+        const auto& taken = m_taken[i];
+        if (taken.samples.getLength() == 0) {
+            // Keep the oscillator running, so that its phase does not
+            // depend on the missing frames
+            advance_phase(m_ensembles[i], num_samples);
+            continue;
+        }
+
+        if (taken.samples.getLength() != samples.getLength()) {
+            throw runtime_error("EnsembleMixer: ensemble " +
+                    m_ensembles[i].name + " gives " +
+                    to_string(taken.samples.getLength()) + " bytes instead of " +
+                    to_string(samples.getLength()));
+        }
+
+        // Every ensemble is normalised for its own output, bring it to the
+        // scale of the first one
+        const float gain = m_gains[i] * normalise / taken.normalise;
+        mix_ensemble(m_ensembles[i],
+                reinterpret_cast<const complexf*>(taken.samples.getData()),
+                out, num_samples, gain, true);
+    }
+}
+
+void EnsembleMixer::set_parameter(const string& parameter, const string& value)
+{
+    if (parameter == "digital_gains" or parameter == "freq_offsets") {
+        stringstream ss(value);
+        vector<double> values;
+        for (double v; ss >> v; ) {
+            values.push_back(v);
+        }
+
+        lock_guard<mutex> lock(m_mutex);
+        if (not ss.eof() or values.size() != m_ensembles.size()) {
+            throw ParameterError(parameter + " needs " +
+                    to_string(m_ensembles.size()) + " values");
+        }
+
+        if (parameter == "digital_gains") {
+            for (size_t i = 0; i < m_ensembles.size(); i++) {
+                m_ensembles[i].gain = values[i];
+            }
+        }
+        else {
+            for (const auto offset : values) {
+                if (fabs(offset) + HALF_BANDWIDTH > m_sample_rate / 2.0) {
+                    throw ParameterError("Frequency offset " +
+                            to_string(offset) + " outside of the output");
+                }
+            }
+
+            // Applied by the next mix(), which owns the oscillators
+            for (size_t i = 0; i < m_ensembles.size(); i++) {
+                m_ensembles[i].requested_frequency_offset = values[i];
+            }
+        }
+    }
+    else if (parameter == "underflows" or parameter == "overflows") {
+        throw ParameterError("Parameter " + parameter + " is read-only");
+    }
+    else {
+        stringstream ss;
+        ss << "Parameter '" << parameter <<
+            "' is not exported by controllable " << get_rc_name();
+        throw ParameterError(ss.str());
+    }
+}
+
+const string EnsembleMixer::get_parameter(const string& parameter) const
+{
+    stringstream ss;
+    lock_guard<mutex> lock(m_mutex);
+    for (size_t i = 0; i < m_ensembles.size(); i++) {
+        const auto& e = m_ensembles[i];
+        ss << (i == 0 ? "" : " ");
+        if (parameter == "digital_gains") {
+            ss << e.gain;
+        }
+        else if (parameter == "freq_offsets") {
+            ss << e.requested_frequency_offset;
+        }
+        else if (parameter == "underflows") {
+            ss << e.underflows;
+        }
+        else if (parameter == "overflows") {
+            ss << e.overflows;
+        }
+        else {
+            ss.str("");
+            ss << "Parameter '" << parameter <<
+                "' is not exported by controllable " << get_rc_name();
+            throw ParameterError(ss.str());
+        }
+    }
+    return ss.str();
+}
+
+const json::map_t EnsembleMixer::get_all_values() const
+{
+    json::map_t map;
+    map["digital_gains"].v = get_parameter("digital_gains");
+    map["freq_offsets"].v = get_parameter("freq_offsets");
+    map["underflows"].v = get_parameter("underflows");
+    map["overflows"].v = get_parameter("overflows");
+    return map;
+}
+
+
+EnsembleMixerSink::EnsembleMixerSink(shared_ptr<EnsembleMixer> mixer,
+        size_t ensemble, float normalise) :
+    ModOutput(),
+    m_mixer(mixer),
+    m_ensemble(ensemble),
+    m_normalise(normalise)
+{
+    PDEBUG("EnsembleMixerSink::EnsembleMixerSink(%zu) @ %p\n", ensemble, this);
+}
+
+int EnsembleMixerSink::process(Buffer* dataIn)
+{
+    const size_t len = dataIn->getLength();
+    m_mixer->push(m_ensemble, *dataIn, m_normalise);
+    return len;
+}
+
+meta_vec_t EnsembleMixerSink::process_metadata(const meta_vec_t&)
+{
+    return {};
+}
+
+
+EnsembleMixerStage::EnsembleMixerStage(shared_ptr<EnsembleMixer> mixer,
+        float normalise) :
+    ModCodec(),
+    m_mixer(mixer),
+    m_normalise(normalise)
+{
+    PDEBUG("EnsembleMixerStage::EnsembleMixerStage() @ %p\n", this);
+}
+
+int EnsembleMixerStage::process(Buffer* const dataIn, Buffer* dataOut)
+{
+    if (dataIn != dataOut) {
+        *dataOut = *dataIn;
+    }
+    m_mixer->mix(*dataOut, m_normalise);
+    return dataOut->getLength();
+}
@@ -0,0 +1,162 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   Digital frequency multiplexing of several ensembles into one wideband
+   signal, using a numerically controlled oscillator for every ensemble.
+*/
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include "ConfigParser.h"
+#include "ModPlugin.h"
+#include "RemoteControl.h"
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/* Shared by the modulators of all ensembles, which run in their own
+ * threads. The first ensemble calls mix() for every output buffer, before
+ * its predistortion and its output. The others give their output buffers
+ * with push(), and the mixer takes one buffer of every other ensemble for
+ * every buffer of the first one.
+ *
+ * The ensembles are aligned on the arrival of their buffers, not on their
+ * timestamps. If an ensemble does not deliver in time, it is missing from
+ * the sum until it catches up. */
+class EnsembleMixer : public RemoteControllable
+{
+    public:
+        EnsembleMixer(const std::vector<fdm_ensemble_config_t>& ensembles,
+                size_t sample_rate);
+
+        EnsembleMixer(const EnsembleMixer& other) = delete;
+        EnsembleMixer& operator=(const EnsembleMixer& other) = delete;
+
+        /* Give the complexf samples of the ensemble, which were scaled
+         * by the normalise factor. Takes the data out of samples. */
+        void push(size_t ensemble, Buffer& samples, float normalise);
+
+        /* Replace the samples of the first ensemble, scaled by normalise,
+         * by the sum of all ensembles at their frequency offset. */
+        void mix(Buffer& samples, float normalise);
+
+        /******* REMOTE CONTROL ********/
+        virtual void set_parameter(const std::string& parameter,
+                const std::string& value) override;
+        virtual const std::string get_parameter(
+                const std::string& parameter) const override;
+        virtual const json::map_t get_all_values() const override;
+
+    private:
+        struct buffer_t {
+            Buffer samples;
+            float normalise = 1.0f;
+        };
+
+        struct ensemble_t {
+            std::string name;
+            float gain = 1.0f;
+
+            // Set over the remote control, applied by the next mix()
+            double requested_frequency_offset = 0.0;
+
+            // Only used by mix(): the frequency offset of the oscillator,
+            // its phase at the next sample in radians, and
+            // exp(j 2 pi f k / fs) for the samples k of a block.
+            double frequency_offset = 0.0;
+            double phase = 0.0;
+            std::vector<complexf> rotation;
+
+            std::deque<buffer_t> queue;
+            size_t underflows = 0;
+            size_t overflows = 0;
+            bool delivering = true;
+        };
+
+        void set_frequency_offset(ensemble_t& ensemble, double offset);
+        void advance_phase(ensemble_t& ensemble, size_t num_samples);
+        void mix_ensemble(ensemble_t& ensemble, const complexf *in,
+                complexf *out, size_t num_samples, float gain, bool accumulate);
+
+        const size_t m_sample_rate;
+
+        mutable std::mutex m_mutex;
+        // Notified when a buffer was queued, and when buffers were taken
+        std::condition_variable m_queue_cv;
+        std::condition_variable m_space_cv;
+        std::vector<ensemble_t> m_ensembles;
+
+        // Buffers given back to push(), to avoid allocations
+        std::vector<Buffer> m_free_buffers;
+
+        // Only used by mix(): the buffers and gains of all ensembles for
+        // the current output, and the oscillator output of one block
+        std::vector<buffer_t> m_taken;
+        std::vector<float> m_gains;
+        std::vector<complexf> m_lo;
+};
+
+/* The end of the flowgraph of an ensemble other than the first, giving
+ * its output to the EnsembleMixer. */
+class EnsembleMixerSink : public ModOutput, public ModMetadata
+{
+    public:
+        EnsembleMixerSink(std::shared_ptr<EnsembleMixer> mixer,
+                size_t ensemble, float normalise);
+
+        int process(Buffer* dataIn) override;
+        const char* name() override { return "EnsembleMixerSink"; }
+
+        // The timestamps of the first ensemble are used
+        virtual meta_vec_t process_metadata(const meta_vec_t& metadataIn) override;
+
+    private:
+        std::shared_ptr<EnsembleMixer> m_mixer;
+        size_t m_ensemble;
+        float m_normalise;
+};
+
+/* The block in the flowgraph of the first ensemble that adds the other
+ * ensembles to its samples. */
+class EnsembleMixerStage : public ModCodec
+{
+    public:
+        EnsembleMixerStage(std::shared_ptr<EnsembleMixer> mixer, float normalise);
+
+        int process(Buffer* const dataIn, Buffer* dataOut) override;
+        const char* name() override { return "EnsembleMixer"; }
+
+        bool supports_in_place() const override { return true; }
+
+    private:
+        std::shared_ptr<EnsembleMixer> m_mixer;
+        float m_normalise;
+};
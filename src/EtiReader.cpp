@@ -30,15 +30,21 @@
 #include "TimestampDecoder.h"
 #include "edi/common.hpp"
 
+#include <algorithm>
+#include <cmath>
 #include <stdexcept>
 #include <memory>
 #include <sys/types.h>
 #include <string.h>
 #include <arpa/inet.h>
 #include <regex>
+#include <poll.h>
+#include <cerrno>
 
 using namespace std;
 
+static constexpr size_t ETI_FRAME_SIZE = 6144;
+
 EtiReader::EtiReader(
         double& tist_offset_s) :
     myTimestampDecoder(tist_offset_s),
@@ -92,187 +98,120 @@ const std::vector<std::shared_ptr<SubchannelSource> > EtiReader::getSubchannels(
 
 int EtiReader::loadEtiData(const Buffer& dataIn)
 {
-    PDEBUG("EtiReader::loadEtiData(dataIn: %p)\n", &dataIn);
-    PDEBUG(" state: %u\n", state);
-    const unsigned char* in = reinterpret_cast<const unsigned char*>(dataIn.getData());
-    size_t input_size = dataIn.getLength();
+    return loadEtiData(reinterpret_cast<const uint8_t*>(dataIn.getData()),
+            dataIn.getLength());
+}
 
-    while (input_size > 0) {
-        switch (state) {
-            case EtiReaderState::NbFrame:
-                if (input_size < 4) {
-                    return dataIn.getLength() - input_size;
-                }
-                nb_frames = *(uint32_t*)in;
-                input_size -= 4;
-                in += 4;
-                state = EtiReaderState::FrameSize;
-                PDEBUG("Nb frames: %i\n", nb_frames);
-                break;
-            case EtiReaderState::FrameSize:
-                if (input_size < 2) {
-                    return dataIn.getLength() - input_size;
-                }
-                framesize = *(uint16_t*)in;
-                input_size -= 2;
-                in += 2;
-                state = EtiReaderState::Sync;
-                PDEBUG("Framesize: %i\n", framesize);
-                break;
-            case EtiReaderState::Sync:
-                if (input_size < 4) {
-                    return dataIn.getLength() - input_size;
-                }
-                framesize = 6144;
-                memcpy(&eti_sync, in, 4);
-                input_size -= 4;
-                framesize -= 4;
-                in += 4;
-                state = EtiReaderState::Fc;
-                PDEBUG("Sync.err: 0x%.2x\n", eti_sync.ERR);
-                PDEBUG("Sync.fsync: 0x%.6x\n", eti_sync.FSYNC);
-                break;
-            case EtiReaderState::Fc:
-                if (input_size < 4) {
-                    return dataIn.getLength() - input_size;
-                }
-                memcpy(&eti_fc, in, 4);
-                eti_fc_valid = true;
-                input_size -= 4;
-                framesize -= 4;
-                in += 4;
-                state = EtiReaderState::Nst;
-                PDEBUG("Fc.fct: 0x%.2x\n", eti_fc.FCT);
-                PDEBUG("Fc.ficf: %u\n", eti_fc.FICF);
-                PDEBUG("Fc.nst: %u\n", eti_fc.NST);
-                PDEBUG("Fc.fp: 0x%x\n", eti_fc.FP);
-                PDEBUG("Fc.mid: %u\n", eti_fc.MID);
-                PDEBUG("Fc.fl: %u\n", eti_fc.getFrameLength());
-                if (!eti_fc.FICF) {
-                    throw std::runtime_error("FIC must be present to modulate!");
-                }
-                if (not myFicSource) {
-                    unsigned ficf = eti_fc.FICF;
-                    unsigned mid = eti_fc.MID;
-                    myFicSource = make_shared<FicSource>(ficf, mid);
-                }
-                break;
-            case EtiReaderState::Nst:
-                if (input_size < 4 * (size_t)eti_fc.NST) {
-                    return dataIn.getLength() - input_size;
-                }
-                if ((eti_stc.size() != eti_fc.NST) ||
-                        (memcmp(&eti_stc[0], in, 4 * eti_fc.NST))) {
-                    PDEBUG("New stc!\n");
-                    eti_stc.resize(eti_fc.NST);
-                    memcpy(&eti_stc[0], in, 4 * eti_fc.NST);
-
-                    mySources.clear();
-                    for (unsigned i = 0; i < eti_fc.NST; ++i) {
-                        const auto tpl = eti_stc[i].TPL;
-                        mySources.push_back(
-                                make_shared<SubchannelSource>(
-                                    eti_stc[i].getStartAddress(),
-                                    eti_stc[i].getSTL(),
-                                    tpl));
-                        PDEBUG("Sstc %u:\n", i);
-                        PDEBUG(" Stc%i.scid: %i\n", i, eti_stc[i].SCID);
-                        PDEBUG(" Stc%i.sad: %u\n", i, eti_stc[i].getStartAddress());
-                        PDEBUG(" Stc%i.tpl: 0x%.2x\n", i, eti_stc[i].TPL);
-                        PDEBUG(" Stc%i.stl: %u\n", i, eti_stc[i].getSTL());
-                    }
-                }
-                input_size -= 4 * eti_fc.NST;
-                framesize -= 4 * eti_fc.NST;
-                in += 4 * eti_fc.NST;
-                state = EtiReaderState::Eoh;
-                break;
-            case EtiReaderState::Eoh:
-                if (input_size < 4) {
-                    return dataIn.getLength() - input_size;
-                }
-                memcpy(&eti_eoh, in, 4);
-                input_size -= 4;
-                framesize -= 4;
-                in += 4;
-                state = EtiReaderState::Fic;
-                PDEBUG("Eoh.mnsc: 0x%.4x\n", eti_eoh.MNSC);
-                PDEBUG("Eoh.crc: 0x%.4x\n", eti_eoh.CRC);
-                break;
-            case EtiReaderState::Fic:
-                if (eti_fc.MID == 3) {
-                    if (input_size < 128) {
-                        return dataIn.getLength() - input_size;
-                    }
-                    PDEBUG("Writing 128 bytes of FIC channel data\n");
-                    Buffer fic(128, in);
-                    myFicSource->loadFicData(fic);
-                    input_size -= 128;
-                    framesize -= 128;
-                    in += 128;
-                } else {
-                    if (input_size < 96) {
-                        return dataIn.getLength() - input_size;
-                    }
-                    PDEBUG("Writing 96 bytes of FIC channel data\n");
-                    Buffer fic(96, in);
-                    myFicSource->loadFicData(fic);
-                    input_size -= 96;
-                    framesize -= 96;
-                    in += 96;
-                }
-                state = EtiReaderState::Subch;
-                break;
-            case EtiReaderState::Subch:
-                for (size_t i = 0; i < eti_stc.size(); ++i) {
-                    unsigned size = mySources[i]->framesize();
-                    PDEBUG("Writting %i bytes of subchannel data\n", size);
-                    Buffer subch(size, in);
-                    mySources[i]->loadSubchannelData(std::move(subch));
-                    input_size -= size;
-                    framesize -= size;
-                    in += size;
-                }
-                state = EtiReaderState::Eof;
-                break;
-            case EtiReaderState::Eof:
-                if (input_size < 4) {
-                    return dataIn.getLength() - input_size;
-                }
-                memcpy(&eti_eof, in, 4);
-                input_size -= 4;
-                framesize -= 4;
-                in += 4;
-                state = EtiReaderState::Tist;
-                PDEBUG("Eof.crc: %#.4x\n", eti_eof.CRC);
-                PDEBUG("Eof.rfu: %#.4x\n", eti_eof.RFU);
-                break;
-            case EtiReaderState::Tist:
-                if (input_size < 4) {
-                    return dataIn.getLength() - input_size;
-                }
-                memcpy(&eti_tist, in, 4);
-                input_size -= 4;
-                framesize -= 4;
-                in += 4;
-                state = EtiReaderState::Pad;
-                PDEBUG("Tist: 0x%.6x\n", eti_tist.TIST);
-                break;
-            case EtiReaderState::Pad:
-                if (framesize > 0) {
-                    --input_size;
-                    --framesize;
-                    ++in;
-                } else {
-                    state = EtiReaderState::Sync;
+int EtiReader::loadEtiData(const uint8_t *data, size_t length)
+{
+    PDEBUG("EtiReader::loadEtiData(data: %p, length: %zu)\n", data, length);
+
+    /* All fields are at offsets given by the FC and the STC, the frame is
+     * parsed in one pass. The FIC and the subchannels are not copied, their
+     * sources point into the frame. */
+    if (length < ETI_FRAME_SIZE) {
+        return 0;
+    }
+
+    const uint8_t *in = data;
+    memcpy(&eti_sync, in, 4);
+    in += 4;
+    PDEBUG("Sync.err: 0x%.2x\n", eti_sync.ERR);
+    PDEBUG("Sync.fsync: 0x%.6x\n", eti_sync.FSYNC);
+
+    memcpy(&eti_fc, in, 4);
+    eti_fc_valid = true;
+    in += 4;
+    PDEBUG("Fc.fct: 0x%.2x\n", eti_fc.FCT);
+    PDEBUG("Fc.ficf: %u\n", eti_fc.FICF);
+    PDEBUG("Fc.nst: %u\n", eti_fc.NST);
+    PDEBUG("Fc.fp: 0x%x\n", eti_fc.FP);
+    PDEBUG("Fc.mid: %u\n", eti_fc.MID);
+    PDEBUG("Fc.fl: %u\n", eti_fc.getFrameLength());
+    if (!eti_fc.FICF) {
+        throw std::runtime_error("FIC must be present to modulate!");
+    }
+    if (not myFicSource) {
+        unsigned ficf = eti_fc.FICF;
+        unsigned mid = eti_fc.MID;
+        myFicSource = make_shared<FicSource>(ficf, mid);
+    }
+
+    const size_t nst = eti_fc.NST;
+    if ((eti_stc.size() != nst) ||
+            (memcmp(eti_stc.data(), in, 4 * nst))) {
+        PDEBUG("New stc!\n");
+        const auto previous_stc = std::move(eti_stc);
+        auto previous_sources = std::move(mySources);
+        eti_stc.resize(nst);
+        memcpy(eti_stc.data(), in, 4 * nst);
+
+        mySources.clear();
+        mySubchOffsets.clear();
+        size_t offset = 0;
+        for (unsigned i = 0; i < nst; ++i) {
+            // Keep the source of a subchannel whose STC did not change,
+            // so that the modulator can keep its encoder chain.
+            shared_ptr<SubchannelSource> source;
+            for (size_t j = 0; j < previous_stc.size(); ++j) {
+                if (previous_sources[j] and
+                        memcmp(&previous_stc[j], &eti_stc[i], sizeof(eti_STC)) == 0) {
+                    source = std::move(previous_sources[j]);
+                    break;
                 }
-                break;
-            default:
-                // throw std::runtime_error("Invalid state!");
-                PDEBUG("Invalid state (%i)!", state);
-                input_size = 0;
+            }
+
+            if (not source) {
+                const auto tpl = eti_stc[i].TPL;
+                source = make_shared<SubchannelSource>(
+                        eti_stc[i].getStartAddress(),
+                        eti_stc[i].getSTL(),
+                        tpl);
+            }
+            mySources.push_back(source);
+            mySubchOffsets.push_back(offset);
+            offset += mySources.back()->framesize();
+            PDEBUG("Sstc %u:\n", i);
+            PDEBUG(" Stc%i.scid: %i\n", i, eti_stc[i].SCID);
+            PDEBUG(" Stc%i.sad: %u\n", i, eti_stc[i].getStartAddress());
+            PDEBUG(" Stc%i.tpl: 0x%.2x\n", i, eti_stc[i].TPL);
+            PDEBUG(" Stc%i.stl: %u\n", i, eti_stc[i].getSTL());
         }
+        myMstLength = offset;
+    }
+    in += 4 * nst;
+
+    memcpy(&eti_eoh, in, 4);
+    in += 4;
+    PDEBUG("Eoh.mnsc: 0x%.4x\n", eti_eoh.MNSC);
+    PDEBUG("Eoh.crc: 0x%.4x\n", eti_eoh.CRC);
+
+    const size_t ficLength = (eti_fc.MID == 3) ? 128 : 96;
+
+    // SYNC, FC, STC, EOH, FIC, MST, EOF and TIST
+    const size_t frameLength = 4 + 4 + 4 * nst + 4 + ficLength + myMstLength + 4 + 4;
+    if (frameLength > ETI_FRAME_SIZE) {
+        throw std::runtime_error("ETI frame too short for its " +
+                to_string(nst) + " subchannels");
+    }
+
+    PDEBUG("Writing %zu bytes of FIC channel data\n", ficLength);
+    myFicSource->loadFicData(in, ficLength);
+    in += ficLength;
+
+    for (size_t i = 0; i < mySources.size(); ++i) {
+        mySources[i]->loadSubchannelData(in + mySubchOffsets[i],
+                mySources[i]->framesize());
     }
+    in += myMstLength;
+
+    memcpy(&eti_eof, in, 4);
+    in += 4;
+    PDEBUG("Eof.crc: %#.4x\n", eti_eof.CRC);
+    PDEBUG("Eof.rfu: %#.4x\n", eti_eof.RFU);
+
+    memcpy(&eti_tist, in, 4);
+    PDEBUG("Tist: 0x%.6x\n", eti_tist.TIST);
 
     // Update timestamps
     myTimestampDecoder.updateTimestampEti(eti_fc.FP & 0x3,
@@ -280,7 +219,8 @@ int EtiReader::loadEtiData(const Buffer& dataIn)
 
     myFicSource->loadTimestamp(myTimestampDecoder.getTimestamp());
 
-    return dataIn.getLength() - input_size;
+    // The rest of the frame is padding
+    return ETI_FRAME_SIZE;
 }
 
 uint32_t EtiReader::getPPSOffset()
@@ -295,6 +235,75 @@ uint32_t EtiReader::getPPSOffset()
     return timestamp;
 }
 
+static constexpr size_t FIB_SIZE = 32;
+
+// An unchanged FIB is decoded again after this time, in case another FIB
+// changed the information it carries in the meantime
+static constexpr auto FIB_REDECODE_INTERVAL = std::chrono::seconds(10);
+
+// Limits for frequently changing FIBs, e.g. with the date and time, and
+// for when nobody asks for the ensemble information
+static constexpr size_t MAX_KNOWN_FIBS = 4096;
+static constexpr size_t MAX_PENDING_FIBS = 4096;
+
+void TistMarginStatistics::add(int64_t margin_us)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_num_frames == 0) {
+        m_min_us = margin_us;
+        m_max_us = margin_us;
+    }
+    m_num_frames++;
+    m_min_us = std::min(m_min_us, margin_us);
+    m_max_us = std::max(m_max_us, margin_us);
+
+    if (margin_us < 0) {
+        m_num_late++;
+    }
+    else {
+        m_bins[bins::bin_index(margin_us)]++;
+    }
+}
+
+TistMarginStatistics::stats_t TistMarginStatistics::get() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    stats_t s;
+    s.num_frames = m_num_frames;
+    s.num_late = m_num_late;
+    s.min_us = m_min_us;
+    s.max_us = m_max_us;
+
+    // The late frames are the lowest margins
+    const auto percentile = [&](double p) -> int64_t {
+        const uint64_t rank = std::max<uint64_t>(1, std::ceil(p * m_num_frames));
+        uint64_t cumulative = m_num_late;
+        if (cumulative >= rank) {
+            return m_min_us;
+        }
+        for (size_t i = 0; i < bins::num_bins; i++) {
+            cumulative += m_bins[i];
+            if (cumulative >= rank) {
+                const int64_t lower = i == 0 ? 0 : bins::bin_upper_bound(i - 1);
+                return std::max(lower, m_min_us);
+            }
+        }
+        return m_max_us;
+    };
+
+    if (m_num_frames > 0) {
+        s.p1_us = percentile(0.01);
+        s.p50_us = percentile(0.5);
+    }
+
+    for (size_t i = 0; i < bins::num_bins; i++) {
+        if (m_bins[i] > 0) {
+            s.bins.emplace_back(bins::bin_upper_bound(i), m_bins[i]);
+        }
+    }
+    return s;
+}
+
 EdiReader::EdiReader(double& tist_offset_s) :
     m_timestamp_decoder(tist_offset_s),
     m_fic_decoder(/*verbose*/ false)
@@ -412,11 +421,69 @@ void EdiReader::update_fic(std::vector<uint8_t>&& fic)
         throw std::logic_error("Cannot update FIC before protocol");
     }
 
-    m_fic_decoder.Process(fic.data(), fic.size());
+    if (fic.size() % FIB_SIZE == 0) {
+        const auto now = std::chrono::steady_clock::now();
+        if (m_known_fibs.size() > MAX_KNOWN_FIBS) {
+            m_known_fibs.clear();
+        }
+
+        for (size_t i = 0; i < fic.size(); i += FIB_SIZE) {
+            // FNV-1a
+            uint64_t hash = 14695981039346656037ull;
+            for (size_t j = i; j < i + FIB_SIZE; j++) {
+                hash = (hash ^ fic[j]) * 1099511628211ull;
+            }
+
+            auto known = m_known_fibs.find(hash);
+            if (known == m_known_fibs.end() or now - known->second > FIB_REDECODE_INTERVAL) {
+                m_known_fibs[hash] = now;
+                m_fib_backlog.insert(m_fib_backlog.end(),
+                        fic.begin() + i, fic.begin() + i + FIB_SIZE);
+            }
+        }
+    }
+    else {
+        etiLog.level(warn) << "EdiReader: Ignoring FIC with a non-integer FIB count of " <<
+            fic.size() << " bytes";
+    }
+
+    std::unique_lock<std::mutex> lock(m_fic_mutex, std::try_to_lock);
+    if (lock.owns_lock() and not m_fib_backlog.empty()) {
+        if (m_pending_fibs.size() + m_fib_backlog.size() > MAX_PENDING_FIBS * FIB_SIZE) {
+            // Nobody asked for the ensemble information in a long time,
+            // the FIBs will be seen again.
+            m_pending_fibs.clear();
+        }
+        m_pending_fibs.insert(m_pending_fibs.end(),
+                m_fib_backlog.begin(), m_fib_backlog.end());
+        m_fib_backlog.clear();
+    }
 
     m_fic = std::move(fic);
 }
 
+void EdiReader::decode_pending_fibs() const
+{
+    if (not m_pending_fibs.empty()) {
+        m_fic_decoder.Process(m_pending_fibs.data(), m_pending_fibs.size());
+        m_pending_fibs.clear();
+    }
+}
+
+std::optional<FIC_ENSEMBLE> EdiReader::getEnsembleInfo() const
+{
+    std::lock_guard<std::mutex> lock(m_fic_mutex);
+    decode_pending_fibs();
+    return m_fic_decoder.observer.ensemble;
+}
+
+std::map<int /*SId*/, LISTED_SERVICE> EdiReader::getServiceInfo() const
+{
+    std::lock_guard<std::mutex> lock(m_fic_mutex);
+    decode_pending_fibs();
+    return m_fic_decoder.observer.services;
+}
+
 void EdiReader::update_edi_time(
         uint32_t utco,
         uint32_t seconds)
@@ -456,11 +523,16 @@ void EdiReader::add_subchannel(EdiDecoder::eti_stc_data&& stc)
         throw std::logic_error("Cannot add subchannel before protocol");
     }
 
-    if (m_sources.count(stc.stream_index) == 0) {
-        m_sources[stc.stream_index] = make_shared<SubchannelSource>(stc.sad, stc.stl(), stc.tpl);
-    }
-
+    // Replace the source only if the subchannel changed, so that the
+    // modulator can keep the encoder chains of the others.
     auto& source = m_sources[stc.stream_index];
+    if (not source or
+            source->startAddress() != stc.sad or
+            source->framesize() != stc.mst.size() or
+            source->protection() != stc.tpl) {
+        source = make_shared<SubchannelSource>(stc.sad, stc.stl(), stc.tpl);
+    }
+    m_received_streams.insert(stc.stream_index);
 
     if (source->framesize() != stc.mst.size()) {
         throw std::invalid_argument(
@@ -503,6 +575,17 @@ void EdiReader::assemble(EdiDecoder::ReceivedTagPacket&& tagpacket)
 
     myFicSource->loadFicData(m_fic);
 
+    // Forget the subchannels that were removed from the ensemble
+    for (auto it = m_sources.begin(); it != m_sources.end();) {
+        if (m_received_streams.count(it->first) == 0) {
+            it = m_sources.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+    m_received_streams.clear();
+
     // Accept zero subchannels, because of an edge-case that can happen
     // during reconfiguration. See ETS 300 799 Clause 5.3.3
 
@@ -523,16 +606,133 @@ void EdiReader::assemble(EdiDecoder::ReceivedTagPacket&& tagpacket)
 
     m_timestamp_decoder.updateTimestampEdi(utc_ts, m_fc.tsta, m_fc.fct(), m_fc.fp);
 
-    myFicSource->loadTimestamp(m_timestamp_decoder.getTimestamp());
+    const auto ts = m_timestamp_decoder.getTimestamp();
+    myFicSource->loadTimestamp(ts);
+
+    if (m_fc.tsta != 0xFFFFFF and
+            tagpacket.arrival != std::chrono::system_clock::time_point()) {
+        using namespace std::chrono;
+        const int64_t arrival_ns = duration_cast<nanoseconds>(
+                tagpacket.arrival.time_since_epoch()).count();
+        m_tist_margins.add((ts.get_ns() - arrival_ns) / 1000);
+    }
+
+    m_frameReady = true;
+}
+
+void EdiFrame::replay(EdiDecoder::ETIDataCollector& collector)
+{
+    if (proto_received) {
+        collector.update_protocol(proto, proto_major, proto_minor);
+    }
+    if (fc_received) {
+        collector.update_fc_data(fc);
+    }
+    if (err_received) {
+        collector.update_err(err);
+    }
+    if (time_received) {
+        collector.update_edi_time(utco, seconds);
+    }
+    if (mnsc_received) {
+        collector.update_mnsc(mnsc);
+    }
+    if (rfu_received) {
+        collector.update_rfu(rfu);
+    }
+    if (not fic.empty()) {
+        collector.update_fic(std::move(fic));
+    }
+    for (auto& stc : subchannels) {
+        collector.add_subchannel(std::move(stc));
+    }
+    collector.assemble(std::move(tagpacket));
+}
+
+void EdiFrame::clear()
+{
+    proto_received = false;
+    fc_received = false;
+    err_received = false;
+    time_received = false;
+    mnsc_received = false;
+    rfu_received = false;
+    fic.clear();
+    subchannels.clear();
+    tagpacket = EdiDecoder::ReceivedTagPacket();
+}
+
+void EdiFrameRecorder::takeFrame(EdiFrame& frame)
+{
+    std::swap(frame, m_frame);
+    m_frame.clear();
+    m_frameReady = false;
+}
+
+void EdiFrameRecorder::update_protocol(
+        const std::string& proto,
+        uint16_t major,
+        uint16_t minor)
+{
+    // A new frame starts with the protocol
+    m_frame.clear();
+    m_frameReady = false;
+
+    m_frame.proto_received = true;
+    m_frame.proto = proto;
+    m_frame.proto_major = major;
+    m_frame.proto_minor = minor;
+}
+
+void EdiFrameRecorder::update_fc_data(const EdiDecoder::eti_fc_data& fc_data)
+{
+    m_frame.fc_received = true;
+    m_frame.fc = fc_data;
+}
+
+void EdiFrameRecorder::update_fic(std::vector<uint8_t>&& fic)
+{
+    m_frame.fic = std::move(fic);
+}
+
+void EdiFrameRecorder::update_err(uint8_t err)
+{
+    m_frame.err_received = true;
+    m_frame.err = err;
+}
+
+void EdiFrameRecorder::update_edi_time(uint32_t utco, uint32_t seconds)
+{
+    m_frame.time_received = true;
+    m_frame.utco = utco;
+    m_frame.seconds = seconds;
+}
+
+void EdiFrameRecorder::update_mnsc(uint16_t mnsc)
+{
+    m_frame.mnsc_received = true;
+    m_frame.mnsc = mnsc;
+}
+
+void EdiFrameRecorder::update_rfu(uint16_t rfu)
+{
+    m_frame.rfu_received = true;
+    m_frame.rfu = rfu;
+}
+
+void EdiFrameRecorder::add_subchannel(EdiDecoder::eti_stc_data&& stc)
+{
+    m_frame.subchannels.push_back(std::move(stc));
+}
 
+void EdiFrameRecorder::assemble(EdiDecoder::ReceivedTagPacket&& tagpacket)
+{
+    m_frame.tagpacket = std::move(tagpacket);
     m_frameReady = true;
 }
 
 EdiTransport::EdiTransport(EdiDecoder::ETIDecoder& decoder) :
     m_enabled(false),
-    m_port(0),
-    m_bindto("0.0.0.0"),
-    m_mcastaddr("0.0.0.0"),
     m_decoder(decoder) { }
 
 
@@ -540,60 +740,92 @@ void EdiTransport::Open(const std::string& uri)
 {
     etiLog.level(info) << "Opening EDI :" << uri;
 
+    const size_t source = m_uris.size();
+
     const string proto = uri.substr(0, 6);
     if (proto == "udp://") {
-        if (m_proto == Proto::TCP) {
-            throw std::invalid_argument("Cannot specify both TCP and UDP urls");
-        }
-
         size_t found_port = uri.find_first_of(":", 6);
         if (found_port == string::npos) {
             throw std::invalid_argument("EDI UDP input port must be provided");
         }
 
-        m_port = std::stoi(uri.substr(found_port+1));
+        const int port = std::stoi(uri.substr(found_port+1));
+        std::string bindto = "0.0.0.0";
+        std::string mcastaddr = "0.0.0.0";
         std::string host_full = uri.substr(6, found_port-6);// skip udp://
         size_t found_mcast = host_full.find_first_of("@"); //have multicast address:
         if (found_mcast != string::npos) {
             if (found_mcast > 0) {
-                m_bindto = host_full.substr(0, found_mcast);
+                bindto = host_full.substr(0, found_mcast);
             }
-            m_mcastaddr = host_full.substr(found_mcast+1);
+            mcastaddr = host_full.substr(found_mcast+1);
         }
         else if (found_port != 6) {
-            m_bindto = host_full;
+            bindto = host_full;
         }
 
-        etiLog.level(info) << "EDI UDP input: host:" << m_bindto <<
-            ", source:" << m_mcastaddr << ", port:" << m_port;
+        // The port tells from which source a packet comes
+        if (m_udp_sources.count(port)) {
+            throw std::invalid_argument("EDI UDP port " + to_string(port) +
+                    " used by several sources");
+        }
 
-        m_udp_rx.add_receive_port(m_port, m_bindto, m_mcastaddr);
-        m_proto = Proto::UDP;
-        m_enabled = true;
+        etiLog.level(info) << "EDI UDP input: host:" << bindto <<
+            ", source:" << mcastaddr << ", port:" << port;
+
+        m_udp_rx.add_receive_port(port, bindto, mcastaddr);
+        m_udp_sources[port] = source;
+        m_udp_sockets = m_udp_rx.getNativeSockets();
     }
     else if (proto == "tcp://") {
-        if (m_proto != Proto::Unspecified) {
-            throw std::invalid_argument("Cannot call Open several times with TCP");
-        }
-
         size_t found_port = uri.find_first_of(":", 6);
         if (found_port == string::npos) {
             throw std::invalid_argument("EDI TCP input port must be provided");
         }
 
-        m_port = std::stoi(uri.substr(found_port+1));
+        const int port = std::stoi(uri.substr(found_port+1));
         const std::string hostname = uri.substr(6, found_port-6);
 
-        etiLog.level(info) << "EDI TCP connect to " << hostname << ":" << m_port;
+        etiLog.level(info) << "EDI TCP connect to " << hostname << ":" << port;
 
-        m_tcp_uri = uri;
-        m_tcpclient.connect(hostname, m_port);
-        m_proto = Proto::TCP;
-        m_enabled = true;
+        auto tcp_source = make_unique<tcp_source_t>();
+        tcp_source->source = source;
+        tcp_source->client.connect(hostname, port);
+        m_tcp_sources.push_back(std::move(tcp_source));
+
+        if (not m_tcp_uri.empty()) {
+            m_tcp_uri += " ";
+        }
+        m_tcp_uri += uri;
     }
     else {
         throw std::invalid_argument("ETI protocol '" + proto + "' unknown");
     }
+
+    m_uris.push_back(uri);
+
+    if (m_tcp_sources.empty()) {
+        m_proto = Proto::UDP;
+    }
+    else if (m_udp_sources.empty() and m_tcp_sources.size() == 1) {
+        m_proto = Proto::TCP;
+    }
+    else {
+        m_proto = Proto::Multiple;
+    }
+    m_enabled = true;
+}
+
+void EdiTransport::setPacketRingInterface(const std::string& interface)
+{
+    etiLog.level(info) << "EDI UDP input through the packet ring of " <<
+        interface;
+    m_udp_rx.set_packet_ring_interface(interface);
+}
+
+void EdiTransport::setRxTimestamps(Socket::rx_timestamps_e timestamps)
+{
+    m_udp_rx.set_rx_timestamps(timestamps);
 }
 
 bool EdiTransport::rxPacket()
@@ -605,70 +837,172 @@ bool EdiTransport::rxPacket()
                 return false;
             }
         case Proto::UDP:
-            {
-                Socket::InetAddress received_from;
-                try {
-                    auto received_packets = m_udp_rx.receive(100);
-                    for (auto rp : received_packets) {
-                        received_from = rp.received_from;
-
-                        EdiDecoder::Packet p;
-                        p.buf = std::move(rp.packetdata);
-                        p.received_on_port = rp.port_received_on;
-                        m_decoder.push_packet(p);
-                    }
-                    return true;
-                }
-                catch (const Socket::UDPReceiver::Timeout&) {
-                    return false;
-                }
-                catch (const Socket::UDPReceiver::Interrupted&) {
-                    return false;
-                }
-                catch (const invalid_argument& e) {
-                    try {
-                        fprintf(stderr, "Invalid argument receiving EDI from %s: %s\n",
-                                received_from.to_string().c_str(), e.what());
-                    }
-                    catch (const invalid_argument& ee) {
-                        fprintf(stderr, "Invalid argument receiving EDI %s\n", e.what());
-                        fprintf(stderr, "Invalid argument converting source address %s\n", ee.what());
-                    }
-                }
-                catch (const runtime_error& e) {
-                    fprintf(stderr, "Runtime error UDP Receive: %s\n", e.what());
-                }
+            return rxUdpPacket(100);
+        case Proto::TCP:
+            return rxTcpPacket(0, 1000);
+        case Proto::Multiple:
+            return rxFromAnySource();
+    }
+    throw logic_error("Incomplete rxPacket implementation!");
+}
 
-                return false;
+bool EdiTransport::rxUdpPacket(int timeout_ms)
+{
+    Socket::InetAddress received_from;
+    try {
+        // Receive the packets in batches, but give them to the
+        // decoder one by one, because the caller must take
+        // every frame before the next one gets decoded.
+        if (m_batch_next == m_batch_size) {
+            m_batch_size = m_udp_rx.receive_batch(timeout_ms);
+            m_batch_next = 0;
+        }
+
+        if (m_batch_next < m_batch_size) {
+            const size_t i = m_batch_next++;
+            const auto& rp = m_udp_rx.batch_packet(i);
+            received_from = rp.address;
+
+            // m_packet keeps the capacity of its buffer
+            m_packet.buf.assign(rp.buffer.begin(), rp.buffer.end());
+            m_packet.received_on_port = m_udp_rx.batch_port(i);
+            m_packet.arrival = rp.arrival;
+            if (m_packet.arrival == std::chrono::system_clock::time_point()) {
+                m_packet.arrival = std::chrono::system_clock::now();
             }
-        case Proto::TCP:
-            {
-                // The buffer size must be smaller than the size of two AF Packets, because otherwise
-                // the EDI decoder decodes two in a row and discards the first. This leads to ETI FCT
-                // discontinuity.
-                m_tcpbuffer.resize(512);
-                const int timeout_ms = 1000;
-
-                ssize_t ret = m_tcpclient.recv(m_tcpbuffer.data(), m_tcpbuffer.size(), 0, timeout_ms);
-                if (ret <= 0) {
-                    return false;
-                }
-                else if (ret > (ssize_t)m_tcpbuffer.size()) {
-                    throw logic_error("EDI TCP: invalid recv() return value");
-                }
-                else {
-                    m_tcpbuffer.resize(ret);
-                    m_decoder.push_bytes(m_tcpbuffer);
-                    return true;
-                }
+            m_packet.source = m_udp_sources.at(m_packet.received_on_port);
+            m_decoder.push_packet(m_packet);
+        }
+        return true;
+    }
+    catch (const Socket::UDPReceiver::Timeout&) {
+        return false;
+    }
+    catch (const Socket::UDPReceiver::Interrupted&) {
+        return false;
+    }
+    catch (const invalid_argument& e) {
+        try {
+            fprintf(stderr, "Invalid argument receiving EDI from %s: %s\n",
+                    received_from.to_string().c_str(), e.what());
+        }
+        catch (const invalid_argument& ee) {
+            fprintf(stderr, "Invalid argument receiving EDI %s\n", e.what());
+            fprintf(stderr, "Invalid argument converting source address %s\n", ee.what());
+        }
+    }
+    catch (const runtime_error& e) {
+        fprintf(stderr, "Runtime error UDP Receive: %s\n", e.what());
+    }
+
+    return false;
+}
+
+bool EdiTransport::rxTcpPacket(size_t tcp_source, int timeout_ms)
+{
+    auto& src = *m_tcp_sources.at(tcp_source);
+
+    // The buffer size must be smaller than the size of two AF Packets, because otherwise
+    // the EDI decoder decodes two in a row and discards the first. This leads to ETI FCT
+    // discontinuity.
+    // The bytes are received directly into the stream buffer of the decoder.
+    constexpr size_t max_len = 512;
+    uint8_t *buf = m_decoder.stream_reserve(max_len, src.source);
+
+    ssize_t ret = src.client.recv(buf, max_len, 0, timeout_ms);
+    if (ret <= 0) {
+        return false;
+    }
+    else if (ret > (ssize_t)max_len) {
+        throw logic_error("EDI TCP: invalid recv() return value");
+    }
+    else {
+        m_decoder.stream_commit(ret, src.source);
+        return true;
+    }
+}
+
+bool EdiTransport::rxFromAnySource()
+{
+    // For the same reason as with the TCP buffer size, only one UDP packet
+    // or TCP read is given to the decoder per call.
+    if (m_batch_next < m_batch_size) {
+        return rxUdpPacket(0);
+    }
+
+    const auto now = chrono::steady_clock::now();
+
+    m_pollfds.clear();
+    for (const auto sock : m_udp_sockets) {
+        m_pollfds.push_back({sock, POLLIN, 0});
+    }
+    for (const auto& src : m_tcp_sources) {
+        // poll() ignores negative fds
+        const SOCKET sock = now < src->retry_after ?
+            -1 : src->client.get_sockfd();
+        m_pollfds.push_back({sock, POLLIN, 0});
+    }
+
+    const int timeout_ms = 100;
+    int retval = poll(m_pollfds.data(), m_pollfds.size(), timeout_ms);
+    if (retval == -1) {
+        if (errno != EINTR) {
+            fprintf(stderr, "EDI receive with poll() error: %s\n", strerror(errno));
+        }
+        return false;
+    }
+
+    bool udp_readable = false;
+    for (size_t i = 0; i < m_udp_sockets.size(); i++) {
+        if (m_pollfds[i].revents & POLLIN) {
+            udp_readable = true;
+        }
+    }
+
+    // Source 0 is all UDP ports, it is followed by the TCP sources.
+    const size_t num_rx_sources = 1 + m_tcp_sources.size();
+    bool received = false;
+    for (size_t n = 0; n < num_rx_sources and not received; n++) {
+        const size_t rx_source = (m_next_rx_source + n) % num_rx_sources;
+
+        if (rx_source == 0) {
+            received = udp_readable and rxUdpPacket(0);
+        }
+        else {
+            const size_t i = rx_source - 1;
+            auto& src = *m_tcp_sources[i];
+            const short revents = m_pollfds[m_udp_sockets.size() + i].revents;
+
+            if (revents & POLLIN) {
+                received = rxTcpPacket(i, 0);
+            }
+            else if (revents & (POLLERR | POLLHUP)) {
+                etiLog.level(warn) << "EDI TCP " << m_uris[src.source] <<
+                    " connection failed, reconnecting";
+                src.client.reconnect();
+                src.retry_after = now + chrono::seconds(1);
             }
+        }
+
+        if (received) {
+            m_next_rx_source = rx_source + 1;
+        }
     }
-    throw logic_error("Incomplete rxPacket implementation!");
+
+    for (auto& src : m_tcp_sources) {
+        // This is to catch half-closed TCP connections
+        src->client.reconnect_if_idle(chrono::milliseconds(5 * 1000));
+    }
+
+    return received;
 }
 
-EdiInput::EdiInput(double& tist_offset_s, float edi_max_delay_ms) :
+EdiInput::EdiInput(double& tist_offset_s, float edi_max_delay_ms,
+        bool record_frames) :
     ediReader(tist_offset_s),
-    decoder(ediReader),
+    decoder(record_frames ?
+            static_cast<EdiDecoder::ETIDataCollector&>(ediRecorder) :
+            static_cast<EdiDecoder::ETIDataCollector&>(ediReader)),
     ediTransport(decoder)
 {
     if (edi_max_delay_ms > 0.0f) {
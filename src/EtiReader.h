@@ -40,8 +40,14 @@
 #include "TimestampDecoder.h"
 #include "lib/edi/ETIDecoder.hpp"
 
+#include <array>
 #include <vector>
+#include <map>
+#include <set>
+#include <unordered_map>
 #include <memory>
+#include <mutex>
+#include <chrono>
 #include <stdint.h>
 #include <sys/types.h>
 
@@ -73,25 +79,6 @@ protected:
     std::shared_ptr<FicSource> myFicSource;
 };
 
-enum class EtiReaderState {
-    // For Framed input format
-    NbFrame,
-
-    // For Streamed input format
-    FrameSize,
-
-    // ETI Sync
-    Sync,
-    Fc,
-    Nst,
-    Eoh,
-    Fic,
-    Subch,
-    Eof,
-    Tist,
-    Pad
-};
-
 /* The EtiReader extracts the necessary data for modulation from an ETI(NI) byte stream. */
 class EtiReader : public EtiSource
 {
@@ -103,10 +90,13 @@ public:
     virtual unsigned getFct() override;
     virtual frame_timestamp getTimestamp() override;
 
-    /* Read ETI data from dataIn. Returns the number of bytes
-     * read from the buffer.
+    /* Read one ETI frame of 6144 bytes from dataIn. Returns the number
+     * of bytes read from the buffer, 0 if it does not contain a whole
+     * frame. The FIC and subchannel sources refer to the data, which must
+     * stay valid until the flowgraph has processed the frame.
      */
     int loadEtiData(const Buffer& dataIn);
+    int loadEtiData(const uint8_t *data, size_t length);
 
     virtual const std::vector<std::shared_ptr<SubchannelSource> > getSubchannels() const override;
 
@@ -114,9 +104,6 @@ private:
     /* Transform the ETI TIST to a PPS offset in units of 1/16384000 s */
     uint32_t getPPSOffset();
 
-    EtiReaderState state = EtiReaderState::Sync;
-    uint32_t nb_frames;
-    uint16_t framesize;
     eti_SYNC eti_sync;
     eti_FC eti_fc;
     std::vector<eti_STC> eti_stc;
@@ -128,11 +115,52 @@ private:
     bool eti_fc_valid;
 
     std::vector<std::shared_ptr<SubchannelSource> > mySources;
+
+    // Offset of every subchannel in the MST, and the MST length, in bytes
+    std::vector<size_t> mySubchOffsets;
+    size_t myMstLength = 0;
 };
 
 /* The EdiReader extracts the necessary data using the EDI input library in
  * lib/edi
  */
+/* How long before its transmission time, which is its TIST plus the
+ * modulator offset, every EDI frame with a timestamp was received. The
+ * margins are in the bins of the EdiDecoder::PathStatistics, the frames
+ * received after their transmission time are only counted. Can be read
+ * from another thread than the one decoding. */
+class TistMarginStatistics
+{
+    public:
+        void add(int64_t margin_us);
+
+        struct stats_t {
+            uint64_t num_frames = 0;
+            uint64_t num_late = 0;
+
+            // The lower bounds of the bins containing the percentiles
+            int64_t min_us = 0;
+            int64_t p1_us = 0;
+            int64_t p50_us = 0;
+            int64_t max_us = 0;
+
+            // The upper bounds and counts of the bins that aren't empty
+            std::vector<std::pair<uint64_t, uint64_t> > bins;
+        };
+
+        stats_t get() const;
+
+    private:
+        using bins = EdiDecoder::PathStatistics;
+
+        mutable std::mutex m_mutex;
+        uint64_t m_num_frames = 0;
+        uint64_t m_num_late = 0;
+        int64_t m_min_us = 0;
+        int64_t m_max_us = 0;
+        std::array<uint64_t, bins::num_bins> m_bins = {};
+};
+
 class EdiReader : public EtiSource, public EdiDecoder::ETIDataCollector
 {
 public:
@@ -176,13 +204,13 @@ public:
     // Gets called by the EDI library to tell us that all data for a frame was given to us
     virtual void assemble(EdiDecoder::ReceivedTagPacket&& tagpacket) override;
 
-    std::optional<FIC_ENSEMBLE> getEnsembleInfo() const {
-        return m_fic_decoder.observer.ensemble;
-    }
+    /* The FIC is decoded when one of these is called, e.g. by the remote
+     * control, instead of at every frame. They can be called from any
+     * thread. */
+    std::optional<FIC_ENSEMBLE> getEnsembleInfo() const;
+    std::map<int /*SId*/, LISTED_SERVICE> getServiceInfo() const;
 
-    std::map<int /*SId*/, LISTED_SERVICE> getServiceInfo() const {
-        return m_fic_decoder.observer.services;
-    }
+    const TistMarginStatistics& getTistMargins() const { return m_tist_margins; }
 
 private:
     bool m_proto_valid = false;
@@ -206,8 +234,95 @@ private:
 
     std::map<uint8_t, std::shared_ptr<SubchannelSource> > m_sources;
 
+    // Stream indices of the subchannels received in the current frame
+    std::set<uint8_t> m_received_streams;
+
     TimestampDecoder m_timestamp_decoder;
-    FICDecoder m_fic_decoder;
+    TistMarginStatistics m_tist_margins;
+
+    // Decodes the FIBs given by update_fic(), must be called with
+    // m_fic_mutex held
+    void decode_pending_fibs() const;
+
+    // Hashes of the FIBs given to the decoder, and when. update_fic only
+    // keeps the FIBs that are new or were last decoded a while ago.
+    std::unordered_map<uint64_t, std::chrono::steady_clock::time_point> m_known_fibs;
+
+    // FIBs that could not be given to the decoder without waiting, because
+    // it was busy in another thread
+    std::vector<uint8_t> m_fib_backlog;
+
+    mutable std::mutex m_fic_mutex;
+    mutable std::vector<uint8_t> m_pending_fibs;
+    mutable FICDecoder m_fic_decoder;
+};
+
+/* The data the ETIDecoder gave for one EDI frame, which can be given again
+ * to an EdiReader later, in another thread.
+ */
+struct EdiFrame {
+    bool proto_received = false;
+    std::string proto;
+    uint16_t proto_major = 0;
+    uint16_t proto_minor = 0;
+
+    bool fc_received = false;
+    EdiDecoder::eti_fc_data fc;
+
+    bool err_received = false;
+    uint8_t err = 0;
+
+    bool time_received = false;
+    uint32_t utco = 0;
+    uint32_t seconds = 0;
+
+    bool mnsc_received = false;
+    uint16_t mnsc = 0;
+
+    bool rfu_received = false;
+    uint16_t rfu = 0;
+
+    std::vector<uint8_t> fic;
+    std::vector<EdiDecoder::eti_stc_data> subchannels;
+    EdiDecoder::ReceivedTagPacket tagpacket;
+
+    /* Give the data to the collector, in the order of the ETIDecoder.
+     * The vectors are moved out. */
+    void replay(EdiDecoder::ETIDataCollector& collector);
+
+    void clear(void);
+};
+
+/* Records what the ETIDecoder gives, instead of decoding it like the
+ * EdiReader. Used when the EDI input runs in its own thread.
+ */
+class EdiFrameRecorder : public EdiDecoder::ETIDataCollector
+{
+public:
+    bool isFrameReady(void) const { return m_frameReady; }
+
+    /* Swap the recorded frame with frame, which is cleared
+     * and used for the next one. */
+    void takeFrame(EdiFrame& frame);
+
+    virtual void update_protocol(
+            const std::string& proto,
+            uint16_t major,
+            uint16_t minor) override;
+    virtual void update_fc_data(const EdiDecoder::eti_fc_data& fc_data) override;
+    virtual void update_fic(std::vector<uint8_t>&& fic) override;
+    virtual void update_err(uint8_t err) override;
+    virtual void update_edi_time(
+            uint32_t utco,
+            uint32_t seconds) override;
+    virtual void update_mnsc(uint16_t mnsc) override;
+    virtual void update_rfu(uint16_t rfu) override;
+    virtual void add_subchannel(EdiDecoder::eti_stc_data&& stc) override;
+    virtual void assemble(EdiDecoder::ReceivedTagPacket&& tagpacket) override;
+
+private:
+    bool m_frameReady = false;
+    EdiFrame m_frame;
 };
 
 /* The EDI input does not use the inputs defined in InputReader.h, as they were
@@ -217,11 +332,28 @@ class EdiTransport {
     public:
         EdiTransport(EdiDecoder::ETIDecoder& decoder);
 
-        /* Can be called once when using TCP, or several times when using UDP */
+        /* Can be called several times, with UDP and TCP urls, to receive
+         * the same EDI stream from several sources. The first copy of
+         * every PFT fragment or AF packet is used. The sources are
+         * numbered in the order of the calls, like in the path statistics
+         * of the decoder.
+         */
         void Open(const std::string& uri);
 
+        /* Receive the UDP sources from a PACKET_MMAP ring on this network
+         * interface, see Socket::UDPReceiver. Must be called before Open().
+         */
+        void setPacketRingInterface(const std::string& interface);
+
+        /* The kernel timestamps of the UDP packets, which tell when the
+         * frames arrived compared with their TIST. The packets without one
+         * get the time at which they are read. Must be called before
+         * Open(). */
+        void setRxTimestamps(Socket::rx_timestamps_e timestamps);
+
         bool isEnabled(void) const { return m_enabled; }
         std::string getTcpUri(void) const { return m_tcp_uri; }
+        const std::vector<std::string>& getSourceUris(void) const { return m_uris; }
 
         /* Receive a packet and give it to the decoder. Returns
          * true if a packet was received, false in case of socket
@@ -230,25 +362,59 @@ class EdiTransport {
         bool rxPacket(void);
 
     private:
+        bool rxUdpPacket(int timeout_ms);
+        bool rxTcpPacket(size_t tcp_source, int timeout_ms);
+
+        // Waits for data from any of the sources, if there are several
+        // TCP sources or both TCP and UDP.
+        bool rxFromAnySource(void);
+
+        // The TCP urls, separated by spaces
         std::string m_tcp_uri;
         bool m_enabled;
-        int m_port;
-        std::string m_bindto;
-        std::string m_mcastaddr;
 
-        enum class Proto { Unspecified, UDP, TCP };
+        // Indexed by source
+        std::vector<std::string> m_uris;
+
+        enum class Proto { Unspecified, UDP, TCP, Multiple };
         Proto m_proto = Proto::Unspecified;
         Socket::UDPReceiver m_udp_rx;
-        std::vector<uint8_t> m_tcpbuffer;
-        Socket::TCPClient m_tcpclient;
+        // The sources of the UDP ports
+        std::map<int, size_t> m_udp_sources;
+        std::vector<SOCKET> m_udp_sockets;
+        // The packets of the last batch received by m_udp_rx, from
+        // m_batch_next on, are not decoded yet.
+        size_t m_batch_size = 0;
+        size_t m_batch_next = 0;
+        EdiDecoder::Packet m_packet;
+
+        struct tcp_source_t {
+            size_t source = 0;
+            Socket::TCPClient client;
+            // After a connection error, the source isn't polled until then
+            std::chrono::steady_clock::time_point retry_after;
+        };
+        std::vector<std::unique_ptr<tcp_source_t> > m_tcp_sources;
+
+        // The UDP sockets followed by the TCP sockets
+        std::vector<struct pollfd> m_pollfds;
+
+        // When receiving from several sources, the one to check first, so
+        // that a busy source does not starve the others.
+        size_t m_next_rx_source = 0;
+
         EdiDecoder::ETIDecoder& m_decoder;
 };
 
 // EdiInput wraps an EdiReader, an EdiDecoder::ETIDecoder and an EdiTransport
 class EdiInput {
     public:
-        EdiInput(double& tist_offset_s, float edi_max_delay_ms);
+        /* With record_frames, the decoder gives the data to the
+         * ediRecorder instead of the ediReader. */
+        EdiInput(double& tist_offset_s, float edi_max_delay_ms,
+                bool record_frames = false);
         EdiReader ediReader;
+        EdiFrameRecorder ediRecorder;
         EdiDecoder::ETIDecoder decoder;
         EdiTransport ediTransport;
 };
@@ -22,15 +22,29 @@
    You should have received a copy of the GNU General Public License
    along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
-#include <string>
+#include <map>
 #include <string>
 
 #include "Events.h"
+#include "Utils.h"
 
 #if defined(HAVE_ZEROMQ)
 
+using namespace std;
+
 EventSender events;
 
+// Beyond this, send() drops the events until the publisher catches up
+static constexpr size_t MAX_QUEUED_EVENTS = 1000;
+
+// Identical events within this interval are published once, with a count
+static constexpr auto COALESCE_INTERVAL = chrono::seconds(1);
+
+static double to_epoch_seconds(chrono::system_clock::time_point t)
+{
+    return chrono::duration<double>(t.time_since_epoch()).count();
+}
+
 EventSender::EventSender() :
     m_zmq_context(1),
     m_socket(m_zmq_context, zmq::socket_type::pub)
@@ -40,13 +54,29 @@ EventSender::EventSender() :
 }
 
 EventSender::~EventSender()
-{ }
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_running = false;
+    }
+    m_notification.notify_one();
+
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
 
 void EventSender::bind(const std::string& bind_endpoint)
 {
     try {
         m_socket.bind(bind_endpoint);
         m_socket_valid = true;
+
+        lock_guard<mutex> lock(m_mutex);
+        if (not m_running) {
+            m_running = true;
+            m_thread = thread(&EventSender::publisher_thread, this);
+        }
     }
     catch (const zmq::error_t& err) {
         fprintf(stderr, "Cannot bind event socket: %s", err.what());
@@ -59,8 +89,27 @@ void EventSender::send(const std::string& event_name, const json::map_t& detail)
         return;
     }
 
+    lock_guard<mutex> lock(m_mutex);
+    if (not m_running) {
+        return;
+    }
+
+    if (m_queue.size() >= MAX_QUEUED_EVENTS) {
+        m_num_dropped++;
+        return;
+    }
+
+    event_t ev;
+    ev.name = event_name;
+    ev.detail = detail;
+    ev.time = chrono::system_clock::now();
+    m_queue.push_back(std::move(ev));
+    m_notification.notify_one();
+}
+
+void EventSender::publish(const std::string& event_name, const std::string& detail_json)
+{
     zmq::message_t zmsg1(event_name.data(), event_name.size());
-    const auto detail_json = json::map_to_json(detail);
     zmq::message_t zmsg2(detail_json.data(), detail_json.size());
 
     try {
@@ -72,6 +121,88 @@ void EventSender::send(const std::string& event_name, const json::map_t& detail)
     }
 }
 
+void EventSender::publisher_thread()
+{
+    set_thread_name("events");
+
+    // The events published less than COALESCE_INTERVAL ago, by name and
+    // detail, with the identical ones that came since.
+    struct recent_t {
+        event_t event;
+        chrono::steady_clock::time_point interval_end;
+        size_t num_coalesced = 0;
+        chrono::system_clock::time_point first_time;
+        chrono::system_clock::time_point last_time;
+    };
+    map<string, recent_t> recent;
+
+    vector<event_t> queue;
+    unique_lock<mutex> lock(m_mutex);
+    while (true) {
+        m_notification.wait_for(lock, chrono::milliseconds(100),
+                [&]() { return not m_running or not m_queue.empty(); });
+
+        const bool running = m_running;
+        queue.swap(m_queue);
+        const size_t num_dropped = m_num_dropped;
+        m_num_dropped = 0;
+        lock.unlock();
+
+        const auto now = chrono::steady_clock::now();
+
+        for (auto& ev : queue) {
+            const string detail_json = json::map_to_json(ev.detail);
+            const string key = ev.name + '\n' + detail_json;
+
+            auto it = recent.find(key);
+            if (it != recent.end()) {
+                auto& r = it->second;
+                if (r.num_coalesced == 0) {
+                    r.first_time = ev.time;
+                }
+                r.num_coalesced++;
+                r.last_time = ev.time;
+            }
+            else {
+                publish(ev.name, detail_json);
+                recent_t r;
+                r.event = std::move(ev);
+                r.interval_end = now + COALESCE_INTERVAL;
+                recent.emplace(key, std::move(r));
+            }
+        }
+        queue.clear();
+
+        for (auto it = recent.begin(); it != recent.end();) {
+            auto& r = it->second;
+            if (running and r.interval_end > now) {
+                ++it;
+                continue;
+            }
+
+            if (r.num_coalesced > 0) {
+                json::map_t detail = r.event.detail;
+                detail["count"].v = (uint64_t)r.num_coalesced;
+                detail["first_time"].v = to_epoch_seconds(r.first_time);
+                detail["last_time"].v = to_epoch_seconds(r.last_time);
+                publish(r.event.name, json::map_to_json(detail));
+            }
+            it = recent.erase(it);
+        }
+
+        if (num_dropped > 0) {
+            json::map_t detail;
+            detail["count"].v = (uint64_t)num_dropped;
+            publish("dropped", json::map_to_json(detail));
+        }
+
+        lock.lock();
+        if (not running) {
+            break;
+        }
+    }
+}
+
 
 void LogToEventSender::log(log_level_t level, const std::string& message)
 {
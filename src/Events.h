@@ -31,10 +31,27 @@
 
 #if defined(HAVE_ZEROMQ)
 #  include "zmq.hpp"
+#  include <atomic>
+#  include <chrono>
+#  include <condition_variable>
+#  include <mutex>
 #  include <string>
+#  include <thread>
+#  include <vector>
 #  include "Log.h"
 #  include "Json.h"
 
+/* Publishes events on a ZMQ PUB socket as two message parts, the event name
+ * and the detail in JSON.
+ *
+ * send() only queues the event, a publisher thread serialises and sends it.
+ * When the queue is full, events are dropped and their number is published
+ * in a "dropped" event. An event identical to one published less than a
+ * second earlier is not published again, instead the publisher sends it once
+ * at the end of that second with the additional details "count",
+ * "first_time" and "last_time": the number of events it stands for and the
+ * times of the first and last of them, in seconds since the epoch.
+ */
 class EventSender {
     public:
         EventSender();
@@ -48,9 +65,25 @@ class EventSender {
 
         void send(const std::string& event_name, const json::map_t& detail);
     private:
+        struct event_t {
+            std::string name;
+            json::map_t detail;
+            std::chrono::system_clock::time_point time;
+        };
+
+        void publisher_thread();
+        void publish(const std::string& event_name, const std::string& detail_json);
+
         zmq::context_t m_zmq_context;
         zmq::socket_t m_socket;
-        bool m_socket_valid = false;
+        std::atomic<bool> m_socket_valid = ATOMIC_VAR_INIT(false);
+
+        std::mutex m_mutex;
+        std::condition_variable m_notification;
+        std::vector<event_t> m_queue;
+        size_t m_num_dropped = 0;
+        bool m_running = false;
+        std::thread m_thread;
 };
 
 class LogToEventSender: public LogBackend {
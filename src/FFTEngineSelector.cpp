@@ -0,0 +1,293 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "FFTEngineSelector.h"
+#include "Buffer.h"
+#include "FixedPointCfr.h"
+#include "Log.h"
+#include "OfdmGenerator.h"
+#include "RunReport.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+// After as many frames to fill the caches and wake up the FFT threads
+static constexpr size_t warmup_frames = 2;
+static constexpr size_t benchmark_frames = 20;
+
+struct ofdm_params_t {
+    size_t nbSymbols; // including the null symbol
+    size_t nbCarriers;
+    size_t spacing;
+};
+
+static ofdm_params_t ofdm_params(unsigned mode)
+{
+    // The DabModulator also uses mode I for mode 0
+    switch (mode) {
+        case 0:
+        case 1: return {1 + 76, 1536, 2048};
+        case 2: return {1 + 76, 384, 512};
+        case 3: return {1 + 153, 192, 256};
+        case 4: return {1 + 76, 768, 1024};
+    }
+    throw std::runtime_error("FFTEngineSelector: invalid mode");
+}
+
+/* Median duration of the benchmarked frames, in microseconds */
+static double time_frames(const function<void()>& process_frame)
+{
+    for (size_t i = 0; i < warmup_frames; i++) {
+        process_frame();
+    }
+
+    vector<double> durations;
+    for (size_t i = 0; i < benchmark_frames; i++) {
+        const auto start = chrono::steady_clock::now();
+        process_frame();
+        durations.push_back(chrono::duration<double, std::micro>(
+                    chrono::steady_clock::now() - start).count());
+    }
+    nth_element(durations.begin(), durations.begin() + durations.size() / 2,
+            durations.end());
+    return durations[durations.size() / 2];
+}
+
+/* SNR of the interleaved (re, im) samples against the reference, once
+ * their scale and phase have been matched by least squares */
+template<typename T>
+static double snr_db(const complexf *ref, const T *samples, size_t n)
+{
+    complex<double> cross = 0;
+    double power = 0;
+    for (size_t i = 0; i < n; i++) {
+        const complex<double> x(samples[2 * i], samples[2 * i + 1]);
+        cross += conj(x) * complex<double>(ref[i]);
+        power += norm(x);
+    }
+    if (power == 0) {
+        return 0;
+    }
+
+    const complex<double> gain = cross / power;
+    double ref_power = 0;
+    double error = 0;
+    for (size_t i = 0; i < n; i++) {
+        const complex<double> x(samples[2 * i], samples[2 * i + 1]);
+        ref_power += norm(complex<double>(ref[i]));
+        error += norm(complex<double>(ref[i]) - gain * x);
+    }
+    return error == 0 ? HUGE_VAL : 10.0 * log10(ref_power / error);
+}
+
+std::string FFTEngineSelector::fixed_point_restriction(const mod_settings_t& s)
+{
+    // The same features the DabModulator and the outputs refuse for
+    // the fixed-point engines
+    if (s.batchFrames > 1) return "batch_frames";
+    if (not s.preemphasisFilename.empty()) return "the pre-emphasis";
+    if (s.txChannels.size() > 1) return "several TX channels";
+    if (not s.memoryPolyCoefFilename.empty()) return "the memory polynomial";
+    if (s.enablePeakCancel) return "the peak cancellation";
+    if (not s.fdmEnsembles.empty()) return "frequency multiplexing";
+    if (s.frequencyShift) return "the frequency shift";
+    if (s.enableRtBudget) return "the real-time budget";
+
+    // The fixed-point engines would change the format of these outputs
+    if (s.useFileOutput and s.fileOutputFormat != "s16") {
+        return "the file output format " + s.fileOutputFormat;
+    }
+    if (s.useVita49Output and s.vita49OutputFormat != "s16") {
+        return "the vita49 output format " + s.vita49OutputFormat;
+    }
+    if (s.useSoapyOutput or s.useLimeOutput or s.useBladeRFOutput or
+            s.useZeroMQOutput or s.useSimulatedOutput) {
+        return "the output";
+    }
+    return "";
+}
+
+void FFTEngineSelector::select(mod_settings_t& s)
+{
+    const auto p = ofdm_params(s.dabMode);
+    const size_t num_carriers = p.nbSymbols * p.nbCarriers;
+    const size_t num_samples = p.nbSymbols * p.spacing;
+
+    // Random QPSK symbols, and a blank null symbol
+    mt19937 rng(42);
+    uniform_int_distribution<int> bit(0, 1);
+    Buffer carriersCF32(num_carriers * sizeof(complexf));
+    Buffer carriersFixed(num_carriers * sizeof(complexfix));
+    auto *cf32 = reinterpret_cast<complexf*>(carriersCF32.getData());
+    auto *fixed = reinterpret_cast<complexfix*>(carriersFixed.getData());
+    for (size_t i = 0; i < num_carriers; i++) {
+        float re = 0;
+        float im = 0;
+        if (i >= p.nbCarriers) {
+            re = bit(rng) ? M_SQRT1_2 : -M_SQRT1_2;
+            im = bit(rng) ? M_SQRT1_2 : -M_SQRT1_2;
+        }
+        cf32[i] = complexf(re, im);
+        fixed[i] = complexfix(fixed_16((double)re), fixed_16((double)im));
+    }
+
+    // Local copies, the OfdmGeneratorCF32 keeps references to them
+    bool enableCfr = false;
+    float cfrClip = s.cfrClip;
+    float cfrErrorClip = s.cfrErrorClip;
+    size_t cfrIterations = s.cfrIterations;
+    float cfrTargetPapr = s.cfrTargetPapr;
+
+    fft_engine_candidate_t reference;
+    reference.engine = FFTEngine::FFTW;
+    Buffer referenceSamples;
+    {
+        OfdmGeneratorCF32 ofdm(p.nbSymbols, p.nbCarriers, p.spacing,
+                enableCfr, cfrClip, cfrErrorClip, cfrIterations,
+                cfrTargetPapr, true, s.batchedFft, s.ofdmNumThreads,
+                s.ofdmCacheStaticSymbols ? 2 : 0);
+        ofdm.set_cfr_method(s.cfrMethod, s.cfrAceGain);
+        ofdm.process(&carriersCF32, &referenceSamples);
+
+        enableCfr = s.enableCfr;
+        Buffer out;
+        reference.frame_time_us = time_frames(
+                [&]() { ofdm.process(&carriersCF32, &out); });
+        reference.snr_db = INFINITY;
+    }
+    const auto *ref = reinterpret_cast<const complexf*>(
+            referenceSamples.getData());
+
+    vector<fft_engine_candidate_t> candidates({reference});
+
+    const string restriction = fixed_point_restriction(s);
+    auto add_fixed_candidate = [&](FFTEngine engine,
+            const function<shared_ptr<ModCodec>()>& make_ofdm) {
+        fft_engine_candidate_t c;
+        c.engine = engine;
+        if (not restriction.empty()) {
+            c.rejected = "fixed point does not support " + restriction;
+            candidates.push_back(c);
+            return;
+        }
+
+        try {
+            auto ofdm = make_ofdm();
+            shared_ptr<FixedPointCfr> cfr;
+            if (s.enableCfr) {
+                cfr = make_shared<FixedPointCfr>(p.spacing, engine,
+                        s.cfrFixedPointPapr);
+            }
+
+            Buffer out;
+            ofdm->process(&carriersFixed, &out);
+            if (engine == FFTEngine::DEXTER) {
+                c.snr_db = snr_db(ref, reinterpret_cast<const int32_t*>(
+                            out.getData()), num_samples);
+            }
+            else {
+                c.snr_db = snr_db(ref, reinterpret_cast<const int16_t*>(
+                            out.getData()), num_samples);
+            }
+
+            c.frame_time_us = time_frames([&]() {
+                    ofdm->process(&carriersFixed, &out);
+                    if (cfr) {
+                        cfr->process(&out, &out);
+                    }
+                });
+
+            if (c.snr_db < s.fftEngineAutoMinSnr) {
+                stringstream ss;
+                ss << "SNR of " << c.snr_db << " dB";
+                c.rejected = ss.str();
+            }
+        }
+        catch (const std::exception& e) {
+            c.rejected = e.what();
+        }
+        candidates.push_back(c);
+    };
+
+    add_fixed_candidate(FFTEngine::KISS, [&]() {
+            return make_shared<OfdmGeneratorFixed>(
+                    p.nbSymbols, p.nbCarriers, p.spacing); });
+    add_fixed_candidate(FFTEngine::KISS_SIMD, [&]() {
+            return make_shared<OfdmGeneratorFixed>(
+                    p.nbSymbols, p.nbCarriers, p.spacing, true, true); });
+
+    // The FFT accelerator is in the FPGA of the DEXTER
+    if (s.useDexterOutput) {
+#if defined(HAVE_DEXTER)
+        add_fixed_candidate(FFTEngine::DEXTER, [&]() {
+                return make_shared<OfdmGeneratorDEXTER>(
+                        p.nbSymbols, p.nbCarriers, p.spacing); });
+#else
+        fft_engine_candidate_t c;
+        c.engine = FFTEngine::DEXTER;
+        c.rejected = "built without --enable-dexter";
+        candidates.push_back(c);
+#endif
+    }
+
+    const fft_engine_candidate_t *chosen = nullptr;
+    for (const auto& c : candidates) {
+        if (c.rejected.empty() and
+                (not chosen or c.frame_time_us < chosen->frame_time_us)) {
+            chosen = &c;
+        }
+    }
+
+    for (const auto& c : candidates) {
+        stringstream ss;
+        ss << std::fixed << std::setprecision(1);
+        ss << "fft_engine auto: " << RunReport::fft_engine_name(c.engine);
+        if (c.frame_time_us > 0) {
+            ss << " " << c.frame_time_us << " us per frame";
+        }
+        if (c.engine != FFTEngine::FFTW and c.frame_time_us > 0) {
+            ss << ", SNR " << c.snr_db << " dB";
+        }
+        if (not c.rejected.empty()) {
+            ss << ", rejected: " << c.rejected;
+        }
+        etiLog.level(info) << ss.str();
+    }
+    etiLog.level(info) << "fft_engine auto: using " <<
+        RunReport::fft_engine_name(chosen->engine) <<
+        (s.enableCfr ? ", timed with CFR" : "");
+
+    s.fftEngine = chosen->engine;
+    s.fftEngineCandidates = candidates;
+}
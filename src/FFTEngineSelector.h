@@ -0,0 +1,52 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include <string>
+#include "ConfigParser.h"
+
+/* Chooses the FFT engine of fft_engine=auto at startup. Every engine the
+ * build and the configuration allow gets a few frames of random QPSK
+ * symbols, and goes through the OfdmGenerator and, if CFR is enabled,
+ * the CFR it would use in the modulator. The fastest engine whose output
+ * has an SNR of at least fftEngineAutoMinSnr dB against the output of
+ * FFTW is chosen.
+ *
+ * The precision is measured without CFR, because the floating-point and
+ * the fixed-point CFR do not clip the same way. */
+namespace FFTEngineSelector {
+
+/* Empty if the configuration can use the fixed-point engines, otherwise
+ * the feature that needs FFTW */
+std::string fixed_point_restriction(const mod_settings_t& s);
+
+/* Replaces the fftEngine of the settings with the chosen one, and fills
+ * their fftEngineCandidates */
+void select(mod_settings_t& s);
+
+} // namespace FFTEngineSelector
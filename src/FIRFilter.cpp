@@ -30,19 +30,31 @@
  */
 
 #include "FIRFilter.h"
+#include "CpuFeatures.h"
 #include "PcDebug.h"
 #include "Utils.h"
+#include "WorkerPool.h"
 
 #include <stdio.h>
 #include <stdexcept>
 
+#include <algorithm>
 #include <array>
+#include <cmath>
+#include <cstring>
+#include <functional>
 #include <iostream>
 #include <fstream>
+#include <limits>
 #include <memory>
+#include <type_traits>
 
-#ifdef __SSE__
-#    include <xmmintrin.h>
+#include <fftw3.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#    include <immintrin.h>
+#elif defined(__ARM_NEON)
+#    include <arm_neon.h>
 #endif
 
 using namespace std;
@@ -71,16 +83,571 @@ static const std::array<float, 45> default_filter_taps({
         -0.00110450468492});
 
 
-FIRFilter::FIRFilter(std::string& taps_file) :
+/* The taps are real, the convolution can therefore be done on the real and
+ * imaginary parts separately: out[i] = sum_j in[i + 2*j] * taps[j], where
+ * in and out are interleaved complex values.
+ *
+ * The kernels compute the first outputs of the frame for which all taps
+ * are inside the frame, several vectors of outputs at a time so that
+ * the additions do not depend on each other. They return the number of
+ * outputs they computed. The products are added in the same order in all
+ * kernels, which gives the same output as the scalar version.
+ */
+static size_t fir_kernel_scalar(const float *in, float *out, size_t num_out,
+        const float *taps, size_t num_taps)
+{
+    size_t i = 0;
+    for (; i + 4 <= num_out; i += 4) {
+        float acc0 = 0.0f;
+        float acc1 = 0.0f;
+        float acc2 = 0.0f;
+        float acc3 = 0.0f;
+
+        for (size_t j = 0; j < num_taps; j++) {
+            acc0 += in[i   + 2*j] * taps[j];
+            acc1 += in[i+1 + 2*j] * taps[j];
+            acc2 += in[i+2 + 2*j] * taps[j];
+            acc3 += in[i+3 + 2*j] * taps[j];
+        }
+
+        out[i]   = acc0;
+        out[i+1] = acc1;
+        out[i+2] = acc2;
+        out[i+3] = acc3;
+    }
+    return i;
+}
+
+#if defined(__SSE__)
+static size_t fir_kernel_sse(const float *in, float *out, size_t num_out,
+        const float *taps, size_t num_taps)
+{
+    size_t i = 0;
+    for (; i + 16 <= num_out; i += 16) {
+        __m128 acc0 = _mm_setzero_ps();
+        __m128 acc1 = _mm_setzero_ps();
+        __m128 acc2 = _mm_setzero_ps();
+        __m128 acc3 = _mm_setzero_ps();
+
+        for (size_t j = 0; j < num_taps; j++) {
+            const __m128 tap = _mm_set1_ps(taps[j]);
+            const float *x = &in[i + 2*j];
+            acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(x), tap));
+            acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(x + 4), tap));
+            acc2 = _mm_add_ps(acc2, _mm_mul_ps(_mm_loadu_ps(x + 8), tap));
+            acc3 = _mm_add_ps(acc3, _mm_mul_ps(_mm_loadu_ps(x + 12), tap));
+        }
+
+        _mm_storeu_ps(&out[i], acc0);
+        _mm_storeu_ps(&out[i + 4], acc1);
+        _mm_storeu_ps(&out[i + 8], acc2);
+        _mm_storeu_ps(&out[i + 12], acc3);
+    }
+    return i;
+}
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+// These are compiled for AVX and AVX-512 even if the rest of the
+// program isn't, and are only used if the CPU supports them.
+#  define HAVE_FIR_KERNEL_DISPATCH 1
+
+__attribute__((target("avx")))
+static size_t fir_kernel_avx(const float *in, float *out, size_t num_out,
+        const float *taps, size_t num_taps)
+{
+    size_t i = 0;
+    for (; i + 32 <= num_out; i += 32) {
+        __m256 acc0 = _mm256_setzero_ps();
+        __m256 acc1 = _mm256_setzero_ps();
+        __m256 acc2 = _mm256_setzero_ps();
+        __m256 acc3 = _mm256_setzero_ps();
+
+        for (size_t j = 0; j < num_taps; j++) {
+            const __m256 tap = _mm256_set1_ps(taps[j]);
+            const float *x = &in[i + 2*j];
+            acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(x), tap));
+            acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_loadu_ps(x + 8), tap));
+            acc2 = _mm256_add_ps(acc2, _mm256_mul_ps(_mm256_loadu_ps(x + 16), tap));
+            acc3 = _mm256_add_ps(acc3, _mm256_mul_ps(_mm256_loadu_ps(x + 24), tap));
+        }
+
+        _mm256_storeu_ps(&out[i], acc0);
+        _mm256_storeu_ps(&out[i + 8], acc1);
+        _mm256_storeu_ps(&out[i + 16], acc2);
+        _mm256_storeu_ps(&out[i + 24], acc3);
+    }
+    return i;
+}
+
+// AVX-512F includes FMA, which GCC would fuse the multiplication and
+// addition into, unlike the other kernels
+#if defined(__clang__)
+__attribute__((target("avx512f")))
+#else
+__attribute__((target("avx512f"), optimize("fp-contract=off")))
+#endif
+static size_t fir_kernel_avx512(const float *in, float *out, size_t num_out,
+        const float *taps, size_t num_taps)
+{
+    size_t i = 0;
+    for (; i + 64 <= num_out; i += 64) {
+        __m512 acc0 = _mm512_setzero_ps();
+        __m512 acc1 = _mm512_setzero_ps();
+        __m512 acc2 = _mm512_setzero_ps();
+        __m512 acc3 = _mm512_setzero_ps();
+
+        for (size_t j = 0; j < num_taps; j++) {
+            const __m512 tap = _mm512_set1_ps(taps[j]);
+            const float *x = &in[i + 2*j];
+            acc0 = _mm512_add_ps(acc0, _mm512_mul_ps(_mm512_loadu_ps(x), tap));
+            acc1 = _mm512_add_ps(acc1, _mm512_mul_ps(_mm512_loadu_ps(x + 16), tap));
+            acc2 = _mm512_add_ps(acc2, _mm512_mul_ps(_mm512_loadu_ps(x + 32), tap));
+            acc3 = _mm512_add_ps(acc3, _mm512_mul_ps(_mm512_loadu_ps(x + 48), tap));
+        }
+
+        _mm512_storeu_ps(&out[i], acc0);
+        _mm512_storeu_ps(&out[i + 16], acc1);
+        _mm512_storeu_ps(&out[i + 32], acc2);
+        _mm512_storeu_ps(&out[i + 48], acc3);
+    }
+    return i;
+}
+#endif
+
+#if defined(__ARM_NEON)
+static size_t fir_kernel_neon(const float *in, float *out, size_t num_out,
+        const float *taps, size_t num_taps)
+{
+    size_t i = 0;
+    for (; i + 16 <= num_out; i += 16) {
+        float32x4_t acc0 = vdupq_n_f32(0.0f);
+        float32x4_t acc1 = vdupq_n_f32(0.0f);
+        float32x4_t acc2 = vdupq_n_f32(0.0f);
+        float32x4_t acc3 = vdupq_n_f32(0.0f);
+
+        for (size_t j = 0; j < num_taps; j++) {
+            const float32x4_t tap = vdupq_n_f32(taps[j]);
+            const float *x = &in[i + 2*j];
+            acc0 = vaddq_f32(acc0, vmulq_f32(vld1q_f32(x), tap));
+            acc1 = vaddq_f32(acc1, vmulq_f32(vld1q_f32(x + 4), tap));
+            acc2 = vaddq_f32(acc2, vmulq_f32(vld1q_f32(x + 8), tap));
+            acc3 = vaddq_f32(acc3, vmulq_f32(vld1q_f32(x + 12), tap));
+        }
+
+        vst1q_f32(&out[i], acc0);
+        vst1q_f32(&out[i + 4], acc1);
+        vst1q_f32(&out[i + 8], acc2);
+        vst1q_f32(&out[i + 12], acc3);
+    }
+    return i;
+}
+#endif
+
+static FIRFilter::kernel_t select_fir_kernel(std::string& kernel_name)
+{
+    auto& cpu = cpu_features();
+    FIRFilter::kernel_t kernel = fir_kernel_scalar;
+    kernel_name = "scalar";
+#if defined(HAVE_FIR_KERNEL_DISPATCH)
+    if (cpu.supports(cpu_feature_e::avx512f)) {
+        kernel_name = "AVX-512";
+        kernel = fir_kernel_avx512;
+    }
+    else if (cpu.supports(cpu_feature_e::avx)) {
+        kernel_name = "AVX";
+        kernel = fir_kernel_avx;
+    }
+    else
+#endif
+#if defined(__SSE__)
+    if (cpu.supports(cpu_feature_e::sse2)) {
+        kernel_name = "SSE";
+        kernel = fir_kernel_sse;
+    }
+#elif defined(__ARM_NEON)
+    if (cpu.supports(cpu_feature_e::neon)) {
+        kernel_name = "NEON";
+        kernel = fir_kernel_neon;
+    }
+#endif
+    cpu.register_kernel("FIRFilter", kernel_name);
+    return kernel;
+}
+
+/* The fixed-point filters compute the same convolution on the raw values
+ * of complexfix (int16_t) or complexfix_wide (int32_t) samples, with taps
+ * that are the raw values of complexfix, which have 14 fractional bits.
+ * The products are summed exactly, and the sum is rounded half up and
+ * saturated once at the end, like the NEON vqrshrn instructions do.
+ *
+ * For complexfix, the sum fits into 32 bits because the sum of the
+ * magnitudes of the raw taps is limited to fir_fix_max_abs_sum, see
+ * load_filter_taps(). All kernels therefore give the same output. */
+static constexpr int fir_fix_shift = 14;
+static constexpr int64_t fir_fix_max_abs_sum = 65535;
+
+template <typename T>
+static T fir_fix_round(int64_t acc)
+{
+    acc = (acc + (1 << (fir_fix_shift - 1))) >> fir_fix_shift;
+    return static_cast<T>(std::clamp<int64_t>(acc,
+                std::numeric_limits<T>::min(), std::numeric_limits<T>::max()));
+}
+
+/* Computes the outputs from start on for which all taps are inside the
+ * frame, or until num_out, and returns how many it computed. */
+static size_t fir_fix16_kernel(const int16_t *in, int16_t *out,
+        size_t num_out, const int16_t *taps, size_t num_taps)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    // Two taps at a time: the samples for both taps are interleaved, and
+    // madd multiplies each pair with the pair of taps and adds them.
+    for (; i + 16 <= num_out; i += 16) {
+        __m128i acc0 = _mm_setzero_si128();
+        __m128i acc1 = _mm_setzero_si128();
+        __m128i acc2 = _mm_setzero_si128();
+        __m128i acc3 = _mm_setzero_si128();
+
+        size_t j = 0;
+        for (; j + 2 <= num_taps; j += 2) {
+            const int16_t *x = &in[i + 2*j];
+            const __m128i tap = _mm_set1_epi32(
+                    (uint16_t)taps[j] | ((uint32_t)(uint16_t)taps[j+1] << 16));
+            const __m128i x0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x));
+            const __m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + 2));
+            const __m128i x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + 8));
+            const __m128i x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + 10));
+            acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_unpacklo_epi16(x0, x1), tap));
+            acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_unpackhi_epi16(x0, x1), tap));
+            acc2 = _mm_add_epi32(acc2, _mm_madd_epi16(_mm_unpacklo_epi16(x2, x3), tap));
+            acc3 = _mm_add_epi32(acc3, _mm_madd_epi16(_mm_unpackhi_epi16(x2, x3), tap));
+        }
+        if (j < num_taps) {
+            const int16_t *x = &in[i + 2*j];
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i tap = _mm_set1_epi32((uint16_t)taps[j]);
+            const __m128i x0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x));
+            const __m128i x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + 8));
+            acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_unpacklo_epi16(x0, zero), tap));
+            acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_unpackhi_epi16(x0, zero), tap));
+            acc2 = _mm_add_epi32(acc2, _mm_madd_epi16(_mm_unpacklo_epi16(x2, zero), tap));
+            acc3 = _mm_add_epi32(acc3, _mm_madd_epi16(_mm_unpackhi_epi16(x2, zero), tap));
+        }
+
+        const __m128i round = _mm_set1_epi32(1 << (fir_fix_shift - 1));
+        acc0 = _mm_srai_epi32(_mm_add_epi32(acc0, round), fir_fix_shift);
+        acc1 = _mm_srai_epi32(_mm_add_epi32(acc1, round), fir_fix_shift);
+        acc2 = _mm_srai_epi32(_mm_add_epi32(acc2, round), fir_fix_shift);
+        acc3 = _mm_srai_epi32(_mm_add_epi32(acc3, round), fir_fix_shift);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&out[i]),
+                _mm_packs_epi32(acc0, acc1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&out[i + 8]),
+                _mm_packs_epi32(acc2, acc3));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 16 <= num_out; i += 16) {
+        int32x4_t acc0 = vdupq_n_s32(0);
+        int32x4_t acc1 = vdupq_n_s32(0);
+        int32x4_t acc2 = vdupq_n_s32(0);
+        int32x4_t acc3 = vdupq_n_s32(0);
+
+        for (size_t j = 0; j < num_taps; j++) {
+            const int16x8_t x0 = vld1q_s16(&in[i + 2*j]);
+            const int16x8_t x1 = vld1q_s16(&in[i + 2*j + 8]);
+            acc0 = vmlal_n_s16(acc0, vget_low_s16(x0), taps[j]);
+            acc1 = vmlal_n_s16(acc1, vget_high_s16(x0), taps[j]);
+            acc2 = vmlal_n_s16(acc2, vget_low_s16(x1), taps[j]);
+            acc3 = vmlal_n_s16(acc3, vget_high_s16(x1), taps[j]);
+        }
+
+        vst1q_s16(&out[i], vcombine_s16(
+                    vqrshrn_n_s32(acc0, fir_fix_shift),
+                    vqrshrn_n_s32(acc1, fir_fix_shift)));
+        vst1q_s16(&out[i + 8], vcombine_s16(
+                    vqrshrn_n_s32(acc2, fir_fix_shift),
+                    vqrshrn_n_s32(acc3, fir_fix_shift)));
+    }
+#endif
+
+    for (; i < num_out; i++) {
+        int32_t acc = 0;
+        for (size_t j = 0; j < num_taps; j++) {
+            acc += (int32_t)in[i + 2*j] * taps[j];
+        }
+        out[i] = fir_fix_round<int16_t>(acc);
+    }
+    return i;
+}
+
+static size_t fir_fix32_kernel(const int32_t *in, int32_t *out,
+        size_t num_out, const int16_t *taps, size_t num_taps)
+{
+    size_t i = 0;
+#if defined(__ARM_NEON)
+    for (; i + 4 <= num_out; i += 4) {
+        int64x2_t acc0 = vdupq_n_s64(0);
+        int64x2_t acc1 = vdupq_n_s64(0);
+
+        for (size_t j = 0; j < num_taps; j++) {
+            const int32x4_t x = vld1q_s32(&in[i + 2*j]);
+            acc0 = vmlal_n_s32(acc0, vget_low_s32(x), taps[j]);
+            acc1 = vmlal_n_s32(acc1, vget_high_s32(x), taps[j]);
+        }
+
+        vst1q_s32(&out[i], vcombine_s32(
+                    vqrshrn_n_s64(acc0, fir_fix_shift),
+                    vqrshrn_n_s64(acc1, fir_fix_shift)));
+    }
+#endif
+
+    for (; i < num_out; i++) {
+        int64_t acc = 0;
+        for (size_t j = 0; j < num_taps; j++) {
+            acc += (int64_t)in[i + 2*j] * taps[j];
+        }
+        out[i] = fir_fix_round<int32_t>(acc);
+    }
+    return i;
+}
+
+/* The frame gets filtered in parts of at least this many values, which
+ * the WorkerPool threads compute side by side. Every part reads 2 *
+ * (num_taps - 1) values of input after its end, and each output is
+ * computed in the same way whatever part it is in. */
+static constexpr size_t fir_min_part_size = 4096;
+
+static size_t fir_num_parts(size_t sizeIn, size_t max_parts)
+{
+    return std::max<size_t>(1, std::min(max_parts, sizeIn / fir_min_part_size));
+}
+
+// The outputs [start, stop) of the frame of sizeIn values
+template <typename T>
+static void fir_fix_process(const T *in, T *out, size_t sizeIn,
+        size_t start, size_t stop, const std::vector<int16_t>& taps)
+{
+    const size_t num_taps = taps.size();
+
+    // The outputs for which all taps are inside the frame
+    const size_t num_full = (sizeIn >= 2*num_taps) ?
+        sizeIn - 2*(num_taps - 1) : 0;
+    size_t i = start;
+    if (start < num_full) {
+        const size_t n = std::min(stop, num_full) - start;
+        if constexpr (std::is_same_v<T, int16_t>) {
+            i += fir_fix16_kernel(in + start, out + start, n, taps.data(), num_taps);
+        }
+        else {
+            i += fir_fix32_kernel(in + start, out + start, n, taps.data(), num_taps);
+        }
+    }
+
+    // Cut off at the end of the frame, like the floating-point filter
+    for (; i < stop; i++) {
+        int64_t acc = 0;
+        for (size_t j = 0; j < num_taps and i+2*j < sizeIn; j++) {
+            acc += (int64_t)in[i+2*j] * taps[j];
+        }
+        out[i] = fir_fix_round<T>(acc);
+    }
+}
+
+// The same with the floating-point kernel
+static void fir_process(FIRFilter::kernel_t kernel, const float *in,
+        float *out, size_t sizeIn, size_t start, size_t stop,
+        const std::vector<float>& taps)
+{
+    const size_t num_taps = taps.size();
+
+    // The outputs for which all taps are inside the frame
+    const size_t num_full = (sizeIn >= 2*num_taps) ?
+        sizeIn - 2*(num_taps - 1) : 0;
+    size_t i = start;
+    if (start < num_full) {
+        i += kernel(in + start, out + start, std::min(stop, num_full) - start,
+                taps.data(), num_taps);
+    }
+
+    // At the end of the frame, we cut the convolution off.
+    // The beginning of the next frame starts with a NULL symbol
+    // anyway.
+    for (; i < stop; i++) {
+        out[i] = 0.0;
+        for (size_t j = 0; j < num_taps and i+2*j < sizeIn; j++) {
+            out[i] += in[i+2*j] * taps[j];
+        }
+    }
+}
+
+
+/* The FFT size for the overlap-save convolution: a power of two at least
+ * twice the number of taps, with the lowest FFT cost per output sample.
+ * Each FFT of size n gives n - num_taps + 1 output samples. Below 256,
+ * the overhead of the FFT calls dominates. */
+static size_t fft_convolution_size(size_t num_taps)
+{
+    size_t n = 256;
+    while (n < 2 * num_taps) {
+        n <<= 1;
+    }
+
+    size_t best_n = n;
+    double best_cost = 0.0;
+    for (; n <= std::max<size_t>(64 * num_taps, 256) and n <= (1 << 20); n <<= 1) {
+        const double cost = n * std::log2(n) / (n - num_taps + 1);
+        if (best_cost == 0.0 or cost < best_cost) {
+            best_cost = cost;
+            best_n = n;
+        }
+    }
+    return best_n;
+}
+
+struct FIRFilter::fft_convolution_t {
+    fft_convolution_t(const std::vector<float>& taps, unsigned fft_threads);
+    ~fft_convolution_t();
+
+    // Gives the same output as the direct form, up to rounding
+    void convolve(const complexf *in, complexf *out, size_t num_samples);
+
+    size_t fft_size;
+    // The number of output samples every FFT gives
+    size_t block_size;
+
+    fftwf_complex *time_buf = nullptr;
+    fftwf_complex *freq_buf = nullptr;
+    fftwf_plan forward_plan = nullptr;
+    fftwf_plan backward_plan = nullptr;
+
+    // The conjugate of the spectrum of the taps, scaled by 1/fft_size
+    std::vector<float> spectrum;
+};
+
+FIRFilter::fft_convolution_t::fft_convolution_t(const std::vector<float>& taps,
+        unsigned fft_threads) :
+    fft_size(fft_convolution_size(taps.size())),
+    block_size(fft_size - taps.size() + 1)
+{
+    {
+        std::lock_guard<std::mutex> lock(fftw_planner_mutex);
+        const unsigned plan_flags = prepare_fftw_planner(fft_threads);
+
+        time_buf = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * fft_size);
+        freq_buf = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * fft_size);
+        forward_plan = fftwf_plan_dft_1d(fft_size, time_buf, freq_buf,
+                FFTW_FORWARD, plan_flags);
+        backward_plan = fftwf_plan_dft_1d(fft_size, freq_buf, time_buf,
+                FFTW_BACKWARD, plan_flags);
+
+        save_fftw_wisdom();
+    }
+
+    // The planner can overwrite the buffers, fill them afterwards
+    memset(time_buf, 0, sizeof(fftwf_complex) * fft_size);
+    for (size_t i = 0; i < taps.size(); i++) {
+        time_buf[i][0] = taps[i];
+    }
+    fftwf_execute(forward_plan);
+
+    spectrum.resize(2 * fft_size);
+    const float scale = 1.0f / fft_size;
+    for (size_t k = 0; k < fft_size; k++) {
+        spectrum[2*k]   =  freq_buf[k][0] * scale;
+        spectrum[2*k+1] = -freq_buf[k][1] * scale;
+    }
+}
+
+FIRFilter::fft_convolution_t::~fft_convolution_t()
+{
+    std::lock_guard<std::mutex> lock(fftw_planner_mutex);
+    fftwf_destroy_plan(forward_plan);
+    fftwf_destroy_plan(backward_plan);
+    fftwf_free(time_buf);
+    fftwf_free(freq_buf);
+}
+
+void FIRFilter::fft_convolution_t::convolve(
+        const complexf *in, complexf *out, size_t num_samples)
+{
+    /* Overlap-save: the circular correlation of fft_size input samples with
+     * the taps, computed by multiplying the spectrum of the samples with the
+     * conjugate spectrum of the taps, is equal to the linear one for the
+     * first block_size outputs. Samples after the end of the frame are zero,
+     * which cuts the convolution off like in the direct form.
+     */
+    float *freq = reinterpret_cast<float*>(freq_buf);
+    const float *h = spectrum.data();
+
+    for (size_t start = 0; start < num_samples; start += block_size) {
+        const size_t num_in = std::min(fft_size, num_samples - start);
+        memcpy(time_buf, in + start, num_in * sizeof(complexf));
+        memset(time_buf + num_in, 0, (fft_size - num_in) * sizeof(complexf));
+
+        fftwf_execute(forward_plan);
+
+        for (size_t k = 0; k < 2 * fft_size; k += 2) {
+            const float re = freq[k] * h[k] - freq[k+1] * h[k+1];
+            const float im = freq[k] * h[k+1] + freq[k+1] * h[k];
+            freq[k] = re;
+            freq[k+1] = im;
+        }
+
+        fftwf_execute(backward_plan);
+
+        const size_t num_out = std::min(block_size, num_samples - start);
+        const complexf *result = reinterpret_cast<const complexf*>(time_buf);
+        std::copy(result, result + num_out, out + start);
+    }
+}
+
+FIRFilter::filter_t::filter_t(std::vector<float>&& filter_taps,
+        size_t fft_min_taps, unsigned fft_threads) :
+    taps(std::move(filter_taps))
+{
+    if (fft_min_taps > 0 and taps.size() >= fft_min_taps) {
+        fft_convolution = std::make_unique<fft_convolution_t>(taps, fft_threads);
+        etiLog.level(debug) << "FIRFilter: using FFT convolution of size " <<
+            fft_convolution->fft_size << " for " << taps.size() << " taps";
+    }
+}
+
+// Defined here, where fft_convolution_t is complete
+FIRFilter::filter_t::~filter_t() = default;
+
+FIRFilter::FIRFilter(std::string& taps_file, size_t fft_min_taps,
+        FFTEngine fftEngine, unsigned fft_threads, unsigned num_threads) :
     PipelinedModCodec(),
     RemoteControllable("firfilter"),
-    m_taps_file(taps_file)
+    m_taps_file(taps_file),
+    m_fft_min_taps(fftEngine == FFTEngine::FFTW ? fft_min_taps : 0),
+    m_fftEngine(fftEngine),
+    m_fft_threads(fft_threads)
 {
-    PDEBUG("FIRFilter::FIRFilter(%s) @ %p\n",
-            taps_file.c_str(), this);
+    PDEBUG("FIRFilter::FIRFilter(%s, %zu) @ %p\n",
+            taps_file.c_str(), fft_min_taps, this);
 
     RC_ADD_PARAMETER(ntaps, "(Read-only) number of filter taps.");
     RC_ADD_PARAMETER(tapsfile, "Filename containing filter taps. When written to, the new file gets automatically loaded.");
+    add_pipeline_parameters(m_parameters);
+    add_bypass_parameter(m_parameters);
+
+    std::string kernel_name;
+    m_kernel = select_fir_kernel(kernel_name);
+    etiLog.level(debug) << "FIRFilter: using the " << kernel_name << " kernel";
+
+    if (num_threads == 0) {
+        m_num_parts = WorkerPool::shared().num_threads() + 1;
+    }
+    else {
+        m_num_parts = num_threads + 1;
+    }
+    if (m_num_parts > 1) {
+        etiLog.level(info) << "FIRFilter will process frames on " <<
+            m_num_parts.load() << " threads" <<
+            (num_threads == 0 ? " (auto detected)" : " (set in config file)");
+    }
 
     load_filter_taps(m_taps_file);
 
@@ -92,7 +659,7 @@ FIRFilter::~FIRFilter()
     stop_pipeline_thread();
 }
 
-void FIRFilter::load_filter_taps(const std::string &tapsFile)
+std::vector<float> FIRFilter::read_filter_taps(const std::string &tapsFile)
 {
     std::vector<float> filter_taps;
     if (tapsFile == "default") {
@@ -111,10 +678,6 @@ void FIRFilter::load_filter_taps(const std::string &tapsFile)
             throw std::runtime_error("FIRFilter: taps file has invalid format.");
         }
 
-        if (n_taps > 100) {
-            etiLog.level(warn) << "FIRFilter: warning: taps file has more than 100 taps";
-        }
-
         etiLog.level(debug) << "FIRFilter: Reading " << n_taps << " taps...";
 
         filter_taps.resize(n_taps);
@@ -133,99 +696,108 @@ void FIRFilter::load_filter_taps(const std::string &tapsFile)
         }
     }
 
-    {
-        std::lock_guard<std::mutex> lock(m_taps_mutex);
-
-        m_taps = filter_taps;
-    }
+    return filter_taps;
 }
 
-
-int FIRFilter::internal_process(Buffer* const dataIn, Buffer* dataOut)
+void FIRFilter::load_filter_taps(const std::string &tapsFile)
 {
-        size_t i;
-
-#if __SSE__
-        // The SSE accelerated version cannot work on the complex values,
-        // it is necessary to do the convolution on the real and imaginary
-        // parts separately. Thankfully, the taps are real, simplifying the
-        // procedure.
+    std::vector<float> filter_taps = read_filter_taps(tapsFile);
 
-        const float* in = reinterpret_cast<const float*>(dataIn->getData());
-        float* out      = reinterpret_cast<float*>(dataOut->getData());
-        size_t sizeIn   = dataIn->getLength() / sizeof(float);
+    if (filter_taps.size() > 100 and (m_fft_min_taps == 0 or
+                filter_taps.size() < m_fft_min_taps)) {
+        etiLog.level(warn) << "FIRFilter: warning: taps file has more than 100 taps";
+    }
 
-        if ((uintptr_t)(&out[0]) % 16 != 0) {
-            throw std::runtime_error("FIRFilterWorker: out not aligned");
+    std::vector<int16_t> taps_fix;
+    if (m_fftEngine != FFTEngine::FFTW) {
+        int64_t abs_sum = 0;
+        for (const float tap : filter_taps) {
+            const long raw = lrint(tap * (1 << fir_fix_shift));
+            abs_sum += std::abs(raw);
+            if (raw < std::numeric_limits<int16_t>::min() or
+                    raw > std::numeric_limits<int16_t>::max() or
+                    abs_sum > fir_fix_max_abs_sum) {
+                throw std::runtime_error("FIRFilter: the sum of the "
+                        "magnitudes of the taps must be below 4 for the "
+                        "fixed-point filter");
+            }
+            taps_fix.push_back(raw);
         }
+    }
 
-        __m128 SSEout;
-        __m128 SSEtaps;
-        __m128 SSEin;
-        {
-            std::lock_guard<std::mutex> lock(m_taps_mutex);
-
-            for (i = 0; i < sizeIn - 2*m_taps.size(); i += 4) {
-                SSEout = _mm_setr_ps(0,0,0,0);
+    auto filter = std::make_shared<filter_t>(
+            std::move(filter_taps), m_fft_min_taps, m_fft_threads);
+    filter->taps_fix = std::move(taps_fix);
 
-                for (size_t j = 0; j < m_taps.size(); j++) {
-                    if ((uintptr_t)(&in[i+2*j]) % 16 == 0) {
-                        SSEin = _mm_load_ps(&in[i+2*j]); //faster when aligned
-                    }
-                    else {
-                        SSEin = _mm_loadu_ps(&in[i+2*j]);
-                    }
+    std::lock_guard<std::mutex> lock(m_reload_mutex);
+    m_previous_filter = std::atomic_exchange(&m_filter, filter);
+}
 
-                    SSEtaps = _mm_load1_ps(&m_taps[j]);
 
-                    SSEout = _mm_add_ps(SSEout, _mm_mul_ps(SSEin, SSEtaps));
-                }
-                _mm_store_ps(&out[i], SSEout);
+int FIRFilter::internal_process(Buffer* const dataIn, Buffer* dataOut)
+{
+        // Splits the sizeIn outputs into parts for the WorkerPool
+        auto process_parts = [&](size_t sizeIn,
+                const std::function<void(size_t, size_t)>& process_part) {
+            const size_t num_parts = fir_num_parts(sizeIn, m_num_parts.load());
+            if (num_parts == 1) {
+                process_part(0, sizeIn);
+                return;
             }
 
-            for (; i < sizeIn; i++) {
-                out[i] = 0.0;
-                for (int j = 0; i+2*j < sizeIn; j++) {
-                    out[i] += in[i+2*j] * m_taps[j];
-                }
+            // Multiples of 16 values, which the kernels compute at a time
+            const size_t part_size = ((sizeIn + num_parts - 1) / num_parts + 15) & ~(size_t)15;
+            WorkerPool::shared().parallel_for(num_parts, [&](size_t part) {
+                    const size_t start = std::min(part * part_size, sizeIn);
+                    process_part(start, std::min(start + part_size, sizeIn));
+                });
+        };
+
+        if (m_fftEngine != FFTEngine::FFTW) {
+            const auto filter = std::atomic_load(&m_filter);
+
+            if (m_fftEngine == FFTEngine::DEXTER) {
+                const auto *in = reinterpret_cast<const int32_t*>(dataIn->getData());
+                auto *out = reinterpret_cast<int32_t*>(dataOut->getData());
+                const size_t sizeIn = dataIn->getLength() / sizeof(int32_t);
+                process_parts(sizeIn, [&](size_t start, size_t stop) {
+                        fir_fix_process(in, out, sizeIn, start, stop,
+                                filter->taps_fix);
+                    });
+            }
+            else {
+                const auto *in = reinterpret_cast<const int16_t*>(dataIn->getData());
+                auto *out = reinterpret_cast<int16_t*>(dataOut->getData());
+                const size_t sizeIn = dataIn->getLength() / sizeof(int16_t);
+                process_parts(sizeIn, [&](size_t start, size_t stop) {
+                        fir_fix_process(in, out, sizeIn, start, stop,
+                                filter->taps_fix);
+                    });
             }
+            return dataOut->getLength();
         }
 
-#else
-        // No SSE ? Loop unrolling should make this faster. As for the SSE,
-        // the real and imaginary parts are calculated separately.
         const float* in = reinterpret_cast<const float*>(dataIn->getData());
         float* out      = reinterpret_cast<float*>(dataOut->getData());
         size_t sizeIn   = dataIn->getLength() / sizeof(float);
 
         {
-            std::lock_guard<std::mutex> lock(m_taps_mutex);
-            // Convolve by aligning both frame and taps at zero.
-            for (i = 0; i < sizeIn - 2*m_taps.size(); i += 4) {
-                out[i]    = 0.0;
-                out[i+1]  = 0.0;
-                out[i+2]  = 0.0;
-                out[i+3]  = 0.0;
-
-                for (size_t j = 0; j < m_taps.size(); j++) {
-                    out[i]   += in[i   + 2*j] * m_taps[j];
-                    out[i+1] += in[i+1 + 2*j] * m_taps[j];
-                    out[i+2] += in[i+2 + 2*j] * m_taps[j];
-                    out[i+3] += in[i+3 + 2*j] * m_taps[j];
-                }
+            // A reload only replaces m_filter, this frame keeps the filter
+            // it started with.
+            const auto filter = std::atomic_load(&m_filter);
+
+            if (filter->fft_convolution) {
+                filter->fft_convolution->convolve(
+                        reinterpret_cast<const complexf*>(in),
+                        reinterpret_cast<complexf*>(out), sizeIn / 2);
+                return dataOut->getLength();
             }
 
-            // At the end of the frame, we cut the convolution off.
-            // The beginning of the next frame starts with a NULL symbol
-            // anyway.
-            for (; i < sizeIn; i++) {
-                out[i] = 0.0;
-                for (int j = 0; i+2*j < sizeIn; j++) {
-                    out[i] += in[i+2*j] * m_taps[j];
-                }
-            }
+            process_parts(sizeIn, [&](size_t start, size_t stop) {
+                    fir_process(m_kernel, in, out, sizeIn, start, stop,
+                            filter->taps);
+                });
         }
-#endif
 
         // The following implementations are for debugging only.
 #if 0
@@ -234,7 +806,8 @@ int FIRFilter::internal_process(Buffer* const dataIn, Buffer* dataOut)
         float* out      = reinterpret_cast<float*>(dataOut->getData());
         size_t sizeIn   = dataIn->getLength() / sizeof(float);
 
-        std::lock_guard<std::mutex> lock(m_taps_mutex);
+        const auto filter = std::atomic_load(&m_filter);
+        const std::vector<float>& m_taps = filter->taps;
 
         for (i = 0; i < sizeIn - 2*m_taps.size(); i += 1) {
             out[i]  = 0.0;
@@ -258,7 +831,8 @@ int FIRFilter::internal_process(Buffer* const dataIn, Buffer* dataOut)
         complexf* out      = reinterpret_cast<complexf*>(dataOut->getData());
         size_t sizeIn      = dataIn->getLength() / sizeof(complexf);
 
-        std::lock_guard<std::mutex> lock(m_taps_mutex);
+        const auto filter = std::atomic_load(&m_filter);
+        const std::vector<float>& m_taps = filter->taps;
 
         for (i = 0; i < sizeIn - m_taps.size(); i += 4) {
             out[i]   = 0.0;
@@ -287,7 +861,8 @@ int FIRFilter::internal_process(Buffer* const dataIn, Buffer* dataOut)
         complexf* out      = reinterpret_cast<complexf*>(dataOut->getData());
         size_t sizeIn      = dataIn->getLength() / sizeof(complexf);
 
-        std::lock_guard<std::mutex> lock(m_taps_mutex);
+        const auto filter = std::atomic_load(&m_filter);
+        const std::vector<float>& m_taps = filter->taps;
 
         for (i = 0; i < sizeIn - m_taps.size(); i += 1) {
             out[i]   = 0.0;
@@ -310,6 +885,10 @@ int FIRFilter::internal_process(Buffer* const dataIn, Buffer* dataOut)
 
 void FIRFilter::set_parameter(const string& parameter, const string& value)
 {
+    if (set_pipeline_parameter(parameter, value)) {
+        return;
+    }
+
     if (parameter == "ntaps") {
         throw ParameterError("Parameter 'ntaps' is read-only");
     }
@@ -332,9 +911,14 @@ void FIRFilter::set_parameter(const string& parameter, const string& value)
 
 const string FIRFilter::get_parameter(const string& parameter) const
 {
+    string pipeline_value;
+    if (get_pipeline_parameter(parameter, pipeline_value)) {
+        return pipeline_value;
+    }
+
     stringstream ss;
     if (parameter == "ntaps") {
-        ss << m_taps.size();
+        ss << std::atomic_load(&m_filter)->taps.size();
     }
     else if (parameter == "tapsfile") {
         ss << m_taps_file;
@@ -350,7 +934,8 @@ const string FIRFilter::get_parameter(const string& parameter) const
 const json::map_t FIRFilter::get_all_values() const
 {
     json::map_t map;
-    map["ntaps"].v = m_taps.size();
+    map["ntaps"].v = std::atomic_load(&m_filter)->taps.size();
     map["tapsfile"].v = m_taps_file;
+    get_pipeline_values(map);
     return map;
 }
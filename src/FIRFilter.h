@@ -31,10 +31,15 @@
 #endif
 
 
+#include "ConfigParser.h"
 #include "RemoteControl.h"
 #include "ModPlugin.h"
 
 #include <sys/types.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <cstdio>
 #include <string>
@@ -44,25 +49,99 @@
 class FIRFilter : public PipelinedModCodec, public RemoteControllable
 {
 public:
-    FIRFilter(std::string& taps_file);
+    /* Filters with at least fft_min_taps taps are applied with FFT
+     * overlap-save convolution instead of the direct form. 0 always uses
+     * the direct form.
+     *
+     * With the fixed-point FFT engines, the samples are complexfix or
+     * complexfix_wide, and the filter is computed in integer arithmetic
+     * with the taps rounded to the format of complexfix. It always uses the
+     * direct form.
+     *
+     * fft_threads is the number of threads with which FFTW computes the
+     * FFTs of the convolution. More than 1 needs FFTW threads support.
+     *
+     * The direct form splits the frames into parts for num_threads
+     * threads of the shared WorkerPool and the pipeline thread, like
+     * the MemlessPoly. 0 uses all threads of the WorkerPool. */
+    FIRFilter(std::string& taps_file, size_t fft_min_taps = 0,
+            FFTEngine fftEngine = FFTEngine::FFTW, unsigned fft_threads = 1,
+            unsigned num_threads = 0);
     FIRFilter(const FIRFilter& other) = delete;
     FIRFilter& operator=(const FIRFilter& other) = delete;
     virtual ~FIRFilter();
 
     const char* name() override { return "FIRFilter"; }
 
+    // The FFT convolution is not split
+    virtual size_t get_num_parts() const override {
+        return std::atomic_load(&m_filter)->fft_convolution ? 0 : m_num_parts.load();
+    }
+    virtual void set_num_parts(size_t num_parts) override {
+        m_num_parts = std::max<size_t>(num_parts, 1);
+    }
+
     /******* REMOTE CONTROL ********/
     virtual void set_parameter(const std::string& parameter, const std::string& value) override;
     virtual const std::string get_parameter(const std::string& parameter) const override;
     virtual const json::map_t get_all_values() const override;
 
+    // Read the taps from a file in the format of
+    // doc/fir-filter/generate-filter.py, or the default taps if tapsFile
+    // is "default". Throws a std::runtime_error on failure.
+    static std::vector<float> read_filter_taps(const std::string &tapsFile);
+
+    // Computes the first outputs of a frame for which all taps are inside
+    // the frame, and returns how many it computed.
+    using kernel_t = size_t (*)(const float *in, float *out, size_t num_out,
+            const float *taps, size_t num_taps);
+
 protected:
     virtual int internal_process(Buffer* const dataIn, Buffer* dataOut) override;
     void load_filter_taps(const std::string &tapsFile);
 
     std::string& m_taps_file;
-
-    mutable std::mutex m_taps_mutex;
-    std::vector<float> m_taps;
+    size_t m_fft_min_taps;
+    FFTEngine m_fftEngine;
+    unsigned m_fft_threads;
+
+    // The FFT plans, buffers and filter spectrum used for long filters
+    struct fft_convolution_t;
+
+    struct filter_t {
+        filter_t(std::vector<float>&& taps, size_t fft_min_taps,
+                unsigned fft_threads);
+        ~filter_t();
+
+        std::vector<float> taps;
+
+        // The taps as raw values of complexfix, only for the fixed-point
+        // engines.
+        std::vector<int16_t> taps_fix;
+
+        // Set when the taps are applied with the FFT. Only the pipeline
+        // thread uses its buffers.
+        std::unique_ptr<fft_convolution_t> fft_convolution;
+    };
+
+    // Only accessed with std::atomic_load() and std::atomic_store(). A
+    // reload replaces the pointer, and every frame is filtered with the
+    // filter that was current when it started, without ever waiting for
+    // a reload.
+    std::shared_ptr<filter_t> m_filter;
+
+    // Serialises the reloads, the filtering never takes it. The filter
+    // replaced by the last reload is kept until the next one, so that it is
+    // normally destroyed here and not by the pipeline thread, because the
+    // destruction of the FFT plans takes the FFTW planner mutex.
+    std::mutex m_reload_mutex;
+    std::shared_ptr<filter_t> m_previous_filter;
+
+    // Selected according to the CPU features at runtime
+    kernel_t m_kernel = nullptr;
+
+    // Number of parts, including the one of the pipeline thread, into
+    // which the direct form splits the frames
+    std::atomic<size_t> m_num_parts = ATOMIC_VAR_INIT(1);
 };
 
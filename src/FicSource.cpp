@@ -58,6 +58,8 @@ FicSource::FicSource(unsigned ficf, unsigned mid) :
         m_puncturing_rules.emplace_back(3 * 16, 0xeeeeeeec);
     }
     m_buffer.setLength(m_framesize);
+    m_data = reinterpret_cast<const uint8_t*>(m_buffer.getData());
+    m_length = m_buffer.getLength();
 }
 
 size_t FicSource::getFramesize() const
@@ -74,6 +76,14 @@ const std::vector<PuncturingRule>& FicSource::get_rules() const
 void FicSource::loadFicData(const Buffer& fic)
 {
     m_buffer = fic;
+    m_data = reinterpret_cast<const uint8_t*>(m_buffer.getData());
+    m_length = m_buffer.getLength();
+}
+
+void FicSource::loadFicData(const uint8_t *data, size_t length)
+{
+    m_data = data;
+    m_length = length;
 }
 
 int FicSource::process(Buffer* outputData)
@@ -81,13 +91,13 @@ int FicSource::process(Buffer* outputData)
     PDEBUG("FicSource::process (outputData: %p, outputSize: %zu)\n",
             outputData, outputData->getLength());
 
-    if (m_buffer.getLength() != m_framesize) {
+    if (m_length != m_framesize) {
         throw std::runtime_error(
                 "ERROR: FicSource::process.outputSize != m_framesize: " +
-                std::to_string(m_buffer.getLength()) + " != " +
+                std::to_string(m_length) + " != " +
                 std::to_string(m_framesize));
     }
-    *outputData = m_buffer;
+    outputData->setData(m_data, m_length);
 
     return outputData->getLength();
 }
@@ -46,15 +46,25 @@ public:
     const std::vector<PuncturingRule>& get_rules() const;
 
     void loadFicData(const Buffer& fic);
+
+    /* Use the FIC where it is, in the ETI frame. The data must stay
+     * valid until process() was called. */
+    void loadFicData(const uint8_t *data, size_t length);
+
     int process(Buffer* outputData) override;
     const char* name() override { return "FicSource"; }
 
     void loadTimestamp(const frame_timestamp& ts);
+
+    // How long the just-in-time start delayed the modulation of the frame
+    void setScheduleWait(double wait) { m_ts.schedule_wait = wait; }
     virtual meta_vec_t process_metadata(const meta_vec_t& metadataIn) override;
 
 private:
     size_t m_framesize = 0;
     Buffer m_buffer;
+    const uint8_t *m_data = nullptr;
+    size_t m_length = 0;
     frame_timestamp m_ts;
     bool m_ts_valid = false;
     std::vector<PuncturingRule> m_puncturing_rules;
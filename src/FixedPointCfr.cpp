@@ -0,0 +1,337 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "FixedPointCfr.h"
+#include "PcDebug.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#if defined(__SSE2__)
+#   include <immintrin.h>
+#elif defined(__ARM_NEON)
+#   include <arm_neon.h>
+#endif
+
+using namespace std;
+
+// The magnitude of a clipped sample gets scaled down to the threshold
+template<typename T>
+static inline void clip_sample(T *sample, double magnitude2,
+        double threshold2)
+{
+    const double scale = sqrt(threshold2 / magnitude2);
+    sample[0] = (T)lround(sample[0] * scale);
+    sample[1] = (T)lround(sample[1] * scale);
+}
+
+// The sum of the squared magnitudes of n complexfix samples
+static double power_fixed(const int16_t *in, size_t n)
+{
+    uint64_t power = 0;
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = zero;
+    for (; i + 4 <= n; i += 4) {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i));
+        // At most 2^31, which does not fit in int32 but in uint32
+        const __m128i m2 = _mm_madd_epi16(x, x);
+        acc = _mm_add_epi64(acc, _mm_add_epi64(
+                    _mm_unpacklo_epi32(m2, zero), _mm_unpackhi_epi32(m2, zero)));
+    }
+    uint64_t sums[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(sums), acc);
+    power = sums[0] + sums[1];
+#elif defined(__ARM_NEON)
+    int64x2_t acc = vdupq_n_s64(0);
+    for (; i + 4 <= n; i += 4) {
+        const int16x8_t x = vld1q_s16(in + 2 * i);
+        acc = vpadalq_s32(acc, vmull_s16(vget_low_s16(x), vget_low_s16(x)));
+        acc = vpadalq_s32(acc, vmull_s16(vget_high_s16(x), vget_high_s16(x)));
+    }
+    power = vgetq_lane_s64(acc, 0) + vgetq_lane_s64(acc, 1);
+#endif
+    for (; i < n; i++) {
+        const int32_t re = in[2 * i];
+        const int32_t im = in[2 * i + 1];
+        power += (uint32_t)(re * re) + (uint32_t)(im * im);
+    }
+    return power;
+}
+
+// The same for complexfix_wide, whose squares need 64 bits each
+static double power_fixed(const int32_t *in, size_t n)
+{
+    double power = 0;
+    for (size_t i = 0; i < n; i++) {
+        const int64_t re = in[2 * i];
+        const int64_t im = in[2 * i + 1];
+        power += (double)(uint64_t)(re * re + im * im);
+    }
+    return power;
+}
+
+/* Clip the n complexfix samples whose squared magnitude is above
+ * threshold2, and return their number. The vectorised loops compare
+ * the squared magnitudes as uint32, and only go through the scalar code
+ * for the groups of samples that contain a clipped one. */
+static size_t clip_fixed(const int16_t *in, int16_t *out, size_t n,
+        double threshold2)
+{
+    if (in != out) {
+        memcpy(out, in, 2 * n * sizeof(int16_t));
+    }
+
+    // The squared magnitudes are at most 2^31
+    if (threshold2 >= 2147483648.0) {
+        return 0;
+    }
+    const uint32_t t = (uint32_t)threshold2;
+
+    size_t num_clipped = 0;
+    const auto clip_group = [&](size_t start, size_t stop) {
+        for (size_t k = start; k < stop; k++) {
+            const int32_t re = out[2 * k];
+            const int32_t im = out[2 * k + 1];
+            const uint32_t m2 = (uint32_t)(re * re) + (uint32_t)(im * im);
+            if (m2 > t) {
+                clip_sample(out + 2 * k, m2, threshold2);
+                num_clipped++;
+            }
+        }
+    };
+
+    size_t i = 0;
+#if defined(__SSE2__)
+    // There is no unsigned comparison, both sides get their sign bit flipped
+    const __m128i bias = _mm_set1_epi32(INT32_MIN);
+    const __m128i vt = _mm_set1_epi32((int32_t)(t ^ 0x80000000u));
+    for (; i + 4 <= n; i += 4) {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(out + 2 * i));
+        const __m128i m2 = _mm_madd_epi16(x, x);
+        const __m128i above = _mm_cmpgt_epi32(_mm_xor_si128(m2, bias), vt);
+        if (_mm_movemask_epi8(above)) {
+            clip_group(i, i + 4);
+        }
+    }
+#elif defined(__ARM_NEON)
+    const uint32x4_t vt = vdupq_n_u32(t);
+    for (; i + 4 <= n; i += 4) {
+        const int16x4x2_t x = vld2_s16(out + 2 * i);
+        // The sum wraps around in int32 for 2^31, but not in uint32
+        const uint32x4_t m2 = vreinterpretq_u32_s32(vmlal_s16(
+                    vmull_s16(x.val[0], x.val[0]), x.val[1], x.val[1]));
+        const uint32x4_t above = vcgtq_u32(m2, vt);
+        const uint32x2_t any = vorr_u32(vget_low_u32(above), vget_high_u32(above));
+        if (vget_lane_u32(any, 0) | vget_lane_u32(any, 1)) {
+            clip_group(i, i + 4);
+        }
+    }
+#endif
+    clip_group(i, n);
+    return num_clipped;
+}
+
+static size_t clip_fixed(const int32_t *in, int32_t *out, size_t n,
+        double threshold2)
+{
+    size_t num_clipped = 0;
+    for (size_t i = 0; i < n; i++) {
+        const int64_t re = in[2 * i];
+        const int64_t im = in[2 * i + 1];
+        out[2 * i] = in[2 * i];
+        out[2 * i + 1] = in[2 * i + 1];
+        const double m2 = (double)(uint64_t)(re * re + im * im);
+        if (m2 > threshold2) {
+            clip_sample(out + 2 * i, m2, threshold2);
+            num_clipped++;
+        }
+    }
+    return num_clipped;
+}
+
+FixedPointCfr::FixedPointCfr(size_t spacing, FFTEngine fftEngine,
+        float papr) :
+    ModCodec(),
+    RemoteControllable("cfr"),
+    m_spacing(spacing),
+    m_wide(fftEngine == FFTEngine::DEXTER),
+    m_papr(papr)
+{
+    PDEBUG("FixedPointCfr::FixedPointCfr(%zu, %f) @ %p\n",
+            spacing, papr, this);
+
+    if (fftEngine == FFTEngine::FFTW) {
+        throw std::logic_error("FixedPointCfr needs a fixed-point FFT engine");
+    }
+    if (papr <= 0) {
+        throw std::invalid_argument("FixedPointCfr: the PAPR must be positive");
+    }
+
+    RC_ADD_PARAMETER(enable, "Enable the clipping");
+    RC_ADD_PARAMETER(papr, "Clip the samples to this PAPR in dB above the mean power of the symbol");
+    RC_ADD_PARAMETER(clip_ratio, "(Read-only) ratio of clipped samples in the last frame");
+
+    m_metrics.add_counter("odr_cfr_clipped_samples_total",
+            "Number of samples clipped by the fixed-point CFR",
+            [this]() { return m_total_clipped_samples.load(); });
+
+    etiLog.level(info) << "FixedPointCfr: clipping to " << papr <<
+        " dB above the mean power of every symbol";
+}
+
+template<typename T>
+size_t FixedPointCfr::process_symbols(const T *in, T *out,
+        size_t num_samples, float papr)
+{
+    const double papr_ratio = pow(10.0, (double)papr / 10.0);
+
+    // The NULL symbol, which is blank or contains the TII, is left as it is
+    if (in != out) {
+        copy(in, in + 2 * m_spacing, out);
+    }
+
+    size_t num_clipped = 0;
+    for (size_t i = m_spacing; i < num_samples; i += m_spacing) {
+        const double power = power_fixed(in + 2 * i, m_spacing);
+        if (power == 0) {
+            if (in != out) {
+                copy(in + 2 * i, in + 2 * (i + m_spacing), out + 2 * i);
+            }
+            continue;
+        }
+
+        const double threshold2 = power / m_spacing * papr_ratio;
+        num_clipped += clip_fixed(in + 2 * i, out + 2 * i, m_spacing,
+                threshold2);
+    }
+    return num_clipped;
+}
+
+int FixedPointCfr::process(Buffer* const dataIn, Buffer* dataOut)
+{
+    PDEBUG("FixedPointCfr::process(dataIn: %p, dataOut: %p)\n",
+            dataIn, dataOut);
+
+    dataOut->setLength(dataIn->getLength());
+    const size_t sample_size = m_wide ?
+        sizeof(complexfix_wide) : sizeof(complexfix);
+    const size_t num_samples = dataIn->getLength() / sample_size;
+
+    if (num_samples % m_spacing != 0) {
+        throw std::runtime_error(
+                "FixedPointCfr::process input size not valid!");
+    }
+
+    if (not m_enabled) {
+        if (dataIn->getData() != dataOut->getData()) {
+            memcpy(dataOut->getData(), dataIn->getData(),
+                    dataIn->getLength());
+        }
+        m_clip_ratio = 0;
+        return num_samples;
+    }
+
+    const float papr = m_papr.load();
+    size_t num_clipped = 0;
+    if (m_wide) {
+        num_clipped = process_symbols(
+                reinterpret_cast<const int32_t*>(dataIn->getData()),
+                reinterpret_cast<int32_t*>(dataOut->getData()),
+                num_samples, papr);
+    }
+    else {
+        num_clipped = process_symbols(
+                reinterpret_cast<const int16_t*>(dataIn->getData()),
+                reinterpret_cast<int16_t*>(dataOut->getData()),
+                num_samples, papr);
+    }
+
+    m_clip_ratio = num_samples ? (float)num_clipped / num_samples : 0.0f;
+    m_total_clipped_samples.fetch_add(num_clipped, std::memory_order_relaxed);
+    return num_samples;
+}
+
+void FixedPointCfr::set_parameter(const string& parameter,
+        const string& value)
+{
+    stringstream ss(value);
+    ss.exceptions ( stringstream::failbit | stringstream::badbit );
+
+    if (parameter == "enable") {
+        int enable = 0;
+        ss >> enable;
+        m_enabled = (enable != 0);
+    }
+    else if (parameter == "papr") {
+        float papr = 0;
+        ss >> papr;
+        if (papr <= 0) {
+            throw ParameterError("The PAPR must be positive");
+        }
+        m_papr = papr;
+    }
+    else if (parameter == "clip_ratio") {
+        throw ParameterError("Parameter " + parameter + " is read-only");
+    }
+    else {
+        stringstream ss_err;
+        ss_err << "Parameter '" << parameter <<
+            "' is not exported by controllable " << get_rc_name();
+        throw ParameterError(ss_err.str());
+    }
+}
+
+const string FixedPointCfr::get_parameter(const string& parameter) const
+{
+    stringstream ss;
+    if (parameter == "enable") {
+        ss << (m_enabled ? 1 : 0);
+    }
+    else if (parameter == "papr") {
+        ss << std::fixed << m_papr.load();
+    }
+    else if (parameter == "clip_ratio") {
+        ss << std::fixed << m_clip_ratio.load();
+    }
+    else {
+        ss << "Parameter '" << parameter <<
+            "' is not exported by controllable " << get_rc_name();
+        throw ParameterError(ss.str());
+    }
+    return ss.str();
+}
+
+const json::map_t FixedPointCfr::get_all_values() const
+{
+    json::map_t map;
+    map["enable"].v = m_enabled.load();
+    map["papr"].v = m_papr.load();
+    map["clip_ratio"].v = m_clip_ratio.load();
+    return map;
+}
@@ -0,0 +1,86 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include "ConfigParser.h"
+#include "ModPlugin.h"
+#include "RemoteControl.h"
+#include "Metrics.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/* Crest factor reduction for the fixed-point FFT engines, between the
+ * OfdmGenerator and the GainControl. Unlike the CFR of the floating-point
+ * OfdmGenerator, which compensates the clipping error on the carriers with
+ * two more FFTs per iteration, it only clips the magnitude of the samples
+ * in the time domain, to papr dB above the mean power of every symbol.
+ *
+ * The samples are complexfix for KISS and KISS_SIMD, and complexfix_wide
+ * for DEXTER. The clipped samples keep their phase and get exactly the
+ * threshold magnitude, rounded to the nearest integer. */
+class FixedPointCfr : public ModCodec, public RemoteControllable
+{
+    public:
+        FixedPointCfr(size_t spacing, FFTEngine fftEngine, float papr);
+        FixedPointCfr(const FixedPointCfr& other) = delete;
+        FixedPointCfr& operator=(const FixedPointCfr& other) = delete;
+
+        int process(Buffer* const dataIn, Buffer* dataOut) override;
+        const char* name() override { return "FixedPointCfr"; }
+
+        bool supports_in_place() const override { return true; }
+
+        /******* REMOTE CONTROL ********/
+        virtual void set_parameter(const std::string& parameter,
+                const std::string& value) override;
+
+        virtual const std::string get_parameter(
+                const std::string& parameter) const override;
+
+        virtual const json::map_t get_all_values() const override;
+
+    private:
+        template<typename T>
+        size_t process_symbols(const T *in, T *out, size_t num_samples,
+                float papr);
+
+        const size_t m_spacing;
+        const bool m_wide;
+
+        // Set by the remote control
+        std::atomic<bool> m_enabled = ATOMIC_VAR_INIT(true);
+        std::atomic<float> m_papr;
+
+        // Ratio of clipped samples in the last frame
+        std::atomic<float> m_clip_ratio = ATOMIC_VAR_INIT(0.0f);
+        std::atomic<uint64_t> m_total_clipped_samples = ATOMIC_VAR_INIT(0);
+
+        Metrics::Handle m_metrics;
+};
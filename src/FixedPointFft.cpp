@@ -0,0 +1,409 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "FixedPointFft.h"
+#include "PcDebug.h"
+#include "CpuFeatures.h"
+
+#include <stdexcept>
+#include <string>
+#include <cmath>
+#if defined(HAVE_FIXED_POINT_FFT_SSSE3)
+#   include <immintrin.h>
+#elif defined(__ARM_NEON)
+#   include <arm_neon.h>
+#endif
+
+static_assert(sizeof(kiss_fft_scalar) == sizeof(int16_t),
+        "FixedPointFft requires KISS FFT with FIXED_POINT=16");
+
+/* The arithmetic of _kiss_fft_guts.h for FIXED_POINT=16. C_FIXDIV
+ * multiplies by SAMP_MAX/div, C_MUL rounds the sum of two products. */
+static inline int16_t fixdiv(int16_t x, int32_t samp_max_div)
+{
+    return (int16_t)((x * samp_max_div + (1 << 14)) >> 15);
+}
+
+static inline kiss_fft_cpx fixdiv(kiss_fft_cpx c, int32_t samp_max_div)
+{
+    return {fixdiv(c.r, samp_max_div), fixdiv(c.i, samp_max_div)};
+}
+
+static inline kiss_fft_cpx cmul(kiss_fft_cpx a, kiss_fft_cpx b)
+{
+    return {(int16_t)((a.r * b.r - a.i * b.i + (1 << 14)) >> 15),
+            (int16_t)((a.r * b.i + a.i * b.r + (1 << 14)) >> 15)};
+}
+
+static inline kiss_fft_cpx cadd(kiss_fft_cpx a, kiss_fft_cpx b)
+{
+    return {(int16_t)(a.r + b.r), (int16_t)(a.i + b.i)};
+}
+
+static inline kiss_fft_cpx csub(kiss_fft_cpx a, kiss_fft_cpx b)
+{
+    return {(int16_t)(a.r - b.r), (int16_t)(a.i - b.i)};
+}
+
+#if defined(HAVE_FIXED_POINT_FFT_SSSE3)
+/* Four interleaved complex values per register. _mm_mulhrs_epi16 rounds
+ * exactly like sround(), and _mm_madd_epi16 gives the sums of products
+ * of C_MUL before rounding. */
+__attribute__((target("ssse3")))
+static inline __m128i load_sse(const kiss_fft_cpx *p)
+{
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+__attribute__((target("ssse3")))
+static inline void store_sse(kiss_fft_cpx *p, __m128i v)
+{
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v);
+}
+
+__attribute__((target("ssse3")))
+static inline __m128i fixdiv4_sse(__m128i x)
+{
+    return _mm_mulhrs_epi16(x, _mm_set1_epi16(INT16_MAX / 4));
+}
+
+__attribute__((target("ssse3")))
+static inline __m128i cmul_sse(__m128i x, __m128i tw_re, __m128i tw_im)
+{
+    const __m128i round = _mm_set1_epi32(1 << 14);
+    const __m128i re = _mm_srai_epi32(
+            _mm_add_epi32(_mm_madd_epi16(x, tw_re), round), 15);
+    const __m128i im = _mm_srai_epi32(
+            _mm_add_epi32(_mm_madd_epi16(x, tw_im), round), 15);
+    return _mm_or_si128(
+            _mm_and_si128(re, _mm_set1_epi32(0xffff)),
+            _mm_slli_epi32(im, 16));
+}
+#elif defined(__ARM_NEON)
+/* Eight complex values, split into real and imaginary parts by vld2q.
+ * vqrdmulhq and vrshrn round exactly like sround(). */
+static inline int16x8_t cmul_re_neon(int16x8_t r, int16x8_t i,
+        int16x8_t tw_r, int16x8_t tw_i)
+{
+    const int32x4_t lo = vmlsl_s16(
+            vmull_s16(vget_low_s16(r), vget_low_s16(tw_r)),
+            vget_low_s16(i), vget_low_s16(tw_i));
+    const int32x4_t hi = vmlsl_s16(
+            vmull_s16(vget_high_s16(r), vget_high_s16(tw_r)),
+            vget_high_s16(i), vget_high_s16(tw_i));
+    return vcombine_s16(vrshrn_n_s32(lo, 15), vrshrn_n_s32(hi, 15));
+}
+
+static inline int16x8_t cmul_im_neon(int16x8_t r, int16x8_t i,
+        int16x8_t tw_r, int16x8_t tw_i)
+{
+    const int32x4_t lo = vmlal_s16(
+            vmull_s16(vget_low_s16(r), vget_low_s16(tw_i)),
+            vget_low_s16(i), vget_low_s16(tw_r));
+    const int32x4_t hi = vmlal_s16(
+            vmull_s16(vget_high_s16(r), vget_high_s16(tw_i)),
+            vget_high_s16(i), vget_high_s16(tw_r));
+    return vcombine_s16(vrshrn_n_s32(lo, 15), vrshrn_n_s32(hi, 15));
+}
+#endif
+
+struct factor_t {
+    int radix;
+    size_t m;
+    size_t fstride;
+};
+
+/* Where kf_work() takes the input of every output element from */
+static void build_input_index(uint32_t *out, uint32_t in,
+        const std::vector<factor_t>& factors, size_t level)
+{
+    const auto& f = factors[level];
+    for (int j = 0; j < f.radix; j++) {
+        if (f.m == 1) {
+            out[j] = in + j * f.fstride;
+        }
+        else {
+            build_input_index(out + j * f.m, in + j * f.fstride,
+                    factors, level + 1);
+        }
+    }
+}
+
+FixedPointFft::FixedPointFft(size_t nfft, bool inverse) :
+    m_nfft(nfft),
+    m_inverse(inverse)
+{
+    PDEBUG("FixedPointFft::FixedPointFft(%zu, %s) @ %p\n",
+            nfft, inverse ? "true" : "false", this);
+
+    if (nfft < 2 or (nfft & (nfft - 1)) != 0) {
+        throw std::invalid_argument("FixedPointFft: size " +
+                std::to_string(nfft) + " is not a power of two");
+    }
+
+    static const bool simd = [] {
+        auto& cpu = cpu_features();
+        const char *name = "scalar";
+#if defined(HAVE_FIXED_POINT_FFT_SSSE3)
+        if (cpu.supports(cpu_feature_e::ssse3)) {
+            name = "SSSE3";
+        }
+#elif defined(__ARM_NEON)
+        if (cpu.supports(cpu_feature_e::neon)) {
+            name = "NEON";
+        }
+#endif
+        cpu.register_kernel("FixedPointFft", name);
+        return std::string(name) != "scalar";
+    }();
+    m_simd = simd;
+
+    // Same twiddles as kiss_fft_alloc()
+    std::vector<kiss_fft_cpx> twiddles(nfft);
+    for (size_t i = 0; i < nfft; i++) {
+        const double pi = 3.141592653589793238462643383279502884197169399375105820974944;
+        double phase = -2 * pi * i / nfft;
+        if (inverse) {
+            phase *= -1;
+        }
+        twiddles[i].r = std::floor(.5 + INT16_MAX * std::cos(phase));
+        twiddles[i].i = std::floor(.5 + INT16_MAX * std::sin(phase));
+    }
+
+    // Same factors as kf_factor(): powers of four, then a two
+    std::vector<factor_t> factors;
+    size_t n = nfft;
+    size_t fstride = 1;
+    while (n > 1) {
+        const int radix = (n % 4 == 0) ? 4 : 2;
+        n /= radix;
+        factors.push_back({radix, n, fstride});
+        fstride *= radix;
+    }
+
+    m_input_index.resize(nfft);
+    build_input_index(m_input_index.data(), 0, factors, 0);
+
+    // kf_work() combines the smallest sub-transforms first
+    for (auto f = factors.rbegin(); f != factors.rend(); ++f) {
+        stage_t stage;
+        stage.radix = f->radix;
+        stage.m = f->m;
+
+        for (int j = 0; j < f->radix - 1; j++) {
+            for (size_t k = 0; k < f->m; k++) {
+                const kiss_fft_cpx tw = twiddles[(j + 1) * k * f->fstride];
+                stage.tw[j].push_back(tw);
+#if defined(HAVE_FIXED_POINT_FFT_SSSE3)
+                if (m_simd) {
+                    stage.tw_re[j].push_back({tw.r, (int16_t)-tw.i});
+                    stage.tw_im[j].push_back({tw.i, tw.r});
+                }
+#endif
+            }
+        }
+
+        m_stages.push_back(std::move(stage));
+    }
+}
+
+void FixedPointFft::transform(const kiss_fft_cpx *fin, kiss_fft_cpx *fout) const
+{
+    for (size_t i = 0; i < m_nfft; i++) {
+        fout[i] = fin[m_input_index[i]];
+    }
+
+    for (const auto& stage : m_stages) {
+        const size_t block_size = stage.radix * stage.m;
+        for (size_t b = 0; b < m_nfft; b += block_size) {
+            if (stage.radix == 4) {
+                bfly4(fout + b, stage);
+            }
+            else {
+                bfly2(fout + b, stage);
+            }
+        }
+    }
+}
+
+void FixedPointFft::bfly2(kiss_fft_cpx *fout, const stage_t& stage) const
+{
+    const size_t m = stage.m;
+    for (size_t k = 0; k < m; k++) {
+        const kiss_fft_cpx f0 = fixdiv(fout[k], INT16_MAX / 2);
+        const kiss_fft_cpx f1 = fixdiv(fout[k + m], INT16_MAX / 2);
+        const kiss_fft_cpx t = cmul(f1, stage.tw[0][k]);
+        fout[k + m] = csub(f0, t);
+        fout[k] = cadd(f0, t);
+    }
+}
+
+#if defined(HAVE_FIXED_POINT_FFT_SSSE3)
+__attribute__((target("ssse3")))
+size_t FixedPointFft::bfly4_ssse3(kiss_fft_cpx *fout, const stage_t& stage) const
+{
+    const size_t m = stage.m;
+    kiss_fft_cpx *fout1 = fout + m;
+    kiss_fft_cpx *fout2 = fout + 2 * m;
+    kiss_fft_cpx *fout3 = fout + 3 * m;
+    size_t k = 0;
+
+    // Selects the real parts
+    const __m128i re_mask = _mm_set1_epi32(0xffff);
+
+    for (; k + 4 <= m; k += 4) {
+        const __m128i f0 = fixdiv4_sse(load_sse(fout + k));
+        const __m128i f1 = fixdiv4_sse(load_sse(fout1 + k));
+        const __m128i f2 = fixdiv4_sse(load_sse(fout2 + k));
+        const __m128i f3 = fixdiv4_sse(load_sse(fout3 + k));
+
+        const __m128i s0 = cmul_sse(f1,
+                load_sse(stage.tw_re[0].data() + k),
+                load_sse(stage.tw_im[0].data() + k));
+        const __m128i s1 = cmul_sse(f2,
+                load_sse(stage.tw_re[1].data() + k),
+                load_sse(stage.tw_im[1].data() + k));
+        const __m128i s2 = cmul_sse(f3,
+                load_sse(stage.tw_re[2].data() + k),
+                load_sse(stage.tw_im[2].data() + k));
+
+        const __m128i s5 = _mm_sub_epi16(f0, s1);
+        const __m128i f0_s1 = _mm_add_epi16(f0, s1);
+        const __m128i s3 = _mm_add_epi16(s0, s2);
+        const __m128i s4 = _mm_sub_epi16(s0, s2);
+        store_sse(fout2 + k, _mm_sub_epi16(f0_s1, s3));
+        store_sse(fout + k, _mm_add_epi16(f0_s1, s3));
+
+        // a = (s5.r + s4.i, s5.i + s4.r), b = (s5.r - s4.i, s5.i - s4.r)
+        const __m128i s4_swapped =
+            _mm_shufflehi_epi16(_mm_shufflelo_epi16(s4, 0xb1), 0xb1);
+        const __m128i a = _mm_add_epi16(s5, s4_swapped);
+        const __m128i b = _mm_sub_epi16(s5, s4_swapped);
+        const __m128i a_re_b_im = _mm_or_si128(
+                _mm_and_si128(re_mask, a), _mm_andnot_si128(re_mask, b));
+        const __m128i b_re_a_im = _mm_or_si128(
+                _mm_and_si128(re_mask, b), _mm_andnot_si128(re_mask, a));
+
+        store_sse(fout1 + k, m_inverse ? b_re_a_im : a_re_b_im);
+        store_sse(fout3 + k, m_inverse ? a_re_b_im : b_re_a_im);
+    }
+    return k;
+}
+#endif
+
+void FixedPointFft::bfly4(kiss_fft_cpx *fout, const stage_t& stage) const
+{
+    const size_t m = stage.m;
+    kiss_fft_cpx *fout1 = fout + m;
+    kiss_fft_cpx *fout2 = fout + 2 * m;
+    kiss_fft_cpx *fout3 = fout + 3 * m;
+    size_t k = 0;
+
+#if defined(HAVE_FIXED_POINT_FFT_SSSE3)
+    if (m_simd) {
+        k = bfly4_ssse3(fout, stage);
+    }
+#elif defined(__ARM_NEON)
+    const int16x8_t samp_max_div4 = vdupq_n_s16(INT16_MAX / 4);
+
+    for (; m_simd and k + 8 <= m; k += 8) {
+        auto load = [k](const kiss_fft_cpx *p) {
+            return vld2q_s16(reinterpret_cast<const int16_t*>(p + k));
+        };
+        auto fixdiv4 = [&](int16x8x2_t v) {
+            v.val[0] = vqrdmulhq_s16(v.val[0], samp_max_div4);
+            v.val[1] = vqrdmulhq_s16(v.val[1], samp_max_div4);
+            return v;
+        };
+        auto cmul = [](int16x8x2_t v, int16x8x2_t tw) {
+            int16x8x2_t res;
+            res.val[0] = cmul_re_neon(v.val[0], v.val[1], tw.val[0], tw.val[1]);
+            res.val[1] = cmul_im_neon(v.val[0], v.val[1], tw.val[0], tw.val[1]);
+            return res;
+        };
+
+        const int16x8x2_t f0 = fixdiv4(load(fout));
+        const int16x8x2_t s0 = cmul(fixdiv4(load(fout1)),
+                load(stage.tw[0].data()));
+        const int16x8x2_t s1 = cmul(fixdiv4(load(fout2)),
+                load(stage.tw[1].data()));
+        const int16x8x2_t s2 = cmul(fixdiv4(load(fout3)),
+                load(stage.tw[2].data()));
+
+        int16x8x2_t s3, s4, s5, f0_s1, res;
+        for (int c = 0; c < 2; c++) {
+            s5.val[c] = vsubq_s16(f0.val[c], s1.val[c]);
+            f0_s1.val[c] = vaddq_s16(f0.val[c], s1.val[c]);
+            s3.val[c] = vaddq_s16(s0.val[c], s2.val[c]);
+            s4.val[c] = vsubq_s16(s0.val[c], s2.val[c]);
+        }
+
+        int16_t *p2 = reinterpret_cast<int16_t*>(fout2 + k);
+        res.val[0] = vsubq_s16(f0_s1.val[0], s3.val[0]);
+        res.val[1] = vsubq_s16(f0_s1.val[1], s3.val[1]);
+        vst2q_s16(p2, res);
+
+        int16_t *p0 = reinterpret_cast<int16_t*>(fout + k);
+        res.val[0] = vaddq_s16(f0_s1.val[0], s3.val[0]);
+        res.val[1] = vaddq_s16(f0_s1.val[1], s3.val[1]);
+        vst2q_s16(p0, res);
+
+        // a = (s5.r + s4.i, s5.i - s4.r), b = (s5.r - s4.i, s5.i + s4.r)
+        int16x8x2_t a, b;
+        a.val[0] = vaddq_s16(s5.val[0], s4.val[1]);
+        a.val[1] = vsubq_s16(s5.val[1], s4.val[0]);
+        b.val[0] = vsubq_s16(s5.val[0], s4.val[1]);
+        b.val[1] = vaddq_s16(s5.val[1], s4.val[0]);
+
+        vst2q_s16(reinterpret_cast<int16_t*>(fout1 + k), m_inverse ? b : a);
+        vst2q_s16(reinterpret_cast<int16_t*>(fout3 + k), m_inverse ? a : b);
+    }
+#endif
+
+    for (; k < m; k++) {
+        const kiss_fft_cpx f0 = fixdiv(fout[k], INT16_MAX / 4);
+        const kiss_fft_cpx s0 = cmul(fixdiv(fout1[k], INT16_MAX / 4),
+                stage.tw[0][k]);
+        const kiss_fft_cpx s1 = cmul(fixdiv(fout2[k], INT16_MAX / 4),
+                stage.tw[1][k]);
+        const kiss_fft_cpx s2 = cmul(fixdiv(fout3[k], INT16_MAX / 4),
+                stage.tw[2][k]);
+
+        const kiss_fft_cpx s5 = csub(f0, s1);
+        const kiss_fft_cpx f0_s1 = cadd(f0, s1);
+        const kiss_fft_cpx s3 = cadd(s0, s2);
+        const kiss_fft_cpx s4 = csub(s0, s2);
+        fout2[k] = csub(f0_s1, s3);
+        fout[k] = cadd(f0_s1, s3);
+
+        if (m_inverse) {
+            fout1[k] = {(int16_t)(s5.r - s4.i), (int16_t)(s5.i + s4.r)};
+            fout3[k] = {(int16_t)(s5.r + s4.i), (int16_t)(s5.i - s4.r)};
+        }
+        else {
+            fout1[k] = {(int16_t)(s5.r + s4.i), (int16_t)(s5.i - s4.r)};
+            fout3[k] = {(int16_t)(s5.r - s4.i), (int16_t)(s5.i + s4.r)};
+        }
+    }
+}
+
@@ -0,0 +1,97 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   Fixed-point FFT for the power-of-two sizes used in DAB, bit-exact with
+   KISS FFT, with SSSE3 and NEON butterflies.
+*/
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include "kiss_fft.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* The SSSE3 butterflies are built with the target attribute, and used if
+ * the CPU supports them. */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#  define HAVE_FIXED_POINT_FFT_SSSE3 1
+#endif
+
+/* Gives the same output as kiss_fft() built with FIXED_POINT=16, for
+ * sizes that are a power of two: it uses the same radix-4 stages and final
+ * radix-2 stage, the same twiddle factors and the same rounding and
+ * scaling by 1/nfft. Unlike kiss_fft(), the input permutation is a lookup
+ * table, the stages run one after the other instead of recursively, and
+ * the butterflies of the larger stages are vectorised.
+ */
+class FixedPointFft
+{
+    public:
+        FixedPointFft(size_t nfft, bool inverse);
+
+        size_t size() const { return m_nfft; }
+
+        /* fin and fout must not overlap */
+        void transform(const kiss_fft_cpx *fin, kiss_fft_cpx *fout) const;
+
+    private:
+        struct stage_t {
+            int radix;
+            // Length of the sub-transforms this stage combines
+            size_t m;
+            // The twiddles used for element k of the sub-transforms,
+            // tw[j][k] is the one applied to sub-transform j+1.
+            std::vector<kiss_fft_cpx> tw[3];
+#if defined(HAVE_FIXED_POINT_FFT_SSSE3)
+            // The same twiddles, as (r, -i) and (i, r) pairs, only
+            // filled when the SSSE3 butterflies are used
+            std::vector<kiss_fft_cpx> tw_re[3];
+            std::vector<kiss_fft_cpx> tw_im[3];
+#endif
+        };
+
+        void bfly2(kiss_fft_cpx *fout, const stage_t& stage) const;
+        void bfly4(kiss_fft_cpx *fout, const stage_t& stage) const;
+#if defined(HAVE_FIXED_POINT_FFT_SSSE3)
+        // Returns the number of elements it computed
+        size_t bfly4_ssse3(kiss_fft_cpx *fout, const stage_t& stage) const;
+#endif
+
+        size_t m_nfft;
+        bool m_inverse;
+        // Use the SSSE3 or NEON butterflies
+        bool m_simd = false;
+
+        // fout[i] = fin[m_input_index[i]] before the first stage
+        std::vector<uint32_t> m_input_index;
+
+        // In the order in which they run
+        std::vector<stage_t> m_stages;
+};
+
@@ -27,21 +27,101 @@
 #include "Flowgraph.h"
 #include "PcDebug.h"
 #include "Log.h"
+#include "Utils.h"
+#include "FrameTracer.h"
 #include <memory>
 #include <algorithm>
 #include <sstream>
 #include <sys/types.h>
 #include <assert.h>
-#include <sys/time.h>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
 
 using namespace std;
 
 using NodeIterator = std::vector<shared_ptr<Node> >::iterator;
 using EdgeIterator = std::vector<shared_ptr<Edge> >::iterator;
 
+size_t LatencyHistogram::bin_index(uint64_t duration_us)
+{
+    if (duration_us < 2) {
+        return 0;
+    }
+
+    // Position of the most significant bit gives the octave, the two
+    // following bits give the bin inside the octave.
+    const size_t octave = 63 - __builtin_clzll(duration_us);
+    size_t sub = 0;
+    if (octave >= 2) {
+        sub = (duration_us >> (octave - 2)) & 0x3;
+    }
+    else {
+        sub = (duration_us << (2 - octave)) & 0x3;
+    }
+
+    return std::min(octave * bins_per_octave + sub, num_bins - 1);
+}
+
+uint64_t LatencyHistogram::bin_upper_bound(size_t index)
+{
+    const size_t octave = index / bins_per_octave;
+    const size_t sub = index % bins_per_octave;
+    // Lower bound of the bin is (4 + sub) * 2^octave / 4
+    return (((uint64_t)(bins_per_octave + sub + 1)) << octave) / bins_per_octave;
+}
+
+void LatencyHistogram::add(uint64_t duration_us)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_bins[bin_index(duration_us)]++;
+    m_count++;
+    m_sum_us += duration_us;
+    if (duration_us > m_max_us) {
+        m_max_us = duration_us;
+    }
+}
+
+uint64_t LatencyHistogram::count() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_count;
+}
+
+uint64_t LatencyHistogram::max_us() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_max_us;
+}
+
+double LatencyHistogram::mean_us() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_count ? (double)m_sum_us / m_count : 0.0;
+}
+
+uint64_t LatencyHistogram::percentile_us(double p) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_count == 0) {
+        return 0;
+    }
+
+    const uint64_t rank = std::max<uint64_t>(1, std::ceil(p * m_count));
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < num_bins; i++) {
+        cumulative += m_bins[i];
+        if (cumulative >= rank) {
+            return std::min(bin_upper_bound(i), m_max_us);
+        }
+    }
+    return m_max_us;
+}
+
 
 Node::Node(shared_ptr<ModPlugin> plugin) :
-    myPlugin(plugin)
+    myPlugin(plugin),
+    myTraceName(frame_tracer().register_name(plugin->name()))
 {
     PDEBUG("Node::Node(plugin(%s): %p) @ %p\n",
             plugin->name(), plugin.get(), this);
@@ -123,6 +203,26 @@ void Node::removeInputBuffer(Buffer::sptr& buffer, Metadata_vec_sptr& md)
     }
 }
 
+size_t Node::outputLength(const Buffer::sptr& buffer) const
+{
+    size_t i = 0;
+    for (const auto& b : myOutputBuffers) {
+        if (b == buffer) {
+            return i < myOutputLengths.size() ? myOutputLengths[i] : 0;
+        }
+        i++;
+    }
+    return 0;
+}
+
+void Node::replaceBuffer(const Buffer::sptr& oldBuffer, Buffer::sptr& newBuffer)
+{
+    std::replace(myInputBuffers.begin(), myInputBuffers.end(),
+            oldBuffer, newBuffer);
+    std::replace(myOutputBuffers.begin(), myOutputBuffers.end(),
+            oldBuffer, newBuffer);
+}
+
 int Node::process()
 {
     PDEBUG("Node::process()\n");
@@ -142,8 +242,83 @@ int Node::process()
         outBuffers.push_back(buffer.get());
     }
 
+    auto& tracer = frame_tracer();
+    const bool tracing = tracer.active();
+    int32_t trace_fct = -1;
+    uint64_t trace_start = 0;
+    if (tracing) {
+        for (const auto& md_vec_sp : myInputMetadata) {
+            if (md_vec_sp and not md_vec_sp->empty()) {
+                trace_fct = md_vec_sp->front().ts.fct;
+                break;
+            }
+        }
+        trace_start = FrameTracer::now_ns();
+        tracer.record(FrameTracer::event_e::node_enter, trace_fct, 0, myTraceName);
+    }
+
+    const auto alloc_mode = alloc_tracking::mode();
+    const auto alloc_start = alloc_tracking::thread_counts();
+
+    perf_counters::counts_t perf_start;
+    const bool counting = perf_counters::read(perf_start);
+
     int ret = myPlugin->process(inBuffers, outBuffers);
 
+    perf_counters::counts_t perf_stop;
+    if (counting and perf_counters::read(perf_stop)) {
+        std::lock_guard<std::mutex> lock(myPerfMutex);
+        myPerfStats.calls++;
+        for (const auto& buffer : outBuffers) {
+            myPerfStats.output_bytes += buffer->getLength();
+        }
+        myPerfStats.counts += perf_stop - perf_start;
+    }
+
+    size_t buffer_bytes = 0;
+    myOutputLengths.resize(outBuffers.size());
+    for (size_t i = 0; i < outBuffers.size(); i++) {
+        myOutputLengths[i] = outBuffers[i]->getLength();
+        buffer_bytes += outBuffers[i]->getCapacity();
+    }
+    myBufferBytes.store(buffer_bytes);
+
+    if (alloc_mode != alloc_tracking::mode_e::off) {
+        const auto allocs = alloc_tracking::thread_counts() - alloc_start;
+        if (allocs.allocations) {
+            std::lock_guard<std::mutex> lock(myPerfMutex);
+            myAllocStats += allocs;
+        }
+
+        if (allocs.steady_allocations) {
+            if (alloc_mode == alloc_tracking::mode_e::abort) {
+                etiLog.level(alert) << myPlugin->name() << " allocated " <<
+                    allocs.steady_allocations << " times after the warm-up, "
+                    "aborting";
+                abort();
+            }
+            else if (alloc_mode == alloc_tracking::mode_e::warn and
+                    not myAllocWarned) {
+                etiLog.level(warn) << myPlugin->name() << " allocated " <<
+                    allocs.steady_allocations << " times after the warm-up. "
+                    "Further allocations are only counted.";
+                myAllocWarned = true;
+            }
+        }
+    }
+
+    if (tracing) {
+        tracer.record(FrameTracer::event_e::node_exit, trace_fct,
+                FrameTracer::now_ns() - trace_start, myTraceName);
+
+        if (tracer.snapshot_wanted(myTraceName)) {
+            for (const auto& buffer : outBuffers) {
+                tracer.record_snapshot(trace_fct, myTraceName,
+                        buffer->getData(), buffer->getLength());
+            }
+        }
+    }
+
     // Collect all incoming metadata into a single vector
     meta_vec_t all_input_mds;
     for (auto& md_vec_sp : myInputMetadata) {
@@ -203,9 +378,35 @@ time_t Node::processTime() const
 void Node::addProcessTime(time_t time)
 {
     myProcessTime += time;
+    myLatency.add(time);
+}
+
+Node::perf_stats_t Node::perfStats() const
+{
+    std::lock_guard<std::mutex> lock(myPerfMutex);
+    return myPerfStats;
+}
+
+alloc_tracking::counts_t Node::allocStats() const
+{
+    std::lock_guard<std::mutex> lock(myPerfMutex);
+    return myAllocStats;
+}
+
+/* Instructions per cycle, and misses per kilobyte of output of the node,
+ * which compares blocks that process different amounts of data */
+static double perf_ipc(const Node::perf_stats_t& s)
+{
+    return s.counts.cycles ? (double)s.counts.instructions / s.counts.cycles : 0.0;
 }
 
-Edge::Edge(shared_ptr<Node>& srcNode, shared_ptr<Node>& dstNode) :
+static double perf_per_kb(const Node::perf_stats_t& s, uint64_t count)
+{
+    return s.output_bytes ? count * 1024.0 / s.output_bytes : 0.0;
+}
+
+Edge::Edge(shared_ptr<Node>& srcNode, shared_ptr<Node>& dstNode,
+        bool stage_boundary) :
     mySrcNode(srcNode),
     myDstNode(dstNode)
 {
@@ -218,7 +419,14 @@ Edge::Edge(shared_ptr<Node>& srcNode, shared_ptr<Node>& dstNode) :
     myMetadata = make_shared<vector<flowgraph_metadata> >();
 
     srcNode->addOutputBuffer(myBuffer, myMetadata);
-    dstNode->addInputBuffer(myBuffer, myMetadata);
+    if (stage_boundary) {
+        myStageBuffer = make_shared<Buffer>();
+        myStageMetadata = make_shared<vector<flowgraph_metadata> >();
+        dstNode->addInputBuffer(myStageBuffer, myStageMetadata);
+    }
+    else {
+        dstNode->addInputBuffer(myBuffer, myMetadata);
+    }
 }
 
 
@@ -228,16 +436,67 @@ Edge::~Edge()
 
     if (myBuffer) {
         mySrcNode->removeOutputBuffer(myBuffer, myMetadata);
-        myDstNode->removeInputBuffer(myBuffer, myMetadata);
+        if (myStageBuffer) {
+            myDstNode->removeInputBuffer(myStageBuffer, myStageMetadata);
+        }
+        else {
+            myDstNode->removeInputBuffer(myBuffer, myMetadata);
+        }
     }
 }
 
+void Edge::handoff()
+{
+    // The destination consumed its previous input, whose allocation the
+    // source can reuse
+    myBuffer->swap(*myStageBuffer);
+    myMetadata->swap(*myStageMetadata);
+}
+
+void Edge::shareBuffer(Buffer::sptr& buffer)
+{
+    if (myStageBuffer) {
+        throw std::logic_error("Edge: a stage boundary cannot share its buffer");
+    }
+    if (buffer == myBuffer) {
+        return;
+    }
+    mySrcNode->replaceBuffer(myBuffer, buffer);
+    myDstNode->replaceBuffer(myBuffer, buffer);
+    myBuffer = buffer;
+}
 
 
-Flowgraph::Flowgraph(bool showProcessTime) :
+
+using timepoint_t = std::chrono::steady_clock::time_point;
+
+static time_t elapsed_us(const timepoint_t& start, const timepoint_t& stop)
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(stop - start).count();
+}
+
+static int process_timed(Node *node)
+{
+    if (not node->isEnabled()) {
+        return 1;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    int ret = node->process();
+    const auto stop = std::chrono::steady_clock::now();
+    node->addProcessTime(elapsed_us(start, stop));
+    return ret;
+}
+
+Flowgraph::Flowgraph(bool showProcessTime, size_t numThreads) :
     myShowProcessTime(showProcessTime)
 {
     PDEBUG("Flowgraph::Flowgraph() @ %p\n", this);
+
+    for (size_t i = 0; i < numThreads; i++) {
+        myWorkers.emplace_back(&Flowgraph::worker_thread, this);
+    }
 }
 
 
@@ -245,6 +504,16 @@ Flowgraph::~Flowgraph()
 {
     PDEBUG("Flowgraph::~Flowgraph() @ %p\n", this);
 
+    stop_stages();
+
+    // A nullptr job tells one worker to terminate
+    for (size_t i = 0; i < myWorkers.size(); i++) {
+        myJobQueue.push(nullptr);
+    }
+    for (auto& worker : myWorkers) {
+        worker.join();
+    }
+
     if (myShowProcessTime and myProcessTime) {
         stringstream ss;
         ss << "Process time:\n";
@@ -252,11 +521,28 @@ Flowgraph::~Flowgraph()
         char node_time_sz[1024] = {};
 
         for (const auto &node : nodes) {
-            snprintf(node_time_sz, 1023, "  %30s: %10lld us (%2.2f %%)\n",
+            snprintf(node_time_sz, 1023, "  %30s: %10lld us (%2.2f %%)",
                     node->plugin()->name(),
                     (long long)node->processTime(),
                     node->processTime() * 100.0 / myProcessTime);
             ss << node_time_sz;
+
+            const auto perf = node->perfStats();
+            if (perf.calls) {
+                snprintf(node_time_sz, 1023,
+                        ", IPC %.2f, LLC misses %.2f/kB, branch misses %.2f/kB",
+                        perf_ipc(perf),
+                        perf_per_kb(perf, perf.counts.llc_misses),
+                        perf_per_kb(perf, perf.counts.branch_misses));
+                ss << node_time_sz;
+            }
+
+            const auto allocs = node->allocStats();
+            if (allocs.steady_allocations) {
+                ss << ", " << allocs.steady_allocations <<
+                    " allocations after the warm-up";
+            }
+            ss << "\n";
         }
 
         snprintf(node_time_sz, 1023, "  %30s: %10lld us (100.00 %%)\n", "total",
@@ -267,11 +553,14 @@ Flowgraph::~Flowgraph()
     }
 }
 
-void Flowgraph::connect(shared_ptr<ModPlugin> input, shared_ptr<ModPlugin> output)
+void Flowgraph::connect(shared_ptr<ModPlugin> input, shared_ptr<ModPlugin> output,
+        bool stage_boundary)
 {
     PDEBUG("Flowgraph::connect(input(%s): %p, output(%s): %p)\n",
             input->name(), input.get(), output->name(), output.get());
 
+    std::lock_guard<std::mutex> lock(myNodesMutex);
+
     NodeIterator inputNode;
     NodeIterator outputNode;
 
@@ -310,24 +599,240 @@ void Flowgraph::connect(shared_ptr<ModPlugin> input, shared_ptr<ModPlugin> outpu
     assert((*inputNode)->plugin() == input);
     assert((*outputNode)->plugin() == output);
 
-    edges.push_back(make_shared<Edge>(*inputNode, *outputNode));
+    edges.push_back(make_shared<Edge>(*inputNode, *outputNode, stage_boundary));
+    myScheduleValid = false;
+}
+
+void Flowgraph::disconnect(shared_ptr<ModPlugin> input, shared_ptr<ModPlugin> output)
+{
+    PDEBUG("Flowgraph::disconnect(input(%s): %p, output(%s): %p)\n",
+            input->name(), input.get(), output->name(), output.get());
+
+    std::lock_guard<std::mutex> lock(myNodesMutex);
+
+    for (auto edge = edges.begin(); edge != edges.end(); ++edge) {
+        if ((*edge)->srcNode()->plugin() == input and
+                (*edge)->dstNode()->plugin() == output) {
+            edges.erase(edge);
+            myScheduleValid = false;
+            return;
+        }
+    }
 }
 
+void Flowgraph::remove(shared_ptr<ModPlugin> plugin)
+{
+    PDEBUG("Flowgraph::remove(plugin(%s): %p)\n", plugin->name(), plugin.get());
+
+    std::lock_guard<std::mutex> lock(myNodesMutex);
+
+    // The edges must be destroyed before the node, as they hold its buffers
+    edges.erase(std::remove_if(edges.begin(), edges.end(),
+                [&](const shared_ptr<Edge>& edge) {
+                    return edge->srcNode()->plugin() == plugin or
+                           edge->dstNode()->plugin() == plugin;
+                }), edges.end());
+
+    nodes.erase(std::remove_if(nodes.begin(), nodes.end(),
+                [&](const shared_ptr<Node>& node) {
+                    return node->plugin() == plugin;
+                }), nodes.end());
+
+    myScheduleValid = false;
+}
+
+void Flowgraph::set_enabled(shared_ptr<ModPlugin> plugin, bool enabled)
+{
+    std::lock_guard<std::mutex> lock(myNodesMutex);
+    for (auto& node : nodes) {
+        if (node->plugin() == plugin) {
+            node->setEnabled(enabled);
+            return;
+        }
+    }
+}
 
 bool Flowgraph::run()
 {
     PDEBUG("Flowgraph::run()\n");
 
-    timeval start, stop;
+    // connect() keeps the nodes in order only when the flowgraph is built
+    // from its sources, not when a part of it gets replaced.
+    if (not myScheduleValid) {
+        schedule();
+    }
+
+    if (not myStages.empty()) {
+        // A stage takes over the frame of the previous stage once that one
+        // has completed it, without a node that returned 0. The frame only
+        // crosses the boundaries into the stages that run.
+        for (size_t s = myStages.size(); s-- > 0;) {
+            auto& stage = *myStages[s];
+            stage.ran = (s == 0) ? myFirstStageCompleted :
+                myStages[s - 1]->completed;
+            stage.completed = false;
+            if (stage.ran) {
+                for (Edge *edge : stage.inputs) {
+                    edge->handoff();
+                }
+            }
+        }
+
+        for (auto& stage : myStages) {
+            if (stage->ran) {
+                stage->busy = true;
+                stage->start.push(true);
+            }
+        }
+    }
+
+    bool success = true;
+    try {
+        success = myWorkers.empty() ? run_sequential() : run_parallel();
+    }
+    catch (...) {
+        wait_stages();
+        throw;
+    }
+
+    // The last stage can write to buffers the caller uses after run()
+    wait_stages();
+    if (myStagesException) {
+        std::exception_ptr exception;
+        std::swap(exception, myStagesException);
+        std::rethrow_exception(exception);
+    }
+    myFirstStageCompleted = success;
+
+    update_memory_usage();
+    // Once every stage has processed a frame with the new schedule
+    if (mySharingReportPending and success and
+            std::all_of(myStages.begin(), myStages.end(),
+                [](const std::unique_ptr<stage_t>& st) { return st->completed; })) {
+        report_sharing();
+    }
+
+    // The output is in the last stage
+    return myStages.empty() ? success : myStages.back()->completed;
+}
+
+void Flowgraph::set_share_buffers(bool share)
+{
+    myShareBuffers = share;
+    myScheduleValid = false;
+}
+
+Flowgraph::memory_usage_t Flowgraph::get_memory_usage() const
+{
+    std::lock_guard<std::mutex> lock(myNodesMutex);
+
+    memory_usage_t usage;
+    for (const auto& node : nodes) {
+        usage.nodes += node->plugin()->memory_usage();
+    }
+    usage.edge_buffers = myEdgeBufferBytes.load();
+    return usage;
+}
+
+void Flowgraph::update_memory_usage()
+{
+    // Shared buffers appear on several edges
+    myBufferScratch.clear();
+    for (const auto& edge : edges) {
+        myBufferScratch.push_back(edge->buffer().get());
+        if (edge->isStageBoundary()) {
+            myBufferScratch.push_back(edge->stageBuffer().get());
+        }
+    }
+    std::sort(myBufferScratch.begin(), myBufferScratch.end());
+    const auto end = std::unique(myBufferScratch.begin(), myBufferScratch.end());
+
+    size_t bytes = 0;
+    for (auto it = myBufferScratch.begin(); it != end; ++it) {
+        bytes += (*it)->getCapacity();
+    }
+    myEdgeBufferBytes.store(bytes);
+}
+
+void Flowgraph::report_sharing()
+{
+    // Every edge would otherwise need a buffer of its own length, the
+    // shared buffers are as long as the longest of their edges
+    size_t separate_bytes = 0;
+    size_t shared_bytes = 0;
+    size_t num_edges = 0;
+    for (const auto& slot : myBufferSlots) {
+        size_t slot_bytes = 0;
+        for (Edge *edge : slot) {
+            const size_t len = edge->srcNode()->outputLength(edge->buffer());
+            separate_bytes += len;
+            slot_bytes = std::max(slot_bytes, len);
+        }
+        shared_bytes += slot_bytes;
+        num_edges += slot.size();
+    }
+
+    etiLog.level(info) << "Flowgraph: " << num_edges << " edges share " <<
+        myBufferSlots.size() << " buffers, which saves " <<
+        (separate_bytes - shared_bytes) / 1024 << " kB of " <<
+        separate_bytes / 1024 << " kB";
+    mySharingReportPending = false;
+}
+
+std::vector<json::value_t> Flowgraph::get_latency_statistics() const
+{
+    std::lock_guard<std::mutex> lock(myNodesMutex);
+
+    std::vector<json::value_t> stats;
+    for (const auto& node : nodes) {
+        const auto& latency = node->latency();
+        auto node_map = make_shared<json::map_t>();
+        (*node_map)["name"].v = std::string(node->plugin()->name());
+        (*node_map)["count"].v = latency.count();
+        (*node_map)["mean_us"].v = latency.mean_us();
+        (*node_map)["p50_us"].v = latency.percentile_us(0.5);
+        (*node_map)["p99_us"].v = latency.percentile_us(0.99);
+        (*node_map)["max_us"].v = latency.max_us();
+
+        if (perf_counters::enabled()) {
+            const auto perf = node->perfStats();
+            (*node_map)["ipc"].v = perf_ipc(perf);
+            (*node_map)["llc_misses_per_kb"].v =
+                perf_per_kb(perf, perf.counts.llc_misses);
+            (*node_map)["branch_misses_per_kb"].v =
+                perf_per_kb(perf, perf.counts.branch_misses);
+        }
+
+        (*node_map)["memory_bytes"].v = node->plugin()->memory_usage();
+        (*node_map)["buffer_bytes"].v = node->bufferBytes();
+
+        if (alloc_tracking::mode() != alloc_tracking::mode_e::off) {
+            const auto allocs = node->allocStats();
+            (*node_map)["allocations"].v = allocs.allocations;
+            (*node_map)["allocated_bytes"].v = allocs.bytes;
+            (*node_map)["steady_allocations"].v = allocs.steady_allocations;
+        }
+        json::value_t v;
+        v.v = node_map;
+        stats.push_back(v);
+    }
+    return stats;
+}
+
+bool Flowgraph::run_sequential()
+{
+    auto start = std::chrono::steady_clock::now();
     time_t diff;
 
-    gettimeofday(&start, NULL);
-    for (const auto &node : nodes) {
+    for (Node *node : myFirstStageNodes) {
+        if (not node->isEnabled()) {
+            continue;
+        }
+
         int ret = node->process();
         PDEBUG(" ret: %i\n", ret);
-        gettimeofday(&stop, NULL);
-        diff = (stop.tv_sec - start.tv_sec) * 1000000 +
-            stop.tv_usec - start.tv_usec;
+        const auto stop = std::chrono::steady_clock::now();
+        diff = elapsed_us(start, stop);
         myProcessTime += diff;
         node->addProcessTime(diff);
         start = stop;
@@ -338,3 +843,478 @@ bool Flowgraph::run()
     return true;
 }
 
+/* The nodes that are neither before nor after the gate, but whose output
+ * only reaches the outputs through the nodes after it */
+static std::vector<size_t> gated_nodes(size_t gate, size_t num_nodes,
+        const std::vector<std::pair<size_t, size_t> >& deps)
+{
+    std::vector<std::vector<size_t> > consumers(num_nodes);
+    std::vector<std::vector<size_t> > producers(num_nodes);
+    for (const auto& dep : deps) {
+        consumers[dep.first].push_back(dep.second);
+        producers[dep.second].push_back(dep.first);
+    }
+
+    auto reachable = [&](const std::vector<std::vector<size_t> >& next) {
+        std::vector<bool> seen(num_nodes, false);
+        std::vector<size_t> todo = next[gate];
+        while (not todo.empty()) {
+            const size_t n = todo.back();
+            todo.pop_back();
+            if (not seen[n]) {
+                seen[n] = true;
+                todo.insert(todo.end(), next[n].begin(), next[n].end());
+            }
+        }
+        return seen;
+    };
+    const auto after = reachable(consumers);
+    const auto before = reachable(producers);
+
+    std::vector<bool> gated(num_nodes, false);
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (size_t n = 0; n < num_nodes; n++) {
+            if (n == gate or after[n] or before[n] or gated[n] or
+                    consumers[n].empty()) {
+                continue;
+            }
+            if (std::all_of(consumers[n].begin(), consumers[n].end(),
+                        [&](size_t c) { return after[c] or gated[c]; })) {
+                gated[n] = true;
+                changed = true;
+            }
+        }
+    }
+
+    std::vector<size_t> result;
+    for (size_t n = 0; n < num_nodes; n++) {
+        if (gated[n]) {
+            result.push_back(n);
+        }
+    }
+    return result;
+}
+
+void Flowgraph::schedule()
+{
+    auto index_of = [&](const shared_ptr<Node>& n) -> size_t {
+        auto it = std::find(nodes.begin(), nodes.end(), n);
+        assert(it != nodes.end());
+        return std::distance(nodes.begin(), it);
+    };
+
+    std::vector<std::pair<size_t, size_t> > deps;
+    for (const auto& edge : edges) {
+        deps.emplace_back(index_of(edge->srcNode()), index_of(edge->dstNode()));
+    }
+
+    // The stage of a node is the number of boundaries on the paths to it
+    std::vector<size_t> stage(nodes.size(), 0);
+    std::vector<bool> boundary;
+    for (const auto& edge : edges) {
+        boundary.push_back(edge->isStageBoundary());
+    }
+    // The generators, which are nodes without inputs like the
+    // PhaseReference, and the nodes that only depend on them, like the
+    // TII, are in the stage of the nodes they feed. They only run when
+    // that stage has a frame, and their edges do not cross a boundary.
+    std::vector<size_t> num_producers(nodes.size(), 0);
+    for (const auto& dep : deps) {
+        num_producers[dep.second]++;
+    }
+    std::vector<size_t> generated_inputs(nodes.size(), 0);
+    std::vector<bool> generated(nodes.size(), false);
+    for (size_t pass = 0; pass <= nodes.size(); pass++) {
+        std::fill(generated_inputs.begin(), generated_inputs.end(), 0);
+        for (const auto& dep : deps) {
+            if (generated[dep.first]) {
+                generated_inputs[dep.second]++;
+            }
+        }
+        for (size_t i = 0; i < nodes.size(); i++) {
+            generated[i] = (generated_inputs[i] == num_producers[i]);
+        }
+    }
+    for (size_t pass = 0; pass <= nodes.size(); pass++) {
+        for (size_t e = 0; e < deps.size(); e++) {
+            const size_t b = boundary[e] ? 1 : 0;
+            const size_t src = deps[e].first;
+            const size_t dst = deps[e].second;
+            stage[dst] = std::max(stage[dst], stage[src] + b);
+            if (generated[src] and stage[dst] > stage[src] + b) {
+                stage[src] = stage[dst] - b;
+            }
+        }
+    }
+    size_t num_stages = 1;
+    for (size_t e = 0; e < deps.size(); e++) {
+        if (stage[deps[e].second] !=
+                stage[deps[e].first] + (boundary[e] ? 1 : 0)) {
+            throw std::logic_error(std::string("Flowgraph: the paths to ") +
+                    nodes[deps[e].second]->plugin()->name() +
+                    " cross different numbers of stage boundaries");
+        }
+        num_stages = std::max(num_stages, stage[deps[e].second] + 1);
+    }
+
+    // The nodes whose output is only used after a node that can stop the
+    // run, like the BlockPartitioner, run after it, as in the order of the
+    // connections. The PhaseReference, the NullSymbol and the TII would
+    // otherwise be processed on every ETI frame instead of once per
+    // transmission frame, and the TII alternates its output from one call
+    // to the next.
+    std::vector<std::pair<size_t, size_t> > order_deps = deps;
+    for (size_t g = 0; g < nodes.size(); g++) {
+        if (not nodes[g]->plugin()->may_stop_run()) {
+            continue;
+        }
+        for (size_t n : gated_nodes(g, nodes.size(), deps)) {
+            if (stage[n] == stage[g]) {
+                order_deps.emplace_back(g, n);
+            }
+        }
+    }
+
+    // The level of a node is one more than the highest level of all
+    // nodes it receives data from, or that it has to run after. The nodes
+    // vector is usually sorted already, but we iterate until nothing
+    // changes to be robust against any connection order.
+    std::vector<size_t> level(nodes.size(), 0);
+    bool changed = true;
+    for (size_t pass = 0; changed; pass++) {
+        if (pass > nodes.size()) {
+            throw std::logic_error("Flowgraph contains a cycle");
+        }
+
+        changed = false;
+        for (const auto& dep : order_deps) {
+            if (level[dep.second] < level[dep.first] + 1) {
+                level[dep.second] = level[dep.first] + 1;
+                changed = true;
+            }
+        }
+    }
+
+    myLevels.clear();
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (stage[i] != 0) {
+            continue;
+        }
+        if (myLevels.size() <= level[i]) {
+            myLevels.resize(level[i] + 1);
+        }
+        // Keep the original node order inside a level
+        myLevels[level[i]].push_back(nodes[i].get());
+    }
+    myLevels.erase(std::remove_if(myLevels.begin(), myLevels.end(),
+                [](const std::vector<Node*>& l) { return l.empty(); }),
+            myLevels.end());
+
+    // The sequential run processes the nodes in the order of the vector.
+    // A node is followed by the nodes it feeds, as soon as they have all
+    // their inputs, so that a chain like the one of a subchannel runs back
+    // to back while its buffers are still in the cache, and not level by
+    // level. Like the levels, the order keeps the nodes that are only
+    // needed after a node that can stop the run behind it, the sequential
+    // run stops at the first node that returns 0.
+    std::vector<std::vector<size_t> > consumers(nodes.size());
+    std::vector<size_t> num_inputs(nodes.size(), 0);
+    for (const auto& dep : order_deps) {
+        consumers[dep.first].push_back(dep.second);
+        num_inputs[dep.second]++;
+    }
+
+    // The ready nodes are a stack, the first of them on top
+    std::vector<size_t> order;
+    std::vector<size_t> ready;
+    for (size_t i = nodes.size(); i-- > 0;) {
+        if (num_inputs[i] == 0) {
+            ready.push_back(i);
+        }
+    }
+    while (not ready.empty()) {
+        const size_t i = ready.back();
+        ready.pop_back();
+        order.push_back(i);
+        for (auto c = consumers[i].rbegin(); c != consumers[i].rend(); ++c) {
+            if (--num_inputs[*c] == 0) {
+                ready.push_back(*c);
+            }
+        }
+    }
+    assert(order.size() == nodes.size());
+
+    // A stage thread is only replaced when the number of stages changes,
+    // so that the frames in the pipeline are not lost
+    if (myStages.size() != num_stages - 1) {
+        stop_stages();
+        for (size_t s = 1; s < num_stages; s++) {
+            myStages.push_back(std::make_unique<stage_t>());
+            stage_t *st = myStages.back().get();
+            st->thread = std::thread(&Flowgraph::stage_thread, this, st);
+        }
+    }
+
+    myFirstStageNodes.clear();
+    for (auto& st : myStages) {
+        st->nodes.clear();
+        st->inputs.clear();
+    }
+    for (size_t e = 0; e < edges.size(); e++) {
+        if (boundary[e]) {
+            myStages[stage[deps[e].second] - 1]->inputs.push_back(edges[e].get());
+        }
+    }
+
+    std::vector<std::shared_ptr<Node> > sorted_nodes;
+    for (size_t i : order) {
+        sorted_nodes.push_back(nodes[i]);
+        if (stage[i] == 0) {
+            myFirstStageNodes.push_back(nodes[i].get());
+        }
+        else {
+            myStages[stage[i] - 1]->nodes.push_back(nodes[i].get());
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(myNodesMutex);
+        nodes = std::move(sorted_nodes);
+    }
+
+    etiLog.level(debug) << "Flowgraph scheduled " << nodes.size() <<
+        " nodes in " << myLevels.size() << " levels on " <<
+        myWorkers.size() << " worker threads, in " << num_stages <<
+        " pipeline stages";
+
+    // The order in which every stage processes its nodes
+    auto dump_order = [](const std::vector<Node*>& stage_nodes) {
+        std::stringstream ss;
+        for (Node *node : stage_nodes) {
+            ss << (ss.tellp() > 0 ? " " : "") << node->plugin()->name();
+        }
+        return ss.str();
+    };
+    etiLog.level(debug) << "Flowgraph stage 0 order: " <<
+        dump_order(myFirstStageNodes);
+    for (size_t s = 0; s < myStages.size(); s++) {
+        etiLog.level(debug) << "Flowgraph stage " << s + 1 << " order: " <<
+            dump_order(myStages[s]->nodes);
+    }
+
+    myBufferSlots.clear();
+    if (myShareBuffers) {
+        // The worker threads do not follow the order of the stage
+        if (myWorkers.empty()) {
+            share_buffers(myFirstStageNodes);
+        }
+        for (const auto& st : myStages) {
+            share_buffers(st->nodes);
+        }
+        mySharingReportPending = true;
+    }
+
+    myScheduleValid = true;
+}
+
+void Flowgraph::share_buffers(const std::vector<Node*>& stage_nodes)
+{
+    auto position = [&](const Node *node) -> size_t {
+        auto it = std::find(stage_nodes.begin(), stage_nodes.end(), node);
+        return std::distance(stage_nodes.begin(), it);
+    };
+
+    // Every edge is needed from the position of its source to the
+    // position of its destination
+    struct interval_t {
+        size_t start;
+        size_t end;
+        Edge *edge;
+    };
+    std::vector<interval_t> intervals;
+    for (const auto& edge : edges) {
+        const size_t start = position(edge->srcNode().get());
+        if (start == stage_nodes.size() or edge->isStageBoundary() or
+                edge->srcNode()->isSource()) {
+            continue;
+        }
+        intervals.push_back({start, position(edge->dstNode().get()),
+                edge.get()});
+    }
+    std::sort(intervals.begin(), intervals.end(),
+            [](const interval_t& a, const interval_t& b) {
+                return a.start < b.start or
+                    (a.start == b.start and a.end < b.end); });
+
+    // Greedy interval colouring, which needs the fewest buffers. An edge
+    // can take a buffer whose last edge ended before it starts.
+    struct slot_t {
+        Buffer::sptr buffer;
+        size_t end;
+        std::vector<Edge*> edges;
+    };
+    std::vector<slot_t> slots;
+    for (const auto& interval : intervals) {
+        auto slot = std::find_if(slots.begin(), slots.end(),
+                [&](const slot_t& sl) { return sl.end < interval.start; });
+        if (slot == slots.end()) {
+            // A buffer shared in a previous schedule cannot start two slots
+            Buffer::sptr buffer = interval.edge->buffer();
+            for (const auto& sl : slots) {
+                if (sl.buffer == buffer) {
+                    buffer = make_shared<Buffer>();
+                    break;
+                }
+            }
+            for (const auto& sl : myBufferSlots) {
+                if (sl.front()->buffer() == buffer) {
+                    buffer = make_shared<Buffer>();
+                    break;
+                }
+            }
+            slots.push_back({buffer, interval.end, {}});
+            slot = slots.end() - 1;
+        }
+        interval.edge->shareBuffer(slot->buffer);
+        slot->end = interval.end;
+        slot->edges.push_back(interval.edge);
+    }
+
+    for (auto& slot : slots) {
+        myBufferSlots.push_back(std::move(slot.edges));
+    }
+    etiLog.level(debug) << "Flowgraph: " << intervals.size() <<
+        " edges of a stage share " << slots.size() << " buffers";
+}
+
+bool Flowgraph::run_parallel()
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    bool success = true;
+    std::exception_ptr exception;
+
+    for (const auto& level : myLevels) {
+        // Give all but the first node to the workers, and process the first
+        // one in this thread.
+        for (size_t i = 1; i < level.size(); i++) {
+            myJobQueue.push(level[i]);
+        }
+
+        try {
+            if (process_timed(level[0]) == 0) {
+                success = false;
+            }
+        }
+        catch (...) {
+            exception = std::current_exception();
+        }
+
+        for (size_t i = 1; i < level.size(); i++) {
+            job_result_t result;
+            myResultQueue.wait_and_pop(result);
+            if (result.exception and not exception) {
+                exception = result.exception;
+            }
+            else if (result.ret == 0) {
+                success = false;
+            }
+        }
+
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+
+        if (not success) {
+            break;
+        }
+    }
+
+    const auto stop = std::chrono::steady_clock::now();
+    myProcessTime += elapsed_us(start, stop);
+
+    return success;
+}
+
+void Flowgraph::worker_thread()
+{
+    set_thread_name("flowgraph");
+    set_realtime_prio(1);
+    set_thread_placement("flowgraph");
+
+    while (true) {
+        Node *node = nullptr;
+        myJobQueue.wait_and_pop(node);
+
+        if (node == nullptr) {
+            break;
+        }
+
+        job_result_t result;
+        try {
+            result.ret = process_timed(node);
+        }
+        catch (...) {
+            result.exception = std::current_exception();
+        }
+        myResultQueue.push(std::move(result));
+    }
+}
+
+void Flowgraph::wait_stages()
+{
+    for (auto& stage : myStages) {
+        if (not stage->busy) {
+            continue;
+        }
+
+        job_result_t result;
+        stage->done.wait_and_pop(result);
+        stage->busy = false;
+        stage->completed = (not result.exception and result.ret != 0);
+        if (result.exception and not myStagesException) {
+            myStagesException = result.exception;
+        }
+    }
+}
+
+void Flowgraph::stop_stages()
+{
+    wait_stages();
+    for (auto& stage : myStages) {
+        stage->start.push(false);
+        stage->thread.join();
+    }
+    myStages.clear();
+}
+
+void Flowgraph::stage_thread(stage_t *stage)
+{
+    set_thread_name("flowgraphstage");
+    set_realtime_prio(1);
+    set_thread_placement("flowgraphstage", "pipeline");
+
+    while (true) {
+        bool run_stage = false;
+        stage->start.wait_and_pop(run_stage);
+
+        if (not run_stage) {
+            break;
+        }
+
+        job_result_t result;
+        result.ret = 1;
+        try {
+            for (Node *node : stage->nodes) {
+                if (process_timed(node) == 0) {
+                    result.ret = 0;
+                    break;
+                }
+            }
+        }
+        catch (...) {
+            result.exception = std::current_exception();
+        }
+        stage->done.push(std::move(result));
+    }
+}
@@ -31,15 +31,58 @@
 #endif
 
 #include "ModPlugin.h"
+#include "ThreadsafeQueue.h"
+#include "Json.h"
+#include "PerfCounters.h"
+#include "AllocationTracker.h"
 
 #include <memory>
 #include <sys/types.h>
+#include <array>
 #include <vector>
 #include <list>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <exception>
 #include <cstdio>
+#include <cstdint>
 
 using Metadata_vec_sptr = std::shared_ptr<std::vector<flowgraph_metadata> >;
 
+/* Histogram of node processing durations in microseconds. The bins are
+ * logarithmic with four bins per octave, which gives a resolution of
+ * about 20% over the range from 1us to 16s. Can be read from another
+ * thread while the flowgraph runs.
+ */
+class LatencyHistogram
+{
+public:
+    void add(uint64_t duration_us);
+
+    uint64_t count() const;
+    uint64_t max_us() const;
+    double mean_us() const;
+
+    // Return the upper bound of the bin containing the given percentile,
+    // p being in the range [0, 1]
+    uint64_t percentile_us(double p) const;
+
+private:
+    static constexpr size_t bins_per_octave = 4;
+    static constexpr size_t num_octaves = 24;
+    static constexpr size_t num_bins = bins_per_octave * num_octaves;
+
+    static size_t bin_index(uint64_t duration_us);
+    static uint64_t bin_upper_bound(size_t index);
+
+    mutable std::mutex m_mutex;
+    std::array<uint64_t, num_bins> m_bins = {};
+    uint64_t m_count = 0;
+    uint64_t m_sum_us = 0;
+    uint64_t m_max_us = 0;
+};
+
 class Node
 {
 public:
@@ -53,6 +96,39 @@ public:
     int process();
     time_t processTime() const;
     void addProcessTime(time_t time);
+    const LatencyHistogram& latency() const { return myLatency; }
+
+    // The hardware performance counters around the processing of the
+    // plugin, when enabled, and the number of bytes it wrote to its
+    // outputs, summed over all calls
+    struct perf_stats_t {
+        uint64_t calls = 0;
+        uint64_t output_bytes = 0;
+        perf_counters::counts_t counts;
+    };
+    perf_stats_t perfStats() const;
+
+    // The heap allocations of the plugin, when tracking is enabled
+    alloc_tracking::counts_t allocStats() const;
+
+    // A disabled node is not processed, its output buffers keep their
+    // contents, unless the flowgraph shares them with other edges
+    bool isEnabled() const { return myEnabled; }
+    void setEnabled(bool enabled) { myEnabled = enabled; }
+
+    // A source has no inputs
+    bool isSource() const { return myInputBuffers.empty(); }
+
+    // Capacity of the output buffers after the last call to process(),
+    // safe to call from another thread
+    size_t bufferBytes() const { return myBufferBytes.load(); }
+
+    // Length of an output buffer after the last call to process(), 0 if
+    // the buffer is not an output of the node
+    size_t outputLength(const Buffer::sptr& buffer) const;
+
+    // Replace a buffer in the inputs and the outputs, at the same position
+    void replaceBuffer(const Buffer::sptr& oldBuffer, Buffer::sptr& newBuffer);
 
     void addOutputBuffer(Buffer::sptr& buffer, Metadata_vec_sptr& md);
     void removeOutputBuffer(Buffer::sptr& buffer, Metadata_vec_sptr& md);
@@ -72,42 +148,203 @@ protected:
 
     std::shared_ptr<ModPlugin> myPlugin;
     time_t myProcessTime = 0;
+    LatencyHistogram myLatency;
+    bool myEnabled = true;
+
+    std::vector<size_t> myOutputLengths;
+    std::atomic<size_t> myBufferBytes = ATOMIC_VAR_INIT(0);
+
+    mutable std::mutex myPerfMutex;
+    perf_stats_t myPerfStats;
+    alloc_tracking::counts_t myAllocStats;
+    bool myAllocWarned = false;
+
+    // Index of the plugin name in the frame trace
+    uint8_t myTraceName = 0;
 };
 
 
+/* The edge between two nodes in different pipeline stages has a buffer
+ * for each node, and handoff() moves the data and metadata written by the
+ * source node to the destination node. */
 class Edge
 {
 public:
-    Edge(std::shared_ptr<Node>& src, std::shared_ptr<Node>& dst);
+    Edge(std::shared_ptr<Node>& src, std::shared_ptr<Node>& dst,
+            bool stage_boundary = false);
     ~Edge();
     Edge(const Edge&) = delete;
     Edge& operator=(const Edge&) = delete;
 
+    std::shared_ptr<Node> srcNode() const { return mySrcNode; }
+    std::shared_ptr<Node> dstNode() const { return myDstNode; }
+
+    bool isStageBoundary() const { return myStageBuffer != nullptr; }
+    void handoff();
+
+    // The buffer the source node writes, and for a stage boundary the
+    // one the destination node reads
+    Buffer::sptr buffer() const { return myBuffer; }
+    Buffer::sptr stageBuffer() const { return myStageBuffer; }
+
+    // Make both nodes use the given buffer instead, only for edges that
+    // are not a stage boundary
+    void shareBuffer(Buffer::sptr& buffer);
+
 protected:
     std::shared_ptr<Node> mySrcNode;
     std::shared_ptr<Node> myDstNode;
     std::shared_ptr<Buffer> myBuffer;
     std::shared_ptr<std::vector<flowgraph_metadata> > myMetadata;
+
+    // The input of the destination node, only for a stage boundary
+    std::shared_ptr<Buffer> myStageBuffer;
+    std::shared_ptr<std::vector<flowgraph_metadata> > myStageMetadata;
 };
 
 
+/* An edge marked as a stage boundary cuts the flowgraph into pipeline
+ * stages. The nodes after the boundary are in the next stage, which has
+ * its own thread and works on the data the previous stage gave during
+ * the previous call to run(), so that all stages run at the same time,
+ * and the duration of run() is the one of the slowest stage.
+ * Every stage adds one run() of latency. The metadata travels with the
+ * data over the boundary. All paths to a node must cross the same number
+ * of boundaries.
+ */
 class Flowgraph
 {
 public:
-    Flowgraph(bool showProcessTime);
+    /* When numThreads is 0, all nodes of the first stage are processed
+     * sequentially in the thread calling run(). Otherwise, nodes that do
+     * not depend on each other are distributed over numThreads worker
+     * threads. The other stages are processed sequentially in their
+     * thread. */
+    Flowgraph(bool showProcessTime, size_t numThreads = 0);
     virtual ~Flowgraph();
     Flowgraph(const Flowgraph&) = delete;
     Flowgraph& operator=(const Flowgraph&) = delete;
 
     void connect(std::shared_ptr<ModPlugin> input,
-                 std::shared_ptr<ModPlugin> output);
+                 std::shared_ptr<ModPlugin> output,
+                 bool stage_boundary = false);
+
+    /* Remove the edge between input and output. The nodes stay in the
+     * flowgraph. */
+    void disconnect(std::shared_ptr<ModPlugin> input,
+                    std::shared_ptr<ModPlugin> output);
+
+    /* Remove the node of plugin and all its edges. Used to change a part
+     * of the flowgraph while the other nodes keep their state. */
+    void remove(std::shared_ptr<ModPlugin> plugin);
+
+    /* Stop or resume the processing of the node of plugin, e.g. to run
+     * only a part of the flowgraph. Must be called from the thread that
+     * calls run(). */
+    void set_enabled(std::shared_ptr<ModPlugin> plugin, bool enabled);
+
+    /* Process one frame in the first stage, and the previous frame of
+     * every stage in the next one, at the same time. Returns when all
+     * stages are done, false if a node returned 0. */
     bool run();
 
+    /* Return name, number of calls, p50, p99 and max processing time
+     * for every node, in flowgraph order. Safe to call from another thread. */
+    std::vector<json::value_t> get_latency_statistics() const;
+
+    /* Let the edges whose data is not needed at the same time use the
+     * same buffer, which saves memory at the price of a less cache
+     * friendly layout. An edge is needed from the moment its source node
+     * runs until its destination node has run, in the order of the pipeline
+     * stage. The edges from nodes without inputs, which may keep their
+     * output from one run to the next, and the stage boundaries are never
+     * shared. The outputs of disabled nodes are not kept either. The first
+     * stage only shares buffers without worker threads. Must be called
+     * before the first run(). */
+    void set_share_buffers(bool share);
+
+    /* The memory of the nodes, see ModPlugin::memory_usage(), and of the
+     * buffers of the edges after the last run(), each buffer counted once.
+     * Safe to call from another thread. */
+    struct memory_usage_t {
+        size_t nodes = 0;
+        size_t edge_buffers = 0;
+    };
+    memory_usage_t get_memory_usage() const;
+
 protected:
     std::vector<std::shared_ptr<Node> > nodes;
     std::vector<std::shared_ptr<Edge> > edges;
     time_t myProcessTime = 0;
     bool myShowProcessTime;
+
+private:
+    // Protects the nodes vector against concurrent
+    // get_latency_statistics() and connect()
+    mutable std::mutex myNodesMutex;
+
+    bool run_sequential();
+    bool run_parallel();
+
+    // Group the nodes into levels, such that all nodes of a level only
+    // depend on nodes of previous levels, and sort the nodes by level.
+    // The nodes whose output is only used after a node that may stop the
+    // run come after it, see ModPlugin::may_stop_run().
+    void schedule();
+    bool myScheduleValid = false;
+    // The nodes of the first stage, sorted, and grouped into levels
+    std::vector<Node*> myFirstStageNodes;
+    std::vector<std::vector<Node*> > myLevels;
+
+    // Give the edges of a stage that are not needed at the same time the
+    // same buffers, and add them to myBufferSlots
+    void share_buffers(const std::vector<Node*>& stage_nodes);
+    bool myShareBuffers = false;
+    // The edges that use the same buffer, for the report after the first
+    // run that follows the schedule
+    std::vector<std::vector<Edge*> > myBufferSlots;
+    bool mySharingReportPending = false;
+    void report_sharing();
+
+    // Sum the capacity of the edge buffers after run()
+    void update_memory_usage();
+    std::vector<Buffer*> myBufferScratch;
+    std::atomic<size_t> myEdgeBufferBytes = ATOMIC_VAR_INIT(0);
+
+    struct job_result_t {
+        int ret = 0;
+        std::exception_ptr exception;
+    };
+
+    ThreadsafeQueue<Node*> myJobQueue;
+    ThreadsafeQueue<job_result_t> myResultQueue;
+    std::vector<std::thread> myWorkers;
+    void worker_thread();
+
+    struct stage_t {
+        // In flowgraph order
+        std::vector<Node*> nodes;
+        // The stage boundaries to the nodes of the stage
+        std::vector<Edge*> inputs;
+        // Whether the stage got a frame in the last run, and whether it
+        // completed it without a node that returned 0
+        bool ran = false;
+        bool completed = false;
+        bool busy = false;
+        ThreadsafeQueue<bool> start;
+        ThreadsafeQueue<job_result_t> done;
+        std::thread thread;
+    };
+
+    // The stages after the first one
+    std::vector<std::unique_ptr<stage_t> > myStages;
+    bool myFirstStageCompleted = false;
+    std::exception_ptr myStagesException;
+
+    // Wait until no stage is processing anymore, and collect the results
+    void wait_stages();
+    void stop_stages();
+    void stage_thread(stage_t *stage);
 };
 
 
@@ -27,38 +27,710 @@
  */
 
 #include "FormatConverter.h"
+#include "CpuFeatures.h"
 #include "PcDebug.h"
 #include "Log.h"
 
+#include <algorithm>
 #include <stdexcept>
 #include <cstring>
 #include <assert.h>
 #include <sys/types.h>
-#if defined(__ARM_NEON)
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
 #include <arm_neon.h>
 #endif
 
-FormatConverter::FormatConverter(bool input_is_complexfix_wide, const std::string& format_out) :
+/* The conversion can be done in place, with output samples written over
+ * input samples that have already been read. Tell the compiler that the
+ * pointers of different types may alias. */
+using float_alias_t = float __attribute__((__may_alias__));
+using int32_alias_t = int32_t __attribute__((__may_alias__));
+using int16_alias_t = int16_t __attribute__((__may_alias__));
+using int8_alias_t = int8_t __attribute__((__may_alias__));
+using uint8_alias_t = uint8_t __attribute__((__may_alias__));
+
+/* The converters from floating-point samples truncate towards zero, and
+ * saturate to the range of the format. They return the number of values
+ * that were clipped. The vectorised ones clip before the conversion, which
+ * gives the same result, and finish the last values with the scalar one.
+ *
+ * They can convert in place, a vector is always loaded before the output
+ * overwrites it.
+ */
+using float_converter_t = FormatConverter::float_converter_t;
+
+struct float_converters_t {
+    float_converter_t s16;
+    float_converter_t sc16q11;
+    float_converter_t s8;
+    float_converter_t u8;
+    float_converter_t sc12;
+    const char *name;
+};
+
+template<typename T, size_t (*kernel)(const float_alias_t*, T*, size_t)>
+static size_t float_converter(const void *in, void *out, size_t n)
+{
+    return kernel(static_cast<const float_alias_t*>(in), static_cast<T*>(out), n);
+}
+
+/* The 16-bit converters saturate to [lo, hi], the full range for s16, and
+ * the 12-bit range for sc16q11, the SC16 Q11 format of libbladeRF. */
+template<int16_t lo = INT16_MIN, int16_t hi = INT16_MAX>
+static size_t to_s16_scalar(const float_alias_t *in, int16_alias_t *out,
+        size_t start, size_t stop)
+{
+    size_t num_clipped = 0;
+    for (size_t i = start; i < stop; i++) {
+        if (in[i] < lo) {
+            out[i] = lo;
+            num_clipped++;
+        }
+        else if (in[i] > hi) {
+            out[i] = hi;
+            num_clipped++;
+        }
+        else {
+            out[i] = in[i];
+        }
+    }
+    return num_clipped;
+}
+
+static size_t to_u8_scalar(const float_alias_t *in, uint8_alias_t *out,
+        size_t start, size_t stop)
+{
+    size_t num_clipped = 0;
+    for (size_t i = start; i < stop; i++) {
+        const auto samp = in[i] + 128.0f;
+        if (samp < 0) {
+            out[i] = 0;
+            num_clipped++;
+        }
+        else if (samp > UINT8_MAX) {
+            out[i] = UINT8_MAX;
+            num_clipped++;
+        }
+        else {
+            out[i] = samp;
+        }
+    }
+    return num_clipped;
+}
+
+static size_t to_s8_scalar(const float_alias_t *in, int8_alias_t *out,
+        size_t start, size_t stop)
+{
+    size_t num_clipped = 0;
+    for (size_t i = start; i < stop; i++) {
+        if (in[i] < INT8_MIN) {
+            out[i] = INT8_MIN;
+            num_clipped++;
+        }
+        else if (in[i] > INT8_MAX) {
+            out[i] = INT8_MAX;
+            num_clipped++;
+        }
+        else {
+            out[i] = in[i];
+        }
+    }
+    return num_clipped;
+}
+
+/* sc12 packs a complex sample with 12-bit I and Q into three bytes, like
+ * the CS12 format of SoapySDR: the low byte of I, then the high nibble of I
+ * with the low nibble of Q above it, then the high byte of Q. */
+constexpr int16_t sc12_min = -2048;
+constexpr int16_t sc12_max = 2047;
+
+static inline void pack_sc12(int16_t i, int16_t q, uint8_alias_t *out)
+{
+    const uint16_t ui = static_cast<uint16_t>(i) & 0x0fff;
+    const uint16_t uq = static_cast<uint16_t>(q) & 0x0fff;
+    out[0] = ui & 0xff;
+    out[1] = (ui >> 8) | ((uq & 0x0f) << 4);
+    out[2] = uq >> 4;
+}
+
+// start and stop are even, they count real and imaginary parts
+static size_t to_sc12_scalar(const float_alias_t *in, uint8_alias_t *out,
+        size_t start, size_t stop)
+{
+    size_t num_clipped = 0;
+    for (size_t i = start; i < stop; i += 2) {
+        int16_t iq[2];
+        for (size_t j = 0; j < 2; j++) {
+            if (in[i + j] < sc12_min) {
+                iq[j] = sc12_min;
+                num_clipped++;
+            }
+            else if (in[i + j] > sc12_max) {
+                iq[j] = sc12_max;
+                num_clipped++;
+            }
+            else {
+                iq[j] = in[i + j];
+            }
+        }
+        pack_sc12(iq[0], iq[1], &out[3 * i / 2]);
+    }
+    return num_clipped;
+}
+
+template<typename T, size_t (*kernel)(const float_alias_t*, T*, size_t, size_t)>
+static size_t scalar_float_converter(const void *in, void *out, size_t n)
+{
+    return kernel(static_cast<const float_alias_t*>(in), static_cast<T*>(out), 0, n);
+}
+
+#if defined(__SSE2__)
+/* Clip to [lo, hi] and convert. Every clipped value subtracts a mask of all
+ * ones, i.e. -1, from count. */
+static inline __m128i clip_sse(__m128 v, __m128 lo, __m128 hi, __m128i& count)
+{
+    const __m128 clipped = _mm_or_ps(_mm_cmplt_ps(v, lo), _mm_cmpgt_ps(v, hi));
+    count = _mm_sub_epi32(count, _mm_castps_si128(clipped));
+    return _mm_cvttps_epi32(_mm_min_ps(hi, _mm_max_ps(lo, v)));
+}
+
+static inline size_t sum_sse(__m128i count)
+{
+    uint32_t counts[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(counts), count);
+    return counts[0] + counts[1] + counts[2] + counts[3];
+}
+
+template<int16_t lo_ = INT16_MIN, int16_t hi_ = INT16_MAX>
+static size_t to_s16_sse(const float_alias_t *in, int16_alias_t *out, size_t n)
+{
+    const __m128 lo = _mm_set1_ps(lo_);
+    const __m128 hi = _mm_set1_ps(hi_);
+    __m128i count = _mm_setzero_si128();
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m128i a = clip_sse(_mm_loadu_ps(&in[i]), lo, hi, count);
+        const __m128i b = clip_sse(_mm_loadu_ps(&in[i + 4]), lo, hi, count);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&out[i]),
+                _mm_packs_epi32(a, b));
+    }
+    return sum_sse(count) + to_s16_scalar<lo_, hi_>(in, out, i, n);
+}
+
+static size_t to_u8_sse(const float_alias_t *in, uint8_alias_t *out, size_t n)
+{
+    const __m128 offset = _mm_set1_ps(128.0f);
+    const __m128 lo = _mm_setzero_ps();
+    const __m128 hi = _mm_set1_ps(UINT8_MAX);
+    __m128i count = _mm_setzero_si128();
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v[4];
+        for (size_t j = 0; j < 4; j++) {
+            v[j] = clip_sse(_mm_add_ps(_mm_loadu_ps(&in[i + 4 * j]), offset),
+                    lo, hi, count);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&out[i]),
+                _mm_packus_epi16(_mm_packs_epi32(v[0], v[1]),
+                    _mm_packs_epi32(v[2], v[3])));
+    }
+    return sum_sse(count) + to_u8_scalar(in, out, i, n);
+}
+
+static size_t to_s8_sse(const float_alias_t *in, int8_alias_t *out, size_t n)
+{
+    const __m128 lo = _mm_set1_ps(INT8_MIN);
+    const __m128 hi = _mm_set1_ps(INT8_MAX);
+    __m128i count = _mm_setzero_si128();
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v[4];
+        for (size_t j = 0; j < 4; j++) {
+            v[j] = clip_sse(_mm_loadu_ps(&in[i + 4 * j]), lo, hi, count);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&out[i]),
+                _mm_packs_epi16(_mm_packs_epi32(v[0], v[1]),
+                    _mm_packs_epi32(v[2], v[3])));
+    }
+    return sum_sse(count) + to_s8_scalar(in, out, i, n);
+}
+
+static size_t to_sc12_sse(const float_alias_t *in, uint8_alias_t *out, size_t n)
+{
+    const __m128 lo = _mm_set1_ps(sc12_min);
+    const __m128 hi = _mm_set1_ps(sc12_max);
+    const __m128i mask_i = _mm_set1_epi32(0x000fff);
+    const __m128i mask_q = _mm_set1_epi32(0xfff000);
+    const __m128i mask_low = _mm_set_epi32(0, 0xffffff, 0, 0xffffff);
+    const __m128i mask_high = _mm_set_epi32(0xffff, 0xff000000, 0xffff, 0xff000000);
+    __m128i count = _mm_setzero_si128();
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m128i a = clip_sse(_mm_loadu_ps(&in[i]), lo, hi, count);
+        const __m128i b = clip_sse(_mm_loadu_ps(&in[i + 4]), lo, hi, count);
+        // I in the low and Q in the high 16 bits of every 32-bit lane, then
+        // the 24 bits of the packed sample
+        const __m128i iq = _mm_packs_epi32(a, b);
+        const __m128i w = _mm_or_si128(_mm_and_si128(iq, mask_i),
+                _mm_and_si128(_mm_srli_epi32(iq, 4), mask_q));
+        // Two packed samples in the low 48 bits of every 64-bit lane
+        const __m128i w2 = _mm_or_si128(_mm_and_si128(w, mask_low),
+                _mm_and_si128(_mm_srli_epi64(w, 8), mask_high));
+        uint8_t bytes[16];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(bytes), w2);
+        memcpy(&out[3 * i / 2], bytes, 6);
+        memcpy(&out[3 * i / 2 + 6], bytes + 8, 6);
+    }
+    return sum_sse(count) + to_sc12_scalar(in, out, i, n);
+}
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+// Compiled for AVX2 even if the rest of the program isn't, and only used if
+// the CPU supports it.
+#  define HAVE_FORMAT_CONVERTER_DISPATCH 1
+
+__attribute__((target("avx2")))
+static inline __m256i clip_avx2(__m256 v, __m256 lo, __m256 hi, __m256i& count)
+{
+    const __m256 clipped = _mm256_or_ps(
+            _mm256_cmp_ps(v, lo, _CMP_LT_OQ), _mm256_cmp_ps(v, hi, _CMP_GT_OQ));
+    count = _mm256_sub_epi32(count, _mm256_castps_si256(clipped));
+    return _mm256_cvttps_epi32(_mm256_min_ps(hi, _mm256_max_ps(lo, v)));
+}
+
+__attribute__((target("avx2")))
+static inline size_t sum_avx2(__m256i count)
+{
+    uint32_t counts[8];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(counts), count);
+    size_t sum = 0;
+    for (const auto c : counts) {
+        sum += c;
+    }
+    return sum;
+}
+
+/* The packs work within each 128-bit half, the permutations restore the
+ * order of the samples. */
+template<int16_t lo_ = INT16_MIN, int16_t hi_ = INT16_MAX>
+__attribute__((target("avx2")))
+static size_t to_s16_avx2(const float_alias_t *in, int16_alias_t *out, size_t n)
+{
+    const __m256 lo = _mm256_set1_ps(lo_);
+    const __m256 hi = _mm256_set1_ps(hi_);
+    __m256i count = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m256i a = clip_avx2(_mm256_loadu_ps(&in[i]), lo, hi, count);
+        const __m256i b = clip_avx2(_mm256_loadu_ps(&in[i + 8]), lo, hi, count);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(&out[i]),
+                _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8));
+    }
+    return sum_avx2(count) + to_s16_scalar<lo_, hi_>(in, out, i, n);
+}
+
+__attribute__((target("avx2")))
+static size_t to_u8_avx2(const float_alias_t *in, uint8_alias_t *out, size_t n)
+{
+    const __m256 offset = _mm256_set1_ps(128.0f);
+    const __m256 lo = _mm256_setzero_ps();
+    const __m256 hi = _mm256_set1_ps(UINT8_MAX);
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    __m256i count = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v[4];
+        for (size_t j = 0; j < 4; j++) {
+            v[j] = clip_avx2(_mm256_add_ps(_mm256_loadu_ps(&in[i + 8 * j]), offset),
+                    lo, hi, count);
+        }
+        const __m256i packed = _mm256_packus_epi16(
+                _mm256_packs_epi32(v[0], v[1]), _mm256_packs_epi32(v[2], v[3]));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(&out[i]),
+                _mm256_permutevar8x32_epi32(packed, order));
+    }
+    return sum_avx2(count) + to_u8_scalar(in, out, i, n);
+}
+
+__attribute__((target("avx2")))
+static size_t to_s8_avx2(const float_alias_t *in, int8_alias_t *out, size_t n)
+{
+    const __m256 lo = _mm256_set1_ps(INT8_MIN);
+    const __m256 hi = _mm256_set1_ps(INT8_MAX);
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    __m256i count = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v[4];
+        for (size_t j = 0; j < 4; j++) {
+            v[j] = clip_avx2(_mm256_loadu_ps(&in[i + 8 * j]), lo, hi, count);
+        }
+        const __m256i packed = _mm256_packs_epi16(
+                _mm256_packs_epi32(v[0], v[1]), _mm256_packs_epi32(v[2], v[3]));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(&out[i]),
+                _mm256_permutevar8x32_epi32(packed, order));
+    }
+    return sum_avx2(count) + to_s8_scalar(in, out, i, n);
+}
+
+__attribute__((target("avx2")))
+static size_t to_sc12_avx2(const float_alias_t *in, uint8_alias_t *out, size_t n)
+{
+    const __m256 lo = _mm256_set1_ps(sc12_min);
+    const __m256 hi = _mm256_set1_ps(sc12_max);
+    const __m256i mask_i = _mm256_set1_epi32(0x000fff);
+    const __m256i mask_q = _mm256_set1_epi32(0xfff000);
+    // The three low bytes of every 32-bit lane, within each 128-bit half
+    const __m256i compact = _mm256_setr_epi8(
+            0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+            0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    __m256i count = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m256i a = clip_avx2(_mm256_loadu_ps(&in[i]), lo, hi, count);
+        const __m256i b = clip_avx2(_mm256_loadu_ps(&in[i + 8]), lo, hi, count);
+        const __m256i iq = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8);
+        const __m256i w = _mm256_or_si256(_mm256_and_si256(iq, mask_i),
+                _mm256_and_si256(_mm256_srli_epi32(iq, 4), mask_q));
+        uint8_t bytes[32];
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(bytes),
+                _mm256_shuffle_epi8(w, compact));
+        memcpy(&out[3 * i / 2], bytes, 12);
+        memcpy(&out[3 * i / 2 + 12], bytes + 16, 12);
+    }
+    return sum_avx2(count) + to_sc12_scalar(in, out, i, n);
+}
+#endif
+
+#if defined(__ARM_NEON)
+static inline int32x4_t clip_neon(float32x4_t v, float32x4_t lo,
+        float32x4_t hi, uint32x4_t& count)
+{
+    const uint32x4_t clipped = vorrq_u32(vcltq_f32(v, lo), vcgtq_f32(v, hi));
+    count = vsubq_u32(count, clipped);
+    return vcvtq_s32_f32(vminq_f32(hi, vmaxq_f32(lo, v)));
+}
+
+static inline size_t sum_neon(uint32x4_t count)
+{
+    uint32_t counts[4];
+    vst1q_u32(counts, count);
+    return counts[0] + counts[1] + counts[2] + counts[3];
+}
+
+template<int16_t lo_ = INT16_MIN, int16_t hi_ = INT16_MAX>
+static size_t to_s16_neon(const float_alias_t *in, int16_alias_t *out, size_t n)
+{
+    const float32x4_t lo = vdupq_n_f32(lo_);
+    const float32x4_t hi = vdupq_n_f32(hi_);
+    uint32x4_t count = vdupq_n_u32(0);
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const int32x4_t a = clip_neon(vld1q_f32(&in[i]), lo, hi, count);
+        const int32x4_t b = clip_neon(vld1q_f32(&in[i + 4]), lo, hi, count);
+        vst1q_s16(&out[i], vcombine_s16(vmovn_s32(a), vmovn_s32(b)));
+    }
+    return sum_neon(count) + to_s16_scalar<lo_, hi_>(in, out, i, n);
+}
+
+static size_t to_u8_neon(const float_alias_t *in, uint8_alias_t *out, size_t n)
+{
+    const float32x4_t offset = vdupq_n_f32(128.0f);
+    const float32x4_t lo = vdupq_n_f32(0.0f);
+    const float32x4_t hi = vdupq_n_f32(UINT8_MAX);
+    uint32x4_t count = vdupq_n_u32(0);
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const int32x4_t a = clip_neon(vaddq_f32(vld1q_f32(&in[i]), offset),
+                lo, hi, count);
+        const int32x4_t b = clip_neon(vaddq_f32(vld1q_f32(&in[i + 4]), offset),
+                lo, hi, count);
+        vst1_u8(&out[i], vqmovun_s16(vcombine_s16(vmovn_s32(a), vmovn_s32(b))));
+    }
+    return sum_neon(count) + to_u8_scalar(in, out, i, n);
+}
+
+static size_t to_s8_neon(const float_alias_t *in, int8_alias_t *out, size_t n)
+{
+    const float32x4_t lo = vdupq_n_f32(INT8_MIN);
+    const float32x4_t hi = vdupq_n_f32(INT8_MAX);
+    uint32x4_t count = vdupq_n_u32(0);
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const int32x4_t a = clip_neon(vld1q_f32(&in[i]), lo, hi, count);
+        const int32x4_t b = clip_neon(vld1q_f32(&in[i + 4]), lo, hi, count);
+        vst1_s8(&out[i], vmovn_s16(vcombine_s16(vmovn_s32(a), vmovn_s32(b))));
+    }
+    return sum_neon(count) + to_s8_scalar(in, out, i, n);
+}
+
+static size_t to_sc12_neon(const float_alias_t *in, uint8_alias_t *out, size_t n)
+{
+    const float32x4_t lo = vdupq_n_f32(sc12_min);
+    const float32x4_t hi = vdupq_n_f32(sc12_max);
+    const uint16x8_t mask = vdupq_n_u16(0x0fff);
+    uint32x4_t count = vdupq_n_u32(0);
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        // Separate I and Q when loading
+        const float32x4x2_t x0 = vld2q_f32(&in[i]);
+        const float32x4x2_t x1 = vld2q_f32(&in[i + 8]);
+        const int16x8_t i16 = vcombine_s16(
+                vmovn_s32(clip_neon(x0.val[0], lo, hi, count)),
+                vmovn_s32(clip_neon(x1.val[0], lo, hi, count)));
+        const int16x8_t q16 = vcombine_s16(
+                vmovn_s32(clip_neon(x0.val[1], lo, hi, count)),
+                vmovn_s32(clip_neon(x1.val[1], lo, hi, count)));
+        const uint16x8_t ui = vandq_u16(vreinterpretq_u16_s16(i16), mask);
+        const uint16x8_t uq = vandq_u16(vreinterpretq_u16_s16(q16), mask);
+
+        uint8x8x3_t bytes;
+        bytes.val[0] = vmovn_u16(ui);
+        bytes.val[1] = vmovn_u16(vorrq_u16(vshrq_n_u16(ui, 8), vshlq_n_u16(uq, 4)));
+        bytes.val[2] = vmovn_u16(vshrq_n_u16(uq, 4));
+        vst3_u8(&out[3 * i / 2], bytes);
+    }
+    return sum_neon(count) + to_sc12_scalar(in, out, i, n);
+}
+#endif
+
+static float_converters_t select_float_converters()
+{
+    auto& cpu = cpu_features();
+    float_converters_t converters = {
+        scalar_float_converter<int16_alias_t, to_s16_scalar<>>,
+        scalar_float_converter<int16_alias_t, to_s16_scalar<sc12_min, sc12_max>>,
+        scalar_float_converter<int8_alias_t, to_s8_scalar>,
+        scalar_float_converter<uint8_alias_t, to_u8_scalar>,
+        scalar_float_converter<uint8_alias_t, to_sc12_scalar>,
+        "scalar"};
+#if defined(HAVE_FORMAT_CONVERTER_DISPATCH)
+    if (cpu.supports(cpu_feature_e::avx2)) {
+        converters = {
+            float_converter<int16_alias_t, to_s16_avx2<>>,
+            float_converter<int16_alias_t, to_s16_avx2<sc12_min, sc12_max>>,
+            float_converter<int8_alias_t, to_s8_avx2>,
+            float_converter<uint8_alias_t, to_u8_avx2>,
+            float_converter<uint8_alias_t, to_sc12_avx2>,
+            "AVX2"};
+    }
+    else
+#endif
+#if defined(__SSE2__)
+    if (cpu.supports(cpu_feature_e::sse2)) {
+        converters = {
+            float_converter<int16_alias_t, to_s16_sse<>>,
+            float_converter<int16_alias_t, to_s16_sse<sc12_min, sc12_max>>,
+            float_converter<int8_alias_t, to_s8_sse>,
+            float_converter<uint8_alias_t, to_u8_sse>,
+            float_converter<uint8_alias_t, to_sc12_sse>,
+            "SSE2"};
+    }
+#elif defined(__ARM_NEON)
+    if (cpu.supports(cpu_feature_e::neon)) {
+        converters = {
+            float_converter<int16_alias_t, to_s16_neon<>>,
+            float_converter<int16_alias_t, to_s16_neon<sc12_min, sc12_max>>,
+            float_converter<int8_alias_t, to_s8_neon>,
+            float_converter<uint8_alias_t, to_u8_neon>,
+            float_converter<uint8_alias_t, to_sc12_neon>,
+            "NEON"};
+    }
+#endif
+    cpu.register_kernel("FormatConverter", converters.name);
+    return converters;
+}
+
+FormatConverter::float_converter_t FormatConverter::get_float_converter(
+        const std::string& format_out)
+{
+    const auto converters = select_float_converters();
+    etiLog.level(debug) << "FormatConverter: using the " <<
+        converters.name << " converters";
+
+    if (format_out == "s16") {
+        return converters.s16;
+    }
+    else if (format_out == "sc16q11") {
+        return converters.sc16q11;
+    }
+    else if (format_out == "u8") {
+        return converters.u8;
+    }
+    else if (format_out == "s8") {
+        return converters.s8;
+    }
+    else if (format_out == "sc12") {
+        return converters.sc12;
+    }
+    throw std::runtime_error("FormatConverter: Invalid format " + format_out);
+}
+
+FormatConverter::FormatConverter(bool input_is_complexfix_wide, const std::string& format_out,
+        bool input_in_range) :
     ModCodec(),
     m_input_complexfix_wide(input_is_complexfix_wide),
-    m_format_out(format_out)
-{ }
+    m_format_out(format_out),
+    m_input_in_range(input_in_range)
+{
+    if (not m_input_complexfix_wide) {
+        m_float_converter = get_float_converter(m_format_out);
+    }
+
+    m_metrics.add_counter("odr_format_converter_clipped_samples_total",
+            "Number of samples clipped by the conversion to the output format",
+            [this]() { return m_total_clipped_samples.load(); });
+}
 
 FormatConverter::~FormatConverter()
 {
     if (
 #if defined(__ARM_NEON)
-    not m_input_complexfix_wide
-#else
-    true
+    not m_input_complexfix_wide and
 #endif
-    ) {
+    not m_input_in_range) {
         etiLog.level(debug) << "FormatConverter: " <<
             m_num_clipped_samples.load() << " clipped";
     }
 }
 
 
+/* For input that is already in the range of the format, so that the
+ * conversion cannot saturate. The conversions truncate towards zero like
+ * the scalar ones. When converting in place, a vector is always loaded
+ * before the output overwrites it. */
+static void convert_in_range(const float_alias_t *in, Buffer* dataOut,
+        size_t sizeIn, const std::string& format_out)
+{
+    size_t i = 0;
+    if (format_out == "s16" or format_out == "sc16q11") {
+        dataOut->setLength(sizeIn * sizeof(int16_t));
+        int16_alias_t* out = reinterpret_cast<int16_alias_t*>(dataOut->getData());
+#if defined(__SSE2__)
+        for (; i + 8 <= sizeIn; i += 8) {
+            const __m128i a = _mm_cvttps_epi32(_mm_loadu_ps(&in[i]));
+            const __m128i b = _mm_cvttps_epi32(_mm_loadu_ps(&in[i + 4]));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&out[i]),
+                    _mm_packs_epi32(a, b));
+        }
+#elif defined(__ARM_NEON)
+        for (; i + 8 <= sizeIn; i += 8) {
+            const int32x4_t a = vcvtq_s32_f32(vld1q_f32(&in[i]));
+            const int32x4_t b = vcvtq_s32_f32(vld1q_f32(&in[i + 4]));
+            vst1q_s16(&out[i], vcombine_s16(vmovn_s32(a), vmovn_s32(b)));
+        }
+#endif
+        for (; i < sizeIn; i++) {
+            out[i] = in[i];
+        }
+    }
+    else if (format_out == "u8") {
+        dataOut->setLength(sizeIn * sizeof(int8_t));
+        uint8_alias_t* out = reinterpret_cast<uint8_alias_t*>(dataOut->getData());
+#if defined(__SSE2__)
+        const __m128 offset = _mm_set1_ps(128.0f);
+        for (; i + 16 <= sizeIn; i += 16) {
+            const __m128i a = _mm_cvttps_epi32(_mm_add_ps(_mm_loadu_ps(&in[i]), offset));
+            const __m128i b = _mm_cvttps_epi32(_mm_add_ps(_mm_loadu_ps(&in[i + 4]), offset));
+            const __m128i c = _mm_cvttps_epi32(_mm_add_ps(_mm_loadu_ps(&in[i + 8]), offset));
+            const __m128i d = _mm_cvttps_epi32(_mm_add_ps(_mm_loadu_ps(&in[i + 12]), offset));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&out[i]),
+                    _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+        }
+#elif defined(__ARM_NEON)
+        const float32x4_t offset = vdupq_n_f32(128.0f);
+        for (; i + 8 <= sizeIn; i += 8) {
+            const uint32x4_t a = vcvtq_u32_f32(vaddq_f32(vld1q_f32(&in[i]), offset));
+            const uint32x4_t b = vcvtq_u32_f32(vaddq_f32(vld1q_f32(&in[i + 4]), offset));
+            vst1_u8(&out[i], vmovn_u16(vcombine_u16(vmovn_u32(a), vmovn_u32(b))));
+        }
+#endif
+        for (; i < sizeIn; i++) {
+            out[i] = in[i] + 128.0f;
+        }
+    }
+    else if (format_out == "s8") {
+        dataOut->setLength(sizeIn * sizeof(int8_t));
+        int8_alias_t* out = reinterpret_cast<int8_alias_t*>(dataOut->getData());
+#if defined(__SSE2__)
+        for (; i + 16 <= sizeIn; i += 16) {
+            const __m128i a = _mm_cvttps_epi32(_mm_loadu_ps(&in[i]));
+            const __m128i b = _mm_cvttps_epi32(_mm_loadu_ps(&in[i + 4]));
+            const __m128i c = _mm_cvttps_epi32(_mm_loadu_ps(&in[i + 8]));
+            const __m128i d = _mm_cvttps_epi32(_mm_loadu_ps(&in[i + 12]));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&out[i]),
+                    _mm_packs_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+        }
+#elif defined(__ARM_NEON)
+        for (; i + 8 <= sizeIn; i += 8) {
+            const int32x4_t a = vcvtq_s32_f32(vld1q_f32(&in[i]));
+            const int32x4_t b = vcvtq_s32_f32(vld1q_f32(&in[i + 4]));
+            vst1_s8(&out[i], vmovn_s16(vcombine_s16(vmovn_s32(a), vmovn_s32(b))));
+        }
+#endif
+        for (; i < sizeIn; i++) {
+            out[i] = in[i];
+        }
+    }
+    else {
+        throw std::runtime_error("FormatConverter: Invalid format " + format_out);
+    }
+}
+
+size_t FormatConverter::convert_complexfix_wide_to_s16(
+        const void *in_, void *out_, size_t sizeIn)
+{
+    const int32_alias_t *in = reinterpret_cast<const int32_alias_t*>(in_);
+    int16_alias_t* out = reinterpret_cast<int16_alias_t*>(out_);
+    size_t num_clipped_samples = 0;
+
+    constexpr int shift = 6;
+
+#if defined(__ARM_NEON)
+    if (sizeIn % 4 != 0) {
+        throw std::logic_error("Unexpected length not multiple of 4");
+    }
+
+    for (size_t i = 0; i < sizeIn; i += 4) {
+        int32x4_t input_vec = vld1q_s32(&in[i]);
+        // Apply shift right, saturate on conversion to int16_t
+        int16x4_t output_vec = vqshrn_n_s32(input_vec, shift);
+        vst1_s16(&out[i], output_vec);
+    }
+#else
+    for (size_t i = 0; i < sizeIn; i++) {
+        const int32_t val = in[i] >> shift;
+        if (val < INT16_MIN) {
+            out[i] = INT16_MIN;
+            num_clipped_samples++;
+        }
+        else if (val > INT16_MAX) {
+            out[i] = INT16_MAX;
+            num_clipped_samples++;
+        }
+        else {
+            out[i] = val;
+        }
+    }
+#endif
+    return num_clipped_samples;
+}
+
 /* Expect the input samples to be in the correct range for the required format */
 int FormatConverter::process(Buffer* const dataIn, Buffer* dataOut)
 {
@@ -71,38 +743,8 @@ int FormatConverter::process(Buffer* const dataIn, Buffer* dataOut)
         size_t sizeIn = dataIn->getLength() / sizeof(int32_t);
         if (m_format_out == "s16") {
             dataOut->setLength(sizeIn * sizeof(int16_t));
-            const int32_t *in = reinterpret_cast<int32_t*>(dataIn->getData());
-            int16_t* out = reinterpret_cast<int16_t*>(dataOut->getData());
-
-            constexpr int shift = 6;
-
-#if defined(__ARM_NEON)
-            if (sizeIn % 4 != 0) {
-                throw std::logic_error("Unexpected length not multiple of 4");
-            }
-
-            for (size_t i = 0; i < sizeIn; i += 4) {
-                int32x4_t input_vec = vld1q_s32(&in[i]);
-                // Apply shift right, saturate on conversion to int16_t
-                int16x4_t output_vec = vqshrn_n_s32(input_vec, shift);
-                vst1_s16(&out[i], output_vec);
-            }
-#else
-            for (size_t i = 0; i < sizeIn; i++) {
-                const int32_t val = in[i] >> shift;
-                if (val < INT16_MIN) {
-                    out[i] = INT16_MIN;
-                    num_clipped_samples++;
-                }
-                else if (val > INT16_MAX) {
-                    out[i] = INT16_MAX;
-                    num_clipped_samples++;
-                }
-                else {
-                    out[i] = val;
-                }
-            }
-#endif
+            num_clipped_samples = convert_complexfix_wide_to_s16(
+                    dataIn->getData(), dataOut->getData(), sizeIn);
         }
         else {
             throw std::runtime_error("FormatConverter: Invalid fix format " + m_format_out);
@@ -110,70 +752,64 @@ int FormatConverter::process(Buffer* const dataIn, Buffer* dataOut)
     }
     else {
         size_t sizeIn = dataIn->getLength() / sizeof(float);
-        const float* in = reinterpret_cast<float*>(dataIn->getData());
+        const float_alias_t* in = reinterpret_cast<float_alias_t*>(dataIn->getData());
 
-        if (m_format_out == "s16") {
-            dataOut->setLength(sizeIn * sizeof(int16_t));
-            int16_t* out = reinterpret_cast<int16_t*>(dataOut->getData());
-
-            for (size_t i = 0; i < sizeIn; i++) {
-                if (in[i] < INT16_MIN) {
-                    out[i] = INT16_MIN;
-                    num_clipped_samples++;
-                }
-                else if (in[i] > INT16_MAX) {
-                    out[i] = INT16_MAX;
-                    num_clipped_samples++;
-                }
-                else {
-                    out[i] = in[i];
-                }
+        if (m_half_input != half_format_e::none) {
+            if (not m_half_converters.from_half) {
+                m_half_converters = half_float::get_converters(m_half_input);
             }
-        }
-        else if (m_format_out == "u8") {
-            dataOut->setLength(sizeIn * sizeof(int8_t));
-            uint8_t* out = reinterpret_cast<uint8_t*>(dataOut->getData());
-
-            for (size_t i = 0; i < sizeIn; i++) {
-                const auto samp = in[i] + 128.0f;
-                if (samp < 0) {
-                    out[i] = 0;
-                    num_clipped_samples++;
-                }
-                else if (samp > UINT8_MAX) {
-                    out[i] = UINT8_MAX;
-                    num_clipped_samples++;
-                }
-                else {
-                    out[i] = samp;
-                }
 
+            // Like for the planar layout, the output of a chunk is not
+            // larger than its 16-bit input, which is already read
+            constexpr size_t chunk_size = 256;
+            const auto *in_half = reinterpret_cast<const uint16_t*>(
+                    dataIn->getData());
+            const size_t num_samples = dataIn->getLength() /
+                (2 * sizeof(uint16_t));
+            const size_t format_size = get_format_size(m_format_out);
+            dataOut->setLength(num_samples * format_size);
+            uint8_t *out = reinterpret_cast<uint8_t*>(dataOut->getData());
+
+            alignas(32) float chunk[2 * chunk_size];
+            for (size_t i = 0; i < num_samples; i += chunk_size) {
+                const size_t n = std::min(chunk_size, num_samples - i);
+                m_half_converters.from_half(in_half + 2 * i, chunk, 2 * n);
+                num_clipped_samples += m_float_converter(chunk,
+                        out + i * format_size, 2 * n);
             }
         }
-        else if (m_format_out == "s8") {
-            dataOut->setLength(sizeIn * sizeof(int8_t));
-            int8_t* out = reinterpret_cast<int8_t*>(dataOut->getData());
-
-            for (size_t i = 0; i < sizeIn; i++) {
-                if (in[i] < INT8_MIN) {
-                    out[i] = INT8_MIN;
-                    num_clipped_samples++;
-                }
-                else if (in[i] > INT8_MAX) {
-                    out[i] = INT8_MAX;
-                    num_clipped_samples++;
-                }
-                else {
-                    out[i] = in[i];
-                }
+        else if (m_planar) {
+            // Interleave a chunk on the stack and convert it. The output
+            // of a chunk is not larger than its I values, which are
+            // already read, so that this works in place.
+            constexpr size_t chunk_size = 256;
+            const size_t num_samples = sizeIn / 2;
+            const size_t format_size = get_format_size(m_format_out);
+            dataOut->setLength(num_samples * format_size);
+            uint8_t *out = reinterpret_cast<uint8_t*>(dataOut->getData());
+
+            alignas(32) float chunk[2 * chunk_size];
+            for (size_t i = 0; i < num_samples; i += chunk_size) {
+                const size_t n = std::min(chunk_size, num_samples - i);
+                planar_to_interleaved(in + i, in + num_samples + i, chunk, n);
+                num_clipped_samples += m_float_converter(chunk,
+                        out + i * format_size, 2 * n);
             }
         }
+        // sc12 needs the converter for the packing in any case
+        else if (m_input_in_range and m_format_out != "sc12") {
+            convert_in_range(in, dataOut, sizeIn, m_format_out);
+        }
         else {
-            throw std::runtime_error("FormatConverter: Invalid format " + m_format_out);
+            // get_format_size() is the size of a complex sample
+            dataOut->setLength(sizeIn * get_format_size(m_format_out) / 2);
+            num_clipped_samples = m_float_converter(in,
+                    dataOut->getData(), sizeIn);
         }
     }
 
     m_num_clipped_samples.store(num_clipped_samples);
+    m_total_clipped_samples.fetch_add(num_clipped_samples, std::memory_order_relaxed);
     return dataOut->getLength();
 }
 
@@ -190,8 +826,9 @@ size_t FormatConverter::get_num_clipped_samples() const
 
 size_t FormatConverter::get_format_size(const std::string& format)
 {
-    // Returns 2*sizeof(SAMPLE_TYPE) because we have I + Q
-    if (format == "s16") {
+    // Returns 2*sizeof(SAMPLE_TYPE) because we have I + Q, and 3 for
+    // the 12-bit samples packed into three bytes
+    if (format == "s16" or format == "sc16q11") {
         return 4;
     }
     else if (format == "u8") {
@@ -200,6 +837,29 @@ size_t FormatConverter::get_format_size(const std::string& format)
     else if (format == "s8") {
         return 2;
     }
+    else if (format == "sc12") {
+        return 3;
+    }
+    else {
+        throw std::runtime_error("FormatConverter: Invalid format " + format);
+    }
+}
+
+std::pair<float, float> FormatConverter::get_format_range(const std::string& format)
+{
+    if (format == "s16") {
+        return {INT16_MIN, INT16_MAX};
+    }
+    else if (format == "u8") {
+        // The converter adds 128
+        return {-128.0f, 127.0f};
+    }
+    else if (format == "s8") {
+        return {INT8_MIN, INT8_MAX};
+    }
+    else if (format == "sc12" or format == "sc16q11") {
+        return {sc12_min, sc12_max};
+    }
     else {
         throw std::runtime_error("FormatConverter: Invalid format " + format);
     }
@@ -33,30 +33,75 @@
 #endif
 
 #include "ModPlugin.h"
+#include "Metrics.h"
 #include <atomic>
 #include <string>
+#include <utility>
 
 class FormatConverter : public ModCodec
 {
     public:
         static size_t get_format_size(const std::string& format);
 
-        // floating-point input allows output formats: s8, u8 and s16
+        // The range of the floating-point samples that the format can
+        // represent
+        static std::pair<float, float> get_format_range(const std::string& format);
+
+        // floating-point input allows output formats: s8, u8, s16, sc16q11
+        // (s16 limited to the 12-bit range) and sc12
         // complexfix_wide input allows output formats: s16
         // complexfix input is already in s16, and needs no converter
-        FormatConverter(bool input_is_complexfix_wide, const std::string& format_out);
+        // If input_in_range is set, the floating-point input is already
+        // clipped to get_format_range(), by the GainControl, and is
+        // converted without checking the range.
+        FormatConverter(bool input_is_complexfix_wide, const std::string& format_out,
+                bool input_in_range = false);
         virtual ~FormatConverter();
 
         int process(Buffer* const dataIn, Buffer* dataOut);
         const char* name();
 
+        // The output samples are never larger than the input samples
+        bool supports_in_place() const { return true; }
+
+        // In the planar layout, the samples are interleaved in chunks
+        bool supports_planar_input() const { return not m_input_complexfix_wide; }
+
+        // The 16-bit floats are converted to floats in chunks
+        bool supports_half_input() const { return not m_input_complexfix_wide; }
+
+        bool supports_streaming() const {
+            return not m_planar and m_half_input == half_format_e::none;
+        }
+
         size_t get_num_clipped_samples() const;
 
+        // Converts n floating-point values, returns how many were clipped
+        using float_converter_t = size_t (*)(const void *in, void *out, size_t n);
+
+        // The converter of the floating-point values to the format, the
+        // fastest one for the CPU
+        static float_converter_t get_float_converter(const std::string& format_out);
+
+        // Converts n complexfix_wide values to s16, which may be in place,
+        // returns how many were clipped
+        static size_t convert_complexfix_wide_to_s16(
+                const void *in, void *out, size_t n);
+
     private:
         bool m_input_complexfix_wide;
         std::string m_format_out;
+        bool m_input_in_range;
+
+        // Selected according to the format and the CPU features at runtime
+        float_converter_t m_float_converter = nullptr;
+        // Selected at the first frame in 16-bit floats
+        half_float::converters_t m_half_converters = {};
 
         std::atomic<size_t> m_num_clipped_samples = 0;
+        std::atomic<uint64_t> m_total_clipped_samples = 0;
+
+        Metrics::Handle m_metrics;
 };
 
 
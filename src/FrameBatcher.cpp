@@ -0,0 +1,82 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "FrameBatcher.h"
+#include "PcDebug.h"
+
+#include <stdexcept>
+#include <iterator>
+#include <algorithm>
+
+FrameBatcher::FrameBatcher(size_t batchSize) :
+    ModCodec(),
+    ModMetadata(),
+    m_batchSize(batchSize)
+{
+    PDEBUG("FrameBatcher::FrameBatcher(%zu) @ %p\n", batchSize, this);
+
+    if (m_batchSize == 0) {
+        throw std::invalid_argument("FrameBatcher: batch size must not be 0");
+    }
+}
+
+int FrameBatcher::process(Buffer* const dataIn, Buffer* dataOut)
+{
+    PDEBUG("FrameBatcher::process(dataIn: %p, dataOut: %p)\n",
+            dataIn, dataOut);
+
+    if (m_numFrames > 0 and
+            dataIn->getLength() * m_numFrames != m_batch.getLength()) {
+        throw std::runtime_error(
+                "FrameBatcher::process input size changed during batch!");
+    }
+
+    // The batch buffer and dataOut get swapped, which means that after the
+    // first two batches both have reached their final capacity.
+    m_batch.appendData(dataIn->getData(), dataIn->getLength());
+
+    if (++m_numFrames < m_batchSize) {
+        return 0;
+    }
+
+    m_numFrames = 0;
+    dataOut->swap(m_batch);
+    m_batch.setLength(0);
+
+    return dataOut->getLength();
+}
+
+meta_vec_t FrameBatcher::process_metadata(const meta_vec_t& metadataIn)
+{
+    std::copy(metadataIn.begin(), metadataIn.end(), std::back_inserter(m_meta));
+
+    if (m_numFrames == 0) {
+        // The batch is complete, hand over the metadata of all its frames
+        meta_vec_t batch_meta;
+        std::swap(batch_meta, m_meta);
+        return batch_meta;
+    }
+    else {
+        return {};
+    }
+}
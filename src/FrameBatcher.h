@@ -0,0 +1,62 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   Collects several transmission frames into one buffer, so that the
+   following blocks can process them in a single call.
+*/
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include "ModPlugin.h"
+#include <cstddef>
+
+/* Like the BlockPartitioner, this block returns 0 until it has received
+ * enough input, which stops the flowgraph for this run. Once batchSize
+ * transmission frames have been collected, they are all given to the
+ * next block together with the metadata of all frames.
+ *
+ * All blocks after this one must therefore accept a multiple of the
+ * transmission frame size. */
+class FrameBatcher : public ModCodec, public ModMetadata
+{
+public:
+    FrameBatcher(size_t batchSize);
+
+    int process(Buffer* const dataIn, Buffer* dataOut) override;
+    const char* name() override { return "FrameBatcher"; }
+    bool may_stop_run() const override { return true; }
+
+    // The implementation assumes process_metadata is always called after process
+    virtual meta_vec_t process_metadata(const meta_vec_t& metadataIn) override;
+
+protected:
+    const size_t m_batchSize;
+    size_t m_numFrames = 0;
+    Buffer m_batch;
+    meta_vec_t m_meta;
+};
+
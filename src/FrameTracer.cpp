@@ -0,0 +1,633 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://www.opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "FrameTracer.h"
+#include "Log.h"
+#include "Utils.h"
+
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <sstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace std;
+
+struct FrameTracer::header_t {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t num_records;
+    std::atomic<uint64_t> write_index;
+    int64_t realtime_offset;
+    uint32_t num_names;
+    uint32_t reserved;
+    char names[MAX_NAMES][NAME_SIZE];
+};
+
+struct FrameTracer::record_t {
+    std::atomic<uint64_t> seq;
+    uint64_t time_ns;
+    uint64_t value;
+    int32_t fct;
+    uint8_t event;
+    uint8_t name;
+    uint16_t thread;
+};
+
+static constexpr size_t HEADER_SIZE = 4096;
+
+// Bytes the capture thread gets woken up for, it otherwise writes every
+// CAPTURE_WRITE_INTERVAL
+static constexpr size_t CAPTURE_WRITE_BYTES = 1024 * 1024;
+static constexpr std::chrono::milliseconds CAPTURE_WRITE_INTERVAL(100);
+
+// The layout of record_t, for the capture
+struct capture_record_t {
+    uint64_t seq;
+    uint64_t time_ns;
+    uint64_t value;
+    int32_t fct;
+    uint8_t event;
+    uint8_t name;
+    uint16_t thread;
+};
+static_assert(sizeof(capture_record_t) == 32, "capture record size");
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+        "The frame trace file needs lock-free 64-bit atomics");
+static_assert(sizeof(FrameTracer::event_e) == 1, "event size");
+
+FrameTracer& frame_tracer()
+{
+    static FrameTracer tracer;
+    return tracer;
+}
+
+static uint64_t clock_ns(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+uint64_t FrameTracer::now_ns()
+{
+    return clock_ns(CLOCK_MONOTONIC);
+}
+
+static uint16_t current_thread_id()
+{
+    static std::atomic<uint16_t> next_thread_id = ATOMIC_VAR_INIT(1);
+    thread_local const uint16_t thread_id = next_thread_id.fetch_add(1);
+    return thread_id;
+}
+
+FrameTracer::FrameTracer() :
+    RemoteControllable("frametrace")
+{
+    static_assert(sizeof(header_t) <= HEADER_SIZE, "header too large");
+    static_assert(sizeof(record_t) == 32, "record size");
+
+    RC_ADD_PARAMETER(enabled, "1 to record the frame events into the trace file");
+    RC_ADD_PARAMETER(file, "(Read-only) Name of the trace file");
+    RC_ADD_PARAMETER(records, "(Read-only) Number of records in the ring");
+    RC_ADD_PARAMETER(written, "(Read-only) Number of records written since the start");
+    RC_ADD_PARAMETER(capture, "Number of frames to capture, starting with the next one. Reads the number of frames left to capture");
+    RC_ADD_PARAMETER(capture_blocks, "Comma-separated names of the blocks whose outputs the next capture copies");
+    RC_ADD_PARAMETER(capture_state, "(Read-only) idle, armed, capturing, writing, done or failed");
+    RC_ADD_PARAMETER(capture_file, "(Read-only) Name of the capture file");
+
+    // The first name is used by the events without one
+    m_names.push_back("");
+}
+
+FrameTracer::~FrameTracer()
+{
+    stop_capture_thread();
+    close();
+}
+
+void FrameTracer::close()
+{
+    m_enabled.store(false);
+
+    if (m_header) {
+        munmap(m_header, m_map_size);
+        m_header = nullptr;
+        m_records = nullptr;
+    }
+
+    if (m_fd != -1) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+void FrameTracer::open(const string& filename, size_t num_records)
+{
+    if (m_header) {
+        throw logic_error("FrameTracer: already open");
+    }
+
+    if (num_records == 0) {
+        throw runtime_error("FrameTracer: the ring needs at least one record");
+    }
+
+    m_fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (m_fd == -1) {
+        throw runtime_error("FrameTracer: cannot open " + filename + ": " +
+                strerror(errno));
+    }
+
+    m_map_size = HEADER_SIZE + num_records * sizeof(record_t);
+    if (ftruncate(m_fd, m_map_size) == -1) {
+        const string err = strerror(errno);
+        close();
+        throw runtime_error("FrameTracer: cannot resize " + filename + ": " + err);
+    }
+
+    void *map = mmap(nullptr, m_map_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED, m_fd, 0);
+    if (map == MAP_FAILED) {
+        const string err = strerror(errno);
+        close();
+        throw runtime_error("FrameTracer: cannot map " + filename + ": " + err);
+    }
+
+    // The file was truncated, all records have seq 0 and are therefore
+    // invalid until written.
+    m_header = reinterpret_cast<header_t*>(map);
+    m_records = reinterpret_cast<record_t*>(
+            reinterpret_cast<uint8_t*>(map) + HEADER_SIZE);
+    m_num_records = num_records;
+    m_filename = filename;
+
+    memcpy(m_header->magic, "ODRTRACE", sizeof(m_header->magic));
+    m_header->version = FORMAT_VERSION;
+    m_header->record_size = sizeof(record_t);
+    m_header->num_records = num_records;
+    m_header->write_index.store(0);
+    m_header->realtime_offset =
+        (int64_t)clock_ns(CLOCK_REALTIME) - (int64_t)clock_ns(CLOCK_MONOTONIC);
+    write_names();
+
+    etiLog.level(info) << "Frame trace: " << num_records <<
+        " records in " << filename;
+}
+
+void FrameTracer::set_enabled(bool enabled)
+{
+    if (enabled and m_header == nullptr) {
+        throw runtime_error("FrameTracer: no trace file");
+    }
+    m_enabled.store(enabled);
+    update_active();
+}
+
+void FrameTracer::update_active()
+{
+    m_active.store(m_enabled.load() or m_capture_armed.load());
+}
+
+void FrameTracer::set_capture_file(const string& filename)
+{
+    lock_guard<mutex> lock(m_capture_mutex);
+    m_capture_filename = filename;
+}
+
+void FrameTracer::arm_capture(size_t num_frames,
+        const vector<string>& snapshot_names)
+{
+    if (num_frames == 0) {
+        throw runtime_error("FrameTracer: a capture needs at least one frame");
+    }
+
+    unique_lock<mutex> lock(m_capture_mutex);
+    if (m_capture_filename.empty()) {
+        throw runtime_error("FrameTracer: no capture file");
+    }
+    if (m_capture == capture_e::armed or m_capture == capture_e::capturing or
+            m_capture == capture_e::writing) {
+        throw runtime_error("FrameTracer: a capture is running");
+    }
+    if (m_capture_thread.joinable()) {
+        m_capture_thread.join();
+    }
+
+    uint64_t snapshot_mask = 0;
+    for (const auto& name : snapshot_names) {
+        const uint8_t index = register_name(name);
+        if (index == 0) {
+            throw runtime_error("FrameTracer: too many names for " + name);
+        }
+        snapshot_mask |= (uint64_t)1 << index;
+    }
+
+    FILE *fd = fopen(m_capture_filename.c_str(), "wb");
+    if (fd == nullptr) {
+        throw runtime_error("FrameTracer: cannot open " + m_capture_filename +
+                ": " + strerror(errno));
+    }
+
+    // The number of records is only known at the end
+    vector<uint8_t> header(HEADER_SIZE, 0);
+    auto *h = reinterpret_cast<header_t*>(header.data());
+    memcpy(h->magic, "ODRCAPTR", sizeof(h->magic));
+    h->version = FORMAT_VERSION;
+    h->record_size = sizeof(capture_record_t);
+    h->realtime_offset =
+        (int64_t)clock_ns(CLOCK_REALTIME) - (int64_t)clock_ns(CLOCK_MONOTONIC);
+    {
+        lock_guard<mutex> names_lock(m_names_mutex);
+        for (size_t i = 0; i < m_names.size(); i++) {
+            strncpy(h->names[i], m_names[i].c_str(), NAME_SIZE - 1);
+        }
+        h->num_names = m_names.size();
+    }
+
+    if (fwrite(header.data(), header.size(), 1, fd) != 1) {
+        const string err = strerror(errno);
+        fclose(fd);
+        throw runtime_error("FrameTracer: cannot write " + m_capture_filename +
+                ": " + err);
+    }
+
+    m_capture = capture_e::armed;
+    m_capture_error.clear();
+    m_capture_frames = num_frames;
+    m_capture_frames_seen = 0;
+    m_capture_records = 0;
+    m_capture_pending.clear();
+    m_capture_pending.reserve(CAPTURE_WRITE_BYTES);
+    m_snapshot_names.store(snapshot_mask);
+    m_capture_thread = std::thread(&FrameTracer::capture_thread, this,
+            fd, std::move(header));
+    lock.unlock();
+
+    m_capture_armed.store(true);
+    update_active();
+
+    etiLog.level(info) << "Frame capture: armed for " << num_frames <<
+        " frames into " << m_capture_filename;
+}
+
+void FrameTracer::stop_capture_thread()
+{
+    {
+        lock_guard<mutex> lock(m_capture_mutex);
+        if (m_capture == capture_e::armed or m_capture == capture_e::capturing) {
+            m_capture = capture_e::writing;
+            m_capturing.store(false);
+            m_capture_armed.store(false);
+            update_active();
+        }
+        m_capture_cv.notify_one();
+    }
+
+    if (m_capture_thread.joinable()) {
+        m_capture_thread.join();
+    }
+}
+
+void FrameTracer::capture_record(uint64_t time_ns, uint64_t value,
+        int32_t fct, event_e event, uint8_t name, uint16_t thread)
+{
+    lock_guard<mutex> lock(m_capture_mutex);
+    if (m_capture == capture_e::armed) {
+        if (event != event_e::frame_input) {
+            return;
+        }
+        m_capture = capture_e::capturing;
+        m_capturing.store(true);
+    }
+    else if (m_capture != capture_e::capturing) {
+        return;
+    }
+
+    if (event == event_e::frame_input) {
+        if (m_capture_frames_seen == m_capture_frames) {
+            // This frame is the first one after the capture
+            m_capture = capture_e::writing;
+            m_capturing.store(false);
+            m_capture_armed.store(false);
+            update_active();
+            m_capture_cv.notify_one();
+            return;
+        }
+        m_capture_frames_seen++;
+    }
+
+    append_capture(time_ns, value, fct, event, name, thread);
+}
+
+void FrameTracer::append_capture(uint64_t time_ns, uint64_t value,
+        int32_t fct, event_e event, uint8_t name, uint16_t thread)
+{
+    capture_record_t r;
+    r.seq = ++m_capture_records;
+    r.time_ns = time_ns;
+    r.value = value;
+    r.fct = fct;
+    r.event = static_cast<uint8_t>(event);
+    r.name = name;
+    r.thread = thread;
+
+    const auto *bytes = reinterpret_cast<const uint8_t*>(&r);
+    m_capture_pending.insert(m_capture_pending.end(), bytes, bytes + sizeof(r));
+    if (m_capture_pending.size() >= CAPTURE_WRITE_BYTES) {
+        m_capture_cv.notify_one();
+    }
+}
+
+void FrameTracer::record_snapshot(int32_t fct, uint8_t name,
+        const void *data, size_t len)
+{
+    const uint16_t thread_id = current_thread_id();
+
+    lock_guard<mutex> lock(m_capture_mutex);
+    if (m_capture != capture_e::capturing) {
+        return;
+    }
+
+    append_capture(now_ns(), len, fct, event_e::snapshot, name, thread_id);
+
+    // The data takes whole records, which keeps the following ones aligned
+    const size_t padded = (len + sizeof(capture_record_t) - 1) /
+        sizeof(capture_record_t) * sizeof(capture_record_t);
+    const auto *bytes = reinterpret_cast<const uint8_t*>(data);
+    m_capture_pending.insert(m_capture_pending.end(), bytes, bytes + len);
+    m_capture_pending.resize(m_capture_pending.size() + padded - len, 0);
+    m_capture_records += padded / sizeof(capture_record_t);
+}
+
+void FrameTracer::capture_thread(FILE *fd, vector<uint8_t> header)
+{
+    set_thread_name("frametrace");
+
+    vector<uint8_t> chunk;
+    chunk.reserve(CAPTURE_WRITE_BYTES);
+    bool failed = false;
+    string err;
+
+    unique_lock<mutex> lock(m_capture_mutex);
+    while (true) {
+        m_capture_cv.wait_for(lock, CAPTURE_WRITE_INTERVAL);
+        const bool finished = m_capture == capture_e::writing;
+        std::swap(chunk, m_capture_pending);
+        lock.unlock();
+
+        if (not failed and not chunk.empty() and
+                fwrite(chunk.data(), chunk.size(), 1, fd) != 1) {
+            failed = true;
+            err = strerror(errno);
+        }
+        chunk.clear();
+
+        lock.lock();
+        if (finished) {
+            break;
+        }
+    }
+    const uint64_t num_records = m_capture_records;
+    const size_t num_frames = m_capture_frames_seen;
+    lock.unlock();
+
+    auto *h = reinterpret_cast<header_t*>(header.data());
+    h->num_records = num_records;
+    h->write_index.store(num_records);
+    if (not failed and (fseek(fd, 0, SEEK_SET) != 0 or
+                fwrite(header.data(), header.size(), 1, fd) != 1)) {
+        failed = true;
+        err = strerror(errno);
+    }
+    if (fclose(fd) != 0 and not failed) {
+        failed = true;
+        err = strerror(errno);
+    }
+
+    lock.lock();
+    if (failed) {
+        m_capture = capture_e::failed;
+        m_capture_error = err;
+        etiLog.level(error) << "Frame capture: cannot write " <<
+            m_capture_filename << ": " << err;
+    }
+    else {
+        m_capture = capture_e::done;
+        etiLog.level(info) << "Frame capture: " << num_frames << " frames, " <<
+            num_records << " records written to " << m_capture_filename;
+    }
+}
+
+size_t FrameTracer::capture_frames_left() const
+{
+    lock_guard<mutex> lock(m_capture_mutex);
+    if (m_capture == capture_e::armed or m_capture == capture_e::capturing) {
+        return m_capture_frames - m_capture_frames_seen;
+    }
+    return 0;
+}
+
+string FrameTracer::capture_state() const
+{
+    lock_guard<mutex> lock(m_capture_mutex);
+    switch (m_capture) {
+        case capture_e::idle: return "idle";
+        case capture_e::armed: return "armed";
+        case capture_e::capturing: return "capturing";
+        case capture_e::writing: return "writing";
+        case capture_e::done: return "done";
+        case capture_e::failed: return "failed: " + m_capture_error;
+    }
+    return "";
+}
+
+uint8_t FrameTracer::register_name(const string& name)
+{
+    lock_guard<mutex> lock(m_names_mutex);
+    for (size_t i = 0; i < m_names.size(); i++) {
+        if (m_names[i] == name) {
+            return i;
+        }
+    }
+
+    if (m_names.size() == MAX_NAMES) {
+        // Shared by all names that do not fit
+        return 0;
+    }
+
+    m_names.push_back(name);
+    write_names();
+    return m_names.size() - 1;
+}
+
+// Must be called with m_names_mutex held, or before the tracer is used
+void FrameTracer::write_names()
+{
+    if (m_header == nullptr) {
+        return;
+    }
+
+    for (size_t i = 0; i < m_names.size(); i++) {
+        strncpy(m_header->names[i], m_names[i].c_str(), NAME_SIZE - 1);
+        m_header->names[i][NAME_SIZE - 1] = '\0';
+    }
+    m_header->num_names = m_names.size();
+}
+
+void FrameTracer::write_record(event_e event, int32_t fct, uint64_t value, uint8_t name)
+{
+    const uint16_t thread_id = current_thread_id();
+
+    const uint64_t time_ns = now_ns();
+    if (m_capture_armed.load(std::memory_order_relaxed)) {
+        capture_record(time_ns, value, fct, event, name, thread_id);
+    }
+    if (not m_enabled.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    const uint64_t index = m_header->write_index.fetch_add(1, std::memory_order_relaxed);
+    record_t& r = m_records[index % m_num_records];
+
+    // A reader ignores the record while it is incomplete
+    r.seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    r.time_ns = time_ns;
+    r.value = value;
+    r.fct = fct;
+    r.event = static_cast<uint8_t>(event);
+    r.name = name;
+    r.thread = thread_id;
+
+    r.seq.store(index + 1, std::memory_order_release);
+}
+
+void FrameTracer::set_parameter(const string& parameter, const string& value)
+{
+    stringstream ss(value);
+    ss.exceptions ( stringstream::failbit | stringstream::badbit );
+
+    if (parameter == "enabled") {
+        int enabled = 0;
+        ss >> enabled;
+        try {
+            set_enabled(enabled != 0);
+        }
+        catch (const runtime_error& e) {
+            throw ParameterError(e.what());
+        }
+    }
+    else if (parameter == "capture") {
+        size_t num_frames = 0;
+        ss >> num_frames;
+        vector<string> blocks;
+        {
+            lock_guard<mutex> lock(m_capture_mutex);
+            blocks = m_capture_blocks;
+        }
+        try {
+            arm_capture(num_frames, blocks);
+        }
+        catch (const runtime_error& e) {
+            throw ParameterError(e.what());
+        }
+    }
+    else if (parameter == "capture_blocks") {
+        vector<string> blocks;
+        stringstream names(value);
+        string name;
+        while (getline(names, name, ',')) {
+            if (not name.empty()) {
+                blocks.push_back(name);
+            }
+        }
+        lock_guard<mutex> lock(m_capture_mutex);
+        m_capture_blocks = blocks;
+    }
+    else {
+        stringstream ss_err;
+        ss_err << "Parameter '" << parameter
+            << "' is read-only or not exported by controllable " << get_rc_name();
+        throw ParameterError(ss_err.str());
+    }
+}
+
+const string FrameTracer::get_parameter(const string& parameter) const
+{
+    stringstream ss;
+    if (parameter == "enabled") {
+        ss << (m_enabled.load() ? 1 : 0);
+    }
+    else if (parameter == "file") {
+        ss << m_filename;
+    }
+    else if (parameter == "records") {
+        ss << m_num_records;
+    }
+    else if (parameter == "written") {
+        ss << (m_header ? m_header->write_index.load() : 0);
+    }
+    else if (parameter == "capture") {
+        ss << capture_frames_left();
+    }
+    else if (parameter == "capture_blocks") {
+        lock_guard<mutex> lock(m_capture_mutex);
+        for (size_t i = 0; i < m_capture_blocks.size(); i++) {
+            ss << (i > 0 ? "," : "") << m_capture_blocks[i];
+        }
+    }
+    else if (parameter == "capture_state") {
+        ss << capture_state();
+    }
+    else if (parameter == "capture_file") {
+        lock_guard<mutex> lock(m_capture_mutex);
+        ss << m_capture_filename;
+    }
+    else {
+        ss << "Parameter '" << parameter <<
+            "' is not exported by controllable " << get_rc_name();
+        throw ParameterError(ss.str());
+    }
+    return ss.str();
+}
+
+const json::map_t FrameTracer::get_all_values() const
+{
+    json::map_t map;
+    map["enabled"].v = m_enabled.load();
+    map["file"].v = m_filename;
+    map["records"].v = m_num_records;
+    map["written"].v = (uint64_t)(m_header ? m_header->write_index.load() : 0);
+    map["capture"].v = capture_frames_left();
+    map["capture_blocks"].v = get_parameter("capture_blocks");
+    map["capture_state"].v = capture_state();
+    lock_guard<mutex> lock(m_capture_mutex);
+    map["capture_file"].v = m_capture_filename;
+    return map;
+}
@@ -0,0 +1,220 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://www.opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "RemoteControl.h"
+
+/* Records events of every transmission frame into a ring of fixed-size
+ * binary records in a memory-mapped file, that survives a crash of the
+ * modulator and can be read while it runs. It can be switched on and off
+ * over the remote control, and costs a relaxed load when off.
+ *
+ * doc/decode_frame_trace.py decodes the file. Its layout, in the byte
+ * order of the machine:
+ *
+ *  header, 4096 bytes:
+ *    char     magic[8]        "ODRTRACE"
+ *    uint32_t version
+ *    uint32_t record_size     32
+ *    uint64_t num_records
+ *    uint64_t write_index     number of records written since the start
+ *    int64_t  realtime_offset CLOCK_REALTIME minus CLOCK_MONOTONIC, in ns
+ *    uint32_t num_names
+ *    uint32_t reserved
+ *    char     names[64][56]   names of the nodes, zero terminated
+ *  num_records records:
+ *    uint64_t seq             index of the record plus one, written last
+ *    uint64_t time_ns         CLOCK_MONOTONIC
+ *    uint64_t value           depends on the event
+ *    int32_t  fct             -1 when not known
+ *    uint8_t  event
+ *    uint8_t  name            index into the names, for the node events
+ *    uint16_t thread          small number identifying the thread
+ *
+ * A capture of the next frames can also be armed over the remote control,
+ * for instance to look into a problem on a live transmitter without
+ * keeping the trace on. It records the same events into the capture file,
+ * from the first frame_input after arming until the given number of
+ * frames have gone into the flowgraphs of all ensembles. The output
+ * buffers of selected blocks can be copied as well. A thread writes the
+ * file while the capture runs. Its layout is the same as the trace file,
+ * with the magic "ODRCAPTR", num_records and write_index set to the number
+ * of records once the capture is complete, and the records in the order
+ * they were written. A snapshot record has the number of copied bytes in
+ * its value, and is followed by the bytes, padded to a whole number of
+ * records.
+ */
+class FrameTracer : public RemoteControllable {
+    public:
+        enum class event_e : uint8_t {
+            frame_input = 1,    // an ETI frame goes into the flowgraph
+            node_enter = 2,
+            node_exit = 3,      // value: duration in ns
+            queue_push = 4,     // value: queue size, bit 32 set on overflow
+            queue_pop = 5,      // value: queue size after the pop
+            send_start = 6,     // value: TX second << 32 | TX pps ticks
+            send_end = 7,       // value: duration in ns
+            timestamp_late = 8, // value: lateness in ns
+            underflow = 9,      // value: underflow counter of the device
+            late_packet = 10,   // value: late packet counter of the device
+            snapshot = 11,      // value: number of bytes, only in captures
+        };
+
+        static constexpr uint32_t FORMAT_VERSION = 1;
+        static constexpr size_t MAX_NAMES = 64;
+        static constexpr size_t NAME_SIZE = 56;
+
+        FrameTracer();
+        FrameTracer(const FrameTracer& other) = delete;
+        FrameTracer& operator=(const FrameTracer& other) = delete;
+        ~FrameTracer();
+
+        /* Create the ring file. Throws a runtime_error on failure. */
+        void open(const std::string& filename, size_t num_records);
+
+        void set_enabled(bool enabled);
+
+        /* File to write the captures to, every capture replaces it. */
+        void set_capture_file(const std::string& filename);
+
+        /* Capture the events of the next num_frames frames, and copy the
+         * outputs of the blocks with the given names. Throws a
+         * runtime_error without capture file, or while a capture runs. */
+        void arm_capture(size_t num_frames,
+                const std::vector<std::string>& snapshot_names);
+
+        /* Returns the index of the name for the node events, registering
+         * it at the first call. */
+        uint8_t register_name(const std::string& name);
+
+        /* Whether the events are recorded into the trace or a capture.
+         * The callers skip the work of preparing them otherwise. */
+        bool active() const {
+            return m_active.load(std::memory_order_relaxed);
+        }
+
+        void record(event_e event, int32_t fct, uint64_t value, uint8_t name = 0) {
+            if (m_active.load(std::memory_order_relaxed)) {
+                write_record(event, fct, value, name);
+            }
+        }
+
+        /* Whether the outputs of the node with this name are to be
+         * copied into the running capture */
+        bool snapshot_wanted(uint8_t name) const {
+            return m_capturing.load(std::memory_order_relaxed) and name != 0 and
+                (m_snapshot_names.load(std::memory_order_relaxed) >> name) & 1;
+        }
+
+        void record_snapshot(int32_t fct, uint8_t name,
+                const void *data, size_t len);
+
+        /* Current time in the unit of the records */
+        static uint64_t now_ns();
+
+        /******* REMOTE CONTROL ********/
+        virtual void set_parameter(const std::string& parameter,
+                const std::string& value) override;
+
+        virtual const std::string get_parameter(
+                const std::string& parameter) const override;
+
+        virtual const json::map_t get_all_values() const override;
+
+    private:
+        struct header_t;
+        struct record_t;
+
+        void write_record(event_e event, int32_t fct, uint64_t value, uint8_t name);
+        void write_names();
+        void close();
+
+        // Appends a record to the capture, and follows its frames
+        void capture_record(uint64_t time_ns, uint64_t value, int32_t fct,
+                event_e event, uint8_t name, uint16_t thread);
+        // Must be called with m_capture_mutex held
+        void append_capture(uint64_t time_ns, uint64_t value, int32_t fct,
+                event_e event, uint8_t name, uint16_t thread);
+        void capture_thread(FILE *fd, std::vector<uint8_t> header);
+        void stop_capture_thread();
+        void update_active();
+        std::string capture_state() const;
+        size_t capture_frames_left() const;
+
+        std::atomic<bool> m_enabled = ATOMIC_VAR_INIT(false);
+        // m_enabled, or a capture armed or running
+        std::atomic<bool> m_active = ATOMIC_VAR_INIT(false);
+
+        // Set by open() before the tracer can be enabled
+        std::string m_filename;
+        int m_fd = -1;
+        size_t m_map_size = 0;
+        header_t *m_header = nullptr;
+        record_t *m_records = nullptr;
+        size_t m_num_records = 0;
+
+        mutable std::mutex m_names_mutex;
+        std::vector<std::string> m_names;
+
+        enum class capture_e { idle, armed, capturing, writing, done, failed };
+
+        // Armed or capturing, and capturing only
+        std::atomic<bool> m_capture_armed = ATOMIC_VAR_INIT(false);
+        std::atomic<bool> m_capturing = ATOMIC_VAR_INIT(false);
+        // Bit n set to copy the outputs of the node with name n
+        std::atomic<uint64_t> m_snapshot_names = ATOMIC_VAR_INIT(0);
+
+        // The capture thread takes the pending bytes and writes them
+        mutable std::mutex m_capture_mutex;
+        std::condition_variable m_capture_cv;
+        std::string m_capture_filename;
+        // Set over the remote control for the next capture
+        std::vector<std::string> m_capture_blocks;
+        capture_e m_capture = capture_e::idle;
+        std::string m_capture_error;
+        size_t m_capture_frames = 0;
+        // frame_input events seen since the start of the capture
+        size_t m_capture_frames_seen = 0;
+        uint64_t m_capture_records = 0;
+        std::vector<uint8_t> m_capture_pending;
+        std::thread m_capture_thread;
+};
+
+/* The frame tracer used by all parts of the program, constructed at the
+ * first call so that it is destroyed before the remote control. */
+FrameTracer& frame_tracer();
@@ -20,13 +20,126 @@
  */
 
 #include "FrequencyInterleaver.h"
+#include "CpuFeatures.h"
 #include "PcDebug.h"
+#include "SharedTables.h"
 
+#include "DabModeKernels.h"
+
+#include <algorithm>
 #include <stdexcept>
 #include <string>
 #include <cstdio>
 #include <cstdlib>
 
+/* On x86, the AVX2 kernels are built with the target attribute of GCC and
+ * clang, and used if the CPU supports it. */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#    define HAVE_INTERLEAVER_KERNEL_DISPATCH 1
+#    include <immintrin.h>
+#endif
+
+/* The kernels gather: carrier j of every OFDM symbol is in[gather[j]].
+ * The output is written in order, and the random accesses are reads from
+ * the input symbol, which stays in the L1 cache. */
+template<typename T>
+static void check_size(Buffer* const dataIn, size_t carriers)
+{
+    if (dataIn->getLength() % (carriers * sizeof(T)) != 0) {
+        throw std::runtime_error(
+                "FrequencyInterleaver::process input size not valid!");
+    }
+}
+
+template<typename T>
+struct interleaver_kernel {
+    template<size_t C>
+    struct type {
+        static void process(Buffer* const dataIn, Buffer* dataOut,
+                const uint16_t * const gather, size_t carriers);
+    };
+};
+
+template<typename T>
+template<size_t C>
+void interleaver_kernel<T>::type<C>::process(Buffer* const dataIn,
+        Buffer* dataOut, const uint16_t * const gather, size_t num_carriers)
+{
+    const size_t carriers = kernel_carriers<C>(num_carriers);
+    check_size<T>(dataIn, carriers);
+
+    const T* in = reinterpret_cast<const T*>(dataIn->getData());
+    T* out = reinterpret_cast<T*>(dataOut->getData());
+    const size_t num_symbols = dataIn->getLength() / (carriers * sizeof(T));
+
+    for (size_t s = 0; s < num_symbols; s++) {
+        for (size_t j = 0; j < carriers; j += 4) {
+            out[j] = in[gather[j]];
+            out[j + 1] = in[gather[j + 1]];
+            out[j + 2] = in[gather[j + 2]];
+            out[j + 3] = in[gather[j + 3]];
+        }
+        in += carriers;
+        out += carriers;
+    }
+}
+
+#if defined(HAVE_INTERLEAVER_KERNEL_DISPATCH)
+/* Eight carriers at a time, for the 8-byte complexf and complexfix_wide
+ * samples with two vpgatherdq of four samples, and for the 4-byte
+ * complexfix samples with one vpgatherdd. The number of carriers of all
+ * modes is a multiple of eight. */
+template<typename T>
+__attribute__((target("avx2")))
+static void interleave_avx2(Buffer* const dataIn, Buffer* dataOut,
+        const uint16_t * const gather, size_t carriers)
+{
+    static_assert(sizeof(T) == 8 or sizeof(T) == 4,
+            "Unsupported sample size");
+    check_size<T>(dataIn, carriers);
+
+    const T* in = reinterpret_cast<const T*>(dataIn->getData());
+    T* out = reinterpret_cast<T*>(dataOut->getData());
+    const size_t num_symbols = dataIn->getLength() / (carriers * sizeof(T));
+
+    for (size_t s = 0; s < num_symbols; s++) {
+        for (size_t j = 0; j < carriers; j += 8) {
+            const __m256i index = _mm256_cvtepu16_epi32(_mm_loadu_si128(
+                        reinterpret_cast<const __m128i*>(gather + j)));
+            if (sizeof(T) == 8) {
+                const long long* base = reinterpret_cast<const long long*>(in);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + j),
+                        _mm256_i32gather_epi64(base,
+                            _mm256_castsi256_si128(index), 8));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + j + 4),
+                        _mm256_i32gather_epi64(base,
+                            _mm256_extracti128_si256(index, 1), 8));
+            }
+            else {
+                const int* base = reinterpret_cast<const int*>(in);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + j),
+                        _mm256_i32gather_epi32(base, index, 4));
+            }
+        }
+        in += carriers;
+        out += carriers;
+    }
+}
+#endif
+
+template<typename T>
+static FrequencyInterleaver::kernel_t select_kernel(size_t carriers)
+{
+    auto& cpu = cpu_features();
+#if defined(HAVE_INTERLEAVER_KERNEL_DISPATCH)
+    if (cpu.supports(cpu_feature_e::avx2) and carriers % 8 == 0) {
+        cpu.register_kernel("FrequencyInterleaver", "AVX2");
+        return &interleave_avx2<T>;
+    }
+#endif
+    cpu.register_kernel("FrequencyInterleaver", "scalar");
+    return select_carriers_kernel<interleaver_kernel<T>::template type>(carriers);
+}
 
 FrequencyInterleaver::FrequencyInterleaver(size_t mode, bool fixedPoint) :
     ModCodec(),
@@ -35,94 +148,97 @@ FrequencyInterleaver::FrequencyInterleaver(size_t mode, bool fixedPoint) :
     PDEBUG("FrequencyInterleaver::FrequencyInterleaver(%zu) @ %p\n",
             mode, this);
 
+    const size_t *indices = shared_carrier_indices(mode, m_carriers);
+
+    // The inverse permutation, all modes have less than 65536 carriers
+    m_gather = shared_tables::get<uint16_t>(
+            "freq-interleaver-gather-" + std::to_string(mode == 0 ? 4 : mode),
+            m_carriers, [&](uint16_t *gather) {
+                for (size_t i = 0; i < m_carriers; i++) {
+                    gather[indices[i]] = i;
+                }
+            });
+
+    m_kernel = m_fixedPoint ?
+        select_kernel<complexfix>(m_carriers) :
+        select_kernel<complexf>(m_carriers);
+}
+
+
+FrequencyInterleaver::~FrequencyInterleaver()
+{
+    PDEBUG("FrequencyInterleaver::~FrequencyInterleaver() @ %p\n", this);
+}
+
+
+std::vector<size_t> FrequencyInterleaver::carrier_indices(size_t mode)
+{
+    size_t carriers;
     size_t num;
     size_t alpha = 13;
     size_t beta;
     switch (mode) {
     case 1:
-        m_carriers = 1536;
+        carriers = 1536;
         num = 2048;
         beta = 511;
         break;
     case 2:
-        m_carriers = 384;
+        carriers = 384;
         num = 512;
         beta = 127;
         break;
     case 3:
-        m_carriers = 192;
+        carriers = 192;
         num = 256;
         beta = 63;
         break;
     case 0:
     case 4:
-        m_carriers = 768;
+        carriers = 768;
         num = 1024;
         beta = 255;
         break;
     default:
-        PDEBUG("Carriers: %zu\n", (m_carriers >> 1) << 1);
         throw std::runtime_error("FrequencyInterleaver: invalid dab mode");
     }
 
-    const int ret = posix_memalign((void**)(&m_indices), 16, m_carriers * sizeof(size_t));
-    if (ret != 0) {
-        throw std::runtime_error("memory allocation failed: " + std::to_string(ret));
-    }
+    std::vector<size_t> indices;
+    indices.reserve(carriers);
 
-    size_t *index = m_indices;
     size_t perm = 0;
     PDEBUG("i: %4u, R: %4u\n", 0, 0);
     for (size_t j = 1; j < num; ++j) {
         perm = (alpha * perm + beta) & (num - 1);
-        if (perm >= ((num - m_carriers) / 2)
-                && perm <= (num - (num - m_carriers) / 2)
+        if (perm >= ((num - carriers) / 2)
+                && perm <= (num - (num - carriers) / 2)
                 && perm != (num / 2)) {
             PDEBUG("i: %4zu, R: %4zu, d: %4zu, n: %4zu, k: %5zi, index: %zu\n",
-                    j, perm, perm, index - m_indices, perm - num / 2,
+                    j, perm, perm, indices.size(), perm - num / 2,
                     perm > num / 2
                     ?  perm - (1 + (num / 2))
-                    : perm + (m_carriers - (num / 2)));
-            *(index++) = perm > num / 2 ?
-                perm - (1 + (num / 2)) : perm + (m_carriers - (num / 2));
+                    : perm + (carriers - (num / 2)));
+            indices.push_back(perm > num / 2 ?
+                perm - (1 + (num / 2)) : perm + (carriers - (num / 2)));
         }
         else {
             PDEBUG("i: %4zu, R: %4zu\n", j, perm);
         }
     }
-}
-
-
-FrequencyInterleaver::~FrequencyInterleaver()
-{
-    PDEBUG("FrequencyInterleaver::~FrequencyInterleaver() @ %p\n", this);
 
-    free(m_indices);
+    return indices;
 }
 
-template<typename T>
-void do_process(Buffer* const dataIn, Buffer* dataOut,
-        size_t carriers, const size_t * const indices)
+const size_t *FrequencyInterleaver::shared_carrier_indices(size_t mode,
+        size_t& carriers)
 {
-    const T* in = reinterpret_cast<const T*>(dataIn->getData());
-    T* out = reinterpret_cast<T*>(dataOut->getData());
-    size_t sizeIn = dataIn->getLength() / sizeof(T);
-
-    if (sizeIn % carriers != 0) {
-        throw std::runtime_error(
-                "FrequencyInterleaver::process input size not valid!");
-    }
-
-    for (size_t i = 0; i < sizeIn;) {
-//      memset(out, 0, m_carriers * sizeof(T));
-        for (size_t j = 0; j < carriers; i += 4, j += 4) {
-            out[indices[j]] = in[i];
-            out[indices[j + 1]] = in[i + 1];
-            out[indices[j + 2]] = in[i + 2];
-            out[indices[j + 3]] = in[i + 3];
-        }
-        out += carriers;
-    }
+    const auto indices = carrier_indices(mode);
+    carriers = indices.size();
+    return shared_tables::get<size_t>(
+            "carrier-indices-" + std::to_string(mode == 0 ? 4 : mode),
+            carriers, [&](size_t *values) {
+                std::copy(indices.begin(), indices.end(), values);
+            });
 }
 
 int FrequencyInterleaver::process(Buffer* const dataIn, Buffer* dataOut)
@@ -132,13 +248,7 @@ int FrequencyInterleaver::process(Buffer* const dataIn, Buffer* dataOut)
             dataIn, dataIn->getLength(), dataOut, dataOut->getLength());
 
     dataOut->setLength(dataIn->getLength());
-
-    if (m_fixedPoint) {
-        do_process<complexfix>(dataIn, dataOut, m_carriers, m_indices);
-    }
-    else {
-        do_process<complexf>(dataIn, dataOut, m_carriers, m_indices);
-    }
+    m_kernel(dataIn, dataOut, m_gather, m_carriers);
 
     return 1;
 }
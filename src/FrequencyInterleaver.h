@@ -27,7 +27,9 @@
 
 #include "ModPlugin.h"
 
+#include <cstdint>
 #include <sys/types.h>
+#include <vector>
 
 class FrequencyInterleaver : public ModCodec
 {
@@ -40,9 +42,28 @@ public:
     int process(Buffer* const dataIn, Buffer* dataOut) override;
     const char* name() override { return "FrequencyInterleaver"; }
 
+    /* For every QPSK symbol of an OFDM symbol, the index of the
+     * carrier it is sent on. The size of the vector is the number of
+     * carriers of the mode. */
+    static std::vector<size_t> carrier_indices(size_t mode);
+
+    /* The same, in a table shared with the other blocks and processes,
+     * see shared_tables. carriers is set to the size of the table. */
+    static const size_t *shared_carrier_indices(size_t mode,
+            size_t& carriers);
+
+    // The kernel for the number of carriers of the mode
+    using kernel_t = void (*)(Buffer* const dataIn, Buffer* dataOut,
+            const uint16_t * const gather, size_t carriers);
+
 protected:
     bool m_fixedPoint;
     size_t m_carriers;
-    size_t *m_indices;
+
+    // The inverse of the carrier indices: for every carrier, the index of
+    // the QPSK symbol it carries, see shared_tables
+    const uint16_t *m_gather = nullptr;
+
+    kernel_t m_kernel;
 };
 
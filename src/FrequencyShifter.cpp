@@ -0,0 +1,191 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "FrequencyShifter.h"
+#include "PcDebug.h"
+#include "Simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+// Number of samples for which the rotation of the oscillator is
+// precomputed. The phase is carried in double precision from one block to
+// the next.
+static constexpr size_t BLOCK_SIZE = 4096;
+
+// Half the bandwidth of the DAB signal
+static constexpr double HALF_BANDWIDTH = 768000;
+
+FrequencyShifter::FrequencyShifter(size_t sample_rate, double offset,
+        bool real_output) :
+    ModCodec(),
+    RemoteControllable("freqshift"),
+    m_sample_rate(sample_rate),
+    m_real_output(real_output),
+    m_requested_offset(offset),
+    m_rotation(BLOCK_SIZE),
+    m_lo(BLOCK_SIZE)
+{
+    PDEBUG("FrequencyShifter::FrequencyShifter(%zu, %f, %d) @ %p\n",
+            sample_rate, offset, real_output, this);
+
+    RC_ADD_PARAMETER(offset, "Frequency offset in Hz");
+    RC_ADD_PARAMETER(real_output,
+            "(Read-only) 1 if only the real part of the signal is output");
+
+    check_offset(offset);
+    set_offset(offset);
+}
+
+void FrequencyShifter::check_offset(double offset) const
+{
+    if (fabs(offset) + HALF_BANDWIDTH > m_sample_rate / 2.0) {
+        throw invalid_argument("FrequencyShifter: the offset " +
+                to_string(offset) + " Hz moves the signal out of the " +
+                "output bandwidth");
+    }
+
+    if (m_real_output and fabs(offset) <= HALF_BANDWIDTH) {
+        throw invalid_argument("FrequencyShifter: with a real output, the "
+                "offset must be larger than " + to_string(HALF_BANDWIDTH) +
+                " Hz");
+    }
+}
+
+void FrequencyShifter::set_offset(double offset)
+{
+    m_offset = offset;
+    const double phase_step = 2.0 * M_PI * offset / m_sample_rate;
+    for (size_t k = 0; k < m_rotation.size(); k++) {
+        m_rotation[k] = complexf(polar(1.0, phase_step * k));
+    }
+}
+
+int FrequencyShifter::process(Buffer* const dataIn, Buffer* dataOut)
+{
+    PDEBUG("FrequencyShifter::process(dataIn: %p, dataOut: %p)\n",
+            dataIn, dataOut);
+
+    const double requested_offset = m_requested_offset.load();
+    if (requested_offset != m_offset) {
+        set_offset(requested_offset);
+    }
+
+    dataOut->setLength(dataIn->getLength());
+    const size_t num_samples = dataIn->getLength() / sizeof(complexf);
+    const complexf *in = reinterpret_cast<const complexf*>(dataIn->getData());
+    complexf *out = reinterpret_cast<complexf*>(dataOut->getData());
+
+    const double phase_step = 2.0 * M_PI * m_offset / m_sample_rate;
+
+    for (size_t start = 0; start < num_samples; start += BLOCK_SIZE) {
+        const size_t len = std::min(BLOCK_SIZE, num_samples - start);
+
+        // Oscillator at the phase of the block
+        const float p_re = cos(m_phase);
+        const float p_im = sin(m_phase);
+        for (size_t k = 0; k < len; k++) {
+            const complexf r = m_rotation[k];
+            m_lo[k] = complexf(r.real() * p_re - r.imag() * p_im,
+                    r.real() * p_im + r.imag() * p_re);
+        }
+
+        const complexf *block_in = in + start;
+        complexf *block_out = out + start;
+        size_t j = 0;
+        for (; j + simd::cf_width <= len; j += simd::cf_width) {
+            simd::store(block_out + j, simd::cmul(simd::load(block_in + j),
+                        simd::load(m_lo.data() + j)));
+        }
+        for (; j < len; j++) {
+            block_out[j] = block_in[j] * m_lo[j];
+        }
+
+        if (m_real_output) {
+            for (size_t k = 0; k < len; k++) {
+                block_out[k] = complexf(block_out[k].real(), 0.0f);
+            }
+        }
+
+        m_phase = fmod(m_phase + phase_step * len, 2.0 * M_PI);
+    }
+
+    return dataOut->getLength();
+}
+
+void FrequencyShifter::set_parameter(const string& parameter,
+        const string& value)
+{
+    stringstream ss(value);
+    ss.exceptions ( stringstream::failbit | stringstream::badbit );
+
+    if (parameter == "offset") {
+        double offset = 0;
+        ss >> offset;
+        try {
+            check_offset(offset);
+        }
+        catch (const invalid_argument& e) {
+            throw ParameterError(e.what());
+        }
+        m_requested_offset = offset;
+    }
+    else if (parameter == "real_output") {
+        throw ParameterError("Parameter " + parameter + " is read-only");
+    }
+    else {
+        stringstream ss_err;
+        ss_err << "Parameter '" << parameter <<
+            "' is not exported by controllable " << get_rc_name();
+        throw ParameterError(ss_err.str());
+    }
+}
+
+const string FrequencyShifter::get_parameter(const string& parameter) const
+{
+    stringstream ss;
+    if (parameter == "offset") {
+        ss << m_requested_offset.load();
+    }
+    else if (parameter == "real_output") {
+        ss << (m_real_output ? 1 : 0);
+    }
+    else {
+        ss << "Parameter '" << parameter <<
+            "' is not exported by controllable " << get_rc_name();
+        throw ParameterError(ss.str());
+    }
+    return ss.str();
+}
+
+const json::map_t FrequencyShifter::get_all_values() const
+{
+    json::map_t map;
+    map["offset"].v = m_requested_offset.load();
+    map["real_output"].v = m_real_output;
+    return map;
+}
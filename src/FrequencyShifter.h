@@ -0,0 +1,93 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include "ModPlugin.h"
+#include "RemoteControl.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+/* Shifts the signal in frequency with a numerically controlled oscillator,
+ * after the resampler. Unlike the lo_offset or the frequency of the SDR
+ * device, changing the offset does not retune the device: the new offset
+ * is taken at the start of the next buffer, and the phase of the
+ * oscillator continues where it was.
+ *
+ * With real_output, only the real part of the shifted signal is kept and
+ * the imaginary part is set to zero, for DACs that have no I/Q modulator
+ * and take the I channel as an IF signal. The offset must then be larger
+ * than half the bandwidth of the signal, so that the signal does not
+ * overlap its mirror image.
+ *
+ * Only floating-point samples are supported. */
+class FrequencyShifter : public ModCodec, public RemoteControllable
+{
+    public:
+        FrequencyShifter(size_t sample_rate, double offset, bool real_output);
+        FrequencyShifter(const FrequencyShifter& other) = delete;
+        FrequencyShifter& operator=(const FrequencyShifter& other) = delete;
+
+        int process(Buffer* const dataIn, Buffer* dataOut) override;
+        const char* name() override { return "FrequencyShifter"; }
+
+        bool supports_in_place() const override { return true; }
+        bool supports_streaming() const override { return true; }
+
+        /******* REMOTE CONTROL ********/
+        virtual void set_parameter(const std::string& parameter,
+                const std::string& value) override;
+
+        virtual const std::string get_parameter(
+                const std::string& parameter) const override;
+
+        virtual const json::map_t get_all_values() const override;
+
+    private:
+        // Throws std::invalid_argument if the shifted signal does not fit
+        // in the output bandwidth
+        void check_offset(double offset) const;
+        void set_offset(double offset);
+
+        const size_t m_sample_rate;
+        const bool m_real_output;
+
+        // Set by the remote control, taken by process()
+        std::atomic<double> m_requested_offset;
+
+        // The offset in Hz the rotation was computed for, the phase of the
+        // oscillator at the next sample in radians, and the rotation of the
+        // oscillator over one block of samples starting at phase zero
+        double m_offset = 0.0;
+        double m_phase = 0.0;
+        std::vector<complexf> m_rotation;
+
+        // The oscillator over the current block
+        std::vector<complexf> m_lo;
+};
@@ -26,50 +26,685 @@
  */
 
 #include "GainControl.h"
+#include "ConfigParser.h"
+#include "CpuFeatures.h"
 #include "PcDebug.h"
+#include "Log.h"
+#include "Simd.h"
 
+#include <cfloat>
+#include <cmath>
 #include <cstdio>
 #include <stdexcept>
 #include <algorithm>
 #include <string>
 
-#ifdef __SSE__
-#  include <xmmintrin.h>
-union u128_union_t {
-    __m128 m;
-    float f[4];
+#if defined(__x86_64__) || defined(__i386__)
+#    include <immintrin.h>
+#elif defined(__ARM_NEON)
+#    include <arm_neon.h>
+#endif
+
+using namespace std;
+
+/* The kernels work on the real and imaginary parts as n floats.
+ *
+ * peak() returns max(-min, max) over all values.
+ *
+ * welford() computes a running mean and sum of squared differences from the
+ * mean with the Welford algorithm, in a single pass, for each of 8 lanes.
+ * Lane j gets the values in[8*i + j]. It returns how many values every lane
+ * got: the last n % 8 values are left to the caller.
+ *
+ * apply() multiplies with the gain, and clips the result to
+ * [clip_min, clip_max] if clip is set. It returns the number of clipped
+ * values.
+ *
+ * All kernels give exactly the same result: the vectorised ones keep the
+ * same 8 lanes and do the operations in the same order, without
+ * fused multiply-add.
+ */
+struct GainControl::kernels_t {
+    float (*peak)(const float *in, size_t n);
+    size_t (*welford)(const float *in, size_t n, float *mean, float *m2);
+    size_t (*apply)(const float *in, float *out, size_t n, float gain,
+            bool clip, float clip_min, float clip_max);
+    const char *name;
 };
+
+static constexpr size_t welford_lanes = 8;
+
+static inline float peak_scalar_range(const float *in, size_t start,
+        size_t stop, float min, float max)
+{
+    for (size_t i = start; i < stop; i++) {
+        if (in[i] < min) {
+            min = in[i];
+        }
+        if (in[i] > max) {
+            max = in[i];
+        }
+    }
+    return std::max(-min, max);
+}
+
+static float peak_scalar(const float *in, size_t n)
+{
+    return peak_scalar_range(in, 0, n, FLT_MAX, FLT_MIN);
+}
+
+static size_t welford_scalar(const float *in, size_t n,
+        float *mean, float *m2)
+{
+    float mu[welford_lanes] = {};
+    float s[welford_lanes] = {};
+
+    const size_t count = n / welford_lanes;
+    for (size_t i = 0; i < count; i++) {
+        const float inv = 1.0f / (float)(i + 1);
+        for (size_t j = 0; j < welford_lanes; j++) {
+            const float x = in[welford_lanes * i + j];
+            const float delta = x - mu[j];
+            mu[j] += delta * inv;
+            s[j] += delta * (x - mu[j]);
+        }
+    }
+
+    std::copy(mu, mu + welford_lanes, mean);
+    std::copy(s, s + welford_lanes, m2);
+    return count;
+}
+
+static size_t apply_scalar_range(const float *in, float *out,
+        size_t start, size_t stop, float gain,
+        bool clip, float clip_min, float clip_max)
+{
+    size_t num_clipped = 0;
+    if (clip) {
+        for (size_t i = start; i < stop; i++) {
+            const float v = in[i] * gain;
+            if (v < clip_min) {
+                out[i] = clip_min;
+                num_clipped++;
+            }
+            else if (v > clip_max) {
+                out[i] = clip_max;
+                num_clipped++;
+            }
+            else {
+                out[i] = v;
+            }
+        }
+    }
+    else {
+        for (size_t i = start; i < stop; i++) {
+            out[i] = in[i] * gain;
+        }
+    }
+    return num_clipped;
+}
+
+static size_t apply_scalar(const float *in, float *out, size_t n, float gain,
+        bool clip, float clip_min, float clip_max)
+{
+    return apply_scalar_range(in, out, 0, n, gain, clip, clip_min, clip_max);
+}
+
+#if defined(__SSE2__)
+static float peak_sse(const float *in, size_t n)
+{
+    __m128 min = _mm_set1_ps(FLT_MAX);
+    __m128 max = _mm_set1_ps(FLT_MIN);
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const __m128 x = _mm_loadu_ps(&in[i]);
+        min = _mm_min_ps(x, min);
+        max = _mm_max_ps(x, max);
+    }
+
+    float mins[4], maxs[4];
+    _mm_storeu_ps(mins, min);
+    _mm_storeu_ps(maxs, max);
+    return peak_scalar_range(in, i, n,
+            std::min(std::min(mins[0], mins[1]), std::min(mins[2], mins[3])),
+            std::max(std::max(maxs[0], maxs[1]), std::max(maxs[2], maxs[3])));
+}
+
+static size_t welford_sse(const float *in, size_t n, float *mean, float *m2)
+{
+    // Lanes 0 to 3 and 4 to 7
+    __m128 mu0 = _mm_setzero_ps();
+    __m128 mu1 = _mm_setzero_ps();
+    __m128 s0 = _mm_setzero_ps();
+    __m128 s1 = _mm_setzero_ps();
+
+    const size_t count = n / welford_lanes;
+    for (size_t i = 0; i < count; i++) {
+        const __m128 inv = _mm_set1_ps(1.0f / (float)(i + 1));
+        const __m128 x0 = _mm_loadu_ps(&in[welford_lanes * i]);
+        const __m128 x1 = _mm_loadu_ps(&in[welford_lanes * i + 4]);
+        const __m128 delta0 = _mm_sub_ps(x0, mu0);
+        const __m128 delta1 = _mm_sub_ps(x1, mu1);
+        mu0 = _mm_add_ps(mu0, _mm_mul_ps(delta0, inv));
+        mu1 = _mm_add_ps(mu1, _mm_mul_ps(delta1, inv));
+        s0 = _mm_add_ps(s0, _mm_mul_ps(delta0, _mm_sub_ps(x0, mu0)));
+        s1 = _mm_add_ps(s1, _mm_mul_ps(delta1, _mm_sub_ps(x1, mu1)));
+    }
+
+    _mm_storeu_ps(mean, mu0);
+    _mm_storeu_ps(mean + 4, mu1);
+    _mm_storeu_ps(m2, s0);
+    _mm_storeu_ps(m2 + 4, s1);
+    return count;
+}
+
+static size_t apply_sse(const float *in, float *out, size_t n, float gain,
+        bool clip, float clip_min, float clip_max)
+{
+    const __m128 g = _mm_set1_ps(gain);
+
+    size_t i = 0;
+    size_t num_clipped = 0;
+    if (clip) {
+        const __m128 lo = _mm_set1_ps(clip_min);
+        const __m128 hi = _mm_set1_ps(clip_max);
+        // Every clipped value subtracts a mask of all ones, i.e. -1
+        __m128i count = _mm_setzero_si128();
+        for (; i + 4 <= n; i += 4) {
+            const __m128 v = _mm_mul_ps(_mm_loadu_ps(&in[i]), g);
+            const __m128 clipped = _mm_or_ps(
+                    _mm_cmplt_ps(v, lo), _mm_cmpgt_ps(v, hi));
+            count = _mm_sub_epi32(count, _mm_castps_si128(clipped));
+            // With the value as second operand, a NaN is kept like in
+            // the scalar version
+            _mm_storeu_ps(&out[i], _mm_min_ps(hi, _mm_max_ps(lo, v)));
+        }
+        uint32_t counts[4];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(counts), count);
+        num_clipped = counts[0] + counts[1] + counts[2] + counts[3];
+    }
+    else {
+        for (; i + 4 <= n; i += 4) {
+            _mm_storeu_ps(&out[i], _mm_mul_ps(_mm_loadu_ps(&in[i]), g));
+        }
+    }
+    return num_clipped +
+        apply_scalar_range(in, out, i, n, gain, clip, clip_min, clip_max);
+}
 #endif
 
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+// Compiled for AVX2 even if the rest of the program isn't, and only used if
+// the CPU supports it.
+#  define HAVE_GAIN_KERNEL_DISPATCH 1
 
-using namespace std;
+__attribute__((target("avx2")))
+static float peak_avx2(const float *in, size_t n)
+{
+    __m256 min = _mm256_set1_ps(FLT_MAX);
+    __m256 max = _mm256_set1_ps(FLT_MIN);
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256 x = _mm256_loadu_ps(&in[i]);
+        min = _mm256_min_ps(x, min);
+        max = _mm256_max_ps(x, max);
+    }
+
+    const __m128 min4 = _mm_min_ps(
+            _mm256_castps256_ps128(min), _mm256_extractf128_ps(min, 1));
+    const __m128 max4 = _mm_max_ps(
+            _mm256_castps256_ps128(max), _mm256_extractf128_ps(max, 1));
+    float mins[4], maxs[4];
+    _mm_storeu_ps(mins, min4);
+    _mm_storeu_ps(maxs, max4);
+    return peak_scalar_range(in, i, n,
+            std::min(std::min(mins[0], mins[1]), std::min(mins[2], mins[3])),
+            std::max(std::max(maxs[0], maxs[1]), std::max(maxs[2], maxs[3])));
+}
+
+__attribute__((target("avx2")))
+static size_t welford_avx2(const float *in, size_t n, float *mean, float *m2)
+{
+    __m256 mu = _mm256_setzero_ps();
+    __m256 s = _mm256_setzero_ps();
+
+    const size_t count = n / welford_lanes;
+    for (size_t i = 0; i < count; i++) {
+        const __m256 inv = _mm256_set1_ps(1.0f / (float)(i + 1));
+        const __m256 x = _mm256_loadu_ps(&in[welford_lanes * i]);
+        const __m256 delta = _mm256_sub_ps(x, mu);
+        mu = _mm256_add_ps(mu, _mm256_mul_ps(delta, inv));
+        s = _mm256_add_ps(s, _mm256_mul_ps(delta, _mm256_sub_ps(x, mu)));
+    }
 
-static float var_variance;
+    _mm256_storeu_ps(mean, mu);
+    _mm256_storeu_ps(m2, s);
+    return count;
+}
+
+__attribute__((target("avx2")))
+static size_t apply_avx2(const float *in, float *out, size_t n, float gain,
+        bool clip, float clip_min, float clip_max)
+{
+    const __m256 g = _mm256_set1_ps(gain);
+
+    size_t i = 0;
+    size_t num_clipped = 0;
+    if (clip) {
+        const __m256 lo = _mm256_set1_ps(clip_min);
+        const __m256 hi = _mm256_set1_ps(clip_max);
+        __m256i count = _mm256_setzero_si256();
+        for (; i + 8 <= n; i += 8) {
+            const __m256 v = _mm256_mul_ps(_mm256_loadu_ps(&in[i]), g);
+            const __m256 clipped = _mm256_or_ps(
+                    _mm256_cmp_ps(v, lo, _CMP_LT_OQ),
+                    _mm256_cmp_ps(v, hi, _CMP_GT_OQ));
+            count = _mm256_sub_epi32(count, _mm256_castps_si256(clipped));
+            _mm256_storeu_ps(&out[i],
+                    _mm256_min_ps(hi, _mm256_max_ps(lo, v)));
+        }
+        uint32_t counts[8];
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(counts), count);
+        for (const auto c : counts) {
+            num_clipped += c;
+        }
+    }
+    else {
+        for (; i + 8 <= n; i += 8) {
+            _mm256_storeu_ps(&out[i],
+                    _mm256_mul_ps(_mm256_loadu_ps(&in[i]), g));
+        }
+    }
+    return num_clipped +
+        apply_scalar_range(in, out, i, n, gain, clip, clip_min, clip_max);
+}
+#endif
+
+#if defined(__ARM_NEON)
+static float peak_neon(const float *in, size_t n)
+{
+    float32x4_t min = vdupq_n_f32(FLT_MAX);
+    float32x4_t max = vdupq_n_f32(FLT_MIN);
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const float32x4_t x = vld1q_f32(&in[i]);
+        min = vminq_f32(x, min);
+        max = vmaxq_f32(x, max);
+    }
+
+    float mins[4], maxs[4];
+    vst1q_f32(mins, min);
+    vst1q_f32(maxs, max);
+    return peak_scalar_range(in, i, n,
+            std::min(std::min(mins[0], mins[1]), std::min(mins[2], mins[3])),
+            std::max(std::max(maxs[0], maxs[1]), std::max(maxs[2], maxs[3])));
+}
+
+static size_t welford_neon(const float *in, size_t n, float *mean, float *m2)
+{
+    float32x4_t mu0 = vdupq_n_f32(0.0f);
+    float32x4_t mu1 = vdupq_n_f32(0.0f);
+    float32x4_t s0 = vdupq_n_f32(0.0f);
+    float32x4_t s1 = vdupq_n_f32(0.0f);
+
+    const size_t count = n / welford_lanes;
+    for (size_t i = 0; i < count; i++) {
+        const float32x4_t inv = vdupq_n_f32(1.0f / (float)(i + 1));
+        const float32x4_t x0 = vld1q_f32(&in[welford_lanes * i]);
+        const float32x4_t x1 = vld1q_f32(&in[welford_lanes * i + 4]);
+        const float32x4_t delta0 = vsubq_f32(x0, mu0);
+        const float32x4_t delta1 = vsubq_f32(x1, mu1);
+        mu0 = vaddq_f32(mu0, vmulq_f32(delta0, inv));
+        mu1 = vaddq_f32(mu1, vmulq_f32(delta1, inv));
+        s0 = vaddq_f32(s0, vmulq_f32(delta0, vsubq_f32(x0, mu0)));
+        s1 = vaddq_f32(s1, vmulq_f32(delta1, vsubq_f32(x1, mu1)));
+    }
+
+    vst1q_f32(mean, mu0);
+    vst1q_f32(mean + 4, mu1);
+    vst1q_f32(m2, s0);
+    vst1q_f32(m2 + 4, s1);
+    return count;
+}
+
+static size_t apply_neon(const float *in, float *out, size_t n, float gain,
+        bool clip, float clip_min, float clip_max)
+{
+    const float32x4_t g = vdupq_n_f32(gain);
+
+    size_t i = 0;
+    size_t num_clipped = 0;
+    if (clip) {
+        const float32x4_t lo = vdupq_n_f32(clip_min);
+        const float32x4_t hi = vdupq_n_f32(clip_max);
+        uint32x4_t count = vdupq_n_u32(0);
+        for (; i + 4 <= n; i += 4) {
+            const float32x4_t v = vmulq_f32(vld1q_f32(&in[i]), g);
+            const uint32x4_t clipped = vorrq_u32(
+                    vcltq_f32(v, lo), vcgtq_f32(v, hi));
+            count = vsubq_u32(count, clipped);
+            // vmaxq and vminq return NaN if one operand is NaN
+            vst1q_f32(&out[i], vminq_f32(hi, vmaxq_f32(lo, v)));
+        }
+        uint32_t counts[4];
+        vst1q_u32(counts, count);
+        num_clipped = counts[0] + counts[1] + counts[2] + counts[3];
+    }
+    else {
+        for (; i + 4 <= n; i += 4) {
+            vst1q_f32(&out[i], vmulq_f32(vld1q_f32(&in[i]), g));
+        }
+    }
+    return num_clipped +
+        apply_scalar_range(in, out, i, n, gain, clip, clip_min, clip_max);
+}
+#endif
+
+static GainControl::kernels_t select_gain_kernels()
+{
+    auto& cpu = cpu_features();
+    GainControl::kernels_t kernels =
+        {peak_scalar, welford_scalar, apply_scalar, "scalar"};
+#if defined(HAVE_GAIN_KERNEL_DISPATCH)
+    if (cpu.supports(cpu_feature_e::avx2)) {
+        kernels = {peak_avx2, welford_avx2, apply_avx2, "AVX2"};
+    }
+    else
+#endif
+#if defined(__SSE2__)
+    if (cpu.supports(cpu_feature_e::sse2)) {
+        kernels = {peak_sse, welford_sse, apply_sse, "SSE"};
+    }
+#elif defined(__ARM_NEON)
+    if (cpu.supports(cpu_feature_e::neon)) {
+        kernels = {peak_neon, welford_neon, apply_neon, "NEON"};
+    }
+#endif
+    cpu.register_kernel("GainControl", kernels.name);
+    return kernels;
+}
+
+static const GainControl::kernels_t& gain_kernels()
+{
+    static const GainControl::kernels_t kernels = select_gain_kernels();
+    return kernels;
+}
+
+/* The fixed-point samples are pairs of int16_t for complexfix, and of
+ * int32_t for complexfix_wide, of which the FormatConverter drops the
+ * lowest bits to get s16. These kernels are selected at compile time. */
+static constexpr int wide_to_s16_shift = 6;
+
+// max(-min, max) over n values
+static int64_t peak_fixed(const int16_t *in, size_t n)
+{
+    int32_t min = 0;
+    int32_t max = 0;
+    size_t i = 0;
+#if defined(__SSE2__)
+    __m128i vmin = _mm_setzero_si128();
+    __m128i vmax = _mm_setzero_si128();
+    for (; i + 8 <= n; i += 8) {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        vmin = _mm_min_epi16(vmin, x);
+        vmax = _mm_max_epi16(vmax, x);
+    }
+    int16_t mins[8], maxs[8];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(mins), vmin);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(maxs), vmax);
+#elif defined(__ARM_NEON)
+    int16x8_t vmin = vdupq_n_s16(0);
+    int16x8_t vmax = vdupq_n_s16(0);
+    for (; i + 8 <= n; i += 8) {
+        const int16x8_t x = vld1q_s16(in + i);
+        vmin = vminq_s16(vmin, x);
+        vmax = vmaxq_s16(vmax, x);
+    }
+    int16_t mins[8], maxs[8];
+    vst1q_s16(mins, vmin);
+    vst1q_s16(maxs, vmax);
+#endif
+#if defined(__SSE2__) || defined(__ARM_NEON)
+    for (size_t j = 0; j < 8; j++) {
+        min = std::min<int32_t>(min, mins[j]);
+        max = std::max<int32_t>(max, maxs[j]);
+    }
+#endif
+    for (; i < n; i++) {
+        min = std::min<int32_t>(min, in[i]);
+        max = std::max<int32_t>(max, in[i]);
+    }
+    return std::max(-(int64_t)min, (int64_t)max);
+}
+
+static int64_t peak_fixed(const int32_t *in, size_t n)
+{
+    int32_t min = 0;
+    int32_t max = 0;
+    size_t i = 0;
+#if defined(__ARM_NEON) && !defined(__SSE2__)
+    int32x4_t vmin = vdupq_n_s32(0);
+    int32x4_t vmax = vdupq_n_s32(0);
+    for (; i + 4 <= n; i += 4) {
+        const int32x4_t x = vld1q_s32(in + i);
+        vmin = vminq_s32(vmin, x);
+        vmax = vmaxq_s32(vmax, x);
+    }
+    int32_t mins[4], maxs[4];
+    vst1q_s32(mins, vmin);
+    vst1q_s32(maxs, vmax);
+    for (size_t j = 0; j < 4; j++) {
+        min = std::min(min, mins[j]);
+        max = std::max(max, maxs[j]);
+    }
+#endif
+    for (; i < n; i++) {
+        min = std::min(min, in[i]);
+        max = std::max(max, in[i]);
+    }
+    return std::max(-(int64_t)min, (int64_t)max);
+}
+
+/* The sums of the real and imaginary parts and of their squares. The
+ * values of complexfix_wide are first shifted to the range of s16, which
+ * keeps the sums of the squares of up to 8192 samples in 64 bits. */
+struct fixed_moments_t {
+    int64_t sum_re = 0;
+    int64_t sum_im = 0;
+    int64_t sq_re = 0;
+    int64_t sq_im = 0;
+};
+
+// The 32-bit lane sums of the vectorised loops are added up in 64 bits
+// after at most this number of complex samples
+static constexpr size_t moments_chunk = 16384;
+
+static fixed_moments_t moments_fixed(const int16_t *in, size_t n)
+{
+    fixed_moments_t m;
+    size_t i = 0;
+#if defined(__SSE2__)
+    // The real part is the lower half of every 32-bit lane
+    const __m128i mask_re = _mm_set1_epi32(0x0000FFFF);
+    const __m128i mask_im = _mm_set1_epi32((int32_t)0xFFFF0000);
+    const __m128i one_re = _mm_set1_epi32(1);
+    const __m128i one_im = _mm_set1_epi32(1 << 16);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sq_re = zero;
+    __m128i sq_im = zero;
+    while (i + 4 <= n) {
+        const size_t stop = std::min(n, i + moments_chunk);
+        __m128i sum_re = zero;
+        __m128i sum_im = zero;
+        for (; i + 4 <= stop; i += 4) {
+            const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i));
+            sum_re = _mm_add_epi32(sum_re, _mm_madd_epi16(x, one_re));
+            sum_im = _mm_add_epi32(sum_im, _mm_madd_epi16(x, one_im));
+            // The squares are not negative, and at most 2^30
+            const __m128i x2_re = _mm_madd_epi16(x, _mm_and_si128(x, mask_re));
+            const __m128i x2_im = _mm_madd_epi16(x, _mm_and_si128(x, mask_im));
+            sq_re = _mm_add_epi64(sq_re, _mm_add_epi64(
+                        _mm_unpacklo_epi32(x2_re, zero), _mm_unpackhi_epi32(x2_re, zero)));
+            sq_im = _mm_add_epi64(sq_im, _mm_add_epi64(
+                        _mm_unpacklo_epi32(x2_im, zero), _mm_unpackhi_epi32(x2_im, zero)));
+        }
+        int32_t re[4], im[4];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(re), sum_re);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(im), sum_im);
+        for (size_t j = 0; j < 4; j++) {
+            m.sum_re += re[j];
+            m.sum_im += im[j];
+        }
+    }
+    int64_t re2[2], im2[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(re2), sq_re);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(im2), sq_im);
+    m.sq_re = re2[0] + re2[1];
+    m.sq_im = im2[0] + im2[1];
+#elif defined(__ARM_NEON)
+    int64x2_t sq_re = vdupq_n_s64(0);
+    int64x2_t sq_im = vdupq_n_s64(0);
+    while (i + 8 <= n) {
+        const size_t stop = std::min(n, i + moments_chunk);
+        int32x4_t sum_re = vdupq_n_s32(0);
+        int32x4_t sum_im = vdupq_n_s32(0);
+        for (; i + 8 <= stop; i += 8) {
+            const int16x8x2_t x = vld2q_s16(in + 2 * i);
+            sum_re = vpadalq_s16(sum_re, x.val[0]);
+            sum_im = vpadalq_s16(sum_im, x.val[1]);
+            const int16x4_t re_lo = vget_low_s16(x.val[0]);
+            const int16x4_t re_hi = vget_high_s16(x.val[0]);
+            const int16x4_t im_lo = vget_low_s16(x.val[1]);
+            const int16x4_t im_hi = vget_high_s16(x.val[1]);
+            sq_re = vpadalq_s32(sq_re, vmull_s16(re_lo, re_lo));
+            sq_re = vpadalq_s32(sq_re, vmull_s16(re_hi, re_hi));
+            sq_im = vpadalq_s32(sq_im, vmull_s16(im_lo, im_lo));
+            sq_im = vpadalq_s32(sq_im, vmull_s16(im_hi, im_hi));
+        }
+        int32_t re[4], im[4];
+        vst1q_s32(re, sum_re);
+        vst1q_s32(im, sum_im);
+        for (size_t j = 0; j < 4; j++) {
+            m.sum_re += re[j];
+            m.sum_im += im[j];
+        }
+    }
+    m.sq_re = vgetq_lane_s64(sq_re, 0) + vgetq_lane_s64(sq_re, 1);
+    m.sq_im = vgetq_lane_s64(sq_im, 0) + vgetq_lane_s64(sq_im, 1);
+#endif
+    for (; i < n; i++) {
+        const int64_t re = in[2 * i];
+        const int64_t im = in[2 * i + 1];
+        m.sum_re += re;
+        m.sum_im += im;
+        m.sq_re += re * re;
+        m.sq_im += im * im;
+    }
+    return m;
+}
+
+static fixed_moments_t moments_fixed(const int32_t *in, size_t n)
+{
+    fixed_moments_t m;
+    size_t i = 0;
+#if defined(__ARM_NEON) && !defined(__SSE2__)
+    int64x2_t sum_re = vdupq_n_s64(0);
+    int64x2_t sum_im = vdupq_n_s64(0);
+    int64x2_t sq_re = vdupq_n_s64(0);
+    int64x2_t sq_im = vdupq_n_s64(0);
+    for (; i + 4 <= n; i += 4) {
+        const int32x4x2_t x = vld2q_s32(in + 2 * i);
+        const int32x4_t re = vshrq_n_s32(x.val[0], wide_to_s16_shift);
+        const int32x4_t im = vshrq_n_s32(x.val[1], wide_to_s16_shift);
+        sum_re = vpadalq_s32(sum_re, re);
+        sum_im = vpadalq_s32(sum_im, im);
+        sq_re = vaddq_s64(sq_re, vmull_s32(vget_low_s32(re), vget_low_s32(re)));
+        sq_re = vaddq_s64(sq_re, vmull_s32(vget_high_s32(re), vget_high_s32(re)));
+        sq_im = vaddq_s64(sq_im, vmull_s32(vget_low_s32(im), vget_low_s32(im)));
+        sq_im = vaddq_s64(sq_im, vmull_s32(vget_high_s32(im), vget_high_s32(im)));
+    }
+    m.sum_re = vgetq_lane_s64(sum_re, 0) + vgetq_lane_s64(sum_re, 1);
+    m.sum_im = vgetq_lane_s64(sum_im, 0) + vgetq_lane_s64(sum_im, 1);
+    m.sq_re = vgetq_lane_s64(sq_re, 0) + vgetq_lane_s64(sq_re, 1);
+    m.sq_im = vgetq_lane_s64(sq_im, 0) + vgetq_lane_s64(sq_im, 1);
+#endif
+    for (; i < n; i++) {
+        const int64_t re = in[2 * i] >> wide_to_s16_shift;
+        const int64_t im = in[2 * i + 1] >> wide_to_s16_shift;
+        m.sum_re += re;
+        m.sum_im += im;
+        m.sq_re += re * re;
+        m.sq_im += im * im;
+    }
+    return m;
+}
+
+static void scale_fixed(const int16_t *in, int16_t *out, size_t n,
+        simd::int_gain_t gain)
+{
+    simd::scale_s16(in, out, n, gain);
+}
+
+static void scale_fixed(const int32_t *in, int32_t *out, size_t n,
+        simd::int_gain_t gain)
+{
+    simd::scale_s32(in, out, n, gain);
+}
 
 GainControl::GainControl(size_t framesize,
                          GainMode& gainMode,
                          float& digGain,
                          float normalise,
-                         float& varVariance) :
+                         float& varVariance,
+                         bool clip,
+                         float clipMin,
+                         float clipMax,
+                         FFTEngine fftEngine) :
     PipelinedModCodec(),
     RemoteControllable("gain"),
-#ifdef __SSE__
-    m_frameSize(framesize * sizeof(complexf) / sizeof(__m128)),
-#else // !__SSE__
     m_frameSize(framesize),
-#endif
     m_digGain(digGain),
     m_normalise(normalise),
+    m_clip(clip),
+    m_clip_min(clipMin),
+    m_clip_max(clipMax),
     m_var_variance_rc(varVariance),
     m_gainmode(gainMode),
-    m_mutex()
+    m_mutex(),
+    m_kernels(gain_kernels()),
+    m_fftEngine(fftEngine),
+    m_fixed_point(fftEngine != FFTEngine::FFTW)
 {
     PDEBUG("GainControl::GainControl(%zu, %zu) @ %p\n", framesize, (size_t)m_gainmode, this);
 
+    if (m_fixed_point) {
+        if (m_clip) {
+            throw std::invalid_argument(
+                    "GainControl: clipping needs floating-point samples");
+        }
+        etiLog.level(debug) << "GainControl: using the fixed-point kernels";
+    }
+    else {
+        etiLog.level(debug) << "GainControl: using the " << m_kernels.name <<
+            " kernels";
+    }
+    if (m_clip) {
+        etiLog.level(info) << "GainControl: clipping to " << m_clip_min <<
+            " .. " << m_clip_max;
+    }
+
     /* register the parameters that can be remote controlled */
     RC_ADD_PARAMETER(digital, "Digital Gain");
     RC_ADD_PARAMETER(mode, "Gainmode (fix|max|var)");
     RC_ADD_PARAMETER(var, "Variance setting for gainmode var (default: 4)");
+    add_pipeline_parameters(m_parameters);
+
+    m_metrics.add_counter("odr_gain_clipped_samples_total",
+            "Number of samples clipped by the GainControl",
+            [this]() { return m_total_clipped_samples.load(); });
 
     start_pipeline_thread();
 }
@@ -77,6 +712,11 @@ GainControl::GainControl(size_t framesize,
 GainControl::~GainControl()
 {
     stop_pipeline_thread();
+
+    if (m_clip) {
+        etiLog.level(debug) << "GainControl: " <<
+            m_num_clipped_samples.load() << " clipped";
+    }
 }
 
 int GainControl::internal_process(Buffer* const dataIn, Buffer* dataOut)
@@ -87,78 +727,49 @@ int GainControl::internal_process(Buffer* const dataIn, Buffer* dataOut)
 
     dataOut->setLength(dataIn->getLength());
 
-#ifdef __SSE__
-    __m128 (*computeGain)(const __m128* in, size_t sizeIn);
-#else
-    float (*computeGain)(const complexf* in, size_t sizeIn);
-#endif
+    GainMode gainmode;
+    float varVariance;
     {
         std::lock_guard<std::mutex> lock(m_mutex);
-
-        var_variance = m_var_variance_rc;
-
-        switch (m_gainmode) {
-            case GainMode::GAIN_FIX:
-                PDEBUG("Gain mode: fix\n");
-                computeGain = computeGainFix;
-                break;
-            case GainMode::GAIN_MAX:
-                PDEBUG("Gain mode: max\n");
-                computeGain = computeGainMax;
-                break;
-            case GainMode::GAIN_VAR:
-                PDEBUG("Gain mode: var\n");
-                computeGain = computeGainVar;
-                break;
-            default:
-                throw std::logic_error("Internal error: invalid gainmode");
-        }
-    }
-
-    const float constantGain = m_normalise * m_digGain;
-
-#ifdef __SSE__
-    const __m128* in  = reinterpret_cast<const __m128*>(dataIn->getData());
-    __m128* out       = reinterpret_cast<__m128*>(dataOut->getData());
-    size_t  sizeIn    = dataIn->getLength() / sizeof(__m128);
-    size_t  sizeOut   = dataOut->getLength() / sizeof(__m128);
-    u128_union_t  gain128;
-
-
-    if ((sizeIn % m_frameSize) != 0) {
-        PDEBUG("%zu != %zu\n", sizeIn, m_frameSize);
-        throw std::runtime_error("GainControl::process input size not valid!");
+        gainmode = m_gainmode;
+        varVariance = m_var_variance_rc;
     }
 
-    const auto constantGain4 = _mm_set1_ps(constantGain);
+    if (m_fixed_point) {
+        const bool wide = m_fftEngine == FFTEngine::DEXTER;
+        const size_t sample_size = wide ?
+            sizeof(complexfix_wide) : sizeof(complexfix);
+        const size_t sizeIn = dataIn->getLength() / sample_size;
+        if ((sizeIn % m_frameSize) != 0) {
+            PDEBUG("%zu != %zu\n", sizeIn, m_frameSize);
+            throw std::runtime_error(
+                    "GainControl::process input size not valid!");
+        }
 
-    for (size_t i = 0; i < sizeIn; i += m_frameSize) {
-        // Do not apply gain computation to the NULL symbol, which either
-        // is blank or contains TII. Apply the gain calculation from the next
-        // symbol on the NULL symbol to get consistent TII power.
-        if (i > 0) {
-            gain128.m = computeGain(in, m_frameSize);
+        if (wide) {
+            process_fixed(reinterpret_cast<const int32_t*>(dataIn->getData()),
+                    reinterpret_cast<int32_t*>(dataOut->getData()),
+                    sizeIn, gainmode, varVariance);
         }
         else {
-            gain128.m = computeGain(in + m_frameSize, m_frameSize);
+            process_fixed(reinterpret_cast<const int16_t*>(dataIn->getData()),
+                    reinterpret_cast<int16_t*>(dataOut->getData()),
+                    sizeIn, gainmode, varVariance);
         }
-        gain128.m = _mm_mul_ps(gain128.m, constantGain4);
-
-        PDEBUG("********** Gain: %10f **********\n", gain128.f[0]);
+        return sizeIn;
+    }
 
-        for (size_t sample = 0; sample < m_frameSize; ++sample) {
-            out[sample] = _mm_mul_ps(in[sample], gain128.m);
-        }
+    const float constantGain = m_normalise * m_digGain;
 
-        in  += m_frameSize;
-        out += m_frameSize;
-    }
-#else // !__SSE__
-    const complexf* in = reinterpret_cast<const complexf*>(dataIn->getData());
-    complexf* out  = reinterpret_cast<complexf*>(dataOut->getData());
+    const float* in = reinterpret_cast<const float*>(dataIn->getData());
+    float* out  = reinterpret_cast<float*>(dataOut->getData());
     size_t sizeIn  = dataIn->getLength() / sizeof(complexf);
     size_t sizeOut = dataOut->getLength() / sizeof(complexf);
-    float  gain;
+
+    // Distance from the I value of a sample to its Q value, and from one
+    // sample to the next, in floats
+    const size_t im_offset = m_planar ? sizeIn : 1;
+    const size_t step = m_planar ? 1 : 2;
 
     if ((sizeIn % m_frameSize) != 0) {
         PDEBUG("%zu != %zu\n", sizeIn, m_frameSize);
@@ -166,341 +777,229 @@ int GainControl::internal_process(Buffer* const dataIn, Buffer* dataOut)
                 "GainControl::process input size not valid!");
     }
 
+    size_t num_clipped = 0;
+
     for (size_t i = 0; i < sizeIn; i += m_frameSize) {
         // Do not apply gain computation to the NULL symbol, which either
         // is blank or contains TII. Apply the gain calculation from the next
         // symbol on the NULL symbol to get consistent TII power.
-        gain = constantGain * (i > 0 ?
-                computeGain(in, m_frameSize) :
-                computeGain(in + m_frameSize, m_frameSize));
+        const float *gainIn = in + step * (i > 0 ? i : i + m_frameSize);
+        const float *gainInIm = m_planar ? gainIn + im_offset : nullptr;
+
+        float gain = 0.0f;
+        switch (gainmode) {
+            case GainMode::GAIN_FIX:
+                gain = 512.0f;
+                break;
+            case GainMode::GAIN_MAX:
+                gain = computeGainMax(gainIn, gainInIm, m_frameSize);
+                break;
+            case GainMode::GAIN_VAR:
+                gain = computeGainVar(gainIn, gainInIm, m_frameSize,
+                        varVariance);
+                break;
+            default:
+                throw std::logic_error("Internal error: invalid gainmode");
+        }
+        gain *= constantGain;
 
         PDEBUG("********** Gain: %10f **********\n", gain);
 
-        ////////////////////////////////////////////////////////////////////////
-        // Applying gain to output data
-        ////////////////////////////////////////////////////////////////////////
-        for (size_t sample = 0; sample < m_frameSize; ++sample) {
-            out[sample] = in[sample] * gain;
+        if (m_planar) {
+            num_clipped += m_kernels.apply(in + i, out + i, m_frameSize,
+                    gain, m_clip, m_clip_min, m_clip_max);
+            num_clipped += m_kernels.apply(in + im_offset + i,
+                    out + im_offset + i, m_frameSize,
+                    gain, m_clip, m_clip_min, m_clip_max);
+        }
+        else {
+            num_clipped += m_kernels.apply(in + 2 * i, out + 2 * i,
+                    2 * m_frameSize, gain, m_clip, m_clip_min, m_clip_max);
         }
-
-        in  += m_frameSize;
-        out += m_frameSize;
     }
-#endif // __SSE__
 
+    m_num_clipped_samples.store(num_clipped);
+    m_total_clipped_samples.fetch_add(num_clipped, std::memory_order_relaxed);
     return sizeOut;
 }
 
-
-#ifdef __SSE__
-__m128 GainControl::computeGainFix(const __m128* in, size_t sizeIn)
+float GainControl::computeGainMax(const float* re, const float* im,
+        size_t sizeIn) const
 {
-    return _mm_set1_ps(512.0f);
-}
-
-__m128 GainControl::computeGainMax(const __m128* in, size_t sizeIn)
-{
-    u128_union_t gain128;
-    u128_union_t min128;
-    u128_union_t max128;
-    u128_union_t tmp128;
-    static const __m128 factor128 = _mm_set1_ps(0x7fff);
-
-    ////////////////////////////////////////////////////////////////////////
-    // Computing max, min and average
-    ////////////////////////////////////////////////////////////////////////
-    min128.m = _mm_set1_ps(__FLT_MAX__);
-    max128.m = _mm_set1_ps(__FLT_MIN__);
-
-    for (size_t sample = 0; sample < sizeIn; ++sample) {
-        min128.m = _mm_min_ps(in[sample], min128.m);
-        max128.m = _mm_max_ps(in[sample], max128.m);
-    }
-
-    // Merging min
-    tmp128.m = _mm_shuffle_ps(min128.m, min128.m, _MM_SHUFFLE(0, 1, 2, 3));
-    min128.m = _mm_min_ps(min128.m, tmp128.m);
-    tmp128.m = _mm_shuffle_ps(min128.m, min128.m, _MM_SHUFFLE(1, 0, 3, 2));
-    min128.m = _mm_min_ps(min128.m, tmp128.m);
-    PDEBUG("********** Min:   %10f  **********\n", min128.f[0]);
-
-    // Merging max
-    tmp128.m = _mm_shuffle_ps(max128.m, max128.m, _MM_SHUFFLE(0, 1, 2, 3));
-    max128.m = _mm_max_ps(max128.m, tmp128.m);
-    tmp128.m = _mm_shuffle_ps(max128.m, max128.m, _MM_SHUFFLE(1, 0, 3, 2));
-    max128.m = _mm_max_ps(max128.m, tmp128.m);
-    PDEBUG("********** Max:   %10f  **********\n", max128.f[0]);
+    static const float factor = 0x7fff;
 
-    ////////////////////////////////////////////////////////////////////////////
-    // Computing gain
-    ////////////////////////////////////////////////////////////////////////////
-    // max = max(-min, max)
-    max128.m = _mm_max_ps(_mm_mul_ps(min128.m, _mm_set1_ps(-1.0f)), max128.m);
+    const float max = im ?
+        std::max(m_kernels.peak(re, sizeIn), m_kernels.peak(im, sizeIn)) :
+        m_kernels.peak(re, 2 * sizeIn);
+    PDEBUG("********** Max:  %10f **********\n", max);
 
     // Detect NULL
-    if ((int)max128.f[0] != 0) {
-        gain128.m = _mm_div_ps(factor128, max128.m);
+    if ((int)max != 0) {
+        return factor / max;
     }
     else {
-        gain128.m = _mm_set1_ps(1.0f);
-    }
-
-    return gain128.m;
-}
-
-__m128 GainControl::computeGainVar(const __m128* in, size_t sizeIn)
-{
-    u128_union_t gain128;
-    u128_union_t mean128;
-    u128_union_t var128;
-    u128_union_t tmp128;
-    static const __m128 factor128 = _mm_set1_ps(0x7fff);
-
-    mean128.m = _mm_setzero_ps();
-
-    for (size_t sample = 0; sample < sizeIn; ++sample) {
-        __m128 delta128 = _mm_sub_ps(in[sample], mean128.m);
-        __m128 i128 = _mm_set1_ps(sample + 1);
-        __m128 q128 = _mm_div_ps(delta128, i128);
-        mean128.m = _mm_add_ps(mean128.m, q128);
-
-        /*
-        tmp128.m = in[sample];
-        printf("S %zu, %.2f+%.2fj\t",
-                sample,
-                tmp128.f[0], tmp128.f[1]);
-        printf(": %.2f+%.2fj\n", mean128.f[0], mean128.f[1]);
-
-        printf("S %zu, %.2f+%.2fj\t",
-                sample,
-                tmp128.f[2], tmp128.f[3]);
-        printf(": %.2f+%.2fj\n", mean128.f[2], mean128.f[3]);
-        */
-    }
-
-    // Merging average
-    tmp128.m = _mm_shuffle_ps(mean128.m, mean128.m, _MM_SHUFFLE(1, 0, 3, 2));
-    mean128.m = _mm_add_ps(mean128.m, tmp128.m);
-    mean128.m = _mm_mul_ps(mean128.m, _mm_set1_ps(0.5f));
-    PDEBUG("********** Mean:  %10f + %10fj %10f + %10fj **********\n",
-            mean128.f[0], mean128.f[1], mean128.f[2], mean128.f[3]);
-
-    ////////////////////////////////////////////////////////////////////////
-    // Computing standard deviation
-    ////////////////////////////////////////////////////////////////////////
-    var128.m = _mm_setzero_ps();
-    for (size_t sample = 0; sample < sizeIn; ++sample) {
-        __m128 diff128 = _mm_sub_ps(in[sample], mean128.m);
-        __m128 delta128 = _mm_sub_ps(_mm_mul_ps(diff128, diff128), var128.m);
-        __m128 i128 = _mm_set1_ps(sample + 1);
-        __m128 q128 = _mm_div_ps(delta128, i128);
-        var128.m = _mm_add_ps(var128.m, q128);
-
-        /*
-        u128_union_t udiff128;  udiff128.m = diff128;
-        u128_union_t udelta128; udelta128.m = delta128;
-        for (int off=0; off<4; off+=2) {
-            printf("S %zu, %.2f+%.2fj\t",
-                    sample,
-                    udiff128.f[off], udiff128.f[1+off]);
-            printf(": %.2f+%.2fj\t", udelta128.f[off], udelta128.f[1+off]);
-            printf(": %.2f+%.2fj\n", var128.f[off], var128.f[1+off]);
-        }
-        */
-
-    }
-    PDEBUG("********** Vars:  %10f + %10fj, %10f + %10fj **********\n",
-            var128.f[0], var128.f[1], var128.f[2], var128.f[3]);
-
-    // Merging standard deviations
-    tmp128.m = _mm_shuffle_ps(var128.m, var128.m, _MM_SHUFFLE(1, 0, 3, 2));
-    var128.m = _mm_add_ps(var128.m, tmp128.m);
-    var128.m = _mm_mul_ps(var128.m, _mm_set1_ps(0.5f));
-    var128.m = _mm_sqrt_ps(var128.m);
-    PDEBUG("********** Var:   %10f + %10fj, %10f + %10fj **********\n",
-            var128.f[0], var128.f[1], var128.f[2], var128.f[3]);
-    var128.m = _mm_mul_ps(var128.m, _mm_set1_ps(var_variance));
-    PDEBUG("********** 4*Var: %10f + %10fj, %10f + %10fj **********\n",
-            var128.f[0], var128.f[1], var128.f[2], var128.f[3]);
-
-    ////////////////////////////////////////////////////////////////////////////
-    // Computing gain
-    ////////////////////////////////////////////////////////////////////////////
-    // gain = factor128 / max(real, imag)
-    // Detect NULL
-    if ((int)var128.f[0] != 0) {
-        gain128.m = _mm_div_ps(factor128,
-                _mm_max_ps(var128.m,
-                    _mm_shuffle_ps(var128.m, var128.m, _MM_SHUFFLE(2, 3, 0, 1))));
-    } else {
-        gain128.m = _mm_set1_ps(1.0f);
+        return 1.0f;
     }
-
-    return gain128.m;
 }
 
-#else // !__SSE__
-
-float GainControl::computeGainFix(const complexf* in, size_t sizeIn)
+template<typename T>
+void GainControl::process_fixed(const T *in, T *out, size_t sizeIn,
+        GainMode gainmode, float varVariance)
 {
-    return 512.0f;
-}
-
-float GainControl::computeGainMax(const complexf* in, size_t sizeIn)
-{
-    float gain;
-    float min;
-    float max;
-    static const float factor = 0x7fff;
+    // The largest s16 output value, in the units of the samples, and in
+    // the units of the moments
+    const int moments_shift = sizeof(T) == sizeof(int16_t) ?
+        0 : wide_to_s16_shift;
+    const float factor = (float)(0x7fff << moments_shift);
 
-    ////////////////////////////////////////////////////////////////////////
-    // Computing max, min and average
-    ////////////////////////////////////////////////////////////////////////
-    min = __FLT_MAX__;
-    max = __FLT_MIN__;
+    for (size_t i = 0; i < sizeIn; i += m_frameSize) {
+        // As for the floating-point samples, the NULL symbol gets the gain
+        // of the next symbol
+        const T *gainIn = in + 2 * (i > 0 ? i : i + m_frameSize);
 
-    for (size_t sample = 0; sample < sizeIn; ++sample) {
-        if (in[sample].real() < min) {
-            min = in[sample].real();
-        }
-        if (in[sample].real() > max) {
-            max = in[sample].real();
-        }
-        if (in[sample].imag() < min) {
-            min = in[sample].imag();
-        }
-        if (in[sample].imag() > max) {
-            max = in[sample].imag();
+        float gain = 1.0f;
+        switch (gainmode) {
+            case GainMode::GAIN_FIX:
+                break;
+            case GainMode::GAIN_MAX:
+            {
+                const int64_t max = peak_fixed(gainIn, 2 * m_frameSize);
+                PDEBUG("********** Max:  %10lld **********\n", (long long)max);
+                if (max != 0) {
+                    gain = factor / (float)max;
+                }
+                break;
+            }
+            case GainMode::GAIN_VAR:
+            {
+                const fixed_moments_t m = moments_fixed(gainIn, m_frameSize);
+                const double n = m_frameSize;
+                const double mean_re = m.sum_re / n;
+                const double mean_im = m.sum_im / n;
+                const double std_re = std::sqrt(
+                        std::max(0.0, m.sq_re / n - mean_re * mean_re));
+                const double std_im = std::sqrt(
+                        std::max(0.0, m.sq_im / n - mean_im * mean_im));
+                const float var = varVariance *
+                    (float)(std::max(std_re, std_im) * (1 << moments_shift));
+                PDEBUG("********** 4*Var: %10f **********\n", var);
+                if ((int)var != 0) {
+                    gain = factor / var;
+                }
+                break;
+            }
+            default:
+                throw std::logic_error("Internal error: invalid gainmode");
         }
-    }
+        gain *= m_digGain;
 
-    PDEBUG("********** Min:  %10f **********\n", min);
-    PDEBUG("********** Max:  %10f **********\n", max);
+        PDEBUG("********** Gain: %10f **********\n", gain);
 
-    ////////////////////////////////////////////////////////////////////////////
-    // Computing gain
-    ////////////////////////////////////////////////////////////////////////////
-    // gain = factor128 / max(-min, max)
-    min = -min;
-    if (min > max) {
-        max = min;
+        scale_fixed(in + 2 * i, out + 2 * i, 2 * m_frameSize,
+                simd::split_gain(gain));
     }
+}
 
-    // Detect NULL
-    if ((int)max != 0) {
-        gain = factor / max;
-    }
-    else {
-        gain = 1.0f;
+/* The running mean and variance of a set of values */
+struct welford_state_t {
+    double count = 0;
+    double mean = 0;
+    double m2 = 0;
+
+    // Merge another set into this one, with the Chan et al. formula
+    void merge(double count_b, double mean_b, double m2_b) {
+        const double total = count + count_b;
+        if (total == 0) {
+            return;
+        }
+        const double delta = mean_b - mean;
+        mean += delta * count_b / total;
+        m2 += m2_b + delta * delta * count * count_b / total;
+        count = total;
     }
+};
+
+/* The mean and variance of n values, of which the kernel computes
+ * welford_lanes interleaved sets */
+static welford_state_t welford_values(const GainControl::kernels_t& kernels,
+        const float *values, size_t n)
+{
+    float mean[welford_lanes];
+    float m2[welford_lanes];
+    const size_t count = kernels.welford(values, n, mean, m2);
 
-    return gain;
+    welford_state_t state;
+    for (size_t j = 0; j < welford_lanes; j++) {
+        state.merge(count, mean[j], m2[j]);
+    }
+    for (size_t i = welford_lanes * count; i < n; i++) {
+        state.merge(1, values[i], 0);
+    }
+    return state;
 }
 
-float GainControl::computeGainVar(const complexf* in, size_t sizeIn)
+float GainControl::computeGainVar(const float* re_in, const float* im_in,
+        size_t sizeIn, float varVariance) const
 {
-    complexf mean;
-
-    /* The variance calculation is a bit strange, because we
-     * emulate the exact same functionality as the SSE code,
-     * which is the most used one.
+    /* The gain is derived from the largest of the standard deviations of
+     * the real and of the imaginary part over the symbol.
      *
      * TODO: verify that this actually corresponds to the
      * gain mode suggested in EN 300 798 Clause 5.3 Numerical Range.
      */
-    complexf var1;
-    complexf var2;
-
     static const float factor = 0x7fff;
 
-    mean = complexf(0.0f, 0.0f);
-
-    for (size_t sample = 0; sample < sizeIn; ++sample) {
-        const complexf delta = in[sample] - mean;
-        const float i = sample + 1;
-        const complexf q = delta / i;
-        mean += q;
-
-        /*
-        printf("F %zu, %.2f+%.2fj\t",
-                sample,
-                in[sample].real(), in[sample].imag());
-
-        printf(": %.2f+%.2fj\n", mean.real(), mean.imag());
-        */
+    welford_state_t re, im;
+    if (im_in) {
+        re = welford_values(m_kernels, re_in, sizeIn);
+        im = welford_values(m_kernels, im_in, sizeIn);
     }
+    else {
+        const float *values = re_in;
+        const size_t n = 2 * sizeIn;
 
-    PDEBUG("********** Mean:  %10f + %10fj **********\n", mean.real(), mean.imag());
-
-    ////////////////////////////////////////////////////////////////////////
-    // Computing standard deviation
-    ////////////////////////////////////////////////////////////////////////
-    var1 = complexf(0.0f, 0.0f);
-    var2 = complexf(0.0f, 0.0f);
-    for (size_t sample = 0; sample < sizeIn; ++sample) {
-        const complexf diff  = in[sample] - mean;
-        complexf delta;
-        complexf q;
-
-        float    i = (sample/2) + 1;
-        if (sample % 2 == 0) {
-            delta = complexf(diff.real() * diff.real(),
-                             diff.imag() * diff.imag()) - var1;
-            q = delta / i;
+        float mean[welford_lanes];
+        float m2[welford_lanes];
+        const size_t count = m_kernels.welford(values, n, mean, m2);
 
-            var1 += q;
+        // The even lanes hold real parts, the odd ones the imaginary parts
+        for (size_t j = 0; j < welford_lanes; j += 2) {
+            re.merge(count, mean[j], m2[j]);
+            im.merge(count, mean[j + 1], m2[j + 1]);
         }
-        else {
-            delta = complexf(diff.real() * diff.real(),
-                             diff.imag() * diff.imag()) - var2;
-            q = delta / i;
-
-            var2 += q;
+        for (size_t i = welford_lanes * count; i < n; i += 2) {
+            re.merge(1, values[i], 0);
+            im.merge(1, values[i + 1], 0);
         }
-
-        /*
-        printf("F %zu, %.2f+%.2fj\t",
-                sample,
-                diff.real(), diff.imag());
-
-        printf(": %.2f+%.2fj\t", delta.real(), delta.imag());
-        printf(": %.2f+%.2fj\t", var1.real(), var1.imag());
-        printf(": %.2f+%.2fj\n", var2.real(), var2.imag());
-        */
     }
 
-    PDEBUG("********** Vars:  %10f + %10fj, %10f + %10fj **********\n",
-                var1.real(), var1.imag(),
-                var2.real(), var2.imag());
+    if (re.count == 0) {
+        return 1.0f;
+    }
 
-    // Merge standard deviations in the same way the SSE version does it
-    complexf tmpvar = (var1 + var2) * 0.5f;
-    complexf var(sqrt(tmpvar.real()), sqrt(tmpvar.imag()));
-    PDEBUG("********** Var:   %10f + %10fj **********\n", var.real(), var.imag());
+    PDEBUG("********** Mean:  %10f + %10fj **********\n", re.mean, im.mean);
 
-    var = var * var_variance;
-    PDEBUG("********** 4*Var: %10f + %10fj **********\n", var.real(), var.imag());
+    const float std_re = (float)std::sqrt(re.m2 / re.count);
+    const float std_im = (float)std::sqrt(im.m2 / im.count);
+    PDEBUG("********** Var:   %10f + %10fj **********\n", std_re, std_im);
 
-    ////////////////////////////////////////////////////////////////////////////
-    // Computing gain
-    ////////////////////////////////////////////////////////////////////////////
-    float gain = var.real();
-    // gain = factor128 / max(real, imag)
-    if (var.imag() > gain) {
-        gain = var.imag();
-    }
+    // gain = factor / max(real, imag)
+    const float var = varVariance * std::max(std_re, std_im);
+    PDEBUG("********** 4*Var: %10f **********\n", var);
 
     // Ignore zero variance samples and apply no gain
-    if ((int)gain == 0) {
-        gain = 1.0f;
+    if ((int)var == 0) {
+        return 1.0f;
     }
     else {
-        gain = factor / gain;
+        return factor / var;
     }
+}
 
-    return gain;
+size_t GainControl::get_num_clipped_samples() const
+{
+    return m_num_clipped_samples.load();
 }
-#endif // !__SSE__
 
 void GainControl::set_parameter(const string& parameter, const string& value)
 {
@@ -555,6 +1054,11 @@ void GainControl::set_parameter(const string& parameter, const string& value)
 
 const string GainControl::get_parameter(const string& parameter) const
 {
+    string pipeline_value;
+    if (get_pipeline_parameter(parameter, pipeline_value)) {
+        return pipeline_value;
+    }
+
     stringstream ss;
     if (parameter == "digital") {
         ss << std::fixed << m_digGain;
@@ -599,5 +1103,6 @@ const json::map_t GainControl::get_all_values() const
             break;
     }
     map["var"].v = m_var_variance_rc;
+    get_pipeline_values(map);
     return map;
 }
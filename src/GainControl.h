@@ -33,25 +33,43 @@
 
 #include "ModPlugin.h"
 #include "RemoteControl.h"
+#include "Metrics.h"
 
 #include <sys/types.h>
+#include <atomic>
 #include <string>
 #include <mutex>
 
-#ifdef __SSE__
-#   include <xmmintrin.h>
-#endif
-
 enum class GainMode { GAIN_FIX = 0, GAIN_MAX = 1, GAIN_VAR = 2 };
 
+// Defined in ConfigParser.h, which includes this header. FFTEngine(0) is
+// FFTW, the floating-point engine.
+enum class FFTEngine;
+
 class GainControl : public PipelinedModCodec, public RemoteControllable
 {
     public:
+        /* If clip is set, the samples are also clipped to
+         * [clipMin, clipMax] when the gain is applied, which the
+         * FormatConverter otherwise does. This is only correct if no other
+         * block changes the amplitude of the samples in between.
+         *
+         * With the fixed-point FFT engines, the samples are complexfix or
+         * complexfix_wide, and the gain is computed and applied in integer
+         * arithmetic, with saturation. The fix mode only applies the
+         * digital gain, because the inverse FFT already scales its output,
+         * and the max and var modes bring the samples to the range of the
+         * s16 output, without normalise, which is meant for the
+         * floating-point samples. Clipping is not supported. */
         GainControl(size_t framesize,
                     GainMode& gainMode,
                     float& digGain,
                     float normalise,
-                    float& varVariance);
+                    float& varVariance,
+                    bool clip = false,
+                    float clipMin = 0.0f,
+                    float clipMax = 0.0f,
+                    FFTEngine fftEngine = FFTEngine(0));
 
         virtual ~GainControl();
         GainControl(const GainControl&) = delete;
@@ -59,33 +77,60 @@ class GainControl : public PipelinedModCodec, public RemoteControllable
 
         const char* name() override { return "GainControl"; }
 
+        bool supports_planar_input() const override { return not m_fixed_point; }
+        bool supports_planar_output() const override { return not m_fixed_point; }
+
         /* Functions for the remote control */
         virtual void set_parameter(const std::string& parameter, const std::string& value) override;
         virtual const std::string get_parameter(const std::string& parameter) const override;
         virtual const json::map_t get_all_values() const override;
 
+        // Only counted if clip is set
+        size_t get_num_clipped_samples() const;
+
+        // The computation kernels, selected according to the CPU features
+        // at runtime
+        struct kernels_t;
+
     protected:
         virtual int internal_process(
                 Buffer* const dataIn, Buffer* dataOut) override;
+        virtual bool internal_supports_in_place() const override { return true; }
 
+        // In complex samples
         size_t m_frameSize;
         float& m_digGain;
         float m_normalise;
 
+        bool m_clip;
+        float m_clip_min;
+        float m_clip_max;
+        std::atomic<size_t> m_num_clipped_samples = 0;
+        std::atomic<uint64_t> m_total_clipped_samples = 0;
+
         // The following variables are accessed from the RC thread
         float& m_var_variance_rc;
         GainMode& m_gainmode;
         mutable std::mutex m_mutex;
 
-#ifdef __SSE__
-        __m128 static computeGainFix(const __m128* in, size_t sizeIn);
-        __m128 static computeGainMax(const __m128* in, size_t sizeIn);
-        __m128 static computeGainVar(const __m128* in, size_t sizeIn);
-#else
-        float static computeGainFix(const complexf* in, size_t sizeIn);
-        float static computeGainMax(const complexf* in, size_t sizeIn);
-        float static computeGainVar(const complexf* in, size_t sizeIn);
-#endif
-};
+        const kernels_t& m_kernels;
+
+        FFTEngine m_fftEngine;
+        bool m_fixed_point;
 
+        Metrics::Handle m_metrics;
+
+        /* The sizeIn samples are interleaved in re if im is nullptr,
+         * otherwise planar. */
+        float computeGainMax(const float* re, const float* im,
+                size_t sizeIn) const;
+        float computeGainVar(const float* re, const float* im,
+                size_t sizeIn, float varVariance) const;
+
+        // The fixed-point version of internal_process, for int16_t or
+        // int32_t samples
+        template<typename T>
+        void process_fixed(const T *in, T *out, size_t sizeIn,
+                GainMode gainmode, float varVariance);
+};
 
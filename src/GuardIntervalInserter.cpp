@@ -26,10 +26,18 @@
 
 #include "GuardIntervalInserter.h"
 #include "PcDebug.h"
+#include "Log.h"
+#include <cmath>
 #include <cstring>
+#include <iomanip>
 #include <cassert>
 #include <stdexcept>
 #include <mutex>
+#if defined(__AVX__) || defined(__SSE__)
+#   include <immintrin.h>
+#elif defined(__ARM_NEON)
+#   include <arm_neon.h>
+#endif
 
 GuardIntervalInserter::Params::Params(
         size_t nbSymbols,
@@ -61,6 +69,7 @@ GuardIntervalInserter::GuardIntervalInserter(
 
 
     RC_ADD_PARAMETER(windowlen, "Window length for OFDM windowng [0 to disable]");
+    RC_ADD_PARAMETER(half_snr, "(Read-only) Ratio of the signal to the rounding noise of the 16-bit float output, in dB, measured on the first frame");
 
     /* We use a raised-cosine window for the OFDM windowing.
      * Each symbol is extended on both sides by windowOverlap samples.
@@ -99,223 +108,470 @@ void GuardIntervalInserter::update_window(size_t new_window_overlap)
 
     m_params.windowOverlap = new_window_overlap;
 
-    // m_params.window only contains the rising window edge.
-    m_params.windowFloat.resize(2*m_params.windowOverlap);
-    m_params.windowFix.resize(2*m_params.windowOverlap);
-    m_params.windowFixWide.resize(2*m_params.windowOverlap);
-    for (size_t i = 0; i < 2*m_params.windowOverlap; i++) {
-        const float value = (float)(0.5 * (1.0 - cos(M_PI * i / (2*m_params.windowOverlap - 1))));
+    const size_t window_len = 2*m_params.windowOverlap;
+    m_params.riseFloat.resize(2*window_len);
+    m_params.fallFloat.resize(2*window_len);
+    m_params.riseFix.resize(2*window_len);
+    m_params.fallFix.resize(2*window_len);
+    m_params.riseFixWide.resize(2*window_len);
+    m_params.fallFixWide.resize(2*window_len);
+    m_params.risePlanar.resize(window_len);
+    m_params.fallPlanar.resize(window_len);
+    for (size_t i = 0; i < window_len; i++) {
+        const float value = (float)(0.5 * (1.0 - cos(M_PI * i / (window_len - 1))));
+        const int16_t value_fix = complexfix::value_type((double)value).raw_value();
+        const int32_t value_fix_wide = complexfix_wide::value_type((double)value).raw_value();
+
+        const size_t fall_ix = window_len - (i+1);
+        m_params.risePlanar[i] = value;
+        m_params.fallPlanar[fall_ix] = value;
+        for (size_t c = 0; c < 2; c++) {
+            m_params.riseFloat[2*i + c] = value;
+            m_params.fallFloat[2*fall_ix + c] = value;
+            m_params.riseFix[2*i + c] = value_fix;
+            m_params.fallFix[2*fall_ix + c] = value_fix;
+            m_params.riseFixWide[2*i + c] = value_fix_wide;
+            m_params.fallFixWide[2*fall_ix + c] = value_fix_wide;
+        }
+    }
+}
+
+/* Multiply n samples with the window, or add the windowed samples to out
+ * if accumulate is set. The window contains one value per real and
+ * imaginary part, except for the planar layout. */
+template <bool accumulate>
+static void apply_window_values(float *o, const float *x,
+        const float *window, size_t num_values)
+{
+    size_t i = 0;
+
+#if defined(__AVX__)
+    for (; i + 8 <= num_values; i += 8) {
+        __m256 v = _mm256_mul_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(window + i));
+        if (accumulate) {
+            v = _mm256_add_ps(_mm256_loadu_ps(o + i), v);
+        }
+        _mm256_storeu_ps(o + i, v);
+    }
+#elif defined(__SSE__)
+    for (; i + 4 <= num_values; i += 4) {
+        __m128 v = _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(window + i));
+        if (accumulate) {
+            v = _mm_add_ps(_mm_loadu_ps(o + i), v);
+        }
+        _mm_storeu_ps(o + i, v);
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 4 <= num_values; i += 4) {
+        float32x4_t v = vmulq_f32(vld1q_f32(x + i), vld1q_f32(window + i));
+        if (accumulate) {
+            v = vaddq_f32(vld1q_f32(o + i), v);
+        }
+        vst1q_f32(o + i, v);
+    }
+#endif
+
+    for (; i < num_values; i++) {
+        o[i] = accumulate ? o[i] + x[i] * window[i] : x[i] * window[i];
+    }
+}
+
+template <bool accumulate>
+static void apply_window(complexf *out, const complexf *in,
+        const float *window, size_t n)
+{
+    apply_window_values<accumulate>(reinterpret_cast<float*>(out),
+            reinterpret_cast<const float*>(in), window, 2 * n);
+}
+
+// For one half of a planar buffer, with one window value per sample
+template <bool accumulate>
+static void apply_window(float *out, const float *in,
+        const float *window, size_t n)
+{
+    apply_window_values<accumulate>(out, in, window, n);
+}
+
+/* The fixed-point multiplication of fpm rounds half away from zero. The
+ * window is never negative, the magnitude of the product is therefore
+ * rounded half up, and gets the sign of the sample. */
+template <bool accumulate>
+static void apply_window(complexfix *out, const complexfix *in,
+        const int16_t *window, size_t n)
+{
+    int16_t *o = reinterpret_cast<int16_t*>(out);
+    const int16_t *x = reinterpret_cast<const int16_t*>(in);
+    const size_t num_values = 2 * n;
+    size_t i = 0;
+
+#if defined(__SSE4_1__)
+    const __m128i round = _mm_set1_epi32(1 << 13);
+    for (; i + 8 <= num_values; i += 8) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i));
+        const __m128i w = _mm_loadu_si128(reinterpret_cast<const __m128i*>(window + i));
+        const __m128i mag = _mm_abs_epi16(v);
+        const __m128i lo = _mm_mullo_epi16(mag, w);
+        const __m128i hi = _mm_mulhi_epu16(mag, w);
+        const __m128i p0 = _mm_srli_epi32(_mm_add_epi32(_mm_unpacklo_epi16(lo, hi), round), 14);
+        const __m128i p1 = _mm_srli_epi32(_mm_add_epi32(_mm_unpackhi_epi16(lo, hi), round), 14);
+        __m128i r = _mm_sign_epi16(_mm_packus_epi32(p0, p1), v);
+        if (accumulate) {
+            r = _mm_add_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(o + i)), r);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(o + i), r);
+    }
+#elif defined(__ARM_NEON)
+    /* The rounding shift rounds half up. Subtracting one from the negative
+     * products first rounds their halves down, away from zero, without
+     * taking the magnitude and restoring the sign. */
+    for (; i + 8 <= num_values; i += 8) {
+        const int16x8_t v = vld1q_s16(x + i);
+        const int16x8_t w = vld1q_s16(window + i);
+        int32x4_t p0 = vmull_s16(vget_low_s16(v), vget_low_s16(w));
+        int32x4_t p1 = vmull_s16(vget_high_s16(v), vget_high_s16(w));
+        p0 = vsraq_n_s32(p0, p0, 31);
+        p1 = vsraq_n_s32(p1, p1, 31);
+        int16x8_t r = vcombine_s16(vrshrn_n_s32(p0, 14), vrshrn_n_s32(p1, 14));
+        if (accumulate) {
+            r = vaddq_s16(vld1q_s16(o + i), r);
+        }
+        vst1q_s16(o + i, r);
+    }
+#endif
+
+    using fixed_t = complexfix::value_type;
+    for (; i < num_values; i++) {
+        const fixed_t r = fixed_t::from_raw_value(x[i]) * fixed_t::from_raw_value(window[i]);
+        o[i] = accumulate ? (fixed_t::from_raw_value(o[i]) + r).raw_value() : r.raw_value();
+    }
+}
+
+template <bool accumulate>
+static void apply_window(complexfix_wide *out, const complexfix_wide *in,
+        const int32_t *window, size_t n)
+{
+    int32_t *o = reinterpret_cast<int32_t*>(out);
+    const int32_t *x = reinterpret_cast<const int32_t*>(in);
+    const size_t num_values = 2 * n;
+    size_t i = 0;
+
+#if defined(__SSE4_1__)
+    const __m128i round = _mm_set1_epi64x(1 << 15);
+    for (; i + 4 <= num_values; i += 4) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i));
+        const __m128i w = _mm_loadu_si128(reinterpret_cast<const __m128i*>(window + i));
+        const __m128i mag = _mm_abs_epi32(v);
+        // Products of the even and of the odd values
+        const __m128i p_even = _mm_srli_epi64(
+                _mm_add_epi64(_mm_mul_epu32(mag, w), round), 16);
+        const __m128i p_odd = _mm_srli_epi64(
+                _mm_add_epi64(_mm_mul_epu32(_mm_srli_epi64(mag, 32),
+                        _mm_srli_epi64(w, 32)), round), 16);
+        __m128i r = _mm_sign_epi32(
+                _mm_blend_epi16(p_even, _mm_slli_epi64(p_odd, 32), 0xcc), v);
+        if (accumulate) {
+            r = _mm_add_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(o + i)), r);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(o + i), r);
+    }
+#elif defined(__ARM_NEON)
+    // Rounded like the complexfix samples above
+    for (; i + 4 <= num_values; i += 4) {
+        const int32x4_t v = vld1q_s32(x + i);
+        const int32x4_t w = vld1q_s32(window + i);
+        int64x2_t p0 = vmull_s32(vget_low_s32(v), vget_low_s32(w));
+        int64x2_t p1 = vmull_s32(vget_high_s32(v), vget_high_s32(w));
+        p0 = vsraq_n_s64(p0, p0, 63);
+        p1 = vsraq_n_s64(p1, p1, 63);
+        int32x4_t r = vcombine_s32(vrshrn_n_s64(p0, 16), vrshrn_n_s64(p1, 16));
+        if (accumulate) {
+            r = vaddq_s32(vld1q_s32(o + i), r);
+        }
+        vst1q_s32(o + i, r);
+    }
+#endif
 
-        m_params.windowFloat[i] = value;
-        m_params.windowFix[i] = complexfix::value_type((double)value);
-        m_params.windowFixWide[i] = complexfix_wide::value_type((double)value);
+    using fixed_t = complexfix_wide::value_type;
+    for (; i < num_values; i++) {
+        const fixed_t r = fixed_t::from_raw_value(x[i]) * fixed_t::from_raw_value(window[i]);
+        o[i] = accumulate ? (fixed_t::from_raw_value(o[i]) + r).raw_value() : r.raw_value();
     }
 }
 
 template<typename T>
-int do_process(const GuardIntervalInserter::Params& p, Buffer* const dataIn, Buffer* dataOut)
+static const auto& rise_window(const GuardIntervalInserter::Params& p)
 {
-    PDEBUG("GuardIntervalInserter do_process(dataIn: %p, dataOut: %p)\n",
-            dataIn, dataOut);
+    if constexpr (std::is_same_v<complexf, T>) {
+        return p.riseFloat;
+    }
+    else if constexpr (std::is_same_v<complexfix, T>) {
+        return p.riseFix;
+    }
+    else {
+        return p.riseFixWide;
+    }
+}
 
-    // Every symbol overlaps over a length of windowOverlap with
-    // the previous symbol, and with the next symbol. First symbol
-    // receives no prefix window, because we don't remember the
-    // last symbol from the previous TF (yet). Last symbol also
-    // receives no suffix window, for the same reason.
-    // Overall output buffer length must stay independent of the windowing.
-    dataOut->setLength((p.nullSize + (p.nbSymbols * p.symSize)) * sizeof(T));
+template<typename T>
+static const auto& fall_window(const GuardIntervalInserter::Params& p)
+{
+    if constexpr (std::is_same_v<complexf, T>) {
+        return p.fallFloat;
+    }
+    else if constexpr (std::is_same_v<complexfix, T>) {
+        return p.fallFix;
+    }
+    else {
+        return p.fallFixWide;
+    }
+}
 
-    const T* in = reinterpret_cast<const T*>(dataIn->getData());
-    T* out = reinterpret_cast<T*>(dataOut->getData());
-    size_t sizeIn = dataIn->getLength() / sizeof(T);
+/* The output of insert_guard_intervals, at the samples ox after the
+ * start of the current symbol, in the format of the input */
+template<typename T>
+struct direct_output_t {
+    T *out;
 
-    const size_t num_symbols = p.nbSymbols + 1;
-    if (sizeIn != num_symbols * p.spacing)
-    {
-        PDEBUG("Nb symbols: %zu\n", p.nbSymbols);
-        PDEBUG("Spacing: %zu\n", p.spacing);
-        PDEBUG("Null size: %zu\n", p.nullSize);
-        PDEBUG("Sym size: %zu\n", p.symSize);
-        PDEBUG("\n%zu != %zu\n", sizeIn, (p.nbSymbols + 1) * p.spacing);
-        throw std::runtime_error(
-                "GuardIntervalInserter::process input size not valid!");
+    void copy(ssize_t ox, const T *in, size_t n) {
+        memcpy(&out[ox], in, n * sizeof(T));
     }
 
-    // TODO remember the end of the last TF so that we can do some
-    //      windowing too.
+    template<bool accumulate, typename W>
+    void window(ssize_t ox, const T *in, const W *window, size_t n) {
+        apply_window<accumulate>(&out[ox], in, window, n);
+    }
 
-    std::lock_guard<std::mutex> lock(p.windowMutex);
-    if (p.windowOverlap) {
-        {
-            // Handle Null symbol separately because it is longer
-            const size_t prefixlength = p.nullSize - p.spacing;
+    void advance(size_t n) { out += n; }
+};
 
-            // end = spacing
-            memcpy(out, &in[p.spacing - prefixlength],
-                    prefixlength * sizeof(T));
+/* The same for complex samples stored as pairs of 16-bit floats. The
+ * windows are applied to floats on the stack, the rising edge added to
+ * the falling edge that is already in the output is rounded twice. */
+struct half_output_t {
+    uint16_t *out;
+    half_float::converters_t converters;
 
-            memcpy(&out[prefixlength], in, (p.spacing - p.windowOverlap) * sizeof(T));
+    void copy(ssize_t ox, const complexf *in, size_t n) {
+        converters.to_half(reinterpret_cast<const float*>(in),
+                out + 2 * ox, 2 * n);
+    }
 
-            // The remaining part of the symbol must have half of the window applied,
-            // sloping down from 1 to 0.5
-            for (size_t i = 0; i < p.windowOverlap; i++) {
-                const size_t out_ix = prefixlength + p.spacing - p.windowOverlap + i;
-                const size_t in_ix = p.spacing - p.windowOverlap + i;
-                if constexpr (std::is_same_v<complexf, T>) {
-                    out[out_ix] = in[in_ix] * p.windowFloat[2*p.windowOverlap - (i+1)];
-                }
-                if constexpr (std::is_same_v<complexfix, T>) {
-                    out[out_ix] = in[in_ix] * p.windowFix[2*p.windowOverlap - (i+1)];
-                }
-                if constexpr (std::is_same_v<complexfix_wide, T>) {
-                    out[out_ix] = in[in_ix] * p.windowFixWide[2*p.windowOverlap - (i+1)];
-                }
+    template<bool accumulate>
+    void window(ssize_t ox, const complexf *in, const float *window, size_t n) {
+        constexpr size_t chunk_size = 256;
+        alignas(32) complexf chunk[chunk_size];
+        for (size_t i = 0; i < n; i += chunk_size) {
+            const size_t len = std::min(chunk_size, n - i);
+            uint16_t *o = out + 2 * (ox + (ssize_t)i);
+            float *c = reinterpret_cast<float*>(chunk);
+            if (accumulate) {
+                converters.from_half(o, c, 2 * len);
             }
+            apply_window<accumulate>(chunk, in + i, window + 2 * i, len);
+            converters.to_half(c, o, 2 * len);
+        }
+    }
 
-            // Suffix is taken from the beginning of the symbol, and sees the other
-            // half of the window applied.
-            for (size_t i = 0; i < p.windowOverlap; i++) {
-                const size_t out_ix = prefixlength + p.spacing + i;
-                if constexpr (std::is_same_v<complexf, T>) {
-                    out[out_ix] = in[i] * p.windowFloat[p.windowOverlap - (i+1)];
-                }
-                if constexpr (std::is_same_v<complexfix, T>) {
-                    out[out_ix] = in[i] * p.windowFix[p.windowOverlap - (i+1)];
-                }
-                if constexpr (std::is_same_v<complexfix_wide, T>) {
-                    out[out_ix] = in[i] * p.windowFixWide[p.windowOverlap - (i+1)];
-                }
+    void advance(size_t n) { out += 2 * n; }
+};
+
+/* Every symbol overlaps over a length of windowOverlap with the previous
+ * symbol, and with the next symbol. First symbol receives no prefix
+ * window, because we don't remember the last symbol from the previous TF
+ * (yet). Last symbol also receives no suffix window, for the same reason.
+ * Overall output buffer length must stay independent of the windowing.
+ *
+ * The input may contain several transmission frames, see FrameBatcher.
+ * Each one is handled separately. fall_suffix is the second half of the
+ * falling edge, from 0.5 to 0. */
+template<typename T, typename W, typename Output>
+static void insert_guard_intervals(const GuardIntervalInserter::Params& p,
+        const T *in, Output out, size_t num_frames,
+        const W *rise, const W *fall, const W *fall_suffix)
+{
+    for (size_t frame = 0; frame < num_frames; frame++) {
+        if (p.windowOverlap) {
+            {
+                // Handle Null symbol separately because it is longer
+                const size_t prefixlength = p.nullSize - p.spacing;
+
+                // end = spacing
+                out.copy(0, &in[p.spacing - prefixlength], prefixlength);
+
+                out.copy(prefixlength, in, p.spacing - p.windowOverlap);
+
+                // The remaining part of the symbol must have half of the window applied,
+                // sloping down from 1 to 0.5
+                out.template window<false>(prefixlength + p.spacing - p.windowOverlap,
+                        &in[p.spacing - p.windowOverlap], fall, p.windowOverlap);
+
+                // Suffix is taken from the beginning of the symbol, and sees the other
+                // half of the window applied.
+                out.template window<false>(prefixlength + p.spacing,
+                        in, fall_suffix, p.windowOverlap);
+
+                in += p.spacing;
+                out.advance(p.nullSize);
+                // out is now pointing to the proper end of symbol. There are
+                // windowOverlap samples ahead that were already written.
             }
 
-            in += p.spacing;
-            out += p.nullSize;
-            // out is now pointing to the proper end of symbol. There are
-            // windowOverlap samples ahead that were already written.
-        }
+            // Data symbols
+            for (size_t sym_ix = 0; sym_ix < p.nbSymbols; sym_ix++) {
+                /* _ix variables are indices into in[], _ox variables are
+                 * indices for out[] */
+                const ssize_t start_rise_ox = -p.windowOverlap;
+                const size_t start_rise_ix = 2 * p.spacing - p.symSize - p.windowOverlap;
+                /*
+                   const size_t start_real_symbol_ox = 0;
+                   const size_t start_real_symbol_ix = 2 * p.spacing - p.symSize;
+                   */
+                const ssize_t end_rise_ox = p.windowOverlap;
+                const size_t end_rise_ix = 2 * p.spacing - p.symSize + p.windowOverlap;
+                const ssize_t end_cyclic_prefix_ox = p.symSize - p.spacing;
+                /* end_cyclic_prefix_ix = end of symbol
+                   const size_t begin_fall_ox = p.symSize - p.windowOverlap;
+                   const size_t begin_fall_ix = p.spacing - p.windowOverlap;
+                   const size_t end_real_symbol_ox = p.symSize;
+                   end_real_symbol_ix = end of symbol
+                   const size_t end_fall_ox = p.symSize + p.windowOverlap;
+                   const size_t end_fall_ix = p.spacing + p.windowOverlap;
+                   */
+
+                // The rising edge is added to the falling edge of the
+                // previous symbol, which is already in out.
+                ssize_t ox = start_rise_ox;
+                size_t ix = start_rise_ix;
+                out.template window<true>(ox, &in[ix], rise, 2 * p.windowOverlap);
+                ox += 2 * p.windowOverlap;
+                ix += 2 * p.windowOverlap;
+                assert(ox == end_rise_ox);
+                assert(ix == end_rise_ix);
+
+                const size_t remaining_prefix_length = end_cyclic_prefix_ox - end_rise_ox;
+                out.copy(ox, &in[ix], remaining_prefix_length);
+                ox += remaining_prefix_length;
+                assert(ox == end_cyclic_prefix_ox);
+                ix = 0;
 
-        // Data symbols
-        for (size_t sym_ix = 0; sym_ix < p.nbSymbols; sym_ix++) {
-            /* _ix variables are indices into in[], _ox variables are
-             * indices for out[] */
-            const ssize_t start_rise_ox = -p.windowOverlap;
-            const size_t start_rise_ix = 2 * p.spacing - p.symSize - p.windowOverlap;
-            /*
-               const size_t start_real_symbol_ox = 0;
-               const size_t start_real_symbol_ix = 2 * p.spacing - p.symSize;
-               */
-            const ssize_t end_rise_ox = p.windowOverlap;
-            const size_t end_rise_ix = 2 * p.spacing - p.symSize + p.windowOverlap;
-            const ssize_t end_cyclic_prefix_ox = p.symSize - p.spacing;
-            /* end_cyclic_prefix_ix = end of symbol
-               const size_t begin_fall_ox = p.symSize - p.windowOverlap;
-               const size_t begin_fall_ix = p.spacing - p.windowOverlap;
-               const size_t end_real_symbol_ox = p.symSize;
-               end_real_symbol_ix = end of symbol
-               const size_t end_fall_ox = p.symSize + p.windowOverlap;
-               const size_t end_fall_ix = p.spacing + p.windowOverlap;
-               */
-
-            ssize_t ox = start_rise_ox;
-            size_t ix = start_rise_ix;
-
-            for (size_t i = 0; ix < end_rise_ix; i++) {
-                if constexpr (std::is_same_v<complexf, T>) {
-                    out[ox] += in[ix] * p.windowFloat.at(i);
+                const bool last_symbol = (sym_ix + 1 >= p.nbSymbols);
+                if (last_symbol) {
+                    // No windowing at all at end
+                    out.copy(ox, &in[ix], p.spacing);
+                    ox += p.spacing;
                 }
-                if constexpr (std::is_same_v<complexfix, T>) {
-                    out[ox] += in[ix] * p.windowFix.at(i);
+                else {
+                    // Copy the middle part of the symbol, p.windowOverlap samples
+                    // short of the end.
+                    out.copy(ox, &in[ix], p.spacing - p.windowOverlap);
+                    ox += p.spacing - p.windowOverlap;
+                    ix += p.spacing - p.windowOverlap;
+                    assert(ox == (ssize_t)(p.symSize - p.windowOverlap));
+
+                    // Apply window from 1 to 0.5 for the end of the symbol
+                    out.template window<false>(ox, &in[ix], fall, p.windowOverlap);
+                    ox += p.windowOverlap;
+
+                    // Cyclic suffix, with window from 0.5 to 0
+                    out.template window<false>(ox, in, fall_suffix, p.windowOverlap);
                 }
-                if constexpr (std::is_same_v<complexfix_wide, T>) {
-                    out[ox] += in[ix] * p.windowFixWide.at(i);
-                }
-                ix++;
-                ox++;
+
+                out.advance(p.symSize);
+                in += p.spacing;
+                // out is now pointing to the proper end of symbol. There are
+                // windowOverlap samples ahead that were already written.
             }
-            assert(ox == end_rise_ox);
-
-            const size_t remaining_prefix_length = end_cyclic_prefix_ox - end_rise_ox;
-            memcpy( &out[ox], &in[ix],
-                    remaining_prefix_length * sizeof(T));
-            ox += remaining_prefix_length;
-            assert(ox == end_cyclic_prefix_ox);
-            ix = 0;
-
-            const bool last_symbol = (sym_ix + 1 >= p.nbSymbols);
-            if (last_symbol) {
-                // No windowing at all at end
-                memcpy(&out[ox], &in[ix], p.spacing * sizeof(T));
-                ox += p.spacing;
+        }
+        else {
+            // Handle Null symbol separately because it is longer
+            // end - (nullSize - spacing) = 2 * spacing - nullSize
+            out.copy(0, &in[2 * p.spacing - p.nullSize], p.nullSize - p.spacing);
+            out.copy(p.nullSize - p.spacing, in, p.spacing);
+            in += p.spacing;
+            out.advance(p.nullSize);
+
+            // Data symbols
+            for (size_t i = 0; i < p.nbSymbols; ++i) {
+                // end - (symSize - spacing) = 2 * spacing - symSize
+                out.copy(0, &in[2 * p.spacing - p.symSize], p.symSize - p.spacing);
+                out.copy(p.symSize - p.spacing, in, p.spacing);
+                in += p.spacing;
+                out.advance(p.symSize);
             }
-            else {
-                // Copy the middle part of the symbol, p.windowOverlap samples
-                // short of the end.
-                memcpy( &out[ox],
-                        &in[ix],
-                        (p.spacing - p.windowOverlap) * sizeof(T));
-                ox += p.spacing - p.windowOverlap;
-                ix += p.spacing - p.windowOverlap;
-                assert(ox == (ssize_t)(p.symSize - p.windowOverlap));
-
-                // Apply window from 1 to 0.5 for the end of the symbol
-                for (size_t i = 0; ox < (ssize_t)p.symSize; i++) {
-                    if constexpr (std::is_same_v<complexf, T>) {
-                        out[ox] = in[ix] * p.windowFloat[2*p.windowOverlap - (i+1)];
-                    }
-                    if constexpr (std::is_same_v<complexfix, T>) {
-                        out[ox] = in[ix] * p.windowFix[2*p.windowOverlap - (i+1)];
-                    }
-                    if constexpr (std::is_same_v<complexfix_wide, T>) {
-                        out[ox] = in[ix] * p.windowFixWide[2*p.windowOverlap - (i+1)];
-                    }
-                    ox++;
-                    ix++;
-                }
-                assert(ix == p.spacing);
+        }
+    }
 
-                ix = 0;
-                // Cyclic suffix, with window from 0.5 to 0
-                for (size_t i = 0; ox < (ssize_t)(p.symSize + p.windowOverlap); i++) {
-                    if constexpr (std::is_same_v<complexf, T>) {
-                        out[ox] = in[ix] * p.windowFloat[p.windowOverlap - (i+1)];
-                    }
-                    if constexpr (std::is_same_v<complexfix, T>) {
-                        out[ox] = in[ix] * p.windowFix[p.windowOverlap - (i+1)];
-                    }
-                    if constexpr (std::is_same_v<complexfix_wide, T>) {
-                        out[ox] = in[ix] * p.windowFixWide[p.windowOverlap - (i+1)];
-                    }
-                    ox++;
-                    ix++;
-                }
+}
 
-                assert(ix == p.windowOverlap);
-            }
+/* half is set to store the output as 16-bit floats */
+template<typename T>
+int do_process(const GuardIntervalInserter::Params& p, bool planar,
+        const half_float::converters_t *half,
+        Buffer* const dataIn, Buffer* dataOut)
+{
+    PDEBUG("GuardIntervalInserter do_process(dataIn: %p, dataOut: %p)\n",
+            dataIn, dataOut);
 
-            out += p.symSize;
-            in += p.spacing;
-            // out is now pointing to the proper end of symbol. There are
-            // windowOverlap samples ahead that were already written.
+    const size_t sizeIn = dataIn->getLength() / sizeof(T);
+    const size_t num_symbols = p.nbSymbols + 1;
+    const size_t num_frames = sizeIn / (num_symbols * p.spacing);
+
+    const size_t sample_size_out = half ? 2 * sizeof(uint16_t) : sizeof(T);
+    dataOut->setLength(num_frames * (p.nullSize + (p.nbSymbols * p.symSize)) *
+            sample_size_out);
+
+    const T* in = reinterpret_cast<const T*>(dataIn->getData());
+    T* out = reinterpret_cast<T*>(dataOut->getData());
+
+    if (num_frames == 0 or sizeIn != num_frames * num_symbols * p.spacing)
+    {
+        PDEBUG("Nb symbols: %zu\n", p.nbSymbols);
+        PDEBUG("Spacing: %zu\n", p.spacing);
+        PDEBUG("Null size: %zu\n", p.nullSize);
+        PDEBUG("Sym size: %zu\n", p.symSize);
+        PDEBUG("\n%zu is not a multiple of %zu\n", sizeIn, num_symbols * p.spacing);
+        throw std::runtime_error(
+                "GuardIntervalInserter::process input size not valid!");
+    }
+
+    // TODO remember the end of the last TF so that we can do some
+    //      windowing too.
+
+    std::lock_guard<std::mutex> lock(p.windowMutex);
+    const auto *rise = rise_window<T>(p).data();
+    const auto *fall = fall_window<T>(p).data();
+
+    if (planar) {
+        // Both halves of the buffer have the layout of a buffer of real
+        // samples
+        const float *in_re = reinterpret_cast<const float*>(in);
+        float *out_re = reinterpret_cast<float*>(out);
+        const size_t planeOut = dataOut->getLength() / sizeof(T);
+        const float *rise_planar = p.risePlanar.data();
+        const float *fall_planar = p.fallPlanar.data();
+        insert_guard_intervals(p, in_re, direct_output_t<float>{out_re},
+                num_frames, rise_planar, fall_planar,
+                fall_planar + p.windowOverlap);
+        insert_guard_intervals(p, in_re + sizeIn,
+                direct_output_t<float>{out_re + planeOut}, num_frames,
+                rise_planar, fall_planar, fall_planar + p.windowOverlap);
+    }
+    else if (half) {
+        if constexpr (std::is_same_v<complexf, T>) {
+            half_output_t out_half{
+                reinterpret_cast<uint16_t*>(dataOut->getData()), *half};
+            insert_guard_intervals(p, in, out_half, num_frames,
+                    rise, fall, fall + 2 * p.windowOverlap);
+        }
+        else {
+            throw std::logic_error("GuardIntervalInserter: 16-bit floats "
+                    "need floating-point input");
         }
     }
     else {
-        // Handle Null symbol separately because it is longer
-        // end - (nullSize - spacing) = 2 * spacing - nullSize
-        memcpy(out, &in[2 * p.spacing - p.nullSize],
-                (p.nullSize - p.spacing) * sizeof(T));
-        memcpy(&out[p.nullSize - p.spacing], in, p.spacing * sizeof(T));
-        in += p.spacing;
-        out += p.nullSize;
-
-        // Data symbols
-        for (size_t i = 0; i < p.nbSymbols; ++i) {
-            // end - (symSize - spacing) = 2 * spacing - symSize
-            memcpy(out, &in[2 * p.spacing - p.symSize],
-                    (p.symSize - p.spacing) * sizeof(T));
-            memcpy(&out[p.symSize - p.spacing], in, p.spacing * sizeof(T));
-            in += p.spacing;
-            out += p.symSize;
-        }
+        // The second half of the falling edge, from 0.5 to 0
+        insert_guard_intervals(p, in, direct_output_t<T>{out}, num_frames,
+                rise, fall, fall + 2 * p.windowOverlap);
     }
 
     const auto sizeOut = dataOut->getLength();
@@ -326,15 +582,65 @@ int GuardIntervalInserter::process(Buffer* const dataIn, Buffer* dataOut)
 {
     switch (m_fftEngine) {
         case FFTEngine::FFTW:
-            return do_process<complexf>(m_params, dataIn, dataOut);
+            if (m_half_output != half_format_e::none) {
+                return process_half(dataIn, dataOut);
+            }
+            return do_process<complexf>(m_params, m_planar, nullptr,
+                    dataIn, dataOut);
         case FFTEngine::KISS:
-            return do_process<complexfix>(m_params, dataIn, dataOut);
+        case FFTEngine::KISS_SIMD:
+            return do_process<complexfix>(m_params, false, nullptr,
+                    dataIn, dataOut);
         case FFTEngine::DEXTER:
-            return do_process<complexfix_wide>(m_params, dataIn, dataOut);
+            return do_process<complexfix_wide>(m_params, false, nullptr,
+                    dataIn, dataOut);
     }
     throw std::logic_error("Unhandled fftEngine variant");
 }
 
+int GuardIntervalInserter::process_half(Buffer* const dataIn, Buffer* dataOut)
+{
+    if (not m_half_converters.to_half) {
+        m_half_converters = half_float::get_converters(m_half_output);
+    }
+
+    const int ret = do_process<complexf>(m_params, false, &m_half_converters,
+            dataIn, dataOut);
+
+    if (not m_half_measured) {
+        /* The rounding noise of the first frame, against the floats. It is
+         * white, and the MER and the shoulders cannot get better than the
+         * ratio of the signal to the noise in their bandwidth. */
+        Buffer reference;
+        do_process<complexf>(m_params, false, nullptr, dataIn, &reference);
+        const float *ref = reinterpret_cast<const float*>(reference.getData());
+        const size_t n = reference.getLength() / sizeof(float);
+        std::vector<float> rounded(n);
+        m_half_converters.from_half(
+                reinterpret_cast<const uint16_t*>(dataOut->getData()),
+                rounded.data(), n);
+
+        double signal = 0;
+        double noise = 0;
+        for (size_t i = 0; i < n; i++) {
+            const double error = (double)ref[i] - (double)rounded[i];
+            signal += (double)ref[i] * (double)ref[i];
+            noise += error * error;
+        }
+        // Without noise, the next frame is measured
+        if (noise == 0) {
+            return ret;
+        }
+        m_half_snr = 10.0 * log10(signal / noise);
+        m_half_measured = true;
+        etiLog.level(info) << "GuardIntervalInserter: " <<
+            half_float::format_name(m_half_output) << " output, the "
+            "rounding noise is " << std::fixed << std::setprecision(1) <<
+            m_half_snr.load() << " dB below the signal";
+    }
+    return ret;
+}
+
 void GuardIntervalInserter::set_parameter(
         const std::string& parameter,
         const std::string& value)
@@ -348,6 +654,9 @@ void GuardIntervalInserter::set_parameter(
         ss >> new_window_overlap;
         update_window(new_window_overlap);
     }
+    else if (parameter == "half_snr") {
+        throw ParameterError("Parameter " + parameter + " is read-only");
+    }
     else {
         stringstream ss_err;
         ss_err << "Parameter '" << parameter <<
@@ -363,6 +672,9 @@ const std::string GuardIntervalInserter::get_parameter(const std::string& parame
     if (parameter == "windowlen") {
         ss << m_params.windowOverlap;
     }
+    else if (parameter == "half_snr") {
+        ss << m_half_snr.load();
+    }
     else {
         ss << "Parameter '" << parameter <<
             "' is not exported by controllable " << get_rc_name();
@@ -375,5 +687,6 @@ const json::map_t GuardIntervalInserter::get_all_values() const
 {
     json::map_t map;
     map["windowlen"].v = m_params.windowOverlap;
+    map["half_snr"].v = m_half_snr.load();
     return map;
 }
@@ -33,7 +33,9 @@
 #include "ConfigParser.h"
 #include "ModPlugin.h"
 #include "RemoteControl.h"
+#include <atomic>
 #include <vector>
+#include <cstdint>
 
 /* The GuardIntervalInserter prepends the cyclic prefix to all
  * symbols in the transmission frame.
@@ -58,6 +60,17 @@ class GuardIntervalInserter : public ModCodec, public RemoteControllable
         int process(Buffer* const dataIn, Buffer* dataOut) override;
         const char* name() override { return "GuardIntervalInserter"; }
 
+        // Only with the FFTW engine, the others use fixed-point samples
+        bool supports_planar_input() const override {
+            return m_fftEngine == FFTEngine::FFTW;
+        }
+        bool supports_planar_output() const override {
+            return m_fftEngine == FFTEngine::FFTW;
+        }
+        bool supports_half_output() const override {
+            return m_fftEngine == FFTEngine::FFTW;
+        }
+
         /******* REMOTE CONTROL ********/
         virtual void set_parameter(const std::string& parameter, const std::string& value) override;
         virtual const std::string get_parameter(const std::string& parameter) const override;
@@ -78,17 +91,35 @@ class GuardIntervalInserter : public ModCodec, public RemoteControllable
             size_t& windowOverlap;
 
             mutable std::mutex windowMutex;
-            std::vector<float> windowFloat;
-            std::vector<complexfix::value_type> windowFix;
-            std::vector<complexfix_wide::value_type> windowFixWide;
+
+            // The rising edge of the window, and the falling edge, which is
+            // the rising edge reversed. Both contain 2*windowOverlap values,
+            // each repeated for the real and imaginary parts of a sample.
+            // The fixed-point windows contain raw fixed_16 and fixed_16_16
+            // values.
+            std::vector<float> riseFloat;
+            std::vector<float> fallFloat;
+            std::vector<int16_t> riseFix;
+            std::vector<int16_t> fallFix;
+            std::vector<int32_t> riseFixWide;
+            std::vector<int32_t> fallFixWide;
+            // One value per sample, for the planar layout
+            std::vector<float> risePlanar;
+            std::vector<float> fallPlanar;
         };
 
     protected:
         void update_window(size_t new_window_overlap);
+        int process_half(Buffer* const dataIn, Buffer* dataOut);
 
         FFTEngine m_fftEngine;
 
         Params m_params;
 
+        // Selected at the first frame with 16-bit float output
+        half_float::converters_t m_half_converters = {};
+        bool m_half_measured = false;
+        std::atomic<float> m_half_snr = ATOMIC_VAR_INIT(0.0f);
+
 };
 
@@ -0,0 +1,317 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "HalfFloat.h"
+#include "CpuFeatures.h"
+
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#if defined(__x86_64__) || defined(__i386__)
+#   include <immintrin.h>
+#elif defined(__ARM_NEON)
+#   include <arm_neon.h>
+#endif
+
+using namespace std;
+
+namespace half_float {
+
+half_format_e parse_format(const string& name)
+{
+    if (name == "none") {
+        return half_format_e::none;
+    }
+    else if (name == "fp16") {
+        return half_format_e::fp16;
+    }
+    else if (name == "bf16") {
+        return half_format_e::bf16;
+    }
+    throw invalid_argument("Unknown 16-bit float format " + name);
+}
+
+const char *format_name(half_format_e format)
+{
+    switch (format) {
+        case half_format_e::none: return "none";
+        case half_format_e::fp16: return "fp16";
+        case half_format_e::bf16: return "bf16";
+    }
+    return "";
+}
+
+static inline uint32_t float_bits(float f)
+{
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+    return x;
+}
+
+static inline float bits_float(uint32_t x)
+{
+    float f;
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+static uint16_t to_fp16(float f)
+{
+    uint32_t x = float_bits(f);
+    const uint16_t sign = (x >> 16) & 0x8000;
+    x &= 0x7fffffff;
+
+    if (x > 0x7f800000) {
+        return sign | 0x7e00;
+    }
+    // From 65520 on, the value rounds to infinity
+    else if (x >= 0x477ff000) {
+        return sign | 0x7c00;
+    }
+    // Below 2^-14, in units of the smallest subnormal 2^-24
+    else if (x < 0x38800000) {
+        return sign | (uint16_t)nearbyintf(bits_float(x) * 16777216.0f);
+    }
+
+    // The exponent bias goes from 127 to 15, and 13 bits are rounded off
+    x += 0xfff + ((x >> 13) & 1);
+    return sign | ((x - 0x38000000) >> 13);
+}
+
+static float from_fp16(uint16_t h)
+{
+    const uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    const uint32_t exponent = (h >> 10) & 0x1f;
+    const uint32_t mantissa = h & 0x3ff;
+
+    if (exponent == 0) {
+        const float f = mantissa * (1.0f / 16777216.0f);
+        return sign ? -f : f;
+    }
+    else if (exponent == 0x1f) {
+        return bits_float(sign | 0x7f800000 | (mantissa << 13));
+    }
+    return bits_float(sign | ((exponent + 112) << 23) | (mantissa << 13));
+}
+
+/* NaNs are not kept, the samples never are */
+static inline uint16_t to_bf16(float f)
+{
+    const uint32_t x = float_bits(f);
+    return (x + 0x7fff + ((x >> 16) & 1)) >> 16;
+}
+
+static inline float from_bf16(uint16_t h)
+{
+    return bits_float((uint32_t)h << 16);
+}
+
+static void to_fp16_scalar(const float *in, uint16_t *out, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        out[i] = to_fp16(in[i]);
+    }
+}
+
+static void from_fp16_scalar(const uint16_t *in, float *out, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        out[i] = from_fp16(in[i]);
+    }
+}
+
+static void to_bf16_scalar(const float *in, uint16_t *out, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        out[i] = to_bf16(in[i]);
+    }
+}
+
+static void from_bf16_scalar(const uint16_t *in, float *out, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        out[i] = from_bf16(in[i]);
+    }
+}
+
+#if defined(__SSE2__)
+static inline __m128i round_bf16_sse(__m128i x)
+{
+    // The arithmetic shift keeps the upper halves in the int16 range,
+    // where the saturating pack does not change them
+    const __m128i lsb = _mm_and_si128(_mm_srli_epi32(x, 16), _mm_set1_epi32(1));
+    x = _mm_add_epi32(x, _mm_add_epi32(lsb, _mm_set1_epi32(0x7fff)));
+    return _mm_srai_epi32(x, 16);
+}
+
+static void to_bf16_sse(const float *in, uint16_t *out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m128i a = _mm_castps_si128(_mm_loadu_ps(in + i));
+        const __m128i b = _mm_castps_si128(_mm_loadu_ps(in + i + 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+                _mm_packs_epi32(round_bf16_sse(a), round_bf16_sse(b)));
+    }
+    to_bf16_scalar(in + i, out + i, n - i);
+}
+
+static void from_bf16_sse(const uint16_t *in, float *out, size_t n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+                _mm_unpacklo_epi16(zero, h));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 4),
+                _mm_unpackhi_epi16(zero, h));
+    }
+    from_bf16_scalar(in + i, out + i, n - i);
+}
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+// Compiled for F16C even if the rest of the program isn't, and only used if
+// the CPU supports it.
+#  define HAVE_HALF_FLOAT_DISPATCH 1
+
+__attribute__((target("avx,f16c")))
+static void to_fp16_f16c(const float *in, uint16_t *out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+                _mm256_cvtps_ph(_mm256_loadu_ps(in + i),
+                    _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+    }
+    to_fp16_scalar(in + i, out + i, n - i);
+}
+
+__attribute__((target("avx,f16c")))
+static void from_fp16_f16c(const uint16_t *in, float *out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(out + i, _mm256_cvtph_ps(_mm_loadu_si128(
+                        reinterpret_cast<const __m128i*>(in + i))));
+    }
+    from_fp16_scalar(in + i, out + i, n - i);
+}
+#endif
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+static void to_fp16_neon(const float *in, uint16_t *out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const float16x4_t a = vcvt_f16_f32(vld1q_f32(in + i));
+        const float16x4_t b = vcvt_f16_f32(vld1q_f32(in + i + 4));
+        vst1q_u16(out + i, vreinterpretq_u16_f16(vcombine_f16(a, b)));
+    }
+    to_fp16_scalar(in + i, out + i, n - i);
+}
+
+static void from_fp16_neon(const uint16_t *in, float *out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const float16x8_t h = vreinterpretq_f16_u16(vld1q_u16(in + i));
+        vst1q_f32(out + i, vcvt_f32_f16(vget_low_f16(h)));
+        vst1q_f32(out + i + 4, vcvt_f32_f16(vget_high_f16(h)));
+    }
+    from_fp16_scalar(in + i, out + i, n - i);
+}
+#endif
+
+#if defined(__ARM_NEON)
+static void to_bf16_neon(const float *in, uint16_t *out, size_t n)
+{
+    const uint32x4_t one = vdupq_n_u32(1);
+    const uint32x4_t bias = vdupq_n_u32(0x7fff);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        uint32x4_t x = vreinterpretq_u32_f32(vld1q_f32(in + i));
+        const uint32x4_t lsb = vandq_u32(vshrq_n_u32(x, 16), one);
+        x = vaddq_u32(x, vaddq_u32(lsb, bias));
+        vst1_u16(out + i, vshrn_n_u32(x, 16));
+    }
+    to_bf16_scalar(in + i, out + i, n - i);
+}
+
+static void from_bf16_neon(const uint16_t *in, float *out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        vst1q_f32(out + i, vreinterpretq_f32_u32(
+                    vshll_n_u16(vld1_u16(in + i), 16)));
+    }
+    from_bf16_scalar(in + i, out + i, n - i);
+}
+#endif
+
+static converters_t select_fp16_converters()
+{
+    auto& cpu = cpu_features();
+    converters_t converters = {to_fp16_scalar, from_fp16_scalar, "scalar"};
+#if defined(HAVE_HALF_FLOAT_DISPATCH)
+    if (cpu.supports(cpu_feature_e::f16c)) {
+        converters = {to_fp16_f16c, from_fp16_f16c, "F16C"};
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    if (cpu.supports(cpu_feature_e::neon)) {
+        converters = {to_fp16_neon, from_fp16_neon, "NEON"};
+    }
+#endif
+    cpu.register_kernel("HalfFloat fp16", converters.name);
+    return converters;
+}
+
+static converters_t select_bf16_converters()
+{
+    auto& cpu = cpu_features();
+    converters_t converters = {to_bf16_scalar, from_bf16_scalar, "scalar"};
+#if defined(__SSE2__)
+    if (cpu.supports(cpu_feature_e::sse2)) {
+        converters = {to_bf16_sse, from_bf16_sse, "SSE2"};
+    }
+#elif defined(__ARM_NEON)
+    if (cpu.supports(cpu_feature_e::neon)) {
+        converters = {to_bf16_neon, from_bf16_neon, "NEON"};
+    }
+#endif
+    cpu.register_kernel("HalfFloat bf16", converters.name);
+    return converters;
+}
+
+converters_t get_converters(half_format_e format)
+{
+    switch (format) {
+        case half_format_e::fp16: return select_fp16_converters();
+        case half_format_e::bf16: return select_bf16_converters();
+        case half_format_e::none: break;
+    }
+    throw logic_error("half_float: no converters without a format");
+}
+
+} // namespace half_float
@@ -0,0 +1,67 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   Conversions between floats and the 16-bit FP16 and BF16 formats, for
+   the samples that are stored with half the size between two blocks
+*/
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/* FP16 is the IEEE 754 half precision, with 11 significant bits and a
+ * largest value of 65504. BF16 keeps the exponent of a float and 8
+ * significant bits. */
+enum class half_format_e {
+    none,
+    fp16,
+    bf16,
+};
+
+namespace half_float {
+
+/* none, fp16 or bf16. Throws an invalid_argument for other names. */
+half_format_e parse_format(const std::string& name);
+const char *format_name(half_format_e format);
+
+/* Convert n values, rounding to the nearest even. Values too large for
+ * FP16 become infinite. in and out must not overlap. */
+using to_half_t = void (*)(const float *in, uint16_t *out, size_t n);
+using from_half_t = void (*)(const uint16_t *in, float *out, size_t n);
+
+struct converters_t {
+    to_half_t to_half;
+    from_half_t from_half;
+    const char *name;
+};
+
+/* The fastest converters for the format and the CPU */
+converters_t get_converters(half_format_e format);
+
+} // namespace half_float
@@ -0,0 +1,319 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "HalfbandInterpolator.h"
+#include "PcDebug.h"
+#include "CpuFeatures.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+/* On x86, the AVX kernel is built with the target attribute of GCC and
+ * clang, and used if the CPU supports it. */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#    define HAVE_HALFBAND_KERNEL_DISPATCH 1
+#endif
+
+#if defined(HAVE_HALFBAND_KERNEL_DISPATCH) || defined(__SSE2__)
+#    include <immintrin.h>
+#elif defined(__ARM_NEON)
+#    include <arm_neon.h>
+#endif
+
+// Half the bandwidth of the DAB signal
+static const double SIGNAL_HALF_BANDWIDTH = 768000.0;
+
+// Kaiser window parameter for 80 dB of stopband attenuation, and the
+// corresponding term of the estimate of the filter length
+static const double KAISER_BETA = 7.857;
+static const double STOPBAND_ATTENUATION = 80.0;
+
+/* Zeroth order modified Bessel function of the first kind */
+static double bessel_i0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 50; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+        if (term < sum * 1e-12) {
+            break;
+        }
+    }
+    return sum;
+}
+
+/* The kernels compute the output pairs first to first + num - 1 of a
+ * stage, b is the buffer of the stage, c and N its taps. Output pair i is
+ * b[i+N-1], and the sum of c[j] * (b[i+N-1-j] + b[i+N+j]), in complex
+ * samples. */
+using halfband_kernel_t = void (*)(const float *b, const float *c, size_t N,
+        float *out, size_t first, size_t num);
+
+static void halfband_scalar(const float *b, const float *c, size_t N,
+        float *out, size_t first, size_t num)
+{
+    for (size_t i = first; i < first + num; i++) {
+        const float *centre = b + 2 * (i + N - 1);
+        float re = 0.0f, im = 0.0f;
+        for (size_t j = 0; j < N; j++) {
+            const float *lo = centre - 2 * j;
+            const float *hi = centre + 2 * (j + 1);
+            re += c[j] * (lo[0] + hi[0]);
+            im += c[j] * (lo[1] + hi[1]);
+        }
+        out[4 * i] = centre[0];
+        out[4 * i + 1] = centre[1];
+        out[4 * i + 2] = re;
+        out[4 * i + 3] = im;
+    }
+}
+
+#if defined(__SSE2__) || defined(__ARM_NEON)
+/* Two output pairs at a time */
+static void halfband_simd(const float *b, const float *c, size_t N,
+        float *out, size_t first, size_t num)
+{
+    const size_t end = first + num / 2 * 2;
+    for (size_t i = first; i < end; i += 2) {
+        const float *centre = b + 2 * (i + N - 1);
+#if defined(__SSE2__)
+        __m128 acc = _mm_setzero_ps();
+        for (size_t j = 0; j < N; j++) {
+            const __m128 sum = _mm_add_ps(_mm_loadu_ps(centre - 2 * j),
+                    _mm_loadu_ps(centre + 2 * (j + 1)));
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(c[j]), sum));
+        }
+        const __m128d even = _mm_castps_pd(_mm_loadu_ps(centre));
+        const __m128d odd = _mm_castps_pd(acc);
+        _mm_storeu_ps(out + 4 * i, _mm_castpd_ps(_mm_unpacklo_pd(even, odd)));
+        _mm_storeu_ps(out + 4 * i + 4, _mm_castpd_ps(_mm_unpackhi_pd(even, odd)));
+#elif defined(__ARM_NEON)
+        float32x4_t acc = vdupq_n_f32(0.0f);
+        for (size_t j = 0; j < N; j++) {
+            const float32x4_t sum = vaddq_f32(vld1q_f32(centre - 2 * j),
+                    vld1q_f32(centre + 2 * (j + 1)));
+            acc = vmlaq_n_f32(acc, sum, c[j]);
+        }
+        const float32x4_t even = vld1q_f32(centre);
+        vst1q_f32(out + 4 * i, vcombine_f32(vget_low_f32(even), vget_low_f32(acc)));
+        vst1q_f32(out + 4 * i + 4, vcombine_f32(vget_high_f32(even), vget_high_f32(acc)));
+#endif
+    }
+    halfband_scalar(b, c, N, out, end, first + num - end);
+}
+#endif
+
+#if defined(HAVE_HALFBAND_KERNEL_DISPATCH)
+/* Four output pairs at a time */
+__attribute__((target("avx")))
+static void halfband_avx(const float *b, const float *c, size_t N,
+        float *out, size_t first, size_t num)
+{
+    const size_t end = first + num / 4 * 4;
+    for (size_t i = first; i < end; i += 4) {
+        const float *centre = b + 2 * (i + N - 1);
+        __m256 acc = _mm256_setzero_ps();
+        for (size_t j = 0; j < N; j++) {
+            const __m256 sum = _mm256_add_ps(_mm256_loadu_ps(centre - 2 * j),
+                    _mm256_loadu_ps(centre + 2 * (j + 1)));
+            acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(c[j]), sum));
+        }
+        // Interleave the complex samples of both
+        const __m256d even = _mm256_castps_pd(_mm256_loadu_ps(centre));
+        const __m256d odd = _mm256_castps_pd(acc);
+        const __m256d lo = _mm256_unpacklo_pd(even, odd);
+        const __m256d hi = _mm256_unpackhi_pd(even, odd);
+        _mm256_storeu_ps(out + 4 * i,
+                _mm256_castpd_ps(_mm256_permute2f128_pd(lo, hi, 0x20)));
+        _mm256_storeu_ps(out + 4 * i + 8,
+                _mm256_castpd_ps(_mm256_permute2f128_pd(lo, hi, 0x31)));
+    }
+    halfband_scalar(b, c, N, out, end, first + num - end);
+}
+#endif
+
+static halfband_kernel_t select_kernel()
+{
+    auto& cpu = cpu_features();
+    halfband_kernel_t kernel = halfband_scalar;
+    const char *name = "scalar";
+#if defined(HAVE_HALFBAND_KERNEL_DISPATCH)
+    if (cpu.supports(cpu_feature_e::avx)) {
+        kernel = halfband_avx;
+        name = "AVX";
+    }
+    else
+#endif
+#if defined(__SSE2__)
+    if (cpu.supports(cpu_feature_e::sse2)) {
+        kernel = halfband_simd;
+        name = "SSE2";
+    }
+#elif defined(__ARM_NEON)
+    if (cpu.supports(cpu_feature_e::neon)) {
+        kernel = halfband_simd;
+        name = "NEON";
+    }
+#endif
+    cpu.register_kernel("HalfbandInterpolator", name);
+    return kernel;
+}
+
+static halfband_kernel_t kernel()
+{
+    static const halfband_kernel_t k = select_kernel();
+    return k;
+}
+
+bool HalfbandInterpolator::supports_ratio(size_t inputRate, size_t outputRate)
+{
+    if (inputRate == 0 or outputRate <= inputRate or
+            outputRate % inputRate != 0) {
+        return false;
+    }
+    const size_t ratio = outputRate / inputRate;
+    return (ratio & (ratio - 1)) == 0;
+}
+
+HalfbandInterpolator::HalfbandInterpolator(size_t inputRate, size_t outputRate) :
+    ModCodec()
+{
+    PDEBUG("HalfbandInterpolator::HalfbandInterpolator(%zu, %zu) @ %p\n",
+            inputRate, outputRate, this);
+
+    if (not supports_ratio(inputRate, outputRate)) {
+        throw std::invalid_argument("HalfbandInterpolator: the output rate "
+                "must be the input rate times a power of two");
+    }
+
+    for (size_t rate = inputRate; rate < outputRate; rate *= 2) {
+        // From the edge of the signal to the edge of its first image,
+        // relative to the output rate of the stage
+        const double transition = (rate - 2.0 * SIGNAL_HALF_BANDWIDTH) /
+            (2.0 * rate);
+        if (transition <= 0.0) {
+            throw std::invalid_argument("HalfbandInterpolator: the input "
+                    "rate is too low for the DAB signal");
+        }
+
+        // Kaiser's estimate of the filter length, and the number of taps
+        // 4N-1 of the half-band filter that covers it
+        const double length = (STOPBAND_ATTENUATION - 7.95) /
+            (14.36 * transition) + 1.0;
+        const size_t N = std::max<size_t>(1, std::ceil((length + 1.0) / 4.0));
+
+        stage_t stage;
+        stage.N = N;
+        stage.taps.resize(N);
+
+        // Taps 2j+1 of the windowed sinc with a cutoff at a quarter of the
+        // output rate, the window reaching zero at 2N
+        double sum = 0.0;
+        for (size_t j = 0; j < N; j++) {
+            const double t = 2.0 * j + 1.0;
+            const double sinc = std::sin(M_PI * t / 2.0) / (M_PI * t / 2.0);
+            const double r = t / (2.0 * N);
+            const double window = bessel_i0(KAISER_BETA * std::sqrt(1.0 - r * r)) /
+                bessel_i0(KAISER_BETA);
+            stage.taps[j] = (float)(sinc * window);
+            sum += 2.0 * (double)stage.taps[j];
+        }
+
+        // The odd outputs keep the level of the even ones
+        for (auto& tap : stage.taps) {
+            tap = (float)((double)tap / sum);
+        }
+
+        stage.buffer.resize(2 * (2 * N - 1), 0.0f);
+        m_stages.push_back(std::move(stage));
+    }
+
+    // Selected once, when the first interpolator is created
+    kernel();
+}
+
+size_t HalfbandInterpolator::num_multiplications() const
+{
+    // Every stage makes N multiplications per input sample, at a rate
+    // that doubles every stage
+    size_t num = 0;
+    size_t factor = 1;
+    for (const auto& stage : m_stages) {
+        num += stage.N * factor;
+        factor *= 2;
+    }
+    return num;
+}
+
+size_t HalfbandInterpolator::delay() const
+{
+    // Every stage delays its input by N samples, which the following
+    // stages double
+    size_t delay = 0;
+    for (const auto& stage : m_stages) {
+        delay = 2 * (delay + stage.N);
+    }
+    return delay;
+}
+
+void HalfbandInterpolator::interpolate(stage_t& stage, const float *in,
+        size_t num_in, float *out)
+{
+    const size_t num_history = 2 * stage.N - 1;
+    auto& buffer = stage.buffer;
+
+    buffer.resize(2 * (num_history + num_in));
+    std::copy(in, in + 2 * num_in, buffer.begin() + 2 * num_history);
+
+    kernel()(buffer.data(), stage.taps.data(), stage.N, out, 0, num_in);
+
+    // The last samples are the history of the next frame
+    std::copy(buffer.end() - 2 * num_history, buffer.end(), buffer.begin());
+    buffer.resize(2 * num_history);
+}
+
+int HalfbandInterpolator::process(Buffer* const dataIn, Buffer* dataOut)
+{
+    PDEBUG("HalfbandInterpolator::process(dataIn: %p, dataOut: %p)\n",
+            dataIn, dataOut);
+
+    size_t num = dataIn->getLength() / sizeof(complexf);
+    dataOut->setLength(num * sizeof(complexf) << m_stages.size());
+
+    const float *in = reinterpret_cast<const float*>(dataIn->getData());
+    for (size_t s = 0; s < m_stages.size(); s++) {
+        auto& stage = m_stages[s];
+        float *out = reinterpret_cast<float*>(dataOut->getData());
+        if (s + 1 < m_stages.size()) {
+            stage.output.resize(4 * num);
+            out = stage.output.data();
+        }
+        interpolate(stage, in, num, out);
+        in = out;
+        num *= 2;
+    }
+
+    return dataOut->getLength();
+}
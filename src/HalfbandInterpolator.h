@@ -0,0 +1,88 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include "ModPlugin.h"
+
+#include <cstddef>
+#include <vector>
+
+/* Interpolates by a power of two with a cascade of half-band filters, each
+ * doubling the rate. In a half-band filter, every other tap is zero except
+ * the centre one: every even output sample is an input sample, and every
+ * odd one a dot product with symmetric taps, which takes one multiplication
+ * for two taps. The first stage has the narrowest transition band, from
+ * the edge of the DAB signal to its first image, the following ones have
+ * wider transition bands and fewer taps. All stages have about 80dB of
+ * image rejection.
+ *
+ * Like the PolyphaseResampler, the filter state carries over from one
+ * frame to the next. Only floating-point samples are supported.
+ */
+class HalfbandInterpolator : public ModCodec
+{
+public:
+    HalfbandInterpolator(size_t inputRate, size_t outputRate);
+    HalfbandInterpolator(const HalfbandInterpolator&) = delete;
+    HalfbandInterpolator& operator=(const HalfbandInterpolator&) = delete;
+
+    // True if outputRate is inputRate times a power of two, at least two
+    static bool supports_ratio(size_t inputRate, size_t outputRate);
+
+    int process(Buffer* const dataIn, Buffer* dataOut) override;
+    const char* name() override { return "HalfbandInterpolator"; }
+
+    // Number of stages, and of multiplications per input sample, for the logs
+    size_t num_stages() const { return m_stages.size(); }
+    size_t num_multiplications() const;
+
+    // Delay of the cascade, in output samples
+    size_t delay() const;
+
+private:
+    struct stage_t {
+        // The odd outputs are sum_j taps[j] * (x[n-j] + x[n+1+j]) for j
+        // from 0 to N-1, the even outputs x[n].
+        size_t N;
+        std::vector<float> taps;
+
+        // The 2N-1 input samples of the previous frame still used by the
+        // filter, followed by the input of the current frame, as
+        // interleaved real and imaginary parts.
+        std::vector<float> buffer;
+
+        // Output of this stage, unless it is the last
+        std::vector<float> output;
+    };
+
+    // Doubles the rate of num_in samples from in into out
+    static void interpolate(stage_t& stage, const float *in, size_t num_in,
+            float *out);
+
+    std::vector<stage_t> m_stages;
+};
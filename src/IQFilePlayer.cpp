@@ -0,0 +1,156 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "IQFilePlayer.h"
+#include "TimestampDecoder.h"
+#include "PcDebug.h"
+#include "Utils.h"
+#include "Log.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+IQFilePlayer::IQFilePlayer(const mod_settings_t& mod_settings, size_t sampleSize) :
+    m_filename(mod_settings.inputName),
+    m_loop(mod_settings.loop),
+    m_timestamps(mod_settings.sdr_device_config.enableSync),
+    m_tist_offset_s(mod_settings.tist_offset_s)
+{
+    const auto duration = transmission_frame_duration(mod_settings.dabMode);
+    if ((mod_settings.outputRate * duration.count()) % 1000 != 0) {
+        throw invalid_argument("IQFilePlayer: the output rate does not give "
+                "a whole number of samples per transmission frame");
+    }
+    const size_t samples_per_frame =
+        mod_settings.outputRate * duration.count() / 1000;
+    m_frame_bytes = samples_per_frame * sampleSize;
+    m_frame_ticks = duration.count() * TIMESTAMP_TICKS_PER_SECOND / 1000;
+    m_eti_frames_per_frame = duration.count() / 24;
+
+    int fd = open(m_filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+        throw runtime_error("IQFilePlayer: unable to open " + m_filename +
+                ": " + strerror(errno));
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 or not S_ISREG(st.st_mode)) {
+        close(fd);
+        throw runtime_error("IQFilePlayer: " + m_filename +
+                " is not a regular file, it cannot be memory-mapped");
+    }
+
+    m_length = st.st_size;
+    m_num_frames = m_length / m_frame_bytes;
+    if (m_num_frames == 0) {
+        close(fd);
+        throw runtime_error("IQFilePlayer: " + m_filename +
+                " does not contain a whole transmission frame");
+    }
+
+    void *data = mmap(nullptr, m_length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        throw runtime_error("IQFilePlayer: unable to map " + m_filename +
+                ": " + strerror(errno));
+    }
+    m_data = reinterpret_cast<uint8_t*>(data);
+    madvise(m_data, m_length, MADV_SEQUENTIAL);
+
+    if (m_length % m_frame_bytes != 0) {
+        etiLog.level(warn) << "IQFilePlayer: ignoring the incomplete " <<
+            "transmission frame at the end of " << m_filename;
+    }
+}
+
+IQFilePlayer::~IQFilePlayer()
+{
+    if (m_data) {
+        munmap(m_data, m_length);
+    }
+}
+
+string IQFilePlayer::get_info() const
+{
+    return "I/Q input file " + m_filename + ", " + to_string(m_num_frames) +
+        " transmission frames of " + to_string(m_frame_bytes) + " bytes" +
+        (m_loop ? ", looped" : "") +
+        (m_timestamps ? ", with timestamps" : "");
+}
+
+bool IQFilePlayer::play_next(ModOutput& output)
+{
+    if (m_next_frame == m_num_frames) {
+        if (not m_loop) {
+            return false;
+        }
+        m_next_frame = 0;
+    }
+
+    if (m_frames_played == 0) {
+        m_start_ticks = frame_timestamp::seconds_to_ticks(
+                ceil(frame_timestamp::system_time()));
+    }
+
+    // Like a modulator getting its input in real time, the frame is
+    // given to the output the offset before it gets transmitted
+    const int64_t due_ticks = m_start_ticks + m_frames_played * m_frame_ticks;
+    const double wait = (double)due_ticks / TIMESTAMP_TICKS_PER_SECOND -
+        frame_timestamp::system_time();
+    if (wait > 0) {
+        this_thread::sleep_for(chrono::duration<double>(wait));
+    }
+
+    m_frame.setData(m_data + m_next_frame * m_frame_bytes, m_frame_bytes);
+
+    flowgraph_metadata md;
+    const uint64_t eti_frames = m_frames_played * m_eti_frames_per_frame;
+    md.ts.fct = eti_frames % 250;
+    md.ts.fp = eti_frames % 8;
+    md.ts.received = frame_timestamp::system_time();
+    if (m_timestamps) {
+        md.ts.ticks = due_ticks +
+            frame_timestamp::seconds_to_ticks(m_tist_offset_s);
+        md.ts.timestamp_valid = true;
+        md.ts.timestamp_offset = m_tist_offset_s;
+    }
+
+    output.process(&m_frame);
+    if (auto mod_meta = dynamic_cast<ModMetadata*>(&output)) {
+        mod_meta->process_metadata({md});
+    }
+
+    m_next_frame++;
+    m_frames_played++;
+    return true;
+}
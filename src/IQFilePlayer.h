@@ -0,0 +1,90 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   Plays a file of I/Q samples onto the output, without modulator.
+*/
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "ConfigParser.h"
+#include "ModPlugin.h"
+
+/* The file, for instance written by the offline rendering, contains the
+ * samples at the output rate and in the sample format of the output,
+ * without any header. It is memory-mapped and cut into transmission
+ * frames, which are given to the output one by one at the pace of the
+ * system clock, as if they came from the modulator.
+ *
+ * With synchronous transmission, the frames get synthetic timestamps:
+ * the first one is transmitted at the first whole second after the
+ * start plus the configured offset, the following ones one transmission
+ * frame later each. Otherwise the timestamps are invalid. The FCT and FP
+ * count the ETI frames that the transmission frames would contain.
+ */
+class IQFilePlayer
+{
+    public:
+        // sampleSize is the size in bytes of one complex sample
+        IQFilePlayer(const mod_settings_t& mod_settings, size_t sampleSize);
+        IQFilePlayer(const IQFilePlayer& other) = delete;
+        IQFilePlayer& operator=(const IQFilePlayer& other) = delete;
+        ~IQFilePlayer();
+
+        std::string get_info() const;
+
+        /* Wait until the next frame is due, and give it with its metadata
+         * to the output. Returns false once the end of the file is
+         * reached, if it is not looped. */
+        bool play_next(ModOutput& output);
+
+    private:
+        const std::string m_filename;
+        const bool m_loop;
+        const bool m_timestamps;
+        const double m_tist_offset_s;
+
+        uint8_t *m_data = nullptr;
+        size_t m_length = 0;
+
+        size_t m_frame_bytes = 0;
+        size_t m_num_frames = 0;
+        size_t m_next_frame = 0;
+        unsigned m_eti_frames_per_frame = 1;
+
+        // Number of frames played, and the system time at which the first
+        // one was due, in timestamp ticks
+        uint64_t m_frames_played = 0;
+        int64_t m_start_ticks = 0;
+        int64_t m_frame_ticks = 0;
+
+        // Given to the output, which may take it
+        Buffer m_frame;
+};
@@ -0,0 +1,867 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   ETI file input from zstd or gzip compressed files, decompressed ahead in
+   a thread
+*/
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "InputReader.h"
+#include "PcDebug.h"
+#include "Utils.h"
+
+#if defined(HAVE_ZSTD)
+#   include <zstd.h>
+#endif
+#if defined(HAVE_ZLIB)
+#   include <zlib.h>
+#endif
+
+using namespace std;
+
+static constexpr size_t ETI_FRAME_SIZE = 6144;
+
+// The read-ahead is NUM_BLOCKS blocks of decompressed data, about 340
+// frames, and the file is read in chunks of COMPRESSED_CHUNK.
+static constexpr size_t BLOCK_SIZE = 256 * 1024;
+static constexpr size_t NUM_BLOCKS = 8;
+static constexpr size_t COMPRESSED_CHUNK = 128 * 1024;
+
+static constexpr uint16_t index_version = 1;
+static constexpr size_t index_header_size = 32;
+static constexpr size_t index_entry_size = 32;
+
+static bool is_sync(const uint8_t *p)
+{
+    // ERR byte followed by one of the two FSYNC values
+    return p[0] == 0xff and (
+            (p[1] == 0x07 and p[2] == 0x3a and p[3] == 0xb6) or
+            (p[1] == 0xf8 and p[2] == 0xc5 and p[3] == 0x49));
+}
+
+static bool is_zstd(const uint8_t *p)
+{
+    return p[0] == 0x28 and p[1] == 0xb5 and p[2] == 0x2f and p[3] == 0xfd;
+}
+
+static bool is_gzip(const uint8_t *p)
+{
+    return p[0] == 0x1f and p[1] == 0x8b;
+}
+
+static void append_le(vector<uint8_t>& buf, uint64_t value, size_t num_bytes)
+{
+    for (size_t i = 0; i < num_bytes; i++) {
+        buf.push_back((value >> (8 * i)) & 0xFF);
+    }
+}
+
+static uint64_t read_le(const uint8_t *p, size_t num_bytes)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < num_bytes; i++) {
+        value |= (uint64_t)p[i] << (8 * i);
+    }
+    return value;
+}
+
+namespace {
+
+class Decompressor
+{
+    public:
+        virtual ~Decompressor() = default;
+
+        /* Decompress from in into out, and count the bytes used of both.
+         * Stops and returns true at the end of a compressed frame. */
+        virtual bool decompress(
+                const uint8_t *in, size_t in_len, size_t& in_used,
+                uint8_t *out, size_t out_len, size_t& out_used) = 0;
+};
+
+#if defined(HAVE_ZSTD)
+class ZstdDecompressor : public Decompressor
+{
+    public:
+        ZstdDecompressor() {
+            m_ctx = ZSTD_createDStream();
+            if (m_ctx == nullptr) {
+                throw runtime_error("cannot create the zstd context");
+            }
+            ZSTD_initDStream(m_ctx);
+        }
+
+        ~ZstdDecompressor() {
+            ZSTD_freeDStream(m_ctx);
+        }
+
+        virtual bool decompress(
+                const uint8_t *in, size_t in_len, size_t& in_used,
+                uint8_t *out, size_t out_len, size_t& out_used) override {
+            ZSTD_inBuffer input = { in, in_len, 0 };
+            ZSTD_outBuffer output = { out, out_len, 0 };
+            const size_t ret = ZSTD_decompressStream(m_ctx, &output, &input);
+            if (ZSTD_isError(ret)) {
+                throw runtime_error(string("zstd: ") + ZSTD_getErrorName(ret));
+            }
+            in_used = input.pos;
+            out_used = output.pos;
+
+            // 0 once the frame is decoded and flushed
+            return ret == 0;
+        }
+
+    private:
+        ZSTD_DStream *m_ctx = nullptr;
+};
+#endif
+
+#if defined(HAVE_ZLIB)
+class GzipDecompressor : public Decompressor
+{
+    public:
+        GzipDecompressor() {
+            memset(&m_strm, 0, sizeof(m_strm));
+            // Only accept the gzip header
+            if (inflateInit2(&m_strm, 16 + MAX_WBITS) != Z_OK) {
+                throw runtime_error("cannot create the zlib context");
+            }
+        }
+
+        ~GzipDecompressor() {
+            inflateEnd(&m_strm);
+        }
+
+        virtual bool decompress(
+                const uint8_t *in, size_t in_len, size_t& in_used,
+                uint8_t *out, size_t out_len, size_t& out_used) override {
+            m_strm.next_in = const_cast<Bytef*>(in);
+            m_strm.avail_in = in_len;
+            m_strm.next_out = out;
+            m_strm.avail_out = out_len;
+
+            const int ret = inflate(&m_strm, Z_NO_FLUSH);
+            in_used = in_len - m_strm.avail_in;
+            out_used = out_len - m_strm.avail_out;
+
+            if (ret == Z_STREAM_END) {
+                // The next member can follow
+                inflateReset(&m_strm);
+                return true;
+            }
+            else if (ret != Z_OK and ret != Z_BUF_ERROR) {
+                throw runtime_error(string("gzip: ") +
+                        (m_strm.msg ? m_strm.msg : "invalid data"));
+            }
+            return false;
+        }
+
+    private:
+        z_stream m_strm;
+};
+#endif
+
+} // namespace
+
+bool InputCompressedReader::IsCompressed(const string& filename)
+{
+    FILE* fd = fopen(filename.c_str(), "r");
+    if (fd == nullptr) {
+        return false;
+    }
+
+    uint8_t magic[4];
+    const bool ok = fread(magic, sizeof(magic), 1, fd) == 1;
+    fclose(fd);
+    return ok and (is_zstd(magic) or is_gzip(magic));
+}
+
+InputCompressedReader::InputCompressedReader() :
+    m_blocks(NUM_BLOCKS + 1),
+    m_free_blocks(NUM_BLOCKS + 1)
+{
+    for (size_t i = 0; i < NUM_BLOCKS; i++) {
+        block_t block;
+        block.data.resize(BLOCK_SIZE);
+        m_free_blocks.push(std::move(block));
+    }
+}
+
+InputCompressedReader::~InputCompressedReader()
+{
+    Stop();
+    if (m_fd != -1) {
+        close(m_fd);
+    }
+}
+
+int InputCompressedReader::Open(const string& filename, bool loop, bool use_index)
+{
+    Stop();
+    if (m_fd != -1) {
+        close(m_fd);
+        m_fd = -1;
+    }
+
+    m_filename = filename;
+    m_loop = loop;
+    m_use_index = use_index;
+    m_num_frames = 0;
+    m_held_frame.clear();
+    m_index.clear();
+    m_index_complete = false;
+    m_index_building = false;
+
+    m_fd = open(m_filename.c_str(), O_RDONLY);
+    if (m_fd == -1) {
+        etiLog.level(error) << "Unable to open input file!";
+        perror(m_filename.c_str());
+        return -1;
+    }
+
+    struct stat inputFileStat;
+    if (fstat(m_fd, &inputFileStat) == -1) {
+        etiLog.level(error) << "Unable to stat input file " << m_filename <<
+            ": " << strerror(errno);
+        return -1;
+    }
+    m_length = inputFileStat.st_size;
+
+    uint8_t magic[4];
+    if (pread(m_fd, magic, sizeof(magic), 0) != sizeof(magic)) {
+        etiLog.level(error) << "Input file " << m_filename << " is too short";
+        return -1;
+    }
+
+    if (is_zstd(magic)) {
+#if defined(HAVE_ZSTD)
+        m_codec = codec_e::zstd;
+#else
+        etiLog.level(error) << "Input file " << m_filename <<
+            " is zstd compressed, but zstd support is not compiled in";
+        return -1;
+#endif
+    }
+    else if (is_gzip(magic)) {
+#if defined(HAVE_ZLIB)
+        m_codec = codec_e::gzip;
+#else
+        etiLog.level(error) << "Input file " << m_filename <<
+            " is gzip compressed, but zlib support is not compiled in";
+        return -1;
+#endif
+    }
+    else {
+        etiLog.level(error) << "Input file " << m_filename <<
+            " is neither zstd nor gzip compressed";
+        return -1;
+    }
+
+    posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    if (m_use_index) {
+        m_index_complete = LoadIndex();
+    }
+
+    try {
+        if (IdentifyType() == -1) {
+            Stop();
+            return -1;
+        }
+    }
+    catch (const runtime_error& e) {
+        etiLog.level(error) << e.what();
+        Stop();
+        return -1;
+    }
+
+    return 0;
+}
+
+int InputCompressedReader::IdentifyType()
+{
+    Start(0, 0);
+
+    // Same identification as the InputMmapReader, on the beginning of
+    // the decompressed file
+    vector<uint8_t> head(ETI_FRAME_SIZE + 10);
+    const size_t len = Read(head.data(), head.size());
+    if (len < 6) {
+        etiLog.level(error) << "Input file " << m_filename << " is too short";
+        return -1;
+    }
+
+    size_t pos = 0;
+    m_raw = false;
+    if (is_sync(head.data())) {
+        m_format = "raw";
+        m_raw = true;
+    }
+    else if (is_sync(head.data() + 2)) {
+        m_format = "streamed";
+    }
+    else if (len >= 10 and is_sync(head.data() + 6)) {
+        m_format = "framed";
+        pos = 4;
+    }
+    else {
+        // Search for the sync marker byte by byte
+        for (size_t i = 0; i + 4 <= len; i++) {
+            if (is_sync(head.data() + i)) {
+                m_format = "raw";
+                m_raw = true;
+                pos = i;
+                break;
+            }
+        }
+
+        if (not m_raw) {
+            etiLog.level(error) << "Bad input file format!";
+            return -1;
+        }
+    }
+
+    // Decompressing the head again is cheaper than keeping it around
+    m_first_skip = pos;
+    Rewind();
+    return 0;
+}
+
+void InputCompressedReader::Start(uint64_t offset, uint64_t skip)
+{
+    Stop();
+    m_start_offset = offset;
+    m_start_skip = skip;
+    m_running = true;
+    m_thread = std::thread(&InputCompressedReader::Decompress, this);
+}
+
+void InputCompressedReader::Stop()
+{
+    if (not m_thread.joinable()) {
+        return;
+    }
+
+    m_running = false;
+
+    // The last block of the thread is marked as the end
+    auto give_back = [this](block_t& block) {
+        block.end = false;
+        block.error.clear();
+        m_free_blocks.push(std::move(block));
+    };
+
+    // The thread only waits when we hold all blocks. Give them back
+    // for it to see that it has to stop.
+    if (m_has_block) {
+        give_back(m_block);
+        m_has_block = false;
+    }
+    block_t block;
+    while (m_blocks.try_pop(block)) {
+        give_back(block);
+    }
+
+    m_thread.join();
+
+    while (m_blocks.try_pop(block)) {
+        give_back(block);
+    }
+    m_block_pos = 0;
+}
+
+void InputCompressedReader::Decompress()
+{
+    set_thread_name("decompress");
+
+    // Never woken up, Stop() gives the blocks back instead
+    block_t block;
+    m_free_blocks.wait_and_pop(block);
+    block.len = 0;
+    block.frame_offset = m_start_offset;
+    block.frame_pos = 0;
+
+    string error;
+    try {
+        unique_ptr<Decompressor> decompressor;
+        switch (m_codec) {
+            case codec_e::zstd:
+#if defined(HAVE_ZSTD)
+                decompressor = make_unique<ZstdDecompressor>();
+#endif
+                break;
+            case codec_e::gzip:
+#if defined(HAVE_ZLIB)
+                decompressor = make_unique<GzipDecompressor>();
+#endif
+                break;
+        }
+        if (not decompressor) {
+            throw logic_error("codec not compiled in");
+        }
+
+        vector<uint8_t> in(COMPRESSED_CHUNK);
+        size_t in_len = 0;
+        size_t in_pos = 0;
+        uint64_t read_offset = m_start_offset;
+        uint64_t skip = m_start_skip;
+        bool in_frame = false;
+        bool eof = false;
+
+        while (m_running) {
+            if (block.len == block.data.size()) {
+                const uint64_t frame_pos = block.frame_pos + block.len;
+                const uint64_t frame_offset = block.frame_offset;
+                m_blocks.push(std::move(block));
+                m_free_blocks.wait_and_pop(block);
+                block.len = 0;
+                block.frame_offset = frame_offset;
+                block.frame_pos = frame_pos;
+                continue;
+            }
+
+            size_t in_used = 0;
+            size_t out_used = 0;
+            const bool frame_end = decompressor->decompress(
+                    in.data() + in_pos, in_len - in_pos, in_used,
+                    block.data.data() + block.len,
+                    block.data.size() - block.len, out_used);
+            in_pos += in_used;
+            block.len += out_used;
+            if (in_used > 0) {
+                in_frame = true;
+            }
+
+            if (skip > 0 and block.len > 0) {
+                const size_t drop = std::min<uint64_t>(skip, block.len);
+                memmove(block.data.data(), block.data.data() + drop,
+                        block.len - drop);
+                block.len -= drop;
+                block.frame_pos += drop;
+                skip -= drop;
+            }
+
+            if (frame_end) {
+                // The next compressed frame starts at the first unused byte
+                const uint64_t frame_offset = read_offset - (in_len - in_pos);
+                in_frame = false;
+                if (block.len > 0) {
+                    m_blocks.push(std::move(block));
+                    m_free_blocks.wait_and_pop(block);
+                    block.len = 0;
+                }
+                block.frame_offset = frame_offset;
+                block.frame_pos = 0;
+                continue;
+            }
+
+            if (in_used == 0 and out_used == 0) {
+                // Needs more input
+                if (eof) {
+                    if (in_frame or in_pos != in_len) {
+                        throw runtime_error("the file is truncated");
+                    }
+                    break;
+                }
+
+                memmove(in.data(), in.data() + in_pos, in_len - in_pos);
+                in_len -= in_pos;
+                in_pos = 0;
+                const ssize_t r = pread(m_fd, in.data() + in_len,
+                        in.size() - in_len, read_offset);
+                if (r < 0) {
+                    throw runtime_error(string("read error: ") + strerror(errno));
+                }
+                else if (r == 0) {
+                    eof = true;
+                }
+                in_len += r;
+                read_offset += r;
+            }
+        }
+    }
+    catch (const exception& e) {
+        error = e.what();
+    }
+
+    if (m_running and block.len > 0) {
+        m_blocks.push(std::move(block));
+        m_free_blocks.wait_and_pop(block);
+        block.len = 0;
+    }
+
+    // Always ends with one last block, which Stop() also takes back
+    block.end = true;
+    block.error = error;
+    m_blocks.push(std::move(block));
+}
+
+bool InputCompressedReader::FillBlock()
+{
+    while (not m_has_block or m_block_pos == m_block.len) {
+        if (m_has_block) {
+            if (m_block.end) {
+                if (not m_block.error.empty()) {
+                    throw runtime_error("Unable to decompress " + m_filename +
+                            ": " + m_block.error);
+                }
+                return false;
+            }
+            m_free_blocks.push(std::move(m_block));
+            m_has_block = false;
+        }
+
+        m_blocks.wait_and_pop(m_block);
+        m_has_block = true;
+        m_block_pos = 0;
+    }
+    return true;
+}
+
+size_t InputCompressedReader::Read(uint8_t *buffer, size_t len)
+{
+    size_t done = 0;
+    while (done < len and FillBlock()) {
+        const size_t n = std::min(len - done, m_block.len - m_block_pos);
+        memcpy(buffer + done, m_block.data.data() + m_block_pos, n);
+        m_block_pos += n;
+        done += n;
+    }
+    return done;
+}
+
+int InputCompressedReader::ReadFrame(uint8_t *buffer)
+{
+    if (not FillBlock()) {
+        return 0;
+    }
+
+    // Where the decompression can start to get this frame
+    const uint64_t offset = m_block.frame_offset;
+    const uint64_t pos = m_block.frame_pos + m_block_pos;
+
+    uint16_t frameSize = ETI_FRAME_SIZE;
+    if (not m_raw) {
+        uint8_t size_le[2];
+        if (Read(size_le, sizeof(size_le)) != sizeof(size_le)) {
+            etiLog.level(error) << "Unable to read the frame size from input file!";
+            return -1;
+        }
+        frameSize = read_le(size_le, 2);
+        if (frameSize > ETI_FRAME_SIZE) {
+            etiLog.level(error) << "Wrong frame size " << frameSize << " in ETI file!";
+            return -1;
+        }
+    }
+
+    // A short read of a frame is not tolerated, like in the InputFileReader
+    if (Read(buffer, frameSize) != frameSize) {
+        etiLog.level(error) <<
+            "Unable to read a complete frame of " << frameSize <<
+            " data bytes from input file!";
+        return -1;
+    }
+    memset(buffer + frameSize, 0x55, ETI_FRAME_SIZE - frameSize);
+
+    if (m_index_building and
+            (m_index.empty() or m_index.back().offset != offset)) {
+        const uint32_t fct = frameSize > 4 ? buffer[4] : 0;
+        m_index.push_back({m_next_frame, fct, offset, pos});
+    }
+
+    m_next_frame++;
+    return ETI_FRAME_SIZE;
+}
+
+void InputCompressedReader::ReachedEnd()
+{
+    m_num_frames = m_next_frame;
+
+    if (m_index_building) {
+        m_index_building = false;
+        m_index_complete = true;
+        WriteIndex();
+    }
+}
+
+void InputCompressedReader::Rewind()
+{
+    Start(0, m_first_skip);
+    m_next_frame = 0;
+    m_held_frame.clear();
+
+    // The index can only be built in one pass from the start
+    if (m_use_index and not m_index_complete) {
+        m_index.clear();
+        m_index_building = true;
+    }
+}
+
+int InputCompressedReader::NextFrame(uint8_t *buffer)
+{
+    int ret = ReadFrame(buffer);
+    if (ret == 0) {
+        ReachedEnd();
+        if (m_loop) {
+            Rewind();
+            ret = ReadFrame(buffer);
+        }
+    }
+    return ret;
+}
+
+int InputCompressedReader::GetNextFrame(void* buffer)
+{
+    uint8_t *frame = reinterpret_cast<uint8_t*>(buffer);
+
+    if (not m_held_frame.empty()) {
+        memcpy(frame, m_held_frame.data(), ETI_FRAME_SIZE);
+        m_held_frame.clear();
+        return ETI_FRAME_SIZE;
+    }
+
+    try {
+        return NextFrame(frame);
+    }
+    catch (const runtime_error& e) {
+        etiLog.level(error) << e.what();
+        return -1;
+    }
+}
+
+bool InputCompressedReader::Seek(size_t frame)
+{
+    if (m_num_frames > 0 and frame >= m_num_frames) {
+        return false;
+    }
+
+    if (not m_held_frame.empty()) {
+        if (m_next_frame == frame + 1) {
+            return true;
+        }
+        m_held_frame.clear();
+    }
+
+    // The last entry before the frame, if it is ahead of the current
+    // position. Otherwise, reading on is faster.
+    const auto next = upper_bound(m_index.begin(), m_index.end(), frame,
+            [](uint64_t f, const index_entry_t& e) { return f < e.frame; });
+    const index_entry_t *entry =
+        next == m_index.begin() ? nullptr : &*std::prev(next);
+
+    if (frame < m_next_frame or (entry and entry->frame > m_next_frame)) {
+        // The index is built from consecutive frames only
+        m_index_building = false;
+        if (entry) {
+            Start(entry->offset, entry->skip);
+            m_next_frame = entry->frame;
+        }
+        else {
+            Start(0, m_first_skip);
+            m_next_frame = 0;
+        }
+    }
+
+    vector<uint8_t> discard(ETI_FRAME_SIZE);
+    try {
+        while (m_next_frame < frame) {
+            const int ret = ReadFrame(discard.data());
+            if (ret == 0) {
+                ReachedEnd();
+            }
+            if (ret <= 0) {
+                Rewind();
+                return false;
+            }
+        }
+    }
+    catch (const runtime_error& e) {
+        etiLog.level(error) << e.what();
+        Rewind();
+        return false;
+    }
+
+    return true;
+}
+
+bool InputCompressedReader::SeekToFct(unsigned fct)
+{
+    if (fct >= 250) {
+        return false;
+    }
+
+    const uint64_t current = m_next_frame - (m_held_frame.empty() ? 0 : 1);
+
+    // Assuming the FCT increments from the entry on, as it does in a
+    // recording of a multiplex, the frame can be found right away.
+    const auto next = upper_bound(m_index.begin(), m_index.end(), current,
+            [](uint64_t f, const index_entry_t& e) { return f < e.frame; });
+    if (next != m_index.begin()) {
+        const auto& entry = *std::prev(next);
+        uint64_t target = entry.frame + (fct + 250 - entry.fct) % 250;
+        while (target < current) {
+            target += 250;
+        }
+        if ((m_num_frames == 0 or target < m_num_frames) and target != current) {
+            Seek(target);
+        }
+    }
+
+    try {
+        for (size_t i = 0; i <= 250; i++) {
+            if (m_held_frame.empty()) {
+                m_held_frame.resize(ETI_FRAME_SIZE);
+                if (NextFrame(m_held_frame.data()) <= 0) {
+                    m_held_frame.clear();
+                    return false;
+                }
+            }
+
+            if (m_held_frame[4] == fct) {
+                return true;
+            }
+            m_held_frame.clear();
+        }
+    }
+    catch (const runtime_error& e) {
+        etiLog.level(error) << e.what();
+        m_held_frame.clear();
+    }
+    return false;
+}
+
+bool InputCompressedReader::LoadIndex()
+{
+    const string index_filename = m_filename + ".idx";
+    FILE* fd = fopen(index_filename.c_str(), "r");
+    if (fd == nullptr) {
+        etiLog.level(info) << "No index for input file " << m_filename <<
+            ", it will be written after the first pass";
+        return false;
+    }
+
+    vector<uint8_t> header(index_header_size);
+    bool valid = fread(header.data(), header.size(), 1, fd) == 1 and
+        memcmp(header.data(), "ODRETIIX", 8) == 0 and
+        read_le(&header[8], 2) == index_version and
+        header[10] == (uint8_t)m_codec and
+        read_le(&header[16], 8) == m_length;
+    const uint64_t num_frames = valid ? read_le(&header[24], 8) : 0;
+
+    vector<uint8_t> entry(index_entry_size);
+    while (valid and fread(entry.data(), entry.size(), 1, fd) == 1) {
+        index_entry_t e;
+        e.frame = read_le(&entry[0], 8);
+        e.offset = read_le(&entry[8], 8);
+        e.skip = read_le(&entry[16], 8);
+        e.fct = read_le(&entry[24], 4);
+        if (e.offset >= m_length or e.frame >= num_frames or
+                (not m_index.empty() and e.frame <= m_index.back().frame)) {
+            valid = false;
+        }
+        m_index.push_back(e);
+    }
+    fclose(fd);
+
+    if (not valid or m_index.empty()) {
+        etiLog.level(warn) << "Ignoring index " << index_filename <<
+            ", it does not match the input file";
+        m_index.clear();
+        return false;
+    }
+
+    m_num_frames = num_frames;
+    return true;
+}
+
+void InputCompressedReader::WriteIndex()
+{
+    vector<uint8_t> data;
+    data.reserve(index_header_size + m_index.size() * index_entry_size);
+    const char magic[] = "ODRETIIX";
+    data.insert(data.end(), magic, magic + 8);
+    append_le(data, index_version, 2);
+    data.push_back((uint8_t)m_codec);
+    data.resize(index_header_size - 16, 0);
+    append_le(data, m_length, 8);
+    append_le(data, m_num_frames, 8);
+
+    for (const auto& e : m_index) {
+        append_le(data, e.frame, 8);
+        append_le(data, e.offset, 8);
+        append_le(data, e.skip, 8);
+        append_le(data, e.fct, 4);
+        data.resize(data.size() + 4, 0);
+    }
+
+    // Write it completely before it replaces an index that did not match
+    const string index_filename = m_filename + ".idx";
+    const string tmp_filename = index_filename + ".tmp";
+    FILE* fd = fopen(tmp_filename.c_str(), "w");
+    bool ok = fd != nullptr;
+    if (ok) {
+        ok = fwrite(data.data(), data.size(), 1, fd) == 1;
+        ok = (fclose(fd) == 0) and ok;
+    }
+    if (ok) {
+        ok = rename(tmp_filename.c_str(), index_filename.c_str()) == 0;
+    }
+
+    if (ok) {
+        etiLog.level(info) << "Wrote index " << index_filename << " with " <<
+            m_index.size() << " entries for " << m_num_frames << " frames";
+    }
+    else {
+        etiLog.level(warn) << "Unable to write index " << index_filename <<
+            ": " << strerror(errno);
+        unlink(tmp_filename.c_str());
+    }
+}
+
+string InputCompressedReader::GetPrintableInfo() const
+{
+    string info = "Input file format: " + m_format + " (" +
+        (m_codec == codec_e::zstd ? "zstd" : "gzip") +
+        " compressed), length: " + to_string(m_length);
+    if (m_num_frames > 0) {
+        info += ", nb frames: " + to_string(m_num_frames);
+    }
+    else {
+        info += ", nb frames: unknown";
+    }
+    if (m_index_complete) {
+        info += ", index of " + to_string(m_index.size()) + " entries";
+    }
+    return info;
+}
@@ -0,0 +1,271 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   Memory-mapped ETI file input
+*/
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <string>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "InputReader.h"
+#include "PcDebug.h"
+
+static constexpr size_t ETI_FRAME_SIZE = 6144;
+
+static uint16_t read_u16le(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static bool is_sync(const uint8_t *p)
+{
+    // ERR byte followed by one of the two FSYNC values
+    return p[0] == 0xff and (
+            (p[1] == 0x07 and p[2] == 0x3a and p[3] == 0xb6) or
+            (p[1] == 0xf8 and p[2] == 0xc5 and p[3] == 0x49));
+}
+
+InputMmapReader::~InputMmapReader()
+{
+    Unmap();
+}
+
+void InputMmapReader::Unmap()
+{
+    if (m_data) {
+        munmap(m_data, m_length);
+        m_data = nullptr;
+    }
+    m_length = 0;
+    m_frames.clear();
+    m_next_frame = 0;
+}
+
+int InputMmapReader::Open(const std::string& filename, bool loop)
+{
+    Unmap();
+    m_filename = filename;
+    m_loop = loop;
+
+    int fd = open(m_filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+        etiLog.level(error) << "Unable to open input file!";
+        perror(m_filename.c_str());
+        return -1;
+    }
+
+    struct stat inputFileStat;
+    if (fstat(fd, &inputFileStat) == -1 or not S_ISREG(inputFileStat.st_mode)) {
+        etiLog.level(error) << "Input file " << m_filename <<
+            " is not a regular file, it cannot be memory-mapped";
+        close(fd);
+        return -1;
+    }
+
+    m_length = inputFileStat.st_size;
+    if (m_length < 6) {
+        etiLog.level(error) << "Input file " << m_filename << " is too short";
+        close(fd);
+        m_length = 0;
+        return -1;
+    }
+
+    void *data = mmap(nullptr, m_length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        etiLog.level(error) << "Unable to map input file " << m_filename <<
+            ": " << strerror(errno);
+        m_length = 0;
+        return -1;
+    }
+    m_data = reinterpret_cast<uint8_t*>(data);
+    madvise(m_data, m_length, MADV_SEQUENTIAL);
+
+    if (IndexFrames() == -1) {
+        Unmap();
+        return -1;
+    }
+    return 0;
+}
+
+int InputMmapReader::IndexFrames()
+{
+    // Same identification as the InputFileReader
+    size_t pos = 0;
+    bool raw = false;
+    if (is_sync(m_data)) {
+        m_format = "raw";
+        raw = true;
+    }
+    else if (is_sync(m_data + 2)) {
+        m_format = "streamed";
+    }
+    else if (m_length >= 10 and is_sync(m_data + 6)) {
+        m_format = "framed";
+        pos = 4;
+    }
+    else {
+        // Search for the sync marker byte by byte
+        for (size_t i = 0; i + 4 <= m_length and i < ETI_FRAME_SIZE + 10; i++) {
+            if (is_sync(m_data + i)) {
+                m_format = "raw";
+                raw = true;
+                pos = i;
+                break;
+            }
+        }
+
+        if (not raw) {
+            etiLog.level(error) << "Bad input file format!";
+            return -1;
+        }
+    }
+
+    if (raw) {
+        const size_t num_frames = (m_length - pos) / ETI_FRAME_SIZE;
+        m_frames.reserve(num_frames);
+        for (size_t i = 0; i < num_frames; i++) {
+            m_frames.push_back({pos + i * ETI_FRAME_SIZE, ETI_FRAME_SIZE});
+        }
+        pos += num_frames * ETI_FRAME_SIZE;
+    }
+    else {
+        while (pos + 2 <= m_length) {
+            const uint16_t frameSize = read_u16le(m_data + pos);
+            if (frameSize > ETI_FRAME_SIZE) {
+                etiLog.level(error) << "Wrong frame size " << frameSize <<
+                    " in ETI file at offset " << pos << "!";
+                return -1;
+            }
+
+            if (pos + 2 + frameSize > m_length) {
+                break;
+            }
+
+            // Empty frames carry nothing for the modulator
+            if (frameSize > 0) {
+                m_frames.push_back({pos + 2, frameSize});
+            }
+            pos += 2 + frameSize;
+        }
+    }
+
+    if (pos != m_length) {
+        // Input files must not contain incomplete frames
+        etiLog.level(warn) << "Ignoring the incomplete frame at the end of " <<
+            m_filename;
+    }
+
+    if (m_frames.empty()) {
+        etiLog.level(error) << "No complete frame in input file!";
+        return -1;
+    }
+
+    return 0;
+}
+
+std::string InputMmapReader::GetPrintableInfo() const
+{
+    return "Input file format: " + m_format + " (memory-mapped), length: " +
+        std::to_string(m_length) + ", nb frames: " +
+        std::to_string(m_frames.size());
+}
+
+int InputMmapReader::GetNextFramePointer(const uint8_t **frame)
+{
+    if (m_next_frame == m_frames.size()) {
+        if (not m_loop) {
+            return 0;
+        }
+        m_next_frame = 0;
+    }
+
+    *frame = GetFrame(m_next_frame++, m_padded_frame);
+    return ETI_FRAME_SIZE;
+}
+
+const uint8_t* InputMmapReader::GetFrame(size_t frame, uint8_t *padded_frame) const
+{
+    const auto& f = m_frames.at(frame);
+    if (f.size == ETI_FRAME_SIZE) {
+        return m_data + f.offset;
+    }
+
+    memcpy(padded_frame, m_data + f.offset, f.size);
+    memset(padded_frame + f.size, 0x55, ETI_FRAME_SIZE - f.size);
+    return padded_frame;
+}
+
+void InputMmapReader::GetFrameCounters(size_t frame, unsigned& fct, unsigned& fp) const
+{
+    const auto& f = m_frames.at(frame);
+
+    // The FC follows ERR and FSYNC: FCT, FICF and NST, then FP in the
+    // three most significant bits.
+    fct = f.size > 4 ? m_data[f.offset + 4] : 0;
+    fp = f.size > 6 ? (m_data[f.offset + 6] >> 5) : 0;
+}
+
+int InputMmapReader::GetNextFrame(void* buffer)
+{
+    const uint8_t *frame = nullptr;
+    const int ret = GetNextFramePointer(&frame);
+    if (ret > 0) {
+        memcpy(buffer, frame, ret);
+    }
+    return ret;
+}
+
+bool InputMmapReader::Seek(size_t frame)
+{
+    if (frame >= m_frames.size()) {
+        return false;
+    }
+    m_next_frame = frame;
+    return true;
+}
+
+bool InputMmapReader::SeekToFct(unsigned fct)
+{
+    for (size_t i = 0; i < m_frames.size(); i++) {
+        const size_t index = (m_next_frame + i) % m_frames.size();
+        unsigned frame_fct = 0;
+        unsigned frame_fp = 0;
+        GetFrameCounters(index, frame_fct, frame_fp);
+        if (m_frames[index].size > 4 and frame_fct == fct) {
+            m_next_frame = index;
+            return true;
+        }
+    }
+    return false;
+}
+
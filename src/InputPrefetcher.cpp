@@ -0,0 +1,242 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+*/
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "InputPrefetcher.h"
+#include "Log.h"
+#include "Utils.h"
+#include <stdexcept>
+
+using namespace std;
+
+InputPrefetcher::InputPrefetcher(
+        shared_ptr<InputReader> inputReader, size_t depth) :
+    m_inputReader(inputReader),
+    m_wait_when_full(
+            dynamic_pointer_cast<InputFileReader>(inputReader) != nullptr or
+            dynamic_pointer_cast<InputMmapReader>(inputReader) != nullptr or
+            dynamic_pointer_cast<InputCompressedReader>(inputReader) != nullptr),
+    m_frames(depth + 1),
+    m_free_frames(depth + 1)
+{
+    allocate_frames(depth, true);
+    add_metrics();
+    m_running = true;
+    m_thread = std::thread(&InputPrefetcher::process_eti, this);
+}
+
+InputPrefetcher::InputPrefetcher(
+        shared_ptr<EdiInput> ediInput, size_t depth) :
+    m_ediInput(ediInput),
+    m_frames(depth + 1),
+    m_free_frames(depth + 1)
+{
+    allocate_frames(depth, false);
+    add_metrics();
+    m_running = true;
+    m_thread = std::thread(&InputPrefetcher::process_edi, this);
+}
+
+InputPrefetcher::~InputPrefetcher()
+{
+    m_running = false;
+    m_free_frames.trigger_wakeup();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+void InputPrefetcher::add_metrics()
+{
+    m_metrics.add_counter("odr_input_prefetcher_overflows_total",
+            "Number of input frames dropped because the prefetch queue was full",
+            [this]() { return m_num_overflows.load(); });
+    m_metrics.add_counter("odr_input_prefetcher_underflows_total",
+            "Number of times the prefetch queue was empty on a frame request",
+            [this]() { return m_num_underflows.load(); });
+}
+
+void InputPrefetcher::allocate_frames(size_t depth, bool eti)
+{
+    if (depth == 0) {
+        throw std::invalid_argument("InputPrefetcher depth must be at least 1");
+    }
+
+    // One more than the depth, for the frame the thread is filling
+    for (size_t i = 0; i < depth + 1; i++) {
+        frame_t frame;
+        if (eti) {
+            frame.eti.setLength(6144);
+        }
+        m_free_frames.push(std::move(frame));
+    }
+}
+
+void InputPrefetcher::get_frame(frame_t& frame)
+{
+    if (not m_frames.try_pop(frame)) {
+        m_waiting = true;
+        m_frames.wait_and_pop(frame);
+    }
+
+    if (m_waiting and m_first_frame_received) {
+        m_num_underflows++;
+    }
+    m_waiting = false;
+
+    if (frame.status == frame_t::status_e::Data) {
+        m_first_frame_received = true;
+    }
+}
+
+void InputPrefetcher::release_frame(frame_t&& frame)
+{
+    m_free_frames.push(std::move(frame));
+}
+
+bool InputPrefetcher::get_free_frame(frame_t& frame)
+{
+    if (m_free_frames.try_pop(frame)) {
+        return true;
+    }
+
+    if (m_wait_when_full) {
+        m_free_frames.wait_and_pop(frame);
+        return true;
+    }
+
+    // All other frames are waiting in the queue, the modulator is late.
+    if (m_frames.try_pop(frame)) {
+        m_num_overflows++;
+        return true;
+    }
+
+    // The modulator is about to give one back
+    std::this_thread::yield();
+    return false;
+}
+
+void InputPrefetcher::push_frame(frame_t&& frame)
+{
+    frame.received = chrono::steady_clock::now();
+    m_frames.push(std::move(frame));
+}
+
+void InputPrefetcher::process_eti()
+{
+    set_thread_name("input");
+    set_thread_placement("input");
+
+    const bool is_file = m_wait_when_full;
+
+    while (m_running) {
+        frame_t frame;
+        try {
+            if (not get_free_frame(frame)) {
+                continue;
+            }
+        }
+        catch (const ThreadsafeQueueWakeup&) {
+            break;
+        }
+
+        frame.status = frame_t::status_e::Data;
+        frame.error.clear();
+
+        int framesize = 0;
+        try {
+            framesize = m_inputReader->GetNextFrame(frame.eti.getData());
+        }
+        catch (const std::exception& e) {
+            frame.status = frame_t::status_e::Error;
+            frame.error = e.what();
+            push_frame(std::move(frame));
+            break;
+        }
+
+        if (framesize == 0 and is_file) {
+            frame.status = frame_t::status_e::EndOfInput;
+            push_frame(std::move(frame));
+            break;
+        }
+        else if (framesize == 0) {
+            /* An empty frame marks a timeout of the TCP input. Let the
+             * modulator check if it must stop. */
+            m_free_frames.push(std::move(frame));
+            m_frames.trigger_wakeup();
+        }
+        else if (framesize < 0) {
+            frame.status = frame_t::status_e::Error;
+            frame.error = "Input read error.";
+            push_frame(std::move(frame));
+            break;
+        }
+        else {
+            push_frame(std::move(frame));
+        }
+    }
+}
+
+void InputPrefetcher::process_edi()
+{
+    set_thread_name("input");
+    set_thread_placement("input");
+
+    auto& transport = m_ediInput->ediTransport;
+    auto& recorder = m_ediInput->ediRecorder;
+
+    while (m_running) {
+        string error;
+        try {
+            if (not transport.rxPacket()) {
+                m_frames.trigger_wakeup();
+            }
+        }
+        catch (const std::runtime_error& e) {
+            error = e.what();
+        }
+
+        if (recorder.isFrameReady() or not error.empty()) {
+            frame_t frame;
+            bool have_frame = false;
+            while (m_running and not have_frame) {
+                have_frame = get_free_frame(frame);
+            }
+
+            if (not have_frame) {
+                break;
+            }
+
+            if (not error.empty()) {
+                frame.status = frame_t::status_e::Error;
+                frame.error = error;
+                push_frame(std::move(frame));
+                break;
+            }
+
+            frame.status = frame_t::status_e::Data;
+            recorder.takeFrame(frame.edi);
+            push_frame(std::move(frame));
+        }
+    }
+}
+
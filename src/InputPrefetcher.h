@@ -0,0 +1,127 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   Receives the ETI or EDI input in its own thread, ahead of the modulator
+*/
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include "Buffer.h"
+#include "EtiReader.h"
+#include "InputReader.h"
+#include "Metrics.h"
+#include "SPSCQueue.h"
+
+/* Reads the input in a thread, so that a slow frame in the modulator does
+ * not delay the socket reads, and a slow read does not stall the
+ * modulator. The thread fills a queue of up to depth frames: complete ETI
+ * frames, or for EDI the data of a frame as decoded by the ETIDecoder,
+ * which the modulator gives to its EdiReader.
+ *
+ * All frames are allocated when the prefetcher is created, and are given
+ * back after use. With a file input, the thread waits when the queue is
+ * full. With a network input, the oldest frame gets dropped instead, which
+ * counts as an overflow. Every time the modulator finds the queue empty
+ * after the first frame counts as an underflow.
+ */
+class InputPrefetcher
+{
+    public:
+        struct frame_t {
+            enum class status_e {
+                Data,
+                EndOfInput, // ETI file read until the end
+                Error,      // Read error, in the error string
+            };
+            status_e status = status_e::Data;
+            std::string error;
+
+            // For ETI inputs, GetNextFrame() fills the 6144 bytes
+            Buffer eti;
+
+            // For EDI inputs
+            EdiFrame edi;
+
+            std::chrono::steady_clock::time_point received;
+        };
+
+        InputPrefetcher(std::shared_ptr<InputReader> inputReader, size_t depth);
+
+        /* The ediInput must record the frames, see EdiInput */
+        InputPrefetcher(std::shared_ptr<EdiInput> ediInput, size_t depth);
+
+        InputPrefetcher(const InputPrefetcher& other) = delete;
+        InputPrefetcher& operator=(const InputPrefetcher& other) = delete;
+        ~InputPrefetcher();
+
+        /* Waits for the next frame. Throws a ThreadsafeQueueWakeup when the
+         * input had a timeout, to let the caller check if it must stop. The
+         * frame must be given back with release_frame(). */
+        void get_frame(frame_t& frame);
+        void release_frame(frame_t&& frame);
+
+        size_t level() const { return m_frames.size(); }
+        uint64_t num_overflows() const { return m_num_overflows.load(); }
+        uint64_t num_underflows() const { return m_num_underflows.load(); }
+
+    private:
+        void allocate_frames(size_t depth, bool eti);
+        void add_metrics();
+        bool get_free_frame(frame_t& frame);
+        void push_frame(frame_t&& frame);
+
+        void process_eti();
+        void process_edi();
+
+        std::shared_ptr<InputReader> m_inputReader;
+        std::shared_ptr<EdiInput> m_ediInput;
+
+        // With a file, waits for free frames instead of dropping
+        bool m_wait_when_full = false;
+
+        // The frames containing data, and those given back
+        SPSCQueue<frame_t> m_frames;
+        SPSCQueue<frame_t> m_free_frames;
+
+        // Only used by the modulator
+        bool m_first_frame_received = false;
+        bool m_waiting = false;
+        std::atomic<uint64_t> m_num_overflows = ATOMIC_VAR_INIT(0);
+        std::atomic<uint64_t> m_num_underflows = ATOMIC_VAR_INIT(0);
+
+        std::atomic<bool> m_running = ATOMIC_VAR_INIT(false);
+        std::thread m_thread;
+
+        Metrics::Handle m_metrics;
+};
+
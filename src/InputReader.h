@@ -35,11 +35,17 @@
 #include <vector>
 #include <string>
 #include <atomic>
+#include <chrono>
 #include <memory>
 #include <thread>
 #include <unistd.h>
 #include "Log.h"
+#include "Metrics.h"
 #include "Socket.h"
+#include "SPSCQueue.h"
+#if defined(HAVE_ZEROMQ)
+#  include "zmq.hpp"
+#endif
 #define INVALID_SOCKET   -1
 
 class InputReader
@@ -125,22 +131,300 @@ class InputFileReader : public InputReader
         // after 2**32 * 24ms ~= 3.3 years
 };
 
+/* Reads an ETI file of any of the formats above through a memory mapping.
+ * The stream type is identified and all frames are indexed once in Open(),
+ * after which the frames are accessed without reads, looping and seeking
+ * cost nothing.
+ */
+class InputMmapReader : public InputReader
+{
+    public:
+        InputMmapReader() = default;
+        InputMmapReader(const InputMmapReader& other) = delete;
+        InputMmapReader& operator=(const InputMmapReader& other) = delete;
+        ~InputMmapReader();
+
+        // map the file and index the frames, returns -1 on error
+        // When loop=1, GetNextFrame will never return 0
+        int Open(const std::string& filename, bool loop);
+
+        virtual std::string GetPrintableInfo() const override;
+        virtual int GetNextFrame(void* buffer) override;
+
+        // Like GetNextFrame, but instead of copying the frame, points frame
+        // to its 6144 bytes in the mapping. Frames without their padding
+        // are padded in an internal buffer. Valid until the next call.
+        int GetNextFramePointer(const uint8_t **frame);
+
+        size_t GetNumFrames() const { return m_frames.size(); }
+
+        // Random access that does not change the position, and can be used
+        // from several threads. Returns the frame in the mapping, or
+        // padded_frame (6144 bytes) if it had to be padded.
+        const uint8_t* GetFrame(size_t frame, uint8_t *padded_frame) const;
+
+        // Read the FCT and FP of a frame from its FC
+        void GetFrameCounters(size_t frame, unsigned& fct, unsigned& fp) const;
+
+        // Continue with the given frame. Returns false if the file does
+        // not have that many frames.
+        bool Seek(size_t frame);
+
+        // Continue with the next frame that has the given FCT, looking
+        // from the current position, wrapping at the end of the file.
+        bool SeekToFct(unsigned fct);
+
+    private:
+        void Unmap();
+        int IndexFrames();
+
+        bool m_loop = false;
+        std::string m_filename;
+        std::string m_format;
+
+        uint8_t *m_data = nullptr;
+        size_t m_length = 0;
+
+        struct frame_index_t {
+            size_t offset;
+            uint16_t size;
+        };
+        std::vector<frame_index_t> m_frames;
+        size_t m_next_frame = 0;
+
+        uint8_t m_padded_frame[6144];
+};
+
+/* Reads an ETI file of any of the formats above that was compressed with
+ * zstd or gzip, without decompressing it to disk first. A thread
+ * decompresses the file ahead of the modulator into a few blocks, from
+ * which the frames are taken.
+ *
+ * The decompression can only start at the beginning of a zstd frame or of
+ * a gzip member. Files made of many of them, as pzstd writes them, or as
+ * concatenated pieces compressed one after the other, can therefore be
+ * entered at many places. With use_index, the reader keeps an index with
+ * the first ETI frame in every compressed frame: its number, its FCT, and
+ * where to start the decompression. The index is loaded from the file of
+ * the same name with the suffix .idx, or written there after the first
+ * pass through the whole file. Seek() and SeekToFct() then only have to
+ * decompress from the nearest entry, instead of from the start.
+ */
+class InputCompressedReader : public InputReader
+{
+    public:
+        InputCompressedReader();
+        InputCompressedReader(const InputCompressedReader& other) = delete;
+        InputCompressedReader& operator=(const InputCompressedReader& other) = delete;
+        ~InputCompressedReader();
+
+        // true if the file starts like a zstd or a gzip file
+        static bool IsCompressed(const std::string& filename);
+
+        // open the file and determine the stream type, returns -1 on error
+        // When loop=1, GetNextFrame will never return 0
+        int Open(const std::string& filename, bool loop, bool use_index);
+
+        virtual std::string GetPrintableInfo() const override;
+        virtual int GetNextFrame(void* buffer) override;
+
+        // Continue with the given frame. Returns false if the file does
+        // not have that many frames, and then continues from the start.
+        bool Seek(size_t frame);
+
+        // Continue with the next frame that has the given FCT, looking
+        // at most one FCT period ahead of the current position.
+        bool SeekToFct(unsigned fct);
+
+    private:
+        enum class codec_e { zstd, gzip };
+
+        // Decompressed data, of a single compressed frame
+        struct block_t {
+            std::vector<uint8_t> data;
+            size_t len = 0;
+
+            // Where the compressed frame starts in the file, and the
+            // position of the data in its decompressed content
+            uint64_t frame_offset = 0;
+            uint64_t frame_pos = 0;
+
+            // The end of the file, or the decompression failed
+            bool end = false;
+            std::string error;
+        };
+
+        struct index_entry_t {
+            uint64_t frame;
+            uint32_t fct;
+            uint64_t offset;
+            uint64_t skip;
+        };
+
+        int IdentifyType();
+
+        // Start the decompression thread at a compressed frame, from
+        // which the first skip bytes are left out
+        void Start(uint64_t offset, uint64_t skip);
+        void Stop();
+        void Decompress();
+
+        // Make sure the current block has data. false at the end.
+        bool FillBlock();
+        size_t Read(uint8_t *buffer, size_t len);
+
+        // Read the next frame, padded to 6144 bytes. Returns the same as
+        // GetNextFrame, but throws on decompression errors.
+        int ReadFrame(uint8_t *buffer);
+
+        // Like ReadFrame, but rewinds at the end when looping
+        int NextFrame(uint8_t *buffer);
+        void ReachedEnd();
+        void Rewind();
+
+        bool LoadIndex();
+        void WriteIndex();
+
+        bool m_loop = false;
+        bool m_use_index = false;
+        std::string m_filename;
+        codec_e m_codec = codec_e::zstd;
+        int m_fd = -1;
+        uint64_t m_length = 0;
+
+        bool m_raw = false;
+        std::string m_format;
+
+        // Bytes before the first frame, the nbFrames of the framed format
+        // or whatever precedes the first sync of a raw file
+        uint64_t m_first_skip = 0;
+
+        // Number of the next frame since the start of the file,
+        // and the number of frames if the end was reached once
+        uint64_t m_next_frame = 0;
+        uint64_t m_num_frames = 0;
+
+        // A frame that SeekToFct() had to read
+        std::vector<uint8_t> m_held_frame;
+
+        std::vector<index_entry_t> m_index;
+        bool m_index_complete = false;
+        bool m_index_building = false;
+
+        SPSCQueue<block_t> m_blocks;
+        SPSCQueue<block_t> m_free_blocks;
+        block_t m_block;
+        bool m_has_block = false;
+        size_t m_block_pos = 0;
+
+        uint64_t m_start_offset = 0;
+        uint64_t m_start_skip = 0;
+        std::atomic<bool> m_running = ATOMIC_VAR_INIT(false);
+        std::thread m_thread;
+};
+
+/* Receives a stream of raw ETI frames over TCP. The socket is read in
+ * chunks of whatever data is available into a buffer of several frames,
+ * and the frames are taken from the buffer. After a reconnection, or if
+ * the stream does not contain a sync word where the next frame should
+ * start, the reader looks for the next sync word.
+ *
+ * The arrival time of every frame is compared to the 24ms it should take,
+ * and the jitter is available as a metric. To keep the modulator from
+ * waiting on the network, use the InputPrefetcher, which calls
+ * GetNextFrame() in its own thread.
+ */
 class InputTcpReader : public InputReader
 {
     public:
+        InputTcpReader();
+        InputTcpReader(const InputTcpReader& other) = delete;
+        InputTcpReader& operator=(const InputTcpReader& other) = delete;
+
         // Endpoint is either host:port or tcp://host:port
         void Open(const std::string& endpoint);
 
         // Put next frame into buffer. This function will never write more than
         // 6144 bytes into buffer.
-        // returns number of bytes written to buffer, 0 on eof, -1 on error
+        // returns number of bytes written to buffer, 0 on timeout or
+        // reconnection, -1 on error
         virtual int GetNextFrame(void* buffer) override;
 
         virtual std::string GetPrintableInfo() const override;
 
     private:
+        // Receive into the free space of the buffer, returns like
+        // TCPClient::recv()
+        ssize_t Receive(int timeout_ms);
+
+        // Drop the data before the next sync word, returns false if
+        // there is none in the buffer
+        bool Resync();
+
+        void UpdateArrivalStatistics();
+
         Socket::TCPClient m_tcpclient;
         std::string m_uri;
+
+        // The received data that was not given to the modulator yet is in
+        // [m_start, m_end)
+        std::vector<uint8_t> m_buffer;
+        size_t m_start = 0;
+        size_t m_end = 0;
+        bool m_synced = false;
+
+        std::chrono::steady_clock::time_point m_last_arrival;
+        bool m_arrival_valid = false;
+
+        std::atomic<uint64_t> m_num_frames = ATOMIC_VAR_INIT(0);
+        std::atomic<uint64_t> m_num_resyncs = ATOMIC_VAR_INIT(0);
+        std::atomic<uint64_t> m_num_reconnects = ATOMIC_VAR_INIT(0);
+        // Smoothed deviation of the inter-arrival time from 24ms, as in
+        // RFC 3550, and largest inter-arrival time, in ms
+        std::atomic<double> m_jitter_ms = ATOMIC_VAR_INIT(0.0);
+        std::atomic<double> m_max_interval_ms = ATOMIC_VAR_INIT(0.0);
+
+        Metrics::Handle m_metrics;
 };
 
+#if defined(HAVE_ZEROMQ)
+/* Subscribes to the ZeroMQ ETI output of ODR-DabMux, for a multiplexer on
+ * the same host over ipc:// or on another one over tcp://. Every message
+ * contains four ETI frames without their padding, they are given to the
+ * modulator one after the other. The TIST is part of the ETI frames. The
+ * ETI frames are aligned to the messages, there is nothing to resync.
+ */
+class InputZeroMQReader : public InputReader
+{
+    public:
+        InputZeroMQReader();
+        InputZeroMQReader(const InputZeroMQReader& other) = delete;
+        InputZeroMQReader& operator=(const InputZeroMQReader& other) = delete;
+
+        // Endpoint is zmq+tcp://host:port, tcp://host:port or ipc://path
+        void Open(const std::string& endpoint);
 
+        // Put next frame into buffer. This function will never write more than
+        // 6144 bytes into buffer.
+        // returns number of bytes written to buffer, 0 on timeout, -1 on
+        // error
+        virtual int GetNextFrame(void* buffer) override;
+
+        virtual std::string GetPrintableInfo() const override;
+
+    private:
+        zmq::context_t m_zmq_context;
+        zmq::socket_t m_zmq_sock;
+        std::string m_uri;
+
+        // The last message received, and the next frame in it
+        zmq::message_t m_message;
+        size_t m_next_frame;
+        size_t m_next_offset = 0;
+
+        std::atomic<uint64_t> m_num_messages = ATOMIC_VAR_INIT(0);
+        std::atomic<uint64_t> m_num_invalid = ATOMIC_VAR_INIT(0);
+
+        Metrics::Handle m_metrics;
+};
+#endif // defined(HAVE_ZEROMQ)
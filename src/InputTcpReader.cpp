@@ -32,9 +32,44 @@
 #include "InputReader.h"
 #include "PcDebug.h"
 #include "Utils.h"
+#include <cmath>
+#include <cstring>
 #include <unistd.h>
 #include <errno.h>
 
+static const size_t ETI_FRAME_SIZE = 6144;
+
+// Room for several frames, so that a recv() can read a large chunk
+static const size_t BUFFER_FRAMES = 8;
+
+// The FSYNC of the ETI(NI) frames alternates between these two values. It
+// follows the ERR byte.
+static bool is_sync(const uint8_t *frame)
+{
+    const uint32_t fsync = (frame[1] << 16) | (frame[2] << 8) | frame[3];
+    return fsync == 0x073AB6 or fsync == 0xF8C549;
+}
+
+InputTcpReader::InputTcpReader() :
+    m_buffer(BUFFER_FRAMES * ETI_FRAME_SIZE)
+{
+    m_metrics.add_counter("odr_input_tcp_frames_total",
+            "Number of ETI frames received over TCP",
+            [this]() { return m_num_frames.load(); });
+    m_metrics.add_counter("odr_input_tcp_resyncs_total",
+            "Number of times the TCP input looked for the ETI sync word",
+            [this]() { return m_num_resyncs.load(); });
+    m_metrics.add_counter("odr_input_tcp_reconnects_total",
+            "Number of timeouts and reconnections of the TCP input",
+            [this]() { return m_num_reconnects.load(); });
+    m_metrics.add_gauge("odr_input_tcp_jitter_ms",
+            "Smoothed deviation of the ETI frame inter-arrival time from 24ms",
+            [this]() { return m_jitter_ms.load(); });
+    m_metrics.add_gauge("odr_input_tcp_max_interval_ms",
+            "Largest ETI frame inter-arrival time",
+            [this]() { return m_max_interval_ms.load(); });
+}
+
 void InputTcpReader::Open(const std::string& endpoint)
 {
     std::string hostname;
@@ -66,24 +101,118 @@ void InputTcpReader::Open(const std::string& endpoint)
     m_uri = endpoint;
 }
 
-int InputTcpReader::GetNextFrame(void* buffer)
+ssize_t InputTcpReader::Receive(int timeout_ms)
 {
-    uint8_t* buf = (uint8_t*)buffer;
+    if (m_end == m_buffer.size()) {
+        // Move the remaining data to the front
+        memmove(m_buffer.data(), m_buffer.data() + m_start, m_end - m_start);
+        m_end -= m_start;
+        m_start = 0;
+    }
 
-    const size_t framesize = 6144;
-    const int timeout_ms = 8000;
+    ssize_t ret = m_tcpclient.recv(m_buffer.data() + m_end,
+            m_buffer.size() - m_end, 0, timeout_ms);
+    if (ret > 0) {
+        m_end += ret;
+    }
+    return ret;
+}
 
-    ssize_t ret = m_tcpclient.recv(buf, framesize, MSG_WAITALL, timeout_ms);
+bool InputTcpReader::Resync()
+{
+    for (size_t i = m_start; i + 4 <= m_end; i++) {
+        // When the next frame is already there, its sync word must be
+        // too, to avoid locking on data that looks like one
+        const bool next_ok = i + ETI_FRAME_SIZE + 4 > m_end or
+            is_sync(m_buffer.data() + i + ETI_FRAME_SIZE);
+        if (is_sync(m_buffer.data() + i) and next_ok) {
+            if (i != m_start) {
+                etiLog.level(warn) << "TCP input: dropped " << i - m_start <<
+                    " bytes before the ETI sync word";
+            }
+            m_start = i;
+            return true;
+        }
+    }
 
-    if (ret == 0) {
-        etiLog.level(debug) << "TCP input auto reconnect";
-        std::this_thread::sleep_for(std::chrono::seconds(1));
+    // Keep the last bytes, they could be the start of a sync word
+    if (m_end - m_start > 3) {
+        m_start = m_end - 3;
     }
-    else if (ret == -2) {
-        etiLog.level(debug) << "TCP input timeout";
+    return false;
+}
+
+void InputTcpReader::UpdateArrivalStatistics()
+{
+    using namespace std::chrono;
+    const auto now = steady_clock::now();
+    if (m_arrival_valid) {
+        const double interval_ms =
+            duration<double, std::milli>(now - m_last_arrival).count();
+        const double deviation = std::abs(interval_ms - 24.0);
+        m_jitter_ms = m_jitter_ms.load() +
+            (deviation - m_jitter_ms.load()) / 16.0;
+        if (interval_ms > m_max_interval_ms.load()) {
+            m_max_interval_ms = interval_ms;
+        }
     }
+    m_last_arrival = now;
+    m_arrival_valid = true;
+    m_num_frames++;
+}
 
-    return ret;
+int InputTcpReader::GetNextFrame(void* buffer)
+{
+    const int timeout_ms = 8000;
+
+    for (;;) {
+        if (not m_synced and m_end - m_start >= 4) {
+            m_synced = Resync();
+        }
+
+        if (m_synced and m_end - m_start >= ETI_FRAME_SIZE) {
+            // A truncated frame is followed by data that is not a sync
+            // word, which is only known if it has already been received
+            const bool next_ok = m_end - m_start < ETI_FRAME_SIZE + 4 or
+                is_sync(m_buffer.data() + m_start + ETI_FRAME_SIZE);
+            if (is_sync(m_buffer.data() + m_start) and next_ok) {
+                break;
+            }
+
+            etiLog.level(warn) << "TCP input: ETI sync lost";
+            m_num_resyncs++;
+            m_synced = false;
+            m_arrival_valid = false;
+            // Skip the byte that should have been the ERR
+            m_start++;
+            continue;
+        }
+
+        ssize_t ret = Receive(timeout_ms);
+
+        if (ret == 0) {
+            etiLog.level(debug) << "TCP input auto reconnect";
+            // The stream starts anew
+            m_start = m_end = 0;
+            m_synced = false;
+            m_arrival_valid = false;
+            m_num_reconnects++;
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            return 0;
+        }
+        else if (ret < 0) {
+            return ret;
+        }
+    }
+
+    memcpy(buffer, m_buffer.data() + m_start, ETI_FRAME_SIZE);
+    m_start += ETI_FRAME_SIZE;
+    if (m_start == m_end) {
+        m_start = m_end = 0;
+    }
+
+    UpdateArrivalStatistics();
+    return ETI_FRAME_SIZE;
 }
 
 std::string InputTcpReader::GetPrintableInfo() const
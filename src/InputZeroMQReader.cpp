@@ -0,0 +1,143 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://www.opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#if defined(HAVE_ZEROMQ)
+
+#include "InputReader.h"
+#include "PcDebug.h"
+#include <cstring>
+
+static const size_t ETI_FRAME_SIZE = 6144;
+
+/* The message of the ZeroMQ output of ODR-DabMux: a version, the sizes of
+ * the four frames, -1 if a frame is missing, and the frames one after the
+ * other. The multiplexer appends metadata after the frames, that the
+ * modulator does not need. */
+static const uint32_t ZMQ_DAB_MESSAGE_VERSION = 1;
+static const size_t NUM_FRAMES_PER_ZMQ_MESSAGE = 4;
+static const size_t ZMQ_DAB_MESSAGE_HEAD_LENGTH =
+    sizeof(uint32_t) + NUM_FRAMES_PER_ZMQ_MESSAGE * sizeof(int16_t);
+
+InputZeroMQReader::InputZeroMQReader() :
+    m_zmq_context(1),
+    m_zmq_sock(m_zmq_context, ZMQ_SUB),
+    m_next_frame(NUM_FRAMES_PER_ZMQ_MESSAGE)
+{
+    m_metrics.add_counter("odr_input_zmq_messages_total",
+            "Number of messages of four ETI frames received over ZeroMQ",
+            [this]() { return m_num_messages.load(); });
+    m_metrics.add_counter("odr_input_zmq_invalid_total",
+            "Number of invalid messages received over ZeroMQ",
+            [this]() { return m_num_invalid.load(); });
+}
+
+void InputZeroMQReader::Open(const std::string& endpoint)
+{
+    std::string zmq_endpoint = endpoint;
+    if (endpoint.compare(0, 4, "zmq+") == 0) {
+        zmq_endpoint = endpoint.substr(4, std::string::npos);
+    }
+
+    m_zmq_sock.connect(zmq_endpoint.c_str());
+    m_zmq_sock.setsockopt(ZMQ_SUBSCRIBE, NULL, 0);
+
+    m_uri = endpoint;
+}
+
+int InputZeroMQReader::GetNextFrame(void* buffer)
+{
+    const int timeout_ms = 8000;
+
+    for (;;) {
+        if (m_next_frame < NUM_FRAMES_PER_ZMQ_MESSAGE) {
+            const uint8_t *data = m_message.data<uint8_t>();
+            int16_t buflen = 0;
+            memcpy(&buflen, data + sizeof(uint32_t) +
+                    m_next_frame * sizeof(int16_t), sizeof(buflen));
+            m_next_frame++;
+
+            if (buflen <= 0) {
+                // The multiplexer did not have this frame
+                continue;
+            }
+
+            if ((size_t)buflen > ETI_FRAME_SIZE or ZMQ_DAB_MESSAGE_HEAD_LENGTH +
+                    m_next_offset + buflen > m_message.size()) {
+                etiLog.level(warn) << "ZeroMQ input: invalid frame size " <<
+                    buflen;
+                m_num_invalid++;
+                m_next_frame = NUM_FRAMES_PER_ZMQ_MESSAGE;
+                continue;
+            }
+
+            uint8_t *buf = reinterpret_cast<uint8_t*>(buffer);
+            memcpy(buf, data + ZMQ_DAB_MESSAGE_HEAD_LENGTH + m_next_offset,
+                    buflen);
+            m_next_offset += buflen;
+
+            // The padding is left out of the messages
+            memset(buf + buflen, 0x55, ETI_FRAME_SIZE - buflen);
+            return ETI_FRAME_SIZE;
+        }
+
+        zmq::pollitem_t pollItems[] = { {m_zmq_sock, 0, ZMQ_POLLIN, 0} };
+        const int num_events = zmq::poll(pollItems, 1, timeout_ms);
+        if (num_events == 0) {
+            etiLog.level(debug) << "ZeroMQ input timeout";
+            return 0;
+        }
+
+        const auto r = m_zmq_sock.recv(m_message, zmq::recv_flags::none);
+        if (not r) {
+            return 0;
+        }
+        m_num_messages++;
+
+        uint32_t version = 0;
+        if (m_message.size() >= ZMQ_DAB_MESSAGE_HEAD_LENGTH) {
+            memcpy(&version, m_message.data(), sizeof(version));
+        }
+
+        if (version != ZMQ_DAB_MESSAGE_VERSION) {
+            etiLog.level(warn) << "ZeroMQ input: invalid message of " <<
+                m_message.size() << " bytes, version " << version;
+            m_num_invalid++;
+            m_next_frame = NUM_FRAMES_PER_ZMQ_MESSAGE;
+            continue;
+        }
+
+        m_next_frame = 0;
+        m_next_offset = 0;
+    }
+}
+
+std::string InputZeroMQReader::GetPrintableInfo() const
+{
+    return "Input ZeroMQ: Receiving from " + m_uri;
+}
+
+#endif // defined(HAVE_ZEROMQ)
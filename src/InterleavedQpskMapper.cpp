@@ -0,0 +1,183 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "InterleavedQpskMapper.h"
+#include "FrequencyInterleaver.h"
+#include "PcDebug.h"
+
+#include <stdexcept>
+#include <string>
+#include <cmath>
+#ifdef __SSE__
+#   include <xmmintrin.h>
+#endif // __SSE__
+
+/* The input of every OFDM symbol is made of two halves, the first one
+ * giving the real parts and the second one the imaginary parts of the
+ * QPSK symbols, MSB first. For every byte, this table gives the eight
+ * values it contains. */
+template<typename T>
+class QpskTable
+{
+public:
+    static const QpskTable& get()
+    {
+        static const QpskTable table;
+        return table;
+    }
+
+    const T* row(uint8_t data) const { return values[data]; }
+
+private:
+    QpskTable()
+    {
+        const T v = static_cast<T>(M_SQRT1_2);
+        for (size_t data = 0; data < 256; data++) {
+            for (size_t k = 0; k < 8; k++) {
+                values[data][k] = (data & (0x80 >> k)) ? -v : v;
+            }
+        }
+    }
+
+    alignas(16) T values[256][8];
+};
+
+
+InterleavedQpskMapper::InterleavedQpskMapper(size_t mode, bool fixedPoint) :
+    ModCodec(),
+    m_fixedPoint(fixedPoint),
+    m_indices(FrequencyInterleaver::shared_carrier_indices(mode, m_carriers))
+{
+    PDEBUG("InterleavedQpskMapper::InterleavedQpskMapper(%zu) @ %p\n",
+            mode, this);
+
+    if (m_fixedPoint) {
+        QpskTable<complexfix::value_type>::get();
+    }
+    else {
+        QpskTable<float>::get();
+    }
+}
+
+template<typename T>
+static void map_symbols(const uint8_t* in, size_t num_symbols,
+        size_t carriers, const size_t* indices, std::complex<T>* out)
+{
+    const auto& table = QpskTable<T>::get();
+    const size_t half = carriers / 8;
+
+    for (size_t s = 0; s < num_symbols; s++) {
+        for (size_t j = 0; j < half; j++) {
+            const T* re = table.row(in[j]);
+            const T* im = table.row(in[j + half]);
+            const size_t* index = indices + 8 * j;
+            for (size_t k = 0; k < 8; k++) {
+                out[index[k]] = std::complex<T>(re[k], im[k]);
+            }
+        }
+        in += carriers / 4;
+        out += carriers;
+    }
+}
+
+#ifdef __SSE__
+static void map_symbols_sse(const uint8_t* in, size_t num_symbols,
+        size_t carriers, const size_t* indices, complexf* out_symbols)
+{
+    const auto& table = QpskTable<float>::get();
+    const size_t half = carriers / 8;
+
+    for (size_t s = 0; s < num_symbols; s++) {
+        float* out = reinterpret_cast<float*>(out_symbols + s * carriers);
+
+        for (size_t j = 0; j < half; j++) {
+            const float* re = table.row(in[j]);
+            const float* im = table.row(in[j + half]);
+            const __m128 re0 = _mm_load_ps(re);
+            const __m128 re1 = _mm_load_ps(re + 4);
+            const __m128 im0 = _mm_load_ps(im);
+            const __m128 im1 = _mm_load_ps(im + 4);
+
+            // Every vector holds two complex symbols
+            const __m128 c0 = _mm_unpacklo_ps(re0, im0);
+            const __m128 c1 = _mm_unpackhi_ps(re0, im0);
+            const __m128 c2 = _mm_unpacklo_ps(re1, im1);
+            const __m128 c3 = _mm_unpackhi_ps(re1, im1);
+
+            const size_t* index = indices + 8 * j;
+            _mm_storel_pi((__m64*)(out + 2 * index[0]), c0);
+            _mm_storeh_pi((__m64*)(out + 2 * index[1]), c0);
+            _mm_storel_pi((__m64*)(out + 2 * index[2]), c1);
+            _mm_storeh_pi((__m64*)(out + 2 * index[3]), c1);
+            _mm_storel_pi((__m64*)(out + 2 * index[4]), c2);
+            _mm_storeh_pi((__m64*)(out + 2 * index[5]), c2);
+            _mm_storel_pi((__m64*)(out + 2 * index[6]), c3);
+            _mm_storeh_pi((__m64*)(out + 2 * index[7]), c3);
+        }
+        in += carriers / 4;
+    }
+}
+#endif // __SSE__
+
+int InterleavedQpskMapper::process(Buffer* const dataIn, Buffer* dataOut)
+{
+    PDEBUG("InterleavedQpskMapper::process"
+            "(dataIn: %p, dataOut: %p)\n",
+            dataIn, dataOut);
+
+    if (dataIn->getLength() % (m_carriers / 4) != 0) {
+        throw std::runtime_error(
+                "InterleavedQpskMapper::process input size not valid: " +
+                std::to_string(dataIn->getLength()) +
+                "(input size) % (" + std::to_string(m_carriers) +
+                " (carriers) / 4) != 0");
+    }
+
+    const uint8_t* in = reinterpret_cast<const uint8_t*>(dataIn->getData());
+    const size_t num_symbols = dataIn->getLength() / (m_carriers / 4);
+
+    // 4 output complex symbols per input byte
+    dataOut->setLength(dataIn->getLength() * 4 *
+            (m_fixedPoint ? sizeof(complexfix) : sizeof(complexf)));
+    map(in, num_symbols, dataOut->getData());
+
+    return 1;
+}
+
+void InterleavedQpskMapper::map(const uint8_t* in, size_t num_symbols,
+        void* out) const
+{
+    if (m_fixedPoint) {
+        map_symbols(in, num_symbols, m_carriers, m_indices,
+                reinterpret_cast<complexfix*>(out));
+    }
+    else {
+#ifdef __SSE__
+        map_symbols_sse(in, num_symbols, m_carriers, m_indices,
+                reinterpret_cast<complexf*>(out));
+#else
+        map_symbols(in, num_symbols, m_carriers, m_indices,
+                reinterpret_cast<complexf*>(out));
+#endif // __SSE__
+    }
+}
@@ -0,0 +1,61 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   QPSK symbol mapping and frequency interleaving in a single pass.
+*/
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include "ModPlugin.h"
+
+#include <vector>
+#include <sys/types.h>
+
+/* Gives the same output as the QpskSymbolMapper followed by the
+ * FrequencyInterleaver: every QPSK symbol is written directly to the
+ * carrier it is sent on, without going through an intermediate buffer.
+ */
+class InterleavedQpskMapper : public ModCodec
+{
+public:
+    InterleavedQpskMapper(size_t mode, bool fixedPoint);
+
+    int process(Buffer* const dataIn, Buffer* dataOut) override;
+    const char* name() override { return "InterleavedQpskMapper"; }
+
+    /* Map num_symbols OFDM symbols of carriers() / 4 bytes each, to
+     * carriers() complexf or complexfix values each */
+    void map(const uint8_t* in, size_t num_symbols, void* out) const;
+    size_t carriers() const { return m_carriers; }
+
+private:
+    bool m_fixedPoint;
+    size_t m_carriers;
+    // See FrequencyInterleaver::shared_carrier_indices()
+    const size_t *m_indices;
+};
+
@@ -0,0 +1,81 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MappingBlockPartitioner.h"
+#include "PcDebug.h"
+
+#include <stdexcept>
+#include <cstring>
+#include <assert.h>
+
+MappingBlockPartitioner::MappingBlockPartitioner(unsigned mode, bool fixedPoint) :
+    BlockPartitioner(mode),
+    d_mapper(mode, fixedPoint),
+    d_sampleSize(fixedPoint ? sizeof(complexfix) : sizeof(complexf))
+{
+    PDEBUG("MappingBlockPartitioner::MappingBlockPartitioner(%u) @ %p\n",
+            mode, this);
+
+    if (d_mapper.carriers() / 4 != d_outputFramesize) {
+        throw std::logic_error("MappingBlockPartitioner: symbol size mismatch");
+    }
+
+    d_ficSymbols = d_cifCount * d_ficSize / d_outputFramesize;
+    d_cifSymbols = d_cifSize / d_outputFramesize;
+    d_fic.resize(d_cifCount * d_ficSize);
+}
+
+// dataIn[0] -> FIC
+// dataIn[1] -> CIF
+int MappingBlockPartitioner::process(std::vector<Buffer*> dataIn, Buffer* dataOut)
+{
+    assert(dataIn.size() == 2);
+
+    if (dataIn[0]->getLength() != d_ficSize) {
+        throw std::runtime_error(
+                "MappingBlockPartitioner::process input 0 size not valid!");
+    }
+    if (dataIn[1]->getLength() != d_cifSize) {
+        throw std::runtime_error(
+                "MappingBlockPartitioner::process input 1 size not valid!");
+    }
+
+    const size_t symbol_size = d_mapper.carriers() * d_sampleSize;
+    d_frame.setLength((d_ficSymbols + d_cifCount * d_cifSymbols) * symbol_size);
+    uint8_t* frame = reinterpret_cast<uint8_t*>(d_frame.getData());
+
+    memcpy(d_fic.data() + d_cifNb * d_ficSize, dataIn[0]->getData(), d_ficSize);
+
+    d_mapper.map(reinterpret_cast<const uint8_t*>(dataIn[1]->getData()),
+            d_cifSymbols,
+            frame + (d_ficSymbols + d_cifNb * d_cifSymbols) * symbol_size);
+
+    if (++d_cifNb == d_cifCount) {
+        d_cifNb = 0;
+
+        d_mapper.map(d_fic.data(), d_ficSymbols, frame);
+        dataOut->swap(d_frame);
+    }
+
+    return d_cifNb == 0;
+}
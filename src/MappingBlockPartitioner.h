@@ -0,0 +1,65 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   Block partitioning, QPSK symbol mapping and frequency interleaving in a
+   single pass.
+*/
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include "BlockPartitioner.h"
+#include "InterleavedQpskMapper.h"
+#include <vector>
+#include <cstdint>
+
+/* Gives the same output as the BlockPartitioner followed by the
+ * InterleavedQpskMapper. The MSC symbols of every CIF are mapped as soon
+ * as the CIF arrives, and the FIC symbols once all CIFs of the
+ * transmission frame are there, which avoids the partitioned frame.
+ * The metadata is handled like in the BlockPartitioner.
+ */
+class MappingBlockPartitioner : public BlockPartitioner
+{
+public:
+    MappingBlockPartitioner(unsigned mode, bool fixedPoint);
+
+    int process(std::vector<Buffer*> dataIn, Buffer* dataOut);
+    const char* name() { return "MappingBlockPartitioner"; }
+
+private:
+    InterleavedQpskMapper d_mapper;
+    size_t d_sampleSize;
+    size_t d_ficSymbols;
+    size_t d_cifSymbols;
+
+    // The FIC of the CIFs received so far
+    std::vector<uint8_t> d_fic;
+
+    // The mapped symbols of the transmission frame, given to the output
+    // once the frame is complete
+    Buffer d_frame;
+};
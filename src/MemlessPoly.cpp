@@ -11,7 +11,8 @@
    This block implements both a memoryless polynom for digital predistortion,
    and a lookup table predistorter.
    For better performance, multiplying is done in another thread, leading
-   to a pipeline delay of two calls to MemlessPoly::process
+   to a pipeline delay of two calls to MemlessPoly::process. Each frame is
+   furthermore split into parts that are processed by the shared WorkerPool.
  */
 /*
    This file is part of ODR-DabMod.
@@ -33,32 +34,52 @@
 #pragma GCC optimize ("O3")
 
 #include "MemlessPoly.h"
+#include "CpuFeatures.h"
 #include "PcDebug.h"
 #include "Utils.h"
+#include "WorkerPool.h"
 
+#include <atomic>
 #include <cstdio>
 #include <cstring>
 #include <stdexcept>
 #include <string>
 #include <future>
+#include <algorithm>
 #include <array>
+#include <cmath>
 #include <iostream>
+#include <limits>
 #include <fstream>
 #include <memory>
 #include <complex>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#    include <immintrin.h>
+#elif defined(__ARM_NEON)
+#    include <arm_neon.h>
+#endif
 
 using namespace std;
 
 // Number of AM/AM coefs, identical to number of AM/PM coefs
 #define NUM_COEFS 5
 
-MemlessPoly::MemlessPoly(std::string& coefs_file, unsigned int num_threads) :
+// The frame is processed in chunks of this many samples, which the threads
+// take from a shared counter. Input and output of a chunk fit into the L1
+// cache, and a thread that starts late or gets preempted delays the frame
+// by one chunk at most, not by its share of the frame.
+static constexpr size_t chunk_size = 2048;
+
+static const char *dpd_kernels_name();
+
+MemlessPoly::MemlessPoly(std::string& coefs_file, unsigned int num_threads,
+        FFTEngine fftEngine, const std::string& rc_name) :
     PipelinedModCodec(),
-    RemoteControllable("memlesspoly"),
-    m_coefs_am(),
-    m_coefs_pm(),
-    m_coefs_file(coefs_file),
-    m_coefs_mutex()
+    RemoteControllable(rc_name),
+    m_fftEngine(fftEngine),
+    m_coefs_file(coefs_file)
 {
     PDEBUG("MemlessPoly::MemlessPoly(%s) @ %p\n",
             coefs_file.c_str(), this);
@@ -67,34 +88,23 @@ MemlessPoly::MemlessPoly(std::string& coefs_file, unsigned int num_threads) :
     RC_ADD_PARAMETER(coefs, "Predistortion coefficients, same format as file.");
     RC_ADD_PARAMETER(coeffile, "Filename containing coefficients. "
             "When set, the file gets loaded.");
+    RC_ADD_PARAMETER(lut_fallback, "1 to replace the polynomial by an "
+            "interpolated lookup table, which is cheaper to compute.");
+    add_pipeline_parameters(m_parameters);
+    add_bypass_parameter(m_parameters);
 
     if (num_threads == 0) {
-        const unsigned int hw_concurrency = std::thread::hardware_concurrency();
-        etiLog.level(info) << "Digital Predistorter will use " <<
-            hw_concurrency << " threads (auto detected)";
-
-        for (size_t i = 0; i < hw_concurrency; i++) {
-            m_workers.emplace_back();
-        }
-
-        for (auto& worker : m_workers) {
-            worker.thread = std::thread(
-                    &MemlessPoly::worker_thread, &worker);
-        }
+        m_num_parts = WorkerPool::shared().num_threads() + 1;
+        etiLog.level(info) << "Digital Predistorter will process frames on " <<
+            m_num_parts.load() << " threads (auto detected)";
     }
     else {
-        etiLog.level(info) << "Digital Predistorter will use " <<
-            num_threads << " threads (set in config file)";
-
-        for (size_t i = 0; i < num_threads; i++) {
-            m_workers.emplace_back();
-        }
-
-        for (auto& worker : m_workers) {
-            worker.thread = std::thread(
-                    &MemlessPoly::worker_thread, &worker);
-        }
+        m_num_parts = num_threads + 1;
+        etiLog.level(info) << "Digital Predistorter will process frames on " <<
+            m_num_parts.load() << " threads (set in config file)";
     }
+    etiLog.level(debug) << "MemlessPoly: using the " <<
+        dpd_kernels_name() << " kernels";
 
     ifstream coefs_fstream(m_coefs_file);
     load_coefficients(coefs_fstream);
@@ -109,33 +119,43 @@ MemlessPoly::~MemlessPoly()
 
 constexpr uint8_t file_format_odd_poly = 1;
 constexpr uint8_t file_format_lut = 2;
+constexpr uint8_t file_format_interpolated_lut = 3;
 
 std::string MemlessPoly::serialise_coefficients() const
 {
     stringstream ss;
 
-    std::lock_guard<std::mutex> lock(m_coefs_mutex);
+    const auto settings = std::atomic_load(&m_dpd_settings);
 
-    if (m_dpd_settings_valid) {
-        switch (m_dpd_type) {
+    if (settings) {
+        switch (settings->dpd_type) {
             case dpd_type_t::odd_only_poly:
                 ss << (int)file_format_odd_poly << endl;
-                ss << m_coefs_am.size() << endl;
-                for (const auto& coef : m_coefs_am) {
+                ss << settings->coefs_am.size() << endl;
+                for (const auto& coef : settings->coefs_am) {
                     ss << coef << endl;
                 }
-                for (const auto& coef : m_coefs_pm) {
+                for (const auto& coef : settings->coefs_pm) {
                     ss << coef << endl;
                 }
                 break;
             case dpd_type_t::lookup_table:
                 ss << (int)file_format_lut << endl;
-                ss << m_lut.size() << endl;
-                ss << m_lut_scalefactor << endl;
-                for (const auto& l : m_lut) {
+                ss << settings->lut.size() << endl;
+                ss << settings->lut_scalefactor << endl;
+                for (const auto& l : settings->lut) {
                     ss << l << endl;
                 }
                 break;
+            case dpd_type_t::interpolated_lut:
+                ss << (int)file_format_interpolated_lut << endl;
+                ss << settings->ilut.size() << endl;
+                ss << settings->ilut_scalefactor << endl;
+                for (const auto& l : settings->ilut) {
+                    ss << l.real() << endl;
+                    ss << l.imag() << endl;
+                }
+                break;
         }
     }
 
@@ -189,16 +209,15 @@ void MemlessPoly::load_coefficients(std::istream& coef_stream)
             }
         }
 
-        {
-            std::lock_guard<std::mutex> lock(m_coefs_mutex);
+        auto settings = make_shared<dpd_settings_t>();
+        settings->dpd_type = dpd_type_t::odd_only_poly;
+        settings->coefs_am = std::move(coefs_am);
+        settings->coefs_pm = std::move(coefs_pm);
+        std::atomic_store(&m_dpd_settings,
+                shared_ptr<const dpd_settings_t>(settings));
 
-            m_dpd_type = dpd_type_t::odd_only_poly;
-            m_coefs_am = coefs_am;
-            m_coefs_pm = coefs_pm;
-            m_dpd_settings_valid = true;
-        }
         etiLog.log(info, "MemlessPoly loaded %zu poly coefs",
-                m_coefs_am.size() + m_coefs_pm.size());
+                settings->coefs_am.size() + settings->coefs_pm.size());
     }
     else if (file_format_indicator == file_format_lut) {
         float scalefactor;
@@ -213,65 +232,234 @@ void MemlessPoly::load_coefficients(std::istream& coef_stream)
             lut[n] = a;
         }
 
-        {
-            std::lock_guard<std::mutex> lock(m_coefs_mutex);
+        auto settings = make_shared<dpd_settings_t>();
+        settings->dpd_type = dpd_type_t::lookup_table;
+        settings->lut_scalefactor = scalefactor;
+        settings->lut = lut;
+        std::atomic_store(&m_dpd_settings,
+                shared_ptr<const dpd_settings_t>(settings));
 
-            m_dpd_type = dpd_type_t::lookup_table;
-            m_lut_scalefactor = scalefactor;
-            m_lut = lut;
-            m_dpd_settings_valid = true;
+        etiLog.log(info, "MemlessPoly loaded %zu LUT entries", lut.size());
+    }
+    else if (file_format_indicator == file_format_interpolated_lut) {
+        size_t n_entries = 0;
+        coef_stream >> n_entries;
+
+        if (n_entries < ilut_min_entries or n_entries > ilut_max_entries) {
+            throw std::runtime_error("MemlessPoly: invalid number of LUT entries: " +
+                    std::to_string(n_entries) + " expected " +
+                    std::to_string(ilut_min_entries) + " to " +
+                    std::to_string(ilut_max_entries));
         }
 
-        etiLog.log(info, "MemlessPoly loaded %zu LUT entries", m_lut.size());
+        float scalefactor = 0;
+        coef_stream >> scalefactor;
+
+        if (not (scalefactor > 0)) {
+            throw std::runtime_error("MemlessPoly: LUT scalefactor must be positive");
+        }
+
+        std::vector<complexf> lut(n_entries);
+        for (size_t n = 0; n < n_entries; n++) {
+            float re, im;
+            coef_stream >> re >> im;
+
+            if (not coef_stream) {
+                etiLog.log(error, "MemlessPoly: coefs should contain %zu LUT "
+                        "entries, but could only read %zu !", n_entries, n);
+                throw std::runtime_error("MemlessPoly: coefs file invalid !");
+            }
+
+            lut[n] = complexf(re, im);
+        }
+
+        std::vector<complexf> slope(n_entries);
+        for (size_t n = 0; n + 1 < n_entries; n++) {
+            slope[n] = lut[n + 1] - lut[n];
+        }
+
+        auto settings = make_shared<dpd_settings_t>();
+        settings->dpd_type = dpd_type_t::interpolated_lut;
+        settings->ilut_scalefactor = scalefactor;
+        settings->ilut = std::move(lut);
+        settings->ilut_slope = std::move(slope);
+        std::atomic_store(&m_dpd_settings,
+                shared_ptr<const dpd_settings_t>(settings));
+
+        etiLog.log(info, "MemlessPoly loaded %zu interpolated LUT entries",
+                n_entries);
     }
     else {
         etiLog.log(error, "MemlessPoly: coef file has unknown format %d",
                 file_format_indicator);
-        m_dpd_settings_valid = false;
+        std::atomic_store(&m_dpd_settings, shared_ptr<const dpd_settings_t>());
+    }
+}
+
+void MemlessPoly::set_lut_fallback(bool fallback)
+{
+    lock_guard<mutex> lock(m_fallback_mutex);
+    if (fallback == m_lut_fallback) {
+        return;
+    }
+    m_lut_fallback = fallback;
+
+    if (not fallback) {
+        if (m_fallback_poly) {
+            std::atomic_store(&m_dpd_settings, m_fallback_poly);
+            m_fallback_poly.reset();
+            etiLog.level(info) << "MemlessPoly: back to the polynomial";
+        }
+        return;
+    }
+
+    const auto poly = std::atomic_load(&m_dpd_settings);
+    if (not poly or poly->dpd_type != dpd_type_t::odd_only_poly) {
+        return;
     }
+
+    // Entry k is the correction for the magnitude k / scalefactor, with
+    // the exact cosine and sine instead of the approximations of
+    // apply_coeff()
+    const size_t n_entries = fallback_lut_entries;
+    const float scalefactor = (n_entries - 1) / fallback_lut_max_magnitude;
+
+    std::vector<complexf> lut(n_entries);
+    for (size_t n = 0; n < n_entries; n++) {
+        const float mag = n / scalefactor;
+        const float mag_sq = mag * mag;
+
+        float am = 0;
+        float pm = 0;
+        for (size_t k = poly->coefs_am.size(); k > 0; k--) {
+            am = poly->coefs_am[k - 1] + mag_sq * am;
+            pm = poly->coefs_pm[k - 1] + mag_sq * pm;
+        }
+        lut[n] = am * complexf(std::cos(-pm), std::sin(-pm));
+    }
+
+    std::vector<complexf> slope(n_entries);
+    for (size_t n = 0; n + 1 < n_entries; n++) {
+        slope[n] = lut[n + 1] - lut[n];
+    }
+
+    auto settings = make_shared<dpd_settings_t>();
+    settings->dpd_type = dpd_type_t::interpolated_lut;
+    settings->ilut_scalefactor = scalefactor;
+    settings->ilut = std::move(lut);
+    settings->ilut_slope = std::move(slope);
+
+    m_fallback_poly = poly;
+    std::atomic_store(&m_dpd_settings,
+            shared_ptr<const dpd_settings_t>(settings));
+    etiLog.level(info) << "MemlessPoly: replaced the polynomial by " <<
+        n_entries << " interpolated LUT entries";
 }
 
 /* The restrict keyword is C99, g++ and clang++ however support __restrict
- * instead, and this allows the compiler to auto-vectorize the loop.
+ * instead, and this allows the compiler to auto-vectorize the loop. The
+ * complex multiplications are written out like in apply_coeff_planar(),
+ * the NaN checks of the std::complex operator prevent the vectorisation.
+ *
+ * The phase correction phi is applied with the rotation (re, im) given by
+ * the two polynomials below, not with the sine and cosine. They are not the
+ * Taylor series of the comments: the magnitude of the rotation is about
+ * 1 + phi^2, 1e-4 too large at |phi| = 0.01 rad, 2.5e-3 at 0.05 rad and 1e-2
+ * at 0.1 rad, and its phase is phi within 7e-7, 8e-5 and 7e-4 rad. Changing
+ * them would change the output for the coefficients in use, all kernels
+ * therefore compute the same polynomials.
  */
 static void apply_coeff(
         const float *__restrict coefs_am, const float *__restrict coefs_pm,
         const complexf *__restrict in, size_t start, size_t stop,
         complexf *__restrict out)
 {
-    for (size_t i = start; i < stop; i+=1) {
+    const float *__restrict x = reinterpret_cast<const float*>(in);
+    float *__restrict y = reinterpret_cast<float*>(out);
 
-        float in_mag_sq = in[i].real() * in[i].real() + in[i].imag() * in[i].imag();
+    for (size_t i = start; i < stop; i+=1) {
+        const float x_re = x[2 * i];
+        const float x_im = x[2 * i + 1];
+        const float in_mag_sq = x_re * x_re + x_im * x_im;
 
-        float amplitude_correction =
+        const float amplitude_correction =
             ( coefs_am[0] + in_mag_sq *
               ( coefs_am[1] + in_mag_sq *
                 ( coefs_am[2] + in_mag_sq *
                   ( coefs_am[3] + in_mag_sq *
                     coefs_am[4]))));
 
-        float phase_correction = -1 *
+        const float phase_correction = -1 *
             ( coefs_pm[0] + in_mag_sq *
               ( coefs_pm[1] + in_mag_sq *
                 ( coefs_pm[2] + in_mag_sq *
                   ( coefs_pm[3] + in_mag_sq *
                     coefs_pm[4]))));
 
-        float phase_correction_sq = phase_correction * phase_correction;
+        const float phase_correction_sq = phase_correction * phase_correction;
 
         // Approximation for Cosinus 1 - 1/2 x^2 + 1/24 x^4 - 1/720 x^6
-        float re = (1.0f - phase_correction_sq *
+        const float re = (1.0f - phase_correction_sq *
                 ( -0.5f + phase_correction_sq *
                     ( 0.486666f  + phase_correction_sq *
                         ( -0.00138888f))));
 
         // Approximation for Sinus x + 1/6 x^3 + 1/120 x^5
-        float im = phase_correction *
+        const float im = phase_correction *
+                (1.0f + phase_correction_sq *
+                    (0.166666f + phase_correction_sq *
+                        (0.00833333f)));
+
+        const float a_re = x_re * amplitude_correction;
+        const float a_im = x_im * amplitude_correction;
+        y[2 * i] = a_re * re - a_im * im;
+        y[2 * i + 1] = a_re * im + a_im * re;
+    }
+}
+
+/* The same for the planar layout, with the products of the complex
+ * multiplications written out in the order std::complex uses. */
+static void apply_coeff_planar(
+        const float *__restrict coefs_am, const float *__restrict coefs_pm,
+        const float *__restrict in_re, const float *__restrict in_im,
+        size_t start, size_t stop,
+        float *__restrict out_re, float *__restrict out_im)
+{
+    for (size_t i = start; i < stop; i++) {
+        const float x_re = in_re[i];
+        const float x_im = in_im[i];
+        const float in_mag_sq = x_re * x_re + x_im * x_im;
+
+        const float amplitude_correction =
+            ( coefs_am[0] + in_mag_sq *
+              ( coefs_am[1] + in_mag_sq *
+                ( coefs_am[2] + in_mag_sq *
+                  ( coefs_am[3] + in_mag_sq *
+                    coefs_am[4]))));
+
+        const float phase_correction = -1 *
+            ( coefs_pm[0] + in_mag_sq *
+              ( coefs_pm[1] + in_mag_sq *
+                ( coefs_pm[2] + in_mag_sq *
+                  ( coefs_pm[3] + in_mag_sq *
+                    coefs_pm[4]))));
+
+        const float phase_correction_sq = phase_correction * phase_correction;
+
+        const float re = (1.0f - phase_correction_sq *
+                ( -0.5f + phase_correction_sq *
+                    ( 0.486666f  + phase_correction_sq *
+                        ( -0.00138888f))));
+
+        const float im = phase_correction *
                 (1.0f + phase_correction_sq *
                     (0.166666f + phase_correction_sq *
                         (0.00833333f)));
 
-        out[i] = in[i] * amplitude_correction * complex<float>(re, im);
+        const float a_re = x_re * amplitude_correction;
+        const float a_im = x_im * amplitude_correction;
+        out_re[i] = a_re * re - a_im * im;
+        out_im[i] = a_re * im + a_im * re;
     }
 }
 
@@ -308,34 +496,724 @@ static void apply_lut(
     }
 }
 
-void MemlessPoly::worker_thread(MemlessPoly::worker_t *workerdata)
+static void apply_interpolated_lut(
+        const complexf *__restrict lut, const complexf *__restrict slope,
+        size_t num_entries, const float scalefactor,
+        const complexf *__restrict in,
+        size_t start, size_t stop, complexf *__restrict out)
 {
-    set_realtime_prio(1);
-    set_thread_name("MemlessPoly");
+    const float max_pos = static_cast<float>(num_entries - 1);
 
-    while (true) {
-        worker_t::input_data_t in_data = {};
-        try {
-            workerdata->in_queue.wait_and_pop(in_data);
+    for (size_t i = start; i < stop; i++) {
+        const float in_mag = std::sqrt(
+                in[i].real() * in[i].real() + in[i].imag() * in[i].imag());
+
+        // Position in the table, magnitudes beyond the last entry use the
+        // last entry. This also catches NaN.
+        float pos = in_mag * scalefactor;
+        pos = pos < max_pos ? pos : max_pos;
+
+        const int32_t lut_ix = static_cast<int32_t>(pos);
+        const float frac = pos - static_cast<float>(lut_ix);
+
+        out[i] = in[i] * (lut[lut_ix] + slope[lut_ix] * frac);
+    }
+}
+
+/* The vectorised kernels process the samples from start on, as long as
+ * a full vector is available, and return the index of the first sample
+ * they did not process. They give exactly the same output as apply_coeff()
+ * and apply_lut() above: the operations are the same and happen in the same
+ * order, without fused multiply-add. The only exception are products that
+ * overflow, which std::complex turns into infinity where these give NaN. For the LUT, the magnitude is computed
+ * in double precision like hypotf() does, and the index is taken from the
+ * scaled magnitude divided by 2^27, which is the same as the high 5 bits of
+ * the rounded value. The interpolated LUT is read with gathers.
+ */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+// Compiled for AVX2 even if the rest of the program isn't, and only used if
+// the CPU supports it.
+#  define HAVE_DPD_KERNEL_DISPATCH 1
+
+// Reads the four complex entries of the table given by ix. The masked
+// gather with a zero source avoids a -Wmaybe-uninitialized warning from
+// the GCC headers for _mm256_i32gather_pd().
+__attribute__((target("avx2")))
+static inline __m256 gather_complex(const complexf *table, __m128i ix)
+{
+    const __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+    return _mm256_castpd_ps(_mm256_mask_i32gather_pd(_mm256_setzero_pd(),
+                reinterpret_cast<const double*>(table), ix, all, 8));
+}
+
+__attribute__((target("avx2")))
+static size_t apply_coeff_avx2(
+        const float *__restrict coefs_am, const float *__restrict coefs_pm,
+        const complexf *__restrict in, size_t start, size_t stop,
+        complexf *__restrict out)
+{
+    __m256 am[NUM_COEFS];
+    __m256 pm[NUM_COEFS];
+    for (size_t k = 0; k < NUM_COEFS; k++) {
+        am[k] = _mm256_set1_ps(coefs_am[k]);
+        pm[k] = _mm256_set1_ps(coefs_pm[k]);
+    }
+
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 cos1 = _mm256_set1_ps(-0.5f);
+    const __m256 cos2 = _mm256_set1_ps(0.486666f);
+    const __m256 cos3 = _mm256_set1_ps(-0.00138888f);
+    const __m256 sin1 = _mm256_set1_ps(0.166666f);
+    const __m256 sin2 = _mm256_set1_ps(0.00833333f);
+
+    size_t i = start;
+    for (; i + 8 <= stop; i += 8) {
+        const float *x = reinterpret_cast<const float*>(&in[i]);
+        const __m256 x0 = _mm256_loadu_ps(x);
+        const __m256 x1 = _mm256_loadu_ps(x + 8);
+
+        // Samples (0 1 4 5 | 2 3 6 7)
+        const __m256 mag_sq = _mm256_hadd_ps(
+                _mm256_mul_ps(x0, x0), _mm256_mul_ps(x1, x1));
+
+        __m256 ampl = am[4];
+        __m256 phase = pm[4];
+        for (int k = NUM_COEFS - 2; k >= 0; k--) {
+            ampl = _mm256_add_ps(am[k], _mm256_mul_ps(mag_sq, ampl));
+            phase = _mm256_add_ps(pm[k], _mm256_mul_ps(mag_sq, phase));
         }
-        catch (const ThreadsafeQueueWakeup&) {
-            break;
+        phase = _mm256_xor_ps(phase, sign);
+
+        const __m256 p_sq = _mm256_mul_ps(phase, phase);
+        const __m256 re = _mm256_sub_ps(one, _mm256_mul_ps(p_sq,
+                    _mm256_add_ps(cos1, _mm256_mul_ps(p_sq,
+                            _mm256_add_ps(cos2, _mm256_mul_ps(p_sq, cos3))))));
+        const __m256 im = _mm256_mul_ps(phase,
+                _mm256_add_ps(one, _mm256_mul_ps(p_sq,
+                        _mm256_add_ps(sin1, _mm256_mul_ps(p_sq, sin2)))));
+
+        // Back to one value per real and imaginary part, samples 0 to 3
+        // from the low halves and 4 to 7 from the high halves.
+        const __m256 ampl0 = _mm256_unpacklo_ps(ampl, ampl);
+        const __m256 ampl1 = _mm256_unpackhi_ps(ampl, ampl);
+        const __m256 re0 = _mm256_unpacklo_ps(re, re);
+        const __m256 re1 = _mm256_unpackhi_ps(re, re);
+        const __m256 im0 = _mm256_unpacklo_ps(im, im);
+        const __m256 im1 = _mm256_unpackhi_ps(im, im);
+
+        const __m256 a0 = _mm256_mul_ps(x0, ampl0);
+        const __m256 a1 = _mm256_mul_ps(x1, ampl1);
+
+        // (a.r*re - a.i*im, a.i*re + a.r*im)
+        const __m256 y0 = _mm256_addsub_ps(_mm256_mul_ps(a0, re0),
+                _mm256_mul_ps(_mm256_permute_ps(a0, 0xB1), im0));
+        const __m256 y1 = _mm256_addsub_ps(_mm256_mul_ps(a1, re1),
+                _mm256_mul_ps(_mm256_permute_ps(a1, 0xB1), im1));
+
+        float *y = reinterpret_cast<float*>(&out[i]);
+        _mm256_storeu_ps(y, y0);
+        _mm256_storeu_ps(y + 8, y1);
+    }
+    return i;
+}
+
+// Without the shuffles of the interleaved version
+__attribute__((target("avx2")))
+static size_t apply_coeff_planar_avx2(
+        const float *__restrict coefs_am, const float *__restrict coefs_pm,
+        const float *__restrict in_re, const float *__restrict in_im,
+        size_t start, size_t stop,
+        float *__restrict out_re, float *__restrict out_im)
+{
+    __m256 am[NUM_COEFS];
+    __m256 pm[NUM_COEFS];
+    for (size_t k = 0; k < NUM_COEFS; k++) {
+        am[k] = _mm256_set1_ps(coefs_am[k]);
+        pm[k] = _mm256_set1_ps(coefs_pm[k]);
+    }
+
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 cos1 = _mm256_set1_ps(-0.5f);
+    const __m256 cos2 = _mm256_set1_ps(0.486666f);
+    const __m256 cos3 = _mm256_set1_ps(-0.00138888f);
+    const __m256 sin1 = _mm256_set1_ps(0.166666f);
+    const __m256 sin2 = _mm256_set1_ps(0.00833333f);
+
+    size_t i = start;
+    for (; i + 8 <= stop; i += 8) {
+        const __m256 x_re = _mm256_loadu_ps(in_re + i);
+        const __m256 x_im = _mm256_loadu_ps(in_im + i);
+        const __m256 mag_sq = _mm256_add_ps(
+                _mm256_mul_ps(x_re, x_re), _mm256_mul_ps(x_im, x_im));
+
+        __m256 ampl = am[4];
+        __m256 phase = pm[4];
+        for (int k = NUM_COEFS - 2; k >= 0; k--) {
+            ampl = _mm256_add_ps(am[k], _mm256_mul_ps(mag_sq, ampl));
+            phase = _mm256_add_ps(pm[k], _mm256_mul_ps(mag_sq, phase));
         }
+        phase = _mm256_xor_ps(phase, sign);
+
+        const __m256 p_sq = _mm256_mul_ps(phase, phase);
+        const __m256 re = _mm256_sub_ps(one, _mm256_mul_ps(p_sq,
+                    _mm256_add_ps(cos1, _mm256_mul_ps(p_sq,
+                            _mm256_add_ps(cos2, _mm256_mul_ps(p_sq, cos3))))));
+        const __m256 im = _mm256_mul_ps(phase,
+                _mm256_add_ps(one, _mm256_mul_ps(p_sq,
+                        _mm256_add_ps(sin1, _mm256_mul_ps(p_sq, sin2)))));
+
+        const __m256 a_re = _mm256_mul_ps(x_re, ampl);
+        const __m256 a_im = _mm256_mul_ps(x_im, ampl);
+        _mm256_storeu_ps(out_re + i, _mm256_sub_ps(
+                    _mm256_mul_ps(a_re, re), _mm256_mul_ps(a_im, im)));
+        _mm256_storeu_ps(out_im + i, _mm256_add_ps(
+                    _mm256_mul_ps(a_re, im), _mm256_mul_ps(a_im, re)));
+    }
+    return i;
+}
 
-        switch (in_data.dpd_type) {
-            case dpd_type_t::odd_only_poly:
-                apply_coeff(in_data.coefs_am, in_data.coefs_pm,
-                        in_data.in, in_data.start, in_data.stop,
-                        in_data.out);
-                break;
-            case dpd_type_t::lookup_table:
-                apply_lut(in_data.lut, in_data.lut_scalefactor,
-                        in_data.in, in_data.start, in_data.stop,
-                        in_data.out);
-                break;
+__attribute__((target("avx2")))
+static size_t apply_lut_avx2(
+        const complexf *__restrict lut, const float scalefactor,
+        const complexf *__restrict in,
+        size_t start, size_t stop, complexf *__restrict out)
+{
+    const __m128 scale = _mm_set1_ps(scalefactor);
+    const __m128 bin_scale = _mm_set1_ps(1.0f / (1u << 27));
+    const __m128i bin_mask = _mm_set1_epi32(0x1F);
+
+    size_t i = start;
+    for (; i + 4 <= stop; i += 4) {
+        const __m256 x = _mm256_loadu_ps(reinterpret_cast<const float*>(&in[i]));
+
+        const __m256d x0 = _mm256_cvtps_pd(_mm256_castps256_ps128(x));
+        const __m256d x1 = _mm256_cvtps_pd(_mm256_extractf128_ps(x, 1));
+
+        // Samples (0 2 1 3), reordered to (0 1 2 3)
+        const __m256d mag_sq = _mm256_permute4x64_pd(_mm256_hadd_pd(
+                    _mm256_mul_pd(x0, x0), _mm256_mul_pd(x1, x1)), 0xD8);
+        const __m128 mag = _mm256_cvtpd_ps(_mm256_sqrt_pd(mag_sq));
+
+        const __m128 scaled = _mm_mul_ps(mag, scale);
+        const __m128i ix = _mm_and_si128(
+                _mm_cvttps_epi32(_mm_mul_ps(scaled, bin_scale)), bin_mask);
+
+        const __m256 l = gather_complex(lut, ix);
+
+        const __m256 l_re = _mm256_moveldup_ps(l);
+        const __m256 l_im = _mm256_movehdup_ps(l);
+        const __m256 y = _mm256_addsub_ps(_mm256_mul_ps(x, l_re),
+                _mm256_mul_ps(_mm256_permute_ps(x, 0xB1), l_im));
+
+        _mm256_storeu_ps(reinterpret_cast<float*>(&out[i]), y);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t apply_interpolated_lut_avx2(
+        const complexf *__restrict lut, const complexf *__restrict slope,
+        size_t num_entries, const float scalefactor,
+        const complexf *__restrict in,
+        size_t start, size_t stop, complexf *__restrict out)
+{
+    const __m256 scale = _mm256_set1_ps(scalefactor);
+    const __m256 max_pos = _mm256_set1_ps(static_cast<float>(num_entries - 1));
+    const __m256i dup_lo = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+    const __m256i dup_hi = _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7);
+
+    size_t i = start;
+    for (; i + 8 <= stop; i += 8) {
+        const float *x = reinterpret_cast<const float*>(&in[i]);
+        const __m256 x0 = _mm256_loadu_ps(x);
+        const __m256 x1 = _mm256_loadu_ps(x + 8);
+
+        // Samples (0 1 4 5 | 2 3 6 7), reordered to (0 1 2 3 | 4 5 6 7)
+        const __m256 mag_sq = _mm256_castpd_ps(_mm256_permute4x64_pd(
+                    _mm256_castps_pd(_mm256_hadd_ps(
+                            _mm256_mul_ps(x0, x0), _mm256_mul_ps(x1, x1))),
+                    0xD8));
+
+        // _mm256_min_ps returns the second operand for NaN
+        const __m256 pos = _mm256_min_ps(
+                _mm256_mul_ps(_mm256_sqrt_ps(mag_sq), scale), max_pos);
+        const __m256i ix = _mm256_cvttps_epi32(pos);
+        const __m256 frac = _mm256_sub_ps(pos, _mm256_cvtepi32_ps(ix));
+
+        const __m128i ix0 = _mm256_castsi256_si128(ix);
+        const __m128i ix1 = _mm256_extracti128_si256(ix, 1);
+
+        const __m256 c0 = _mm256_add_ps(
+                gather_complex(lut, ix0),
+                _mm256_mul_ps(gather_complex(slope, ix0),
+                    _mm256_permutevar8x32_ps(frac, dup_lo)));
+        const __m256 c1 = _mm256_add_ps(
+                gather_complex(lut, ix1),
+                _mm256_mul_ps(gather_complex(slope, ix1),
+                    _mm256_permutevar8x32_ps(frac, dup_hi)));
+
+        const __m256 y0 = _mm256_addsub_ps(
+                _mm256_mul_ps(x0, _mm256_moveldup_ps(c0)),
+                _mm256_mul_ps(_mm256_permute_ps(x0, 0xB1), _mm256_movehdup_ps(c0)));
+        const __m256 y1 = _mm256_addsub_ps(
+                _mm256_mul_ps(x1, _mm256_moveldup_ps(c1)),
+                _mm256_mul_ps(_mm256_permute_ps(x1, 0xB1), _mm256_movehdup_ps(c1)));
+
+        float *y = reinterpret_cast<float*>(&out[i]);
+        _mm256_storeu_ps(y, y0);
+        _mm256_storeu_ps(y + 8, y1);
+    }
+    return i;
+}
+#endif
+
+#if defined(__SSE2__)
+/* For the CPUs without AVX2. SSE2 has neither gathers nor addsub, the
+ * samples are split into real and imaginary parts, and the table entries
+ * are loaded one by one. */
+static inline void rotate_sse2(const __m128 *am, const __m128 *pm,
+        __m128 x_re, __m128 x_im, __m128& y_re, __m128& y_im)
+{
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    const __m128 mag_sq = _mm_add_ps(
+            _mm_mul_ps(x_re, x_re), _mm_mul_ps(x_im, x_im));
+
+    __m128 ampl = am[4];
+    __m128 phase = pm[4];
+    for (int k = NUM_COEFS - 2; k >= 0; k--) {
+        ampl = _mm_add_ps(am[k], _mm_mul_ps(mag_sq, ampl));
+        phase = _mm_add_ps(pm[k], _mm_mul_ps(mag_sq, phase));
+    }
+    phase = _mm_xor_ps(phase, sign);
+
+    const __m128 p_sq = _mm_mul_ps(phase, phase);
+    const __m128 re = _mm_sub_ps(one, _mm_mul_ps(p_sq,
+                _mm_add_ps(_mm_set1_ps(-0.5f), _mm_mul_ps(p_sq,
+                        _mm_add_ps(_mm_set1_ps(0.486666f), _mm_mul_ps(p_sq,
+                                _mm_set1_ps(-0.00138888f)))))));
+    const __m128 im = _mm_mul_ps(phase,
+            _mm_add_ps(one, _mm_mul_ps(p_sq,
+                    _mm_add_ps(_mm_set1_ps(0.166666f), _mm_mul_ps(p_sq,
+                            _mm_set1_ps(0.00833333f))))));
+
+    const __m128 a_re = _mm_mul_ps(x_re, ampl);
+    const __m128 a_im = _mm_mul_ps(x_im, ampl);
+    y_re = _mm_sub_ps(_mm_mul_ps(a_re, re), _mm_mul_ps(a_im, im));
+    y_im = _mm_add_ps(_mm_mul_ps(a_re, im), _mm_mul_ps(a_im, re));
+}
+
+// The complex products of the two samples in x and c
+static inline __m128 complex_mul_sse2(__m128 x, __m128 c)
+{
+    const __m128 sign_re = _mm_setr_ps(-0.0f, 0.0f, -0.0f, 0.0f);
+    const __m128 c_re = _mm_shuffle_ps(c, c, _MM_SHUFFLE(2, 2, 0, 0));
+    const __m128 c_im = _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 1, 1));
+    const __m128 x_swap = _mm_shuffle_ps(x, x, _MM_SHUFFLE(2, 3, 0, 1));
+    return _mm_add_ps(_mm_mul_ps(x, c_re),
+            _mm_xor_ps(_mm_mul_ps(x_swap, c_im), sign_re));
+}
+
+// The two complex entries of the table given by ix0 and ix1
+static inline __m128 load_complex_pair(const complexf *table,
+        int32_t ix0, int32_t ix1)
+{
+    const __m128 lo = _mm_loadl_pi(_mm_setzero_ps(),
+            reinterpret_cast<const __m64*>(&table[ix0]));
+    return _mm_loadh_pi(lo, reinterpret_cast<const __m64*>(&table[ix1]));
+}
+
+static size_t apply_coeff_sse2(
+        const float *__restrict coefs_am, const float *__restrict coefs_pm,
+        const complexf *__restrict in, size_t start, size_t stop,
+        complexf *__restrict out)
+{
+    __m128 am[NUM_COEFS];
+    __m128 pm[NUM_COEFS];
+    for (size_t k = 0; k < NUM_COEFS; k++) {
+        am[k] = _mm_set1_ps(coefs_am[k]);
+        pm[k] = _mm_set1_ps(coefs_pm[k]);
+    }
+
+    size_t i = start;
+    for (; i + 4 <= stop; i += 4) {
+        const float *x = reinterpret_cast<const float*>(&in[i]);
+        const __m128 x0 = _mm_loadu_ps(x);
+        const __m128 x1 = _mm_loadu_ps(x + 4);
+
+        __m128 y_re, y_im;
+        rotate_sse2(am, pm,
+                _mm_shuffle_ps(x0, x1, _MM_SHUFFLE(2, 0, 2, 0)),
+                _mm_shuffle_ps(x0, x1, _MM_SHUFFLE(3, 1, 3, 1)),
+                y_re, y_im);
+
+        float *y = reinterpret_cast<float*>(&out[i]);
+        _mm_storeu_ps(y, _mm_unpacklo_ps(y_re, y_im));
+        _mm_storeu_ps(y + 4, _mm_unpackhi_ps(y_re, y_im));
+    }
+    return i;
+}
+
+static size_t apply_coeff_planar_sse2(
+        const float *__restrict coefs_am, const float *__restrict coefs_pm,
+        const float *__restrict in_re, const float *__restrict in_im,
+        size_t start, size_t stop,
+        float *__restrict out_re, float *__restrict out_im)
+{
+    __m128 am[NUM_COEFS];
+    __m128 pm[NUM_COEFS];
+    for (size_t k = 0; k < NUM_COEFS; k++) {
+        am[k] = _mm_set1_ps(coefs_am[k]);
+        pm[k] = _mm_set1_ps(coefs_pm[k]);
+    }
+
+    size_t i = start;
+    for (; i + 4 <= stop; i += 4) {
+        __m128 y_re, y_im;
+        rotate_sse2(am, pm, _mm_loadu_ps(in_re + i), _mm_loadu_ps(in_im + i),
+                y_re, y_im);
+        _mm_storeu_ps(out_re + i, y_re);
+        _mm_storeu_ps(out_im + i, y_im);
+    }
+    return i;
+}
+
+// The magnitudes of the two samples in x, computed in double precision
+static inline __m128 magnitude_pair_sse2(__m128 x)
+{
+    const __m128d d0 = _mm_cvtps_pd(x);
+    const __m128d d1 = _mm_cvtps_pd(_mm_movehl_ps(x, x));
+    const __m128d sq0 = _mm_mul_pd(d0, d0);
+    const __m128d sq1 = _mm_mul_pd(d1, d1);
+    const __m128d mag_sq = _mm_add_pd(
+            _mm_unpacklo_pd(sq0, sq1), _mm_unpackhi_pd(sq0, sq1));
+    return _mm_cvtpd_ps(_mm_sqrt_pd(mag_sq));
+}
+
+static size_t apply_lut_sse2(
+        const complexf *__restrict lut, const float scalefactor,
+        const complexf *__restrict in,
+        size_t start, size_t stop, complexf *__restrict out)
+{
+    const __m128 scale = _mm_set1_ps(scalefactor);
+    const __m128 bin_scale = _mm_set1_ps(1.0f / (1u << 27));
+    const __m128i bin_mask = _mm_set1_epi32(0x1F);
+
+    size_t i = start;
+    for (; i + 4 <= stop; i += 4) {
+        const float *x = reinterpret_cast<const float*>(&in[i]);
+        const __m128 x0 = _mm_loadu_ps(x);
+        const __m128 x1 = _mm_loadu_ps(x + 4);
+
+        const __m128 mag = _mm_movelh_ps(
+                magnitude_pair_sse2(x0), magnitude_pair_sse2(x1));
+        const __m128 scaled = _mm_mul_ps(mag, scale);
+
+        alignas(16) int32_t ix[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(ix), _mm_and_si128(
+                    _mm_cvttps_epi32(_mm_mul_ps(scaled, bin_scale)), bin_mask));
+
+        float *y = reinterpret_cast<float*>(&out[i]);
+        _mm_storeu_ps(y, complex_mul_sse2(x0,
+                    load_complex_pair(lut, ix[0], ix[1])));
+        _mm_storeu_ps(y + 4, complex_mul_sse2(x1,
+                    load_complex_pair(lut, ix[2], ix[3])));
+    }
+    return i;
+}
+
+static size_t apply_interpolated_lut_sse2(
+        const complexf *__restrict lut, const complexf *__restrict slope,
+        size_t num_entries, const float scalefactor,
+        const complexf *__restrict in,
+        size_t start, size_t stop, complexf *__restrict out)
+{
+    const __m128 scale = _mm_set1_ps(scalefactor);
+    const __m128 max_pos = _mm_set1_ps(static_cast<float>(num_entries - 1));
+
+    size_t i = start;
+    for (; i + 4 <= stop; i += 4) {
+        const float *x = reinterpret_cast<const float*>(&in[i]);
+        const __m128 x0 = _mm_loadu_ps(x);
+        const __m128 x1 = _mm_loadu_ps(x + 4);
+
+        const __m128 x_re = _mm_shuffle_ps(x0, x1, _MM_SHUFFLE(2, 0, 2, 0));
+        const __m128 x_im = _mm_shuffle_ps(x0, x1, _MM_SHUFFLE(3, 1, 3, 1));
+        const __m128 mag_sq = _mm_add_ps(
+                _mm_mul_ps(x_re, x_re), _mm_mul_ps(x_im, x_im));
+
+        // _mm_min_ps returns the second operand for NaN
+        const __m128 pos = _mm_min_ps(
+                _mm_mul_ps(_mm_sqrt_ps(mag_sq), scale), max_pos);
+        const __m128i ixv = _mm_cvttps_epi32(pos);
+        const __m128 frac = _mm_sub_ps(pos, _mm_cvtepi32_ps(ixv));
+
+        alignas(16) int32_t ix[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(ix), ixv);
+
+        const __m128 c0 = _mm_add_ps(load_complex_pair(lut, ix[0], ix[1]),
+                _mm_mul_ps(load_complex_pair(slope, ix[0], ix[1]),
+                    _mm_unpacklo_ps(frac, frac)));
+        const __m128 c1 = _mm_add_ps(load_complex_pair(lut, ix[2], ix[3]),
+                _mm_mul_ps(load_complex_pair(slope, ix[2], ix[3]),
+                    _mm_unpackhi_ps(frac, frac)));
+
+        float *y = reinterpret_cast<float*>(&out[i]);
+        _mm_storeu_ps(y, complex_mul_sse2(x0, c0));
+        _mm_storeu_ps(y + 4, complex_mul_sse2(x1, c1));
+    }
+    return i;
+}
+#endif
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+static size_t apply_coeff_neon(
+        const float *__restrict coefs_am, const float *__restrict coefs_pm,
+        const complexf *__restrict in, size_t start, size_t stop,
+        complexf *__restrict out)
+{
+    float32x4_t am[NUM_COEFS];
+    float32x4_t pm[NUM_COEFS];
+    for (size_t k = 0; k < NUM_COEFS; k++) {
+        am[k] = vdupq_n_f32(coefs_am[k]);
+        pm[k] = vdupq_n_f32(coefs_pm[k]);
+    }
+
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    const float32x4_t cos1 = vdupq_n_f32(-0.5f);
+    const float32x4_t cos2 = vdupq_n_f32(0.486666f);
+    const float32x4_t cos3 = vdupq_n_f32(-0.00138888f);
+    const float32x4_t sin1 = vdupq_n_f32(0.166666f);
+    const float32x4_t sin2 = vdupq_n_f32(0.00833333f);
+
+    size_t i = start;
+    for (; i + 4 <= stop; i += 4) {
+        const float32x4x2_t x = vld2q_f32(reinterpret_cast<const float*>(&in[i]));
+        const float32x4_t mag_sq = vaddq_f32(
+                vmulq_f32(x.val[0], x.val[0]), vmulq_f32(x.val[1], x.val[1]));
+
+        float32x4_t ampl = am[4];
+        float32x4_t phase = pm[4];
+        for (int k = NUM_COEFS - 2; k >= 0; k--) {
+            ampl = vaddq_f32(am[k], vmulq_f32(mag_sq, ampl));
+            phase = vaddq_f32(pm[k], vmulq_f32(mag_sq, phase));
         }
+        phase = vnegq_f32(phase);
+
+        const float32x4_t p_sq = vmulq_f32(phase, phase);
+        const float32x4_t re = vsubq_f32(one, vmulq_f32(p_sq,
+                    vaddq_f32(cos1, vmulq_f32(p_sq,
+                            vaddq_f32(cos2, vmulq_f32(p_sq, cos3))))));
+        const float32x4_t im = vmulq_f32(phase,
+                vaddq_f32(one, vmulq_f32(p_sq,
+                        vaddq_f32(sin1, vmulq_f32(p_sq, sin2)))));
+
+        const float32x4_t a_re = vmulq_f32(x.val[0], ampl);
+        const float32x4_t a_im = vmulq_f32(x.val[1], ampl);
+
+        float32x4x2_t y;
+        y.val[0] = vsubq_f32(vmulq_f32(a_re, re), vmulq_f32(a_im, im));
+        y.val[1] = vaddq_f32(vmulq_f32(a_re, im), vmulq_f32(a_im, re));
+        vst2q_f32(reinterpret_cast<float*>(&out[i]), y);
+    }
+    return i;
+}
 
-        workerdata->out_queue.push(1);
+static size_t apply_lut_neon(
+        const complexf *__restrict lut, const float scalefactor,
+        const complexf *__restrict in,
+        size_t start, size_t stop, complexf *__restrict out)
+{
+    const float32x4_t scale = vdupq_n_f32(scalefactor);
+    const float32x4_t bin_scale = vdupq_n_f32(1.0f / (1u << 27));
+    const uint32x4_t bin_mask = vdupq_n_u32(0x1F);
+
+    size_t i = start;
+    for (; i + 4 <= stop; i += 4) {
+        const float32x4x2_t x = vld2q_f32(reinterpret_cast<const float*>(&in[i]));
+
+        const float64x2_t re0 = vcvt_f64_f32(vget_low_f32(x.val[0]));
+        const float64x2_t re1 = vcvt_high_f64_f32(x.val[0]);
+        const float64x2_t im0 = vcvt_f64_f32(vget_low_f32(x.val[1]));
+        const float64x2_t im1 = vcvt_high_f64_f32(x.val[1]);
+        const float64x2_t mag0 = vsqrtq_f64(
+                vaddq_f64(vmulq_f64(re0, re0), vmulq_f64(im0, im0)));
+        const float64x2_t mag1 = vsqrtq_f64(
+                vaddq_f64(vmulq_f64(re1, re1), vmulq_f64(im1, im1)));
+        const float32x4_t mag = vcvt_high_f32_f64(vcvt_f32_f64(mag0), mag1);
+
+        const float32x4_t scaled = vmulq_f32(mag, scale);
+        const uint32x4_t ix = vandq_u32(
+                vcvtq_u32_f32(vmulq_f32(scaled, bin_scale)), bin_mask);
+
+        uint32_t ix_a[4];
+        vst1q_u32(ix_a, ix);
+        float l_re[4];
+        float l_im[4];
+        for (int k = 0; k < 4; k++) {
+            l_re[k] = lut[ix_a[k]].real();
+            l_im[k] = lut[ix_a[k]].imag();
+        }
+        float32x4x2_t l;
+        l.val[0] = vld1q_f32(l_re);
+        l.val[1] = vld1q_f32(l_im);
+
+        float32x4x2_t y;
+        y.val[0] = vsubq_f32(vmulq_f32(x.val[0], l.val[0]),
+                vmulq_f32(x.val[1], l.val[1]));
+        y.val[1] = vaddq_f32(vmulq_f32(x.val[0], l.val[1]),
+                vmulq_f32(x.val[1], l.val[0]));
+        vst2q_f32(reinterpret_cast<float*>(&out[i]), y);
+    }
+    return i;
+}
+
+static size_t apply_interpolated_lut_neon(
+        const complexf *__restrict lut, const complexf *__restrict slope,
+        size_t num_entries, const float scalefactor,
+        const complexf *__restrict in,
+        size_t start, size_t stop, complexf *__restrict out)
+{
+    const float32x4_t scale = vdupq_n_f32(scalefactor);
+    const float32x4_t max_pos = vdupq_n_f32(static_cast<float>(num_entries - 1));
+
+    size_t i = start;
+    for (; i + 4 <= stop; i += 4) {
+        const float32x4x2_t x = vld2q_f32(reinterpret_cast<const float*>(&in[i]));
+        const float32x4_t mag = vsqrtq_f32(vaddq_f32(
+                    vmulq_f32(x.val[0], x.val[0]), vmulq_f32(x.val[1], x.val[1])));
+
+        // vminq_f32 would propagate NaN
+        float32x4_t pos = vmulq_f32(mag, scale);
+        pos = vbslq_f32(vcltq_f32(pos, max_pos), pos, max_pos);
+
+        const int32x4_t ix = vcvtq_s32_f32(pos);
+        const float32x4_t frac = vsubq_f32(pos, vcvtq_f32_s32(ix));
+
+        int32_t ix_a[4];
+        vst1q_s32(ix_a, ix);
+        float l_re[4];
+        float l_im[4];
+        float s_re[4];
+        float s_im[4];
+        for (int k = 0; k < 4; k++) {
+            l_re[k] = lut[ix_a[k]].real();
+            l_im[k] = lut[ix_a[k]].imag();
+            s_re[k] = slope[ix_a[k]].real();
+            s_im[k] = slope[ix_a[k]].imag();
+        }
+        const float32x4_t c_re = vaddq_f32(vld1q_f32(l_re),
+                vmulq_f32(vld1q_f32(s_re), frac));
+        const float32x4_t c_im = vaddq_f32(vld1q_f32(l_im),
+                vmulq_f32(vld1q_f32(s_im), frac));
+
+        float32x4x2_t y;
+        y.val[0] = vsubq_f32(vmulq_f32(x.val[0], c_re),
+                vmulq_f32(x.val[1], c_im));
+        y.val[1] = vaddq_f32(vmulq_f32(x.val[0], c_im),
+                vmulq_f32(x.val[1], c_re));
+        vst2q_f32(reinterpret_cast<float*>(&out[i]), y);
+    }
+    return i;
+}
+#endif
+
+using apply_coeff_kernel_t = size_t (*)(const float*, const float*,
+        const complexf*, size_t, size_t, complexf*);
+using apply_lut_kernel_t = size_t (*)(const complexf*, float,
+        const complexf*, size_t, size_t, complexf*);
+using apply_interpolated_lut_kernel_t = size_t (*)(const complexf*,
+        const complexf*, size_t, float, const complexf*, size_t, size_t,
+        complexf*);
+using apply_coeff_planar_kernel_t = size_t (*)(const float*, const float*,
+        const float*, const float*, size_t, size_t, float*, float*);
+
+struct dpd_kernels_t {
+    // nullptr if there is no vectorised kernel
+    apply_coeff_kernel_t apply_coeff = nullptr;
+    apply_lut_kernel_t apply_lut = nullptr;
+    apply_interpolated_lut_kernel_t apply_interpolated_lut = nullptr;
+    apply_coeff_planar_kernel_t apply_coeff_planar = nullptr;
+    const char *name = "scalar";
+};
+
+static dpd_kernels_t select_dpd_kernels()
+{
+    auto& cpu = cpu_features();
+    dpd_kernels_t k;
+#if defined(HAVE_DPD_KERNEL_DISPATCH)
+    if (cpu.supports(cpu_feature_e::avx2)) {
+        k.apply_coeff = apply_coeff_avx2;
+        k.apply_lut = apply_lut_avx2;
+        k.apply_interpolated_lut = apply_interpolated_lut_avx2;
+        k.apply_coeff_planar = apply_coeff_planar_avx2;
+        k.name = "AVX2";
+    }
+    else
+#endif
+#if defined(__SSE2__)
+    if (cpu.supports(cpu_feature_e::sse2)) {
+        k.apply_coeff = apply_coeff_sse2;
+        k.apply_lut = apply_lut_sse2;
+        k.apply_interpolated_lut = apply_interpolated_lut_sse2;
+        k.apply_coeff_planar = apply_coeff_planar_sse2;
+        k.name = "SSE2";
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    if (cpu.supports(cpu_feature_e::neon)) {
+        k.apply_coeff = apply_coeff_neon;
+        k.apply_lut = apply_lut_neon;
+        k.apply_interpolated_lut = apply_interpolated_lut_neon;
+        k.name = "NEON";
+    }
+#endif
+    cpu.register_kernel("MemlessPoly", k.name);
+    return k;
+}
+
+static const dpd_kernels_t& dpd_kernels()
+{
+    static const dpd_kernels_t kernels = select_dpd_kernels();
+    return kernels;
+}
+
+static const char *dpd_kernels_name()
+{
+    return dpd_kernels().name;
+}
+
+/* With the fixed-point FFT engines, every chunk is converted to complexf,
+ * predistorted by the same kernels, and converted back with rounding and
+ * saturation. T is the type of the raw values, with frac_bits fractional
+ * bits. */
+template <typename T, int frac_bits>
+static void fix_to_float(const T *in, float *out, size_t num_samples)
+{
+    constexpr float scale = 1.0f / (1 << frac_bits);
+    for (size_t i = 0; i < 2 * num_samples; i++) {
+        out[i] = in[i] * scale;
+    }
+}
+
+template <typename T, int frac_bits>
+static void float_to_fix(const float *in, T *out, size_t num_samples)
+{
+    constexpr float scale = 1 << frac_bits;
+    constexpr float lo = std::numeric_limits<T>::min();
+    // The largest float below the maximum of int32_t is 2^31 - 128
+    constexpr float hi = std::is_same_v<T, int16_t> ?
+        std::numeric_limits<int16_t>::max() : 2147483520.0f;
+    for (size_t i = 0; i < 2 * num_samples; i++) {
+        // Rounds half away from zero. Unlike lrintf(), this gets
+        // vectorised. The comparisons also map NaN to lo.
+        float v = in[i] * scale;
+        v += std::copysign(0.5f, v);
+        v = lo < v ? v : lo;
+        v = v < hi ? v : hi;
+        out[i] = static_cast<int32_t>(v);
     }
 }
 
@@ -343,68 +1221,145 @@ int MemlessPoly::internal_process(Buffer* const dataIn, Buffer* dataOut)
 {
     dataOut->setLength(dataIn->getLength());
 
+    const size_t sample_size =
+        m_fftEngine == FFTEngine::FFTW ? sizeof(complexf) :
+        m_fftEngine == FFTEngine::DEXTER ? sizeof(complexfix_wide) :
+        sizeof(complexfix);
     const complexf* in = reinterpret_cast<const complexf*>(dataIn->getData());
     complexf* out = reinterpret_cast<complexf*>(dataOut->getData());
-    size_t sizeOut = dataOut->getLength() / sizeof(complexf);
-
-    if (m_dpd_settings_valid) {
-        std::lock_guard<std::mutex> lock(m_coefs_mutex);
-        const size_t num_threads = m_workers.size();
-
-        if (num_threads > 0) {
-            const size_t step = sizeOut / num_threads;
-
-            size_t start = 0;
-            for (auto& worker : m_workers) {
-                worker_t::input_data_t dat;
-                dat.dpd_type = m_dpd_type;
-                dat.lut_scalefactor = m_lut_scalefactor;
-                dat.lut = m_lut.data();
-                dat.coefs_am = m_coefs_am.data();
-                dat.coefs_pm = m_coefs_pm.data();
-                dat.in = in;
-                dat.start = start;
-                dat.stop = start + step;
-                dat.out = out;
-
-                worker.in_queue.push(dat);
-
-                start += step;
-            }
+    size_t sizeOut = dataOut->getLength() / sample_size;
+
+    // Reloads only replace m_dpd_settings, this frame keeps the
+    // settings it started with.
+    const auto settings = std::atomic_load(&m_dpd_settings);
 
-            // Do the last in this thread
-            switch (m_dpd_type) {
+    if (settings) {
+        const dpd_settings_t& s = *settings;
+        const auto& kernels = dpd_kernels();
+
+        // The vectorised LUT kernel does not reproduce the wrap-around of
+        // negative scaled magnitudes.
+        const bool vector_lut = kernels.apply_lut and s.lut_scalefactor >= 0;
+
+        auto apply = [&](const complexf *src, size_t start, size_t stop,
+                complexf *dst) {
+            size_t i = start;
+            switch (s.dpd_type) {
                 case dpd_type_t::odd_only_poly:
-                    apply_coeff(m_coefs_am.data(), m_coefs_pm.data(),
-                            in, start, sizeOut, out);
+                    if (kernels.apply_coeff) {
+                        i = kernels.apply_coeff(s.coefs_am.data(),
+                                s.coefs_pm.data(), src, start, stop, dst);
+                    }
+                    apply_coeff(s.coefs_am.data(), s.coefs_pm.data(),
+                            src, i, stop, dst);
                     break;
                 case dpd_type_t::lookup_table:
-                    apply_lut(m_lut.data(), m_lut_scalefactor,
-                            in, start, sizeOut, out);
+                    if (vector_lut) {
+                        i = kernels.apply_lut(s.lut.data(),
+                                s.lut_scalefactor, src, start, stop, dst);
+                    }
+                    apply_lut(s.lut.data(), s.lut_scalefactor,
+                            src, i, stop, dst);
+                    break;
+                case dpd_type_t::interpolated_lut:
+                    if (kernels.apply_interpolated_lut) {
+                        i = kernels.apply_interpolated_lut(
+                                s.ilut.data(), s.ilut_slope.data(),
+                                s.ilut.size(), s.ilut_scalefactor,
+                                src, start, stop, dst);
+                    }
+                    apply_interpolated_lut(s.ilut.data(),
+                            s.ilut_slope.data(), s.ilut.size(),
+                            s.ilut_scalefactor, src, i, stop, dst);
                     break;
             }
-
-            // Wait for completion of the tasks
-            for (auto& worker : m_workers) {
-                int ret = 0;
-                worker.out_queue.wait_and_pop(ret);
+        };
+
+        // For the planar layout. The LUTs go through the interleaved
+        // kernels, tmp_in and tmp_out hold a chunk.
+        const float *in_re = reinterpret_cast<const float*>(in);
+        const float *in_im = in_re + sizeOut;
+        float *out_re = reinterpret_cast<float*>(out);
+        float *out_im = out_re + sizeOut;
+        auto apply_planar = [&](size_t start, size_t stop,
+                float *tmp_in, float *tmp_out) {
+            if (s.dpd_type == dpd_type_t::odd_only_poly) {
+                size_t i = start;
+                if (kernels.apply_coeff_planar) {
+                    i = kernels.apply_coeff_planar(s.coefs_am.data(),
+                            s.coefs_pm.data(), in_re, in_im, start, stop,
+                            out_re, out_im);
+                }
+                apply_coeff_planar(s.coefs_am.data(), s.coefs_pm.data(),
+                        in_re, in_im, i, stop, out_re, out_im);
             }
-        }
-        else {
-            switch (m_dpd_type) {
-                case dpd_type_t::odd_only_poly:
-                    apply_coeff(m_coefs_am.data(), m_coefs_pm.data(),
-                            in, 0, sizeOut, out);
-                    break;
-                case dpd_type_t::lookup_table:
-                    apply_lut(m_lut.data(), m_lut_scalefactor,
-                            in, 0, sizeOut, out);
-                    break;
+            else {
+                const size_t n = stop - start;
+                planar_to_interleaved(in_re + start, in_im + start, tmp_in, n);
+                apply(reinterpret_cast<const complexf*>(tmp_in), 0, n,
+                        reinterpret_cast<complexf*>(tmp_out));
+                for (size_t i = 0; i < n; i++) {
+                    out_re[start + i] = tmp_out[2 * i];
+                    out_im[start + i] = tmp_out[2 * i + 1];
+                }
             }
-        }
+        };
+
+        const size_t num_chunks = (sizeOut + chunk_size - 1) / chunk_size;
+        atomic<size_t> next_chunk(0);
+
+        WorkerPool::shared().parallel_for(std::min(m_num_parts.load(), num_chunks),
+                [&](size_t) {
+                    // Only used by the fixed-point engines and the planar
+                    // layout
+                    alignas(32) float in_float[2 * chunk_size];
+                    alignas(32) float out_float[2 * chunk_size];
+
+                    size_t chunk;
+                    while ((chunk = next_chunk.fetch_add(1)) < num_chunks) {
+                        const size_t start = chunk * chunk_size;
+                        const size_t stop = std::min(start + chunk_size, sizeOut);
+                        const size_t n = stop - start;
+
+                        switch (m_fftEngine) {
+                            case FFTEngine::FFTW:
+                                if (m_planar) {
+                                    apply_planar(start, stop, in_float, out_float);
+                                }
+                                else {
+                                    apply(in, start, stop, out);
+                                }
+                                break;
+                            case FFTEngine::KISS:
+                            case FFTEngine::KISS_SIMD:
+                                fix_to_float<int16_t, 14>(
+                                        reinterpret_cast<const int16_t*>(
+                                            dataIn->getData()) + 2 * start,
+                                        in_float, n);
+                                apply(reinterpret_cast<const complexf*>(in_float),
+                                        0, n, reinterpret_cast<complexf*>(out_float));
+                                float_to_fix<int16_t, 14>(out_float,
+                                        reinterpret_cast<int16_t*>(
+                                            dataOut->getData()) + 2 * start, n);
+                                break;
+                            case FFTEngine::DEXTER:
+                                fix_to_float<int32_t, 16>(
+                                        reinterpret_cast<const int32_t*>(
+                                            dataIn->getData()) + 2 * start,
+                                        in_float, n);
+                                apply(reinterpret_cast<const complexf*>(in_float),
+                                        0, n, reinterpret_cast<complexf*>(out_float));
+                                float_to_fix<int32_t, 16>(out_float,
+                                        reinterpret_cast<int32_t*>(
+                                            dataOut->getData()) + 2 * start, n);
+                                break;
+                        }
+                    }
+                });
     }
     else {
-        memcpy(dataOut->getData(), dataIn->getData(), sizeOut);
+        // Forward the input without copying it
+        dataOut->swap(*dataIn);
     }
 
     return dataOut->getLength();
@@ -412,14 +1367,21 @@ int MemlessPoly::internal_process(Buffer* const dataIn, Buffer* dataOut)
 
 void MemlessPoly::set_parameter(const string& parameter, const string& value)
 {
+    if (set_pipeline_parameter(parameter, value)) {
+        return;
+    }
+
     if (parameter == "ncoefs") {
         throw ParameterError("Parameter 'ncoefs' is read-only");
     }
     else if (parameter == "coeffile") {
         try {
             ifstream coefs_fstream(value);
+            lock_guard<mutex> lock(m_fallback_mutex);
             load_coefficients(coefs_fstream);
             m_coefs_file = value;
+            m_lut_fallback = false;
+            m_fallback_poly.reset();
         }
         catch (const std::runtime_error &e) {
             throw ParameterError(e.what());
@@ -428,7 +1390,10 @@ void MemlessPoly::set_parameter(const string& parameter, const string& value)
     else if (parameter == "coefs") {
         try {
             stringstream ss(value);
+            lock_guard<mutex> lock(m_fallback_mutex);
             load_coefficients(ss);
+            m_lut_fallback = false;
+            m_fallback_poly.reset();
 
             // Write back to the file to ensure we will start up
             // with the same settings next time
@@ -439,6 +1404,17 @@ void MemlessPoly::set_parameter(const string& parameter, const string& value)
             throw ParameterError(e.what());
         }
     }
+    else if (parameter == "lut_fallback") {
+        if (m_fftEngine != FFTEngine::FFTW) {
+            throw ParameterError("The LUT fallback needs the float samples "
+                    "of the fftw engine");
+        }
+        stringstream ss(value);
+        ss.exceptions ( stringstream::failbit | stringstream::badbit );
+        int fallback = 0;
+        ss >> fallback;
+        set_lut_fallback(fallback != 0);
+    }
     else {
         stringstream ss;
         ss << "Parameter '" << parameter <<
@@ -449,9 +1425,15 @@ void MemlessPoly::set_parameter(const string& parameter, const string& value)
 
 const string MemlessPoly::get_parameter(const string& parameter) const
 {
+    string pipeline_value;
+    if (get_pipeline_parameter(parameter, pipeline_value)) {
+        return pipeline_value;
+    }
+
     stringstream ss;
     if (parameter == "ncoefs") {
-        ss << m_coefs_am.size();
+        const auto settings = std::atomic_load(&m_dpd_settings);
+        ss << (settings ? settings->coefs_am.size() : 0);
     }
     else if (parameter == "coefs") {
         ss << serialise_coefficients();
@@ -459,6 +1441,10 @@ const string MemlessPoly::get_parameter(const string& parameter) const
     else if (parameter == "coeffile") {
         ss << m_coefs_file;
     }
+    else if (parameter == "lut_fallback") {
+        lock_guard<mutex> lock(m_fallback_mutex);
+        ss << (m_lut_fallback ? 1 : 0);
+    }
     else {
         ss << "Parameter '" << parameter <<
             "' is not exported by controllable " << get_rc_name();
@@ -470,8 +1456,14 @@ const string MemlessPoly::get_parameter(const string& parameter) const
 const json::map_t MemlessPoly::get_all_values() const
 {
     json::map_t map;
-    map["ncoefs"].v = m_coefs_am.size();
+    const auto settings = std::atomic_load(&m_dpd_settings);
+    map["ncoefs"].v = settings ? settings->coefs_am.size() : 0;
     map["coefs"].v = serialise_coefficients();
     map["coeffile"].v = m_coefs_file;
+    {
+        lock_guard<mutex> lock(m_fallback_mutex);
+        map["lut_fallback"].v = m_lut_fallback;
+    }
+    get_pipeline_values(map);
     return map;
 }
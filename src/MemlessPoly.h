@@ -30,12 +30,15 @@
 #   include <config.h>
 #endif
 
+#include "ConfigParser.h"
 #include "RemoteControl.h"
 #include "ModPlugin.h"
-#include "ThreadsafeQueue.h"
 
 #include <sys/types.h>
 #include <array>
+#include <algorithm>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <vector>
@@ -46,20 +49,40 @@
 
 enum class dpd_type_t {
     odd_only_poly,
-    lookup_table
+    lookup_table,
+    interpolated_lut
 };
 
 
+/* With the fixed-point FFT engines, the samples are complexfix or
+ * complexfix_wide, and the coefficients apply to their values. */
 class MemlessPoly : public PipelinedModCodec, public RemoteControllable
 {
 public:
-    MemlessPoly(std::string& coefs_file, unsigned int num_threads);
+    MemlessPoly(std::string& coefs_file, unsigned int num_threads,
+            FFTEngine fftEngine = FFTEngine::FFTW,
+            const std::string& rc_name = "memlesspoly");
     MemlessPoly(const MemlessPoly& other) = delete;
     MemlessPoly& operator=(const MemlessPoly& other) = delete;
     virtual ~MemlessPoly();
 
     virtual const char* name() override { return "MemlessPoly"; }
 
+    virtual size_t get_num_parts() const override { return m_num_parts; }
+    virtual void set_num_parts(size_t num_parts) override {
+        m_num_parts = std::max<size_t>(num_parts, 1);
+    }
+
+    virtual bool supports_planar_input() const override {
+        return m_fftEngine == FFTEngine::FFTW;
+    }
+    virtual bool supports_planar_output() const override {
+        return m_fftEngine == FFTEngine::FFTW;
+    }
+
+    // Every sample is predistorted on its own
+    virtual bool supports_streaming() const override { return not m_planar; }
+
     /******* REMOTE CONTROL ********/
     virtual void set_parameter(const std::string& parameter, const std::string& value) override;
     virtual const std::string get_parameter(const std::string& parameter) const override;
@@ -70,66 +93,59 @@ private:
     void load_coefficients(std::istream& coefData);
     std::string serialise_coefficients() const;
 
-    struct worker_t {
-        struct input_data_t {
-            dpd_type_t dpd_type;
-
-            // Valid for polynomial types
-            const float *coefs_am = nullptr;
-            const float *coefs_pm = nullptr;
-
-            // Valid for LUT
-            float lut_scalefactor = 0.0f;
-            const complexf *lut = nullptr;
-
-            const complexf *in = nullptr;
-            size_t start = 0;
-            size_t stop = 0;
-            complexf *out = nullptr;
-        };
-
-        worker_t() {}
-        worker_t(const worker_t& other) = delete;
-        worker_t operator=(const worker_t& other) = delete;
-        worker_t operator=(worker_t&& other) = delete;
-
-        // The move constructor creates a new in_queue and out_queue,
-        // because ThreadsafeQueue is neither copy- nor move-constructible.
-        // Not an issue because creating the workers happens at startup, before
-        // the first work item.
-        worker_t(worker_t&& other) :
-            in_queue(),
-            out_queue(),
-            thread(std::move(other.thread)) {}
-
-        ~worker_t() {
-            if (thread.joinable()) {
-                in_queue.trigger_wakeup();
-                thread.join();
-            }
-        }
-
-        ThreadsafeQueue<input_data_t> in_queue;
-        ThreadsafeQueue<int> out_queue;
-
-        std::thread thread;
-    };
+    /* Replace the odd-only polynomial by an interpolated lookup table
+     * that gives the same correction, or go back to the polynomial.
+     * Other predistortion types are left unchanged. */
+    void set_lut_fallback(bool fallback);
+
+    // Number of threads, the calling one included, that take chunks of
+    // the frame to process from the shared WorkerPool. The AutoTuner
+    // can change it while the frames are processed.
+    std::atomic<size_t> m_num_parts = ATOMIC_VAR_INIT(1);
 
-    std::vector<worker_t> m_workers;
+    FFTEngine m_fftEngine;
 
-    static void worker_thread(worker_t *workerdata);
+    static constexpr size_t lut_entries = 32;
 
-    bool m_dpd_settings_valid = false;
-    dpd_type_t m_dpd_type;
-    std::vector<float> m_coefs_am; // AM/AM coefficients
-    std::vector<float> m_coefs_pm; // AM/PM coefficients
+    // The interpolated lookup table has a configurable size. Entry k is the
+    // correction for a magnitude of k / ilut_scalefactor, and between two
+    // entries, the correction is interpolated linearly.
+    static constexpr size_t ilut_min_entries = 2;
+    static constexpr size_t ilut_max_entries = 65536;
 
-    float m_lut_scalefactor; // Scale value applied before looking up in LUT
+    struct dpd_settings_t {
+        dpd_type_t dpd_type;
+        std::vector<float> coefs_am; // AM/AM coefficients
+        std::vector<float> coefs_pm; // AM/PM coefficients
 
-    static constexpr size_t lut_entries = 32;
-    std::array<complexf, lut_entries> m_lut; // Lookup table correction factors
+        float lut_scalefactor = 0; // Scale value applied before looking up in LUT
+        std::array<complexf, lut_entries> lut; // Lookup table correction factors
+
+        float ilut_scalefactor = 0;
+        std::vector<complexf> ilut;
+        // ilut[k+1] - ilut[k], and 0 for the last entry.
+        std::vector<complexf> ilut_slope;
+    };
+
+    // Never modified once set, and only accessed with std::atomic_load()
+    // and std::atomic_store(). A reload replaces the pointer, and every
+    // frame is processed with the settings that were current when it
+    // started, without ever waiting for a reload. nullptr if the
+    // predistortion is disabled.
+    std::shared_ptr<const dpd_settings_t> m_dpd_settings;
+
+    // Size and range of the lookup table computed from the polynomial.
+    // The output of the device clips I and Q to [-1, 1], larger
+    // magnitudes use the last entry.
+    static constexpr size_t fallback_lut_entries = 1024;
+    static constexpr float fallback_lut_max_magnitude = 1.41421356f;
+
+    // The polynomial settings while the lookup table replaces them,
+    // nullptr otherwise. A reload of the coefficients ends the fallback.
+    mutable std::mutex m_fallback_mutex;
+    bool m_lut_fallback = false;
+    std::shared_ptr<const dpd_settings_t> m_fallback_poly;
 
     std::string& m_coefs_file;
-    mutable std::mutex m_coefs_mutex;
 };
 
@@ -0,0 +1,471 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   Digital predistortion with a memory polynomial, which also corrects
+   the memory effects of the PA.
+*/
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma GCC optimize ("O3")
+
+#include "MemoryPoly.h"
+#include "CpuFeatures.h"
+#include "PcDebug.h"
+#include "Utils.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#    include <immintrin.h>
+#elif defined(__ARM_NEON)
+#    include <arm_neon.h>
+#endif
+
+using namespace std;
+
+constexpr uint8_t file_format_memory_poly = 1;
+
+// Same as in MemlessPoly: the input and output of a chunk fit into the L1
+// cache, and a late thread delays the frame by one chunk at most.
+static constexpr size_t chunk_size = 2048;
+
+constexpr size_t history_len = MemoryPoly::max_memory_taps - 1;
+
+/* All kernels compute outputs start to stop, where in[i - m] is the input
+ * for memory tap m. The vectorised ones stop at the last full vector and
+ * return the index of the first output they did not compute. They give the
+ * same output as the scalar one, the operations happen in the same order,
+ * without fused multiply-add.
+ */
+static void memory_poly_scalar(
+        const float *__restrict coefs_re, const float *__restrict coefs_im,
+        size_t num_orders, size_t num_taps,
+        const complexf *__restrict in, size_t start, size_t stop,
+        complexf *__restrict out)
+{
+    for (size_t i = start; i < stop; i++) {
+        float acc_re = 0.0f;
+        float acc_im = 0.0f;
+
+        for (size_t m = 0; m < num_taps; m++) {
+            const float x_re = in[i - m].real();
+            const float x_im = in[i - m].imag();
+            const float mag_sq = x_re * x_re + x_im * x_im;
+
+            const float *c_re = &coefs_re[m * num_orders];
+            const float *c_im = &coefs_im[m * num_orders];
+            float p_re = c_re[num_orders - 1];
+            float p_im = c_im[num_orders - 1];
+            for (size_t k = num_orders - 1; k-- > 0;) {
+                p_re = c_re[k] + mag_sq * p_re;
+                p_im = c_im[k] + mag_sq * p_im;
+            }
+
+            acc_re += x_re * p_re - x_im * p_im;
+            acc_im += x_re * p_im + x_im * p_re;
+        }
+
+        out[i] = complexf(acc_re, acc_im);
+    }
+}
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+// Compiled for AVX2 even if the rest of the program isn't, and only used if
+// the CPU supports it.
+#  define HAVE_MEMORY_POLY_KERNEL_DISPATCH 1
+
+__attribute__((target("avx2")))
+static size_t memory_poly_avx2(
+        const float *__restrict coefs_re, const float *__restrict coefs_im,
+        size_t num_orders, size_t num_taps,
+        const complexf *__restrict in, size_t start, size_t stop,
+        complexf *__restrict out)
+{
+    size_t i = start;
+    for (; i + 8 <= stop; i += 8) {
+        // Samples in the order (0 1 4 5 | 2 3 6 7)
+        __m256 acc_re = _mm256_setzero_ps();
+        __m256 acc_im = _mm256_setzero_ps();
+
+        for (size_t m = 0; m < num_taps; m++) {
+            const float *x = reinterpret_cast<const float*>(&in[i - m]);
+            const __m256 x0 = _mm256_loadu_ps(x);
+            const __m256 x1 = _mm256_loadu_ps(x + 8);
+            const __m256 x_re = _mm256_shuffle_ps(x0, x1, 0x88);
+            const __m256 x_im = _mm256_shuffle_ps(x0, x1, 0xDD);
+            const __m256 mag_sq = _mm256_add_ps(
+                    _mm256_mul_ps(x_re, x_re), _mm256_mul_ps(x_im, x_im));
+
+            const float *c_re = &coefs_re[m * num_orders];
+            const float *c_im = &coefs_im[m * num_orders];
+            __m256 p_re = _mm256_broadcast_ss(&c_re[num_orders - 1]);
+            __m256 p_im = _mm256_broadcast_ss(&c_im[num_orders - 1]);
+            for (size_t k = num_orders - 1; k-- > 0;) {
+                p_re = _mm256_add_ps(_mm256_broadcast_ss(&c_re[k]),
+                        _mm256_mul_ps(mag_sq, p_re));
+                p_im = _mm256_add_ps(_mm256_broadcast_ss(&c_im[k]),
+                        _mm256_mul_ps(mag_sq, p_im));
+            }
+
+            acc_re = _mm256_add_ps(acc_re, _mm256_sub_ps(
+                        _mm256_mul_ps(x_re, p_re), _mm256_mul_ps(x_im, p_im)));
+            acc_im = _mm256_add_ps(acc_im, _mm256_add_ps(
+                        _mm256_mul_ps(x_re, p_im), _mm256_mul_ps(x_im, p_re)));
+        }
+
+        // Interleaving the lanes again gives samples 0 to 3 and 4 to 7
+        float *y = reinterpret_cast<float*>(&out[i]);
+        _mm256_storeu_ps(y, _mm256_unpacklo_ps(acc_re, acc_im));
+        _mm256_storeu_ps(y + 8, _mm256_unpackhi_ps(acc_re, acc_im));
+    }
+    return i;
+}
+#endif
+
+#if defined(__ARM_NEON)
+static size_t memory_poly_neon(
+        const float *__restrict coefs_re, const float *__restrict coefs_im,
+        size_t num_orders, size_t num_taps,
+        const complexf *__restrict in, size_t start, size_t stop,
+        complexf *__restrict out)
+{
+    size_t i = start;
+    for (; i + 4 <= stop; i += 4) {
+        float32x4_t acc_re = vdupq_n_f32(0.0f);
+        float32x4_t acc_im = vdupq_n_f32(0.0f);
+
+        for (size_t m = 0; m < num_taps; m++) {
+            const float32x4x2_t x = vld2q_f32(
+                    reinterpret_cast<const float*>(&in[i - m]));
+            const float32x4_t mag_sq = vaddq_f32(
+                    vmulq_f32(x.val[0], x.val[0]), vmulq_f32(x.val[1], x.val[1]));
+
+            const float *c_re = &coefs_re[m * num_orders];
+            const float *c_im = &coefs_im[m * num_orders];
+            float32x4_t p_re = vdupq_n_f32(c_re[num_orders - 1]);
+            float32x4_t p_im = vdupq_n_f32(c_im[num_orders - 1]);
+            for (size_t k = num_orders - 1; k-- > 0;) {
+                p_re = vaddq_f32(vdupq_n_f32(c_re[k]), vmulq_f32(mag_sq, p_re));
+                p_im = vaddq_f32(vdupq_n_f32(c_im[k]), vmulq_f32(mag_sq, p_im));
+            }
+
+            acc_re = vaddq_f32(acc_re, vsubq_f32(
+                        vmulq_f32(x.val[0], p_re), vmulq_f32(x.val[1], p_im)));
+            acc_im = vaddq_f32(acc_im, vaddq_f32(
+                        vmulq_f32(x.val[0], p_im), vmulq_f32(x.val[1], p_re)));
+        }
+
+        float32x4x2_t y;
+        y.val[0] = acc_re;
+        y.val[1] = acc_im;
+        vst2q_f32(reinterpret_cast<float*>(&out[i]), y);
+    }
+    return i;
+}
+#endif
+
+using memory_poly_kernel_t = size_t (*)(const float*, const float*,
+        size_t, size_t, const complexf*, size_t, size_t, complexf*);
+
+struct memory_poly_kernel_info_t {
+    // nullptr if there is no vectorised kernel
+    memory_poly_kernel_t kernel = nullptr;
+    const char *name = "scalar";
+};
+
+static memory_poly_kernel_info_t select_memory_poly_kernel()
+{
+    auto& cpu = cpu_features();
+    memory_poly_kernel_info_t k;
+#if defined(HAVE_MEMORY_POLY_KERNEL_DISPATCH)
+    if (cpu.supports(cpu_feature_e::avx2)) {
+        k.kernel = memory_poly_avx2;
+        k.name = "AVX2";
+    }
+#elif defined(__ARM_NEON)
+    if (cpu.supports(cpu_feature_e::neon)) {
+        k.kernel = memory_poly_neon;
+        k.name = "NEON";
+    }
+#endif
+    cpu.register_kernel("MemoryPoly", k.name);
+    return k;
+}
+
+static const memory_poly_kernel_info_t& memory_poly_kernel()
+{
+    static const memory_poly_kernel_info_t kernel = select_memory_poly_kernel();
+    return kernel;
+}
+
+MemoryPoly::MemoryPoly(const std::string& coefs_file, unsigned int num_threads) :
+    PipelinedModCodec(),
+    RemoteControllable("memorypoly"),
+    m_coefs_file(coefs_file),
+    m_buffer(history_len)
+{
+    PDEBUG("MemoryPoly::MemoryPoly(%s) @ %p\n",
+            coefs_file.c_str(), this);
+
+    RC_ADD_PARAMETER(orders, "(Read-only) number of nonlinear orders.");
+    RC_ADD_PARAMETER(memorytaps, "(Read-only) number of memory taps.");
+    RC_ADD_PARAMETER(coefs, "Predistortion coefficients, same format as file.");
+    RC_ADD_PARAMETER(coeffile, "Filename containing coefficients. "
+            "When set, the file gets loaded.");
+    add_pipeline_parameters(m_parameters);
+    add_bypass_parameter(m_parameters);
+
+    if (num_threads == 0) {
+        m_num_parts = WorkerPool::shared().num_threads() + 1;
+    }
+    else {
+        m_num_parts = num_threads + 1;
+    }
+    etiLog.level(info) << "MemoryPoly will process frames on " <<
+        m_num_parts.load() << " threads, using the " <<
+        memory_poly_kernel().name << " kernel";
+
+    ifstream coefs_fstream(m_coefs_file);
+    load_coefficients(coefs_fstream);
+
+    start_pipeline_thread();
+}
+
+MemoryPoly::~MemoryPoly()
+{
+    stop_pipeline_thread();
+}
+
+std::string MemoryPoly::serialise_coefficients() const
+{
+    stringstream ss;
+
+    const auto coefs = std::atomic_load(&m_coefs);
+
+    if (coefs) {
+        ss << (int)file_format_memory_poly << endl;
+        ss << coefs->num_orders << endl;
+        ss << coefs->num_memory_taps << endl;
+        for (size_t i = 0; i < coefs->re.size(); i++) {
+            ss << coefs->re[i] << endl;
+            ss << coefs->im[i] << endl;
+        }
+    }
+
+    return ss.str();
+}
+
+void MemoryPoly::load_coefficients(std::istream& coef_stream)
+{
+    if (!coef_stream) {
+        throw std::runtime_error("MemoryPoly: Could not open file with coefs!");
+    }
+
+    uint32_t file_format_indicator = 0;
+    coef_stream >> file_format_indicator;
+
+    if (file_format_indicator != file_format_memory_poly) {
+        throw std::runtime_error("MemoryPoly: coef file has unknown format " +
+                std::to_string(file_format_indicator));
+    }
+
+    size_t num_orders = 0;
+    size_t num_memory_taps = 0;
+    coef_stream >> num_orders >> num_memory_taps;
+
+    if (num_orders < 1 or num_orders > max_orders) {
+        throw std::runtime_error("MemoryPoly: invalid number of orders: " +
+                std::to_string(num_orders) + " expected 1 to " +
+                std::to_string(max_orders));
+    }
+
+    if (num_memory_taps < 1 or num_memory_taps > max_memory_taps) {
+        throw std::runtime_error("MemoryPoly: invalid number of memory taps: " +
+                std::to_string(num_memory_taps) + " expected 1 to " +
+                std::to_string(max_memory_taps));
+    }
+
+    const size_t n_coefs = num_orders * num_memory_taps;
+    auto coefs = make_shared<coefs_t>();
+    coefs->num_orders = num_orders;
+    coefs->num_memory_taps = num_memory_taps;
+    coefs->re.resize(n_coefs);
+    coefs->im.resize(n_coefs);
+
+    for (size_t n = 0; n < n_coefs; n++) {
+        coef_stream >> coefs->re[n] >> coefs->im[n];
+
+        if (not coef_stream) {
+            etiLog.log(error, "MemoryPoly: coefs should contain %zu coefs, "
+                    "but could only read %zu !", n_coefs, n);
+            throw std::runtime_error("MemoryPoly: coefs file invalid !");
+        }
+    }
+
+    std::atomic_store(&m_coefs, shared_ptr<const coefs_t>(coefs));
+
+    etiLog.log(info, "MemoryPoly loaded %zu orders x %zu memory taps",
+            num_orders, num_memory_taps);
+}
+
+int MemoryPoly::internal_process(Buffer* const dataIn, Buffer* dataOut)
+{
+    const complexf* in = reinterpret_cast<const complexf*>(dataIn->getData());
+    const size_t sizeIn = dataIn->getLength() / sizeof(complexf);
+
+    m_buffer.resize(history_len + sizeIn);
+    std::copy(in, in + sizeIn, m_buffer.begin() + history_len);
+
+    dataOut->setLength(sizeIn * sizeof(complexf));
+    complexf* out = reinterpret_cast<complexf*>(dataOut->getData());
+
+    {
+        // A reload only replaces m_coefs, this frame keeps the
+        // coefficients it started with.
+        const auto coefs = std::atomic_load(&m_coefs);
+
+        if (coefs) {
+            const coefs_t& c = *coefs;
+            const auto& kernel = memory_poly_kernel();
+            const complexf *x = m_buffer.data() + history_len;
+
+            const size_t num_chunks = (sizeIn + chunk_size - 1) / chunk_size;
+            atomic<size_t> next_chunk(0);
+
+            WorkerPool::shared().parallel_for(std::min(m_num_parts.load(), num_chunks),
+                    [&](size_t) {
+                        size_t chunk;
+                        while ((chunk = next_chunk.fetch_add(1)) < num_chunks) {
+                            const size_t start = chunk * chunk_size;
+                            const size_t stop = std::min(start + chunk_size, sizeIn);
+
+                            size_t i = start;
+                            if (kernel.kernel) {
+                                i = kernel.kernel(c.re.data(), c.im.data(),
+                                        c.num_orders, c.num_memory_taps,
+                                        x, start, stop, out);
+                            }
+                            memory_poly_scalar(c.re.data(), c.im.data(),
+                                    c.num_orders, c.num_memory_taps,
+                                    x, i, stop, out);
+                        }
+                    });
+        }
+        else {
+            std::copy(in, in + sizeIn, out);
+        }
+    }
+
+    // Keep the history for the next frame
+    std::copy(m_buffer.end() - history_len, m_buffer.end(), m_buffer.begin());
+    m_buffer.resize(history_len);
+
+    return dataOut->getLength();
+}
+
+void MemoryPoly::set_parameter(const string& parameter, const string& value)
+{
+    if (set_pipeline_parameter(parameter, value)) {
+        return;
+    }
+
+    if (parameter == "orders" or parameter == "memorytaps") {
+        throw ParameterError("Parameter '" + parameter + "' is read-only");
+    }
+    else if (parameter == "coeffile") {
+        try {
+            ifstream coefs_fstream(value);
+            load_coefficients(coefs_fstream);
+            m_coefs_file = value;
+        }
+        catch (const std::runtime_error &e) {
+            throw ParameterError(e.what());
+        }
+    }
+    else if (parameter == "coefs") {
+        try {
+            stringstream ss(value);
+            load_coefficients(ss);
+
+            // Write back to the file to ensure we will start up
+            // with the same settings next time
+            ofstream coefs_fstream(m_coefs_file);
+            coefs_fstream << value;
+        }
+        catch (const std::runtime_error &e) {
+            throw ParameterError(e.what());
+        }
+    }
+    else {
+        stringstream ss;
+        ss << "Parameter '" << parameter <<
+            "' is not exported by controllable " << get_rc_name();
+        throw ParameterError(ss.str());
+    }
+}
+
+const string MemoryPoly::get_parameter(const string& parameter) const
+{
+    string pipeline_value;
+    if (get_pipeline_parameter(parameter, pipeline_value)) {
+        return pipeline_value;
+    }
+
+    stringstream ss;
+    if (parameter == "orders") {
+        const auto coefs = std::atomic_load(&m_coefs);
+        ss << (coefs ? coefs->num_orders : 0);
+    }
+    else if (parameter == "memorytaps") {
+        const auto coefs = std::atomic_load(&m_coefs);
+        ss << (coefs ? coefs->num_memory_taps : 0);
+    }
+    else if (parameter == "coefs") {
+        ss << serialise_coefficients();
+    }
+    else if (parameter == "coeffile") {
+        ss << m_coefs_file;
+    }
+    else {
+        ss << "Parameter '" << parameter <<
+            "' is not exported by controllable " << get_rc_name();
+        throw ParameterError(ss.str());
+    }
+    return ss.str();
+}
+
+const json::map_t MemoryPoly::get_all_values() const
+{
+    json::map_t map;
+    const auto coefs = std::atomic_load(&m_coefs);
+    map["orders"].v = coefs ? coefs->num_orders : 0;
+    map["memorytaps"].v = coefs ? coefs->num_memory_taps : 0;
+    map["coefs"].v = serialise_coefficients();
+    map["coeffile"].v = m_coefs_file;
+    get_pipeline_values(map);
+    return map;
+}
@@ -0,0 +1,112 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   Digital predistortion with a memory polynomial, which also corrects
+   the memory effects of the PA.
+*/
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include "RemoteControl.h"
+#include "ModPlugin.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+/* Computes
+ *
+ *   y(n) = sum_{m=0}^{M-1} x(n-m) sum_{k=0}^{K-1} a_{m,k} |x(n-m)|^(2k)
+ *
+ * with K nonlinear orders, M memory taps and complex coefficients a_{m,k}.
+ * With M = 1, this is the odd-order polynomial of MemlessPoly, with an
+ * AM/AM and AM/PM correction in a single complex coefficient per order.
+ *
+ * The last input samples of a frame are kept for the next frame. Like
+ * MemlessPoly, every frame is processed in chunks by the shared WorkerPool.
+ */
+class MemoryPoly : public PipelinedModCodec, public RemoteControllable
+{
+public:
+    MemoryPoly(const std::string& coefs_file, unsigned int num_threads);
+    MemoryPoly(const MemoryPoly& other) = delete;
+    MemoryPoly& operator=(const MemoryPoly& other) = delete;
+    virtual ~MemoryPoly();
+
+    virtual const char* name() override { return "MemoryPoly"; }
+
+    virtual size_t get_num_parts() const override { return m_num_parts; }
+    virtual void set_num_parts(size_t num_parts) override {
+        m_num_parts = std::max<size_t>(num_parts, 1);
+    }
+
+    // The history carries the memory taps from one call to the next
+    virtual bool supports_streaming() const override { return true; }
+
+    /******* REMOTE CONTROL ********/
+    virtual void set_parameter(const std::string& parameter, const std::string& value) override;
+    virtual const std::string get_parameter(const std::string& parameter) const override;
+    virtual const json::map_t get_all_values() const override;
+
+    static constexpr size_t max_orders = 8;
+    static constexpr size_t max_memory_taps = 16;
+
+private:
+    int internal_process(Buffer* const dataIn, Buffer* dataOut) override;
+    void load_coefficients(std::istream& coef_stream);
+    std::string serialise_coefficients() const;
+
+    // Number of threads, the calling one included, that take chunks of
+    // the frame to process from the shared WorkerPool. The AutoTuner
+    // can change it while the frames are processed.
+    std::atomic<size_t> m_num_parts = ATOMIC_VAR_INIT(1);
+
+    struct coefs_t {
+        size_t num_orders = 0;
+        size_t num_memory_taps = 0;
+        // a_{m,k} is at index m * num_orders + k
+        std::vector<float> re;
+        std::vector<float> im;
+    };
+
+    // Never modified once set, and only accessed with std::atomic_load()
+    // and std::atomic_store(). A reload replaces the pointer, and every
+    // frame is processed with the coefficients that were current when it
+    // started, without ever waiting for a reload. nullptr until valid
+    // coefficients are loaded.
+    std::shared_ptr<const coefs_t> m_coefs;
+
+    std::string m_coefs_file;
+
+    // The last max_memory_taps - 1 input samples of the previous frames,
+    // followed by the input of the current frame. Always keeping the same
+    // number of samples allows to load coefficients with a different
+    // number of taps at any time.
+    std::vector<complexf> m_buffer;
+};
+
@@ -0,0 +1,240 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://www.opendigitalradio.org
+ */
+/*
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Metrics.h"
+#include "Log.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <sstream>
+
+using namespace std;
+
+namespace Metrics {
+
+Registry registry;
+
+// Requests longer than this are not metric scrapes
+static constexpr size_t MAX_REQUEST_SIZE = 8192;
+static constexpr int REQUEST_TIMEOUT_MS = 1000;
+
+Registry::id_t Registry::add(const string& name, const string& help,
+        type_t type, getter_t getter)
+{
+    entry_t entry;
+    entry.name = name;
+    entry.help = help;
+    entry.type = type;
+    entry.getter = getter;
+
+    // The ensemble name, from which set_rc_name_prefix() appended a dot
+    string prefix = get_rc_name_prefix();
+    if (not prefix.empty()) {
+        if (prefix.back() == '.') {
+            prefix.pop_back();
+        }
+
+        string escaped;
+        for (const char c : prefix) {
+            if (c == '\\' or c == '"') {
+                escaped += '\\';
+            }
+            escaped += c;
+        }
+        entry.labels = "{ensemble=\"" + escaped + "\"}";
+    }
+
+    lock_guard<mutex> lock(m_mutex);
+    const id_t id = m_next_id++;
+    m_entries.emplace(id, std::move(entry));
+    return id;
+}
+
+void Registry::remove(id_t id)
+{
+    lock_guard<mutex> lock(m_mutex);
+    m_entries.erase(id);
+}
+
+string Registry::render() const
+{
+    lock_guard<mutex> lock(m_mutex);
+
+    // All samples of a metric must follow its HELP and TYPE lines
+    vector<const entry_t*> entries;
+    entries.reserve(m_entries.size());
+    for (const auto& e : m_entries) {
+        entries.push_back(&e.second);
+    }
+    stable_sort(entries.begin(), entries.end(),
+            [](const entry_t *a, const entry_t *b) { return a->name < b->name; });
+
+    stringstream ss;
+    ss.precision(15);
+    const string *previous_name = nullptr;
+    for (const auto e : entries) {
+        if (previous_name == nullptr or *previous_name != e->name) {
+            ss << "# HELP " << e->name << " " << e->help << "\n" <<
+                "# TYPE " << e->name << " " <<
+                (e->type == type_t::counter ? "counter" : "gauge") << "\n";
+            previous_name = &e->name;
+        }
+        ss << e->name << e->labels << " " << e->getter() << "\n";
+    }
+    return ss.str();
+}
+
+Handle::~Handle()
+{
+    for (const auto id : m_ids) {
+        registry.remove(id);
+    }
+}
+
+void Handle::add_counter(const string& name, const string& help, getter_t getter)
+{
+    m_ids.push_back(registry.add(name, help, type_t::counter, getter));
+}
+
+void Handle::add_gauge(const string& name, const string& help, getter_t getter)
+{
+    m_ids.push_back(registry.add(name, help, type_t::gauge, getter));
+}
+
+HttpExporter::HttpExporter(int port, const string& address) :
+    m_active(true),
+    m_port(port),
+    m_address(address)
+{
+    m_child_thread = thread(&HttpExporter::process, this);
+}
+
+HttpExporter::~HttpExporter()
+{
+    m_active = false;
+
+    if (m_restarter_thread.joinable()) {
+        m_restarter_thread.join();
+    }
+
+    if (m_child_thread.joinable()) {
+        m_child_thread.join();
+    }
+}
+
+void HttpExporter::restart()
+{
+    if (m_restarter_thread.joinable()) {
+        m_restarter_thread.join();
+    }
+
+    m_restarter_thread = thread(&HttpExporter::restart_thread, this);
+}
+
+// Joining the thread takes up to the accept timeout, which is too long
+// for the main loop.
+void HttpExporter::restart_thread()
+{
+    m_active = false;
+
+    if (m_child_thread.joinable()) {
+        m_child_thread.join();
+    }
+
+    m_fault = false;
+    m_active = true;
+    m_child_thread = thread(&HttpExporter::process, this);
+}
+
+void HttpExporter::process()
+{
+    set_thread_name("metrics");
+
+    try {
+        Socket::TCPSocket listen_socket;
+        listen_socket.listen(m_port, m_address);
+
+        etiLog.level(info) << "Metrics: listening on " <<
+            (m_address.empty() ? "*" : m_address) << ":" << m_port;
+
+        while (m_active) {
+            auto sock = listen_socket.accept(1000);
+            if (sock.valid()) {
+                handle_request(sock);
+            }
+        }
+    }
+    catch (const runtime_error& e) {
+        etiLog.level(warn) << "Metrics: Encountered error: " << e.what();
+        m_fault = true;
+    }
+}
+
+void HttpExporter::handle_request(Socket::TCPSocket& socket)
+{
+    // Read until the end of the request header, its content does not
+    // matter except for the method.
+    string request;
+    char buf[1024];
+    try {
+        while (request.find("\r\n\r\n") == string::npos and
+                request.find("\n\n") == string::npos) {
+            const ssize_t ret = socket.recv(buf, sizeof(buf), 0, REQUEST_TIMEOUT_MS);
+            if (ret <= 0) {
+                return;
+            }
+            request.append(buf, ret);
+
+            if (request.size() > MAX_REQUEST_SIZE) {
+                return;
+            }
+        }
+    }
+    catch (const Socket::TCPSocket::Timeout&) {
+        return;
+    }
+    catch (const Socket::TCPSocket::Interrupted&) {
+        return;
+    }
+    catch (const runtime_error& e) {
+        etiLog.level(debug) << "Metrics: receive error: " << e.what();
+        return;
+    }
+
+    string status = "200 OK";
+    string body;
+    if (request.compare(0, 4, "GET ") == 0) {
+        body = registry.render();
+    }
+    else {
+        status = "405 Method Not Allowed";
+    }
+
+    stringstream ss;
+    ss << "HTTP/1.0 " << status << "\r\n" <<
+        "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n" <<
+        "Content-Length: " << body.size() << "\r\n" <<
+        "Connection: close\r\n\r\n" << body;
+    const string response = ss.str();
+    socket.sendall(response.data(), response.size());
+}
+
+} // namespace Metrics
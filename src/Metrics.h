@@ -0,0 +1,126 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://www.opendigitalradio.org
+ */
+/*
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "RemoteControl.h"
+#include "Socket.h"
+
+/* Counters and gauges for monitoring, served in the text format of
+ * Prometheus. Unlike the remote control, reading them does not go through
+ * the modules: every metric is a getter that only loads an atomic the
+ * module updates anyway, so that scraping never takes a lock the signal
+ * processing also takes. */
+namespace Metrics {
+
+enum class type_t { counter, gauge };
+
+using getter_t = std::function<double()>;
+
+class Registry {
+    public:
+        using id_t = uint64_t;
+
+        /* The name must be a valid Prometheus metric name. The metric
+         * gets the label ensemble when the RC name prefix of the calling
+         * thread is set. */
+        id_t add(const std::string& name, const std::string& help,
+                type_t type, getter_t getter);
+        void remove(id_t id);
+
+        std::string render() const;
+
+    private:
+        struct entry_t {
+            std::string name;
+            std::string help;
+            type_t type;
+            std::string labels;
+            getter_t getter;
+        };
+
+        // Protects the list only. Getters are called with it held, so
+        // that remove() waits for a scrape that uses the metric.
+        mutable std::mutex m_mutex;
+        id_t m_next_id = 0;
+        std::map<id_t, entry_t> m_entries;
+};
+
+/* Constructed in Metrics.cpp */
+extern Registry registry;
+
+/* Removes its metrics from the registry when destroyed. Declare it after
+ * the members its getters read, so that it is destroyed before them. */
+class Handle {
+    public:
+        Handle() = default;
+        Handle(const Handle& other) = delete;
+        Handle& operator=(const Handle& other) = delete;
+        ~Handle();
+
+        void add_counter(const std::string& name, const std::string& help,
+                getter_t getter);
+        void add_gauge(const std::string& name, const std::string& help,
+                getter_t getter);
+
+    private:
+        std::vector<Registry::id_t> m_ids;
+};
+
+/* Serves the registry over HTTP, to any GET request. It is restarted like
+ * a remote controller after a fault. */
+class HttpExporter : public BaseRemoteController {
+    public:
+        HttpExporter(int port, const std::string& address);
+        HttpExporter(const HttpExporter& other) = delete;
+        HttpExporter& operator=(const HttpExporter& other) = delete;
+        ~HttpExporter();
+
+        virtual bool fault_detected() override { return m_fault; }
+        virtual void restart() override;
+
+    private:
+        void restart_thread();
+        void process();
+        void handle_request(Socket::TCPSocket& socket);
+
+        std::atomic<bool> m_active = ATOMIC_VAR_INIT(false);
+        std::atomic<bool> m_fault = ATOMIC_VAR_INIT(false);
+        int m_port;
+        std::string m_address;
+        std::thread m_restarter_thread;
+        std::thread m_child_thread;
+};
+
+} // namespace Metrics
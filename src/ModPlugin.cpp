@@ -26,11 +26,19 @@
 
 #include "ModPlugin.h"
 #include "PcDebug.h"
+#include "PipelineExecutor.h"
+#include "RemoteControl.h"
 #include "Utils.h"
+#include <algorithm>
+#include <chrono>
 #include <stdexcept>
 #include <string>
 #include <cstring>
 
+// Recycled buffers beyond this number are freed. One is enough once the
+// pipeline is running, the margin absorbs jitter between the threads.
+static constexpr size_t max_recycled_buffers = 2;
+
 #define MODASSERT(cond) \
     if (not (cond)) { \
         throw std::runtime_error("Assertion failure: " #cond " for " + \
@@ -52,9 +60,34 @@ int ModCodec::process(
 {
     MODASSERT(dataIn.size() == 1);
     MODASSERT(dataOut.size() == 1);
+    if (supports_in_place()) {
+        // Move the input data into the output buffer, and give the previous
+        // output allocation back to the upstream block.
+        dataOut[0]->swap(*dataIn[0]);
+        return process(dataOut[0], dataOut[0]);
+    }
     return process(dataIn[0], dataOut[0]);
 }
 
+void interleaved_to_planar(float *samples, size_t n, std::vector<float>& scratch)
+{
+    scratch.resize(n);
+    // The I values move towards the start, always from a higher index
+    for (size_t i = 0; i < n; i++) {
+        scratch[i] = samples[2 * i + 1];
+        samples[i] = samples[2 * i];
+    }
+    std::copy(scratch.begin(), scratch.end(), samples + n);
+}
+
+void planar_to_interleaved(const float *re, const float *im, float *out, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        out[2 * i] = re[i];
+        out[2 * i + 1] = im[i];
+    }
+}
+
 int ModMux::process(
             std::vector<Buffer*> dataIn,
             std::vector<Buffer*> dataOut)
@@ -75,49 +108,223 @@ int ModOutput::process(
 
 void PipelinedModCodec::stop_pipeline_thread()
 {
-    m_input_queue.push({});
-    if (m_thread.joinable()) {
-        m_thread.join();
+    if (m_executor) {
+        push_input({});
+        std::unique_lock<std::mutex> lock(m_pending_mutex);
+        m_pending_cv.wait(lock, [&]{ return m_pending == 0; });
+    }
+    else {
+        m_input_queue.push({});
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
     }
 }
 
 void PipelinedModCodec::start_pipeline_thread()
 {
     m_running = true;
-    m_thread = std::thread(&PipelinedModCodec::process_thread, this);
+    m_executor = PipelineExecutor::shared();
+    if (not m_executor) {
+        m_thread = std::thread(&PipelinedModCodec::process_thread, this);
+    }
+}
+
+void PipelinedModCodec::push_input(Buffer&& dataIn)
+{
+    m_input_queue.push(std::move(dataIn));
+
+    if (not m_executor) {
+        return;
+    }
+
+    bool start_task = false;
+    {
+        std::lock_guard<std::mutex> lock(m_pending_mutex);
+        start_task = (m_pending++ == 0);
+    }
+
+    if (start_task) {
+        m_executor->submit(m_priority, [this]{ run_pending(); });
+    }
+}
+
+void PipelinedModCodec::run_pending()
+{
+    // Only one task per block exists at any time, which keeps the input
+    // queue single-consumer and the frames in order.
+    while (true) {
+        Buffer dataIn;
+        m_input_queue.try_pop(dataIn);
+
+        if (m_running and not process_one(dataIn)) {
+            m_running = false;
+        }
+
+        std::lock_guard<std::mutex> lock(m_pending_mutex);
+        if (--m_pending == 0) {
+            m_pending_cv.notify_all();
+            return;
+        }
+    }
 }
 
 int PipelinedModCodec::process(Buffer* dataIn, Buffer* dataOut)
 {
+    if (m_synchronous) {
+        if (m_bypass) {
+            dataOut->swap(*dataIn);
+            return dataOut->getLength();
+        }
+        dataOut->setLength(dataIn->getLength());
+        return timed_process(dataIn, dataOut);
+    }
+
     if (!m_running) {
         return 0;
     }
 
+    // Give the upstream block a previously consumed allocation, so that it
+    // doesn't have to allocate a new one.
+    const size_t in_length = dataIn->getLength();
     Buffer inbuffer;
+    m_recycled_inputs.try_pop(inbuffer);
     std::swap(inbuffer, *dataIn);
-    m_input_queue.push(std::move(inbuffer));
+    push_input(std::move(inbuffer));
 
-    if (m_ready_to_output_data) {
+    if (m_primed_outputs == m_depth) {
+        const auto start = std::chrono::steady_clock::now();
         Buffer outbuffer;
         m_output_queue.wait_and_pop(outbuffer);
+        const uint64_t waited_us =
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start).count();
+        if (waited_us > m_max_wait_us.load(std::memory_order_relaxed)) {
+            m_max_wait_us.store(waited_us, std::memory_order_relaxed);
+        }
+
         std::swap(outbuffer, *dataOut);
+        m_recycled_outputs.push(std::move(outbuffer), max_recycled_buffers);
     }
     else {
         dataOut->setLength(dataIn->getLength());
         if (dataOut->getLength() > 0) {
             memset(dataOut->getData(), 0, dataOut->getLength());
         }
-        m_ready_to_output_data = true;
+        m_primed_outputs++;
     }
 
+    m_frame_bytes.store(std::max(in_length, dataOut->getLength()),
+            std::memory_order_relaxed);
     return dataOut->getLength();
 
 }
 
+void PipelinedModCodec::set_pipeline_depth(size_t depth)
+{
+    if (depth == 0 or depth > max_pipeline_depth) {
+        throw std::invalid_argument("Pipeline depth must be between 1 and " +
+                std::to_string(max_pipeline_depth));
+    }
+    if (m_primed_outputs > 0) {
+        throw std::logic_error("Pipeline depth changed after the first frame");
+    }
+    m_depth = depth;
+}
+
+void PipelinedModCodec::run_synchronously()
+{
+    if (m_primed_outputs > 0) {
+        throw std::logic_error("Pipelined block made synchronous after the first frame");
+    }
+    stop_pipeline_thread();
+    m_synchronous = true;
+}
+
+void PipelinedModCodec::add_pipeline_parameters(
+        std::list<std::vector<std::string> >& parameters)
+{
+    parameters.push_back({"pipeline_depth",
+            "(Read-only) number of frames of latency of the block."});
+    parameters.push_back({"pipeline_queue",
+            "(Read-only) number of frames waiting to be processed."});
+    parameters.push_back({"pipeline_max_wait",
+            "(Read-only) longest time the flowgraph waited for an output, in ms."});
+}
+
+bool PipelinedModCodec::get_pipeline_parameter(const std::string& parameter,
+        std::string& value) const
+{
+    if (parameter == "pipeline_depth") {
+        value = std::to_string(m_depth);
+    }
+    else if (parameter == "pipeline_queue") {
+        value = std::to_string(m_input_queue.size());
+    }
+    else if (parameter == "pipeline_max_wait") {
+        value = std::to_string(m_max_wait_us.load() / 1000.0);
+    }
+    else if (parameter == "bypass" and m_bypassable) {
+        value = m_bypass ? "1" : "0";
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+void PipelinedModCodec::get_pipeline_values(json::map_t& map) const
+{
+    map["pipeline_depth"].v = (uint64_t)m_depth;
+    map["pipeline_queue"].v = (uint64_t)m_input_queue.size();
+    map["pipeline_max_wait"].v = m_max_wait_us.load() / 1000.0;
+    if (m_bypassable) {
+        map["bypass"].v = m_bypass.load();
+    }
+}
+
+size_t PipelinedModCodec::memory_usage() const
+{
+    const size_t num_buffers = m_input_queue.size() + m_output_queue.size() +
+        m_recycled_inputs.size() + m_recycled_outputs.size();
+    return num_buffers * m_frame_bytes.load(std::memory_order_relaxed);
+}
+
+void PipelinedModCodec::add_bypass_parameter(
+        std::list<std::vector<std::string> >& parameters)
+{
+    m_bypassable = true;
+    parameters.push_back({"bypass",
+            "1 to forward the samples unprocessed, 0 to process them."});
+}
+
+bool PipelinedModCodec::set_pipeline_parameter(const std::string& parameter,
+        const std::string& value)
+{
+    if (parameter == "bypass" and m_bypassable) {
+        if (value == "0" or value == "1") {
+            m_bypass = (value == "1");
+        }
+        else {
+            throw ParameterError("Parameter 'bypass' must be 0 or 1");
+        }
+        return true;
+    }
+    else if (parameter == "pipeline_depth" or parameter == "pipeline_queue" or
+            parameter == "pipeline_max_wait") {
+        throw ParameterError("Parameter '" + parameter + "' is read-only");
+    }
+    return false;
+}
+
 meta_vec_t PipelinedModCodec::process_metadata(const meta_vec_t& metadataIn)
 {
+    if (m_synchronous) {
+        return metadataIn;
+    }
+
     m_metadata_fifo.push_back(metadataIn);
-    if (m_metadata_fifo.size() == 2) {
+    if (m_metadata_fifo.size() > m_depth) {
         auto r = std::move(m_metadata_fifo.front());
         m_metadata_fifo.pop_front();
         return r;
@@ -132,23 +339,83 @@ void PipelinedModCodec::process_thread()
     set_thread_name(name());
     set_realtime_prio(1);
 
+    std::string role = name();
+    std::transform(role.begin(), role.end(), role.begin(), ::tolower);
+    set_thread_placement(role, "pipeline");
+
     while (m_running) {
         Buffer dataIn;
         m_input_queue.wait_and_pop(dataIn);
 
-        if (dataIn.getLength() == 0) {
+        if (not process_one(dataIn)) {
             break;
         }
+    }
+
+    m_running = false;
+}
+
+bool PipelinedModCodec::process_one(Buffer& dataIn)
+{
+    if (dataIn.getLength() == 0) {
+        return false;
+    }
+
+    bool running = true;
+
+    const bool bypass = m_bypass;
+    if (bypass or internal_supports_in_place()) {
+        if (not bypass and timed_process(&dataIn, &dataIn) == 0) {
+            running = false;
+        }
+
+        m_output_queue.push(std::move(dataIn));
 
+        // The previous outputs become the next inputs
+        Buffer spare;
+        if (m_recycled_outputs.try_pop(spare)) {
+            m_recycled_inputs.push(std::move(spare), max_recycled_buffers);
+        }
+    }
+    else {
         Buffer dataOut;
+        m_recycled_outputs.try_pop(dataOut);
         dataOut.setLength(dataIn.getLength());
 
-        if (internal_process(&dataIn, &dataOut) == 0) {
-            m_running = false;
+        if (timed_process(&dataIn, &dataOut) == 0) {
+            running = false;
         }
 
         m_output_queue.push(std::move(dataOut));
+        m_recycled_inputs.push(std::move(dataIn), max_recycled_buffers);
     }
 
-    m_running = false;
+    return running;
+}
+
+int PipelinedModCodec::timed_process(Buffer* const dataIn, Buffer* dataOut)
+{
+    const auto start = std::chrono::steady_clock::now();
+    const int ret = internal_process(dataIn, dataOut);
+    const double duration_us = std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - start).count();
+
+    std::lock_guard<std::mutex> lock(m_process_time_mutex);
+    m_process_count++;
+    m_process_total_us += duration_us;
+    m_process_max_us = std::max(m_process_max_us, duration_us);
+    return ret;
+}
+
+PipelinedModCodec::process_time_t PipelinedModCodec::take_process_time()
+{
+    std::lock_guard<std::mutex> lock(m_process_time_mutex);
+    process_time_t t;
+    t.count = m_process_count;
+    t.mean_us = m_process_count ? m_process_total_us / m_process_count : 0;
+    t.max_us = m_process_max_us;
+    m_process_count = 0;
+    m_process_total_us = 0;
+    m_process_max_us = 0;
+    return t;
 }
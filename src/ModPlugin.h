@@ -31,17 +31,30 @@
 #endif
 
 #include "Buffer.h"
+#include "HalfFloat.h"
 #include "ThreadsafeQueue.h"
+#include "SPSCQueue.h"
 #include "TimestampDecoder.h"
+#include "Json.h"
+#include <list>
+#include <string>
 #include <vector>
 #include <thread>
 #include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+class PipelineExecutor;
 
 // All flowgraph elements derive from ModPlugin, or a variant of it.
 // Some ModPlugins also support handling metadata.
 
 struct flowgraph_metadata {
     frame_timestamp ts;
+
+    // The frame only contains zeros, given by the DabModulator while
+    // the output is muted
+    bool filler = false;
 };
 
 using meta_vec_t = std::vector<flowgraph_metadata>;
@@ -64,6 +77,18 @@ public:
             std::vector<Buffer*> dataOut) = 0;
     virtual const char* name() = 0;
     virtual ~ModPlugin() = default;
+
+    /* Bytes of memory the plugin keeps from one frame to the next, like
+     * its history, workspaces and queued frames, but not the buffers of
+     * the flowgraph. Safe to call from another thread. */
+    virtual size_t memory_usage() const { return 0; }
+
+    /* A plugin whose process() returns 0 until it has received enough
+     * input, like the BlockPartitioner, stops the run of the flowgraph.
+     * The flowgraph then processes the nodes whose output is only used
+     * after it, like the PhaseReference, after it, so that they only run
+     * when it gives an output. */
+    virtual bool may_stop_run() const { return false; }
 };
 
 /* Inputs are sources, the output buffers without reading any */
@@ -76,7 +101,18 @@ public:
     virtual int process(Buffer* dataOut) = 0;
 };
 
-/* Codecs are 1-input 1-output flowgraph plugins */
+/* Codecs are 1-input 1-output flowgraph plugins
+ *
+ * The flowgraph gives the input buffer to the codec for the duration of
+ * process(), nobody else reads it afterwards. A codec that doesn't modify
+ * the data, or that can compute its output in the input buffer, may
+ * therefore swap dataIn and dataOut instead of copying. The previous
+ * allocation of dataOut is then reused by the upstream block.
+ *
+ * Codecs that only touch every sample once and produce at most as many
+ * bytes as they consume can declare that they support in-place processing.
+ * Their process() is then called with dataIn == dataOut.
+ */
 class ModCodec : public ModPlugin
 {
 public:
@@ -84,11 +120,61 @@ public:
             std::vector<Buffer*> dataIn,
             std::vector<Buffer*> dataOut);
     virtual int process(Buffer* const dataIn, Buffer* dataOut) = 0;
+
+    virtual bool supports_in_place() const { return false; }
+
+    /* Complex float samples are normally interleaved (I, Q, I, Q...). In
+     * the planar layout, the first half of the buffer contains the I
+     * values of all samples and the second half their Q values, which
+     * lets vector kernels work without shuffles.
+     *
+     * A codec that can write planar output, read planar input, or both,
+     * says so here. If it does both, its output keeps the layout of its
+     * input. The modulator calls set_planar() on a chain of codecs that
+     * starts with one that writes planar output, continues with codecs
+     * that do both and ends with one that reads planar input. This happens
+     * before the first process(). */
+    virtual bool supports_planar_input() const { return false; }
+    virtual bool supports_planar_output() const { return false; }
+    void set_planar(bool planar) { m_planar = planar; }
+    bool planar() const { return m_planar; }
+
+    /* The complex float samples between two codecs can be stored as pairs
+     * of 16-bit floats, see HalfFloat.h, which halves the memory traffic
+     * of the buffer. The modulator calls set_half_output() on a codec that
+     * supports it, and set_half_input() with the same format on the codec
+     * that reads its output, before the first process(). Only interleaved
+     * samples are stored this way. */
+    virtual bool supports_half_input() const { return false; }
+    virtual bool supports_half_output() const { return false; }
+    void set_half_input(half_format_e format) { m_half_input = format; }
+    void set_half_output(half_format_e format) { m_half_output = format; }
+
+    /* A codec that gives the same output when its input is cut into
+     * consecutive parts of any length that are processed one after the
+     * other, and whose output is not larger than its input, can be run by
+     * the SymbolStreamer. */
+    virtual bool supports_streaming() const { return false; }
+
+protected:
+    bool m_planar = false;
+    half_format_e m_half_input = half_format_e::none;
+    half_format_e m_half_output = half_format_e::none;
 };
 
+/* Convert n complex float samples from the interleaved to the planar
+ * layout in place, and back from the two halves of a planar buffer into
+ * out, which must not overlap them. */
+void interleaved_to_planar(float *samples, size_t n, std::vector<float>& scratch);
+void planar_to_interleaved(const float *re, const float *im, float *out, size_t n);
+
 /* Pipelined ModCodecs run their processing in a separate thread, and
- * have a one-call-to-process() latency. Because of this latency, they
- * must also handle the metadata
+ * have a latency of one or more calls to process(). Because of this
+ * latency, they must also handle the metadata
+ *
+ * Buffers are moved between the flowgraph and the processing thread, and
+ * the allocations are recycled in both directions so that no memory
+ * gets allocated or copied once the pipeline is running.
  */
 class PipelinedModCodec : public ModCodec, public ModMetadata
 {
@@ -98,6 +184,53 @@ public:
 
     virtual meta_vec_t process_metadata(const meta_vec_t& metadataIn) final;
 
+    // The buffers are already moved in and out of the pipeline thread
+    virtual bool supports_in_place() const final { return false; }
+
+    /* When the blocks share the PipelineExecutor threads, the frames of
+     * the blocks with a higher priority are processed first. */
+    void set_pipeline_priority(int priority) { m_priority = priority; }
+
+    /* Number of calls to process() before an input comes out of the
+     * block. Every additional frame of latency lets the block absorb one
+     * more slow frame without delaying the output. Must be set before
+     * the first call to process(). */
+    static constexpr size_t max_pipeline_depth = 8;
+    void set_pipeline_depth(size_t depth);
+    size_t get_pipeline_depth() const { return m_depth; }
+
+    /* Stop the pipeline thread, process() then calls internal_process()
+     * directly and the block has no latency. Used by the SymbolStreamer,
+     * must be called before the first call to process(). */
+    void run_synchronously(void);
+
+    /* A bypassed block forwards its input buffers to its output without
+     * calling internal_process, which costs no processing but keeps the
+     * latency of the pipeline. It can be bypassed and activated again at
+     * any time. */
+    void set_bypass(bool bypass) { m_bypass = bypass; }
+    bool bypassed() const { return m_bypass; }
+
+    /* Number of calls to internal_process since the previous call, and
+     * their mean and longest duration. Used by the AutoTuner. */
+    struct process_time_t {
+        uint64_t count = 0;
+        double mean_us = 0;
+        double max_us = 0;
+    };
+    process_time_t take_process_time();
+
+    /* The blocks that split their frames into parts for the shared
+     * WorkerPool return the number of parts, the calling thread included,
+     * and the other blocks 0. A new number of parts applies from the next
+     * frame on. */
+    virtual size_t get_num_parts() const { return 0; }
+    virtual void set_num_parts(size_t num_parts) { }
+
+    // The buffers in the queues of the pipeline, assuming they all have
+    // the size of the latest frame
+    virtual size_t memory_usage() const override;
+
 protected:
     // Once the instance implementing PipelinedModCodec has been constructed,
     // it must call start_pipeline_thread()
@@ -109,17 +242,74 @@ protected:
     // The real processing must be implemented in internal_process
     virtual int internal_process(Buffer* const dataIn, Buffer* dataOut) = 0;
 
+    // Same meaning as ModCodec::supports_in_place(), but for internal_process
+    virtual bool internal_supports_in_place() const { return false; }
+
+    // The blocks that are RemoteControllable export the read-only
+    // pipeline_depth, pipeline_queue and pipeline_max_wait parameters
+    // with these, get_pipeline_parameter returns false for other names.
+    static void add_pipeline_parameters(
+            std::list<std::vector<std::string> >& parameters);
+    bool get_pipeline_parameter(const std::string& parameter,
+            std::string& value) const;
+    void get_pipeline_values(json::map_t& map) const;
+
+    // The blocks that can be bypassed through the remote control also
+    // export the bypass parameter, set_pipeline_parameter returns false
+    // for other names. Throws a ParameterError for invalid values.
+    void add_bypass_parameter(
+            std::list<std::vector<std::string> >& parameters);
+    bool set_pipeline_parameter(const std::string& parameter,
+            const std::string& value);
+
 private:
-    bool m_ready_to_output_data = false;
+    bool m_synchronous = false;
+    size_t m_depth = 1;
+    // Number of zero outputs given while the pipeline fills up
+    size_t m_primed_outputs = 0;
+    // Longest time process() waited for an output, in microseconds
+    std::atomic<uint64_t> m_max_wait_us = ATOMIC_VAR_INIT(0);
+    // Larger of the input and output length of the latest frame
+    std::atomic<size_t> m_frame_bytes = ATOMIC_VAR_INIT(0);
+
+    bool m_bypassable = false;
+    std::atomic<bool> m_bypass = ATOMIC_VAR_INIT(false);
+
+    SPSCQueue<Buffer> m_input_queue;
+    SPSCQueue<Buffer> m_output_queue;
 
-    ThreadsafeQueue<Buffer> m_input_queue;
-    ThreadsafeQueue<Buffer> m_output_queue;
+    // Input buffers already consumed by the thread, given back to the
+    // upstream block in exchange for the next input.
+    SPSCQueue<Buffer> m_recycled_inputs;
+    // Previous output buffers, reused by the thread for the next output.
+    SPSCQueue<Buffer> m_recycled_outputs;
 
     std::deque<meta_vec_t> m_metadata_fifo;
 
     std::atomic<bool> m_running = ATOMIC_VAR_INIT(false);
     std::thread m_thread;
     void process_thread(void);
+
+    // Process one input, returns false when the pipeline must stop
+    bool process_one(Buffer& dataIn);
+
+    // Calls internal_process, and adds its duration to the process time
+    int timed_process(Buffer* const dataIn, Buffer* dataOut);
+    std::mutex m_process_time_mutex;
+    uint64_t m_process_count = 0;
+    double m_process_total_us = 0;
+    double m_process_max_us = 0;
+
+    // Without a PipelineExecutor, the block runs in m_thread. Otherwise
+    // one task at a time drains the input queue, m_pending counts the
+    // inputs not yet processed.
+    PipelineExecutor *m_executor = nullptr;
+    int m_priority = 0;
+    size_t m_pending = 0;
+    std::mutex m_pending_mutex;
+    std::condition_variable m_pending_cv;
+    void push_input(Buffer&& dataIn);
+    void run_pending(void);
 };
 
 
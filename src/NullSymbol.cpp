@@ -50,8 +50,12 @@ int NullSymbol::process(Buffer* dataOut)
 {
     PDEBUG("NullSymbol::process(dataOut: %p)\n", dataOut);
 
-    dataOut->setLength(m_numCarriers * m_typeSize);
-    memset(dataOut->getData(), 0, dataOut->getLength());
+    // Nothing writes into our output, it only needs to be zeroed once
+    const size_t length = m_numCarriers * m_typeSize;
+    if (dataOut->getLength() != length) {
+        dataOut->setLength(length);
+        memset(dataOut->getData(), 0, dataOut->getLength());
+    }
 
     return dataOut->getLength();
 }
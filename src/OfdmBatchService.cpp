@@ -0,0 +1,227 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "OfdmBatchService.h"
+#include "Buffer.h"
+#include "ConfigParser.h"
+#include "Log.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+OfdmBatchService::OfdmBatchService(size_t nbSymbols, size_t spacing,
+        size_t numSlots, chrono::milliseconds timeout) :
+    m_nbSymbols(nbSymbols),
+    m_spacing(spacing),
+    m_numSlots(numSlots),
+    m_timeout(timeout),
+    m_attached(numSlots, false),
+    m_arrived(numSlots, false)
+{
+    if (numSlots == 0) {
+        throw std::invalid_argument("OfdmBatchService: no slot");
+    }
+
+    const size_t batch_size = m_numSlots * m_nbSymbols * m_spacing;
+    m_in = (fftwf_complex*)alloc_workspace(
+            2 * sizeof(fftwf_complex) * batch_size);
+    m_out = m_in + batch_size;
+
+    // Like the batch plan of the OfdmGeneratorCF32, the plan keeps its
+    // input, whose bins outside the carriers are only zeroed once
+    const int N = m_spacing;
+    {
+        lock_guard<mutex> lock(fftw_planner_mutex);
+        const unsigned plan_flags = prepare_fftw_planner();
+        m_plan = fftwf_plan_many_dft(1, &N, m_numSlots * m_nbSymbols,
+                m_in, nullptr, 1, N,
+                m_out, nullptr, 1, N,
+                FFTW_BACKWARD, plan_flags | FFTW_PRESERVE_INPUT);
+        save_fftw_wisdom();
+    }
+
+    memset(m_in, 0, sizeof(fftwf_complex) * batch_size);
+}
+
+OfdmBatchService::~OfdmBatchService()
+{
+    lock_guard<mutex> lock(fftw_planner_mutex);
+    if (m_plan) {
+        fftwf_destroy_plan(m_plan);
+    }
+    free_workspace(m_in);
+}
+
+void OfdmBatchService::assign(vector<mod_settings_t>& ensembles)
+{
+    // By transmission mode, the indices of the eligible ensembles
+    map<unsigned, vector<size_t> > groups;
+    for (size_t i = 0; i < ensembles.size(); i++) {
+        const auto& s = ensembles[i];
+        if (not s.sharedBatchedFft) {
+            continue;
+        }
+
+        // The OfdmGeneratorCF32 only transforms all symbols at once when
+        // it does not split them, and every TX channel has its own
+        const char *reason = nullptr;
+        if (s.fftEngine != FFTEngine::FFTW) {
+            reason = "it does not use the fftw engine";
+        }
+        else if (s.ofdmNumThreads > 0) {
+            reason = "its OFDM symbols are processed in parallel";
+        }
+        else if (s.txChannels.size() > 1) {
+            reason = "it has several TX channels";
+        }
+        else if (s.lowMemory) {
+            reason = "of general.low_memory";
+        }
+
+        if (reason) {
+            etiLog.level(warn) << "OfdmBatchService: ensemble " <<
+                s.ensembleName << " keeps its own FFT, because " << reason;
+            continue;
+        }
+        groups[s.dabMode == 0 ? 1 : s.dabMode].push_back(i);
+    }
+
+    for (const auto& group : groups) {
+        const unsigned mode = group.first;
+        const auto& members = group.second;
+        if (members.size() < 2) {
+            etiLog.level(warn) << "OfdmBatchService: ensemble " <<
+                ensembles[members.front()].ensembleName << " is the only " <<
+                "one in mode " << mode << ", it keeps its own FFT";
+            continue;
+        }
+
+        // Like DabModulator::setMode(), with the null symbol
+        size_t nbSymbols = 0;
+        size_t spacing = 0;
+        switch (mode) {
+            case 1: nbSymbols = 77; spacing = 2048; break;
+            case 2: nbSymbols = 77; spacing = 512; break;
+            case 3: nbSymbols = 154; spacing = 256; break;
+            case 4: nbSymbols = 77; spacing = 1024; break;
+            default: throw std::runtime_error("OfdmBatchService: invalid mode");
+        }
+
+        auto service = make_shared<OfdmBatchService>(nbSymbols, spacing,
+                members.size(), transmission_frame_duration(mode));
+
+        stringstream ss;
+        for (size_t slot = 0; slot < members.size(); slot++) {
+            auto& s = ensembles[members[slot]];
+            s.batchedFft = true;
+            s.ofdmBatchService = service;
+            s.ofdmBatchSlot = slot;
+            ss << (slot ? ", " : "") << s.ensembleName;
+        }
+        etiLog.level(info) << "OfdmBatchService: mode " << mode <<
+            ", one FFT plan for the symbols of the ensembles " << ss.str();
+    }
+}
+
+fftwf_complex *OfdmBatchService::input(size_t slot)
+{
+    if (slot >= m_numSlots) {
+        throw std::out_of_range("OfdmBatchService: invalid slot");
+    }
+    return m_in + slot * m_nbSymbols * m_spacing;
+}
+
+bool OfdmBatchService::attach(size_t slot)
+{
+    if (slot >= m_numSlots) {
+        throw std::out_of_range("OfdmBatchService: invalid slot");
+    }
+
+    lock_guard<mutex> lock(m_mutex);
+    if (m_attached[slot]) {
+        return false;
+    }
+    m_attached[slot] = true;
+    m_numAttached++;
+    return true;
+}
+
+void OfdmBatchService::detach(size_t slot)
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        if (not m_attached[slot]) {
+            return;
+        }
+        m_attached[slot] = false;
+        m_numAttached--;
+    }
+    // The others may now be all there
+    m_cond.notify_all();
+}
+
+bool OfdmBatchService::transform(size_t slot, fftwf_complex *out)
+{
+    unique_lock<mutex> lock(m_mutex);
+    if (not m_attached[slot] or m_arrived[slot]) {
+        throw std::logic_error("OfdmBatchService: slot not attached");
+    }
+
+    m_arrived[slot] = true;
+    m_numArrived++;
+    const uint64_t round = m_round;
+    const auto deadline = chrono::steady_clock::now() + m_timeout;
+
+    while (m_round == round) {
+        if (m_numArrived == m_numAttached) {
+            // The detached slots get transformed as well, their outputs
+            // are not read
+            fftwf_execute(m_plan);
+            m_round++;
+            m_numArrived = 0;
+            std::fill(m_arrived.begin(), m_arrived.end(), false);
+            m_cond.notify_all();
+            break;
+        }
+
+        if (m_cond.wait_until(lock, deadline) == cv_status::timeout and
+                m_round == round and m_numArrived < m_numAttached) {
+            m_arrived[slot] = false;
+            m_numArrived--;
+            return false;
+        }
+    }
+    lock.unlock();
+
+    // The next round needs this slot, it cannot overwrite the output yet
+    const size_t frame_size = m_nbSymbols * m_spacing;
+    memcpy(out, m_out + slot * frame_size, frame_size * sizeof(fftwf_complex));
+    return true;
+}
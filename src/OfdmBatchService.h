@@ -0,0 +1,103 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include <fftw3.h>
+
+struct mod_settings_t;
+
+/* Transforms the transmission frames of several ensembles that use the
+ * same transmission mode with one FFTW plan over the symbols of all of
+ * them, see general.shared_batched_fft.
+ *
+ * Every ensemble has a slot, with its part of the input of the plan. Its
+ * OfdmGeneratorCF32 copies the carriers of a frame to its input, and calls
+ * transform(). The plan runs once all attached generators have called it,
+ * and they then copy their part of the output. A generator that waits for
+ * longer than the timeout, usually a transmission frame, takes its slot
+ * out of the current round, and transforms its frame with its own plan:
+ * the ensembles do not stop each other when one of them has no input. */
+class OfdmBatchService
+{
+    public:
+        // nbSymbols includes the null symbol
+        OfdmBatchService(size_t nbSymbols, size_t spacing, size_t numSlots,
+                std::chrono::milliseconds timeout);
+        ~OfdmBatchService();
+        OfdmBatchService(const OfdmBatchService&) = delete;
+        OfdmBatchService& operator=(const OfdmBatchService&) = delete;
+
+        /* Give the ensembles that can share their FFT a service for their
+         * transmission mode, and their slot in it. Their batchedFft gets
+         * enabled. Needs at least two eligible ensembles with the same
+         * mode, the others keep their own plans. */
+        static void assign(std::vector<mod_settings_t>& ensembles);
+
+        size_t nb_symbols() const { return m_nbSymbols; }
+        size_t spacing() const { return m_spacing; }
+
+        /* The input of the slot, nbSymbols * spacing values where the
+         * bins outside the carriers are zero. It keeps its contents,
+         * and only its generator writes to it. */
+        fftwf_complex *input(size_t slot);
+
+        /* Only one generator can be attached to a slot. Returns false if
+         * another one is. */
+        bool attach(size_t slot);
+        void detach(size_t slot);
+
+        /* Transform the input of the slot to out. Returns false after a
+         * timeout, without touching out. */
+        bool transform(size_t slot, fftwf_complex *out);
+
+    private:
+        const size_t m_nbSymbols;
+        const size_t m_spacing;
+        const size_t m_numSlots;
+        const std::chrono::milliseconds m_timeout;
+
+        // The inputs of all slots one after the other, then the outputs
+        fftwf_complex *m_in = nullptr;
+        fftwf_complex *m_out = nullptr;
+        fftwf_plan m_plan = nullptr;
+
+        std::mutex m_mutex;
+        std::condition_variable m_cond;
+        std::vector<bool> m_attached;
+        std::vector<bool> m_arrived;
+        size_t m_numAttached = 0;
+        size_t m_numArrived = 0;
+        // Incremented every time the plan runs
+        uint64_t m_round = 0;
+};
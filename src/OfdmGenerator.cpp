@@ -26,6 +26,9 @@
 
 #include "OfdmGenerator.h"
 #include "PcDebug.h"
+#include "Utils.h"
+#include "WorkerPool.h"
+#include "Log.h"
 
 #include <stdexcept>
 #include <assert.h>
@@ -34,28 +37,314 @@
 #include <vector>
 #include <cstring>
 #include <complex>
+#include <cmath>
+#include <algorithm>
+#include <iomanip>
+#if defined(__AVX__) || defined(__SSE__)
+#   include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#   include <arm_neon.h>
+#endif
 
 static const size_t MAX_CLIP_STATS = 10;
 
 using FFTW_TYPE = fftwf_complex;
 
+/* Scale the samples whose magnitude is above sqrt(clip_squared) down to
+ * that magnitude, and return how many got clipped.
+ * Uses std::norm instead of std::abs to avoid calculating the square roots
+ * of the samples that are not clipped. */
+static size_t cfr_clip(complexf *samples, size_t n, float clip_squared)
+{
+    size_t count = 0;
+    size_t i = 0;
+
+#if defined(__AVX__)
+    float *f = reinterpret_cast<float*>(samples);
+    const __m256 clip = _mm256_set1_ps(clip_squared);
+    for (; i + 4 <= n; i += 4) {
+        const __m256 x = _mm256_loadu_ps(f + 2 * i);
+        const __m256 sq = _mm256_mul_ps(x, x);
+        // Both floats of a sample get its squared magnitude
+        const __m256 mag = _mm256_add_ps(sq, _mm256_permute_ps(sq, 0xb1));
+        const __m256 over = _mm256_cmp_ps(mag, clip, _CMP_GT_OQ);
+        const int mask = _mm256_movemask_ps(over);
+        if (mask) {
+            const __m256 scale = _mm256_sqrt_ps(_mm256_div_ps(clip, mag));
+            _mm256_storeu_ps(f + 2 * i,
+                    _mm256_blendv_ps(x, _mm256_mul_ps(x, scale), over));
+            count += __builtin_popcount(mask) / 2;
+        }
+    }
+#elif defined(__SSE__)
+    float *f = reinterpret_cast<float*>(samples);
+    const __m128 clip = _mm_set1_ps(clip_squared);
+    for (; i + 2 <= n; i += 2) {
+        const __m128 x = _mm_loadu_ps(f + 2 * i);
+        const __m128 sq = _mm_mul_ps(x, x);
+        const __m128 mag = _mm_add_ps(sq, _mm_shuffle_ps(sq, sq, 0xb1));
+        const __m128 over = _mm_cmpgt_ps(mag, clip);
+        const int mask = _mm_movemask_ps(over);
+        if (mask) {
+            const __m128 scale = _mm_sqrt_ps(_mm_div_ps(clip, mag));
+            _mm_storeu_ps(f + 2 * i, _mm_or_ps(
+                        _mm_and_ps(over, _mm_mul_ps(x, scale)),
+                        _mm_andnot_ps(over, x)));
+            count += __builtin_popcount(mask) / 2;
+        }
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    float *f = reinterpret_cast<float*>(samples);
+    const float32x4_t clip = vdupq_n_f32(clip_squared);
+    for (; i + 4 <= n; i += 4) {
+        float32x4x2_t x = vld2q_f32(f + 2 * i);
+        const float32x4_t mag = vaddq_f32(
+                vmulq_f32(x.val[0], x.val[0]), vmulq_f32(x.val[1], x.val[1]));
+        const uint32x4_t over = vcgtq_f32(mag, clip);
+        if (vmaxvq_u32(over)) {
+            const float32x4_t scale = vsqrtq_f32(vdivq_f32(clip, mag));
+            x.val[0] = vbslq_f32(over, vmulq_f32(x.val[0], scale), x.val[0]);
+            x.val[1] = vbslq_f32(over, vmulq_f32(x.val[1], scale), x.val[1]);
+            vst2q_f32(f + 2 * i, x);
+            count += vaddvq_u32(vshrq_n_u32(over, 31));
+        }
+    }
+#endif
+
+    for (; i < n; i++) {
+        const float mag_squared = std::norm(samples[i]);
+        if (mag_squared > clip_squared) {
+            // normalise absolute value to the clip level:
+            // x_clipped = x * clip / |x|
+            //           = x * sqrt(clip_squared) / sqrt(mag_squared)
+            //           = x * sqrt(clip_squared / mag_squared)
+            samples[i] *= std::sqrt(clip_squared / mag_squared);
+            count++;
+        }
+    }
+
+    return count;
+}
+
+/* Whether the peak to average power ratio of the samples is above ratio,
+ * given in linear scale */
+static bool papr_above(const complexf *samples, size_t n, float ratio)
+{
+    float peak = 0;
+    float sum = 0;
+    PAPRStats::measure_power(samples, n, peak, sum);
+    return peak * n > ratio * sum;
+}
+
+/* Calculate the error between the carriers of the clipped signal, scaled
+ * by 1/fft_size, and the reference carriers. Limit the magnitude of the
+ * error to sqrt(err_clip_squared), and write the carriers with the limited
+ * error to corrected. Returns how many errors got clipped. */
+static size_t cfr_error_clip(const complexf *clipped, const complexf *reference,
+        complexf *corrected, size_t n, float fft_size, float err_clip_squared)
+{
+    size_t count = 0;
+    size_t i = 0;
+
+#if defined(__AVX__)
+    const float *fc = reinterpret_cast<const float*>(clipped);
+    const float *fr = reinterpret_cast<const float*>(reference);
+    float *fo = reinterpret_cast<float*>(corrected);
+    const __m256 size = _mm256_set1_ps(fft_size);
+    const __m256 limit = _mm256_set1_ps(err_clip_squared);
+    for (; i + 4 <= n; i += 4) {
+        const __m256 point = _mm256_div_ps(_mm256_loadu_ps(fc + 2 * i), size);
+        __m256 error = _mm256_sub_ps(_mm256_loadu_ps(fr + 2 * i), point);
+        const __m256 sq = _mm256_mul_ps(error, error);
+        const __m256 mag = _mm256_add_ps(sq, _mm256_permute_ps(sq, 0xb1));
+        const __m256 over = _mm256_cmp_ps(mag, limit, _CMP_GT_OQ);
+        const int mask = _mm256_movemask_ps(over);
+        if (mask) {
+            const __m256 scale = _mm256_sqrt_ps(_mm256_div_ps(limit, mag));
+            error = _mm256_blendv_ps(error, _mm256_mul_ps(error, scale), over);
+            count += __builtin_popcount(mask) / 2;
+        }
+        _mm256_storeu_ps(fo + 2 * i, _mm256_add_ps(point, error));
+    }
+#elif defined(__SSE__)
+    const float *fc = reinterpret_cast<const float*>(clipped);
+    const float *fr = reinterpret_cast<const float*>(reference);
+    float *fo = reinterpret_cast<float*>(corrected);
+    const __m128 size = _mm_set1_ps(fft_size);
+    const __m128 limit = _mm_set1_ps(err_clip_squared);
+    for (; i + 2 <= n; i += 2) {
+        const __m128 point = _mm_div_ps(_mm_loadu_ps(fc + 2 * i), size);
+        __m128 error = _mm_sub_ps(_mm_loadu_ps(fr + 2 * i), point);
+        const __m128 sq = _mm_mul_ps(error, error);
+        const __m128 mag = _mm_add_ps(sq, _mm_shuffle_ps(sq, sq, 0xb1));
+        const __m128 over = _mm_cmpgt_ps(mag, limit);
+        const int mask = _mm_movemask_ps(over);
+        if (mask) {
+            const __m128 scale = _mm_sqrt_ps(_mm_div_ps(limit, mag));
+            error = _mm_or_ps(_mm_and_ps(over, _mm_mul_ps(error, scale)),
+                    _mm_andnot_ps(over, error));
+            count += __builtin_popcount(mask) / 2;
+        }
+        _mm_storeu_ps(fo + 2 * i, _mm_add_ps(point, error));
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const float *fc = reinterpret_cast<const float*>(clipped);
+    const float *fr = reinterpret_cast<const float*>(reference);
+    float *fo = reinterpret_cast<float*>(corrected);
+    const float32x4_t size = vdupq_n_f32(fft_size);
+    const float32x4_t limit = vdupq_n_f32(err_clip_squared);
+    for (; i + 4 <= n; i += 4) {
+        const float32x4x2_t c = vld2q_f32(fc + 2 * i);
+        const float32x4x2_t r = vld2q_f32(fr + 2 * i);
+        const float32x4_t point_re = vdivq_f32(c.val[0], size);
+        const float32x4_t point_im = vdivq_f32(c.val[1], size);
+        float32x4_t error_re = vsubq_f32(r.val[0], point_re);
+        float32x4_t error_im = vsubq_f32(r.val[1], point_im);
+        const float32x4_t mag = vaddq_f32(
+                vmulq_f32(error_re, error_re), vmulq_f32(error_im, error_im));
+        const uint32x4_t over = vcgtq_f32(mag, limit);
+        if (vmaxvq_u32(over)) {
+            const float32x4_t scale = vsqrtq_f32(vdivq_f32(limit, mag));
+            error_re = vbslq_f32(over, vmulq_f32(error_re, scale), error_re);
+            error_im = vbslq_f32(over, vmulq_f32(error_im, scale), error_im);
+            count += vaddvq_u32(vshrq_n_u32(over, 31));
+        }
+        float32x4x2_t o;
+        o.val[0] = vaddq_f32(point_re, error_re);
+        o.val[1] = vaddq_f32(point_im, error_im);
+        vst2q_f32(fo + 2 * i, o);
+    }
+#endif
+
+    for (; i < n; i++) {
+        const complexf constellation_point = clipped[i] / fft_size;
+
+        complexf error = reference[i] - constellation_point;
+
+        const float mag_squared = std::norm(error);
+        if (mag_squared > err_clip_squared) {
+            error *= std::sqrt(err_clip_squared / mag_squared);
+            count++;
+        }
+
+        corrected[i] = constellation_point + error;
+    }
+
+    return count;
+}
+
+/* Active constellation extension. The carriers are differentially
+ * modulated PSK, whose information is only in the phase: the clipped
+ * carrier is projected onto the direction of its reference, and may only
+ * extend outward, by at most the error clip. The extension is multiplied
+ * by the gain, which makes the iterations converge faster. The unused
+ * carriers have a zero reference and get the same treatment as in
+ * cfr_error_clip. */
+static size_t cfr_ace(const complexf *clipped, const complexf *reference,
+        complexf *corrected, size_t n, float fft_size, float err_clip_squared,
+        float gain)
+{
+    size_t count = 0;
+    size_t i = 0;
+
+#if defined(__AVX__)
+    const float *fc = reinterpret_cast<const float*>(clipped);
+    const float *fr = reinterpret_cast<const float*>(reference);
+    float *fo = reinterpret_cast<float*>(corrected);
+    const __m256 size = _mm256_set1_ps(fft_size);
+    const __m256 limit = _mm256_set1_ps(err_clip_squared);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 ext_gain = _mm256_set1_ps(gain);
+    for (; i + 4 <= n; i += 4) {
+        const __m256 point = _mm256_div_ps(_mm256_loadu_ps(fc + 2 * i), size);
+        const __m256 ref = _mm256_loadu_ps(fr + 2 * i);
+
+        // Both floats of a sample get |ref|^2 and Re((point - ref) * conj(ref))
+        const __m256 rr = _mm256_mul_ps(ref, ref);
+        const __m256 ref_mag = _mm256_add_ps(rr, _mm256_permute_ps(rr, 0xb1));
+        const __m256 dr = _mm256_mul_ps(_mm256_sub_ps(point, ref), ref);
+        const __m256 dot = _mm256_add_ps(dr, _mm256_permute_ps(dr, 0xb1));
+        const __m256 unused = _mm256_cmp_ps(ref_mag, zero, _CMP_EQ_OQ);
+
+        // Relative outward extension, limited to the error clip
+        __m256 ext = _mm256_mul_ps(ext_gain,
+                _mm256_max_ps(_mm256_div_ps(dot, ref_mag), zero));
+        const __m256 ext_mag = _mm256_mul_ps(_mm256_mul_ps(ext, ext), ref_mag);
+        const __m256 over = _mm256_andnot_ps(unused,
+                _mm256_cmp_ps(ext_mag, limit, _CMP_GT_OQ));
+        ext = _mm256_blendv_ps(ext,
+                _mm256_sqrt_ps(_mm256_div_ps(limit, ref_mag)), over);
+        __m256 out = _mm256_mul_ps(ref, _mm256_add_ps(one, ext));
+
+        // The unused carriers keep what exceeds the error clip
+        const __m256 pp = _mm256_mul_ps(point, point);
+        const __m256 point_mag = _mm256_add_ps(pp, _mm256_permute_ps(pp, 0xb1));
+        const __m256 over_unused = _mm256_and_ps(unused,
+                _mm256_cmp_ps(point_mag, limit, _CMP_GT_OQ));
+        const __m256 rest = _mm256_mul_ps(point, _mm256_sub_ps(one,
+                    _mm256_sqrt_ps(_mm256_div_ps(limit, point_mag))));
+        out = _mm256_blendv_ps(out, zero, unused);
+        out = _mm256_blendv_ps(out, rest, over_unused);
+
+        count += __builtin_popcount(_mm256_movemask_ps(
+                    _mm256_or_ps(over, over_unused))) / 2;
+        _mm256_storeu_ps(fo + 2 * i, out);
+    }
+#endif
+
+    for (; i < n; i++) {
+        const complexf point = clipped[i] / fft_size;
+        const float ref_mag = std::norm(reference[i]);
+
+        if (ref_mag == 0.0f) {
+            const float mag_squared = std::norm(point);
+            if (mag_squared > err_clip_squared) {
+                corrected[i] = point *
+                    (1.0f - std::sqrt(err_clip_squared / mag_squared));
+                count++;
+            }
+            else {
+                corrected[i] = 0.0f;
+            }
+            continue;
+        }
+
+        const float dot = std::real((point - reference[i]) *
+                std::conj(reference[i]));
+        float ext = gain * std::max(dot / ref_mag, 0.0f);
+        if (ext * ext * ref_mag > err_clip_squared) {
+            ext = std::sqrt(err_clip_squared / ref_mag);
+            count++;
+        }
+
+        corrected[i] = reference[i] * (1.0f + ext);
+    }
+
+    return count;
+}
+
 OfdmGeneratorCF32::OfdmGeneratorCF32(size_t nbSymbols,
                              size_t nbCarriers,
                              size_t spacing,
                              bool& enableCfr,
                              float& cfrClip,
                              float& cfrErrorClip,
-                             bool inverse) :
+                             size_t& cfrIterations,
+                             float& cfrTargetPapr,
+                             bool inverse,
+                             bool batchedFft,
+                             size_t numThreads,
+                             size_t numCachedSymbols) :
     ModCodec(), RemoteControllable("ofdm"),
-    myFftPlan(nullptr),
-    myFftIn(nullptr), myFftOut(nullptr),
     myNbSymbols(nbSymbols),
     myNbCarriers(nbCarriers),
     mySpacing(spacing),
     myCfr(enableCfr),
     myCfrClip(cfrClip),
     myCfrErrorClip(cfrErrorClip),
-    myCfrFft(nullptr),
+    myCfrIterations(cfrIterations),
+    myCfrTargetPapr(cfrTargetPapr),
     // Initialise the PAPRStats to a few seconds worth of samples
     myPaprBeforeCFR(nbSymbols * 50),
     myPaprAfterCFR(nbSymbols * 50)
@@ -71,8 +360,15 @@ OfdmGeneratorCF32::OfdmGeneratorCF32(size_t nbSymbols,
     RC_ADD_PARAMETER(cfr, "Enable crest factor reduction");
     RC_ADD_PARAMETER(clip, "CFR: Clip to amplitude");
     RC_ADD_PARAMETER(errorclip, "CFR: Limit error");
+    RC_ADD_PARAMETER(iterations, "CFR: Maximum number of iterations per symbol");
+    RC_ADD_PARAMETER(method, "CFR: How the clipping error is compensated, errorclip or ace");
+    RC_ADD_PARAMETER(ace_gain, "CFR: Gain of the constellation extension with the ace method, at least 1");
+    RC_ADD_PARAMETER(mer_calc, "CFR: 1 to measure the MER after CFR on the measured frames");
+    RC_ADD_PARAMETER(stats_interval, "CFR: Measure the PAPR and the MER on one in this many frames");
+    RC_ADD_PARAMETER(target_papr, "CFR: Skip further iterations once the symbol PAPR is below this value in dB, 0 to disable");
     RC_ADD_PARAMETER(clip_stats, "CFR: statistics (clip ratio, errorclip ratio)");
     RC_ADD_PARAMETER(papr, "PAPR measurements (before CFR, after CFR)");
+    RC_ADD_PARAMETER(ccdf, "Probability that the sample power exceeds the mean power by 2 to 12 dB (before CFR, after CFR)");
 
     if (inverse) {
         myPosDst = (nbCarriers & 1 ? 0 : 1);
@@ -102,19 +398,86 @@ OfdmGeneratorCF32::OfdmGeneratorCF32(size_t nbSymbols,
     PDEBUG("  myZeroDst: %u\n", myZeroDst);
     PDEBUG("  myZeroSize: %u\n", myZeroSize);
 
+    // The symbols are split into numThreads + 1 parts, the flowgraph
+    // thread processes one of them.
+    const size_t num_parts = std::min(numThreads + 1, myNbSymbols);
+    if (num_parts > 1) {
+        etiLog.level(info) << "OfdmGenerator will split frames into " <<
+            num_parts << " parts";
+
+        if (batchedFft) {
+            etiLog.level(warn) << "OfdmGenerator: batched FFT is not "
+                "used when the symbols are processed in parallel";
+            batchedFft = false;
+        }
+    }
+
+    if (numCachedSymbols > 0) {
+        if (batchedFft) {
+            etiLog.level(warn) << "OfdmGenerator: the symbol cache is not "
+                "used with batched FFT";
+        }
+        else {
+            mySymbolCaches.resize(std::min(numCachedSymbols, myNbSymbols));
+        }
+    }
+
     const int N = mySpacing; // The size of the FFT
-    myFftIn = (FFTW_TYPE*)fftwf_malloc(sizeof(FFTW_TYPE) * N);
-    myFftOut = (FFTW_TYPE*)fftwf_malloc(sizeof(FFTW_TYPE) * N);
-    fftwf_set_timelimit(2);
-    myFftPlan = fftwf_plan_dft_1d(N,
-            myFftIn, myFftOut,
-            FFTW_BACKWARD, FFTW_MEASURE);
-
-    myCfrPostClip = (FFTW_TYPE*)fftwf_malloc(sizeof(FFTW_TYPE) * N);
-    myCfrPostFft = (FFTW_TYPE*)fftwf_malloc(sizeof(FFTW_TYPE) * N);
-    myCfrFft = fftwf_plan_dft_1d(N,
-            myCfrPostClip, myCfrPostFft,
-            FFTW_FORWARD, FFTW_MEASURE);
+
+    std::lock_guard<std::mutex> lock(fftw_planner_mutex);
+    const unsigned plan_flags = prepare_fftw_planner();
+
+    mySymbolFfts.resize(num_parts);
+    for (auto& fft : mySymbolFfts) {
+        fft.in = (FFTW_TYPE*)fftwf_malloc(sizeof(FFTW_TYPE) * N);
+        fft.out = (FFTW_TYPE*)fftwf_malloc(sizeof(FFTW_TYPE) * N);
+        fft.plan = fftwf_plan_dft_1d(N,
+                fft.in, fft.out,
+                FFTW_BACKWARD, plan_flags);
+
+        // The clipping is done in place in fft.out
+        fft.cfr_post_fft = (FFTW_TYPE*)fftwf_malloc(sizeof(FFTW_TYPE) * N);
+        fft.cfr_plan = fftwf_plan_dft_1d(N,
+                fft.out, fft.cfr_post_fft,
+                FFTW_FORWARD, plan_flags);
+    }
+
+    if (batchedFft) {
+        // The DC carrier and the carriers outside the signal bandwidth
+        // are zeroed once, the plan must therefore keep its input.
+        const size_t batch_size = myNbSymbols * N;
+        myBatchIn = (FFTW_TYPE*)alloc_workspace(
+                4 * sizeof(FFTW_TYPE) * batch_size);
+        myBatchOut = myBatchIn + batch_size;
+        myCfrBatchPostFft = myBatchIn + 2 * batch_size;
+        myCfrBatchCorrected = myBatchIn + 3 * batch_size;
+
+        myBatchPlan = fftwf_plan_many_dft(1, &N, myNbSymbols,
+                myBatchIn, nullptr, 1, N,
+                myBatchOut, nullptr, 1, N,
+                FFTW_BACKWARD, plan_flags | FFTW_PRESERVE_INPUT);
+
+        // For CFR, myBatchFftIn is the reference, the symbols get clipped
+        // in myBatchOut and transformed back to myCfrBatchPostFft.
+
+        myCfrBatchFft = fftwf_plan_many_dft(1, &N, myNbSymbols,
+                myBatchOut, nullptr, 1, N,
+                myCfrBatchPostFft, nullptr, 1, N,
+                FFTW_FORWARD, plan_flags);
+
+        memset(myBatchIn, 0, sizeof(FFTW_TYPE) * batch_size);
+        myBatchFftIn = myBatchIn;
+        memset(myCfrBatchCorrected, 0, sizeof(FFTW_TYPE) * batch_size);
+    }
+
+    save_fftw_wisdom();
+
+    myWorkspaceBytes = mySymbolFfts.size() * 3 * sizeof(FFTW_TYPE) * N;
+    if (batchedFft) {
+        myWorkspaceBytes += 4 * sizeof(FFTW_TYPE) * myNbSymbols * N;
+    }
+    myWorkspaceBytes += mySymbolCaches.size() * CACHE_ENTRIES_PER_SYMBOL *
+        (myNbCarriers + 2 * mySpacing) * sizeof(complexf);
 
     if (sizeof(complexf) != sizeof(FFTW_TYPE)) {
         printf("sizeof(complexf) %zu\n", sizeof(complexf));
@@ -122,35 +485,417 @@ OfdmGeneratorCF32::OfdmGeneratorCF32(size_t nbSymbols,
         throw std::runtime_error(
                 "OfdmGenerator::process complexf size is not FFT_TYPE size!");
     }
+
+    myStatsThread = std::thread(&OfdmGeneratorCF32::stats_thread, this);
 }
 
 
+size_t OfdmGeneratorCF32::memory_usage() const
+{
+    return myWorkspaceBytes + mySnapshotBytes.load();
+}
+
 OfdmGeneratorCF32::~OfdmGeneratorCF32()
 {
     PDEBUG("OfdmGenerator::~OfdmGenerator() @ %p\n", this);
 
-    if (myFftIn) {
-         fftwf_free(myFftIn);
+    // The other ensembles need not wait for this one any more
+    if (myBatchService) {
+        myBatchService->detach(myBatchSlot);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mySnapshotMutex);
+        myStatsThreadRunning = false;
+    }
+    mySnapshotCond.notify_all();
+    myStatsThread.join();
+
+    std::lock_guard<std::mutex> lock(fftw_planner_mutex);
+
+    for (auto& fft : mySymbolFfts) {
+        if (fft.plan) {
+            fftwf_destroy_plan(fft.plan);
+        }
+
+        if (fft.cfr_plan) {
+            fftwf_destroy_plan(fft.cfr_plan);
+        }
+
+        if (fft.in) {
+            fftwf_free(fft.in);
+        }
+
+        if (fft.out) {
+            fftwf_free(fft.out);
+        }
+
+        if (fft.cfr_post_fft) {
+            fftwf_free(fft.cfr_post_fft);
+        }
+    }
+
+    if (myBatchPlan) {
+        fftwf_destroy_plan(myBatchPlan);
+    }
+
+    if (myCfrBatchFft) {
+        fftwf_destroy_plan(myCfrBatchFft);
+    }
+
+    // Also holds myBatchOut, myCfrBatchPostFft and myCfrBatchCorrected
+    free_workspace(myBatchIn);
+}
+
+void OfdmGeneratorCF32::set_batch_service(
+        std::shared_ptr<OfdmBatchService> service, size_t slot)
+{
+    if (not myBatchPlan) {
+        etiLog.level(warn) << "OfdmGenerator: the symbols are not " <<
+            "transformed together with the other ensembles, because " <<
+            "they are not batched";
+        return;
+    }
+
+    if (service->nb_symbols() != myNbSymbols or
+            service->spacing() != mySpacing) {
+        throw std::logic_error("OfdmGenerator: the batch service is for "
+                "another mode");
+    }
+
+    if (not service->attach(slot)) {
+        etiLog.level(warn) << "OfdmGenerator: another generator of this " <<
+            "ensemble still uses the batch service, transforming alone";
+        return;
+    }
+
+    myBatchService = service;
+    myBatchSlot = slot;
+    myBatchFftIn = service->input(slot);
+}
+
+void OfdmGeneratorCF32::set_carrier_gains(const std::vector<float>& gains)
+{
+    if (gains.size() != myNbCarriers) {
+        throw std::logic_error("OfdmGenerator: wrong number of carrier gains");
+    }
+
+    myCarrierGains.resize(2 * myNbCarriers);
+    for (size_t i = 0; i < myNbCarriers; i++) {
+        myCarrierGains[2 * i] = gains[i];
+        myCarrierGains[2 * i + 1] = gains[i];
+    }
+
+    // The cached symbols were transformed without them
+    for (auto& cache : mySymbolCaches) {
+        for (auto& entry : cache) {
+            entry.carriers.clear();
+        }
+    }
+}
+
+// With the gains interleaved like the samples, the loops vectorise
+static void copy_with_gains(float *__restrict dst, const float *__restrict src,
+        const float *__restrict gains, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = src[i] * gains[i];
+    }
+}
+
+void OfdmGeneratorCF32::copy_carriers(FFTW_TYPE *fft_in,
+        const FFTW_TYPE *symbol) const
+{
+    if (myCarrierGains.empty()) {
+        memcpy(&fft_in[myPosDst], &symbol[myPosSrc],
+                myPosSize * sizeof(FFTW_TYPE));
+        memcpy(&fft_in[myNegDst], &symbol[myNegSrc],
+                myNegSize * sizeof(FFTW_TYPE));
+    }
+    else {
+        copy_with_gains(fft_in[myPosDst], symbol[myPosSrc],
+                &myCarrierGains[2 * myPosSrc], 2 * myPosSize);
+        copy_with_gains(fft_in[myNegDst], symbol[myNegSrc],
+                &myCarrierGains[2 * myNegSrc], 2 * myNegSize);
+    }
+}
+
+void OfdmGeneratorCF32::load_batch(const FFTW_TYPE *in)
+{
+    FFTW_TYPE *fft_in = myBatchFftIn;
+    for (size_t i = 0; i < myNbSymbols; i++) {
+        copy_carriers(fft_in, in);
+        in += myNbCarriers;
+        fft_in += mySpacing;
+    }
+}
+
+void OfdmGeneratorCF32::execute_batch(FFTW_TYPE *fft_in, FFTW_TYPE *out)
+{
+    // The plan can write to any array that has the same alignment as the
+    // one it was created with, which saves a copy. All our fft_in arrays
+    // come from fftwf_malloc or alloc_workspace(), and are aligned the
+    // same way.
+    if (fftwf_alignment_of(reinterpret_cast<float*>(out)) ==
+            fftwf_alignment_of(reinterpret_cast<float*>(myBatchOut))) {
+        fftwf_execute_dft(myBatchPlan, fft_in, out);
+    }
+    else {
+        fftwf_execute_dft(myBatchPlan, fft_in, myBatchOut);
+        memcpy(out, myBatchOut, myNbSymbols * mySpacing * sizeof(FFTW_TYPE));
+    }
+}
+
+void OfdmGeneratorCF32::transform_batch(FFTW_TYPE *out)
+{
+    if (myBatchService) {
+        if (myBatchService->transform(myBatchSlot, out)) {
+            if (myBatchTimedOut) {
+                etiLog.level(info) << "OfdmGenerator: transforming the " <<
+                    "symbols together with the other ensembles again";
+                myBatchTimedOut = false;
+            }
+            return;
+        }
+
+        if (not myBatchTimedOut) {
+            etiLog.level(warn) << "OfdmGenerator: the other ensembles " <<
+                "did not follow, transforming the symbols alone";
+            myBatchTimedOut = true;
+        }
+    }
+    execute_batch(myBatchFftIn, out);
+}
+
+void OfdmGeneratorCF32::process_batched(const FFTW_TYPE *in, FFTW_TYPE *out)
+{
+    load_batch(in);
+    transform_batch(out);
+}
+
+OfdmGeneratorCF32::cfr_iter_stat_t OfdmGeneratorCF32::process_batched_cfr(
+        const FFTW_TYPE *in, FFTW_TYPE *out)
+{
+    OfdmGeneratorCF32::cfr_iter_stat_t ret;
+
+    load_batch(in);
+    transform_batch(myBatchOut);
+
+    complexf *symbols = reinterpret_cast<complexf*>(myBatchOut);
+    if (myCurrentSnapshot) {
+        memcpy(myCurrentSnapshot->before_cfr.data(), symbols,
+                myNbSymbols * mySpacing * sizeof(complexf));
+    }
+
+    const float clip_squared = myCfrClip * myCfrClip;
+    const float target_ratio = myCfrTargetPapr > 0 ?
+        std::pow(10.0f, myCfrTargetPapr / 10.0f) : 0.0f;
+
+    // The reference symbols are in myBatchFftIn, the plans preserve it.
+    const complexf *reference = reinterpret_cast<const complexf*>(myBatchFftIn);
+    const complexf *post_fft =
+        reinterpret_cast<const complexf*>(myCfrBatchPostFft);
+    complexf *corrected = reinterpret_cast<complexf*>(myCfrBatchCorrected);
+
+    // Symbols whose PAPR is below the target are done
+    std::vector<bool> active(myNbSymbols, true);
+
+    for (size_t iteration = 0; iteration < myCfrIterations; iteration++) {
+        size_t num_active = 0;
+        for (size_t i = 0; i < myNbSymbols; i++) {
+            complexf *symbol = symbols + i * mySpacing;
+            if (active[i] and target_ratio > 0) {
+                active[i] = papr_above(symbol, mySpacing, target_ratio);
+            }
+
+            if (active[i]) {
+                ret.clip_count += cfr_clip(symbol, mySpacing, clip_squared);
+                num_active++;
+            }
+        }
+
+        if (num_active == 0) {
+            break;
+        }
+        ret.symbol_count += num_active;
+
+        fftwf_execute(myCfrBatchFft); // FFT from myBatchOut to myCfrBatchPostFft
+
+        for (size_t i = 0; i < myNbSymbols; i++) {
+            if (active[i]) {
+                const size_t offset = i * mySpacing;
+                ret.errclip_count += cfr_correct(post_fft + offset,
+                        reference + offset, corrected + offset, mySpacing);
+            }
+        }
+
+        // Run the error-compensated symbols through the IFFT again. The
+        // symbols that are done must not change.
+        if (num_active == myNbSymbols) {
+            fftwf_execute_dft(myBatchPlan, myCfrBatchCorrected, myBatchOut);
+        }
+        else {
+            fftwf_execute_dft(myBatchPlan, myCfrBatchCorrected,
+                    myCfrBatchPostFft);
+            for (size_t i = 0; i < myNbSymbols; i++) {
+                if (active[i]) {
+                    memcpy(symbols + i * mySpacing, post_fft + i * mySpacing,
+                            mySpacing * sizeof(FFTW_TYPE));
+                }
+            }
+        }
+    }
+
+    memcpy(out, myBatchOut, myNbSymbols * mySpacing * sizeof(FFTW_TYPE));
+
+    return ret;
+}
+
+OfdmGeneratorCF32::stats_snapshot_t *OfdmGeneratorCF32::begin_snapshot()
+{
+    if (not myCfr or ++myStatsFrameCount < myStatsInterval.load()) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mySnapshotMutex);
+    for (auto& snapshot : mySnapshots) {
+        if (not snapshot.pending) {
+            myStatsFrameCount = 0;
+            snapshot.before_cfr.resize(myNbSymbols * mySpacing);
+            snapshot.after_cfr.resize(myNbSymbols * mySpacing);
+            size_t snapshot_bytes = 0;
+            for (const auto& s : mySnapshots) {
+                snapshot_bytes += (s.before_cfr.capacity() +
+                        s.after_cfr.capacity()) * sizeof(complexf);
+            }
+            mySnapshotBytes.store(snapshot_bytes);
+            return &snapshot;
+        }
+    }
+    return nullptr;
+}
+
+void OfdmGeneratorCF32::end_snapshot(stats_snapshot_t *snapshot,
+        const FFTW_TYPE *out)
+{
+    const complexf *symbols = reinterpret_cast<const complexf*>(out);
+    std::copy(symbols, symbols + myNbSymbols * mySpacing,
+            snapshot->after_cfr.begin());
+    snapshot->generation = myStatsGeneration.load();
+    snapshot->measure_mer = myMERCalcEnabled.load();
+
+    {
+        std::lock_guard<std::mutex> lock(mySnapshotMutex);
+        snapshot->pending = true;
+    }
+    mySnapshotCond.notify_one();
+}
+
+void OfdmGeneratorCF32::stats_thread()
+{
+    set_thread_name("ofdmstats");
+
+    std::unique_lock<std::mutex> lock(mySnapshotMutex);
+    while (true) {
+        stats_snapshot_t *snapshot = nullptr;
+        mySnapshotCond.wait(lock, [&] {
+                for (auto& s : mySnapshots) {
+                    if (s.pending) {
+                        snapshot = &s;
+                        return true;
+                    }
+                }
+                return not myStatsThreadRunning;
+            });
+
+        if (not snapshot) {
+            break;
+        }
+
+        // The processing thread does not touch a pending snapshot
+        lock.unlock();
+        if (snapshot->generation == myStatsGeneration.load()) {
+            measure_snapshot(*snapshot);
+        }
+        lock.lock();
+        snapshot->pending = false;
+    }
+}
+
+void OfdmGeneratorCF32::measure_snapshot(const stats_snapshot_t& snapshot)
+{
+    for (size_t i = 0; i < myNbSymbols; i++) {
+        myPaprBeforeCFR.process_block(
+                snapshot.before_cfr.data() + i * mySpacing, mySpacing);
+
+        // i == 0 always zero power
+        if (i > 0) {
+            myPaprAfterCFR.process_block(
+                    snapshot.after_cfr.data() + i * mySpacing, mySpacing);
+        }
     }
 
-    if (myFftOut) {
-         fftwf_free(myFftOut);
+    if (not snapshot.measure_mer) {
+        return;
     }
 
-    if (myFftPlan) {
-        fftwf_destroy_plan(myFftPlan);
+    /* MER definition, ETSI ETR 290, Annex C
+     *
+     *                       \sum I^2 + Q^2
+     * MER[dB] = 10 log_10( ---------------- )
+     *                      \sum dI^2 + dQ^2
+     * Where I and Q are the ideal coordinates, and dI and dQ are
+     * the errors in the received datapoints.
+     *
+     * In our case, we consider the constellation points given to the
+     * OfdmGenerator as "ideal", and we compare the CFR output to it. The
+     * sums go over all symbols of the frame except the null symbol.
+     */
+    double sum_iq = 0;
+    double sum_delta = 0;
+    for (size_t j = mySpacing; j < myNbSymbols * mySpacing; j++) {
+        const complexf before = snapshot.before_cfr[j];
+        sum_iq += (double)std::norm(before);
+        sum_delta += (double)std::norm(snapshot.after_cfr[j] - before);
+    }
+
+    // Clamp to 90dB, otherwise the MER average is going to be inf
+    const double mer = sum_delta > 0 ?
+        10.0 * std::log10(sum_iq / sum_delta) : 90;
+    std::lock_guard<std::mutex> lock(myCfrRcMutex);
+    myMERs.push_back(mer);
+}
+
+void OfdmGeneratorCF32::push_cfr_stats(const cfr_iter_stat_t& stat)
+{
+    std::lock_guard<std::mutex> lock(myCfrRcMutex);
+
+    // The ratios are relative to the samples that went through the
+    // iterations
+    const double num_samps = stat.symbol_count * mySpacing;
+    const double clip_ratio = num_samps > 0 ?
+        (double)stat.clip_count / num_samps : 0.0;
+
+    myClipRatios.push_back(clip_ratio);
+    while (myClipRatios.size() > MAX_CLIP_STATS) {
+        myClipRatios.pop_front();
     }
 
-    if (myCfrPostClip) {
-        fftwf_free(myCfrPostClip);
+    const double errclip_ratio = num_samps > 0 ?
+        (double)stat.errclip_count / num_samps : 0.0;
+    myErrorClipRatios.push_back(errclip_ratio);
+    while (myErrorClipRatios.size() > MAX_CLIP_STATS) {
+        myErrorClipRatios.pop_front();
     }
 
-    if (myCfrPostFft) {
-        fftwf_free(myCfrPostFft);
+    myIterationsPerSymbol.push_back(
+            (double)stat.symbol_count / myNbSymbols);
+    while (myIterationsPerSymbol.size() > MAX_CLIP_STATS) {
+        myIterationsPerSymbol.pop_front();
     }
 
-    if (myCfrFft) {
-        fftwf_destroy_plan(myCfrFft);
+    while (myMERs.size() > MAX_CLIP_STATS) {
+        myMERs.pop_front();
     }
 }
 
@@ -159,219 +904,327 @@ int OfdmGeneratorCF32::process(Buffer* const dataIn, Buffer* dataOut)
     PDEBUG("OfdmGenerator::process(dataIn: %p, dataOut: %p)\n",
             dataIn, dataOut);
 
-    dataOut->setLength(myNbSymbols * mySpacing * sizeof(complexf));
+    const int sizeOut = process_interleaved(dataIn, dataOut);
+    if (m_planar) {
+        interleaved_to_planar(reinterpret_cast<float*>(dataOut->getData()),
+                sizeOut, myPlanarScratch);
+    }
+    return sizeOut;
+}
+
+int OfdmGeneratorCF32::process_interleaved(Buffer* const dataIn, Buffer* dataOut)
+{
+
+    // The input may contain several transmission frames, see FrameBatcher
+    const size_t sizeIn = dataIn->getLength() / sizeof(complexf);
+    const size_t numFrames = sizeIn / (myNbSymbols * myNbCarriers);
+
+    dataOut->setLength(numFrames * myNbSymbols * mySpacing * sizeof(complexf));
 
     FFTW_TYPE *in = reinterpret_cast<FFTW_TYPE*>(dataIn->getData());
     FFTW_TYPE *out = reinterpret_cast<FFTW_TYPE*>(dataOut->getData());
 
-    size_t sizeIn = dataIn->getLength() / sizeof(complexf);
-    size_t sizeOut = dataOut->getLength() / sizeof(complexf);
+    const size_t sizeOut = dataOut->getLength() / sizeof(complexf);
 
-    if (sizeIn != myNbSymbols * myNbCarriers) {
+    if (numFrames == 0 or sizeIn != numFrames * myNbSymbols * myNbCarriers) {
         PDEBUG("Nb symbols: %zu\n", myNbSymbols);
         PDEBUG("Nb carriers: %zu\n", myNbCarriers);
         PDEBUG("Spacing: %zu\n", mySpacing);
-        PDEBUG("\n%zu != %zu\n", sizeIn, myNbSymbols * myNbCarriers);
+        PDEBUG("\n%zu is not a multiple of %zu\n", sizeIn, myNbSymbols * myNbCarriers);
         throw std::runtime_error(
                 "OfdmGenerator::process input size not valid!");
     }
-    if (sizeOut != myNbSymbols * mySpacing) {
+    if (sizeOut != numFrames * myNbSymbols * mySpacing) {
         PDEBUG("Nb symbols: %zu\n", myNbSymbols);
         PDEBUG("Nb carriers: %zu\n", myNbCarriers);
         PDEBUG("Spacing: %zu\n", mySpacing);
-        PDEBUG("\n%zu != %zu\n", sizeIn, myNbSymbols * mySpacing);
+        PDEBUG("\n%zu != %zu\n", sizeOut, numFrames * myNbSymbols * mySpacing);
         throw std::runtime_error(
                 "OfdmGenerator::process output size not valid!");
     }
 
-    // It is not guaranteed that fftw keeps the FFT input vector intact.
-    // That's why we copy it to the reference.
-    std::vector<complexf> reference;
+    // Clear the PAPRStats together with the cached symbols, which also
+    // depend on the CFR settings.
+    if (myPaprClearRequest.exchange(false)) {
+        myStatsGeneration++;
+        myPaprBeforeCFR.clear();
+        myPaprAfterCFR.clear();
+
+        for (auto& cache : mySymbolCaches) {
+            for (auto& entry : cache) {
+                entry.carriers.clear();
+            }
+        }
+    }
 
-    // IFFT output before CFR applied, for MER calc
-    std::vector<complexf> before_cfr;
+    if (myBatchPlan) {
+        for (size_t frame = 0; frame < numFrames; frame++) {
+            myCurrentSnapshot = begin_snapshot();
+            if (myCfr) {
+                push_cfr_stats(process_batched_cfr(in, out));
+            }
+            else {
+                process_batched(in, out);
+            }
+            if (myCurrentSnapshot) {
+                end_snapshot(myCurrentSnapshot, out);
+            }
+            in += myNbSymbols * myNbCarriers;
+            out += myNbSymbols * mySpacing;
+        }
+        return sizeOut;
+    }
 
-    size_t num_clip = 0;
-    size_t num_error_clip = 0;
+    const float target_ratio = myCfrTargetPapr > 0 ?
+        std::pow(10.0f, myCfrTargetPapr / 10.0f) : 0.0f;
 
-    // For performance reasons, do not calculate MER for every symbol.
-    myMERCalcIndex = (myMERCalcIndex + 1) % myNbSymbols;
+    const size_t num_parts = mySymbolFfts.size();
+    auto part_start = [&](size_t part) {
+        return part * myNbSymbols / num_parts;
+    };
 
-    // The PAPRStats' clear() is not threadsafe, do not access it
-    // from the RC functions.
-    if (myPaprClearRequest.exchange(false)) {
-        myPaprBeforeCFR.clear();
-        myPaprAfterCFR.clear();
+    for (size_t frame = 0; frame < numFrames; frame++) {
+        myFrameCount++;
+        myCurrentSnapshot = begin_snapshot();
+
+        if (num_parts == 1) {
+            process_symbols(mySymbolFfts[0], in, out, 0, myNbSymbols,
+                    target_ratio);
+        }
+        else {
+            WorkerPool::shared().parallel_for(num_parts, [&](size_t part) {
+                    process_symbols(mySymbolFfts[part], in, out,
+                            part_start(part), part_start(part + 1),
+                            target_ratio);
+                });
+        }
+
+        if (myCfr) {
+            cfr_iter_stat_t frame_stat;
+            for (size_t part = 0; part < num_parts; part++) {
+                const auto& stat = mySymbolFfts[part].stat;
+                frame_stat.clip_count += stat.clip_count;
+                frame_stat.errclip_count += stat.errclip_count;
+                frame_stat.symbol_count += stat.symbol_count;
+            }
+
+            push_cfr_stats(frame_stat);
+        }
+
+        if (myCurrentSnapshot) {
+            end_snapshot(myCurrentSnapshot, out);
+        }
+
+        in += myNbSymbols * myNbCarriers;
+        out += myNbSymbols * mySpacing;
     }
 
-    for (size_t i = 0; i < myNbSymbols; i++) {
-        myFftIn[0][0] = 0;
-        myFftIn[0][1] = 0;
+    return sizeOut;
+}
+
+void OfdmGeneratorCF32::process_symbols(symbol_fft_t& fft,
+        const FFTW_TYPE *in, FFTW_TYPE *out,
+        size_t start, size_t stop, float target_ratio)
+{
+    fft.stat = cfr_iter_stat_t();
+
+    for (size_t i = start; i < stop; i++) {
+        const FFTW_TYPE *symbol_in = &in[i * myNbCarriers];
+        const bool cached = i < mySymbolCaches.size();
+
+        if (cached and lookup_cached_symbol(fft, i,
+                    reinterpret_cast<const complexf*>(symbol_in),
+                    reinterpret_cast<complexf*>(&out[i * mySpacing]))) {
+            continue;
+        }
+
+        fft.in[0][0] = 0;
+        fft.in[0][1] = 0;
 
         /* For TM I this is:
          * ZeroDst=769 ZeroSize=511
          * PosSrc=0 PosDst=1 PosSize=768
          * NegSrc=768 NegDst=1280 NegSize=768
          */
-        memset(&myFftIn[myZeroDst], 0, myZeroSize * sizeof(FFTW_TYPE));
-        memcpy(&myFftIn[myPosDst], &in[myPosSrc],
-                myPosSize * sizeof(FFTW_TYPE));
-        memcpy(&myFftIn[myNegDst], &in[myNegSrc],
-                myNegSize * sizeof(FFTW_TYPE));
+        memset(&fft.in[myZeroDst], 0, myZeroSize * sizeof(FFTW_TYPE));
+        copy_carriers(fft.in, symbol_in);
 
         if (myCfr) {
-            reference.resize(mySpacing);
-            memcpy(reinterpret_cast<fftwf_complex*>(reference.data()),
-                    myFftIn, mySpacing * sizeof(FFTW_TYPE));
+            fft.reference.resize(mySpacing);
+            memcpy(reinterpret_cast<fftwf_complex*>(fft.reference.data()),
+                    fft.in, mySpacing * sizeof(FFTW_TYPE));
         }
 
-        fftwf_execute(myFftPlan); // IFFT from myFftIn to myFftOut
+        fftwf_execute(fft.plan); // IFFT from fft.in to fft.out
 
+        cfr_iter_stat_t symbol_stat;
         if (myCfr) {
-            complexf *symbol = reinterpret_cast<complexf*>(myFftOut);
-            myPaprBeforeCFR.process_block(symbol, mySpacing);
-
-            if (myMERCalcIndex == i) {
-                before_cfr.resize(mySpacing);
-                memcpy(reinterpret_cast<fftwf_complex*>(before_cfr.data()),
-                        myFftOut, mySpacing * sizeof(FFTW_TYPE));
+            complexf *symbol = reinterpret_cast<complexf*>(fft.out);
+            if (myCurrentSnapshot) {
+                memcpy(myCurrentSnapshot->before_cfr.data() + i * mySpacing,
+                        symbol, mySpacing * sizeof(complexf));
             }
 
-            /* cfr_one_iteration runs the myFftPlan again at the end, and
-             * therefore writes the output data to myFftOut.
-             */
-            const auto stat = cfr_one_iteration(symbol, reference.data());
-
-            // i == 0 always zero power, so the MER ends up being NaN
-            if (i > 0) {
-                myPaprAfterCFR.process_block(symbol, mySpacing);
+            if (cached) {
+                fft.before_cfr.assign(symbol, symbol + mySpacing);
             }
 
-            if (i > 0 and myMERCalcIndex == i) {
-                /* MER definition, ETSI ETR 290, Annex C
-                 *
-                 *                       \sum I^2 + Q^2
-                 * MER[dB] = 10 log_10( ---------------- )
-                 *                      \sum dI^2 + dQ^2
-                 * Where I and Q are the ideal coordinates, and dI and dQ are
-                 * the errors in the received datapoints.
-                 *
-                 * In our case, we consider the constellation points given to the
-                 * OfdmGenerator as "ideal", and we compare the CFR output to it.
-                 */
-                double sum_iq = 0;
-                double sum_delta = 0;
-                for (size_t j = 0; j < mySpacing; j++) {
-                    sum_iq += (double)std::norm(before_cfr[j]);
-                    sum_delta += (double)std::norm(symbol[j] - before_cfr[j]);
+            /* cfr_one_iteration runs the fft.plan again at the end, and
+             * therefore writes the output data to fft.out.
+             */
+            for (size_t iteration = 0; iteration < myCfrIterations;
+                    iteration++) {
+                if (target_ratio > 0 and
+                        not papr_above(symbol, mySpacing, target_ratio)) {
+                    break;
                 }
 
-                // Clamp to 90dB, otherwise the MER average is going to be inf
-                const double mer = sum_delta > 0 ?
-                    10.0 * std::log10(sum_iq / sum_delta) : 90;
-                myMERs.push_back(mer);
+                const auto stat = cfr_one_iteration(fft, symbol,
+                        fft.reference.data());
+                fft.stat.clip_count += stat.clip_count;
+                fft.stat.errclip_count += stat.errclip_count;
+                fft.stat.symbol_count++;
+                symbol_stat.clip_count += stat.clip_count;
+                symbol_stat.errclip_count += stat.errclip_count;
+                symbol_stat.symbol_count++;
             }
-
-            num_clip += stat.clip_count;
-            num_error_clip += stat.errclip_count;
         }
 
-        memcpy(out, myFftOut, mySpacing * sizeof(FFTW_TYPE));
+        memcpy(&out[i * mySpacing], fft.out, mySpacing * sizeof(FFTW_TYPE));
 
-        in += myNbCarriers;
-        out += mySpacing;
+        if (cached) {
+            store_cached_symbol(fft, i, symbol_stat,
+                    reinterpret_cast<const complexf*>(symbol_in),
+                    reinterpret_cast<const complexf*>(&out[i * mySpacing]));
+        }
     }
+}
 
-    if (myCfr) {
-        std::lock_guard<std::mutex> lock(myCfrRcMutex);
+bool OfdmGeneratorCF32::lookup_cached_symbol(symbol_fft_t& fft, size_t i,
+        const complexf *carriers, complexf *out)
+{
+    for (auto& entry : mySymbolCaches[i]) {
+        if (entry.carriers.empty() or memcmp(entry.carriers.data(),
+                    carriers, myNbCarriers * sizeof(complexf)) != 0) {
+            continue;
+        }
 
-        const double num_samps = myNbSymbols * mySpacing;
-        const double clip_ratio = (double)num_clip / num_samps;
+        entry.last_use = myFrameCount;
+        memcpy(out, entry.symbol.data(), mySpacing * sizeof(complexf));
 
-        myClipRatios.push_back(clip_ratio);
-        while (myClipRatios.size() > MAX_CLIP_STATS) {
-            myClipRatios.pop_front();
-        }
+        if (myCfr) {
+            fft.stat.clip_count += entry.stat.clip_count;
+            fft.stat.errclip_count += entry.stat.errclip_count;
+            fft.stat.symbol_count += entry.stat.symbol_count;
 
-        const double errclip_ratio = (double)num_error_clip / num_samps;
-        myErrorClipRatios.push_back(errclip_ratio);
-        while (myErrorClipRatios.size() > MAX_CLIP_STATS) {
-            myErrorClipRatios.pop_front();
+            if (myCurrentSnapshot and not entry.before_cfr.empty()) {
+                memcpy(myCurrentSnapshot->before_cfr.data() + i * mySpacing,
+                        entry.before_cfr.data(), mySpacing * sizeof(complexf));
+            }
         }
+        return true;
+    }
+    return false;
+}
 
-        while (myMERs.size() > MAX_CLIP_STATS) {
-            myMERs.pop_front();
+void OfdmGeneratorCF32::store_cached_symbol(const symbol_fft_t& fft, size_t i,
+        const cfr_iter_stat_t& stat, const complexf *carriers,
+        const complexf *out)
+{
+    // Replace the entry that was used the longest time ago
+    cached_symbol_t *entry = &mySymbolCaches[i][0];
+    for (auto& e : mySymbolCaches[i]) {
+        if (e.last_use < entry->last_use) {
+            entry = &e;
         }
     }
 
-    return sizeOut;
+    entry->carriers.assign(carriers, carriers + myNbCarriers);
+    entry->symbol.assign(out, out + mySpacing);
+    entry->last_use = myFrameCount;
+
+    if (myCfr) {
+        entry->before_cfr = fft.before_cfr;
+        entry->stat = stat;
+    }
 }
 
 OfdmGeneratorCF32::cfr_iter_stat_t OfdmGeneratorCF32::cfr_one_iteration(
-        complexf *symbol, const complexf *reference)
+        symbol_fft_t& fft, complexf *symbol, const complexf *reference)
 {
-    // use std::norm instead of std::abs to avoid calculating the
-    // square roots
-    const float clip_squared = myCfrClip * myCfrClip;
-
     OfdmGeneratorCF32::cfr_iter_stat_t ret;
 
-    // Clip
-    for (size_t i = 0; i < mySpacing; i++) {
-        const float mag_squared = std::norm(symbol[i]);
-        if (mag_squared > clip_squared) {
-            // normalise absolute value to myCfrClip:
-            // x_clipped = x * clip / |x|
-            //           = x * sqrt(clip_squared) / sqrt(mag_squared)
-            //           = x * sqrt(clip_squared / mag_squared)
-            symbol[i] *= std::sqrt(clip_squared / mag_squared);
-            ret.clip_count++;
-        }
-    }
+    // Clip, symbol is fft.out
+    ret.clip_count = cfr_clip(symbol, mySpacing, myCfrClip * myCfrClip);
 
     // Take FFT of our clipped signal
-    memcpy(myCfrPostClip, symbol, mySpacing * sizeof(FFTW_TYPE));
-    fftwf_execute(myCfrFft); // FFT from myCfrPostClip to myCfrPostFft
+    fftwf_execute(fft.cfr_plan); // FFT from fft.out to fft.cfr_post_fft
 
     // Calculate the error in frequency domain by subtracting our reference
     // and clip it to myCfrErrorClip. By adding this clipped error signal
     // to our FFT output, we compensate the introduced error to some
     // extent.
-    const float err_clip_squared = myCfrErrorClip * myCfrErrorClip;
-
-    std::vector<float> error_norm(mySpacing);
-
-    for (size_t i = 0; i < mySpacing; i++) {
-        // FFTW computes an unnormalised transform, i.e. a FFT-IFFT pair
-        // or vice-versa gives back the original vector scaled by a factor
-        // FFT-size. Because we're comparing our constellation point
-        // (calculated with IFFT-clip-FFT) against reference (input to
-        // the IFFT), we need to divide by our FFT size.
-        const complexf constellation_point =
-            reinterpret_cast<complexf*>(myCfrPostFft)[i] / (float)mySpacing;
-
-        complexf error = reference[i] - constellation_point;
+    //
+    // FFTW computes an unnormalised transform, i.e. a FFT-IFFT pair
+    // or vice-versa gives back the original vector scaled by a factor
+    // FFT-size. Because we're comparing our constellation point
+    // (calculated with IFFT-clip-FFT) against reference (input to
+    // the IFFT), we need to divide by our FFT size.
+    //
+    // Update the input to the FFT directly to avoid another copy for the
+    // subsequence IFFT
+    ret.errclip_count = cfr_correct(
+            reinterpret_cast<const complexf*>(fft.cfr_post_fft), reference,
+            reinterpret_cast<complexf*>(fft.in), mySpacing);
 
-        const float mag_squared = std::norm(error);
-        error_norm[i] = mag_squared;
+    // Run our error-compensated symbol through the IFFT again
+    fftwf_execute(fft.plan); // IFFT from fft.in to fft.out
 
-        if (mag_squared > err_clip_squared) {
-            error *= std::sqrt(err_clip_squared / mag_squared);
-            ret.errclip_count++;
-        }
+    return ret;
+}
 
-        // Update the input to the FFT directly to avoid another copy for the
-        // subsequence IFFT
-        complexf *fft_in = reinterpret_cast<complexf*>(myFftIn);
-        fft_in[i] = constellation_point + error;
+size_t OfdmGeneratorCF32::cfr_correct(const complexf *clipped,
+        const complexf *reference, complexf *corrected, size_t n) const
+{
+    const float err_clip_squared = myCfrErrorClip * myCfrErrorClip;
+    switch (myCfrMethod) {
+        case cfr_method_e::ace:
+            return cfr_ace(clipped, reference, corrected, n,
+                    (float)mySpacing, err_clip_squared, myCfrAceGain);
+        case cfr_method_e::errorclip:
+            break;
     }
+    return cfr_error_clip(clipped, reference, corrected, n,
+            (float)mySpacing, err_clip_squared);
+}
 
-    // Run our error-compensated symbol through the IFFT again
-    fftwf_execute(myFftPlan); // IFFT from myFftIn to myFftOut
+void OfdmGeneratorCF32::set_cfr_method(const std::string& method,
+        float aceGain)
+{
+    if (aceGain < 1.0f) {
+        throw std::invalid_argument("The ACE gain must be at least 1");
+    }
 
-    return ret;
+    if (method == "errorclip") {
+        myCfrMethod = cfr_method_e::errorclip;
+    }
+    else if (method == "ace") {
+        myCfrMethod = cfr_method_e::ace;
+    }
+    else {
+        throw std::invalid_argument("Unknown CFR method " + method);
+    }
+    myCfrAceGain = aceGain;
+    myPaprClearRequest.store(true);
 }
 
+void OfdmGeneratorCF32::set_stats_interval(size_t interval)
+{
+    if (interval == 0) {
+        throw std::invalid_argument("The stats interval must be at least 1");
+    }
+    myStatsInterval.store(interval);
+}
 
 void OfdmGeneratorCF32::set_parameter(const std::string& parameter,
                                   const std::string& value)
@@ -392,7 +1245,64 @@ void OfdmGeneratorCF32::set_parameter(const std::string& parameter,
         ss >> myCfrErrorClip;
         myPaprClearRequest.store(true);
     }
-    else if (parameter == "clip_stats" or parameter == "papr") {
+    else if (parameter == "iterations") {
+        size_t iterations = 0;
+        ss >> iterations;
+        if (iterations == 0) {
+            throw ParameterError("Parameter 'iterations' must be at least 1");
+        }
+        myCfrIterations = iterations;
+        myPaprClearRequest.store(true);
+    }
+    else if (parameter == "method") {
+        try {
+            set_cfr_method(value, myCfrAceGain);
+        }
+        catch (const std::invalid_argument& e) {
+            throw ParameterError(e.what());
+        }
+    }
+    else if (parameter == "ace_gain") {
+        float gain = 0;
+        ss >> gain;
+        try {
+            set_cfr_method(
+                    myCfrMethod == cfr_method_e::ace ? "ace" : "errorclip", gain);
+        }
+        catch (const std::invalid_argument& e) {
+            throw ParameterError(e.what());
+        }
+    }
+    else if (parameter == "target_papr") {
+        float target_papr = 0;
+        ss >> target_papr;
+        if (target_papr < 0) {
+            throw ParameterError("Parameter 'target_papr' must not be negative");
+        }
+        myCfrTargetPapr = target_papr;
+        myPaprClearRequest.store(true);
+    }
+    else if (parameter == "mer_calc") {
+        int enabled = 0;
+        ss >> enabled;
+        myMERCalcEnabled.store(enabled != 0);
+        if (not enabled) {
+            std::lock_guard<std::mutex> lock(myCfrRcMutex);
+            myMERs.clear();
+        }
+    }
+    else if (parameter == "stats_interval") {
+        size_t interval = 0;
+        ss >> interval;
+        try {
+            set_stats_interval(interval);
+        }
+        catch (const std::invalid_argument& e) {
+            throw ParameterError(e.what());
+        }
+    }
+    else if (parameter == "clip_stats" or parameter == "papr" or
+            parameter == "ccdf") {
         throw ParameterError("Parameter '" + parameter + "' is read-only");
     }
     else {
@@ -416,9 +1326,27 @@ const std::string OfdmGeneratorCF32::get_parameter(const std::string& parameter)
     else if (parameter == "errorclip") {
         ss << std::fixed << myCfrErrorClip;
     }
+    else if (parameter == "iterations") {
+        ss << myCfrIterations;
+    }
+    else if (parameter == "target_papr") {
+        ss << std::fixed << myCfrTargetPapr;
+    }
+    else if (parameter == "mer_calc") {
+        ss << (myMERCalcEnabled.load() ? 1 : 0);
+    }
+    else if (parameter == "stats_interval") {
+        ss << myStatsInterval.load();
+    }
+    else if (parameter == "method") {
+        ss << (myCfrMethod == cfr_method_e::ace ? "ace" : "errorclip");
+    }
+    else if (parameter == "ace_gain") {
+        ss << std::fixed << myCfrAceGain;
+    }
     else if (parameter == "clip_stats") {
         std::lock_guard<std::mutex> lock(myCfrRcMutex);
-        if (myClipRatios.empty() or myErrorClipRatios.empty() or myMERs.empty()) {
+        if (myClipRatios.empty() or myErrorClipRatios.empty()) {
             ss << "No stats available";
         }
         else {
@@ -430,14 +1358,21 @@ const std::string OfdmGeneratorCF32::get_parameter(const std::string& parameter)
                 std::accumulate(myErrorClipRatios.begin(), myErrorClipRatios.end(), 0.0) /
                 myErrorClipRatios.size();
 
-            const double avg_mer =
-                std::accumulate(myMERs.begin(), myMERs.end(), 0.0) /
-                myMERs.size();
+            const double avg_iterations =
+                std::accumulate(myIterationsPerSymbol.begin(),
+                        myIterationsPerSymbol.end(), 0.0) /
+                myIterationsPerSymbol.size();
 
             ss << "Statistics : " << std::fixed <<
                 avg_clip_ratio * 100 << "%"" samples clipped, " <<
-                avg_errclip_ratio * 100 << "%"" errors clipped. " <<
-                "MER after CFR: " << avg_mer << " dB";
+                avg_errclip_ratio * 100 << "%"" errors clipped. ";
+            if (not myMERs.empty()) {
+                const double avg_mer =
+                    std::accumulate(myMERs.begin(), myMERs.end(), 0.0) /
+                    myMERs.size();
+                ss << "MER after CFR: " << avg_mer << " dB. ";
+            }
+            ss << avg_iterations << " iterations per symbol";
         }
     }
     else if (parameter == "papr") {
@@ -449,6 +1384,29 @@ const std::string OfdmGeneratorCF32::get_parameter(const std::string& parameter)
             ", " <<
             (papr_after == 0 ? string("N/A") : to_string(papr_after));
     }
+    else if (parameter == "ccdf") {
+        const vector<double> levels = {2, 4, 6, 8, 10, 12};
+        const auto ccdf_before = myPaprBeforeCFR.calculate_ccdf(levels);
+        const auto ccdf_after = myPaprAfterCFR.calculate_ccdf(levels);
+
+        ss << "CCDF:" << std::scientific << std::setprecision(2);
+        for (size_t i = 0; i < levels.size(); i++) {
+            ss << (i == 0 ? " " : "; ") << (int)levels[i] << " dB: ";
+            if (ccdf_before.empty()) {
+                ss << "N/A";
+            }
+            else {
+                ss << ccdf_before[i];
+            }
+            ss << ", ";
+            if (ccdf_after.empty()) {
+                ss << "N/A";
+            }
+            else {
+                ss << ccdf_after[i];
+            }
+        }
+    }
     else {
         ss << "Parameter '" << parameter <<
             "' is not exported by controllable " << get_rc_name();
@@ -467,16 +1425,23 @@ const json::map_t OfdmGeneratorCF32::get_all_values() const
 OfdmGeneratorFixed::OfdmGeneratorFixed(size_t nbSymbols,
                              size_t nbCarriers,
                              size_t spacing,
-                             bool inverse) :
+                             bool inverse,
+                             bool simdFft) :
     ModCodec(),
     myNbSymbols(nbSymbols),
     myNbCarriers(nbCarriers),
     mySpacing(spacing)
 {
-    PDEBUG("OfdmGenerator::OfdmGenerator(%zu, %zu, %zu, %s) @ %p\n",
-            nbSymbols, nbCarriers, spacing, inverse ? "true" : "false", this);
+    PDEBUG("OfdmGenerator::OfdmGenerator(%zu, %zu, %zu, %s, %s) @ %p\n",
+            nbSymbols, nbCarriers, spacing, inverse ? "true" : "false",
+            simdFft ? "true" : "false", this);
 
-    etiLog.level(info) << "Using KISS FFT by Mark Borgerding for fixed-point transform";
+    if (simdFft) {
+        etiLog.level(info) << "Using SIMD fixed-point FFT, bit-exact with KISS FFT";
+    }
+    else {
+        etiLog.level(info) << "Using KISS FFT by Mark Borgerding for fixed-point transform";
+    }
 
     if (nbCarriers > spacing) {
         throw std::runtime_error("OfdmGenerator nbCarriers > spacing!");
@@ -517,7 +1482,12 @@ OfdmGeneratorFixed::OfdmGeneratorFixed(size_t nbSymbols,
     myFftOut = (kiss_fft_cpx*)KISS_FFT_MALLOC(nbytes);
     memset(myFftIn, 0, nbytes);
 
-    myKissCfg = kiss_fft_alloc(N, inverse, nullptr, nullptr);
+    if (simdFft) {
+        mySimdFft = std::make_unique<FixedPointFft>(N, inverse);
+    }
+    else {
+        myKissCfg = kiss_fft_alloc(N, inverse, nullptr, nullptr);
+    }
 }
 
 OfdmGeneratorFixed::~OfdmGeneratorFixed()
@@ -567,9 +1537,13 @@ int OfdmGeneratorFixed::process(Buffer* const dataIn, Buffer* dataOut)
         memcpy(&myFftIn[myPosDst], &in[myPosSrc], myPosSize * sizeof(kiss_fft_cpx));
         memcpy(&myFftIn[myNegDst], &in[myNegSrc], myNegSize * sizeof(kiss_fft_cpx));
 
-        kiss_fft(myKissCfg, myFftIn, myFftOut);
-
-        memcpy(out, myFftOut, mySpacing * sizeof(kiss_fft_cpx));
+        if (mySimdFft) {
+            mySimdFft->transform(myFftIn, out);
+        }
+        else {
+            kiss_fft(myKissCfg, myFftIn, myFftOut);
+            memcpy(out, myFftOut, mySpacing * sizeof(kiss_fft_cpx));
+        }
 
         in += myNbCarriers;
         out += mySpacing;
@@ -633,6 +1607,15 @@ OfdmGeneratorDEXTER::OfdmGeneratorDEXTER(size_t nbSymbols,
     iio_channel_enable(m_channel_in);
     iio_channel_enable(m_channel_out);
 
+    // Every symbol in flight needs a kernel buffer on both sides, and one
+    // more is needed for the symbol being prepared or read back.
+    constexpr unsigned int kernel_buffers = FFT_SYMBOLS_IN_FLIGHT + 2;
+    if (iio_device_set_kernel_buffers_count(m_dev_in, kernel_buffers) != 0 or
+            iio_device_set_kernel_buffers_count(m_dev_out, kernel_buffers) != 0) {
+        etiLog.level(warn) << "OfdmGeneratorDEXTER: cannot set " <<
+            kernel_buffers << " kernel buffers, using the default";
+    }
+
     m_buf_in = iio_device_create_buffer(m_dev_in, nbytes_in, false);
     if (!m_buf_in) {
         throw std::runtime_error("OfdmGeneratorDEXTER could not create in buffer");
@@ -672,6 +1655,33 @@ OfdmGeneratorDEXTER::~OfdmGeneratorDEXTER()
     }
 }
 
+void OfdmGeneratorDEXTER::read_fft_output(complexfix_wide *out)
+{
+    ssize_t nbytes_rx = iio_buffer_refill(m_buf_out);
+    if (nbytes_rx < 0) {
+        throw std::runtime_error("OfdmGenerator::process error refilling IIO buffer!");
+    }
+
+    ptrdiff_t p_inc = iio_buffer_step(m_buf_out);
+    if (p_inc != 1) {
+        throw std::runtime_error("OfdmGenerator::process Wrong p_inc");
+    }
+
+    // The FFT Accelerator takes 16-bit I + 16-bit Q, and outputs 32-bit I and 32-bit Q.
+    // The formatconvert will take care of this
+    const uint8_t *fft_out = (const uint8_t*)iio_buffer_first(m_buf_out, m_channel_out);
+    const uint8_t *fft_out_end = (const uint8_t*)iio_buffer_end(m_buf_out);
+    constexpr size_t sizeof_out_iq = sizeof(complexfix_wide);
+    if ((fft_out_end - fft_out) != (ssize_t)(mySpacing * sizeof_out_iq)) {
+        fprintf(stderr, "FFT_OUT: %p %p %zu %zu\n",
+                fft_out, fft_out_end, (fft_out_end - fft_out),
+                mySpacing * sizeof_out_iq);
+        throw std::runtime_error("OfdmGenerator::process fft_out length invalid!");
+    }
+
+    memcpy(out, fft_out, mySpacing * sizeof_out_iq);
+}
+
 int OfdmGeneratorDEXTER::process(Buffer* const dataIn, Buffer* dataOut)
 {
     dataOut->setLength(myNbSymbols * mySpacing * sizeof(complexfix_wide));
@@ -703,6 +1713,10 @@ int OfdmGeneratorDEXTER::process(Buffer* const dataIn, Buffer* dataOut)
         throw std::runtime_error("OfdmGenerator::process incorrect iio buffer size!");
     }
 
+    /* Keep FFT_SYMBOLS_IN_FLIGHT symbols in the accelerator while we are
+     * preparing the next one and reading back the oldest one, so that
+     * neither the CPU nor the FPGA wait for the other. */
+    size_t num_in_flight = 0;
     for (size_t i = 0; i < myNbSymbols; i++) {
         complexfix *fft_in = reinterpret_cast<complexfix*>(iio_buffer_start(m_buf_in));
 
@@ -726,63 +1740,21 @@ int OfdmGeneratorDEXTER::process(Buffer* const dataIn, Buffer* dataOut)
         }
 
         in += myNbCarriers;
+        num_in_flight++;
 
-        // Keep one buffer in flight while we're doing shuffling data around here,
-        // this improves performance.
-        // I believe that, by default, IIO allocates four buffers in total.
-        if (i > 0) {
-            ssize_t nbytes_rx = iio_buffer_refill(m_buf_out);
-            if (nbytes_rx < 0) {
-                throw std::runtime_error("OfdmGenerator::process error refilling IIO buffer!");
-            }
-
-            ptrdiff_t p_inc = iio_buffer_step(m_buf_out);
-            if (p_inc != 1) {
-                throw std::runtime_error("OfdmGenerator::process Wrong p_inc");
-            }
-
-            // The FFT Accelerator takes 16-bit I + 16-bit Q, and outputs 32-bit I and 32-bit Q.
-            // The formatconvert will take care of this
-            const uint8_t *fft_out = (const uint8_t*)iio_buffer_first(m_buf_out, m_channel_out);
-            const uint8_t *fft_out_end = (const uint8_t*)iio_buffer_end(m_buf_out);
-            constexpr size_t sizeof_out_iq = sizeof(complexfix_wide);
-            if ((fft_out_end - fft_out) != (ssize_t)(mySpacing * sizeof_out_iq)) {
-                fprintf(stderr, "FFT_OUT: %p %p %zu %zu\n",
-                        fft_out, fft_out_end, (fft_out_end - fft_out),
-                        mySpacing * sizeof_out_iq);
-                throw std::runtime_error("OfdmGenerator::process fft_out length invalid!");
-            }
-
-            memcpy(out, fft_out, mySpacing * sizeof_out_iq);
-
+        if (num_in_flight > FFT_SYMBOLS_IN_FLIGHT) {
+            read_fft_output(out);
             out += mySpacing;
+            num_in_flight--;
         }
     }
 
-    ssize_t nbytes_rx = iio_buffer_refill(m_buf_out);
-    if (nbytes_rx < 0) {
-        throw std::runtime_error("OfdmGenerator::process error refilling IIO buffer!");
-    }
-
-    ptrdiff_t p_inc = iio_buffer_step(m_buf_out);
-    if (p_inc != 1) {
-        throw std::runtime_error("OfdmGenerator::process Wrong p_inc");
-    }
-
-    // The FFT Accelerator takes 16-bit I + 16-bit Q, and outputs 32-bit I and 32-bit Q.
-    // The formatconvert will take care of this
-    const uint8_t *fft_out = (const uint8_t*)iio_buffer_first(m_buf_out, m_channel_out);
-    const uint8_t *fft_out_end = (const uint8_t*)iio_buffer_end(m_buf_out);
-    constexpr size_t sizeof_out_iq = sizeof(complexfix_wide);
-    if ((fft_out_end - fft_out) != (ssize_t)(mySpacing * sizeof_out_iq)) {
-        fprintf(stderr, "FFT_OUT: %p %p %zu %zu\n",
-                fft_out, fft_out_end, (fft_out_end - fft_out),
-                mySpacing * sizeof_out_iq);
-        throw std::runtime_error("OfdmGenerator::process fft_out length invalid!");
+    while (num_in_flight > 0) {
+        read_fft_output(out);
+        out += mySpacing;
+        num_in_flight--;
     }
 
-    memcpy(out, fft_out, mySpacing * sizeof_out_iq);
-
     return sizeOut;
 }
 
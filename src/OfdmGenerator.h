@@ -34,9 +34,18 @@
 #include "RemoteControl.h"
 #include "PAPRStats.h"
 #include "kiss_fft.h"
+#include "FixedPointFft.h"
+#include "OfdmBatchService.h"
 
 #include <cstddef>
+#include <cstdint>
+#include <array>
 #include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include <fftw3.h>
 
 #ifdef HAVE_DEXTER
@@ -53,7 +62,12 @@ class OfdmGeneratorCF32 : public ModCodec, public RemoteControllable
                       bool& enableCfr,
                       float& cfrClip,
                       float& cfrErrorClip,
-                      bool inverse = true);
+                      size_t& cfrIterations,
+                      float& cfrTargetPapr,
+                      bool inverse = true,
+                      bool batchedFft = false,
+                      size_t numThreads = 0,
+                      size_t numCachedSymbols = 0);
         virtual ~OfdmGeneratorCF32();
         OfdmGeneratorCF32(const OfdmGeneratorCF32&) = delete;
         OfdmGeneratorCF32& operator=(const OfdmGeneratorCF32&) = delete;
@@ -61,22 +75,185 @@ class OfdmGeneratorCF32 : public ModCodec, public RemoteControllable
         int process(Buffer* const dataIn, Buffer* dataOut) override;
         const char* name() override { return "OfdmGenerator"; }
 
+        // The FFT workspaces, the symbol caches once they are full, and
+        // the snapshots of the statistics
+        size_t memory_usage() const override;
+
+        // The symbols are converted after the IFFT
+        bool supports_planar_output() const override { return true; }
+
+        /* Multiply every carrier by its gain, given in the order of the
+         * carriers in the input symbols, while it is copied into the FFT
+         * input. This replaces the CicEqualizer, and applies a
+         * pre-emphasis. Must be called before the first frame. */
+        void set_carrier_gains(const std::vector<float>& gains);
+
+        /* Transform the symbols with the plan of the service, together
+         * with the other ensembles of the same mode, in the given slot.
+         * Only with batched FFT, and without parallel symbols. Must be
+         * called before the first frame. */
+        void set_batch_service(std::shared_ptr<OfdmBatchService> service,
+                size_t slot);
+
+        /* How the CFR compensates the error the clipping introduces on the
+         * carriers:
+         *  errorclip: the error is clipped to the errorclip amplitude,
+         *  ace: active constellation extension, the carriers keep their
+         *      phase and can only move outward, by up to the errorclip
+         *      amplitude, after multiplication by aceGain. The unused
+         *      carriers keep the error that exceeds the errorclip
+         *      amplitude, like with errorclip.
+         * Throws an invalid_argument for other names, or a gain below 1. */
+        void set_cfr_method(const std::string& method, float aceGain = 4.0f);
+
+        /* With CFR, measure the PAPR before and after CFR, and the MER
+         * after CFR, on one in interval frames. Throws an invalid_argument
+         * if interval is 0. */
+        void set_stats_interval(size_t interval);
+
         /* Functions for the remote control */
         virtual void set_parameter(const std::string& parameter, const std::string& value) override;
         virtual const std::string get_parameter(const std::string& parameter) const override;
         virtual const json::map_t get_all_values() const override;
 
     protected:
+        int process_interleaved(Buffer* const dataIn, Buffer* dataOut);
+
         struct cfr_iter_stat_t {
             size_t clip_count = 0;
             size_t errclip_count = 0;
+            // Number of symbols that went through an iteration
+            size_t symbol_count = 0;
         };
 
-        cfr_iter_stat_t cfr_one_iteration(
+        // The plans and buffers to transform one symbol at a time. The
+        // symbols of a transmission frame are split into parts that are
+        // transformed in parallel, each part with its own symbol_fft_t.
+        struct symbol_fft_t {
+            fftwf_plan plan = nullptr; // IFFT from in to out
+            fftwf_complex *in = nullptr;
+            fftwf_complex *out = nullptr;
+            fftwf_plan cfr_plan = nullptr; // FFT from out to cfr_post_fft
+            fftwf_complex *cfr_post_fft = nullptr;
+
+            // It is not guaranteed that fftw keeps the FFT input vector
+            // intact, the CFR reference is therefore a copy.
+            std::vector<complexf> reference;
+
+            // IFFT output before CFR applied, for the symbol cache
+            std::vector<complexf> before_cfr;
+
+            cfr_iter_stat_t stat;
+        };
+
+        // The first symbols of a transmission frame, the null symbol with
+        // the TII and the phase reference, usually repeat from one frame to
+        // the next. Their output is cached together with their carriers.
+        struct cached_symbol_t {
+            std::vector<complexf> carriers; // Empty if the entry is unused
+            std::vector<complexf> symbol;
+            std::vector<complexf> before_cfr;
+            cfr_iter_stat_t stat;
+            uint64_t last_use = 0;
+        };
+
+        // The TII is only inserted in every other null symbol
+        static constexpr size_t CACHE_ENTRIES_PER_SYMBOL = 2;
+        using symbol_cache_t = std::array<cached_symbol_t, CACHE_ENTRIES_PER_SYMBOL>;
+
+        // Copy symbol i to out and fill the statistics from the cache.
+        // Returns false if the cache does not contain its carriers.
+        bool lookup_cached_symbol(symbol_fft_t& fft, size_t i,
+                const complexf *carriers, complexf *out);
+        void store_cached_symbol(const symbol_fft_t& fft, size_t i,
+                const cfr_iter_stat_t& stat, const complexf *carriers,
+                const complexf *out);
+
+        cfr_iter_stat_t cfr_one_iteration(symbol_fft_t& fft,
                 complexf *symbol, const complexf *reference);
 
-        fftwf_plan myFftPlan;
-        fftwf_complex *myFftIn, *myFftOut;
+        // Compensate the error of n clipped carriers with myCfrMethod,
+        // returns the number of carriers whose error was limited
+        size_t cfr_correct(const complexf *clipped, const complexf *reference,
+                complexf *corrected, size_t n) const;
+
+        // Transform the symbols [start, stop) of a transmission frame
+        void process_symbols(symbol_fft_t& fft,
+                const fftwf_complex *in, fftwf_complex *out,
+                size_t start, size_t stop, float target_ratio);
+
+        // Copy the carriers of a symbol to their bins, with the gains
+        void copy_carriers(fftwf_complex *fft_in, const fftwf_complex *symbol) const;
+
+        // Copy the carriers of all symbols of a transmission frame to
+        // myBatchFftIn, and run myBatchPlan from fft_in to out
+        void load_batch(const fftwf_complex *in);
+        void execute_batch(fftwf_complex *fft_in, fftwf_complex *out);
+
+        // Transform myBatchFftIn to out, with the service if there is one
+        void transform_batch(fftwf_complex *out);
+
+        // Transform all symbols of a transmission frame with one plan
+        void process_batched(const fftwf_complex *in, fftwf_complex *out);
+
+        // Same, with the CFR iterations on all symbols. The clipped
+        // symbols are also transformed with one plan.
+        cfr_iter_stat_t process_batched_cfr(
+                const fftwf_complex *in, fftwf_complex *out);
+
+        void push_cfr_stats(const cfr_iter_stat_t& stat);
+
+        /* The PAPR and MER of a frame are measured by the stats thread,
+         * on copies of the symbols before and after CFR. */
+        struct stats_snapshot_t {
+            std::vector<complexf> before_cfr;
+            std::vector<complexf> after_cfr;
+            uint64_t generation = 0;
+            bool measure_mer = false;
+            // Given to the stats thread, and not yet measured
+            bool pending = false;
+        };
+
+        // Returns the snapshot to fill for the current frame, nullptr if
+        // the frame is not measured
+        stats_snapshot_t *begin_snapshot();
+        // Copy the output frame and give the snapshot to the stats thread
+        void end_snapshot(stats_snapshot_t *snapshot, const fftwf_complex *out);
+        void stats_thread();
+        void measure_snapshot(const stats_snapshot_t& snapshot);
+
+        std::vector<symbol_fft_t> mySymbolFfts;
+        // Bytes of the FFT arrays and of the full symbol caches
+        size_t myWorkspaceBytes = 0;
+
+        // One cache for each of the first numCachedSymbols symbols
+        std::vector<symbol_cache_t> mySymbolCaches;
+        uint64_t myFrameCount = 0;
+
+        // Plan over all symbols of a transmission frame, and the forward
+        // plan over the clipped symbols for CFR. nullptr if batching is
+        // not enabled. The four arrays are in one workspace that starts
+        // at myBatchIn, large enough for huge pages.
+        fftwf_plan myBatchPlan = nullptr;
+        fftwf_complex *myBatchIn = nullptr;
+        fftwf_complex *myBatchOut = nullptr;
+        fftwf_plan myCfrBatchFft = nullptr;
+        fftwf_complex *myCfrBatchPostFft = nullptr;
+        fftwf_complex *myCfrBatchCorrected = nullptr;
+
+        // The input of the batch, myBatchIn or the slot of the service
+        fftwf_complex *myBatchFftIn = nullptr;
+        std::shared_ptr<OfdmBatchService> myBatchService;
+        size_t myBatchSlot = 0;
+        // The last frame timed out in the service
+        bool myBatchTimedOut = false;
+
+        // For the conversion to the planar layout
+        std::vector<float> myPlanarScratch;
+
+        // Two values per carrier, for the real and imaginary parts. Empty
+        // without gains.
+        std::vector<float> myCarrierGains;
         const size_t myNbSymbols;
         const size_t myNbCarriers;
         const size_t mySpacing;
@@ -93,21 +270,42 @@ class OfdmGeneratorCF32 : public ModCodec, public RemoteControllable
         mutable std::mutex myCfrRcMutex;
         float& myCfrClip;
         float& myCfrErrorClip;
-        fftwf_plan myCfrFft;
-        fftwf_complex *myCfrPostClip;
-        fftwf_complex *myCfrPostFft;
+        // Maximum number of iterations, and PAPR in dB below which a
+        // symbol needs no further iteration. 0 disables the early exit.
+        size_t& myCfrIterations;
+        float& myCfrTargetPapr;
+
+        enum class cfr_method_e { errorclip, ace };
+        cfr_method_e myCfrMethod = cfr_method_e::errorclip;
+        float myCfrAceGain = 4.0f;
 
         // Statistics for CFR
         std::deque<double> myClipRatios;
         std::deque<double> myErrorClipRatios;
+        std::deque<double> myIterationsPerSymbol;
 
         // Measure PAPR before and after CFR
         PAPRStats myPaprBeforeCFR;
         PAPRStats myPaprAfterCFR;
         std::atomic<bool> myPaprClearRequest;
 
-        size_t myMERCalcIndex = 0;
+        std::atomic<bool> myMERCalcEnabled = ATOMIC_VAR_INIT(true);
         std::deque<double> myMERs;
+
+        // One in myStatsInterval frames is measured. The snapshots are
+        // allocated at the first measured frame. A frame is skipped if the
+        // stats thread still has both. The snapshots of an older
+        // generation were taken before the statistics got cleared.
+        std::atomic<size_t> myStatsInterval = ATOMIC_VAR_INIT(1);
+        size_t myStatsFrameCount = 0;
+        std::atomic<uint64_t> myStatsGeneration = ATOMIC_VAR_INIT(0);
+        std::array<stats_snapshot_t, 2> mySnapshots;
+        std::atomic<size_t> mySnapshotBytes = ATOMIC_VAR_INIT(0);
+        stats_snapshot_t *myCurrentSnapshot = nullptr;
+        std::mutex mySnapshotMutex;
+        std::condition_variable mySnapshotCond;
+        bool myStatsThreadRunning = true;
+        std::thread myStatsThread;
 };
 
 // Fixed point implementation uses KISS FFT with -DFIXED_POINT=32
@@ -117,7 +315,8 @@ class OfdmGeneratorFixed : public ModCodec
         OfdmGeneratorFixed(size_t nbSymbols,
                       size_t nbCarriers,
                       size_t spacing,
-                      bool inverse = true);
+                      bool inverse = true,
+                      bool simdFft = false);
         virtual ~OfdmGeneratorFixed();
         OfdmGeneratorFixed(const OfdmGeneratorFixed&) = delete;
         OfdmGeneratorFixed& operator=(const OfdmGeneratorFixed&) = delete;
@@ -129,6 +328,9 @@ class OfdmGeneratorFixed : public ModCodec
         kiss_fft_cfg myKissCfg = nullptr;
         kiss_fft_cpx *myFftIn, *myFftOut;
 
+        // Replaces myKissCfg when the SIMD engine is used
+        std::unique_ptr<FixedPointFft> mySimdFft;
+
         const size_t myNbSymbols;
         const size_t myNbCarriers;
         const size_t mySpacing;
@@ -159,6 +361,13 @@ class OfdmGeneratorDEXTER : public ModCodec
         const char* name() override { return "OfdmGenerator"; }
 
     private:
+        // Number of symbols given to the FFT accelerator before the first
+        // result is read back
+        static constexpr size_t FFT_SYMBOLS_IN_FLIGHT = 2;
+
+        // Read back the oldest symbol from the FFT accelerator
+        void read_fft_output(complexfix_wide *out);
+
         struct iio_context *m_ctx = nullptr;
 
         // "in" and "out" are from the point of view of the FFT Accelerator block
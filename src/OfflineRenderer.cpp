@@ -0,0 +1,267 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+*/
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "OfflineRenderer.h"
+#include "DabModulator.h"
+#include "EtiReader.h"
+#include "FrameMultiplexer.h"
+#include "Log.h"
+#include "WorkerPool.h"
+
+#include <chrono>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+// A subchannel goes through the time interleaver in 16 CIFs, there is one
+// CIF per ETI frame.
+static constexpr size_t TIME_INTERLEAVER_FRAMES = 16;
+
+// Most transmission frames contain 4 ETI frames, in mode I. The blocks
+// after the time interleaver keep less than one transmission frame of
+// history.
+static constexpr size_t MAX_FRAMES_PER_TF = 4;
+
+// The FP counts ETI frames modulo 8. Aligning the chunks on it also keeps
+// the TII, inserted in every second transmission frame, in the same phase.
+static constexpr size_t FP_PERIOD = 8;
+
+OfflineRenderer::OfflineRenderer(
+        const mod_settings_t& mod_settings, const std::string& format) :
+    m_mod_settings(mod_settings),
+    m_format(format)
+{
+    if (m_input.Open(m_mod_settings.inputName, false) == -1) {
+        throw runtime_error("Offline rendering: unable to open input " +
+                m_mod_settings.inputName);
+    }
+
+    switch (m_mod_settings.dabMode) {
+        case 2:
+        case 3: m_frames_per_output = 1; break;
+        case 4: m_frames_per_output = 2; break;
+        default: m_frames_per_output = MAX_FRAMES_PER_TF; break;
+    }
+    m_frames_per_output *= m_mod_settings.batchFrames;
+    m_frame_alignment = std::lcm(FP_PERIOD, m_frames_per_output);
+
+    auto align = [this](size_t frames) {
+        return (frames + m_frame_alignment - 1) /
+            m_frame_alignment * m_frame_alignment;
+    };
+    m_warmup_frames = align(TIME_INTERLEAVER_FRAMES + MAX_FRAMES_PER_TF);
+    m_chunk_frames = align(m_mod_settings.offlineChunkFrames);
+
+    // Same as the live modulator, which waits for FP 0 to start
+    const size_t num_frames = m_input.GetNumFrames();
+    unsigned fct = 0;
+    unsigned fp = 0;
+    for (m_first_frame = 0; m_first_frame < num_frames; m_first_frame++) {
+        m_input.GetFrameCounters(m_first_frame, fct, fp);
+        if (fp == 0) {
+            break;
+        }
+    }
+
+    if (m_first_frame == num_frames) {
+        throw runtime_error("Offline rendering: no frame with FP 0 in input");
+    }
+
+    unsigned last_fct = fct;
+    for (size_t i = m_first_frame + 1; i < num_frames; i++) {
+        m_input.GetFrameCounters(i, fct, fp);
+        if (fct != (last_fct + 1) % 250) {
+            throw runtime_error("Offline rendering: ETI FCT discontinuity at frame " +
+                    to_string(i) + ", expected " + to_string((last_fct + 1) % 250) +
+                    " received " + to_string(fct));
+        }
+        last_fct = fct;
+    }
+
+    m_num_frames = num_frames - m_first_frame;
+    m_num_chunks = (m_num_frames + m_chunk_frames - 1) / m_chunk_frames;
+
+    m_output_fd = open(m_mod_settings.outputName.c_str(),
+            O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (m_output_fd == -1) {
+        throw runtime_error("Offline rendering: unable to open output file " +
+                m_mod_settings.outputName + ": " + strerror(errno));
+    }
+
+    struct stat output_stat;
+    if (fstat(m_output_fd, &output_stat) == -1 or not S_ISREG(output_stat.st_mode)) {
+        close(m_output_fd);
+        throw runtime_error("Offline rendering: output " +
+                m_mod_settings.outputName + " is not a regular file");
+    }
+}
+
+void OfflineRenderer::run()
+{
+    using namespace std::chrono;
+
+    etiLog.level(info) << "Offline rendering of " << m_num_frames <<
+        " frames in " << m_num_chunks << " chunks of " << m_chunk_frames <<
+        " frames, on " << WorkerPool::shared().num_threads() + 1 << " threads";
+
+    const auto start = steady_clock::now();
+
+    try {
+        WorkerPool::shared().parallel_for(m_num_chunks,
+                [this](size_t chunk) { render_chunk(chunk); });
+    }
+    catch (...) {
+        close(m_output_fd);
+        throw;
+    }
+
+    if (close(m_output_fd) == -1) {
+        throw runtime_error(string("Offline rendering: unable to close output file: ") +
+                strerror(errno));
+    }
+
+    const double duration = duration_cast<milliseconds>(
+            steady_clock::now() - start).count() / 1000.0;
+    const double signal_duration = m_num_frames * 0.024;
+    etiLog.level(info) << "Offline rendering of " << signal_duration <<
+        "s took " << duration << "s, " <<
+        (duration > 0 ? signal_duration / duration : 0) <<
+        " times faster than real time";
+}
+
+void OfflineRenderer::render_chunk(size_t chunk)
+{
+    const size_t chunk_start = m_first_frame + chunk * m_chunk_frames;
+    const size_t chunk_end = std::min(chunk_start + m_chunk_frames,
+            m_first_frame + m_num_frames);
+    const size_t warmup_start = chunk_start -
+        std::min(m_warmup_frames, chunk_start - m_first_frame);
+
+    // The DabModulator keeps a reference to its settings
+    mod_settings_t mod_settings = m_mod_settings;
+    mod_settings.showProcessTime = false;
+
+    unique_ptr<EtiReader> etiReader;
+    unique_ptr<DabModulator> modulator;
+    auto setup = [&]() {
+        modulator.reset();
+        etiReader = make_unique<EtiReader>(mod_settings.tist_offset_s);
+        modulator = make_unique<DabModulator>(*etiReader, mod_settings, m_format);
+    };
+    setup();
+
+    vector<uint8_t> padded_frame(6144);
+    Buffer samples;
+
+    // The pipelined blocks delay the output by a few transmission frames.
+    // The n-th output of the modulator therefore contains the samples of
+    // the n-th group of m_frames_per_output frames since modulator_start,
+    // and the frames after the chunk are used to get the last ones out.
+    size_t modulator_start = warmup_start;
+    size_t num_outputs = 0;
+
+    const size_t input_end = m_first_frame + m_num_frames;
+    for (size_t frame = warmup_start; frame < input_end; frame++) {
+        const uint8_t *eti = m_input.GetFrame(frame, padded_frame.data());
+        if (etiReader->loadEtiData(eti, 6144) != 6144) {
+            throw runtime_error("Offline rendering: ETI frame " +
+                    to_string(frame) + " incompletely read");
+        }
+
+        // Returns 0 until a transmission frame, or a batch, is complete
+        int ret = 0;
+        try {
+            ret = modulator->process(&samples);
+        }
+        catch (const FrameMultiplexerError& e) {
+            // Like the live modulator, restart with a new modulator, at the
+            // next aligned frame. The samples of the frames in between stay
+            // zero in the output.
+            etiLog.level(warn) << "Offline rendering: " << e.what() <<
+                " at frame " << frame;
+            setup();
+            modulator_start = m_first_frame +
+                ((frame - m_first_frame) / m_frame_alignment + 1) * m_frame_alignment;
+            num_outputs = 0;
+            frame = modulator_start - 1;
+            continue;
+        }
+
+        if (ret == 0) {
+            continue;
+        }
+
+        const size_t output_start = modulator_start + num_outputs * m_frames_per_output;
+        num_outputs++;
+        if (output_start >= chunk_end) {
+            break;
+        }
+
+        size_t expected_bytes = 0;
+        if (not m_bytes_per_output.compare_exchange_strong(expected_bytes,
+                    samples.getLength()) and expected_bytes != samples.getLength()) {
+            throw runtime_error("Offline rendering: the modulator output does "
+                    "not have the same size for every frame");
+        }
+
+        // The output of the frames before the chunk is only used to get
+        // the blocks into the right state
+        if (output_start >= chunk_start) {
+            write_output((output_start - m_first_frame) / m_frames_per_output, samples);
+        }
+    }
+
+    const size_t chunks_done = ++m_chunks_done;
+    if (chunks_done * 10 / m_num_chunks != (chunks_done - 1) * 10 / m_num_chunks) {
+        etiLog.level(info) << "Offline rendering: " <<
+            chunks_done * 100 / m_num_chunks << "% done";
+    }
+}
+
+void OfflineRenderer::write_output(size_t output_index, const Buffer& samples)
+{
+    const uint8_t *data = reinterpret_cast<const uint8_t*>(samples.getData());
+    size_t remaining = samples.getLength();
+    off_t offset = output_index * samples.getLength();
+
+    while (remaining > 0) {
+        const ssize_t ret = pwrite(m_output_fd, data, remaining, offset);
+        if (ret == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw runtime_error(string("Offline rendering: unable to write output: ") +
+                    strerror(errno));
+        }
+        data += ret;
+        remaining -= ret;
+        offset += ret;
+    }
+}
+
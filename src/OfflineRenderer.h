@@ -0,0 +1,98 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   Modulates an ETI file into an I/Q file faster than real time, using
+   all CPUs.
+*/
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include "ConfigParser.h"
+#include "InputReader.h"
+
+/* The ETI file is cut into chunks of chunk_frames frames, which the tasks
+ * of the WorkerPool modulate independently, each with its own EtiReader
+ * and DabModulator. The output of every chunk is written at its place in
+ * the output file, which therefore needs to be a regular file.
+ *
+ * Only the time interleaver and the blocks working on the samples keep
+ * state from one frame to the next. Every chunk therefore starts by
+ * modulating some frames before its beginning, whose output is
+ * discarded. After these, the state of all blocks is the same as if the
+ * whole file had been modulated in one go, and so is the output.
+ *
+ * Like the live modulator, rendering starts at the first frame with
+ * FP 0. The file must not have FCT discontinuities after that.
+ */
+class OfflineRenderer
+{
+    public:
+        OfflineRenderer(const mod_settings_t& mod_settings,
+                const std::string& format);
+
+        OfflineRenderer(const OfflineRenderer& other) = delete;
+        OfflineRenderer& operator=(const OfflineRenderer& other) = delete;
+
+        // Returns when the whole file has been written, throws on error
+        void run();
+
+    private:
+        void render_chunk(size_t chunk);
+        void write_output(size_t output_index, const Buffer& samples);
+
+        const mod_settings_t m_mod_settings;
+        const std::string m_format;
+
+        InputMmapReader m_input;
+        int m_output_fd = -1;
+
+        // Chunk boundaries and the number of frames modulated before every
+        // chunk are multiples of this
+        size_t m_frame_alignment = 1;
+        size_t m_warmup_frames = 0;
+        size_t m_chunk_frames = 0;
+
+        // Index of the first frame with FP 0, and number of frames from there
+        size_t m_first_frame = 0;
+        size_t m_num_frames = 0;
+        size_t m_num_chunks = 0;
+
+        // Every output buffer of the modulator contains the samples of one
+        // transmission frame, or of one batch.
+        size_t m_frames_per_output = 1;
+
+        // The size of the output buffers, which must be the same for all.
+        // Set by the first task getting an output, and checked by all others.
+        std::atomic<size_t> m_bytes_per_output = ATOMIC_VAR_INIT(0);
+
+        std::atomic<size_t> m_chunks_done = ATOMIC_VAR_INIT(0);
+};
+
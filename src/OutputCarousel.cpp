@@ -0,0 +1,195 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "OutputCarousel.h"
+#include "PcDebug.h"
+#include "Log.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace std;
+
+OutputCarousel::OutputCarousel(shared_ptr<ModOutput> output,
+        const string& cacheFile) :
+    ModOutput(),
+    ModMetadata(),
+    m_output(output),
+    m_cache_filename(cacheFile)
+{
+    PDEBUG("OutputCarousel::OutputCarousel() @ %p\n", this);
+
+    if (not m_output) {
+        throw invalid_argument("OutputCarousel: needs an output");
+    }
+
+    if (not m_cache_filename.empty()) {
+        m_cache_fd = open(m_cache_filename.c_str(),
+                O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (m_cache_fd == -1) {
+            throw runtime_error("OutputCarousel: unable to open cache file " +
+                    m_cache_filename + ": " + strerror(errno));
+        }
+    }
+}
+
+OutputCarousel::~OutputCarousel()
+{
+    if (m_cache_map) {
+        munmap(m_cache_map, m_cache_length);
+    }
+
+    if (m_cache_fd != -1) {
+        close(m_cache_fd);
+    }
+}
+
+void OutputCarousel::start_recording()
+{
+    m_frames.clear();
+    m_cache_length = 0;
+    m_next_frame = 0;
+
+    if (m_cache_fd != -1) {
+        if (ftruncate(m_cache_fd, 0) == -1 or
+                lseek(m_cache_fd, 0, SEEK_SET) == -1) {
+            throw runtime_error("OutputCarousel: unable to truncate cache file " +
+                    m_cache_filename + ": " + strerror(errno));
+        }
+    }
+
+    m_recording = true;
+}
+
+void OutputCarousel::stop_recording()
+{
+    if (not m_recording) {
+        throw logic_error("OutputCarousel: not recording");
+    }
+    m_recording = false;
+
+    if (m_cache_fd != -1 and m_cache_length > 0) {
+        void *map = mmap(nullptr, m_cache_length, PROT_READ, MAP_SHARED,
+                m_cache_fd, 0);
+        if (map == MAP_FAILED) {
+            throw runtime_error("OutputCarousel: unable to map cache file " +
+                    m_cache_filename + ": " + strerror(errno));
+        }
+        m_cache_map = reinterpret_cast<uint8_t*>(map);
+    }
+
+    m_ready = true;
+
+    etiLog.level(info) << "OutputCarousel: recorded " << m_frames.size() <<
+        " frames, " << m_cache_length / (1024 * 1024) << " MB" <<
+        (m_cache_fd != -1 ? " in " + m_cache_filename : string(" in memory"));
+}
+
+void OutputCarousel::cancel_recording()
+{
+    m_recording = false;
+    m_frames.clear();
+    m_cache_length = 0;
+}
+
+void OutputCarousel::write_to_cache(const void *data, size_t len)
+{
+    const uint8_t *p = reinterpret_cast<const uint8_t*>(data);
+    while (len > 0) {
+        const ssize_t ret = write(m_cache_fd, p, len);
+        if (ret == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw runtime_error("OutputCarousel: unable to write cache file " +
+                    m_cache_filename + ": " + strerror(errno));
+        }
+        p += ret;
+        len -= ret;
+    }
+}
+
+int OutputCarousel::process(Buffer* dataIn)
+{
+    PDEBUG("OutputCarousel::process(%p)\n", dataIn);
+
+    // Before the output, which may take the buffer
+    if (m_recording) {
+        cached_frame_t frame;
+        frame.offset = m_cache_length;
+        frame.length = dataIn->getLength();
+        if (m_cache_fd != -1) {
+            write_to_cache(dataIn->getData(), frame.length);
+        }
+        else {
+            frame.data = *dataIn;
+        }
+        m_cache_length += frame.length;
+        m_frames.push_back(std::move(frame));
+    }
+
+    return m_output->process(dataIn);
+}
+
+meta_vec_t OutputCarousel::process_metadata(const meta_vec_t& metadataIn)
+{
+    if (m_recording and not m_frames.empty()) {
+        m_frames.back().metadata = metadataIn;
+    }
+
+    if (auto mod_meta = dynamic_pointer_cast<ModMetadata>(m_output)) {
+        return mod_meta->process_metadata(metadataIn);
+    }
+    return {};
+}
+
+int OutputCarousel::replay_next()
+{
+    if (not m_ready or m_frames.empty()) {
+        throw logic_error("OutputCarousel: nothing recorded");
+    }
+
+    if (m_next_frame == m_frames.size()) {
+        m_next_frame = 0;
+    }
+    const auto& frame = m_frames[m_next_frame++];
+
+    if (m_cache_map) {
+        m_replay_buffer.setData(m_cache_map + frame.offset, frame.length);
+    }
+    else {
+        m_replay_buffer = frame.data;
+    }
+
+    const int ret = m_output->process(&m_replay_buffer);
+
+    if (auto mod_meta = dynamic_pointer_cast<ModMetadata>(m_output)) {
+        mod_meta->process_metadata(frame.metadata);
+    }
+
+    return ret;
+}
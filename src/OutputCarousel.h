@@ -0,0 +1,111 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   Cache of the output of one loop of the input file, which is then
+   transmitted again and again instead of modulating the file.
+*/
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include "ModPlugin.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+/* When a file is looped, the output of the modulator repeats itself with
+ * the period of the file once the time interleaver and the pipelined
+ * blocks are filled. The mainloop tells the carousel to record the frames
+ * given to the output while one loop of the file gets modulated, and
+ * afterwards gives the recorded frames to the output again and again,
+ * without running the modulator.
+ *
+ * The frames are kept in memory, or written to a cache file that gets
+ * mapped once the recording is complete, so that they do not need to
+ * stay in RAM. The metadata is recorded with the frames, its timestamps
+ * repeat with the file as they do when the file gets modulated. */
+class OutputCarousel : public ModOutput, public ModMetadata
+{
+public:
+    // An empty cacheFile keeps the frames in memory
+    OutputCarousel(std::shared_ptr<ModOutput> output,
+            const std::string& cacheFile);
+    OutputCarousel(const OutputCarousel& other) = delete;
+    OutputCarousel& operator=(const OutputCarousel& other) = delete;
+    virtual ~OutputCarousel();
+
+    virtual int process(Buffer* dataIn) override;
+    const char* name() override { return "OutputCarousel"; }
+
+    // The implementation assumes process_metadata is always called after process
+    virtual meta_vec_t process_metadata(const meta_vec_t& metadataIn) override;
+
+    // Record the frames given to the output from now on, discarding an
+    // incomplete recording
+    void start_recording();
+
+    // End the recording, after which the carousel is ready
+    void stop_recording();
+
+    // Discard an incomplete recording
+    void cancel_recording();
+
+    bool is_recording() const { return m_recording; }
+    bool is_ready() const { return m_ready; }
+
+    // Number of recorded frames, and their total size in bytes
+    size_t num_frames() const { return m_frames.size(); }
+    size_t cache_size() const { return m_cache_length; }
+
+    // Give the next recorded frame and its metadata to the output,
+    // starting again with the first after the last
+    int replay_next();
+
+private:
+    void write_to_cache(const void *data, size_t len);
+
+    struct cached_frame_t {
+        // Either in memory, or at offset in the cache file
+        Buffer data;
+        size_t offset = 0;
+        size_t length = 0;
+        meta_vec_t metadata;
+    };
+
+    std::shared_ptr<ModOutput> m_output;
+    std::string m_cache_filename;
+    int m_cache_fd = -1;
+    uint8_t *m_cache_map = nullptr;
+    size_t m_cache_length = 0;
+
+    bool m_recording = false;
+    bool m_ready = false;
+    std::vector<cached_frame_t> m_frames;
+    size_t m_next_frame = 0;
+
+    // Given to the output, which may take it
+    Buffer m_replay_buffer;
+};
@@ -27,30 +27,116 @@
 #include "OutputFile.h"
 #include "PcDebug.h"
 #include "Log.h"
+#include "Simd.h"
+#include "Utils.h"
 
 #include <string>
 #include <chrono>
 #include <stdexcept>
 #include <cassert>
 #include <cmath>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 using namespace std;
 
-OutputFile::OutputFile(const std::string& filename, bool show_metadata) :
-    ModOutput(), ModMetadata(),
+static size_t num_async_blocks(size_t async_buffer_size, size_t block_size)
+{
+    if (async_buffer_size == 0) {
+        return 1;
+    }
+    // Two blocks at least, one being filled while the other gets written
+    return std::max<size_t>(2, (async_buffer_size + block_size - 1) / block_size);
+}
+
+OutputFile::OutputFile(const std::string& filename, bool show_metadata,
+        size_t async_buffer_size, bool direct_io) :
+    ModOutput(), ModMetadata(), RemoteControllable("fileoutput"),
     myShowMetadata(show_metadata),
-    myFilename(filename)
+    myFilename(filename),
+    m_async(async_buffer_size > 0),
+    m_num_blocks(num_async_blocks(async_buffer_size, block_size)),
+    m_full_blocks(m_num_blocks),
+    m_free_blocks(m_num_blocks)
 {
     PDEBUG("OutputFile::OutputFile(filename: %s) @ %p\n",
             filename.c_str(), this);
 
-    FILE* fd = fopen(filename.c_str(), "w");
-    if (fd == nullptr) {
+    RC_ADD_PARAMETER(dropped_bytes, "(Read-only) Number of bytes dropped because the disk was too slow");
+    RC_ADD_PARAMETER(buffer_usage, "(Read-only) Percentage of the write buffer waiting to be written");
+
+    m_metrics.add_counter("odr_file_output_dropped_bytes_total",
+            "Number of bytes dropped because the disk was too slow",
+            [this]() { return m_dropped_bytes.load(); });
+
+    if (not m_async) {
+        FILE* fd = fopen(filename.c_str(), "w");
+        if (fd == nullptr) {
+            perror(filename.c_str());
+            throw std::runtime_error(
+                    "OutputFile::OutputFile() unable to open file!");
+        }
+        myFile.reset(fd);
+        return;
+    }
+
+    const int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    if (direct_io) {
+        m_fd = open(filename.c_str(), flags | O_DIRECT, 0644);
+        if (m_fd != -1) {
+            m_direct_io = true;
+        }
+        else if (errno == EINVAL) {
+            etiLog.level(warn) << "OutputFile: " << filename <<
+                " does not support O_DIRECT, writing through the page cache";
+        }
+    }
+
+    if (m_fd == -1) {
+        m_fd = open(filename.c_str(), flags, 0644);
+    }
+
+    if (m_fd == -1) {
         perror(filename.c_str());
         throw std::runtime_error(
                 "OutputFile::OutputFile() unable to open file!");
     }
-    myFile.reset(fd);
+
+    for (size_t i = 0; i < m_num_blocks; i++) {
+        void *data = nullptr;
+        if (posix_memalign(&data, block_alignment, block_size) != 0) {
+            close(m_fd);
+            throw std::bad_alloc();
+        }
+        block_t block;
+        block.data.reset(reinterpret_cast<uint8_t*>(data));
+        m_free_blocks.push(std::move(block));
+    }
+
+    etiLog.level(info) << "OutputFile: writing in a separate thread, with " <<
+        m_num_blocks * block_size / (1024 * 1024) << " MB of buffers" <<
+        (m_direct_io ? " and O_DIRECT" : "");
+
+    m_running = true;
+    m_thread = std::thread(&OutputFile::writer_thread, this);
+}
+
+OutputFile::~OutputFile()
+{
+    if (m_async) {
+        // Write what is left before stopping
+        if (m_have_block and m_block.length > 0) {
+            m_full_blocks.push(std::move(m_block));
+        }
+        m_running = false;
+        m_full_blocks.trigger_wakeup();
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+        close(m_fd);
+    }
 }
 
 int OutputFile::process(Buffer* dataIn)
@@ -58,14 +144,123 @@ int OutputFile::process(Buffer* dataIn)
     PDEBUG("OutputFile::process(%p)\n", dataIn);
     assert(dataIn != nullptr);
 
-    if (fwrite(dataIn->getData(), dataIn->getLength(), 1, myFile.get()) == 0) {
+    if (not m_async) {
+        if (fwrite(dataIn->getData(), dataIn->getLength(), 1, myFile.get()) == 0) {
+            throw std::runtime_error(
+                    "OutputFile::process() unable to write to file!");
+        }
+
+        return dataIn->getLength();
+    }
+
+    if (m_write_error) {
         throw std::runtime_error(
                 "OutputFile::process() unable to write to file!");
     }
 
+    const uint8_t *in = reinterpret_cast<const uint8_t*>(dataIn->getData());
+    size_t remaining = dataIn->getLength();
+
+    // Only the writer thread adds free blocks, there is at least as much
+    // room as seen here. Dropping the whole frame keeps the samples aligned.
+    const size_t room = (m_have_block ? block_size - m_block.length : 0) +
+        m_free_blocks.size() * block_size;
+    if (room < remaining) {
+        if (m_dropped_bytes.fetch_add(remaining) == 0) {
+            etiLog.level(warn) << "OutputFile: the disk is too slow, "
+                "dropping frames";
+        }
+        return dataIn->getLength();
+    }
+
+    while (remaining > 0) {
+        if (not m_have_block and not get_free_block()) {
+            throw std::logic_error("OutputFile: no free block");
+        }
+
+        const size_t len = std::min(remaining, block_size - m_block.length);
+        // The writer thread hands the block to the disk without reading it
+        simd::stream_copy(m_block.data.get() + m_block.length, in, len);
+        m_block.length += len;
+        in += len;
+        remaining -= len;
+
+        if (m_block.length == block_size) {
+            m_full_blocks.push(std::move(m_block));
+            m_have_block = false;
+        }
+    }
+
     return dataIn->getLength();
 }
 
+bool OutputFile::get_free_block()
+{
+    if (m_free_blocks.try_pop(m_block)) {
+        m_block.length = 0;
+        m_have_block = true;
+    }
+    return m_have_block;
+}
+
+void OutputFile::writer_thread()
+{
+    set_thread_name("fileoutput");
+    set_thread_placement("fileoutput");
+
+    while (true) {
+        block_t block;
+        try {
+            m_full_blocks.wait_and_pop(block);
+        }
+        catch (const ThreadsafeQueueWakeup&) {
+            if (m_running) {
+                continue;
+            }
+
+            // Drain the blocks pushed before stopping
+            while (m_full_blocks.try_pop(block)) {
+                write_block(block);
+            }
+            break;
+        }
+
+        write_block(block);
+        m_free_blocks.push(std::move(block));
+    }
+}
+
+void OutputFile::write_block(const block_t& block)
+{
+    if (m_write_error) {
+        return;
+    }
+
+    if (m_direct_io and block.length % block_alignment != 0) {
+        // Only the last block can be partial, O_DIRECT cannot write it
+        const int flags = fcntl(m_fd, F_GETFL);
+        fcntl(m_fd, F_SETFL, flags & ~O_DIRECT);
+        m_direct_io = false;
+    }
+
+    const uint8_t *data = block.data.get();
+    size_t remaining = block.length;
+    while (remaining > 0) {
+        const ssize_t ret = write(m_fd, data, remaining);
+        if (ret == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            etiLog.level(error) << "OutputFile: unable to write to " <<
+                myFilename << ": " << strerror(errno);
+            m_write_error = true;
+            return;
+        }
+        data += ret;
+        remaining -= ret;
+    }
+}
+
 meta_vec_t OutputFile::process_metadata(const meta_vec_t& metadataIn)
 {
     if (myShowMetadata) {
@@ -85,9 +280,8 @@ meta_vec_t OutputFile::process_metadata(const meta_vec_t& metadataIn)
             ss << " FCT=" << md.ts.fct <<
                 " FP=" << (int)md.ts.fp;
             if (md.ts.timestamp_valid) {
-                ss << " TS=" << md.ts.timestamp_sec << " + " <<
-                    std::fixed
-                    << (double)md.ts.timestamp_pps / 163840000.0 << ";";
+                ss << " TS=" << md.ts.timestamp_sec() << " + " <<
+                    std::fixed << md.ts.pps_offset() << ";";
             }
             else {
                 ss << " TS invalid;";
@@ -96,16 +290,10 @@ meta_vec_t OutputFile::process_metadata(const meta_vec_t& metadataIn)
 
         if (myLastTimestamp.timestamp_valid) {
             if (first_ts.timestamp_valid) {
-                uint32_t timestamp = myLastTimestamp.timestamp_pps;
-                timestamp += 96 << 14; // Shift 96ms by 14 to Timestamp level 2
-                if (timestamp > 0xf9FFff) {
-                    timestamp -= 0xfa0000; // Substract 16384000, corresponding to one second
-                    myLastTimestamp.timestamp_sec += 1;
-                }
-                myLastTimestamp.timestamp_pps = timestamp;
+                // 96ms
+                myLastTimestamp.ticks += 96 * TIMESTAMP_TICKS_PER_SECOND / 1000;
 
-                if (myLastTimestamp.timestamp_sec != first_ts.timestamp_sec or
-                        myLastTimestamp.timestamp_pps != first_ts.timestamp_pps) {
+                if (myLastTimestamp.ticks != first_ts.ticks) {
                     ss << " TS wrong interval; ";
                 }
                 myLastTimestamp = first_ts;
@@ -127,8 +315,7 @@ meta_vec_t OutputFile::process_metadata(const meta_vec_t& metadataIn)
             using namespace std::chrono;
             const auto now = system_clock::now();
             const int64_t ticks_now = duration_cast<milliseconds>(now.time_since_epoch()).count();
-            //const int64_t first_ts_ticks = first_ts.timestamp_sec * 1000 + first_ts.timestamp_pps / 16384;
-            const int64_t first_ts_ticks = std::llrint(first_ts.get_real_secs() * 1000);
+            const int64_t first_ts_ticks = first_ts.ticks / 16384;
 
             ss << " DELTA: " << first_ts_ticks - ticks_now << "ms;";
 
@@ -138,3 +325,41 @@ meta_vec_t OutputFile::process_metadata(const meta_vec_t& metadataIn)
     return {};
 }
 
+
+void OutputFile::set_parameter(const string& parameter, const string& value)
+{
+    if (parameter == "dropped_bytes" or parameter == "buffer_usage") {
+        throw ParameterError("Parameter '" + parameter + "' is read-only");
+    }
+    else {
+        stringstream ss;
+        ss << "Parameter '" << parameter <<
+            "' is not exported by controllable " << get_rc_name();
+        throw ParameterError(ss.str());
+    }
+}
+
+const string OutputFile::get_parameter(const string& parameter) const
+{
+    stringstream ss;
+    if (parameter == "dropped_bytes") {
+        ss << m_dropped_bytes.load();
+    }
+    else if (parameter == "buffer_usage") {
+        ss << (m_async ? m_full_blocks.size() * 100 / m_num_blocks : 0);
+    }
+    else {
+        ss << "Parameter '" << parameter <<
+            "' is not exported by controllable " << get_rc_name();
+        throw ParameterError(ss.str());
+    }
+    return ss.str();
+}
+
+const json::map_t OutputFile::get_all_values() const
+{
+    json::map_t map;
+    map["dropped_bytes"].v = m_dropped_bytes.load();
+    map["buffer_usage"].v = (m_async ? m_full_blocks.size() * 100 / m_num_blocks : 0);
+    return map;
+}
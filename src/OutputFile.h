@@ -34,16 +34,35 @@
 #include "ModPlugin.h"
 #include "EtiReader.h"
 #include "TimestampDecoder.h"
+#include "RemoteControl.h"
+#include "Metrics.h"
+#include "SPSCQueue.h"
 
+#include <atomic>
 #include <string>
 #include <cstdio>
 #include <cstdint>
 #include <memory>
-
-class OutputFile : public ModOutput, public ModMetadata
+#include <thread>
+
+/* By default, the frames are written with fwrite in the flowgraph thread.
+ *
+ * With a non-zero async_buffer_size, they are instead copied into blocks
+ * of that much memory in total, which a separate thread writes to the
+ * file. If the disk is slower than the modulator long enough to fill all
+ * blocks, the frames that do not fit get dropped, and counted in the
+ * dropped_bytes RC parameter, instead of blocking the modulator. With
+ * direct_io, the file is opened with O_DIRECT to bypass the page cache,
+ * if the filesystem supports it.
+ */
+class OutputFile : public ModOutput, public ModMetadata, public RemoteControllable
 {
 public:
-    OutputFile(const std::string& filename, bool show_metadata);
+    OutputFile(const std::string& filename, bool show_metadata,
+            size_t async_buffer_size = 0, bool direct_io = false);
+    OutputFile(const OutputFile& other) = delete;
+    OutputFile& operator=(const OutputFile& other) = delete;
+    virtual ~OutputFile();
 
     virtual int process(Buffer* dataIn) override;
     const char* name() override { return "OutputFile"; }
@@ -51,6 +70,13 @@ public:
     virtual meta_vec_t process_metadata(
             const meta_vec_t& metadataIn) override;
 
+    /******* REMOTE CONTROL ********/
+    virtual void set_parameter(const std::string& parameter,
+            const std::string& value) override;
+    virtual const std::string get_parameter(
+            const std::string& parameter) const override;
+    virtual const json::map_t get_all_values() const override;
+
 protected:
     bool myShowMetadata = false;
     frame_timestamp myLastTimestamp;
@@ -58,5 +84,39 @@ protected:
 
     struct FILEDeleter{ void operator()(FILE* fd){ if (fd) fclose(fd); }};
     std::unique_ptr<FILE, FILEDeleter> myFile;
+
+private:
+    // Size and alignment of the blocks, suitable for O_DIRECT
+    static constexpr size_t block_size = 4 * 1024 * 1024;
+    static constexpr size_t block_alignment = 4096;
+
+    struct block_t {
+        struct Deleter{ void operator()(uint8_t *p) { free(p); }};
+        std::unique_ptr<uint8_t, Deleter> data;
+        size_t length = 0;
+    };
+
+    bool get_free_block();
+    void writer_thread();
+    void write_block(const block_t& block);
+
+    bool m_async = false;
+    int m_fd = -1;
+    bool m_direct_io = false;
+    size_t m_num_blocks = 0;
+
+    // The block being filled by process()
+    block_t m_block;
+    bool m_have_block = false;
+
+    SPSCQueue<block_t> m_full_blocks;
+    SPSCQueue<block_t> m_free_blocks;
+
+    std::atomic<bool> m_running = ATOMIC_VAR_INIT(false);
+    std::atomic<bool> m_write_error = ATOMIC_VAR_INIT(false);
+    std::atomic<uint64_t> m_dropped_bytes = ATOMIC_VAR_INIT(0);
+    std::thread m_thread;
+
+    Metrics::Handle m_metrics;
 };
 
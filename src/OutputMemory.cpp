@@ -64,11 +64,14 @@ int OutputMemory::process(Buffer* dataIn)
     PDEBUG("OutputMemory::process(dataIn: %p)\n",
             dataIn);
 
-    *m_dataOut = *dataIn;
+    // The output of the last block is handed over without a copy. The
+    // previous contents of m_dataOut end up in dataIn, which the last
+    // block overwrites when it processes the next frame.
+    m_dataOut->swap(*dataIn);
 
 #if OUTPUT_MEM_HISTOGRAM
-    const float* in = (const float*)dataIn->getData();
-    const size_t len = dataIn->getLength() / sizeof(float);
+    const float* in = (const float*)m_dataOut->getData();
+    const size_t len = m_dataOut->getLength() / sizeof(float);
 
     for (size_t i = 0; i < len; i++) {
         float absval = fabsf(in[i]);
@@ -0,0 +1,314 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   An output that archives the samples in compressed chunks, with an index
+   of the FCT and the timestamp of every chunk.
+*/
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "OutputRecorder.h"
+#include "PcDebug.h"
+#include "Log.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#if defined(HAVE_LZ4)
+#   include <lz4.h>
+#endif
+#if defined(HAVE_ZSTD)
+#   include <zstd.h>
+#endif
+
+using namespace std;
+
+static constexpr uint16_t recorder_version = 1;
+static constexpr size_t file_header_size = 32;
+static constexpr size_t chunk_header_size = 40;
+static constexpr size_t index_entry_size = 32;
+
+static void append_le(vector<uint8_t>& buf, uint64_t value, size_t num_bytes)
+{
+    for (size_t i = 0; i < num_bytes; i++) {
+        buf.push_back((value >> (8 * i)) & 0xFF);
+    }
+}
+
+OutputRecorder::codec_e OutputRecorder::parse_codec(const string& codec)
+{
+    if (codec == "none") {
+        return codec_e::none;
+    }
+    else if (codec == "lz4") {
+#if defined(HAVE_LZ4)
+        return codec_e::lz4;
+#else
+        throw runtime_error("OutputRecorder: lz4 support is not compiled in");
+#endif
+    }
+    else if (codec == "zstd") {
+#if defined(HAVE_ZSTD)
+        return codec_e::zstd;
+#else
+        throw runtime_error("OutputRecorder: zstd support is not compiled in");
+#endif
+    }
+    throw runtime_error("OutputRecorder: unknown codec " + codec);
+}
+
+OutputRecorder::OutputRecorder(const string& filename,
+        codec_e codec, int level,
+        const string& input_format, float scale,
+        unsigned sample_rate, size_t chunk_frames) :
+    ModOutput(), ModMetadata(),
+    m_filename(filename),
+    m_codec(codec),
+    m_level(level),
+    m_convert(input_format == "complexf"),
+    m_scale(scale),
+    m_chunk_frames(chunk_frames)
+{
+    PDEBUG("OutputRecorder::OutputRecorder(filename: %s) @ %p\n",
+            filename.c_str(), this);
+
+    if (m_chunk_frames == 0) {
+        throw invalid_argument("OutputRecorder: chunks must contain frames");
+    }
+
+    const string format = m_convert ? "s16" : input_format;
+    if (format.size() >= 16) {
+        throw invalid_argument("OutputRecorder: invalid format " + format);
+    }
+
+    if (m_convert) {
+        m_converter = FormatConverter::get_float_converter("s16");
+    }
+
+#if defined(HAVE_ZSTD)
+    if (m_codec == codec_e::zstd) {
+        m_zstd_ctx = ZSTD_createCCtx();
+        if (m_zstd_ctx == nullptr) {
+            throw runtime_error("OutputRecorder: cannot create the zstd context");
+        }
+    }
+#endif
+
+    FILE* fd = fopen(filename.c_str(), "w");
+    if (fd == nullptr) {
+        perror(filename.c_str());
+        throw runtime_error("OutputRecorder: unable to open file!");
+    }
+    m_file.reset(fd);
+
+    const string index_filename = filename + ".idx";
+    fd = fopen(index_filename.c_str(), "w");
+    if (fd == nullptr) {
+        perror(index_filename.c_str());
+        throw runtime_error("OutputRecorder: unable to open index file!");
+    }
+    m_index.reset(fd);
+
+    vector<uint8_t> header;
+    const char magic[] = "ODRIQREC";
+    header.insert(header.end(), magic, magic + 8);
+    append_le(header, recorder_version, 2);
+    header.push_back((uint8_t)m_codec);
+    header.push_back(0);
+    append_le(header, sample_rate, 4);
+    header.insert(header.end(), format.begin(), format.end());
+    header.resize(file_header_size, 0);
+    write_all(m_file.get(), header.data(), header.size());
+    m_offset = header.size();
+
+    m_metrics.add_counter("odr_recorder_input_bytes_total",
+            "Number of bytes of samples given to the recorder",
+            [this]() { return m_input_bytes.load(); });
+    m_metrics.add_counter("odr_recorder_written_bytes_total",
+            "Number of bytes the recorder wrote to the file",
+            [this]() { return m_written_bytes.load(); });
+
+    etiLog.level(info) << "OutputRecorder: recording " << format <<
+        " samples into " << filename << " in chunks of " << m_chunk_frames <<
+        " frames";
+}
+
+OutputRecorder::~OutputRecorder()
+{
+    try {
+        if (m_chunk_num_frames > 0) {
+            write_chunk();
+        }
+    }
+    catch (const runtime_error& e) {
+        etiLog.level(error) << e.what();
+    }
+
+#if defined(HAVE_ZSTD)
+    if (m_zstd_ctx) {
+        ZSTD_freeCCtx(reinterpret_cast<ZSTD_CCtx*>(m_zstd_ctx));
+    }
+#endif
+
+    const double ratio = m_written_bytes ?
+        (double)m_input_bytes / m_written_bytes : 0.0;
+    etiLog.level(info) << "OutputRecorder: " << m_frame_index <<
+        " frames recorded, compression ratio " << ratio;
+    PDEBUG("OutputRecorder::~OutputRecorder() @ %p\n", this);
+}
+
+int OutputRecorder::process(Buffer* dataIn)
+{
+    PDEBUG("OutputRecorder::process(%p)\n", dataIn);
+
+    const uint8_t *data = reinterpret_cast<const uint8_t*>(dataIn->getData());
+    size_t len = dataIn->getLength();
+
+    if (m_convert) {
+        // The tee gives us our own copy of the frame
+        float *in = reinterpret_cast<float*>(dataIn->getData());
+        const size_t n = len / sizeof(float);
+        for (size_t i = 0; i < n; i++) {
+            in[i] *= m_scale;
+        }
+        m_converted.resize(n);
+        m_converter(in, m_converted.data(), n);
+        data = reinterpret_cast<const uint8_t*>(m_converted.data());
+        len = n * sizeof(int16_t);
+    }
+
+    m_chunk.insert(m_chunk.end(), data, data + len);
+    m_input_bytes += len;
+
+    return dataIn->getLength();
+}
+
+meta_vec_t OutputRecorder::process_metadata(const meta_vec_t& metadataIn)
+{
+    if (m_chunk_num_frames == 0) {
+        m_chunk_first_frame = m_frame_index;
+        if (metadataIn.empty()) {
+            m_chunk_ts = frame_timestamp();
+            m_chunk_fct = -1;
+        }
+        else {
+            m_chunk_ts = metadataIn[0].ts;
+            m_chunk_fct = metadataIn[0].ts.fct;
+        }
+    }
+
+    m_frame_index++;
+    if (++m_chunk_num_frames == m_chunk_frames) {
+        write_chunk();
+    }
+
+    return {};
+}
+
+void OutputRecorder::write_chunk()
+{
+    const uint8_t *payload = m_chunk.data();
+    size_t payload_len = m_chunk.size();
+
+    switch (m_codec) {
+        case codec_e::none:
+            break;
+        case codec_e::lz4:
+#if defined(HAVE_LZ4)
+        {
+            m_compressed.resize(LZ4_compressBound(m_chunk.size()));
+            const int len = LZ4_compress_fast(
+                    reinterpret_cast<const char*>(m_chunk.data()),
+                    reinterpret_cast<char*>(m_compressed.data()),
+                    m_chunk.size(), m_compressed.size(), m_level);
+            if (len <= 0) {
+                throw runtime_error("OutputRecorder: lz4 compression failed");
+            }
+            payload = m_compressed.data();
+            payload_len = len;
+        }
+#endif
+            break;
+        case codec_e::zstd:
+#if defined(HAVE_ZSTD)
+        {
+            m_compressed.resize(ZSTD_compressBound(m_chunk.size()));
+            const size_t len = ZSTD_compressCCtx(
+                    reinterpret_cast<ZSTD_CCtx*>(m_zstd_ctx),
+                    m_compressed.data(), m_compressed.size(),
+                    m_chunk.data(), m_chunk.size(), m_level);
+            if (ZSTD_isError(len)) {
+                throw runtime_error(string("OutputRecorder: zstd compression failed: ") +
+                        ZSTD_getErrorName(len));
+            }
+            payload = m_compressed.data();
+            payload_len = len;
+        }
+#endif
+            break;
+    }
+
+    const bool ts_valid = m_chunk_ts.timestamp_valid;
+    const uint32_t ts_sec = ts_valid ? m_chunk_ts.timestamp_sec() : 0;
+    const uint32_t ts_pps = ts_valid ? m_chunk_ts.timestamp_pps() : 0;
+
+    vector<uint8_t> header;
+    header.reserve(chunk_header_size);
+    const char magic[] = "CHNK";
+    header.insert(header.end(), magic, magic + 4);
+    append_le(header, payload_len, 4);
+    append_le(header, m_chunk.size(), 4);
+    append_le(header, m_chunk_num_frames, 4);
+    append_le(header, m_chunk_first_frame, 8);
+    append_le(header, (uint32_t)m_chunk_fct, 4);
+    header.push_back(ts_valid ? 1 : 0);
+    header.resize(header.size() + 3, 0);
+    append_le(header, ts_sec, 4);
+    append_le(header, ts_pps, 4);
+    write_all(m_file.get(), header.data(), header.size());
+    write_all(m_file.get(), payload, payload_len);
+    fflush(m_file.get());
+
+    vector<uint8_t> entry;
+    entry.reserve(index_entry_size);
+    append_le(entry, m_offset, 8);
+    append_le(entry, m_chunk_first_frame, 8);
+    append_le(entry, (uint32_t)m_chunk_fct, 4);
+    entry.push_back(ts_valid ? 1 : 0);
+    entry.resize(entry.size() + 3, 0);
+    append_le(entry, ts_sec, 4);
+    append_le(entry, ts_pps, 4);
+    write_all(m_index.get(), entry.data(), entry.size());
+    fflush(m_index.get());
+
+    m_offset += header.size() + payload_len;
+    m_written_bytes += header.size() + payload_len;
+
+    m_chunk.clear();
+    m_chunk_num_frames = 0;
+}
+
+void OutputRecorder::write_all(FILE *fd, const uint8_t *data, size_t len)
+{
+    if (len > 0 and fwrite(data, len, 1, fd) != 1) {
+        throw runtime_error("OutputRecorder: unable to write to " + m_filename);
+    }
+}
@@ -0,0 +1,131 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   An output that archives the samples in compressed chunks, with an index
+   of the FCT and the timestamp of every chunk.
+*/
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include "ModPlugin.h"
+#include "FormatConverter.h"
+#include "Metrics.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+/* The recorder is meant to run as an additional output of the OutputTee,
+ * whose thread does the conversion and the compression, and whose queue
+ * drops frames instead of delaying the modulator when the recorder is too
+ * slow.
+ *
+ * Floating-point samples are scaled and converted to s16 with the
+ * converter of the FormatConverter, the other formats are recorded as they are. Every
+ * chunk_frames transmission frames, the samples are compressed and
+ * appended to the file as one chunk. All integers are little endian.
+ *
+ * File header, 32 bytes:
+ *   magic "ODRIQREC", u16 version 1, u8 codec (0 none, 1 lz4, 2 zstd),
+ *   u8 reserved, u32 sample rate, sample format, zero padded to 16 bytes
+ * Chunk header, 40 bytes, followed by the compressed samples:
+ *   magic "CHNK", u32 compressed length, u32 uncompressed length,
+ *   u32 number of frames, u64 index of the first frame since the start
+ *   of the recording, i32 FCT of the first frame (-1 if unknown),
+ *   u8 timestamp valid, 3 bytes reserved, u32 timestamp seconds and
+ *   u32 timestamp pps of the first frame
+ *
+ * The chunks can be found by following their lengths from the start of
+ * the file. To seek directly, the index file of the same name with the
+ * suffix .idx contains one entry of 32 bytes per chunk, written once the
+ * chunk is in the file:
+ *   u64 offset of the chunk header in the file, u64 index of the first
+ *   frame, i32 FCT, u8 timestamp valid, 3 bytes reserved, u32 timestamp
+ *   seconds, u32 timestamp pps
+ */
+class OutputRecorder : public ModOutput, public ModMetadata
+{
+public:
+    enum class codec_e { none = 0, lz4 = 1, zstd = 2 };
+
+    // Throws if the codec is not available in this build
+    static codec_e parse_codec(const std::string& codec);
+
+    /* input_format is complexf for floating-point samples, which get
+     * multiplied by scale before they are converted to s16. The level is
+     * the zstd compression level, or the lz4 acceleration. */
+    OutputRecorder(const std::string& filename,
+            codec_e codec, int level,
+            const std::string& input_format, float scale,
+            unsigned sample_rate, size_t chunk_frames);
+    OutputRecorder(const OutputRecorder& other) = delete;
+    OutputRecorder& operator=(const OutputRecorder& other) = delete;
+    virtual ~OutputRecorder();
+
+    virtual int process(Buffer* dataIn) override;
+    const char* name() override { return "OutputRecorder"; }
+
+    // The implementation assumes process_metadata is always called after process
+    virtual meta_vec_t process_metadata(const meta_vec_t& metadataIn) override;
+
+private:
+    void write_chunk();
+    void write_all(FILE *fd, const uint8_t *data, size_t len);
+
+    std::string m_filename;
+    codec_e m_codec;
+    int m_level;
+    bool m_convert;
+    float m_scale;
+    size_t m_chunk_frames;
+
+    struct FILEDeleter{ void operator()(FILE* fd){ if (fd) fclose(fd); }};
+    std::unique_ptr<FILE, FILEDeleter> m_file;
+    std::unique_ptr<FILE, FILEDeleter> m_index;
+    uint64_t m_offset = 0;
+
+    FormatConverter::float_converter_t m_converter = nullptr;
+    std::vector<int16_t> m_converted;
+
+    // The samples of the chunk being filled, and its first frame
+    std::vector<uint8_t> m_chunk;
+    size_t m_chunk_num_frames = 0;
+    uint64_t m_frame_index = 0;
+    uint64_t m_chunk_first_frame = 0;
+    frame_timestamp m_chunk_ts;
+    int32_t m_chunk_fct = -1;
+
+    std::vector<uint8_t> m_compressed;
+    void *m_zstd_ctx = nullptr;
+
+    std::atomic<uint64_t> m_input_bytes = ATOMIC_VAR_INIT(0);
+    std::atomic<uint64_t> m_written_bytes = ATOMIC_VAR_INIT(0);
+    Metrics::Handle m_metrics;
+};
@@ -0,0 +1,191 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "OutputTee.h"
+#include "PcDebug.h"
+#include "Utils.h"
+#include "Log.h"
+
+#include <stdexcept>
+
+using namespace std;
+
+OutputTee::OutputTee(shared_ptr<ModOutput> mainOutput) :
+    ModOutput(),
+    ModMetadata(),
+    m_mainOutput(mainOutput)
+{
+    PDEBUG("OutputTee::OutputTee() @ %p\n", this);
+
+    if (not m_mainOutput) {
+        throw invalid_argument("OutputTee: needs a main output");
+    }
+}
+
+OutputTee::~OutputTee()
+{
+    for (auto& out : m_outputs) {
+        out->queue.push({});
+    }
+
+    for (auto& out : m_outputs) {
+        if (out->thread.joinable()) {
+            out->thread.join();
+        }
+    }
+}
+
+void OutputTee::add_output(const string& outputName,
+        shared_ptr<ModOutput> output,
+        size_t queueSize, drop_policy_e dropPolicy)
+{
+    if (queueSize == 0) {
+        throw invalid_argument("OutputTee: the queue size must not be 0");
+    }
+
+    auto out = make_unique<tee_output_t>();
+    out->name = outputName;
+    out->output = output;
+    out->queueSize = queueSize;
+    out->dropPolicy = dropPolicy;
+
+    auto *o = out.get();
+    m_metrics.add_counter("odr_tee_" + outputName + "_dropped_frames_total",
+            "Number of frames not given to the " + outputName +
+            " output because its queue was full",
+            [o]() { return o->droppedFrames.load(); });
+
+    out->thread = std::thread(&OutputTee::output_thread, this, o);
+    m_outputs.push_back(std::move(out));
+
+    etiLog.level(info) << "OutputTee: also giving the samples to the " <<
+        outputName << " output";
+}
+
+int OutputTee::process(Buffer* dataIn)
+{
+    PDEBUG("OutputTee::process(%p)\n", dataIn);
+
+    // Before the main output, which may take the buffer
+    if (not m_outputs.empty()) {
+        m_frame = make_shared<shared_frame_t>();
+        m_frame->data = *dataIn;
+    }
+
+    return m_mainOutput->process(dataIn);
+}
+
+meta_vec_t OutputTee::process_metadata(const meta_vec_t& metadataIn)
+{
+    meta_vec_t ret;
+    if (auto mod_meta = dynamic_pointer_cast<ModMetadata>(m_mainOutput)) {
+        ret = mod_meta->process_metadata(metadataIn);
+    }
+
+    if (not m_frame) {
+        return ret;
+    }
+
+    m_frame->metadata = metadataIn;
+    m_frame->readers = m_outputs.size();
+
+    for (auto& out : m_outputs) {
+        switch (out->dropPolicy) {
+            case drop_policy_e::oldest:
+                // The dropped frame keeps a reader, and the remaining
+                // outputs copy it
+                if (out->queue.push_overflow(frame_t(m_frame),
+                            out->queueSize).overflowed) {
+                    out->droppedFrames++;
+                }
+                break;
+            case drop_policy_e::newest:
+                // Only this thread pushes, the queue cannot fill up in
+                // between
+                if (out->queue.size() >= out->queueSize) {
+                    out->droppedFrames++;
+                    m_frame->readers.fetch_sub(1, std::memory_order_release);
+                }
+                else {
+                    out->queue.push(frame_t(m_frame));
+                }
+                break;
+            case drop_policy_e::block:
+                out->queue.push_wait_if_full(m_frame, out->queueSize);
+                break;
+        }
+    }
+
+    m_frame.reset();
+    return ret;
+}
+
+void OutputTee::output_thread(tee_output_t *out)
+{
+    set_thread_name("outputtee");
+    set_thread_placement("outputtee", "fileoutput");
+
+    auto mod_meta = dynamic_pointer_cast<ModMetadata>(out->output);
+
+    while (true) {
+        frame_t frame;
+        out->queue.wait_and_pop(frame);
+
+        if (not frame) {
+            break;
+        }
+
+        // The output may take the buffer, the other outputs must not
+        // see that. When they all decremented the readers after their
+        // copy, this one is the last and takes the data.
+        Buffer data;
+        meta_vec_t metadata;
+        if (frame->readers.load(std::memory_order_acquire) == 1) {
+            data.swap(frame->data);
+            metadata = std::move(frame->metadata);
+        }
+        else if (not out->failed) {
+            data = frame->data;
+            metadata = frame->metadata;
+        }
+        frame->readers.fetch_sub(1, std::memory_order_release);
+        frame.reset();
+
+        if (out->failed) {
+            continue;
+        }
+
+        try {
+            out->output->process(&data);
+            if (mod_meta) {
+                mod_meta->process_metadata(metadata);
+            }
+        }
+        catch (const std::exception& e) {
+            etiLog.level(error) << "OutputTee: the " << out->name <<
+                " output failed and does not get any more frames: " <<
+                e.what();
+            out->failed = true;
+        }
+    }
+}
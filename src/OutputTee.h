@@ -0,0 +1,110 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   Gives the output samples to additional outputs, for instance to record
+   what gets transmitted.
+*/
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include "ModPlugin.h"
+#include "Metrics.h"
+#include "ThreadsafeQueue.h"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* The main output runs in the flowgraph as before. Every frame is copied
+ * once into a Buffer shared by all additional outputs, each of which has
+ * its own queue and thread, so that a slow recording never delays the
+ * main output. The last output to process a frame gets the shared Buffer
+ * itself, the others a copy, as the outputs may take their input. When the queue of an output is full, the drop policy of
+ * that output decides:
+ *  oldest: the oldest queued frame is dropped
+ *  newest: the new frame is dropped
+ *  block:  the flowgraph waits for the output
+ *
+ * The additional outputs get the samples in the format of the main
+ * output. An output that throws an exception is not fed anymore, the
+ * others continue. */
+class OutputTee : public ModOutput, public ModMetadata
+{
+public:
+    enum class drop_policy_e { oldest, newest, block };
+
+    OutputTee(std::shared_ptr<ModOutput> mainOutput);
+    OutputTee(const OutputTee& other) = delete;
+    OutputTee& operator=(const OutputTee& other) = delete;
+    virtual ~OutputTee();
+
+    // Must be called before the first frame. The name appears in the
+    // logs and the metrics, and must be a valid part of a metric name.
+    void add_output(const std::string& outputName,
+            std::shared_ptr<ModOutput> output,
+            size_t queueSize, drop_policy_e dropPolicy);
+
+    virtual int process(Buffer* dataIn) override;
+    const char* name() override { return "OutputTee"; }
+
+    // The implementation assumes process_metadata is always called after process
+    virtual meta_vec_t process_metadata(const meta_vec_t& metadataIn) override;
+
+private:
+    struct shared_frame_t {
+        Buffer data;
+        meta_vec_t metadata;
+        // Number of outputs that did not process the frame yet. The last
+        // one takes the data instead of copying it.
+        std::atomic<size_t> readers = ATOMIC_VAR_INIT(0);
+    };
+    // nullptr stops the thread of the output
+    using frame_t = std::shared_ptr<shared_frame_t>;
+
+    struct tee_output_t {
+        std::string name;
+        std::shared_ptr<ModOutput> output;
+        size_t queueSize = 0;
+        drop_policy_e dropPolicy = drop_policy_e::oldest;
+
+        ThreadsafeQueue<frame_t> queue;
+        std::atomic<uint64_t> droppedFrames = ATOMIC_VAR_INIT(0);
+        std::atomic<bool> failed = ATOMIC_VAR_INIT(false);
+        std::thread thread;
+    };
+
+    void output_thread(tee_output_t *out);
+
+    std::shared_ptr<ModOutput> m_mainOutput;
+    std::vector<std::unique_ptr<tee_output_t> > m_outputs;
+
+    // The frame of the last call to process(), sent with its metadata
+    frame_t m_frame;
+
+    Metrics::Handle m_metrics;
+};
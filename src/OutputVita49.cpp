@@ -0,0 +1,180 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "OutputVita49.h"
+#include "PcDebug.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <arpa/inet.h>
+
+// Packet header, stream identifier, integer and fractional timestamp
+static constexpr size_t VRT_MAX_HEADER_WORDS = 5;
+static constexpr size_t VRT_HEADER_WORDS_NO_TIMESTAMP = 2;
+
+// Packet type 1: IF data packet with stream identifier
+static constexpr uint32_t VRT_PACKET_TYPE = 0x1;
+// TSI 1: UTC, TSF 2: real time in picoseconds
+static constexpr uint32_t VRT_TSI_UTC = 0x1;
+static constexpr uint32_t VRT_TSF_REAL_TIME = 0x2;
+
+static constexpr uint64_t PICOSECONDS_PER_SECOND = 1000000000000uLL;
+
+OutputVita49::OutputVita49(const std::string& destination, int port,
+        const std::string& format, uint32_t stream_id,
+        size_t max_packet_size, size_t sample_rate) :
+    ModOutput(),
+    ModMetadata(),
+    m_sock(),
+    m_float(format == "complexf"),
+    m_sample_size(m_float ? 2 * sizeof(float) : 2 * sizeof(int16_t)),
+    m_stream_id(stream_id),
+    m_samples_per_packet(
+            (max_packet_size - VRT_MAX_HEADER_WORDS * sizeof(uint32_t)) /
+            m_sample_size),
+    m_sample_rate(sample_rate)
+{
+    PDEBUG("OutputVita49::OutputVita49() @ %p\n", this);
+
+    if (format != "complexf" and format != "s16") {
+        throw std::invalid_argument("OutputVita49: invalid format " + format);
+    }
+
+    if (max_packet_size <= VRT_MAX_HEADER_WORDS * sizeof(uint32_t) + m_sample_size or
+            max_packet_size / sizeof(uint32_t) > 0xFFFF) {
+        throw std::invalid_argument("OutputVita49: invalid packet size");
+    }
+
+    m_destination.resolveUdpDestination(destination, port);
+
+    etiLog.level(info) << "OutputVita49: sending " << format << " to " <<
+        m_destination.to_string() << ", " << m_samples_per_packet <<
+        " samples per packet";
+}
+
+int OutputVita49::process(Buffer* dataIn)
+{
+    // Take the frame instead of copying it, the upstream block gets the
+    // previous one to write its next output into.
+    m_frame.swap(*dataIn);
+
+    // The frame is sent once we got the metadata.
+
+    return m_frame.getLength();
+}
+
+meta_vec_t OutputVita49::process_metadata(const meta_vec_t& metadataIn)
+{
+    const size_t num_samples = m_frame.getLength() / m_sample_size;
+    if (num_samples == 0) {
+        return {};
+    }
+
+    // Bring the samples to network byte order in place
+    if (m_float) {
+        uint32_t *words = reinterpret_cast<uint32_t*>(m_frame.getData());
+        for (size_t i = 0; i < 2 * num_samples; i++) {
+            words[i] = htonl(words[i]);
+        }
+    }
+    else {
+        uint16_t *halfwords = reinterpret_cast<uint16_t*>(m_frame.getData());
+        for (size_t i = 0; i < 2 * num_samples; i++) {
+            halfwords[i] = htons(halfwords[i]);
+        }
+    }
+
+    /* Every ETI frame contributes the same number of samples to the
+     * buffer, and every part gets the timestamp of its ETI frame. This
+     * also holds when several transmission frames are batched. */
+    const size_t num_parts = std::max<size_t>(1, metadataIn.size());
+    const size_t samples_per_part = num_samples / num_parts;
+
+    m_num_packets = 0;
+    const size_t max_packets = num_parts +
+        num_samples / m_samples_per_packet + 1;
+    m_headers.resize(max_packets * VRT_MAX_HEADER_WORDS);
+    m_iovs.resize(max_packets * 2);
+
+    uint8_t *samples = reinterpret_cast<uint8_t*>(m_frame.getData());
+    for (size_t part = 0; part < num_parts; part++) {
+        const size_t first = part * samples_per_part;
+        const size_t len = (part + 1 == num_parts) ?
+            num_samples - first : samples_per_part;
+
+        frame_timestamp ts;
+        if (not metadataIn.empty()) {
+            ts = metadataIn[part].ts;
+        }
+        add_packets(samples + first * m_sample_size, len, ts);
+    }
+
+    m_sock.send_many(m_iovs.data(), 2, m_num_packets, m_destination);
+
+    return {};
+}
+
+void OutputVita49::add_packets(uint8_t *first_sample, size_t num_samples,
+        const frame_timestamp& ts)
+{
+    // 61035.15625 picoseconds per 1/16384000 s
+    const uint64_t ts_ps = (uint64_t)ts.timestamp_pps() * 15625000uLL / 256;
+
+    for (size_t offset = 0; offset < num_samples; offset += m_samples_per_packet) {
+        const size_t len = std::min(m_samples_per_packet, num_samples - offset);
+
+        uint32_t *header = &m_headers[m_num_packets * VRT_MAX_HEADER_WORDS];
+        const size_t header_words = ts.timestamp_valid ?
+            VRT_MAX_HEADER_WORDS : VRT_HEADER_WORDS_NO_TIMESTAMP;
+        const size_t packet_words = header_words +
+            len * m_sample_size / sizeof(uint32_t);
+
+        uint32_t w0 = (VRT_PACKET_TYPE << 28) |
+            ((m_packet_count & 0xF) << 16) | packet_words;
+        m_packet_count++;
+
+        if (ts.timestamp_valid) {
+            w0 |= (VRT_TSI_UTC << 22) | (VRT_TSF_REAL_TIME << 20);
+
+            const uint64_t ps = ts_ps +
+                (uint64_t)offset * PICOSECONDS_PER_SECOND / m_sample_rate;
+            const uint32_t seconds = ts.timestamp_sec() + ps / PICOSECONDS_PER_SECOND;
+            const uint64_t fractional = ps % PICOSECONDS_PER_SECOND;
+
+            header[2] = htonl(seconds);
+            header[3] = htonl(fractional >> 32);
+            header[4] = htonl(fractional & 0xFFFFFFFF);
+        }
+        header[0] = htonl(w0);
+        header[1] = htonl(m_stream_id);
+
+        struct iovec *iov = &m_iovs[m_num_packets * 2];
+        iov[0].iov_base = header;
+        iov[0].iov_len = header_words * sizeof(uint32_t);
+        iov[1].iov_base = first_sample + offset * m_sample_size;
+        iov[1].iov_len = len * m_sample_size;
+
+        m_num_packets++;
+    }
+}
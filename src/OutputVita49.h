@@ -0,0 +1,91 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   Output of the samples over UDP, in VITA 49 (VRT) IF data packets that
+   carry the transmission timestamp.
+*/
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include "ModPlugin.h"
+#include "Socket.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <sys/uio.h>
+
+/* Every packet is an IF data packet with stream identifier, without class
+ * identifier and trailer. When the frame has a valid timestamp, the packet
+ * carries the UTC time of its first sample, as integer seconds and
+ * picoseconds. Otherwise it carries no timestamp.
+ *
+ * The s16 format gives 16-bit I and Q in every 32-bit word of the payload,
+ * the complexf format 32-bit IEEE-754 I and Q. Everything is big-endian.
+ */
+class OutputVita49 : public ModOutput, public ModMetadata
+{
+    public:
+        OutputVita49(const std::string& destination, int port,
+                const std::string& format, uint32_t stream_id,
+                size_t max_packet_size, size_t sample_rate);
+        OutputVita49(const OutputVita49& other) = delete;
+        OutputVita49& operator=(const OutputVita49& other) = delete;
+
+        virtual int process(Buffer* dataIn) override;
+        const char* name() override { return "OutputVita49"; }
+
+        virtual meta_vec_t process_metadata(
+                const meta_vec_t& metadataIn) override;
+
+    private:
+        // Prepare the packets for num_samples samples starting at
+        // first_sample, with the timestamp of the first of them.
+        void add_packets(uint8_t *first_sample, size_t num_samples,
+                const frame_timestamp& ts);
+
+        Socket::UDPSocket m_sock;
+        Socket::InetAddress m_destination;
+
+        const bool m_float;
+        const size_t m_sample_size;
+        const uint32_t m_stream_id;
+        const size_t m_samples_per_packet;
+        const size_t m_sample_rate;
+
+        // Modulo 16 counter of the packets of the stream
+        uint8_t m_packet_count = 0;
+
+        // Taken from the flowgraph in process(), sent in process_metadata()
+        Buffer m_frame;
+
+        // The headers and the iovecs given to sendmmsg, two per packet: the
+        // header and the samples in m_frame.
+        size_t m_num_packets = 0;
+        std::vector<uint32_t> m_headers;
+        std::vector<struct iovec> m_iovs;
+};
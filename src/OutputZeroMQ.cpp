@@ -26,20 +26,43 @@
 
 #include "OutputZeroMQ.h"
 #include "PcDebug.h"
+#include "Log.h"
 #include <stdexcept>
 #include <string.h>
 #include <sstream>
 
 #if defined(HAVE_ZEROMQ)
 
-OutputZeroMQ::OutputZeroMQ(std::string endpoint, int type, Buffer* dataOut) :
+static_assert(sizeof(zmq_output_header_t) == 16, "Unexpected header size");
+
+// Buffers kept for reuse, the others are freed
+static constexpr size_t MAX_FREE_BUFFERS = 8;
+
+struct sent_buffer_t {
+    std::shared_ptr<ThreadsafeQueue<Buffer> > pool;
+    Buffer buf;
+};
+
+// Called by ZeroMQ when it does not need the data of a message anymore
+static void give_back_buffer(void* /*data*/, void* hint)
+{
+    auto sent = static_cast<sent_buffer_t*>(hint);
+    sent->pool->push(std::move(sent->buf), MAX_FREE_BUFFERS);
+    delete sent;
+}
+
+OutputZeroMQ::OutputZeroMQ(std::string endpoint, int type,
+        int sndhwm, bool send_header) :
     ModOutput(),
+    ModMetadata(),
     m_type(type),
     m_zmq_context(1),
     m_zmq_sock(m_zmq_context, type),
-    m_endpoint(endpoint)
+    m_endpoint(endpoint),
+    m_send_header(send_header),
+    m_free_buffers(std::make_shared<buffer_pool_t>())
 {
-    PDEBUG("OutputZeroMQ::OutputZeroMQ(%p) @ %p\n", dataOut, this);
+    PDEBUG("OutputZeroMQ::OutputZeroMQ() @ %p\n", this);
 
     std::stringstream ss;
     ss << "OutputZeroMQ(" << m_endpoint << " ";
@@ -50,12 +73,19 @@ OutputZeroMQ::OutputZeroMQ(std::string endpoint, int type, Buffer* dataOut) :
     else if (type == ZMQ_REP) {
         ss << "ZMQ_REP";
     }
+    else if (type == ZMQ_PUSH) {
+        ss << "ZMQ_PUSH";
+    }
     else {
         throw std::invalid_argument("ZMQ socket type unknown");
     }
     ss << ")";
     m_name = ss.str();
 
+    if (sndhwm > 0) {
+        m_zmq_sock.setsockopt(ZMQ_SNDHWM, &sndhwm, sizeof(sndhwm));
+    }
+
     m_zmq_sock.bind(m_endpoint.c_str());
 }
 
@@ -65,6 +95,25 @@ int OutputZeroMQ::process(Buffer* dataIn)
             "(dataIn: %p)\n",
             dataIn);
 
+    if (m_frame.getData() == nullptr) {
+        m_free_buffers->try_pop(m_frame);
+    }
+
+    // Take the frame instead of copying it, the upstream block gets the
+    // recycled buffer to write its next output into.
+    m_frame.swap(*dataIn);
+
+    // The frame is sent once we got the metadata.
+
+    return m_frame.getLength();
+}
+
+meta_vec_t OutputZeroMQ::process_metadata(const meta_vec_t& metadataIn)
+{
+    if (m_frame.getLength() == 0) {
+        return {};
+    }
+
     if (m_type == ZMQ_REP) {
         // A ZMQ_REP socket requires a request first
         zmq::message_t msg;
@@ -72,10 +121,51 @@ int OutputZeroMQ::process(Buffer* dataIn)
         (void)rr;
     }
 
-    m_zmq_sock.send(zmq::const_buffer{dataIn->getData(), dataIn->getLength()});
+    // A PUSH socket blocks when no peer is connected, drop the frames
+    // instead of blocking the modulator
+    const auto flags = (m_type == ZMQ_PUSH) ?
+        zmq::send_flags::dontwait : zmq::send_flags::none;
+
+    if (m_send_header) {
+        zmq_output_header_t header;
+        if (not metadataIn.empty()) {
+            const auto& ts = metadataIn[0].ts;
+            header.timestamp_valid = ts.timestamp_valid ? 1 : 0;
+            header.fp = ts.fp;
+            header.fct = ts.fct;
+            header.timestamp_sec = ts.timestamp_sec();
+            header.timestamp_pps = ts.timestamp_pps();
+        }
+
+        const auto r = m_zmq_sock.send(zmq::buffer(&header, sizeof(header)),
+                flags | zmq::send_flags::sndmore);
+        if (not r) {
+            if (m_num_dropped++ == 0) {
+                etiLog.level(warn) << m_name << ": no peer, dropping frames";
+            }
+            return {};
+        }
+    }
 
-    return dataIn->getLength();
+    auto sent = new sent_buffer_t{m_free_buffers, Buffer()};
+    sent->buf.swap(m_frame);
+    zmq::message_t msg(sent->buf.getData(), sent->buf.getLength(),
+            give_back_buffer, sent);
+
+    // Once the header was accepted, the whole message is.
+    const auto r = m_zmq_sock.send(msg, flags);
+    if (not r) {
+        if (m_num_dropped++ == 0) {
+            etiLog.level(warn) << m_name << ": no peer, dropping frames";
+        }
+    }
+    else if (m_num_dropped > 0) {
+        etiLog.level(info) << m_name << ": " << m_num_dropped <<
+            " frames dropped";
+        m_num_dropped = 0;
+    }
+
+    return {};
 }
 
 #endif // HAVE_ZEROMQ
-
@@ -33,15 +33,37 @@
 #if defined(HAVE_ZEROMQ)
 
 #include "ModPlugin.h"
+#include "ThreadsafeQueue.h"
 #include "zmq.hpp"
+#include <cstdint>
+#include <memory>
 
-class OutputZeroMQ : public ModOutput
+/* Sent as first part of every message when the header is enabled, followed
+ * by the part containing the samples. The fields are in host byte order,
+ * the timestamp is the one of the first ETI frame in the samples. */
+struct zmq_output_header_t {
+    uint16_t version = 1;
+    uint8_t timestamp_valid = 0;
+    uint8_t fp = 0;             // Frame phase
+    int32_t fct = 0;            // ETI frame count
+    uint32_t timestamp_sec = 0; // seconds in unix epoch
+    uint32_t timestamp_pps = 0; // In units of 1/16384000 s
+};
+
+/* The samples are handed over to ZeroMQ without copy, and the buffers come
+ * back once ZeroMQ has sent them. */
+class OutputZeroMQ : public ModOutput, public ModMetadata
 {
     public:
-        OutputZeroMQ(std::string endpoint, int type, Buffer* dataOut = nullptr);
+        // A sndhwm of 0 keeps the default of ZeroMQ
+        OutputZeroMQ(std::string endpoint, int type,
+                int sndhwm = 0, bool send_header = false);
         virtual int process(Buffer* dataIn) override;
         const char* name() override { return m_name.c_str(); }
 
+        virtual meta_vec_t process_metadata(
+                const meta_vec_t& metadataIn) override;
+
     protected:
         int m_type;                   // zmq socket type
         zmq::context_t m_zmq_context; // handle for the zmq context
@@ -51,7 +73,19 @@ class OutputZeroMQ : public ModOutput
                                       // tcp://*:58300
 
         std::string m_name;
-};
 
+    private:
+        bool m_send_header;
+
+        // Taken from the flowgraph in process(), sent in process_metadata()
+        Buffer m_frame;
+
+        // Buffers that ZeroMQ has finished sending, shared with the
+        // messages in flight because they can outlive the output
+        using buffer_pool_t = ThreadsafeQueue<Buffer>;
+        std::shared_ptr<buffer_pool_t> m_free_buffers;
+
+        size_t m_num_dropped = 0;
+};
 #endif // HAVE_ZEROMQ
 
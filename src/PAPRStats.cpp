@@ -25,72 +25,370 @@
  */
 
 #include "PAPRStats.h"
+#include "CpuFeatures.h"
+#include <algorithm>
 #include <numeric>
 #include <cmath>
+#include <cstring>
 #include <stdexcept>
+#if defined(__x86_64__) || defined(__i386__)
+#  include <immintrin.h>
+#elif defined(__ARM_NEON)
+#  include <arm_neon.h>
+#endif
 #if defined(TEST)
 /* compile with g++ -std=c++11 -Wall -DTEST PAPRStats.cpp -o paprtest */
 #  include <iostream>
 #endif
 
+using power_kernel_t = void (*)(const std::complex<float>*, size_t,
+        float&, float&);
+
+static void measure_power_scalar(const std::complex<float>* data,
+        size_t data_len, float& norm_peak, float& norm_sum)
+{
+    float peak = 0;
+    float sum = 0;
+    for (size_t i = 0; i < data_len; i++) {
+        const float x_norm = std::norm(data[i]);
+        peak = std::max(peak, x_norm);
+        sum += x_norm;
+    }
+    norm_peak = peak;
+    norm_sum = sum;
+}
+
+#if defined(__SSE2__)
+static void measure_power_sse(const std::complex<float>* data,
+        size_t data_len, float& norm_peak, float& norm_sum)
+{
+    const float *f = reinterpret_cast<const float*>(data);
+    __m128 peak = _mm_setzero_ps();
+    __m128 sum = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= data_len; i += 4) {
+        const __m128 a = _mm_loadu_ps(f + 2 * i);
+        const __m128 b = _mm_loadu_ps(f + 2 * i + 4);
+        const __m128 a2 = _mm_mul_ps(a, a);
+        const __m128 b2 = _mm_mul_ps(b, b);
+        const __m128 norm = _mm_add_ps(
+                _mm_shuffle_ps(a2, b2, 0x88), _mm_shuffle_ps(a2, b2, 0xdd));
+        peak = _mm_max_ps(peak, norm);
+        sum = _mm_add_ps(sum, norm);
+    }
+
+    alignas(16) float peaks[4];
+    alignas(16) float sums[4];
+    _mm_store_ps(peaks, peak);
+    _mm_store_ps(sums, sum);
+
+    float tail_peak = 0;
+    float tail_sum = 0;
+    measure_power_scalar(data + i, data_len - i, tail_peak, tail_sum);
+    norm_peak = std::max(std::max(peaks[0], peaks[1]),
+            std::max(std::max(peaks[2], peaks[3]), tail_peak));
+    norm_sum = (sums[0] + sums[1]) + (sums[2] + sums[3]) + tail_sum;
+}
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+// Compiled for AVX2 even if the rest of the program isn't, and only used if
+// the CPU supports it.
+#  define HAVE_PAPR_STATS_DISPATCH 1
+
+__attribute__((target("avx2")))
+static void measure_power_avx2(const std::complex<float>* data,
+        size_t data_len, float& norm_peak, float& norm_sum)
+{
+    const float *f = reinterpret_cast<const float*>(data);
+    __m256 peak = _mm256_setzero_ps();
+    __m256 sum = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= data_len; i += 8) {
+        const __m256 a = _mm256_loadu_ps(f + 2 * i);
+        const __m256 b = _mm256_loadu_ps(f + 2 * i + 8);
+        const __m256 a2 = _mm256_mul_ps(a, a);
+        const __m256 b2 = _mm256_mul_ps(b, b);
+        // The order of the samples within the lanes doesn't matter
+        const __m256 norm = _mm256_add_ps(
+                _mm256_shuffle_ps(a2, b2, 0x88),
+                _mm256_shuffle_ps(a2, b2, 0xdd));
+        peak = _mm256_max_ps(peak, norm);
+        sum = _mm256_add_ps(sum, norm);
+    }
+
+    alignas(32) float peaks[8];
+    alignas(32) float sums[8];
+    _mm256_store_ps(peaks, peak);
+    _mm256_store_ps(sums, sum);
+
+    float tail_peak = 0;
+    float tail_sum = 0;
+    measure_power_scalar(data + i, data_len - i, tail_peak, tail_sum);
+    float p = tail_peak;
+    float s = 0;
+    for (size_t j = 0; j < 8; j++) {
+        p = std::max(p, peaks[j]);
+        s += sums[j];
+    }
+    norm_peak = p;
+    norm_sum = s + tail_sum;
+}
+#endif
+
+#if defined(__ARM_NEON)
+static void measure_power_neon(const std::complex<float>* data,
+        size_t data_len, float& norm_peak, float& norm_sum)
+{
+    const float *f = reinterpret_cast<const float*>(data);
+    float32x4_t peak = vdupq_n_f32(0);
+    float32x4_t sum = vdupq_n_f32(0);
+    size_t i = 0;
+    for (; i + 4 <= data_len; i += 4) {
+        const float32x4x2_t x = vld2q_f32(f + 2 * i);
+        const float32x4_t norm = vmlaq_f32(
+                vmulq_f32(x.val[0], x.val[0]), x.val[1], x.val[1]);
+        peak = vmaxq_f32(peak, norm);
+        sum = vaddq_f32(sum, norm);
+    }
+
+    float tail_peak = 0;
+    float tail_sum = 0;
+    measure_power_scalar(data + i, data_len - i, tail_peak, tail_sum);
+    norm_peak = std::max(vmaxvq_f32(peak), tail_peak);
+    norm_sum = vaddvq_f32(sum) + tail_sum;
+}
+#endif
+
+static power_kernel_t select_power_kernel()
+{
+    auto& cpu = cpu_features();
+    power_kernel_t kernel = measure_power_scalar;
+    const char *name = "scalar";
+#if defined(HAVE_PAPR_STATS_DISPATCH)
+    if (cpu.supports(cpu_feature_e::avx2)) {
+        kernel = measure_power_avx2;
+        name = "AVX2";
+    }
+    else
+#endif
+#if defined(__SSE2__)
+    if (cpu.supports(cpu_feature_e::sse2)) {
+        kernel = measure_power_sse;
+        name = "SSE2";
+    }
+#elif defined(__ARM_NEON)
+    if (cpu.supports(cpu_feature_e::neon)) {
+        kernel = measure_power_neon;
+        name = "NEON";
+    }
+#endif
+    cpu.register_kernel("PAPRStats", name);
+    return kernel;
+}
+
+/* The bins above the mean power are given by the exponent and the first
+ * mantissa bits of the power ratio as a float. */
+static constexpr int ccdf_mantissa_shift = 23 - 4;
+static_assert((1 << (23 - ccdf_mantissa_shift)) ==
+        PAPRStats::ccdf_bins_per_octave, "Invalid CCDF bins per octave");
+
+// The raw bits of 1.0f, shifted like the bins
+static constexpr int32_t ccdf_bin_offset = 127 << (23 - ccdf_mantissa_shift);
+
+static inline int32_t ccdf_bin(float ratio)
+{
+    int32_t bits;
+    std::memcpy(&bits, &ratio, sizeof(bits));
+    const int32_t bin = (bits >> ccdf_mantissa_shift) - ccdf_bin_offset + 1;
+    return std::min(std::max(bin, 0),
+            (int32_t)PAPRStats::ccdf_num_bins - 1);
+}
+
+// Lowest power ratio of a bin above the mean power
+static double ccdf_bin_start(size_t bin)
+{
+    const size_t octave = (bin - 1) / PAPRStats::ccdf_bins_per_octave;
+    const size_t step = (bin - 1) % PAPRStats::ccdf_bins_per_octave;
+    return std::ldexp(1.0 + (double)step / PAPRStats::ccdf_bins_per_octave,
+            octave);
+}
+
+// Calculate the bins of n samples with the given inverse mean power
+static void ccdf_bins(const std::complex<float>* data, size_t n,
+        float inv_mean, int32_t *bins)
+{
+    size_t i = 0;
+#if defined(__SSE2__) || defined(__ARM_NEON)
+    const float *f = reinterpret_cast<const float*>(data);
+    // Clamping the ratio to just below 1 and to 32 gives the first and
+    // last bin without comparing the integers.
+    const float ratio_lo = std::nextafter(1.0f, 0.0f);
+    const float ratio_hi = std::ldexp(1.0f, PAPRStats::ccdf_num_octaves);
+#endif
+#if defined(__SSE2__)
+    const __m128 inv = _mm_set1_ps(inv_mean);
+    const __m128 lo = _mm_set1_ps(ratio_lo);
+    const __m128 hi = _mm_set1_ps(ratio_hi);
+    const __m128i offset = _mm_set1_epi32(ccdf_bin_offset - 1);
+    for (; i + 4 <= n; i += 4) {
+        const __m128 a = _mm_loadu_ps(f + 2 * i);
+        const __m128 b = _mm_loadu_ps(f + 2 * i + 4);
+        const __m128 a2 = _mm_mul_ps(a, a);
+        const __m128 b2 = _mm_mul_ps(b, b);
+        const __m128 norm = _mm_add_ps(
+                _mm_shuffle_ps(a2, b2, 0x88), _mm_shuffle_ps(a2, b2, 0xdd));
+        const __m128 ratio = _mm_min_ps(
+                _mm_max_ps(_mm_mul_ps(norm, inv), lo), hi);
+        const __m128i bin = _mm_sub_epi32(_mm_srli_epi32(
+                    _mm_castps_si128(ratio), ccdf_mantissa_shift), offset);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(bins + i), bin);
+    }
+#elif defined(__ARM_NEON)
+    const float32x4_t lo = vdupq_n_f32(ratio_lo);
+    const float32x4_t hi = vdupq_n_f32(ratio_hi);
+    const int32x4_t offset = vdupq_n_s32(ccdf_bin_offset - 1);
+    for (; i + 4 <= n; i += 4) {
+        const float32x4x2_t x = vld2q_f32(f + 2 * i);
+        const float32x4_t norm = vmlaq_f32(
+                vmulq_f32(x.val[0], x.val[0]), x.val[1], x.val[1]);
+        const float32x4_t ratio = vminq_f32(
+                vmaxq_f32(vmulq_n_f32(norm, inv_mean), lo), hi);
+        const int32x4_t bin = vsubq_s32(vshrq_n_s32(
+                    vreinterpretq_s32_f32(ratio), ccdf_mantissa_shift), offset);
+        vst1q_s32(bins + i, bin);
+    }
+#endif
+    for (; i < n; i++) {
+        bins[i] = ccdf_bin(std::norm(data[i]) * inv_mean);
+    }
+}
+
 PAPRStats::PAPRStats(size_t num_blocks_to_accumulate) :
-    m_num_blocks_to_accumulate(num_blocks_to_accumulate)
+    m_num_blocks_to_accumulate(num_blocks_to_accumulate),
+    m_blocks(num_blocks_to_accumulate)
 {
+    if (num_blocks_to_accumulate == 0) {
+        throw std::invalid_argument("PAPRStats needs to accumulate blocks");
+    }
 }
 
 void PAPRStats::process_block(const complexf* data, size_t data_len)
 {
-    double norm_peak = 0;
-    double rms2 = 0;
+    push_block(measure_block(data, data_len));
+}
 
-    for (size_t i = 0; i < data_len; i++) {
-        const double x_norm = std::norm(data[i]);
+void PAPRStats::measure_power(const complexf* data, size_t data_len,
+        float& norm_peak, float& norm_sum)
+{
+    static const power_kernel_t kernel = select_power_kernel();
+    kernel(data, data_len, norm_peak, norm_sum);
+}
 
-        if (x_norm > norm_peak) {
-            norm_peak = x_norm;
+PAPRStats::block_t PAPRStats::measure_block(
+        const complexf* data, size_t data_len)
+{
+    block_t block;
+
+    float norm_peak = 0;
+    float norm_sum = 0;
+    measure_power(data, data_len, norm_peak, norm_sum);
+
+    block.norm_peak = norm_peak;
+    block.rms2 = (double)norm_sum / data_len;
+
+    if (norm_sum > 0) {
+        const float inv_mean = data_len / norm_sum;
+
+        // Calculate the bins of a chunk of samples at once before counting
+        // them. Most samples fall into the same few bins, counting
+        // into separate histograms avoids waiting for the previous increment
+        // of a bin.
+        constexpr size_t chunk_size = 256;
+        int32_t bins[chunk_size];
+        uint32_t counts[4][ccdf_num_bins] = {};
+        for (size_t start = 0; start < data_len; start += chunk_size) {
+            const size_t len = std::min(chunk_size, data_len - start);
+            ccdf_bins(data + start, len, inv_mean, bins);
+
+            size_t i = 0;
+            for (; i + 4 <= len; i += 4) {
+                counts[0][bins[i]]++;
+                counts[1][bins[i + 1]]++;
+                counts[2][bins[i + 2]]++;
+                counts[3][bins[i + 3]]++;
+            }
+            for (; i < len; i++) {
+                counts[0][bins[i]]++;
+            }
         }
 
-        rms2 += x_norm;
+        for (size_t bin = 0; bin < ccdf_num_bins; bin++) {
+            block.ccdf_counts[bin] = (counts[0][bin] + counts[1][bin]) +
+                (counts[2][bin] + counts[3][bin]);
+        }
     }
 
-    rms2 /= data_len;
+    return block;
+}
 
+void PAPRStats::push_block(const block_t& block)
+{
 #if defined(TEST)
-    std::cerr << "Accumulating peak " << norm_peak <<
-        " rms2 " << rms2 << std::endl;
+    std::cerr << "Accumulating peak " << block.norm_peak <<
+        " rms2 " << block.rms2 << std::endl;
 #endif
 
-    m_squared_peaks.push_back(norm_peak);
-    m_squared_mean.push_back(rms2);
+    std::lock_guard<std::mutex> lock(m_mutex);
 
-    if (m_squared_mean.size() > m_num_blocks_to_accumulate) {
-        m_squared_mean.pop_front();
-        m_squared_peaks.pop_front();
+    block_t& slot = m_blocks[m_next_block];
+    if (m_num_blocks == m_num_blocks_to_accumulate) {
+        m_rms2_sum -= slot.rms2;
+        for (size_t bin = 0; bin < ccdf_num_bins; bin++) {
+            m_ccdf_counts[bin] -= slot.ccdf_counts[bin];
+        }
     }
-}
-
-double PAPRStats::calculate_papr() const
-{
-    if (m_squared_mean.size() < m_num_blocks_to_accumulate) {
-        return 0;
+    else {
+        m_num_blocks++;
     }
 
-    if (m_squared_mean.size() != m_squared_peaks.size()) {
-        throw std::logic_error("Invalid PAPR measurement sizes");
+    slot = block;
+    m_rms2_sum += block.rms2;
+    for (size_t bin = 0; bin < ccdf_num_bins; bin++) {
+        m_ccdf_counts[bin] += block.ccdf_counts[bin];
     }
 
-    double peak = 0;
-    double rms2 = 0;
-    for (size_t i = 0; i < m_squared_peaks.size(); i++) {
-        if (m_squared_peaks[i] > peak) {
-            peak = m_squared_peaks[i];
+    while (not m_peaks.empty() and m_peaks.back().second <= block.norm_peak) {
+        m_peaks.pop_back();
+    }
+    m_peaks.emplace_back(m_block_index, block.norm_peak);
+    if (m_peaks.front().first + m_num_blocks_to_accumulate <= m_block_index) {
+        m_peaks.pop_front();
+    }
+    m_block_index++;
+
+    m_next_block++;
+    if (m_next_block == m_num_blocks_to_accumulate) {
+        m_next_block = 0;
+        m_rms2_sum = 0;
+        for (const auto& b : m_blocks) {
+            m_rms2_sum += b.rms2;
         }
+    }
+}
+
+double PAPRStats::calculate_papr() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
 
-        rms2 += m_squared_mean[i];
+    if (m_num_blocks < m_num_blocks_to_accumulate) {
+        return 0;
     }
 
+    const double peak = m_peaks.front().second;
+
     // This assumes all blocks given to process have the same length
-    rms2 /= m_squared_peaks.size();
+    const double rms2 = m_rms2_sum / m_num_blocks;
 
 #if defined(TEST)
     std::cerr << "Calculate peak " << peak <<
@@ -100,10 +398,56 @@ double PAPRStats::calculate_papr() const
     return 10.0 * std::log10(peak / rms2);
 }
 
+std::vector<double> PAPRStats::calculate_ccdf(
+        const std::vector<double>& levels_dB) const
+{
+    std::vector<double> ccdf;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_num_blocks < m_num_blocks_to_accumulate) {
+        return ccdf;
+    }
+
+    // Number of samples in the bin and all bins above
+    std::array<uint64_t, ccdf_num_bins + 1> above = {};
+    for (size_t bin = ccdf_num_bins; bin > 0; bin--) {
+        above[bin - 1] = above[bin] + m_ccdf_counts[bin - 1];
+    }
+
+    if (above[0] == 0) {
+        return std::vector<double>(levels_dB.size(), 0.0);
+    }
+
+    for (const double level : levels_dB) {
+        const float ratio = std::pow(10.0, std::max(level, 0.0) / 10.0);
+        const size_t bin = std::max(ccdf_bin(ratio), 1);
+
+        double count = above[bin + 1];
+        if (bin + 1 < ccdf_num_bins) {
+            // Assume the samples are spread evenly over the bin
+            const double start = ccdf_bin_start(bin);
+            const double end = ccdf_bin_start(bin + 1);
+            count += (double)m_ccdf_counts[bin] * (end - (double)ratio) / (end - start);
+        }
+        else {
+            count += m_ccdf_counts[bin];
+        }
+        ccdf.push_back(count / above[0]);
+    }
+
+    return ccdf;
+}
+
 void PAPRStats::clear()
 {
-    m_squared_peaks.clear();
-    m_squared_mean.clear();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::fill(m_blocks.begin(), m_blocks.end(), block_t());
+    m_num_blocks = 0;
+    m_next_block = 0;
+    m_rms2_sum = 0;
+    m_ccdf_counts.fill(0);
+    m_peaks.clear();
 }
 
 #if defined(TEST)
@@ -120,7 +464,7 @@ print(10. * np.log10(peak / rms))
 int main(int argc, char **argv)
 {
     using namespace std;
-    vector<complexf> vec(40);
+    vector<complex<float> > vec(40);
 
     for (size_t i = 0; i < vec.size(); i++) {
         vec[i] = polar(0.5, 0.3 * i);
@@ -147,6 +491,11 @@ int main(int argc, char **argv)
     const auto papr1 = stats.calculate_papr();
     cout << "PAPR = " << papr1 << " dB" << endl;
 
+    const vector<double> levels = {0, 3, 6, 10, 14};
+    const auto ccdf = stats.calculate_ccdf(levels);
+    for (size_t i = 0; i < levels.size(); i++) {
+        cout << "CCDF(" << levels[i] << " dB) = " << ccdf[i] << endl;
+    }
 }
 
 #endif
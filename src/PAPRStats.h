@@ -30,9 +30,14 @@
 #   include "config.h"
 #endif
 
+#include <array>
+#include <complex>
 #include <cstddef>
+#include <cstdint>
 #include <deque>
-#include <complex>
+#include <mutex>
+#include <utility>
+#include <vector>
 
 /* Helper class to calculate Peak-to-average-power ratio.
  * Definition of PAPR:
@@ -47,12 +52,38 @@
  *
  * Given that peaks are rare in a DAB signal, we want to accumulate
  * several seconds worth of samples to do our calculation.
+ *
+ * Over the same blocks, it also accumulates a histogram of the ratio between
+ * the power of every sample and the mean power of its block, from which
+ * the CCDF, the probability that this ratio exceeds a given level, is
+ * calculated.
+ *
+ * Accumulating a block and calculating the PAPR and the CCDF take constant
+ * time, independently of the number of accumulated blocks. The public
+ * functions are threadsafe.
  */
 class PAPRStats
 {
     typedef std::complex<float> complexf;
 
     public:
+        /* Bin 0 counts the samples below the mean power. Above, every octave
+         * of the power ratio is split into ccdf_bins_per_octave bins that
+         * are evenly spaced in the ratio, and the last bin counts the
+         * samples above ccdf_num_octaves octaves, about 15 dB.
+         */
+        static constexpr size_t ccdf_bins_per_octave = 16;
+        static constexpr size_t ccdf_num_octaves = 5;
+        static constexpr size_t ccdf_num_bins =
+            ccdf_num_octaves * ccdf_bins_per_octave + 2;
+
+        struct block_t {
+            double norm_peak = 0;
+            double rms2 = 0;
+            // Empty if the block has no power
+            std::array<uint32_t, ccdf_num_bins> ccdf_counts = {};
+        };
+
         PAPRStats(size_t num_blocks_to_accumulate);
 
         /* Push in a new block of samples to measure. calculate_papr()
@@ -60,18 +91,54 @@ class PAPRStats
          */
         void process_block(const complexf* data, size_t data_len);
 
+        /* Measure a block without accumulating it, so that blocks can be
+         * measured in parallel, and accumulate it later with push_block.
+         */
+        static block_t measure_block(const complexf* data, size_t data_len);
+        void push_block(const block_t& block);
+
+        /* Single pass over the samples, vectorised, that returns the
+         * largest norm of the samples and the sum of their norms.
+         */
+        static void measure_power(const complexf* data, size_t data_len,
+                float& norm_peak, float& norm_sum);
+
         /* Returns PAPR in dB if enough blocks were processed, or
          * 0 otherwise.
          */
         double calculate_papr(void) const;
 
+        /* For every level in dB, between 0 and 15 dB, returns the
+         * probability that the power of a sample exceeds the mean power of
+         * its block by more than the level. Returns an empty vector if
+         * not enough blocks were processed.
+         */
+        std::vector<double> calculate_ccdf(
+                const std::vector<double>& levels_dB) const;
+
         void clear(void);
 
     private:
         size_t m_num_blocks_to_accumulate;
-        std::deque<double> m_squared_peaks;
-        std::deque<double> m_squared_mean;
-};
-
 
+        mutable std::mutex m_mutex;
+
+        // Ring buffer of the accumulated blocks, the oldest one is
+        // replaced once it is full.
+        std::vector<block_t> m_blocks;
+        size_t m_num_blocks = 0;
+        size_t m_next_block = 0;
+        uint64_t m_block_index = 0;
+
+        // Sums over the accumulated blocks. The sum of the rms2 is
+        // recalculated every time the ring buffer wraps around, so that
+        // the rounding errors of the updates do not accumulate.
+        double m_rms2_sum = 0;
+        std::array<uint64_t, ccdf_num_bins> m_ccdf_counts = {};
+
+        // Block indices and peaks of the blocks that are larger than all
+        // the blocks accumulated after them, in decreasing order of peaks.
+        // The front one is the peak of all accumulated blocks.
+        std::deque<std::pair<uint64_t, double> > m_peaks;
+};
 
@@ -0,0 +1,389 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PeakCanceller.h"
+#include "CpuFeatures.h"
+#include "PcDebug.h"
+
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#    include <immintrin.h>
+#elif defined(__ARM_NEON)
+#    include <arm_neon.h>
+#endif
+
+using namespace std;
+
+// Bandwidth of the DAB signal, which the cancellation pulse must not exceed
+static constexpr double dab_bandwidth = 1536000.0;
+
+// Number of zero crossings of the sinc on each side of the pulse
+static constexpr double pulse_zero_crossings = 8.0;
+
+struct PeakCanceller::kernels_t {
+    // Index of the first of the samples [start, n) whose norm exceeds
+    // threshold, or n if there is none
+    size_t (*find_peak)(const float *x, size_t start, size_t n,
+            float threshold);
+    // x -= c * pulse, over len floats
+    void (*cancel)(float *x, const float *pulse, size_t len,
+            float c_re, float c_im);
+    const char *name;
+};
+
+static size_t find_peak_scalar(const float *x, size_t start, size_t n,
+        float threshold)
+{
+    for (size_t i = start; i < n; i++) {
+        if (x[2*i] * x[2*i] + x[2*i+1] * x[2*i+1] > threshold) {
+            return i;
+        }
+    }
+    return n;
+}
+
+static void cancel_scalar(float *x, const float *pulse, size_t len,
+        float c_re, float c_im)
+{
+    for (size_t i = 0; i < len; i += 2) {
+        x[i] -= c_re * pulse[i];
+        x[i+1] -= c_im * pulse[i+1];
+    }
+}
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+// Compiled for AVX even if the rest of the program isn't, and only used if
+// the CPU supports it.
+#  define HAVE_PEAK_KERNEL_DISPATCH 1
+
+__attribute__((target("avx")))
+static size_t find_peak_avx(const float *x, size_t start, size_t n,
+        float threshold)
+{
+    const __m256 t = _mm256_set1_ps(threshold);
+    size_t i = start;
+    for (; i + 4 <= n; i += 4) {
+        const __m256 v = _mm256_loadu_ps(x + 2*i);
+        const __m256 sq = _mm256_mul_ps(v, v);
+        // Both floats of a sample get its norm
+        const __m256 norm = _mm256_add_ps(sq, _mm256_permute_ps(sq, 0xb1));
+        const int mask = _mm256_movemask_ps(_mm256_cmp_ps(norm, t, _CMP_GT_OQ));
+        if (mask) {
+            return i + __builtin_ctz(mask) / 2;
+        }
+    }
+    return find_peak_scalar(x, i, n, threshold);
+}
+
+__attribute__((target("avx")))
+static void cancel_avx(float *x, const float *pulse, size_t len,
+        float c_re, float c_im)
+{
+    const __m256 c = _mm256_setr_ps(c_re, c_im, c_re, c_im,
+            c_re, c_im, c_re, c_im);
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        _mm256_storeu_ps(x + i, _mm256_sub_ps(_mm256_loadu_ps(x + i),
+                    _mm256_mul_ps(c, _mm256_loadu_ps(pulse + i))));
+    }
+    cancel_scalar(x + i, pulse + i, len - i, c_re, c_im);
+}
+#endif
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+static size_t find_peak_neon(const float *x, size_t start, size_t n,
+        float threshold)
+{
+    const float32x4_t t = vdupq_n_f32(threshold);
+    size_t i = start;
+    for (; i + 4 <= n; i += 4) {
+        const float32x4x2_t v = vld2q_f32(x + 2*i);
+        const float32x4_t norm = vaddq_f32(
+                vmulq_f32(v.val[0], v.val[0]), vmulq_f32(v.val[1], v.val[1]));
+        if (vmaxvq_u32(vcgtq_f32(norm, t))) {
+            return find_peak_scalar(x, i, i + 4, threshold);
+        }
+    }
+    return find_peak_scalar(x, i, n, threshold);
+}
+
+static void cancel_neon(float *x, const float *pulse, size_t len,
+        float c_re, float c_im)
+{
+    const float c_array[4] = {c_re, c_im, c_re, c_im};
+    const float32x4_t c = vld1q_f32(c_array);
+    size_t i = 0;
+    for (; i + 4 <= len; i += 4) {
+        vst1q_f32(x + i, vmlsq_f32(vld1q_f32(x + i), c, vld1q_f32(pulse + i)));
+    }
+    cancel_scalar(x + i, pulse + i, len - i, c_re, c_im);
+}
+#endif
+
+static PeakCanceller::kernels_t select_peak_kernels()
+{
+    auto& cpu = cpu_features();
+    PeakCanceller::kernels_t kernels =
+        {find_peak_scalar, cancel_scalar, "scalar"};
+#if defined(HAVE_PEAK_KERNEL_DISPATCH)
+    if (cpu.supports(cpu_feature_e::avx)) {
+        kernels = {find_peak_avx, cancel_avx, "AVX"};
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    if (cpu.supports(cpu_feature_e::neon)) {
+        kernels = {find_peak_neon, cancel_neon, "NEON"};
+    }
+#endif
+    cpu.register_kernel("PeakCanceller", kernels.name);
+    return kernels;
+}
+
+static const PeakCanceller::kernels_t& peak_kernels()
+{
+    static const PeakCanceller::kernels_t kernels = select_peak_kernels();
+    return kernels;
+}
+
+PeakCanceller::PeakCanceller(float threshold, size_t iterations,
+        size_t sampleRate) :
+    ModCodec(),
+    RemoteControllable("peakcancel"),
+    m_threshold(threshold),
+    m_iterations(iterations),
+    m_kernels(peak_kernels()),
+    // Initialise the PAPRStats to a few seconds worth of samples
+    m_papr_before(50),
+    m_papr_after(50)
+{
+    PDEBUG("PeakCanceller::PeakCanceller(%f, %zu, %zu) @ %p\n",
+            threshold, iterations, sampleRate, this);
+
+    if (iterations == 0) {
+        throw std::runtime_error("PeakCanceller: needs at least one iteration");
+    }
+
+    if (sampleRate < dab_bandwidth) {
+        throw std::runtime_error("PeakCanceller: sample rate below the "
+                "bandwidth of the signal");
+    }
+
+    RC_ADD_PARAMETER(enabled, "Enable peak cancellation, the output is delayed all the same");
+    RC_ADD_PARAMETER(threshold, "Cancel the peaks that exceed the mean power by this value in dB");
+    RC_ADD_PARAMETER(iterations, "Maximum number of searches for peaks per frame");
+    RC_ADD_PARAMETER(stats, "(Read-only) Ratio of the samples at which a peak was cancelled");
+    RC_ADD_PARAMETER(papr, "(Read-only) PAPR measurements (before, after)");
+
+    // The pulse is a sinc of the bandwidth of the signal, relative to the
+    // sample rate, with a Hann window. Its centre is 1.
+    const double bw = dab_bandwidth / sampleRate;
+    m_half_length = std::ceil(pulse_zero_crossings / bw);
+
+    const size_t length = 2 * m_half_length + 1;
+    m_pulse.resize(2 * length);
+    for (size_t i = 0; i < length; i++) {
+        const double k = (double)i - m_half_length;
+        const double sinc = (k == 0) ? 1.0 :
+            std::sin(M_PI * bw * k) / (M_PI * bw * k);
+        const double window =
+            0.5 * (1.0 + std::cos(M_PI * k / (m_half_length + 1)));
+        m_pulse[2*i] = m_pulse[2*i+1] = sinc * window;
+    }
+
+    m_work.resize(delay());
+}
+
+size_t PeakCanceller::cancel_peaks(float threshold, size_t start, size_t stop)
+{
+    float *work = reinterpret_cast<float*>(m_work.data());
+    const size_t h = m_half_length;
+
+    size_t num_peaks = 0;
+    size_t j = start;
+    while (true) {
+        j = m_kernels.find_peak(work, j, stop, threshold);
+        if (j == stop) {
+            break;
+        }
+
+        const float peak = std::norm(m_work[j]);
+        if (std::norm(m_work[j + 1]) > peak) {
+            // The next sample is the larger peak
+            j++;
+            continue;
+        }
+
+        const complexf c = m_work[j] * (1.0f - std::sqrt(threshold / peak));
+        m_kernels.cancel(work + 2 * (j - h), m_pulse.data(),
+                m_pulse.size(), c.real(), c.imag());
+        num_peaks++;
+        j++;
+    }
+    return num_peaks;
+}
+
+int PeakCanceller::process(Buffer* const dataIn, Buffer* dataOut)
+{
+    const size_t n = dataIn->getLength() / sizeof(complexf);
+    const complexf *in = reinterpret_cast<const complexf*>(dataIn->getData());
+
+    const size_t h = m_half_length;
+    const size_t d = delay();
+    if (m_work.size() != d + n) {
+        m_work.resize(d + n);
+    }
+    memcpy(&m_work[d], in, n * sizeof(complexf));
+
+    if (m_enabled.load()) {
+        const auto block = PAPRStats::measure_block(in, n);
+        m_papr_before.push_block(block);
+
+        const float threshold = (float)(block.rms2 *
+            (double)std::pow(10.0f, m_threshold.load() / 10.0f));
+
+        // The peaks before h were handled with the previous frame, and
+        // those after n + h need the next one. A cancellation can push up
+        // the samples around the pulse, that earlier peak searches have
+        // already passed.
+        uint64_t num_peaks = 0;
+        const size_t iterations = m_iterations.load();
+        for (size_t i = 0; i < iterations and threshold > 0; i++) {
+            const size_t peaks = cancel_peaks(threshold, h, n + h);
+            if (peaks == 0) {
+                break;
+            }
+            num_peaks += peaks;
+        }
+
+        m_num_peaks += num_peaks;
+        m_num_samples += n;
+    }
+
+    dataOut->setLength(n * sizeof(complexf));
+    memcpy(dataOut->getData(), m_work.data(), n * sizeof(complexf));
+    memmove(m_work.data(), &m_work[n], d * sizeof(complexf));
+
+    if (m_enabled.load()) {
+        m_papr_after.process_block(
+                reinterpret_cast<const complexf*>(dataOut->getData()), n);
+    }
+
+    return dataOut->getLength();
+}
+
+void PeakCanceller::set_parameter(const string& parameter, const string& value)
+{
+    stringstream ss(value);
+    ss.exceptions ( stringstream::failbit | stringstream::badbit );
+
+    if (parameter == "enabled") {
+        bool enabled = false;
+        ss >> enabled;
+        m_enabled.store(enabled);
+        m_papr_before.clear();
+        m_papr_after.clear();
+    }
+    else if (parameter == "threshold") {
+        float threshold = 0;
+        ss >> threshold;
+        if (threshold <= 0) {
+            throw ParameterError("Parameter 'threshold' must be positive");
+        }
+        m_threshold.store(threshold);
+        m_papr_before.clear();
+        m_papr_after.clear();
+    }
+    else if (parameter == "iterations") {
+        size_t iterations = 0;
+        ss >> iterations;
+        if (iterations == 0) {
+            throw ParameterError("Parameter 'iterations' must be at least 1");
+        }
+        m_iterations.store(iterations);
+        m_papr_before.clear();
+        m_papr_after.clear();
+    }
+    else if (parameter == "stats" or parameter == "papr") {
+        throw ParameterError("Parameter '" + parameter + "' is read-only");
+    }
+    else {
+        stringstream ss_err;
+        ss_err << "Parameter '" << parameter
+            << "' is not exported by controllable " << get_rc_name();
+        throw ParameterError(ss_err.str());
+    }
+}
+
+const string PeakCanceller::get_parameter(const string& parameter) const
+{
+    stringstream ss;
+    if (parameter == "enabled") {
+        ss << m_enabled.load();
+    }
+    else if (parameter == "threshold") {
+        ss << std::fixed << m_threshold.load();
+    }
+    else if (parameter == "iterations") {
+        ss << m_iterations.load();
+    }
+    else if (parameter == "stats") {
+        const uint64_t num_samples = m_num_samples.load();
+        if (num_samples == 0) {
+            ss << "No stats available";
+        }
+        else {
+            ss << std::scientific << (double)m_num_peaks.load() / num_samples;
+        }
+    }
+    else if (parameter == "papr") {
+        const double papr_before = m_papr_before.calculate_papr();
+        const double papr_after = m_papr_after.calculate_papr();
+
+        ss << "PAPR [dB]: " << std::fixed <<
+            (papr_before == 0 ? string("N/A") : to_string(papr_before)) <<
+            ", " <<
+            (papr_after == 0 ? string("N/A") : to_string(papr_after));
+    }
+    else {
+        ss << "Parameter '" << parameter <<
+            "' is not exported by controllable " << get_rc_name();
+        throw ParameterError(ss.str());
+    }
+    return ss.str();
+}
+
+const json::map_t PeakCanceller::get_all_values() const
+{
+    json::map_t map;
+    map["enabled"].v = m_enabled.load();
+    map["threshold"].v = m_threshold.load();
+    map["iterations"].v = m_iterations.load();
+    const uint64_t num_samples = m_num_samples.load();
+    map["stats"].v = num_samples == 0 ? 0.0 :
+        (double)m_num_peaks.load() / num_samples;
+    map["papr"].v = m_papr_after.calculate_papr();
+    return map;
+}
@@ -0,0 +1,109 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   Crest factor reduction by peak cancellation, on the samples after the
+   guard interval, the windowing, the FIR filter and the resampler.
+*/
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include "ModPlugin.h"
+#include "PAPRStats.h"
+#include "RemoteControl.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* Every sample whose power exceeds the mean power of its frame by more
+ * than the threshold, and that is not smaller than the sample after it,
+ * is brought down to the threshold by subtracting a cancellation pulse
+ * centred on it. The pulse is a Hann-windowed sinc limited to the
+ * bandwidth of the DAB signal, so that the cancellation does not spread
+ * outside of the channel. The peaks are handled one after the other, and
+ * every cancellation is taken into account when looking for the next
+ * peak. The search is repeated until it finds no more peak, or up to the
+ * given number of iterations.
+ *
+ * A peak at the end of a frame needs the samples of the next one, and the
+ * output is therefore delayed by the length of the pulse minus one, see
+ * delay(). */
+class PeakCanceller : public ModCodec, public RemoteControllable
+{
+    public:
+        /* threshold in dB above the mean power, sampleRate of the input */
+        PeakCanceller(float threshold, size_t iterations, size_t sampleRate);
+        PeakCanceller(const PeakCanceller& other) = delete;
+        PeakCanceller& operator=(const PeakCanceller& other) = delete;
+
+        int process(Buffer* const dataIn, Buffer* dataOut) override;
+        const char* name() override { return "PeakCanceller"; }
+
+        // In samples
+        size_t delay() const { return 2 * m_half_length; }
+
+        /******* REMOTE CONTROL ********/
+        virtual void set_parameter(const std::string& parameter,
+                const std::string& value) override;
+
+        virtual const std::string get_parameter(
+                const std::string& parameter) const override;
+
+        virtual const json::map_t get_all_values() const override;
+
+        // The computation kernels, selected according to the CPU features
+        // at runtime
+        struct kernels_t;
+
+    private:
+        // Cancel the peaks in [start, stop) of m_work, returns their number
+        size_t cancel_peaks(float threshold, size_t start, size_t stop);
+
+        std::atomic<float> m_threshold;
+        std::atomic<size_t> m_iterations;
+        std::atomic<bool> m_enabled = ATOMIC_VAR_INIT(true);
+
+        // The pulse goes from -m_half_length to m_half_length, with every
+        // value twice for the real and imaginary parts.
+        size_t m_half_length;
+        std::vector<float> m_pulse;
+
+        // The samples of the previous frames that are not output yet,
+        // followed by the current frame
+        std::vector<complexf> m_work;
+
+        const kernels_t& m_kernels;
+
+        std::atomic<uint64_t> m_num_peaks = ATOMIC_VAR_INIT(0);
+        std::atomic<uint64_t> m_num_samples = ATOMIC_VAR_INIT(0);
+
+        // Over the last 50 frames
+        PAPRStats m_papr_before;
+        PAPRStats m_papr_after;
+};
@@ -0,0 +1,216 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PerfCounters.h"
+#include "Log.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#if defined(__linux__)
+#  include <linux/perf_event.h>
+#  include <sys/ioctl.h>
+#  include <sys/syscall.h>
+#endif
+
+namespace perf_counters {
+
+counts_t& counts_t::operator+=(const counts_t& other)
+{
+    cycles += other.cycles;
+    instructions += other.instructions;
+    llc_misses += other.llc_misses;
+    branch_misses += other.branch_misses;
+    return *this;
+}
+
+counts_t counts_t::operator-(const counts_t& other) const
+{
+    counts_t diff;
+    diff.cycles = cycles - other.cycles;
+    diff.instructions = instructions - other.instructions;
+    diff.llc_misses = llc_misses - other.llc_misses;
+    diff.branch_misses = branch_misses - other.branch_misses;
+    return diff;
+}
+
+static std::atomic<bool> s_enabled = ATOMIC_VAR_INIT(false);
+
+#if defined(__linux__)
+static constexpr size_t NUM_EVENTS = 4;
+
+// In the order of the fields of counts_t
+static const uint64_t events[NUM_EVENTS] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+/* The group of counters of one thread, the cycles being the leader. An
+ * event the CPU does not have is left out of the group and reads as
+ * zero. */
+struct thread_counters_t {
+    thread_counters_t() = default;
+    thread_counters_t(const thread_counters_t&) = delete;
+    thread_counters_t& operator=(const thread_counters_t&) = delete;
+
+    ~thread_counters_t() {
+        for (int fd : fds) {
+            if (fd != -1) {
+                ::close(fd);
+            }
+        }
+    }
+
+    // Returns 0 or the errno of the leader
+    int open() {
+        for (size_t i = 0; i < NUM_EVENTS; i++) {
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.size = sizeof(attr);
+            attr.config = events[i];
+            attr.read_format = PERF_FORMAT_GROUP;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.disabled = (i == 0) ? 1 : 0;
+
+            const int leader = (i == 0) ? -1 : fds[0];
+            fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+            if (fds[i] == -1) {
+                if (i == 0) {
+                    return errno;
+                }
+                continue;
+            }
+            member[num_members++] = i;
+        }
+
+        ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        return 0;
+    }
+
+    bool read(counts_t& counts) {
+        // The number of counters, followed by their values
+        uint64_t values[1 + NUM_EVENTS] = {};
+        const ssize_t len = ::read(fds[0], values, sizeof(values));
+        if (len < (ssize_t)sizeof(uint64_t) or values[0] != num_members) {
+            return false;
+        }
+
+        uint64_t all[NUM_EVENTS] = {};
+        for (size_t i = 0; i < num_members; i++) {
+            all[member[i]] = values[1 + i];
+        }
+        counts.cycles = all[0];
+        counts.instructions = all[1];
+        counts.llc_misses = all[2];
+        counts.branch_misses = all[3];
+        return true;
+    }
+
+    int fds[NUM_EVENTS] = {-1, -1, -1, -1};
+
+    // Index into events of every member of the group
+    size_t member[NUM_EVENTS] = {};
+    size_t num_members = 0;
+
+    bool opened = false;
+    bool failed = false;
+};
+
+static thread_local thread_counters_t t_counters;
+
+static int open_thread_counters()
+{
+    if (t_counters.failed) {
+        return EINVAL;
+    }
+    if (not t_counters.opened) {
+        const int err = t_counters.open();
+        if (err != 0) {
+            t_counters.failed = true;
+            return err;
+        }
+        t_counters.opened = true;
+    }
+    return 0;
+}
+#endif
+
+bool set_enabled(bool enabled)
+{
+    if (not enabled) {
+        s_enabled = false;
+        return true;
+    }
+
+#if defined(__linux__)
+    const int err = open_thread_counters();
+    if (err != 0) {
+        if (err == EACCES or err == EPERM) {
+            etiLog.level(warn) << "Cannot open the hardware performance "
+                "counters: " << strerror(err) << ". Check "
+                "/proc/sys/kernel/perf_event_paranoid, it must be 2 or lower.";
+        }
+        else {
+            // E.g. in a virtual machine without a PMU
+            etiLog.level(warn) << "Cannot open the hardware performance "
+                "counters: " << strerror(err) << ". The CPU or the kernel "
+                "does not provide them.";
+        }
+        return false;
+    }
+    s_enabled = true;
+    return true;
+#else
+    etiLog.level(warn) << "Hardware performance counters are only "
+        "supported on Linux";
+    return false;
+#endif
+}
+
+bool enabled()
+{
+    return s_enabled.load(std::memory_order_relaxed);
+}
+
+bool read(counts_t& counts)
+{
+    if (not enabled()) {
+        return false;
+    }
+
+#if defined(__linux__)
+    if (open_thread_counters() != 0) {
+        return false;
+    }
+    return t_counters.read(counts);
+#else
+    return false;
+#endif
+}
+
+} // namespace perf_counters
@@ -0,0 +1,64 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include <cstdint>
+
+/* Hardware performance counters of the calling thread, read with
+ * perf_event_open. Every thread opens its own group of counters the first
+ * time it reads them, so that the flowgraph can count the events around
+ * the processing of a node in whichever thread processes it. Only the
+ * events in user space are counted, which works with the default
+ * perf_event_paranoid setting.
+ *
+ * Only available on Linux, and off by default.
+ */
+namespace perf_counters {
+
+struct counts_t {
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    uint64_t llc_misses = 0;
+    uint64_t branch_misses = 0;
+
+    counts_t& operator+=(const counts_t& other);
+    counts_t operator-(const counts_t& other) const;
+};
+
+/* Switch the counters on or off for all threads. When switching on, the
+ * counters are opened in the calling thread to check that the kernel and
+ * the CPU support them. Returns false, and leaves the counters off, if
+ * they do not. */
+bool set_enabled(bool enabled);
+bool enabled();
+
+/* Read the counters of the calling thread. Returns false if they are off,
+ * or cannot be opened in this thread. */
+bool read(counts_t& counts);
+
+} // namespace perf_counters
@@ -26,13 +26,17 @@
 
 #include "PhaseReference.h"
 #include "PcDebug.h"
+#include "SharedTables.h"
 
 #include <stdexcept>
+#include <array>
+#include <string>
+#include <type_traits>
 
 /* ETSI EN 300 401 Table 43 (Clause 14.3.2)
  * Contains h_{i,k} values
  */
-static const uint8_t d_h[4][32] = {
+static constexpr uint8_t d_h[4][32] = {
     /* h0 */ { 0, 2, 0, 0, 0, 0, 1, 1, 2, 0, 0, 0, 2, 2, 1, 1,
         0, 2, 0, 0, 0, 0, 1, 1, 2, 0, 0, 0, 2, 2, 1, 1 },
     /* h1 */ { 0, 3, 2, 3, 0, 1, 3, 0, 2, 1, 2, 3, 2, 3, 3, 0,
@@ -43,6 +47,63 @@ static const uint8_t d_h[4][32] = {
         0, 1, 2, 1, 0, 3, 3, 2, 2, 3, 2, 1, 2, 1, 3, 2 }
 };
 
+static constexpr int table[][48][2] = {
+    { // Mode 0/4
+        // Positive part
+        { 0, 0 }, { 3, 1 }, { 2, 0 }, { 1, 2 }, { 0, 0 }, { 3, 1 },
+        { 2, 2 }, { 1, 2 }, { 0, 2 }, { 3, 1 }, { 2, 3 }, { 1, 0 },
+        // Negative part
+        { 0, 0 }, { 1, 1 }, { 2, 1 }, { 3, 2 }, { 0, 2 }, { 1, 2 },
+        { 2, 0 }, { 3, 3 }, { 0, 3 }, { 1, 1 }, { 2, 3 }, { 3, 2 },
+    },
+    { // Mode 1
+        // Positive part
+        { 0, 3 }, { 3, 1 }, { 2, 1 }, { 1, 1 }, { 0, 2 }, { 3, 2 },
+        { 2, 1 }, { 1, 0 }, { 0, 2 }, { 3, 2 }, { 2, 3 }, { 1, 3 },
+        { 0, 0 }, { 3, 2 }, { 2, 1 }, { 1, 3 }, { 0, 3 }, { 3, 3 },
+        { 2, 3 }, { 1, 0 }, { 0, 3 }, { 3, 0 }, { 2, 1 }, { 1, 1 },
+        // Negative part
+        { 0, 1 }, { 1, 2 }, { 2, 0 }, { 3, 1 }, { 0, 3 }, { 1, 2 },
+        { 2, 2 }, { 3, 3 }, { 0, 2 }, { 1, 1 }, { 2, 2 }, { 3, 3 },
+        { 0, 1 }, { 1, 2 }, { 2, 3 }, { 3, 3 }, { 0, 2 }, { 1, 2 },
+        { 2, 2 }, { 3, 1 }, { 0, 1 }, { 1, 3 }, { 2, 1 }, { 3, 2 },
+    },
+    { // Mode 2
+        // Positive part
+        { 2, 0 }, { 1, 2 }, { 0, 2 }, { 3, 1 }, { 2, 0 }, { 1, 3 },
+        // Negative part
+        { 0, 2 }, { 1, 3 }, { 2, 2 }, { 3, 2 }, { 0, 1 }, { 1, 2 },
+    },
+    { // Mode 3
+        // Positive part
+        { 3, 2 }, { 2, 2 }, { 1, 2 },
+        // Negative part
+        { 0, 2 }, { 1, 3 }, { 2, 0 },
+    },
+};
+
+/* The phase of every carrier, in multiples of pi/2, given by the h_{i,k}
+ * values from d_h and the i and n values from table, for each mode.
+ */
+template <size_t carriers>
+static constexpr std::array<uint8_t, carriers> phase_indices(unsigned int dabmode)
+{
+    std::array<uint8_t, carriers> phases{};
+    for (size_t index = 0, offset = 0; index < carriers; ++offset) {
+        for (size_t k = 0; k < 32; ++k) {
+            phases[index++] =
+                (d_h[ table[dabmode][offset][0] ][k] +
+                 table[dabmode][offset][1]) % 4;
+        }
+    }
+    return phases;
+}
+
+static constexpr auto phases_tm1 = phase_indices<1536>(1);
+static constexpr auto phases_tm2 = phase_indices<384>(2);
+static constexpr auto phases_tm3 = phase_indices<192>(3);
+static constexpr auto phases_tm4 = phase_indices<768>(0);
+
 /* EN 300 401, Clause 14.3.2:
  * \phi_k = (\pi / 2) * (h_{i,k-k'} + n
  *
@@ -88,40 +149,6 @@ PhaseReference::PhaseReference(unsigned int dabmode, bool fixedPoint) :
 }
 
 
-static const int table[][48][2] = {
-    { // Mode 0/4
-        // Positive part
-        { 0, 0 }, { 3, 1 }, { 2, 0 }, { 1, 2 }, { 0, 0 }, { 3, 1 },
-        { 2, 2 }, { 1, 2 }, { 0, 2 }, { 3, 1 }, { 2, 3 }, { 1, 0 },
-        // Negative part
-        { 0, 0 }, { 1, 1 }, { 2, 1 }, { 3, 2 }, { 0, 2 }, { 1, 2 },
-        { 2, 0 }, { 3, 3 }, { 0, 3 }, { 1, 1 }, { 2, 3 }, { 3, 2 },
-    },
-    { // Mode 1
-        // Positive part
-        { 0, 3 }, { 3, 1 }, { 2, 1 }, { 1, 1 }, { 0, 2 }, { 3, 2 },
-        { 2, 1 }, { 1, 0 }, { 0, 2 }, { 3, 2 }, { 2, 3 }, { 1, 3 },
-        { 0, 0 }, { 3, 2 }, { 2, 1 }, { 1, 3 }, { 0, 3 }, { 3, 3 },
-        { 2, 3 }, { 1, 0 }, { 0, 3 }, { 3, 0 }, { 2, 1 }, { 1, 1 },
-        // Negative part
-        { 0, 1 }, { 1, 2 }, { 2, 0 }, { 3, 1 }, { 0, 3 }, { 1, 2 },
-        { 2, 2 }, { 3, 3 }, { 0, 2 }, { 1, 1 }, { 2, 2 }, { 3, 3 },
-        { 0, 1 }, { 1, 2 }, { 2, 3 }, { 3, 3 }, { 0, 2 }, { 1, 2 },
-        { 2, 2 }, { 3, 1 }, { 0, 1 }, { 1, 3 }, { 2, 1 }, { 3, 2 },
-    },
-    { // Mode 2
-        // Positive part
-        { 2, 0 }, { 1, 2 }, { 0, 2 }, { 3, 1 }, { 2, 0 }, { 1, 3 },
-        // Negative part
-        { 0, 2 }, { 1, 3 }, { 2, 2 }, { 3, 2 }, { 0, 1 }, { 1, 2 },
-    },
-    { // Mode 3
-        // Positive part
-        { 3, 2 }, { 2, 2 }, { 1, 2 },
-        // Negative part
-        { 0, 2 }, { 1, 3 }, { 2, 0 },
-    },
-};
 
 
 template <>
@@ -152,22 +179,43 @@ complexfix PhaseRefGen<complexfix>::convert(uint8_t data) {
 template <typename T>
 void PhaseRefGen<T>::fillData(unsigned int dabmode, size_t carriers)
 {
-    dataIn.resize(carriers);
-    if (dataIn.size() != carriers) {
+    const uint8_t *phases = nullptr;
+    size_t num_phases = 0;
+    switch (dabmode) {
+        case 1:
+            phases = phases_tm1.data();
+            num_phases = phases_tm1.size();
+            break;
+        case 2:
+            phases = phases_tm2.data();
+            num_phases = phases_tm2.size();
+            break;
+        case 3:
+            phases = phases_tm3.data();
+            num_phases = phases_tm3.size();
+            break;
+        case 0:
+            phases = phases_tm4.data();
+            num_phases = phases_tm4.size();
+            break;
+        default:
+            throw std::runtime_error(
+                    "PhaseReference::fillData DAB mode not valid!");
+    }
+
+    if (num_phases != carriers) {
         throw std::runtime_error(
                 "PhaseReference::fillData dataIn has incorrect size!");
     }
 
-    for (size_t index = 0,
-                offset = 0;
-                index < dataIn.size();
-                ++offset) {
-        for (size_t k = 0; k < 32; ++k) {
-            dataIn[index++] = convert(
-                    d_h[ table[dabmode][offset][0] ][k] +
-                    table[dabmode][offset][1] );
-        }
-    }
+    // Mode IV is 0 here
+    const std::string name = "phaseref-" + std::to_string(dabmode ? dabmode : 4) +
+        (std::is_same<T, complexf>::value ? "-cf32" : "-fixed");
+    dataIn = shared_tables::get<T>(name, carriers, [&](T *values) {
+            for (size_t i = 0; i < carriers; ++i) {
+                values[i] = convert(phases[i]);
+            }
+        });
 }
 
 
@@ -176,10 +224,10 @@ int PhaseReference::process(Buffer* dataOut)
     PDEBUG("PhaseReference::process(dataOut: %p)\n", dataOut);
 
     if (d_fixedPoint) {
-        dataOut->setData(d_phaseRefFixed.dataIn.data(), d_carriers * sizeof(complexfix));
+        dataOut->setData(d_phaseRefFixed.dataIn, d_carriers * sizeof(complexfix));
     }
     else {
-        dataOut->setData(d_phaseRefCF32.dataIn.data(), d_carriers * sizeof(complexf));
+        dataOut->setData(d_phaseRefCF32.dataIn, d_carriers * sizeof(complexf));
     }
 
     return 1;
@@ -37,7 +37,8 @@
 
 template <typename T>
 struct PhaseRefGen {
-    std::vector<T> dataIn;
+    // The carriers of the phase reference symbol, see shared_tables
+    const T *dataIn = nullptr;
     void fillData(unsigned int dabmode, size_t carriers);
 
     private:
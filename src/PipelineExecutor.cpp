@@ -0,0 +1,105 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PipelineExecutor.h"
+#include "Utils.h"
+#include "Log.h"
+
+#include <memory>
+
+using namespace std;
+
+static size_t s_configured_num_threads = 0;
+
+void PipelineExecutor::configure(size_t num_threads)
+{
+    s_configured_num_threads = num_threads;
+}
+
+PipelineExecutor* PipelineExecutor::shared()
+{
+    static unique_ptr<PipelineExecutor> executor(s_configured_num_threads ?
+            new PipelineExecutor(s_configured_num_threads) : nullptr);
+    return executor.get();
+}
+
+PipelineExecutor::PipelineExecutor(size_t num_threads)
+{
+    etiLog.level(info) << "PipelineExecutor: starting " << num_threads <<
+        " threads for the pipelined blocks";
+
+    for (size_t i = 0; i < num_threads; i++) {
+        m_threads.emplace_back(&PipelineExecutor::worker_thread, this, i);
+    }
+}
+
+PipelineExecutor::~PipelineExecutor()
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+
+    for (auto& t : m_threads) {
+        if (t.joinable()) {
+            t.join();
+        }
+    }
+}
+
+void PipelineExecutor::submit(int priority, function<void()>&& task)
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_tasks.push({priority, m_next_seq++, std::move(task)});
+    }
+    m_cv.notify_one();
+}
+
+void PipelineExecutor::worker_thread(size_t index)
+{
+    set_thread_name(("pipeline" + to_string(index)).c_str());
+
+    if (int ret = set_realtime_prio(1)) {
+        etiLog.level(warn) << "PipelineExecutor: could not set priority: " << ret;
+    }
+
+    set_thread_placement("pipeline");
+
+    while (true) {
+        function<void()> func;
+        {
+            unique_lock<mutex> lock(m_mutex);
+            m_cv.wait(lock, [&]{ return m_stop or not m_tasks.empty(); });
+            if (m_tasks.empty()) {
+                break;
+            }
+            // top() is const, the task is removed right after
+            func = std::move(const_cast<task_t&>(m_tasks.top()).func);
+            m_tasks.pop();
+        }
+
+        func();
+    }
+}
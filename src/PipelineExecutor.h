@@ -0,0 +1,89 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   Threads shared by all pipelined blocks of the process
+*/
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+/* Without it, every PipelinedModCodec runs in its own thread, which is
+ * idle most of the time. With several ensembles in the same process,
+ * the executor runs the frames of all pipelined blocks on a fixed number
+ * of threads instead. A block gives one task per frame, the tasks of
+ * the blocks closer to the output have a higher priority.
+ */
+class PipelineExecutor {
+    public:
+        /* Returns the executor shared by the whole process, or nullptr if
+         * configure() was not called with a number of threads, in which
+         * case the blocks keep their own thread. */
+        static PipelineExecutor* shared();
+
+        // Must be called before the first call to shared()
+        static void configure(size_t num_threads);
+
+        PipelineExecutor(size_t num_threads);
+        PipelineExecutor(const PipelineExecutor& other) = delete;
+        PipelineExecutor& operator=(const PipelineExecutor& other) = delete;
+        ~PipelineExecutor();
+
+        /* Run task in one of the threads. The tasks with the highest
+         * priority run first, and the ones with the same priority in the
+         * order they were submitted. */
+        void submit(int priority, std::function<void()>&& task);
+
+    private:
+        struct task_t {
+            int priority;
+            uint64_t seq;
+            std::function<void()> func;
+
+            bool operator<(const task_t& other) const {
+                if (priority != other.priority) {
+                    return priority < other.priority;
+                }
+                return seq > other.seq;
+            }
+        };
+
+        void worker_thread(size_t index);
+
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+        std::priority_queue<task_t> m_tasks;
+        uint64_t m_next_seq = 0;
+        bool m_stop = false;
+        std::vector<std::thread> m_threads;
+};
@@ -0,0 +1,621 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PolyphaseResampler.h"
+#include "FIRFilter.h"
+#include "PcDebug.h"
+#include "CpuFeatures.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+
+/* On x86, the AVX kernel is built with the target attribute of GCC and
+ * clang, and used if the CPU supports it. */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#    define HAVE_POLYPHASE_KERNEL_DISPATCH 1
+#endif
+
+#if defined(HAVE_POLYPHASE_KERNEL_DISPATCH) || defined(__SSE__) || defined(__SSE2__)
+#    include <immintrin.h>
+#elif defined(__ARM_NEON)
+#    include <arm_neon.h>
+#endif
+
+// Length of the low-pass in input or output samples, whichever rate is
+// lower. With the Kaiser window below, this gives a transition band of
+// about a fifth of that rate, centered on its Nyquist frequency.
+static const size_t LOWPASS_LENGTH = 24;
+
+// Kaiser window parameter for 80 dB of stopband attenuation
+static const double KAISER_BETA = 7.857;
+
+// Above this, the tables of coefficients get too large
+static const size_t MAX_PHASES = 4096;
+
+/* Zeroth order modified Bessel function of the first kind */
+static double bessel_i0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 50; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+        if (term < sum * 1e-12) {
+            break;
+        }
+    }
+    return sum;
+}
+
+/* The dot products of n floats of taps and interleaved complex samples,
+ * where n is a multiple of 16 and the taps are duplicated for the real and
+ * imaginary part. */
+static inline complexf dot_product_scalar(const float *c, const float *x, size_t n)
+{
+    float re0 = 0.0f, im0 = 0.0f, re1 = 0.0f, im1 = 0.0f;
+    for (size_t m = 0; m < n; m += 4) {
+        re0 += c[m] * x[m];
+        im0 += c[m + 1] * x[m + 1];
+        re1 += c[m + 2] * x[m + 2];
+        im1 += c[m + 3] * x[m + 3];
+    }
+    return complexf(re0 + re1, im0 + im1);
+}
+
+#if defined(__SSE__) || defined(__ARM_NEON)
+static inline complexf dot_product_simd(const float *c, const float *x, size_t n)
+{
+#if defined(__SSE__)
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    __m128 acc2 = _mm_setzero_ps();
+    __m128 acc3 = _mm_setzero_ps();
+    for (size_t m = 0; m < n; m += 16) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(c + m), _mm_loadu_ps(x + m)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(c + m + 4), _mm_loadu_ps(x + m + 4)));
+        acc2 = _mm_add_ps(acc2, _mm_mul_ps(_mm_loadu_ps(c + m + 8), _mm_loadu_ps(x + m + 8)));
+        acc3 = _mm_add_ps(acc3, _mm_mul_ps(_mm_loadu_ps(c + m + 12), _mm_loadu_ps(x + m + 12)));
+    }
+    __m128 sum = _mm_add_ps(_mm_add_ps(acc0, acc1), _mm_add_ps(acc2, acc3));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    float res[4];
+    _mm_storeu_ps(res, sum);
+    return complexf(res[0], res[1]);
+#elif defined(__ARM_NEON)
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    float32x4_t acc2 = vdupq_n_f32(0.0f);
+    float32x4_t acc3 = vdupq_n_f32(0.0f);
+    for (size_t m = 0; m < n; m += 16) {
+        acc0 = vmlaq_f32(acc0, vld1q_f32(c + m), vld1q_f32(x + m));
+        acc1 = vmlaq_f32(acc1, vld1q_f32(c + m + 4), vld1q_f32(x + m + 4));
+        acc2 = vmlaq_f32(acc2, vld1q_f32(c + m + 8), vld1q_f32(x + m + 8));
+        acc3 = vmlaq_f32(acc3, vld1q_f32(c + m + 12), vld1q_f32(x + m + 12));
+    }
+    const float32x4_t sum = vaddq_f32(vaddq_f32(acc0, acc1), vaddq_f32(acc2, acc3));
+    const float32x2_t res = vadd_f32(vget_low_f32(sum), vget_high_f32(sum));
+    return complexf(vget_lane_f32(res, 0), vget_lane_f32(res, 1));
+#endif
+}
+#endif
+
+#if defined(HAVE_POLYPHASE_KERNEL_DISPATCH)
+__attribute__((target("avx")))
+static inline complexf dot_product_avx(const float *c, const float *x, size_t n)
+{
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    for (size_t m = 0; m < n; m += 16) {
+        acc0 = _mm256_add_ps(acc0,
+                _mm256_mul_ps(_mm256_loadu_ps(c + m), _mm256_loadu_ps(x + m)));
+        acc1 = _mm256_add_ps(acc1,
+                _mm256_mul_ps(_mm256_loadu_ps(c + m + 8), _mm256_loadu_ps(x + m + 8)));
+    }
+    const __m256 acc = _mm256_add_ps(acc0, acc1);
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc),
+            _mm256_extractf128_ps(acc, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    float res[4];
+    _mm_storeu_ps(res, sum);
+    return complexf(res[0], res[1]);
+}
+#endif
+
+/* The position in the input of the next output sample: the newest input
+ * sample output n uses is number time / L, which makes the first one the
+ * filter uses buffer[time / L]. The phase is time % L. Both advance by M
+ * at every output sample. */
+struct polyphase_position_t {
+    size_t base;
+    size_t phase;
+    size_t base_step;
+    size_t phase_step;
+    size_t L;
+
+    void next() {
+        base += base_step;
+        phase += phase_step;
+        if (phase >= L) {
+            phase -= L;
+            base++;
+        }
+    }
+};
+
+/* The float kernels compute all output samples of a frame, so that the
+ * dot product gets inlined whichever one is selected. */
+using float_kernel_t = void (*)(const std::vector<float> *phases,
+        const float *x, size_t K, float *out, size_t num_out,
+        polyphase_position_t& pos);
+
+template <complexf (*dot)(const float*, const float*, size_t)>
+static void resample_float(const std::vector<float> *phases,
+        const float *x, size_t K, float *out, size_t num_out,
+        polyphase_position_t& pos)
+{
+    for (size_t n = 0; n < num_out; n++) {
+        const complexf res = dot(phases[pos.phase].data(), x + 2 * pos.base, 2 * K);
+        out[2 * n] = res.real();
+        out[2 * n + 1] = res.imag();
+        pos.next();
+    }
+}
+
+#if defined(HAVE_POLYPHASE_KERNEL_DISPATCH)
+__attribute__((target("avx")))
+static void resample_float_avx(const std::vector<float> *phases,
+        const float *x, size_t K, float *out, size_t num_out,
+        polyphase_position_t& pos)
+{
+    for (size_t n = 0; n < num_out; n++) {
+        const complexf res = dot_product_avx(phases[pos.phase].data(),
+                x + 2 * pos.base, 2 * K);
+        out[2 * n] = res.real();
+        out[2 * n + 1] = res.imag();
+        pos.next();
+    }
+}
+#endif
+
+static float_kernel_t select_float_kernel()
+{
+    auto& cpu = cpu_features();
+    float_kernel_t kernel = resample_float<dot_product_scalar>;
+    const char *name = "scalar";
+#if defined(HAVE_POLYPHASE_KERNEL_DISPATCH)
+    if (cpu.supports(cpu_feature_e::avx)) {
+        kernel = resample_float_avx;
+        name = "AVX";
+    }
+    else
+#endif
+#if defined(__SSE__)
+    if (cpu.supports(cpu_feature_e::sse2)) {
+        kernel = resample_float<dot_product_simd>;
+        name = "SSE";
+    }
+#elif defined(__ARM_NEON)
+    if (cpu.supports(cpu_feature_e::neon)) {
+        kernel = resample_float<dot_product_simd>;
+        name = "NEON";
+    }
+#endif
+    cpu.register_kernel("PolyphaseResampler", name);
+    return kernel;
+}
+
+static float_kernel_t float_kernel()
+{
+    static const float_kernel_t kernel = select_float_kernel();
+    return kernel;
+}
+
+/* The fixed-point dot products take the raw values of complexfix or
+ * complexfix_wide samples and K taps that are the raw values of complexfix,
+ * with 14 fractional bits, where K is a multiple of 8. The products are
+ * summed exactly, and the sum is rounded half up and saturated once, like
+ * the NEON vqrshrn instructions do. For complexfix, the sum fits into 32
+ * bits thanks to check_fixed_point(), and all versions give the same
+ * output. */
+static constexpr int fix_shift = 14;
+static constexpr int64_t fix_max_abs_sum = 65535;
+
+template <typename T>
+static T fix_round(int64_t acc)
+{
+    acc = (acc + (1 << (fix_shift - 1))) >> fix_shift;
+    return static_cast<T>(std::clamp<int64_t>(acc,
+                std::numeric_limits<T>::min(), std::numeric_limits<T>::max()));
+}
+
+static inline void dot_product(const int16_t *c, const int16_t *x,
+        size_t K, int16_t *out)
+{
+#if defined(__SSE2__)
+    // The samples get reordered to re, re, im, im, so that madd
+    // multiplies two real or two imaginary parts with two taps and adds
+    // the products.
+    __m128i acc0 = _mm_setzero_si128();
+    __m128i acc1 = _mm_setzero_si128();
+    for (size_t k = 0; k < K; k += 8) {
+        const __m128i t = _mm_loadu_si128(reinterpret_cast<const __m128i*>(c + k));
+        const __m128i x0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + 2 * k));
+        const __m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + 2 * k + 8));
+        const __m128i s0 = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x0, 0xD8), 0xD8);
+        const __m128i s1 = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x1, 0xD8), 0xD8);
+        acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(s0, _mm_unpacklo_epi32(t, t)));
+        acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(s1, _mm_unpackhi_epi32(t, t)));
+    }
+    __m128i acc = _mm_add_epi32(acc0, acc1);
+    acc = _mm_add_epi32(acc, _mm_srli_si128(acc, 8));
+    acc = _mm_srai_epi32(_mm_add_epi32(acc,
+                _mm_set1_epi32(1 << (fix_shift - 1))), fix_shift);
+    const int32_t res = _mm_cvtsi128_si32(_mm_packs_epi32(acc, acc));
+    memcpy(out, &res, sizeof(res));
+#elif defined(__ARM_NEON)
+    int32x4_t acc_re = vdupq_n_s32(0);
+    int32x4_t acc_im = vdupq_n_s32(0);
+    for (size_t k = 0; k < K; k += 8) {
+        const int16x8_t t = vld1q_s16(c + k);
+        const int16x8x2_t v = vld2q_s16(x + 2 * k);
+        acc_re = vmlal_s16(acc_re, vget_low_s16(v.val[0]), vget_low_s16(t));
+        acc_re = vmlal_s16(acc_re, vget_high_s16(v.val[0]), vget_high_s16(t));
+        acc_im = vmlal_s16(acc_im, vget_low_s16(v.val[1]), vget_low_s16(t));
+        acc_im = vmlal_s16(acc_im, vget_high_s16(v.val[1]), vget_high_s16(t));
+    }
+    const int32x2_t sum = vpadd_s32(
+            vadd_s32(vget_low_s32(acc_re), vget_high_s32(acc_re)),
+            vadd_s32(vget_low_s32(acc_im), vget_high_s32(acc_im)));
+    const int16x4_t res = vqrshrn_n_s32(vcombine_s32(sum, sum), fix_shift);
+    out[0] = vget_lane_s16(res, 0);
+    out[1] = vget_lane_s16(res, 1);
+#else
+    int32_t re = 0, im = 0;
+    for (size_t k = 0; k < K; k++) {
+        re += (int32_t)c[k] * x[2 * k];
+        im += (int32_t)c[k] * x[2 * k + 1];
+    }
+    out[0] = fix_round<int16_t>(re);
+    out[1] = fix_round<int16_t>(im);
+#endif
+}
+
+static inline void dot_product(const int16_t *c, const int32_t *x,
+        size_t K, int32_t *out)
+{
+#if defined(__ARM_NEON)
+    int64x2_t acc_re = vdupq_n_s64(0);
+    int64x2_t acc_im = vdupq_n_s64(0);
+    for (size_t k = 0; k < K; k += 4) {
+        const int32x4_t t = vmovl_s16(vld1_s16(c + k));
+        const int32x4x2_t v = vld2q_s32(x + 2 * k);
+        acc_re = vmlal_s32(acc_re, vget_low_s32(v.val[0]), vget_low_s32(t));
+        acc_re = vmlal_s32(acc_re, vget_high_s32(v.val[0]), vget_high_s32(t));
+        acc_im = vmlal_s32(acc_im, vget_low_s32(v.val[1]), vget_low_s32(t));
+        acc_im = vmlal_s32(acc_im, vget_high_s32(v.val[1]), vget_high_s32(t));
+    }
+    const int64x2_t sum = vcombine_s64(
+            vadd_s64(vget_low_s64(acc_re), vget_high_s64(acc_re)),
+            vadd_s64(vget_low_s64(acc_im), vget_high_s64(acc_im)));
+    const int32x2_t res = vqrshrn_n_s64(sum, fix_shift);
+    out[0] = vget_lane_s32(res, 0);
+    out[1] = vget_lane_s32(res, 1);
+#else
+    int64_t re = 0, im = 0;
+    for (size_t k = 0; k < K; k++) {
+        re += (int64_t)c[k] * x[2 * k];
+        im += (int64_t)c[k] * x[2 * k + 1];
+    }
+    out[0] = fix_round<int32_t>(re);
+    out[1] = fix_round<int32_t>(im);
+#endif
+}
+
+PolyphaseResampler::PolyphaseResampler(
+        size_t inputRate, size_t outputRate, const std::string& taps_file,
+        FFTEngine fftEngine) :
+    ModCodec(),
+    RemoteControllable("firfilter"),
+    m_fftEngine(fftEngine),
+    m_taps_file(taps_file)
+{
+    PDEBUG("PolyphaseResampler::PolyphaseResampler(%zu, %zu, %s) @ %p\n",
+            inputRate, outputRate, taps_file.c_str(), this);
+
+    const size_t divisor = std::gcd(inputRate, outputRate);
+    m_L = outputRate / divisor;
+    m_M = inputRate / divisor;
+
+    if (m_L > MAX_PHASES or m_M > MAX_PHASES) {
+        throw std::runtime_error("PolyphaseResampler: ratio " +
+                std::to_string(m_L) + "/" + std::to_string(m_M) +
+                " not supported, use the fft resampler");
+    }
+
+    m_lowpass = lowpass_filter(m_L, m_M);
+
+    if (m_taps_file.empty()) {
+        check_fixed_point(*m_lowpass);
+        m_filter = m_lowpass;
+    }
+    else {
+        RC_ADD_PARAMETER(ntaps, "(Read-only) number of filter taps.");
+        RC_ADD_PARAMETER(tapsfile, "Filename containing filter taps. When written to, the new file gets automatically loaded.");
+
+        load_filter_taps(m_taps_file);
+    }
+
+    etiLog.level(debug) << "PolyphaseResampler: " << m_L << "/" << m_M <<
+        " with " << m_filter->num_taps_per_phase << " taps per phase";
+}
+
+std::shared_ptr<const PolyphaseResampler::filter_t>
+PolyphaseResampler::make_filter(size_t L, std::vector<float>&& taps)
+{
+    auto filter = std::make_shared<filter_t>();
+
+    // Output sample n uses taps p + k*L on the input samples before it.
+    // Every phase gets the same length, padded with zeros to a multiple of
+    // eight samples for the dot product.
+    const size_t K = ((taps.size() + L - 1) / L + 7) / 8 * 8;
+    filter->num_taps_per_phase = K;
+    filter->phases.resize(L);
+    filter->phases_fix.resize(L);
+    filter->max_abs_sum_fix = 0;
+    for (size_t p = 0; p < L; p++) {
+        auto& phase = filter->phases[p];
+        auto& phase_fix = filter->phases_fix[p];
+        phase.resize(2 * K, 0.0f);
+        phase_fix.resize(K, 0);
+        int64_t abs_sum = 0;
+        for (size_t k = 0; k < K; k++) {
+            const size_t ix = p + k * L;
+            const float tap = ix < taps.size() ? taps[ix] : 0.0f;
+            phase[2 * (K - 1 - k)] = tap;
+            phase[2 * (K - 1 - k) + 1] = tap;
+
+            // Taps that do not fit make the sum too large
+            const long raw = lrint(tap * (1 << fix_shift));
+            phase_fix[K - 1 - k] = std::clamp<long>(raw,
+                    std::numeric_limits<int16_t>::min(),
+                    std::numeric_limits<int16_t>::max());
+            abs_sum += (phase_fix[K - 1 - k] == raw) ?
+                std::abs(raw) : fix_max_abs_sum + 1;
+        }
+        filter->max_abs_sum_fix = std::max(filter->max_abs_sum_fix, abs_sum);
+    }
+
+    filter->taps = std::move(taps);
+    return filter;
+}
+
+std::shared_ptr<const PolyphaseResampler::filter_t>
+PolyphaseResampler::lowpass_filter(size_t L, size_t M)
+{
+    static std::mutex cache_mutex;
+    static std::map<std::pair<size_t, size_t>,
+        std::weak_ptr<const filter_t> > cache;
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto filter = cache[{L, M}].lock();
+    if (filter) {
+        return filter;
+    }
+
+    // The cutoff is at the Nyquist frequency of the lower of both rates,
+    // in cycles per sample at the upsampled rate.
+    const size_t max_LM = std::max(L, M);
+    const double cutoff = 0.5 / max_LM;
+    const size_t len = LOWPASS_LENGTH * max_LM + 1;
+    const double centre = (len - 1) / 2.0;
+
+    std::vector<double> lowpass(len);
+    double sum = 0.0;
+    for (size_t n = 0; n < len; n++) {
+        const double t = n - centre;
+        const double sinc = (t == 0.0) ? 1.0 :
+            sin(2.0 * M_PI * cutoff * t) / (2.0 * M_PI * cutoff * t);
+        const double r = t / centre;
+        const double window = bessel_i0(KAISER_BETA * sqrt(1.0 - r * r)) /
+            bessel_i0(KAISER_BETA);
+        lowpass[n] = sinc * window;
+        sum += lowpass[n];
+    }
+
+    // Each phase sums to about one, which keeps the signal level
+    std::vector<float> taps(len);
+    for (size_t n = 0; n < len; n++) {
+        taps[n] = lowpass[n] * L / sum;
+    }
+
+    filter = make_filter(L, std::move(taps));
+    cache[{L, M}] = filter;
+    return filter;
+}
+
+void PolyphaseResampler::load_filter_taps(const std::string& taps_file)
+{
+    const auto fir_taps = FIRFilter::read_filter_taps(taps_file);
+
+    // The FIRFilter computes out[i] = sum_j in[i+j] * taps[j], which is a
+    // convolution with the reversed taps. At the upsampled rate, its taps
+    // are L samples apart.
+    const auto& lowpass = m_lowpass->taps;
+    const size_t num_fir = fir_taps.size();
+    std::vector<float> taps(lowpass.size() + m_L * (num_fir - 1), 0.0f);
+    for (size_t j = 0; j < num_fir; j++) {
+        const float fir_tap = fir_taps[num_fir - 1 - j];
+        float *t = &taps[j * m_L];
+        for (size_t n = 0; n < lowpass.size(); n++) {
+            t[n] += fir_tap * lowpass[n];
+        }
+    }
+    auto filter = make_filter(m_L, std::move(taps));
+    check_fixed_point(*filter);
+
+    std::lock_guard<std::mutex> lock(m_filter_mutex);
+    std::atomic_store(&m_filter, filter);
+    m_num_fir_taps = fir_taps.size();
+    m_taps_file = taps_file;
+}
+
+void PolyphaseResampler::check_fixed_point(const filter_t& filter) const
+{
+    if (m_fftEngine != FFTEngine::FFTW and
+            filter.max_abs_sum_fix > fix_max_abs_sum) {
+        throw std::runtime_error("PolyphaseResampler: the sum of the "
+                "magnitudes of the taps of a phase must be below 4 for the "
+                "fixed-point filter");
+    }
+}
+
+template <typename T>
+void PolyphaseResampler::resample(std::vector<T>& buffer,
+        const filter_t& filter, Buffer* const dataIn, Buffer* dataOut)
+{
+    const size_t K = filter.num_taps_per_phase;
+    const size_t num_in = dataIn->getLength() / (2 * sizeof(T));
+
+    // Keep the most recent input samples if the filter length changed
+    const size_t num_history = K - 1;
+    if (num_history > m_num_history) {
+        buffer.insert(buffer.begin(), 2 * (num_history - m_num_history), 0);
+    }
+    else if (num_history < m_num_history) {
+        buffer.erase(buffer.begin(),
+                buffer.begin() + 2 * (m_num_history - num_history));
+    }
+    m_num_history = num_history;
+
+    buffer.resize(2 * (num_history + num_in));
+    const T *in = reinterpret_cast<const T*>(dataIn->getData());
+    std::copy(in, in + 2 * num_in, buffer.begin() + 2 * num_history);
+
+    const size_t end_time = num_in * m_L;
+    const size_t num_out = (end_time > m_next_time) ?
+        (end_time - m_next_time + m_M - 1) / m_M : 0;
+    dataOut->setLength(num_out * 2 * sizeof(T));
+    T *out = reinterpret_cast<T*>(dataOut->getData());
+
+    polyphase_position_t pos = {m_next_time / m_L, m_next_time % m_L,
+        m_M / m_L, m_M % m_L, m_L};
+
+    if constexpr (std::is_same_v<T, float>) {
+        float_kernel()(filter.phases.data(), buffer.data(), K, out, num_out, pos);
+    }
+    else {
+        for (size_t n = 0; n < num_out; n++) {
+            dot_product(filter.phases_fix[pos.phase].data(),
+                    buffer.data() + 2 * pos.base, K, out + 2 * n);
+            pos.next();
+        }
+    }
+    m_next_time = pos.base * m_L + pos.phase - end_time;
+
+    // The last samples are the history of the next frame
+    std::copy(buffer.end() - 2 * num_history, buffer.end(), buffer.begin());
+    buffer.resize(2 * num_history);
+}
+
+int PolyphaseResampler::process(Buffer* const dataIn, Buffer* dataOut)
+{
+    PDEBUG("PolyphaseResampler::process(dataIn: %p, dataOut: %p)\n",
+            dataIn, dataOut);
+
+    // A reload only replaces m_filter, this frame keeps the filter it
+    // started with.
+    const auto filter = std::atomic_load(&m_filter);
+
+    switch (m_fftEngine) {
+        case FFTEngine::FFTW:
+            resample(m_buffer, *filter, dataIn, dataOut);
+            break;
+        case FFTEngine::KISS:
+        case FFTEngine::KISS_SIMD:
+            resample(m_buffer_fix, *filter, dataIn, dataOut);
+            break;
+        case FFTEngine::DEXTER:
+            resample(m_buffer_fix_wide, *filter, dataIn, dataOut);
+            break;
+    }
+
+    return dataOut->getLength();
+}
+
+void PolyphaseResampler::set_parameter(const std::string& parameter,
+        const std::string& value)
+{
+    if (parameter == "ntaps") {
+        throw ParameterError("Parameter 'ntaps' is read-only");
+    }
+    else if (parameter == "tapsfile") {
+        try {
+            load_filter_taps(value);
+        }
+        catch (const std::runtime_error &e) {
+            throw ParameterError(e.what());
+        }
+    }
+    else {
+        std::stringstream ss;
+        ss << "Parameter '" << parameter <<
+            "' is not exported by controllable " << get_rc_name();
+        throw ParameterError(ss.str());
+    }
+}
+
+const std::string PolyphaseResampler::get_parameter(
+        const std::string& parameter) const
+{
+    std::lock_guard<std::mutex> lock(m_filter_mutex);
+    std::stringstream ss;
+    if (parameter == "ntaps") {
+        ss << m_num_fir_taps;
+    }
+    else if (parameter == "tapsfile") {
+        ss << m_taps_file;
+    }
+    else {
+        ss << "Parameter '" << parameter <<
+            "' is not exported by controllable " << get_rc_name();
+        throw ParameterError(ss.str());
+    }
+    return ss.str();
+}
+
+const json::map_t PolyphaseResampler::get_all_values() const
+{
+    std::lock_guard<std::mutex> lock(m_filter_mutex);
+    json::map_t map;
+    map["ntaps"].v = m_num_fir_taps;
+    map["tapsfile"].v = m_taps_file;
+    return map;
+}
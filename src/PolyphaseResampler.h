@@ -0,0 +1,146 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   Rational resampler in the time domain, using a polyphase filter into
+   which the FIR filter taps can be folded.
+*/
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include "ConfigParser.h"
+#include "ModPlugin.h"
+#include "RemoteControl.h"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/* Resamples by L/M: conceptually, the input is upsampled by L, filtered
+ * with a Kaiser-windowed sinc low-pass and decimated by M. Only the
+ * outputs that are kept get computed, each with one of the L phases of the
+ * filter, which reads the input directly.
+ *
+ * If a FIR filter taps file is given, the FIR filter is convolved into the
+ * low-pass, which replaces the FIRFilter block in front of the resampler.
+ * The FIRFilter taps apply to the input rate. In that case, this block
+ * exports the ntaps and tapsfile parameters of the FIRFilter to the RC,
+ * under the same name.
+ *
+ * Unlike the FIRFilter, the filter is not cut off at the end of every
+ * frame, the state carries over to the next frame.
+ *
+ * With the fixed-point FFT engines, the samples are complexfix or
+ * complexfix_wide, and the filter is computed in integer arithmetic with
+ * the taps rounded to the format of complexfix.
+ */
+class PolyphaseResampler : public ModCodec, public RemoteControllable
+{
+public:
+    /* taps_file is empty if no FIR filter is folded in. */
+    PolyphaseResampler(size_t inputRate, size_t outputRate,
+            const std::string& taps_file = "",
+            FFTEngine fftEngine = FFTEngine::FFTW);
+    PolyphaseResampler(const PolyphaseResampler&) = delete;
+    PolyphaseResampler& operator=(const PolyphaseResampler&) = delete;
+
+    int process(Buffer* const dataIn, Buffer* dataOut) override;
+    const char* name() override { return "PolyphaseResampler"; }
+
+    /******* REMOTE CONTROL ********/
+    virtual void set_parameter(const std::string& parameter,
+            const std::string& value) override;
+    virtual const std::string get_parameter(
+            const std::string& parameter) const override;
+    virtual const json::map_t get_all_values() const override;
+
+private:
+    struct filter_t {
+        // The taps at the upsampled rate
+        std::vector<float> taps;
+
+        // Number of input samples every phase uses, a multiple of 8
+        size_t num_taps_per_phase;
+
+        // For every phase, the taps in the order of the input samples,
+        // each one twice, for the real and imaginary part.
+        std::vector<std::vector<float> > phases;
+
+        // The same taps as raw values of complexfix, once each, and the
+        // largest sum of their magnitudes over all phases.
+        std::vector<std::vector<int16_t> > phases_fix;
+        int64_t max_abs_sum_fix;
+    };
+
+    // Split the taps into the L phases
+    static std::shared_ptr<const filter_t> make_filter(
+            size_t L, std::vector<float>&& taps);
+
+    // The low-pass for a ratio, designed once and shared by all
+    // resamplers that use it.
+    static std::shared_ptr<const filter_t> lowpass_filter(size_t L, size_t M);
+
+    void load_filter_taps(const std::string& taps_file);
+
+    // Throws if the filter would overflow the fixed-point accumulators
+    void check_fixed_point(const filter_t& filter) const;
+
+    // T is the type of the real and imaginary parts of the samples
+    template <typename T>
+    void resample(std::vector<T>& buffer, const filter_t& filter,
+            Buffer* const dataIn, Buffer* dataOut);
+
+    size_t m_L;
+    size_t m_M;
+    FFTEngine m_fftEngine;
+
+    // The low-pass without the FIR filter
+    std::shared_ptr<const filter_t> m_lowpass;
+
+    // Protected by m_filter_mutex, which the processing never takes
+    mutable std::mutex m_filter_mutex;
+    std::string m_taps_file;
+    size_t m_num_fir_taps = 0;
+
+    // Only accessed with std::atomic_load() and std::atomic_store() once
+    // the processing has started.
+    std::shared_ptr<const filter_t> m_filter;
+
+    // The input samples of the previous frames still used by the filter,
+    // followed by the input of the current frame, as interleaved real and
+    // imaginary parts. Only the one for the format of the FFT engine
+    // is used.
+    std::vector<float> m_buffer;
+    std::vector<int16_t> m_buffer_fix;
+    std::vector<int32_t> m_buffer_fix_wide;
+    size_t m_num_history = 0;
+
+    // Position of the next output sample at the upsampled rate, relative
+    // to the first sample of the next input frame.
+    size_t m_next_time = 0;
+};
+
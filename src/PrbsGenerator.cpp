@@ -24,8 +24,21 @@
 
 #include <stdexcept>
 #include <string>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <cstring>
 #include <stdio.h>
 #include <stdlib.h>
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
+using sequence_key_t = std::tuple<size_t, uint32_t, uint32_t, size_t>;
+
+static std::mutex s_sequences_mutex;
+static std::map<sequence_key_t,
+    std::shared_ptr<const std::vector<uint8_t> > > s_sequences;
 
 
 PrbsGenerator::PrbsGenerator(size_t framesize, uint32_t polynomial,
@@ -40,8 +53,19 @@ PrbsGenerator::PrbsGenerator(size_t framesize, uint32_t polynomial,
     PDEBUG("PrbsGenerator::PrbsGenerator(%zu, %u, %u, %zu) @ %p\n",
             framesize, polynomial, accum, init, this);
 
-    gen_prbs_table();
-    gen_weight_table();
+    const sequence_key_t key(framesize, polynomial, accum, init);
+
+    std::lock_guard<std::mutex> lock(s_sequences_mutex);
+    auto& sequence = s_sequences[key];
+    if (not sequence) {
+        gen_prbs_table();
+        gen_weight_table();
+
+        auto s = std::make_shared<std::vector<uint8_t> >(d_framesize);
+        gen_sequence(*s);
+        sequence = s;
+    }
+    d_sequence = sequence;
 }
 
 
@@ -123,23 +147,8 @@ uint32_t PrbsGenerator::update_prbs()
 }
 
 
-int PrbsGenerator::process(
-        std::vector<Buffer*> dataIn,
-        std::vector<Buffer*> dataOut)
+void PrbsGenerator::gen_sequence(std::vector<uint8_t>& out)
 {
-    PDEBUG("PrbsGenerator::process(dataIn: %zu, dataOut: %zu)\n",
-            dataIn.size(), dataOut.size());
-    if (dataIn.size() > 1) {
-        throw std::runtime_error("Invalid dataIn size for PrbsGenerator " +
-                std::to_string(dataIn.size()));
-    }
-    if (dataOut.size() != 1) {
-        throw std::runtime_error("Invalid dataOut size for PrbsGenerator " +
-                std::to_string(dataOut.size()));
-    }
-    dataOut[0]->setLength(d_framesize);
-    unsigned char* out = reinterpret_cast<unsigned char*>(dataOut[0]->getData());
-
     // Initialization
     if (d_accum_init) {
         d_accum = d_accum_init;
@@ -168,19 +177,51 @@ int PrbsGenerator::process(
         }
         //PDEBUG("accum: 0x%x\n", d_accum);
     }
+}
+
+
+int PrbsGenerator::process(
+        std::vector<Buffer*> dataIn,
+        std::vector<Buffer*> dataOut)
+{
+    PDEBUG("PrbsGenerator::process(dataIn: %zu, dataOut: %zu)\n",
+            dataIn.size(), dataOut.size());
+    if (dataIn.size() > 1) {
+        throw std::runtime_error("Invalid dataIn size for PrbsGenerator " +
+                std::to_string(dataIn.size()));
+    }
+    if (dataOut.size() != 1) {
+        throw std::runtime_error("Invalid dataOut size for PrbsGenerator " +
+                std::to_string(dataOut.size()));
+    }
+    dataOut[0]->setLength(d_framesize);
+    uint8_t* out = reinterpret_cast<uint8_t*>(dataOut[0]->getData());
+    const uint8_t* prbs = d_sequence->data();
 
-    if (not dataIn.empty()) {
+    if (dataIn.empty()) {
+        memcpy(out, prbs, d_framesize);
+    }
+    else {
         PDEBUG(" mixing input\n");
-        const unsigned char* in =
-            reinterpret_cast<const unsigned char*>(dataIn[0]->getData());
+        const uint8_t* in =
+            reinterpret_cast<const uint8_t*>(dataIn[0]->getData());
 
         if (dataIn[0]->getLength() != dataOut[0]->getLength()) {
             PDEBUG("%zu != %zu\n", dataIn[0]->getLength(), dataOut[0]->getLength());
             throw std::runtime_error("PrbsGenerator::process "
                     "input size is not equal to output size!\n");
         }
-        for (size_t j = 0; j < dataOut[0]->getLength(); ++j) {
-            out[j] ^= in[j];
+
+        size_t j = 0;
+#ifdef __SSE2__
+        for (; j + 16 <= d_framesize; j += 16) {
+            const __m128i a = _mm_loadu_si128((const __m128i*)(in + j));
+            const __m128i b = _mm_loadu_si128((const __m128i*)(prbs + j));
+            _mm_storeu_si128((__m128i*)(out + j), _mm_xor_si128(a, b));
+        }
+#endif
+        for (; j < d_framesize; ++j) {
+            out[j] = in[j] ^ prbs[j];
         }
     }
 
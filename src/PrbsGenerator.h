@@ -33,10 +33,16 @@
 #include "ModPlugin.h"
 #include <sys/types.h>
 #include <stdint.h>
+#include <memory>
+#include <vector>
 
 /* The PrbsGenerator can work as a ModInput generating a Prbs
  * sequence from the given parameters only, or as a ModCodec
  * XORing incoming data with the PRBS
+ *
+ * The sequence restarts with every frame, and is therefore generated only
+ * once. All generators with the same parameters, e.g. all subchannels of
+ * the same size, share the same sequence.
  */
 class PrbsGenerator : public ModPlugin
 {
@@ -45,6 +51,7 @@ private:
     void gen_prbs_table();
     uint32_t update_prbs();
     void gen_weight_table();
+    void gen_sequence(std::vector<uint8_t>& sequence);
 
     size_t d_framesize;
     // table of matrix products used to update a 32-bit PRBS generator
@@ -58,6 +65,8 @@ private:
     uint32_t d_accum_init;
     // Initialization size
     size_t d_init;
+    // One frame of PRBS
+    std::shared_ptr<const std::vector<uint8_t> > d_sequence;
 
 public:
     PrbsGenerator(size_t framesize, uint32_t polynomial, uint32_t accum = 0,
@@ -65,6 +74,11 @@ public:
     virtual ~PrbsGenerator();
 
     int process(std::vector<Buffer*> dataIn, std::vector<Buffer*> dataOut);
+
+    /* The PRBS for one frame, d_framesize bytes long */
+    std::shared_ptr<const std::vector<uint8_t> > sequence() const {
+        return d_sequence;
+    }
     const char* name() { return "PrbsGenerator"; }
 };
 
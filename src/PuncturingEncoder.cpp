@@ -29,6 +29,10 @@
 #include <cstdio>
 #include <cstdint>
 #include <cassert>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <utility>
 
 #include "PuncturingEncoder.h"
 #include "PcDebug.h"
@@ -37,7 +41,8 @@ PuncturingEncoder::PuncturingEncoder() :
     ModCodec(),
     d_num_cu(0),
     d_in_block_size(0),
-    d_out_block_size(0)
+    d_out_block_size(0),
+    d_compiled(compile({}, nullptr))
 {
     PDEBUG("PuncturingEncoder() @ %p\n", this);
 }
@@ -47,32 +52,109 @@ PuncturingEncoder::PuncturingEncoder(
     ModCodec(),
     d_num_cu(num_cu),
     d_in_block_size(0),
-    d_out_block_size(0)
+    d_out_block_size(0),
+    d_compiled(compile({}, nullptr))
 {
     PDEBUG("PuncturingEncoder(%zu) @ %p\n", num_cu, this);
 }
 
-void PuncturingEncoder::adjust_item_size()
+std::shared_ptr<const PuncturingEncoder::compiled_rules_t>
+PuncturingEncoder::compile(
+        const std::vector<PuncturingRule>& rules,
+        const PuncturingRule* tail_rule)
 {
-    PDEBUG("PuncturingEncoder::adjust_item_size()\n");
-    int in_size = 0;
-    int out_size = 0;
-    int length = 0;
+    auto compiled = std::make_shared<compiled_rules_t>();
+    size_t in_size = 0;
+    size_t out_size = 0;
 
-    for (const auto& rule : d_rules) {
-        for (length = rule.length(); length > 0; length -= 4) {
+    for (const auto& rule : rules) {
+        for (int length = rule.length(); length > 0; length -= 4) {
             out_size += rule.bit_size();
             in_size += 4;
         }
     }
 
-    if (d_tail_rule) {
-        in_size += d_tail_rule->length();
-        out_size += d_tail_rule->bit_size();
+    if (tail_rule) {
+        in_size += tail_rule->length();
+        out_size += tail_rule->bit_size();
+    }
+
+    compiled->in_block_size = in_size;
+    compiled->out_block_size = (out_size + 7) / 8;
+
+    const auto& table = PuncturingTable::get();
+    auto compile_rule = [&](size_t num_bytes, uint32_t pattern) {
+        compiled_rule_t c;
+        c.num_bytes = num_bytes;
+        for (int k = 0; k < 4; k++) {
+            const uint8_t pattern_byte = pattern >> (24 - 8 * k);
+            c.rows[k] = table.row(pattern_byte);
+            c.widths[k] = __builtin_popcount(pattern_byte);
+        }
+        return c;
+    };
+
+    for (const auto& rule : rules) {
+        compiled->rules.push_back(
+                compile_rule((rule.length() + 3) / 4 * 4, rule.pattern()));
+    }
+
+    if (tail_rule) {
+        // The tail pattern only has 24 bits, the following bytes are
+        // all punctured.
+        compiled->tail_length = tail_rule->length();
+        compiled->tail = compile_rule(
+                tail_rule->length(), tail_rule->pattern() << 8);
     }
 
-    d_in_block_size = in_size;
-    d_out_block_size = (out_size + 7) / 8;
+    return compiled;
+}
+
+PuncturingEncoder::PuncturingEncoder(
+        size_t num_cu,
+        const std::vector<PuncturingRule>& rules,
+        const PuncturingRule& tail_rule) :
+    ModCodec(),
+    d_num_cu(num_cu),
+    d_rules(rules),
+    d_tail_rule(new PuncturingRule(tail_rule))
+{
+    PDEBUG("PuncturingEncoder(%zu, %zu rules) @ %p\n",
+            num_cu, rules.size(), this);
+
+    /* The compiled rules of every profile, identified by the length and
+     * the pattern of all the rules, the tail rule last */
+    using rules_key_t = std::vector<std::pair<size_t, uint32_t> >;
+    static std::mutex s_compiled_mutex;
+    static std::map<rules_key_t,
+        std::shared_ptr<const compiled_rules_t> > s_compiled;
+
+    rules_key_t key;
+    for (const auto& rule : rules) {
+        key.emplace_back(rule.length(), rule.pattern());
+    }
+    key.emplace_back(tail_rule.length(), tail_rule.pattern());
+
+    {
+        std::lock_guard<std::mutex> lock(s_compiled_mutex);
+        auto& compiled = s_compiled[key];
+        if (not compiled) {
+            compiled = compile(d_rules, d_tail_rule.get());
+        }
+        d_compiled = compiled;
+    }
+
+    d_in_block_size = d_compiled->in_block_size;
+    d_out_block_size = d_compiled->out_block_size;
+}
+
+void PuncturingEncoder::adjust_item_size()
+{
+    PDEBUG("PuncturingEncoder::adjust_item_size()\n");
+
+    d_compiled = compile(d_rules, d_tail_rule.get());
+    d_in_block_size = d_compiled->in_block_size;
+    d_out_block_size = d_compiled->out_block_size;
 
     PDEBUG(" Puncturing encoder ratio (out/in): %zu / %zu\n",
             d_out_block_size, d_in_block_size);
@@ -106,12 +188,8 @@ int PuncturingEncoder::process(Buffer* const dataIn, Buffer* dataOut)
             dataIn, dataOut);
     size_t in_count = 0;
     size_t out_count = 0;
-    size_t bit_count = 0;
-    size_t length;
-    unsigned char data;
-    uint32_t mask;
-    uint32_t pattern;
-    auto rule_it = d_rules.begin();
+    const auto& compiled_rules = d_compiled->rules;
+    auto rule_it = compiled_rules.begin();
     PDEBUG(" in block size: %zu\n", d_in_block_size);
     PDEBUG(" out block size: %zu\n", d_out_block_size);
 
@@ -140,60 +218,36 @@ int PuncturingEncoder::process(Buffer* const dataIn, Buffer* dataOut)
                 "PuncturingEncoder::process wrong input size");
     }
 
-    if (d_tail_rule) {
-        d_in_block_size -= d_tail_rule->length();
-    }
-    while (in_count < d_in_block_size) {
-        for (length = rule_it->length(); length > 0; length -= 4) {
-            mask = 0x80000000;
-            pattern = rule_it->pattern();
-            for (int i = 0; i < 4; ++i) {
-                data = in[in_count++];
-                for (int j = 0; j < 8; ++j) {
-                    if (pattern & mask) {
-                        out[out_count] <<= 1;
-                        out[out_count] |= data >> 7;
-                        if (++bit_count == 8) {
-                            bit_count = 0;
-                            ++out_count;
-                        }
-                    }
-                    data <<= 1;
-                    mask >>= 1;
-                }
+    uint64_t acc = 0;
+    unsigned num_bits = 0;
+    auto puncture = [&](const compiled_rule_t& rule, size_t num_bytes) {
+        for (size_t n = 0; n < num_bytes; n += 4) {
+            for (size_t k = 0; k < 4 and n + k < num_bytes; k++) {
+                acc = (acc << rule.widths[k]) | rule.rows[k][in[in_count++]];
+                num_bits += rule.widths[k];
+            }
+
+            while (num_bits >= 8) {
+                num_bits -= 8;
+                out[out_count++] = acc >> num_bits;
             }
         }
-        if (++rule_it == d_rules.end()) {
-            rule_it = d_rules.begin();
+    };
+
+    const size_t tail_length = d_compiled->tail_length;
+    while (in_count < d_in_block_size - tail_length) {
+        puncture(*rule_it, rule_it->num_bytes);
+        if (++rule_it == compiled_rules.end()) {
+            rule_it = compiled_rules.begin();
         }
     }
-    if (d_tail_rule) {
-        d_in_block_size += d_tail_rule->length();
-        mask = 0x800000;
-        pattern = d_tail_rule->pattern();
-        length = d_tail_rule->length();
-        for (size_t i = 0; i < length; ++i) {
-            data = in[in_count++];
-            for (int j = 0; j < 8; ++j) {
-                if (pattern & mask) {
-                    out[out_count] <<= 1;
-                    out[out_count] |= data >> 7;
-                    if (++bit_count == 8) {
-                        bit_count = 0;
-                        ++out_count;
-                    }
-                }
-                data <<= 1;
-                mask >>= 1;
-            }
-        }
+    if (tail_length) {
+        const size_t num_bytes = std::min<size_t>(tail_length, 4);
+        puncture(d_compiled->tail, num_bytes);
+        in_count += tail_length - num_bytes;
     }
-    while (bit_count) {
-        out[out_count] <<= 1;
-        if (++bit_count == 8) {
-            bit_count = 0;
-            ++out_count;
-        }
+    if (num_bits) {
+        out[out_count++] = acc << (8 - num_bits);
     }
 
     for (size_t i = out_count; i < dataOut->getLength(); ++i) {
@@ -56,6 +56,15 @@ public:
      */
     PuncturingEncoder(size_t num_cu);
 
+    /* Initialise a puncturer with all its rules, followed by the tail
+     * rule, as with append_rule() and append_tail_rule(). The compiled
+     * rules are kept in a cache, and shared by all the puncturers with
+     * the same rules, including the ones of a later reconfiguration.
+     * num_cu is 0 for the FIC. */
+    PuncturingEncoder(size_t num_cu,
+            const std::vector<PuncturingRule>& rules,
+            const PuncturingRule& tail_rule);
+
     void append_rule(const PuncturingRule& rule);
     void append_tail_rule(const PuncturingRule& rule);
     int process(Buffer* const dataIn, Buffer* dataOut);
@@ -73,6 +82,28 @@ private:
     // on boost::optional here
     std::unique_ptr<PuncturingRule> d_tail_rule;
 
+    /* The rules compiled to lookups in the PuncturingTable: every byte
+     * of a pattern selects a table row, and the number of bits it keeps */
+    struct compiled_rule_t {
+        size_t num_bytes;
+        const uint8_t* rows[4];
+        unsigned widths[4];
+    };
+
+    struct compiled_rules_t {
+        size_t in_block_size = 0;
+        size_t out_block_size = 0;
+        std::vector<compiled_rule_t> rules;
+        size_t tail_length = 0; // 0 without tail rule
+        compiled_rule_t tail;
+    };
+
+    static std::shared_ptr<const compiled_rules_t> compile(
+            const std::vector<PuncturingRule>& rules,
+            const PuncturingRule* tail_rule);
+
+    // Never modified once compiled
+    std::shared_ptr<const compiled_rules_t> d_compiled;
+
     void adjust_item_size();
 };
-
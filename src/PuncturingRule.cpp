@@ -40,3 +40,24 @@ size_t PuncturingRule::bit_size() const
     }
     return bits;
 }
+
+const PuncturingTable& PuncturingTable::get()
+{
+    static const PuncturingTable table;
+    return table;
+}
+
+PuncturingTable::PuncturingTable()
+{
+    for (size_t pattern = 0; pattern < 256; pattern++) {
+        for (size_t data = 0; data < 256; data++) {
+            uint8_t bits = 0;
+            for (int j = 7; j >= 0; j--) {
+                if (pattern & (1 << j)) {
+                    bits = (bits << 1) | ((data >> j) & 1);
+                }
+            }
+            kept[pattern][data] = bits;
+        }
+    }
+}
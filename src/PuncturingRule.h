@@ -44,3 +44,18 @@ private:
     uint32_t d_pattern;
 };
 
+/* For every 8-bit puncturing pattern and every data byte, the data bits
+ * selected by the pattern, MSB first, packed into the low bits. */
+class PuncturingTable
+{
+public:
+    static const PuncturingTable& get();
+
+    const uint8_t* row(uint8_t pattern) const { return kept[pattern]; }
+
+private:
+    PuncturingTable();
+
+    uint8_t kept[256][256];
+};
+
@@ -30,32 +30,19 @@
 
 #include "QpskSymbolMapper.h"
 #include "PcDebug.h"
-
-QpskSymbolMapper::QpskSymbolMapper(size_t carriers, bool fixedPoint) :
-    ModCodec(),
-    m_fixedPoint(fixedPoint),
-    m_carriers(carriers) { }
-
-int QpskSymbolMapper::process(Buffer* const dataIn, Buffer* dataOut)
-{
-    PDEBUG("QpskSymbolMapper::process"
-            "(dataIn: %p, dataOut: %p)\n",
-            dataIn, dataOut);
-
-    // 4 output complex symbols per input byte
-
-    if (m_fixedPoint) {
-        dataOut->setLength(dataIn->getLength() * 4 * sizeof(complexfix));
-
+#include "DabModeKernels.h"
+
+/* The kernels map the bits of each OFDM symbol, the first half of its
+ * bytes giving the real parts and the second half the imaginary parts,
+ * to 4 complex symbols per input byte. */
+template<size_t C>
+struct qpsk_fix_kernel {
+    static void process(const uint8_t* in, size_t sizeIn, void* dataOut,
+            size_t num_carriers)
+    {
+        const size_t carriers = kernel_carriers<C>(num_carriers);
         using fixed_t = complexfix::value_type;
-
-        const uint8_t* in = reinterpret_cast<const uint8_t*>(dataIn->getData());
-        fixed_t* out = reinterpret_cast<fixed_t*>(dataOut->getData());
-
-        if (dataIn->getLength() % (m_carriers / 4) != 0) {
-            throw std::runtime_error(
-                    "QpskSymbolMapper::process input size not valid!");
-        }
+        fixed_t* out = reinterpret_cast<fixed_t*>(dataOut);
 
         constexpr fixed_t v = static_cast<fixed_t>(M_SQRT1_2);
 
@@ -80,39 +67,36 @@ int QpskSymbolMapper::process(Buffer* const dataIn, Buffer* dataOut)
         size_t inOffset = 0;
         size_t outOffset = 0;
         uint8_t tmp;
-        for (size_t i = 0; i < dataIn->getLength(); i += m_carriers / 4) {
-            for (size_t j = 0; j < m_carriers / 8; ++j) {
+        for (size_t i = 0; i < sizeIn; i += carriers / 4) {
+            for (size_t j = 0; j < carriers / 8; ++j) {
                 tmp =  (in[inOffset] & 0xc0) >> 4;
-                tmp |= (in[inOffset + (m_carriers / 8)] & 0xc0) >> 6;
+                tmp |= (in[inOffset + (carriers / 8)] & 0xc0) >> 6;
                 memcpy(&out[outOffset], symbols[tmp], sizeof(fixed_t) * 4);
                 tmp =  (in[inOffset] & 0x30) >> 2;
-                tmp |= (in[inOffset + (m_carriers / 8)] & 0x30) >> 4;
+                tmp |= (in[inOffset + (carriers / 8)] & 0x30) >> 4;
                 memcpy(&out[outOffset + 4], symbols[tmp], sizeof(fixed_t) * 4);
                 tmp =  (in[inOffset] & 0x0c);
-                tmp |= (in[inOffset + (m_carriers / 8)] & 0x0c) >> 2;
+                tmp |= (in[inOffset + (carriers / 8)] & 0x0c) >> 2;
                 memcpy(&out[outOffset + 8], symbols[tmp], sizeof(fixed_t) * 4);
                 tmp =  (in[inOffset] & 0x03) << 2;
-                tmp |= (in[inOffset + (m_carriers / 8)] & 0x03);
+                tmp |= (in[inOffset + (carriers / 8)] & 0x03);
                 memcpy(&out[outOffset + 12], symbols[tmp], sizeof(fixed_t) * 4);
                 ++inOffset;
                 outOffset += 4*4;
             }
-            inOffset += m_carriers / 8;
+            inOffset += carriers / 8;
         }
     }
-    else {
-        dataOut->setLength(dataIn->getLength() * 4 * sizeof(complexf));
+};
+
+template<size_t C>
+struct qpsk_float_kernel {
+    static void process(const uint8_t* in, size_t sizeIn, void* dataOut,
+            size_t num_carriers)
+    {
+        const size_t carriers = kernel_carriers<C>(num_carriers);
 #ifdef __SSE__
-        const uint8_t* in = reinterpret_cast<const uint8_t*>(dataIn->getData());
-        __m128* out = reinterpret_cast<__m128*>(dataOut->getData());
-
-        if (dataIn->getLength() % (m_carriers / 4) != 0) {
-            throw std::runtime_error(
-                    "QpskSymbolMapper::process input size not valid: " +
-                    std::to_string(dataIn->getLength()) +
-                    "(input size) % (" + std::to_string(m_carriers) +
-                    " (carriers) / 4) != 0");
-        }
+        __m128* out = reinterpret_cast<__m128*>(dataOut);
 
         const static __m128 symbols[16] = {
             _mm_setr_ps( M_SQRT1_2,  M_SQRT1_2,  M_SQRT1_2,  M_SQRT1_2),
@@ -135,36 +119,27 @@ int QpskSymbolMapper::process(Buffer* const dataIn, Buffer* dataOut)
         size_t inOffset = 0;
         size_t outOffset = 0;
         uint8_t tmp = 0;
-        for (size_t i = 0; i < dataIn->getLength(); i += m_carriers / 4) {
-            for (size_t j = 0; j < m_carriers / 8; ++j) {
+        for (size_t i = 0; i < sizeIn; i += carriers / 4) {
+            for (size_t j = 0; j < carriers / 8; ++j) {
                 tmp =  (in[inOffset] & 0xc0) >> 4;
-                tmp |= (in[inOffset + (m_carriers / 8)] & 0xc0) >> 6;
+                tmp |= (in[inOffset + (carriers / 8)] & 0xc0) >> 6;
                 out[outOffset] = symbols[tmp];
                 tmp =  (in[inOffset] & 0x30) >> 2;
-                tmp |= (in[inOffset + (m_carriers / 8)] & 0x30) >> 4;
+                tmp |= (in[inOffset + (carriers / 8)] & 0x30) >> 4;
                 out[outOffset + 1] = symbols[tmp];
                 tmp =  (in[inOffset] & 0x0c);
-                tmp |= (in[inOffset + (m_carriers / 8)] & 0x0c) >> 2;
+                tmp |= (in[inOffset + (carriers / 8)] & 0x0c) >> 2;
                 out[outOffset + 2] = symbols[tmp];
                 tmp =  (in[inOffset] & 0x03) << 2;
-                tmp |= (in[inOffset + (m_carriers / 8)] & 0x03);
+                tmp |= (in[inOffset + (carriers / 8)] & 0x03);
                 out[outOffset + 3] = symbols[tmp];
                 ++inOffset;
                 outOffset += 4;
             }
-            inOffset += m_carriers / 8;
+            inOffset += carriers / 8;
         }
 #else // !__SSE__
-        const uint8_t* in = reinterpret_cast<const uint8_t*>(dataIn->getData());
-        float* out = reinterpret_cast<float*>(dataOut->getData());
-        if (dataIn->getLength() % (m_carriers / 4) != 0) {
-            throw std::runtime_error(
-                    "QpskSymbolMapper::process input size not valid!");
-        }
-        if (dataOut->getLength() / sizeof(float) != dataIn->getLength() * 4 * 2) {    // 4 output complex symbols per input byte
-            throw std::runtime_error(
-                    "QpskSymbolMapper::process output size not valid!");
-        }
+        float* out = reinterpret_cast<float*>(dataOut);
 
         const static float symbols[16][4] = {
             { M_SQRT1_2,  M_SQRT1_2,  M_SQRT1_2,  M_SQRT1_2},
@@ -187,28 +162,57 @@ int QpskSymbolMapper::process(Buffer* const dataIn, Buffer* dataOut)
         size_t inOffset = 0;
         size_t outOffset = 0;
         uint8_t tmp;
-        for (size_t i = 0; i < dataIn->getLength(); i += m_carriers / 4) {
-            for (size_t j = 0; j < m_carriers / 8; ++j) {
+        for (size_t i = 0; i < sizeIn; i += carriers / 4) {
+            for (size_t j = 0; j < carriers / 8; ++j) {
                 tmp =  (in[inOffset] & 0xc0) >> 4;
-                tmp |= (in[inOffset + (m_carriers / 8)] & 0xc0) >> 6;
+                tmp |= (in[inOffset + (carriers / 8)] & 0xc0) >> 6;
                 memcpy(&out[outOffset], symbols[tmp], sizeof(float) * 4);
                 tmp =  (in[inOffset] & 0x30) >> 2;
-                tmp |= (in[inOffset + (m_carriers / 8)] & 0x30) >> 4;
+                tmp |= (in[inOffset + (carriers / 8)] & 0x30) >> 4;
                 memcpy(&out[outOffset + 4], symbols[tmp], sizeof(float) * 4);
                 tmp =  (in[inOffset] & 0x0c);
-                tmp |= (in[inOffset + (m_carriers / 8)] & 0x0c) >> 2;
+                tmp |= (in[inOffset + (carriers / 8)] & 0x0c) >> 2;
                 memcpy(&out[outOffset + 8], symbols[tmp], sizeof(float) * 4);
                 tmp =  (in[inOffset] & 0x03) << 2;
-                tmp |= (in[inOffset + (m_carriers / 8)] & 0x03);
+                tmp |= (in[inOffset + (carriers / 8)] & 0x03);
                 memcpy(&out[outOffset + 12], symbols[tmp], sizeof(float) * 4);
                 ++inOffset;
                 outOffset += 4*4;
             }
-            inOffset += m_carriers / 8;
+            inOffset += carriers / 8;
         }
 #endif // __SSE__
     }
+};
+
+QpskSymbolMapper::QpskSymbolMapper(size_t carriers, bool fixedPoint) :
+    ModCodec(),
+    m_fixedPoint(fixedPoint),
+    m_carriers(carriers),
+    m_kernel(fixedPoint ?
+            select_carriers_kernel<qpsk_fix_kernel>(carriers) :
+            select_carriers_kernel<qpsk_float_kernel>(carriers)) { }
+
+int QpskSymbolMapper::process(Buffer* const dataIn, Buffer* dataOut)
+{
+    PDEBUG("QpskSymbolMapper::process"
+            "(dataIn: %p, dataOut: %p)\n",
+            dataIn, dataOut);
+
+    if (dataIn->getLength() % (m_carriers / 4) != 0) {
+        throw std::runtime_error(
+                "QpskSymbolMapper::process input size not valid: " +
+                std::to_string(dataIn->getLength()) +
+                "(input size) % (" + std::to_string(m_carriers) +
+                " (carriers) / 4) != 0");
+    }
+
+    // 4 output complex symbols per input byte
+    dataOut->setLength(dataIn->getLength() * 4 *
+            (m_fixedPoint ? sizeof(complexfix) : sizeof(complexf)));
+
+    m_kernel(reinterpret_cast<const uint8_t*>(dataIn->getData()),
+            dataIn->getLength(), dataOut->getData(), m_carriers);
 
     return 1;
 }
-
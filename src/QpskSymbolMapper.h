@@ -39,5 +39,10 @@ public:
 protected:
     bool m_fixedPoint;
     size_t m_carriers;
+
+    // The kernel for the number of carriers of the mode
+    using kernel_t = void (*)(const uint8_t* in, size_t sizeIn,
+            void* dataOut, size_t carriers);
+    kernel_t m_kernel;
 };
 
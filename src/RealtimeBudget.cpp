@@ -0,0 +1,239 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "RealtimeBudget.h"
+#include "Events.h"
+#include "Log.h"
+
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+RealtimeBudget::RealtimeBudget(chrono::milliseconds frame_duration,
+        float high, float low, size_t window, size_t recovery) :
+    RemoteControllable("rtbudget"),
+    m_frame_duration(chrono::duration<double>(frame_duration).count()),
+    m_high(high),
+    m_low(low),
+    m_window(window),
+    m_recovery(recovery)
+{
+    if (window == 0 or not (low < high)) {
+        throw invalid_argument("RealtimeBudget: invalid settings");
+    }
+
+    RC_ADD_PARAMETER(enabled, "1 to degrade the processing when the modulator falls behind, 0 also undoes all steps");
+    RC_ADD_PARAMETER(load, "(Read-only) Average processing time of the last frames, relative to their duration");
+    RC_ADD_PARAMETER(level, "(Read-only) Number of degradation steps applied");
+    RC_ADD_PARAMETER(steps, "(Read-only) Degradation steps, in the order they are applied");
+    RC_ADD_PARAMETER(transitions, "(Read-only) Number of steps applied or undone since the start");
+}
+
+void RealtimeBudget::add_step(const string& name,
+        RemoteControllable *controllable,
+        const string& parameter, const string& value)
+{
+    lock_guard<mutex> lock(m_mutex);
+    if (m_steps.empty() or m_steps.back().name != name) {
+        step_t step;
+        step.name = name;
+        m_steps.push_back(step);
+    }
+
+    action_t action;
+    action.controllable = controllable;
+    action.parameter = parameter;
+    action.value = value;
+    m_steps.back().actions.push_back(action);
+}
+
+void RealtimeBudget::frame_processed(chrono::steady_clock::duration duration)
+{
+    const double load = chrono::duration<double>(duration).count() /
+        m_frame_duration;
+
+    lock_guard<mutex> lock(m_mutex);
+    if (not m_enabled) {
+        return;
+    }
+
+    m_loads.push_back(load);
+    m_loads_sum += load;
+    if (m_loads.size() > m_window) {
+        m_loads_sum -= m_loads.front();
+        m_loads.pop_front();
+    }
+
+    if (m_loads.size() < m_window) {
+        return;
+    }
+
+    const double average = m_loads_sum / m_loads.size();
+    if (average > (double)m_high) {
+        m_frames_below = 0;
+        if (m_level < m_steps.size()) {
+            degrade(average);
+        }
+    }
+    else if (average < (double)m_low and m_level > 0) {
+        m_frames_below++;
+        if (m_frames_below >= m_recovery) {
+            recover(average);
+        }
+    }
+    else {
+        m_frames_below = 0;
+    }
+}
+
+void RealtimeBudget::degrade(double load)
+{
+    auto& step = m_steps[m_level];
+    for (auto& action : step.actions) {
+        try {
+            action.restore_value =
+                action.controllable->get_parameter(action.parameter);
+            action.controllable->set_parameter(action.parameter, action.value);
+        }
+        catch (const ParameterError& e) {
+            etiLog.level(error) << "Real-time budget: cannot set " <<
+                action.controllable->get_rc_name() << "." << action.parameter <<
+                ": " << e.what();
+        }
+    }
+    m_level++;
+
+    etiLog.level(warn) << "Real-time budget: processing takes " <<
+        (int)(load * 100) << "% of the frame duration, step " << step.name <<
+        " applied";
+    send_transition("degrade", step, load);
+}
+
+void RealtimeBudget::recover(double load)
+{
+    m_level--;
+    auto& step = m_steps[m_level];
+    for (auto it = step.actions.rbegin(); it != step.actions.rend(); ++it) {
+        try {
+            it->controllable->set_parameter(it->parameter, it->restore_value);
+        }
+        catch (const ParameterError& e) {
+            etiLog.level(error) << "Real-time budget: cannot restore " <<
+                it->controllable->get_rc_name() << "." << it->parameter <<
+                ": " << e.what();
+        }
+    }
+
+    etiLog.level(info) << "Real-time budget: processing takes " <<
+        (int)(load * 100) << "% of the frame duration, step " << step.name <<
+        " undone";
+    send_transition("recover", step, load);
+}
+
+void RealtimeBudget::send_transition(const string& transition,
+        const step_t& step, double load)
+{
+    m_num_transitions++;
+    m_loads.clear();
+    m_loads_sum = 0;
+    m_frames_below = 0;
+
+#if defined(HAVE_ZEROMQ)
+    json::map_t detail;
+    detail["transition"].v = transition;
+    detail["step"].v = step.name;
+    detail["level"].v = m_level;
+    detail["load"].v = load;
+    events.send("rtbudget", detail);
+#endif
+}
+
+void RealtimeBudget::set_parameter(const string& parameter, const string& value)
+{
+    stringstream ss(value);
+    ss.exceptions ( stringstream::failbit | stringstream::badbit );
+
+    if (parameter == "enabled") {
+        int enabled = 0;
+        ss >> enabled;
+
+        lock_guard<mutex> lock(m_mutex);
+        m_enabled = enabled != 0;
+        if (not m_enabled) {
+            while (m_level > 0) {
+                recover(0);
+            }
+        }
+        m_loads.clear();
+        m_loads_sum = 0;
+    }
+    else {
+        stringstream ss_err;
+        ss_err << "Parameter '" << parameter
+            << "' is read-only or not exported by controllable " << get_rc_name();
+        throw ParameterError(ss_err.str());
+    }
+}
+
+const string RealtimeBudget::get_parameter(const string& parameter) const
+{
+    lock_guard<mutex> lock(m_mutex);
+    stringstream ss;
+    if (parameter == "enabled") {
+        ss << (m_enabled ? 1 : 0);
+    }
+    else if (parameter == "load") {
+        ss << (m_loads.empty() ? 0.0 : m_loads_sum / m_loads.size());
+    }
+    else if (parameter == "level") {
+        ss << m_level;
+    }
+    else if (parameter == "steps") {
+        for (size_t i = 0; i < m_steps.size(); i++) {
+            ss << (i > 0 ? "," : "") << m_steps[i].name;
+        }
+    }
+    else if (parameter == "transitions") {
+        ss << m_num_transitions;
+    }
+    else {
+        ss << "Parameter '" << parameter <<
+            "' is not exported by controllable " << get_rc_name();
+        throw ParameterError(ss.str());
+    }
+    return ss.str();
+}
+
+const json::map_t RealtimeBudget::get_all_values() const
+{
+    json::map_t map;
+    map["steps"].v = get_parameter("steps");
+
+    lock_guard<mutex> lock(m_mutex);
+    map["enabled"].v = m_enabled;
+    map["load"].v = m_loads.empty() ? 0.0 : m_loads_sum / m_loads.size();
+    map["level"].v = m_level;
+    map["transitions"].v = m_num_transitions;
+    return map;
+}
@@ -0,0 +1,116 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   Watches the processing time of the modulator against the duration of
+   the transmission frames, and disables costly processing steps before
+   the output runs out of frames.
+*/
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include "RemoteControl.h"
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/* The load is the processing time of a frame divided by its duration.
+ * When the average load over the last `window` frames exceeds `high`, the
+ * modulator would soon fall behind, and the next degradation step is
+ * applied. When the average stays below `low` for `recovery` frames, the
+ * most recent step is undone. After every transition, the average starts
+ * over.
+ *
+ * A step sets parameters of remote controllables, and restores the values
+ * they had before it was applied. The steps are applied in the order they
+ * were added. Every transition is logged and sent as an event. */
+class RealtimeBudget : public RemoteControllable
+{
+    public:
+        RealtimeBudget(std::chrono::milliseconds frame_duration,
+                float high, float low, size_t window, size_t recovery);
+        RealtimeBudget(const RealtimeBudget& other) = delete;
+        RealtimeBudget& operator=(const RealtimeBudget& other) = delete;
+
+        /* Add a parameter to set to value with the step name. The
+         * parameters of a step are added one after the other, and the step
+         * is created by the first one. */
+        void add_step(const std::string& name,
+                RemoteControllable *controllable,
+                const std::string& parameter, const std::string& value);
+
+        // Called after every frame, with the time it took to process it
+        void frame_processed(std::chrono::steady_clock::duration duration);
+
+        /******* REMOTE CONTROL ********/
+        virtual void set_parameter(const std::string& parameter,
+                const std::string& value) override;
+
+        virtual const std::string get_parameter(
+                const std::string& parameter) const override;
+
+        virtual const json::map_t get_all_values() const override;
+
+    private:
+        struct action_t {
+            RemoteControllable *controllable;
+            std::string parameter;
+            std::string value;
+            // The value before the step was applied
+            std::string restore_value;
+        };
+
+        struct step_t {
+            std::string name;
+            std::vector<action_t> actions;
+        };
+
+        // Must be called with m_mutex held
+        void degrade(double load);
+        void recover(double load);
+        void send_transition(const std::string& transition,
+                const step_t& step, double load);
+
+        const double m_frame_duration;
+        const float m_high;
+        const float m_low;
+        const size_t m_window;
+        const size_t m_recovery;
+
+        mutable std::mutex m_mutex;
+        bool m_enabled = true;
+        std::vector<step_t> m_steps;
+        // Number of steps applied
+        size_t m_level = 0;
+        std::deque<double> m_loads;
+        double m_loads_sum = 0;
+        size_t m_frames_below = 0;
+        size_t m_num_transitions = 0;
+};
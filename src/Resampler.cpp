@@ -26,6 +26,7 @@
 
 #include "Resampler.h"
 #include "PcDebug.h"
+#include "Utils.h"
 
 #include <string>
 #include <stdexcept>
@@ -48,7 +49,29 @@ T gcd(T a, T b)
 }
 
 
-Resampler::Resampler(size_t inputRate, size_t outputRate, size_t resolution) :
+// Number of blocks of M input samples in the fft, which must be even
+static size_t fft_factor(size_t resolution, size_t M)
+{
+    size_t factor = resolution * 2 / M;
+    if (factor & 1) {
+        ++factor;
+    }
+    return factor;
+}
+
+size_t Resampler::delay(size_t inputRate, size_t outputRate,
+        size_t resolution)
+{
+    // The overlap-add holds back half an output fft
+    const size_t divisor = gcd(inputRate, outputRate);
+    const size_t L = outputRate / divisor;
+    const size_t M = inputRate / divisor;
+    return fft_factor(resolution, M) * L / 2;
+}
+
+
+Resampler::Resampler(size_t inputRate, size_t outputRate, size_t resolution,
+        unsigned fft_threads) :
     ModCodec(),
     myFftPlan1(nullptr),
     myFftPlan2(nullptr),
@@ -67,10 +90,7 @@ Resampler::Resampler(size_t inputRate, size_t outputRate, size_t resolution) :
     M = inputRate / divisor;
     PDEBUG(" gcd: %zu, L: %zu, M: %zu\n", divisor, L, M);
     {
-        size_t factor = resolution * 2 / M;
-        if (factor & 1) {
-            ++factor;
-        }
+        const size_t factor = fft_factor(resolution, M);
         myFftSizeIn = factor * M;
         myFftSizeOut = factor * L;
     }
@@ -86,23 +106,29 @@ Resampler::Resampler(size_t inputRate, size_t outputRate, size_t resolution) :
     if (ret != 0) {
         throw std::runtime_error("memory allocation failed: " + std::to_string(ret));
     }
+    // The FFTs are linear, the output scaling myFactor can therefore be
+    // applied together with the window.
     for (size_t i = 0; i < myFftSizeIn; ++i) {
-        myWindow[i] = (float)(0.5 * (1.0 - cos(2.0 * M_PI * i / (myFftSizeIn - 1))));
+        myWindow[i] = (float)(0.5 * (1.0 - cos(2.0 * M_PI * i / (myFftSizeIn - 1)))) *
+            myFactor;
         PDEBUG("Window[%zu] = %f\n", i, myWindow[i]);
     }
 
     myFftIn = (FFT_TYPE*)fftwf_malloc(sizeof(FFT_TYPE) * myFftSizeIn);
     myFront = (FFT_TYPE*)fftwf_malloc(sizeof(FFT_TYPE) * myFftSizeIn);
-    fftwf_set_timelimit(2);
+
+    std::lock_guard<std::mutex> lock(fftw_planner_mutex);
+    const unsigned plan_flags = prepare_fftw_planner(fft_threads);
     myFftPlan1 = fftwf_plan_dft_1d(myFftSizeIn,
             myFftIn, myFront,
-            FFTW_FORWARD, FFTW_MEASURE);
+            FFTW_FORWARD, plan_flags);
 
     myBack = (FFT_TYPE*)fftwf_malloc(sizeof(FFT_TYPE) * myFftSizeOut);
     myFftOut = (FFT_TYPE*)fftwf_malloc(sizeof(FFT_TYPE) * myFftSizeOut);
     myFftPlan2 = fftwf_plan_dft_1d(myFftSizeOut,
             myBack, myFftOut,
-            FFTW_BACKWARD, FFTW_MEASURE);
+            FFTW_BACKWARD, plan_flags);
+    save_fftw_wisdom();
 
     myBufferIn = (FFT_TYPE*)fftwf_malloc(sizeof(FFT_TYPE) * myFftSizeIn / 2);
     myBufferOut = (FFT_TYPE*)fftwf_malloc(sizeof(FFT_TYPE) * myFftSizeOut / 2);
@@ -123,6 +149,7 @@ Resampler::~Resampler()
     if (myFront != nullptr) { fftwf_free(myFront); }
     if (myBack != nullptr) { fftwf_free(myBack); }
     if (myWindow != nullptr) { fftwf_free(myWindow); }
+    std::lock_guard<std::mutex> lock(fftw_planner_mutex);
     fftwf_destroy_plan(myFftPlan1);
     fftwf_destroy_plan(myFftPlan2);
 }
@@ -140,13 +167,17 @@ int Resampler::process(Buffer* const dataIn, Buffer* dataOut)
     size_t sizeIn = dataIn->getLength() / sizeof(complexf);
 
     for (size_t i = 0, j = 0; i < sizeIn; i += myFftSizeIn / 2, j += myFftSizeOut / 2) {
-        memcpy(myFftIn, myBufferIn, myFftSizeIn / 2 * sizeof(FFT_TYPE));
-        memcpy(myFftIn + (myFftSizeIn / 2), in + i, myFftSizeIn / 2 * sizeof(FFT_TYPE));
-        memcpy(myBufferIn, in + i, myFftSizeIn / 2 * sizeof(FFT_TYPE));
-        for (size_t k = 0; k < myFftSizeIn; ++k) {
-            FFT_REAL(myFftIn[k]) *= myWindow[k];
-            FFT_IMAG(myFftIn[k]) *= myWindow[k];
+        // Window the previous and the current half block while copying
+        const size_t half_in = myFftSizeIn / 2;
+        for (size_t k = 0; k < half_in; ++k) {
+            FFT_REAL(myFftIn[k]) = FFT_REAL(myBufferIn[k]) * myWindow[k];
+            FFT_IMAG(myFftIn[k]) = FFT_IMAG(myBufferIn[k]) * myWindow[k];
         }
+        for (size_t k = 0; k < half_in; ++k) {
+            FFT_REAL(myFftIn[half_in + k]) = FFT_REAL(in[i + k]) * myWindow[half_in + k];
+            FFT_IMAG(myFftIn[half_in + k]) = FFT_IMAG(in[i + k]) * myWindow[half_in + k];
+        }
+        memcpy(myBufferIn, in + i, half_in * sizeof(FFT_TYPE));
 
         fftwf_execute(myFftPlan1);
 
@@ -175,11 +206,6 @@ int Resampler::process(Buffer* const dataIn, Buffer* dataOut)
             FFT_REAL(myBack[myFftSizeOut / 2]) *= 0.5f;
             FFT_IMAG(myBack[myFftSizeOut / 2]) *= 0.5f;
         }
-        for (size_t k = 0; k < myFftSizeOut; ++k) {
-            FFT_REAL(myBack[k]) *= myFactor;
-            FFT_IMAG(myBack[k]) *= myFactor;
-        }
-
         fftwf_execute(myFftPlan2);
 
         for (size_t k = 0; k < myFftSizeOut / 2; ++k) {
@@ -41,11 +41,18 @@
 class Resampler : public ModCodec
 {
 public:
-    Resampler(size_t inputRate, size_t outputRate, size_t resolution = 512);
+    /* fft_threads is the number of threads with which FFTW computes each
+     * of the two FFTs, which only helps for the large FFTs of high output
+     * rates. More than 1 needs FFTW threads support. */
+    Resampler(size_t inputRate, size_t outputRate, size_t resolution = 512,
+            unsigned fft_threads = 1);
     virtual ~Resampler();
     Resampler(const Resampler&);
     Resampler& operator=(const Resampler&);
 
+    // Delay, in output samples, of a resampler with these parameters
+    static size_t delay(size_t inputRate, size_t outputRate,
+            size_t resolution = 512);
 
     int process(Buffer* const dataIn, Buffer* dataOut);
     const char* name() { return "Resampler"; }
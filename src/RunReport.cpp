@@ -0,0 +1,184 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "RunReport.h"
+#include "CpuFeatures.h"
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <errno.h>
+
+using namespace std;
+
+namespace RunReport {
+
+static string cpuinfo_field(const string& line)
+{
+    const auto colon = line.find(':');
+    if (colon == string::npos) {
+        return "";
+    }
+
+    const auto start = line.find_first_not_of(" \t", colon + 1);
+    return start == string::npos ? "" : line.substr(start);
+}
+
+// x86 gives the model name, ARM only the implementer and part number
+static string cpu_model()
+{
+    ifstream cpuinfo("/proc/cpuinfo");
+    string line;
+    string implementer;
+    string part;
+    while (getline(cpuinfo, line)) {
+        if (line.compare(0, 10, "model name") == 0) {
+            return cpuinfo_field(line);
+        }
+        else if (line.compare(0, 15, "CPU implementer") == 0 and implementer.empty()) {
+            implementer = cpuinfo_field(line);
+        }
+        else if (line.compare(0, 8, "CPU part") == 0 and part.empty()) {
+            part = cpuinfo_field(line);
+        }
+    }
+
+    if (not implementer.empty()) {
+        return "implementer " + implementer + " part " + part;
+    }
+    return "unknown";
+}
+
+static json::value_t string_list(const vector<string>& strings)
+{
+    vector<json::value_t> list;
+    for (const auto& s : strings) {
+        json::value_t v;
+        v.v = s;
+        list.push_back(v);
+    }
+
+    json::value_t v;
+    v.v = list;
+    return v;
+}
+
+json::map_t build_info()
+{
+    json::map_t map;
+
+#if defined(GITVERSION)
+    map["version"].v = string(GITVERSION);
+#else
+    map["version"].v = string(VERSION);
+#endif
+    map["compiled"].v = string(__DATE__ " " __TIME__);
+    map["cpu_model"].v = cpu_model();
+    map["num_cpus"].v = (uint32_t)std::thread::hardware_concurrency();
+
+    const auto& cpu = cpu_features();
+    map["simd_build"] = string_list(cpu.build_names());
+    map["simd_cpu"] = string_list(cpu.cpu_names());
+    map["simd_limit"].v = cpu.limit();
+
+    auto kernels = make_shared<json::map_t>();
+    for (const auto& k : cpu.kernels()) {
+        (*kernels)[k.first].v = k.second;
+    }
+    map["kernels"].v = kernels;
+
+    return map;
+}
+
+string fft_engine_name(FFTEngine engine)
+{
+    switch (engine) {
+        case FFTEngine::FFTW: return "fftw";
+        case FFTEngine::KISS: return "kiss";
+        case FFTEngine::KISS_SIMD: return "kiss_simd";
+        case FFTEngine::DEXTER: return "dexter";
+    }
+    return "unknown";
+}
+
+static string resampler_name(ResamplerType resampler)
+{
+    switch (resampler) {
+        case ResamplerType::Auto: return "auto";
+        case ResamplerType::FFT: return "fft";
+        case ResamplerType::Polyphase: return "polyphase";
+        case ResamplerType::Halfband: return "halfband";
+    }
+    return "unknown";
+}
+
+json::map_t settings_info(const mod_settings_t& s)
+{
+    json::map_t map;
+    map["ensemble"].v = s.ensembleName;
+    map["dab_mode"].v = (uint32_t)s.dabMode;
+    map["fft_engine"].v = fft_engine_name(s.fftEngine);
+    map["fftw_plan_mode"].v = s.fftwPlanMode;
+    map["output_rate"].v = (uint64_t)s.outputRate;
+    map["resampler"].v = resampler_name(s.resampler);
+    map["cfr"].v = s.enableCfr;
+    map["batch_frames"].v = (uint64_t)s.batchFrames;
+    map["batched_fft"].v = s.batchedFft;
+    map["planar_samples"].v = s.planarSamples;
+    map["stream_symbols"].v = (uint64_t)s.streamSymbols;
+    map["worker_threads"].v = (uint64_t)s.workerPoolNumThreads;
+    map["pipeline_threads"].v = (uint64_t)s.pipelineExecutorNumThreads;
+    map["flowgraph_threads"].v = (uint64_t)s.flowgraphNumThreads;
+    map["ofdm_threads"].v = (uint64_t)s.ofdmNumThreads;
+    map["poly_threads"].v = (uint32_t)s.polyNumThreads;
+    map["memory_poly_threads"].v = (uint32_t)s.memoryPolyNumThreads;
+    return map;
+}
+
+double timestamp()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(
+            system_clock::now().time_since_epoch()).count() / 1e6;
+}
+
+void append(const string& filename, const json::map_t& report)
+{
+    ofstream out(filename, ios::app);
+    if (not out) {
+        throw runtime_error("Cannot open run report " + filename + ": " +
+                strerror(errno));
+    }
+
+    out << json::map_to_json(report) << "\n";
+    out.flush();
+    if (not out) {
+        throw runtime_error("Cannot write run report " + filename);
+    }
+}
+
+} // namespace RunReport
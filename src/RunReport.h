@@ -0,0 +1,58 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   Machine-readable reports of modulator and benchmark runs
+*/
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include <string>
+#include "ConfigParser.h"
+#include "Json.h"
+
+/* Every report is one JSON object, appended as one line to a file, so that
+ * the runs of different builds, configurations and machines can be
+ * collected and compared. */
+namespace RunReport {
+
+/* Version, CPU model and number of CPUs, and the SIMD instruction sets
+ * the build uses and the CPU supports */
+json::map_t build_info();
+
+/* FFT engine and thread counts of the modulator */
+json::map_t settings_info(const mod_settings_t& s);
+
+/* The name of the engine in the fft_engine setting */
+std::string fft_engine_name(FFTEngine engine);
+
+/* Seconds since the epoch, with a fractional part */
+double timestamp();
+
+/* Throws a runtime_error if the file cannot be written */
+void append(const std::string& filename, const json::map_t& report);
+
+} // namespace RunReport
@@ -0,0 +1,211 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SharedTables.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace shared_tables {
+
+static constexpr uint64_t segment_magic = 0x3142415444524f44; // "DORDTAB1"
+// The data starts after the header, aligned for every table
+static constexpr size_t header_size = 64;
+// How long to wait for the process that fills a segment
+static constexpr auto fill_timeout = chrono::seconds(1);
+
+struct segment_header_t {
+    uint64_t magic;
+    uint64_t size;
+    // Set once the data is filled
+    atomic<uint32_t> ready;
+};
+static_assert(sizeof(segment_header_t) <= header_size, "header too large");
+
+static mutex s_mutex;
+static bool s_enabled = false;
+// By name, the tables of this process
+static map<string, const void*> s_tables;
+// The tables that are not in a segment
+static vector<unique_ptr<uint8_t[]> > s_local_tables;
+
+void set_enabled(bool enabled)
+{
+    lock_guard<mutex> lock(s_mutex);
+    s_enabled = enabled;
+}
+
+static string segment_name(const string& name)
+{
+    // Only one slash is allowed, at the start
+    string shm_name = string("/odr-dabmod-") + PACKAGE_VERSION + "-" + name;
+    for (size_t i = 1; i < shm_name.size(); i++) {
+        if (shm_name[i] == '/') {
+            shm_name[i] = '_';
+        }
+    }
+    return shm_name;
+}
+
+/* Create and fill the segment, or map the one another process created.
+ * Returns nullptr if the segment cannot be used. */
+static const void *map_segment(const string& name, size_t size,
+        const function<void(void *data)>& fill)
+{
+    const string shm_name = segment_name(name);
+    const size_t total = header_size + size;
+
+    int fd = shm_open(shm_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd >= 0) {
+        void *p = MAP_FAILED;
+        if (ftruncate(fd, total) == 0) {
+            p = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        const int err = errno;
+        close(fd);
+        if (p == MAP_FAILED) {
+            shm_unlink(shm_name.c_str());
+            etiLog.level(warn) << "SharedTables: cannot create " <<
+                shm_name << ": " << strerror(err);
+            return nullptr;
+        }
+
+        auto *header = new (p) segment_header_t;
+        header->magic = segment_magic;
+        header->size = size;
+        uint8_t *data = static_cast<uint8_t*>(p) + header_size;
+        fill(data);
+        header->ready.store(1, memory_order_release);
+
+        // The tables are only read from now on, also by this process
+        mprotect(p, total, PROT_READ);
+        etiLog.level(debug) << "SharedTables: created " << shm_name;
+        return data;
+    }
+
+    if (errno != EEXIST) {
+        etiLog.level(warn) << "SharedTables: cannot create " << shm_name <<
+            ": " << strerror(errno);
+        return nullptr;
+    }
+
+    fd = shm_open(shm_name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        etiLog.level(warn) << "SharedTables: cannot open " << shm_name <<
+            ": " << strerror(errno);
+        return nullptr;
+    }
+
+    // The segment only gets its size once the other process has set it
+    const auto deadline = chrono::steady_clock::now() + fill_timeout;
+    struct stat st;
+    bool valid = false;
+    while (fstat(fd, &st) == 0) {
+        // A segment of another user could contain anything
+        if (st.st_uid != geteuid()) {
+            break;
+        }
+        if ((size_t)st.st_size == total) {
+            valid = true;
+            break;
+        }
+        if (st.st_size != 0 or chrono::steady_clock::now() > deadline) {
+            break;
+        }
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+
+    void *p = MAP_FAILED;
+    if (valid) {
+        p = mmap(nullptr, total, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (p == MAP_FAILED) {
+        etiLog.level(warn) << "SharedTables: " << shm_name << " does not "
+            "belong to this user or has the wrong size, remove it from "
+            "/dev/shm";
+        return nullptr;
+    }
+
+    const auto *header = static_cast<const segment_header_t*>(p);
+    while (header->ready.load(memory_order_acquire) == 0 and
+            chrono::steady_clock::now() < deadline) {
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+
+    if (header->ready.load(memory_order_acquire) == 0 or
+            header->magic != segment_magic or header->size != size) {
+        munmap(p, total);
+        etiLog.level(warn) << "SharedTables: " << shm_name << " was not "
+            "filled, remove it from /dev/shm if no other modulator is "
+            "starting";
+        return nullptr;
+    }
+
+    etiLog.level(debug) << "SharedTables: mapped " << shm_name;
+    return static_cast<const uint8_t*>(p) + header_size;
+}
+
+const void *get_bytes(const string& name, size_t size,
+        const function<void(void *data)>& fill)
+{
+    lock_guard<mutex> lock(s_mutex);
+    const auto it = s_tables.find(name);
+    if (it != s_tables.end()) {
+        return it->second;
+    }
+
+    const void *table = nullptr;
+    if (s_enabled) {
+        table = map_segment(name, size, fill);
+    }
+
+    if (not table) {
+        // new[] aligns to at least 16 bytes on the platforms we support
+        s_local_tables.emplace_back(new uint8_t[std::max<size_t>(size, 1)]);
+        fill(s_local_tables.back().get());
+        table = s_local_tables.back().get();
+    }
+
+    s_tables[name] = table;
+    return table;
+}
+
+} // namespace shared_tables
@@ -0,0 +1,66 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <type_traits>
+
+/* The read-only tables that the blocks compute at startup, and that only
+ * depend on the transmission mode. Every table is computed once per
+ * process, and all blocks and ensembles get the same copy.
+ *
+ * With general.shared_tables, the tables are in POSIX shared memory
+ * segments called /odr-dabmod-<version>-<name>, which the first process
+ * creates and fills, and which the other processes of the same user map
+ * read-only. The segments stay in /dev/shm after the processes exit, for
+ * the next ones. If a segment cannot be used, the table is computed for
+ * the process alone. */
+namespace shared_tables {
+
+// Call before the first get()
+void set_enabled(bool enabled);
+
+const void *get_bytes(const std::string& name, size_t size,
+        const std::function<void(void *data)>& fill);
+
+/* The table of n values called name. fill is only called if the table
+ * does not exist yet. The table stays valid until the process exits. */
+template<typename T>
+const T *get(const std::string& name, size_t n,
+        const std::function<void(T *values)>& fill)
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+            "shared tables are copied between processes");
+    static_assert(alignof(T) <= 16, "shared tables are aligned to 16 bytes");
+    return static_cast<const T*>(get_bytes(name, n * sizeof(T),
+                [&](void *data) { fill(static_cast<T*>(data)); }));
+}
+
+} // namespace shared_tables
@@ -23,11 +23,14 @@
 #include "PcDebug.h"
 
 #include <cstdio>
+#include <cstring>
+#include <stdexcept>
 #include <assert.h>
 
 
-SignalMultiplexer::SignalMultiplexer() :
-    ModMux()
+SignalMultiplexer::SignalMultiplexer(size_t firstSymbolSize) :
+    ModMux(),
+    m_firstSymbolSize(firstSymbolSize)
 {
     PDEBUG("SignalMultiplexer::SignalMultiplexer() @ %p\n", this);
 }
@@ -58,7 +61,20 @@ int SignalMultiplexer::process(std::vector<Buffer*> dataIn, Buffer* dataOut)
 
     assert(dataIn.size() == 2 or dataIn.size() == 3);
 
-    if (dataIn.size() == 2) {
+    if (m_firstSymbolSize) {
+        const Buffer *first = dataIn.size() == 3 ? dataIn[2] : dataIn[0];
+        if (first->getLength() != m_firstSymbolSize or
+                dataIn[1]->getLength() < m_firstSymbolSize) {
+            throw std::runtime_error(
+                    "SignalMultiplexer::process input size not valid!");
+        }
+
+        // The DifferentialModulator writes a new output every frame, and
+        // can have our previous buffer.
+        dataOut->swap(*dataIn[1]);
+        memcpy(dataOut->getData(), first->getData(), m_firstSymbolSize);
+    }
+    else if (dataIn.size() == 2) {
         *dataOut = *dataIn[0];
         *dataOut += *dataIn[1];
     }
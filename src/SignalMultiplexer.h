@@ -36,7 +36,11 @@
 class SignalMultiplexer : public ModMux
 {
 public:
-    SignalMultiplexer();
+    /* With a firstSymbolSize, the DifferentialModulator leaves that many
+     * bytes free at the start of its output. The null or TII symbol is
+     * written there, and that buffer becomes the output without copying
+     * the other symbols. Without, the symbols are concatenated. */
+    SignalMultiplexer(size_t firstSymbolSize = 0);
     virtual ~SignalMultiplexer();
     SignalMultiplexer(const SignalMultiplexer&);
     SignalMultiplexer& operator=(const SignalMultiplexer&);
@@ -44,5 +48,8 @@ public:
 
     int process(std::vector<Buffer*> dataIn, Buffer* dataOut);
     const char* name() { return "SignalMultiplexer"; }
+
+private:
+    size_t m_firstSymbolSize;
 };
 
@@ -0,0 +1,580 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   Vectors of complex and real floats with the operations the DSP kernels
+   share, for the instruction set the program is compiled for.
+*/
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX512F__) || defined(__AVX__) || defined(__SSE2__)
+#   include <immintrin.h>
+#elif defined(__ARM_NEON)
+#   include <arm_neon.h>
+#endif
+
+/* The backend is the widest of AVX-512, AVX, SSE2 and NEON the compiler
+ * targets, or scalar code without any of them. It is fixed at compile
+ * time. The kernels that select an instruction set at runtime, with the
+ * target attribute, keep their own intrinsics, because these inline
+ * functions are compiled for the base instruction set.
+ *
+ * vcf holds cf_width complex samples and vf holds f_width floats. The
+ * loads and stores do not need aligned pointers. A kernel processes
+ * cf_width or f_width elements at a time, and finishes the rest with
+ * scalar code.
+ */
+namespace simd {
+
+using complexf = std::complex<float>;
+
+#if defined(__AVX512F__)
+#   define SIMD_BACKEND_NAME "AVX-512"
+using vcf = __m512;
+using vf = __m512;
+constexpr size_t cf_width = 8;
+constexpr size_t f_width = 16;
+
+static inline vcf load(const complexf *p) { return _mm512_loadu_ps(p); }
+static inline void store(complexf *p, vcf v) { _mm512_storeu_ps(p, v); }
+static inline vf loadf(const float *p) { return _mm512_loadu_ps(p); }
+static inline void storef(float *p, vf v) { _mm512_storeu_ps(p, v); }
+static inline vf add(vf a, vf b) { return _mm512_add_ps(a, b); }
+static inline vf mul(vf a, vf b) { return _mm512_mul_ps(a, b); }
+static inline vf fmadd(vf a, vf b, vf c) { return _mm512_fmadd_ps(a, b, c); }
+
+/* (ar + j ai) * (br + j bi), with the real and imaginary parts of b
+ * duplicated, and the ones of a swapped for the cross terms. The maskz
+ * forms with all lanes set are the same instructions, but unlike the
+ * unmasked intrinsics of GCC they do not pass an uninitialised vector. */
+static inline vcf cmul(vcf a, vcf b)
+{
+    const __mmask16 all = 0xffff;
+    const __m512 b_re = _mm512_maskz_moveldup_ps(all, b);
+    const __m512 b_im = _mm512_maskz_movehdup_ps(all, b);
+    const __m512 a_swapped = _mm512_maskz_permute_ps(all, a, 0xb1);
+    return _mm512_fmaddsub_ps(a, b_re, _mm512_mul_ps(a_swapped, b_im));
+}
+
+/* Truncate 2 * f_width floats towards zero, saturate to the int16 range
+ * and store them. The floats must be in the int32 range. */
+static inline void pack_s16(int16_t *out, vf a, vf b)
+{
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out),
+            _mm512_cvtsepi32_epi16(_mm512_cvttps_epi32(a)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 16),
+            _mm512_cvtsepi32_epi16(_mm512_cvttps_epi32(b)));
+}
+
+// The complex samples base[index[i]] for i in [0, cf_width)
+static inline vcf gather(const complexf *base, const int32_t *index)
+{
+    const __m256i vindex = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(index));
+    return _mm512_castpd_ps(_mm512_i32gather_pd(vindex,
+                reinterpret_cast<const double*>(base), 8));
+}
+
+#elif defined(__AVX__)
+#   define SIMD_BACKEND_NAME "AVX"
+using vcf = __m256;
+using vf = __m256;
+constexpr size_t cf_width = 4;
+constexpr size_t f_width = 8;
+
+static inline vcf load(const complexf *p)
+{
+    return _mm256_loadu_ps(reinterpret_cast<const float*>(p));
+}
+static inline void store(complexf *p, vcf v)
+{
+    _mm256_storeu_ps(reinterpret_cast<float*>(p), v);
+}
+static inline vf loadf(const float *p) { return _mm256_loadu_ps(p); }
+static inline void storef(float *p, vf v) { _mm256_storeu_ps(p, v); }
+static inline vf add(vf a, vf b) { return _mm256_add_ps(a, b); }
+static inline vf mul(vf a, vf b) { return _mm256_mul_ps(a, b); }
+static inline vf fmadd(vf a, vf b, vf c)
+{
+#if defined(__FMA__)
+    return _mm256_fmadd_ps(a, b, c);
+#else
+    return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+}
+
+static inline vcf cmul(vcf a, vcf b)
+{
+    const __m256 b_re = _mm256_moveldup_ps(b);
+    const __m256 b_im = _mm256_movehdup_ps(b);
+    const __m256 a_swapped = _mm256_permute_ps(a, 0xb1);
+#if defined(__FMA__)
+    return _mm256_fmaddsub_ps(a, b_re, _mm256_mul_ps(a_swapped, b_im));
+#else
+    return _mm256_addsub_ps(
+            _mm256_mul_ps(a, b_re), _mm256_mul_ps(a_swapped, b_im));
+#endif
+}
+
+static inline void pack_s16(int16_t *out, vf a, vf b)
+{
+    const __m256i ia = _mm256_cvttps_epi32(a);
+    const __m256i ib = _mm256_cvttps_epi32(b);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_packs_epi32(
+                _mm256_castsi256_si128(ia), _mm256_extractf128_si256(ia, 1)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 8), _mm_packs_epi32(
+                _mm256_castsi256_si128(ib), _mm256_extractf128_si256(ib, 1)));
+}
+
+static inline vcf gather(const complexf *base, const int32_t *index)
+{
+#if defined(__AVX2__)
+    const __m128i vindex = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(index));
+    return _mm256_castpd_ps(_mm256_i32gather_pd(
+                reinterpret_cast<const double*>(base), vindex, 8));
+#else
+    const double *d = reinterpret_cast<const double*>(base);
+    return _mm256_castpd_ps(_mm256_setr_pd(
+                d[index[0]], d[index[1]], d[index[2]], d[index[3]]));
+#endif
+}
+
+#elif defined(__SSE2__)
+#   define SIMD_BACKEND_NAME "SSE2"
+using vcf = __m128;
+using vf = __m128;
+constexpr size_t cf_width = 2;
+constexpr size_t f_width = 4;
+
+static inline vcf load(const complexf *p)
+{
+    return _mm_loadu_ps(reinterpret_cast<const float*>(p));
+}
+static inline void store(complexf *p, vcf v)
+{
+    _mm_storeu_ps(reinterpret_cast<float*>(p), v);
+}
+static inline vf loadf(const float *p) { return _mm_loadu_ps(p); }
+static inline void storef(float *p, vf v) { _mm_storeu_ps(p, v); }
+static inline vf add(vf a, vf b) { return _mm_add_ps(a, b); }
+static inline vf mul(vf a, vf b) { return _mm_mul_ps(a, b); }
+static inline vf fmadd(vf a, vf b, vf c)
+{
+    return _mm_add_ps(_mm_mul_ps(a, b), c);
+}
+
+static inline vcf cmul(vcf a, vcf b)
+{
+    const __m128 a_swapped = _mm_shuffle_ps(a, a, 0xb1);
+#if defined(__SSE3__)
+    const __m128 b_re = _mm_moveldup_ps(b);
+    const __m128 b_im = _mm_movehdup_ps(b);
+    return _mm_addsub_ps(_mm_mul_ps(a, b_re), _mm_mul_ps(a_swapped, b_im));
+#else
+    // Without addsub, the sign of the real cross term is flipped
+    const __m128 b_re = _mm_shuffle_ps(b, b, 0xa0);
+    const __m128 b_im = _mm_shuffle_ps(b, b, 0xf5);
+    const __m128 sign = _mm_setr_ps(-0.0f, 0.0f, -0.0f, 0.0f);
+    return _mm_add_ps(_mm_mul_ps(a, b_re),
+            _mm_xor_ps(_mm_mul_ps(a_swapped, b_im), sign));
+#endif
+}
+
+static inline void pack_s16(int16_t *out, vf a, vf b)
+{
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_packs_epi32(
+                _mm_cvttps_epi32(a), _mm_cvttps_epi32(b)));
+}
+
+static inline vcf gather(const complexf *base, const int32_t *index)
+{
+    const double *d = reinterpret_cast<const double*>(base);
+    return _mm_castpd_ps(_mm_setr_pd(d[index[0]], d[index[1]]));
+}
+
+#elif defined(__ARM_NEON)
+#   define SIMD_BACKEND_NAME "NEON"
+// The real and imaginary parts are in separate registers
+using vcf = float32x4x2_t;
+using vf = float32x4_t;
+constexpr size_t cf_width = 4;
+constexpr size_t f_width = 4;
+
+static inline vcf load(const complexf *p)
+{
+    return vld2q_f32(reinterpret_cast<const float*>(p));
+}
+static inline void store(complexf *p, vcf v)
+{
+    vst2q_f32(reinterpret_cast<float*>(p), v);
+}
+static inline vf loadf(const float *p) { return vld1q_f32(p); }
+static inline void storef(float *p, vf v) { vst1q_f32(p, v); }
+static inline vf add(vf a, vf b) { return vaddq_f32(a, b); }
+static inline vf mul(vf a, vf b) { return vmulq_f32(a, b); }
+static inline vf fmadd(vf a, vf b, vf c)
+{
+#if defined(__aarch64__)
+    return vfmaq_f32(c, a, b);
+#else
+    return vmlaq_f32(c, a, b);
+#endif
+}
+
+static inline vcf cmul(vcf a, vcf b)
+{
+    vcf out;
+    out.val[0] = vmlsq_f32(vmulq_f32(a.val[0], b.val[0]),
+            a.val[1], b.val[1]);
+    out.val[1] = vmlaq_f32(vmulq_f32(a.val[0], b.val[1]),
+            a.val[1], b.val[0]);
+    return out;
+}
+
+static inline void pack_s16(int16_t *out, vf a, vf b)
+{
+    vst1q_s16(out, vcombine_s16(vqmovn_s32(vcvtq_s32_f32(a)),
+                vqmovn_s32(vcvtq_s32_f32(b))));
+}
+
+static inline vcf gather(const complexf *base, const int32_t *index)
+{
+    complexf samples[cf_width];
+    for (size_t i = 0; i < cf_width; i++) {
+        samples[i] = base[index[i]];
+    }
+    return load(samples);
+}
+
+#else
+#   define SIMD_BACKEND_NAME "scalar"
+using vcf = complexf;
+using vf = float;
+constexpr size_t cf_width = 1;
+constexpr size_t f_width = 1;
+
+static inline vcf load(const complexf *p) { return *p; }
+static inline void store(complexf *p, vcf v) { *p = v; }
+static inline vf loadf(const float *p) { return *p; }
+static inline void storef(float *p, vf v) { *p = v; }
+static inline vf add(vf a, vf b) { return a + b; }
+static inline vf mul(vf a, vf b) { return a * b; }
+static inline vf fmadd(vf a, vf b, vf c) { return a * b + c; }
+static inline vcf cmul(vcf a, vcf b) { return a * b; }
+
+static inline void pack_s16(int16_t *out, vf a, vf b)
+{
+    for (const float v : {a, b}) {
+        const int32_t i = v;
+        *out++ = i < INT16_MIN ? INT16_MIN : (i > INT16_MAX ? INT16_MAX : i);
+    }
+}
+
+static inline vcf gather(const complexf *base, const int32_t *index)
+{
+    return base[index[0]];
+}
+#endif
+
+// The sum of the complex vectors, a + b
+static inline vcf cadd(vcf a, vcf b)
+{
+#if defined(__ARM_NEON) && !defined(__SSE2__)
+    vcf out;
+    out.val[0] = vaddq_f32(a.val[0], b.val[0]);
+    out.val[1] = vaddq_f32(a.val[1], b.val[1]);
+    return out;
+#else
+    return a + b;
+#endif
+}
+
+/* Complex samples in Q2.14, as the raw values of complexfix: pairs of
+ * int16. Like the multiplication of fpm, every product is rounded half
+ * away from zero, so that the results are the same as with complexfix.
+ * The products are then summed in 32 bits, and narrowed to int16 with
+ * saturation, where the int16 sum of complexfix would wrap around.
+ */
+static inline int32_t mul_q14(int32_t a, int32_t b)
+{
+    const int32_t p = a * b;
+    return (p + (1 << 13) + (p >> 31)) >> 14;
+}
+
+static inline int16_t saturate_s16(int32_t v)
+{
+    return v < INT16_MIN ? INT16_MIN : (v > INT16_MAX ? INT16_MAX : v);
+}
+
+#if defined(__SSE2__)
+// The rounded products of the int16 values of a and b, in two halves
+static inline void mul_q14(__m128i a, __m128i b, __m128i& lo, __m128i& hi)
+{
+    const __m128i p_lo = _mm_mullo_epi16(a, b);
+    const __m128i p_hi = _mm_mulhi_epi16(a, b);
+    const __m128i round = _mm_set1_epi32(1 << 13);
+    lo = _mm_unpacklo_epi16(p_lo, p_hi);
+    hi = _mm_unpackhi_epi16(p_lo, p_hi);
+    lo = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(lo, round),
+                _mm_srai_epi32(lo, 31)), 14);
+    hi = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(hi, round),
+                _mm_srai_epi32(hi, 31)), 14);
+}
+#elif defined(__ARM_NEON)
+/* The rounding shift rounds half up. Subtracting one from the negative
+ * products first rounds their halves away from zero. */
+static inline int32x4_t round_q14(int32x4_t p)
+{
+    return vrshrq_n_s32(vsraq_n_s32(p, p, 31), 14);
+}
+
+static inline int32x4_t mul_q14(int16x4_t a, int16x4_t b)
+{
+    return round_q14(vmull_s16(a, b));
+}
+#endif
+
+// out[i] = a[i] * b[i] for n complex samples, out may be a or b
+static inline void cmul_q14(const int16_t *a, const int16_t *b,
+        int16_t *out, size_t n)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    // Negates the real parts of the cross terms
+    const __m128i negate_re = _mm_setr_epi32(-1, 0, -1, 0);
+    for (; i + 4 <= n; i += 4) {
+        const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + 2 * i));
+        const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + 2 * i));
+        const __m128i b_re = _mm_shufflehi_epi16(
+                _mm_shufflelo_epi16(vb, _MM_SHUFFLE(2, 2, 0, 0)), _MM_SHUFFLE(2, 2, 0, 0));
+        const __m128i b_im = _mm_shufflehi_epi16(
+                _mm_shufflelo_epi16(vb, _MM_SHUFFLE(3, 3, 1, 1)), _MM_SHUFFLE(3, 3, 1, 1));
+        const __m128i a_swapped = _mm_shufflehi_epi16(
+                _mm_shufflelo_epi16(va, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+
+        // ar*br, ai*br and ai*bi, ar*bi
+        __m128i direct_lo, direct_hi, cross_lo, cross_hi;
+        mul_q14(va, b_re, direct_lo, direct_hi);
+        mul_q14(a_swapped, b_im, cross_lo, cross_hi);
+        cross_lo = _mm_sub_epi32(_mm_xor_si128(cross_lo, negate_re), negate_re);
+        cross_hi = _mm_sub_epi32(_mm_xor_si128(cross_hi, negate_re), negate_re);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i), _mm_packs_epi32(
+                    _mm_add_epi32(direct_lo, cross_lo),
+                    _mm_add_epi32(direct_hi, cross_hi)));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 8 <= n; i += 8) {
+        const int16x8x2_t va = vld2q_s16(a + 2 * i);
+        const int16x8x2_t vb = vld2q_s16(b + 2 * i);
+        const int16x4_t ar_lo = vget_low_s16(va.val[0]), ar_hi = vget_high_s16(va.val[0]);
+        const int16x4_t ai_lo = vget_low_s16(va.val[1]), ai_hi = vget_high_s16(va.val[1]);
+        const int16x4_t br_lo = vget_low_s16(vb.val[0]), br_hi = vget_high_s16(vb.val[0]);
+        const int16x4_t bi_lo = vget_low_s16(vb.val[1]), bi_hi = vget_high_s16(vb.val[1]);
+
+        int16x8x2_t r;
+        r.val[0] = vcombine_s16(
+                vqmovn_s32(vsubq_s32(mul_q14(ar_lo, br_lo), mul_q14(ai_lo, bi_lo))),
+                vqmovn_s32(vsubq_s32(mul_q14(ar_hi, br_hi), mul_q14(ai_hi, bi_hi))));
+        r.val[1] = vcombine_s16(
+                vqmovn_s32(vaddq_s32(mul_q14(ar_lo, bi_lo), mul_q14(ai_lo, br_lo))),
+                vqmovn_s32(vaddq_s32(mul_q14(ar_hi, bi_hi), mul_q14(ai_hi, br_hi))));
+        vst2q_s16(out + 2 * i, r);
+    }
+#endif
+
+    // Indexed by int16 value, so that no index in the loop can overflow
+    for (size_t k = 2 * i; k < 2 * n; k += 2) {
+        const int32_t ar = a[k], ai = a[k + 1];
+        const int32_t br = b[k], bi = b[k + 1];
+        out[k] = saturate_s16(mul_q14(ar, br) - mul_q14(ai, bi));
+        out[k + 1] = saturate_s16(mul_q14(ar, bi) + mul_q14(ai, br));
+    }
+}
+
+/* A gain for integer samples, as gain ~= mantissa * 2^-shift, with the
+ * largest shift up to 30 that keeps the mantissa in int16, so that the
+ * products of int16 samples and their rounding fit in 32 bits. */
+struct int_gain_t {
+    int16_t mantissa = 1;
+    int shift = 0;
+};
+
+static inline int_gain_t split_gain(float gain)
+{
+    int_gain_t g;
+    if (not (gain > 0.0f)) {
+        g.mantissa = 0;
+        return g;
+    }
+    else if (gain >= (float)INT16_MAX) {
+        g.mantissa = INT16_MAX;
+        return g;
+    }
+
+    while (g.shift < 30 and gain * (float)(1 << (g.shift + 1)) < 32767.5f) {
+        g.shift++;
+    }
+    g.mantissa = (int16_t)std::min(32767.0f,
+            std::round(gain * (float)(1 << g.shift)));
+    return g;
+}
+
+static inline int32_t saturate_s32(int64_t v)
+{
+    return v < INT32_MIN ? INT32_MIN : (v > INT32_MAX ? INT32_MAX : v);
+}
+
+/* out[i] = in[i] * gain for n int16 values, out may be in. The products
+ * are rounded half up, like the rounding shifts of NEON, and saturated. */
+static inline void scale_s16(const int16_t *in, int16_t *out, size_t n,
+        int_gain_t gain)
+{
+    const int32_t round = gain.shift ? 1 << (gain.shift - 1) : 0;
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i g = _mm_set1_epi16(gain.mantissa);
+    const __m128i r = _mm_set1_epi32(round);
+    const __m128i s = _mm_cvtsi32_si128(gain.shift);
+    for (; i + 8 <= n; i += 8) {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        const __m128i p_lo = _mm_mullo_epi16(x, g);
+        const __m128i p_hi = _mm_mulhi_epi16(x, g);
+        const __m128i lo = _mm_sra_epi32(
+                _mm_add_epi32(_mm_unpacklo_epi16(p_lo, p_hi), r), s);
+        const __m128i hi = _mm_sra_epi32(
+                _mm_add_epi32(_mm_unpackhi_epi16(p_lo, p_hi), r), s);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+                _mm_packs_epi32(lo, hi));
+    }
+#elif defined(__ARM_NEON)
+    const int16x4_t g = vdup_n_s16(gain.mantissa);
+    const int32x4_t s = vdupq_n_s32(-gain.shift);
+    for (; i + 8 <= n; i += 8) {
+        const int16x8_t x = vld1q_s16(in + i);
+        const int32x4_t lo = vrshlq_s32(vmull_s16(vget_low_s16(x), g), s);
+        const int32x4_t hi = vrshlq_s32(vmull_s16(vget_high_s16(x), g), s);
+        vst1q_s16(out + i, vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+    }
+#endif
+
+    for (; i < n; i++) {
+        out[i] = saturate_s16((in[i] * gain.mantissa + round) >> gain.shift);
+    }
+}
+
+/* The same for int32 values, with 64-bit products. SSE2 cannot multiply
+ * signed 32-bit values, the x86 version is scalar. */
+static inline void scale_s32(const int32_t *in, int32_t *out, size_t n,
+        int_gain_t gain)
+{
+    const int64_t round = gain.shift ? INT64_C(1) << (gain.shift - 1) : 0;
+    size_t i = 0;
+#if defined(__ARM_NEON) && !defined(__SSE2__)
+    const int32x2_t g = vdup_n_s32(gain.mantissa);
+    const int64x2_t s = vdupq_n_s64(-gain.shift);
+    for (; i + 4 <= n; i += 4) {
+        const int32x4_t x = vld1q_s32(in + i);
+        const int64x2_t lo = vrshlq_s64(vmull_s32(vget_low_s32(x), g), s);
+        const int64x2_t hi = vrshlq_s64(vmull_s32(vget_high_s32(x), g), s);
+        vst1q_s32(out + i, vcombine_s32(vqmovn_s64(lo), vqmovn_s64(hi)));
+    }
+#endif
+
+    for (; i < n; i++) {
+        out[i] = saturate_s32(((int64_t)in[i] * gain.mantissa + round) >>
+                gain.shift);
+    }
+}
+
+/* Copies len bytes like memcpy, with non-temporal stores that do not
+ * fill the caches, for destinations that are not read again before they
+ * would be evicted: frames that wait in a queue, or go to a file or a DMA
+ * buffer. The source is prefetched ahead of the loads, and the copy is
+ * visible to the other threads and devices like the one of memcpy. Short
+ * copies, and 32-bit ARM, go through memcpy. */
+static inline void stream_copy(void *dst, const void *src, size_t len)
+{
+    // Below a page, the copy stays in the caches anyway
+    constexpr size_t min_stream_len = 4096;
+    constexpr size_t prefetch_distance = 512;
+
+    uint8_t *d = reinterpret_cast<uint8_t*>(dst);
+    const uint8_t *s = reinterpret_cast<const uint8_t*>(src);
+    if (len < min_stream_len) {
+        memcpy(d, s, len);
+        return;
+    }
+
+#if defined(__SSE2__)
+    // The streaming stores need an aligned destination
+    const size_t head = (16 - reinterpret_cast<uintptr_t>(d) % 16) % 16;
+    memcpy(d, s, head);
+    d += head;
+    s += head;
+    len -= head;
+
+    for (; len >= 64; len -= 64, d += 64, s += 64) {
+        _mm_prefetch(reinterpret_cast<const char*>(s + prefetch_distance),
+                _MM_HINT_NTA);
+        const __m128i *in = reinterpret_cast<const __m128i*>(s);
+        __m128i *out = reinterpret_cast<__m128i*>(d);
+        const __m128i a = _mm_loadu_si128(in);
+        const __m128i b = _mm_loadu_si128(in + 1);
+        const __m128i c = _mm_loadu_si128(in + 2);
+        const __m128i e = _mm_loadu_si128(in + 3);
+        _mm_stream_si128(out, a);
+        _mm_stream_si128(out + 1, b);
+        _mm_stream_si128(out + 2, c);
+        _mm_stream_si128(out + 3, e);
+    }
+    // The streaming stores are weakly ordered
+    _mm_sfence();
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    for (; len >= 64; len -= 64, d += 64, s += 64) {
+        __builtin_prefetch(s + prefetch_distance, 0, 0);
+        const uint8x16_t a = vld1q_u8(s);
+        const uint8x16_t b = vld1q_u8(s + 16);
+        const uint8x16_t c = vld1q_u8(s + 32);
+        const uint8x16_t e = vld1q_u8(s + 48);
+        asm volatile(
+                "stnp %q0, %q1, [%4]\n\t"
+                "stnp %q2, %q3, [%4, #32]"
+                :: "w"(a), "w"(b), "w"(c), "w"(e), "r"(d) : "memory");
+    }
+    // STNP is not ordered with the stores that follow
+    asm volatile("dmb ishst" ::: "memory");
+#endif
+
+    memcpy(d, s, len);
+}
+
+} // namespace simd
@@ -0,0 +1,247 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SubchannelEncoder.h"
+#include "ConvEncoder.h"
+#include "PrbsGenerator.h"
+#include "PcDebug.h"
+
+#include <stdexcept>
+#include <string>
+#include <cstring>
+
+/* Hash of the input frame, to find cache entries that might match */
+static uint64_t hash_frame(const uint8_t* data, size_t len)
+{
+    uint64_t hash = len;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * 0x9e3779b97f4a7c15;
+        hash ^= hash >> 29;
+    }
+    for (; i < len; i++) {
+        hash = (hash ^ data[i]) * 0x9e3779b97f4a7c15;
+    }
+    return hash;
+}
+
+/* Puncture the four bytes of mother code c with a 32-bit pattern, and
+ * append the kept bits to the accumulator. Less than 32 bits are left in
+ * the accumulator, they are written out four bytes at a time. */
+static inline void puncture_word(const uint8_t *c,
+        const uint8_t* const rows[4], const unsigned widths[4],
+        uint64_t& acc, unsigned& num_bits, uint8_t*& out)
+{
+    for (int k = 0; k < 4; k++) {
+        acc = (acc << widths[k]) | rows[k][c[k]];
+        num_bits += widths[k];
+    }
+
+    if (num_bits >= 32) {
+        num_bits -= 32;
+        const uint32_t word = acc >> num_bits;
+        out[0] = word >> 24;
+        out[1] = word >> 16;
+        out[2] = word >> 8;
+        out[3] = word;
+        out += 4;
+    }
+}
+
+SubchannelEncoder::SubchannelEncoder(
+        size_t framesize,
+        size_t num_cu,
+        const std::vector<PuncturingRule>& rules,
+        const PuncturingRule& tail_rule,
+        size_t cache_size) :
+    ModCodec(),
+    m_framesize(framesize),
+    m_cache_size(cache_size)
+{
+    PDEBUG("SubchannelEncoder(%zu, %zu, %zu) @ %p\n",
+            framesize, num_cu, cache_size, this);
+
+    // The energy dispersal sequence restarts with every frame
+    m_prbs = PrbsGenerator(framesize, 0x110).sequence();
+
+    // Every input byte gives four bytes of mother code, and every rule
+    // pattern applies to four bytes of mother code. Like in the
+    // PuncturingEncoder, the rules must cover the frame exactly.
+    size_t out_bits = 0;
+    size_t in_bytes = 0;
+    for (const auto& rule : rules) {
+        const size_t num_bytes = (rule.length() + 3) / 4;
+        m_segments.push_back({num_bytes, rule.pattern()});
+        in_bytes += num_bytes;
+        out_bits += num_bytes * rule.bit_size();
+    }
+
+    if (in_bytes != m_framesize) {
+        throw std::runtime_error("SubchannelEncoder: puncturing rules cover " +
+                std::to_string(in_bytes) + " bytes, expected " +
+                std::to_string(m_framesize));
+    }
+
+    // The tail of the mother code is three bytes long
+    if (tail_rule.length() != 3) {
+        throw std::runtime_error("SubchannelEncoder: invalid tail rule length " +
+                std::to_string(tail_rule.length()));
+    }
+    m_tail_pattern = tail_rule.pattern() << 8;
+    out_bits += PuncturingRule(4, m_tail_pattern).bit_size();
+
+    m_out_block_size = (out_bits + 7) / 8;
+
+    if (num_cu > 0) {
+        if (num_cu * 8 == m_out_block_size + 1) {
+            /* EN 300 401 Table 31 in 11.3.1 UEP coding specifies
+             * that we need one byte of padding
+             */
+            m_out_block_size = num_cu * 8;
+        }
+
+        if (num_cu * 8 != m_out_block_size) {
+            throw std::runtime_error(
+                    "SubchannelEncoder initialisation failed. "
+                    " CU: " + std::to_string(num_cu) +
+                    " block_size: " + std::to_string(m_out_block_size));
+        }
+    }
+
+    // Build the tables now rather than during the first frame
+    ConvEncoderTable::get();
+    PuncturingTable::get();
+}
+
+int SubchannelEncoder::process(Buffer* const dataIn, Buffer* dataOut)
+{
+    PDEBUG("SubchannelEncoder::process"
+            "(dataIn: %p, dataOut: %p)\n",
+            dataIn, dataOut);
+
+    if (dataIn->getLength() != m_framesize) {
+        throw std::runtime_error(
+                "SubchannelEncoder::process wrong input size");
+    }
+
+    dataOut->setLength(m_out_block_size);
+    const uint8_t* in = reinterpret_cast<const uint8_t*>(dataIn->getData());
+    uint8_t* out = reinterpret_cast<uint8_t*>(dataOut->getData());
+
+    if (m_cache_size == 0) {
+        encode(in, out);
+        return m_out_block_size;
+    }
+
+    m_num_frames++;
+    const uint64_t hash = hash_frame(in, m_framesize);
+
+    for (auto& entry : m_cache) {
+        if (entry.hash == hash and
+                memcmp(entry.input.data(), in, m_framesize) == 0) {
+            entry.last_use = m_num_frames;
+            memcpy(out, entry.output.data(), m_out_block_size);
+            return m_out_block_size;
+        }
+    }
+
+    encode(in, out);
+
+    // Replace the entry that was used the longest time ago
+    cache_entry_t *entry = nullptr;
+    if (m_cache.size() < m_cache_size) {
+        m_cache.emplace_back();
+        entry = &m_cache.back();
+    }
+    else {
+        entry = &m_cache[0];
+        for (auto& e : m_cache) {
+            if (e.last_use < entry->last_use) {
+                entry = &e;
+            }
+        }
+    }
+
+    entry->hash = hash;
+    entry->last_use = m_num_frames;
+    entry->input.assign(in, in + m_framesize);
+    entry->output.assign(out, out + m_out_block_size);
+
+    return m_out_block_size;
+}
+
+void SubchannelEncoder::encode(const uint8_t* in, uint8_t* out) const
+{
+    uint8_t* const out_start = out;
+
+    const auto& conv = ConvEncoderTable::get();
+    const auto& punct = PuncturingTable::get();
+    const uint8_t* prbs = m_prbs->data();
+
+    uint64_t acc = 0;
+    unsigned num_bits = 0;
+
+    // The encoder memory is zero at the start of every frame
+    uint8_t prev = 0;
+    size_t i = 0;
+
+    const uint8_t* rows[4];
+    unsigned widths[4];
+    auto set_pattern = [&](uint32_t pattern) {
+        for (int k = 0; k < 4; k++) {
+            const uint8_t pattern_byte = pattern >> (24 - 8 * k);
+            rows[k] = punct.row(pattern_byte);
+            widths[k] = __builtin_popcount(pattern_byte);
+        }
+    };
+
+    for (const auto& segment : m_segments) {
+        set_pattern(segment.pattern);
+
+        for (size_t n = 0; n < segment.num_bytes; n++, i++) {
+            const uint8_t data = in[i] ^ prbs[i];
+            puncture_word(conv.lookup(prev, data), rows, widths,
+                    acc, num_bits, out);
+            prev = data;
+        }
+    }
+
+    // The tail flushes the memory with six zero bits, which are the first
+    // 24 bits of mother code of a zero byte. The last pattern byte is 0.
+    set_pattern(m_tail_pattern);
+    puncture_word(conv.lookup(prev, 0), rows, widths, acc, num_bits, out);
+
+    while (num_bits >= 8) {
+        num_bits -= 8;
+        *out++ = acc >> num_bits;
+    }
+
+    if (num_bits) {
+        *out++ = acc << (8 - num_bits);
+    }
+
+    const size_t out_count = out - out_start;
+    memset(out, 0, m_out_block_size - out_count);
+}
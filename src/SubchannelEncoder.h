@@ -0,0 +1,98 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   Energy dispersal, convolutional encoding and puncturing of a subchannel
+   in a single pass.
+*/
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include "ModPlugin.h"
+#include "PuncturingRule.h"
+
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+/* Gives the same output as the PrbsGenerator, ConvEncoder and
+ * PuncturingEncoder chain, but without writing the intermediate buffers.
+ * In particular the output of the mother code, four times as large as the
+ * input, is never stored: each input byte is encoded to 32 bits that
+ * get punctured right away.
+ *
+ * The encoder state is reset at the start of every frame, and the output
+ * therefore only depends on the input frame. Padding, silence and static
+ * data repeat the same frames, whose output can be kept in a small cache
+ * instead of being encoded again.
+ */
+class SubchannelEncoder : public ModCodec
+{
+public:
+    /* framesize is the size of the subchannel data in bytes, num_cu the
+     * size of the encoded subchannel in CUs, or 0 to not check the
+     * output size, as for the FIC. The rules are applied as in
+     * the PuncturingEncoder, followed by the tail rule.
+     * cache_size is the number of different frames for which the output
+     * is remembered, 0 disables the cache. */
+    SubchannelEncoder(
+            size_t framesize,
+            size_t num_cu,
+            const std::vector<PuncturingRule>& rules,
+            const PuncturingRule& tail_rule,
+            size_t cache_size = 0);
+
+    int process(Buffer* const dataIn, Buffer* dataOut) override;
+    const char* name() override { return "SubchannelEncoder"; }
+
+private:
+    /* A run of input bytes to which the same puncturing pattern applies */
+    struct segment_t {
+        size_t num_bytes;
+        uint32_t pattern;
+    };
+
+    struct cache_entry_t {
+        uint64_t hash;
+        uint64_t last_use;
+        std::vector<uint8_t> input;
+        std::vector<uint8_t> output;
+    };
+
+    void encode(const uint8_t* in, uint8_t* out) const;
+
+    size_t m_framesize;
+    size_t m_out_block_size;
+    std::shared_ptr<const std::vector<uint8_t> > m_prbs;
+    std::vector<segment_t> m_segments;
+    uint32_t m_tail_pattern;
+
+    size_t m_cache_size;
+    std::vector<cache_entry_t> m_cache;
+    uint64_t m_num_frames = 0;
+};
+
@@ -28,8 +28,11 @@
 #include "PcDebug.h"
 #include "Log.h"
 
+#include <map>
+#include <mutex>
 #include <string>
 #include <stdexcept>
+#include <utility>
 #include <sys/types.h>
 #include <stdlib.h>
 #include <string.h>
@@ -63,7 +66,7 @@
 
 const std::vector<PuncturingRule>& SubchannelSource::get_rules() const
 {
-    return d_puncturing_rules;
+    return d_profile->rules;
 }
 
 
@@ -81,84 +84,114 @@ SubchannelSource::SubchannelSource(
     PDEBUG("  Start address: %zu\n", d_start_address);
     PDEBUG("  Framesize: %zu\n", d_framesize);
     PDEBUG("  Protection: %zu\n", d_protection);
+
+    /* The coding profiles, identified by the frame size and the
+     * protection of the subchannel */
+    using profile_key_t = std::pair<size_t, size_t>;
+    static std::mutex s_profiles_mutex;
+    static std::map<profile_key_t,
+        std::shared_ptr<const coding_profile_t> > s_profiles;
+
+    std::lock_guard<std::mutex> lock(s_profiles_mutex);
+    auto& profile = s_profiles[profile_key_t(d_framesize, d_protection)];
+    if (not profile) {
+        auto p = std::make_shared<coding_profile_t>();
+        compute_rules(p->rules);
+        try {
+            p->framesize_cu = compute_framesize_cu();
+        }
+        catch (const std::runtime_error&) {
+            // framesizeCu() throws again, if the modulator needs it
+            p->framesize_cu = 0;
+        }
+        profile = p;
+    }
+    d_profile = profile;
+}
+
+void SubchannelSource::compute_rules(std::vector<PuncturingRule>& rules) const
+{
     if (protectionForm()) {
         if (protectionOption() == 0) {
             switch (protectionLevel()) {
             case 1:
-                d_puncturing_rules.emplace_back(
+                rules.emplace_back(
                         ((6 * bitrate() / 8) - 3) * 16, P24);
-                d_puncturing_rules.emplace_back(3 * 16, P23);
+                rules.emplace_back(3 * 16, P23);
                 break;
             case 2:
                 if (bitrate() == 8) {
-                    d_puncturing_rules.emplace_back(5 * 16, P13);
-                    d_puncturing_rules.emplace_back(1 * 16, P12);
+                    rules.emplace_back(5 * 16, P13);
+                    rules.emplace_back(1 * 16, P12);
                 } else {
-                    d_puncturing_rules.emplace_back(
+                    rules.emplace_back(
                             ((2 * bitrate() / 8) - 3) * 16, P14);
-                    d_puncturing_rules.emplace_back(
+                    rules.emplace_back(
                             ((4 * bitrate() / 8) + 3) * 16, P13);
                 }
                 break;
             case 3:
-                d_puncturing_rules.emplace_back(
+                rules.emplace_back(
                         ((6 * bitrate() / 8) - 3) * 16, P8);
-                d_puncturing_rules.emplace_back(3 * 16, P7);
+                rules.emplace_back(3 * 16, P7);
                 break;
             case 4:
-                d_puncturing_rules.emplace_back(
+                rules.emplace_back(
                         ((4 * bitrate() / 8) - 3) * 16, P3);
-                d_puncturing_rules.emplace_back(
+                rules.emplace_back(
                         ((2 * bitrate() / 8) + 3) * 16, P2);
                 break;
             default:
                 fprintf(stderr,
                         "Protection form(%zu), option(%zu) and level(%zu)\n",
                         protectionForm(), protectionOption(), protectionLevel());
-                fprintf(stderr, "Subchannel TPL: 0x%x (%u)\n", tpl, tpl);
-                throw std::runtime_error("SubchannelSource::SubchannelSource "
+                fprintf(stderr, "Subchannel TPL: 0x%zx (%zu)\n",
+                        d_protection, d_protection);
+                throw std::runtime_error("SubchannelSource "
                         "unknown protection level!");
             }
         } else if (protectionOption() == 1) {
             switch (protectionLevel()) {
             case 1:
-                d_puncturing_rules.emplace_back(
+                rules.emplace_back(
                             ((24 * bitrate() / 32) - 3) * 16, P10);
-                d_puncturing_rules.emplace_back(
+                rules.emplace_back(
                             3 * 16, P9);
                 break;
             case 2:
-                d_puncturing_rules.emplace_back(
+                rules.emplace_back(
                             ((24 * bitrate() / 32) - 3) * 16, P6);
-                d_puncturing_rules.emplace_back(
+                rules.emplace_back(
                             3 * 16, P5);
                 break;
             case 3:
-                d_puncturing_rules.emplace_back(
+                rules.emplace_back(
                             ((24 * bitrate() / 32) - 3) * 16, P4);
-                d_puncturing_rules.emplace_back(
+                rules.emplace_back(
                             3 * 16, P3);
                 break;
             case 4:
-                d_puncturing_rules.emplace_back(
+                rules.emplace_back(
                             ((24 * bitrate() / 32) - 3) * 16, P2);
-                d_puncturing_rules.emplace_back(
+                rules.emplace_back(
                             3 * 16, P1);
                 break;
             default:
                 fprintf(stderr,
                         "Protection form(%zu), option(%zu) and level(%zu)\n",
                         protectionForm(), protectionOption(), protectionLevel());
-                fprintf(stderr, "Subchannel TPL: 0x%x (%u)\n", tpl, tpl);
-                throw std::runtime_error("SubchannelSource::SubchannelSource "
+                fprintf(stderr, "Subchannel TPL: 0x%zx (%zu)\n",
+                        d_protection, d_protection);
+                throw std::runtime_error("SubchannelSource "
                         "unknown protection level!");
             }
         } else {
             fprintf(stderr,
                     "Protection form(%zu), option(%zu) and level(%zu)\n",
                     protectionForm(), protectionOption(), protectionLevel());
-            fprintf(stderr, "Subchannel TPL: 0x%x (%u)\n", tpl, tpl);
-            throw std::runtime_error("SubchannelSource::SubchannelSource "
+            fprintf(stderr, "Subchannel TPL: 0x%zx (%zu)\n",
+                        d_protection, d_protection);
+            throw std::runtime_error("SubchannelSource "
                     "unknown protection option!");
         }
     }
@@ -168,32 +201,32 @@ SubchannelSource::SubchannelSource(
         case 32:
             switch (protectionLevel()) {
             case 1:
-                d_puncturing_rules.emplace_back(3  * 16, P24);
-                d_puncturing_rules.emplace_back(5  * 16, P17);
-                d_puncturing_rules.emplace_back(13 * 16, P12);
-                d_puncturing_rules.emplace_back(3  * 16, P17);
+                rules.emplace_back(3  * 16, P24);
+                rules.emplace_back(5  * 16, P17);
+                rules.emplace_back(13 * 16, P12);
+                rules.emplace_back(3  * 16, P17);
                 break;
             case 2:
-                d_puncturing_rules.emplace_back(3  * 16, P22);
-                d_puncturing_rules.emplace_back(4  * 16, P13);
-                d_puncturing_rules.emplace_back(14 * 16, P8 );
-                d_puncturing_rules.emplace_back(3  * 16, P13);
+                rules.emplace_back(3  * 16, P22);
+                rules.emplace_back(4  * 16, P13);
+                rules.emplace_back(14 * 16, P8 );
+                rules.emplace_back(3  * 16, P13);
                 break;
             case 3:
-                d_puncturing_rules.emplace_back(3  * 16, P15);
-                d_puncturing_rules.emplace_back(4  * 16, P9 );
-                d_puncturing_rules.emplace_back(14 * 16, P6 );
-                d_puncturing_rules.emplace_back(3  * 16, P8 );
+                rules.emplace_back(3  * 16, P15);
+                rules.emplace_back(4  * 16, P9 );
+                rules.emplace_back(14 * 16, P6 );
+                rules.emplace_back(3  * 16, P8 );
                 break;
             case 4:
-                d_puncturing_rules.emplace_back(3  * 16, P11);
-                d_puncturing_rules.emplace_back(3  * 16, P6 );
-                d_puncturing_rules.emplace_back(18 * 16, P5 );
+                rules.emplace_back(3  * 16, P11);
+                rules.emplace_back(3  * 16, P6 );
+                rules.emplace_back(18 * 16, P5 );
                 break;
             case 5:
-                d_puncturing_rules.emplace_back(3  * 16, P5 );
-                d_puncturing_rules.emplace_back(4  * 16, P3 );
-                d_puncturing_rules.emplace_back(17 * 16, P2 );
+                rules.emplace_back(3  * 16, P5 );
+                rules.emplace_back(4  * 16, P3 );
+                rules.emplace_back(17 * 16, P2 );
                 break;
             default:
                 rule_error = true;
@@ -202,34 +235,34 @@ SubchannelSource::SubchannelSource(
         case 48:
             switch (protectionLevel()) {
             case 1:
-                d_puncturing_rules.emplace_back(3  * 16, P24);
-                d_puncturing_rules.emplace_back(5  * 16, P18);
-                d_puncturing_rules.emplace_back(25 * 16, P13);
-                d_puncturing_rules.emplace_back(3  * 16, P18);
+                rules.emplace_back(3  * 16, P24);
+                rules.emplace_back(5  * 16, P18);
+                rules.emplace_back(25 * 16, P13);
+                rules.emplace_back(3  * 16, P18);
                 break;
             case 2:
-                d_puncturing_rules.emplace_back(3  * 16, P24);
-                d_puncturing_rules.emplace_back(4  * 16, P14);
-                d_puncturing_rules.emplace_back(26 * 16, P8 );
-                d_puncturing_rules.emplace_back(3  * 16, P15);
+                rules.emplace_back(3  * 16, P24);
+                rules.emplace_back(4  * 16, P14);
+                rules.emplace_back(26 * 16, P8 );
+                rules.emplace_back(3  * 16, P15);
                 break;
             case 3:
-                d_puncturing_rules.emplace_back(3  * 16, P15);
-                d_puncturing_rules.emplace_back(4  * 16, P10);
-                d_puncturing_rules.emplace_back(26 * 16, P6 );
-                d_puncturing_rules.emplace_back(3  * 16, P9 );
+                rules.emplace_back(3  * 16, P15);
+                rules.emplace_back(4  * 16, P10);
+                rules.emplace_back(26 * 16, P6 );
+                rules.emplace_back(3  * 16, P9 );
                 break;
             case 4:
-                d_puncturing_rules.emplace_back(3  * 16, P9 );
-                d_puncturing_rules.emplace_back(4  * 16, P6 );
-                d_puncturing_rules.emplace_back(26 * 16, P4 );
-                d_puncturing_rules.emplace_back(3  * 16, P6 );
+                rules.emplace_back(3  * 16, P9 );
+                rules.emplace_back(4  * 16, P6 );
+                rules.emplace_back(26 * 16, P4 );
+                rules.emplace_back(3  * 16, P6 );
                 break;
             case 5:
-                d_puncturing_rules.emplace_back(4  * 16, P5 );
-                d_puncturing_rules.emplace_back(3  * 16, P4 );
-                d_puncturing_rules.emplace_back(26 * 16, P2 );
-                d_puncturing_rules.emplace_back(3  * 16, P3 );
+                rules.emplace_back(4  * 16, P5 );
+                rules.emplace_back(3  * 16, P4 );
+                rules.emplace_back(26 * 16, P2 );
+                rules.emplace_back(3  * 16, P3 );
                 break;
             default:
                 rule_error = true;
@@ -238,28 +271,28 @@ SubchannelSource::SubchannelSource(
         case 56:
             switch (protectionLevel()) {
             case 2:
-                d_puncturing_rules.emplace_back(6  * 16, P23);
-                d_puncturing_rules.emplace_back(10 * 16, P13);
-                d_puncturing_rules.emplace_back(23 * 16, P8 );
-                d_puncturing_rules.emplace_back(3  * 16, P13);
+                rules.emplace_back(6  * 16, P23);
+                rules.emplace_back(10 * 16, P13);
+                rules.emplace_back(23 * 16, P8 );
+                rules.emplace_back(3  * 16, P13);
                 break;
             case 3:
-                d_puncturing_rules.emplace_back(6  * 16, P16);
-                d_puncturing_rules.emplace_back(12 * 16, P7 );
-                d_puncturing_rules.emplace_back(21 * 16, P6 );
-                d_puncturing_rules.emplace_back(3  * 16, P9 );
+                rules.emplace_back(6  * 16, P16);
+                rules.emplace_back(12 * 16, P7 );
+                rules.emplace_back(21 * 16, P6 );
+                rules.emplace_back(3  * 16, P9 );
                 break;
             case 4:
-                d_puncturing_rules.emplace_back(6  * 16, P9 );
-                d_puncturing_rules.emplace_back(10 * 16, P6 );
-                d_puncturing_rules.emplace_back(23 * 16, P4 );
-                d_puncturing_rules.emplace_back(3  * 16, P5 );
+                rules.emplace_back(6  * 16, P9 );
+                rules.emplace_back(10 * 16, P6 );
+                rules.emplace_back(23 * 16, P4 );
+                rules.emplace_back(3  * 16, P5 );
                 break;
             case 5:
-                d_puncturing_rules.emplace_back(6  * 16, P5 );
-                d_puncturing_rules.emplace_back(10 * 16, P4 );
-                d_puncturing_rules.emplace_back(23 * 16, P2 );
-                d_puncturing_rules.emplace_back(3  * 16, P3 );
+                rules.emplace_back(6  * 16, P5 );
+                rules.emplace_back(10 * 16, P4 );
+                rules.emplace_back(23 * 16, P2 );
+                rules.emplace_back(3  * 16, P3 );
                 break;
             default:
                 rule_error = true;
@@ -268,33 +301,33 @@ SubchannelSource::SubchannelSource(
         case 64:
             switch (protectionLevel()) {
             case 1:
-                d_puncturing_rules.emplace_back(6  * 16, P24);
-                d_puncturing_rules.emplace_back(11 * 16, P18);
-                d_puncturing_rules.emplace_back(28 * 16, P12);
-                d_puncturing_rules.emplace_back(3  * 16, P18);
+                rules.emplace_back(6  * 16, P24);
+                rules.emplace_back(11 * 16, P18);
+                rules.emplace_back(28 * 16, P12);
+                rules.emplace_back(3  * 16, P18);
                 break;
             case 2:
-                d_puncturing_rules.emplace_back(6  * 16, P23);
-                d_puncturing_rules.emplace_back(10 * 16, P13);
-                d_puncturing_rules.emplace_back(29 * 16, P8 );
-                d_puncturing_rules.emplace_back(3  * 16, P13);
+                rules.emplace_back(6  * 16, P23);
+                rules.emplace_back(10 * 16, P13);
+                rules.emplace_back(29 * 16, P8 );
+                rules.emplace_back(3  * 16, P13);
                 break;
             case 3:
-                d_puncturing_rules.emplace_back(6  * 16, P16);
-                d_puncturing_rules.emplace_back(12 * 16, P8 );
-                d_puncturing_rules.emplace_back(27 * 16, P6 );
-                d_puncturing_rules.emplace_back(3  * 16, P9 );
+                rules.emplace_back(6  * 16, P16);
+                rules.emplace_back(12 * 16, P8 );
+                rules.emplace_back(27 * 16, P6 );
+                rules.emplace_back(3  * 16, P9 );
                 break;
             case 4:
-                d_puncturing_rules.emplace_back(6  * 16, P11);
-                d_puncturing_rules.emplace_back(9  * 16, P6 );
-                d_puncturing_rules.emplace_back(33 * 16, P5 );
+                rules.emplace_back(6  * 16, P11);
+                rules.emplace_back(9  * 16, P6 );
+                rules.emplace_back(33 * 16, P5 );
                 break;
             case 5:
-                d_puncturing_rules.emplace_back(6  * 16, P5 );
-                d_puncturing_rules.emplace_back(9  * 16, P3 );
-                d_puncturing_rules.emplace_back(31 * 16, P2 );
-                d_puncturing_rules.emplace_back(2  * 16, P3 );
+                rules.emplace_back(6  * 16, P5 );
+                rules.emplace_back(9  * 16, P3 );
+                rules.emplace_back(31 * 16, P2 );
+                rules.emplace_back(2  * 16, P3 );
                 break;
             default:
                 rule_error = true;
@@ -303,34 +336,34 @@ SubchannelSource::SubchannelSource(
         case 80:
             switch (protectionLevel()) {
             case 1:
-                d_puncturing_rules.emplace_back(6  * 16, P24);
-                d_puncturing_rules.emplace_back(10 * 16, P17);
-                d_puncturing_rules.emplace_back(41 * 16, P12);
-                d_puncturing_rules.emplace_back(3  * 16, P18);
+                rules.emplace_back(6  * 16, P24);
+                rules.emplace_back(10 * 16, P17);
+                rules.emplace_back(41 * 16, P12);
+                rules.emplace_back(3  * 16, P18);
                 break;
             case 2:
-                d_puncturing_rules.emplace_back(6  * 16, P23);
-                d_puncturing_rules.emplace_back(10 * 16, P13);
-                d_puncturing_rules.emplace_back(41 * 16, P8 );
-                d_puncturing_rules.emplace_back(3  * 16, P13);
+                rules.emplace_back(6  * 16, P23);
+                rules.emplace_back(10 * 16, P13);
+                rules.emplace_back(41 * 16, P8 );
+                rules.emplace_back(3  * 16, P13);
                 break;
             case 3:
-                d_puncturing_rules.emplace_back(6  * 16, P16);
-                d_puncturing_rules.emplace_back(11 * 16, P8 );
-                d_puncturing_rules.emplace_back(40 * 16, P6 );
-                d_puncturing_rules.emplace_back(3  * 16, P7 );
+                rules.emplace_back(6  * 16, P16);
+                rules.emplace_back(11 * 16, P8 );
+                rules.emplace_back(40 * 16, P6 );
+                rules.emplace_back(3  * 16, P7 );
                 break;
             case 4:
-                d_puncturing_rules.emplace_back(6  * 16, P11);
-                d_puncturing_rules.emplace_back(10 * 16, P6 );
-                d_puncturing_rules.emplace_back(41 * 16, P5 );
-                d_puncturing_rules.emplace_back(3  * 16, P6 );
+                rules.emplace_back(6  * 16, P11);
+                rules.emplace_back(10 * 16, P6 );
+                rules.emplace_back(41 * 16, P5 );
+                rules.emplace_back(3  * 16, P6 );
                 break;
             case 5:
-                d_puncturing_rules.emplace_back(6  * 16, P6 );
-                d_puncturing_rules.emplace_back(10 * 16, P3 );
-                d_puncturing_rules.emplace_back(41 * 16, P2 );
-                d_puncturing_rules.emplace_back(3  * 16, P3 );
+                rules.emplace_back(6  * 16, P6 );
+                rules.emplace_back(10 * 16, P3 );
+                rules.emplace_back(41 * 16, P2 );
+                rules.emplace_back(3  * 16, P3 );
                 break;
             default:
                 rule_error = true;
@@ -339,34 +372,34 @@ SubchannelSource::SubchannelSource(
         case 96:
             switch (protectionLevel()) {
             case 1:
-                d_puncturing_rules.emplace_back(6  * 16, P24);
-                d_puncturing_rules.emplace_back(13 * 16, P18);
-                d_puncturing_rules.emplace_back(50 * 16, P13);
-                d_puncturing_rules.emplace_back(3  * 16, P19);
+                rules.emplace_back(6  * 16, P24);
+                rules.emplace_back(13 * 16, P18);
+                rules.emplace_back(50 * 16, P13);
+                rules.emplace_back(3  * 16, P19);
                 break;
             case 2:
-                d_puncturing_rules.emplace_back(6  * 16, P22);
-                d_puncturing_rules.emplace_back(10 * 16, P12);
-                d_puncturing_rules.emplace_back(53 * 16, P9 );
-                d_puncturing_rules.emplace_back(3  * 16, P12);
+                rules.emplace_back(6  * 16, P22);
+                rules.emplace_back(10 * 16, P12);
+                rules.emplace_back(53 * 16, P9 );
+                rules.emplace_back(3  * 16, P12);
                 break;
             case 3:
-                d_puncturing_rules.emplace_back(6  * 16, P16);
-                d_puncturing_rules.emplace_back(12 * 16, P9 );
-                d_puncturing_rules.emplace_back(51 * 16, P6 );
-                d_puncturing_rules.emplace_back(3  * 16, P10);
+                rules.emplace_back(6  * 16, P16);
+                rules.emplace_back(12 * 16, P9 );
+                rules.emplace_back(51 * 16, P6 );
+                rules.emplace_back(3  * 16, P10);
                 break;
             case 4:
-                d_puncturing_rules.emplace_back(7  * 16, P9 );
-                d_puncturing_rules.emplace_back(10 * 16, P6 );
-                d_puncturing_rules.emplace_back(52 * 16, P4 );
-                d_puncturing_rules.emplace_back(3  * 16, P6 );
+                rules.emplace_back(7  * 16, P9 );
+                rules.emplace_back(10 * 16, P6 );
+                rules.emplace_back(52 * 16, P4 );
+                rules.emplace_back(3  * 16, P6 );
                 break;
             case 5:
-                d_puncturing_rules.emplace_back(7  * 16, P5 );
-                d_puncturing_rules.emplace_back(9  * 16, P4 );
-                d_puncturing_rules.emplace_back(53 * 16, P2 );
-                d_puncturing_rules.emplace_back(3  * 16, P4 );
+                rules.emplace_back(7  * 16, P5 );
+                rules.emplace_back(9  * 16, P4 );
+                rules.emplace_back(53 * 16, P2 );
+                rules.emplace_back(3  * 16, P4 );
                 break;
             default:
                 rule_error = true;
@@ -375,28 +408,28 @@ SubchannelSource::SubchannelSource(
         case 112:
             switch (protectionLevel()) {
             case 2:
-                d_puncturing_rules.emplace_back(11 * 16, P23);
-                d_puncturing_rules.emplace_back(21 * 16, P12);
-                d_puncturing_rules.emplace_back(49 * 16, P9 );
-                d_puncturing_rules.emplace_back(3  * 16, P14);
+                rules.emplace_back(11 * 16, P23);
+                rules.emplace_back(21 * 16, P12);
+                rules.emplace_back(49 * 16, P9 );
+                rules.emplace_back(3  * 16, P14);
                 break;
             case 3:
-                d_puncturing_rules.emplace_back(11 * 16, P16);
-                d_puncturing_rules.emplace_back(23 * 16, P8 );
-                d_puncturing_rules.emplace_back(47 * 16, P6 );
-                d_puncturing_rules.emplace_back(3  * 16, P9 );
+                rules.emplace_back(11 * 16, P16);
+                rules.emplace_back(23 * 16, P8 );
+                rules.emplace_back(47 * 16, P6 );
+                rules.emplace_back(3  * 16, P9 );
                 break;
             case 4:
-                d_puncturing_rules.emplace_back(11 * 16, P9 );
-                d_puncturing_rules.emplace_back(21 * 16, P6 );
-                d_puncturing_rules.emplace_back(49 * 16, P4 );
-                d_puncturing_rules.emplace_back(3  * 16, P8 );
+                rules.emplace_back(11 * 16, P9 );
+                rules.emplace_back(21 * 16, P6 );
+                rules.emplace_back(49 * 16, P4 );
+                rules.emplace_back(3  * 16, P8 );
                 break;
             case 5:
-                d_puncturing_rules.emplace_back(14 * 16, P5 );
-                d_puncturing_rules.emplace_back(17 * 16, P4 );
-                d_puncturing_rules.emplace_back(50 * 16, P2 );
-                d_puncturing_rules.emplace_back(3  * 16, P5 );
+                rules.emplace_back(14 * 16, P5 );
+                rules.emplace_back(17 * 16, P4 );
+                rules.emplace_back(50 * 16, P2 );
+                rules.emplace_back(3  * 16, P5 );
                 break;
             default:
                 rule_error = true;
@@ -405,34 +438,34 @@ SubchannelSource::SubchannelSource(
         case 128:
             switch (protectionLevel()) {
             case 1:
-                d_puncturing_rules.emplace_back(11 * 16, P24);
-                d_puncturing_rules.emplace_back(20 * 16, P17);
-                d_puncturing_rules.emplace_back(62 * 16, P13);
-                d_puncturing_rules.emplace_back(3  * 16, P19);
+                rules.emplace_back(11 * 16, P24);
+                rules.emplace_back(20 * 16, P17);
+                rules.emplace_back(62 * 16, P13);
+                rules.emplace_back(3  * 16, P19);
                 break;
             case 2:
-                d_puncturing_rules.emplace_back(11 * 16, P22);
-                d_puncturing_rules.emplace_back(21 * 16, P12);
-                d_puncturing_rules.emplace_back(61 * 16, P9 );
-                d_puncturing_rules.emplace_back(3  * 16, P14);
+                rules.emplace_back(11 * 16, P22);
+                rules.emplace_back(21 * 16, P12);
+                rules.emplace_back(61 * 16, P9 );
+                rules.emplace_back(3  * 16, P14);
                 break;
             case 3:
-                d_puncturing_rules.emplace_back(11 * 16, P16);
-                d_puncturing_rules.emplace_back(22 * 16, P9 );
-                d_puncturing_rules.emplace_back(60 * 16, P6 );
-                d_puncturing_rules.emplace_back(3  * 16, P10);
+                rules.emplace_back(11 * 16, P16);
+                rules.emplace_back(22 * 16, P9 );
+                rules.emplace_back(60 * 16, P6 );
+                rules.emplace_back(3  * 16, P10);
                 break;
             case 4:
-                d_puncturing_rules.emplace_back(11 * 16, P11);
-                d_puncturing_rules.emplace_back(21 * 16, P6 );
-                d_puncturing_rules.emplace_back(61 * 16, P5 );
-                d_puncturing_rules.emplace_back(3  * 16, P7 );
+                rules.emplace_back(11 * 16, P11);
+                rules.emplace_back(21 * 16, P6 );
+                rules.emplace_back(61 * 16, P5 );
+                rules.emplace_back(3  * 16, P7 );
                 break;
             case 5:
-                d_puncturing_rules.emplace_back(12 * 16, P5 );
-                d_puncturing_rules.emplace_back(19 * 16, P3 );
-                d_puncturing_rules.emplace_back(62 * 16, P2 );
-                d_puncturing_rules.emplace_back(3  * 16, P4 );
+                rules.emplace_back(12 * 16, P5 );
+                rules.emplace_back(19 * 16, P3 );
+                rules.emplace_back(62 * 16, P2 );
+                rules.emplace_back(3  * 16, P4 );
                 break;
             default:
                 rule_error = true;
@@ -441,34 +474,34 @@ SubchannelSource::SubchannelSource(
         case 160:
             switch (protectionLevel()) {
             case 1:
-                d_puncturing_rules.emplace_back(11 * 16, P24);
-                d_puncturing_rules.emplace_back(22 * 16, P18);
-                d_puncturing_rules.emplace_back(84 * 16, P12);
-                d_puncturing_rules.emplace_back(3  * 16, P19);
+                rules.emplace_back(11 * 16, P24);
+                rules.emplace_back(22 * 16, P18);
+                rules.emplace_back(84 * 16, P12);
+                rules.emplace_back(3  * 16, P19);
                 break;
             case 2:
-                d_puncturing_rules.emplace_back(11 * 16, P22);
-                d_puncturing_rules.emplace_back(21 * 16, P11);
-                d_puncturing_rules.emplace_back(85 * 16, P9 );
-                d_puncturing_rules.emplace_back(3  * 16, P13);
+                rules.emplace_back(11 * 16, P22);
+                rules.emplace_back(21 * 16, P11);
+                rules.emplace_back(85 * 16, P9 );
+                rules.emplace_back(3  * 16, P13);
                 break;
             case 3:
-                d_puncturing_rules.emplace_back(11 * 16, P16);
-                d_puncturing_rules.emplace_back(24 * 16, P8 );
-                d_puncturing_rules.emplace_back(82 * 16, P6 );
-                d_puncturing_rules.emplace_back(3  * 16, P11);
+                rules.emplace_back(11 * 16, P16);
+                rules.emplace_back(24 * 16, P8 );
+                rules.emplace_back(82 * 16, P6 );
+                rules.emplace_back(3  * 16, P11);
                 break;
             case 4:
-                d_puncturing_rules.emplace_back(11 * 16, P11);
-                d_puncturing_rules.emplace_back(23 * 16, P6 );
-                d_puncturing_rules.emplace_back(83 * 16, P5 );
-                d_puncturing_rules.emplace_back(3  * 16, P9 );
+                rules.emplace_back(11 * 16, P11);
+                rules.emplace_back(23 * 16, P6 );
+                rules.emplace_back(83 * 16, P5 );
+                rules.emplace_back(3  * 16, P9 );
                 break;
             case 5:
-                d_puncturing_rules.emplace_back(11 * 16, P5 );
-                d_puncturing_rules.emplace_back(19 * 16, P4 );
-                d_puncturing_rules.emplace_back(87 * 16, P2 );
-                d_puncturing_rules.emplace_back(3  * 16, P4 );
+                rules.emplace_back(11 * 16, P5 );
+                rules.emplace_back(19 * 16, P4 );
+                rules.emplace_back(87 * 16, P2 );
+                rules.emplace_back(3  * 16, P4 );
                 break;
             default:
                 rule_error = true;
@@ -477,34 +510,34 @@ SubchannelSource::SubchannelSource(
         case 192:
             switch (protectionLevel()) {
             case 1:
-                d_puncturing_rules.emplace_back(11 * 16, P24);
-                d_puncturing_rules.emplace_back(21 * 16, P20);
-                d_puncturing_rules.emplace_back(109 * 16, P13);
-                d_puncturing_rules.emplace_back(3  * 16, P24);
+                rules.emplace_back(11 * 16, P24);
+                rules.emplace_back(21 * 16, P20);
+                rules.emplace_back(109 * 16, P13);
+                rules.emplace_back(3  * 16, P24);
                 break;
             case 2:
-                d_puncturing_rules.emplace_back(11 * 16, P22);
-                d_puncturing_rules.emplace_back(20 * 16, P13);
-                d_puncturing_rules.emplace_back(110 * 16, P9);
-                d_puncturing_rules.emplace_back(3  * 16, P13);
+                rules.emplace_back(11 * 16, P22);
+                rules.emplace_back(20 * 16, P13);
+                rules.emplace_back(110 * 16, P9);
+                rules.emplace_back(3  * 16, P13);
                 break;
             case 3:
-                d_puncturing_rules.emplace_back(11 * 16, P16);
-                d_puncturing_rules.emplace_back(24 * 16, P10);
-                d_puncturing_rules.emplace_back(106 * 16, P6);
-                d_puncturing_rules.emplace_back(3  * 16, P11);
+                rules.emplace_back(11 * 16, P16);
+                rules.emplace_back(24 * 16, P10);
+                rules.emplace_back(106 * 16, P6);
+                rules.emplace_back(3  * 16, P11);
                 break;
             case 4:
-                d_puncturing_rules.emplace_back(11 * 16, P10);
-                d_puncturing_rules.emplace_back(22 * 16, P6);
-                d_puncturing_rules.emplace_back(108 * 16, P4);
-                d_puncturing_rules.emplace_back(3  * 16, P9);
+                rules.emplace_back(11 * 16, P10);
+                rules.emplace_back(22 * 16, P6);
+                rules.emplace_back(108 * 16, P4);
+                rules.emplace_back(3  * 16, P9);
                 break;
             case 5:
-                d_puncturing_rules.emplace_back(11 * 16, P6);
-                d_puncturing_rules.emplace_back(20 * 16, P4);
-                d_puncturing_rules.emplace_back(110 * 16, P2);
-                d_puncturing_rules.emplace_back(3  * 16, P5);
+                rules.emplace_back(11 * 16, P6);
+                rules.emplace_back(20 * 16, P4);
+                rules.emplace_back(110 * 16, P2);
+                rules.emplace_back(3  * 16, P5);
                 break;
             default:
                 rule_error = true;
@@ -513,34 +546,34 @@ SubchannelSource::SubchannelSource(
         case 224:
             switch (protectionLevel()) {
             case 1:
-                d_puncturing_rules.emplace_back(11 * 16, P24);
-                d_puncturing_rules.emplace_back(24 * 16, P20);
-                d_puncturing_rules.emplace_back(130 * 16, P12);
-                d_puncturing_rules.emplace_back(3  * 16, P20);
+                rules.emplace_back(11 * 16, P24);
+                rules.emplace_back(24 * 16, P20);
+                rules.emplace_back(130 * 16, P12);
+                rules.emplace_back(3  * 16, P20);
                 break;
             case 2:
-                d_puncturing_rules.emplace_back(11 * 16, P24);
-                d_puncturing_rules.emplace_back(22 * 16, P16);
-                d_puncturing_rules.emplace_back(132 * 16, P10);
-                d_puncturing_rules.emplace_back(3  * 16, P15);
+                rules.emplace_back(11 * 16, P24);
+                rules.emplace_back(22 * 16, P16);
+                rules.emplace_back(132 * 16, P10);
+                rules.emplace_back(3  * 16, P15);
                 break;
             case 3:
-                d_puncturing_rules.emplace_back(11 * 16, P16);
-                d_puncturing_rules.emplace_back(20 * 16, P10);
-                d_puncturing_rules.emplace_back(134 * 16, P7);
-                d_puncturing_rules.emplace_back(3  * 16, P9);
+                rules.emplace_back(11 * 16, P16);
+                rules.emplace_back(20 * 16, P10);
+                rules.emplace_back(134 * 16, P7);
+                rules.emplace_back(3  * 16, P9);
                 break;
             case 4:
-                d_puncturing_rules.emplace_back(12 * 16, P12);
-                d_puncturing_rules.emplace_back(26 * 16, P8);
-                d_puncturing_rules.emplace_back(127 * 16, P4);
-                d_puncturing_rules.emplace_back(3  * 16, P11);
+                rules.emplace_back(12 * 16, P12);
+                rules.emplace_back(26 * 16, P8);
+                rules.emplace_back(127 * 16, P4);
+                rules.emplace_back(3  * 16, P11);
                 break;
             case 5:
-                d_puncturing_rules.emplace_back(12 * 16, P8);
-                d_puncturing_rules.emplace_back(22 * 16, P6);
-                d_puncturing_rules.emplace_back(131 * 16, P2);
-                d_puncturing_rules.emplace_back(3  * 16, P6);
+                rules.emplace_back(12 * 16, P8);
+                rules.emplace_back(22 * 16, P6);
+                rules.emplace_back(131 * 16, P2);
+                rules.emplace_back(3  * 16, P6);
                 break;
             default:
                 rule_error = true;
@@ -549,34 +582,34 @@ SubchannelSource::SubchannelSource(
         case 256:
             switch (protectionLevel()) {
             case 1:
-                d_puncturing_rules.emplace_back(11 * 16, P24);
-                d_puncturing_rules.emplace_back(26 * 16, P19);
-                d_puncturing_rules.emplace_back(152 * 16, P14);
-                d_puncturing_rules.emplace_back(3  * 16, P18);
+                rules.emplace_back(11 * 16, P24);
+                rules.emplace_back(26 * 16, P19);
+                rules.emplace_back(152 * 16, P14);
+                rules.emplace_back(3  * 16, P18);
                 break;
             case 2:
-                d_puncturing_rules.emplace_back(11 * 16, P24);
-                d_puncturing_rules.emplace_back(22 * 16, P14);
-                d_puncturing_rules.emplace_back(156 * 16, P10);
-                d_puncturing_rules.emplace_back(3  * 16, P13);
+                rules.emplace_back(11 * 16, P24);
+                rules.emplace_back(22 * 16, P14);
+                rules.emplace_back(156 * 16, P10);
+                rules.emplace_back(3  * 16, P13);
                 break;
             case 3:
-                d_puncturing_rules.emplace_back(11 * 16, P16);
-                d_puncturing_rules.emplace_back(27 * 16, P10);
-                d_puncturing_rules.emplace_back(151 * 16, P7);
-                d_puncturing_rules.emplace_back(3  * 16, P10);
+                rules.emplace_back(11 * 16, P16);
+                rules.emplace_back(27 * 16, P10);
+                rules.emplace_back(151 * 16, P7);
+                rules.emplace_back(3  * 16, P10);
                 break;
             case 4:
-                d_puncturing_rules.emplace_back(11 * 16, P12);
-                d_puncturing_rules.emplace_back(24 * 16, P9);
-                d_puncturing_rules.emplace_back(154 * 16, P5);
-                d_puncturing_rules.emplace_back(3  * 16, P10);
+                rules.emplace_back(11 * 16, P12);
+                rules.emplace_back(24 * 16, P9);
+                rules.emplace_back(154 * 16, P5);
+                rules.emplace_back(3  * 16, P10);
                 break;
             case 5:
-                d_puncturing_rules.emplace_back(11 * 16, P6);
-                d_puncturing_rules.emplace_back(24 * 16, P5);
-                d_puncturing_rules.emplace_back(154 * 16, P2);
-                d_puncturing_rules.emplace_back(3  * 16, P5);
+                rules.emplace_back(11 * 16, P6);
+                rules.emplace_back(24 * 16, P5);
+                rules.emplace_back(154 * 16, P2);
+                rules.emplace_back(3  * 16, P5);
                 break;
             default:
                 rule_error = true;
@@ -585,22 +618,22 @@ SubchannelSource::SubchannelSource(
         case 320:
             switch (protectionLevel()) {
             case 2:
-                d_puncturing_rules.emplace_back(11 * 16, P24);
-                d_puncturing_rules.emplace_back(26 * 16, P17);
-                d_puncturing_rules.emplace_back(200 * 16, P9 );
-                d_puncturing_rules.emplace_back(3  * 16, P17);
+                rules.emplace_back(11 * 16, P24);
+                rules.emplace_back(26 * 16, P17);
+                rules.emplace_back(200 * 16, P9 );
+                rules.emplace_back(3  * 16, P17);
                 break;
             case 4:
-                d_puncturing_rules.emplace_back(11 * 16, P13);
-                d_puncturing_rules.emplace_back(25 * 16, P9);
-                d_puncturing_rules.emplace_back(201 * 16, P5);
-                d_puncturing_rules.emplace_back(3  * 16, P10);
+                rules.emplace_back(11 * 16, P13);
+                rules.emplace_back(25 * 16, P9);
+                rules.emplace_back(201 * 16, P5);
+                rules.emplace_back(3  * 16, P10);
                 break;
             case 5:
-                d_puncturing_rules.emplace_back(11 * 16, P8);
-                d_puncturing_rules.emplace_back(26 * 16, P5);
-                d_puncturing_rules.emplace_back(200 * 16, P2);
-                d_puncturing_rules.emplace_back(3  * 16, P6);
+                rules.emplace_back(11 * 16, P8);
+                rules.emplace_back(26 * 16, P5);
+                rules.emplace_back(200 * 16, P2);
+                rules.emplace_back(3  * 16, P6);
                 break;
             default:
                 rule_error = true;
@@ -609,22 +642,22 @@ SubchannelSource::SubchannelSource(
         case 384:
             switch (protectionLevel()) {
             case 1:
-                d_puncturing_rules.emplace_back(12 * 16, P24);
-                d_puncturing_rules.emplace_back(28 * 16, P20);
-                d_puncturing_rules.emplace_back(245 * 16, P14);
-                d_puncturing_rules.emplace_back(3  * 16, P23);
+                rules.emplace_back(12 * 16, P24);
+                rules.emplace_back(28 * 16, P20);
+                rules.emplace_back(245 * 16, P14);
+                rules.emplace_back(3  * 16, P23);
                 break;
             case 3:
-                d_puncturing_rules.emplace_back(11 * 16, P16);
-                d_puncturing_rules.emplace_back(24 * 16, P9);
-                d_puncturing_rules.emplace_back(250 * 16, P7);
-                d_puncturing_rules.emplace_back(3  * 16, P10);
+                rules.emplace_back(11 * 16, P16);
+                rules.emplace_back(24 * 16, P9);
+                rules.emplace_back(250 * 16, P7);
+                rules.emplace_back(3  * 16, P10);
                 break;
             case 5:
-                d_puncturing_rules.emplace_back(11 * 16, P8);
-                d_puncturing_rules.emplace_back(27 * 16, P6);
-                d_puncturing_rules.emplace_back(247 * 16, P2);
-                d_puncturing_rules.emplace_back(3  * 16, P7);
+                rules.emplace_back(11 * 16, P8);
+                rules.emplace_back(27 * 16, P6);
+                rules.emplace_back(247 * 16, P2);
+                rules.emplace_back(3  * 16, P7);
                 break;
             default:
                 rule_error = true;
@@ -655,6 +688,15 @@ size_t SubchannelSource::framesize() const
 
 
 size_t SubchannelSource::framesizeCu() const
+{
+    if (d_profile->framesize_cu) {
+        return d_profile->framesize_cu;
+    }
+    return compute_framesize_cu();
+}
+
+
+size_t SubchannelSource::compute_framesize_cu() const
 {
     size_t framesizeCu = 0;
 
@@ -1046,9 +1088,17 @@ size_t SubchannelSource::protectionOption() const
     return 0;
 }
 
-void SubchannelSource::loadSubchannelData(Buffer&& data)
+void SubchannelSource::loadSubchannelData(std::vector<uint8_t>&& data)
+{
+    d_mst = std::move(data);
+    d_data = d_mst.data();
+    d_length = d_mst.size();
+}
+
+void SubchannelSource::loadSubchannelData(const uint8_t *data, size_t length)
 {
-    d_buffer = std::move(data);
+    d_data = data;
+    d_length = length;
 }
 
 int SubchannelSource::process(Buffer* outputData)
@@ -1056,13 +1106,13 @@ int SubchannelSource::process(Buffer* outputData)
     PDEBUG("SubchannelSource::process(outputData: %p, outputSize: %zu)\n",
             outputData, outputData->getLength());
 
-    if (d_buffer.getLength() != d_framesize) {
+    if (d_length != d_framesize) {
         throw std::runtime_error(
-                "ERROR: Subchannel::process: d_buffer != d_framesize: " +
-                std::to_string(d_buffer.getLength()) + " != " +
+                "ERROR: Subchannel::process: d_length != d_framesize: " +
+                std::to_string(d_length) + " != " +
                 std::to_string(d_framesize));
     }
-    *outputData = d_buffer;
+    outputData->setData(d_data, d_length);
 
     return outputData->getLength();
 }
@@ -35,6 +35,7 @@
 #include "Eti.h"
 #include "ModPlugin.h"
 
+#include <memory>
 #include <vector>
 
 
@@ -59,16 +60,37 @@ public:
     size_t protectionOption() const;
     const std::vector<PuncturingRule>& get_rules() const;
 
-    void loadSubchannelData(Buffer&& data);
+    /* Take the MST data decoded from EDI, without copying it */
+    void loadSubchannelData(std::vector<uint8_t>&& data);
+
+    /* Use the MST data of the subchannel where it is, in the ETI frame.
+     * The data must stay valid until process() was called. */
+    void loadSubchannelData(const uint8_t *data, size_t length);
+
     int process(Buffer* outputData);
     const char* name() { return "SubchannelSource"; }
 
 private:
+    // Throw for unknown protections
+    void compute_rules(std::vector<PuncturingRule>& rules) const;
+    size_t compute_framesize_cu() const;
+
     size_t d_start_address;
     size_t d_framesize;
     size_t d_protection;
-    Buffer d_buffer;
-    std::vector<PuncturingRule> d_puncturing_rules;
+    std::vector<uint8_t> d_mst;
+    const uint8_t *d_data = nullptr;
+    size_t d_length = 0;
+
+    /* What only depends on the size and the protection of the subchannel
+     * is computed once, and shared by all the subchannels with the same
+     * profile, also across reconfigurations and restarts. framesize_cu
+     * is 0 if the protection has no known size. */
+    struct coding_profile_t {
+        std::vector<PuncturingRule> rules;
+        size_t framesize_cu = 0;
+    };
+    std::shared_ptr<const coding_profile_t> d_profile;
 };
 
 
@@ -0,0 +1,95 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SymbolStreamer.h"
+#include "PcDebug.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+// The parts start on a multiple of this number of bytes, which keeps them
+// aligned for the vector kernels and made of whole samples for all sample
+// formats, including the sample pairs of sc12.
+static constexpr size_t part_alignment = 64;
+
+SymbolStreamer::SymbolStreamer(vector<shared_ptr<ModCodec> > codecs,
+        size_t numParts) :
+    ModCodec(),
+    m_codecs(std::move(codecs)),
+    m_numParts(numParts)
+{
+    PDEBUG("SymbolStreamer::SymbolStreamer(%zu, %zu) @ %p\n",
+            m_codecs.size(), numParts, this);
+
+    if (m_codecs.empty() or m_numParts == 0) {
+        throw invalid_argument("SymbolStreamer: needs blocks and parts");
+    }
+
+    for (auto& codec : m_codecs) {
+        if (not codec->supports_streaming()) {
+            throw invalid_argument(string("SymbolStreamer: ") +
+                    codec->name() + " cannot process parts of frames");
+        }
+
+        if (auto pipelined = dynamic_pointer_cast<PipelinedModCodec>(codec)) {
+            pipelined->run_synchronously();
+        }
+    }
+}
+
+int SymbolStreamer::process(Buffer* const dataIn, Buffer* dataOut)
+{
+    PDEBUG("SymbolStreamer::process(dataIn: %p, dataOut: %p)\n",
+            dataIn, dataOut);
+
+    const size_t len = dataIn->getLength();
+    const uint8_t *in = reinterpret_cast<const uint8_t*>(dataIn->getData());
+
+    size_t part_len = (len + m_numParts - 1) / m_numParts;
+    part_len = (part_len + part_alignment - 1) / part_alignment * part_alignment;
+
+    // None of the blocks makes the samples larger, the output then gets
+    // its allocation once.
+    dataOut->setLength(len);
+    dataOut->setLength(0);
+
+    for (size_t offset = 0; offset < len; offset += part_len) {
+        m_part.setData(in + offset, std::min(part_len, len - offset));
+
+        for (auto& codec : m_codecs) {
+            if (codec->supports_in_place()) {
+                codec->process(&m_part, &m_part);
+            }
+            else {
+                codec->process(&m_part, &m_partOut);
+                std::swap(m_part, m_partOut);
+            }
+        }
+
+        dataOut->appendData(m_part.getData(), m_part.getLength());
+    }
+
+    return dataOut->getLength();
+}
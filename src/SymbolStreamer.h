@@ -0,0 +1,64 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   Runs a chain of blocks on a few OFDM symbols at a time instead of on
+   the whole transmission frame.
+*/
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include "ModPlugin.h"
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+/* The input of every call is cut into numParts parts, and each part goes
+ * through all blocks before the next one. The samples then stay in the
+ * cache from one block to the next, and the buffers between the blocks
+ * only hold one part instead of one or several transmission frames.
+ *
+ * All blocks must support_streaming(). The pipelined blocks among them
+ * run synchronously in the streamer, so that a part does not come out of
+ * them one call later. The metadata is forwarded unchanged, as none of
+ * the blocks delays it anymore. */
+class SymbolStreamer : public ModCodec
+{
+public:
+    SymbolStreamer(std::vector<std::shared_ptr<ModCodec> > codecs,
+            size_t numParts);
+
+    int process(Buffer* const dataIn, Buffer* dataOut) override;
+    const char* name() override { return "SymbolStreamer"; }
+
+protected:
+    std::vector<std::shared_ptr<ModCodec> > m_codecs;
+    const size_t m_numParts;
+
+    // The part given to the current block, and the output of that block
+    Buffer m_part;
+    Buffer m_partOut;
+};
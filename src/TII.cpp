@@ -27,6 +27,7 @@
 #include "TII.h"
 #include "PcDebug.h"
 
+#include <array>
 #include <cstdio>
 #include <cstring>
 
@@ -103,6 +104,83 @@ const int pattern_tm1_2_4[][8] = { // {{{
     {1,1,1,0,1,0,0,0},
     {1,1,1,1,0,0,0,0} }; // }}}
 
+/* The carrier of a comb that is enabled by one bit of the pattern */
+struct tii_carrier_t {
+    uint16_t index;
+    uint8_t bit;
+};
+
+template <size_t carriers_per_comb>
+using tii_table_t = std::array<std::array<tii_carrier_t, carriers_per_comb>, 24>;
+
+static constexpr uint16_t carrier_index(int carriers, int k)
+{
+    /* The OFDMGenerator shifts all positive frequencies by one,
+     * i.e. index 0 is not the DC component, it's the first positive
+     * frequency. Because this is different from the definition of k
+     * from the spec, we need to compensate this here.
+     *
+     * Positive frequencies are k > 0
+     */
+    return carriers/2 + k + (k>=0 ? -1 : 0);
+}
+
+/* ETSI EN 300 401 Clause 14.8: in TM I, A_{c,p}(k) is 1 for
+ * k = base + 2 * c + 48 * b in each of the four groups of 384 carriers,
+ * if bit b of pattern p is set.
+ */
+static constexpr tii_table_t<32> make_tii_table_tm1()
+{
+    constexpr int bases[4] = { -768, -384, 1, 385 };
+    tii_table_t<32> table{};
+    for (int comb = 0; comb < 24; comb++) {
+        for (int group = 0; group < 4; group++) {
+            for (int b = 0; b < 8; b++) {
+                table[comb][8 * group + b] = {
+                    carrier_index(1536, bases[group] + 2 * comb + 48 * b),
+                    (uint8_t)b };
+            }
+        }
+    }
+    return table;
+}
+
+/* In TM II, the first four bits of the pattern use base -192, the last
+ * four base -191. */
+static constexpr tii_table_t<8> make_tii_table_tm2()
+{
+    tii_table_t<8> table{};
+    for (int comb = 0; comb < 24; comb++) {
+        for (int b = 0; b < 8; b++) {
+            const int base = (b < 4) ? -192 : -191;
+            table[comb][b] = {
+                carrier_index(384, base + 2 * comb + 48 * b),
+                (uint8_t)b };
+        }
+    }
+    return table;
+}
+
+template <size_t carriers_per_comb>
+static constexpr bool valid_tii_table(
+        const tii_table_t<carriers_per_comb>& table, size_t carriers)
+{
+    for (const auto& comb : table) {
+        for (const auto& carrier : comb) {
+            // do_process() also writes the carrier after this one
+            if (carrier.index + 1u >= carriers) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static constexpr auto tii_carriers_tm1 = make_tii_table_tm1();
+static constexpr auto tii_carriers_tm2 = make_tii_table_tm2();
+static_assert(valid_tii_table(tii_carriers_tm1, 1536), "Invalid TII carrier for TM I");
+static_assert(valid_tii_table(tii_carriers_tm2, 384), "Invalid TII carrier for TM II");
+
 TII::TII(unsigned int dabmode, tii_config_t& tii_config, bool fixedPoint) :
     ModCodec(),
     RemoteControllable("tii"),
@@ -151,8 +229,6 @@ TII::TII(unsigned int dabmode, tii_config_t& tii_config, bool fixedPoint) :
         throw TIIError("TII::TII comb not valid!");
     }
 
-    m_Acp.clear();
-    m_Acp.resize(m_carriers);
     prepare_pattern();
 }
 
@@ -169,8 +245,8 @@ const char* TII::name()
     return m_name.c_str();
 }
 
-template<typename T>
-void do_process(size_t carriers, bool old_variant, const std::vector<bool>& Acp, Buffer* dataIn, Buffer* dataOut)
+template<typename T, typename copies_t>
+void do_process(const copies_t& copies, Buffer* dataIn, Buffer* dataOut)
 {
     const T* in = reinterpret_cast<const T*>(dataIn->getData());
     T* out = reinterpret_cast<T*>(dataOut->getData());
@@ -185,28 +261,8 @@ void do_process(size_t carriers, bool old_variant, const std::vector<bool>& Acp,
      * This is because we only enable 32 out of 1536 carriers, not because
      * every carrier is lower power.
      */
-    for (size_t i = 0; i < Acp.size(); i++) {
-        /* See header file for an explanation of the old variant.
-         *
-         * A_{c,p}(k) and A_{c,p}(k-1) are never both simultaneously true,
-         * so instead of doing the sum inside z_{m,0,k}, we could do
-         *
-         * if (m_Acp[i]) out[i] = in[i];
-         * if (m_Acp[i-1]) out[i] = in[i-1]
-         *
-         * (Considering only the new variant)
-         *
-         * To avoid messing with indices, we substitute j = i-1
-         *
-         * if (m_Acp[i]) out[i] = in[i];
-         * if (m_Acp[j]) out[j+1] = in[j]
-         *
-         * and fuse the two conditionals together:
-         */
-        if (Acp[i]) {
-            out[i] = in[i];
-            out[i+1] = (old_variant ? in[i+1] : in[i]);
-        }
+    for (const auto& copy : copies) {
+        out[copy.dst] = in[copy.src];
     }
 }
 
@@ -224,17 +280,22 @@ int TII::process(Buffer* dataIn, Buffer* dataOut)
     dataOut->setLength(m_carriers * sizeof_samples);
     memset(dataOut->getData(), 0, dataOut->getLength());
 
+    // A new pattern is applied at a frame boundary. If the RC thread is
+    // still preparing it, it gets applied at the next frame.
+    if (m_pattern_changed.load(std::memory_order_acquire)) {
+        std::unique_lock<std::mutex> lock(m_next_copies_mutex, std::try_to_lock);
+        if (lock.owns_lock()) {
+            std::swap(m_copies, m_next_copies);
+            m_pattern_changed.store(false, std::memory_order_relaxed);
+        }
+    }
+
     if (m_conf.enable and m_insert) {
-        std::lock_guard<std::mutex> lock(m_enabled_carriers_mutex);
         if (m_fixedPoint) {
-            do_process<complexfix>(
-                    m_carriers, m_conf.old_variant, m_Acp,
-                    dataIn, dataOut);
+            do_process<complexfix>(m_copies, dataIn, dataOut);
         }
         else {
-            do_process<complexf>(
-                    m_carriers, m_conf.old_variant, m_Acp,
-                    dataIn, dataOut);
+            do_process<complexf>(m_copies, dataIn, dataOut);
         }
     }
 
@@ -244,96 +305,56 @@ int TII::process(Buffer* dataIn, Buffer* dataOut)
     return 1;
 }
 
-void TII::enable_carrier(int k)
-{
-    /* The OFDMGenerator shifts all positive frequencies by one,
-     * i.e. index 0 is not the DC component, it's the first positive
-     * frequency. Because this is different from the definition of k
-     * from the spec, we need to compensate this here.
-     *
-     * Positive frequencies are k > 0
-     */
-    int ix = m_carriers/2 + k + (k>=0 ? -1 : 0);
-
-    if (ix < 0 or ix+1 >= (ssize_t)m_Acp.size()) {
-        throw TIIError("TII::enable_carrier invalid k!");
-    }
-
-    m_Acp[ix] = true;
-}
-
 void TII::prepare_pattern()
 {
-    int comb = m_conf.comb; // Convert from unsigned to signed
-
-    std::lock_guard<std::mutex> lock(m_enabled_carriers_mutex);
+    const int *pattern = pattern_tm1_2_4[m_conf.pattern];
 
-    // Clear previous pattern
-    for (size_t i = 0; i < m_Acp.size(); i++) {
-        m_Acp[i] = false;
-    }
-
-    // This could be written more efficiently, but since it is
-    // not performance-critial, it makes sense to write it
-    // in the same way as the specification in
-    // ETSI EN 300 401 Clause 14.8
-    if (m_dabmode == 1) {
-        for (int k = -768; k < -384; k++) {
-            for (int b = 0; b < 8; b++) {
-                if (    k == -768 + 2 * comb + 48 * b and
-                        pattern_tm1_2_4[m_conf.pattern][b]) {
-                    enable_carrier(k);
-                }
-            }
-        }
-
-        for (int k = -384; k < -0; k++) {
-            for (int b = 0; b < 8; b++) {
-                if (    k == -384 + 2 * comb + 48 * b and
-                        pattern_tm1_2_4[m_conf.pattern][b]) {
-                    enable_carrier(k);
-                }
-            }
-        }
-
-        for (int k = 1; k <= 384; k++) {
-            for (int b = 0; b < 8; b++) {
-                if (    k == 1 + 2 * comb + 48 * b and
-                        pattern_tm1_2_4[m_conf.pattern][b]) {
-                    enable_carrier(k);
-                }
+    /* See header file for an explanation of the old variant.
+     *
+     * A_{c,p}(k) and A_{c,p}(k-1) are never both simultaneously true,
+     * so instead of doing the sum inside z_{m,0,k}, we could do
+     *
+     * if (Acp[i]) out[i] = in[i];
+     * if (Acp[i-1]) out[i] = in[i-1]
+     *
+     * (Considering only the new variant)
+     *
+     * To avoid messing with indices, we substitute j = i-1
+     *
+     * if (Acp[i]) out[i] = in[i];
+     * if (Acp[j]) out[j+1] = in[j]
+     *
+     * and fuse the two conditionals together. Only the carriers for
+     * which the conditional is true give copies.
+     */
+    const bool old_variant = m_conf.old_variant;
+    auto select_carriers = [&](const auto& comb) {
+        std::vector<carrier_copy_t> copies;
+        for (const auto& carrier : comb) {
+            if (pattern[carrier.bit]) {
+                const uint16_t i = carrier.index;
+                copies.push_back({i, i});
+                copies.push_back({(uint16_t)(i + 1),
+                        (uint16_t)(old_variant ? i + 1 : i)});
             }
         }
+        return copies;
+    };
 
-        for (int k = 385; k <= 768; k++) {
-            for (int b = 0; b < 8; b++) {
-                if (    k == 385 + 2 * comb + 48 * b and
-                        pattern_tm1_2_4[m_conf.pattern][b]) {
-                    enable_carrier(k);
-                }
-            }
-        }
+    std::vector<carrier_copy_t> copies;
+    if (m_dabmode == 1) {
+        copies = select_carriers(tii_carriers_tm1[m_conf.comb]);
     }
     else if (m_dabmode == 2) {
-        for (int k = -192; k <= 192; k++) {
-            for (int b = 0; b < 4; b++) {
-                if (    k == -192 + 2 * comb + 48 * b and
-                        pattern_tm1_2_4[m_conf.pattern][b]) {
-                    enable_carrier(k);
-                }
-            }
-
-            for (int b = 4; b < 8; b++) {
-                if (    k == -191 + 2 * comb + 48 * b and
-                        pattern_tm1_2_4[m_conf.pattern][b]) {
-                    enable_carrier(k);
-                }
-            }
-        }
+        copies = select_carriers(tii_carriers_tm2[m_conf.comb]);
     }
     else {
         throw TIIError("TII::TII DAB mode not valid!");
     }
+
+    std::lock_guard<std::mutex> lock(m_next_copies_mutex);
+    m_next_copies = std::move(copies);
+    m_pattern_changed.store(true, std::memory_order_release);
 }
 
 void TII::set_parameter(const std::string& parameter, const std::string& value)
@@ -366,6 +387,7 @@ void TII::set_parameter(const std::string& parameter, const std::string& value)
     }
     else if (parameter == "old_variant") {
         ss >> m_conf.old_variant;
+        prepare_pattern();
     }
     else {
         stringstream ss_err;
@@ -35,7 +35,10 @@
 #include "ModPlugin.h"
 #include "RemoteControl.h"
 
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <mutex>
 #include <vector>
 #include <string>
 
@@ -91,13 +94,10 @@ class TII : public ModCodec, public RemoteControllable
         virtual const json::map_t get_all_values() const override;
 
     protected:
-        // Fill m_Acp with the correct carriers for the pattern/comb
-        // combination
+        // Fill m_next_copies with the carriers of the pattern/comb
+        // combination and the variant
         void prepare_pattern(void);
 
-        // prerequisites: calling thread must hold m_Acp mutex
-        void enable_carrier(int k);
-
         // Configuration settings
         unsigned int m_dabmode;
 
@@ -113,13 +113,22 @@ class TII : public ModCodec, public RemoteControllable
 
         std::string m_name;
 
-        // m_Acp is read by modulator thread, and written
-        // to by RC thread.
-        mutable std::mutex m_enabled_carriers_mutex;
-
-        // m_Acp corresponds to the A_{c,p}(k) function from the spec, except
-        // that the leftmost carrier is at index 0, and not at -m_carriers/2 like
-        // in the spec.
-        std::vector<bool> m_Acp;
+        // The output carrier dst takes the phase reference of carrier src
+        struct carrier_copy_t {
+            uint16_t dst;
+            uint16_t src;
+        };
+
+        /* m_copies is only used by the modulator thread. The RC thread
+         * prepares a new pattern in m_next_copies, and the modulator swaps
+         * them at the start of the next frame. The carriers are those for
+         * which the A_{c,p}(k) function from the spec is 1, except that the
+         * leftmost carrier is at index 0, and not at -m_carriers/2 like in
+         * the spec, and each of them gives two copies. */
+        std::vector<carrier_copy_t> m_copies;
+
+        std::mutex m_next_copies_mutex;
+        std::vector<carrier_copy_t> m_next_copies;
+        std::atomic<bool> m_pattern_changed = ATOMIC_VAR_INIT(false);
 };
 
@@ -22,23 +22,34 @@
 #include "TimeInterleaver.h"
 #include "PcDebug.h"
 
+#include <algorithm>
 #include <vector>
 #include <string>
 #include <stdint.h>
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+/* Delay in frames of every bit of the output bytes, MSB first,
+ * for even and odd bytes. */
+static const uint8_t delays[2][8] = {
+    {0, 8, 4, 12, 2, 10, 6, 14},
+    {1, 9, 5, 13, 3, 11, 7, 15} };
 
 
 TimeInterleaver::TimeInterleaver(size_t framesize) :
         ModCodec(),
-        d_framesize(framesize)
+        d_framesize(framesize),
+        d_history(16 * framesize, 0)
 {
     PDEBUG("TimeInterleaver::TimeInterleaver(%zu) @ %p\n", framesize, this);
 
     if (framesize & 1) {
         throw std::invalid_argument("framesize must be 16 bits multiple");
     }
-    for (int i = 0; i < 16; ++i) {
-        d_history.emplace_back(framesize, 0);
-    }
 }
 
 
@@ -48,6 +59,24 @@ TimeInterleaver::~TimeInterleaver()
 }
 
 
+void TimeInterleaver::update_masks()
+{
+    for (size_t parity = 0; parity < 2; parity++) {
+        for (size_t column = 0; column < 16; column++) {
+            d_masks[parity][column] = 0;
+        }
+
+        for (size_t bit = 0; bit < 8; bit++) {
+            const uint8_t delay = delays[parity][bit];
+            if (delay != 0) {
+                const size_t column = (d_column + 16 - delay) % 16;
+                d_masks[parity][column] = 0x80 >> bit;
+            }
+        }
+    }
+}
+
+
 int TimeInterleaver::process(Buffer* const dataIn, Buffer* dataOut)
 {
     PDEBUG("TimeInterleaver::process(dataIn: %p, dataOut: %p)\n",
@@ -60,37 +89,84 @@ int TimeInterleaver::process(Buffer* const dataIn, Buffer* dataOut)
     }
 
     dataOut->setLength(dataIn->getLength());
-    const unsigned char* in = reinterpret_cast<const unsigned char*>(dataIn->getData());
-    unsigned char* out = reinterpret_cast<unsigned char*>(dataOut->getData());
-
-    for (size_t i = 0; i < dataOut->getLength();) {
-        d_history.push_front(move(d_history.back()));
-        d_history.pop_back();
-        for (uint_fast16_t j = 0; j < d_framesize;) {
-            d_history[0][j] = in[i];
-            out[i]  = d_history[0] [j] & 0x80;
-            out[i] |= d_history[8] [j] & 0x40;
-            out[i] |= d_history[4] [j] & 0x20;
-            out[i] |= d_history[12][j] & 0x10;
-            out[i] |= d_history[2] [j] & 0x08;
-            out[i] |= d_history[10][j] & 0x04;
-            out[i] |= d_history[6] [j] & 0x02;
-            out[i] |= d_history[14][j] & 0x01;
-            ++i;
-            ++j;
-            d_history[0][j] = in[i];
-            out[i]  = d_history[1] [j] & 0x80;
-            out[i] |= d_history[9] [j] & 0x40;
-            out[i] |= d_history[5] [j] & 0x20;
-            out[i] |= d_history[13][j] & 0x10;
-            out[i] |= d_history[3] [j] & 0x08;
-            out[i] |= d_history[11][j] & 0x04;
-            out[i] |= d_history[7] [j] & 0x02;
-            out[i] |= d_history[15][j] & 0x01;
-            ++i;
-            ++j;
+    const uint8_t* in = reinterpret_cast<const uint8_t*>(dataIn->getData());
+    uint8_t* out = reinterpret_cast<uint8_t*>(dataOut->getData());
+
+    // The new frame replaces the one that is 16 frames old
+    d_column = (d_column + 1) % 16;
+    update_masks();
+
+    // Every column contributes to a different bit, so adding up the
+    // masked bytes of a row gives the same as ORing them. The row is
+    // read before the input byte is written to it, which avoids
+    // reloading a vector right after storing into it.
+    uint8_t* row = d_history.data();
+    size_t j = 0;
+
+#ifdef __SSE2__
+    const __m128i mask_even = _mm_loadu_si128((const __m128i*)d_masks[0]);
+    const __m128i mask_odd = _mm_loadu_si128((const __m128i*)d_masks[1]);
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; j + 2 <= d_framesize; j += 2, row += 32) {
+        const __m128i even = _mm_sad_epu8(_mm_and_si128(
+                    _mm_loadu_si128((const __m128i*)row), mask_even), zero);
+        const __m128i odd = _mm_sad_epu8(_mm_and_si128(
+                    _mm_loadu_si128((const __m128i*)(row + 16)), mask_odd), zero);
+
+        // psadbw gives one sum per half of the vector
+        const __m128i sums = _mm_add_epi64(
+                _mm_unpacklo_epi64(even, odd),
+                _mm_unpackhi_epi64(even, odd));
+
+        out[j] = _mm_cvtsi128_si32(sums) | (in[j] & 0x80);
+        out[j + 1] = _mm_extract_epi16(sums, 4);
+
+        row[d_column] = in[j];
+        row[16 + d_column] = in[j + 1];
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const uint8x16_t mask_even = vld1q_u8(d_masks[0]);
+    const uint8x16_t mask_odd = vld1q_u8(d_masks[1]);
+
+    for (; j + 2 <= d_framesize; j += 2, row += 32) {
+        out[j] = vaddvq_u8(vandq_u8(vld1q_u8(row), mask_even)) |
+            (in[j] & 0x80);
+        out[j + 1] = vaddvq_u8(vandq_u8(vld1q_u8(row + 16), mask_odd));
+
+        row[d_column] = in[j];
+        row[16 + d_column] = in[j + 1];
+    }
+#endif
+
+    for (; j < d_framesize; j++, row += 16) {
+        const uint8_t* mask = d_masks[j % 2];
+        uint8_t value = (j % 2 == 0) ? (in[j] & 0x80) : 0;
+        for (size_t column = 0; column < 16; column++) {
+            value |= row[column] & mask[column];
         }
+        out[j] = value;
+        row[d_column] = in[j];
     }
 
     return dataOut->getLength();
 }
+
+
+std::vector<uint8_t> TimeInterleaver::save_state() const
+{
+    std::vector<uint8_t> state(d_history);
+    state.push_back(d_column);
+    return state;
+}
+
+
+void TimeInterleaver::restore_state(const std::vector<uint8_t>& state)
+{
+    if (state.size() != d_history.size() + 1 or state.back() >= 16) {
+        throw std::invalid_argument("TimeInterleaver state does not fit");
+    }
+
+    std::copy(state.begin(), state.end() - 1, d_history.begin());
+    d_column = state.back();
+}
@@ -29,18 +29,30 @@
 #include "ModPlugin.h"
 
 #include <vector>
-#include <deque>
 #include <stdexcept>
+#include <stdint.h>
 #include <sys/types.h>
 
-
+/* The history of the last 16 frames is kept in a single buffer, in which
+ * the 16 bytes at the same position in the frames are next to each other.
+ * Frame n is stored in column n % 16: every new frame overwrites the
+ * oldest one, and all bits that make up an output byte are in one
+ * 16-byte row.
+ */
 class TimeInterleaver : public ModCodec
 {
 private:
+    /* For even and odd bytes, compute the bit mask to apply to every
+     * column, depending on the delay of the frame it contains. A single
+     * bit is set in eight of the sixteen columns. The column of the
+     * current frame is left out, its bit is taken from the input. */
+    void update_masks();
 
 protected:
     size_t d_framesize;
-    std::deque<std::vector<unsigned char> > d_history;
+    std::vector<uint8_t> d_history;
+    size_t d_column = 0;
+    uint8_t d_masks[2][16];
 
 public:
     TimeInterleaver(size_t framesize);
@@ -48,6 +60,13 @@ public:
 
     int process(Buffer* const dataIn, Buffer* dataOut);
     const char* name() { return "TimeInterleaver"; }
+    size_t memory_usage() const override { return d_history.size(); }
+
+    /* The history of the last frames, to continue the interleaving in a
+     * new TimeInterleaver of the same framesize. restore_state() throws
+     * std::invalid_argument if the state does not fit. */
+    std::vector<uint8_t> save_state() const;
+    void restore_state(const std::vector<uint8_t>& state);
 };
 
 
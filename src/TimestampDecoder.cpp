@@ -36,53 +36,36 @@
 //#define MDEBUG(fmt, args...) fprintf (LOG, "*****" fmt , ## args)
 #define MDEBUG(fmt, args...) PDEBUG(fmt, ## args)
 
-double frame_timestamp::offset_to_system_time() const
+double frame_timestamp::system_time()
 {
-    if (not timestamp_valid) {
-        throw new std::runtime_error("Cannot calculate offset for invalid timestamp");
-    }
-
     struct timespec t;
     if (clock_gettime(CLOCK_REALTIME, &t) != 0) {
         throw std::runtime_error(std::string("Failed to retrieve CLOCK_REALTIME") + strerror(errno));
     }
 
-    return get_real_secs() - (double)t.tv_sec - (t.tv_nsec / 1000000000.0);
+    return (double)t.tv_sec + (t.tv_nsec / 1000000000.0);
+}
+
+double frame_timestamp::offset_to_system_time() const
+{
+    if (not timestamp_valid) {
+        throw new std::runtime_error("Cannot calculate offset for invalid timestamp");
+    }
+
+    return get_real_secs() - system_time();
 }
 
 std::string frame_timestamp::to_string() const
 {
-    time_t s = timestamp_sec;
+    time_t s = timestamp_sec();
     std::stringstream ss;
     char timestr[100];
     if (std::strftime(timestr, sizeof(timestr), "%Y-%m-%dZ%H:%M:%S", std::gmtime(&s))) {
-        ss << timestr << " + " << ((double)timestamp_pps / 16384000.0);
+        ss << timestr << " + " << pps_offset();
     }
     return ss.str();
 }
 
-frame_timestamp& frame_timestamp::operator+=(const double& diff)
-{
-    double offset_pps, offset_secs;
-    offset_pps = modf(diff, &offset_secs);
-
-    this->timestamp_sec += lrint(offset_secs);
-    int64_t new_pps = (int64_t)this->timestamp_pps + llrint(offset_pps * 16384000.0);
-
-    while (new_pps < 0) {
-        this->timestamp_sec -= 1;
-        new_pps += 16384000;
-    }
-
-    while (new_pps >= 16384000) {
-        this->timestamp_sec += 1;
-        new_pps -= 16384000;
-    }
-
-    this->timestamp_pps = new_pps;
-    return *this;
-}
-
 TimestampDecoder::TimestampDecoder(double& offset_s) :
         RemoteControllable("tist"),
         timestamp_offset(offset_s)
@@ -105,14 +88,14 @@ frame_timestamp TimestampDecoder::getTimestamp()
     frame_timestamp ts;
 
     ts.timestamp_valid = full_timestamp_received;
-    ts.timestamp_sec = time_secs;
-    ts.timestamp_pps = time_pps;
+    ts.set_timestamp(time_secs, time_pps);
     ts.fct = latestFCT;
     ts.fp = latestFP;
 
     ts.timestamp_offset = timestamp_offset;
     ts.offset_changed = offset_changed;
     offset_changed = false;
+    ts.received = frame_timestamp::system_time();
 
     ts += timestamp_offset;
 
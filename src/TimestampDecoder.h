@@ -26,6 +26,7 @@
 
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <memory>
 #include <string>
@@ -33,20 +34,59 @@
 #include <stdio.h>
 #include "RemoteControl.h"
 
+/* The TIST resolution, all timestamps are integer numbers of these ticks */
+static constexpr int64_t TIMESTAMP_TICKS_PER_SECOND = 16384000;
+
 struct frame_timestamp
 {
     // Which frame count does this timestamp apply to
     int32_t fct;
     uint8_t fp; // Frame Phase
 
-    uint32_t timestamp_sec; // seconds in unix epoch
-    uint32_t timestamp_pps; // In units of 1/16384000 s
+    // Time in units of 1/16384000 s since the unix epoch. The arithmetic
+    // and the comparisons on it are exact.
+    int64_t ticks = 0;
     bool timestamp_valid = false;
 
     double timestamp_offset = 0.0; // copy of the configured modulator offset
     bool offset_changed = false;
 
-    frame_timestamp& operator+=(const double& diff);
+    // System time at which the modulator received the frame, and how long
+    // the just-in-time start delayed its modulation, in seconds. received
+    // is 0 if not known.
+    double received = 0.0;
+    double schedule_wait = 0.0;
+
+    // CLOCK_REALTIME in seconds
+    static double system_time();
+
+    // Rounded to the nearest tick
+    static int64_t seconds_to_ticks(double seconds) {
+        return llrint(seconds * TIMESTAMP_TICKS_PER_SECOND);
+    }
+
+    // The number of ticks in num_samples at sample_rate, rounded down
+    static int64_t samples_to_ticks(size_t num_samples, size_t sample_rate) {
+        return (int64_t)num_samples * TIMESTAMP_TICKS_PER_SECOND /
+            (int64_t)sample_rate;
+    }
+
+    uint32_t timestamp_sec() const { // seconds in unix epoch
+        return ticks / TIMESTAMP_TICKS_PER_SECOND;
+    }
+
+    uint32_t timestamp_pps() const { // In units of 1/16384000 s
+        return ticks % TIMESTAMP_TICKS_PER_SECOND;
+    }
+
+    void set_timestamp(uint32_t seconds, uint32_t pps) {
+        ticks = (int64_t)seconds * TIMESTAMP_TICKS_PER_SECOND + pps;
+    }
+
+    frame_timestamp& operator+=(const double& diff) {
+        ticks += seconds_to_ticks(diff);
+        return *this;
+    }
 
     const frame_timestamp operator+(const double diff) const {
         frame_timestamp ts = *this;
@@ -55,27 +95,28 @@ struct frame_timestamp
     }
 
     double pps_offset() const {
-        return timestamp_pps / 16384000.0;
+        return timestamp_pps() / (double)TIMESTAMP_TICKS_PER_SECOND;
     }
 
     double offset_to_system_time() const;
 
     double get_real_secs() const {
-        double t = timestamp_sec;
+        double t = timestamp_sec();
         t += pps_offset();
         return t;
     }
 
+    // 1/16384000 s is 15625/256 ns
     long long int get_ns() const {
-        long long int ns = timestamp_sec * 1000000000ull;
-        ns += llrint((double)timestamp_pps / 0.016384);
+        long long int ns = timestamp_sec() * 1000000000ll;
+        ns += ((int64_t)timestamp_pps() * 15625 + 128) / 256;
         return ns;
     }
 
     void set_ns(long long int time_ns) {
-        timestamp_sec = time_ns / 1000000000ull;
-        const long long int subsecond = time_ns % 1000000000ull;
-        timestamp_pps = lrint(subsecond * 16384000.0);
+        const int64_t subsecond = time_ns % 1000000000ll;
+        ticks = (time_ns / 1000000000ll) * TIMESTAMP_TICKS_PER_SECOND +
+            (subsecond * 256 + 7812) / 15625;
     }
 
     std::string to_string() const;
@@ -84,7 +125,7 @@ struct frame_timestamp
         etiLog.log(debug,
                 "%s <frame_timestamp(%s, %d, %.9f, %d)>\n",
                 t, this->timestamp_valid ? "valid" : "invalid",
-                 this->timestamp_sec, pps_offset(),
+                 this->timestamp_sec(), pps_offset(),
                  this->fct);
     }
 };
@@ -0,0 +1,167 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "TxChannels.h"
+#include "PcDebug.h"
+
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+ChannelSplitter::ChannelSplitter(const vector<float>& gains) :
+    ModPlugin(),
+    RemoteControllable("txchannels"),
+    m_gains(gains)
+{
+    PDEBUG("ChannelSplitter::ChannelSplitter(%zu) @ %p\n", gains.size(), this);
+
+    RC_ADD_PARAMETER(digital_gains,
+            "Digital gain of every TX channel, separated by spaces");
+}
+
+int ChannelSplitter::process(vector<Buffer*> dataIn, vector<Buffer*> dataOut)
+{
+    if (dataIn.size() != 1) {
+        throw logic_error("ChannelSplitter needs one input");
+    }
+
+    vector<float> gains;
+    {
+        lock_guard<mutex> lock(m_gains_mutex);
+        gains = m_gains;
+    }
+
+    if (dataOut.size() != gains.size()) {
+        throw logic_error("ChannelSplitter: " + to_string(dataOut.size()) +
+                " outputs for " + to_string(gains.size()) + " channels");
+    }
+
+    const size_t len = dataIn[0]->getLength();
+    const size_t num_samples = len / sizeof(complexf);
+    const complexf *in = reinterpret_cast<const complexf*>(dataIn[0]->getData());
+
+    for (size_t c = 0; c < dataOut.size(); c++) {
+        dataOut[c]->setLength(len);
+        complexf *out = reinterpret_cast<complexf*>(dataOut[c]->getData());
+
+        if (gains[c] == 1.0f) {
+            memcpy(out, in, len);
+        }
+        else {
+            const float gain = gains[c];
+            for (size_t i = 0; i < num_samples; i++) {
+                out[i] = in[i] * gain;
+            }
+        }
+    }
+
+    return len;
+}
+
+void ChannelSplitter::set_parameter(const string& parameter, const string& value)
+{
+    if (parameter == "digital_gains") {
+        stringstream ss(value);
+        vector<float> gains;
+        for (float gain; ss >> gain; ) {
+            gains.push_back(gain);
+        }
+
+        lock_guard<mutex> lock(m_gains_mutex);
+        if (not ss.eof() or gains.size() != m_gains.size()) {
+            throw ParameterError("digital_gains needs " +
+                    to_string(m_gains.size()) + " values");
+        }
+        m_gains = gains;
+    }
+    else {
+        stringstream ss;
+        ss << "Parameter '" << parameter <<
+            "' is not exported by controllable " << get_rc_name();
+        throw ParameterError(ss.str());
+    }
+}
+
+const string ChannelSplitter::get_parameter(const string& parameter) const
+{
+    stringstream ss;
+    if (parameter == "digital_gains") {
+        lock_guard<mutex> lock(m_gains_mutex);
+        for (size_t c = 0; c < m_gains.size(); c++) {
+            ss << (c == 0 ? "" : " ") << m_gains[c];
+        }
+    }
+    else {
+        ss << "Parameter '" << parameter <<
+            "' is not exported by controllable " << get_rc_name();
+        throw ParameterError(ss.str());
+    }
+    return ss.str();
+}
+
+const json::map_t ChannelSplitter::get_all_values() const
+{
+    json::map_t map;
+    map["digital_gains"].v = get_parameter("digital_gains");
+    return map;
+}
+
+
+ChannelCombiner::ChannelCombiner(size_t num_channels) :
+    ModMux(),
+    m_num_channels(num_channels)
+{
+    PDEBUG("ChannelCombiner::ChannelCombiner(%zu) @ %p\n", num_channels, this);
+}
+
+int ChannelCombiner::process(vector<Buffer*> dataIn, Buffer* dataOut)
+{
+    if (dataIn.size() != m_num_channels) {
+        throw logic_error("ChannelCombiner: " + to_string(dataIn.size()) +
+                " inputs for " + to_string(m_num_channels) + " channels");
+    }
+
+    const size_t len = dataIn[0]->getLength();
+    for (const auto in : dataIn) {
+        if (in->getLength() != len) {
+            throw logic_error("ChannelCombiner: inputs of different length");
+        }
+    }
+
+    dataOut->setLength(len * m_num_channels);
+    uint8_t *out = reinterpret_cast<uint8_t*>(dataOut->getData());
+    for (size_t c = 0; c < m_num_channels; c++) {
+        memcpy(out + c * len, dataIn[c]->getData(), len);
+    }
+
+    return dataOut->getLength();
+}
+
+meta_vec_t ChannelCombiner::process_metadata(const meta_vec_t& metadataIn)
+{
+    // The flowgraph gives the metadata of all inputs one after the other
+    return meta_vec_t(metadataIn.begin(),
+            metadataIn.begin() + metadataIn.size() / m_num_channels);
+}
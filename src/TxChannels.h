@@ -0,0 +1,80 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   Fan-out of the modulated signal to several TX channels of the same
+   SDR device, and packing of the channels into one output buffer.
+*/
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include "ModPlugin.h"
+#include "RemoteControl.h"
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+/* Gives the complexf samples of its input to one output per TX channel,
+ * multiplied by the digital gain of that channel. The outputs are in the
+ * order in which they are connected in the flowgraph. */
+class ChannelSplitter : public ModPlugin, public RemoteControllable
+{
+public:
+    ChannelSplitter(const std::vector<float>& gains);
+
+    int process(std::vector<Buffer*> dataIn,
+            std::vector<Buffer*> dataOut) override;
+    const char* name() override { return "ChannelSplitter"; }
+
+    /******* REMOTE CONTROL ********/
+    virtual void set_parameter(const std::string& parameter,
+            const std::string& value) override;
+    virtual const std::string get_parameter(
+            const std::string& parameter) const override;
+    virtual const json::map_t get_all_values() const override;
+
+private:
+    mutable std::mutex m_gains_mutex;
+    std::vector<float> m_gains;
+};
+
+/* Puts the samples of all TX channels one after the other into its output,
+ * in the order of its inputs. Every input carries the same metadata, only
+ * that of the first one is given further. */
+class ChannelCombiner : public ModMux, public ModMetadata
+{
+public:
+    ChannelCombiner(size_t num_channels);
+
+    int process(std::vector<Buffer*> dataIn, Buffer* dataOut) override;
+    const char* name() override { return "ChannelCombiner"; }
+
+    virtual meta_vec_t process_metadata(const meta_vec_t& metadataIn) override;
+
+private:
+    size_t m_num_channels;
+};
@@ -26,15 +26,31 @@
  */
 
 #include "Utils.h"
+#include "CpuFeatures.h"
+#include "AllocationTracker.h"
 
+#include <cerrno>
 #include <ctime>
 #include <cstring>
 #include <sstream>
+#include <stdexcept>
 #include <iomanip>
+#include <fstream>
 #include <pthread.h>
+#include <sched.h>
+#include <alloca.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <fftw3.h>
 #if defined(HAVE_PRCTL)
 #  include <sys/prctl.h>
 #endif
+#if defined(__linux__)
+#  include <sys/syscall.h>
+#  include <dirent.h>
+#  include <linux/mempolicy.h>
+#endif
+#include "Log.h"
 
 
 static void printHeader()
@@ -70,6 +86,12 @@ static void printHeader()
         "NEON " <<
 #endif
         "\n";
+
+    std::cerr << "SIMD instruction sets of the CPU:";
+    for (const auto& name : cpu_features().cpu_names()) {
+        std::cerr << " " << name;
+    }
+    std::cerr << "\n";
 }
 
 void printUsage(const char* progName)
@@ -103,6 +125,7 @@ void printUsage(const char* progName)
     fprintf(out, "Where:\n");
     fprintf(out, "input:         ETI input filename (default: stdin), or\n");
     fprintf(out, "                  tcp://source:port for ETI-over-TCP input, or\n");
+    fprintf(out, "                  zmq+tcp://source:port for ETI-over-ZeroMQ input, or\n");
     fprintf(out, "                  udp://:port for EDI input.\n");
     fprintf(out, "-f name:       Use file output with given filename. (use /dev/stdout for standard output)\n");
     fprintf(out, "-F format:     Set the output format (see doc/example.ini for formats) for the file output.\n");
@@ -163,6 +186,9 @@ void printModSettings(const mod_settings_t& mod_settings)
 {
     std::stringstream ss;
     // Print settings
+    if (not mod_settings.ensembleName.empty()) {
+        ss << "Ensemble " << mod_settings.ensembleName << "\n";
+    }
     ss << "Input\n";
     ss << "  Type: " << mod_settings.inputTransport << "\n";
     ss << "  Source: " << mod_settings.inputName << "\n";
@@ -214,10 +240,31 @@ void printModSettings(const mod_settings_t& mod_settings)
             "  refclk: " << mod_settings.sdr_device_config.refclk_src << "\n";
     }
 #endif
+    else if (mod_settings.useSimulatedOutput) {
+        ss << " Simulated\n"
+            "  Buffer: " << mod_settings.sdr_device_config.simulatedBufferMs << " ms\n" <<
+            "  Loopback: " <<
+                (mod_settings.sdr_device_config.simulatedLoopback ? "yes" : "no") << "\n";
+    }
     else if (mod_settings.useZeroMQOutput) {
         ss << " ZeroMQ\n" <<
             "  Listening on: " << mod_settings.outputName << "\n" <<
-            "  Socket type : " << mod_settings.zmqOutputSocketType << "\n";
+            "  Socket type : " << mod_settings.zmqOutputSocketType << "\n" <<
+            "  Header      : " << (mod_settings.zmqOutputHeader ? "yes" : "no") << "\n";
+    }
+    else if (mod_settings.useVita49Output) {
+        ss << " VITA 49\n" <<
+            "  Destination : " << mod_settings.outputName << ":" <<
+            mod_settings.vita49OutputPort << "\n" <<
+            "  Format      : " << mod_settings.vita49OutputFormat << "\n" <<
+            "  Stream ID   : " << mod_settings.vita49OutputStreamId << "\n";
+    }
+    else if (mod_settings.fdmIndex > 0) {
+        ss << " Frequency multiplexed into ensemble " <<
+            mod_settings.fdmEnsembles.front().ensembleName << "\n" <<
+            "  Offset: " << std::fixed << std::setprecision(4) <<
+            mod_settings.fdmEnsembles[mod_settings.fdmIndex].frequencyOffset /
+            1000.0 << " kHz\n";
     }
 
     ss << "  Sampling rate: ";
@@ -250,11 +297,373 @@ int set_realtime_prio(int prio)
     return ret;
 }
 
+int lock_memory()
+{
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        return errno;
+    }
+    return 0;
+}
+
+void prefault_stack(size_t size)
+{
+    // alloca is not optimised away like an unused array
+    volatile uint8_t *stack = static_cast<volatile uint8_t*>(alloca(size));
+    const size_t page_size = sysconf(_SC_PAGESIZE);
+    for (size_t i = 0; i < size; i += page_size) {
+        stack[i] = 0;
+    }
+}
+
+std::mutex fftw_planner_mutex;
+
+static std::string s_fftw_wisdom_file;
+static unsigned s_fftw_plan_flags = FFTW_MEASURE;
+static double s_fftw_timelimit = 2;
+
+void configure_fftw_planner(const std::string& wisdom_file,
+        const std::string& plan_mode)
+{
+    std::lock_guard<std::mutex> lock(fftw_planner_mutex);
+
+    if (plan_mode == "estimate") {
+        s_fftw_plan_flags = FFTW_ESTIMATE;
+    }
+    else if (plan_mode == "measure") {
+        s_fftw_plan_flags = FFTW_MEASURE;
+    }
+    else if (plan_mode == "patient") {
+        s_fftw_plan_flags = FFTW_PATIENT;
+    }
+    else if (plan_mode == "exhaustive") {
+        s_fftw_plan_flags = FFTW_EXHAUSTIVE;
+    }
+    else {
+        throw std::invalid_argument("Unknown FFTW plan mode " + plan_mode);
+    }
+
+    s_fftw_wisdom_file = wisdom_file;
+
+    if (wisdom_file.empty()) {
+        s_fftw_timelimit = 2;
+        return;
+    }
+
+    s_fftw_timelimit = FFTW_NO_TIMELIMIT;
+
+    if (fftwf_import_wisdom_from_filename(wisdom_file.c_str())) {
+        etiLog.level(info) << "FFTW wisdom loaded from " << wisdom_file;
+    }
+    else {
+        etiLog.level(info) << "Could not load FFTW wisdom from " <<
+            wisdom_file << ", it will be created";
+    }
+}
+
+unsigned prepare_fftw_planner(unsigned num_threads)
+{
+#if defined(HAVE_FFTW_THREADS)
+    // The number of threads applies to all plans created afterwards, so
+    // it is set again for every plan once threads were initialised.
+    static bool s_fftw_threads_initialised = false;
+    if (num_threads > 1 and not s_fftw_threads_initialised) {
+        if (fftwf_init_threads() == 0) {
+            throw std::runtime_error("Could not initialise FFTW threads");
+        }
+        s_fftw_threads_initialised = true;
+    }
+    if (s_fftw_threads_initialised) {
+        fftwf_plan_with_nthreads(num_threads);
+    }
+#else
+    if (num_threads > 1) {
+        throw std::invalid_argument("FFTW was built without threads");
+    }
+#endif
+    fftwf_set_timelimit(s_fftw_timelimit);
+    return s_fftw_plan_flags;
+}
+
+bool fftw_threads_supported()
+{
+#if defined(HAVE_FFTW_THREADS)
+    return true;
+#else
+    return false;
+#endif
+}
+
+void save_fftw_wisdom()
+{
+    if (s_fftw_wisdom_file.empty()) {
+        return;
+    }
+
+    if (not fftwf_export_wisdom_to_filename(s_fftw_wisdom_file.c_str())) {
+        etiLog.level(warn) << "Could not save FFTW wisdom to " <<
+            s_fftw_wisdom_file;
+    }
+}
+
 void set_thread_name(const char *name)
 {
 #if defined(HAVE_PRCTL)
     prctl(PR_SET_NAME,name,0,0,0);
 #endif
+    alloc_tracking::register_thread(name);
+}
+
+std::vector<int> parse_cpu_list(const std::string& list)
+{
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    std::string item;
+
+    while (std::getline(ss, item, ',')) {
+        if (item.empty()) {
+            continue;
+        }
+
+        try {
+            const auto dash = item.find('-');
+            if (dash == std::string::npos) {
+                cpus.push_back(std::stoi(item));
+            }
+            else {
+                const int first = std::stoi(item.substr(0, dash));
+                const int last = std::stoi(item.substr(dash + 1));
+                if (last < first) {
+                    throw std::invalid_argument("range");
+                }
+                for (int cpu = first; cpu <= last; cpu++) {
+                    cpus.push_back(cpu);
+                }
+            }
+        }
+        catch (const std::logic_error&) {
+            throw std::invalid_argument("Invalid CPU list '" + list + "'");
+        }
+    }
+
+    for (const int cpu : cpus) {
+        if (cpu < 0 or cpu >= CPU_SETSIZE) {
+            throw std::invalid_argument("Invalid CPU " + std::to_string(cpu) +
+                    " in CPU list '" + list + "'");
+        }
+    }
+
+    return cpus;
+}
+
+static std::map<std::string, thread_placement_t> thread_placement;
+
+#if defined(__linux__) && defined(SYS_sched_setattr)
+// From the sched_setattr man page, glibc does not always declare it
+struct deadline_sched_attr_t {
+    uint32_t size;
+    uint32_t sched_policy;
+    uint64_t sched_flags;
+    int32_t sched_nice;
+    uint32_t sched_priority;
+    uint64_t sched_runtime;
+    uint64_t sched_deadline;
+    uint64_t sched_period;
+};
+
+#  if !defined(SCHED_DEADLINE)
+#    define SCHED_DEADLINE 6
+#  endif
+#  if !defined(SCHED_FLAG_RESET_ON_FORK)
+#    define SCHED_FLAG_RESET_ON_FORK 0x01
+#  endif
+#endif
+
+static void set_thread_policy(const std::string& role,
+        const thread_placement_t& placement)
+{
+    sched_param sp = {};
+    int ret = 0;
+
+    switch (placement.policy) {
+        case thread_policy_e::Unchanged:
+            return;
+        case thread_policy_e::Other:
+            ret = pthread_setschedparam(pthread_self(), SCHED_OTHER, &sp);
+            break;
+        case thread_policy_e::FIFO:
+            sp.sched_priority = placement.priority;
+            ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+            break;
+        case thread_policy_e::RR:
+            sp.sched_priority = placement.priority;
+            ret = pthread_setschedparam(pthread_self(), SCHED_RR, &sp);
+            break;
+        case thread_policy_e::Deadline:
+        {
+#if defined(__linux__) && defined(SYS_sched_setattr)
+            deadline_sched_attr_t attr = {};
+            attr.size = sizeof(attr);
+            attr.sched_policy = SCHED_DEADLINE;
+            // The threads it starts must not inherit the reservation
+            attr.sched_flags = SCHED_FLAG_RESET_ON_FORK;
+            attr.sched_runtime = placement.deadline_runtime_ns;
+            attr.sched_deadline = placement.deadline_period_ns;
+            attr.sched_period = placement.deadline_period_ns;
+            if (syscall(SYS_sched_setattr, 0, &attr, 0) != 0) {
+                ret = errno;
+            }
+#else
+            etiLog.level(warn) << "SCHED_DEADLINE not supported";
+            return;
+#endif
+            break;
+        }
+    }
+
+    if (ret) {
+        etiLog.level(warn) << "Could not set scheduling policy of thread " <<
+            role << ": " << strerror(ret);
+    }
+}
+
+void configure_thread_placement(
+        const std::map<std::string, thread_placement_t>& placement)
+{
+    thread_placement = placement;
+}
+
+std::vector<int> get_thread_cpus(const std::string& role)
+{
+    const auto it = thread_placement.find(role);
+    if (it == thread_placement.end()) {
+        return {};
+    }
+    return it->second.cpus;
+}
+
+void set_thread_placement(const std::string& role, const std::string& fallback_role)
+{
+    auto it = thread_placement.find(role);
+    if (it == thread_placement.end() and not fallback_role.empty()) {
+        it = thread_placement.find(fallback_role);
+    }
+
+    if (it == thread_placement.end()) {
+        return;
+    }
+
+    const auto& placement = it->second;
+
+    if (not placement.cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (const int cpu : placement.cpus) {
+            CPU_SET(cpu, &set);
+        }
+
+        if (int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) {
+            etiLog.level(warn) << "Could not set CPU affinity of thread " <<
+                role << ": " << strerror(ret);
+        }
+    }
+
+    if (placement.numa_node >= 0) {
+#if defined(__linux__)
+        unsigned long nodemask = 0;
+        if ((size_t)placement.numa_node >= sizeof(nodemask) * 8) {
+            etiLog.level(warn) << "NUMA node " << placement.numa_node <<
+                " of thread " << role << " not supported";
+        }
+        else {
+            nodemask = 1ul << placement.numa_node;
+            if (syscall(SYS_set_mempolicy, MPOL_BIND, &nodemask,
+                        sizeof(nodemask) * 8 + 1) != 0) {
+                etiLog.level(warn) << "Could not bind memory of thread " <<
+                    role << " to NUMA node " << placement.numa_node << ": " <<
+                    strerror(errno);
+            }
+        }
+#else
+        etiLog.level(warn) << "NUMA memory binding not supported";
+#endif
+    }
+
+    set_thread_policy(role, placement);
+}
+
+std::map<std::string, thread_stats_t> get_thread_stats()
+{
+    std::map<std::string, thread_stats_t> stats;
+#if defined(__linux__)
+    DIR *dir = opendir("/proc/self/task");
+    if (dir == nullptr) {
+        return stats;
+    }
+
+    const double ticks_per_second = sysconf(_SC_CLK_TCK);
+
+    while (struct dirent *entry = readdir(dir)) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        const std::string task = std::string("/proc/self/task/") + entry->d_name;
+
+        // The thread may have exited since the directory was read
+        std::ifstream stat_file(task + "/stat");
+        std::string stat_line;
+        if (not std::getline(stat_file, stat_line)) {
+            continue;
+        }
+
+        // The name is between parentheses, and may itself contain spaces
+        // and parentheses. The fields after it start with the third one,
+        // the state, see proc(5).
+        const size_t name_start = stat_line.find('(');
+        const size_t name_end = stat_line.rfind(')');
+        if (name_start == std::string::npos or name_end == std::string::npos or
+                name_end < name_start) {
+            continue;
+        }
+        const std::string name = stat_line.substr(name_start + 1,
+                name_end - name_start - 1);
+
+        std::vector<std::string> fields;
+        std::stringstream ss(stat_line.substr(name_end + 1));
+        std::string field;
+        while (ss >> field) {
+            fields.push_back(field);
+        }
+        if (fields.size() < 13) {
+            continue;
+        }
+
+        auto& s = stats[name];
+        s.num_threads++;
+        s.minor_faults += std::stoull(fields[10 - 3]);
+        s.major_faults += std::stoull(fields[12 - 3]);
+        s.user_time += std::stoull(fields[14 - 3]) / ticks_per_second;
+        s.system_time += std::stoull(fields[15 - 3]) / ticks_per_second;
+
+        std::ifstream status_file(task + "/status");
+        std::string line;
+        while (std::getline(status_file, line)) {
+            const size_t colon = line.find(':');
+            if (colon == std::string::npos) {
+                continue;
+            }
+            const std::string key = line.substr(0, colon);
+            if (key == "voluntary_ctxt_switches") {
+                s.voluntary_switches += std::stoull(line.substr(colon + 1));
+            }
+            else if (key == "nonvoluntary_ctxt_switches") {
+                s.involuntary_switches += std::stoull(line.substr(colon + 1));
+            }
+        }
+    }
+
+    closedir(dir);
+#endif
+    return stats;
 }
 
 double parse_channel(const std::string& chan)
@@ -32,9 +32,13 @@
 #endif
 
 #include <optional>
+#include <mutex>
+#include <map>
+#include <vector>
 #include <string>
 #include <chrono>
 #include <cstdio>
+#include <cstdint>
 #include <ctime>
 #include <cstdlib>
 #include <unistd.h>
@@ -51,9 +55,78 @@ void printModSettings(const mod_settings_t& mod_settings);
 // Set SCHED_RR with priority prio (0=lowest)
 int set_realtime_prio(int prio);
 
+// Lock all current and future pages of the process into RAM with
+// mlockall, which also faults them in. Returns 0 or the errno.
+int lock_memory();
+
+// Touch size bytes of the stack of the calling thread, so that its
+// growth does not cause page faults later.
+void prefault_stack(size_t size);
+
 // Set the name of the thread
 void set_thread_name(const char *name);
 
+// Parse a list of CPUs like "0,2,4-7". Throws invalid_argument on error.
+std::vector<int> parse_cpu_list(const std::string& list);
+
+// Set the placement of the threads, indexed by role. Must be called
+// before the threads get started.
+void configure_thread_placement(
+        const std::map<std::string, thread_placement_t>& placement);
+
+// Return the CPUs configured for the role, empty if none are.
+std::vector<int> get_thread_cpus(const std::string& role);
+
+// Apply the CPU affinity, NUMA memory policy and scheduling policy
+// configured for the role to the calling thread. If nothing is configured for the role, the
+// settings of fallback_role are used instead, if given.
+void set_thread_placement(const std::string& role,
+        const std::string& fallback_role = "");
+
+// Resource usage of the threads of the process that have the same name,
+// as set by set_thread_name, since they were started. The CPU times are
+// in seconds.
+struct thread_stats_t {
+    size_t num_threads = 0;
+    double user_time = 0.0;
+    double system_time = 0.0;
+    uint64_t voluntary_switches = 0;
+    uint64_t involuntary_switches = 0;
+    uint64_t minor_faults = 0;
+    uint64_t major_faults = 0;
+};
+
+// Read the resource usage of all threads of the process from
+// /proc/self/task, indexed by thread name. Empty if not available.
+std::map<std::string, thread_stats_t> get_thread_stats();
+
+// The FFTW planner is not thread-safe, and several modulators can create
+// their plans at the same time. Hold this mutex when creating or destroying
+// FFTW plans.
+extern std::mutex fftw_planner_mutex;
+
+// Configure the FFTW planner for all blocks that use FFTW. plan_mode is
+// one of estimate, measure, patient or exhaustive. If wisdom_file is not
+// empty, the wisdom from earlier runs is imported from it, and
+// save_fftw_wisdom() writes to it. Planning is limited to two seconds per
+// plan, unless a wisdom file is used: then the plans only get measured
+// once, and they are always the same.
+void configure_fftw_planner(const std::string& wisdom_file,
+        const std::string& plan_mode);
+
+// Set up the planner for a plan computed by num_threads threads, and
+// return the flags to create it with. Call with the fftw_planner_mutex
+// held. num_threads must be 1 without fftw_threads_supported().
+unsigned prepare_fftw_planner(unsigned num_threads = 1);
+
+// Whether FFTW was built with threads, for multithreaded plans
+bool fftw_threads_supported();
+
+// Write the wisdom accumulated so far to the wisdom file, if one is
+// configured. Call with the fftw_planner_mutex held, after creating
+// new plans.
+void save_fftw_wisdom();
+
 // Convert a channel like 10A to a frequency in Hz
 double parse_channel(const std::string& chan);
 
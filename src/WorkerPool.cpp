@@ -0,0 +1,205 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "WorkerPool.h"
+#include "Utils.h"
+#include "Log.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <sched.h>
+
+using namespace std;
+
+static size_t s_configured_num_threads = 0;
+static bool s_configured_pin_threads = false;
+
+struct WorkerPool::job_t {
+    const function<void(size_t)> *func = nullptr;
+    size_t num_tasks = 0;
+    atomic<size_t> next_task = ATOMIC_VAR_INIT(0);
+
+    mutex done_mutex;
+    condition_variable done_cv;
+    size_t num_done = 0;
+    exception_ptr exception;
+};
+
+void WorkerPool::configure(size_t num_threads, bool pin_threads)
+{
+    s_configured_num_threads = num_threads;
+    s_configured_pin_threads = pin_threads;
+}
+
+WorkerPool& WorkerPool::shared()
+{
+    static WorkerPool pool(s_configured_num_threads, s_configured_pin_threads);
+    return pool;
+}
+
+WorkerPool::WorkerPool(size_t num_threads, bool pin_threads)
+{
+    if (num_threads == 0) {
+        num_threads = std::thread::hardware_concurrency();
+    }
+
+    // When pinning, distribute the workers over the CPUs configured for
+    // the workerpool role, or else over all CPUs we may run on.
+    vector<int> cpus;
+    if (pin_threads) {
+        cpus = get_thread_cpus("workerpool");
+    }
+
+    if (pin_threads and cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                if (CPU_ISSET(cpu, &set)) {
+                    cpus.push_back(cpu);
+                }
+            }
+        }
+        else {
+            etiLog.level(warn) << "WorkerPool: cannot get CPU affinity, "
+                "workers will not be pinned";
+        }
+    }
+
+    etiLog.level(info) << "WorkerPool: starting " << num_threads <<
+        " threads" << (cpus.empty() ? "" : ", pinned to CPUs");
+
+    for (size_t i = 0; i < num_threads; i++) {
+        const int cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+        m_threads.emplace_back(&WorkerPool::worker_thread, this, i, cpu);
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    for (size_t i = 0; i < m_threads.size(); i++) {
+        m_queue.push(nullptr);
+    }
+
+    for (auto& t : m_threads) {
+        if (t.joinable()) {
+            t.join();
+        }
+    }
+}
+
+void WorkerPool::run_tasks(job_t& job)
+{
+    while (true) {
+        const size_t task = job.next_task.fetch_add(1);
+        if (task >= job.num_tasks) {
+            break;
+        }
+
+        exception_ptr exception;
+        try {
+            (*job.func)(task);
+        }
+        catch (...) {
+            exception = current_exception();
+        }
+
+        lock_guard<mutex> lock(job.done_mutex);
+        if (exception and not job.exception) {
+            job.exception = exception;
+        }
+        if (++job.num_done == job.num_tasks) {
+            job.done_cv.notify_one();
+        }
+    }
+}
+
+void WorkerPool::parallel_for(size_t num_tasks,
+        const function<void(size_t)>& func)
+{
+    if (num_tasks == 0) {
+        return;
+    }
+
+    if (num_tasks == 1 or m_threads.empty()) {
+        for (size_t i = 0; i < num_tasks; i++) {
+            func(i);
+        }
+        return;
+    }
+
+    // Workers that pick up the job after all tasks were taken return
+    // immediately, but they might still do so after we returned. The
+    // job is therefore shared with them.
+    auto job = make_shared<job_t>();
+    job->func = &func;
+    job->num_tasks = num_tasks;
+
+    const size_t num_helpers = std::min(num_tasks - 1, m_threads.size());
+    for (size_t i = 0; i < num_helpers; i++) {
+        m_queue.push(job);
+    }
+
+    run_tasks(*job);
+
+    unique_lock<mutex> lock(job->done_mutex);
+    job->done_cv.wait(lock, [&]{ return job->num_done == job->num_tasks; });
+
+    if (job->exception) {
+        rethrow_exception(job->exception);
+    }
+}
+
+void WorkerPool::worker_thread(size_t index, int cpu)
+{
+    set_thread_name(("workerpool" + to_string(index)).c_str());
+
+    if (int ret = set_realtime_prio(1)) {
+        etiLog.level(warn) << "WorkerPool: could not set priority: " << ret;
+    }
+
+    set_thread_placement("workerpool");
+
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) {
+            etiLog.level(warn) << "WorkerPool: could not pin thread " <<
+                index << " to CPU " << cpu << ": " << ret;
+        }
+    }
+
+    while (true) {
+        shared_ptr<job_t> job;
+        m_queue.wait_and_pop(job);
+
+        if (not job) {
+            break;
+        }
+
+        run_tasks(*job);
+    }
+}
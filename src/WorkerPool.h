@@ -0,0 +1,79 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   A pool of worker threads shared by all modulators running in the process
+*/
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "ThreadsafeQueue.h"
+
+/* Blocks that can split their work into independent parts, like the
+ * MemlessPoly predistorter, give them to this pool instead of running
+ * their own threads. When several ensembles are modulated in the same
+ * process, they all share the same workers, and the number of threads
+ * therefore stays bounded by the number of CPUs.
+ */
+class WorkerPool {
+    public:
+        /* Returns the pool shared by the whole process. On first use, it
+         * gets created with the settings given to configure(), or with
+         * one thread per CPU if configure() was never called. */
+        static WorkerPool& shared();
+
+        /* Set the parameters of the shared pool. Must be called before
+         * the first call to shared().
+         * num_threads == 0 means one worker per CPU. If pin_threads is
+         * true, each worker is bound to one of the CPUs the process
+         * is allowed to run on. */
+        static void configure(size_t num_threads, bool pin_threads);
+
+        WorkerPool(size_t num_threads, bool pin_threads);
+        WorkerPool(const WorkerPool& other) = delete;
+        WorkerPool& operator=(const WorkerPool& other) = delete;
+        ~WorkerPool();
+
+        size_t num_threads() const { return m_threads.size(); }
+
+        /* Call func(i) for every i in [0, num_tasks). The calling thread
+         * takes part in the work, and parallel_for returns once all tasks
+         * are done. If a task throws, the exception is rethrown here. */
+        void parallel_for(size_t num_tasks,
+                const std::function<void(size_t)>& func);
+
+    private:
+        struct job_t;
+        static void run_tasks(job_t& job);
+        void worker_thread(size_t index, int cpu);
+
+        ThreadsafeQueue<std::shared_ptr<job_t> > m_queue;
+        std::vector<std::thread> m_threads;
+};
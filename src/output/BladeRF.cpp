@@ -34,6 +34,7 @@
 #include <chrono>
 #include <limits>
 #include <cstdio>
+#include <cstring>
 #include <iomanip>
 #include <algorithm>
 #include <iterator>
@@ -126,19 +127,22 @@ BladeRF::BladeRF(SDRDeviceConfig &config) : SDRDevice(), m_conf(config)
     }
 
     /* ---------------------------- Streaming Config ---------------------------- */
-    const unsigned int num_buffers = 16;   // Number of buffers to use in the underlying data stream
-    const unsigned int buffer_size = 8192; // "to hold 2048 samples for one channel, a buffer must be at least 8192 bytes large"
-    const unsigned int num_transfers = 8;  // active USB transfers
-    const unsigned int timeout_ms = 3500;
-
     /* Configure the device's x1 TX (SISO) channel for use with the
-    * synchronous interface. SC16 Q11 samples *without* metadata are used. */
-    status = bladerf_sync_config(m_device, BLADERF_TX_X1, BLADERF_FORMAT_SC16_Q11, num_buffers,
-                                    buffer_size, num_transfers, timeout_ms);
+    * synchronous interface. The FormatConverter gives SC16 Q11 samples,
+    * with metadata if the frames are timestamped. */
+    const bladerf_format format = m_conf.bladerfMetadata ?
+        BLADERF_FORMAT_SC16_Q11_META : BLADERF_FORMAT_SC16_Q11;
+    status = bladerf_sync_config(m_device, BLADERF_TX_X1, format,
+            m_conf.bladerfNumBuffers, m_conf.bladerfBufferSize,
+            m_conf.bladerfNumTransfers, m_conf.bladerfTimeoutMs);
     if (status != 0) {
         etiLog.level(error) << "Error making BladeRF device: %s " << bladerf_strerror(status);
         throw runtime_error("Cannot setup BladeRF stream");
     }
+    etiLog.level(info) << "BladeRF stream: " << m_conf.bladerfNumBuffers <<
+        " buffers of " << m_conf.bladerfBufferSize << " samples, " <<
+        m_conf.bladerfNumTransfers << " transfers" <<
+        (m_conf.bladerfMetadata ? ", with timestamps" : "");
 
     status = bladerf_enable_module(m_device, m_channel, true);
     if(status < 0)
@@ -242,6 +246,7 @@ double BladeRF::get_bandwidth(void) const
 SDRDevice::run_statistics_t BladeRF::get_run_statistics(void) const
 {
     run_statistics_t rs;
+    m_tx_events.add_to(rs);
     rs["frames"].v = num_frames_modulated;
     return rs;
 }
@@ -300,11 +305,46 @@ std::optional<double> BladeRF::get_temperature(void) const
     }
 }
 
-void BladeRF::transmit_frame(struct FrameData&& frame) // SC16 frames
+void BladeRF::transmit_frame(struct FrameData&& frame) // SC16 Q11 frames
 {
-    const size_t num_samples = frame.buf.size() / (2*sizeof(int16_t));
+    const size_t num_samples = frame.buf.getLength() / (2*sizeof(int16_t));
+
+    int status = 0;
+    if (m_conf.bladerfMetadata) {
+        struct bladerf_metadata meta;
+        memset(&meta, 0, sizeof(meta));
+
+        uint64_t now = 0;
+        status = bladerf_get_timestamp(m_device, BLADERF_TX, &now);
+        if (status < 0) {
+            etiLog.level(error) << "Error getting BladeRF timestamp: %s " << bladerf_strerror(status);
+            throw runtime_error("Cannot get BladeRF timestamp");
+        }
+
+        /* The frames follow each other in one burst. The first one starts
+         * once the buffers are full, and when the frames come too late,
+         * the timestamps start again in the future and libbladeRF fills
+         * the gap with zeros. */
+        const uint64_t latency = (uint64_t)m_conf.bladerfNumBuffers *
+            m_conf.bladerfBufferSize;
+        if (not m_burst_started) {
+            meta.flags = BLADERF_META_FLAG_TX_BURST_START;
+            m_next_timestamp = now + latency;
+            m_burst_started = true;
+        }
+        else if (now > m_next_timestamp) {
+            m_tx_events.late_packets++;
+            m_next_timestamp = now + latency;
+        }
+
+        meta.timestamp = m_next_timestamp;
+        status = bladerf_sync_tx(m_device, frame.buf.getData(), num_samples, &meta, 0);
+        m_next_timestamp += num_samples;
+    }
+    else {
+        status = bladerf_sync_tx(m_device, frame.buf.getData(), num_samples, NULL, 0);
+    }
 
-    const int status = bladerf_sync_tx(m_device, frame.buf.data(), num_samples, NULL, 0);
     if (status < 0) {
         etiLog.level(error) << "Error transmitting samples with BladeRF: %s " << bladerf_strerror(status);
         throw runtime_error("Cannot transmit TX samples");
@@ -76,6 +76,7 @@ class BladeRF : public Output::SDRDevice
        virtual double get_bandwidth(void) const override;
        virtual void transmit_frame(struct FrameData&& frame) override;
        virtual run_statistics_t get_run_statistics(void) const override;
+       virtual const TxEventCounters* get_tx_event_counters(void) const override { return &m_tx_events; }
        virtual double get_real_secs(void) const override;
 
        virtual void set_rxgain(double rxgain) override;
@@ -99,7 +100,16 @@ class BladeRF : public Output::SDRDevice
        bladerf_channel m_channel = BLADERF_CHANNEL_TX(0); // channel TX0
        //struct bladerf_stream* m_stream; /* used for asynchronous api */
 
+       // libbladeRF does not report TX underruns, this counter stays at
+       // zero and is given for uniformity with the other devices. The late
+       // packets are only counted with timestamped frames.
+       TxEventCounters m_tx_events;
        size_t num_frames_modulated = 0;
+
+       // The position in the burst of the next timestamped frame, in
+       // samples of the device clock
+       bool m_burst_started = false;
+       uint64_t m_next_timestamp = 0;
 };
 
 } // namespace Output
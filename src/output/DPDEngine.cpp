@@ -0,0 +1,529 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   Estimation of the predistortion coefficients inside the modulator, from
+   the TX and RX feedback samples of the DPDFeedbackServer.
+*/
+
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "output/DPDEngine.h"
+#include "Utils.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace Output {
+
+// Number of coefficients of the AM/AM and of the AM/PM polynomial of
+// MemlessPoly
+static constexpr size_t NUM_POLY_COEFS = 5;
+
+// The bursts are shorter than a transmission frame, waiting for longer
+// than this means there is no feedback.
+static constexpr double BURST_TIMEOUT_S = 10.0;
+
+// Smallest burst that gives a useful fit
+static constexpr size_t MIN_SAMPLES = FeedbackAligner::MIN_SAMPLES;
+
+// Samples below this fraction of the maximum RX amplitude are not used in
+// the fit, and below PHASE_MIN their phase difference is taken as zero.
+static constexpr double AMPLITUDE_MIN = 0.01;
+static constexpr double PHASE_MIN = 0.1;
+
+// The amplitude range is split into this many bins, that all get the same
+// weight in the polynomial fit.
+static constexpr size_t NUM_BINS = 32;
+
+using coefs_t = array<double, NUM_POLY_COEFS>;
+
+// Solve A x = b by Gaussian elimination with partial pivoting.
+static coefs_t solve(array<coefs_t, NUM_POLY_COEFS> A, coefs_t b)
+{
+    constexpr size_t N = NUM_POLY_COEFS;
+    for (size_t col = 0; col < N; col++) {
+        size_t pivot = col;
+        for (size_t row = col + 1; row < N; row++) {
+            if (fabs(A[row][col]) > fabs(A[pivot][col])) {
+                pivot = row;
+            }
+        }
+
+        if (fabs(A[pivot][col]) < 1e-12) {
+            throw runtime_error("DPDEngine: fit is ill-conditioned");
+        }
+
+        swap(A[col], A[pivot]);
+        swap(b[col], b[pivot]);
+
+        for (size_t row = col + 1; row < N; row++) {
+            const double f = A[row][col] / A[col][col];
+            for (size_t k = col; k < N; k++) {
+                A[row][k] -= f * A[col][k];
+            }
+            b[row] -= f * b[col];
+        }
+    }
+
+    coefs_t x;
+    for (size_t i = N; i-- > 0;) {
+        double sum = b[i];
+        for (size_t k = i + 1; k < N; k++) {
+            sum -= A[i][k] * x[k];
+        }
+        x[i] = sum / A[i][i];
+    }
+    return x;
+}
+
+// Read the poly coefficients in MemlessPoly format, false if they are of
+// another format.
+static bool parse_poly(const string& coefs, coefs_t& am, coefs_t& pm)
+{
+    stringstream ss(coefs);
+    int format = 0;
+    size_t n = 0;
+    ss >> format >> n;
+    if (format != 1 or n != NUM_POLY_COEFS) {
+        return false;
+    }
+
+    for (auto& c : am) ss >> c;
+    for (auto& c : pm) ss >> c;
+    return not ss.fail();
+}
+
+// Read an interpolated LUT in MemlessPoly format, false if the coefficients
+// are of another format.
+static bool parse_lut(const string& coefs,
+        vector<complexf>& lut, float& scalefactor)
+{
+    stringstream ss(coefs);
+    int format = 0;
+    size_t n = 0;
+    ss >> format >> n >> scalefactor;
+    if (format != 3 or n < 2 or not (scalefactor > 0)) {
+        return false;
+    }
+
+    lut.resize(n);
+    for (auto& l : lut) {
+        float re = 0, im = 0;
+        ss >> re >> im;
+        l = complexf(re, im);
+    }
+    return not ss.fail();
+}
+
+DPDEngine::DPDEngine(
+        const DPDEngineConfig& config,
+        server_getter_t get_server,
+        uint32_t sampleRate) :
+    RemoteControllable("dpdengine"),
+    m_get_server(get_server),
+    m_sampleRate(sampleRate),
+    m_config(config)
+{
+    RC_ADD_PARAMETER(run, "Write N to run N iterations, reads the number of pending ones");
+    RC_ADD_PARAMETER(model, "poly or lut");
+    RC_ADD_PARAMETER(num_samples, "Number of samples of every burst");
+    RC_ADD_PARAMETER(learning_rate, "Fraction of the estimated change applied every iteration");
+    RC_ADD_PARAMETER(interval, "Seconds between automatic iterations, 0 to only run on request");
+    RC_ADD_PARAMETER(iterations, "(Read-only) Number of iterations done");
+    RC_ADD_PARAMETER(status, "(Read-only) Result of the last iteration");
+    RC_ADD_PARAMETER(delay, "(Read-only) Delay in samples of the RX feedback");
+    RC_ADD_PARAMETER(nmse, "(Read-only) Error between TX and RX after alignment, in dB");
+    RC_ADD_PARAMETER(duration_ms, "(Read-only) Duration of the last iteration");
+
+    m_running.store(true);
+    m_thread = thread(&DPDEngine::engine_thread, this);
+}
+
+DPDEngine::~DPDEngine()
+{
+    m_running.store(false);
+    m_notification.notify_all();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+void DPDEngine::engine_thread()
+{
+    set_thread_name("dpdengine");
+    set_thread_placement("dpdfeedback");
+
+    while (m_running) {
+        {
+            unique_lock<mutex> lock(m_mutex);
+            if (m_config.interval > 0) {
+                m_notification.wait_for(lock, chrono::seconds(m_config.interval),
+                        [&]{ return not m_running or m_pending_iterations > 0; });
+            }
+            else {
+                m_notification.wait(lock,
+                        [&]{ return not m_running or m_pending_iterations > 0; });
+            }
+
+            if (not m_running) break;
+
+            if (m_pending_iterations > 0) {
+                m_pending_iterations--;
+            }
+        }
+
+        const auto start = chrono::steady_clock::now();
+        string status = "ok";
+        try {
+            run_iteration();
+        }
+        catch (const std::exception& e) {
+            status = e.what();
+            etiLog.level(warn) << "DPD engine: " << e.what();
+        }
+        const auto duration = chrono::steady_clock::now() - start;
+
+        lock_guard<mutex> lock(m_mutex);
+        m_status = status;
+        m_duration_ms = chrono::duration_cast<chrono::microseconds>(
+                duration).count() / 1000.0;
+        m_iterations++;
+    }
+}
+
+void DPDEngine::run_iteration()
+{
+    DPDEngineConfig config;
+    {
+        lock_guard<mutex> lock(m_mutex);
+        config = m_config;
+    }
+
+    auto server = m_get_server();
+    if (not server) {
+        throw runtime_error("no feedback server");
+    }
+
+    FeedbackBurst burst;
+    if (not server->request_burst(config.numSamples, burst, BURST_TIMEOUT_S)) {
+        throw runtime_error("no feedback burst acquired");
+    }
+
+    const auto result = m_aligner.align(
+            burst.tx_samples, burst.rx_samples, m_tx, m_rx);
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_delay = result.delay;
+        m_nmse_db = result.nmse_db;
+    }
+
+    const string current = rcs.get_param(config.target, "coefs");
+    const string coefs = (config.model == "lut") ?
+        fit_lut(current, config) : fit_poly(current, config);
+
+    rcs.set_param(config.target, "coefs", coefs);
+
+    lock_guard<mutex> lock(m_mutex);
+    etiLog.level(debug) << "DPD engine: iteration " << m_iterations <<
+        " with delay " << m_delay << " samples, NMSE " << m_nmse_db << " dB";
+}
+
+string DPDEngine::fit_poly(const string& current_coefs,
+        const DPDEngineConfig& config) const
+{
+    double max_mag = 0;
+    for (const auto& y : m_rx) {
+        max_mag = std::max(max_mag, (double)abs(y));
+    }
+    const double min_mag = AMPLITUDE_MIN * max_mag;
+    const double min_phase_mag = PHASE_MIN * max_mag;
+
+    auto bin_of = [&](double mag) {
+        return std::min(NUM_BINS - 1, (size_t)(mag / max_mag * NUM_BINS));
+    };
+
+    array<size_t, NUM_BINS> bin_count = {};
+    for (const auto& y : m_rx) {
+        const double mag = abs(y);
+        if (mag >= min_mag) {
+            bin_count[bin_of(mag)]++;
+        }
+    }
+
+    // Normal equations of the weighted least squares, both polynomials
+    // are in the squared magnitude
+    array<coefs_t, NUM_POLY_COEFS> A = {};
+    coefs_t b_am = {};
+    coefs_t b_pm = {};
+    for (size_t i = 0; i < m_rx.size(); i++) {
+        const double mag = abs(m_rx[i]);
+        if (mag < min_mag) {
+            continue;
+        }
+        const double w = 1.0 / bin_count[bin_of(mag)];
+
+        coefs_t basis;
+        basis[0] = 1.0;
+        for (size_t k = 1; k < NUM_POLY_COEFS; k++) {
+            basis[k] = basis[k - 1] * mag * mag;
+        }
+
+        // The predistorter multiplies by the AM correction and rotates by
+        // minus the PM correction
+        const double am = (double)abs(m_tx[i]) / mag;
+        const double pm = (mag >= min_phase_mag) ?
+            (double)arg(m_rx[i] * conj(m_tx[i])) : 0.0;
+
+        for (size_t r = 0; r < NUM_POLY_COEFS; r++) {
+            for (size_t c = 0; c < NUM_POLY_COEFS; c++) {
+                A[r][c] += w * basis[r] * basis[c];
+            }
+            b_am[r] += w * basis[r] * am;
+            b_pm[r] += w * basis[r] * pm;
+        }
+    }
+
+    coefs_t am = solve(A, b_am);
+    coefs_t pm = solve(A, b_pm);
+
+    coefs_t cur_am, cur_pm;
+    if (parse_poly(current_coefs, cur_am, cur_pm)) {
+        for (size_t k = 0; k < NUM_POLY_COEFS; k++) {
+            am[k] = cur_am[k] + config.learningRate * (am[k] - cur_am[k]);
+            pm[k] = cur_pm[k] + config.learningRate * (pm[k] - cur_pm[k]);
+        }
+    }
+
+    stringstream ss;
+    ss.precision(9);
+    ss << 1 << endl << NUM_POLY_COEFS << endl;
+    for (const auto& c : am) ss << c << endl;
+    for (const auto& c : pm) ss << c << endl;
+    return ss.str();
+}
+
+string DPDEngine::fit_lut(const string& current_coefs,
+        const DPDEngineConfig& config) const
+{
+    const size_t num_entries = config.lutEntries;
+
+    float max_mag = 0;
+    for (const auto& y : m_rx) {
+        max_mag = std::max(max_mag, abs(y));
+    }
+    const float min_mag = (float)AMPLITUDE_MIN * max_mag;
+    const float scalefactor = (num_entries - 1) / max_mag;
+
+    // Every sample contributes its correction to the two entries around
+    // its magnitude, weighted like the interpolation of MemlessPoly.
+    vector<complex<double> > sum(num_entries);
+    vector<double> weight(num_entries);
+    for (size_t i = 0; i < m_rx.size(); i++) {
+        const float mag = abs(m_rx[i]);
+        if (mag < min_mag) {
+            continue;
+        }
+
+        const complex<double> correction =
+            complex<double>(m_tx[i]) / complex<double>(m_rx[i]);
+        const float pos = std::min<float>(mag * scalefactor, num_entries - 1);
+        const size_t ix = pos;
+        const double frac = pos - ix;
+
+        sum[ix] += (1.0 - frac) * correction;
+        weight[ix] += 1.0 - frac;
+        if (ix + 1 < num_entries) {
+            sum[ix + 1] += frac * correction;
+            weight[ix + 1] += frac;
+        }
+    }
+
+    vector<complexf> lut(num_entries);
+    vector<bool> valid(num_entries);
+    for (size_t k = 0; k < num_entries; k++) {
+        valid[k] = weight[k] > 0;
+        if (valid[k]) {
+            lut[k] = complexf(sum[k] / weight[k]);
+        }
+    }
+
+    // Entries without samples take the value of the closest entry with
+    // samples below, or above for the lowest ones.
+    const auto first_valid = find(valid.begin(), valid.end(), true);
+    if (first_valid == valid.end()) {
+        throw runtime_error("no samples for the LUT");
+    }
+    for (size_t k = first_valid - valid.begin(); k-- > 0;) {
+        lut[k] = lut[k + 1];
+    }
+    for (size_t k = first_valid - valid.begin() + 1; k < num_entries; k++) {
+        if (not valid[k]) {
+            lut[k] = lut[k - 1];
+        }
+    }
+
+    vector<complexf> cur_lut;
+    float cur_scalefactor = 0;
+    if (parse_lut(current_coefs, cur_lut, cur_scalefactor)) {
+        const float max_pos = cur_lut.size() - 1;
+        for (size_t k = 0; k < num_entries; k++) {
+            // The current LUT at the magnitude of entry k
+            const float pos = std::min(k / scalefactor * cur_scalefactor, max_pos);
+            const size_t ix = pos;
+            const float frac = pos - ix;
+            const complexf cur = (ix + 1 < cur_lut.size()) ?
+                cur_lut[ix] + (cur_lut[ix + 1] - cur_lut[ix]) * frac :
+                cur_lut[ix];
+
+            lut[k] = cur + (float)config.learningRate * (lut[k] - cur);
+        }
+    }
+
+    stringstream ss;
+    ss.precision(9);
+    ss << 3 << endl << num_entries << endl << scalefactor << endl;
+    for (const auto& l : lut) {
+        ss << l.real() << endl << l.imag() << endl;
+    }
+    return ss.str();
+}
+
+void DPDEngine::set_parameter(const string& parameter, const string& value)
+{
+    stringstream ss(value);
+    ss.exceptions ( stringstream::failbit | stringstream::badbit );
+
+    unique_lock<mutex> lock(m_mutex);
+    if (parameter == "run") {
+        size_t n = 0;
+        ss >> n;
+        m_pending_iterations += n;
+        lock.unlock();
+        m_notification.notify_all();
+    }
+    else if (parameter == "model") {
+        if (value != "poly" and value != "lut") {
+            throw ParameterError("model must be poly or lut");
+        }
+        m_config.model = value;
+    }
+    else if (parameter == "num_samples") {
+        size_t n = 0;
+        ss >> n;
+        if (n < MIN_SAMPLES or n > m_sampleRate) {
+            throw ParameterError("num_samples must be between " +
+                    to_string(MIN_SAMPLES) + " and the sample rate");
+        }
+        m_config.numSamples = n;
+    }
+    else if (parameter == "learning_rate") {
+        double lr = 0;
+        ss >> lr;
+        if (not (lr > 0 and lr <= 1)) {
+            throw ParameterError("learning_rate must be in ]0, 1]");
+        }
+        m_config.learningRate = lr;
+    }
+    else if (parameter == "interval") {
+        ss >> m_config.interval;
+        lock.unlock();
+        m_notification.notify_all();
+    }
+    else {
+        stringstream ss_err;
+        ss_err << "Parameter '" << parameter
+            << "' is read-only or not exported by controllable " << get_rc_name();
+        throw ParameterError(ss_err.str());
+    }
+}
+
+const string DPDEngine::get_parameter(const string& parameter) const
+{
+    stringstream ss;
+    ss << std::fixed;
+
+    lock_guard<mutex> lock(m_mutex);
+    if (parameter == "run") {
+        ss << m_pending_iterations;
+    }
+    else if (parameter == "model") {
+        ss << m_config.model;
+    }
+    else if (parameter == "num_samples") {
+        ss << m_config.numSamples;
+    }
+    else if (parameter == "learning_rate") {
+        ss << m_config.learningRate;
+    }
+    else if (parameter == "interval") {
+        ss << m_config.interval;
+    }
+    else if (parameter == "iterations") {
+        ss << m_iterations;
+    }
+    else if (parameter == "status") {
+        ss << m_status;
+    }
+    else if (parameter == "delay") {
+        ss << m_delay;
+    }
+    else if (parameter == "nmse") {
+        ss << m_nmse_db;
+    }
+    else if (parameter == "duration_ms") {
+        ss << m_duration_ms;
+    }
+    else {
+        ss << "Parameter '" << parameter <<
+            "' is not exported by controllable " << get_rc_name();
+        throw ParameterError(ss.str());
+    }
+    return ss.str();
+}
+
+const json::map_t DPDEngine::get_all_values() const
+{
+    json::map_t map;
+    lock_guard<mutex> lock(m_mutex);
+    map["run"].v = m_pending_iterations;
+    map["model"].v = m_config.model;
+    map["num_samples"].v = m_config.numSamples;
+    map["learning_rate"].v = m_config.learningRate;
+    map["interval"].v = m_config.interval;
+    map["iterations"].v = m_iterations;
+    map["status"].v = m_status;
+    map["delay"].v = m_delay;
+    map["nmse"].v = m_nmse_db;
+    map["duration_ms"].v = m_duration_ms;
+    return map;
+}
+
+} // namespace Output
@@ -0,0 +1,113 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   Estimation of the predistortion coefficients inside the modulator, from
+   the TX and RX feedback samples of the DPDFeedbackServer.
+*/
+
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "RemoteControl.h"
+#include "output/Feedback.h"
+#include "output/FeedbackAlign.h"
+#include "output/SDRDevice.h"
+
+namespace Output {
+
+/* Every iteration acquires a burst from the feedback server and aligns it
+ * with the FeedbackAligner.
+ *
+ * It then fits a postdistorter that maps the RX samples back to the TX
+ * samples (indirect learning), with the model of MemlessPoly: either the
+ * odd polynomial, by least squares on the AM/AM and AM/PM corrections, or
+ * the interpolated LUT. Every amplitude range gets the same weight in the
+ * fit. The result, blended with the current coefficients by the learning
+ * rate, is given to MemlessPoly through its coefs parameter. */
+class DPDEngine : public RemoteControllable {
+    public:
+        using server_getter_t = std::function<std::shared_ptr<DPDFeedbackServer>()>;
+
+        DPDEngine(const DPDEngineConfig& config,
+                server_getter_t get_server,
+                uint32_t sampleRate);
+        DPDEngine(const DPDEngine& other) = delete;
+        DPDEngine& operator=(const DPDEngine& other) = delete;
+        ~DPDEngine();
+
+        /******* REMOTE CONTROL ********/
+        virtual void set_parameter(const std::string& parameter,
+                const std::string& value) override;
+
+        virtual const std::string get_parameter(
+                const std::string& parameter) const override;
+
+        virtual const json::map_t get_all_values() const override;
+
+    private:
+        void engine_thread();
+        void run_iteration();
+
+        std::string fit_poly(const std::string& current_coefs,
+                const DPDEngineConfig& config) const;
+        std::string fit_lut(const std::string& current_coefs,
+                const DPDEngineConfig& config) const;
+
+        FeedbackAligner m_aligner;
+
+        server_getter_t m_get_server;
+        uint32_t m_sampleRate;
+
+        // The config and the results are protected by m_mutex
+        mutable std::mutex m_mutex;
+        std::condition_variable m_notification;
+        DPDEngineConfig m_config;
+        size_t m_pending_iterations = 0;
+        size_t m_iterations = 0;
+        std::string m_status = "idle";
+        double m_delay = 0.0;
+        double m_nmse_db = 0.0;
+        double m_duration_ms = 0.0;
+
+        // Only used by the engine thread
+        std::vector<complexf> m_tx;
+        std::vector<complexf> m_rx;
+
+        std::atomic<bool> m_running = ATOMIC_VAR_INIT(false);
+        std::thread m_thread;
+};
+
+} // namespace Output
@@ -34,10 +34,14 @@ DESCRIPTION:
 
 #include <chrono>
 #include <limits>
+#include <cerrno>
 #include <cstdio>
 #include <iomanip>
+#include <poll.h>
 
+#include "FormatConverter.h"
 #include "Log.h"
+#include "Simd.h"
 #include "Utils.h"
 
 using namespace std;
@@ -52,6 +56,10 @@ static constexpr size_t TRANSMISSION_FRAME_LEN_SAMPS = (2656 + 76 * 2552) * /* I
 static constexpr size_t IIO_BUFFERS = 2;
 static constexpr size_t IIO_BUFFER_LEN_SAMPS = TRANSMISSION_FRAME_LEN_SAMPS / IIO_BUFFERS;
 
+// Number of buffers in the ring between the IIO buffer and the kernel, so
+// that the next buffer can be filled while the previous ones are transferred
+static constexpr unsigned int IIO_KERNEL_BUFFERS = 4;
+
 static string get_iio_error(int err)
 {
     char dst[256];
@@ -150,18 +158,28 @@ Dexter::Dexter(SDRDeviceConfig& config) :
 
     iio_channel_enable(m_tx_channel);
 
+    if ((r = iio_device_set_kernel_buffers_count(m_ad9957_tx0, IIO_KERNEL_BUFFERS)) != 0) {
+        etiLog.level(warn) << "Dexter: Failed to set " << IIO_KERNEL_BUFFERS <<
+            " kernel buffers: " << get_iio_error(r);
+    }
+
     m_buffer = iio_device_create_buffer(m_ad9957_tx0, IIO_BUFFER_LEN_SAMPS, 0);
     if (not m_buffer) {
         throw std::runtime_error("Dexter: Cannot create IIO buffer.");
     }
 
+    if ((r = iio_buffer_set_blocking_mode(m_buffer, false)) != 0) {
+        etiLog.level(warn) << "Dexter: Failed to set non-blocking IIO buffer: " <<
+            get_iio_error(r);
+    }
+
     // Flush the FPGA FIFO
     {
         constexpr size_t buflen_samps = TRANSMISSION_FRAME_LEN_SAMPS / IIO_BUFFERS;
         constexpr size_t buflen = buflen_samps * sizeof(int16_t);
 
         memset(iio_buffer_start(m_buffer), 0, buflen);
-        ssize_t pushed = iio_buffer_push(m_buffer);
+        ssize_t pushed = push_buffer();
         if (pushed < 0) {
             etiLog.level(error) << "Dexter: init push buffer " << get_iio_error(pushed);
         }
@@ -439,6 +457,7 @@ SDRDevice::run_statistics_t Dexter::get_run_statistics(void) const
     }
     rs["latepackets"].v = num_late;
     rs["frames"].v = num_frames_modulated;
+    rs["clipped_samples"].v = num_clipped_samples;
 
     rs["in_holdover_since"].v = 0;
     rs["remaining_holdover_s"].v = m_conf.maxGPSHoldoverTime;
@@ -532,12 +551,49 @@ std::optional<double> Dexter::get_temperature(void) const
     }
 }
 
+ssize_t Dexter::push_buffer()
+{
+    /* The buffer is non-blocking, wait for a free kernel buffer ourselves so
+     * that a stalled device is detected after IIO_TIMEOUT_MS */
+    const auto deadline = chrono::steady_clock::now() +
+        chrono::milliseconds(IIO_TIMEOUT_MS);
+
+    while (true) {
+        const ssize_t pushed = iio_buffer_push(m_buffer);
+        if (pushed != -EAGAIN) {
+            return pushed;
+        }
+
+        const int fd = iio_buffer_get_poll_fd(m_buffer);
+        if (fd < 0) {
+            return fd;
+        }
+
+        const auto remaining_ms = chrono::duration_cast<chrono::milliseconds>(
+                deadline - chrono::steady_clock::now()).count();
+        if (remaining_ms <= 0) {
+            return -ETIMEDOUT;
+        }
+
+        struct pollfd pfd = {};
+        pfd.fd = fd;
+        pfd.events = POLLOUT;
+        if (poll(&pfd, 1, remaining_ms) < 0 and errno != EINTR) {
+            return -errno;
+        }
+    }
+}
+
 void Dexter::transmit_frame(struct FrameData&& frame)
 {
-    constexpr size_t frame_len_bytes = TRANSMISSION_FRAME_LEN_SAMPS * sizeof(int16_t);
-    if (frame.buf.size() != frame_len_bytes) {
+    // The frame contains s16 samples, or the s32 samples of the FPGA FFT
+    // when DabMod::launch_modulator leaves the conversion to us
+    const bool convert_s32 = (frame.sampleSize == 2 * sizeof(int32_t));
+    const size_t frame_len_bytes = TRANSMISSION_FRAME_LEN_SAMPS *
+        (convert_s32 ? sizeof(int32_t) : sizeof(int16_t));
+    if (frame.buf.getLength() != frame_len_bytes) {
         etiLog.level(debug) << "Dexter::transmit_frame Expected " <<
-            frame_len_bytes << " got " << frame.buf.size();
+            frame_len_bytes << " got " << frame.buf.getLength();
         throw std::runtime_error("Dexter: invalid buffer size");
     }
 
@@ -553,9 +609,9 @@ void Dexter::transmit_frame(struct FrameData&& frame)
                 // TIMESTAMP_PPS_PER_DSP_CLOCKS=10 because timestamp_pps is represented in 16.384 MHz clocks
                 uint64_t frame_start_clocks =
                     // at second level
-                    ((int64_t)frame.ts.timestamp_sec - (int64_t)m_utc_seconds_at_startup) * DSP_CLOCK + m_clock_count_at_startup +
+                    ((int64_t)frame.ts.timestamp_sec() - (int64_t)m_utc_seconds_at_startup) * DSP_CLOCK + m_clock_count_at_startup +
                     // at subsecond level
-                    (uint64_t)frame.ts.timestamp_pps * TIMESTAMP_PPS_PER_DSP_CLOCKS;
+                    (uint64_t)frame.ts.timestamp_pps() * TIMESTAMP_PPS_PER_DSP_CLOCKS;
 
                 const double margin_s = frame.ts.offset_to_system_time();
 
@@ -569,9 +625,9 @@ void Dexter::transmit_frame(struct FrameData&& frame)
                 const double margin_device_s = (double)(frame_start_clocks - clks) / DSP_CLOCK;
 
                 etiLog.level(debug) << "DEXTER FCT " << frame.ts.fct << " TS CLK " <<
-                    ((int64_t)frame.ts.timestamp_sec - (int64_t)m_utc_seconds_at_startup) * DSP_CLOCK << " + " <<
+                    ((int64_t)frame.ts.timestamp_sec() - (int64_t)m_utc_seconds_at_startup) * DSP_CLOCK << " + " <<
                     m_clock_count_at_startup << " + " <<
-                    (uint64_t)frame.ts.timestamp_pps * TIMESTAMP_PPS_PER_DSP_CLOCKS << " = " <<
+                    (uint64_t)frame.ts.timestamp_pps() * TIMESTAMP_PPS_PER_DSP_CLOCKS << " = " <<
                     frame_start_clocks << " DELTA " << margin_s << " " << margin_device_s;
 
                 // Ensure we hand the frame over to HW with a bit of margin
@@ -599,17 +655,25 @@ void Dexter::transmit_frame(struct FrameData&& frame)
         m_require_timestamp_refresh = false;
     }
 
-    // DabMod::launch_modulator ensures we get int16_t IQ here
-    //const size_t num_samples = frame.buf.size() / (2*sizeof(int16_t));
-    //const int16_t *buf = reinterpret_cast<const int16_t*>(frame.buf.data());
+    const uint8_t *buf = reinterpret_cast<const uint8_t*>(frame.buf.getData());
 
     if (m_channel_is_up) {
         for (size_t i = 0; i < IIO_BUFFERS; i++) {
             constexpr size_t buflen_samps = TRANSMISSION_FRAME_LEN_SAMPS / IIO_BUFFERS;
             constexpr size_t buflen = buflen_samps * sizeof(int16_t);
 
-            memcpy(iio_buffer_start(m_buffer), frame.buf.data() + (i * buflen), buflen);
-            ssize_t pushed = iio_buffer_push(m_buffer);
+            // Write into the buffer that the kernel has given back
+            void *dst = iio_buffer_start(m_buffer);
+            if (convert_s32) {
+                num_clipped_samples += FormatConverter::convert_complexfix_wide_to_s16(
+                        buf + (i * buflen_samps * sizeof(int32_t)), dst, buflen_samps);
+            }
+            else {
+                // Only the DMA of the IIO device reads the buffer
+                simd::stream_copy(dst, buf + (i * buflen), buflen);
+            }
+
+            ssize_t pushed = push_buffer();
             if (pushed < 0) {
                 etiLog.level(error) << "Dexter: failed to push buffer " << get_iio_error(pushed) <<
                     " after " << num_buffers_pushed << " bufs";
@@ -648,6 +712,7 @@ void Dexter::underflow_read_process()
     }
 
     set_thread_name("dexter_underflow");
+    set_thread_placement("dexter");
 
     while (m_running) {
         this_thread::sleep_for(chrono::seconds(1));
@@ -94,6 +94,10 @@ class Dexter : public Output::SDRDevice
         void channel_down();
         void handle_hw_time();
 
+        // Push m_buffer, waiting at most IIO_TIMEOUT_MS for a free kernel
+        // buffer. Returns the number of bytes pushed, or a negative error.
+        ssize_t push_buffer();
+
         bool m_channel_is_up = false;
 
         SDRDeviceConfig& m_conf;
@@ -117,6 +121,7 @@ class Dexter : public Output::SDRDevice
         size_t prev_underflows = 0;
         size_t num_late = 0;
         size_t num_frames_modulated = 0;
+        size_t num_clipped_samples = 0;
 
         size_t num_buffers_pushed = 0;
 
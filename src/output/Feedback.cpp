@@ -44,6 +44,10 @@ DESCRIPTION:
 #include "Utils.h"
 #include "Socket.h"
 
+#if defined(HAVE_ZSTD)
+#   include <zstd.h>
+#endif
+
 using namespace std;
 
 namespace Output {
@@ -51,8 +55,10 @@ namespace Output {
 DPDFeedbackServer::DPDFeedbackServer(
         std::shared_ptr<SDRDevice> device,
         uint16_t port,
+        const std::string& listen_address,
         uint32_t sampleRate) :
     m_port(port),
+    m_listen_address(listen_address),
     m_sampleRate(sampleRate),
     m_device(device)
 {
@@ -83,7 +89,7 @@ DPDFeedbackServer::~DPDFeedbackServer()
 }
 
 void DPDFeedbackServer::set_tx_frame(
-        const std::vector<uint8_t> &buf,
+        const Buffer &buf,
         const frame_timestamp &buf_ts)
 {
     if (not m_running) {
@@ -92,13 +98,18 @@ void DPDFeedbackServer::set_tx_frame(
 
     unique_lock<mutex> lock(burstRequest.mutex);
 
-    if (buf.size() % sizeof(complexf) != 0) {
+    if (buf.getLength() % sizeof(complexf) != 0) {
         throw logic_error("Buffer for tx frame has incorrect size");
     }
 
-    if (burstRequest.state == BurstRequestState::SaveTransmitFrame) {
+    if (burstRequest.stream_active) {
+        save_stream_tx_frame(buf, buf_ts);
+        lock.unlock();
+        burstRequest.mutex_notification.notify_all();
+    }
+    else if (burstRequest.state == BurstRequestState::SaveTransmitFrame) {
         const size_t n = std::min(
-                burstRequest.num_samples * sizeof(complexf), buf.size());
+                burstRequest.num_samples * sizeof(complexf), buf.getLength());
 
         burstRequest.num_samples = n / sizeof(complexf);
 
@@ -106,49 +117,199 @@ void DPDFeedbackServer::set_tx_frame(
         burstRequest.tx_samples.resize(n);
         // A frame will always begin with the NULL symbol, which contains
         // no power. Instead of taking n samples at the beginning of the
-        // frame, we take them at the end and adapt the timestamp accordingly.
+        // frame, we take them at the end and adapt the timestamp accordingly,
+        // unless the phase reference symbol is wanted.
 
-        const size_t start_ix = buf.size() - n;
-        copy(buf.begin() + start_ix, buf.end(), burstRequest.tx_samples.begin());
+        const size_t start_ix = burstRequest.from_frame_start ?
+            0 : buf.getLength() - n;
+        const uint8_t *data = reinterpret_cast<const uint8_t*>(buf.getData());
+        copy(data + start_ix, data + buf.getLength(),
+                burstRequest.tx_samples.begin());
 
         frame_timestamp ts = buf_ts;
-        ts += (1.0 * start_ix) / (sizeof(complexf) * m_sampleRate);
+        ts.ticks += frame_timestamp::samples_to_ticks(
+                start_ix / sizeof(complexf), m_sampleRate);
 
-        burstRequest.tx_second = ts.timestamp_sec;
-        burstRequest.tx_pps = ts.timestamp_pps;
+        burstRequest.tx_second = ts.timestamp_sec();
+        burstRequest.tx_pps = ts.timestamp_pps();
+        burstRequest.tx_timestamp_valid = ts.timestamp_valid;
+        burstRequest.tx_margin = ts.timestamp_valid ?
+            ts.get_real_secs() - m_device->get_real_secs() : 0.0;
 
         // Prepare the next state
-        burstRequest.rx_second = ts.timestamp_sec;
-        burstRequest.rx_pps = ts.timestamp_pps;
+        burstRequest.rx_second = ts.timestamp_sec();
+        burstRequest.rx_pps = ts.timestamp_pps();
         burstRequest.state = BurstRequestState::SaveReceiveFrame;
 
         lock.unlock();
-        burstRequest.mutex_notification.notify_one();
+        burstRequest.mutex_notification.notify_all();
     }
     else {
         lock.unlock();
     }
 }
 
+size_t DPDFeedbackServer::memory_usage() const
+{
+    std::lock_guard<std::mutex> lock(burstRequest.mutex);
+    size_t bytes = burstRequest.tx_samples.capacity() +
+        burstRequest.rx_samples.capacity();
+    for (const auto *records : {&burstRequest.stream_free,
+            &burstRequest.stream_to_receive, &burstRequest.stream_to_send}) {
+        for (const auto& record : *records) {
+            bytes += record.data.capacity();
+        }
+    }
+    return bytes;
+}
+
+bool DPDFeedbackServer::request_burst(
+        size_t num_samples,
+        FeedbackBurst& burst,
+        double timeout_secs,
+        bool from_frame_start)
+{
+    lock_guard<mutex> request_lock(m_request_mutex);
+
+    unique_lock<mutex> lock(burstRequest.mutex);
+    if (not m_running or burstRequest.stream_active) {
+        return false;
+    }
+
+    burstRequest.num_samples = num_samples;
+    burstRequest.from_frame_start = from_frame_start;
+    burstRequest.state = BurstRequestState::SaveTransmitFrame;
+
+    const auto timeout = chrono::steady_clock::now() +
+        chrono::microseconds(lrint(timeout_secs * 1e6));
+    while (burstRequest.state != BurstRequestState::Acquired) {
+        if (not m_running or burstRequest.mutex_notification.wait_until(
+                    lock, timeout) == cv_status::timeout) {
+            break;
+        }
+    }
+
+    const bool acquired = burstRequest.state == BurstRequestState::Acquired;
+    if (not acquired and burstRequest.state != BurstRequestState::SaveTransmitFrame) {
+        // The RX thread still uses the request, it must not be reused
+        // before it completed.
+        while (m_running and burstRequest.state != BurstRequestState::Acquired) {
+            burstRequest.mutex_notification.wait(lock);
+        }
+    }
+    burstRequest.state = BurstRequestState::None;
+
+    if (not acquired) {
+        return false;
+    }
+
+    const size_t n = std::min(
+            burstRequest.tx_samples.size(),
+            burstRequest.rx_samples.size()) / sizeof(complexf);
+    burst.tx_samples.resize(n);
+    burst.rx_samples.resize(n);
+    memcpy(burst.tx_samples.data(), burstRequest.tx_samples.data(), n * sizeof(complexf));
+    memcpy(burst.rx_samples.data(), burstRequest.rx_samples.data(), n * sizeof(complexf));
+    burst.tx_second = burstRequest.tx_second;
+    burst.tx_pps = burstRequest.tx_pps;
+    burst.rx_second = burstRequest.rx_second;
+    burst.rx_pps = burstRequest.rx_pps;
+    burst.tx_timestamp_valid = burstRequest.tx_timestamp_valid;
+    burst.tx_margin = burstRequest.tx_margin;
+    return true;
+}
+
+void DPDFeedbackServer::save_stream_tx_frame(
+        const Buffer &buf,
+        const frame_timestamp &buf_ts)
+{
+    if (burstRequest.stream_frame_counter++ % burstRequest.stream_decimation != 0) {
+        return;
+    }
+
+    if (burstRequest.stream_free.empty()) {
+        burstRequest.stream_dropped++;
+        return;
+    }
+
+    auto record = std::move(burstRequest.stream_free.front());
+    burstRequest.stream_free.pop_front();
+
+    // Like for the bursts, take the samples at the end of the frame
+    const size_t n = std::min(
+            burstRequest.stream_num_samples * sizeof(complexf), buf.getLength());
+    record.num_samples = n / sizeof(complexf);
+
+    const size_t start_ix = buf.getLength() - n;
+    const uint8_t *data = reinterpret_cast<const uint8_t*>(buf.getData());
+    copy(data + start_ix, data + buf.getLength(), record.tx_samples());
+
+    record.tx_ts = buf_ts;
+    record.tx_ts.ticks += frame_timestamp::samples_to_ticks(
+            start_ix / sizeof(complexf), m_sampleRate);
+
+    burstRequest.stream_to_receive.push_back(std::move(record));
+}
+
 void DPDFeedbackServer::ReceiveBurstThread()
 {
     try {
         set_thread_name("dpdreceiveburst");
+        set_thread_placement("dpdfeedback");
 
         while (m_running) {
             unique_lock<mutex> lock(burstRequest.mutex);
-            while (burstRequest.state != BurstRequestState::SaveReceiveFrame) {
+            while (burstRequest.state != BurstRequestState::SaveReceiveFrame and
+                    burstRequest.stream_to_receive.empty()) {
                 if (not m_running) break;
                 burstRequest.mutex_notification.wait(lock);
             }
 
             if (not m_running) break;
 
+            if (not burstRequest.stream_to_receive.empty()) {
+                auto record = std::move(burstRequest.stream_to_receive.front());
+                burstRequest.stream_to_receive.pop_front();
+                lock.unlock();
+
+                frame_timestamp ts = record.tx_ts;
+                ts.timestamp_valid = true;
+
+                const double timeout = 60;
+                const size_t samples_read = m_device->receive_frame(
+                        reinterpret_cast<complexf*>(record.rx_samples()),
+                        record.num_samples, ts, timeout);
+
+                // The RX samples must follow the TX samples we keep
+                if (samples_read < record.num_samples) {
+                    uint8_t *rx = record.rx_samples();
+                    record.num_samples = samples_read;
+                    memmove(record.rx_samples(), rx,
+                            samples_read * sizeof(complexf));
+                }
+
+                uint32_t *header = record.header();
+                header[0] = record.num_samples;
+                header[1] = record.tx_ts.timestamp_sec();
+                header[2] = record.tx_ts.timestamp_pps();
+                header[3] = ts.timestamp_sec();
+                header[4] = ts.timestamp_pps();
+
+                lock.lock();
+                // Records of a stream that ended in the meantime are dropped
+                if (burstRequest.stream_active and
+                        record.session == burstRequest.stream_session) {
+                    burstRequest.stream_to_send.push_back(std::move(record));
+                }
+                lock.unlock();
+                burstRequest.mutex_notification.notify_all();
+                continue;
+            }
+
             const size_t num_samps = burstRequest.num_samples;
 
             frame_timestamp ts;
-            ts.timestamp_sec = burstRequest.rx_second;
-            ts.timestamp_pps = burstRequest.rx_pps;
+            ts.set_timestamp(burstRequest.rx_second, burstRequest.rx_pps);
             ts.timestamp_valid = true;
 
             // We need to free the mutex while we recv(), because otherwise we block the
@@ -170,8 +331,8 @@ void DPDFeedbackServer::ReceiveBurstThread()
             burstRequest.rx_samples.resize(samples_read * sizeof(complexf));
 
             // The recv might have happened at another time than requested
-            burstRequest.rx_second = ts.timestamp_sec;
-            burstRequest.rx_pps = ts.timestamp_pps;
+            burstRequest.rx_second = ts.timestamp_sec();
+            burstRequest.rx_pps = ts.timestamp_pps();
 
             etiLog.level(debug) << "DPD: acquired " << samples_read <<
                 " RX feedback samples " <<
@@ -182,7 +343,7 @@ void DPDFeedbackServer::ReceiveBurstThread()
             burstRequest.state = BurstRequestState::Acquired;
 
             lock.unlock();
-            burstRequest.mutex_notification.notify_one();
+            burstRequest.mutex_notification.notify_all();
         }
     }
     catch (const runtime_error &e) {
@@ -201,9 +362,10 @@ void DPDFeedbackServer::ReceiveBurstThread()
 void DPDFeedbackServer::ServeFeedback()
 {
     Socket::TCPSocket m_server_sock;
-    m_server_sock.listen(m_port, "127.0.0.1");
+    m_server_sock.listen(m_port, m_listen_address);
 
-    etiLog.level(info) << "DPD Feedback server listening on port " << m_port;
+    etiLog.level(info) << "DPD Feedback server listening on " <<
+        m_listen_address << " port " << m_port;
 
     while (m_running) {
         auto client_sock = m_server_sock.accept(1000);
@@ -226,7 +388,7 @@ void DPDFeedbackServer::ServeFeedback()
             break;
         }
 
-        if (request_version != 1) {
+        if (request_version < 1 or request_version > 3) {
             etiLog.level(info) << "DPD Feedback Server wrong request version";
             break;
         }
@@ -240,10 +402,23 @@ void DPDFeedbackServer::ServeFeedback()
             break;
         }
 
+        if (request_version == 2) {
+            ServeStream(client_sock, num_samples);
+            continue;
+        }
+        else if (request_version == 3) {
+            ServeBursts(client_sock, num_samples);
+            continue;
+        }
+
+        // The lock is held until the result is sent
+        lock_guard<mutex> request_lock(m_request_mutex);
+
         // We are ready to issue the request now
         {
             unique_lock<mutex> lock(burstRequest.mutex);
             burstRequest.num_samples = num_samples;
+            burstRequest.from_frame_start = false;
             burstRequest.state = BurstRequestState::SaveTransmitFrame;
         }
 
@@ -329,9 +504,230 @@ void DPDFeedbackServer::ServeFeedback()
     }
 }
 
+// Convert every decimation-th sample to the format, into out. Returns the
+// scale of the integer formats.
+static float convert_samples(const vector<complexf>& samples,
+        feedback_format_t format, size_t decimation, vector<uint8_t>& out)
+{
+    const size_t n = (samples.size() + decimation - 1) / decimation;
+
+    if (format == feedback_format_t::CF32) {
+        out.resize(n * sizeof(complexf));
+        complexf *dst = reinterpret_cast<complexf*>(out.data());
+        for (size_t i = 0; i < n; i++) {
+            dst[i] = samples[i * decimation];
+        }
+        return 1.0f;
+    }
+
+    float peak = 0;
+    for (size_t i = 0; i < n; i++) {
+        const complexf s = samples[i * decimation];
+        peak = std::max(peak, std::max(fabsf(s.real()), fabsf(s.imag())));
+    }
+
+    if (format == feedback_format_t::SC16) {
+        const float scale = peak > 0 ? 32767.0f / peak : 1.0f;
+        out.resize(n * 2 * sizeof(int16_t));
+        int16_t *dst = reinterpret_cast<int16_t*>(out.data());
+        for (size_t i = 0; i < n; i++) {
+            const complexf s = samples[i * decimation];
+            dst[2*i] = lrintf(s.real() * scale);
+            dst[2*i+1] = lrintf(s.imag() * scale);
+        }
+        return scale;
+    }
+    else {
+        const float scale = peak > 0 ? 127.0f / peak : 1.0f;
+        out.resize(n * 2 * sizeof(int8_t));
+        int8_t *dst = reinterpret_cast<int8_t*>(out.data());
+        for (size_t i = 0; i < n; i++) {
+            const complexf s = samples[i * decimation];
+            dst[2*i] = lrintf(s.real() * scale);
+            dst[2*i+1] = lrintf(s.imag() * scale);
+        }
+        return scale;
+    }
+}
+
+void DPDFeedbackServer::ServeBursts(
+        Socket::TCPSocket& client_sock,
+        uint32_t num_samples)
+{
+    FeedbackBurst burst;
+    vector<uint8_t> tx_payload;
+    vector<uint8_t> rx_payload;
+    vector<uint8_t> response;
+
+    while (m_running) {
+        struct {
+            uint8_t format;
+            uint8_t compression;
+            uint16_t decimation;
+        } request;
+        static_assert(sizeof(request) == 4, "unexpected padding");
+
+        if (client_sock.recv(&request, sizeof(request), MSG_WAITALL) !=
+                sizeof(request)) {
+            etiLog.level(info) <<
+                "DPD Feedback Server Client read request failed";
+            return;
+        }
+
+        if (request.format > (uint8_t)feedback_format_t::SC8 or
+                request.compression > 1 or request.decimation == 0 or
+                num_samples == 0 or num_samples > m_sampleRate) {
+            etiLog.level(info) << "DPD Feedback Server invalid request";
+            return;
+        }
+
+        // The header is sent even if no burst could be acquired, with
+        // zero samples.
+        if (not request_burst(num_samples, burst, 60)) {
+            burst = FeedbackBurst();
+        }
+
+        const auto format = static_cast<feedback_format_t>(request.format);
+        feedback_v3_header_t header = {};
+        header.format = request.format;
+        header.decimation = request.decimation;
+        header.tx_second = burst.tx_second;
+        header.tx_pps = burst.tx_pps;
+        header.rx_second = burst.rx_second;
+        header.rx_pps = burst.rx_pps;
+        header.tx_scale = convert_samples(burst.tx_samples, format,
+                request.decimation, tx_payload);
+        header.rx_scale = convert_samples(burst.rx_samples, format,
+                request.decimation, rx_payload);
+        header.num_samples = (burst.tx_samples.size() + request.decimation - 1) /
+            request.decimation;
+
+        response.resize(sizeof(header));
+
+#if defined(HAVE_ZSTD)
+        if (request.compression == 1) {
+            header.compression = 1;
+            for (const auto *payload : {&tx_payload, &rx_payload}) {
+                const size_t offset = response.size();
+                response.resize(offset + ZSTD_compressBound(payload->size()));
+                const size_t len = ZSTD_compress(response.data() + offset,
+                        response.size() - offset,
+                        payload->data(), payload->size(), 1);
+                if (ZSTD_isError(len)) {
+                    throw runtime_error(string("DPD Feedback zstd: ") +
+                            ZSTD_getErrorName(len));
+                }
+                response.resize(offset + len);
+                (payload == &tx_payload ? header.tx_bytes : header.rx_bytes) = len;
+            }
+        }
+        else
+#endif
+        {
+            header.tx_bytes = tx_payload.size();
+            header.rx_bytes = rx_payload.size();
+            response.insert(response.end(), tx_payload.begin(), tx_payload.end());
+            response.insert(response.end(), rx_payload.begin(), rx_payload.end());
+        }
+
+        memcpy(response.data(), &header, sizeof(header));
+        if (client_sock.sendall(response.data(), response.size()) < 0) {
+            etiLog.level(info) <<
+                "DPD Feedback Server Client send burst failed";
+            return;
+        }
+
+        // The next request of the same client
+        uint8_t request_version = 0;
+        if (client_sock.recv(&request_version, 1, 0) != 1 or
+                request_version != 3 or
+                client_sock.recv(&num_samples, sizeof(num_samples), MSG_WAITALL) !=
+                sizeof(num_samples)) {
+            return;
+        }
+    }
+}
+
+void DPDFeedbackServer::ServeStream(
+        Socket::TCPSocket& client_sock,
+        uint32_t num_samples)
+{
+    uint32_t decimation = 0;
+    ssize_t read = client_sock.recv(&decimation, 4, 0);
+    if (read <= 0) {
+        etiLog.level(info) <<
+            "DPD Feedback Server Client read decimation failed";
+        return;
+    }
+
+    if (num_samples == 0 or num_samples > m_sampleRate or decimation == 0) {
+        etiLog.level(info) << "DPD Feedback Server invalid stream request for " <<
+            num_samples << " samples every " << decimation << " frames";
+        return;
+    }
+
+    unique_lock<mutex> lock(burstRequest.mutex);
+    burstRequest.stream_session++;
+    burstRequest.stream_num_samples = num_samples;
+    burstRequest.stream_decimation = decimation;
+    burstRequest.stream_frame_counter = 0;
+    burstRequest.stream_dropped = 0;
+    burstRequest.stream_to_receive.clear();
+    burstRequest.stream_to_send.clear();
+    burstRequest.stream_free.clear();
+    for (size_t i = 0; i < STREAM_RECORDS; i++) {
+        FeedbackStreamRecord record;
+        record.session = burstRequest.stream_session;
+        record.data.resize(FeedbackStreamRecord::HEADER_WORDS * sizeof(uint32_t) +
+                2 * num_samples * sizeof(complexf));
+        burstRequest.stream_free.push_back(std::move(record));
+    }
+    burstRequest.stream_active = true;
+
+    etiLog.level(info) << "DPD Feedback Server streaming " << num_samples <<
+        " samples every " << decimation << " frames";
+
+    size_t dropped_sent = 0;
+    while (m_running) {
+        while (burstRequest.stream_to_send.empty()) {
+            if (not m_running) break;
+            burstRequest.mutex_notification.wait(lock);
+        }
+
+        if (not m_running) break;
+
+        auto record = std::move(burstRequest.stream_to_send.front());
+        burstRequest.stream_to_send.pop_front();
+        const size_t dropped = burstRequest.stream_dropped;
+        lock.unlock();
+
+        record.header()[5] = dropped - dropped_sent;
+        dropped_sent = dropped;
+
+        const size_t record_bytes =
+            FeedbackStreamRecord::HEADER_WORDS * sizeof(uint32_t) +
+            2 * record.num_samples * sizeof(complexf);
+        const bool success = client_sock.sendall(record.data.data(), record_bytes) >= 0;
+
+        lock.lock();
+        if (not success) {
+            etiLog.level(info) << "DPD Feedback Server stream ended, " <<
+                dropped << " records dropped";
+            break;
+        }
+        burstRequest.stream_free.push_back(std::move(record));
+    }
+
+    burstRequest.stream_active = false;
+    burstRequest.stream_to_receive.clear();
+    burstRequest.stream_to_send.clear();
+    burstRequest.stream_free.clear();
+}
+
 void DPDFeedbackServer::ServeFeedbackThread()
 {
     set_thread_name("dpdfeedbackserver");
+    set_thread_placement("dpdfeedback");
 
     while (m_running) {
         try {
@@ -11,6 +11,29 @@ DESCRIPTION:
    This presents a TCP socket to an external tool which calculates
    a Digital Predistortion model from a short sequence of transmit
    samples and corresponding receive samples.
+
+   The client starts by sending one byte with the request version, and a
+   uint32_t with the number of samples it wants. Everything is in host
+   byte order.
+
+   Version 1 gets one burst: a uint32_t with the number of samples, the
+   uint32_t second and pps of the TX samples, the TX samples, the uint32_t
+   second and pps of the RX samples and the RX samples.
+
+   Version 2 additionally sends a uint32_t decimation N, and then gets a
+   stream of records, one for every Nth transmission frame, until it
+   disconnects. Every record has a header of six uint32_t: number of
+   samples, TX second and pps, RX second and pps, and the number of
+   records dropped before this one because the client or the receive
+   side did not keep up. The TX and then the RX samples follow.
+
+   Version 3 additionally sends a uint8_t sample format (see
+   feedback_format_t), a uint8_t compression (0: none, 1: zstd) and a
+   uint16_t decimation N, and gets a feedback_v3_header_t followed by the
+   TX and the RX payload. Only every Nth sample is kept, without filtering,
+   which keeps the TX and RX samples paired as the memoryless predistortion
+   needs them. The integer formats carry value * scale. The client can
+   send further version 3 requests on the same connection.
 */
 
 /*
@@ -42,13 +65,55 @@ DESCRIPTION:
 #include <memory>
 #include <string>
 #include <atomic>
+#include <deque>
+#include <vector>
 
 #include "Log.h"
 #include "TimestampDecoder.h"
 #include "output/SDRDevice.h"
+#include "Socket.h"
 
 namespace Output {
 
+enum class feedback_format_t : uint8_t {
+    CF32 = 0,
+    SC16 = 1,
+    SC8 = 2,
+};
+
+// Response header of request version 3
+struct feedback_v3_header_t {
+    uint32_t num_samples;
+    uint32_t tx_second;
+    uint32_t tx_pps;
+    uint32_t rx_second;
+    uint32_t rx_pps;
+    uint8_t format;
+    uint8_t compression; // 0 when zstd was requested but is not available
+    uint16_t decimation;
+    float tx_scale;
+    float rx_scale;
+    uint32_t tx_bytes;
+    uint32_t rx_bytes;
+};
+static_assert(sizeof(feedback_v3_header_t) == 40, "unexpected padding");
+
+// A burst of TX samples and the corresponding RX samples
+struct FeedbackBurst {
+    std::vector<complexf> tx_samples;
+    uint32_t tx_second = 0;
+    uint32_t tx_pps = 0;
+
+    std::vector<complexf> rx_samples;
+    uint32_t rx_second = 0;
+    uint32_t rx_pps = 0;
+
+    // Seconds from the moment the TX frame was queued in the output to
+    // the transmission of the first TX sample, if the frame had a timestamp
+    bool tx_timestamp_valid = false;
+    double tx_margin = 0.0;
+};
+
 enum class BurstRequestState {
     None, // To pending request
     SaveTransmitFrame, // The TX thread has to save an outgoing frame
@@ -56,6 +121,21 @@ enum class BurstRequestState {
     Acquired, // Both TX and RX frames are ready
 };
 
+/* One record of the version 2 stream. data contains the header, the TX and the
+ * RX samples as they are sent to the client. */
+struct FeedbackStreamRecord {
+    static constexpr size_t HEADER_WORDS = 6;
+
+    size_t session = 0;
+    size_t num_samples = 0;
+    frame_timestamp tx_ts;
+    std::vector<uint8_t> data;
+
+    uint32_t* header() { return reinterpret_cast<uint32_t*>(data.data()); }
+    uint8_t* tx_samples() { return data.data() + HEADER_WORDS * sizeof(uint32_t); }
+    uint8_t* rx_samples() { return tx_samples() + num_samples * sizeof(complexf); }
+};
+
 struct FeedbackBurstRequest {
     // All fields in this struct are protected
     mutable std::mutex mutex;
@@ -67,6 +147,13 @@ struct FeedbackBurstRequest {
     // the vectors
     size_t num_samples = 0;
 
+    // The TX samples are taken at the beginning of the frame instead of
+    // at its end
+    bool from_frame_start = false;
+
+    bool tx_timestamp_valid = false;
+    double tx_margin = 0.0;
+
     // The timestamp of the first sample of the TX buffers
     uint32_t tx_second = 0;
     uint32_t tx_pps = 0; // in units of 1/16384000s
@@ -80,6 +167,18 @@ struct FeedbackBurstRequest {
     uint32_t rx_pps = 0;
 
     std::vector<uint8_t> rx_samples; // Also, actually complexf
+
+    // Streaming mode, records go from free to to_receive, to_send and
+    // back to free, so that they are only allocated when a stream starts.
+    bool stream_active = false;
+    size_t stream_session = 0;
+    size_t stream_num_samples = 0;
+    size_t stream_decimation = 1;
+    size_t stream_frame_counter = 0;
+    size_t stream_dropped = 0;
+    std::deque<FeedbackStreamRecord> stream_free;
+    std::deque<FeedbackStreamRecord> stream_to_receive;
+    std::deque<FeedbackStreamRecord> stream_to_send;
 };
 
 // Serve TX samples and RX feedback samples over a TCP connection
@@ -88,14 +187,28 @@ class DPDFeedbackServer {
         DPDFeedbackServer(
                 std::shared_ptr<SDRDevice> device,
                 uint16_t port, // Set to 0 to disable the Feedbackserver
+                const std::string& listen_address,
                 uint32_t sampleRate);
         DPDFeedbackServer(const DPDFeedbackServer& other) = delete;
         DPDFeedbackServer& operator=(const DPDFeedbackServer& other) = delete;
         ~DPDFeedbackServer();
 
-        void set_tx_frame(const std::vector<uint8_t> &buf,
+        void set_tx_frame(const Buffer &buf,
                 const frame_timestamp& ts);
 
+        /* Acquire a burst of num_samples TX and RX samples like a version 1
+         * client does, for the in-process DPD estimation. Returns false if
+         * no burst could be acquired within the timeout, for instance
+         * while a stream is active. With from_frame_start, the burst
+         * begins with the NULL symbol and the phase reference symbol. */
+        bool request_burst(size_t num_samples,
+                FeedbackBurst& burst,
+                double timeout_secs,
+                bool from_frame_start = false);
+
+        // Bytes of the burst and the stream records
+        size_t memory_usage() const;
+
     private:
         // Thread that reacts to burstRequests and receives from the SDR device
         void ReceiveBurstThread(void);
@@ -104,13 +217,30 @@ class DPDFeedbackServer {
         void ServeFeedbackThread(void);
         void ServeFeedback(void);
 
+        // Serves version 3 requests until the client disconnects
+        void ServeBursts(Socket::TCPSocket& client_sock, uint32_t num_samples);
+
+        // Streams records to the client until it disconnects
+        void ServeStream(Socket::TCPSocket& client_sock, uint32_t num_samples);
+
+        // Called by set_tx_frame() with the mutex held, in streaming mode
+        void save_stream_tx_frame(const Buffer &buf, const frame_timestamp& ts);
+
+        // Number of records of the stream that can be in flight
+        static constexpr size_t STREAM_RECORDS = 8;
+
         std::thread rx_burst_thread;
         std::thread burst_tcp_thread;
 
         FeedbackBurstRequest burstRequest;
 
+        // Serialises the burst requests of the TCP client and of
+        // request_burst()
+        std::mutex m_request_mutex;
+
         std::atomic_bool m_running;
         uint16_t m_port = 0;
+        std::string m_listen_address;
         uint32_t m_sampleRate = 0;
         std::shared_ptr<SDRDevice> m_device;
 };
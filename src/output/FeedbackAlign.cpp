@@ -0,0 +1,190 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   Time alignment and normalisation of the TX and RX feedback samples.
+*/
+
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "output/FeedbackAlign.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+using namespace std;
+
+namespace Output {
+
+// Samples at both ends of the burst that are discarded after the
+// alignment, because the fractional delay spreads the edges.
+static constexpr size_t ALIGN_MARGIN = 16;
+
+FeedbackAligner::fft_t::fft_t(size_t size) :
+    size(size)
+{
+    lock_guard<mutex> lock(fftw_planner_mutex);
+
+    a = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * size);
+    b = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * size);
+    if (a == nullptr or b == nullptr) {
+        throw runtime_error("DPDEngine: FFTW malloc failed");
+    }
+
+    // The size depends on the burst, measuring the plans is not worth it
+    forward_a = fftwf_plan_dft_1d(size, a, a, FFTW_FORWARD, FFTW_ESTIMATE);
+    forward_b = fftwf_plan_dft_1d(size, b, b, FFTW_FORWARD, FFTW_ESTIMATE);
+    backward_a = fftwf_plan_dft_1d(size, a, a, FFTW_BACKWARD, FFTW_ESTIMATE);
+}
+
+FeedbackAligner::fft_t::~fft_t()
+{
+    lock_guard<mutex> lock(fftw_planner_mutex);
+    if (forward_a) fftwf_destroy_plan(forward_a);
+    if (forward_b) fftwf_destroy_plan(forward_b);
+    if (backward_a) fftwf_destroy_plan(backward_a);
+    fftwf_free(a);
+    fftwf_free(b);
+}
+
+FeedbackAligner::result_t FeedbackAligner::align(
+        const vector<complexf>& tx, const vector<complexf>& rx,
+        vector<complexf>& tx_out, vector<complexf>& rx_out)
+{
+    const size_t n = std::min(tx.size(), rx.size());
+    if (n < MIN_SAMPLES) {
+        throw runtime_error("burst too short: " + to_string(n) + " samples");
+    }
+
+    // Zero-padding to twice the length makes the correlation linear
+    size_t fft_size = 1;
+    while (fft_size < 2 * n) {
+        fft_size <<= 1;
+    }
+
+    if (not m_fft or m_fft->size != fft_size) {
+        m_fft = make_unique<fft_t>(fft_size);
+    }
+    auto& f = *m_fft;
+    complexf *a = reinterpret_cast<complexf*>(f.a);
+    complexf *b = reinterpret_cast<complexf*>(f.b);
+
+    fill(a, a + fft_size, complexf());
+    fill(b, b + fft_size, complexf());
+    copy(tx.begin(), tx.begin() + n, a);
+    copy(rx.begin(), rx.begin() + n, b);
+    fftwf_execute(f.forward_a);
+    fftwf_execute(f.forward_b);
+
+    vector<complexf> rx_spectrum(b, b + fft_size);
+
+    // Cross-correlation: corr[lag] = sum rx[i + lag] * conj(tx[i])
+    for (size_t k = 0; k < fft_size; k++) {
+        a[k] = b[k] * conj(a[k]);
+    }
+    fftwf_execute(f.backward_a);
+
+    const long max_lag = n / 4;
+    auto corr_abs = [&](long lag) {
+        return abs(a[lag >= 0 ? lag : (long)fft_size + lag]);
+    };
+
+    long best_lag = 0;
+    for (long lag = -max_lag; lag <= max_lag; lag++) {
+        if (corr_abs(lag) > corr_abs(best_lag)) {
+            best_lag = lag;
+        }
+    }
+
+    // Refine to a fraction of a sample with a parabola through the peak
+    const double c_m = corr_abs(best_lag - 1);
+    const double c_0 = corr_abs(best_lag);
+    const double c_p = corr_abs(best_lag + 1);
+    const double denom = c_m - 2 * c_0 + c_p;
+    const double frac = (denom != 0.0) ? 0.5 * (c_m - c_p) / denom : 0.0;
+    const double delay = best_lag + std::max(-0.5, std::min(0.5, frac));
+
+    // Advance the RX samples by the delay, with a linear phase in the
+    // frequency domain.
+    for (size_t k = 0; k < fft_size; k++) {
+        const double freq = (k < fft_size / 2) ?
+            (double)k : (double)k - (double)fft_size;
+        const double phase = 2.0 * M_PI * freq * delay / fft_size;
+        a[k] = rx_spectrum[k] * complexf(cos(phase), sin(phase));
+    }
+    // The bin at half the sample rate is both the highest positive and
+    // negative frequency.
+    a[fft_size / 2] = rx_spectrum[fft_size / 2] * (float)cos(M_PI * delay);
+    fftwf_execute(f.backward_a);
+
+    const long shift = lrint(ceil(fabs(delay)));
+    const long first = ALIGN_MARGIN + (delay < 0 ? shift : 0);
+    const long last = (long)n - (long)ALIGN_MARGIN - (delay > 0 ? shift : 0);
+    if (last - first < (long)MIN_SAMPLES / 2) {
+        throw runtime_error("burst too short after alignment");
+    }
+
+    const float scale = 1.0f / fft_size;
+    tx_out.assign(tx.begin() + first, tx.begin() + last);
+    rx_out.resize(last - first);
+    for (long i = first; i < last; i++) {
+        rx_out[i - first] = a[i] * scale;
+    }
+
+    // Normalise the RX gain and phase on the samples of small amplitude,
+    // where the PA is linear.
+    vector<float> tx_mag(tx_out.size());
+    for (size_t i = 0; i < tx_out.size(); i++) {
+        tx_mag[i] = abs(tx_out[i]);
+    }
+    auto median_it = tx_mag.begin() + tx_mag.size() / 2;
+    nth_element(tx_mag.begin(), median_it, tx_mag.end());
+    const float median = *median_it;
+
+    complex<double> xy = 0;
+    double yy = 0;
+    for (size_t i = 0; i < tx_out.size(); i++) {
+        if (abs(tx_out[i]) <= median) {
+            xy += complex<double>(tx_out[i]) * conj(complex<double>(rx_out[i]));
+            yy += (double)norm(rx_out[i]);
+        }
+    }
+    if (yy == 0.0) {
+        throw runtime_error("no RX signal");
+    }
+    const complexf gain(xy / yy);
+
+    double err = 0, ref = 0;
+    for (size_t i = 0; i < rx_out.size(); i++) {
+        rx_out[i] *= gain;
+        err += (double)norm(tx_out[i] - rx_out[i]);
+        ref += (double)norm(tx_out[i]);
+    }
+
+    result_t result;
+    result.delay = delay;
+    result.nmse_db = (ref > 0 and err > 0) ? 10 * log10(err / ref) : 0.0;
+    return result;
+}
+
+} // namespace Output
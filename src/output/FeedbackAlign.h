@@ -0,0 +1,87 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   Time alignment and normalisation of the TX and RX feedback samples.
+*/
+
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include <memory>
+#include <vector>
+
+#include <fftw3.h>
+
+#include "output/SDRDevice.h"
+
+namespace Output {
+
+/* Aligns the RX samples to the TX samples with an FFT cross-correlation
+ * refined to a fraction of a sample, and normalises their gain and phase
+ * on the samples of small amplitude, where the PA is linear. Not thread
+ * safe, every user has its own. */
+class FeedbackAligner {
+    public:
+        // Shortest burst that can be aligned
+        static constexpr size_t MIN_SAMPLES = 1024;
+
+        struct result_t {
+            // Delay of the RX samples, in samples
+            double delay = 0.0;
+
+            // Power of the difference between the aligned TX and RX
+            // samples, relative to the TX power, in dB
+            double nmse_db = 0.0;
+        };
+
+        /* Sets tx_out and rx_out to the same number of aligned samples.
+         * Throws a runtime_error if the burst cannot be aligned. */
+        result_t align(const std::vector<complexf>& tx,
+                const std::vector<complexf>& rx,
+                std::vector<complexf>& tx_out,
+                std::vector<complexf>& rx_out);
+
+    private:
+        // Buffers and plans of the FFTs, kept as long as the size does
+        // not change.
+        struct fft_t {
+            explicit fft_t(size_t size);
+            fft_t(const fft_t& other) = delete;
+            fft_t& operator=(const fft_t& other) = delete;
+            ~fft_t();
+
+            size_t size;
+            fftwf_complex *a = nullptr;
+            fftwf_complex *b = nullptr;
+            fftwf_plan forward_a = nullptr;
+            fftwf_plan forward_b = nullptr;
+            fftwf_plan backward_a = nullptr;
+        };
+        std::unique_ptr<fft_t> m_fft;
+};
+
+} // namespace Output
@@ -0,0 +1,374 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   Measurement of the transmitted signal quality from the RX feedback
+   samples of the DPDFeedbackServer.
+*/
+
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "output/FeedbackMonitor.h"
+#include "Utils.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace Output {
+
+// The bursts are shorter than a transmission frame, waiting for longer
+// than this means there is no feedback.
+static constexpr double BURST_TIMEOUT_S = 10.0;
+
+// Frequency ranges of the shoulder measurement, in Hz from the centre
+static constexpr double INBAND_MAX = 668e3;
+static constexpr double SHOULDER_MIN = 926e3;
+static constexpr double SHOULDER_MAX = 1026e3;
+
+// Number of bins of the PSD given over the remote control
+static constexpr size_t PSD_EXPORT_BINS = 128;
+
+// FFT size for a resolution of about 1 kHz
+static size_t welch_fft_size(uint32_t sampleRate)
+{
+    size_t fft_size = 256;
+    while (fft_size < sampleRate / 1000) {
+        fft_size <<= 1;
+    }
+    return fft_size;
+}
+
+FeedbackMonitor::FeedbackMonitor(
+        unsigned interval,
+        size_t num_samples,
+        server_getter_t get_server,
+        uint32_t sampleRate) :
+    RemoteControllable("feedbackmonitor"),
+    m_get_server(get_server),
+    m_sampleRate(sampleRate),
+    m_fft_size(welch_fft_size(sampleRate)),
+    m_interval(interval),
+    m_num_samples(num_samples)
+{
+    RC_ADD_PARAMETER(interval, "Seconds between two measurements, 0 to pause");
+    RC_ADD_PARAMETER(num_samples, "Number of samples of every burst");
+    RC_ADD_PARAMETER(measurements, "(Read-only) Number of measurements done");
+    RC_ADD_PARAMETER(status, "(Read-only) Result of the last measurement");
+    RC_ADD_PARAMETER(mer, "(Read-only) MER of the transmitted signal in dB");
+    RC_ADD_PARAMETER(shoulder, "(Read-only) Mean of the shoulders in dB below the band");
+    RC_ADD_PARAMETER(shoulder_left, "(Read-only) Lower shoulder in dB below the band");
+    RC_ADD_PARAMETER(shoulder_right, "(Read-only) Upper shoulder in dB below the band");
+    RC_ADD_PARAMETER(delay, "(Read-only) Delay in samples of the RX feedback");
+    RC_ADD_PARAMETER(psd, "(Read-only) PSD in dB relative to the band, from -fs/2 to fs/2");
+
+    m_window.resize(m_fft_size);
+    for (size_t i = 0; i < m_fft_size; i++) {
+        m_window[i] = (float)(0.5 - 0.5 * cos(2.0 * M_PI * (double)i / (double)m_fft_size));
+    }
+
+    m_running.store(true);
+    m_thread = thread(&FeedbackMonitor::monitor_thread, this);
+}
+
+FeedbackMonitor::~FeedbackMonitor()
+{
+    m_running.store(false);
+    m_notification.notify_all();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+
+    lock_guard<mutex> lock(fftw_planner_mutex);
+    if (m_plan) {
+        fftwf_destroy_plan(m_plan);
+    }
+    fftwf_free(m_segments);
+}
+
+void FeedbackMonitor::monitor_thread()
+{
+    set_thread_name("feedbackmonitor");
+    set_thread_placement("dpdfeedback");
+
+    while (m_running) {
+        {
+            unique_lock<mutex> lock(m_mutex);
+            // A change of the interval wakes us up
+            const unsigned interval = m_interval;
+            if (interval == 0) {
+                m_notification.wait(lock);
+            }
+            else {
+                m_notification.wait_for(lock, chrono::seconds(interval));
+            }
+
+            if (not m_running) break;
+            if (m_interval == 0 or m_interval != interval) continue;
+        }
+
+        string status = "ok";
+        try {
+            measure();
+        }
+        catch (const std::exception& e) {
+            status = e.what();
+            etiLog.level(warn) << "Feedback monitor: " << e.what();
+        }
+
+        lock_guard<mutex> lock(m_mutex);
+        m_status = status;
+        m_measurements++;
+    }
+}
+
+void FeedbackMonitor::measure()
+{
+    size_t num_samples = 0;
+    {
+        lock_guard<mutex> lock(m_mutex);
+        num_samples = m_num_samples;
+    }
+
+    auto server = m_get_server();
+    if (not server) {
+        throw runtime_error("no feedback server");
+    }
+
+    FeedbackBurst burst;
+    if (not server->request_burst(num_samples, burst, BURST_TIMEOUT_S)) {
+        throw runtime_error("no feedback burst acquired");
+    }
+
+    const auto result = m_aligner.align(
+            burst.tx_samples, burst.rx_samples, m_tx, m_rx);
+
+    welch_psd(burst.rx_samples);
+
+    const double inband = mean_level(-INBAND_MAX, INBAND_MAX);
+    const double left = mean_level(-SHOULDER_MAX, -SHOULDER_MIN);
+    const double right = mean_level(SHOULDER_MIN, SHOULDER_MAX);
+
+    // Average of the PSD relative to the band, in dB, in fewer bins
+    vector<float> psd_export(PSD_EXPORT_BINS);
+    const size_t bins_per_export = m_fft_size / PSD_EXPORT_BINS;
+    for (size_t i = 0; i < PSD_EXPORT_BINS; i++) {
+        double sum = 0;
+        for (size_t k = 0; k < bins_per_export; k++) {
+            sum += pow(10.0, (double)m_psd_db[i * bins_per_export + k] / 10.0);
+        }
+        psd_export[i] = 10.0 * log10(sum / bins_per_export) - inband;
+    }
+
+    lock_guard<mutex> lock(m_mutex);
+    m_mer_db = -result.nmse_db;
+    m_delay = result.delay;
+    m_shoulder_left_db = inband - left;
+    m_shoulder_right_db = inband - right;
+    m_psd_export = std::move(psd_export);
+}
+
+void FeedbackMonitor::welch_psd(const vector<complexf>& samples)
+{
+    const size_t hop = m_fft_size / 2;
+    if (samples.size() < m_fft_size * 2) {
+        throw runtime_error("burst too short for the PSD");
+    }
+    const size_t num_segments = (samples.size() - m_fft_size) / hop + 1;
+
+    if (num_segments != m_num_segments) {
+        lock_guard<mutex> lock(fftw_planner_mutex);
+        if (m_plan) {
+            fftwf_destroy_plan(m_plan);
+        }
+        fftwf_free(m_segments);
+
+        m_segments = (fftwf_complex*)fftwf_malloc(
+                sizeof(fftwf_complex) * m_fft_size * num_segments);
+        if (m_segments == nullptr) {
+            throw runtime_error("FeedbackMonitor: FFTW malloc failed");
+        }
+
+        const int n = m_fft_size;
+        m_plan = fftwf_plan_many_dft(1, &n, num_segments,
+                m_segments, nullptr, 1, n,
+                m_segments, nullptr, 1, n,
+                FFTW_FORWARD, FFTW_ESTIMATE);
+        m_num_segments = num_segments;
+    }
+
+    complexf *segments = reinterpret_cast<complexf*>(m_segments);
+    for (size_t s = 0; s < num_segments; s++) {
+        const complexf *in = samples.data() + s * hop;
+        complexf *out = segments + s * m_fft_size;
+        for (size_t i = 0; i < m_fft_size; i++) {
+            out[i] = in[i] * m_window[i];
+        }
+    }
+
+    fftwf_execute(m_plan);
+
+    double window_power = 0;
+    for (const auto w : m_window) {
+        window_power += (double)w * (double)w;
+    }
+    const double scale = 1.0 / (window_power * num_segments);
+
+    m_psd_db.resize(m_fft_size);
+    for (size_t k = 0; k < m_fft_size; k++) {
+        double sum = 0;
+        for (size_t s = 0; s < num_segments; s++) {
+            sum += (double)norm(segments[s * m_fft_size + k]);
+        }
+
+        // Negative frequencies first
+        const size_t ix = (k + m_fft_size / 2) % m_fft_size;
+        m_psd_db[ix] = 10.0 * log10(sum * scale + 1e-20);
+    }
+}
+
+double FeedbackMonitor::mean_level(double f_from, double f_to) const
+{
+    const double bin_width = (double)m_sampleRate / m_fft_size;
+    const long centre = m_fft_size / 2;
+    const long first = std::max(0L, centre + lrint(ceil(f_from / bin_width)));
+    const long last = std::min((long)m_fft_size - 1,
+            centre + lrint(floor(f_to / bin_width)));
+
+    if (last < first) {
+        throw runtime_error("sample rate too low for the shoulder measurement");
+    }
+
+    double sum = 0;
+    for (long k = first; k <= last; k++) {
+        sum += (double)m_psd_db[k];
+    }
+    return sum / (last - first + 1);
+}
+
+string FeedbackMonitor::serialise_psd() const
+{
+    stringstream ss;
+    ss.precision(1);
+    ss << std::fixed;
+    for (size_t i = 0; i < m_psd_export.size(); i++) {
+        ss << (i ? " " : "") << m_psd_export[i];
+    }
+    return ss.str();
+}
+
+void FeedbackMonitor::set_parameter(const string& parameter, const string& value)
+{
+    stringstream ss(value);
+    ss.exceptions ( stringstream::failbit | stringstream::badbit );
+
+    unique_lock<mutex> lock(m_mutex);
+    if (parameter == "interval") {
+        ss >> m_interval;
+        lock.unlock();
+        m_notification.notify_all();
+    }
+    else if (parameter == "num_samples") {
+        size_t n = 0;
+        ss >> n;
+        if (n < std::max(FeedbackAligner::MIN_SAMPLES, 2 * m_fft_size) or
+                n > m_sampleRate) {
+            throw ParameterError("num_samples must be between " +
+                    to_string(std::max(FeedbackAligner::MIN_SAMPLES, 2 * m_fft_size)) +
+                    " and the sample rate");
+        }
+        m_num_samples = n;
+    }
+    else {
+        stringstream ss_err;
+        ss_err << "Parameter '" << parameter
+            << "' is read-only or not exported by controllable " << get_rc_name();
+        throw ParameterError(ss_err.str());
+    }
+}
+
+const string FeedbackMonitor::get_parameter(const string& parameter) const
+{
+    stringstream ss;
+    ss << std::fixed;
+
+    lock_guard<mutex> lock(m_mutex);
+    if (parameter == "interval") {
+        ss << m_interval;
+    }
+    else if (parameter == "num_samples") {
+        ss << m_num_samples;
+    }
+    else if (parameter == "measurements") {
+        ss << m_measurements;
+    }
+    else if (parameter == "status") {
+        ss << m_status;
+    }
+    else if (parameter == "mer") {
+        ss << m_mer_db;
+    }
+    else if (parameter == "shoulder") {
+        ss << (m_shoulder_left_db + m_shoulder_right_db) / 2;
+    }
+    else if (parameter == "shoulder_left") {
+        ss << m_shoulder_left_db;
+    }
+    else if (parameter == "shoulder_right") {
+        ss << m_shoulder_right_db;
+    }
+    else if (parameter == "delay") {
+        ss << m_delay;
+    }
+    else if (parameter == "psd") {
+        ss << serialise_psd();
+    }
+    else {
+        ss << "Parameter '" << parameter <<
+            "' is not exported by controllable " << get_rc_name();
+        throw ParameterError(ss.str());
+    }
+    return ss.str();
+}
+
+const json::map_t FeedbackMonitor::get_all_values() const
+{
+    json::map_t map;
+    lock_guard<mutex> lock(m_mutex);
+    map["interval"].v = m_interval;
+    map["num_samples"].v = m_num_samples;
+    map["measurements"].v = m_measurements;
+    map["status"].v = m_status;
+    map["mer"].v = m_mer_db;
+    map["shoulder"].v = (m_shoulder_left_db + m_shoulder_right_db) / 2;
+    map["shoulder_left"].v = m_shoulder_left_db;
+    map["shoulder_right"].v = m_shoulder_right_db;
+    map["delay"].v = m_delay;
+    map["psd"].v = serialise_psd();
+    return map;
+}
+
+} // namespace Output
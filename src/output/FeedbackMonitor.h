@@ -0,0 +1,127 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   Measurement of the transmitted signal quality from the RX feedback
+   samples of the DPDFeedbackServer.
+*/
+
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fftw3.h>
+
+#include "RemoteControl.h"
+#include "output/Feedback.h"
+#include "output/FeedbackAlign.h"
+#include "output/SDRDevice.h"
+
+namespace Output {
+
+/* Every interval, acquires a burst from the feedback server and computes
+ *  - the Welch PSD of the RX samples, with a Hann window of about 1 kHz
+ *    resolution and 50% overlap, all segments in one batch of FFTs;
+ *  - the shoulders: the mean level from 926 to 1026 kHz away from the
+ *    centre, below the mean level of the band up to 668 kHz, as measured
+ *    by python/dpd/Measure_Shoulders.py;
+ *  - the MER of the transmitted signal, i.e. the TX power relative to the
+ *    power of the difference between the aligned TX and RX samples. */
+class FeedbackMonitor : public RemoteControllable {
+    public:
+        using server_getter_t = std::function<std::shared_ptr<DPDFeedbackServer>()>;
+
+        FeedbackMonitor(unsigned interval, size_t num_samples,
+                server_getter_t get_server, uint32_t sampleRate);
+        FeedbackMonitor(const FeedbackMonitor& other) = delete;
+        FeedbackMonitor& operator=(const FeedbackMonitor& other) = delete;
+        ~FeedbackMonitor();
+
+        /******* REMOTE CONTROL ********/
+        virtual void set_parameter(const std::string& parameter,
+                const std::string& value) override;
+
+        virtual const std::string get_parameter(
+                const std::string& parameter) const override;
+
+        virtual const json::map_t get_all_values() const override;
+
+    private:
+        void monitor_thread();
+        void measure();
+
+        // Sets m_psd_db to the PSD of the samples, fftshifted
+        void welch_psd(const std::vector<complexf>& samples);
+
+        // Mean of m_psd_db over the bins between the two frequencies in Hz
+        double mean_level(double f_from, double f_to) const;
+
+        std::string serialise_psd() const;
+
+        server_getter_t m_get_server;
+        const uint32_t m_sampleRate;
+        const size_t m_fft_size;
+
+        FeedbackAligner m_aligner;
+
+        // Batch of Welch segments, and its plan, recreated when the
+        // number of segments changes.
+        size_t m_num_segments = 0;
+        fftwf_complex *m_segments = nullptr;
+        fftwf_plan m_plan = nullptr;
+        std::vector<float> m_window;
+
+        // Only used by the monitor thread
+        std::vector<complexf> m_tx;
+        std::vector<complexf> m_rx;
+        std::vector<float> m_psd_db;
+
+        // The settings and the results are protected by m_mutex
+        mutable std::mutex m_mutex;
+        std::condition_variable m_notification;
+        unsigned m_interval;
+        size_t m_num_samples;
+        size_t m_measurements = 0;
+        std::string m_status = "idle";
+        double m_mer_db = 0.0;
+        double m_shoulder_left_db = 0.0;
+        double m_shoulder_right_db = 0.0;
+        double m_delay = 0.0;
+        std::vector<float> m_psd_export;
+
+        std::atomic<bool> m_running = ATOMIC_VAR_INIT(false);
+        std::thread m_thread;
+};
+
+} // namespace Output
@@ -0,0 +1,269 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   Measurement of the latency from the modulator to the antenna, by
+   aligning the phase reference symbol of the RX feedback samples of the
+   DPDFeedbackServer with the transmitted one.
+*/
+
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "output/LatencyProbe.h"
+#include "Utils.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace Output {
+
+// The bursts are shorter than a transmission frame, waiting for longer
+// than this means there is no feedback.
+static constexpr double BURST_TIMEOUT_S = 10.0;
+
+// The NULL symbol and the phase reference symbol of transmission mode I,
+// in samples at 2048000 samples/s. The other modes have shorter ones,
+// followed by some data symbols.
+static constexpr size_t NULL_AND_PRS_SAMPLES = 2656 + 2552;
+
+// Number of measurements for the mean latency and the jitter
+static constexpr size_t LATENCY_WINDOW = 32;
+
+struct latency_stats_t {
+    double mean = 0.0;
+    double min = 0.0;
+    double max = 0.0;
+    double stddev = 0.0;
+};
+
+static latency_stats_t latency_stats(const deque<double>& latencies)
+{
+    latency_stats_t stats;
+    if (latencies.empty()) {
+        return stats;
+    }
+
+    stats.min = *std::min_element(latencies.begin(), latencies.end());
+    stats.max = *std::max_element(latencies.begin(), latencies.end());
+    double sum = 0.0;
+    for (const auto l : latencies) {
+        sum += l;
+    }
+    stats.mean = sum / latencies.size();
+
+    double variance = 0.0;
+    for (const auto l : latencies) {
+        variance += (l - stats.mean) * (l - stats.mean);
+    }
+    stats.stddev = sqrt(variance / latencies.size());
+    return stats;
+}
+
+LatencyProbe::LatencyProbe(
+        unsigned interval,
+        server_getter_t get_server,
+        uint32_t sampleRate) :
+    RemoteControllable("latencyprobe"),
+    m_get_server(get_server),
+    m_sampleRate(sampleRate),
+    m_num_samples(std::max(FeedbackAligner::MIN_SAMPLES,
+                (size_t)((uint64_t)NULL_AND_PRS_SAMPLES * sampleRate / 2048000))),
+    m_interval(interval)
+{
+    RC_ADD_PARAMETER(interval, "Seconds between two measurements, 0 to pause");
+    RC_ADD_PARAMETER(measurements, "(Read-only) Number of measurements done");
+    RC_ADD_PARAMETER(status, "(Read-only) Result of the last measurement");
+    RC_ADD_PARAMETER(latency, "(Read-only) Mean latency from the SDR output queue to the RX feedback in ms, over the last measurements");
+    RC_ADD_PARAMETER(latency_min, "(Read-only) Minimum of the latency in ms, over the last measurements");
+    RC_ADD_PARAMETER(latency_max, "(Read-only) Maximum of the latency in ms, over the last measurements");
+    RC_ADD_PARAMETER(jitter, "(Read-only) Standard deviation of the latency in ms, over the last measurements");
+    RC_ADD_PARAMETER(margin, "(Read-only) Time from the SDR output queue to the timestamp of the frame in ms, last measurement");
+    RC_ADD_PARAMETER(device_delay, "(Read-only) Time from the timestamp of the frame to the RX feedback in ms, last measurement");
+
+    m_running.store(true);
+    m_thread = thread(&LatencyProbe::probe_thread, this);
+}
+
+LatencyProbe::~LatencyProbe()
+{
+    m_running.store(false);
+    m_notification.notify_all();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+void LatencyProbe::probe_thread()
+{
+    set_thread_name("latencyprobe");
+    set_thread_placement("dpdfeedback");
+
+    while (m_running) {
+        {
+            unique_lock<mutex> lock(m_mutex);
+            // A change of the interval wakes us up
+            const unsigned interval = m_interval;
+            if (interval == 0) {
+                m_notification.wait(lock);
+            }
+            else {
+                m_notification.wait_for(lock, chrono::seconds(interval));
+            }
+
+            if (not m_running) break;
+            if (m_interval == 0 or m_interval != interval) continue;
+        }
+
+        string status = "ok";
+        try {
+            measure();
+        }
+        catch (const std::exception& e) {
+            status = e.what();
+            etiLog.level(warn) << "Latency probe: " << e.what();
+        }
+
+        lock_guard<mutex> lock(m_mutex);
+        m_status = status;
+        m_measurements++;
+    }
+}
+
+void LatencyProbe::measure()
+{
+    auto server = m_get_server();
+    if (not server) {
+        throw runtime_error("no feedback server");
+    }
+
+    FeedbackBurst burst;
+    if (not server->request_burst(m_num_samples, burst, BURST_TIMEOUT_S,
+                true)) {
+        throw runtime_error("no feedback burst acquired");
+    }
+    if (not burst.tx_timestamp_valid) {
+        throw runtime_error("the frames have no timestamp");
+    }
+
+    const auto result = m_aligner.align(
+            burst.tx_samples, burst.rx_samples, m_tx, m_rx);
+
+    // The reception can start later than requested
+    const double rx_start = (double)burst.rx_second - burst.tx_second +
+        ((double)burst.rx_pps - burst.tx_pps) / 16384000.0;
+    const double device_delay = rx_start + result.delay / m_sampleRate;
+
+    lock_guard<mutex> lock(m_mutex);
+    m_margin = burst.tx_margin;
+    m_device_delay = device_delay;
+    m_latencies.push_back(burst.tx_margin + device_delay);
+    if (m_latencies.size() > LATENCY_WINDOW) {
+        m_latencies.pop_front();
+    }
+}
+
+void LatencyProbe::set_parameter(const string& parameter, const string& value)
+{
+    stringstream ss(value);
+    ss.exceptions ( stringstream::failbit | stringstream::badbit );
+
+    unique_lock<mutex> lock(m_mutex);
+    if (parameter == "interval") {
+        ss >> m_interval;
+        lock.unlock();
+        m_notification.notify_all();
+    }
+    else {
+        stringstream ss_err;
+        ss_err << "Parameter '" << parameter
+            << "' is read-only or not exported by controllable " << get_rc_name();
+        throw ParameterError(ss_err.str());
+    }
+}
+
+const string LatencyProbe::get_parameter(const string& parameter) const
+{
+    stringstream ss;
+    ss << std::fixed << std::setprecision(3);
+
+    lock_guard<mutex> lock(m_mutex);
+    const auto stats = latency_stats(m_latencies);
+    if (parameter == "interval") {
+        ss << m_interval;
+    }
+    else if (parameter == "measurements") {
+        ss << m_measurements;
+    }
+    else if (parameter == "status") {
+        ss << m_status;
+    }
+    else if (parameter == "latency") {
+        ss << stats.mean * 1e3;
+    }
+    else if (parameter == "latency_min") {
+        ss << stats.min * 1e3;
+    }
+    else if (parameter == "latency_max") {
+        ss << stats.max * 1e3;
+    }
+    else if (parameter == "jitter") {
+        ss << stats.stddev * 1e3;
+    }
+    else if (parameter == "margin") {
+        ss << m_margin * 1e3;
+    }
+    else if (parameter == "device_delay") {
+        ss << m_device_delay * 1e3;
+    }
+    else {
+        ss << "Parameter '" << parameter <<
+            "' is not exported by controllable " << get_rc_name();
+        throw ParameterError(ss.str());
+    }
+    return ss.str();
+}
+
+const json::map_t LatencyProbe::get_all_values() const
+{
+    json::map_t map;
+    lock_guard<mutex> lock(m_mutex);
+    const auto stats = latency_stats(m_latencies);
+    map["interval"].v = m_interval;
+    map["measurements"].v = m_measurements;
+    map["status"].v = m_status;
+    map["latency"].v = stats.mean * 1e3;
+    map["latency_min"].v = stats.min * 1e3;
+    map["latency_max"].v = stats.max * 1e3;
+    map["jitter"].v = stats.stddev * 1e3;
+    map["margin"].v = m_margin * 1e3;
+    map["device_delay"].v = m_device_delay * 1e3;
+    return map;
+}
+
+} // namespace Output
@@ -0,0 +1,111 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   Measurement of the latency from the modulator to the antenna, by
+   aligning the phase reference symbol of the RX feedback samples of the
+   DPDFeedbackServer with the transmitted one.
+*/
+
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "RemoteControl.h"
+#include "output/Feedback.h"
+#include "output/FeedbackAlign.h"
+#include "output/SDRDevice.h"
+
+namespace Output {
+
+/* Every interval, acquires a short burst that begins with the NULL symbol
+ * and the phase reference symbol of a frame, and aligns the RX samples
+ * with it. The latency is the sum of
+ *  - the margin: from the moment the frame is queued in the SDR output to
+ *    its timestamp, which the buffering in the output and in the device
+ *    driver have to stay within;
+ *  - the device delay: from the timestamp to the moment the RX feedback
+ *    receives the samples, i.e. the DAC, the analog path and the ADC.
+ * The frames need timestamps. The jitter is the standard deviation of the
+ * latency over the last measurements. */
+class LatencyProbe : public RemoteControllable {
+    public:
+        using server_getter_t = std::function<std::shared_ptr<DPDFeedbackServer>()>;
+
+        LatencyProbe(unsigned interval,
+                server_getter_t get_server, uint32_t sampleRate);
+        LatencyProbe(const LatencyProbe& other) = delete;
+        LatencyProbe& operator=(const LatencyProbe& other) = delete;
+        ~LatencyProbe();
+
+        /******* REMOTE CONTROL ********/
+        virtual void set_parameter(const std::string& parameter,
+                const std::string& value) override;
+
+        virtual const std::string get_parameter(
+                const std::string& parameter) const override;
+
+        virtual const json::map_t get_all_values() const override;
+
+    private:
+        void probe_thread();
+        void measure();
+
+        server_getter_t m_get_server;
+        const uint32_t m_sampleRate;
+        const size_t m_num_samples;
+
+        FeedbackAligner m_aligner;
+
+        // Only used by the probe thread
+        std::vector<complexf> m_tx;
+        std::vector<complexf> m_rx;
+
+        // The settings and the results are protected by m_mutex, all
+        // durations are in seconds
+        mutable std::mutex m_mutex;
+        std::condition_variable m_notification;
+        unsigned m_interval;
+        size_t m_measurements = 0;
+        std::string m_status = "idle";
+        double m_margin = 0.0;
+        double m_device_delay = 0.0;
+        std::deque<double> m_latencies;
+
+        std::atomic<bool> m_running = ATOMIC_VAR_INIT(false);
+        std::thread m_thread;
+};
+
+} // namespace Output
@@ -228,13 +228,20 @@ Lime::Lime(SDRDeviceConfig &config) : SDRDevice(), m_conf(config)
 
     // Frame duration is 96ms
     const size_t samplerate_ratio = m_conf.sampleRate / 2048000;
-    const size_t buffer_size = FRAME_LENGTH * m_interpolate * samplerate_ratio * 10; // We take 10 Frame buffer size Fifo
+    const size_t buffer_size = FRAME_LENGTH * m_interpolate * samplerate_ratio * m_conf.limeFifoFrames;
     // Fifo seems to be round to multiple of SampleRate
     m_tx_stream.channel = m_channel;
     m_tx_stream.fifoSize = buffer_size;
-    m_tx_stream.throughputVsLatency = 2.0; // Should be {0..1} but could be extended 
+    m_tx_stream.throughputVsLatency = m_conf.limeThroughputVsLatency; // Should be {0..1} but could be extended
     m_tx_stream.isTx = LMS_CH_TX;
-    m_tx_stream.dataFmt = lms_stream_t::LMS_FMT_I16;
+
+    // The 12-bit format takes a quarter less USB bandwidth, the samples
+    // are still given in int16_t
+    m_i12 = (m_conf.otwFormat == "sc12");
+    m_tx_stream.dataFmt = m_i12 ?
+        lms_stream_t::LMS_FMT_I12 : lms_stream_t::LMS_FMT_I16;
+    etiLog.level(info) << "LimeSDR TX stream FIFO of " << buffer_size <<
+        " samples, " << (m_i12 ? "12" : "16") << "-bit samples";
     if (LMS_SetupStream(m_device, &m_tx_stream) < 0)
     {
         etiLog.level(error) << "Error making LimeSDR device: %s " << LMS_GetLastErrorMessage();
@@ -242,10 +249,19 @@ Lime::Lime(SDRDeviceConfig &config) : SDRDevice(), m_conf(config)
     }
     LMS_StartStream(&m_tx_stream);
     LMS_SetGFIR(m_device, LMS_CH_TX, m_channel, LMS_GFIR3, true);
+
+    m_running.store(true);
+    m_async_thread = std::thread(&Lime::monitor_async_thread, this);
 }
 
 Lime::~Lime()
 {
+    m_running.store(false);
+    if (m_async_thread.joinable())
+    {
+        m_async_thread.join();
+    }
+
     if (m_device != nullptr)
     {
         LMS_StopStream(&m_tx_stream);
@@ -321,11 +337,14 @@ double Lime::get_bandwidth(void) const
 SDRDevice::run_statistics_t Lime::get_run_statistics(void) const
 {
     run_statistics_t rs;
-    rs["underruns"].v = underflows;
-    rs["overruns"].v = overflows;
-    rs["dropped_packets"].v = dropped_packets;
+    m_tx_events.add_to(rs);
+    rs["overruns"].v = overflows.load();
+    rs["dropped_packets"].v = m_tx_events.seq_errors.load();
     rs["frames"].v = num_frames_modulated;
     rs["fifo_fill"].v = m_last_fifo_fill_percent * 100;
+    rs["fifo_size"].v = m_fifo_size.load();
+    // In bytes per second over USB or PCIe
+    rs["link_rate"].v = m_link_rate.load();
     return rs;
 }
 
@@ -388,31 +407,45 @@ void Lime::transmit_frame(struct FrameData&& frame)
     if (not m_device)
         throw runtime_error("Lime device not set up");
 
-    // The frame buffer contains bytes representing FC32 samples
-    const complexf *buf = reinterpret_cast<const complexf *>(frame.buf.data());
-    const size_t numSamples = frame.buf.size() / sizeof(complexf);
+    // The frame buffer contains bytes representing SC16 samples, or FC32
+    // samples when the DPD feedback server is used.
+    const short *buffi16 = nullptr;
+    size_t numSamples = 0;
+    if (frame.sampleSize == 2 * sizeof(int16_t) and m_i12)
+    {
+        const short *in = reinterpret_cast<const short *>(frame.buf.getData());
+        numSamples = frame.buf.getLength() / frame.sampleSize;
 
-    m_i16samples.resize(numSamples * 2);
-    short *buffi16 = &m_i16samples[0];
-    
-    conv_s16_from_float(numSamples * 2, (const float *)buf, buffi16);
-    if ((frame.buf.size() % sizeof(complexf)) != 0)
+        m_i16samples.resize(numSamples * 2);
+        for (size_t i = 0; i < numSamples * 2; i++) {
+            m_i16samples[i] = in[i] >> 4;
+        }
+        buffi16 = &m_i16samples[0];
+    }
+    else if (frame.sampleSize == 2 * sizeof(int16_t))
     {
-        throw runtime_error("Lime: invalid buffer size");
+        buffi16 = reinterpret_cast<const short *>(frame.buf.getData());
+        numSamples = frame.buf.getLength() / frame.sampleSize;
+    }
+    else
+    {
+        const complexf *buf = reinterpret_cast<const complexf *>(frame.buf.getData());
+        numSamples = frame.buf.getLength() / sizeof(complexf);
+
+        m_i16samples.resize(numSamples * 2);
+        conv_s16_from_float(numSamples * 2, (const float *)buf, &m_i16samples[0]);
+        if (m_i12) {
+            for (auto& s : m_i16samples) {
+                s >>= 4;
+            }
+        }
+        buffi16 = &m_i16samples[0];
     }
 
-    lms_stream_status_t LimeStatus;
-    LMS_GetStreamStatus(&m_tx_stream, &LimeStatus);
-    overflows += LimeStatus.overrun;
-    underflows += LimeStatus.underrun;
-    dropped_packets += LimeStatus.droppedPackets;
-
-#ifdef LIMEDEBUG
-    etiLog.level(info) << LimeStatus.fifoFilledCount << "/" << LimeStatus.fifoSize << ":" << numSamples << "Rate" << LimeStatus.linkRate / (2 * 2.0);
-    etiLog.level(info) << "overrun" << LimeStatus.overrun << "underun" << LimeStatus.underrun << "drop" << LimeStatus.droppedPackets;
-#endif
-
-    m_last_fifo_fill_percent.store((float)LimeStatus.fifoFilledCount / (float)LimeStatus.fifoSize);
+    if ((frame.buf.getLength() % frame.sampleSize) != 0)
+    {
+        throw runtime_error("Lime: invalid buffer size");
+    }
 
     /*
     if(LimeStatus.fifoFilledCount>=5*FRAME_LENGTH*m_interpolate) // Start if FIFO is half full {
@@ -450,6 +483,43 @@ void Lime::transmit_frame(struct FrameData&& frame)
     num_frames_modulated++;
 }
 
+void Lime::monitor_async_thread()
+{
+    set_thread_name("limeasync");
+
+    auto last_print_time = std::chrono::steady_clock::now();
+
+    while (m_running.load())
+    {
+        // The counters of the status are reset every time it is read
+        lms_stream_status_t LimeStatus;
+        if (LMS_GetStreamStatus(&m_tx_stream, &LimeStatus) == 0)
+        {
+            overflows += LimeStatus.overrun;
+            m_tx_events.underflows += LimeStatus.underrun;
+            m_tx_events.seq_errors += LimeStatus.droppedPackets;
+            m_last_fifo_fill_percent.store(
+                (float)LimeStatus.fifoFilledCount / (float)LimeStatus.fifoSize);
+            m_fifo_size.store(LimeStatus.fifoSize);
+            m_link_rate.store(LimeStatus.linkRate);
+
+#ifdef LIMEDEBUG
+            etiLog.level(info) << LimeStatus.fifoFilledCount << "/" << LimeStatus.fifoSize << " Rate" << LimeStatus.linkRate / (2 * 2.0);
+            etiLog.level(info) << "overrun" << LimeStatus.overrun << "underun" << LimeStatus.underrun << "drop" << LimeStatus.droppedPackets;
+#endif
+        }
+
+        const auto time_now = std::chrono::steady_clock::now();
+        if (last_print_time + std::chrono::seconds(1) < time_now)
+        {
+            m_tx_events.log_changes("LimeSDR");
+            last_print_time = time_now;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+}
+
 } // namespace Output
 
 #endif // HAVE_LIMESDR
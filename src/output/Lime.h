@@ -42,6 +42,7 @@ DESCRIPTION:
 #include <atomic>
 #include <string>
 #include <memory>
+#include <thread>
 
 #include "output/SDR.h"
 #include "ModPlugin.h"
@@ -68,6 +69,7 @@ class Lime : public Output::SDRDevice
     virtual double get_bandwidth(void) const override;
     virtual void transmit_frame(struct FrameData&& frame) override;
     virtual run_statistics_t get_run_statistics(void) const override;
+    virtual const TxEventCounters* get_tx_event_counters(void) const override { return &m_tx_events; }
     virtual double get_real_secs(void) const override;
 
     virtual void set_rxgain(double rxgain) override;
@@ -93,12 +95,20 @@ class Lime : public Output::SDRDevice
     size_t m_interpolate = 1;
     std::vector<complexf> interpolatebuf;
     std::vector<short> m_i16samples; 
+    // With the 12-bit stream format, the samples are scaled to 12 bits
+    bool m_i12 = false;
     std::atomic<float> m_last_fifo_fill_percent = ATOMIC_VAR_INIT(0);
+    std::atomic<size_t> m_fifo_size = ATOMIC_VAR_INIT(0);
+    std::atomic<double> m_link_rate = ATOMIC_VAR_INIT(0);
 
-    size_t underflows = 0;
-    size_t overflows = 0;
-    size_t dropped_packets = 0;
+    TxEventCounters m_tx_events;
+    std::atomic<size_t> overflows = ATOMIC_VAR_INIT(0);
     size_t num_frames_modulated = 0;
+
+    // Poll the TX stream status of the device
+    std::atomic<bool> m_running = ATOMIC_VAR_INIT(false);
+    std::thread m_async_thread;
+    void monitor_async_thread(void);
 };
 
 } // namespace Output
@@ -0,0 +1,176 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+ */
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "output/RxRing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+namespace Output {
+
+using namespace std;
+
+RxRing::RxRing(size_t capacity, size_t block, double sample_rate) :
+    m_block(block),
+    m_sample_rate(sample_rate),
+    m_samples(capacity)
+{
+    if (block == 0 or capacity < 2 * block or sample_rate <= 0) {
+        throw invalid_argument("RxRing: invalid settings");
+    }
+}
+
+complexf *RxRing::write_ptr(size_t& max_samples)
+{
+    const uint64_t w = m_written.load(memory_order_relaxed);
+    const size_t pos = w % m_samples.size();
+    max_samples = min(m_block, m_samples.size() - pos);
+
+    // The readers must see the reservation before the samples change
+    m_reserved.store(w + max_samples, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    return &m_samples[pos];
+}
+
+void RxRing::commit(size_t n, long long time_ns, bool time_valid)
+{
+    const uint64_t w = m_written.load(memory_order_relaxed);
+    const double sample_ns = 1e9 / m_sample_rate;
+
+    bool new_segment = false;
+    if (not m_has_segment) {
+        new_segment = true;
+        if (not time_valid) {
+            // Without device time, the first samples were received now
+            using namespace chrono;
+            time_ns = duration_cast<nanoseconds>(
+                    system_clock::now().time_since_epoch()).count() -
+                llround(n * sample_ns);
+        }
+    }
+    else if (time_valid) {
+        const long long expected_ns =
+            m_segment_ns.load(memory_order_relaxed) +
+            llround((w - m_segment_sample.load(memory_order_relaxed)) * sample_ns);
+        new_segment = fabs((double)(time_ns - expected_ns)) > sample_ns;
+    }
+
+    if (new_segment) {
+        const uint64_t seq = m_segment_seq.load(memory_order_relaxed);
+        m_segment_seq.store(seq + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        m_segment_sample.store(w, memory_order_relaxed);
+        m_segment_ns.store(time_ns, memory_order_relaxed);
+        m_segment_seq.store(seq + 2, memory_order_release);
+
+        if (m_has_segment) {
+            m_discontinuities++;
+        }
+        m_has_segment = true;
+    }
+
+    m_written.store(w + n, memory_order_release);
+}
+
+RxRing::segment_t RxRing::load_segment() const
+{
+    segment_t segment;
+    for (;;) {
+        const uint64_t seq = m_segment_seq.load(memory_order_acquire);
+        if (seq % 2 == 1) {
+            continue;
+        }
+        segment.seq = seq;
+        segment.first_sample = m_segment_sample.load(memory_order_relaxed);
+        segment.first_ns = m_segment_ns.load(memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        if (m_segment_seq.load(memory_order_relaxed) == seq) {
+            return segment;
+        }
+    }
+}
+
+size_t RxRing::read(complexf *buf, size_t num_samples,
+        long long& time_ns, double timeout_secs) const
+{
+    using namespace chrono;
+    const auto deadline = steady_clock::now() +
+        duration_cast<steady_clock::duration>(duration<double>(timeout_secs));
+    const size_t capacity = m_samples.size();
+
+    /* The reader polls for samples that are not received yet, so that the
+     * capture thread never has to wake it up. The requests come from the
+     * DPD feedback and the monitoring, a few times per second at most. */
+    for (;;) {
+        const segment_t segment = load_segment();
+        const uint64_t written = m_written.load(memory_order_acquire);
+
+        if (segment.seq == 0 or written == 0) {
+            if (steady_clock::now() > deadline) {
+                return 0;
+            }
+            this_thread::sleep_for(milliseconds(1));
+            continue;
+        }
+
+        // Keep a block away from the samples the writer overwrites next
+        const uint64_t oldest = max(segment.first_sample,
+                written > capacity - m_block ? written - (capacity - m_block) : 0);
+
+        const long long offset = llround(
+                (time_ns - segment.first_ns) * m_sample_rate / 1e9);
+        uint64_t start = (long long)segment.first_sample + offset < (long long)oldest ?
+            oldest : segment.first_sample + offset;
+
+        size_t n = min(num_samples, capacity - m_block);
+        if (start + n > written) {
+            if (steady_clock::now() < deadline) {
+                this_thread::sleep_for(milliseconds(1));
+                continue;
+            }
+            n = written > start ? written - start : 0;
+        }
+
+        const size_t pos = start % capacity;
+        const size_t first = min(n, capacity - pos);
+        memcpy(buf, &m_samples[pos], first * sizeof(complexf));
+        memcpy(buf + first, &m_samples[0], (n - first) * sizeof(complexf));
+
+        atomic_thread_fence(memory_order_acquire);
+        if (m_reserved.load(memory_order_relaxed) > start + capacity or
+                m_segment_seq.load(memory_order_relaxed) != segment.seq) {
+            // Overwritten during the copy, try again with newer samples
+            continue;
+        }
+
+        time_ns = segment.first_ns +
+            llround((start - segment.first_sample) * 1e9 / m_sample_rate);
+        return n;
+    }
+}
+
+} // namespace Output
@@ -0,0 +1,112 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   A ring of timestamped RX samples, filled continuously by the capture
+   thread of an SDR device, from which the DPD feedback and the monitoring
+   take windows of samples without a round trip to the device.
+*/
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "ModPlugin.h"
+
+namespace Output {
+
+/* One capture thread writes into the ring, any number of threads read
+ * from it, and neither takes a lock. The samples are counted from the
+ * start of the capture, and a segment maps the sample count to the time
+ * of the device. A new segment starts when the time of the received
+ * samples does not follow the previous ones, after an overflow for
+ * instance.
+ *
+ * The writer announces the samples it is about to overwrite before
+ * writing them, and a reader checks after its copy that they were not
+ * overwritten in the meantime, like with a seqlock. The segment is
+ * protected the same way. */
+class RxRing
+{
+    public:
+        /* capacity and block in samples. The writer receives at most
+         * block samples at a time. */
+        RxRing(size_t capacity, size_t block, double sample_rate);
+        RxRing(const RxRing& other) = delete;
+        RxRing& operator=(const RxRing& other) = delete;
+
+        /* Writer: where to receive the next samples, and how many fit at
+         * that place, at most one block. */
+        complexf *write_ptr(size_t& max_samples);
+
+        /* Writer: publish the n samples received at write_ptr(). time_ns
+         * is the device time of the first one, ignored if time_valid is
+         * false, in which case the samples are taken to follow the
+         * previous ones. */
+        void commit(size_t n, long long time_ns, bool time_valid);
+
+        /* Reader: copy num_samples from time_ns into buf, waiting up to
+         * timeout_secs for them to be received. If the samples at time_ns
+         * are not in the ring anymore, or never were, the copy starts with
+         * the oldest samples after that time. Sets time_ns to the time of
+         * the first sample copied, and returns the number of samples, at
+         * most the capacity minus one block. */
+        size_t read(complexf *buf, size_t num_samples,
+                long long& time_ns, double timeout_secs) const;
+
+        // Number of segments started after the first one
+        size_t num_discontinuities() const { return m_discontinuities.load(); }
+
+    private:
+        struct segment_t {
+            uint64_t seq = 0;
+            uint64_t first_sample = 0;
+            long long first_ns = 0;
+        };
+
+        segment_t load_segment() const;
+
+        const size_t m_block;
+        const double m_sample_rate;
+        std::vector<complexf> m_samples;
+
+        // Samples published, and samples the writer may be overwriting
+        std::atomic<uint64_t> m_written = ATOMIC_VAR_INIT(0);
+        std::atomic<uint64_t> m_reserved = ATOMIC_VAR_INIT(0);
+
+        // Odd while the writer changes the segment
+        std::atomic<uint64_t> m_segment_seq = ATOMIC_VAR_INIT(0);
+        std::atomic<uint64_t> m_segment_sample = ATOMIC_VAR_INIT(0);
+        std::atomic<long long> m_segment_ns = ATOMIC_VAR_INIT(0);
+        bool m_has_segment = false;
+
+        std::atomic<size_t> m_discontinuities = ATOMIC_VAR_INIT(0);
+};
+
+} // namespace Output
@@ -32,10 +32,13 @@
 #include "PcDebug.h"
 #include "Log.h"
 #include "RemoteControl.h"
+#include "Simd.h"
 #include "Utils.h"
 
+#include <algorithm>
 #include <chrono>
 #include <cmath>
+#include <cstring>
 #include <iostream>
 #include <assert.h>
 #include <stdexcept>
@@ -55,6 +58,15 @@ namespace Output {
 static constexpr size_t FRAMES_MAX_SIZE_UNSYNC = 8;
 static constexpr size_t FRAMES_MAX_SIZE_SYNC = 250;
 
+// In adaptive mode, the queue depth is reduced by one frame after this
+// many frames without the queue running empty, and increased by
+// QUEUE_ADAPTIVE_GROW frames every time it does.
+static constexpr size_t QUEUE_ADAPTIVE_SHRINK_FRAMES = 250;
+static constexpr size_t QUEUE_ADAPTIVE_GROW = 2;
+
+// Number of frames over which the queue depth statistics are taken
+static constexpr size_t QUEUE_STATS_FRAMES = 100;
+
 // If the timestamp is further in the future than
 // 100 seconds, abort
 static constexpr double TIMESTAMP_ABORT_FUTURE = 100;
@@ -62,6 +74,8 @@ static constexpr double TIMESTAMP_ABORT_FUTURE = 100;
 SDR::SDR(SDRDeviceConfig& config, std::shared_ptr<SDRDevice> device) :
     ModOutput(), ModMetadata(), RemoteControllable("sdr"),
     m_config(config),
+    m_queue(FRAMES_MAX_SIZE_SYNC),
+    m_recycled_frames(max_recycled_frames),
     m_device(device)
 {
     // muting is remote-controllable
@@ -74,7 +88,32 @@ SDR::SDR(SDRDeviceConfig& config, std::shared_ptr<SDRDevice> device) :
         m_dpd_feedback_server = make_shared<DPDFeedbackServer>(
                 m_device,
                 m_config.dpdFeedbackServerPort,
+                m_config.dpdFeedbackServerAddress,
                 m_config.sampleRate);
+
+        if (m_config.dpdEngine.enabled) {
+            m_dpd_engine = make_unique<DPDEngine>(m_config.dpdEngine,
+                    [this]() { return std::atomic_load(&m_dpd_feedback_server); },
+                    m_config.sampleRate);
+            rcs.enrol(m_dpd_engine.get());
+        }
+
+        if (m_config.feedbackMonitorInterval > 0) {
+            m_feedback_monitor = make_unique<FeedbackMonitor>(
+                    m_config.feedbackMonitorInterval,
+                    m_config.feedbackMonitorNumSamples,
+                    [this]() { return std::atomic_load(&m_dpd_feedback_server); },
+                    m_config.sampleRate);
+            rcs.enrol(m_feedback_monitor.get());
+        }
+
+        if (m_config.latencyProbeInterval > 0) {
+            m_latency_probe = make_unique<LatencyProbe>(
+                    m_config.latencyProbeInterval,
+                    [this]() { return std::atomic_load(&m_dpd_feedback_server); },
+                    m_config.sampleRate);
+            rcs.enrol(m_latency_probe.get());
+        }
     }
 
     RC_ADD_PARAMETER(txgain, "TX gain");
@@ -82,10 +121,11 @@ SDR::SDR(SDRDeviceConfig& config, std::shared_ptr<SDRDevice> device) :
     RC_ADD_PARAMETER(bandwidth, "Analog front-end bandwidth");
     RC_ADD_PARAMETER(freq, "Transmission frequency in Hz");
     RC_ADD_PARAMETER(channel, "Transmission frequency as channel");
-    RC_ADD_PARAMETER(muting, "Mute the output by stopping the transmitter");
+    RC_ADD_PARAMETER(muting, "Mute the output, the modulator then gives frames of zeros that keep the transmitter streaming");
     RC_ADD_PARAMETER(temp, "Temperature in degrees C of the device");
     RC_ADD_PARAMETER(underruns, "Counter of number of underruns");
     RC_ADD_PARAMETER(latepackets, "Counter of number of late packets");
+    RC_ADD_PARAMETER(seq_errors, "Counter of number of packets lost between host and device");
     RC_ADD_PARAMETER(frames, "Counter of number of frames modulated");
     RC_ADD_PARAMETER(synchronous, "1 if configured for synchronous transmission");
     RC_ADD_PARAMETER(max_gps_holdover_time, "Max holdover duration in seconds");
@@ -98,10 +138,27 @@ SDR::SDR(SDRDeviceConfig& config, std::shared_ptr<SDRDevice> device) :
 #endif // HAVE_OUTPUT_UHD
 
     RC_ADD_PARAMETER(queued_frames_ms, "Number of frames queued, represented in milliseconds");
+    RC_ADD_PARAMETER(queue_depth, "Maximum number of frames in the queue, 0 for the default");
+    RC_ADD_PARAMETER(queue_prefill, "Number of frames to queue before transmitting after the queue ran empty");
+    RC_ADD_PARAMETER(queue_adaptive, "1 to reduce the queue depth as long as the queue does not run empty");
+    RC_ADD_PARAMETER(queue_target, "(Read-only) Current maximum number of frames in the queue");
+    RC_ADD_PARAMETER(queue_min_ms, "(Read-only) Minimum queue depth in milliseconds over the last 100 frames");
+    RC_ADD_PARAMETER(queue_max_ms, "(Read-only) Maximum queue depth in milliseconds over the last 100 frames");
+    RC_ADD_PARAMETER(queue_avg_ms, "(Read-only) Average queue depth in milliseconds over the last 100 frames");
+    RC_ADD_PARAMETER(queue_underruns, "(Read-only) Number of times the queue ran empty");
+    RC_ADD_PARAMETER(queue_overflows, "(Read-only) Number of frames dropped because the queue was full");
+    RC_ADD_PARAMETER(latency_min_ms, "(Read-only) Minimum time in milliseconds from the reception of a frame to its queueing, over the last 100 frames");
+    RC_ADD_PARAMETER(latency_max_ms, "(Read-only) Maximum time in milliseconds from the reception of a frame to its queueing, over the last 100 frames");
+    RC_ADD_PARAMETER(latency_avg_ms, "(Read-only) Average time in milliseconds from the reception of a frame to its queueing, over the last 100 frames");
+    RC_ADD_PARAMETER(tist_slack_ms, "(Read-only) Minimum time in milliseconds from the queueing of a frame to its transmission time, over the last 100 frames");
+    RC_ADD_PARAMETER(tist_offset_min, "(Read-only) Smallest TIST offset in seconds that leaves the offset guard to all of the last 100 frames, 0 if unknown");
 
 #ifdef HAVE_LIMESDR
     if (std::dynamic_pointer_cast<Lime>(device)) {
         RC_ADD_PARAMETER(fifo_fill, "A value representing the Lime FIFO fullness [percent]");
+        RC_ADD_PARAMETER(fifo_size, "(Read-only) Size of the Lime FIFO in samples");
+        RC_ADD_PARAMETER(link_rate, "(Read-only) Lime USB or PCIe data rate in bytes per second");
+        RC_ADD_PARAMETER(dropped_packets, "(Read-only) Number of packets the Lime dropped");
     }
 #endif // HAVE_LIMESDR
 
@@ -113,6 +170,32 @@ SDR::SDR(SDRDeviceConfig& config, std::shared_ptr<SDRDevice> device) :
     }
 #endif // HAVE_DEXTER
 
+    m_metrics.add_counter("odr_sdr_queue_underruns_total",
+            "Number of times the SDR output queue ran empty",
+            [this]() { return num_queue_underruns.load(); });
+    m_metrics.add_counter("odr_sdr_queue_overflows_total",
+            "Number of frames dropped because the SDR output queue was full",
+            [this]() { return num_queue_overflows.load(); });
+    m_metrics.add_gauge("odr_sdr_queued_frames",
+            "Number of transmission frames in the SDR output queue",
+            [this]() { return m_queued_frames.load(); });
+    m_metrics.add_gauge("odr_sdr_queue_target_frames",
+            "Current maximum number of frames in the SDR output queue",
+            [this]() { return m_queue_target.load(); });
+
+    // The device outlives us, m_device is never replaced
+    const TxEventCounters *tx_events = m_device->get_tx_event_counters();
+    if (tx_events) {
+        m_metrics.add_counter("odr_sdr_underruns_total",
+                "Number of underruns reported by the SDR device",
+                [tx_events]() { return tx_events->underflows.load(); });
+        m_metrics.add_counter("odr_sdr_late_packets_total",
+                "Number of late packets reported by the SDR device",
+                [tx_events]() { return tx_events->late_packets.load(); });
+        m_metrics.add_counter("odr_sdr_seq_errors_total",
+                "Number of sequence errors reported by the SDR device",
+                [tx_events]() { return tx_events->seq_errors.load(); });
+    }
 
 }
 
@@ -122,6 +205,11 @@ SDR::~SDR()
 
     m_queue.trigger_wakeup();
 
+    // The engine, the monitor and the probe use the feedback server
+    m_dpd_engine.reset();
+    m_feedback_monitor.reset();
+    m_latency_probe.reset();
+
     if (m_device_thread.joinable()) {
         m_device_thread.join();
     }
@@ -132,34 +220,46 @@ void SDR::set_sample_size(size_t size)
     m_size = size;
 }
 
+void SDR::set_frames_per_buffer(size_t frames)
+{
+    if (frames == 0) {
+        throw std::invalid_argument("SDR: frames per buffer must not be 0");
+    }
+    m_frames_per_buffer = frames;
+}
+
 int SDR::process(Buffer *dataIn)
 {
     if (not m_running) {
         throw std::runtime_error("SDR thread failed");
     }
 
-    const uint8_t* pDataIn = (uint8_t*)dataIn->getData();
-    m_frame.resize(dataIn->getLength());
-    std::copy(pDataIn, pDataIn + dataIn->getLength(),
-            m_frame.begin());
+    if (m_frame.getData() == nullptr) {
+        m_recycled_frames.try_pop(m_frame);
+    }
+
+    // Take the frame instead of copying it, the upstream block gets the
+    // recycled buffer to write its next output into.
+    m_frame.swap(*dataIn);
 
     // We will effectively transmit the frame once we got the metadata.
 
-    return dataIn->getLength();
+    return m_frame.getLength();
 }
 
 meta_vec_t SDR::process_metadata(const meta_vec_t& metadataIn)
 {
     if (m_device and m_running) {
-        FrameData frame;
-        frame.buf = std::move(m_frame);
-        frame.sampleSize = m_size;
-
         if (metadataIn.empty()) {
             etiLog.level(info) <<
                 "SDR output: dropping one frame with invalid FCT";
         }
-        else {
+        else if (m_frames_per_buffer == 1) {
+            FrameData frame;
+            frame.buf = std::move(m_frame);
+            frame.sampleSize = m_size;
+            frame.numChannels = m_config.numTxChannels();
+
             /* In transmission modes where several ETI frames are needed to
              * build one transmission frame (like in TM 1), we will have
              * several entries in metadataIn. Take the first one, which
@@ -168,30 +268,59 @@ meta_vec_t SDR::process_metadata(const meta_vec_t& metadataIn)
              * which took the timestamp from the latest ETI frame.
              */
             frame.ts = metadataIn[0].ts;
+            frame.filler = metadataIn[0].filler;
+            queue_frame(std::move(frame));
+        }
+        else {
+            /* The buffer contains m_frames_per_buffer transmission frames,
+             * and metadataIn the entries of all their ETI frames. Every
+             * transmission frame gets the timestamp of its first ETI frame,
+             * as above.
+             * With several TX channels, the buffer contains all frames of
+             * the first channel, then those of the next one.
+             * The frames after the first one are copied out, the first one
+             * keeps the buffer, which comes back through the recycled
+             * frames. */
+            const size_t n = m_frames_per_buffer;
+            const size_t num_channels = m_config.numTxChannels();
+            if (m_frame.getLength() % (n * num_channels) != 0 or
+                    metadataIn.size() % n != 0) {
+                throw std::runtime_error(
+                        "SDR output: buffer does not contain whole frames");
+            }
 
-            // TODO check device running
-
-            try {
-                if (m_dpd_feedback_server) {
-                    m_dpd_feedback_server->set_tx_frame(frame.buf, frame.ts);
+            uint8_t *batch = reinterpret_cast<uint8_t*>(m_frame.getData());
+            const size_t frame_len = m_frame.getLength() / (n * num_channels);
+            m_batch_frames.resize(n);
+            for (size_t i = 1; i < n; i++) {
+                FrameData& frame = m_batch_frames[i];
+                m_recycled_frames.try_pop(frame.buf);
+                frame.buf.setLength(num_channels * frame_len);
+                uint8_t *out = reinterpret_cast<uint8_t*>(frame.buf.getData());
+                // The frame is only read once it comes out of the queue
+                for (size_t c = 0; c < num_channels; c++) {
+                    simd::stream_copy(out + c * frame_len,
+                            batch + (c * n + i) * frame_len, frame_len);
                 }
             }
-            catch (const runtime_error& e) {
-                etiLog.level(warn) <<
-                    "SDR output: Feedback server failed, restarting...";
-
-                m_dpd_feedback_server = std::make_shared<DPDFeedbackServer>(
-                        m_device,
-                        m_config.dpdFeedbackServerPort,
-                        m_config.sampleRate);
-            }
 
-
-            const auto max_size = m_config.enableSync ? FRAMES_MAX_SIZE_SYNC : FRAMES_MAX_SIZE_UNSYNC;
-            auto r = m_queue.push_overflow(std::move(frame), max_size);
-            etiLog.log(trace, "SDR,push %d %zu", r.overflowed, r.new_size);
-
-            num_queue_overflows += r.overflowed ? 1 : 0;
+            // The other channels of the first frame move down to follow
+            // its first channel
+            for (size_t c = 1; c < num_channels; c++) {
+                memmove(batch + c * frame_len, batch + c * n * frame_len,
+                        frame_len);
+            }
+            m_frame.setLength(num_channels * frame_len);
+            m_batch_frames[0].buf = std::move(m_frame);
+
+            for (size_t i = 0; i < n; i++) {
+                FrameData& frame = m_batch_frames[i];
+                frame.sampleSize = m_size;
+                frame.numChannels = num_channels;
+                frame.ts = metadataIn[i * metadataIn.size() / n].ts;
+                frame.filler = metadataIn[i * metadataIn.size() / n].filler;
+                queue_frame(std::move(frame));
+            }
         }
     }
     else {
@@ -200,6 +329,96 @@ meta_vec_t SDR::process_metadata(const meta_vec_t& metadataIn)
     return {};
 }
 
+void SDR::queue_frame(FrameData&& frame)
+{
+    // TODO check device running
+
+    try {
+        if (m_dpd_feedback_server and frame.numChannels > 1) {
+            // The feedback server only sees the first TX channel
+            Buffer first_channel(frame.buf.getLength() / frame.numChannels,
+                    frame.buf.getData());
+            m_dpd_feedback_server->set_tx_frame(first_channel, frame.ts);
+        }
+        else if (m_dpd_feedback_server) {
+            m_dpd_feedback_server->set_tx_frame(frame.buf, frame.ts);
+        }
+    }
+    catch (const runtime_error& e) {
+        etiLog.level(warn) <<
+            "SDR output: Feedback server failed, restarting...";
+
+        std::atomic_store(&m_dpd_feedback_server,
+                std::make_shared<DPDFeedbackServer>(
+                    m_device,
+                    m_config.dpdFeedbackServerPort,
+                    m_config.dpdFeedbackServerAddress,
+                    m_config.sampleRate));
+    }
+
+    update_latency_stats(frame.ts);
+
+    m_frame_bytes.store(frame.buf.getLength());
+
+    const size_t target = m_queue_target.load();
+    const auto max_size = target > 0 ? target : queue_max_depth();
+    const int32_t fct = frame.ts.fct;
+    auto r = m_queue.push_overflow(std::move(frame), max_size);
+    LOG_DEFERRED(trace, "SDR,push %d %zu", r.overflowed, r.new_size);
+    frame_tracer().record(FrameTracer::event_e::queue_push, fct,
+            (uint64_t)r.new_size | ((uint64_t)r.overflowed << 32));
+
+    num_queue_overflows += r.overflowed ? 1 : 0;
+    m_queued_frames.store(r.new_size);
+}
+
+void SDR::update_latency_stats(const frame_timestamp& ts)
+{
+    if (ts.received == 0) {
+        return;
+    }
+
+    const double now = frame_timestamp::system_time();
+    const double latency = now - ts.received - ts.schedule_wait;
+
+    std::lock_guard<std::mutex> lock(m_latency_stats_mutex);
+    auto& s = m_latency_stats_current;
+    if (s.count == 0) {
+        s.min = latency;
+        s.max = latency;
+    }
+    else {
+        s.min = std::min(s.min, latency);
+        s.max = std::max(s.max, latency);
+    }
+    s.sum += latency;
+    s.count++;
+
+    if (m_config.enableSync and ts.timestamp_valid) {
+        // The time the just-in-time start waited could also have been
+        // taken from the offset
+        const double slack = ts.get_real_secs() - now + ts.schedule_wait;
+        s.slack_min = s.slack_count == 0 ? slack : std::min(s.slack_min, slack);
+        s.slack_count++;
+        s.offset = ts.timestamp_offset;
+    }
+
+    if (s.count >= QUEUE_STATS_FRAMES) {
+        m_latency_stats_last = s;
+        s = latency_stats_t();
+    }
+}
+
+double SDR::tist_offset_min() const
+{
+    std::lock_guard<std::mutex> lock(m_latency_stats_mutex);
+    const auto& stats = m_latency_stats_last;
+    if (stats.slack_count == 0) {
+        return 0;
+    }
+    return stats.offset - stats.slack_min + m_config.tistGuard;
+}
+
 
 void SDR::process_thread_entry()
 {
@@ -209,15 +428,16 @@ void SDR::process_thread_entry()
     }
 
     set_thread_name("sdrdevice");
+    set_thread_placement("sdrdevice");
 
     last_tx_time_initialised = false;
 
     try {
         while (m_running.load()) {
             struct FrameData frame;
-            etiLog.log(trace, "SDR,wait");
-            m_queue.wait_and_pop(frame);
-            etiLog.log(trace, "SDR,pop");
+            LOG_DEFERRED(trace, "SDR,wait");
+            const bool underrun_filler = pop_frame(frame);
+            LOG_DEFERRED(trace, "SDR,pop");
 
             if (m_running.load() == false) {
                 break;
@@ -226,6 +446,14 @@ void SDR::process_thread_entry()
             if (m_device) {
                 handle_frame(std::move(frame));
             }
+
+            if (underrun_filler) {
+                m_underrun_frame = std::move(frame.buf);
+            }
+            else if (frame.buf.getData() != nullptr) {
+                m_recycled_frames.push(std::move(frame.buf),
+                        max_recycled_frames);
+            }
         }
     }
     catch (const ThreadsafeQueueWakeup& e) { }
@@ -237,6 +465,188 @@ void SDR::process_thread_entry()
     m_running.store(false);
 }
 
+size_t SDR::queue_max_depth() const
+{
+    // A whole batch must fit into the queue
+    if (m_config.queueDepth > 0) {
+        return std::max(std::min(m_config.queueDepth, FRAMES_MAX_SIZE_SYNC),
+                m_frames_per_buffer);
+    }
+    return m_config.enableSync ? FRAMES_MAX_SIZE_SYNC :
+        std::max(FRAMES_MAX_SIZE_UNSYNC, m_frames_per_buffer);
+}
+
+void SDR::adapt_queue_target(bool underrun)
+{
+    const size_t max_depth = queue_max_depth();
+    size_t target = m_queue_target.load();
+
+    if (not m_config.queueAdaptive or m_config.enableSync) {
+        target = max_depth;
+    }
+    else {
+        // The prefill must always fit into the queue
+        const size_t min_depth = std::min(max_depth, std::max<size_t>(
+                    {1, m_config.queuePrefill, m_frames_per_buffer}));
+
+        if (target == 0) {
+            target = max_depth;
+        }
+
+        if (underrun) {
+            target += QUEUE_ADAPTIVE_GROW;
+            m_frames_since_underrun = 0;
+        }
+        else if (++m_frames_since_underrun >= QUEUE_ADAPTIVE_SHRINK_FRAMES) {
+            if (target > min_depth) {
+                target--;
+            }
+            m_frames_since_underrun = 0;
+        }
+
+        target = std::clamp(target, min_depth, max_depth);
+    }
+
+    if (target != m_queue_target.load()) {
+        etiLog.level(debug) << "OutputSDR: queue depth " << target << " frames";
+        m_queue_target.store(target);
+    }
+}
+
+void SDR::update_queue_stats(size_t depth)
+{
+    std::lock_guard<std::mutex> lock(m_queue_stats_mutex);
+    auto& s = m_queue_stats_current;
+    if (s.count == 0) {
+        s.min = depth;
+        s.max = depth;
+    }
+    else {
+        s.min = std::min(s.min, depth);
+        s.max = std::max(s.max, depth);
+    }
+    s.sum += depth;
+    s.count++;
+
+    if (s.count >= QUEUE_STATS_FRAMES) {
+        m_queue_stats_last = s;
+        s = queue_stats_t();
+    }
+}
+
+double SDR::frames_to_ms(double frames) const
+{
+    return frames * chrono::duration<double, milli>(
+            transmission_frame_duration(m_config.dabMode)).count();
+}
+
+bool SDR::pop_frame(FrameData& frame)
+{
+    bool underrun = false;
+    if (not m_queue.try_pop(frame)) {
+        if (m_queue_transmitting and m_config.underrunFiller and
+                m_last_frame_length > 0) {
+            const bool first_filler = not m_underrun_filling;
+            if (make_underrun_filler(frame)) {
+                if (first_filler) {
+                    num_queue_underruns++;
+                    etiLog.level(warn) << "OutputSDR: queue ran empty, "
+                        "transmitting filler frames after FCT=" <<
+                        m_last_frame.ts.fct;
+                }
+                adapt_queue_target(first_filler);
+                m_queued_frames.store(0);
+                update_queue_stats(0);
+                return true;
+            }
+            if (not m_running.load()) {
+                return false;
+            }
+            // The queue got a frame in the meantime
+        }
+        else if (m_queue_transmitting) {
+            // The device is done with the previous frame, and there is
+            // nothing to give it
+            num_queue_underruns++;
+            underrun = true;
+            m_queue_transmitting = false;
+        }
+        m_queue.wait_and_pop(frame);
+    }
+
+    if (m_underrun_filling) {
+        etiLog.level(info) << "OutputSDR: transmitting again from FCT=" <<
+            frame.ts.fct;
+        m_underrun_filling = false;
+    }
+
+    // The metadata the filler frames follow
+    m_last_frame.ts = frame.ts;
+    m_last_frame.sampleSize = frame.sampleSize;
+    m_last_frame.numChannels = frame.numChannels;
+    m_last_frame_length = frame.buf.getLength();
+
+    adapt_queue_target(underrun);
+
+    if (not m_queue_transmitting) {
+        // Wait for the low watermark, counting the frame we already have
+        const size_t prefill = std::min(m_config.queuePrefill,
+                m_queue_target.load());
+        while (m_running.load() and m_queue.size() + 1 < prefill) {
+            this_thread::sleep_for(chrono::milliseconds(2));
+        }
+        m_queue_transmitting = true;
+    }
+
+    const size_t queued = m_queue.size();
+    m_queued_frames.store(queued);
+    update_queue_stats(queued + 1);
+    frame_tracer().record(FrameTracer::event_e::queue_pop, frame.ts.fct, queued);
+    return false;
+}
+
+bool SDR::make_underrun_filler(FrameData& frame)
+{
+    const size_t num_samples = m_last_frame_length /
+        (m_last_frame.sampleSize * m_last_frame.numChannels);
+    const auto duration = chrono::duration_cast<chrono::steady_clock::duration>(
+            chrono::duration<double>((double)num_samples / m_config.sampleRate));
+
+    /* The first filler goes out immediately, the next ones in real time,
+     * as not all devices block until they can take more samples */
+    if (not m_underrun_filling) {
+        m_underrun_next_filler = chrono::steady_clock::now();
+    }
+    while (chrono::steady_clock::now() < m_underrun_next_filler) {
+        if (not m_running.load() or m_queue.size() > 0) {
+            return false;
+        }
+        this_thread::sleep_for(chrono::milliseconds(2));
+    }
+    m_underrun_next_filler += duration;
+    m_underrun_filling = true;
+
+    if (m_underrun_frame.getLength() != m_last_frame_length) {
+        m_underrun_frame.setLength(m_last_frame_length);
+        memset(m_underrun_frame.getData(), 0, m_last_frame_length);
+    }
+    frame.buf = std::move(m_underrun_frame);
+    frame.sampleSize = m_last_frame.sampleSize;
+    frame.numChannels = m_last_frame.numChannels;
+
+    // The timestamp continues from the previous frame
+    frame.ts = m_last_frame.ts;
+    frame.ts.ticks += frame_timestamp::samples_to_ticks(num_samples,
+            m_config.sampleRate);
+    frame.ts.offset_changed = false;
+    frame.ts.received = 0;
+    frame.filler = true;
+    m_last_frame.ts = frame.ts;
+
+    frame_tracer().record(FrameTracer::event_e::queue_pop, frame.ts.fct, 0);
+    return true;
+}
+
 const char* SDR::name()
 {
     if (m_device) {
@@ -250,6 +660,17 @@ const char* SDR::name()
     return m_name.c_str();
 }
 
+size_t SDR::memory_usage() const
+{
+    const size_t num_frames = m_queue.size() + m_recycled_frames.size();
+    size_t bytes = num_frames * m_frame_bytes.load();
+    auto feedback_server = std::atomic_load(&m_dpd_feedback_server);
+    if (feedback_server) {
+        bytes += feedback_server->memory_usage();
+    }
+    return bytes;
+}
+
 
 void SDR::handle_frame(struct FrameData&& frame)
 {
@@ -268,10 +689,10 @@ void SDR::handle_frame(struct FrameData&& frame)
 
     if (m_config.enableSync and time_spec.timestamp_valid) {
         // Tx time from MNSC and TIST
-        const uint32_t tx_second = frame.ts.timestamp_sec;
-        const uint32_t tx_pps    = frame.ts.timestamp_pps;
+        const int64_t tx_ticks = frame.ts.ticks;
 
         const double device_time = m_device->get_real_secs();
+        const int64_t device_ticks = frame_timestamp::seconds_to_ticks(device_time);
 
         if (not frame.ts.timestamp_valid) {
             /* We have not received a full timestamp through
@@ -279,8 +700,8 @@ void SDR::handle_frame(struct FrameData&& frame)
              */
             etiLog.level(info) <<
                 "OutputSDR: Throwing sample " << frame.ts.fct <<
-                " away: incomplete timestamp " << tx_second <<
-                " / " << tx_pps;
+                " away: incomplete timestamp " << frame.ts.timestamp_sec() <<
+                " / " << frame.ts.timestamp_pps();
             return;
         }
 
@@ -290,59 +711,50 @@ void SDR::handle_frame(struct FrameData&& frame)
         }
 
         if (last_tx_time_initialised) {
-            const size_t sizeIn = frame.buf.size() / frame.sampleSize;
-
-            // Checking units for the increment calculation:
-            // samps  * ticks/s  / (samps/s)
-            // (samps * ticks * s) / (s * samps)
-            // ticks
-            const uint64_t increment = (uint64_t)sizeIn * 16384000ul /
-                                       (uint64_t)m_config.sampleRate;
+            const size_t sizeIn = frame.buf.getLength() /
+                (frame.sampleSize * frame.numChannels);
 
-            uint32_t expected_sec = last_tx_second + increment / 16384000ul;
-            uint32_t expected_pps = last_tx_pps + increment % 16384000ul;
+            frame_timestamp expected = frame.ts;
+            expected.ticks = last_tx_ticks +
+                frame_timestamp::samples_to_ticks(sizeIn, m_config.sampleRate);
 
-            while (expected_pps >= 16384000) {
-                expected_sec++;
-                expected_pps -= 16384000;
-            }
-
-            if (expected_sec != tx_second or expected_pps != tx_pps) {
+            if (expected.ticks != tx_ticks) {
                 etiLog.level(warn) << "OutputSDR: timestamp irregularity at FCT=" << frame.ts.fct <<
                     std::fixed <<
                     " Expected " <<
-                    expected_sec << "+" << (double)expected_pps/16384000.0 <<
-                    "(" << expected_pps << ")" <<
+                    expected.timestamp_sec() << "+" << expected.pps_offset() <<
+                    "(" << expected.timestamp_pps() << ")" <<
                     " Got " <<
-                    tx_second << "+" << (double)tx_pps/16384000.0 <<
-                    "(" << tx_pps << ")";
+                    frame.ts.timestamp_sec() << "+" << frame.ts.pps_offset() <<
+                    "(" << frame.ts.timestamp_pps() << ")";
 
                 m_device->require_timestamp_refresh();
             }
         }
 
-        last_tx_second = tx_second;
-        last_tx_pps    = tx_pps;
+        last_tx_ticks = tx_ticks;
         last_tx_time_initialised = true;
 
-        const double pps_offset = tx_pps / 16384000.0;
-
-        etiLog.log(trace, "SDR,tist %f", time_spec.get_real_secs());
+        LOG_DEFERRED(trace, "SDR,tist %f", time_spec.get_real_secs());
 
-        if (time_spec.get_real_secs() < device_time) {
+        if (tx_ticks < device_ticks) {
+            // 1/16384000 s is 15625/256 ns
+            frame_tracer().record(FrameTracer::event_e::timestamp_late, frame.ts.fct,
+                    (device_ticks - tx_ticks) * 15625 / 256);
             etiLog.level(warn) <<
                 "OutputSDR: Timestamp in the past at FCT=" << frame.ts.fct << " offset: " <<
                 std::fixed <<
                 time_spec.get_real_secs() - device_time <<
                 "  (" << device_time << ")"
                 " frame " << frame.ts.fct <<
-                ", tx_second " << tx_second <<
-                ", pps " << pps_offset;
+                ", tx_second " << frame.ts.timestamp_sec() <<
+                ", pps " << frame.ts.pps_offset();
             m_device->require_timestamp_refresh();
             return;
         }
 
-        if (time_spec.get_real_secs() > device_time + TIMESTAMP_ABORT_FUTURE) {
+        if (tx_ticks > device_ticks +
+                frame_timestamp::seconds_to_ticks(TIMESTAMP_ABORT_FUTURE)) {
             etiLog.level(error) <<
                 "OutputSDR: Timestamp way too far in the future at FCT=" << frame.ts.fct << " offset: " <<
                 std::fixed <<
@@ -351,13 +763,43 @@ void SDR::handle_frame(struct FrameData&& frame)
         }
     }
 
-    if (m_config.muting) {
+    /* The filler frames the modulator gives while muted keep the device
+     * streaming with the same timestamps, the other frames get dropped */
+    if (m_config.muting and not frame.filler) {
         etiLog.log(info, "OutputSDR: Muting FCT=%d requested", frame.ts.fct);
         m_device->require_timestamp_refresh();
         return;
     }
 
+    auto& tracer = frame_tracer();
+    if (not tracer.active()) {
+        m_device->transmit_frame(std::move(frame));
+        return;
+    }
+
+    const int32_t fct = frame.ts.fct;
+    tracer.record(FrameTracer::event_e::send_start, fct,
+            ((uint64_t)frame.ts.timestamp_sec() << 32) | frame.ts.timestamp_pps());
+    const uint64_t send_start = FrameTracer::now_ns();
     m_device->transmit_frame(std::move(frame));
+    tracer.record(FrameTracer::event_e::send_end, fct,
+            FrameTracer::now_ns() - send_start);
+
+    // The device reports its events asynchronously, they get attributed
+    // to the frame sent when we see them.
+    const TxEventCounters *tx_events = m_device->get_tx_event_counters();
+    if (tx_events) {
+        const size_t underflows = tx_events->underflows.load();
+        const size_t late_packets = tx_events->late_packets.load();
+        if (underflows != m_traced_underflows) {
+            tracer.record(FrameTracer::event_e::underflow, fct, underflows);
+            m_traced_underflows = underflows;
+        }
+        if (late_packets != m_traced_late_packets) {
+            tracer.record(FrameTracer::event_e::late_packet, fct, late_packets);
+            m_traced_late_packets = late_packets;
+        }
+    }
 }
 
 // =======================================
@@ -406,6 +848,23 @@ void SDR::set_parameter(const string& parameter, const string& value)
     else if (parameter == "max_gps_holdover_time") {
         ss >> m_config.maxGPSHoldoverTime;
     }
+    else if (parameter == "queue_depth") {
+        size_t depth = 0;
+        ss >> depth;
+        if (depth > FRAMES_MAX_SIZE_SYNC) {
+            throw ParameterError("queue_depth must be at most " +
+                    to_string(FRAMES_MAX_SIZE_SYNC));
+        }
+        m_config.queueDepth = depth;
+    }
+    else if (parameter == "queue_prefill") {
+        ss >> m_config.queuePrefill;
+    }
+    else if (parameter == "queue_adaptive") {
+        uint32_t adaptive = 0;
+        ss >> adaptive;
+        m_config.queueAdaptive = adaptive > 0;
+    }
     else {
         stringstream ss_err;
         ss_err << "Parameter '" << parameter
@@ -466,6 +925,58 @@ const string SDR::get_parameter(const string& parameter) const
     else if (parameter == "max_gps_holdover_time") {
         ss << m_config.maxGPSHoldoverTime;
     }
+    else if (parameter == "queue_depth") {
+        ss << m_config.queueDepth;
+    }
+    else if (parameter == "queue_prefill") {
+        ss << m_config.queuePrefill;
+    }
+    else if (parameter == "queue_adaptive") {
+        ss << m_config.queueAdaptive;
+    }
+    else if (parameter == "queue_target") {
+        ss << m_queue_target.load();
+    }
+    else if (parameter == "latency_min_ms" or parameter == "latency_max_ms" or
+            parameter == "latency_avg_ms" or parameter == "tist_slack_ms") {
+        std::lock_guard<std::mutex> lock(m_latency_stats_mutex);
+        const auto& stats = m_latency_stats_last;
+        if (parameter == "latency_min_ms") {
+            ss << stats.min * 1000.0;
+        }
+        else if (parameter == "latency_max_ms") {
+            ss << stats.max * 1000.0;
+        }
+        else if (parameter == "latency_avg_ms") {
+            ss << (stats.count ? stats.sum * 1000.0 / stats.count : 0.0);
+        }
+        else {
+            ss << stats.slack_min * 1000.0;
+        }
+    }
+    else if (parameter == "tist_offset_min") {
+        ss << tist_offset_min();
+    }
+    else if (parameter == "queue_min_ms" or parameter == "queue_max_ms" or
+            parameter == "queue_avg_ms") {
+        std::lock_guard<std::mutex> lock(m_queue_stats_mutex);
+        const auto& stats = m_queue_stats_last;
+        if (parameter == "queue_min_ms") {
+            ss << frames_to_ms(stats.min);
+        }
+        else if (parameter == "queue_max_ms") {
+            ss << frames_to_ms(stats.max);
+        }
+        else {
+            ss << (stats.count ? frames_to_ms((double)stats.sum / stats.count) : 0.0);
+        }
+    }
+    else if (parameter == "queue_underruns") {
+        ss << num_queue_underruns;
+    }
+    else if (parameter == "queue_overflows") {
+        ss << num_queue_overflows;
+    }
     else {
         if (m_device) {
             const auto stat = m_device->get_run_statistics();
@@ -534,6 +1045,31 @@ const json::map_t SDR::get_all_values() const
             (size_t)chrono::duration_cast<chrono::milliseconds>(transmission_frame_duration(m_config.dabMode))
             .count();
 
+    stat["queue_depth"].v = m_config.queueDepth;
+    stat["queue_prefill"].v = m_config.queuePrefill;
+    stat["queue_adaptive"].v = m_config.queueAdaptive;
+    stat["queue_target"].v = m_queue_target.load();
+    {
+        std::lock_guard<std::mutex> lock(m_queue_stats_mutex);
+        const auto& stats = m_queue_stats_last;
+        stat["queue_min_ms"].v = frames_to_ms(stats.min);
+        stat["queue_max_ms"].v = frames_to_ms(stats.max);
+        stat["queue_avg_ms"].v = stats.count ?
+            frames_to_ms((double)stats.sum / stats.count) : 0.0;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_latency_stats_mutex);
+        const auto& stats = m_latency_stats_last;
+        stat["latency_min_ms"].v = stats.min * 1000.0;
+        stat["latency_max_ms"].v = stats.max * 1000.0;
+        stat["latency_avg_ms"].v = stats.count ?
+            stats.sum * 1000.0 / stats.count : 0.0;
+        stat["tist_slack_ms"].v = stats.slack_min * 1000.0;
+    }
+    stat["tist_offset_min"].v = tist_offset_min();
+    stat["queue_underruns"].v = num_queue_underruns.load();
+    stat["queue_overflows"].v = num_queue_overflows.load();
+
     stat["synchronous"].v = m_config.enableSync;
     stat["max_gps_holdover_time"].v = (size_t)m_config.maxGPSHoldoverTime;
 
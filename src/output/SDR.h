@@ -35,8 +35,15 @@ DESCRIPTION:
 #endif
 
 #include "ModPlugin.h"
+#include "Metrics.h"
+#include "FrameTracer.h"
 #include "output/SDRDevice.h"
 #include "output/Feedback.h"
+#include "output/DPDEngine.h"
+#include "output/FeedbackMonitor.h"
+#include "output/LatencyProbe.h"
+
+#include <mutex>
 
 namespace Output {
 
@@ -48,11 +55,20 @@ class SDR : public ModOutput, public ModMetadata, public RemoteControllable {
         virtual ~SDR();
 
         virtual void set_sample_size(size_t size);
+
+        /* When several transmission frames are batched together by the
+         * modulator, every buffer given to process() contains that many
+         * frames. They are split again before being transmitted, so that
+         * each one gets its own timestamp. */
+        virtual void set_frames_per_buffer(size_t frames);
         virtual int process(Buffer *dataIn) override;
         virtual meta_vec_t process_metadata(const meta_vec_t& metadataIn) override;
 
         virtual const char* name() override;
 
+        // The queued and recycled frames, and the feedback server bursts
+        virtual size_t memory_usage() const override;
+
         /*********** REMOTE CONTROL ***************/
 
         /* Base function to set parameters. */
@@ -68,24 +84,122 @@ class SDR : public ModOutput, public ModMetadata, public RemoteControllable {
     private:
         void process_thread_entry(void);
         void handle_frame(struct FrameData&& frame);
+        void queue_frame(struct FrameData&& frame);
+
+        // Called by the device thread, waits for the next frame to
+        // transmit, and for the prefill after the queue ran empty.
+        // Returns true if it gave an underrun filler frame instead.
+        bool pop_frame(struct FrameData& frame);
+
+        // With underrunFiller, gives the filler frame that follows the
+        // last transmitted frame, or returns false if the queue got a
+        // frame while waiting for the time of the filler
+        bool make_underrun_filler(struct FrameData& frame);
+
+        // The maximum queue depth from the configuration
+        size_t queue_max_depth() const;
+        void adapt_queue_target(bool underrun);
+        void update_queue_stats(size_t depth);
+        void update_latency_stats(const frame_timestamp& ts);
+        double frames_to_ms(double frames) const;
 
         SDRDeviceConfig& m_config;
 
         std::atomic<bool> m_running = ATOMIC_VAR_INIT(false);
         std::thread m_device_thread;
         size_t m_size = sizeof(complexf);
-        std::vector<uint8_t> m_frame;
-        ThreadsafeQueue<FrameData> m_queue;
+        size_t m_frames_per_buffer = 1;
+        Buffer m_frame;
+
+        // The frames of a buffer of m_frames_per_buffer frames, before
+        // they get queued
+        std::vector<FrameData> m_batch_frames;
+        SPSCQueue<FrameData> m_queue;
+
+        // Frame buffers given back by the device thread once transmitted,
+        // which process() gives to the upstream block in exchange for the
+        // frame it takes.
+        static constexpr size_t max_recycled_frames = 4;
+        SPSCQueue<Buffer> m_recycled_frames;
 
         std::shared_ptr<SDRDevice> m_device;
         std::string m_name;
 
+        // Replaced by the device thread when it fails, read with
+        // std::atomic_load() by the DPD engine
         std::shared_ptr<DPDFeedbackServer> m_dpd_feedback_server;
+        std::unique_ptr<DPDEngine> m_dpd_engine;
+        std::unique_ptr<FeedbackMonitor> m_feedback_monitor;
+        std::unique_ptr<LatencyProbe> m_latency_probe;
 
         bool     last_tx_time_initialised = false;
-        uint32_t last_tx_second = 0;
-        uint32_t last_tx_pps = 0;
-        size_t   num_queue_overflows = 0;
+        int64_t last_tx_ticks = 0;
+        std::atomic<size_t> num_queue_overflows = ATOMIC_VAR_INIT(0);
+        std::atomic<size_t> num_queue_underruns = ATOMIC_VAR_INIT(0);
+
+        // Number of frames in the queue, updated when it changes
+        std::atomic<size_t> m_queued_frames = ATOMIC_VAR_INIT(0);
+        // Length of the latest queued frame
+        std::atomic<size_t> m_frame_bytes = ATOMIC_VAR_INIT(0);
+
+        // The depth at which queue_frame() drops the oldest frames. It
+        // changes in adaptive mode, 0 until the device thread sets it.
+        std::atomic<size_t> m_queue_target = ATOMIC_VAR_INIT(0);
+
+        // Only used by the device thread: false after startup and after
+        // the queue ran empty, until the prefill is reached.
+        bool m_queue_transmitting = false;
+        size_t m_frames_since_underrun = 0;
+
+        // Only used by the device thread: the frames of zeros transmitted
+        // while the queue is empty with underrunFiller all use the same
+        // buffer, and follow the last frame from the queue.
+        Buffer m_underrun_frame;
+        FrameData m_last_frame;
+        size_t m_last_frame_length = 0;
+        bool m_underrun_filling = false;
+        std::chrono::steady_clock::time_point m_underrun_next_filler;
+
+        // Device event counters at the last frame trace record
+        size_t m_traced_underflows = 0;
+        size_t m_traced_late_packets = 0;
+
+        // Queue depth seen by the device thread at every frame, over the
+        // current and the last completed measurement period
+        struct queue_stats_t {
+            size_t min = 0;
+            size_t max = 0;
+            size_t sum = 0;
+            size_t count = 0;
+        };
+        mutable std::mutex m_queue_stats_mutex;
+        queue_stats_t m_queue_stats_current;
+        queue_stats_t m_queue_stats_last;
+
+        // Time in seconds from the reception of a frame to its queueing,
+        // without the wait of the just-in-time start, and the slack until
+        // its transmission time, over the current and the last completed
+        // measurement period. The slack is only measured with
+        // synchronous transmission.
+        struct latency_stats_t {
+            double min = 0;
+            double max = 0;
+            double sum = 0;
+            size_t count = 0;
+            double slack_min = 0;
+            size_t slack_count = 0;
+            double offset = 0; // The TIST offset of the last frame
+        };
+        mutable std::mutex m_latency_stats_mutex;
+        latency_stats_t m_latency_stats_current;
+        latency_stats_t m_latency_stats_last;
+
+        // Smallest TIST offset that would have left m_config.tistGuard
+        // of slack to every frame of the last measurement period, 0 if
+        // unknown
+        double tist_offset_min() const;
+
+        Metrics::Handle m_metrics;
 };
 
 }
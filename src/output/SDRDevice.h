@@ -34,12 +34,18 @@ DESCRIPTION:
 #   include <config.h>
 #endif
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <complex>
 #include <optional>
 
+#include "Buffer.h"
+#include "Log.h"
 #include "TimestampDecoder.h"
 
 namespace Output {
@@ -48,6 +54,24 @@ enum refclk_lock_loss_behaviour_t { CRASH, IGNORE };
 
 using complexf = std::complex<float>;
 
+/* Settings of the in-process DPD estimation, see output/DPDEngine.h */
+struct DPDEngineConfig {
+    bool enabled = false;
+
+    // Name of the MemlessPoly remote controllable that gets the coefficients
+    std::string target = "memlesspoly";
+
+    // poly: the odd polynomial of MemlessPoly, lut: its interpolated LUT
+    std::string model = "poly";
+    size_t lutEntries = 64;
+
+    size_t numSamples = 65536;
+    double learningRate = 0.5;
+
+    // Seconds between two automatic iterations, 0 to only run on request
+    unsigned interval = 0;
+};
+
 /* This structure is used as initial configuration for all SDR devices.
  * It must also contain all remote-controllable settings, otherwise
  * they will get lost on a modulator restart. */
@@ -94,21 +118,209 @@ struct SDRDeviceConfig {
     // TCP port on which to serve TX and RX samples for the
     // digital pre distortion learning tool
     uint16_t dpdFeedbackServerPort = 0;
+    std::string dpdFeedbackServerAddress = "127.0.0.1";
+
+    // Estimation of the predistortion coefficients from the feedback
+    // samples, without the external tool
+    DPDEngineConfig dpdEngine;
+
+    // Seconds between two measurements of the MER and shoulders from the
+    // feedback samples, 0 disables the monitor
+    unsigned feedbackMonitorInterval = 0;
+    size_t feedbackMonitorNumSamples = 65536;
+
+    // Seconds between two measurements of the latency from the feedback
+    // samples, 0 disables the probe
+    unsigned latencyProbeInterval = 0;
+
+    // The FormatConverter format of the samples given to the device,
+    // empty for complexf. Only used by the UHD, SoapySDR and simulated
+    // outputs.
+    std::string sampleFormat;
+
+    // The UHD over-the-wire format: sc16, sc12 or sc8. The LimeSDR output
+    // supports sc16 and sc12.
+    std::string otwFormat = "sc16";
+
+    // Size of the LimeSDR stream FIFO in transmission frames, and the
+    // stream setting that trades latency (0) against throughput (1 and
+    // above)
+    size_t limeFifoFrames = 10;
+    float limeThroughputVsLatency = 2.0f;
+
+    // Settings of the bladeRF synchronous interface: the number of
+    // buffers, their size in samples, a multiple of 1024, the number of
+    // active USB transfers and the timeout of a transfer. With
+    // bladerfMetadata, every frame carries the timestamp of its first
+    // sample, so that the FPGA transmits the frames without gaps.
+    unsigned int bladerfNumBuffers = 16;
+    unsigned int bladerfBufferSize = 8192;
+    unsigned int bladerfNumTransfers = 8;
+    unsigned int bladerfTimeoutMs = 3500;
+    bool bladerfMetadata = false;
+
+    // Settings of the simulated output: the duration of the samples its
+    // buffer holds, and whether the TX samples are looped back to the RX
+    // through a PA with the given saturation amplitude, Rapp smoothness
+    // and AM/PM conversion in degrees at saturation.
+    unsigned int simulatedBufferMs = 20;
+    bool simulatedLoopback = false;
+    double simulatedPaSaturation = 1.0;
+    double simulatedPaSmoothness = 2.0;
+    double simulatedPaAmPm = 0.0;
+
+    // Frequency offset in Hz of every TX channel, relative to frequency.
+    // Empty when transmitting on one channel. Only used by the UHD and
+    // SoapySDR outputs.
+    std::vector<double> txChannelOffsets;
+
+    // Give every frame to the driver in as few calls as possible, and let
+    // it split the frame into packets. Only used by the UHD and SoapySDR
+    // outputs.
+    bool bulkTransmit = false;
+
+    // Receive continuously into a ring of rxRingDuration seconds, from
+    // which the DPD feedback and the monitoring take their RX samples,
+    // instead of starting a reception for every request. Only used by the
+    // UHD and SoapySDR outputs. The loopback of the simulated output always
+    // uses a ring of rxRingDuration seconds.
+    bool rxContinuous = false;
+    double rxRingDuration = 1.0;
+
+    // Maximum number of transmission frames waiting for the device. 0
+    // selects 250 frames for synchronous transmission and 8 otherwise.
+    size_t queueDepth = 0;
+
+    // After startup and after the queue ran empty, transmission starts
+    // again once this many frames are queued.
+    size_t queuePrefill = 0;
+
+    // Without synchronous transmission, reduce the depth one frame at a
+    // time as long as the queue does not run empty, and increase it again
+    // when it does.
+    bool queueAdaptive = false;
+
+    // When the queue runs empty, keep the device streaming with frames
+    // of zeros that continue the timestamps, and let the modulator
+    // continue after a discontinuity of the input instead of restarting.
+    bool underrunFiller = false;
+
+    // Margin in seconds between the queueing of a frame and its
+    // transmission time that the smallest safe TIST offset includes, for
+    // the device to get the samples in time
+    double tistGuard = 0.05;
+
+    size_t numTxChannels() const {
+        return txChannelOffsets.empty() ? 1 : txChannelOffsets.size();
+    }
 };
 
 // Each frame contains one OFDM frame, and its
 // associated timestamp
 struct FrameData {
-    // Buffer holding frame data
-    std::vector<uint8_t> buf;
+    // Buffer holding frame data, taken over from the modulator without
+    // a copy. With several TX channels, it contains the samples of every
+    // channel one after the other.
+    Buffer buf;
     size_t sampleSize = sizeof(complexf);
+    size_t numChannels = 1;
 
     // A full timestamp contains a TIST according to standard
     // and time information within MNSC with tx_second.
     frame_timestamp ts;
+
+    // Zeros from the modulator, transmitted even when muted
+    bool filler = false;
 };
 
 
+/* Duration of the calls that give the samples to the driver, recorded by
+ * the device thread. The averages and the maximum are taken over the last
+ * period of STATS_CALLS calls. */
+class TransmitCallStats {
+    public:
+        void record(std::chrono::steady_clock::duration duration,
+                size_t num_samples) {
+            using namespace std::chrono;
+            const double us = duration_cast<nanoseconds>(duration).count() / 1000.0;
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_num_calls++;
+            m_current.sum_us += us;
+            m_current.max_us = std::max(m_current.max_us, us);
+            m_current.num_samples += num_samples;
+            if (++m_current.num_calls >= STATS_CALLS) {
+                m_last = m_current;
+                m_current = period_t();
+            }
+        }
+
+        void add_to(json::map_t& rs) const {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            const size_t n = m_last.num_calls;
+            rs["send_calls"].v = m_num_calls;
+            rs["send_avg_us"].v = n ? m_last.sum_us / n : 0.0;
+            rs["send_max_us"].v = m_last.max_us;
+            rs["send_avg_samples"].v = n ? (double)m_last.num_samples / n : 0.0;
+        }
+
+    private:
+        static constexpr size_t STATS_CALLS = 1000;
+
+        struct period_t {
+            size_t num_calls = 0;
+            size_t num_samples = 0;
+            double sum_us = 0.0;
+            double max_us = 0.0;
+        };
+
+        mutable std::mutex m_mutex;
+        size_t m_num_calls = 0;
+        period_t m_current;
+        period_t m_last;
+};
+
+/* Counters of the TX events reported by the device, updated by the thread
+ * that monitors the device asynchronously, and by transmit_frame() for the
+ * errors returned by the send calls. */
+class TxEventCounters {
+    public:
+        std::atomic<size_t> underflows = ATOMIC_VAR_INIT(0);
+        std::atomic<size_t> late_packets = ATOMIC_VAR_INIT(0);
+        std::atomic<size_t> seq_errors = ATOMIC_VAR_INIT(0);
+
+        void add_to(json::map_t& rs) const {
+            rs["underruns"].v = underflows.load();
+            rs["latepackets"].v = late_packets.load();
+            rs["late_packets"].v = late_packets.load();
+            rs["seq_errors"].v = seq_errors.load();
+        }
+
+        /* Called periodically by the monitoring thread, logs the events
+         * since the previous call if there were any. */
+        void log_changes(const char* device_name) {
+            const size_t u = underflows.load();
+            const size_t l = late_packets.load();
+            const size_t s = seq_errors.load();
+            if (u > m_previous_underflows or l > m_previous_late_packets or
+                    s > m_previous_seq_errors) {
+                etiLog.level(info) << device_name << " status: " <<
+                    u - m_previous_underflows << " underruns, " <<
+                    l - m_previous_late_packets << " late packets and " <<
+                    s - m_previous_seq_errors <<
+                    " sequence errors since last status.";
+            }
+            m_previous_underflows = u;
+            m_previous_late_packets = l;
+            m_previous_seq_errors = s;
+        }
+
+    private:
+        size_t m_previous_underflows = 0;
+        size_t m_previous_late_packets = 0;
+        size_t m_previous_seq_errors = 0;
+};
+
 // All SDR Devices must implement the SDRDevice interface
 class SDRDevice {
     public:
@@ -120,6 +332,10 @@ class SDRDevice {
         virtual double get_txgain(void) const = 0;
         virtual void transmit_frame(struct FrameData&& frame) = 0;
         virtual run_statistics_t get_run_statistics(void) const = 0;
+
+        // The counters of the TX events, nullptr if the device has none
+        virtual const TxEventCounters* get_tx_event_counters(void) const { return nullptr; }
+
         virtual double get_real_secs(void) const = 0;
         virtual void set_rxgain(double rxgain) = 0;
         virtual double get_rxgain(void) const = 0;
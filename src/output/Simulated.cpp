@@ -0,0 +1,295 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   An SDR device without hardware, that consumes the samples at the sample
+   rate against a simulated device clock, for load tests and benchmarks.
+*/
+
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "output/Simulated.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#include "Log.h"
+
+using namespace std;
+
+namespace Output {
+
+// Samples given to the RX ring at a time
+static constexpr size_t LOOPBACK_BLOCK = 4096;
+
+static float db_to_lin(double db)
+{
+    return pow(10.0, db / 20.0);
+}
+
+Simulated::Simulated(SDRDeviceConfig& config) :
+    SDRDevice(),
+    m_conf(config)
+{
+    if (m_conf.sampleRate == 0) {
+        throw invalid_argument("Simulated: invalid sample rate");
+    }
+
+    if (not m_conf.sampleFormat.empty() and m_conf.sampleFormat != "s16") {
+        throw runtime_error("Simulated: unsupported sample format " +
+                m_conf.sampleFormat);
+    }
+
+    using namespace std::chrono;
+    m_clock_start = steady_clock::now();
+    m_start_ns = duration_cast<nanoseconds>(
+            system_clock::now().time_since_epoch()).count();
+    m_last_print_time = m_clock_start;
+
+    m_tx_gain_lin = db_to_lin(m_conf.txgain);
+    m_rx_gain_lin = db_to_lin(m_conf.rxgain);
+
+    if (m_conf.simulatedLoopback) {
+        const size_t capacity = std::max<size_t>(
+                m_conf.rxRingDuration * m_conf.sampleRate, 4 * LOOPBACK_BLOCK);
+        m_rx_ring = make_unique<RxRing>(capacity, LOOPBACK_BLOCK, m_conf.sampleRate);
+    }
+
+    etiLog.level(info) << "Simulated: " << m_conf.sampleRate <<
+        " samples per second into a buffer of " << m_conf.simulatedBufferMs <<
+        " ms" << (m_rx_ring ? ", with PA loopback" : "");
+}
+
+long long Simulated::device_ns(void) const
+{
+    using namespace std::chrono;
+    return m_start_ns + duration_cast<nanoseconds>(
+            steady_clock::now() - m_clock_start).count();
+}
+
+void Simulated::tune(double lo_offset, double frequency)
+{
+    m_conf.lo_offset = lo_offset;
+    m_conf.frequency = frequency;
+}
+
+double Simulated::get_tx_freq(void) const
+{
+    return m_conf.frequency;
+}
+
+void Simulated::set_txgain(double txgain)
+{
+    m_conf.txgain = txgain;
+    m_tx_gain_lin = db_to_lin(txgain);
+}
+
+double Simulated::get_txgain(void) const
+{
+    return m_conf.txgain;
+}
+
+void Simulated::set_bandwidth(double bandwidth)
+{
+    m_conf.bandwidth = bandwidth;
+}
+
+double Simulated::get_bandwidth(void) const
+{
+    return m_conf.bandwidth;
+}
+
+SDRDevice::run_statistics_t Simulated::get_run_statistics(void) const
+{
+    run_statistics_t rs;
+    m_tx_events.add_to(rs);
+    rs["frames"].v = num_frames_modulated;
+    m_send_stats.add_to(rs);
+    if (m_rx_ring) {
+        rs["rx_discontinuities"].v = m_rx_ring->num_discontinuities();
+    }
+    return rs;
+}
+
+double Simulated::get_real_secs(void) const
+{
+    return device_ns() / 1e9;
+}
+
+void Simulated::set_rxgain(double rxgain)
+{
+    m_conf.rxgain = rxgain;
+    m_rx_gain_lin = db_to_lin(rxgain);
+}
+
+double Simulated::get_rxgain(void) const
+{
+    return m_conf.rxgain;
+}
+
+size_t Simulated::receive_frame(
+        complexf *buf,
+        size_t num_samples,
+        frame_timestamp& ts,
+        double timeout_secs)
+{
+    if (not m_rx_ring) {
+        // Without loopback, there is nothing to receive
+        return 0;
+    }
+
+    long long time_ns = ts.get_ns();
+    const size_t n_read = m_rx_ring->read(buf, num_samples, time_ns, timeout_secs);
+    ts.set_ns(time_ns);
+    return n_read;
+}
+
+bool Simulated::is_clk_source_ok()
+{
+    return true;
+}
+
+const char* Simulated::device_name(void) const
+{
+    return "Simulated";
+}
+
+std::optional<double> Simulated::get_temperature(void) const
+{
+    return std::nullopt;
+}
+
+void Simulated::transmit_frame(struct FrameData&& frame)
+{
+    const auto time_before_write = std::chrono::steady_clock::now();
+
+    const uint8_t *buf = reinterpret_cast<const uint8_t*>(frame.buf.getData());
+    const size_t numSamples = frame.buf.getLength() /
+        (frame.sampleSize * frame.numChannels);
+    if ((frame.buf.getLength() % (frame.sampleSize * frame.numChannels)) != 0) {
+        throw std::runtime_error("Simulated: invalid buffer size");
+    }
+
+    const long long duration_ns = llround(numSamples * 1e9 / m_conf.sampleRate);
+    const long long now_ns = device_ns();
+
+    // muting and mutenotimestamp is handled by SDR. Like UHD, only the
+    // first frame of a burst is transmitted at its timestamp, the following
+    // ones continue the burst.
+    const bool has_time_spec = (m_conf.enableSync and frame.ts.timestamp_valid);
+
+    long long start_ns = now_ns;
+    if (m_streaming) {
+        start_ns = m_next_ns;
+        if (start_ns < now_ns) {
+            // The device ran out of samples, the frame goes out as soon as
+            // it arrives
+            m_tx_events.underflows++;
+            start_ns = now_ns;
+        }
+    }
+    else if (has_time_spec) {
+        start_ns = frame.ts.get_ns();
+        if (start_ns < now_ns) {
+            // The device drops the bursts that start in the past
+            m_tx_events.late_packets++;
+            num_frames_modulated++;
+            return;
+        }
+    }
+
+    if (m_rx_ring) {
+        loop_back(buf, numSamples, frame.sampleSize, start_ns);
+    }
+
+    // End the burst if the timestamps have been refreshed and need to be
+    // reconsidered, or if muting was set
+    const bool end_of_burst = m_conf.muting or
+        (frame.ts.timestamp_valid and m_require_timestamp_refresh);
+    m_streaming = not end_of_burst;
+    m_next_ns = start_ns + duration_ns;
+    if (end_of_burst) {
+        m_require_timestamp_refresh = false;
+    }
+
+    // Block until the buffer of the device has room for the whole frame
+    const long long writable_ns = m_next_ns -
+        (long long)m_conf.simulatedBufferMs * 1000000;
+    if (writable_ns > now_ns) {
+        this_thread::sleep_until(m_clock_start +
+                chrono::nanoseconds(writable_ns - m_start_ns));
+    }
+
+    const auto time_now = std::chrono::steady_clock::now();
+    m_send_stats.record(time_now - time_before_write, numSamples);
+    num_frames_modulated++;
+
+    if (m_last_print_time + std::chrono::seconds(1) < time_now) {
+        m_tx_events.log_changes("Simulated");
+        m_last_print_time = time_now;
+    }
+}
+
+void Simulated::loop_back(const uint8_t *buf, size_t num_samples,
+        size_t sample_size, long long time_ns)
+{
+    const float tx_gain = m_tx_gain_lin.load();
+    const float rx_gain = m_rx_gain_lin.load();
+    const float saturation = m_conf.simulatedPaSaturation;
+    const float two_p = 2.0 * m_conf.simulatedPaSmoothness;
+    const float am_pm = m_conf.simulatedPaAmPm * M_PI / 180.0;
+
+    const complexf *in_f = reinterpret_cast<const complexf*>(buf);
+    const int16_t *in_s16 = reinterpret_cast<const int16_t*>(buf);
+    const bool is_s16 = (sample_size == 2 * sizeof(int16_t));
+
+    size_t done = 0;
+    while (done < num_samples) {
+        size_t max_samples = 0;
+        complexf *out = m_rx_ring->write_ptr(max_samples);
+        const size_t n = std::min(max_samples, num_samples - done);
+
+        for (size_t i = 0; i < n; i++) {
+            const size_t j = done + i;
+            const complexf x = is_s16 ?
+                complexf(in_s16[2*j] / 32767.0f, in_s16[2*j+1] / 32767.0f) :
+                in_f[j];
+
+            // Rapp AM/AM, and an AM/PM that reaches am_pm at saturation
+            const complexf v = x * tx_gain;
+            const float r2 = std::norm(v) / (saturation * saturation);
+            const float gain = 1.0f / pow(1.0f + pow(r2, two_p / 2.0f), 1.0f / two_p);
+            complexf y = v * (gain * rx_gain);
+            if (am_pm != 0.0f) {
+                y *= std::polar(1.0f, am_pm * r2 / (1.0f + r2) * 2.0f);
+            }
+            out[i] = y;
+        }
+
+        m_rx_ring->commit(n, time_ns + llround(done * 1e9 / m_conf.sampleRate), true);
+        done += n;
+    }
+}
+
+} // namespace Output
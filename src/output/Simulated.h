@@ -0,0 +1,117 @@
+/*
+   Copyright (C) 2026
+   Matthias P. Braendli, matthias.braendli@mpb.li
+
+    http://opendigitalradio.org
+
+DESCRIPTION:
+   An SDR device without hardware, that consumes the samples at the sample
+   rate against a simulated device clock, for load tests and benchmarks.
+*/
+
+/*
+   This file is part of ODR-DabMod.
+
+   ODR-DabMod is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   ODR-DabMod is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#   include <config.h>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "output/SDRDevice.h"
+#include "output/RxRing.h"
+
+namespace Output {
+
+/* The device clock starts at the system time and advances with the
+ * steady clock. transmit_frame() blocks until the device has room for the
+ * frame in a buffer of simulatedBufferMs, and counts underruns when the
+ * frames do not come in time to continue the burst, and late packets when
+ * a burst starts at a time in the past, like UHD does.
+ *
+ * With simulatedLoopback, the samples of the first TX channel go through
+ * a PA model and a continuous RX ring, from which receive_frame() reads
+ * them at the time they were transmitted. The PA follows the Rapp model,
+ * with an optional AM/PM conversion; the TX and RX gains are in dB.
+ */
+class Simulated : public Output::SDRDevice
+{
+    public:
+        Simulated(SDRDeviceConfig& config);
+        Simulated(const Simulated& other) = delete;
+        Simulated& operator=(const Simulated& other) = delete;
+
+        virtual void tune(double lo_offset, double frequency) override;
+        virtual double get_tx_freq(void) const override;
+        virtual void set_txgain(double txgain) override;
+        virtual double get_txgain(void) const override;
+        virtual void set_bandwidth(double bandwidth) override;
+        virtual double get_bandwidth(void) const override;
+        virtual void transmit_frame(struct FrameData&& frame) override;
+        virtual run_statistics_t get_run_statistics(void) const override;
+        virtual const TxEventCounters* get_tx_event_counters(void) const override { return &m_tx_events; }
+        virtual double get_real_secs(void) const override;
+
+        virtual void set_rxgain(double rxgain) override;
+        virtual double get_rxgain(void) const override;
+        virtual size_t receive_frame(
+                complexf *buf,
+                size_t num_samples,
+                frame_timestamp& ts,
+                double timeout_secs) override;
+
+        // Return true if GPS and reference clock inputs are ok
+        virtual bool is_clk_source_ok(void) override;
+        virtual const char* device_name(void) const override;
+
+        virtual std::optional<double> get_temperature(void) const override;
+
+    private:
+        // The time of the device clock in ns since the unix epoch
+        long long device_ns(void) const;
+
+        // Put num_samples of channel 0 through the PA into the RX ring
+        void loop_back(const uint8_t *buf, size_t num_samples,
+                size_t sample_size, long long time_ns);
+
+        SDRDeviceConfig& m_conf;
+
+        std::chrono::steady_clock::time_point m_clock_start;
+        long long m_start_ns = 0;
+
+        // Whether a burst is ongoing, and the time of its next sample
+        bool m_streaming = false;
+        long long m_next_ns = 0;
+
+        // Linear gains of the loopback
+        std::atomic<float> m_tx_gain_lin = ATOMIC_VAR_INIT(1.0f);
+        std::atomic<float> m_rx_gain_lin = ATOMIC_VAR_INIT(1.0f);
+
+        std::unique_ptr<RxRing> m_rx_ring;
+
+        TxEventCounters m_tx_events;
+        TransmitCallStats m_send_stats;
+        std::chrono::steady_clock::time_point m_last_print_time;
+        size_t num_frames_modulated = 0;
+};
+
+} // namespace Output
@@ -34,6 +34,7 @@ DESCRIPTION:
 #ifdef HAVE_SOAPYSDR
 
 #include <SoapySDR/Errors.hpp>
+#include <algorithm>
 #include <chrono>
 #include <limits>
 #include <cstdio>
@@ -78,7 +79,16 @@ Soapy::Soapy(SDRDeviceConfig& config) :
         std::fixed << std::setprecision(4) <<
         m_device->getMasterClockRate()/1000.0 << " kHz";
 
-    m_device->setSampleRate(SOAPY_SDR_TX, 0, m_conf.sampleRate);
+    const size_t num_channels = m_conf.numTxChannels();
+    if (num_channels > m_device->getNumChannels(SOAPY_SDR_TX)) {
+        throw std::runtime_error("Soapy: the device has only " +
+                std::to_string(m_device->getNumChannels(SOAPY_SDR_TX)) +
+                " TX channels");
+    }
+
+    for (size_t chan = 0; chan < num_channels; chan++) {
+        m_device->setSampleRate(SOAPY_SDR_TX, chan, m_conf.sampleRate);
+    }
     m_device->setSampleRate(SOAPY_SDR_RX, 0, m_conf.sampleRate);
     etiLog.level(info) << "SoapySDR:Actual TX rate: " <<
         std::fixed << std::setprecision(4) <<
@@ -91,20 +101,26 @@ Soapy::Soapy(SDRDeviceConfig& config) :
         m_conf.frequency / 1000.0 << " kHz.";
 
     if (m_conf.bandwidth > 0) {
-        m_device->setBandwidth(SOAPY_SDR_TX, 0, m_conf.bandwidth);
+        for (size_t chan = 0; chan < num_channels; chan++) {
+            m_device->setBandwidth(SOAPY_SDR_TX, chan, m_conf.bandwidth);
+        }
         m_device->setBandwidth(SOAPY_SDR_RX, 0, m_conf.bandwidth);
         etiLog.level(info) << "SoapySDR:Actual TX bandwidth: " <<
             std::fixed << std::setprecision(2) <<
             m_device->getBandwidth(SOAPY_SDR_TX, 0);
     }
 
-    m_device->setGain(SOAPY_SDR_TX, 0, m_conf.txgain);
+    for (size_t chan = 0; chan < num_channels; chan++) {
+        m_device->setGain(SOAPY_SDR_TX, chan, m_conf.txgain);
+    }
     etiLog.level(info) << "SoapySDR:Actual TX gain: " <<
         std::fixed << std::setprecision(2) <<
         m_device->getGain(SOAPY_SDR_TX, 0);
 
     if (not m_conf.tx_antenna.empty()) {
-        m_device->setAntenna(SOAPY_SDR_TX, 0, m_conf.tx_antenna);
+        for (size_t chan = 0; chan < num_channels; chan++) {
+            m_device->setAntenna(SOAPY_SDR_TX, chan, m_conf.tx_antenna);
+        }
     }
     etiLog.level(info) << "SoapySDR:Actual TX antenna: " <<
         m_device->getAntenna(SOAPY_SDR_TX, 0);
@@ -116,13 +132,50 @@ Soapy::Soapy(SDRDeviceConfig& config) :
         m_device->setHardwareTime(ticks);
     }
 
-    const std::vector<size_t> channels({0});
-    m_tx_stream = m_device->setupStream(SOAPY_SDR_TX, "CF32", channels);
-    m_rx_stream = m_device->setupStream(SOAPY_SDR_RX, "CF32", channels);
+    std::string tx_format = "CF32";
+    if (m_conf.sampleFormat == "s16") {
+        tx_format = "CS16";
+    }
+    else if (m_conf.sampleFormat == "sc12") {
+        tx_format = "CS12";
+    }
+    else if (not m_conf.sampleFormat.empty()) {
+        throw std::runtime_error("Soapy: unsupported sample format " +
+                m_conf.sampleFormat);
+    }
+    etiLog.level(info) << "SoapySDR:TX stream format " << tx_format;
+
+    std::vector<size_t> tx_channels;
+    for (size_t chan = 0; chan < num_channels; chan++) {
+        tx_channels.push_back(chan);
+    }
+    m_tx_stream = m_device->setupStream(SOAPY_SDR_TX, tx_format, tx_channels);
+    m_rx_stream = m_device->setupStream(SOAPY_SDR_RX, "CF32", {0});
+
+    m_running.store(true);
+    m_async_thread = std::thread(&Soapy::monitor_async_thread, this);
+
+    if (m_conf.rxContinuous) {
+        const size_t block = m_device->getStreamMTU(m_rx_stream);
+        const size_t capacity = std::max<size_t>(
+                m_conf.rxRingDuration * m_conf.sampleRate, 4 * block);
+        m_rx_ring = std::make_unique<RxRing>(capacity, block, m_conf.sampleRate);
+        m_rx_thread = std::thread(&Soapy::rx_capture_thread, this);
+        etiLog.level(info) << "SoapySDR: continuous RX into a ring of " <<
+            capacity << " samples";
+    }
 }
 
 Soapy::~Soapy()
 {
+    m_running.store(false);
+    if (m_async_thread.joinable()) {
+        m_async_thread.join();
+    }
+    if (m_rx_thread.joinable()) {
+        m_rx_thread.join();
+    }
+
     if (m_device != nullptr) {
         if (m_tx_stream != nullptr) {
             m_device->closeStream(m_tx_stream);
@@ -141,9 +194,16 @@ void Soapy::tune(double lo_offset, double frequency)
 
     SoapySDR::Kwargs offset_arg;
     offset_arg["OFFSET"] = to_string(lo_offset);
-    m_device->setFrequency(SOAPY_SDR_TX, 0, m_conf.frequency, offset_arg);
 
-    m_conf.frequency = m_device->getFrequency(SOAPY_SDR_TX, 0);
+    // Every TX channel has its own frequency offset
+    const auto& offsets = m_conf.txChannelOffsets;
+    for (size_t chan = 0; chan < m_conf.numTxChannels(); chan++) {
+        const double offset = offsets.empty() ? 0.0 : offsets[chan];
+        m_device->setFrequency(SOAPY_SDR_TX, chan, frequency + offset, offset_arg);
+    }
+
+    const double offset0 = offsets.empty() ? 0.0 : offsets[0];
+    m_conf.frequency = m_device->getFrequency(SOAPY_SDR_TX, 0) - offset0;
 }
 
 double Soapy::get_tx_freq(void) const
@@ -158,7 +218,9 @@ void Soapy::set_txgain(double txgain)
 {
     m_conf.txgain = txgain;
     if (not m_device) throw runtime_error("Soapy device not set up");
-    m_device->setGain(SOAPY_SDR_TX, 0, m_conf.txgain);
+    for (size_t chan = 0; chan < m_conf.numTxChannels(); chan++) {
+        m_device->setGain(SOAPY_SDR_TX, chan, m_conf.txgain);
+    }
 }
 
 double Soapy::get_txgain(void) const
@@ -171,7 +233,9 @@ void Soapy::set_bandwidth(double bandwidth)
 {
     m_conf.bandwidth = bandwidth;
     if (not m_device) throw runtime_error("Soapy device not set up");
-    m_device->setBandwidth(SOAPY_SDR_TX, 0, m_conf.bandwidth);
+    for (size_t chan = 0; chan < m_conf.numTxChannels(); chan++) {
+        m_device->setBandwidth(SOAPY_SDR_TX, chan, m_conf.bandwidth);
+    }
     m_device->setBandwidth(SOAPY_SDR_RX, 0, m_conf.bandwidth);
 }
 
@@ -184,10 +248,15 @@ double Soapy::get_bandwidth(void) const
 SDRDevice::run_statistics_t Soapy::get_run_statistics(void) const
 {
     run_statistics_t rs;
-    rs["underruns"].v = underflows;
+    m_tx_events.add_to(rs);
     rs["overruns"].v = overflows;
     rs["timeouts"].v = timeouts;
     rs["frames"].v = num_frames_modulated;
+    m_send_stats.add_to(rs);
+    if (m_rx_ring) {
+        rs["rx_overruns"].v = m_rx_overflows.load();
+        rs["rx_discontinuities"].v = m_rx_ring->num_discontinuities();
+    }
     return rs;
 }
 
@@ -220,6 +289,13 @@ size_t Soapy::receive_frame(
         frame_timestamp& ts,
         double timeout_secs)
 {
+    if (m_rx_ring) {
+        long long time_ns = ts.get_ns();
+        const size_t n_read = m_rx_ring->read(buf, num_samples, time_ns, timeout_secs);
+        ts.set_ns(time_ns);
+        return n_read;
+    }
+
     int flags = 0;
     long long timeNs = ts.get_ns();
     const size_t numElems = num_samples;
@@ -291,34 +367,48 @@ void Soapy::transmit_frame(struct FrameData&& frame)
         m_tx_stream_active = true;
     }
 
-    // The frame buffer contains bytes representing FC32 samples
-    const complexf *buf = reinterpret_cast<const complexf*>(frame.buf.data());
-    const size_t numSamples = frame.buf.size() / sizeof(complexf);
-    if ((frame.buf.size() % sizeof(complexf)) != 0) {
+    // The frame buffer contains bytes representing samples in the
+    // format of the TX stream, CF32 unless configured otherwise. With
+    // several TX channels, they are one after the other.
+    const uint8_t *buf = reinterpret_cast<const uint8_t*>(frame.buf.getData());
+    const size_t numSamples = frame.buf.getLength() /
+        (frame.sampleSize * frame.numChannels);
+    if ((frame.buf.getLength() % (frame.sampleSize * frame.numChannels)) != 0) {
         throw std::runtime_error("Soapy: invalid buffer size");
     }
 
-    // Stream MTU is in samples, not bytes.
-    const size_t mtu = m_device->getStreamMTU(m_tx_stream);
+    std::vector<const void*> buffs(frame.numChannels);
+
+    // Stream MTU is in samples, not bytes. With bulk transmission, give the
+    // driver the whole remainder of the frame, it writes as much of it as
+    // fits into its buffers and tells how much that was.
+    const size_t max_samps_per_call = m_conf.bulkTransmit ?
+        numSamples : m_device->getStreamMTU(m_tx_stream);
+
+    // Deactivate the stream at the end of the frame if the timestamps have
+    // been refreshed and need to be reconsidered. If muting was set,
+    // deactivate it after the first write and give up the rest of the frame.
+    const bool eob_because_muting = m_conf.muting;
+    const bool eob_at_frame_end = eob_because_muting or
+        (frame.ts.timestamp_valid and m_require_timestamp_refresh);
 
     size_t num_acc_samps = 0;
     while (num_acc_samps < numSamples) {
 
-        const void *buffs[1];
-        buffs[0] = buf + num_acc_samps;
-
-        const size_t samps_to_send = std::min(numSamples - num_acc_samps, mtu);
+        for (size_t chan = 0; chan < buffs.size(); chan++) {
+            buffs[chan] = buf + (chan * numSamples + num_acc_samps) * frame.sampleSize;
+        }
 
-        const bool eob_because_muting = m_conf.muting;
-        const bool end_of_burst = eob_because_muting or (
-                frame.ts.timestamp_valid and
-                m_require_timestamp_refresh and
-                samps_to_send <= mtu );
+        const size_t samps_to_send = std::min(numSamples - num_acc_samps,
+                max_samps_per_call);
 
         int flags = 0;
 
+        const auto time_before_write = std::chrono::steady_clock::now();
         auto num_sent = m_device->writeStream(
-                m_tx_stream, buffs, samps_to_send, flags, timeNs);
+                m_tx_stream, buffs.data(), samps_to_send, flags, timeNs);
+        m_send_stats.record(std::chrono::steady_clock::now() - time_before_write,
+                num_sent > 0 ? num_sent : 0);
 
         if (num_sent == SOAPY_SDR_TIMEOUT) {
             timeouts++;
@@ -329,7 +419,7 @@ void Soapy::transmit_frame(struct FrameData&& frame)
             continue;
         }
         else if (num_sent == SOAPY_SDR_UNDERFLOW) {
-            underflows++;
+            m_tx_events.underflows++;
             continue;
         }
 
@@ -343,6 +433,8 @@ void Soapy::transmit_frame(struct FrameData&& frame)
 
         num_acc_samps += num_sent;
 
+        const bool end_of_burst = eob_at_frame_end and
+            (eob_because_muting or num_acc_samps == numSamples);
         if (end_of_burst) {
             int ret_deact = m_device->deactivateStream(m_tx_stream);
             if (ret_deact != 0) {
@@ -361,6 +453,92 @@ void Soapy::transmit_frame(struct FrameData&& frame)
     num_frames_modulated++;
 }
 
+void Soapy::monitor_async_thread()
+{
+    set_thread_name("soapyasync");
+
+    auto last_print_time = std::chrono::steady_clock::now();
+
+    while (m_running.load()) {
+        size_t chan_mask = 0;
+        int flags = 0;
+        long long time_ns = 0;
+        const int ret = m_device->readStreamStatus(
+                m_tx_stream, chan_mask, flags, time_ns, 100000);
+
+        switch (ret) {
+            case 0:
+            case SOAPY_SDR_TIMEOUT:
+                break;
+            case SOAPY_SDR_UNDERFLOW:
+                m_tx_events.underflows++;
+                break;
+            case SOAPY_SDR_TIME_ERROR:
+                m_tx_events.late_packets++;
+                break;
+            case SOAPY_SDR_CORRUPTION:
+                m_tx_events.seq_errors++;
+                etiLog.level(alert) << "SoapySDR: TX stream corruption at time " <<
+                    time_ns / 1e9;
+                break;
+            case SOAPY_SDR_NOT_SUPPORTED:
+                etiLog.level(info) << "SoapySDR: the device does not report "
+                    "the TX stream status, underruns and late packets are "
+                    "only counted when writing samples";
+                return;
+            default:
+                etiLog.level(warn) << "SoapySDR: TX stream status " <<
+                    SoapySDR::errToStr(ret) << ", stop monitoring it";
+                return;
+        }
+
+        const auto time_now = std::chrono::steady_clock::now();
+        if (last_print_time + std::chrono::seconds(1) < time_now) {
+            m_tx_events.log_changes("SoapySDR");
+            last_print_time = time_now;
+        }
+    }
+}
+
+void Soapy::rx_capture_thread()
+{
+    set_thread_name("soapyrx");
+
+    int ret = m_device->activateStream(m_rx_stream);
+    if (ret != 0) {
+        etiLog.level(error) << "SoapySDR: activate RX stream failed: " <<
+            SoapySDR::errToStr(ret) << ", no continuous RX";
+        return;
+    }
+    m_rx_stream_active = true;
+
+    while (m_running.load()) {
+        size_t max_samples = 0;
+        void *buffs[1];
+        buffs[0] = m_rx_ring->write_ptr(max_samples);
+
+        int flags = 0;
+        long long time_ns = 0;
+        ret = m_device->readStream(m_rx_stream, buffs, max_samples,
+                flags, time_ns, 100000);
+
+        if (ret > 0) {
+            m_rx_ring->commit(ret, time_ns, flags & SOAPY_SDR_HAS_TIME);
+        }
+        else if (ret == SOAPY_SDR_OVERFLOW) {
+            m_rx_overflows++;
+        }
+        else if (ret != SOAPY_SDR_TIMEOUT and ret != 0) {
+            etiLog.level(error) << "SoapySDR: RX stream error " <<
+                SoapySDR::errToStr(ret) << ", continuous RX stopped";
+            break;
+        }
+    }
+
+    m_device->deactivateStream(m_rx_stream);
+    m_rx_stream_active = false;
+}
+
 } // namespace Output
 
 #endif // HAVE_SOAPYSDR
@@ -41,10 +41,13 @@ DESCRIPTION:
 #include <SoapySDR/Registry.hpp>
 #include <SoapySDR/Device.hpp>
 
+#include <atomic>
 #include <string>
 #include <memory>
+#include <thread>
 
 #include "output/SDR.h"
+#include "output/RxRing.h"
 #include "ModPlugin.h"
 #include "EtiReader.h"
 #include "RemoteControl.h"
@@ -67,6 +70,7 @@ class Soapy : public Output::SDRDevice
         virtual double get_bandwidth(void) const override;
         virtual void transmit_frame(struct FrameData&& frame) override;
         virtual run_statistics_t get_run_statistics(void) const override;
+        virtual const TxEventCounters* get_tx_event_counters(void) const override { return &m_tx_events; }
         virtual double get_real_secs(void) const override;
 
         virtual void set_rxgain(double rxgain) override;
@@ -92,9 +96,22 @@ class Soapy : public Output::SDRDevice
         bool m_rx_stream_active = false;
 
         size_t timeouts = 0;
-        size_t underflows = 0;
         size_t overflows = 0;
         size_t num_frames_modulated = 0;
+        TransmitCallStats m_send_stats;
+        TxEventCounters m_tx_events;
+
+        // Poll the TX stream status of the device
+        std::atomic<bool> m_running = ATOMIC_VAR_INIT(false);
+        std::thread m_async_thread;
+        void monitor_async_thread(void);
+
+        // With rxContinuous, receives into m_rx_ring, from which
+        // receive_frame() takes the samples
+        std::unique_ptr<RxRing> m_rx_ring;
+        std::thread m_rx_thread;
+        std::atomic<size_t> m_rx_overflows = ATOMIC_VAR_INIT(0);
+        void rx_capture_thread(void);
 };
 
 } // namespace Output
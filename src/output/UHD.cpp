@@ -32,9 +32,11 @@
 #define MDEBUG(fmt, args...)
 
 #include "Log.h"
+#include "Utils.h"
 
 #include <thread>
 #include <iomanip>
+#include <algorithm>
 
 #include <uhd/version.hpp>
 // 3.11.0.0 introduces the API breaking change, where
@@ -188,8 +190,17 @@ UHD::UHD(SDRDeviceConfig& config) :
         throw std::runtime_error("Cannot set USRP sample rate. Aborted.");
     }
 
+    const size_t num_channels = m_conf.numTxChannels();
+    if (num_channels > m_usrp->get_tx_num_channels()) {
+        throw std::runtime_error("OutputUHD: the device has only " +
+                std::to_string(m_usrp->get_tx_num_channels()) +
+                " TX channels, check the subdevice");
+    }
+
     if (m_conf.bandwidth > 0) {
-        m_usrp->set_tx_bandwidth(m_conf.bandwidth);
+        for (size_t chan = 0; chan < num_channels; chan++) {
+            m_usrp->set_tx_bandwidth(m_conf.bandwidth, chan);
+        }
         m_usrp->set_rx_bandwidth(m_conf.bandwidth);
 
         etiLog.level(info) << "OutputUHD:Actual TX bandwidth: " <<
@@ -205,8 +216,7 @@ UHD::UHD(SDRDeviceConfig& config) :
     etiLog.level(debug) << std::fixed << std::setprecision(3) <<
         "OutputUHD:Actual RX frequency: " << m_usrp->get_tx_freq();
 
-    m_usrp->set_tx_gain(m_conf.txgain);
-    m_conf.txgain = m_usrp->get_tx_gain();
+    set_txgain(m_conf.txgain);
     etiLog.log(debug, "OutputUHD:Actual TX Gain: %f", m_conf.txgain);
 
     etiLog.log(debug, "OutputUHD:Mute on missing timestamps: %s",
@@ -222,7 +232,9 @@ UHD::UHD(SDRDeviceConfig& config) :
             m_usrp->get_rx_antenna().c_str());
 
     if (not m_conf.tx_antenna.empty()) {
-        m_usrp->set_tx_antenna(m_conf.tx_antenna);
+        for (size_t chan = 0; chan < num_channels; chan++) {
+            m_usrp->set_tx_antenna(m_conf.tx_antenna, chan);
+        }
     }
     etiLog.log(debug, "OutputUHD:Actual TX Antenna: %s",
             m_usrp->get_tx_antenna().c_str());
@@ -230,13 +242,40 @@ UHD::UHD(SDRDeviceConfig& config) :
     m_usrp->set_rx_gain(m_conf.rxgain);
     etiLog.log(debug, "OutputUHD:Actual RX Gain: %f", m_usrp->get_rx_gain());
 
+    // The ring of the continuous reception holds complexf samples
     const uhd::stream_args_t stream_args(
-            m_conf.fixedPoint ? "sc16" : "fc32");
+            m_conf.fixedPoint and not m_conf.rxContinuous ? "sc16" : "fc32");
     m_rx_stream = m_usrp->get_rx_stream(stream_args);
-    m_tx_stream = m_usrp->get_tx_stream(stream_args);
+
+    // The samples converted to sc16 by the FormatConverter, or the fixed
+    // point samples, are given to UHD without further conversion.
+    const bool tx_sc16 = m_conf.fixedPoint or m_conf.sampleFormat == "s16";
+    uhd::stream_args_t tx_stream_args(
+            tx_sc16 ? "sc16" : "fc32", m_conf.otwFormat);
+    etiLog.level(info) << "OutputUHD:TX stream format " <<
+        tx_stream_args.cpu_format << ", over the wire " <<
+        tx_stream_args.otw_format;
+    for (size_t chan = 0; chan < num_channels; chan++) {
+        tx_stream_args.channels.push_back(chan);
+    }
+    m_tx_stream = m_usrp->get_tx_stream(tx_stream_args);
+
+    // Before the threads get started, in case it throws
+    m_clk_source_ok = check_clk_source();
 
     m_running.store(true);
     m_async_rx_thread = std::thread(&UHD::print_async_thread, this);
+    m_clock_monitor_thread = std::thread(&UHD::clock_monitor_thread, this);
+
+    if (m_conf.rxContinuous) {
+        const size_t block = m_rx_stream->get_max_num_samps();
+        const size_t capacity = std::max<size_t>(
+                m_conf.rxRingDuration * m_conf.sampleRate, 4 * block);
+        m_rx_ring = std::make_unique<RxRing>(capacity, block, m_conf.sampleRate);
+        m_rx_thread = std::thread(&UHD::rx_capture_thread, this);
+        etiLog.level(info) << "OutputUHD: continuous RX into a ring of " <<
+            capacity << " samples";
+    }
 
     MDEBUG("OutputUHD:UHD ready.\n");
 }
@@ -248,20 +287,31 @@ UHD::~UHD()
 
 void UHD::tune(double lo_offset, double frequency)
 {
+    // Every TX channel has its own frequency offset, the RX for the
+    // DPD feedback receives the first one.
+    const auto& offsets = m_conf.txChannelOffsets;
+    const double offset0 = offsets.empty() ? 0.0 : offsets[0];
+    const size_t num_channels = m_conf.numTxChannels();
+
     if (lo_offset != 0.0) {
         etiLog.level(info) << std::fixed << std::setprecision(3) <<
             "OutputUHD:Setting freq to " << frequency <<
             "  with LO offset " << lo_offset << "...";
 
-        const auto tr = uhd::tune_request_t(frequency, lo_offset);
-        uhd::tune_result_t result = m_usrp->set_tx_freq(tr);
+        for (size_t chan = 0; chan < num_channels; chan++) {
+            const double offset = offsets.empty() ? 0.0 : offsets[chan];
+            const auto tr_tx = uhd::tune_request_t(frequency + offset, lo_offset);
+            uhd::tune_result_t result = m_usrp->set_tx_freq(tr_tx, chan);
+
+            etiLog.level(debug) << "OutputUHD: TX " << chan << " freq" <<
+                std::fixed << std::setprecision(0) <<
+                " Target RF: " << result.target_rf_freq <<
+                " Actual RF: " << result.actual_rf_freq <<
+                " Target DSP: " << result.target_dsp_freq <<
+                " Actual DSP: " << result.actual_dsp_freq;
+        }
 
-        etiLog.level(debug) << "OutputUHD: TX freq" <<
-            std::fixed << std::setprecision(0) <<
-            " Target RF: " << result.target_rf_freq <<
-            " Actual RF: " << result.actual_rf_freq <<
-            " Target DSP: " << result.target_dsp_freq <<
-            " Actual DSP: " << result.actual_dsp_freq;
+        const auto tr = uhd::tune_request_t(frequency + offset0, lo_offset);
 
         uhd::tune_result_t result_rx = m_usrp->set_rx_freq(tr);
 
@@ -276,12 +326,15 @@ void UHD::tune(double lo_offset, double frequency)
         //set the centre frequency
         etiLog.level(info) << std::fixed << std::setprecision(3) <<
             "OutputUHD:Setting freq to " << frequency << "...";
-        m_usrp->set_tx_freq(frequency);
+        for (size_t chan = 0; chan < num_channels; chan++) {
+            const double offset = offsets.empty() ? 0.0 : offsets[chan];
+            m_usrp->set_tx_freq(frequency + offset, chan);
+        }
 
-        m_usrp->set_rx_freq(frequency);
+        m_usrp->set_rx_freq(frequency + offset0);
     }
 
-    m_conf.frequency = m_usrp->get_tx_freq();
+    m_conf.frequency = m_usrp->get_tx_freq() - offset0;
 }
 
 double UHD::get_tx_freq(void) const
@@ -291,7 +344,9 @@ double UHD::get_tx_freq(void) const
 
 void UHD::set_txgain(double txgain)
 {
-    m_usrp->set_tx_gain(txgain);
+    for (size_t chan = 0; chan < m_conf.numTxChannels(); chan++) {
+        m_usrp->set_tx_gain(txgain, chan);
+    }
     m_conf.txgain = m_usrp->get_tx_gain();
 }
 
@@ -302,7 +357,9 @@ double UHD::get_txgain(void) const
 
 void UHD::set_bandwidth(double bandwidth)
 {
-    m_usrp->set_tx_bandwidth(bandwidth);
+    for (size_t chan = 0; chan < m_conf.numTxChannels(); chan++) {
+        m_usrp->set_tx_bandwidth(bandwidth, chan);
+    }
     m_usrp->set_rx_bandwidth(bandwidth);
     m_conf.bandwidth = m_usrp->get_tx_bandwidth();
 }
@@ -316,8 +373,13 @@ void UHD::transmit_frame(struct FrameData&& frame)
 {
     const double tx_timeout = 20.0;
 
-    const size_t sample_size = m_conf.fixedPoint ? (2 * sizeof(int16_t)) : sizeof(complexf);
-    const size_t sizeIn = frame.buf.size() / sample_size;
+    const size_t sample_size = m_conf.fixedPoint ?
+        (2 * sizeof(int16_t)) : frame.sampleSize;
+    const size_t sizeIn = frame.buf.getLength() / (sample_size * frame.numChannels);
+    const uint8_t *buf = reinterpret_cast<const uint8_t*>(frame.buf.getData());
+
+    // One pointer per TX channel, into the part of the frame of that channel
+    std::vector<const void*> buffs(frame.numChannels);
 
     uhd::tx_metadata_t md_tx;
 
@@ -326,7 +388,7 @@ void UHD::transmit_frame(struct FrameData&& frame)
     // muting and mutenotimestamp is handled by SDR
     if (m_conf.enableSync and frame.ts.timestamp_valid) {
         uhd::time_spec_t timespec(
-                frame.ts.timestamp_sec, frame.ts.pps_offset());
+                frame.ts.timestamp_sec(), frame.ts.pps_offset());
         md_tx.time_spec = timespec;
         md_tx.has_time_spec = true;
     }
@@ -334,27 +396,36 @@ void UHD::transmit_frame(struct FrameData&& frame)
         md_tx.has_time_spec = false;
     }
 
-    size_t usrp_max_num_samps = m_tx_stream->get_max_num_samps();
+    // Without bulk transmission, give the driver one packet per call. With
+    // it, give it the whole remainder of the frame and let it fragment.
+    const size_t max_samps_per_call = m_conf.bulkTransmit ?
+        sizeIn : m_tx_stream->get_max_num_samps();
+
+    // Ensure the last packet of the frame has EOB set if the timestamps have
+    // been refreshed and need to be reconsidered. If muting was set, set EOB
+    // and give up the rest of the frame, to avoid an underrun.
+    const bool eob_because_muting = m_conf.muting;
+    const bool eob_at_frame_end = eob_because_muting or
+        (frame.ts.timestamp_valid and m_require_timestamp_refresh);
+    m_require_timestamp_refresh = false;
+
     size_t num_acc_samps = 0; //number of accumulated samples
     while (tx_allowed and m_running.load() and (num_acc_samps < sizeIn)) {
-        size_t samps_to_send = std::min(sizeIn - num_acc_samps, usrp_max_num_samps);
+        size_t samps_to_send = std::min(sizeIn - num_acc_samps, max_samps_per_call);
 
-        const bool eob_because_muting = m_conf.muting;
+        md_tx.end_of_burst = eob_at_frame_end and
+            (eob_because_muting or num_acc_samps + samps_to_send == sizeIn);
 
-        // ensure the the last packet has EOB set if the timestamps has been
-        // refreshed and need to be reconsidered. If muting was set, set the
-        // EOB and quit the loop afterwards, to avoid an underrun.
-        md_tx.end_of_burst = eob_because_muting or (
-                frame.ts.timestamp_valid and
-                m_require_timestamp_refresh and
-                samps_to_send <= usrp_max_num_samps );
-        m_require_timestamp_refresh = false;
+        for (size_t chan = 0; chan < buffs.size(); chan++) {
+            buffs[chan] = buf + sample_size * (chan * sizeIn + num_acc_samps);
+        }
 
-        // send a single packet
+        const auto time_before_send = std::chrono::steady_clock::now();
         size_t num_tx_samps = m_tx_stream->send(
-                frame.buf.data() + sample_size * num_acc_samps,
-                samps_to_send, md_tx, tx_timeout);
-        etiLog.log(trace, "UHD,sent %zu of %zu", num_tx_samps, samps_to_send);
+                buffs, samps_to_send, md_tx, tx_timeout);
+        m_send_stats.record(std::chrono::steady_clock::now() - time_before_send,
+                num_tx_samps);
+        LOG_DEFERRED(trace, "UHD,sent %zu of %zu", num_tx_samps, samps_to_send);
 
         num_acc_samps += num_tx_samps;
 
@@ -378,10 +449,14 @@ void UHD::transmit_frame(struct FrameData&& frame)
 SDRDevice::run_statistics_t UHD::get_run_statistics(void) const
 {
     run_statistics_t rs;
-    rs["underruns"].v = num_underflows;
+    m_tx_events.add_to(rs);
     rs["overruns"].v = num_overflows;
-    rs["late_packets"].v = num_late_packets;
     rs["frames"].v = num_frames_modulated;
+    m_send_stats.add_to(rs);
+    if (m_rx_ring) {
+        rs["rx_overruns"].v = m_rx_overflows.load();
+        rs["rx_discontinuities"].v = m_rx_ring->num_discontinuities();
+    }
 
     if (m_device_time) {
         const auto gpsdo_stat = m_device_time->get_gnss_stats();
@@ -417,11 +492,18 @@ size_t UHD::receive_frame(
         frame_timestamp& ts,
         double timeout_secs)
 {
+    if (m_rx_ring) {
+        long long time_ns = ts.get_ns();
+        const size_t samples_read = m_rx_ring->read(buf, num_samples, time_ns, timeout_secs);
+        ts.set_ns(time_ns);
+        return samples_read;
+    }
+
     uhd::stream_cmd_t cmd(
             uhd::stream_cmd_t::stream_mode_t::STREAM_MODE_NUM_SAMPS_AND_DONE);
     cmd.num_samps = num_samples;
     cmd.stream_now = false;
-    cmd.time_spec = uhd::time_spec_t(ts.timestamp_sec, ts.pps_offset());
+    cmd.time_spec = uhd::time_spec_t(ts.timestamp_sec(), ts.pps_offset());
 
     m_rx_stream->issue_stream_cmd(cmd);
 
@@ -431,13 +513,22 @@ size_t UHD::receive_frame(
     size_t samples_read = m_rx_stream->recv(buf, num_samples, md_rx, timeout);
 
     // Update the ts with the effective receive TS
-    ts.timestamp_sec = md_rx.time_spec.get_full_secs();
-    ts.timestamp_pps = md_rx.time_spec.get_frac_secs() * 16384000.0;
+    ts.set_timestamp(md_rx.time_spec.get_full_secs(),
+            md_rx.time_spec.get_frac_secs() * TIMESTAMP_TICKS_PER_SECOND);
     return samples_read;
 }
 
-// Return true if GPS and reference clock inputs are ok
 bool UHD::is_clk_source_ok(void)
+{
+    if (m_clk_source_failed.load()) {
+        std::lock_guard<std::mutex> lock(m_clk_source_error_mutex);
+        throw std::runtime_error(m_clk_source_error);
+    }
+    return m_clk_source_ok.load();
+}
+
+// Return true if GPS and reference clock inputs are ok
+bool UHD::check_clk_source(void)
 {
     bool ok = true;
 
@@ -498,10 +589,81 @@ void UHD::stop_threads()
     if (m_async_rx_thread.joinable()) {
         m_async_rx_thread.join();
     }
+    if (m_clock_monitor_thread.joinable()) {
+        m_clock_monitor_thread.join();
+    }
+    if (m_rx_thread.joinable()) {
+        m_rx_thread.join();
+    }
+}
+
+void UHD::clock_monitor_thread()
+{
+    set_thread_name("uhdclock");
+
+    while (m_running.load()) {
+        try {
+            m_clk_source_ok = check_clk_source();
+        }
+        catch (const std::exception& e) {
+            {
+                std::lock_guard<std::mutex> lock(m_clk_source_error_mutex);
+                m_clk_source_error = e.what();
+            }
+            m_clk_source_ok = false;
+            m_clk_source_failed = true;
+            break;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
 }
 
 
 
+void UHD::rx_capture_thread()
+{
+    set_thread_name("uhdrx");
+
+    uhd::stream_cmd_t cmd(
+            uhd::stream_cmd_t::stream_mode_t::STREAM_MODE_START_CONTINUOUS);
+    cmd.stream_now = true;
+    m_rx_stream->issue_stream_cmd(cmd);
+
+    bool rx_error = false;
+    while (m_running.load() and not rx_error) {
+        size_t max_samples = 0;
+        complexf *buf = m_rx_ring->write_ptr(max_samples);
+
+        uhd::rx_metadata_t md_rx;
+        const size_t samples_read = m_rx_stream->recv(buf, max_samples, md_rx, 0.1);
+
+        switch (md_rx.error_code) {
+            case uhd::rx_metadata_t::ERROR_CODE_NONE:
+                if (samples_read > 0) {
+                    const long long time_ns =
+                        md_rx.time_spec.get_full_secs() * 1000000000ll +
+                        std::llround(md_rx.time_spec.get_frac_secs() * 1e9);
+                    m_rx_ring->commit(samples_read, time_ns, md_rx.has_time_spec);
+                }
+                break;
+            case uhd::rx_metadata_t::ERROR_CODE_TIMEOUT:
+                break;
+            case uhd::rx_metadata_t::ERROR_CODE_OVERFLOW:
+                m_rx_overflows++;
+                break;
+            default:
+                etiLog.level(error) << "OutputUHD: RX error " <<
+                    md_rx.strerror() << ", continuous RX stopped";
+                rx_error = true;
+                break;
+        }
+    }
+
+    m_rx_stream->issue_stream_cmd(uhd::stream_cmd_t(
+            uhd::stream_cmd_t::stream_mode_t::STREAM_MODE_STOP_CONTINUOUS));
+}
+
 void UHD::print_async_thread()
 {
     while (m_running.load()) {
@@ -514,22 +676,25 @@ void UHD::print_async_thread()
                     break;
                 case uhd::async_metadata_t::EVENT_CODE_UNDERFLOW:
                     uhd_async_message = "Underflow";
-                    num_underflows++;
+                    m_tx_events.underflows++;
                     break;
                 case uhd::async_metadata_t::EVENT_CODE_SEQ_ERROR:
                     uhd_async_message = "Packet loss between host and device.";
+                    m_tx_events.seq_errors++;
                     failure = true;
                     break;
                 case uhd::async_metadata_t::EVENT_CODE_TIME_ERROR:
                     uhd_async_message = "Packet had time that was late.";
-                    num_late_packets++;
+                    m_tx_events.late_packets++;
                     break;
                 case uhd::async_metadata_t::EVENT_CODE_UNDERFLOW_IN_PACKET:
                     uhd_async_message = "Underflow occurred inside a packet.";
+                    m_tx_events.underflows++;
                     failure = true;
                     break;
                 case uhd::async_metadata_t::EVENT_CODE_SEQ_ERROR_IN_BURST:
                     uhd_async_message = "Packet loss within a burst.";
+                    m_tx_events.seq_errors++;
                     failure = true;
                     break;
                 default:
@@ -548,22 +713,7 @@ void UHD::print_async_thread()
 
         auto time_now = std::chrono::steady_clock::now();
         if (last_print_time + std::chrono::seconds(1) < time_now) {
-            const double usrp_time =
-                m_usrp->get_time_now().get_real_secs();
-
-            if ( (num_underflows > num_underflows_previous) or
-                 (num_late_packets > num_late_packets_previous)) {
-                etiLog.log(info,
-                        "OutputUHD status (usrp time: %f): "
-                        "%d underruns and %d late packets since last status.\n",
-                        usrp_time,
-                        num_underflows - num_underflows_previous,
-                        num_late_packets - num_late_packets_previous);
-            }
-
-            num_underflows_previous = num_underflows;
-            num_late_packets_previous = num_late_packets;
-
+            m_tx_events.log_changes("OutputUHD");
             last_print_time = time_now;
         }
     }
@@ -43,10 +43,12 @@ DESCRIPTION:
 #include <memory>
 #include <string>
 #include <atomic>
+#include <mutex>
 #include <thread>
 
 #include "output/SDR.h"
 #include "output/USRPTime.h"
+#include "output/RxRing.h"
 #include "TimestampDecoder.h"
 
 #include <stdio.h>
@@ -70,6 +72,7 @@ class UHD : public Output::SDRDevice
         virtual double get_bandwidth(void) const override;
         virtual void transmit_frame(struct FrameData&& frame) override;
         virtual run_statistics_t get_run_statistics(void) const override;
+        virtual const TxEventCounters* get_tx_event_counters(void) const override { return &m_tx_events; }
         virtual double get_real_secs(void) const override;
 
         virtual void set_rxgain(double rxgain) override;
@@ -80,7 +83,8 @@ class UHD : public Output::SDRDevice
                 frame_timestamp& ts,
                 double timeout_secs) override;
 
-        // Return true if GPS and reference clock inputs are ok
+        // Return true if GPS and reference clock inputs are ok. Only reads
+        // the state the clock monitor thread found.
         virtual bool is_clk_source_ok(void) override;
         virtual const char* device_name(void) const override;
 
@@ -93,12 +97,10 @@ class UHD : public Output::SDRDevice
         uhd::rx_streamer::sptr m_rx_stream;
         std::shared_ptr<USRPTime> m_device_time;
 
-        size_t num_underflows = 0;
+        TxEventCounters m_tx_events;
         size_t num_overflows = 0;
-        size_t num_late_packets = 0;
         size_t num_frames_modulated = 0;
-        size_t num_underflows_previous = 0;
-        size_t num_late_packets_previous = 0;
+        TransmitCallStats m_send_stats;
 
         // Used to print statistics once a second
         std::chrono::steady_clock::time_point last_print_time;
@@ -112,6 +114,29 @@ class UHD : public Output::SDRDevice
         std::thread m_async_rx_thread;
         void stop_threads(void);
         void print_async_thread(void);
+
+        /* The sensors are read over the bus to the device, which can take
+         * long enough to delay the transmission. The clock monitor thread
+         * reads them, and verifies the GPSDO and sets the device time
+         * through the USRPTime, so that the transmit path only has to read
+         * the result. */
+        bool check_clk_source(void);
+        void clock_monitor_thread(void);
+        std::thread m_clock_monitor_thread;
+        std::atomic<bool> m_clk_source_ok = ATOMIC_VAR_INIT(false);
+
+        // When the check threw, the error is thrown again in the transmit
+        // path, to stop the modulator like before
+        std::atomic<bool> m_clk_source_failed = ATOMIC_VAR_INIT(false);
+        std::mutex m_clk_source_error_mutex;
+        std::string m_clk_source_error;
+
+        // With rxContinuous, receives into m_rx_ring, from which
+        // receive_frame() takes the samples
+        std::unique_ptr<RxRing> m_rx_ring;
+        std::thread m_rx_thread;
+        std::atomic<size_t> m_rx_overflows = ATOMIC_VAR_INIT(0);
+        void rx_capture_thread(void);
 };
 
 } // namespace Output
@@ -133,6 +133,7 @@ bool USRPTime::verify_time()
 
 gnss_stats_t USRPTime::get_gnss_stats(void) const
 {
+    std::lock_guard<std::mutex> lock(gnss_stats_mutex);
     return gnss_stats;
 }
 
@@ -140,39 +141,27 @@ void USRPTime::check_gps()
 {
     timepoint_t time_now = timepoint_t::clock::now();
 
-    // Divide interval by two because we alternate between
-    // launch and check
-    const auto checkinterval = chrono::seconds(lrint(gps_fix_check_interval/2.0));
+    const auto checkinterval = chrono::seconds(lrint(gps_fix_check_interval));
 
     if (gpsfix_needs_check() and time_last_check + checkinterval < time_now) {
         time_last_check = time_now;
 
-        // Alternate between launching task and checking the result.
-        if (gps_fix_future.valid()) {
-            if (not gps_fix_future.get()) {
-                if (num_checks_without_gps_fix == 0) {
-                    etiLog.level(alert) << "OutputUHD: GPS Time Lock lost";
-                }
-                num_checks_without_gps_fix++;
-            }
-            else {
-                if (num_checks_without_gps_fix) {
-                    etiLog.level(info) << "OutputUHD: GPS Time Lock recovered";
-                }
-                num_checks_without_gps_fix = 0;
+        // The caller is not the transmit thread, the sensor can be read
+        // directly.
+        const bool locked = gpsdo_is_ettus() ?
+            check_gps_locked() : check_gps_timelock();
+
+        if (not locked) {
+            if (num_checks_without_gps_fix == 0) {
+                etiLog.level(alert) << "OutputUHD: GPS Time Lock lost";
             }
+            num_checks_without_gps_fix++;
         }
         else {
-            // Checking the sensor here takes too much
-            // time, it has to be done in a separate thread.
-            if (gpsdo_is_ettus()) {
-                gps_fix_future = std::async(std::launch::async,
-                        std::bind(&USRPTime::check_gps_locked, this) );
-            }
-            else {
-                gps_fix_future = std::async(std::launch::async,
-                        std::bind(&USRPTime::check_gps_timelock, this) );
+            if (num_checks_without_gps_fix) {
+                etiLog.level(info) << "OutputUHD: GPS Time Lock recovered";
             }
+            num_checks_without_gps_fix = 0;
         }
     }
 }
@@ -276,6 +265,7 @@ bool USRPTime::check_gps_timelock()
         }
 
         const auto num_svs = (elems.size() > 7) ? elems[7] : "0";
+        std::lock_guard<std::mutex> lock(gnss_stats_mutex);
         gnss_stats.num_sv = std::stoi(num_svs);
 
         locked = (sensor_value.find("TIME LOCKED") != string::npos);
@@ -300,7 +290,10 @@ bool USRPTime::check_gps_timelock()
             e.what();
     }
 
-    gnss_stats.holdover = not locked;
+    {
+        std::lock_guard<std::mutex> lock(gnss_stats_mutex);
+        gnss_stats.holdover = not locked;
+    }
 
     return locked;
 }
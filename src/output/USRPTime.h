@@ -42,7 +42,7 @@ DESCRIPTION:
 #include <memory>
 #include <string>
 #include <atomic>
-#include <future>
+#include <mutex>
 
 #include "Log.h"
 #include "output/SDR.h"
@@ -67,7 +67,9 @@ class USRPTime {
         // Verifies the GPSDO state, that the device time is ok.
         // Returns true if all ok. Needs to be called so the device
         // time gets properly set.
-        // Should be called more often than the gps_fix_check_interval
+        // Should be called more often than the gps_fix_check_interval.
+        // Reads the sensors of the device, and can block for a while when
+        // it sets the time: UHD calls it from its clock monitor thread.
         bool verify_time(void);
 
         gnss_stats_t get_gnss_stats(void) const;
@@ -99,13 +101,13 @@ class USRPTime {
         gps_state_e gps_state = gps_state_e::bootup;
         int num_checks_without_gps_fix = 1;
 
+        // Written by verify_time(), read by get_gnss_stats()
+        mutable std::mutex gnss_stats_mutex;
         gnss_stats_t gnss_stats;
 
         using timepoint_t = std::chrono::time_point<std::chrono::steady_clock>;
         timepoint_t time_last_check;
 
-        std::future<bool> gps_fix_future;
-
         // Returns true if we want to check for the gps_timelock sensor
         bool gpsfix_needs_check(void) const;
 